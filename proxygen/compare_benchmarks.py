@@ -0,0 +1,267 @@
+#!/usr/bin/env python
+# @lint-avoid-python-3-compatibility-imports
+
+"""
+Records the results of the benchmarks as JSON baselines, one per commit and
+machine profile, and compares new runs against them.
+
+  ./compare_benchmarks.py record --build_dir=.
+  (change things, rebuild)
+  ./compare_benchmarks.py compare --build_dir=.
+
+Each benchmark is run --trials times. A metric keeps the median of its
+trials and their median absolute deviation (MAD), and moves between two
+runs only when the difference of the medians is larger than both
+--mad_factor times their combined MAD and --min_change of the baseline.
+compare exits with 1 if a metric regressed.
+
+The benchmarks are the binaries of SUITE, built by hand (they are not part
+of `make check`); those not built are skipped.
+"""
+
+import argparse
+import json
+import math
+import os
+import platform
+import re
+import subprocess
+import sys
+
+# (name, path relative to the build dir, arguments, output format)
+SUITE = [
+    ('codec', 'lib/http/codec/test/CodecBenchmark', ['--json'], 'folly'),
+    ('hpack_indexing', 'lib/http/codec/compress/test/HPACKIndexingBenchmark',
+     ['--json'], 'folly'),
+    ('huffman', 'lib/http/codec/compress/test/HuffmanBenchmark', ['--json'],
+     'folly'),
+    ('headers', 'lib/http/test/HTTPHeadersBenchmark', ['--json'], 'folly'),
+    ('rfc2616', 'lib/http/test/RFC2616Benchmark', ['--json'], 'folly'),
+    ('result', 'lib/utils/test/ResultBenchmark', ['--json'], 'folly'),
+    ('loopback', 'httpserver/tests/LoopbackBenchmark', [], 'loopback'),
+]
+
+# a MAD is this many standard deviations of a normal distribution
+MAD_TO_STDDEV = 1.4826
+
+ALLOCS_RE = re.compile(r'^(\S+)\s+([0-9.]+) allocs/op$')
+
+
+def metric(value, unit, lower_is_better=True):
+    return {'value': float(value), 'unit': unit,
+            'lower_is_better': lower_is_better}
+
+
+def parse_folly(output):
+    """
+    The {name: time/iter} object that folly::runBenchmarks() prints with
+    --json, and the allocs/op lines of CodecBenchmark
+    """
+    metrics = {}
+    start = output.find('{')
+    if start >= 0:
+        times, end = json.JSONDecoder().raw_decode(output[start:])
+        for name, value in times.items():
+            metrics[name] = metric(value, 'ns/iter')
+        output = output[start + end:]
+    for line in output.splitlines():
+        match = ALLOCS_RE.match(line.strip())
+        if match:
+            metrics[match.group(1) + ' allocs'] = metric(match.group(2),
+                                                         'allocs/op')
+    return metrics
+
+
+def parse_loopback(output):
+    """ The JSON object per configuration of LoopbackBenchmark """
+    metrics = {}
+    for line in output.splitlines():
+        line = line.strip()
+        if not line.startswith('{'):
+            continue
+        result = json.loads(line)
+        name = '%s/%sB/%dt' % (result['mode'], result['payload_bytes'],
+                               result['client_threads'])
+        metrics[name + ' rps'] = metric(result['requests_per_sec'], 'req/s',
+                                        lower_is_better=False)
+        for percentile in ('p50', 'p99'):
+            metrics['%s %s' % (name, percentile)] = metric(
+                result['latency_us'][percentile], 'us')
+    return metrics
+
+
+PARSERS = {'folly': parse_folly, 'loopback': parse_loopback}
+
+
+def median(values):
+    values = sorted(values)
+    middle = len(values) // 2
+    if len(values) % 2:
+        return values[middle]
+    return (values[middle - 1] + values[middle]) / 2.0
+
+
+def mad(values):
+    center = median(values)
+    return median([abs(value - center) for value in values])
+
+
+def run_suite(options):
+    """ @return {benchmark/metric: summary of its trials} """
+    samples = {}
+    for name, path, args, output_format in SUITE:
+        if options.only and name not in options.only:
+            continue
+        binary = os.path.join(options.build_dir, path)
+        if not os.access(binary, os.X_OK):
+            sys.stderr.write('skipping %s, %s is not built\n' % (name, binary))
+            continue
+        for trial in range(options.trials):
+            sys.stderr.write('%s: trial %d/%d\n' %
+                             (name, trial + 1, options.trials))
+            output = subprocess.check_output([binary] + args)
+            if not isinstance(output, str):
+                output = output.decode('utf-8')
+            for key, result in PARSERS[output_format](output).items():
+                entry = samples.setdefault(name + '/' + key, {
+                    'unit': result['unit'],
+                    'lower_is_better': result['lower_is_better'],
+                    'samples': []})
+                entry['samples'].append(result['value'])
+    for entry in samples.values():
+        entry['median'] = median(entry['samples'])
+        entry['mad'] = mad(entry['samples'])
+    return samples
+
+
+def git_commit():
+    commit = subprocess.check_output(
+        ['git', 'rev-parse', '--short', 'HEAD']).decode('utf-8').strip()
+    dirty = subprocess.call(['git', 'diff', '--quiet', 'HEAD'])
+    return commit + ('-dirty' if dirty else '')
+
+
+def machine_profile():
+    """ Host, CPU model and count: results only compare on one profile """
+    model = platform.machine()
+    try:
+        with open('/proc/cpuinfo') as cpuinfo:
+            for line in cpuinfo:
+                if line.startswith('model name'):
+                    model = line.split(':', 1)[1].strip()
+                    break
+    except IOError:
+        pass
+    profile = '%s-%s-%dcpu' % (platform.node(), model,
+                               os.sysconf('SC_NPROCESSORS_ONLN'))
+    return re.sub(r'[^A-Za-z0-9_.-]+', '_', profile)
+
+
+def baseline_path(options, commit):
+    return os.path.join(options.baseline_dir, options.profile,
+                        commit + '.json')
+
+
+def latest_baseline(options):
+    directory = os.path.join(options.baseline_dir, options.profile)
+    if not os.path.isdir(directory):
+        return None
+    paths = [os.path.join(directory, name) for name in os.listdir(directory)
+             if name.endswith('.json')]
+    return max(paths, key=os.path.getmtime) if paths else None
+
+
+def record(options):
+    commit = options.commit or git_commit()
+    results = {'commit': commit, 'profile': options.profile,
+               'trials': options.trials, 'benchmarks': run_suite(options)}
+    path = baseline_path(options, commit)
+    if not os.path.isdir(os.path.dirname(path)):
+        os.makedirs(os.path.dirname(path))
+    with open(path, 'w') as out:
+        json.dump(results, out, indent=2, sort_keys=True)
+    sys.stderr.write('recorded %s\n' % path)
+    return 0
+
+
+def compare(options):
+    if options.baseline:
+        path = baseline_path(options, options.baseline)
+    else:
+        path = latest_baseline(options)
+    if not path or not os.path.exists(path):
+        sys.stderr.write('no baseline for the profile %s in %s\n' %
+                         (options.profile, options.baseline_dir))
+        return 2
+    with open(path) as baseline_file:
+        baseline = json.load(baseline_file)['benchmarks']
+    if options.results:
+        with open(options.results) as results_file:
+            current = json.load(results_file)['benchmarks']
+    else:
+        current = run_suite(options)
+
+    regressions = 0
+    print('%-50s %12s %12s %8s  %s' %
+          ('benchmark', 'baseline', 'current', 'change', 'verdict'))
+    for key in sorted(set(baseline) | set(current)):
+        if key not in current or key not in baseline:
+            print('%-50s %s' % (key, 'only in the baseline' if key in baseline
+                                else 'new'))
+            continue
+        old, new = baseline[key], current[key]
+        delta = new['median'] - old['median']
+        noise = options.mad_factor * MAD_TO_STDDEV * math.sqrt(
+            old['mad'] ** 2 + new['mad'] ** 2)
+        threshold = max(noise, options.min_change * abs(old['median']))
+        change = delta / old['median'] if old['median'] else 0.0
+        if abs(delta) <= threshold:
+            verdict = ''
+        elif (delta > 0) == old['lower_is_better']:
+            verdict = 'REGRESSION'
+            regressions += 1
+        else:
+            verdict = 'improvement'
+        print('%-50s %12.2f %12.2f %+7.1f%%  %s' %
+              (key, old['median'], new['median'], change * 100, verdict))
+    print('%d regression(s) against %s' % (regressions, path))
+    return 1 if regressions else 0
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument('command', choices=['record', 'compare'])
+    parser.add_argument('--build_dir', default='.',
+                        help='Where the benchmarks were built')
+    parser.add_argument('--baseline_dir', default='benchmark_baselines',
+                        help='Where the baselines are kept')
+    parser.add_argument('--profile', default=machine_profile(),
+                        help='Machine profile of the baselines')
+    parser.add_argument('--commit', default=None,
+                        help='record: the commit to record as, by default '
+                        'the checked out one')
+    parser.add_argument('--baseline', default=None,
+                        help='compare: the commit to compare against, by '
+                        'default the last recorded')
+    parser.add_argument('--results', default=None,
+                        help='compare: a recorded run to compare instead of '
+                        'running the suite')
+    parser.add_argument('--only', action='append', default=[],
+                        help='Run only this benchmark of the suite, '
+                        'repeatable')
+    parser.add_argument('--trials', type=int, default=5,
+                        help='Runs of each benchmark')
+    parser.add_argument('--mad_factor', type=float, default=3.0,
+                        help='Changes within this many combined standard '
+                        'deviations, estimated from the MADs, are noise')
+    parser.add_argument('--min_change', type=float, default=0.02,
+                        help='And so are changes within this fraction of '
+                        'the baseline')
+    options = parser.parse_args(argv[1:])
+    if options.command == 'record':
+        return record(options)
+    return compare(options)
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
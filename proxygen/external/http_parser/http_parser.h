@@ -231,6 +231,11 @@ struct http_parser {
    */
   char upgrade : 1;
 
+  /* 1 = use SSE4.2 to skip over runs of plain URL, header name and header
+   * value bytes (see http_parser_set_fast_scan()).
+   */
+  unsigned char fast_scan : 1;
+
 #if HTTP_PARSER_DEBUG
   uint32_t error_lineno;
 #endif
@@ -312,6 +317,24 @@ int http_parser_parse_url(const char *buf, size_t buflen,
 /* Pause or un-pause the parser; a nonzero value pauses */
 void http_parser_pause(http_parser *parser, int paused);
 
+/* Enable or disable vectorized scanning of the request line and headers. It
+ * is only turned on if the CPU supports SSE4.2; returns nonzero if it is
+ * enabled. Callbacks are invoked exactly as with the scalar parser.
+ */
+int http_parser_set_fast_scan(http_parser *parser, int enabled);
+
+/* Nonzero if the CPU has what the vectorized scanning needs */
+int http_parser_fast_scan_supported(void);
+
+/* The vectorized scanner, for the other validators of HTTP bytes. Returns
+ * the number of leading bytes of [p, end) that fall inside the inclusive
+ * byte ranges: ranges_len bytes, at most 16, of pairs in a 16-byte aligned
+ * buffer. Only whole 16-byte blocks are examined, so the caller finishes
+ * with a scalar loop; only call it if http_parser_fast_scan_supported().
+ */
+size_t http_parser_count_in_ranges(const char *p, const char *end,
+                                   const char *ranges, int ranges_len);
+
 #if __cplusplus
 }
 #endif /* __cplusplus */
@@ -269,6 +269,99 @@ static const uint8_t normal_url_char[256] = {
 
 #undef T
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HTTP_PARSER_HAVE_SSE42_SCAN 1
+
+/* Byte ranges (inclusive pairs) for the vectorized scanners below. They are
+ * padded to 16 bytes since the whole vector is loaded. The scanners only
+ * skip over bytes that are certainly valid in the current state; whatever
+ * byte they stop on is handled by the regular state machine.
+ */
+static const char token_ranges[16] __attribute__((aligned(16))) =
+  /* mirrors tokens[] */
+  "\x20\x27\x2a\x2b\x2d\x39\x41\x5a\x5e\x7a\x7c\x7e";
+#define TOKEN_RANGES_LEN 12
+
+static const char url_ranges[16] __attribute__((aligned(16))) =
+#if HTTP_PARSER_STRICT
+  "\x21\x22\x24\x3e\x40\x7e";
+#define URL_RANGES_LEN 6
+#else
+  "\x21\x22\x24\x3e\x40\x7e\x80\xff";
+#define URL_RANGES_LEN 8
+#endif
+
+static const char value_stops[16] __attribute__((aligned(16))) = "\r\n\"";
+#define VALUE_STOPS_LEN 3
+
+/* Returns the number of leading bytes of [p, end) that fall inside the
+ * byte ranges in `ranges`. Only whole 16-byte blocks are examined, so the
+ * result can stop short of the first out-of-range byte near the end of the
+ * buffer.
+ */
+__attribute__((target("sse4.2")))
+static size_t sse42_count_in_ranges(const char *p, const char *end,
+                                    const char *ranges, int ranges_len)
+{
+  const __m128i r = _mm_load_si128((const __m128i *) ranges);
+  const char *start = p;
+  while (end - p >= 16) {
+    const __m128i b = _mm_loadu_si128((const __m128i *) p);
+    int idx = _mm_cmpestri(r, ranges_len, b, 16,
+                           _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                           _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+    if (idx != 16) {
+      return (p - start) + idx;
+    }
+    p += 16;
+  }
+  return p - start;
+}
+
+/* Returns the number of leading bytes of [p, end) that are none of the
+ * bytes in `stops`, with the same whole-block caveat as above.
+ */
+__attribute__((target("sse4.2")))
+static size_t sse42_count_until_any(const char *p, const char *end,
+                                    const char *stops, int stops_len)
+{
+  const __m128i s = _mm_load_si128((const __m128i *) stops);
+  const char *start = p;
+  while (end - p >= 16) {
+    const __m128i b = _mm_loadu_si128((const __m128i *) p);
+    int idx = _mm_cmpestri(s, stops_len, b, 16,
+                           _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                           _SIDD_LEAST_SIGNIFICANT);
+    if (idx != 16) {
+      return (p - start) + idx;
+    }
+    p += 16;
+  }
+  return p - start;
+}
+
+/* Skip ahead over the bytes after the current one at `p` while they are in
+ * the ranges; the loop increment then lands on the first byte that needs
+ * the full state machine.
+ */
+#define FAST_SCAN_RANGES(ranges, n) do {                                  \
+  if (parser->fast_scan && data + len - p > 16) {                         \
+    p += sse42_count_in_ranges(p + 1, data + len, ranges, n);             \
+  }                                                                       \
+} while (0)
+
+#define FAST_SCAN_UNTIL(stops, n) do {                                    \
+  if (parser->fast_scan && data + len - p > 16) {                         \
+    p += sse42_count_until_any(p + 1, data + len, stops, n);              \
+  }                                                                       \
+} while (0)
+#else
+#define HTTP_PARSER_HAVE_SSE42_SCAN 0
+#define FAST_SCAN_RANGES(ranges, n)
+#define FAST_SCAN_UNTIL(stops, n)
+#endif
+
 enum state
   { s_dead = 1 /* important that this is > 0 */
   , s_pre_start_req_or_res
@@ -1137,7 +1230,10 @@ size_t http_parser_execute (http_parser *parser,
 
       case s_req_path:
       {
-        if (IS_URL_CHAR(ch)) break;
+        if (IS_URL_CHAR(ch)) {
+          FAST_SCAN_RANGES(url_ranges, URL_RANGES_LEN);
+          break;
+        }
 
         switch (ch) {
           case ' ':
@@ -1207,7 +1303,10 @@ size_t http_parser_execute (http_parser *parser,
 
       case s_req_query_string:
       {
-        if (IS_URL_CHAR(ch)) break;
+        if (IS_URL_CHAR(ch)) {
+          FAST_SCAN_RANGES(url_ranges, URL_RANGES_LEN);
+          break;
+        }
 
         switch (ch) {
           case '?':
@@ -1481,6 +1580,12 @@ size_t http_parser_execute (http_parser *parser,
         if (c) {
           switch (parser->header_state) {
             case h_general:
+#if HTTP_PARSER_HAVE_SSE42_SCAN
+              if (parser->fast_scan) {
+                FAST_SCAN_RANGES(token_ranges, TOKEN_RANGES_LEN);
+                break;
+              }
+#endif
 
               // fast-forwarding, wheeeeeee!
               #define MOVE_THE_HEAD do { \
@@ -1647,6 +1752,12 @@ size_t http_parser_execute (http_parser *parser,
             if (ch == QT) {
               parser->header_state = h_general_and_quote;
             }
+#if HTTP_PARSER_HAVE_SSE42_SCAN
+            else if (parser->fast_scan) {
+              FAST_SCAN_UNTIL(value_stops, VALUE_STOPS_LEN);
+              break;
+            }
+#endif
 
             // fast-forwarding, wheee!
             #define MOVE_FAST do {                    \
@@ -2109,6 +2220,39 @@ http_parser_init (http_parser *parser, enum http_parser_type t)
   parser->flags = 0;
   parser->method = 0;
   parser->http_errno = HPE_OK;
+  parser->fast_scan = 0;
+}
+
+int
+http_parser_set_fast_scan(http_parser *parser, int enabled)
+{
+  parser->fast_scan = enabled && http_parser_fast_scan_supported();
+  return parser->fast_scan;
+}
+
+int
+http_parser_fast_scan_supported(void)
+{
+#if HTTP_PARSER_HAVE_SSE42_SCAN
+  /* __builtin_cpu_init() first, in case this runs from a static
+   * initializer before the one of libgcc */
+  static const int supported =
+    (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+  return supported;
+#else
+  return 0;
+#endif
+}
+
+size_t
+http_parser_count_in_ranges(const char *p, const char *end,
+                            const char *ranges, int ranges_len)
+{
+#if HTTP_PARSER_HAVE_SSE42_SCAN
+  return sse42_count_in_ranges(p, end, ranges, ranges_len);
+#else
+  return 0;
+#endif
 }
 
 const char *
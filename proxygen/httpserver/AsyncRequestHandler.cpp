@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/AsyncRequestHandler.h>
+
+#include <exception>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+namespace proxygen {
+
+const size_t AsyncRequestHandler::kDefaultMaxBodySize;
+
+AsyncRequestHandler::AsyncRequestHandler(CPUExecutor* executor,
+                                         size_t maxBodySize):
+    executor_(CHECK_NOTNULL(executor)),
+    maxBodySize_(maxBodySize) {
+}
+
+void AsyncRequestHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  request_ = std::move(headers);
+}
+
+void AsyncRequestHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
+  if (rejected_) {
+    return;
+  }
+  body_.append(std::move(body));
+  if (body_.chainLength() > maxBodySize_) {
+    rejected_ = true;
+    body_.move();
+    ResponseBuilder(downstream_)
+      .status(413, "Request Entity Too Large")
+      .closeConnection()
+      .sendWithEOM();
+  }
+}
+
+void AsyncRequestHandler::onEOM() noexcept {
+  if (rejected_) {
+    return;
+  }
+  auto evb = folly::EventBaseManager::get()->getEventBase();
+  running_ = true;
+  // the request and body move into the task, which is destroyed on the
+  // executor thread once it has run
+  auto request = std::make_shared<std::unique_ptr<HTTPMessage>>(
+    std::move(request_));
+  auto body = std::make_shared<std::unique_ptr<folly::IOBuf>>(body_.move());
+  executor_->add(evb, [this, request, body] () -> CPUExecutor::Callback {
+      auto response = std::make_shared<Response>();
+      try {
+        *response = handleRequest(std::move(*request), std::move(*body));
+      } catch (const std::exception& ex) {
+        LOG(ERROR) << "handleRequest threw: " << ex.what();
+        *response = Response();
+        response->status = 500;
+        response->message = "Internal Server Error";
+      }
+      return [this, response] {
+        running_ = false;
+        if (finished_) {
+          delete this;
+        } else {
+          sendResponse(std::move(*response));
+        }
+      };
+    });
+}
+
+void AsyncRequestHandler::requestComplete() noexcept {
+  finish();
+}
+
+void AsyncRequestHandler::onError(ProxygenError err) noexcept {
+  finish();
+}
+
+void AsyncRequestHandler::sendResponse(Response response) {
+  ResponseBuilder builder(downstream_);
+  builder.status(response.status, response.message);
+  for (auto& header: response.headers) {
+    builder.header(header.first, header.second);
+  }
+  builder
+    .body(std::move(response.body))
+    .sendWithEOM();
+}
+
+void AsyncRequestHandler::finish() {
+  finished_ = true;
+  if (!running_) {
+    delete this;
+  }
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/lib/utils/CPUExecutor.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Base for handlers that do CPU heavy or blocking work. It collects the
+ * request, hands it to handleRequest() on a thread of a CPUExecutor, and
+ * sends the Response it returns from the thread of the EventBase, so
+ * that the other connections of that thread aren't held up meanwhile.
+ *
+ * handleRequest() must not touch downstream_, or anything else that
+ * belongs to the EventBase thread. The handler stays alive until
+ * handleRequest() returns, even if the client goes away before.
+ */
+class AsyncRequestHandler : public RequestHandler {
+ public:
+  static const size_t kDefaultMaxBodySize = 1024 * 1024;
+
+  struct Response {
+    uint16_t status{200};
+    std::string message{"OK"};
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::unique_ptr<folly::IOBuf> body;
+  };
+
+  /**
+   * executor must outlive the handler. Requests with bodies larger than
+   * maxBodySize get a 413.
+   */
+  explicit AsyncRequestHandler(CPUExecutor* executor,
+                               size_t maxBodySize = kDefaultMaxBodySize);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override;
+
+  void onError(ProxygenError err) noexcept override;
+
+ protected:
+  /**
+   * Build the response to request, on a thread of the executor. Any
+   * exception becomes a 500.
+   */
+  virtual Response handleRequest(std::unique_ptr<HTTPMessage> request,
+                                 std::unique_ptr<folly::IOBuf> body) = 0;
+
+ private:
+  void sendResponse(Response response);
+  void finish();
+
+  CPUExecutor* const executor_;
+  const size_t maxBodySize_;
+  std::unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool rejected_{false};
+  // handleRequest() is running
+  bool running_{false};
+  // the transaction is gone
+  bool finished_{false};
+};
+
+}
@@ -0,0 +1,186 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/BatchHandler.h>
+
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+using folly::IOBuf;
+
+namespace proxygen {
+
+const size_t BatchHandlerFactory::kDefaultMaxBatchSize;
+const size_t BatchHandlerFactory::kDefaultMaxBodySize;
+
+void BatchHandler::Request::respond(uint16_t code,
+                                    const std::string& message,
+                                    std::unique_ptr<IOBuf> body) {
+  if (!downstream_) {
+    return;
+  }
+  auto downstream = downstream_;
+  downstream_ = nullptr;
+  ResponseBuilder(downstream)
+    .status(code, message)
+    .body(std::move(body))
+    .sendWithEOM();
+}
+
+/**
+ * The batch of a handler thread, with the loop callback that dispatches
+ * it
+ */
+class BatchHandlerFactory::Dispatcher :
+      public folly::EventBase::LoopCallback {
+ public:
+  Dispatcher(std::unique_ptr<BatchHandler> handler,
+             folly::EventBase* eventBase,
+             size_t maxBatchSize):
+      handler_(std::move(handler)),
+      eventBase_(eventBase),
+      maxBatchSize_(maxBatchSize) {
+  }
+
+  void add(std::shared_ptr<BatchHandler::Request> request) {
+    batch_.push_back(std::move(request));
+    if (batch_.size() >= maxBatchSize_) {
+      cancelLoopCallback();
+      dispatch();
+    } else if (!isLoopCallbackScheduled()) {
+      eventBase_->runInLoop(this);
+    }
+  }
+
+  void runLoopCallback() noexcept override {
+    dispatch();
+  }
+
+ private:
+  void dispatch() {
+    BatchHandler::Batch batch;
+    batch.reserve(batch_.size());
+    for (auto& request: batch_) {
+      // the clients that went away since don't get into the batch
+      if (!request->isDone()) {
+        batch.push_back(std::move(request));
+      }
+    }
+    batch_.clear();
+    if (!batch.empty()) {
+      handler_->onBatch(std::move(batch));
+    }
+  }
+
+  std::unique_ptr<BatchHandler> handler_;
+  folly::EventBase* const eventBase_;
+  const size_t maxBatchSize_;
+  BatchHandler::Batch batch_;
+};
+
+/**
+ * The handler of one transaction, which collects its request and adds it
+ * to the batch
+ */
+class BatchHandlerFactory::Handler : public RequestHandler {
+ public:
+  Handler(Dispatcher* dispatcher, size_t maxBodySize):
+      dispatcher_(dispatcher),
+      maxBodySize_(maxBodySize) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override {
+    request_.reset(new BatchHandler::Request(std::move(headers)));
+  }
+
+  void onBody(std::unique_ptr<IOBuf> body) noexcept override {
+    if (rejected_) {
+      return;
+    }
+    body_.append(std::move(body));
+    if (body_.chainLength() > maxBodySize_) {
+      rejected_ = true;
+      body_.move();
+      ResponseBuilder(downstream_)
+        .status(413, "Request Entity Too Large")
+        .closeConnection()
+        .sendWithEOM();
+      // the connection closes after the response, no need to read the rest
+      downstream_->pauseIngress();
+    }
+  }
+
+  void onUpgrade(UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override {
+    if (rejected_) {
+      return;
+    }
+    request_->body_ = body_.move();
+    request_->downstream_ = downstream_;
+    dispatcher_->add(request_);
+  }
+
+  void requestComplete() noexcept override {
+    finish();
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    finish();
+  }
+
+ private:
+  void finish() {
+    if (request_) {
+      request_->downstream_ = nullptr;
+    }
+    delete this;
+  }
+
+  Dispatcher* const dispatcher_;
+  const size_t maxBodySize_;
+  std::shared_ptr<BatchHandler::Request> request_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool rejected_{false};
+};
+
+BatchHandlerFactory::BatchHandlerFactory(
+  std::function<std::unique_ptr<BatchHandler>()> makeHandler,
+  size_t maxBatchSize,
+  size_t maxBodySize):
+    makeHandler_(std::move(makeHandler)),
+    maxBatchSize_(maxBatchSize),
+    maxBodySize_(maxBodySize) {
+  CHECK(makeHandler_);
+  CHECK_GT(maxBatchSize_, 0);
+}
+
+BatchHandlerFactory::~BatchHandlerFactory() {
+}
+
+void BatchHandlerFactory::onServerStart() noexcept {
+  dispatcher_.reset(new Dispatcher(makeHandler_(),
+                                   folly::EventBaseManager::get()
+                                     ->getEventBase(),
+                                   maxBatchSize_));
+}
+
+void BatchHandlerFactory::onServerStop() noexcept {
+  // the sessions drained, nobody waits for a batch not dispatched yet
+  dispatcher_.reset();
+}
+
+RequestHandler* BatchHandlerFactory::onRequest(RequestHandler*,
+                                               HTTPMessage*) noexcept {
+  return new Handler(dispatcher_.get(), maxBodySize_);
+}
+
+}
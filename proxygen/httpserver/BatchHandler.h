@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <memory>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+class BatchHandlerFactory;
+
+/**
+ * Handler that gets its requests in batches rather than one at a time,
+ * for workloads of many tiny requests, such as key/value lookups over
+ * HTTP, where the backend can do a whole batch at the cost of one
+ * lookup. See BatchHandlerFactory.
+ */
+class BatchHandler {
+ public:
+  /**
+   * A complete request, with its whole body, and the way to answer it
+   */
+  class Request {
+   public:
+    const HTTPMessage& getMessage() const {
+      return *message_;
+    }
+
+    /**
+     * @return the body buffers, nullptr if there are none
+     */
+    const folly::IOBuf* getBody() const {
+      return body_.get();
+    }
+
+    /**
+     * @return true once the transaction is gone, the client went away or
+     *         the response was sent
+     */
+    bool isDone() const {
+      return !downstream_;
+    }
+
+    /**
+     * @return where to send a response of one's own, e.g. with a
+     *         ResponseBuilder; nullptr once done
+     */
+    ResponseHandler* getResponseHandler() const {
+      return downstream_;
+    }
+
+    /**
+     * Send the whole response, unless the request is done
+     */
+    void respond(uint16_t code, const std::string& message,
+                 std::unique_ptr<folly::IOBuf> body = nullptr);
+
+   private:
+    friend class BatchHandlerFactory;
+
+    explicit Request(std::unique_ptr<HTTPMessage> message):
+        message_(std::move(message)) {}
+
+    std::unique_ptr<HTTPMessage> message_;
+    std::unique_ptr<folly::IOBuf> body_;
+    ResponseHandler* downstream_{nullptr};
+  };
+
+  /**
+   * Shared with the transactions, so that a request can be answered after
+   * onBatch() returns, from a callback of the backend; a done request just
+   * drops its response
+   */
+  typedef std::vector<std::shared_ptr<Request>> Batch;
+
+  virtual ~BatchHandler() {}
+
+  /**
+   * Invoked in the EventBase thread with the requests that completed in
+   * one iteration of its loop, in the order they completed, none of them
+   * done
+   */
+  virtual void onBatch(Batch batch) noexcept = 0;
+};
+
+/**
+ * Collects the requests of each handler thread as they complete, and
+ * hands them to the thread's BatchHandler together, from a loop callback
+ * at the end of the loop iteration that read them. The sessions write
+ * out what the responses sent then in one pass, at the end of the
+ * iteration as well, so a batch answered right away costs one write per
+ * connection whatever its size.
+ *
+ * A batch reaching maxBatchSize goes right away. Requests with bodies
+ * larger than maxBodySize get a 413 and are not batched.
+ */
+class BatchHandlerFactory : public RequestHandlerFactory {
+ public:
+  static const size_t kDefaultMaxBatchSize = 256;
+  static const size_t kDefaultMaxBodySize = 64 * 1024;
+
+  /**
+   * @param makeHandler   called in each handler thread as the server
+   *                      starts, for the handler of that thread
+   */
+  explicit BatchHandlerFactory(
+    std::function<std::unique_ptr<BatchHandler>()> makeHandler,
+    size_t maxBatchSize = kDefaultMaxBatchSize,
+    size_t maxBodySize = kDefaultMaxBodySize);
+  ~BatchHandlerFactory();
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override;
+
+ private:
+  class Dispatcher;
+  class Handler;
+
+  const std::function<std::unique_ptr<BatchHandler>()> makeHandler_;
+  const size_t maxBatchSize_;
+  const size_t maxBodySize_;
+  folly::ThreadLocalPtr<Dispatcher> dispatcher_;
+};
+
+}
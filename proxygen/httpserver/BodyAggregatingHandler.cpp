@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/BodyAggregatingHandler.h>
+
+#include <folly/Conv.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+using folly::IOBuf;
+
+namespace proxygen {
+
+const size_t BodyAggregatingHandler::kDefaultMaxBodySize;
+
+BodyAggregatingHandler::Body::Body(std::unique_ptr<IOBuf> chain)
+    : chain_(std::move(chain)),
+      size_(chain_ ? chain_->computeChainDataLength() : 0) {
+}
+
+folly::ByteRange BodyAggregatingHandler::Body::getContiguous() {
+  if (!chain_) {
+    return folly::ByteRange();
+  }
+  if (chain_->isChained()) {
+    chain_->coalesce();
+  }
+  return folly::ByteRange(chain_->data(), chain_->length());
+}
+
+BodyAggregatingHandler::BodyAggregatingHandler(size_t maxBodySize)
+    : maxBodySize_(maxBodySize) {
+}
+
+void BodyAggregatingHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  request_ = std::move(headers);
+  const auto& contentLength =
+    request_->getHeaders().getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH);
+  if (!contentLength.empty()) {
+    try {
+      if (folly::to<uint64_t>(contentLength) > maxBodySize_) {
+        reject();
+      }
+    } catch (const std::range_error&) {
+      // the codec rejects bad lengths, the body will tell
+    }
+  }
+}
+
+void BodyAggregatingHandler::onBody(std::unique_ptr<IOBuf> body) noexcept {
+  if (rejected_) {
+    return;
+  }
+  body_.append(std::move(body));
+  if (body_.chainLength() > maxBodySize_) {
+    reject();
+  }
+}
+
+void BodyAggregatingHandler::onEOM() noexcept {
+  if (rejected_) {
+    return;
+  }
+  onRequestBody(std::move(request_), Body(body_.move()));
+}
+
+void BodyAggregatingHandler::reject() {
+  rejected_ = true;
+  body_.move();
+  ResponseBuilder(downstream_)
+    .status(413, "Request Entity Too Large")
+    .closeConnection()
+    .sendWithEOM();
+  // the connection closes after the response, no need to read the rest
+  downstream_->pauseIngress();
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/RequestHandler.h>
+
+namespace proxygen {
+
+/**
+ * Base for handlers that need the whole request body. The body buffers
+ * are chained as they come, without copies, and onRequestBody() gets the
+ * request with the chain once the body is complete.
+ *
+ * A request whose Content-Length, or whose body so far, is past
+ * maxBodySize gets a 413 right away, and the rest of its body isn't read.
+ */
+class BodyAggregatingHandler : public RequestHandler {
+ public:
+  static const size_t kDefaultMaxBodySize = 1024 * 1024;
+
+  /**
+   * A complete request body
+   */
+  class Body {
+   public:
+    Body() {}
+
+    explicit Body(std::unique_ptr<folly::IOBuf> chain);
+
+    size_t size() const {
+      return size_;
+    }
+
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    /**
+     * @return the body buffers, nullptr if there are none
+     */
+    const folly::IOBuf* getChain() const {
+      return chain_.get();
+    }
+
+    std::unique_ptr<folly::IOBuf> moveChain() {
+      size_ = 0;
+      return std::move(chain_);
+    }
+
+    /**
+     * @return the body as contiguous bytes. The first call coalesces the
+     *         chain if it has several buffers, the only time the body is
+     *         copied.
+     */
+    folly::ByteRange getContiguous();
+
+    folly::StringPiece getStringPiece() {
+      auto range = getContiguous();
+      return folly::StringPiece((const char*)range.data(), range.size());
+    }
+
+   private:
+    std::unique_ptr<folly::IOBuf> chain_;
+    size_t size_{0};
+  };
+
+  explicit BodyAggregatingHandler(size_t maxBodySize = kDefaultMaxBodySize);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override {
+    delete this;
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    delete this;
+  }
+
+ protected:
+  /**
+   * Invoked with the request and its whole body, in the place of onEOM()
+   */
+  virtual void onRequestBody(std::unique_ptr<HTTPMessage> request,
+                             Body body) noexcept = 0;
+
+ private:
+  void reject();
+
+  const size_t maxBodySize_;
+  std::unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool rejected_{false};
+};
+
+}
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/ConnectionBalancer.h>
+
+#include <algorithm>
+#include <folly/Foreach.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <proxygen/httpserver/HTTPServerAcceptor.h>
+#include <unistd.h>
+
+using folly::SocketAddress;
+
+namespace proxygen {
+
+ConnectionBalancer::ConnectionBalancer(
+    HTTPServerOptions::Balancing balancing,
+    std::vector<HTTPServerAcceptor*> acceptors,
+    folly::AsyncServerSocket* socket,
+    uint32_t groupSize)
+    : balancing_(balancing),
+      acceptors_(std::move(acceptors)),
+      socket_(socket),
+      groupSize_(std::max(groupSize, 1u)),
+      pending_(acceptors_.size()) {
+  CHECK(!acceptors_.empty());
+}
+
+ConnectionBalancer::~ConnectionBalancer() {
+  for (auto& batch: pending_) {
+    for (auto& connection: batch) {
+      close(connection.first);
+    }
+  }
+}
+
+uint64_t ConnectionBalancer::getLoad(size_t index) const {
+  const HTTPServerAcceptor* acceptor = acceptors_[index];
+  switch (balancing_) {
+    case HTTPServerOptions::Balancing::LEAST_CONNECTIONS:
+      // plus the ones of this iteration, not dispatched yet
+      return acceptor->getActiveConnections() + pending_[index].size();
+    case HTTPServerOptions::Balancing::LEAST_LOOP_LAG:
+      return acceptor->getLoopLag().count();
+    case HTTPServerOptions::Balancing::ROUND_ROBIN:
+      break;
+  }
+  return 0;
+}
+
+size_t ConnectionBalancer::pickAcceptor() {
+  size_t best = next_;
+  uint64_t bestLoad = getLoad(best);
+  for (size_t i = 1; i < acceptors_.size() && bestLoad > 0; ++i) {
+    size_t index = (next_ + i) % acceptors_.size();
+    uint64_t load = getLoad(index);
+    if (load < bestLoad) {
+      best = index;
+      bestLoad = load;
+    }
+  }
+  next_ = (best + 1) % acceptors_.size();
+  return best;
+}
+
+void ConnectionBalancer::connectionAccepted(
+    int fd, const SocketAddress& clientAddr) noexcept {
+  numAccepted_.fetch_add(1, std::memory_order_relaxed);
+  if (groupLeft_ == 0) {
+    groupAcceptor_ = pickAcceptor();
+    groupLeft_ = groupSize_;
+  }
+  --groupLeft_;
+  size_t index = groupAcceptor_;
+  VLOG(5) << "Dispatching connection from " << clientAddr << " to acceptor "
+          << index << " with " << acceptors_[index]->getActiveConnections()
+          << " connections, loop lag "
+          << acceptors_[index]->getLoopLag().count() << "ms";
+  if (socket_) {
+    pending_[index].emplace_back(fd, clientAddr);
+    if (numPending_++ == 0) {
+      socket_->getEventBase()->runInLoop(this);
+    }
+    return;
+  }
+  if (!acceptors_[index]->dispatchConnection(fd, clientAddr)) {
+    LOG(ERROR) << "Failed to dispatch connection from " << clientAddr;
+    close(fd);
+  }
+}
+
+void ConnectionBalancer::runLoopCallback() noexcept {
+  numBatches_.fetch_add(1, std::memory_order_relaxed);
+  if (numPending_ >= socket_->getMaxAcceptAtOnce()) {
+    numBudgetExhausted_.fetch_add(1, std::memory_order_relaxed);
+  }
+  numPending_ = 0;
+  // the next batch picks afresh
+  groupLeft_ = 0;
+  FOR_EACH_RANGE (i, 0, pending_.size()) {
+    auto& batch = pending_[i];
+    if (batch.empty()) {
+      continue;
+    }
+    if (!acceptors_[i]->dispatchConnections(batch)) {
+      LOG(ERROR) << "Failed to dispatch " << batch.size()
+                 << " connections to acceptor " << i;
+      for (auto& connection: batch) {
+        close(connection.first);
+      }
+      batch.clear();
+    }
+  }
+  sampleQueue();
+}
+
+void ConnectionBalancer::sampleQueue() {
+  for (int fd: socket_->getSockets()) {
+    // for a listening socket, the length of its accept queue and the
+    // backlog
+    tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+      continue;
+    }
+    if (info.tcpi_unacked > maxQueueLength_.load(std::memory_order_relaxed)) {
+      maxQueueLength_.store(info.tcpi_unacked, std::memory_order_relaxed);
+    }
+    backlog_.store(info.tcpi_sacked, std::memory_order_relaxed);
+    if (info.tcpi_sacked > 0 && info.tcpi_unacked >= info.tcpi_sacked) {
+      numQueueOverflows_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+ConnectionBalancer::AcceptStats ConnectionBalancer::getAcceptStats() const {
+  AcceptStats stats;
+  stats.accepted = numAccepted_.load(std::memory_order_relaxed);
+  stats.batches = numBatches_.load(std::memory_order_relaxed);
+  stats.budgetExhausted = numBudgetExhausted_.load(std::memory_order_relaxed);
+  stats.queueOverflows = numQueueOverflows_.load(std::memory_order_relaxed);
+  stats.maxQueueLength = maxQueueLength_.load(std::memory_order_relaxed);
+  stats.backlog = backlog_.load(std::memory_order_relaxed);
+  stats.acceptErrors = numAcceptErrors_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ConnectionBalancer::acceptError(const std::exception& ex) noexcept {
+  numAcceptErrors_.fetch_add(1, std::memory_order_relaxed);
+  LOG(ERROR) << "Error accepting connection: " << ex.what();
+}
+
+void ConnectionBalancer::acceptStopped() noexcept {
+  if (numPending_ > 0) {
+    cancelLoopCallback();
+    runLoopCallback();
+  }
+  // The acceptors aren't registered with the socket, tell them here so that
+  // they drain their connections
+  for (auto acceptor: acceptors_) {
+    acceptor->dispatchAcceptStopped();
+  }
+}
+
+}
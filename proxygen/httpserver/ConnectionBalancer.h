@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <proxygen/httpserver/HTTPServerOptions.h>
+#include <utility>
+#include <vector>
+
+namespace proxygen {
+
+class HTTPServerAcceptor;
+
+/**
+ * Accepts the connections of one listening socket in the socket's own
+ * EventBase, and hands each of them to the least loaded of the acceptors
+ * of that address, one per handler thread. With ROUND_ROBIN, the acceptors
+ * just take turns. Ties go to the acceptor after the last one picked, so
+ * that idle threads also share the connections.
+ *
+ * Given the listening socket, the connections accepted in one iteration of
+ * its loop are held until the end of the iteration, and handed over
+ * together, groupSize consecutive ones to the same acceptor, and with one
+ * wakeup per acceptor. The balancer also keeps the accept stats of the
+ * socket then.
+ */
+class ConnectionBalancer : public folly::AsyncServerSocket::AcceptCallback,
+                           private folly::EventBase::LoopCallback {
+ public:
+  struct AcceptStats {
+    uint64_t accepted{0};
+    // the loop iterations that accepted connections
+    uint64_t batches{0};
+    // the iterations that accepted as many as the accept budget of the
+    // socket, leaving connections in its queue
+    uint64_t budgetExhausted{0};
+    // the times the accept queue was seen full, the kernel then drops the
+    // new connections
+    uint64_t queueOverflows{0};
+    // the longest accept queue seen, and its capacity
+    uint32_t maxQueueLength{0};
+    uint32_t backlog{0};
+    uint64_t acceptErrors{0};
+  };
+
+  ConnectionBalancer(HTTPServerOptions::Balancing balancing,
+                     std::vector<HTTPServerAcceptor*> acceptors,
+                     folly::AsyncServerSocket* socket = nullptr,
+                     uint32_t groupSize = 1);
+  ~ConnectionBalancer();
+
+  /**
+   * @return the index of the acceptor the next connection goes to
+   */
+  size_t pickAcceptor();
+
+  HTTPServerAcceptor* getAcceptor(size_t index) const {
+    return acceptors_[index];
+  }
+
+  // AsyncServerSocket::AcceptCallback
+  void connectionAccepted(int fd, const folly::SocketAddress& clientAddr)
+    noexcept override;
+  void acceptError(const std::exception& ex) noexcept override;
+  void acceptStopped() noexcept override;
+
+  /**
+   * May be called from any thread
+   */
+  AcceptStats getAcceptStats() const;
+
+ private:
+  uint64_t getLoad(size_t index) const;
+
+  // LoopCallback methods, hand the batches over
+  void runLoopCallback() noexcept override;
+
+  // record the accept queue of the socket
+  void sampleQueue();
+
+  const HTTPServerOptions::Balancing balancing_;
+  const std::vector<HTTPServerAcceptor*> acceptors_;
+  folly::AsyncServerSocket* const socket_;
+  const uint32_t groupSize_;
+  size_t next_{0};
+
+  // the connections of this loop iteration, per acceptor
+  std::vector<std::vector<std::pair<int, folly::SocketAddress>>> pending_;
+  size_t numPending_{0};
+  size_t groupAcceptor_{0};
+  uint32_t groupLeft_{0};
+
+  std::atomic<uint64_t> numAccepted_{0};
+  std::atomic<uint64_t> numBatches_{0};
+  std::atomic<uint64_t> numBudgetExhausted_{0};
+  std::atomic<uint64_t> numQueueOverflows_{0};
+  std::atomic<uint32_t> maxQueueLength_{0};
+  std::atomic<uint32_t> backlog_{0};
+  std::atomic<uint64_t> numAcceptErrors_{0};
+};
+
+}
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/DrainScheduler.h>
+
+#include <algorithm>
+#include <folly/Random.h>
+
+using folly::wangle::ManagedConnection;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+DrainScheduler::DrainScheduler(folly::TimeoutManager* timeoutManager,
+                               milliseconds window,
+                               double jitter,
+                               std::function<void()> done)
+    : folly::AsyncTimeout(timeoutManager),
+      window_(std::max(window, milliseconds(0))),
+      jitter_(std::min(std::max(jitter, 0.0), 1.0)),
+      done_(std::move(done)) {
+}
+
+void DrainScheduler::start(
+    std::vector<std::pair<ManagedConnection*, uint32_t>> connections) {
+  CHECK(!started_);
+  started_ = true;
+  std::stable_sort(connections.begin(), connections.end(),
+                   [] (const std::pair<ManagedConnection*, uint32_t>& a,
+                       const std::pair<ManagedConnection*, uint32_t>& b) {
+                     return a.second < b.second;
+                   });
+
+  const size_t count = connections.size();
+  total_ = count;
+  remaining_ = count;
+  const TimePoint now = getCurrentTime();
+  const double slot = count ?
+    double(microseconds(window_).count()) / count : 0;
+  turns_.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    // within the connection's own slot, so that turns_ stays in order
+    double offset = slot * (i + jitter_ * (folly::Random::rand32() /
+                                           4294967296.0));
+    turns_.push_back({now + microseconds(uint64_t(offset)),
+                      connections[i].first});
+    pending_[connections[i].first] = i;
+  }
+  VLOG(3) << "Draining " << count << " connections over "
+          << window_.count() << "ms";
+  scheduleNext();
+  checkDone();
+}
+
+void DrainScheduler::remove(ManagedConnection* connection) {
+  auto it = pending_.find(connection);
+  if (it != pending_.end()) {
+    turns_[it->second].connection = nullptr;
+    pending_.erase(it);
+    --remaining_;
+    checkDone();
+  } else if (notified_.erase(connection)) {
+    --remaining_;
+  }
+}
+
+DrainScheduler::Progress DrainScheduler::getProgress() const {
+  Progress progress;
+  progress.total = total_.load(std::memory_order_relaxed);
+  progress.notified = notifiedCount_.load(std::memory_order_relaxed);
+  progress.remaining = remaining_.load(std::memory_order_relaxed);
+  return progress;
+}
+
+void DrainScheduler::timeoutExpired() noexcept {
+  const TimePoint now = getCurrentTime();
+  while (next_ < turns_.size() && turns_[next_].when <= now) {
+    ManagedConnection* connection = turns_[next_++].connection;
+    if (!connection) {
+      // went away before its turn
+      continue;
+    }
+    pending_.erase(connection);
+    notified_.insert(connection);
+    ++notifiedCount_;
+    // either may close it, and so remove() it
+    folly::DelayedDestruction::DestructorGuard dg(connection);
+    connection->notifyPendingShutdown();
+    if (notified_.count(connection) && !connection->isBusy()) {
+      connection->closeWhenIdle();
+    }
+  }
+  scheduleNext();
+  checkDone();
+}
+
+void DrainScheduler::scheduleNext() {
+  while (next_ < turns_.size() && !turns_[next_].connection) {
+    ++next_;
+  }
+  if (next_ == turns_.size()) {
+    return;
+  }
+  auto delay = std::chrono::duration_cast<milliseconds>(
+    turns_[next_].when - getCurrentTime() + milliseconds(1) -
+    microseconds(1));
+  scheduleTimeout(std::max(delay, milliseconds(0)).count());
+}
+
+void DrainScheduler::checkDone() {
+  if (!started_ || !pending_.empty() || !done_) {
+    return;
+  }
+  cancelTimeout();
+  auto done = std::move(done_);
+  done_ = nullptr;
+  done();
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <folly/experimental/wangle/ManagedConnection.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/TimeoutManager.h>
+#include <functional>
+#include <proxygen/lib/utils/Time.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Drains a set of connections over a window of time rather than all at
+ * once, so that their clients don't all reconnect elsewhere in the same
+ * burst. The window is cut in one slot per connection, the least loaded
+ * ones going first and the busiest last, and each connection's turn comes
+ * at a random point of its slot, jitter being the fraction of the slot it
+ * moves over, so that several servers drained together don't line up.
+ *
+ * At its turn a connection gets notifyPendingShutdown(), a GOAWAY or a
+ * "Connection: close" on its next response, and an idle one is closed
+ * right away with closeWhenIdle(). The busy ones close once their
+ * requests are done. done() is called when every connection had its
+ * turn or went away before.
+ *
+ * Lives in the thread of its TimeoutManager, but for getProgress().
+ */
+class DrainScheduler : private folly::AsyncTimeout {
+ public:
+  struct Progress {
+    // connections at start()
+    uint32_t total{0};
+    // those that had their turn
+    uint32_t notified{0};
+    // those still open
+    uint32_t remaining{0};
+  };
+
+  DrainScheduler(folly::TimeoutManager* timeoutManager,
+                 std::chrono::milliseconds window,
+                 double jitter,
+                 std::function<void()> done);
+
+  /**
+   * Schedule the connections, with their load, such as their number of
+   * open streams. Can only be called once.
+   */
+  void start(
+    std::vector<std::pair<folly::wangle::ManagedConnection*, uint32_t>>
+      connections);
+
+  bool isStarted() const {
+    return started_;
+  }
+
+  /**
+   * The connection is going away, before or after its turn
+   */
+  void remove(folly::wangle::ManagedConnection* connection);
+
+  /**
+   * May be called from any thread
+   */
+  Progress getProgress() const;
+
+ private:
+  struct Turn {
+    TimePoint when;
+    folly::wangle::ManagedConnection* connection;
+  };
+
+  void timeoutExpired() noexcept override;
+  void scheduleNext();
+  void checkDone();
+
+  const std::chrono::milliseconds window_;
+  const double jitter_;
+  std::function<void()> done_;
+  bool started_{false};
+  // by time, the next one at next_
+  std::vector<Turn> turns_;
+  size_t next_{0};
+  // where in turns_ each connection that didn't have its turn is
+  std::unordered_map<folly::wangle::ManagedConnection*, size_t> pending_;
+  // those that had their turn and are still open
+  std::unordered_set<folly::wangle::ManagedConnection*> notified_;
+  std::atomic<uint32_t> total_{0};
+  std::atomic<uint32_t> notifiedCount_{0};
+  std::atomic<uint32_t> remaining_{0};
+};
+
+}
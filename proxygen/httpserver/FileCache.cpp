@@ -0,0 +1,275 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/FileCache.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using folly::IOBuf;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+const uint32_t kWatchEvents = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+  IN_MOVE_SELF;
+
+const struct {
+  const char* extension;
+  const char* contentType;
+} kContentTypes[] = {
+  {"css", "text/css"},
+  {"gif", "image/gif"},
+  {"htm", "text/html"},
+  {"html", "text/html"},
+  {"ico", "image/x-icon"},
+  {"jpeg", "image/jpeg"},
+  {"jpg", "image/jpeg"},
+  {"js", "application/javascript"},
+  {"json", "application/json"},
+  {"pdf", "application/pdf"},
+  {"png", "image/png"},
+  {"svg", "image/svg+xml"},
+  {"txt", "text/plain"},
+  {"woff", "application/font-woff"},
+  {"xml", "application/xml"},
+};
+
+string getContentType(const string& path) {
+  auto dot = path.rfind('.');
+  auto slash = path.rfind('/');
+  if (dot != string::npos && (slash == string::npos || dot > slash)) {
+    string extension = path.substr(dot + 1);
+    for (auto& type: kContentTypes) {
+      if (strcasecmp(extension.c_str(), type.extension) == 0) {
+        return type.contentType;
+      }
+    }
+  }
+  return "application/octet-stream";
+}
+
+string getDir(const string& path) {
+  auto slash = path.rfind('/');
+  if (slash == string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// read the file into memory, mapping it could fault if it gets truncated
+unique_ptr<IOBuf> readAll(int fd, size_t size) {
+  unique_ptr<IOBuf> buf = IOBuf::create(size);
+  while (buf->length() < size) {
+    ssize_t n = pread(fd, buf->writableTail(), size - buf->length(),
+                      buf->length());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return nullptr;
+    }
+    buf->append(n);
+  }
+  return buf;
+}
+
+}
+
+const size_t FileCache::kDefaultMaxEntries;
+const size_t FileCache::kDefaultMaxCachedBody;
+
+FileCache::FileCache(folly::EventBase* eventBase,
+                     size_t maxEntries,
+                     size_t maxCachedBody):
+    folly::EventHandler(eventBase),
+    maxEntries_(maxEntries),
+    maxCachedBody_(maxCachedBody) {
+  CHECK_GT(maxEntries, 0);
+  inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd_ < 0) {
+    LOG(WARNING) << "inotify is not available, file cache entries will be "
+                 << "checked with stat(): " << strerror(errno);
+    return;
+  }
+  changeHandlerFD(inotifyFd_);
+  registerHandler(EventHandler::READ | EventHandler::PERSIST);
+}
+
+FileCache::~FileCache() {
+  if (inotifyFd_ >= 0) {
+    unregisterHandler();
+    close(inotifyFd_);
+  }
+}
+
+shared_ptr<const FileCache::Entry> FileCache::get(const string& path) {
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    const Entry& entry = *it->second.entry;
+    struct stat st;
+    if (isWatching() ||
+        (stat(path.c_str(), &st) == 0 && st.st_ino == entry.inode &&
+         size_t(st.st_size) == entry.size && st.st_mtime == entry.mtime)) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      return it->second.entry;
+    }
+    remove(path);
+  }
+
+  // watch the directory before opening, so that no change is missed
+  string dir = getDir(path);
+  if (isWatching()) {
+    auto& watch = watches_[dir];
+    if (watch.numEntries == 0) {
+      watch.wd = inotify_add_watch(inotifyFd_, dir.c_str(), kWatchEvents);
+      if (watch.wd < 0) {
+        VLOG(4) << "failed to watch " << dir << ": " << strerror(errno);
+        watches_.erase(dir);
+        return open(path);
+      }
+      watchDirs_[watch.wd] = dir;
+    }
+    watch.numEntries++;
+  }
+
+  auto entry = open(path);
+  if (!entry) {
+    if (isWatching()) {
+      unwatch(dir);
+    }
+    return nullptr;
+  }
+  if (entries_.size() >= maxEntries_) {
+    remove(lru_.back());
+  }
+  lru_.push_front(path);
+  Cached& cached = entries_[path];
+  cached.entry = entry;
+  cached.dir = std::move(dir);
+  cached.lru = lru_.begin();
+  return entry;
+}
+
+void FileCache::invalidate(const string& path) {
+  if (entries_.count(path)) {
+    remove(path);
+  }
+}
+
+void FileCache::handlerReady(uint16_t events) noexcept {
+  char buf[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  while (true) {
+    ssize_t n = read(inotifyFd_, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    for (char* p = buf; p < buf + n; ) {
+      auto event = reinterpret_cast<struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // events were lost, nothing cached can be trusted
+        clear();
+        continue;
+      }
+      auto it = watchDirs_.find(event->wd);
+      if (it == watchDirs_.end()) {
+        continue;
+      }
+      string dir = it->second;
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        for (auto entry = entries_.begin(); entry != entries_.end(); ) {
+          auto next = std::next(entry);
+          if (entry->second.dir == dir) {
+            remove(entry->first);
+          }
+          entry = next;
+        }
+      } else if (event->len > 0) {
+        invalidate(dir == "/" ? dir + event->name : dir + "/" + event->name);
+      }
+    }
+  }
+}
+
+shared_ptr<const FileCache::Entry> FileCache::open(const string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    VLOG(4) << "failed to open " << path << ": " << strerror(errno);
+    return nullptr;
+  }
+  auto file = std::make_shared<folly::File>(fd, true);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return nullptr;
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->file = std::move(file);
+  entry->size = st.st_size;
+  entry->mtime = st.st_mtime;
+  entry->inode = st.st_ino;
+  entry->etag = folly::stringPrintf("\"%lx-%zx\"", long(st.st_mtime),
+                                    entry->size);
+  entry->lastModified = formatHTTPDateTime(st.st_mtime);
+  entry->contentType = getContentType(path);
+  if (entry->size <= maxCachedBody_) {
+    entry->data = readAll(fd, entry->size);
+    if (!entry->data) {
+      LOG(ERROR) << "failed to read " << path;
+      return nullptr;
+    }
+  }
+  return entry;
+}
+
+void FileCache::remove(const string& path) {
+  auto it = entries_.find(path);
+  CHECK(it != entries_.end());
+  string dir = std::move(it->second.dir);
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+  if (isWatching()) {
+    unwatch(dir);
+  }
+}
+
+void FileCache::unwatch(const string& dir) {
+  auto it = watches_.find(dir);
+  CHECK(it != watches_.end());
+  if (--it->second.numEntries == 0) {
+    inotify_rm_watch(inotifyFd_, it->second.wd);
+    watchDirs_.erase(it->second.wd);
+    watches_.erase(it);
+  }
+}
+
+void FileCache::clear() {
+  while (!lru_.empty()) {
+    remove(lru_.back());
+  }
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventHandler.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace proxygen {
+
+/**
+ * Open files and their metadata, for the thread of one EventBase, so that
+ * serving a file doesn't cost an open() and a stat(). Files up to
+ * maxCachedBody bytes are also kept in memory.
+ *
+ * The directories of the cached files are watched with inotify, and an
+ * entry is dropped as soon as its file is written, replaced or removed.
+ * Without inotify, the entries are checked with stat() on every lookup.
+ */
+class FileCache : private folly::EventHandler {
+ public:
+  static const size_t kDefaultMaxEntries = 4096;
+  static const size_t kDefaultMaxCachedBody = 64 * 1024;
+
+  struct Entry {
+    std::shared_ptr<folly::File> file;
+    size_t size{0};
+    time_t mtime{0};
+    ino_t inode{0};
+    std::string etag;
+    std::string lastModified;
+    std::string contentType;
+    // the whole file, if it is small enough
+    std::unique_ptr<folly::IOBuf> data;
+  };
+
+  FileCache(folly::EventBase* eventBase,
+            size_t maxEntries = kDefaultMaxEntries,
+            size_t maxCachedBody = kDefaultMaxCachedBody);
+  ~FileCache();
+
+  /**
+   * @return the entry for the file at path, which stays valid for as long
+   *         as it is held even if the file changes. nullptr if path isn't
+   *         a readable regular file.
+   */
+  std::shared_ptr<const Entry> get(const std::string& path);
+
+  /**
+   * Drop the entry for path, if any
+   */
+  void invalidate(const std::string& path);
+
+  size_t getNumEntries() const {
+    return entries_.size();
+  }
+
+  bool isWatching() const {
+    return inotifyFd_ >= 0;
+  }
+
+ private:
+  struct Cached {
+    std::shared_ptr<const Entry> entry;
+    std::string dir;
+    std::list<std::string>::iterator lru;
+  };
+
+  struct Watch {
+    int wd{-1};
+    size_t numEntries{0};
+  };
+
+  void handlerReady(uint16_t events) noexcept override;
+
+  std::shared_ptr<const Entry> open(const std::string& path);
+  void remove(const std::string& path);
+  void unwatch(const std::string& dir);
+  void clear();
+
+  const size_t maxEntries_;
+  const size_t maxCachedBody_;
+  int inotifyFd_{-1};
+  std::unordered_map<std::string, Cached> entries_;
+  // most recently used first
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, Watch> watches_;
+  std::unordered_map<int, std::string> watchDirs_;
+};
+
+}
@@ -80,6 +80,10 @@ class Filter : public RequestHandler, public ResponseHandler {
     downstream_->sendHeaders(msg);
   }
 
+  bool sendInformational(HTTPMessage& msg) noexcept override {
+    return downstream_->sendInformational(msg);
+  }
+
   void sendChunkHeader(size_t len) noexcept override {
     downstream_->sendChunkHeader(len);
   }
@@ -88,6 +92,10 @@ class Filter : public RequestHandler, public ResponseHandler {
     downstream_->sendBody(std::move(body));
   }
 
+  void sendFileRegion(const FileRegion& region) noexcept override {
+    downstream_->sendFileRegion(region);
+  }
+
   void sendChunkTerminator() noexcept override {
     downstream_->sendChunkTerminator();
   }
@@ -112,6 +120,11 @@ class Filter : public RequestHandler, public ResponseHandler {
     downstream_->resumeIngress();
   }
 
+  ResponseHandler* newPushedResponse(
+    PushHandler* handler, const std::string& path) noexcept override {
+    return downstream_->newPushedResponse(handler, path);
+  }
+
   const folly::TransportInfo& getSetupTransportInfo() const noexcept override {
     return downstream_->getSetupTransportInfo();
   }
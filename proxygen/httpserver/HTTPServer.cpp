@@ -9,12 +9,37 @@
  */
 #include <proxygen/httpserver/HTTPServer.h>
 
+#include <algorithm>
 #include <boost/thread.hpp>
+#include <folly/Conv.h>
+#include <folly/String.h>
 #include <folly/ThreadName.h>
 #include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/ConnectionBalancer.h>
 #include <proxygen/httpserver/HTTPServerAcceptor.h>
 #include <proxygen/httpserver/SignalHandler.h>
+#include <proxygen/httpserver/SocketTakeover.h>
+#include <proxygen/httpserver/WorkerGroup.h>
 #include <proxygen/httpserver/filters/RejectConnectFilter.h>
+#include <proxygen/httpserver/filters/StatsRegistry.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <linux/filter.h>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
 
 using folly::AsyncServerSocket;
 using folly::EventBase;
@@ -23,6 +48,51 @@ using folly::SocketAddress;
 
 namespace proxygen {
 
+namespace {
+
+/**
+ * Restrict the calling thread to the given CPUs. Failure is not fatal, the
+ * thread just keeps running wherever the scheduler puts it.
+ */
+void pinCurrentThread(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (auto cpu: cpus) {
+    CHECK_GE(cpu, 0);
+    CHECK_LT(cpu, CPU_SETSIZE);
+    CPU_SET(cpu, &cpuSet);
+  }
+
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (rc != 0) {
+    LOG(WARNING) << "Failed to pin handler thread to "
+                 << folly::join(",", cpus) << ": " << folly::errnoStr(rc);
+  }
+}
+
+/**
+ * Accept TCP Fast Open on the listening sockets of socket. Failure is not
+ * fatal, clients then just do the full handshake.
+ */
+void enableFastOpen(AsyncServerSocket* socket, uint32_t queueLength) {
+  if (queueLength == 0) {
+    return;
+  }
+  int qlen = queueLength;
+  for (auto fd: socket->getSockets()) {
+    if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) != 0) {
+      LOG(WARNING) << "Failed to set TCP_FASTOPEN=" << qlen << ": "
+                   << folly::errnoStr(errno);
+    }
+  }
+}
+
+}
+
 HTTPServer::HTTPServer(HTTPServerOptions options):
     options_(std::move(options)) {
 
@@ -32,6 +102,16 @@ HTTPServer::HTTPServer(HTTPServerOptions options):
         options_.handlerFactories.begin(),
         folly::make_unique<RejectConnectFilterFactory>());
   }
+
+  for (auto& config: options_.workerGroups) {
+    if (!options_.supportsConnect) {
+      config.handlerFactories.insert(
+          config.handlerFactories.begin(),
+          folly::make_unique<RejectConnectFilterFactory>());
+    }
+    workerGroups_.emplace_back(new WorkerGroup(std::move(config)));
+  }
+  options_.workerGroups.clear();
 }
 
 HTTPServer::~HTTPServer() {
@@ -49,7 +129,13 @@ void HTTPServer::bind(std::vector<IPConfig>& addrs) {
   auto evb = EventBaseManager::get()->getEventBase();
   for (auto& addr: addrs) {
     serverSockets_.emplace_back(new AsyncServerSocket(evb));
+    if (options_.reusePort) {
+      // This socket only reserves the address, handler threads open their
+      // own sockets on it in start()
+      serverSockets_.back()->setReusePortEnabled(true);
+    }
     serverSockets_.back()->bind(addr.address);
+    enableFastOpen(serverSockets_.back().get(), options_.fastOpenQueueLength);
 
     // Use might have asked to register with some ephemeral port
     serverSockets_.back()->getAddress(&addr.address);
@@ -60,6 +146,59 @@ void HTTPServer::bind(std::vector<IPConfig>& addrs) {
   addresses_ = addrs;
 }
 
+void HTTPServer::takeover(std::vector<IPConfig>& addrs) {
+  CHECK(serverSockets_.empty()) << "Server sockets are already bound";
+  CHECK(!options_.takeoverPath.empty());
+  CHECK(!options_.reusePort) << "Can't take per-thread sockets over";
+
+  std::unique_ptr<TakeoverClient> client(
+    new TakeoverClient(options_.takeoverPath));
+  std::vector<std::pair<SocketAddress, int>> inherited;
+  for (auto fd: client->releaseSockets()) {
+    SocketAddress address;
+    address.setFromLocalAddress(fd);
+    inherited.emplace_back(address, fd);
+  }
+
+  folly::ScopeGuard g = folly::makeGuard([&] {
+    serverSockets_.clear();
+    for (auto& socket: inherited) {
+      close(socket.second);
+    }
+  });
+
+  auto evb = EventBaseManager::get()->getEventBase();
+  for (auto& addr: addrs) {
+    serverSockets_.emplace_back(new AsyncServerSocket(evb));
+    auto it = std::find_if(
+      inherited.begin(), inherited.end(),
+      [&addr] (const std::pair<SocketAddress, int>& socket) {
+        return socket.first == addr.address;
+      });
+    if (it != inherited.end()) {
+      serverSockets_.back()->useExistingSocket(it->second);
+      inherited.erase(it);
+    } else {
+      LOG(INFO) << "Nothing to take over on " << addr.address.describe()
+                << ", binding it";
+      serverSockets_.back()->bind(addr.address);
+      enableFastOpen(serverSockets_.back().get(),
+                     options_.fastOpenQueueLength);
+      serverSockets_.back()->getAddress(&addr.address);
+    }
+  }
+
+  // the old server listened on more addresses than we serve
+  for (auto& socket: inherited) {
+    close(socket.second);
+  }
+  inherited.clear();
+
+  g.dismiss();
+  addresses_ = addrs;
+  takeoverClient_ = std::move(client);
+}
+
 void HTTPServer::start(std::function<void()> onSuccess,
                        std::function<void(std::exception_ptr)> onError) {
   // Step 1: Check that server sockets are bound
@@ -74,8 +213,37 @@ void HTTPServer::start(std::function<void()> onSuccess,
   // before we proceed
   boost::barrier barrier(2);
 
-  // Step 2: Setup handler threads
-  handlerThreads_ = std::vector<HandlerThread>(options_.threads);
+  // Step 2: Switch the server socket eventbase (bind may have been invoked
+  //         in a separate thread).
+  for (auto& serverSocket: serverSockets_) {
+    serverSocket->detachEventBase();
+    serverSocket->attachEventBase(mainEventBase_);
+  }
+
+  if (options_.hugePageArenas) {
+    IOBufSlab::setUseHugePages(true);
+  }
+
+  // Step 3: Setup handler threads. With `threads == 0` a single handler runs
+  //         directly on the main event base and no thread is spawned.
+  const bool inlineHandler = (options_.threads == 0);
+  handlerThreads_ = std::vector<HandlerThread>(
+    inlineHandler ? 1 : options_.threads);
+
+  // The server socket can only take turns between its accept callbacks,
+  // one connection at a time, other balancing and batches go through a
+  // ConnectionBalancer
+  const bool balance = !options_.reusePort && !inlineHandler &&
+    (options_.balancing != HTTPServerOptions::Balancing::ROUND_ROBIN ||
+     options_.acceptBatchGroupSize > 0);
+  // The TLS addresses whose handshakes run on their own threads
+  std::vector<bool> offloadHandshakes(addresses_.size(), false);
+  if (!options_.reusePort && !inlineHandler &&
+      options_.sslHandshakeThreads > 0) {
+    FOR_EACH_RANGE (i, 0, addresses_.size()) {
+      offloadHandshakes[i] = !addresses_[i].sslConfigs.empty();
+    }
+  }
 
   std::vector<AcceptorConfiguration> accConfigs;
   FOR_EACH_RANGE (i, 0, addresses_.size()) {
@@ -83,34 +251,86 @@ void HTTPServer::start(std::function<void()> onSuccess,
                                                            options_));
   }
 
-  for (auto& handlerThread: handlerThreads_) {
-    handlerThread.thread = std::thread([&] () {
-      folly::setThreadName("http-worker");
-      handlerThread.eventBase = manager->getEventBase();
-      barrier.wait();
-
-      handlerThread.eventBase->loopForever();
-
-      // Call loop() again to drain all the events
-      handlerThread.eventBase->loop();
-    });
+  // The groups take requests as soon as the handler threads accept
+  startWorkerGroups();
+  std::vector<WorkerGroup*> workerGroups;
+  for (auto& group: workerGroups_) {
+    workerGroups.push_back(group.get());
+  }
+  if (!workerGroups_.empty() && !inlineHandler) {
+    handlersDrained_ = std::make_shared<boost::barrier>(
+      handlerThreads_.size() + 1);
+  }
 
-    // Wait for eventbase pointer to be set
-    barrier.wait();
+  if (!options_.threadAffinity.empty()) {
+    FOR_EACH_RANGE (i, 0, handlerThreads_.size()) {
+      handlerThreads_[i].cpus =
+        options_.threadAffinity[i % options_.threadAffinity.size()];
+    }
+  }
 
-    // Make sure event loop is running before we proceed
-    handlerThread.eventBase->runInEventBaseThread([&] () {
-      barrier.wait();
-      for (auto& factory: options_.handlerFactories) {
-        factory->onServerStart();
-      }
-    });
-    barrier.wait();
+  if (inlineHandler) {
+    auto& handlerThread = handlerThreads_.front();
+    pinCurrentThread(handlerThread.cpus);
+    handlerThread.eventBase = mainEventBase_;
+    startLoopMonitor(handlerThread, "http-worker", 0);
+    startLoopClock(handlerThread);
+    for (auto& factory: options_.handlerFactories) {
+      factory->onServerStart();
+    }
+  } else {
+    // The threads start in parallel, each running onServerStart() in its
+    // loop, and we wait once for all of them. The barrier is shared, the
+    // threads may still be leaving it when we are done.
+    auto started = std::make_shared<boost::barrier>(
+      handlerThreads_.size() + 1);
+    auto drained = handlersDrained_;
+    for (auto& handlerThread: handlerThreads_) {
+      handlerThread.thread = std::thread([&, started, drained] () {
+        folly::setThreadName("http-worker");
+        // Pin before creating the EventBase so that its allocations are
+        // local to the thread's NUMA node
+        pinCurrentThread(handlerThread.cpus);
+        handlerThread.eventBase = manager->getEventBase();
+        startLoopMonitor(handlerThread, "http-worker",
+                         &handlerThread - &handlerThreads_[0]);
+        startLoopClock(handlerThread);
+        handlerThread.eventBase->runInLoop([this, started] () {
+          for (auto& factory: options_.handlerFactories) {
+            factory->onServerStart();
+          }
+          started->wait();
+        });
+
+        handlerThread.eventBase->loopForever();
+
+        // Call loop() again to drain all the events
+        handlerThread.eventBase->loop();
+        if (drained) {
+          // and once more for the responses of the groups' last requests
+          drained->wait();
+          drained->wait();
+          handlerThread.eventBase->loop();
+        }
+        if (handlerThread.loopMonitor) {
+          handlerThread.loopMonitor->stop();
+        }
+        handlerThread.loopClock.reset();
+      });
+    }
+    started->wait();
+  }
 
+  for (auto& handlerThread: handlerThreads_) {
     // Create acceptors
     FOR_EACH_RANGE (i, 0, accConfigs.size()) {
-      auto acc = HTTPServerAcceptor::make(accConfigs[i], options_);
-      acc->init(serverSockets_[i].get(), handlerThread.eventBase);
+      auto acc = HTTPServerAcceptor::make(accConfigs[i], options_,
+                                          workerGroups);
+      if (balance || offloadHandshakes[i]) {
+        acc->init(nullptr, handlerThread.eventBase);
+      } else if (!options_.reusePort) {
+        acc->init(serverSockets_[i].get(), handlerThread.eventBase);
+      }
       ++handlerThread.acceptorsRunning;
 
       // Set completion callback such that it invokes onServerStop when
@@ -130,35 +350,189 @@ void HTTPServer::start(std::function<void()> onSuccess,
     }
   }
 
-  // Step 3: Install signal handler if required
+  // Step 3a: Build the codec tables, zlib contexts and buffers of every
+  //          handler thread, all at once, before the first connection
+  //          needs them
+  if (inlineHandler) {
+    for (auto& acc: handlerThreads_.front().acceptors) {
+      acc->prewarm();
+    }
+  } else {
+    auto prewarmed = std::make_shared<boost::barrier>(
+      handlerThreads_.size() + 1);
+    for (auto& handlerThread: handlerThreads_) {
+      HandlerThread* ptr = &handlerThread;
+      handlerThread.eventBase->runInEventBaseThread([ptr, prewarmed] () {
+        for (auto& acc: ptr->acceptors) {
+          acc->prewarm();
+        }
+        prewarmed->wait();
+      });
+    }
+    prewarmed->wait();
+  }
+
+  auto makeBalancer = [this] (size_t i, AsyncServerSocket* socket) {
+    std::vector<HTTPServerAcceptor*> acceptors;
+    for (auto& handlerThread: handlerThreads_) {
+      acceptors.push_back(handlerThread.acceptors[i].get());
+    }
+    return folly::make_unique<ConnectionBalancer>(
+      options_.balancing, std::move(acceptors), socket,
+      options_.acceptBatchGroupSize);
+  };
+
+  if (balance) {
+    FOR_EACH_RANGE (i, 0, serverSockets_.size()) {
+      if (offloadHandshakes[i]) {
+        continue;
+      }
+      balancers_.push_back(makeBalancer(
+          i,
+          options_.acceptBatchGroupSize > 0 ? serverSockets_[i].get()
+                                            : nullptr));
+      // No EventBase, the balancer runs in the server socket's own
+      serverSockets_[i]->addAcceptCallback(balancers_.back().get(), nullptr);
+    }
+  }
+
+  // Step 3b: Setup the TLS handshake threads. Their acceptors hand the
+  //          established connections over to the handler threads' ones.
+  if (std::find(offloadHandshakes.begin(), offloadHandshakes.end(), true) !=
+      offloadHandshakes.end()) {
+    handshakeThreads_ = std::vector<HandlerThread>(
+      options_.sslHandshakeThreads);
+  }
+  if (!handshakeThreads_.empty()) {
+    auto started = std::make_shared<boost::barrier>(
+      handshakeThreads_.size() + 1);
+    for (auto& handshakeThread: handshakeThreads_) {
+      handshakeThread.thread = std::thread([&, started] () {
+        folly::setThreadName("http-handshake");
+        handshakeThread.eventBase = manager->getEventBase();
+        startLoopMonitor(handshakeThread, "http-handshake",
+                         &handshakeThread - &handshakeThreads_[0]);
+        handshakeThread.eventBase->runInLoop([started] () {
+          started->wait();
+        });
+
+        handshakeThread.eventBase->loopForever();
+
+        // Call loop() again to drain all the events
+        handshakeThread.eventBase->loop();
+        if (handshakeThread.loopMonitor) {
+          handshakeThread.loopMonitor->stop();
+        }
+      });
+    }
+    started->wait();
+  }
+  for (auto& handshakeThread: handshakeThreads_) {
+    FOR_EACH_RANGE (i, 0, accConfigs.size()) {
+      if (!offloadHandshakes[i]) {
+        continue;
+      }
+      auto acc = HTTPServerAcceptor::make(accConfigs[i], options_);
+      acc->init(serverSockets_[i].get(), handshakeThread.eventBase);
+      acc->setHandoff(makeBalancer(i, nullptr));
+      handshakeThread.acceptors.push_back(std::move(acc));
+    }
+  }
+
+  // Step 4: Install signal handler if required
   if (!options_.shutdownOn.empty()) {
     signalHandler_ = folly::make_unique<SignalHandler>(this);
     signalHandler_->install(options_.shutdownOn);
   }
 
-  // Step 4: Switch the server socket eventbase (bind may have been invoked
-  //         in a separate thread).
-  for (auto& serverSocket: serverSockets_) {
-    serverSocket->detachEventBase();
-    serverSocket->attachEventBase(mainEventBase_);
-  }
-
   // Step 5: Start listening for connections. This can throw if somebody else
   //         binds to same address and calls listen before this.
-  try {
-    for (auto& serverSocket: serverSockets_) {
-      serverSocket->listen(options_.listenBacklog);
-      serverSocket->startAccepting();
+  std::exception_ptr listenError;
+  if (options_.reusePort) {
+    for (auto& handlerThread: handlerThreads_) {
+      if (inlineHandler) {
+        try {
+          startReusePortAcceptors(handlerThread);
+        } catch (...) {
+          listenError = std::current_exception();
+        }
+      } else {
+        handlerThread.eventBase->runInEventBaseThread([&] () {
+          try {
+            startReusePortAcceptors(handlerThread);
+          } catch (...) {
+            listenError = std::current_exception();
+          }
+          barrier.wait();
+        });
+        barrier.wait();
+      }
+
+      if (listenError) {
+        break;
+      }
+    }
+    if (!listenError && options_.steerByCpuBpf) {
+      attachCpuSteeringProgram();
+    }
+  } else {
+    try {
+      for (auto& serverSocket: serverSockets_) {
+        if (options_.acceptBudget > 0) {
+          serverSocket->setMaxAcceptAtOnce(options_.acceptBudget);
+        }
+        serverSocket->listen(options_.listenBacklog);
+        serverSocket->startAccepting();
+      }
+    } catch (...) {
+      listenError = std::current_exception();
     }
-  } catch (...) {
+  }
+
+  if (listenError) {
     stop();
 
     if (onError) {
-      onError(std::current_exception());
+      onError(listenError);
       return;
     }
 
-    throw;
+    std::rethrow_exception(listenError);
+  }
+
+  // Step 5b: Be ready to hand the sockets over to our successor, and tell
+  //          the server we took them over from, if any, to drain. A
+  //          failure here is no reason not to serve.
+  if (!options_.takeoverPath.empty() && !options_.reusePort) {
+    std::vector<int> fds;
+    for (auto& serverSocket: serverSockets_) {
+      auto sockets = serverSocket->getSockets();
+      fds.insert(fds.end(), sockets.begin(), sockets.end());
+    }
+    takeoverServer_ = folly::make_unique<TakeoverServer>(
+      mainEventBase_, options_.takeoverPath, std::move(fds), [this] {
+        // not from within the TakeoverServer, stop() destroys it
+        mainEventBase_->runInLoop([this] {
+            if (mainEventBase_) {
+              stop();
+            }
+          });
+      });
+    try {
+      takeoverServer_->start();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Can't listen for a takeover on "
+                 << options_.takeoverPath << ": " << ex.what();
+      takeoverServer_.reset();
+    }
+  }
+  if (takeoverClient_) {
+    try {
+      takeoverClient_->confirm();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Failed to tell the old server to drain: " << ex.what();
+    }
+    takeoverClient_.reset();
   }
 
   // Step 6: Start the main event loop
@@ -186,19 +560,251 @@ void HTTPServer::stop() {
   }
 
   signalHandler_.reset();
+  takeoverServer_.reset();
+  takeoverClient_.reset();
   serverSockets_.clear();
+  balancers_.clear();
   mainEventBase_->terminateLoopSoon();
   mainEventBase_ = nullptr;
 
+  // The handshake threads hand their last connections over, and tell the
+  // handler threads to drain, before they stop
+  for (auto& handshakeThread: handshakeThreads_) {
+    handshakeThread.eventBase->terminateLoopSoon();
+  }
+  for (auto& handshakeThread: handshakeThreads_) {
+    if (handshakeThread.thread.joinable()) {
+      handshakeThread.thread.join();
+    }
+  }
+
   for (auto& handlerThread: handlerThreads_) {
+    if (handlerThread.eventBase->isInEventBaseThread()) {
+      // the inline handler, on the main EventBase
+      handlerThread.serverSockets.clear();
+      if (handlerThread.loopMonitor) {
+        handlerThread.loopMonitor->stop();
+      }
+      handlerThread.loopClock.reset();
+    } else if (!handlerThread.serverSockets.empty()) {
+      // Per-thread sockets have to be destroyed in their own EventBase
+      auto barrier = std::make_shared<boost::barrier>(2);
+      handlerThread.eventBase->runInEventBaseThread(
+        [&handlerThread, barrier] () {
+          handlerThread.serverSockets.clear();
+          barrier->wait();
+        });
+      barrier->wait();
+    }
     handlerThread.eventBase->terminateLoopSoon();
   }
 
+  if (handlersDrained_) {
+    handlersDrained_->wait();
+    stopWorkerGroups();
+    handlersDrained_->wait();
+    handlersDrained_.reset();
+  }
+
   for (auto& handlerThread: handlerThreads_) {
-    handlerThread.thread.join();
+    if (handlerThread.thread.joinable()) {
+      handlerThread.thread.join();
+    }
   }
 
   handlerThreads_.clear();
+  // the inline handler's sessions are still around, on this thread, but
+  // don't take responses any more
+  stopWorkerGroups();
+}
+
+void HTTPServer::startWorkerGroups() {
+  auto manager = EventBaseManager::get();
+  size_t total = 0;
+  workerGroupThreads_.resize(workerGroups_.size());
+  FOR_EACH_RANGE (g, 0, workerGroups_.size()) {
+    auto group = workerGroups_[g].get();
+    workerGroupThreads_[g] = std::vector<HandlerThread>(
+      group->getNumThreads());
+    const auto& affinity = group->getThreadAffinity();
+    if (!affinity.empty()) {
+      FOR_EACH_RANGE (i, 0, workerGroupThreads_[g].size()) {
+        workerGroupThreads_[g][i].cpus = affinity[i % affinity.size()];
+      }
+    }
+    total += workerGroupThreads_[g].size();
+  }
+  if (total == 0) {
+    return;
+  }
+
+  auto started = std::make_shared<boost::barrier>(total + 1);
+  FOR_EACH_RANGE (g, 0, workerGroups_.size()) {
+    auto group = workerGroups_[g].get();
+    auto name = folly::to<std::string>("http-group-", group->getName());
+    FOR_EACH_RANGE (i, 0, workerGroupThreads_[g].size()) {
+      HandlerThread* ptr = &workerGroupThreads_[g][i];
+      ptr->thread = std::thread([=] () {
+        folly::setThreadName("http-group");
+        pinCurrentThread(ptr->cpus);
+        ptr->eventBase = manager->getEventBase();
+        startLoopMonitor(*ptr, name.c_str(), i);
+        startLoopClock(*ptr);
+        ptr->eventBase->runInLoop([=] () {
+          group->onThreadStart(i, ptr->eventBase);
+          started->wait();
+        });
+
+        ptr->eventBase->loopForever();
+
+        group->onThreadStop();
+        // Call loop() again to drain all the events
+        ptr->eventBase->loop();
+        if (ptr->loopMonitor) {
+          ptr->loopMonitor->stop();
+        }
+        ptr->loopClock.reset();
+      });
+    }
+  }
+  started->wait();
+}
+
+void HTTPServer::stopWorkerGroups() {
+  for (auto& threads: workerGroupThreads_) {
+    for (auto& thread: threads) {
+      thread.eventBase->terminateLoopSoon();
+    }
+  }
+  for (auto& threads: workerGroupThreads_) {
+    for (auto& thread: threads) {
+      if (thread.thread.joinable()) {
+        thread.thread.join();
+      }
+    }
+  }
+  workerGroupThreads_.clear();
+}
+
+void HTTPServer::startLoopMonitor(HandlerThread& handlerThread,
+                                  const char* name, size_t index) {
+  if (!options_.loopStats) {
+    return;
+  }
+  handlerThread.loopMonitor = LoopMonitor::start(
+    handlerThread.eventBase, options_.loopStatsSampleRate);
+  options_.loopStats->addLoopMonitor(folly::to<std::string>(name, ".", index),
+                                     handlerThread.loopMonitor);
+}
+
+void HTTPServer::startLoopClock(HandlerThread& handlerThread) {
+  if (options_.loopClock) {
+    handlerThread.loopClock.reset(new LoopClock(handlerThread.eventBase));
+  }
+}
+
+ConnectionBalancer::AcceptStats HTTPServer::getAcceptStats() const {
+  ConnectionBalancer::AcceptStats total;
+  for (auto& balancer: balancers_) {
+    auto stats = balancer->getAcceptStats();
+    total.accepted += stats.accepted;
+    total.batches += stats.batches;
+    total.budgetExhausted += stats.budgetExhausted;
+    total.queueOverflows += stats.queueOverflows;
+    total.maxQueueLength = std::max(total.maxQueueLength,
+                                    stats.maxQueueLength);
+    total.backlog = std::max(total.backlog, stats.backlog);
+    total.acceptErrors += stats.acceptErrors;
+  }
+  return total;
+}
+
+DrainScheduler::Progress HTTPServer::getDrainProgress() const {
+  DrainScheduler::Progress total;
+  for (auto& handlerThread: handlerThreads_) {
+    for (auto& acceptor: handlerThread.acceptors) {
+      auto progress = acceptor->getDrainProgress();
+      total.total += progress.total;
+      total.notified += progress.notified;
+      total.remaining += progress.remaining;
+    }
+  }
+  return total;
+}
+
+void HTTPServer::attachCpuSteeringProgram() {
+  // A socket's index in its group is the order it was bound in, which is
+  // the order of the handler threads. The first thread pinned to a CPU
+  // gets its connections.
+  std::map<int, uint32_t> threadOfCpu;
+  FOR_EACH_RANGE (i, 0, handlerThreads_.size()) {
+    for (auto cpu: handlerThreads_[i].cpus) {
+      threadOfCpu.insert(std::make_pair(cpu, i));
+    }
+  }
+  if (threadOfCpu.empty()) {
+    LOG(WARNING) << "steerByCpuBpf needs threadAffinity, not attaching";
+    return;
+  }
+
+  std::vector<sock_filter> code;
+  code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU));
+  for (const auto& cpuThread: threadOfCpu) {
+    code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpuThread.first, 0, 1));
+    code.push_back(BPF_STMT(BPF_RET | BPF_K, cpuThread.second));
+  }
+  // past the end of the group, the kernel picks a socket by hash
+  code.push_back(BPF_STMT(BPF_RET | BPF_K, handlerThreads_.size()));
+  sock_fprog program;
+  program.len = code.size();
+  program.filter = code.data();
+
+  // the program of a group is attached through any of its sockets
+  for (auto& socket: handlerThreads_.front().serverSockets) {
+    for (auto fd: socket->getSockets()) {
+      if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                     &program, sizeof(program)) != 0) {
+        LOG(WARNING) << "Failed to attach the CPU steering program: "
+                     << folly::errnoStr(errno);
+      }
+    }
+  }
+}
+
+void HTTPServer::startReusePortAcceptors(HandlerThread& handlerThread) {
+  CHECK(handlerThread.eventBase->isInEventBaseThread());
+  CHECK_EQ(handlerThread.acceptors.size(), addresses_.size());
+
+  FOR_EACH_RANGE (i, 0, addresses_.size()) {
+    AsyncServerSocket::UniquePtr socket(
+      new AsyncServerSocket(handlerThread.eventBase));
+    socket->setReusePortEnabled(true);
+    socket->bind(addresses_[i].address);
+    enableFastOpen(socket.get(), options_.fastOpenQueueLength);
+
+    if (options_.steerByIncomingCpu && !handlerThread.cpus.empty()) {
+      int cpu = handlerThread.cpus.front();
+      for (auto fd: socket->getSockets()) {
+        if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU,
+                       &cpu, sizeof(cpu)) != 0) {
+          LOG(WARNING) << "Failed to set SO_INCOMING_CPU=" << cpu << ": "
+                       << folly::errnoStr(errno);
+        }
+      }
+    }
+
+    if (options_.acceptBudget > 0) {
+      socket->setMaxAcceptAtOnce(options_.acceptBudget);
+    }
+    socket->listen(options_.listenBacklog);
+
+    // The accept callback runs in the same EventBase as the socket, so
+    // accepted connections are never handed off to another thread.
+    handlerThread.acceptors[i]->init(socket.get(), handlerThread.eventBase);
+    socket->startAccepting();
+
+    handlerThread.serverSockets.push_back(std::move(socket));
+  }
 }
 
 }
@@ -9,16 +9,25 @@
  */
 #pragma once
 
+#include <boost/thread.hpp>
 #include <folly/experimental/wangle/ssl/SSLContextConfig.h>
 #include <folly/io/async/AsyncServerSocket.h>
 #include <folly/io/async/EventBase.h>
+#include <proxygen/httpserver/ConnectionBalancer.h>
+#include <proxygen/httpserver/DrainScheduler.h>
 #include <proxygen/httpserver/HTTPServerOptions.h>
+#include <proxygen/lib/ssl/SSLCertCache.h>
+#include <proxygen/lib/utils/LoopClock.h>
 #include <thread>
 
 namespace proxygen {
 
-class SignalHandler;
 class HTTPServerAcceptor;
+class LoopMonitor;
+class SignalHandler;
+class TakeoverClient;
+class TakeoverServer;
+class WorkerGroup;
 
 /**
  * HTTPServer based on proxygen http libraries
@@ -43,6 +52,26 @@ class HTTPServer final {
     folly::SocketAddress address;
     Protocol protocol;
     std::vector<folly::SSLContextConfig> sslConfigs;
+
+    /**
+     * Session ticket keys, the same on all the servers behind a VIP so
+     * that clients can resume on any of them. See SSLTicketKeys. Without
+     * keys, each handler thread picks its own, random ones.
+     */
+    std::vector<std::string> sslTicketKeys;
+
+    /**
+     * Certificates for many more hostnames than sslConfigs, loaded when a
+     * handshake first asks for them by SNI, with sslConfigs as the default.
+     * Shared by all the handler threads. See SSLCertCache.
+     */
+    std::shared_ptr<SSLCertCache> sslCertCache;
+
+    /**
+     * Let the kernel encrypt and decrypt the TLS records of the
+     * connections to this address, when it can. See KernelTLS.
+     */
+    bool kernelTLS{false};
   };
 
   /**
@@ -64,6 +93,16 @@ class HTTPServer final {
    */
   void bind(std::vector<IPConfig>& addrs);
 
+  /**
+   * Like bind(), but take the listening sockets of the addresses over from
+   * the server running at HTTPServerOptions::takeoverPath, if it listens
+   * on them. Once start() accepts on them, it tells that server to drain.
+   *
+   * Throws if there is no server to take over from; callers can then fall
+   * back to bind().
+   */
+  void takeover(std::vector<IPConfig>& addrs);
+
   /**
    * Start HTTPServer.
    *
@@ -98,6 +137,20 @@ class HTTPServer final {
     return addresses_;
   }
 
+  /**
+   * The accept stats of all the listening sockets, added up. Only kept
+   * with HTTPServerOptions::acceptBatchGroupSize. Can be called from any
+   * thread while the server runs.
+   */
+  ConnectionBalancer::AcceptStats getAcceptStats() const;
+
+  /**
+   * How far the drain of stop() went, over the handler threads. See
+   * HTTPServerOptions::drainWindow. Can be called from any thread while
+   * the server runs.
+   */
+  DrainScheduler::Progress getDrainProgress() const;
+
  private:
   HTTPServerOptions options_;
 
@@ -122,16 +175,111 @@ class HTTPServer final {
 
     std::vector<std::unique_ptr<HTTPServerAcceptor>> acceptors;
 
+    /**
+     * Per-thread listening sockets, one per address. Only used when
+     * HTTPServerOptions::reusePort is set.
+     */
+    std::vector<folly::AsyncServerSocket::UniquePtr> serverSockets;
+
     uint32_t acceptorsRunning{0};
+
+    /**
+     * CPUs this thread is pinned to, empty if not pinned
+     */
+    std::vector<int> cpus;
+
+    /**
+     * Set with HTTPServerOptions::loopStats
+     */
+    std::shared_ptr<LoopMonitor> loopMonitor;
+
+    /**
+     * Set with HTTPServerOptions::loopClock, deleted on the thread
+     */
+    std::unique_ptr<LoopClock> loopClock;
   };
 
+  /**
+   * Observe the loop of handlerThread, from its thread, for
+   * HTTPServerOptions::loopStats
+   */
+  void startLoopMonitor(HandlerThread& handlerThread, const char* name,
+                        size_t index);
+
+  /**
+   * Cache the loop time of handlerThread, from its thread, for
+   * HTTPServerOptions::loopClock
+   */
+  void startLoopClock(HandlerThread& handlerThread);
+
+  /**
+   * Open, bind and start listening on this thread's own SO_REUSEPORT
+   * sockets, and hook them up to the thread's acceptors. Must be invoked in
+   * the handler thread's EventBase.
+   */
+  void startReusePortAcceptors(HandlerThread& handlerThread);
+
+  /**
+   * Attach the program of HTTPServerOptions::steerByCpuBpf to the
+   * SO_REUSEPORT groups, once all the handler threads joined them
+   */
+  void attachCpuSteeringProgram();
+
+  /**
+   * Start the threads of the worker groups, and wait until they run
+   */
+  void startWorkerGroups();
+
+  /**
+   * Stop the threads of the worker groups, once the handler threads
+   * drained, and wait until they are done
+   */
+  void stopWorkerGroups();
+
   std::vector<HandlerThread> handlerThreads_;
 
+  /**
+   * See HTTPServerOptions::workerGroups, and the threads of each
+   */
+  std::vector<std::unique_ptr<WorkerGroup>> workerGroups_;
+  std::vector<std::vector<HandlerThread>> workerGroupThreads_;
+
+  /**
+   * With worker groups, the handler threads wait here once they drained,
+   * and again once the groups stopped, so that they take the groups' last
+   * responses
+   */
+  std::shared_ptr<boost::barrier> handlersDrained_;
+
+  /**
+   * Threads that only do the TLS handshakes, see
+   * HTTPServerOptions::sslHandshakeThreads
+   */
+  std::vector<HandlerThread> handshakeThreads_;
+
+  /**
+   * One per address, when the acceptors get their connections from a
+   * ConnectionBalancer instead of straight from the server socket
+   */
+  std::vector<std::unique_ptr<ConnectionBalancer>> balancers_;
+
   /**
    * Optional signal handlers on which we should shutdown server
    */
   std::unique_ptr<SignalHandler> signalHandler_;
 
+  /**
+   * The server we took the sockets over from, until start() tells it to
+   * drain
+   */
+  std::unique_ptr<TakeoverClient> takeoverClient_;
+
+  /**
+   * Hands our sockets over to our successor, see
+   * HTTPServerOptions::takeoverPath
+   */
+  std::unique_ptr<TakeoverServer> takeoverServer_;
+
   /**
    * Addresses we are listening on
    */
@@ -9,35 +9,75 @@
  */
 #include <proxygen/httpserver/HTTPServerAcceptor.h>
 
+#include <algorithm>
+#include <folly/Conv.h>
+#include <proxygen/httpserver/ConnectionBalancer.h>
+#include <proxygen/httpserver/LoadShedder.h>
 #include <proxygen/httpserver/RequestHandlerAdaptor.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/RateLimitFilter.h>
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
+#include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
 #include <proxygen/lib/http/session/HTTPDownstreamSession.h>
 
 using folly::SocketAddress;
 
 namespace proxygen {
 
+namespace {
+
+// longer request timeouts are taken as this, a day
+const uint64_t kMaxRequestTimeoutMs = 24 * 3600 * 1000;
+
+}
+
 AcceptorConfiguration HTTPServerAcceptor::makeConfig(
     const HTTPServer::IPConfig& ipConfig,
     const HTTPServerOptions& opts) {
 
   AcceptorConfiguration conf;
   conf.bindAddress = ipConfig.address;
-  conf.connectionIdleTimeout = opts.idleTimeout;
+  conf.connectionIdleTimeout = opts.keepAliveTimeout.count() > 0 ?
+    opts.keepAliveTimeout : opts.idleTimeout;
   conf.transactionIdleTimeout = opts.idleTimeout;
+  conf.headerTimeout = opts.headerTimeout;
 
   if (ipConfig.protocol == HTTPServer::Protocol::SPDY) {
     conf.plaintextProtocol = "spdy/3.1";
   }
 
   conf.sslContextConfigs = ipConfig.sslConfigs;
+  // The config is copied into the acceptors of all the handler threads,
+  // which so share these
+  if (!ipConfig.sslConfigs.empty() && opts.sslSessionCacheSize > 0) {
+    conf.sslSessionCache =
+      std::make_shared<SSLSessionCache>(opts.sslSessionCacheSize);
+  }
+  if (!ipConfig.sslTicketKeys.empty()) {
+    conf.sslTicketKeys =
+      std::make_shared<SSLTicketKeys>(ipConfig.sslTicketKeys);
+  }
+  conf.sslCertCache = ipConfig.sslCertCache;
+  conf.kernelTLS = ipConfig.kernelTLS;
+  conf.ioUring = opts.ioUring;
+  conf.maxPipelinedRequests = opts.maxPipelinedRequests;
+  conf.maxPipelinedBufferBytes = opts.maxPipelinedBufferBytes;
+  conf.coalesceIngressBody = opts.coalesceIngressBody;
+  conf.sharedEgressFlusher = opts.sharedEgressFlusher;
+  conf.egressBytesPerLoop = opts.egressBytesPerLoop;
+  conf.ingressBytesPerLoop = opts.ingressBytesPerLoop;
+  conf.egressShaping = opts.egressShaping;
+  conf.allowH2C = opts.allowH2C;
+  conf.slowTransactionSampler = opts.slowTransactionSampler;
+  conf.tcpInfoSampleInterval = opts.tcpInfoSampleInterval;
   return conf;
 }
 
 std::unique_ptr<HTTPServerAcceptor> HTTPServerAcceptor::make(
   const AcceptorConfiguration& conf,
-  const HTTPServerOptions& opts) {
+  const HTTPServerOptions& opts,
+  std::vector<WorkerGroup*> workerGroups) {
   // Create a copy of the filter chain in reverse order since we need to create
   // Handlers in that order.
   std::vector<RequestHandlerFactory*> handlerFactories;
@@ -47,14 +87,265 @@ std::unique_ptr<HTTPServerAcceptor> HTTPServerAcceptor::make(
   std::reverse(handlerFactories.begin(), handlerFactories.end());
 
   return std::unique_ptr<HTTPServerAcceptor>(
-      new HTTPServerAcceptor(conf, handlerFactories));
+      new HTTPServerAcceptor(conf, opts, handlerFactories,
+                             std::move(workerGroups)));
 }
 
 HTTPServerAcceptor::HTTPServerAcceptor(
     const AcceptorConfiguration& conf,
-    std::vector<RequestHandlerFactory*> handlerFactories)
+    const HTTPServerOptions& opts,
+    std::vector<RequestHandlerFactory*> handlerFactories,
+    std::vector<WorkerGroup*> workerGroups)
     : HTTPSessionAcceptor(conf),
-      handlerFactories_(handlerFactories) {
+      maxLoopLag_(opts.maxLoopLag),
+      maxConnections_(opts.maxConnectionsPerThread),
+      rejectRequestsOnOverload_(opts.rejectRequestsOnOverload),
+      loadShedder_(opts.loadShedder),
+      connectionRateLimiter_(opts.connectionRateLimiter),
+      measureLoopLag_(
+        maxLoopLag_.count() > 0 ||
+        opts.balancing == HTTPServerOptions::Balancing::LEAST_LOOP_LAG),
+      handlerFactories_(handlerFactories),
+      workerGroups_(std::move(workerGroups)),
+      handlerCpuStats_(opts.handlerCpuStats),
+      handlerCpuSampleRate_(std::max(opts.handlerCpuSampleRate, 1u)),
+      requestTimeoutHeader_(opts.requestTimeoutHeader),
+      defaultRequestTimeout_(opts.defaultRequestTimeout),
+      drainWindow_(opts.drainWindow),
+      drainJitter_(opts.drainJitter),
+      minKeepAliveTimeout_(opts.minKeepAliveTimeout),
+      keepAlivePressure_(opts.keepAlivePressure) {
+  downstreamSessionStats_ = opts.sessionStats;
+}
+
+void HTTPServerAcceptor::init(folly::AsyncServerSocket* serverSocket,
+                              folly::EventBase* eventBase) {
+  HTTPSessionAcceptor::init(serverSocket, eventBase);
+  eventBase_ = eventBase;
+  if (measureLoopLag_) {
+    loopLagMonitor_.reset(new LoopLagMonitor(eventBase));
+    loopLagMonitor_->start();
+  }
+  if (!workerGroups_.empty()) {
+    completions_ = std::make_shared<CompletionQueue>(eventBase);
+  }
+  if (minKeepAliveTimeout_.count() > 0) {
+    idleReaper_.reset(new IdleReaper(
+      eventBase, accConfig_.connectionIdleTimeout, minKeepAliveTimeout_,
+      maxConnections_, keepAlivePressure_));
+  }
+  if (drainWindow_.count() > 0) {
+    // the rest of the drain, with the gracefulShutdownTimeout, once every
+    // session had its turn
+    drainScheduler_.reset(new DrainScheduler(
+      eventBase, drainWindow_, drainJitter_, [this] {
+        HTTPSessionAcceptor::acceptStopped();
+      }));
+  }
+}
+
+bool HTTPServerAcceptor::isOverloaded() const {
+  return maxLoopLag_.count() > 0 && loopLagMonitor_ &&
+    loopLagMonitor_->getLag() > maxLoopLag_;
+}
+
+bool HTTPServerAcceptor::shouldRejectRequest(const HTTPTransaction& txn,
+                                             const HTTPMessage& msg) const {
+  if (!rejectRequestsOnOverload_ || !isOverloaded()) {
+    return false;
+  }
+  if (!loadShedder_) {
+    return true;
+  }
+  return loadShedder_->shouldReject(msg.getPath(), txn.getPriority(),
+                                    loopLagMonitor_->getLag(), maxLoopLag_);
+}
+
+std::chrono::milliseconds HTTPServerAcceptor::getLoopLag() const {
+  if (!loopLagMonitor_) {
+    return std::chrono::milliseconds(0);
+  }
+  return loopLagMonitor_->getLag();
+}
+
+bool HTTPServerAcceptor::dispatchConnection(int fd,
+                                            const SocketAddress& clientAddr) {
+  CHECK(eventBase_);
+  // Count the connection now, so that the next ones accepted before this
+  // one gets to the EventBase don't all pick the same acceptor
+  ++pendingConnections_;
+  bool queued = eventBase_->runInEventBaseThread([this, fd, clientAddr] {
+      connectionAccepted(fd, clientAddr);
+      --pendingConnections_;
+    });
+  if (!queued) {
+    --pendingConnections_;
+  }
+  return queued;
+}
+
+bool HTTPServerAcceptor::dispatchConnections(ConnectionBatch& batch) {
+  CHECK(eventBase_);
+  size_t count = batch.size();
+  pendingConnections_ += count;
+  auto connections = std::make_shared<ConnectionBatch>();
+  connections->swap(batch);
+  bool queued = eventBase_->runInEventBaseThread([this, connections] {
+      for (auto& connection: *connections) {
+        connectionAccepted(connection.first, connection.second);
+        --pendingConnections_;
+      }
+    });
+  if (!queued) {
+    pendingConnections_ -= count;
+    batch.swap(*connections);
+  }
+  return queued;
+}
+
+void HTTPServerAcceptor::dispatchAcceptStopped() {
+  CHECK(eventBase_);
+  if (acceptStopped_.exchange(true)) {
+    // several handshake acceptors may hand over to this one
+    return;
+  }
+  eventBase_->runInEventBaseThread([this] {
+      acceptStopped();
+    });
+}
+
+void HTTPServerAcceptor::setHandoff(
+    std::unique_ptr<ConnectionBalancer> handoff) {
+  handoff_ = std::move(handoff);
+}
+
+bool HTTPServerAcceptor::adoptConnection(
+    folly::AsyncSocket::UniquePtr& sock,
+    const SocketAddress& clientAddr,
+    const std::string& nextProtocol,
+    const folly::TransportInfo& tinfo) {
+  CHECK(eventBase_);
+  ++pendingConnections_;
+  folly::AsyncSocket* raw = sock.get();
+  bool queued = eventBase_->runInEventBaseThread(
+    [this, raw, clientAddr, nextProtocol, tinfo] {
+      folly::AsyncSocket::UniquePtr adopted(raw);
+      adopted->attachEventBase(eventBase_);
+      HTTPSessionAcceptor::onNewConnection(std::move(adopted), &clientAddr,
+                                           nextProtocol, tinfo);
+      --pendingConnections_;
+    });
+  if (queued) {
+    sock.release();
+  } else {
+    --pendingConnections_;
+  }
+  return queued;
+}
+
+void HTTPServerAcceptor::acceptStopped() noexcept {
+  if (drainScheduler_ && !drainScheduler_->isStarted()) {
+    std::vector<std::pair<folly::wangle::ManagedConnection*, uint32_t>>
+      connections;
+    connections.reserve(sessions_.size());
+    for (auto session: sessions_) {
+      connections.emplace_back(session, session->getNumIncomingStreams());
+    }
+    drainScheduler_->start(std::move(connections));
+  } else {
+    HTTPSessionAcceptor::acceptStopped();
+  }
+  if (handoff_) {
+    handoff_->acceptStopped();
+  }
+}
+
+void HTTPServerAcceptor::onNewConnection(
+    folly::AsyncSocket::UniquePtr sock,
+    const SocketAddress* address,
+    const std::string& nextProtocol,
+    const folly::TransportInfo& tinfo) {
+  if (!handoff_ || !sock->isDetachable()) {
+    HTTPSessionAcceptor::onNewConnection(std::move(sock), address,
+                                         nextProtocol, tinfo);
+    return;
+  }
+
+  auto target = handoff_->getAcceptor(handoff_->pickAcceptor());
+  sock->detachEventBase();
+  if (!target->adoptConnection(sock, *address, nextProtocol, tinfo)) {
+    // keep it here rather than drop it
+    sock->attachEventBase(eventBase_);
+    HTTPSessionAcceptor::onNewConnection(std::move(sock), address,
+                                         nextProtocol, tinfo);
+  }
+}
+
+void HTTPServerAcceptor::onCreate(const HTTPSession& session) {
+  ++activeConnections_;
+  if (drainScheduler_) {
+    // the sessions are this acceptor's own, only their callbacks are const
+    sessions_.insert(const_cast<HTTPSession*>(&session));
+  }
+  if (idleReaper_) {
+    // idle until its first request
+    idleReaper_->onIdle(const_cast<HTTPSession*>(&session));
+    idleReaper_->setConnections(activeConnections_);
+  }
+}
+
+void HTTPServerAcceptor::onDestroy(const HTTPSession& session) {
+  --activeConnections_;
+  if (drainScheduler_) {
+    auto mutableSession = const_cast<HTTPSession*>(&session);
+    sessions_.erase(mutableSession);
+    drainScheduler_->remove(mutableSession);
+  }
+  if (idleReaper_) {
+    idleReaper_->remove(const_cast<HTTPSession*>(&session));
+    idleReaper_->setConnections(activeConnections_);
+  }
+}
+
+void HTTPServerAcceptor::onActivateConnection(const HTTPSession& session) {
+  if (idleReaper_) {
+    idleReaper_->remove(const_cast<HTTPSession*>(&session));
+  }
+}
+
+void HTTPServerAcceptor::onDeactivateConnection(const HTTPSession& session) {
+  if (idleReaper_) {
+    idleReaper_->onIdle(const_cast<HTTPSession*>(&session));
+  }
+}
+
+DrainScheduler::Progress HTTPServerAcceptor::getDrainProgress() const {
+  DrainScheduler::Progress progress;
+  if (drainScheduler_) {
+    progress = drainScheduler_->getProgress();
+  }
+  progress.remaining = getActiveConnections();
+  return progress;
+}
+
+bool HTTPServerAcceptor::canAccept(const SocketAddress& address) {
+  if (isOverloaded()) {
+    VLOG(3) << "Rejecting connection from " << address << ", loop lag is "
+            << loopLagMonitor_->getLag().count() << "ms";
+    return false;
+  }
+  if (maxConnections_ > 0 && getNumConnections() >= maxConnections_ &&
+      !(idleReaper_ && idleReaper_->evictOldest())) {
+    VLOG(3) << "Rejecting connection from " << address << ", "
+            << getNumConnections() << " connections are open";
+    return false;
+  }
+  if (connectionRateLimiter_ && !connectionRateLimiter_->admit(address)) {
+    VLOG(3) << "Rejecting connection from " << address
+            << ", over its rate limit";
+    return false;
+  }
+  return HTTPSessionAcceptor::canAccept(address);
 }
 
 void HTTPServerAcceptor::setCompletionCallback(std::function<void()> f) {
@@ -68,21 +359,89 @@ HTTPTransactionHandler* HTTPServerAcceptor::newHandler(
     HTTPTransaction& txn,
     HTTPMessage* msg) noexcept {
 
-  SocketAddress clientAddr, vipAddr;
-  txn.getPeerAddress(clientAddr);
-  txn.getLocalAddress(vipAddr);
-  msg->setClientAddress(clientAddr);
-  msg->setDstAddress(vipAddr);
+  // shared with the other requests of the session, and only formatted if
+  // someone asks for the strings
+  msg->setClientAddress(txn.getCachedPeerAddress());
+  msg->setDstAddress(txn.getCachedLocalAddress());
+
+  setRequestedDeadline(*msg);
+  if (msg->isExpired()) {
+    // the client doesn't wait for anything better
+    return new HTTPDirectResponseHandler(504, "Gateway Timeout");
+  }
+
+  if (accConfig_.egressShaping) {
+    int egressClass = accConfig_.egressShaping->getPathClass(msg->getPath());
+    if (egressClass >= 0) {
+      txn.setEgressClass(egressClass);
+    }
+  }
+
+  if (maxLoopLag_.count() > 0) {
+    // the SPDY response headers of the thread's sessions are deflated at
+    // level 1 while it lags
+    GzipHeaderCodec::setThreadMaxLevel(
+      isOverloaded() ? 1 : Z_BEST_COMPRESSION);
+  }
+
+  if (shouldRejectRequest(txn, *msg)) {
+    // cheaper than any handler, and keeps the connection
+    return new HTTPDirectResponseHandler(503, "Service Unavailable");
+  }
+
+  const auto defaultDeadline = msg->getStartTime() + defaultRequestTimeout_;
+  for (auto group: workerGroups_) {
+    if (group->matches(*msg)) {
+      // the group builds its chain later, on its own thread, so its
+      // routes' timeouts only apply if there is no default
+      if (!msg->hasDeadline() && defaultRequestTimeout_.count() > 0) {
+        msg->setDeadline(defaultDeadline);
+      }
+      return new RequestHandlerAdaptor(group->newHandler(completions_));
+    }
+  }
 
   // Create filters chain
   RequestHandler* h = nullptr;
+  RequestHandler* app = nullptr;
   for (auto& factory: handlerFactories_) {
     h = factory->onRequest(h, msg);
+    if (!app) {
+      app = h;
+    }
   }
 
+  // after the chain, whose Router may have set the route's own
+  if (!msg->hasDeadline() && defaultRequestTimeout_.count() > 0) {
+    msg->setDeadline(defaultDeadline);
+  }
+
+  if (handlerCpuStats_ && app && handlerCpuCountdown_-- == 0) {
+    handlerCpuCountdown_ = handlerCpuSampleRate_ - 1;
+    return new RequestHandlerAdaptor(h, handlerCpuStats_, typeid(*app));
+  }
   return new RequestHandlerAdaptor(h);
 }
 
+void HTTPServerAcceptor::setRequestedDeadline(HTTPMessage& msg) const {
+  if (requestTimeoutHeader_.empty()) {
+    return;
+  }
+  const auto& value = msg.getHeaders().getSingleOrEmpty(requestTimeoutHeader_);
+  if (value.empty()) {
+    return;
+  }
+  uint64_t timeout;
+  try {
+    timeout = folly::to<uint64_t>(value);
+  } catch (const std::range_error&) {
+    VLOG(4) << "Ignoring bad " << requestTimeoutHeader_ << ": " << value;
+    return;
+  }
+  timeout = std::min(timeout, kMaxRequestTimeoutMs);
+  msg.setDeadline(msg.getStartTime() + std::chrono::milliseconds(timeout));
+}
+
 void HTTPServerAcceptor::onConnectionsDrained() {
   if (completionCallback_) {
     completionCallback_();
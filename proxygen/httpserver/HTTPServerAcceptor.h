@@ -9,21 +9,35 @@
  */
 #pragma once
 
+#include <proxygen/httpserver/DrainScheduler.h>
 #include <proxygen/httpserver/HTTPServer.h>
 #include <proxygen/httpserver/HTTPServerOptions.h>
+#include <proxygen/httpserver/IdleReaper.h>
+#include <proxygen/httpserver/WorkerGroup.h>
 #include <proxygen/lib/http/session/HTTPSessionAcceptor.h>
+#include <proxygen/lib/utils/LoopLagMonitor.h>
+
+#include <atomic>
+#include <unordered_set>
 
 namespace proxygen {
 
+class ConnectionBalancer;
+
 class HTTPServerAcceptor final : public HTTPSessionAcceptor {
  public:
   static AcceptorConfiguration makeConfig(
     const HTTPServer::IPConfig& ipConfig,
     const HTTPServerOptions& opts);
 
+  /**
+   * The requests that match one of workerGroups, in order, are handed to
+   * that group instead of getting the chain of opts' handlerFactories
+   */
   static std::unique_ptr<HTTPServerAcceptor> make(
     const AcceptorConfiguration& conf,
-    const HTTPServerOptions& opts);
+    const HTTPServerOptions& opts,
+    std::vector<WorkerGroup*> workerGroups = std::vector<WorkerGroup*>());
 
   /**
    * Invokes the given method when all the connections are drained
@@ -32,17 +46,149 @@ class HTTPServerAcceptor final : public HTTPSessionAcceptor {
 
   ~HTTPServerAcceptor();
 
+  void init(folly::AsyncServerSocket* serverSocket,
+            folly::EventBase* eventBase) override;
+
+  /**
+   * @return true if the loop lag is past options' maxLoopLag
+   */
+  bool isOverloaded() const;
+
+  /**
+   * @return true if the request must get a 503 rather than a handler, see
+   *         HTTPServerOptions::rejectRequestsOnOverload
+   */
+  bool shouldRejectRequest(const HTTPTransaction& txn,
+                           const HTTPMessage& msg) const;
+
+  /**
+   * Connections handed to this acceptor, from sessions created until they
+   * are destroyed, plus the ones dispatched by dispatchConnection() and not
+   * picked up yet. May be called from any thread.
+   */
+  uint32_t getActiveConnections() const {
+    return activeConnections_.load(std::memory_order_relaxed) +
+      pendingConnections_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The loop lag measured in this acceptor's EventBase, zero if it isn't
+   * measured. May be called from any thread.
+   */
+  std::chrono::milliseconds getLoopLag() const;
+
+  /**
+   * How far the drain of the connections went, once accepting stopped.
+   * Only the connections there were at that point are counted as notified
+   * with HTTPServerOptions::drainWindow. May be called from any thread.
+   */
+  DrainScheduler::Progress getDrainProgress() const;
+
+  /**
+   * Hand over a connection accepted in another thread to this acceptor's
+   * EventBase. May be called from any thread.
+   *
+   * @return false if the EventBase took no more work, the caller still owns
+   *         the fd in that case
+   */
+  bool dispatchConnection(int fd, const folly::SocketAddress& clientAddr);
+
+  typedef std::vector<std::pair<int, folly::SocketAddress>> ConnectionBatch;
+
+  /**
+   * Like dispatchConnection(), for several connections at once with a
+   * single wakeup of the EventBase. The batch is left empty, or untouched
+   * on failure.
+   */
+  bool dispatchConnections(ConnectionBatch& batch);
+
+  /**
+   * Tell the acceptor, in its EventBase, that no more connections will be
+   * dispatched, so that it drains the ones it has. Only the first call
+   * does anything.
+   */
+  void dispatchAcceptStopped();
+
+  /**
+   * Make this acceptor only set up connections, with their TLS handshake,
+   * and hand them over to the acceptors of handoff, which create the
+   * sessions in their own EventBase.
+   */
+  void setHandoff(std::unique_ptr<ConnectionBalancer> handoff);
+
+  /**
+   * Take over a connection set up in another thread, and detached from its
+   * EventBase. May be called from any thread.
+   *
+   * @return false if the EventBase took no more work, sock is left to the
+   *         caller in that case
+   */
+  bool adoptConnection(folly::AsyncSocket::UniquePtr& sock,
+                       const folly::SocketAddress& clientAddr,
+                       const std::string& nextProtocol,
+                       const folly::TransportInfo& tinfo);
+
+  // AsyncServerSocket::AcceptCallback
+  void acceptStopped() noexcept override;
+
  private:
   HTTPServerAcceptor(const AcceptorConfiguration& conf,
-                     std::vector<RequestHandlerFactory*> handlerFactories);
+                     const HTTPServerOptions& opts,
+                     std::vector<RequestHandlerFactory*> handlerFactories,
+                     std::vector<WorkerGroup*> workerGroups);
 
   // HTTPSessionAcceptor
   HTTPTransaction::Handler* newHandler(HTTPTransaction& txn,
                                        HTTPMessage* msg) noexcept override;
   void onConnectionsDrained() override;
+  bool canAccept(const folly::SocketAddress& address) override;
+  void onNewConnection(folly::AsyncSocket::UniquePtr sock,
+                       const folly::SocketAddress* address,
+                       const std::string& nextProtocol,
+                       const folly::TransportInfo& tinfo) override;
+  void onCreate(const HTTPSession&) override;
+  void onDestroy(const HTTPSession&) override;
+  void onActivateConnection(const HTTPSession&) override;
+  void onDeactivateConnection(const HTTPSession&) override;
+
+  /**
+   * Set the deadline that the client asked for in requestTimeoutHeader_,
+   * if any
+   */
+  void setRequestedDeadline(HTTPMessage& msg) const;
 
   std::function<void()> completionCallback_;
+  folly::EventBase* eventBase_{nullptr};
+  std::unique_ptr<LoopLagMonitor> loopLagMonitor_;
+  std::atomic<uint32_t> activeConnections_{0};
+  std::atomic<uint32_t> pendingConnections_{0};
+  std::atomic<bool> acceptStopped_{false};
+  // with HTTPServerOptions::drainWindow
+  std::unique_ptr<DrainScheduler> drainScheduler_;
+  std::unordered_set<HTTPSession*> sessions_;
+  std::unique_ptr<ConnectionBalancer> handoff_;
+  // with HTTPServerOptions::minKeepAliveTimeout
+  std::unique_ptr<IdleReaper> idleReaper_;
+  const std::chrono::milliseconds maxLoopLag_;
+  const uint32_t maxConnections_;
+  const bool rejectRequestsOnOverload_;
+  const LoadShedder* const loadShedder_;
+  RateLimiter* const connectionRateLimiter_;
+  const bool measureLoopLag_;
   const std::vector<RequestHandlerFactory*> handlerFactories_{nullptr};
+  const std::vector<WorkerGroup*> workerGroups_;
+  // where the worker groups send the responses back to, with groups only
+  std::shared_ptr<CompletionQueue> completions_;
+  StatsRegistry* const handlerCpuStats_;
+  const uint32_t handlerCpuSampleRate_;
+  const std::string requestTimeoutHeader_;
+  const std::chrono::milliseconds defaultRequestTimeout_;
+  const std::chrono::milliseconds drainWindow_;
+  const double drainJitter_;
+  const std::chrono::milliseconds minKeepAliveTimeout_;
+  const double keepAlivePressure_;
+  // requests left until the next one whose CPU time is measured
+  uint32_t handlerCpuCountdown_{0};
 };
 
 }
@@ -12,10 +12,18 @@
 #include <folly/SocketAddress.h>
 #include <proxygen/httpserver/Filters.h>
 #include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/ssl/SSLSessionCache.h>
 #include <signal.h>
 
 namespace proxygen {
 
+struct EgressShaperConfig;
+class HTTPSessionStats;
+class LoadShedder;
+class RateLimiter;
+class SlowTransactionSampler;
+class StatsRegistry;
+
 /**
  * Configuration options for HTTPServer
  *
@@ -28,10 +36,13 @@ class HTTPServerOptions {
    * Number of threads to start to handle requests. Note that this excludes
    * the thread you call `HTTPServer.start()` in.
    *
+   * If `threads == 0`, no worker threads are created and the acceptors,
+   * sessions and handlers all run on the EventBase of the thread calling
+   * `HTTPServer.start()`. This avoids the thread hop from the accept loop
+   * to a worker, which is useful for small, lightly loaded servers.
+   *
    * XXX: Put some perf numbers to help user decide how many threads to
    *      create.
-   * XXX: Maybe support not creating any more worker threads and doing all
-   *      the work in same thread when `threads == 0`.
    */
   size_t threads = 1;
 
@@ -51,22 +62,123 @@ class HTTPServerOptions {
   std::vector<std::unique_ptr<RequestHandlerFactory>> handlerFactories;
 
   /**
-   * This idle timeout serves two purposes -
-   *
-   * 1. How long to keep idle connections around before throwing them away.
-   *
-   * 2. If it takes client more than this time to send request, we fail the
-   *    request.
+   * Handler threads of their own for some of the requests, so that an
+   * expensive tenant or endpoint only takes the cores of its group. The
+   * sessions stay on the handler threads above; a request whose Host is
+   * one of `hosts` ("*.example.com" matches any subdomain, the port is
+   * left out), or whose path starts with one of `pathPrefixes`, is handed
+   * to the least busy thread of the first group that matches, built by
+   * that group's chain of `handlerFactories`, and its response comes back
+   * the same way. See WorkerGroup. Other requests get `handlerFactories`
+   * above.
    *
-   * XXX: Maybe have separate time limit for both?
+   * Each group has `threads` threads, pinned like `threadAffinity`.
+   */
+  struct WorkerGroupConfig {
+    std::string name;
+    size_t threads{1};
+    std::vector<std::vector<int>> threadAffinity;
+    std::vector<std::string> hosts;
+    std::vector<std::string> pathPrefixes;
+    std::vector<std::unique_ptr<RequestHandlerFactory>> handlerFactories;
+  };
+  std::vector<WorkerGroupConfig> workerGroups;
+
+  /**
+   * How long a request may be idle, receiving or sending nothing, before we
+   * fail it. Unless set on their own, also how long to keep idle
+   * connections around before throwing them away (`keepAliveTimeout`), and
+   * how long a client may take to send the headers of a request, from its
+   * first byte (`headerTimeout`).
    */
   std::chrono::milliseconds idleTimeout{60000};
+  std::chrono::milliseconds keepAliveTimeout{0};
+  std::chrono::milliseconds headerTimeout{0};
+
+  /**
+   * If set, the keep-alive of the idle connections of a handler thread
+   * shrinks down to `minKeepAliveTimeout` as the thread gets closer to
+   * `maxConnectionsPerThread` connections or to its memoryBudget, from
+   * `keepAlivePressure` of either, and the connections idle for the
+   * longest are closed first. At maxConnectionsPerThread, the thread
+   * closes its oldest idle connection for a new one instead of refusing
+   * it. See IdleReaper.
+   */
+  std::chrono::milliseconds minKeepAliveTimeout{0};
+  double keepAlivePressure{0.5};
 
   /**
    * TCP server socket backlog to start with.
    */
   uint32_t listenBacklog{1024};
 
+  /**
+   * If non zero, the listening sockets accept TCP Fast Open, with up to
+   * this many connections whose SYN carried data but whose handshake isn't
+   * done yet. Clients that connected once then send their request in the
+   * SYN and save a round trip. Requires Linux >= 3.7, with bit 1 of
+   * net.ipv4.tcp_fastopen set.
+   */
+  uint32_t fastOpenQueueLength{0};
+
+  /**
+   * If true, every handler thread opens its own SO_REUSEPORT listening socket
+   * for each address and accepts on its own EventBase. The kernel then
+   * spreads incoming connections across the workers and there is no handoff
+   * from the thread that called `HTTPServer.start()`.
+   *
+   * Requires SO_REUSEPORT support in the kernel (Linux >= 3.9).
+   */
+  bool reusePort{false};
+
+  /**
+   * CPUs to pin handler threads to. Handler thread `i` is restricted to the
+   * CPU ids in `threadAffinity[i % threadAffinity.size()]`. Leave empty to
+   * let the scheduler place threads freely.
+   *
+   * Threads are pinned before their EventBase is created, so with the
+   * default first-touch memory policy the session state and buffers they
+   * allocate end up on the NUMA node local to those CPUs.
+   */
+  std::vector<std::vector<int>> threadAffinity;
+
+  /**
+   * If true (and `reusePort` is set), each handler thread marks its
+   * listening sockets with SO_INCOMING_CPU set to the first CPU it is pinned
+   * to. The kernel then prefers handing a new connection to the socket whose
+   * CPU took the NIC interrupt, keeping the connection on the same NUMA node
+   * as the receive queue. Requires `threadAffinity` and Linux >= 4.4.
+   */
+  bool steerByIncomingCpu{false};
+
+  /**
+   * If true (and `reusePort` is set), a classic BPF program attached to
+   * the SO_REUSEPORT group of each address hands a new connection to the
+   * socket of the handler thread pinned to the CPU that took its packets,
+   * so that the connection is processed where its NIC interrupt was
+   * handled. Unlike `steerByIncomingCpu` this is not a preference: only
+   * the connections arriving on CPUs no thread is pinned to are spread by
+   * hash. Requires `threadAffinity`, with the CPUs of the NIC queues in
+   * it, and Linux >= 4.6. The server must be alone in its groups.
+   */
+  bool steerByCpuBpf{false};
+
+  /**
+   * If true, the handler threads do the socket I/O of their plaintext
+   * connections through io_uring, batching the reads and writes of a loop
+   * iteration into one system call. Falls back to plain sockets where the
+   * kernel can't (Linux < 6.0).
+   */
+  bool ioUring{false};
+
+  /**
+   * If true, the buffers, sessions and stream table entries of the handler
+   * threads come from 2MB regions backed by huge pages, reserved ones if
+   * the system has some and transparent ones otherwise, so that the memory
+   * of many connections takes fewer TLB entries. See IOBufSlab.
+   */
+  bool hugePageArenas{false};
+
   /**
    * Signals on which to shutdown the server. Mostly you will want
    * {SIGINT, SIGTERM}. Note, if you have multiple deamons running or you want
@@ -75,11 +187,224 @@ class HTTPServerOptions {
    */
   std::vector<int> shutdownOn{};
 
+  /**
+   * If non zero, stop() drains the connections of each handler thread over
+   * this long instead of all at once, the least busy first, so that their
+   * clients don't all reconnect to the other servers in the same burst.
+   * Each connection gets its GOAWAY, or its idle close, at a random point
+   * of its share of the window, drainJitter being the fraction of the
+   * share it moves over. See DrainScheduler and
+   * HTTPServer::getDrainProgress().
+   */
+  std::chrono::milliseconds drainWindow{0};
+  double drainJitter{1.0};
+
+  /**
+   * If set, the server listens on this Unix socket path for the process
+   * that replaces it, see SocketTakeover.h. That process calls
+   * `HTTPServer::takeover()` instead of `bind()` with the same path; it
+   * gets the listening sockets, starts accepting on them, and then this
+   * server stops as if `stop()` was called, draining its connections. No
+   * connection is refused during the restart. Not supported with
+   * `reusePort`.
+   */
+  std::string takeoverPath;
+
   /**
    * Set to true if you want to support CONNECT request. Most likely you
    * don't want that.
    */
   bool supportsConnect{false};
+
+  /**
+   * If greater than 1, up to this many pipelined HTTP/1.1 requests of a
+   * connection go to their handlers at once, instead of each waiting for
+   * the response to the previous one. The responses that are ready early
+   * are held, up to maxPipelinedBufferBytes of body per connection before
+   * the connection stops reading requests, and written in order.
+   */
+  uint32_t maxPipelinedRequests{0};
+  uint64_t maxPipelinedBufferBytes{1 << 20};
+
+  /**
+   * The body of an HTTP/1.x request goes to the handler in one onBody()
+   * per read rather than one per chunk. The handlers of this server don't
+   * see the chunk boundaries either way.
+   */
+  bool coalesceIngressBody{true};
+
+  /**
+   * The connections of a handler thread write in turns from one loop
+   * callback of the thread rather than one per connection, and at most
+   * `egressBytesPerLoop` together per loop iteration (0 for no limit), so
+   * that a few fast connections can't keep the others waiting.
+   */
+  bool sharedEgressFlusher{false};
+  uint64_t egressBytesPerLoop{0};
+
+  /**
+   * The most bytes of ingress a connection parses, and dispatches the
+   * requests of, before the other connections of its handler thread get
+   * their turn, 0 for no limit. The rest is parsed in a later loop
+   * callback. Keeps a client that sends a large batch of pipelined
+   * requests or SPDY frames from delaying the other clients.
+   */
+  uint64_t ingressBytesPerLoop{0};
+
+  /**
+   * Shape the egress of the connections of each handler thread together,
+   * in the classes of `egressShaping`, so that bulk downloads leave
+   * bandwidth to the latency sensitive responses. A response is in the
+   * class of the longest of its `pathClasses` prefixes, else in the one of
+   * its priority. See EgressShaper.
+   */
+  std::shared_ptr<const EgressShaperConfig> egressShaping;
+
+  /**
+   * Let the clients of a plaintext HTTP/1.1 address move their connection
+   * to HTTP/2, either by starting with the HTTP/2 connection preface or
+   * with an `Upgrade: h2c` request, instead of opening more connections.
+   */
+  bool allowH2C{false};
+
+  /**
+   * Capacity of the TLS session cache that the handler threads share for
+   * each address with sslConfigs, 0 to leave sessions to the cache of
+   * each thread. See SSLSessionCache.
+   */
+  size_t sslSessionCacheSize{SSLSessionCache::kDefaultCapacity};
+
+  /**
+   * Admission control. While the event loop of a handler thread runs its
+   * timeouts more than `maxLoopLag` late (see LoopLagMonitor), or while it
+   * has `maxConnectionsPerThread` open connections, the thread accepts no
+   * new connections. With `rejectRequestsOnOverload`, the new requests on
+   * the connections it has get a 503 without reaching the handlers while
+   * the loop lags. Zero disables a limit. The SPDY header compression of
+   * the thread also drops to level 1 while the loop lags.
+   *
+   * If `loadShedder` is set, it decides which of those requests get the
+   * 503, by their route and priority, so that the critical ones still get
+   * through. Must outlive the server.
+   */
+  std::chrono::milliseconds maxLoopLag{0};
+  uint32_t maxConnectionsPerThread{0};
+  bool rejectRequestsOnOverload{false};
+  const LoadShedder* loadShedder{nullptr};
+
+  /**
+   * If set, each new connection takes a token for its client IP and is
+   * refused, before any TLS or parsing work, if there is none. Can be the
+   * limiter of a RateLimitFilterFactory keyed by CLIENT_IP, to count both
+   * connections and requests. Must outlive the server.
+   */
+  RateLimiter* connectionRateLimiter{nullptr};
+
+  /**
+   * Request deadlines, so that no work goes into the requests that the
+   * clients gave up on. A request whose `requestTimeoutHeader` holds a
+   * number of milliseconds (say "X-Request-Timeout: 500") must be answered
+   * that long after it started arriving; the others get
+   * `defaultRequestTimeout`, unless their Router route has a timeout of its
+   * own. Empty or zero disables them. See HTTPMessage::getDeadline().
+   *
+   * A request that expired before it gets a handler, e.g. while queued for
+   * a worker group, gets a 504 instead. The handlers can ask for the
+   * budget left, and ProxyHandler passes it on upstream.
+   */
+  std::string requestTimeoutHeader;
+  std::chrono::milliseconds defaultRequestTimeout{0};
+
+  /**
+   * How the thread calling `HTTPServer.start()` spreads accepted
+   * connections over the handler threads. By default every handler thread
+   * takes its turn. With LEAST_CONNECTIONS or LEAST_LOOP_LAG, each
+   * connection goes to the thread with the fewest open connections, or
+   * with the lowest loop lag, so that a thread stuck with a few expensive
+   * connections gets no more of them. Ignored with `reusePort`, where the
+   * kernel picks the thread.
+   */
+  enum class Balancing: uint8_t {
+    ROUND_ROBIN,
+    LEAST_CONNECTIONS,
+    LEAST_LOOP_LAG,
+  };
+  Balancing balancing{Balancing::ROUND_ROBIN};
+
+  /**
+   * The most connections a listening socket accepts per wakeup of its
+   * loop, 0 for the AsyncServerSocket default (30). A higher budget drains
+   * the accept queue faster in a connection flood, and holds up the other
+   * events of the loop longer.
+   */
+  uint32_t acceptBudget{0};
+
+  /**
+   * If non zero, the connections accepted in one loop iteration are handed
+   * to the handler threads together, with one wakeup of each, this many
+   * consecutive ones going to the same thread and `balancing` picking the
+   * thread of each group. The accept stats of the sockets are then kept,
+   * see HTTPServer::getAcceptStats(). Ignored with `reusePort` or
+   * `threads == 0`.
+   */
+  uint32_t acceptBatchGroupSize{0};
+
+  /**
+   * If non zero, the connections to the addresses with sslConfigs are
+   * accepted and TLS handshaked by this many dedicated threads, and only
+   * handed to the handler threads once they are established, following
+   * `balancing`. The private key operations and certificate checks of a
+   * burst of new connections then don't hold up the requests of the
+   * connections the handler threads already have. Ignored with
+   * `reusePort` or `threads == 0`.
+   */
+  size_t sslHandshakeThreads{0};
+
+  /**
+   * If set, the stats the downstream sessions of all the threads record,
+   * such as StatsRegistry::getSessionStats(). Must outlive the server.
+   */
+  HTTPSessionStats* sessionStats{nullptr};
+
+  /**
+   * If set, one in handlerCpuSampleRate requests measures the thread CPU
+   * time spent in its handler chain, and in the ResponseHandler calls the
+   * chain makes, and records it in this registry under the type of the
+   * handler the innermost factory made (the route's handler, with a
+   * Router). Must outlive the server.
+   */
+  StatsRegistry* handlerCpuStats{nullptr};
+  uint32_t handlerCpuSampleRate{64};
+
+  /**
+   * If set, each handler and handshake thread observes one in
+   * loopStatsSampleRate iterations of its event loop (see LoopMonitor), and
+   * adds what it finds to this registry as "http-worker.<i>" or
+   * "http-handshake.<i>". Must outlive the server.
+   */
+  StatsRegistry* loopStats{nullptr};
+  uint32_t loopStatsSampleRate{1};
+
+  /**
+   * If set, each handler thread caches the time of each iteration of its
+   * event loop (see LoopClock), and the lazy transaction timeouts and the
+   * connect timings read it instead of the clock. The cached time lags by
+   * as long as the iteration has run.
+   */
+  bool loopClock{false};
+
+  /**
+   * If set, the state of the transactions still open after the threshold
+   * of this sampler is recorded in it, for SlowTransactionDebugHandler.
+   */
+  std::shared_ptr<SlowTransactionSampler> slowTransactionSampler;
+
+  /**
+   * If not 0, each session reads TCP_INFO as its transactions end, at most
+   * once per interval, for the RTT, congestion window and retransmission
+   * stats of sessionStats and for the window autotuner.
+   */
+  std::chrono::milliseconds tcpInfoSampleInterval{0};
 };
 
 }
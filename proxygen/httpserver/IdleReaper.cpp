@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/IdleReaper.h>
+
+#include <algorithm>
+#include <proxygen/lib/http/session/MemoryBudget.h>
+
+using folly::wangle::ManagedConnection;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+namespace {
+
+// how far used is between the threshold of limit and limit, 0 to 1
+double getFraction(uint64_t used, uint64_t limit, double threshold) {
+  if (limit == 0) {
+    return 0;
+  }
+  double start = limit * threshold;
+  if (used <= start) {
+    return 0;
+  }
+  if (used >= limit || start >= limit) {
+    return 1;
+  }
+  return (used - start) / (limit - start);
+}
+
+}
+
+IdleReaper::IdleReaper(folly::TimeoutManager* timeoutManager,
+                       milliseconds idleTimeout,
+                       milliseconds minIdleTimeout,
+                       uint32_t maxConnections,
+                       double threshold)
+    : folly::AsyncTimeout(timeoutManager),
+      idleTimeout_(idleTimeout),
+      minIdleTimeout_(std::min(minIdleTimeout, idleTimeout)),
+      maxConnections_(maxConnections),
+      threshold_(std::min(std::max(threshold, 0.0), 1.0)) {
+}
+
+void IdleReaper::onIdle(ManagedConnection* connection) {
+  remove(connection);
+  idle_.push_back({connection, getCurrentTime()});
+  index_[connection] = std::prev(idle_.end());
+  if (!isScheduled()) {
+    // there may be memory pressure since the last look
+    scheduleNext();
+  }
+}
+
+void IdleReaper::remove(ManagedConnection* connection) {
+  auto it = index_.find(connection);
+  if (it == index_.end()) {
+    return;
+  }
+  bool oldest = it->second == idle_.begin();
+  idle_.erase(it->second);
+  index_.erase(it);
+  if (oldest) {
+    scheduleNext();
+  }
+}
+
+void IdleReaper::setConnections(uint32_t connections) {
+  bool more = connections > connections_;
+  connections_ = connections;
+  // more pressure may bring the deadline closer, less is handled when
+  // the timeout fires
+  if (more || !isScheduled()) {
+    scheduleNext();
+  }
+}
+
+bool IdleReaper::evictOldest() {
+  if (idle_.empty()) {
+    return false;
+  }
+  VLOG(4) << "Evicting the oldest of " << idle_.size()
+          << " idle connections";
+  close(idle_.front().connection);
+  return true;
+}
+
+double IdleReaper::getPressure() const {
+  auto& memory = MemoryBudget::get();
+  return std::max(getFraction(connections_, maxConnections_, threshold_),
+                  getFraction(memory.getUsed(), memory.getLimit(),
+                              threshold_));
+}
+
+milliseconds IdleReaper::getIdleTimeout() const {
+  double shrink = getPressure() * (idleTimeout_ - minIdleTimeout_).count();
+  return idleTimeout_ - milliseconds(uint64_t(shrink));
+}
+
+void IdleReaper::timeoutExpired() noexcept {
+  const auto timeout = getIdleTimeout();
+  const TimePoint now = getCurrentTime();
+  while (timeout < idleTimeout_ && !idle_.empty() &&
+         now - idle_.front().since >= timeout) {
+    close(idle_.front().connection);
+  }
+  scheduleNext();
+}
+
+void IdleReaper::scheduleNext() {
+  if (idle_.empty() || getPressure() == 0) {
+    // the connections' own idle timeout applies
+    cancelTimeout();
+    return;
+  }
+  TimePoint deadline = idle_.front().since + getIdleTimeout();
+  if (isScheduled() && deadline_ <= deadline) {
+    return;
+  }
+  deadline_ = deadline;
+  auto delay = std::chrono::duration_cast<milliseconds>(
+    deadline - getCurrentTime() + milliseconds(1) - microseconds(1));
+  scheduleTimeout(std::max(delay, milliseconds(0)).count());
+}
+
+void IdleReaper::close(ManagedConnection* connection) {
+  // closing it removes it, unless it isn't as idle as it was thought
+  remove(connection);
+  folly::DelayedDestruction::DestructorGuard dg(connection);
+  connection->closeWhenIdle();
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/experimental/wangle/ManagedConnection.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/TimeoutManager.h>
+#include <list>
+#include <proxygen/lib/utils/Time.h>
+#include <unordered_map>
+
+namespace proxygen {
+
+/**
+ * Shortens the keep-alive of the idle connections of a thread as it runs
+ * short of connections or of memory, so that it closes the connections
+ * that cost it the most for the least rather than refuse new ones.
+ *
+ * The pressure goes from 0 at `threshold` of maxConnections, or of the
+ * MemoryBudget of the thread, whichever is higher, to 1 at the limit, and
+ * the keep-alive shrinks with it from idleTimeout to minIdleTimeout. The
+ * connections idle for longer are closed, the oldest first. Without
+ * pressure the reaper does nothing, the idleTimeout of the connections
+ * applies. At the connection limit, evictOldest() makes room for a new
+ * connection.
+ *
+ * The connections are told when they become idle and busy, and must be
+ * removed when they go away, such as from closeWhenIdle(). Lives in the
+ * thread of its TimeoutManager.
+ */
+class IdleReaper : private folly::AsyncTimeout {
+ public:
+  IdleReaper(folly::TimeoutManager* timeoutManager,
+             std::chrono::milliseconds idleTimeout,
+             std::chrono::milliseconds minIdleTimeout,
+             uint32_t maxConnections,
+             double threshold);
+
+  /**
+   * The connection has no request, since now
+   */
+  void onIdle(folly::wangle::ManagedConnection* connection);
+
+  /**
+   * The connection has a request again, or is going away
+   */
+  void remove(folly::wangle::ManagedConnection* connection);
+
+  /**
+   * The number of open connections changed
+   */
+  void setConnections(uint32_t connections);
+
+  /**
+   * Close the connection idle for the longest, to make room for another
+   *
+   * @return false if none is idle
+   */
+  bool evictOldest();
+
+  /**
+   * From 0, no pressure, to 1, at a limit
+   */
+  double getPressure() const;
+
+  /**
+   * How long the connections may be idle under the current pressure
+   */
+  std::chrono::milliseconds getIdleTimeout() const;
+
+  size_t getIdleConnections() const {
+    return idle_.size();
+  }
+
+ private:
+  struct Idle {
+    folly::wangle::ManagedConnection* connection;
+    TimePoint since;
+  };
+
+  void timeoutExpired() noexcept override;
+  void scheduleNext();
+  void close(folly::wangle::ManagedConnection* connection);
+
+  const std::chrono::milliseconds idleTimeout_;
+  const std::chrono::milliseconds minIdleTimeout_;
+  const uint32_t maxConnections_;
+  const double threshold_;
+  uint32_t connections_{0};
+  // the oldest first
+  std::list<Idle> idle_;
+  std::unordered_map<folly::wangle::ManagedConnection*,
+                     std::list<Idle>::iterator> index_;
+  // when the scheduled timeout fires, if it is
+  TimePoint deadline_;
+};
+
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/LoadShedder.h>
+
+#include <algorithm>
+
+namespace proxygen {
+
+namespace {
+
+// priorities of a criticality, and steps of the lag thresholds in each of
+// the two sheddable ones
+const uint32_t kNumPriorities = 8;
+const uint32_t kNumSteps = 2 * kNumPriorities;
+
+}
+
+LoadShedder& LoadShedder::setCriticality(const std::string& pathPrefix,
+                                         Criticality criticality) {
+  for (auto& route: routes_) {
+    if (route.first == pathPrefix) {
+      route.second = criticality;
+      return *this;
+    }
+  }
+  auto it = std::find_if(
+    routes_.begin(), routes_.end(),
+    [&pathPrefix] (const std::pair<std::string, Criticality>& route) {
+      return route.first.size() < pathPrefix.size();
+    });
+  routes_.emplace(it, pathPrefix, criticality);
+  return *this;
+}
+
+LoadShedder::Criticality LoadShedder::getCriticality(
+    folly::StringPiece path) const {
+  for (const auto& route: routes_) {
+    if (path.startsWith(route.first)) {
+      return route.second;
+    }
+  }
+  return Criticality::DEFAULT;
+}
+
+bool LoadShedder::shouldReject(folly::StringPiece path,
+                               uint8_t priority,
+                               std::chrono::milliseconds lag,
+                               std::chrono::milliseconds maxLag) const {
+  if (lag <= maxLag) {
+    return false;
+  }
+  uint32_t rank;
+  switch (getCriticality(path)) {
+    case Criticality::CRITICAL:
+      return false;
+    case Criticality::DEFAULT:
+      rank = kNumPriorities;
+      break;
+    case Criticality::SHEDDABLE:
+      rank = 0;
+      break;
+  }
+  // the lowest priority goes first
+  rank += kNumPriorities - 1 - std::min<uint32_t>(priority,
+                                                  kNumPriorities - 1);
+  // rejected past maxLag * (1 + rank / kNumSteps)
+  return lag.count() * kNumSteps > maxLag.count() * (kNumSteps + rank);
+}
+
+}
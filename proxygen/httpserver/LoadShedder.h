@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/Range.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Picks the requests a handler thread rejects while its event loop lags
+ * (see HTTPServerOptions::maxLoopLag), so that the least important traffic
+ * is refused first and the critical one keeps its latency.
+ *
+ * A request has the criticality of the longest path prefix it was given
+ * for, DEFAULT if none, and the priority of its transaction, from 0
+ * (highest) to 7 as in the egress queue; plain HTTP/1.x requests have 0.
+ * The SHEDDABLE requests are rejected as the lag grows from maxLoopLag to
+ * 1.5 times it, those of the lowest priority first, and the DEFAULT ones
+ * the same way from 1.5 to twice maxLoopLag. CRITICAL requests are never
+ * rejected, only new connections are while the loop lags.
+ *
+ * Must be set up before the server starts; it is then only read, from
+ * all the handler threads.
+ */
+class LoadShedder {
+ public:
+  enum class Criticality: uint8_t {
+    CRITICAL,
+    DEFAULT,
+    SHEDDABLE,
+  };
+
+  /**
+   * Give criticality to the requests whose path starts with pathPrefix
+   */
+  LoadShedder& setCriticality(const std::string& pathPrefix,
+                              Criticality criticality);
+
+  Criticality getCriticality(folly::StringPiece path) const;
+
+  /**
+   * @return true if the request for path and with priority must be
+   *         rejected with a loop lag of lag
+   */
+  bool shouldReject(folly::StringPiece path,
+                    uint8_t priority,
+                    std::chrono::milliseconds lag,
+                    std::chrono::milliseconds maxLag) const;
+
+ private:
+  // longest prefix first
+  std::vector<std::pair<std::string, Criticality>> routes_;
+};
+
+}
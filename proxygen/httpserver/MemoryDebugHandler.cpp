@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/MemoryDebugHandler.h>
+
+#include <algorithm>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/session/MemoryBudget.h>
+#include <vector>
+
+namespace proxygen {
+
+// Enough for a look at the outliers, and a bound on the response
+static const int kMaxTop = 1000;
+
+void MemoryDebugHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  int top = headers->getIntQueryParam("top", (int)defaultTop_);
+  top_ = std::min(std::max(top, 0), kMaxTop);
+}
+
+void MemoryDebugHandler::onEOM() noexcept {
+  const auto& budget = MemoryBudget::get();
+  auto footprint = budget.getFootprint(top_);
+
+  std::vector<folly::dynamic> sessions;
+  for (const auto consumer: footprint.largest) {
+    folly::dynamic session = folly::dynamic::object;
+    consumer->describeMemory(session);
+    session["bytes"] = (int64_t)consumer->getMemoryFootprint();
+    sessions.push_back(std::move(session));
+  }
+  folly::dynamic result = folly::dynamic::object
+    ("worker_sessions", (int64_t)footprint.consumers)
+    ("worker_bytes", (int64_t)footprint.bytes)
+    ("worker_buffer_bytes", (int64_t)budget.getUsed())
+    ("worker_buffer_limit", (int64_t)budget.getLimit())
+    ("process_buffer_bytes", (int64_t)MemoryBudget::getProcessUsed())
+    ("sessions", folly::dynamic(sessions.begin(), sessions.end()));
+
+  ResponseBuilder(downstream_)
+    .status(200, "OK")
+    .header(HTTP_HEADER_CONTENT_TYPE, "application/json")
+    .body(folly::toJson(result).toStdString())
+    .sendWithEOM();
+}
+
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+
+namespace proxygen {
+
+/**
+ * Debug endpoint for the memory of the sessions of the handler thread that
+ * serves the request: what they hold in all, and the top N sessions by
+ * memory with the breakdown of HTTPSession::getMemoryUsage(), as JSON.
+ * N comes from the "top" query parameter. Each handler thread only sees
+ * its own sessions; the buffered bytes of the whole process are included
+ * as process_buffer_bytes.
+ */
+class MemoryDebugHandler : public RequestHandler {
+ public:
+  explicit MemoryDebugHandler(size_t defaultTop): defaultTop_(defaultTop) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+  }
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override {
+    delete this;
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    delete this;
+  }
+
+ private:
+  const size_t defaultTop_;
+  size_t top_{0};
+};
+
+class MemoryDebugHandlerFactory : public RequestHandlerFactory {
+ public:
+  explicit MemoryDebugHandlerFactory(size_t defaultTop = 10)
+      : defaultTop_(defaultTop) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new MemoryDebugHandler(defaultTop_);
+  }
+
+ private:
+  const size_t defaultTop_;
+};
+
+}
@@ -25,14 +25,18 @@ class MockResponseHandler : public ResponseHandler {
   }
 
   GMOCK_METHOD1_(, noexcept,, sendHeaders, void(HTTPMessage&));
+  GMOCK_METHOD1_(, noexcept,, sendInformational, bool(HTTPMessage&));
   GMOCK_METHOD1_(, noexcept,, sendChunkHeader, void(size_t));
   GMOCK_METHOD1_(, noexcept,, sendBody, void(std::shared_ptr<folly::IOBuf>));
+  GMOCK_METHOD1_(, noexcept,, sendFileRegion, void(const FileRegion&));
   GMOCK_METHOD0_(, noexcept,, sendChunkTerminator, void());
   GMOCK_METHOD0_(, noexcept,, sendEOM, void());
   GMOCK_METHOD0_(, noexcept,, sendAbort, void());
   GMOCK_METHOD0_(, noexcept,, refreshTimeout, void());
   GMOCK_METHOD0_(, noexcept,, pauseIngress, void());
   GMOCK_METHOD0_(, noexcept,, resumeIngress, void());
+  GMOCK_METHOD2_(, noexcept,, newPushedResponse,
+                 ResponseHandler*(PushHandler*, const std::string&));
   const folly::TransportInfo& getSetupTransportInfo() const noexcept {
     return transportInfo;
   }
@@ -0,0 +1,331 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/ProxyHandler.h>
+
+#include <folly/Conv.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/ParseURL.h>
+
+using apache::thrift::transport::TTransportException;
+using folly::EventBaseManager;
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+// Hop-by-hop headers (RFC 7230 6.1), and those the Connection header
+// names, which the SPDY and HTTP/2 codecs would pass on. A request body
+// that came chunked goes chunked to an HTTP/1.x upstream, the other
+// codecs drop the header.
+void removeHopByHopHeaders(HTTPMessage* msg) {
+  HTTPHeaders stripped;
+  msg->getHeaders().stripPerHopHeaders(stripped);
+  if (msg->isRequest() && msg->getIsChunked()) {
+    msg->getHeaders().set(HTTP_HEADER_TRANSFER_ENCODING, "chunked");
+  }
+}
+
+// Any request may go to a multiplexed upstream, which takes the host
+// apart from the path and can't do without it: a URL in absolute form,
+// as sent to forward proxies, goes in origin form with its authority as
+// the Host, and a request without Host, from an HTTP/1.0 client, gets
+// the one of the upstream
+void normalizeRequest(HTTPMessage* msg,
+                      const HTTPSessionPool::Key& upstream) {
+  removeHopByHopHeaders(msg);
+  auto& headers = msg->getHeaders();
+  ParseURL url(msg->getURL());
+  if (url.hasHost()) {
+    std::string host = url.hostAndPort();
+    std::string path = url.path().empty() ? "/" : url.path().str();
+    if (!url.query().empty()) {
+      path.append("?");
+      path.append(url.query().data(), url.query().size());
+    }
+    headers.set(HTTP_HEADER_HOST, host);
+    msg->setURL(std::move(path));
+  } else if (!headers.exists(HTTP_HEADER_HOST)) {
+    headers.set(HTTP_HEADER_HOST, upstream.host.empty() ?
+                upstream.address.describe() : upstream.host);
+  }
+}
+
+}
+
+const size_t ProxyHandler::kDefaultMaxBufferSize;
+
+ProxyHandler::ProxyHandler(HTTPSessionPool* pool,
+                           const HTTPSessionPool::Key& upstream,
+                           std::chrono::milliseconds connectTimeout,
+                           size_t maxBufferSize,
+                           const std::string& deadlineHeader):
+    pool_(CHECK_NOTNULL(pool)),
+    upstream_(upstream),
+    connectTimeout_(connectTimeout),
+    maxBufferSize_(maxBufferSize),
+    deadlineHeader_(deadlineHeader) {
+}
+
+ProxyHandler::~ProxyHandler() {
+  CHECK(!txn_);
+  CHECK(!connecting_);
+}
+
+void ProxyHandler::onRequest(unique_ptr<HTTPMessage> headers) noexcept {
+  request_ = std::move(headers);
+  normalizeRequest(request_.get(), upstream_);
+  auto connectTimeout = connectTimeout_;
+  if (request_->hasDeadline()) {
+    auto budget = request_->getRemainingBudget();
+    if (budget.count() == 0) {
+      sendError(504, "Gateway Timeout");
+      return;
+    }
+    if (connectTimeout.count() == 0 || budget < connectTimeout) {
+      connectTimeout = budget;
+    }
+  }
+  connecting_ = true;
+  // This may call back right away, with a pooled session
+  pool_->getSession(upstream_, this, connectTimeout);
+}
+
+void ProxyHandler::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (txn_) {
+    txn_->sendBody(std::move(body));
+  } else if (connecting_) {
+    pendingBody_.append(std::move(body));
+    updateDownstreamIngress();
+  }
+  // else the upstream failed, and the client got an error already
+}
+
+void ProxyHandler::onUpgrade(UpgradeProtocol protocol) noexcept {
+  // upgrades aren't proxied
+}
+
+void ProxyHandler::onEOM() noexcept {
+  if (txn_) {
+    txn_->sendEOM();
+  } else {
+    requestEOM_ = true;
+  }
+}
+
+void ProxyHandler::requestComplete() noexcept {
+  downstreamDone();
+}
+
+void ProxyHandler::onError(ProxygenError err) noexcept {
+  VLOG(4) << "Downstream error " << getErrorString(err);
+  downstreamDone();
+}
+
+void ProxyHandler::onEgressPaused() noexcept {
+  // the client doesn't keep up, stop reading the response
+  if (txn_) {
+    txn_->pauseIngress();
+  }
+}
+
+void ProxyHandler::onEgressResumed() noexcept {
+  if (txn_) {
+    txn_->resumeIngress();
+  }
+}
+
+void ProxyHandler::sessionAvailable(HTTPUpstreamSession* session) {
+  connecting_ = false;
+  if (!session->newTransaction(&upstreamHandler_)) {
+    upstreamError("no upstream transaction");
+    return;
+  }
+  CHECK(txn_);
+  session_ = session;
+  if (request_->hasDeadline() && !deadlineHeader_.empty()) {
+    request_->getHeaders().set(
+      deadlineHeader_,
+      folly::to<std::string>(request_->getRemainingBudget().count()));
+  }
+  txn_->sendHeaders(*request_);
+  if (!pendingBody_.empty()) {
+    txn_->sendBody(pendingBody_.move());
+  }
+  if (requestEOM_) {
+    txn_->sendEOM();
+  }
+  updateDownstreamIngress();
+}
+
+void ProxyHandler::sessionError(const TTransportException& ex) {
+  connecting_ = false;
+  pendingBody_.move();
+  updateDownstreamIngress();
+  if (request_->isExpired()) {
+    // most likely the connect timeout that the budget cut short
+    VLOG(4) << "Upstream error " << ex.what() << " past the deadline";
+    sendError(504, "Gateway Timeout");
+    return;
+  }
+  upstreamError(ex.what());
+}
+
+void ProxyHandler::upstreamError(const std::string& reason) {
+  VLOG(4) << "Upstream error " << reason;
+  if (downstreamDone_) {
+    return;
+  }
+  if (responseStarted_) {
+    downstream_->sendAbort();
+    return;
+  }
+  sendError(502, "Bad Gateway");
+}
+
+void ProxyHandler::sendError(uint16_t code, const std::string& message) {
+  if (downstreamDone_ || responseStarted_) {
+    return;
+  }
+  responseStarted_ = true;
+  ResponseBuilder(downstream_)
+    .status(code, message)
+    .sendWithEOM();
+}
+
+void ProxyHandler::updateDownstreamIngress() {
+  if (downstreamDone_) {
+    return;
+  }
+  bool pause = upstreamEgressPaused_ ||
+    pendingBody_.chainLength() > maxBufferSize_;
+  if (pause && !downstreamIngressPaused_) {
+    downstream_->pauseIngress();
+  } else if (!pause && downstreamIngressPaused_) {
+    downstream_->resumeIngress();
+  }
+  downstreamIngressPaused_ = pause;
+}
+
+void ProxyHandler::downstreamDone() {
+  downstreamDone_ = true;
+  downstream_ = nullptr;
+  if (connecting_) {
+    pool_->cancel(this);
+    connecting_ = false;
+  }
+  // A finished exchange leaves the upstream session to the pool, anything
+  // else is abandoned
+  if (txn_ && !(txn_->isIngressEOMSeen() && txn_->isEgressEOMQueued())) {
+    txn_->sendAbort();
+  }
+  maybeDelete();
+}
+
+void ProxyHandler::maybeDelete() {
+  if (downstreamDone_ && !txn_) {
+    delete this;
+  }
+}
+
+void ProxyHandler::Upstream::setTransaction(HTTPTransaction* txn) noexcept {
+  proxy_->txn_ = txn;
+}
+
+void ProxyHandler::Upstream::detachTransaction() noexcept {
+  proxy_->txn_ = nullptr;
+  proxy_->session_ = nullptr;
+  proxy_->maybeDelete();
+}
+
+void ProxyHandler::Upstream::onHeadersComplete(unique_ptr<HTTPMessage> msg)
+  noexcept {
+  if (msg->getStatusCode() == 421 && !proxy_->upstream_.host.empty()) {
+    proxy_->pool_->setMisdirected(*proxy_->session_, proxy_->upstream_.host);
+  }
+  if (proxy_->downstreamDone_) {
+    return;
+  }
+  removeHopByHopHeaders(msg.get());
+  proxy_->responseStarted_ = true;
+  proxy_->downstream_->sendHeaders(*msg);
+}
+
+void ProxyHandler::Upstream::onBody(unique_ptr<IOBuf> chain) noexcept {
+  if (!proxy_->downstreamDone_) {
+    proxy_->downstream_->sendBody(std::move(chain));
+  }
+}
+
+void ProxyHandler::Upstream::onTrailers(unique_ptr<HTTPHeaders> trailers)
+  noexcept {
+  // ResponseHandler can't send trailers
+}
+
+void ProxyHandler::Upstream::onEOM() noexcept {
+  if (!proxy_->downstreamDone_) {
+    proxy_->downstream_->sendEOM();
+  }
+}
+
+void ProxyHandler::Upstream::onUpgrade(UpgradeProtocol protocol) noexcept {
+}
+
+void ProxyHandler::Upstream::onError(const HTTPException& error) noexcept {
+  proxy_->upstreamError(error.what());
+}
+
+void ProxyHandler::Upstream::onEgressPaused() noexcept {
+  proxy_->upstreamEgressPaused_ = true;
+  proxy_->updateDownstreamIngress();
+}
+
+void ProxyHandler::Upstream::onEgressResumed() noexcept {
+  proxy_->upstreamEgressPaused_ = false;
+  proxy_->updateDownstreamIngress();
+}
+
+ProxyHandlerFactory::ProxyHandlerFactory(
+  const HTTPSessionPool::Key& upstream,
+  std::chrono::milliseconds connectTimeout,
+  std::chrono::milliseconds transactionTimeout,
+  uint32_t maxIdleSessions,
+  const std::string& deadlineHeader):
+    upstream_(upstream),
+    connectTimeout_(connectTimeout),
+    transactionTimeout_(transactionTimeout),
+    maxIdleSessions_(maxIdleSessions),
+    deadlineHeader_(deadlineHeader) {
+}
+
+void ProxyHandlerFactory::onServerStart() noexcept {
+  auto evb = EventBaseManager::get()->getEventBase();
+  auto state = new ThreadState;
+  state->timeouts.reset(new AsyncTimeoutSet(evb, transactionTimeout_));
+  state->pool.reset(new HTTPSessionPool(evb, state->timeouts.get(),
+                                        maxIdleSessions_));
+  state_.reset(state);
+}
+
+void ProxyHandlerFactory::onServerStop() noexcept {
+  state_.reset();
+}
+
+RequestHandler* ProxyHandlerFactory::onRequest(RequestHandler*, HTTPMessage*)
+  noexcept {
+  return new ProxyHandler(state_->pool.get(), upstream_, connectTimeout_,
+                          ProxyHandler::kDefaultMaxBufferSize,
+                          deadlineHeader_);
+}
+
+}
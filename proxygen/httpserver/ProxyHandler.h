@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPSessionPool.h>
+
+namespace proxygen {
+
+/**
+ * Forwards a request to an upstream server, and its response back, with
+ * a session from an HTTPSessionPool. Body chains are passed through as
+ * they are, without copies.
+ *
+ * The flow control of the two sides is coupled: while the upstream
+ * transaction can't send, the downstream ingress is paused, and while the
+ * client can't take more of the response, the upstream ingress is paused.
+ * Request body that arrives before the upstream transaction exists is
+ * held, up to maxBufferSize before the downstream ingress is paused too.
+ * So a slow client or server never makes the proxy buffer without bound.
+ *
+ * A request with a deadline (see HTTPMessage::getDeadline()) waits for
+ * the upstream connection no longer than its budget, gets a 504 once it
+ * expired, and tells the upstream the budget left in deadlineHeader, if
+ * set, in milliseconds.
+ *
+ * The request may come in any protocol and go out in any other: with a
+ * SPDY or HTTP/2 upstream (see HTTPSessionPool::Key), the requests of the
+ * HTTP/1.x clients share its sessions. The hop-by-hop headers are removed
+ * both ways, with those named by Connection, and the request is given the
+ * Host and origin form URL the multiplexed protocols need.
+ *
+ * A 421 from a session the pool shared with another host is passed on to
+ * the client, and the next request for the host gets a session of its
+ * own.
+ */
+class ProxyHandler : public RequestHandler,
+                     private HTTPSessionPool::Callback {
+ public:
+  static const size_t kDefaultMaxBufferSize = 64 * 1024;
+
+  ProxyHandler(HTTPSessionPool* pool,
+               const HTTPSessionPool::Key& upstream,
+               std::chrono::milliseconds connectTimeout =
+                 std::chrono::milliseconds(0),
+               size_t maxBufferSize = kDefaultMaxBufferSize,
+               const std::string& deadlineHeader = "");
+
+  // RequestHandler
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+  void onEgressPaused() noexcept override;
+  void onEgressResumed() noexcept override;
+
+ private:
+  ~ProxyHandler();
+
+  // The upstream transaction's handler, its callbacks share names with
+  // those of RequestHandler
+  class Upstream : public HTTPTransactionHandler {
+   public:
+    explicit Upstream(ProxyHandler* proxy): proxy_(proxy) {}
+
+    void setTransaction(HTTPTransaction* txn) noexcept override;
+    void detachTransaction() noexcept override;
+    void onHeadersComplete(std::unique_ptr<HTTPMessage> msg) noexcept override;
+    void onBody(std::unique_ptr<folly::IOBuf> chain) noexcept override;
+    void onTrailers(std::unique_ptr<HTTPHeaders> trailers) noexcept override;
+    void onEOM() noexcept override;
+    void onUpgrade(UpgradeProtocol protocol) noexcept override;
+    void onError(const HTTPException& error) noexcept override;
+    void onEgressPaused() noexcept override;
+    void onEgressResumed() noexcept override;
+
+   private:
+    ProxyHandler* proxy_;
+  };
+
+  // HTTPSessionPool::Callback
+  void sessionAvailable(HTTPUpstreamSession* session) override;
+  void sessionError(
+    const apache::thrift::transport::TTransportException& ex) override;
+
+  void upstreamError(const std::string& reason);
+  void sendError(uint16_t code, const std::string& message);
+  void updateDownstreamIngress();
+  void downstreamDone();
+  void maybeDelete();
+
+  HTTPSessionPool* pool_;
+  HTTPSessionPool::Key upstream_;
+  std::chrono::milliseconds connectTimeout_;
+  const size_t maxBufferSize_;
+  const std::string deadlineHeader_;
+  Upstream upstreamHandler_{this};
+  HTTPTransaction* txn_{nullptr};
+  // the session of txn_
+  HTTPUpstreamSession* session_{nullptr};
+  std::unique_ptr<HTTPMessage> request_;
+  // request body waiting for the upstream transaction
+  folly::IOBufQueue pendingBody_{folly::IOBufQueue::cacheChainLength()};
+  bool connecting_{false};
+  bool requestEOM_{false};
+  bool upstreamEgressPaused_{false};
+  bool downstreamIngressPaused_{false};
+  bool responseStarted_{false};
+  bool downstreamDone_{false};
+};
+
+/**
+ * Makes ProxyHandlers that send every request to the same upstream, with
+ * a session pool for each handler thread
+ */
+class ProxyHandlerFactory : public RequestHandlerFactory {
+ public:
+  /**
+   * @param transactionTimeout the idle timeout of the upstream
+   *                           transactions
+   * @param deadlineHeader     see ProxyHandler
+   */
+  ProxyHandlerFactory(const HTTPSessionPool::Key& upstream,
+                      std::chrono::milliseconds connectTimeout,
+                      std::chrono::milliseconds transactionTimeout,
+                      uint32_t maxIdleSessions =
+                        HTTPSessionPool::kDefaultMaxIdleSessions,
+                      const std::string& deadlineHeader = "");
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override;
+
+ private:
+  const HTTPSessionPool::Key upstream_;
+  const std::chrono::milliseconds connectTimeout_;
+  const std::chrono::milliseconds transactionTimeout_;
+  const uint32_t maxIdleSessions_;
+  const std::string deadlineHeader_;
+
+  struct ThreadState {
+    AsyncTimeoutSet::UniquePtr timeouts;
+    // destroyed first, the pool's sessions use the timeouts
+    std::unique_ptr<HTTPSessionPool> pool;
+  };
+  folly::ThreadLocalPtr<ThreadState> state_;
+};
+
+}
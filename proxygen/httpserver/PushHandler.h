@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/RequestHandler.h>
+
+namespace proxygen {
+
+/**
+ * The RequestHandler of a pushed response. A push has no request to read,
+ * so only the callbacks of the response reach it: requestComplete() once
+ * it is sent, onError(), and the egress ones.
+ *
+ * The handler of a request starts a push with
+ * ResponseHandler::newPushedResponse(), and the PushHandler then sends the
+ * response through downstream_ as a RequestHandler would, with the URL and
+ * the Host of the promised request in the headers of the response.
+ */
+class PushHandler : public RequestHandler {
+ public:
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept final {
+    LOG(FATAL) << "push handler received a request";
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept final {
+    LOG(FATAL) << "push handler received a body";
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept final {
+    LOG(FATAL) << "push handler received an upgrade";
+  }
+
+  void onEOM() noexcept final {
+    LOG(FATAL) << "push handler received an EOM";
+  }
+};
+
+}
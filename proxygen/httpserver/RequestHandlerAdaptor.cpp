@@ -10,15 +10,171 @@
 #include <proxygen/httpserver/RequestHandlerAdaptor.h>
 
 #include <boost/algorithm/string.hpp>
+#include <proxygen/httpserver/PushHandler.h>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/httpserver/filters/StatsRegistry.h>
+#include <proxygen/lib/utils/Time.h>
 
 namespace proxygen {
 
+namespace {
+
+/**
+ * Between the transaction of a push and its PushHandler. Like the
+ * RequestHandlerAdaptor of a request, it deletes itself when the
+ * transaction detaches.
+ */
+class PushResponseAdaptor
+    : public HTTPPushTransactionHandler,
+      public ResponseHandler {
+ public:
+  explicit PushResponseAdaptor(PushHandler* handler)
+      : ResponseHandler(handler) {
+  }
+
+  // HTTPTransactionHandler
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+    upstream_->setResponseHandler(this);
+  }
+
+  void detachTransaction() noexcept override {
+    if (err_ == kErrorNone) {
+      upstream_->requestComplete();
+    }
+    delete this;
+  }
+
+  void onError(const HTTPException& error) noexcept override {
+    if (err_ != kErrorNone) {
+      return;
+    }
+    // a push only writes
+    err_ = error.getProxygenError() == kErrorTimeout ?
+      kErrorTimeout : kErrorWrite;
+    upstream_->onError(err_);
+  }
+
+  void onEgressPaused() noexcept override {
+    upstream_->onEgressPaused();
+  }
+
+  void onEgressResumed() noexcept override {
+    upstream_->onEgressResumed();
+  }
+
+  // ResponseHandler
+  void sendHeaders(HTTPMessage& msg) noexcept override {
+    txn_->sendHeaders(msg);
+  }
+
+  void sendChunkHeader(size_t len) noexcept override {
+    txn_->sendChunkHeader(len);
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    txn_->sendBody(std::move(body));
+  }
+
+  void sendFileRegion(const FileRegion& region) noexcept override {
+    txn_->sendFileRegion(region);
+  }
+
+  void sendChunkTerminator() noexcept override {
+    txn_->sendChunkTerminator();
+  }
+
+  void sendEOM() noexcept override {
+    txn_->sendEOM();
+  }
+
+  void sendAbort() noexcept override {
+    txn_->sendAbort();
+  }
+
+  void refreshTimeout() noexcept override {
+    txn_->refreshTimeout();
+  }
+
+  void pauseIngress() noexcept override {
+  }
+
+  void resumeIngress() noexcept override {
+  }
+
+  const folly::TransportInfo& getSetupTransportInfo() const noexcept
+    override {
+    return txn_->getSetupTransportInfo();
+  }
+
+  void getCurrentTransportInfo(folly::TransportInfo* tinfo) const override {
+    txn_->getCurrentTransportInfo(tinfo);
+  }
+
+ private:
+  HTTPTransaction* txn_{nullptr};
+  ProxygenError err_{kErrorNone};
+};
+
+}
+
+class RequestHandlerAdaptor::CpuTimer {
+ public:
+  explicit CpuTimer(RequestHandlerAdaptor* adaptor)
+      : adaptor_(adaptor->cpuStats_ ? adaptor : nullptr) {
+    if (adaptor_ && adaptor_->cpuTimerDepth_++ == 0) {
+      outer_ = true;
+      // The ResponseHandler calls can complete the transaction, which
+      // deletes the adaptor before they return
+      adaptor_->setDestroyedPtr(&destroyed_);
+      cpuStats_ = adaptor_->cpuStats_;
+      handlerType_ = adaptor_->handlerType_;
+      start_ = getThreadCpuTime();
+    }
+  }
+
+  ~CpuTimer() {
+    if (!adaptor_) {
+      return;
+    }
+    if (!outer_) {
+      adaptor_->cpuTimerDepth_--;
+      return;
+    }
+    auto elapsed = getThreadCpuTime() - start_;
+    if (destroyed_) {
+      // the request was recorded when it completed, inside this call
+      cpuStats_->recordHandlerCpu(*handlerType_, elapsed, 0);
+      return;
+    }
+    adaptor_->clearDestroyedPtr();
+    adaptor_->cpuTimerDepth_--;
+    adaptor_->cpuTime_ += elapsed;
+  }
+
+ private:
+  RequestHandlerAdaptor* const adaptor_;
+  StatsRegistry* cpuStats_{nullptr};
+  const std::type_info* handlerType_{nullptr};
+  std::chrono::nanoseconds start_;
+  bool outer_{false};
+  bool destroyed_{false};
+};
+
 RequestHandlerAdaptor::RequestHandlerAdaptor(RequestHandler* requestHandler)
     : ResponseHandler(requestHandler) {
 }
 
+RequestHandlerAdaptor::RequestHandlerAdaptor(
+    RequestHandler* requestHandler,
+    StatsRegistry* cpuStats,
+    const std::type_info& handlerType)
+    : ResponseHandler(requestHandler),
+      cpuStats_(cpuStats),
+      handlerType_(&handlerType) {
+}
+
 void RequestHandlerAdaptor::setTransaction(HTTPTransaction* txn) noexcept {
   txn_ = txn;
 
@@ -28,8 +184,12 @@ void RequestHandlerAdaptor::setTransaction(HTTPTransaction* txn) noexcept {
 
 void RequestHandlerAdaptor::detachTransaction() noexcept {
   if (err_ == kErrorNone) {
+    CpuTimer timer(this);
     upstream_->requestComplete();
   }
+  if (cpuStats_) {
+    cpuStats_->recordHandlerCpu(*handlerType_, cpuTime_, 1);
+  }
 
   // Otherwise we would have got some error call back and invoked onError
   // on RequestHandler
@@ -38,6 +198,10 @@ void RequestHandlerAdaptor::detachTransaction() noexcept {
 
 void RequestHandlerAdaptor::onHeadersComplete(std::unique_ptr<HTTPMessage> msg)
     noexcept {
+  CpuTimer timer(this);
+  informationalAllowed_ =
+    msg->getHTTPVersion() >= HTTPMessage::kHTTPVersion11 &&
+    txn_->getTransport().getCodec().supportsInformationalResponses();
   if (msg->getHeaders().exists(HTTP_HEADER_EXPECT)) {
     auto expectation = msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_EXPECT);
     if (!boost::iequals(expectation, "100-continue")) {
@@ -48,10 +212,9 @@ void RequestHandlerAdaptor::onHeadersComplete(std::unique_ptr<HTTPMessage> msg)
           .closeConnection()
           .sendWithEOM();
     } else {
-      ResponseBuilder(this)
-        .status(100, "Continue")
-        .send();
-
+      // Not until the chain had a look at the headers, so that a request
+      // it turns down isn't uploaded for nothing
+      continuePending_ = informationalAllowed_;
     }
   }
 
@@ -59,9 +222,25 @@ void RequestHandlerAdaptor::onHeadersComplete(std::unique_ptr<HTTPMessage> msg)
   if (err_ == kErrorNone) {
     upstream_->onRequest(std::move(msg));
   }
+  // We are in a callback of the transaction, which can't detach before it
+  // returns. A handler that decides later pauses ingress until it does.
+  if (!ingressPaused_) {
+    sendContinue();
+  }
+}
+
+void RequestHandlerAdaptor::sendContinue() noexcept {
+  if (!continuePending_ || responseStarted_ || err_ != kErrorNone) {
+    continuePending_ = false;
+    return;
+  }
+  ResponseBuilder(this)
+    .status(100, "Continue")
+    .sendInformational();
 }
 
 void RequestHandlerAdaptor::onBody(std::unique_ptr<folly::IOBuf> c) noexcept {
+  CpuTimer timer(this);
   upstream_->onBody(std::move(c));
 }
 
@@ -77,12 +256,14 @@ void RequestHandlerAdaptor::onTrailers(std::unique_ptr<HTTPHeaders> trailers)
 }
 
 void RequestHandlerAdaptor::onEOM() noexcept {
+  CpuTimer timer(this);
   if (err_ == kErrorNone) {
     upstream_->onEOM();
   }
 }
 
 void RequestHandlerAdaptor::onUpgrade(UpgradeProtocol protocol) noexcept {
+  CpuTimer timer(this);
   upstream_->onUpgrade(protocol);
 }
 
@@ -92,6 +273,7 @@ void RequestHandlerAdaptor::onError(const HTTPException& error) noexcept {
     return;
   }
 
+  CpuTimer timer(this);
   if (error.getProxygenError() == kErrorTimeout) {
     setError(kErrorTimeout);
 
@@ -123,35 +305,73 @@ void RequestHandlerAdaptor::onError(const HTTPException& error) noexcept {
 }
 
 void RequestHandlerAdaptor::onEgressPaused() noexcept {
+  CpuTimer timer(this);
   upstream_->onEgressPaused();
 }
 
 void RequestHandlerAdaptor::onEgressResumed() noexcept {
+  CpuTimer timer(this);
   upstream_->onEgressResumed();
 }
 
 void RequestHandlerAdaptor::sendHeaders(HTTPMessage& msg) noexcept {
+  CpuTimer timer(this);
   responseStarted_ = true;
+  if (continuePending_) {
+    continuePending_ = false;
+    // The client holds the body back. Closing the connection after the
+    // response spares reading it, in case it sends it anyway.
+    if (!txn_->getTransport().getCodec().supportsParallelRequests()) {
+      msg.setWantsKeepalive(false);
+    }
+  }
+  txn_->sendHeaders(msg);
+}
+
+bool RequestHandlerAdaptor::sendInformational(HTTPMessage& msg) noexcept {
+  CpuTimer timer(this);
+  CHECK(msg.is1xxResponse() && msg.getStatusCode() != 101)
+    << "Not an informational response, status=" << msg.getStatusCode();
+  // Once the final response started, it is too late
+  if (!informationalAllowed_ || responseStarted_) {
+    VLOG(4) << "Dropping the " << msg.getStatusCode()
+            << " response of " << *txn_;
+    return false;
+  }
+  if (msg.getStatusCode() == 100) {
+    continuePending_ = false;
+  }
   txn_->sendHeaders(msg);
+  return true;
 }
 
 void RequestHandlerAdaptor::sendChunkHeader(size_t len) noexcept {
+  CpuTimer timer(this);
   txn_->sendChunkHeader(len);
 }
 
 void RequestHandlerAdaptor::sendBody(std::unique_ptr<folly::IOBuf> b) noexcept {
+  CpuTimer timer(this);
   txn_->sendBody(std::move(b));
 }
 
+void RequestHandlerAdaptor::sendFileRegion(const FileRegion& region) noexcept {
+  CpuTimer timer(this);
+  txn_->sendFileRegion(region);
+}
+
 void RequestHandlerAdaptor::sendChunkTerminator() noexcept {
+  CpuTimer timer(this);
   txn_->sendChunkTerminator();
 }
 
 void RequestHandlerAdaptor::sendEOM() noexcept {
+  CpuTimer timer(this);
   txn_->sendEOM();
 }
 
 void RequestHandlerAdaptor::sendAbort() noexcept {
+  CpuTimer timer(this);
   txn_->sendAbort();
 }
 
@@ -160,13 +380,34 @@ void RequestHandlerAdaptor::refreshTimeout() noexcept {
 }
 
 void RequestHandlerAdaptor::pauseIngress() noexcept {
+  ingressPaused_ = true;
   txn_->pauseIngress();
 }
 
 void RequestHandlerAdaptor::resumeIngress() noexcept {
+  ingressPaused_ = false;
+  sendContinue();
   txn_->resumeIngress();
 }
 
+ResponseHandler* RequestHandlerAdaptor::newPushedResponse(
+    PushHandler* handler, const std::string& path) noexcept {
+  auto& transport = txn_->getTransport();
+  if (transport.wasRecentlyFetched(path)) {
+    VLOG(4) << "Not pushing " << path << ", the client recently fetched it";
+    return nullptr;
+  }
+  // The transaction owns the adaptor once it is its handler. The session
+  // turns the push down past its limit of concurrent pushes.
+  auto adaptor = new PushResponseAdaptor(handler);
+  if (!txn_->newPushedTransaction(adaptor, txn_->getPriority())) {
+    delete adaptor;
+    return nullptr;
+  }
+  transport.recordFetched(path);
+  return adaptor;
+}
+
 const folly::TransportInfo&
 RequestHandlerAdaptor::getSetupTransportInfo() const noexcept {
   return txn_->getSetupTransportInfo();
@@ -9,12 +9,16 @@
  */
 #pragma once
 
+#include <chrono>
 #include <proxygen/httpserver/ResponseHandler.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/utils/DestructorCheck.h>
+#include <typeinfo>
 
 namespace proxygen {
 
 class RequestHandler;
+class StatsRegistry;
 
 /**
  * An adaptor that converts HTTPTransactionHandler to RequestHandler.
@@ -27,14 +31,38 @@ class RequestHandler;
  *   onError - Send a direct response back if no response has started and
  *             writing is still possible. Otherwise sends an abort.
  *
- * - Handles 100-continue case for you (by sending Continue response)
+ * - Handles 100-continue case for you. The Continue response is sent
+ *   once the handler chain returns from onRequest without having sent a
+ *   response, so that the filters that turn requests down on their
+ *   headers spare the client the upload. A handler that decides
+ *   asynchronously pauses ingress in onRequest, and the Continue goes out
+ *   when it resumes it. A final response sent instead closes HTTP/1.x
+ *   connections.
+ *
+ * - Drops the informational responses of the handler that the client
+ *   can't take
+ *
+ * - Optionally measures the thread CPU time spent in the handler chain's
+ *   callbacks and in the ResponseHandler calls it makes, and records it in
+ *   a StatsRegistry under the type of the application handler when the
+ *   request completes
  */
 class RequestHandlerAdaptor
     : public HTTPTransactionHandler,
-      public ResponseHandler {
+      public ResponseHandler,
+      public DestructorCheck {
  public:
   explicit RequestHandlerAdaptor(RequestHandler* requestHandler);
 
+  /**
+   * Measure the CPU time of this request in cpuStats, recorded under
+   * handlerType. Reading the thread CPU clock costs a system call, so this
+   * is meant for a sample of the requests.
+   */
+  RequestHandlerAdaptor(RequestHandler* requestHandler,
+                        StatsRegistry* cpuStats,
+                        const std::type_info& handlerType);
+
  private:
   // HTTPTransactionHandler
   void setTransaction(HTTPTransaction* txn) noexcept override;
@@ -52,23 +80,42 @@ class RequestHandlerAdaptor
 
   // ResponseHandler
   void sendHeaders(HTTPMessage& msg) noexcept override;
+  bool sendInformational(HTTPMessage& msg) noexcept override;
   void sendChunkHeader(size_t len) noexcept override;
   void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void sendFileRegion(const FileRegion& region) noexcept override;
   void sendChunkTerminator() noexcept override;
   void sendEOM() noexcept override;
   void sendAbort() noexcept override;
   void refreshTimeout() noexcept override;
   void pauseIngress() noexcept override;
   void resumeIngress() noexcept override;
+  ResponseHandler* newPushedResponse(
+    PushHandler* handler, const std::string& path) noexcept override;
   const folly::TransportInfo& getSetupTransportInfo() const noexcept override;
   void getCurrentTransportInfo(folly::TransportInfo* tinfo) const override;
 
-  // Helper method
+  // Helper methods
   void setError(ProxygenError err) noexcept;
+  void sendContinue() noexcept;
+
+  // Adds the CPU time from its construction to its destruction to the
+  // adaptor's, unless it is nested in another one
+  class CpuTimer;
 
   HTTPTransaction* txn_{nullptr};
+  StatsRegistry* const cpuStats_{nullptr};
+  const std::type_info* const handlerType_{nullptr};
+  std::chrono::nanoseconds cpuTime_{0};
+  uint32_t cpuTimerDepth_{0};
   ProxygenError err_{kErrorNone};
   bool responseStarted_{false};
+  // Whether the protocol and the client take 1xx responses
+  bool informationalAllowed_{false};
+  // The client expects a 100 Continue that wasn't sent yet
+  bool continuePending_{false};
+  // By the handler chain
+  bool ingressPaused_{false};
 };
 
 }
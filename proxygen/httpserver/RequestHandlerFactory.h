@@ -23,7 +23,8 @@ class RequestHandlerFactory {
   /**
    * Invoked in each thread server is going to handle requests
    * before we start handling requests. Can be used to setup
-   * thread-local setup for each thread (stats and such).
+   * thread-local setup for each thread (stats and such). The threads
+   * start in parallel, so it may run in several of them at once.
    */
   virtual void onServerStart() noexcept = 0;
 
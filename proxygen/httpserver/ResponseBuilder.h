@@ -11,6 +11,9 @@
 
 #include <folly/ScopeGuard.h>
 #include <proxygen/httpserver/ResponseHandler.h>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ObjectPool.h>
 
 namespace proxygen {
 
@@ -50,7 +53,15 @@ namespace proxygen {
  *    .body(...)
  *    .sendWithEOM();
  *
- * 3. Accept or reject Upgrade Requests
+ * 3. Send informational responses before the final one, such as 103 Early
+ *    Hints for the subresources the client can fetch in the meantime
+ *
+ * ResponseBuilder(handler)
+ *    .status(103, "Early Hints")
+ *    .header(HTTP_HEADER_LINK, "</style.css>; rel=preload; as=style")
+ *    .sendInformational();
+ *
+ * 4. Accept or reject Upgrade Requests
  *
  * ResponseBuilder(handler)
  *    .acceptUpgradeRequest() // send '200 OK' without EOM
@@ -67,7 +78,7 @@ class ResponseBuilder {
   }
 
   ResponseBuilder& status(uint16_t code, std::string message) {
-    headers_ = folly::make_unique<HTTPMessage>();
+    newHeaders();
     headers_->setHTTPVersion(1, 1);
     headers_->setStatusCode(code);
     headers_->setStatusMessage(message);
@@ -88,6 +99,16 @@ class ResponseBuilder {
     return *this;
   }
 
+  /**
+   * Send a set of static headers, serialized once and reused by every
+   * response that carries the same HTTPCachedHeaders
+   */
+  ResponseBuilder& headers(std::shared_ptr<const HTTPCachedHeaders> cached) {
+    CHECK(headers_) << "You need to call `status` before adding headers";
+    headers_->setCachedHeaders(std::move(cached));
+    return *this;
+  }
+
   ResponseBuilder& body(std::unique_ptr<folly::IOBuf> bodyIn) {
     if (bodyIn) {
       if (body_) {
@@ -102,7 +123,7 @@ class ResponseBuilder {
 
   template <typename T>
   ResponseBuilder& body(T&& t) {
-    return body(folly::IOBuf::maybeCopyBuffer(
+    return body(IOBufSlab::get().maybeCopyBuffer(
         folly::to<std::string>(std::forward<T>(t))));
   }
 
@@ -117,7 +138,7 @@ class ResponseBuilder {
 
   void send() {
     // Once we send them, we don't want to send them again
-    SCOPE_EXIT { headers_.reset(); };
+    SCOPE_EXIT { recycleHeaders(); };
 
     // By default, chunked
     bool chunked = true;
@@ -158,6 +179,34 @@ class ResponseBuilder {
     }
   }
 
+  /**
+   * Send the status and headers as an informational (1xx) response, see
+   * ResponseHandler::sendInformational(). The builder can make the final
+   * response next.
+   *
+   * @return false if the client can't take it and it was dropped
+   */
+  bool sendInformational() {
+    CHECK(headers_ && !body_ && !sendEOM_);
+    SCOPE_EXIT { recycleHeaders(); };
+    return txn_->sendInformational(*headers_);
+  }
+
+  /**
+   * Send a whole canned response, see HTTPCannedResponse. Nothing else
+   * may have been given to this builder.
+   */
+  void sendCanned(const std::shared_ptr<const HTTPCannedResponse>& canned) {
+    CHECK(!headers_ && !body_);
+    HTTPMessage msg(canned->getMessage());
+    msg.setCannedResponse(canned);
+    txn_->sendHeaders(msg);
+    if (canned->getBody()) {
+      txn_->sendBody(canned->getBody()->clone());
+    }
+    txn_->sendEOM();
+  }
+
   enum class UpgradeType {
     CONNECT_REQUEST = 0,
     HTTP_UPGRADE,
@@ -165,7 +214,7 @@ class ResponseBuilder {
 
   void acceptUpgradeRequest(UpgradeType upgradeType,
                             const std::string upgradeProtocol = "") {
-    headers_ = folly::make_unique<HTTPMessage>();
+    newHeaders();
     if (upgradeType == UpgradeType::CONNECT_REQUEST) {
       headers_->constructDirectResponse({1, 1}, 200, "OK");
     } else {
@@ -175,16 +224,29 @@ class ResponseBuilder {
       headers_->getHeaders().add(HTTP_HEADER_CONNECTION, "Upgrade");
     }
     txn_->sendHeaders(*headers_);
+    recycleHeaders();
   }
 
   void rejectUpgradeRequest() {
-    headers_ = folly::make_unique<HTTPMessage>();
+    newHeaders();
     headers_->constructDirectResponse({1, 1}, 400, "Bad Request");
     txn_->sendHeaders(*headers_);
+    recycleHeaders();
     txn_->sendEOM();
   }
 
  private:
+  // The response headers come from the message pool of the thread, and go
+  // back to it once they are sent
+  void newHeaders() {
+    recycleHeaders();
+    headers_ = ObjectPool<HTTPMessage>::get().acquire();
+  }
+
+  void recycleHeaders() {
+    ObjectPool<HTTPMessage>::get().recycle(std::move(headers_));
+  }
+
   ResponseHandler* const txn_{nullptr};
 
   std::unique_ptr<HTTPMessage> headers_;
@@ -13,6 +13,7 @@
 
 namespace proxygen {
 
+class PushHandler;
 class RequestHandler;
 
 /**
@@ -56,10 +57,31 @@ class ResponseHandler {
    */
   virtual void sendHeaders(HTTPMessage& msg) noexcept = 0;
 
+  /**
+   * Send an informational (1xx) response ahead of the final one, such as
+   * 103 Early Hints with the Link headers of the subresources the client
+   * can start fetching while the final response is being made. It is
+   * dropped when the client can't take one: SPDY streams have a single
+   * reply and HTTP/1.0 predates 1xx responses. The default is for
+   * ResponseHandlers that can't send one.
+   *
+   * @return true if the response was sent
+   */
+  virtual bool sendInformational(HTTPMessage& msg) noexcept {
+    return false;
+  }
+
   virtual void sendChunkHeader(size_t len) noexcept = 0;
 
   virtual void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept = 0;
 
+  /**
+   * Send a part of a file as body. The bytes go from the file to the socket
+   * without a copy when the transport can do it, else they are read and
+   * sent as with sendBody().
+   */
+  virtual void sendFileRegion(const FileRegion& region) noexcept = 0;
+
   virtual void sendChunkTerminator() noexcept = 0;
 
   virtual void sendEOM() noexcept = 0;
@@ -72,6 +94,23 @@ class ResponseHandler {
 
   virtual void resumeIngress() noexcept = 0;
 
+  /**
+   * Push the resource at path to the client along with the response to
+   * this request, for protocols that can push. The response of the push
+   * is sent through the ResponseHandler this returns, which calls back
+   * handler like the one of a request.
+   *
+   * @return nullptr if the push isn't possible: the protocol can't push,
+   *         the client has as many pushes open as it allows, the response
+   *         to this request is complete, or the client recently fetched
+   *         path on this connection so it likely has it cached. The
+   *         default is for ResponseHandlers that can't push.
+   */
+  virtual ResponseHandler* newPushedResponse(
+    PushHandler* handler, const std::string& path) noexcept {
+    return nullptr;
+  }
+
   // Accessors for Transport/Connection information
   virtual const folly::TransportInfo& getSetupTransportInfo() const noexcept = 0;
 
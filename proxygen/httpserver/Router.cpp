@@ -0,0 +1,249 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/Router.h>
+
+#include <glog/logging.h>
+#include <proxygen/httpserver/filters/DirectResponseHandler.h>
+
+using folly::StringPiece;
+using std::string;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const size_t Router::kMaxParams;
+
+struct Router::Node {
+  // the literal part of the path this node matches, after its parent
+  string prefix;
+  // literal children, the first characters of their prefixes differ
+  std::vector<unique_ptr<Node>> children;
+  // child matching a ":name" segment
+  unique_ptr<Node> param;
+  string paramName;
+  // child matching a "*name" rest of the path
+  unique_ptr<Node> wildcard;
+  string wildcardName;
+  // the routes ending at this node
+  struct Route {
+    HTTPMethod method;
+    RequestHandlerFactory* factory;
+    std::chrono::milliseconds timeout;
+  };
+  std::vector<Route> routes;
+
+  const Route* getRoute(HTTPMethod method) const {
+    for (const auto& route: routes) {
+      if (route.method == method) {
+        return &route;
+      }
+    }
+    return nullptr;
+  }
+};
+
+namespace {
+
+// Where the next ":" or "*" segment of pattern starts
+size_t findSpecial(StringPiece pattern) {
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if ((pattern[i] == ':' || pattern[i] == '*') &&
+        (i == 0 || pattern[i - 1] == '/')) {
+      return i;
+    }
+  }
+  return pattern.size();
+}
+
+}
+
+Router::Router(): root_(new Node()) {
+}
+
+Router::~Router() {
+}
+
+Router& Router::add(HTTPMethod method,
+                    const string& pattern,
+                    unique_ptr<RequestHandlerFactory> factory,
+                    std::chrono::milliseconds timeout) {
+  CHECK(!pattern.empty() && pattern[0] == '/')
+    << "bad route pattern " << pattern;
+  size_t numParams = 0;
+  Node* node = insert(root_.get(), pattern, numParams);
+  CHECK(!node->getRoute(method))
+    << "duplicate route " << methodToString(method) << " " << pattern;
+  node->routes.push_back({method, factory.get(), timeout});
+  factories_.push_back(std::move(factory));
+  return *this;
+}
+
+Router& Router::setNotFound(unique_ptr<RequestHandlerFactory> factory) {
+  notFound_ = std::move(factory);
+  return *this;
+}
+
+Router::Node* Router::insert(Node* node, StringPiece pattern,
+                             size_t& numParams) {
+  if (pattern.empty()) {
+    return node;
+  }
+  if (pattern[0] == ':' || pattern[0] == '*') {
+    size_t end = pattern.find('/');
+    if (end == StringPiece::npos) {
+      end = pattern.size();
+    }
+    string name = pattern.subpiece(1, end - 1).str();
+    CHECK(!name.empty()) << "unnamed parameter in route pattern";
+    CHECK_LT(numParams, kMaxParams) << "too many parameters in route";
+    numParams++;
+    if (pattern[0] == '*') {
+      CHECK_EQ(end, pattern.size()) << "wildcard must end a route pattern";
+      if (!node->wildcard) {
+        node->wildcard.reset(new Node());
+        node->wildcardName = name;
+      }
+      CHECK_EQ(node->wildcardName, name) << "conflicting wildcard names";
+      return node->wildcard.get();
+    }
+    if (!node->param) {
+      node->param.reset(new Node());
+      node->paramName = name;
+    }
+    CHECK_EQ(node->paramName, name) << "conflicting parameter names";
+    return insert(node->param.get(), pattern.subpiece(end), numParams);
+  }
+
+  StringPiece literal = pattern.subpiece(0, findSpecial(pattern));
+  for (auto& child: node->children) {
+    if (child->prefix[0] != literal[0]) {
+      continue;
+    }
+    size_t common = 1;
+    while (common < child->prefix.size() && common < literal.size() &&
+           child->prefix[common] == literal[common]) {
+      common++;
+    }
+    if (common < child->prefix.size()) {
+      // split the child at the end of the common part
+      unique_ptr<Node> split(new Node());
+      split->prefix = child->prefix.substr(0, common);
+      child->prefix.erase(0, common);
+      split->children.push_back(std::move(child));
+      child = std::move(split);
+    }
+    return insert(child.get(), pattern.subpiece(common), numParams);
+  }
+  node->children.emplace_back(new Node());
+  Node* child = node->children.back().get();
+  child->prefix = literal.str();
+  return insert(child, pattern.subpiece(literal.size()), numParams);
+}
+
+const Router::Node* Router::match(const Node* node, StringPiece path,
+                                  Captures& captures) {
+  if (path.empty() && !node->routes.empty()) {
+    return node;
+  }
+  if (!path.empty()) {
+    for (const auto& child: node->children) {
+      if (child->prefix[0] == path[0]) {
+        if (path.startsWith(child->prefix)) {
+          auto found = match(child.get(), path.subpiece(child->prefix.size()),
+                             captures);
+          if (found) {
+            return found;
+          }
+        }
+        break;
+      }
+    }
+    if (node->param && path[0] != '/') {
+      size_t end = path.find('/');
+      if (end == StringPiece::npos) {
+        end = path.size();
+      }
+      captures.params[captures.size++] =
+        std::make_pair(&node->paramName, path.subpiece(0, end));
+      auto found = match(node->param.get(), path.subpiece(end), captures);
+      if (found) {
+        return found;
+      }
+      captures.size--;
+    }
+  }
+  if (node->wildcard) {
+    captures.params[captures.size++] =
+      std::make_pair(&node->wildcardName, path);
+    return node->wildcard.get();
+  }
+  return nullptr;
+}
+
+void Router::onServerStart() noexcept {
+  for (auto& factory: factories_) {
+    factory->onServerStart();
+  }
+  if (notFound_) {
+    notFound_->onServerStart();
+  }
+}
+
+void Router::onServerStop() noexcept {
+  for (auto& factory: factories_) {
+    factory->onServerStop();
+  }
+  if (notFound_) {
+    notFound_->onServerStop();
+  }
+}
+
+RequestHandler* Router::onRequest(RequestHandler* h,
+                                  HTTPMessage* msg) noexcept {
+  Captures captures;
+  const Node* node = match(root_.get(), msg->getPath(), captures);
+  if (!node) {
+    if (notFound_) {
+      return notFound_->onRequest(h, msg);
+    }
+    return new DirectResponseHandler(404, "Not Found", "");
+  }
+
+  const Node::Route* route = nullptr;
+  auto method = msg->getMethod();
+  if (method) {
+    route = node->getRoute(*method);
+    if (!route && *method == HTTPMethod::HEAD) {
+      route = node->getRoute(HTTPMethod::GET);
+    }
+  }
+  if (!route) {
+    string allow;
+    for (const auto& other: node->routes) {
+      if (!allow.empty()) {
+        allow.append(", ");
+      }
+      allow.append(methodToString(other.method));
+    }
+    auto handler = new DirectResponseHandler(405, "Method Not Allowed", "");
+    handler->addHeader("Allow", allow);
+    return handler;
+  }
+
+  for (size_t i = 0; i < captures.size; i++) {
+    msg->setPathParam(*captures.params[i].first, captures.params[i].second);
+  }
+  if (route->timeout.count() > 0 && !msg->hasDeadline()) {
+    msg->setDeadline(msg->getStartTime() + route->timeout);
+  }
+  return route->factory->onRequest(h, msg);
+}
+
+}
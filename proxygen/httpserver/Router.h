@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <folly/Range.h>
+#include <memory>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPMethod.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * RequestHandlerFactory that hands each request to the factory of the
+ * route that matches its method and path.
+ *
+ * A path pattern is a sequence of segments. A segment is matched
+ * literally, except for ":name", which matches one non-empty segment, and
+ * "*name", which can only be the last one and matches the rest of the
+ * path. The captured values are set as path params on the message (see
+ * HTTPMessage::getPathParam()) before the route's factory is asked for
+ * a handler:
+ *
+ *   router.add(HTTPMethod::GET, "/users/:id", ...);
+ *   router.add(HTTPMethod::GET, "/static/*file", ...);
+ *
+ * The patterns are compiled into a radix trie, so a lookup costs about
+ * the length of the path whatever the number of routes, and doesn't
+ * allocate. Literal segments take precedence over parameters, which take
+ * precedence over a wildcard.
+ *
+ * A HEAD request is given to the GET route if there is no HEAD one. A
+ * path that matches with another method gets a 405, and one that doesn't
+ * match at all the not-found factory's handler, or a 404.
+ */
+class Router : public RequestHandlerFactory {
+ public:
+  // maximum number of parameters in a pattern
+  static const size_t kMaxParams = 8;
+
+  Router();
+  ~Router();
+
+  /**
+   * Route the requests for method and pattern to factory. Must be called
+   * before the server starts.
+   *
+   * The requests that come without a deadline get one `timeout` after
+   * they started arriving, unless it is zero; see
+   * HTTPServerOptions::defaultRequestTimeout.
+   */
+  Router& add(HTTPMethod method,
+              const std::string& pattern,
+              std::unique_ptr<RequestHandlerFactory> factory,
+              std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(0));
+
+  /**
+   * Give the requests that match no route to factory.
+   */
+  Router& setNotFound(std::unique_ptr<RequestHandlerFactory> factory);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override;
+
+ private:
+  struct Node;
+
+  struct Captures {
+    size_t size{0};
+    std::array<std::pair<const std::string*, folly::StringPiece>,
+               kMaxParams> params;
+  };
+
+  static Node* insert(Node* node, folly::StringPiece pattern,
+                      size_t& numParams);
+  static const Node* match(const Node* node, folly::StringPiece path,
+                           Captures& captures);
+
+  std::unique_ptr<Node> root_;
+  std::vector<std::unique_ptr<RequestHandlerFactory>> factories_;
+  std::unique_ptr<RequestHandlerFactory> notFound_;
+};
+
+}
@@ -93,12 +93,15 @@ class ScopedHTTPServer final {
  public:
   /**
    * Start a server listening on the requested `port`.
-   * If `port` is 0, it will choose a random port.
+   * If `port` is 0, it will choose a random port. `protocol` is the one
+   * the connections speak, HTTP/1.x or plaintext SPDY.
    */
   template <typename HandlerType>
-  static std::unique_ptr<ScopedHTTPServer> start(HandlerType handler,
-                                                 int port = 0,
-                                                 int numThreads = 4);
+  static std::unique_ptr<ScopedHTTPServer> start(
+    HandlerType handler,
+    int port = 0,
+    int numThreads = 4,
+    HTTPServer::Protocol protocol = HTTPServer::Protocol::HTTP);
 
   /**
    * Get the port the server is listening on. This is helpful if the port was
@@ -130,11 +133,12 @@ template <typename HandlerType>
 inline std::unique_ptr<ScopedHTTPServer> ScopedHTTPServer::start(
     HandlerType handler,
     int port,
-    int numThreads) {
+    int numThreads,
+    HTTPServer::Protocol protocol) {
 
   std::unique_ptr<RequestHandlerFactory> f =
       folly::make_unique<ScopedHandlerFactory<HandlerType>>(handler);
-  return start(std::move(f), port, numThreads);
+  return start(std::move(f), port, numThreads, protocol);
 }
 
 template <>
@@ -142,14 +146,15 @@ inline std::unique_ptr<ScopedHTTPServer>
 ScopedHTTPServer::start<std::unique_ptr<RequestHandlerFactory>>(
     std::unique_ptr<RequestHandlerFactory> f,
     int port,
-    int numThreads) {
+    int numThreads,
+    HTTPServer::Protocol protocol) {
 
   // This will handle both IPv4 and IPv6 cases
   folly::SocketAddress addr;
   addr.setFromLocalPort(port);
 
   std::vector<HTTPServer::IPConfig> IPs = {
-    {addr, HTTPServer::Protocol::HTTP}
+    {addr, protocol}
   };
 
   HTTPServerOptions options;
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/SlowTransactionDebugHandler.h>
+
+#include <algorithm>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <vector>
+
+namespace proxygen {
+
+void SlowTransactionDebugHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  int limit = headers->getIntQueryParam(
+    "limit", (int)SlowTransactionSampler::kDefaultCapacity);
+  limit_ = std::max(limit, 0);
+}
+
+void SlowTransactionDebugHandler::onEOM() noexcept {
+  auto samples = sampler_->getSamples();
+  std::reverse(samples.begin(), samples.end());
+  if (samples.size() > limit_) {
+    samples.resize(limit_);
+  }
+  folly::dynamic result = folly::dynamic::object
+    ("threshold_ms", (int64_t)sampler_->getThreshold().count())
+    ("recorded", (int64_t)sampler_->getNumRecorded())
+    ("samples", folly::dynamic(samples.begin(), samples.end()));
+
+  ResponseBuilder(downstream_)
+    .status(200, "OK")
+    .header(HTTP_HEADER_CONTENT_TYPE, "application/json")
+    .body(folly::toJson(result).toStdString())
+    .sendWithEOM();
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/session/SlowTransactionSampler.h>
+
+namespace proxygen {
+
+/**
+ * Debug endpoint for the samples of a SlowTransactionSampler, as JSON: the
+ * threshold, the number of samples recorded, and the ones still in the
+ * ring, the most recent first. The "limit" query parameter caps the
+ * number of samples returned.
+ */
+class SlowTransactionDebugHandler : public RequestHandler {
+ public:
+  explicit SlowTransactionDebugHandler(
+    std::shared_ptr<SlowTransactionSampler> sampler)
+      : sampler_(std::move(sampler)) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+  }
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override {
+    delete this;
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    delete this;
+  }
+
+ private:
+  std::shared_ptr<SlowTransactionSampler> sampler_;
+  size_t limit_{0};
+};
+
+class SlowTransactionDebugHandlerFactory : public RequestHandlerFactory {
+ public:
+  explicit SlowTransactionDebugHandlerFactory(
+    std::shared_ptr<SlowTransactionSampler> sampler)
+      : sampler_(std::move(sampler)) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+    return new SlowTransactionDebugHandler(sampler_);
+  }
+
+ private:
+  std::shared_ptr<SlowTransactionSampler> sampler_;
+};
+
+}
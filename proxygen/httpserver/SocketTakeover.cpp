@@ -0,0 +1,263 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/SocketTakeover.h>
+
+#include <algorithm>
+#include <cstring>
+#include <folly/Conv.h>
+#include <folly/Exception.h>
+#include <folly/SocketAddress.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace proxygen {
+
+namespace {
+
+// SCM_MAX_FD of the kernel
+const size_t kMaxFds = 253;
+const char kConfirm = 'D';
+
+}
+
+void sendFds(int fd, const std::vector<int>& fds) {
+  if (fds.empty() || fds.size() > kMaxFds) {
+    throw std::invalid_argument(
+      folly::to<std::string>("can't send ", fds.size(), " fds"));
+  }
+  uint32_t count = fds.size();
+  iovec iov;
+  iov.iov_base = &count;
+  iov.iov_len = sizeof(count);
+
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+  ssize_t rc;
+  do {
+    rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (rc < 0 && errno == EINTR);
+  if (rc < 0) {
+    folly::throwSystemError("sendmsg() of the listening sockets failed");
+  }
+}
+
+std::vector<int> receiveFds(int fd) {
+  uint32_t count = 0;
+  iovec iov;
+  iov.iov_base = &count;
+  iov.iov_len = sizeof(count);
+
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+
+  ssize_t rc;
+  do {
+    rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (rc < 0 && errno == EINTR);
+  if (rc < 0) {
+    folly::throwSystemError("recvmsg() of the listening sockets failed");
+  }
+
+  std::vector<int> fds;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+      fds.insert(fds.end(), data, data + n);
+    }
+  }
+  if (rc != sizeof(count) || fds.size() != count ||
+      (msg.msg_flags & MSG_CTRUNC)) {
+    for (auto received: fds) {
+      close(received);
+    }
+    throw std::runtime_error(folly::to<std::string>(
+        "bad takeover message: ", rc, " bytes, ", fds.size(), " fds"));
+  }
+  return fds;
+}
+
+TakeoverServer::TakeoverServer(folly::EventBase* eventBase,
+                               const std::string& path,
+                               std::vector<int> sockets,
+                               std::function<void()> drain):
+    eventBase_(eventBase),
+    path_(path),
+    sockets_(std::move(sockets)),
+    drain_(std::move(drain)) {
+  CHECK(!sockets_.empty());
+}
+
+TakeoverServer::~TakeoverServer() {
+  // path isn't removed, the successor listens on it by now
+  successors_.clear();
+  socket_.reset();
+}
+
+void TakeoverServer::start() {
+  CHECK(!socket_);
+  // left over by the previous process, or by a crash
+  if (unlink(path_.c_str()) != 0 && errno != ENOENT) {
+    folly::throwSystemError("unlink() of ", path_, " failed");
+  }
+  folly::SocketAddress address;
+  address.setFromPath(path_);
+  socket_.reset(new folly::AsyncServerSocket(eventBase_));
+  socket_->bind(address);
+  socket_->listen(8);
+  socket_->addAcceptCallback(this, nullptr);
+  socket_->startAccepting();
+}
+
+void TakeoverServer::connectionAccepted(
+    int fd, const folly::SocketAddress& addr) noexcept {
+  try {
+    sendFds(fd, sockets_);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Failed to hand the listening sockets over: " << ex.what();
+    close(fd);
+    return;
+  }
+  LOG(INFO) << "Handed " << sockets_.size() << " listening sockets over, "
+            << "waiting for the successor to confirm";
+  // the ones that went away without confirming are done by now
+  successors_.erase(
+    std::remove_if(successors_.begin(), successors_.end(),
+                   [] (const std::unique_ptr<Successor>& successor) {
+                     return successor->isDone();
+                   }),
+    successors_.end());
+  successors_.emplace_back(new Successor(this, fd));
+}
+
+void TakeoverServer::acceptError(const std::exception& ex) noexcept {
+  LOG(ERROR) << "Takeover socket accept error: " << ex.what();
+}
+
+void TakeoverServer::onSuccessor(bool confirmed) {
+  if (confirmed) {
+    LOG(INFO) << "Successor is serving, draining";
+    socket_->stopAccepting();
+    drain_();
+  } else {
+    LOG(WARNING) << "Successor went away before it confirmed the takeover, "
+                 << "still serving";
+  }
+}
+
+TakeoverServer::Successor::Successor(TakeoverServer* server, int fd):
+    folly::EventHandler(server->eventBase_, fd),
+    server_(server),
+    fd_(fd) {
+  registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
+}
+
+TakeoverServer::Successor::~Successor() {
+  finish();
+}
+
+void TakeoverServer::Successor::finish() {
+  if (fd_ >= 0) {
+    unregisterHandler();
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void TakeoverServer::Successor::handlerReady(uint16_t events) noexcept {
+  char byte = 0;
+  ssize_t rc = read(fd_, &byte, 1);
+  if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  finish();
+  // the TakeoverServer may be gone after this
+  server_->onSuccessor(rc == 1 && byte == kConfirm);
+}
+
+TakeoverClient::TakeoverClient(const std::string& path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("takeover path too long: " + path);
+  }
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path.data(), path.size());
+
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    folly::throwSystemError("socket() failed");
+  }
+  if (connect(fd_, reinterpret_cast<const sockaddr*>(&address),
+              sizeof(address)) != 0) {
+    int err = errno;
+    close(fd_);
+    fd_ = -1;
+    folly::throwSystemErrorExplicit(err, "connect() to ", path, " failed");
+  }
+  try {
+    sockets_ = receiveFds(fd_);
+  } catch (...) {
+    close(fd_);
+    fd_ = -1;
+    throw;
+  }
+}
+
+TakeoverClient::~TakeoverClient() {
+  for (auto fd: sockets_) {
+    close(fd);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::vector<int> TakeoverClient::releaseSockets() {
+  std::vector<int> sockets;
+  sockets.swap(sockets_);
+  return sockets;
+}
+
+void TakeoverClient::confirm() {
+  CHECK_GE(fd_, 0);
+  ssize_t rc;
+  do {
+    rc = send(fd_, &kConfirm, 1, MSG_NOSIGNAL);
+  } while (rc < 0 && errno == EINTR);
+  if (rc != 1) {
+    folly::throwSystemError("send() of the takeover confirmation failed");
+  }
+  close(fd_);
+  fd_ = -1;
+}
+
+}
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Hand the listening sockets of a server over to the process replacing
+ * it, so that a restart never refuses a connection.
+ *
+ * The old process listens on a Unix socket with a TakeoverServer. The new
+ * one connects to it with a TakeoverClient, which receives duplicates of
+ * the listening sockets (SCM_RIGHTS) and starts accepting on them right
+ * away; both processes take connections off the same queues for a while.
+ * Once the new process is serving, confirm() tells the old one to stop
+ * accepting and drain its connections. If the new process goes away
+ * before that, the old one just keeps serving.
+ */
+class TakeoverServer : private folly::AsyncServerSocket::AcceptCallback {
+ public:
+  /**
+   * @param sockets the listening sockets to hand over, they must stay open
+   *                as long as the TakeoverServer
+   * @param drain   called once a successor took the sockets over and is
+   *                serving, the server should close them and drain
+   */
+  TakeoverServer(folly::EventBase* eventBase,
+                 const std::string& path,
+                 std::vector<int> sockets,
+                 std::function<void()> drain);
+  ~TakeoverServer();
+
+  /**
+   * Replace whatever is at path and listen on it. Throws on error.
+   */
+  void start();
+
+ private:
+  // a successor that got the sockets, until it confirms or goes away
+  class Successor : public folly::EventHandler {
+   public:
+    Successor(TakeoverServer* server, int fd);
+    ~Successor();
+
+    bool isDone() const {
+      return fd_ < 0;
+    }
+
+    void handlerReady(uint16_t events) noexcept override;
+
+   private:
+    void finish();
+
+    TakeoverServer* const server_;
+    int fd_;
+  };
+
+  void connectionAccepted(int fd, const folly::SocketAddress& addr)
+    noexcept override;
+  void acceptError(const std::exception& ex) noexcept override;
+
+  void onSuccessor(bool confirmed);
+
+  folly::EventBase* const eventBase_;
+  const std::string path_;
+  const std::vector<int> sockets_;
+  std::function<void()> drain_;
+  folly::AsyncServerSocket::UniquePtr socket_;
+  std::vector<std::unique_ptr<Successor>> successors_;
+};
+
+class TakeoverClient {
+ public:
+  /**
+   * Connect to the TakeoverServer listening on path and receive its
+   * sockets. Blocks; throws if there is no server or it fails.
+   */
+  explicit TakeoverClient(const std::string& path);
+
+  /**
+   * Closes the connection, if confirm() wasn't called the old process
+   * keeps serving
+   */
+  ~TakeoverClient();
+
+  /**
+   * Take the listening sockets received, in the order the old process
+   * listed them. The caller owns them.
+   */
+  std::vector<int> releaseSockets();
+
+  /**
+   * Tell the old process to stop accepting and drain, once this one
+   * accepts on the sockets
+   */
+  void confirm();
+
+ private:
+  int fd_{-1};
+  std::vector<int> sockets_;
+};
+
+/**
+ * Send fds over the Unix socket fd in one message. Throws on error.
+ */
+void sendFds(int fd, const std::vector<int>& fds);
+
+/**
+ * Receive the fds of one sendFds() message from the Unix socket fd.
+ * Blocks; throws on error or if the peer closed.
+ */
+std::vector<int> receiveFds(int fd);
+
+}
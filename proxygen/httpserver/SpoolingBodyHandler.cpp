@@ -0,0 +1,258 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/SpoolingBodyHandler.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <folly/Conv.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <limits.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const size_t SpoolingBodyHandler::kDefaultMemoryLimit;
+const size_t SpoolingBodyHandler::kDefaultMaxBodySize;
+const size_t SpoolingBodyHandler::kMaxPendingWrite;
+
+namespace {
+
+// @return 0 or the errno
+int createTempFile(const std::string& dir, folly::File& file) {
+  std::string path = dir + "/upload.XXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  int fd = mkstemp(name.data());
+  if (fd < 0) {
+    return errno;
+  }
+  // only the descriptor refers to the file, it goes away with it
+  unlink(name.data());
+  file = folly::File(fd, true);
+  return 0;
+}
+
+// @return 0 or the errno
+int writeChain(int fd, const IOBuf* chain) {
+  std::vector<iovec> iov;
+  const IOBuf* buf = chain;
+  do {
+    if (buf->length() > 0) {
+      iovec vec;
+      vec.iov_base = (void*)buf->data();
+      vec.iov_len = buf->length();
+      iov.push_back(vec);
+    }
+    buf = buf->next();
+  } while (buf != chain);
+
+  size_t start = 0;
+  while (start < iov.size()) {
+    int count = std::min(iov.size() - start, size_t(IOV_MAX));
+    ssize_t written = ::writev(fd, &iov[start], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    while (start < iov.size() && size_t(written) >= iov[start].iov_len) {
+      written -= iov[start].iov_len;
+      start++;
+    }
+    if (start < iov.size()) {
+      iov[start].iov_base = (char*)iov[start].iov_base + written;
+      iov[start].iov_len -= written;
+    }
+  }
+  return 0;
+}
+
+}
+
+SpoolingBodyHandler::Body::Body(unique_ptr<IOBuf> head,
+                                std::shared_ptr<folly::File> file,
+                                size_t fileLength)
+    : head_(std::move(head)),
+      headLength_(head_ ? head_->computeChainDataLength() : 0),
+      file_(std::move(file)),
+      fileLength_(fileLength) {
+}
+
+FileRegion SpoolingBodyHandler::Body::getFileRegion() const {
+  CHECK(file_);
+  return FileRegion(file_, 0, fileLength_);
+}
+
+SpoolingBodyHandler::SpoolingBodyHandler(CPUExecutor* executor,
+                                         size_t memoryLimit,
+                                         size_t maxBodySize,
+                                         const std::string& tmpDir)
+    : executor_(CHECK_NOTNULL(executor)),
+      memoryLimit_(memoryLimit),
+      maxBodySize_(maxBodySize),
+      tmpDir_(tmpDir) {
+}
+
+void SpoolingBodyHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  request_ = std::move(headers);
+  const auto& contentLength =
+    request_->getHeaders().getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH);
+  if (!contentLength.empty()) {
+    try {
+      if (folly::to<uint64_t>(contentLength) > maxBodySize_) {
+        reject(413, "Request Entity Too Large");
+      }
+    } catch (const std::range_error&) {
+      // the codec rejects bad lengths, the body will tell
+    }
+  }
+}
+
+void SpoolingBodyHandler::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (rejected_ || !body) {
+    return;
+  }
+  received_ += body->computeChainDataLength();
+  if (received_ > maxBodySize_) {
+    reject(413, "Request Entity Too Large");
+    return;
+  }
+  if (pending_.chainLength() == 0 && fileLength_ == 0 && !writing_) {
+    memory_.append(std::move(body));
+    if (memory_.chainLength() > memoryLimit_) {
+      // keep the first memoryLimit_ bytes, the rest goes to the file
+      auto head = memory_.split(memoryLimit_);
+      pending_.append(memory_.move());
+      memory_.append(std::move(head));
+    }
+  } else {
+    pending_.append(std::move(body));
+  }
+  if (pending_.chainLength() == 0) {
+    return;
+  }
+  spool();
+  if (!paused_ && pending_.chainLength() >= kMaxPendingWrite) {
+    paused_ = true;
+    downstream_->pauseIngress();
+  }
+}
+
+void SpoolingBodyHandler::onEOM() noexcept {
+  eom_ = true;
+  maybeDeliver();
+}
+
+void SpoolingBodyHandler::requestComplete() noexcept {
+  finish();
+}
+
+void SpoolingBodyHandler::onError(ProxygenError err) noexcept {
+  finish();
+}
+
+void SpoolingBodyHandler::spool() {
+  if (writing_ || pending_.chainLength() == 0) {
+    return;
+  }
+  if (!file_) {
+    file_ = std::make_shared<folly::File>();
+  }
+  writing_ = true;
+  auto evb = folly::EventBaseManager::get()->getEventBase();
+  auto file = file_;
+  auto dir = tmpDir_;
+  // the chain moves into the task, which is destroyed on the executor
+  // thread once it has run
+  auto chain = std::make_shared<unique_ptr<IOBuf>>(pending_.move());
+  executor_->add(evb, [this, file, dir, chain] () -> CPUExecutor::Callback {
+      size_t length = (*chain)->computeChainDataLength();
+      int error = 0;
+      if (file->fd() < 0) {
+        error = createTempFile(dir, *file);
+      }
+      if (!error) {
+        error = writeChain(file->fd(), chain->get());
+      }
+      chain->reset();
+      return [this, length, error] {
+        onWritten(length, error);
+      };
+    });
+}
+
+void SpoolingBodyHandler::onWritten(size_t length, int error) {
+  writing_ = false;
+  if (finished_) {
+    delete this;
+    return;
+  }
+  if (rejected_) {
+    return;
+  }
+  if (error) {
+    LOG(ERROR) << "can't spool request body to " << tmpDir_ << ": "
+               << strerror(error);
+    reject(500, "Internal Server Error");
+    return;
+  }
+  fileLength_ += length;
+  spool();
+  if (paused_ && pending_.chainLength() < kMaxPendingWrite / 2) {
+    paused_ = false;
+    downstream_->resumeIngress();
+  }
+  maybeDeliver();
+}
+
+void SpoolingBodyHandler::maybeDeliver() {
+  if (!eom_ || rejected_ || delivered_ || writing_ ||
+      pending_.chainLength() > 0) {
+    return;
+  }
+  delivered_ = true;
+  onRequestBody(std::move(request_),
+                Body(memory_.move(), fileLength_ ? file_ : nullptr,
+                     fileLength_));
+}
+
+void SpoolingBodyHandler::reject(uint16_t status, const std::string& message) {
+  rejected_ = true;
+  memory_.move();
+  pending_.move();
+  ResponseBuilder(downstream_)
+    .status(status, message)
+    .closeConnection()
+    .sendWithEOM();
+  // the connection closes after the response, no need to read the rest
+  if (!paused_) {
+    paused_ = true;
+    downstream_->pauseIngress();
+  }
+}
+
+void SpoolingBodyHandler::finish() {
+  finished_ = true;
+  if (!writing_) {
+    delete this;
+  }
+}
+
+}
@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/lib/utils/CPUExecutor.h>
+#include <proxygen/lib/utils/FileRegion.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * Base for handlers that need the whole body of requests too large to
+ * keep in memory, such as uploads. The first memoryLimit bytes of the body
+ * are kept in IOBufs, and the rest is written to an unlinked temporary
+ * file by a thread of a CPUExecutor, so that the EventBase never waits on
+ * the disk. onRequestBody() gets the request and the body once it is all
+ * in memory or on disk.
+ *
+ * While more than kMaxPendingWrite bytes wait to be written ingress is
+ * paused, so a client faster than the disk doesn't fill the memory. A
+ * request whose body is past maxBodySize gets a 413.
+ *
+ * Subclasses that override requestComplete() or onError() must call the
+ * base ones, which delete the handler once no write is running.
+ */
+class SpoolingBodyHandler : public RequestHandler {
+ public:
+  static const size_t kDefaultMemoryLimit = 1024 * 1024;
+  static const size_t kDefaultMaxBodySize = 1024 * 1024 * 1024;
+  static const size_t kMaxPendingWrite = 4 * 1024 * 1024;
+
+  /**
+   * A complete request body, its first bytes in memory and the rest, if
+   * any, in a file
+   */
+  class Body {
+   public:
+    Body(std::unique_ptr<folly::IOBuf> head,
+         std::shared_ptr<folly::File> file,
+         size_t fileLength);
+
+    size_t size() const {
+      return headLength_ + fileLength_;
+    }
+
+    const folly::IOBuf* getHead() const {
+      return head_.get();
+    }
+
+    std::unique_ptr<folly::IOBuf> moveHead() {
+      headLength_ = 0;
+      return std::move(head_);
+    }
+
+    bool isSpooled() const {
+      return fileLength_ > 0;
+    }
+
+    size_t getFileLength() const {
+      return fileLength_;
+    }
+
+    /**
+     * @return the file, nullptr if the body isn't spooled. Reading it
+     *         blocks, do it on a thread of the executor.
+     */
+    const std::shared_ptr<folly::File>& getFile() const {
+      return file_;
+    }
+
+    /**
+     * @return the spooled part of the body, to send with sendFileRegion()
+     */
+    FileRegion getFileRegion() const;
+
+   private:
+    std::unique_ptr<folly::IOBuf> head_;
+    size_t headLength_;
+    std::shared_ptr<folly::File> file_;
+    size_t fileLength_;
+  };
+
+  /**
+   * executor must outlive the handler. The temporary files are created
+   * in tmpDir.
+   */
+  SpoolingBodyHandler(CPUExecutor* executor,
+                      size_t memoryLimit = kDefaultMemoryLimit,
+                      size_t maxBodySize = kDefaultMaxBodySize,
+                      const std::string& tmpDir = "/tmp");
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override;
+
+  void onError(ProxygenError err) noexcept override;
+
+ protected:
+  /**
+   * Invoked with the request and its whole body, in the place of onEOM()
+   */
+  virtual void onRequestBody(std::unique_ptr<HTTPMessage> request,
+                             Body body) noexcept = 0;
+
+ private:
+  void spool();
+  void onWritten(size_t length, int error);
+  void maybeDeliver();
+  void reject(uint16_t status, const std::string& message);
+  void finish();
+
+  CPUExecutor* const executor_;
+  const size_t memoryLimit_;
+  const size_t maxBodySize_;
+  const std::string tmpDir_;
+  std::unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue memory_{folly::IOBufQueue::cacheChainLength()};
+  // bytes for the file, that no write has taken yet
+  folly::IOBufQueue pending_{folly::IOBufQueue::cacheChainLength()};
+  // only touched by the writes once created, which run one at a time
+  std::shared_ptr<folly::File> file_;
+  size_t received_{0};
+  size_t fileLength_{0};
+  bool writing_{false};
+  bool paused_{false};
+  bool eom_{false};
+  bool rejected_{false};
+  bool delivered_{false};
+  // the transaction is gone
+  bool finished_{false};
+};
+
+}
@@ -0,0 +1,454 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/ResponseHandler.h>
+#include <tuple>
+#include <type_traits>
+
+namespace proxygen {
+
+/**
+ * Base for the filters of a StaticChain. Unlike a Filter, a static filter
+ * has no virtual methods and doesn't know its neighbours; each hook is
+ * given a cursor for its place in the chain, whose methods of the same
+ * names pass the event on: the on*() ones towards the handler, and the
+ * send*() ones towards the client. Hooks are templates on the cursor type
+ * so that the whole pass through a chain is inlined:
+ *
+ *   class AuthFilter : public StaticFilter {
+ *    public:
+ *     template <typename Chain>
+ *     void onRequest(Chain& chain, std::unique_ptr<HTTPMessage> msg) {
+ *       if (!isAllowed(*msg)) {
+ *         HTTPMessage resp;
+ *         ...
+ *         chain.sendHeaders(resp);
+ *         chain.sendEOM();
+ *         return;
+ *       }
+ *       chain.onRequest(std::move(msg));
+ *     }
+ *   };
+ *
+ * The default implementation just lets everything pass through. A filter
+ * that doesn't pass a request on still has to pass requestComplete() and
+ * onError() on, the handler behind the chain is waiting for those.
+ */
+class StaticFilter {
+ public:
+  template <typename Chain>
+  void onRequest(Chain& chain, std::unique_ptr<HTTPMessage> msg) {
+    chain.onRequest(std::move(msg));
+  }
+
+  template <typename Chain>
+  void onBody(Chain& chain, std::unique_ptr<folly::IOBuf> body) {
+    chain.onBody(std::move(body));
+  }
+
+  template <typename Chain>
+  void onUpgrade(Chain& chain, UpgradeProtocol protocol) {
+    chain.onUpgrade(protocol);
+  }
+
+  template <typename Chain>
+  void onEOM(Chain& chain) {
+    chain.onEOM();
+  }
+
+  template <typename Chain>
+  void requestComplete(Chain& chain) {
+    chain.requestComplete();
+  }
+
+  template <typename Chain>
+  void onError(Chain& chain, ProxygenError err) {
+    chain.onError(err);
+  }
+
+  template <typename Chain>
+  void onEgressPaused(Chain& chain) {
+    chain.onEgressPaused();
+  }
+
+  template <typename Chain>
+  void onEgressResumed(Chain& chain) {
+    chain.onEgressResumed();
+  }
+
+  template <typename Chain>
+  void sendHeaders(Chain& chain, HTTPMessage& msg) {
+    chain.sendHeaders(msg);
+  }
+
+  template <typename Chain>
+  void sendChunkHeader(Chain& chain, size_t len) {
+    chain.sendChunkHeader(len);
+  }
+
+  template <typename Chain>
+  void sendBody(Chain& chain, std::unique_ptr<folly::IOBuf> body) {
+    chain.sendBody(std::move(body));
+  }
+
+  template <typename Chain>
+  void sendFileRegion(Chain& chain, const FileRegion& region) {
+    chain.sendFileRegion(region);
+  }
+
+  template <typename Chain>
+  void sendChunkTerminator(Chain& chain) {
+    chain.sendChunkTerminator();
+  }
+
+  template <typename Chain>
+  void sendEOM(Chain& chain) {
+    chain.sendEOM();
+  }
+
+  template <typename Chain>
+  void sendAbort(Chain& chain) {
+    chain.sendAbort();
+  }
+};
+
+/**
+ * A chain of StaticFilters that sits in the place of a Filter: Filters[0]
+ * is the closest to the client, as with HTTPServerOptions::handlerFactories.
+ * All the filters live in the chain object, so a request costs one
+ * allocation however long the chain is, and an event costs one virtual
+ * call into the chain and one out of it, to the upstream handler or to
+ * the downstream response handler.
+ *
+ * sendInformational(), refreshTimeout(), pauseIngress(), resumeIngress(),
+ * newPushedResponse() and the transport info go straight to the downstream
+ * response handler.
+ */
+template <typename... Filters>
+class StaticChain : public RequestHandler, public ResponseHandler {
+ public:
+  static_assert(sizeof...(Filters) > 0, "a StaticChain needs filters");
+  static const size_t kSize = sizeof...(Filters);
+
+  template <size_t I>
+  class Cursor;
+
+  StaticChain(RequestHandler* upstream, const std::tuple<Filters...>& filters)
+      : ResponseHandler(upstream),
+        filters_(filters) {
+  }
+
+  template <size_t I>
+  typename std::tuple_element<I, std::tuple<Filters...>>::type& getFilter() {
+    return std::get<I>(filters_);
+  }
+
+  // Request handler
+  void setResponseHandler(ResponseHandler* handler) noexcept override {
+    downstream_ = handler;
+    upstream_->setResponseHandler(this);
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    upOnRequest(Index<0>(), std::move(msg));
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    upOnBody(Index<0>(), std::move(body));
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {
+    upOnUpgrade(Index<0>(), protocol);
+  }
+
+  void onEOM() noexcept override {
+    upOnEOM(Index<0>());
+  }
+
+  void requestComplete() noexcept override {
+    downstream_ = nullptr;
+    upRequestComplete(Index<0>());
+    delete this;
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    downstream_ = nullptr;
+    upOnError(Index<0>(), err);
+    delete this;
+  }
+
+  void onEgressPaused() noexcept override {
+    upOnEgressPaused(Index<0>());
+  }
+
+  void onEgressResumed() noexcept override {
+    upOnEgressResumed(Index<0>());
+  }
+
+  // Response handler
+  void sendHeaders(HTTPMessage& msg) noexcept override {
+    downSendHeaders(Index<kSize>(), msg);
+  }
+
+  bool sendInformational(HTTPMessage& msg) noexcept override {
+    return downstream_->sendInformational(msg);
+  }
+
+  void sendChunkHeader(size_t len) noexcept override {
+    downSendChunkHeader(Index<kSize>(), len);
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    downSendBody(Index<kSize>(), std::move(body));
+  }
+
+  void sendFileRegion(const FileRegion& region) noexcept override {
+    downSendFileRegion(Index<kSize>(), region);
+  }
+
+  void sendChunkTerminator() noexcept override {
+    downSendChunkTerminator(Index<kSize>());
+  }
+
+  void sendEOM() noexcept override {
+    downSendEOM(Index<kSize>());
+  }
+
+  void sendAbort() noexcept override {
+    downSendAbort(Index<kSize>());
+  }
+
+  void refreshTimeout() noexcept override {
+    downstream_->refreshTimeout();
+  }
+
+  void pauseIngress() noexcept override {
+    downstream_->pauseIngress();
+  }
+
+  void resumeIngress() noexcept override {
+    downstream_->resumeIngress();
+  }
+
+  ResponseHandler* newPushedResponse(
+    PushHandler* handler, const std::string& path) noexcept override {
+    return downstream_->newPushedResponse(handler, path);
+  }
+
+  const folly::TransportInfo& getSetupTransportInfo() const noexcept override {
+    return downstream_->getSetupTransportInfo();
+  }
+
+  void getCurrentTransportInfo(folly::TransportInfo* tinfo) const override {
+    downstream_->getCurrentTransportInfo(tinfo);
+  }
+
+ private:
+  template <size_t I>
+  using Index = std::integral_constant<size_t, I>;
+
+  // The up*() methods give an event to filter I or, past the last one, to
+  // upstream_. The down*() ones give it to filter I - 1 or, before the
+  // first one, to downstream_. The overloads for the ends aren't
+  // templates, so they are preferred there.
+
+#define PROXYGEN_STATIC_CHAIN_UP0(up, name)                             \
+  template <size_t I>                                                   \
+  void up(Index<I>) {                                                   \
+    Cursor<I> cursor(*this);                                            \
+    std::get<I>(filters_).name(cursor);                                 \
+  }                                                                     \
+  void up(Index<kSize>) {                                               \
+    upstream_->name();                                                  \
+  }
+
+#define PROXYGEN_STATIC_CHAIN_UP1(up, name, Arg)                        \
+  template <size_t I>                                                   \
+  void up(Index<I>, Arg arg) {                                          \
+    Cursor<I> cursor(*this);                                            \
+    std::get<I>(filters_).name(cursor, std::forward<Arg>(arg));         \
+  }                                                                     \
+  void up(Index<kSize>, Arg arg) {                                      \
+    upstream_->name(std::forward<Arg>(arg));                            \
+  }
+
+#define PROXYGEN_STATIC_CHAIN_DOWN0(down, name)                         \
+  template <size_t I>                                                   \
+  void down(Index<I>) {                                                 \
+    Cursor<I - 1> cursor(*this);                                        \
+    std::get<I - 1>(filters_).name(cursor);                             \
+  }                                                                     \
+  void down(Index<0>) {                                                 \
+    downstream_->name();                                                \
+  }
+
+#define PROXYGEN_STATIC_CHAIN_DOWN1(down, name, Arg)                    \
+  template <size_t I>                                                   \
+  void down(Index<I>, Arg arg) {                                        \
+    Cursor<I - 1> cursor(*this);                                        \
+    std::get<I - 1>(filters_).name(cursor, std::forward<Arg>(arg));     \
+  }                                                                     \
+  void down(Index<0>, Arg arg) {                                        \
+    downstream_->name(std::forward<Arg>(arg));                          \
+  }
+
+  PROXYGEN_STATIC_CHAIN_UP1(upOnRequest, onRequest,
+                            std::unique_ptr<HTTPMessage>)
+  PROXYGEN_STATIC_CHAIN_UP1(upOnBody, onBody, std::unique_ptr<folly::IOBuf>)
+  PROXYGEN_STATIC_CHAIN_UP1(upOnUpgrade, onUpgrade, UpgradeProtocol)
+  PROXYGEN_STATIC_CHAIN_UP0(upOnEOM, onEOM)
+  PROXYGEN_STATIC_CHAIN_UP0(upRequestComplete, requestComplete)
+  PROXYGEN_STATIC_CHAIN_UP1(upOnError, onError, ProxygenError)
+  PROXYGEN_STATIC_CHAIN_UP0(upOnEgressPaused, onEgressPaused)
+  PROXYGEN_STATIC_CHAIN_UP0(upOnEgressResumed, onEgressResumed)
+  PROXYGEN_STATIC_CHAIN_DOWN1(downSendHeaders, sendHeaders, HTTPMessage&)
+  PROXYGEN_STATIC_CHAIN_DOWN1(downSendChunkHeader, sendChunkHeader, size_t)
+  PROXYGEN_STATIC_CHAIN_DOWN1(downSendBody, sendBody,
+                              std::unique_ptr<folly::IOBuf>)
+  PROXYGEN_STATIC_CHAIN_DOWN1(downSendFileRegion, sendFileRegion,
+                              const FileRegion&)
+  PROXYGEN_STATIC_CHAIN_DOWN0(downSendChunkTerminator, sendChunkTerminator)
+  PROXYGEN_STATIC_CHAIN_DOWN0(downSendEOM, sendEOM)
+  PROXYGEN_STATIC_CHAIN_DOWN0(downSendAbort, sendAbort)
+
+#undef PROXYGEN_STATIC_CHAIN_UP0
+#undef PROXYGEN_STATIC_CHAIN_UP1
+#undef PROXYGEN_STATIC_CHAIN_DOWN0
+#undef PROXYGEN_STATIC_CHAIN_DOWN1
+
+  std::tuple<Filters...> filters_;
+};
+
+template <typename... Filters>
+const size_t StaticChain<Filters...>::kSize;
+
+/**
+ * What the hooks of filter I are given: the rest of the chain, on both
+ * sides of the filter
+ */
+template <typename... Filters>
+template <size_t I>
+class StaticChain<Filters...>::Cursor {
+ public:
+  explicit Cursor(StaticChain& chain): chain_(chain) {
+  }
+
+  // towards the handler
+  void onRequest(std::unique_ptr<HTTPMessage> msg) {
+    chain_.upOnRequest(Index<I + 1>(), std::move(msg));
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) {
+    chain_.upOnBody(Index<I + 1>(), std::move(body));
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) {
+    chain_.upOnUpgrade(Index<I + 1>(), protocol);
+  }
+
+  void onEOM() {
+    chain_.upOnEOM(Index<I + 1>());
+  }
+
+  void requestComplete() {
+    chain_.upRequestComplete(Index<I + 1>());
+  }
+
+  void onError(ProxygenError err) {
+    chain_.upOnError(Index<I + 1>(), err);
+  }
+
+  void onEgressPaused() {
+    chain_.upOnEgressPaused(Index<I + 1>());
+  }
+
+  void onEgressResumed() {
+    chain_.upOnEgressResumed(Index<I + 1>());
+  }
+
+  // towards the client
+  void sendHeaders(HTTPMessage& msg) {
+    chain_.downSendHeaders(Index<I>(), msg);
+  }
+
+  void sendChunkHeader(size_t len) {
+    chain_.downSendChunkHeader(Index<I>(), len);
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) {
+    chain_.downSendBody(Index<I>(), std::move(body));
+  }
+
+  void sendFileRegion(const FileRegion& region) {
+    chain_.downSendFileRegion(Index<I>(), region);
+  }
+
+  void sendChunkTerminator() {
+    chain_.downSendChunkTerminator(Index<I>());
+  }
+
+  void sendEOM() {
+    chain_.downSendEOM(Index<I>());
+  }
+
+  void sendAbort() {
+    chain_.downSendAbort(Index<I>());
+  }
+
+  void refreshTimeout() {
+    chain_.refreshTimeout();
+  }
+
+  void pauseIngress() {
+    chain_.pauseIngress();
+  }
+
+  void resumeIngress() {
+    chain_.resumeIngress();
+  }
+
+  StaticChain& getChain() {
+    return chain_;
+  }
+
+ private:
+  StaticChain& chain_;
+};
+
+/**
+ * Makes a StaticChain for each request, in front of the handler made by
+ * the factories after this one. The filters of each chain are copies of
+ * the ones given here.
+ */
+template <typename... Filters>
+class StaticChainFactory : public RequestHandlerFactory {
+ public:
+  explicit StaticChainFactory(Filters... filters)
+      : filters_(std::move(filters)...) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage*) noexcept override {
+    return new StaticChain<Filters...>(h, filters_);
+  }
+
+ private:
+  const std::tuple<Filters...> filters_;
+};
+
+}
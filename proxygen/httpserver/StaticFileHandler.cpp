@@ -0,0 +1,252 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/StaticFileHandler.h>
+
+#include <folly/Conv.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+
+using folly::StringPiece;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+// ranges past which a Range is ignored
+const size_t kMaxRanges = 16;
+
+bool isValidPath(const string& path) {
+  if (path.empty() || path[0] != '/' || path.find('\0') != string::npos) {
+    return false;
+  }
+  // no way out of the root
+  size_t pos = 0;
+  while ((pos = path.find("/..", pos)) != string::npos) {
+    pos += 3;
+    if (pos == path.size() || path[pos] == '/') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// whether an If-None-Match list has etag
+bool matchesETag(StringPiece list, StringPiece etag) {
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    StringPiece tag(list.begin(),
+                    comma == StringPiece::npos ? list.end() :
+                      list.begin() + comma);
+    list.advance(comma == StringPiece::npos ? list.size() : comma + 1);
+    while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) {
+      tag.pop_front();
+    }
+    while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) {
+      tag.pop_back();
+    }
+    // the weak comparison is enough for a GET
+    if (tag.startsWith("W/")) {
+      tag.advance(2);
+    }
+    if (tag == "*" || tag == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+StaticFileHandler::StaticFileHandler(FileCache* cache, const string& root):
+    cache_(CHECK_NOTNULL(cache)),
+    root_(root) {
+}
+
+void StaticFileHandler::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  request_ = std::move(headers);
+}
+
+void StaticFileHandler::onEOM() noexcept {
+  auto method = request_->getMethod();
+  if (method != HTTPMethod::GET && method != HTTPMethod::HEAD) {
+    ResponseBuilder(downstream_)
+      .status(405, "Method Not Allowed")
+      .header(HTTP_HEADER_ALLOW, "GET, HEAD")
+      .sendWithEOM();
+    return;
+  }
+  string path = request_->getPath();
+  if (!isValidPath(path)) {
+    sendError(400, "Bad Request");
+    return;
+  }
+  if (path.back() == '/') {
+    path += "index.html";
+  }
+  auto entry = cache_->get(root_ + path);
+  if (!entry) {
+    sendError(404, "Not Found");
+    return;
+  }
+  // a precompressed variant, unless it is older than the file
+  if (RFC2616::getAcceptEncodingQvalue(request_->getHeaders(), "gzip") > 0) {
+    auto variant = cache_->get(root_ + path + ".gz");
+    if (variant && variant->mtime >= entry->mtime) {
+      sendFile(*variant, entry->contentType, "gzip");
+      return;
+    }
+  }
+  sendFile(*entry, entry->contentType, "");
+}
+
+void StaticFileHandler::requestComplete() noexcept {
+  delete this;
+}
+
+void StaticFileHandler::onError(ProxygenError err) noexcept {
+  delete this;
+}
+
+void StaticFileHandler::sendFile(const FileCache::Entry& entry,
+                                 const string& contentType,
+                                 const string& contentEncoding) {
+  HTTPMessage response;
+  response.setHTTPVersion(1, 1);
+  auto& headers = response.getHeaders();
+  headers.add(HTTP_HEADER_ETAG, entry.etag);
+  headers.add(HTTP_HEADER_LAST_MODIFIED, entry.lastModified);
+  if (!contentEncoding.empty()) {
+    headers.add(HTTP_HEADER_CONTENT_ENCODING, contentEncoding);
+    headers.add(HTTP_HEADER_VARY, "Accept-Encoding");
+  }
+  if (isNotModified(entry)) {
+    response.setStatusCode(304);
+    response.setStatusMessage("Not Modified");
+    downstream_->sendHeaders(response);
+    downstream_->sendEOM();
+    return;
+  }
+
+  headers.add(HTTP_HEADER_ACCEPT_RANGES, "bytes");
+  size_t offset = 0;
+  size_t length = entry.size;
+  auto range = RFC2616::RangeResult::NONE;
+  std::vector<RFC2616::ByteRange> ranges;
+  const auto& reqHeaders = request_->getHeaders();
+  const string& rangeValue = reqHeaders.getSingleOrEmpty(HTTP_HEADER_RANGE);
+  // a range of another version of the file is of no use
+  if (!rangeValue.empty() &&
+      RFC2616::isIfRangeMatched(
+        reqHeaders.getSingleOrEmpty(HTTP_HEADER_IF_RANGE), entry.etag,
+        entry.lastModified)) {
+    range = RFC2616::parseByteRanges(rangeValue, entry.size, kMaxRanges,
+                                     ranges);
+    if (range == RFC2616::RangeResult::SATISFIABLE) {
+      if (ranges.size() == 1) {
+        offset = ranges[0].offset;
+        length = ranges[0].length;
+      } else {
+        // the whole file, for a RangeFilter to split
+        range = RFC2616::RangeResult::NONE;
+      }
+    }
+  }
+  if (range == RFC2616::RangeResult::UNSATISFIABLE) {
+    response.setStatusCode(416);
+    response.setStatusMessage("Requested Range Not Satisfiable");
+    headers.add(HTTP_HEADER_CONTENT_RANGE,
+                folly::to<string>("bytes */", entry.size));
+    headers.add(HTTP_HEADER_CONTENT_LENGTH, "0");
+    downstream_->sendHeaders(response);
+    downstream_->sendEOM();
+    return;
+  }
+  if (range == RFC2616::RangeResult::SATISFIABLE) {
+    response.setStatusCode(206);
+    response.setStatusMessage("Partial Content");
+    headers.add(HTTP_HEADER_CONTENT_RANGE,
+                folly::to<string>("bytes ", offset, "-", offset + length - 1,
+                                  "/", entry.size));
+  } else {
+    response.setStatusCode(200);
+    response.setStatusMessage("OK");
+  }
+  headers.add(HTTP_HEADER_CONTENT_TYPE, contentType);
+  headers.add(HTTP_HEADER_CONTENT_LENGTH, folly::to<string>(length));
+  downstream_->sendHeaders(response);
+
+  if (request_->getMethod() == HTTPMethod::GET && length > 0) {
+    if (entry.data) {
+      auto body = entry.data->clone();
+      body->trimStart(offset);
+      body->trimEnd(entry.size - offset - length);
+      downstream_->sendBody(std::move(body));
+    } else {
+      downstream_->sendFileRegion(FileRegion(entry.file, offset, length));
+    }
+  }
+  downstream_->sendEOM();
+}
+
+bool StaticFileHandler::isNotModified(const FileCache::Entry& entry) const {
+  const auto& headers = request_->getHeaders();
+  // If-None-Match wins over If-Modified-Since when both are there
+  if (headers.exists(HTTP_HEADER_IF_NONE_MATCH)) {
+    bool matched = false;
+    headers.forEachValueOfHeader(HTTP_HEADER_IF_NONE_MATCH,
+                                 [&] (const string& value) {
+        matched = matchesETag(value, entry.etag);
+        return matched;
+      });
+    return matched;
+  }
+  const string& since = headers.getSingleOrEmpty(
+    HTTP_HEADER_IF_MODIFIED_SINCE);
+  if (!since.empty()) {
+    auto time = parseHTTPDateTime(since);
+    return time && *time >= entry.mtime;
+  }
+  return false;
+}
+
+void StaticFileHandler::sendError(uint16_t status, const string& message) {
+  ResponseBuilder(downstream_)
+    .status(status, message)
+    .body(message)
+    .sendWithEOM();
+}
+
+StaticFileHandlerFactory::StaticFileHandlerFactory(const string& root,
+                                                   size_t maxEntries,
+                                                   size_t maxCachedBody):
+    root_(root),
+    maxEntries_(maxEntries),
+    maxCachedBody_(maxCachedBody) {
+}
+
+void StaticFileHandlerFactory::onServerStart() noexcept {
+  cache_.reset(new FileCache(folly::EventBaseManager::get()->getEventBase(),
+                             maxEntries_, maxCachedBody_));
+}
+
+void StaticFileHandlerFactory::onServerStop() noexcept {
+  cache_.reset();
+}
+
+RequestHandler* StaticFileHandlerFactory::onRequest(RequestHandler*,
+                                                     HTTPMessage*) noexcept {
+  return new StaticFileHandler(cache_.get(), root_);
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <proxygen/httpserver/FileCache.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+
+namespace proxygen {
+
+/**
+ * Serves GET and HEAD requests with the files under a root directory,
+ * from a FileCache. Small files are sent from the cached IOBufs, and the
+ * others as file regions, which go out with sendfile() when the transport
+ * can do it.
+ *
+ * Conditional requests (If-None-Match, If-Modified-Since) get a 304, and a
+ * single byte range (Range, If-Range) a 206, without reading the file.
+ * Requests for several ranges get the whole file, which a RangeFilter in
+ * front of the handler turns into a multipart 206.
+ *
+ * Clients that accept gzip get the precompressed variant of a file, the
+ * one with a .gz suffix, if there is one that isn't older than the file.
+ */
+class StaticFileHandler : public RequestHandler {
+ public:
+  /**
+   * @param root the directory with the files, without a trailing slash
+   */
+  StaticFileHandler(FileCache* cache, const std::string& root);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+  }
+
+  void onUpgrade(proxygen::UpgradeProtocol prot) noexcept override {
+  }
+
+  void onEOM() noexcept override;
+
+  void requestComplete() noexcept override;
+
+  void onError(ProxygenError err) noexcept override;
+
+ private:
+  void sendFile(const FileCache::Entry& entry,
+                const std::string& contentType,
+                const std::string& contentEncoding);
+  bool isNotModified(const FileCache::Entry& entry) const;
+  void sendError(uint16_t status, const std::string& message);
+
+  FileCache* const cache_;
+  const std::string root_;
+  std::unique_ptr<HTTPMessage> request_;
+};
+
+/**
+ * Makes StaticFileHandlers for root, with a FileCache for each handler
+ * thread
+ */
+class StaticFileHandlerFactory : public RequestHandlerFactory {
+ public:
+  explicit StaticFileHandlerFactory(
+    const std::string& root,
+    size_t maxEntries = FileCache::kDefaultMaxEntries,
+    size_t maxCachedBody = FileCache::kDefaultMaxCachedBody);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override;
+
+ private:
+  const std::string root_;
+  const size_t maxEntries_;
+  const size_t maxCachedBody_;
+  folly::ThreadLocalPtr<FileCache> cache_;
+};
+
+}
@@ -0,0 +1,353 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/WebSocketHandler.h>
+
+#include <folly/String.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <vector>
+
+using folly::IOBuf;
+using folly::StringPiece;
+using std::string;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const uint16_t WebSocketHandler::kCloseAbnormal;
+
+namespace {
+
+const string kKeyHeader("Sec-WebSocket-Key");
+const string kVersionHeader("Sec-WebSocket-Version");
+const string kAcceptHeader("Sec-WebSocket-Accept");
+const string kExtensionsHeader("Sec-WebSocket-Extensions");
+
+// the base64 of the 16 bytes of a key
+const size_t kKeyLength = 24;
+
+StringPiece trim(StringPiece s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.advance(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.subtract(1);
+  }
+  return s;
+}
+
+/**
+ * Pick the first permessage-deflate offer of the request that the codec
+ * can do: it deflates each message on its own with the full window, and
+ * inflates whatever the window of the client.
+ *
+ * @return false if there is none
+ */
+bool negotiateDeflate(const HTTPHeaders& headers,
+                      bool& clientNoContextTakeover) {
+  return headers.forEachValueOfHeader(kExtensionsHeader,
+                                      [&] (const string& value) {
+    std::vector<StringPiece> offers;
+    folly::split(',', value, offers);
+    for (auto offer : offers) {
+      std::vector<StringPiece> params;
+      folly::split(';', offer, params);
+      if (trim(params[0]) != "permessage-deflate") {
+        continue;
+      }
+      bool acceptable = true;
+      bool noContextTakeover = false;
+      for (size_t i = 1; i < params.size() && acceptable; i++) {
+        StringPiece param = trim(params[i]);
+        const size_t eq = param.find('=');
+        StringPiece name = trim(param.subpiece(0, eq));
+        StringPiece arg;
+        if (eq != string::npos) {
+          arg = trim(param.subpiece(eq + 1));
+          if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') {
+            arg = arg.subpiece(1, arg.size() - 2);
+          }
+        }
+        if (name == "server_no_context_takeover") {
+          acceptable = eq == string::npos;
+        } else if (name == "client_no_context_takeover") {
+          acceptable = eq == string::npos;
+          noContextTakeover = true;
+        } else if (name == "server_max_window_bits") {
+          acceptable = arg == "15";
+        } else if (name != "client_max_window_bits") {
+          acceptable = false;
+        }
+      }
+      if (acceptable) {
+        clientNoContextTakeover = noContextTakeover;
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+}
+
+WebSocketHandler::WebSocketHandler(const Options& options):
+    options_(options) {
+  codec_.setCallback(this);
+  codec_.setMaxMessageSize(options_.maxMessageSize);
+}
+
+void WebSocketHandler::onRequest(unique_ptr<HTTPMessage> request) noexcept {
+  const auto& headers = request->getHeaders();
+  if (request->getMethod() != HTTPMethod::GET || !request->isHTTP1_1() ||
+      !request->checkForHeaderToken(HTTP_HEADER_UPGRADE, "websocket",
+                                    false) ||
+      !request->checkForHeaderToken(HTTP_HEADER_CONNECTION, "upgrade",
+                                    false)) {
+    reject(400, "Bad Request");
+    return;
+  }
+  if (headers.getSingleOrEmpty(kVersionHeader) != "13") {
+    ResponseBuilder(downstream_)
+      .status(426, "Upgrade Required")
+      .header(kVersionHeader, "13")
+      .sendWithEOM();
+    return;
+  }
+  const string& key = headers.getSingleOrEmpty(kKeyHeader);
+  if (key.size() != kKeyLength) {
+    reject(400, "Bad Request");
+    return;
+  }
+
+  HTTPMessage response;
+  response.setHTTPVersion(1, 1);
+  response.setStatusCode(101);
+  response.setStatusMessage("Switching Protocols");
+  // the codec adds the Connection: upgrade
+  response.getHeaders().add(HTTP_HEADER_UPGRADE, "websocket");
+  response.getHeaders().add(kAcceptHeader, WebSocketCodec::getAcceptKey(key));
+  bool clientNoContextTakeover = false;
+  if (options_.deflateLevel >= 0 &&
+      negotiateDeflate(headers, clientNoContextTakeover)) {
+    response.getHeaders().add(
+      kExtensionsHeader,
+      clientNoContextTakeover ?
+      "permessage-deflate; server_no_context_takeover; "
+      "client_no_context_takeover" :
+      "permessage-deflate; server_no_context_takeover");
+    codec_.setDeflate(options_.deflateLevel, clientNoContextTakeover);
+  }
+  if (!onWebSocketRequest(*request, response)) {
+    reject(403, "Forbidden");
+    return;
+  }
+  downstream_->sendHeaders(response);
+}
+
+void WebSocketHandler::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (!open_) {
+    // the body of a refused request
+    return;
+  }
+  // the replies to a read go out together
+  parsing_ = true;
+  codec_.onIngress(std::move(body));
+  parsing_ = false;
+  flush();
+}
+
+void WebSocketHandler::onUpgrade(UpgradeProtocol prot) noexcept {
+  open_ = true;
+  onWebSocketOpen();
+}
+
+void WebSocketHandler::onEOM() noexcept {
+  if (!open_) {
+    return;
+  }
+  // the peer closed the connection
+  notifyClose(kCloseAbnormal, "");
+  shutdown();
+}
+
+void WebSocketHandler::requestComplete() noexcept {
+  if (open_) {
+    notifyClose(kCloseAbnormal, "");
+  }
+  delete this;
+}
+
+void WebSocketHandler::onError(ProxygenError err) noexcept {
+  if (open_) {
+    notifyClose(kCloseAbnormal, "");
+  }
+  delete this;
+}
+
+void WebSocketHandler::onEgressPaused() noexcept {
+  egressPaused_ = true;
+  updateIngressPause();
+}
+
+void WebSocketHandler::onEgressResumed() noexcept {
+  egressPaused_ = false;
+  updateIngressPause();
+}
+
+void WebSocketHandler::sendMessage(WebSocketOpcode opcode,
+                                   unique_ptr<IOBuf> data) {
+  if (!isOpen()) {
+    return;
+  }
+  codec_.generateMessage(writeBuf_, opcode, std::move(data));
+  if (!parsing_) {
+    flush();
+  }
+}
+
+void WebSocketHandler::sendText(StringPiece text) {
+  sendMessage(WebSocketOpcode::TEXT,
+              IOBuf::copyBuffer(text.data(), text.size()));
+}
+
+void WebSocketHandler::sendFrame(WebSocketOpcode opcode,
+                                 unique_ptr<IOBuf> data, bool fin) {
+  if (!isOpen()) {
+    return;
+  }
+  codec_.generateFrame(writeBuf_, opcode, std::move(data), fin);
+  if (!parsing_) {
+    flush();
+  }
+}
+
+void WebSocketHandler::sendPing(unique_ptr<IOBuf> data) {
+  if (!isOpen()) {
+    return;
+  }
+  codec_.generatePing(writeBuf_, std::move(data));
+  if (!parsing_) {
+    flush();
+  }
+}
+
+void WebSocketHandler::close(uint16_t code, StringPiece reason) {
+  if (!isOpen()) {
+    return;
+  }
+  sendClose(code, reason);
+  if (!parsing_) {
+    flush();
+  }
+}
+
+void WebSocketHandler::pauseIngress() {
+  pausedByUser_ = true;
+  updateIngressPause();
+}
+
+void WebSocketHandler::resumeIngress() {
+  pausedByUser_ = false;
+  updateIngressPause();
+}
+
+void WebSocketHandler::onMessageData(WebSocketOpcode opcode,
+                                     unique_ptr<IOBuf> data, bool fin) {
+  onWebSocketMessageData(opcode, std::move(data), fin);
+}
+
+void WebSocketHandler::onPing(unique_ptr<IOBuf> data) {
+  if (!closeSent_) {
+    codec_.generatePong(writeBuf_, std::move(data));
+  }
+}
+
+void WebSocketHandler::onPong(unique_ptr<IOBuf> data) {
+  onWebSocketPong(std::move(data));
+}
+
+void WebSocketHandler::onClose(uint16_t code, string reason) {
+  if (!closeSent_) {
+    // echo the code, as the RFC recommends
+    sendClose(code, "");
+  }
+  notifyClose(code, reason);
+  shutdown();
+}
+
+void WebSocketHandler::onError(uint16_t code) {
+  if (!closeSent_) {
+    sendClose(code, "");
+  }
+  notifyClose(code, "");
+  shutdown();
+}
+
+void WebSocketHandler::reject(uint16_t status, const string& message) {
+  ResponseBuilder(downstream_)
+    .status(status, message)
+    .sendWithEOM();
+}
+
+void WebSocketHandler::flush() {
+  if (writeBuf_.chainLength() == 0) {
+    return;
+  }
+  if (eomSent_) {
+    writeBuf_.move();
+    return;
+  }
+  downstream_->sendBody(writeBuf_.move());
+}
+
+void WebSocketHandler::sendClose(uint16_t code, StringPiece reason) {
+  closeSent_ = true;
+  codec_.generateClose(writeBuf_, code, reason);
+}
+
+void WebSocketHandler::shutdown() {
+  flush();
+  if (!eomSent_) {
+    eomSent_ = true;
+    // may complete the transaction, and delete this
+    downstream_->sendEOM();
+  }
+}
+
+void WebSocketHandler::notifyClose(uint16_t code, const string& reason) {
+  if (closeNotified_) {
+    return;
+  }
+  closeNotified_ = true;
+  onWebSocketClose(code, reason);
+}
+
+void WebSocketHandler::updateIngressPause() {
+  const bool pause = egressPaused_ || pausedByUser_;
+  if (pause == ingressPaused_) {
+    return;
+  }
+  ingressPaused_ = pause;
+  if (pause) {
+    codec_.setParserPaused(true);
+    downstream_->pauseIngress();
+    return;
+  }
+  downstream_->resumeIngress();
+  // what was queued is parsed now
+  const bool parsing = parsing_;
+  parsing_ = true;
+  codec_.setParserPaused(false);
+  parsing_ = parsing;
+  if (!parsing_) {
+    flush();
+  }
+}
+
+}
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/lib/http/codec/WebSocketCodec.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * Base for handlers that accept WebSockets (RFC 6455) on the HTTP/1.1
+ * Upgrade path. The handshake is answered with a 101, permessage-deflate
+ * is taken when the client offers it, and from the upgrade on the raw
+ * bytes of the connection go through a WebSocketCodec to the
+ * onWebSocket*() methods. Pings are answered and the closing handshake is
+ * done here.
+ *
+ * Ingress is paused while the egress of the connection is, so that a peer
+ * that doesn't read can't make the handler queue replies without bounds.
+ * The transaction timeouts still apply, a connection that may stay quiet
+ * longer needs pings.
+ *
+ * Subclasses that override requestComplete() or onError() must call the
+ * base ones, which delete the handler.
+ */
+class WebSocketHandler : public RequestHandler,
+                         private WebSocketCodec::Callback {
+ public:
+  struct Options {
+    size_t maxMessageSize{WebSocketCodec::kDefaultMaxMessageSize};
+    // the zlib level of permessage-deflate, -1 to refuse the extension
+    int deflateLevel{6};
+  };
+
+  explicit WebSocketHandler(const Options& options = Options());
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept final;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept final;
+
+  void onUpgrade(UpgradeProtocol prot) noexcept final;
+
+  void onEOM() noexcept final;
+
+  void requestComplete() noexcept override;
+
+  void onError(ProxygenError err) noexcept override;
+
+  void onEgressPaused() noexcept final;
+
+  void onEgressResumed() noexcept final;
+
+ protected:
+  /**
+   * Invoked with a valid handshake request. response is the 101 to send,
+   * a Sec-WebSocket-Protocol may be added to it.
+   *
+   * @return false to refuse the WebSocket with a 403
+   */
+  virtual bool onWebSocketRequest(const HTTPMessage& request,
+                                  HTTPMessage& response) noexcept {
+    return true;
+  }
+
+  /**
+   * Invoked once the 101 is sent, messages may be sent from here on
+   */
+  virtual void onWebSocketOpen() noexcept {
+  }
+
+  /**
+   * Part of a TEXT or BINARY message, see WebSocketCodec::Callback
+   */
+  virtual void onWebSocketMessageData(WebSocketOpcode opcode,
+                                      std::unique_ptr<folly::IOBuf> data,
+                                      bool fin) noexcept = 0;
+
+  virtual void onWebSocketPong(std::unique_ptr<folly::IOBuf> data) noexcept {
+  }
+
+  /**
+   * The WebSocket is closed, by the peer, by close() or by an error, with
+   * kCloseAbnormal if the connection just went away. Nothing can be sent
+   * any more.
+   */
+  virtual void onWebSocketClose(uint16_t code,
+                                const std::string& reason) noexcept {
+  }
+
+  void sendMessage(WebSocketOpcode opcode,
+                   std::unique_ptr<folly::IOBuf> data);
+
+  void sendText(folly::StringPiece text);
+
+  /**
+   * Send a message in pieces, see WebSocketCodec::generateFrame()
+   */
+  void sendFrame(WebSocketOpcode opcode, std::unique_ptr<folly::IOBuf> data,
+                 bool fin);
+
+  void sendPing(std::unique_ptr<folly::IOBuf> data = nullptr);
+
+  /**
+   * Start the closing handshake; the connection goes once the peer
+   * answers
+   */
+  void close(uint16_t code = WebSocketCodec::kCloseNormal,
+             folly::StringPiece reason = folly::StringPiece());
+
+  /**
+   * Stop and resume the WebSocket ingress, on top of the pauses for egress
+   */
+  void pauseIngress();
+
+  void resumeIngress();
+
+  bool isOpen() const {
+    return open_ && !closeSent_;
+  }
+
+  bool isEgressPaused() const {
+    return egressPaused_;
+  }
+
+  // for onWebSocketClose() when the connection went without a CLOSE
+  static const uint16_t kCloseAbnormal = 1006;
+
+ private:
+  void onMessageData(WebSocketOpcode opcode,
+                     std::unique_ptr<folly::IOBuf> data,
+                     bool fin) override;
+  void onPing(std::unique_ptr<folly::IOBuf> data) override;
+  void onPong(std::unique_ptr<folly::IOBuf> data) override;
+  void onClose(uint16_t code, std::string reason) override;
+  void onError(uint16_t code) override;
+
+  void reject(uint16_t status, const std::string& message);
+  void flush();
+  void sendClose(uint16_t code, folly::StringPiece reason);
+  void shutdown();
+  void notifyClose(uint16_t code, const std::string& reason);
+  void updateIngressPause();
+
+  const Options options_;
+  WebSocketCodec codec_{TransportDirection::DOWNSTREAM};
+  folly::IOBufQueue writeBuf_{folly::IOBufQueue::cacheChainLength()};
+  bool open_{false};
+  bool closeSent_{false};
+  bool closeReceived_{false};
+  bool closeNotified_{false};
+  bool eomSent_{false};
+  // the sends are flushed once the codec returns
+  bool parsing_{false};
+  bool egressPaused_{false};
+  bool pausedByUser_{false};
+  bool ingressPaused_{false};
+};
+
+}
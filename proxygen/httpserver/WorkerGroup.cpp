@@ -0,0 +1,370 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/WorkerGroup.h>
+
+#include <algorithm>
+#include <folly/io/async/EventBaseManager.h>
+#include <functional>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/httpserver/ResponseHandler.h>
+#include <strings.h>
+
+namespace proxygen {
+
+namespace {
+
+/**
+ * What the two halves of a handed off request share. Each field belongs to
+ * one thread, except setupInfo, which is written before the request is
+ * handed off and only read after.
+ */
+struct Bridge {
+  std::shared_ptr<CompletionQueue> sessionQueue;
+  std::shared_ptr<CompletionQueue> workerQueue;
+  std::atomic<uint32_t>* active{nullptr};
+  const std::vector<RequestHandlerFactory*>* chain{nullptr};
+  folly::TransportInfo setupInfo;
+
+  // the session's thread: null once the transaction is done
+  ResponseHandler* downstream{nullptr};
+
+  // the worker's thread: the group's chain, null once it is done, and the
+  // ResponseHandler it sends its response to
+  RequestHandler* upstream{nullptr};
+  ResponseHandler* response{nullptr};
+};
+
+/**
+ * Run fn with the group's chain, on its thread, unless it is done
+ */
+void toWorker(const std::shared_ptr<Bridge>& bridge,
+              std::function<void(RequestHandler*)> fn) {
+  CompletionQueue::post(bridge->workerQueue, [bridge, fn] {
+      if (bridge->upstream) {
+        fn(bridge->upstream);
+      }
+    });
+}
+
+/**
+ * Run fn with the session's ResponseHandler, on its thread, unless the
+ * transaction is done
+ */
+void toSession(const std::shared_ptr<Bridge>& bridge,
+               std::function<void(ResponseHandler*)> fn) {
+  CompletionQueue::post(bridge->sessionQueue, [bridge, fn] {
+      if (bridge->downstream) {
+        fn(bridge->downstream);
+      }
+    });
+}
+
+/**
+ * The ResponseHandler of the group's chain, on the group's thread
+ */
+class WorkerResponseHandler : public ResponseHandler {
+ public:
+  WorkerResponseHandler(RequestHandler* upstream,
+                        std::shared_ptr<Bridge> bridge)
+      : ResponseHandler(upstream),
+        bridge_(std::move(bridge)) {
+  }
+
+  void sendHeaders(HTTPMessage& msg) noexcept override {
+    auto copy = std::make_shared<HTTPMessage>(msg);
+    toSession(bridge_, [copy] (ResponseHandler* h) {
+        h->sendHeaders(*copy);
+      });
+  }
+
+  void sendChunkHeader(size_t len) noexcept override {
+    toSession(bridge_, [len] (ResponseHandler* h) {
+        h->sendChunkHeader(len);
+      });
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    auto shared = std::make_shared<std::unique_ptr<folly::IOBuf>>(
+      std::move(body));
+    toSession(bridge_, [shared] (ResponseHandler* h) {
+        h->sendBody(std::move(*shared));
+      });
+  }
+
+  void sendFileRegion(const FileRegion& region) noexcept override {
+    toSession(bridge_, [region] (ResponseHandler* h) {
+        h->sendFileRegion(region);
+      });
+  }
+
+  void sendChunkTerminator() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->sendChunkTerminator();
+      });
+  }
+
+  void sendEOM() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->sendEOM();
+      });
+  }
+
+  void sendAbort() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->sendAbort();
+      });
+  }
+
+  void refreshTimeout() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->refreshTimeout();
+      });
+  }
+
+  void pauseIngress() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->pauseIngress();
+      });
+  }
+
+  void resumeIngress() noexcept override {
+    toSession(bridge_, [] (ResponseHandler* h) {
+        h->resumeIngress();
+      });
+  }
+
+  const folly::TransportInfo& getSetupTransportInfo() const noexcept
+    override {
+    return bridge_->setupInfo;
+  }
+
+  void getCurrentTransportInfo(folly::TransportInfo* tinfo) const override {
+    *tinfo = bridge_->setupInfo;
+  }
+
+ private:
+  std::shared_ptr<Bridge> bridge_;
+};
+
+/**
+ * Build the group's chain for request, on its thread, and hand it the
+ * request
+ */
+void startChain(const std::shared_ptr<Bridge>& bridge,
+                std::unique_ptr<HTTPMessage> request) {
+  if (request->isExpired()) {
+    // it waited for the group longer than the client does, the handlers
+    // never see it
+    toSession(bridge, [] (ResponseHandler* h) {
+        ResponseBuilder(h)
+          .status(504, "Gateway Timeout")
+          .sendWithEOM();
+      });
+    return;
+  }
+  RequestHandler* h = nullptr;
+  for (auto factory: *bridge->chain) {
+    h = factory->onRequest(h, request.get());
+  }
+  bridge->response = new WorkerResponseHandler(h, bridge);
+  h->setResponseHandler(bridge->response);
+  bridge->upstream = h;
+  h->onRequest(std::move(request));
+}
+
+/**
+ * The handler of a handed off request, on the thread of its session
+ */
+class HandoffHandler : public RequestHandler {
+ public:
+  explicit HandoffHandler(std::shared_ptr<Bridge> bridge)
+      : bridge_(std::move(bridge)) {
+  }
+
+  void setResponseHandler(ResponseHandler* handler) noexcept override {
+    RequestHandler::setResponseHandler(handler);
+    bridge_->downstream = handler;
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override {
+    bridge_->setupInfo = downstream_->getSetupTransportInfo();
+    auto request = std::make_shared<std::unique_ptr<HTTPMessage>>(
+      std::move(headers));
+    auto bridge = bridge_;
+    CompletionQueue::post(bridge->workerQueue, [bridge, request] {
+        startChain(bridge, std::move(*request));
+      });
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    auto shared = std::make_shared<std::unique_ptr<folly::IOBuf>>(
+      std::move(body));
+    toWorker(bridge_, [shared] (RequestHandler* h) {
+        h->onBody(std::move(*shared));
+      });
+  }
+
+  void onUpgrade(UpgradeProtocol prot) noexcept override {
+    toWorker(bridge_, [prot] (RequestHandler* h) {
+        h->onUpgrade(prot);
+      });
+  }
+
+  void onEOM() noexcept override {
+    toWorker(bridge_, [] (RequestHandler* h) {
+        h->onEOM();
+      });
+  }
+
+  void requestComplete() noexcept override {
+    finish([] (RequestHandler* h) {
+        h->requestComplete();
+      });
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    finish([err] (RequestHandler* h) {
+        h->onError(err);
+      });
+  }
+
+  void onEgressPaused() noexcept override {
+    toWorker(bridge_, [] (RequestHandler* h) {
+        h->onEgressPaused();
+      });
+  }
+
+  void onEgressResumed() noexcept override {
+    toWorker(bridge_, [] (RequestHandler* h) {
+        h->onEgressResumed();
+      });
+  }
+
+ private:
+  /**
+   * Deliver the last event to the group's chain, which deletes itself
+   * with it, and go away
+   */
+  void finish(std::function<void(RequestHandler*)> last) {
+    bridge_->downstream = nullptr;
+    auto bridge = bridge_;
+    CompletionQueue::post(bridge->workerQueue, [bridge, last] {
+        if (bridge->upstream) {
+          auto upstream = bridge->upstream;
+          bridge->upstream = nullptr;
+          last(upstream);
+        }
+        delete bridge->response;
+        bridge->response = nullptr;
+        bridge->active->fetch_sub(1, std::memory_order_relaxed);
+      });
+    delete this;
+  }
+
+  std::shared_ptr<Bridge> bridge_;
+};
+
+}
+
+WorkerGroup::WorkerGroup(HTTPServerOptions::WorkerGroupConfig config)
+    : name_(config.name),
+      threadAffinity_(config.threadAffinity),
+      hosts_(config.hosts),
+      pathPrefixes_(config.pathPrefixes),
+      handlerFactories_(std::move(config.handlerFactories)) {
+  CHECK(!handlerFactories_.empty()) << "worker group " << name_
+                                    << " has no handler factories";
+  CHECK_GT(config.threads, 0);
+  for (auto& factory: handlerFactories_) {
+    chain_.push_back(factory.get());
+  }
+  std::reverse(chain_.begin(), chain_.end());
+  for (size_t i = 0; i < config.threads; i++) {
+    workers_.emplace_back(new Worker());
+  }
+}
+
+WorkerGroup::~WorkerGroup() {
+}
+
+bool WorkerGroup::matchesHost(folly::StringPiece host,
+                              const std::string& pattern) {
+  if (pattern.size() > 2 && pattern[0] == '*' && pattern[1] == '.') {
+    // any subdomain, not the domain itself
+    size_t suffix = pattern.size() - 1;
+    return host.size() > suffix &&
+      strncasecmp(host.data() + host.size() - suffix, pattern.data() + 1,
+                  suffix) == 0;
+  }
+  return host.size() == pattern.size() &&
+    strncasecmp(host.data(), pattern.data(), host.size()) == 0;
+}
+
+bool WorkerGroup::matches(const HTTPMessage& msg) const {
+  if (!hosts_.empty()) {
+    auto host = msg.getHeaders().getSingleOrEmptyView(HTTP_HEADER_HOST);
+    // the port, unless the colon is the one of an IPv6 literal
+    auto colon = host.rfind(':');
+    if (colon != folly::StringPiece::npos &&
+        host.find(']', colon) == folly::StringPiece::npos) {
+      host = host.subpiece(0, colon);
+    }
+    for (const auto& pattern: hosts_) {
+      if (matchesHost(host, pattern)) {
+        return true;
+      }
+    }
+  }
+  const auto& path = msg.getPath();
+  for (const auto& prefix: pathPrefixes_) {
+    if (path.compare(0, prefix.size(), prefix) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkerGroup::onThreadStart(size_t index, folly::EventBase* eventBase) {
+  workers_[index]->queue = std::make_shared<CompletionQueue>(eventBase);
+  for (auto& factory: handlerFactories_) {
+    factory->onServerStart();
+  }
+}
+
+void WorkerGroup::onThreadStop() {
+  for (auto& factory: handlerFactories_) {
+    factory->onServerStop();
+  }
+}
+
+RequestHandler* WorkerGroup::newHandler(
+    std::shared_ptr<CompletionQueue> sessionQueue) {
+  size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+  Worker* worker = nullptr;
+  uint32_t least = 0;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    auto candidate = workers_[(start + i) % workers_.size()].get();
+    uint32_t active = candidate->active.load(std::memory_order_relaxed);
+    if (!worker || active < least) {
+      worker = candidate;
+      least = active;
+    }
+  }
+  worker->active.fetch_add(1, std::memory_order_relaxed);
+
+  auto bridge = std::make_shared<Bridge>();
+  bridge->sessionQueue = std::move(sessionQueue);
+  bridge->workerQueue = worker->queue;
+  bridge->active = &worker->active;
+  bridge->chain = &chain_;
+  return new HandoffHandler(std::move(bridge));
+}
+
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <proxygen/httpserver/HTTPServerOptions.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/lib/utils/CompletionQueue.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A set of threads with a handler chain of their own, that the sessions of
+ * the handler threads hand some of their requests to, see
+ * HTTPServerOptions::workerGroups.
+ *
+ * The handler that newHandler() returns runs on the thread of the session
+ * and forwards each event of the request to the group's handler chain,
+ * through the CompletionQueue of the group thread; the chain's response
+ * comes back through the CompletionQueue of the session's thread. Both
+ * are lock-free, and batch the events of a loop behind one wakeup. The
+ * group's handlers see the transport info as of the request;
+ * getCurrentTransportInfo() returns that too.
+ *
+ * The server runs the group's threads: each calls onThreadStart() before
+ * the server accepts, and onThreadStop() once the sessions drained.
+ */
+class WorkerGroup {
+ public:
+  explicit WorkerGroup(HTTPServerOptions::WorkerGroupConfig config);
+  ~WorkerGroup();
+
+  const std::string& getName() const {
+    return name_;
+  }
+
+  size_t getNumThreads() const {
+    return workers_.size();
+  }
+
+  const std::vector<std::vector<int>>& getThreadAffinity() const {
+    return threadAffinity_;
+  }
+
+  /**
+   * @return true if the request goes to this group, by its Host or path
+   */
+  bool matches(const HTTPMessage& msg) const;
+
+  /**
+   * Called in the EventBase of thread `index` of the group, before any
+   * request comes
+   */
+  void onThreadStart(size_t index, folly::EventBase* eventBase);
+
+  /**
+   * Called in the EventBase of each thread of the group, once no request
+   * comes any more
+   */
+  void onThreadStop();
+
+  /**
+   * A handler, for the thread of sessionQueue, that hands the request to
+   * the least busy thread of the group
+   */
+  RequestHandler* newHandler(std::shared_ptr<CompletionQueue> sessionQueue);
+
+  /**
+   * @return the requests handed to thread `index` of the group and not
+   *         done yet. May be called from any thread.
+   */
+  uint32_t getActiveRequests(size_t index) const {
+    return workers_[index]->active.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Worker {
+    std::shared_ptr<CompletionQueue> queue;
+    std::atomic<uint32_t> active{0};
+  };
+
+  static bool matchesHost(folly::StringPiece host,
+                          const std::string& pattern);
+
+  const std::string name_;
+  const std::vector<std::vector<int>> threadAffinity_;
+  const std::vector<std::string> hosts_;
+  const std::vector<std::string> pathPrefixes_;
+  std::vector<std::unique_ptr<RequestHandlerFactory>> handlerFactories_;
+  // in the order they build the chain in, the handler first
+  std::vector<RequestHandlerFactory*> chain_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // where the search for the least busy thread starts, so that ties
+  // rotate
+  std::atomic<size_t> next_{0};
+};
+
+}
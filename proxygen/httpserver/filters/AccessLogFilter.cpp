@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/AccessLogFilter.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <proxygen/lib/utils/HTTPTime.h>
+
+namespace proxygen {
+
+const size_t AccessLogFilter::kMaxRequestLine;
+
+namespace {
+
+// The fixed parts of a line, the numbers and the date
+const size_t kMaxLineOverhead = 128;
+
+// Copy str into dst of size, cut if needed
+void copyCut(char* dst, size_t size, const std::string& str) {
+  size_t len = std::min(str.size(), size - 1);
+  memcpy(dst, str.data(), len);
+  dst[len] = '\0';
+}
+
+}
+
+AccessLogFilter::AccessLogFilter(RequestHandler* upstream,
+                                 AsyncLogWriter* writer)
+    : Filter(upstream),
+      writer_(CHECK_NOTNULL(writer)),
+      start_(getCurrentTime()) {
+  clientIP_[0] = '\0';
+  strcpy(requestLine_, "-");
+}
+
+void AccessLogFilter::onRequest(std::unique_ptr<HTTPMessage> headers)
+    noexcept {
+  start_ = getCurrentTime();
+  copyCut(clientIP_, sizeof(clientIP_), headers->getClientIP());
+  const auto& version = headers->getHTTPVersion();
+  const auto& url = headers->getURL();
+  snprintf(requestLine_, sizeof(requestLine_), "%s %.*s HTTP/%u.%u",
+           headers->getMethodString().c_str(),
+           int(std::min(url.size(), kMaxRequestLine)), url.data(),
+           version.first, version.second);
+  Filter::onRequest(std::move(headers));
+}
+
+void AccessLogFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  if (msg.getStatusCode() >= 200) {
+    status_ = msg.getStatusCode();
+  }
+  Filter::sendHeaders(msg);
+}
+
+void AccessLogFilter::sendBody(std::unique_ptr<folly::IOBuf> body) noexcept {
+  if (body) {
+    bytes_ += body->computeChainDataLength();
+  }
+  Filter::sendBody(std::move(body));
+}
+
+void AccessLogFilter::sendFileRegion(const FileRegion& region) noexcept {
+  bytes_ += region.getLength();
+  Filter::sendFileRegion(region);
+}
+
+void AccessLogFilter::requestComplete() noexcept {
+  log();
+  Filter::requestComplete();
+}
+
+void AccessLogFilter::onError(ProxygenError err) noexcept {
+  log();
+  Filter::onError(err);
+}
+
+void AccessLogFilter::log() {
+  const auto& date = getCachedHTTPDateTime();
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+    getCurrentTime() - start_).count();
+  size_t maxLength = sizeof(clientIP_) + sizeof(requestLine_) +
+    date.size() + kMaxLineOverhead;
+  writer_->append(maxLength, [&] (char* dst) {
+      int len = snprintf(dst, maxLength,
+                         "%s - - [%s] \"%s\" %u %" PRIu64 " %" PRId64 "\n",
+                         clientIP_[0] ? clientIP_ : "-", date.c_str(),
+                         requestLine_, status_, bytes_, int64_t(micros));
+      return std::min(size_t(std::max(len, 0)), maxLength - 1);
+    });
+}
+
+}
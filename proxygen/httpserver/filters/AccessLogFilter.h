@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/utils/AsyncLogWriter.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * A filter that logs each request to an AsyncLogWriter once it is done,
+ * in the common log format followed by the time it took in microseconds:
+ *
+ *   10.0.0.1 - - [Tue, 14 Oct 2014 10:00:00 GMT] "GET / HTTP/1.1" 200 612 83
+ *
+ * The fields are kept in the filter itself and the line is formatted in
+ * the buffer of the writer, so logging allocates nothing per request.
+ * Request lines longer than kMaxRequestLine are cut.
+ */
+class AccessLogFilter : public Filter {
+ public:
+  static const size_t kMaxRequestLine = 512;
+
+  AccessLogFilter(RequestHandler* upstream, AsyncLogWriter* writer);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void sendFileRegion(const FileRegion& region) noexcept override;
+
+ private:
+  void log();
+
+  AsyncLogWriter* const writer_;
+  TimePoint start_;
+  uint16_t status_{0};
+  uint64_t bytes_{0};
+  char clientIP_[48];
+  char requestLine_[kMaxRequestLine];
+};
+
+/**
+ * Makes AccessLogFilters that log to writer. Each handler thread hands
+ * what it logged to the writer as the server stops.
+ */
+class AccessLogFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit AccessLogFilterFactory(std::shared_ptr<AsyncLogWriter> writer)
+      : writer_(std::move(writer)) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+    writer_->flush();
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage*) noexcept override {
+    return new AccessLogFilter(h, writer_.get());
+  }
+
+ private:
+  std::shared_ptr<AsyncLogWriter> writer_;
+};
+
+}
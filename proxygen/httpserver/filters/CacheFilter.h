@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Conv.h>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/DiskCache.h>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+namespace proxygen {
+
+/**
+ * A filter that answers requests from a ResponseCache when it can, and
+ * stores the cacheable responses of the handler there otherwise. A hit
+ * never reaches the handler, which is told to go away with onError().
+ *
+ * With a DiskCache, the requests the ResponseCache misses are looked up
+ * there, and the bodies of its hits are sent from the file.
+ */
+class CacheFilter : public Filter {
+ public:
+  CacheFilter(RequestHandler* upstream, ResponseCache* cache,
+              DiskCache* disk = nullptr)
+      : Filter(upstream),
+        cache_(cache),
+        disk_(disk) {
+  }
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override {
+    if (ResponseCache::isCacheableRequest(*msg)) {
+      if (ResponseCache::mayServeFromCache(*msg)) {
+        auto hit = cache_->get(*msg);
+        if (hit) {
+          upstream_->onError(kErrorCanceled);
+          upstream_ = nullptr;
+          sendHit(*hit);
+          return;
+        }
+        auto diskHit = disk_ ? disk_->get(*msg) : nullptr;
+        if (diskHit) {
+          upstream_->onError(kErrorCanceled);
+          upstream_ = nullptr;
+          sendDiskHit(*diskHit);
+          return;
+        }
+      }
+      request_.reset(new HTTPMessage(*msg));
+    }
+    upstream_->onRequest(std::move(msg));
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    if (upstream_) {
+      upstream_->onBody(std::move(body));
+    }
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {
+    if (upstream_) {
+      upstream_->onUpgrade(protocol);
+    }
+  }
+
+  void onEOM() noexcept override {
+    if (upstream_) {
+      upstream_->onEOM();
+    }
+  }
+
+  void requestComplete() noexcept override {
+    if (upstream_) {
+      Filter::requestComplete();
+    } else {
+      delete this;
+    }
+  }
+
+  void onError(ProxygenError err) noexcept override {
+    if (upstream_) {
+      Filter::onError(err);
+    } else {
+      delete this;
+    }
+  }
+
+  void onEgressPaused() noexcept override {
+    if (upstream_) {
+      upstream_->onEgressPaused();
+    }
+  }
+
+  void onEgressResumed() noexcept override {
+    if (upstream_) {
+      upstream_->onEgressResumed();
+    }
+  }
+
+  // Response handler
+  void sendHeaders(HTTPMessage& msg) noexcept override {
+    if (request_ && ResponseCache::getFreshness(msg).count() > 0) {
+      response_.reset(new HTTPMessage(msg));
+    } else {
+      request_.reset();
+    }
+    downstream_->sendHeaders(msg);
+  }
+
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    if (response_ && body) {
+      bodySize_ += body->computeChainDataLength();
+      if (bodySize_ > cache_->getMaxEntrySize()) {
+        response_.reset();
+        body_.reset();
+      } else if (body_) {
+        body_->prependChain(body->clone());
+      } else {
+        body_ = body->clone();
+      }
+    }
+    downstream_->sendBody(std::move(body));
+  }
+
+  void sendFileRegion(const FileRegion& region) noexcept override {
+    response_.reset();
+    downstream_->sendFileRegion(region);
+  }
+
+  void sendEOM() noexcept override {
+    if (response_) {
+      cache_->put(*request_, *response_, std::move(body_));
+      response_.reset();
+    }
+    downstream_->sendEOM();
+  }
+
+  void sendAbort() noexcept override {
+    response_.reset();
+    downstream_->sendAbort();
+  }
+
+ private:
+  void sendHit(const ResponseCache::Response& hit) {
+    HTTPMessage msg(hit.headers);
+    setAge(msg, hit.initialAge, hit.stored);
+    downstream_->sendHeaders(msg);
+    if (hit.body) {
+      downstream_->sendBody(hit.body->clone());
+    }
+    downstream_->sendEOM();
+  }
+
+  void sendDiskHit(DiskCache::Hit& hit) {
+    setAge(hit.headers, hit.initialAge, hit.stored);
+    downstream_->sendHeaders(hit.headers);
+    if (hit.body) {
+      downstream_->sendFileRegion(*hit.body);
+    }
+    downstream_->sendEOM();
+  }
+
+  static void setAge(HTTPMessage& msg, std::chrono::seconds initialAge,
+                     TimePoint stored) {
+    auto age = initialAge +
+      std::chrono::duration_cast<std::chrono::seconds>(
+        getCurrentTime() - stored);
+    msg.getHeaders().set(HTTP_HEADER_AGE, folly::to<std::string>(age.count()));
+  }
+
+  ResponseCache* const cache_;
+  DiskCache* const disk_;
+  // set while the response may be stored
+  std::unique_ptr<HTTPMessage> request_;
+  std::unique_ptr<HTTPMessage> response_;
+  std::unique_ptr<folly::IOBuf> body_;
+  size_t bodySize_{0};
+};
+
+/**
+ * Makes CacheFilters over one ResponseCache for all the handler threads
+ */
+class CacheFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit CacheFilterFactory(
+    size_t capacity = ResponseCache::kDefaultCapacity,
+    size_t maxEntrySize = ResponseCache::kDefaultMaxEntrySize)
+      : cache_(capacity, maxEntrySize) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+      noexcept override {
+    return new CacheFilter(h, &cache_, disk_.get());
+  }
+
+  ResponseCache* getCache() {
+    return &cache_;
+  }
+
+  /**
+   * Keep the responses the ResponseCache drops on disk, and serve the
+   * requests it misses from there. Set before the server starts.
+   */
+  void setDiskCache(std::unique_ptr<DiskCache> disk) {
+    disk_ = std::move(disk);
+    DiskCache* diskCache = disk_.get();
+    cache_.setEvictionCallback(
+      [diskCache] (const std::string& key,
+                   const std::vector<std::string>& varyNames,
+                   const std::vector<std::string>& varyValues,
+                   std::shared_ptr<const ResponseCache::Response> response) {
+        diskCache->admit(key, varyNames, varyValues, std::move(response));
+      });
+  }
+
+  DiskCache* getDiskCache() {
+    return disk_.get();
+  }
+
+ private:
+  // outlives cache_, which may still evict to it
+  std::unique_ptr<DiskCache> disk_;
+  ResponseCache cache_;
+};
+
+}
@@ -0,0 +1,319 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/CollapseFilter.h>
+
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+class CollapseFilter::Fetch {
+ public:
+  void unregister(Fetches* fetches) {
+    if (registered) {
+      fetches->erase(key);
+      registered = false;
+    }
+  }
+
+  std::string key;
+  // the request of the leader, whose handler produces the response
+  HTTPMessage request;
+  // null once the leader is done with the fetch
+  CollapseFilter* leader{nullptr};
+  // set once the headers are in, if they may be shared
+  unique_ptr<HTTPMessage> response;
+  std::vector<unique_ptr<IOBuf>> chunks;
+  size_t bytes{0};
+  bool complete{false};
+  // still taking new waiters
+  bool registered{true};
+  std::list<CollapseFilter*> waiters;
+};
+
+const size_t CollapseFilter::kDefaultMaxBacklog;
+
+CollapseFilter::CollapseFilter(RequestHandler* upstream, Fetches* fetches,
+                               size_t maxBacklog)
+    : Filter(upstream),
+      fetches_(CHECK_NOTNULL(fetches)),
+      maxBacklog_(maxBacklog) {
+}
+
+void CollapseFilter::onRequest(unique_ptr<HTTPMessage> msg) noexcept {
+  if (ResponseCache::isCacheableRequest(*msg)) {
+    auto key = ResponseCache::getKey(*msg);
+    auto it = fetches_->find(key);
+    if (it != fetches_->end()) {
+      fetch_ = it->second;
+      join(std::move(msg));
+      return;
+    }
+    fetch_ = std::make_shared<Fetch>();
+    fetch_->key = key;
+    fetch_->request = *msg;
+    fetch_->leader = this;
+    fetches_->emplace(key, fetch_);
+  }
+  upstream_->onRequest(std::move(msg));
+}
+
+void CollapseFilter::onBody(unique_ptr<IOBuf> body) noexcept {
+  // the body of a waiting GET is dropped
+  if (upstream_ && (!fetch_ || isLeader())) {
+    upstream_->onBody(std::move(body));
+  }
+}
+
+void CollapseFilter::onUpgrade(UpgradeProtocol protocol) noexcept {
+  if (upstream_ && (!fetch_ || isLeader())) {
+    upstream_->onUpgrade(protocol);
+  }
+}
+
+void CollapseFilter::onEOM() noexcept {
+  if (fetch_ && !isLeader()) {
+    requestEOM_ = true;
+  } else if (upstream_) {
+    upstream_->onEOM();
+  }
+}
+
+void CollapseFilter::requestComplete() noexcept {
+  if (fetch_) {
+    leave(isLeader() && !fetch_->complete);
+  }
+  if (upstream_) {
+    Filter::requestComplete();
+  } else {
+    delete this;
+  }
+}
+
+void CollapseFilter::onError(ProxygenError err) noexcept {
+  if (fetch_) {
+    leave(isLeader() && !fetch_->complete);
+  }
+  if (upstream_) {
+    Filter::onError(err);
+  } else {
+    delete this;
+  }
+}
+
+void CollapseFilter::onEgressPaused() noexcept {
+  egressPaused_ = true;
+  if (isLeader()) {
+    updateHandlerEgress();
+  } else if (fetch_) {
+    if (fetch_->leader) {
+      fetch_->leader->updateHandlerEgress();
+    }
+  } else if (upstream_) {
+    upstream_->onEgressPaused();
+  }
+}
+
+void CollapseFilter::onEgressResumed() noexcept {
+  egressPaused_ = false;
+  if (isLeader()) {
+    updateHandlerEgress();
+  } else if (fetch_) {
+    flush();
+  } else if (upstream_) {
+    upstream_->onEgressResumed();
+  }
+}
+
+void CollapseFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  if (isLeader()) {
+    if (ResponseCache::isShareable(msg)) {
+      fetch_->response.reset(new HTTPMessage(msg));
+      // each waiter sends a copy of it, which shares these headers until a
+      // filter on its way changes them
+      fetch_->response->shareHeaders();
+      auto waiters = fetch_->waiters;
+      for (auto waiter: waiters) {
+        if (ResponseCache::varyMatches(*waiter->request_, fetch_->request,
+                                       msg)) {
+          waiter->flush();
+        } else {
+          waiter->release();
+        }
+      }
+    } else {
+      leave(true);
+      updateHandlerEgress();
+    }
+  }
+  downstream_->sendHeaders(msg);
+}
+
+void CollapseFilter::sendBody(unique_ptr<IOBuf> body) noexcept {
+  if (isLeader() && body) {
+    fetch_->bytes += body->computeChainDataLength();
+    fetch_->chunks.push_back(body->clone());
+    auto waiters = fetch_->waiters;
+    for (auto waiter: waiters) {
+      waiter->flush();
+    }
+    updateHandlerEgress();
+  }
+  downstream_->sendBody(std::move(body));
+}
+
+void CollapseFilter::sendFileRegion(const FileRegion& region) noexcept {
+  if (isLeader()) {
+    // can't be shared
+    leave(true);
+    updateHandlerEgress();
+  }
+  downstream_->sendFileRegion(region);
+}
+
+void CollapseFilter::sendEOM() noexcept {
+  if (isLeader()) {
+    auto fetch = fetch_;
+    fetch->complete = true;
+    leave(false);
+    auto waiters = fetch->waiters;
+    for (auto waiter: waiters) {
+      waiter->flush();
+    }
+    updateHandlerEgress();
+  }
+  downstream_->sendEOM();
+}
+
+void CollapseFilter::sendAbort() noexcept {
+  if (isLeader()) {
+    leave(true);
+    updateHandlerEgress();
+  }
+  downstream_->sendAbort();
+}
+
+bool CollapseFilter::isLeader() const {
+  return fetch_ && fetch_->leader == this;
+}
+
+void CollapseFilter::join(unique_ptr<HTTPMessage> msg) {
+  request_ = std::move(msg);
+  fetch_->waiters.push_back(this);
+  if (fetch_->response) {
+    if (ResponseCache::varyMatches(*request_, fetch_->request,
+                                   *fetch_->response)) {
+      flush();
+    } else {
+      release();
+    }
+  }
+}
+
+void CollapseFilter::release() {
+  auto fetch = std::move(fetch_);
+  fetch->waiters.remove(this);
+  if (fetch->leader) {
+    fetch->leader->updateHandlerEgress();
+  }
+  upstream_->onRequest(std::move(request_));
+  if (egressPaused_) {
+    upstream_->onEgressPaused();
+  }
+  if (requestEOM_) {
+    upstream_->onEOM();
+  }
+}
+
+void CollapseFilter::flush() {
+  if (!fetch_ || !fetch_->response || egressPaused_) {
+    return;
+  }
+  auto fetch = fetch_;
+  if (!headersSent_) {
+    // served by the fetch from now on
+    headersSent_ = true;
+    upstream_->onError(kErrorCanceled);
+    upstream_ = nullptr;
+    HTTPMessage msg(*fetch->response);
+    downstream_->sendHeaders(msg);
+  }
+  while (!egressPaused_ && nextChunk_ < fetch->chunks.size()) {
+    auto& chunk = fetch->chunks[nextChunk_++];
+    bytesSent_ += chunk->computeChainDataLength();
+    downstream_->sendBody(chunk->clone());
+  }
+  if (nextChunk_ == fetch->chunks.size() && fetch->complete) {
+    fetch->waiters.remove(this);
+    fetch_.reset();
+    downstream_->sendEOM();
+  } else if (fetch->leader) {
+    fetch->leader->updateHandlerEgress();
+  }
+}
+
+void CollapseFilter::leave(bool failed) {
+  auto fetch = std::move(fetch_);
+  if (fetch->leader != this) {
+    // a waiter that goes away before it was served
+    fetch->waiters.remove(this);
+    if (upstream_) {
+      upstream_->onError(kErrorCanceled);
+      upstream_ = nullptr;
+    }
+    if (fetch->leader) {
+      fetch->leader->updateHandlerEgress();
+    }
+    return;
+  }
+
+  fetch->leader = nullptr;
+  fetch->unregister(fetches_);
+  if (!failed) {
+    // the waiters finish with the chunks they have
+    return;
+  }
+  auto waiters = fetch->waiters;
+  fetch->waiters.clear();
+  for (auto waiter: waiters) {
+    if (waiter->headersSent_) {
+      waiter->fetch_.reset();
+      waiter->downstream_->sendAbort();
+    } else {
+      waiter->release();
+    }
+  }
+}
+
+void CollapseFilter::updateHandlerEgress() {
+  if (!upstream_) {
+    return;
+  }
+  bool pause = egressPaused_;
+  if (isLeader()) {
+    for (auto waiter: fetch_->waiters) {
+      if (fetch_->bytes - waiter->bytesSent_ > maxBacklog_) {
+        pause = true;
+      }
+    }
+  }
+  if (pause != handlerEgressPaused_) {
+    handlerEgressPaused_ = pause;
+    if (pause) {
+      upstream_->onEgressPaused();
+    } else {
+      upstream_->onEgressResumed();
+    }
+  }
+}
+
+}
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <list>
+#include <memory>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <unordered_map>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A filter that collapses concurrent identical GETs: while the handler of
+ * one request for a URL works on the response, the other requests for it
+ * wait, and get the same response as it streams, from clones of its body
+ * chains. A request only goes on to its own handler if the response turns
+ * out to be private (see ResponseCache::isShareable()), to vary on
+ * headers it doesn't share, or to fail before its headers.
+ *
+ * Each waiter is sent the response at its own pace. While a waiter is
+ * more than maxBacklog bytes behind, the handler producing the response
+ * is told that its egress is paused, as when the client of the request
+ * it handles is slow.
+ *
+ * Requests are collapsed within a handler thread. Placed after a
+ * CacheFilter, it keeps the requests for an expired object from all
+ * reaching the origin at once.
+ */
+class CollapseFilter : public Filter {
+ public:
+  static const size_t kDefaultMaxBacklog = 256 * 1024;
+
+  class Fetch;
+  // the fetches in progress in a thread, by ResponseCache::getKey()
+  typedef std::unordered_map<std::string, std::shared_ptr<Fetch>> Fetches;
+
+  CollapseFilter(RequestHandler* upstream, Fetches* fetches,
+                 size_t maxBacklog = kDefaultMaxBacklog);
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+  void onEgressPaused() noexcept override;
+  void onEgressResumed() noexcept override;
+
+  // Response handler
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void sendFileRegion(const FileRegion& region) noexcept override;
+  void sendEOM() noexcept override;
+  void sendAbort() noexcept override;
+
+ private:
+  bool isLeader() const;
+  // wait on the fetch, or stop waiting and go to our own handler
+  void join(std::unique_ptr<HTTPMessage> msg);
+  void release();
+  // send a waiter what it hasn't had of the response
+  void flush();
+  // let go of the fetch, before the response is complete if failed
+  void leave(bool failed);
+  void updateHandlerEgress();
+
+  Fetches* const fetches_;
+  const size_t maxBacklog_;
+  std::shared_ptr<Fetch> fetch_;
+
+  // waiter state
+  std::unique_ptr<HTTPMessage> request_;
+  bool requestEOM_{false};
+  size_t nextChunk_{0};
+  size_t bytesSent_{0};
+  bool headersSent_{false};
+  bool egressPaused_{false};
+
+  // leader state
+  bool handlerEgressPaused_{false};
+};
+
+/**
+ * Makes CollapseFilters that collapse the requests of each handler thread
+ */
+class CollapseFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit CollapseFilterFactory(
+    size_t maxBacklog = CollapseFilter::kDefaultMaxBacklog)
+      : maxBacklog_(maxBacklog) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+      noexcept override {
+    return new CollapseFilter(h, fetches_.get(), maxBacklog_);
+  }
+
+ private:
+  const size_t maxBacklog_;
+  folly::ThreadLocal<CollapseFilter::Fetches> fetches_;
+};
+
+}
@@ -0,0 +1,263 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/CompressionFilter.h>
+
+#include <folly/Conv.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using folly::IOBuf;
+using folly::StringPiece;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+const char* const kCompressibleTypes[] = {
+  "application/javascript",
+  "application/json",
+  "application/x-javascript",
+  "application/xml",
+  "image/svg+xml",
+};
+
+bool isCompressibleType(StringPiece contentType) {
+  auto semicolon = contentType.find(';');
+  if (semicolon != StringPiece::npos) {
+    contentType.reset(contentType.start(), semicolon);
+  }
+  while (!contentType.empty() && isspace(contentType.back())) {
+    contentType.pop_back();
+  }
+  if (contentType.size() > 5 &&
+      caseInsensitiveEqual(contentType.subpiece(0, 5), "text/")) {
+    return true;
+  }
+  if (contentType.size() > 5 &&
+      (caseInsensitiveEqual(contentType.subpiece(contentType.size() - 5),
+                            "+json") ||
+       caseInsensitiveEqual(contentType.subpiece(contentType.size() - 4),
+                            "+xml"))) {
+    return true;
+  }
+  for (auto type: kCompressibleTypes) {
+    if (caseInsensitiveEqual(contentType, type)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+const size_t CompressionFilter::kDefaultMinSize;
+
+CompressionFilter::CompressionFilter(RequestHandler* upstream, int level,
+                                     size_t minSize):
+    Filter(upstream),
+    level_(level),
+    minSize_(minSize) {
+}
+
+CompressionFilter::~CompressionFilter() {
+  ZlibStreamCompressor::release(std::move(compressor_));
+}
+
+bool CompressionFilter::chooseType(const HTTPMessage& request,
+                                   ZlibStreamCompressor::Type* type) {
+  const auto& headers = request.getHeaders();
+  double gzip = RFC2616::getAcceptEncodingQvalue(headers, "gzip");
+  double deflate = RFC2616::getAcceptEncodingQvalue(headers, "deflate");
+  if (gzip <= 0 && deflate <= 0) {
+    return false;
+  }
+  // gzip wins a tie, some clients take deflate for raw deflate
+  *type = gzip >= deflate ? ZlibStreamCompressor::Type::GZIP :
+    ZlibStreamCompressor::Type::DEFLATE;
+  return true;
+}
+
+bool CompressionFilter::isCompressible(const HTTPMessage& response,
+                                       size_t minSize) {
+  uint16_t status = response.getStatusCode();
+  // a compressed part isn't a part of the compressed whole
+  if (RFC2616::responseBodyMustBeEmpty(status) || status == 206) {
+    return false;
+  }
+  const auto& headers = response.getHeaders();
+  if (headers.exists(HTTP_HEADER_CONTENT_ENCODING) ||
+      !isCompressibleType(headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE))) {
+    return false;
+  }
+  bool noTransform = false;
+  headers.forEachValueOfHeader(HTTP_HEADER_CACHE_CONTROL,
+                               [&] (const string& value) {
+      noTransform = value.find("no-transform") != string::npos;
+      return noTransform;
+    });
+  if (noTransform) {
+    return false;
+  }
+  const string& length = headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH);
+  if (!length.empty()) {
+    try {
+      return folly::to<size_t>(length) >= minSize;
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int CompressionFilter::getLevel(int level, std::chrono::milliseconds lag,
+                                std::chrono::milliseconds maxLag) {
+  if (maxLag.count() <= 0 || level <= 1) {
+    return level;
+  }
+  if (lag >= maxLag) {
+    return 1;
+  }
+  return level - (level - 1) * lag.count() / maxLag.count();
+}
+
+void CompressionFilter::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  // a HEAD response must have the headers of the GET one, keep both plain
+  accepted_ = headers->getMethod() != HTTPMethod::HEAD &&
+    chooseType(*headers, &type_);
+  upstream_->onRequest(std::move(headers));
+}
+
+void CompressionFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  if (isCompressible(msg, minSize_)) {
+    auto& headers = msg.getHeaders();
+    headers.add(HTTP_HEADER_VARY, "Accept-Encoding");
+    if (accepted_) {
+      compressor_ = ZlibStreamCompressor::acquire(type_, level_);
+      headers.remove(HTTP_HEADER_CONTENT_LENGTH);
+      headers.add(HTTP_HEADER_CONTENT_ENCODING,
+                  type_ == ZlibStreamCompressor::Type::GZIP ? "gzip" :
+                    "deflate");
+      // the bytes differ from those of the plain response
+      const string& etag = headers.getSingleOrEmpty(HTTP_HEADER_ETAG);
+      if (!etag.empty() && !StringPiece(etag).startsWith("W/")) {
+        headers.set(HTTP_HEADER_ETAG, "W/" + etag);
+      }
+    }
+  }
+  downstream_->sendHeaders(msg);
+}
+
+void CompressionFilter::sendChunkHeader(size_t len) noexcept {
+  // the compressed chunks have other lengths, the codec adds their headers
+  if (!compressor_) {
+    downstream_->sendChunkHeader(len);
+  }
+}
+
+void CompressionFilter::sendBody(std::unique_ptr<IOBuf> body) noexcept {
+  if (compressor_) {
+    compress(body.get(), Z_NO_FLUSH);
+  } else if (!failed_) {
+    downstream_->sendBody(std::move(body));
+  }
+}
+
+void CompressionFilter::sendFileRegion(const FileRegion& region) noexcept {
+  if (!compressor_) {
+    if (!failed_) {
+      downstream_->sendFileRegion(region);
+    }
+    return;
+  }
+  auto body = region.map();
+  if (!body) {
+    LOG(ERROR) << "failed to read the file region of a compressed response";
+    failed_ = true;
+    compressor_.reset();
+    downstream_->sendAbort();
+    return;
+  }
+  compress(body.get(), Z_NO_FLUSH);
+}
+
+void CompressionFilter::sendChunkTerminator() noexcept {
+  if (compressor_) {
+    compress(nullptr, Z_SYNC_FLUSH);
+  } else if (!failed_) {
+    downstream_->sendChunkTerminator();
+  }
+}
+
+void CompressionFilter::sendEOM() noexcept {
+  if (compressor_) {
+    compress(nullptr, Z_FINISH);
+    ZlibStreamCompressor::release(std::move(compressor_));
+  }
+  if (!failed_) {
+    downstream_->sendEOM();
+  }
+}
+
+void CompressionFilter::sendAbort() noexcept {
+  compressor_.reset();
+  if (!failed_) {
+    downstream_->sendAbort();
+  }
+}
+
+void CompressionFilter::compress(const IOBuf* in, int flush) {
+  auto out = compressor_->compress(in, flush);
+  if (!out) {
+    failed_ = true;
+    compressor_.reset();
+    downstream_->sendAbort();
+    return;
+  }
+  if (out->computeChainDataLength() > 0) {
+    downstream_->sendBody(std::move(out));
+  }
+}
+
+CompressionFilterFactory::CompressionFilterFactory(
+  int level,
+  std::chrono::milliseconds maxLoopLag,
+  size_t minSize):
+    level_(level),
+    maxLoopLag_(maxLoopLag),
+    minSize_(minSize) {
+}
+
+void CompressionFilterFactory::onServerStart() noexcept {
+  if (maxLoopLag_.count() > 0) {
+    auto monitor = new LoopLagMonitor(
+      folly::EventBaseManager::get()->getEventBase());
+    monitor->start();
+    loopLagMonitor_.reset(monitor);
+  }
+}
+
+void CompressionFilterFactory::onServerStop() noexcept {
+  loopLagMonitor_.reset();
+}
+
+RequestHandler* CompressionFilterFactory::onRequest(RequestHandler* h,
+                                                    HTTPMessage*) noexcept {
+  int level = level_;
+  if (loopLagMonitor_.get()) {
+    level = CompressionFilter::getLevel(level, loopLagMonitor_->getLag(),
+                                        maxLoopLag_);
+  }
+  return new CompressionFilter(h, level, minSize_);
+}
+
+}
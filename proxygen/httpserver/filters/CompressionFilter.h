@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/ThreadLocal.h>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/utils/LoopLagMonitor.h>
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+
+namespace proxygen {
+
+/**
+ * A filter that compresses response bodies with gzip or deflate, as the
+ * Accept-Encoding of the request prefers, while they stream. Only
+ * responses with a textual Content-Type of at least minSize bytes, if
+ * their length is known, are compressed. Responses that already have a
+ * Content-Encoding, such as precompressed files, go through as they are.
+ *
+ * The compressed response has no Content-Length, HTTP/1.1 sends it
+ * chunked. The chunks the handler makes are kept, each chunk terminator
+ * flushes what was compressed so far.
+ */
+class CompressionFilter : public Filter {
+ public:
+  static const size_t kDefaultMinSize = 256;
+
+  CompressionFilter(RequestHandler* upstream, int level,
+                    size_t minSize = kDefaultMinSize);
+  ~CompressionFilter();
+
+  /**
+   * Choose the format of the response to request
+   *
+   * @return false if it shouldn't be compressed
+   */
+  static bool chooseType(const HTTPMessage& request,
+                         ZlibStreamCompressor::Type* type);
+
+  /**
+   * @return whether response is worth compressing, whatever the client
+   *         accepts
+   */
+  static bool isCompressible(const HTTPMessage& response, size_t minSize);
+
+  /**
+   * @return level lowered towards 1 as the loop lag grows to maxLag, so
+   *         that a busy thread spends less on compression
+   */
+  static int getLevel(int level, std::chrono::milliseconds lag,
+                      std::chrono::milliseconds maxLag);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+  void sendChunkHeader(size_t len) noexcept override;
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void sendFileRegion(const FileRegion& region) noexcept override;
+  void sendChunkTerminator() noexcept override;
+  void sendEOM() noexcept override;
+  void sendAbort() noexcept override;
+
+ private:
+  void compress(const folly::IOBuf* in, int flush);
+
+  const int level_;
+  const size_t minSize_;
+  bool accepted_{false};
+  ZlibStreamCompressor::Type type_{ZlibStreamCompressor::Type::GZIP};
+  ZlibStreamCompressor::UniquePtr compressor_;
+  bool failed_{false};
+};
+
+/**
+ * Makes CompressionFilters. With a maxLoopLag, the level of each response
+ * drops as the loop lag of its thread grows (see LoopLagMonitor), to 1
+ * when the lag reaches maxLoopLag.
+ */
+class CompressionFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit CompressionFilterFactory(
+    int level = 6,
+    std::chrono::milliseconds maxLoopLag = std::chrono::milliseconds(0),
+    size_t minSize = CompressionFilter::kDefaultMinSize);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage*) noexcept override;
+
+ private:
+  const int level_;
+  const std::chrono::milliseconds maxLoopLag_;
+  const size_t minSize_;
+  folly::ThreadLocalPtr<LoopLagMonitor> loopLagMonitor_;
+};
+
+}
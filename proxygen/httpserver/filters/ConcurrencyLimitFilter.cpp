@@ -0,0 +1,306 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/ConcurrencyLimitFilter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/session/StreamLimit.h>
+
+using folly::IOBuf;
+using std::chrono::microseconds;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+const double kMinGradient = 0.5;
+
+// the change of the total limit of the routes worth a SETTINGS frame
+const double kStreamLimitChange = 0.1;
+
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter(const Options& options)
+    : options_(options),
+      limit_(std::min(std::max(options.initialLimit, options.minLimit),
+                      options.maxLimit)) {
+  CHECK(options.minLimit > 0 && options.minLimit <= options.maxLimit)
+    << "minLimit=" << options.minLimit << " maxLimit=" << options.maxLimit;
+  CHECK(options.windowSamples > 0 && options.probeWindows > 0);
+}
+
+bool ConcurrencyLimiter::tryAcquire() {
+  if (inFlight_ >= getLimit()) {
+    return false;
+  }
+  ++inFlight_;
+  windowMaxInFlight_ = std::max(windowMaxInFlight_, inFlight_);
+  return true;
+}
+
+void ConcurrencyLimiter::release(microseconds latency) {
+  release();
+  windowSum_ += latency.count();
+  if (++windowCount_ < options_.windowSamples) {
+    return;
+  }
+  update(windowSum_ / windowCount_);
+  windowSum_ = 0;
+  windowCount_ = 0;
+  windowMaxInFlight_ = inFlight_;
+}
+
+void ConcurrencyLimiter::release() {
+  DCHECK_GT(inFlight_, 0);
+  --inFlight_;
+}
+
+void ConcurrencyLimiter::update(double latency) {
+  latency = std::max(latency, 1.0);
+  if (++windows_ % options_.probeWindows == 0) {
+    // the next window, with fewer requests queued, measures it again
+    baseLatency_ = 0;
+    limit_ = std::max(limit_ / 2, double(options_.minLimit));
+    return;
+  }
+  if (baseLatency_ == 0 || latency < baseLatency_) {
+    baseLatency_ = latency;
+  }
+
+  double gradient = std::min(
+    std::max(options_.tolerance * baseLatency_ / latency, kMinGradient), 1.0);
+  double estimate = limit_ * gradient + std::sqrt(limit_);
+  if (windowMaxInFlight_ * 2 < limit_) {
+    // too few requests to tell whether more would queue
+    estimate = std::min(estimate, limit_);
+  }
+  limit_ = limit_ * (1 - options_.smoothing) + estimate * options_.smoothing;
+  limit_ = std::min(std::max(limit_, double(options_.minLimit)),
+                    double(options_.maxLimit));
+}
+
+ConcurrencyLimitFilter::Route::Route(
+  const ConcurrencyLimiter::Options& options,
+  uint32_t maxQueued)
+    : limiter_(options),
+      maxQueued_(maxQueued) {
+}
+
+void ConcurrencyLimitFilter::Route::dispatch() {
+  while (!queued_.empty() && limiter_.tryAcquire()) {
+    auto filter = queued_.front();
+    queued_.pop_front();
+    filter->start();
+  }
+}
+
+ConcurrencyLimitFilter::ConcurrencyLimitFilter(
+  RequestHandler* upstream,
+  std::shared_ptr<Route> route,
+  std::shared_ptr<const HTTPCannedResponse> response)
+    : Filter(upstream),
+      route_(std::move(route)),
+      response_(std::move(response)) {
+}
+
+void ConcurrencyLimitFilter::onRequest(unique_ptr<HTTPMessage> msg) noexcept {
+  if (route_->limiter_.tryAcquire()) {
+    acquired_ = true;
+    start_ = getCurrentTime();
+    upstream_->onRequest(std::move(msg));
+    return;
+  }
+  if (route_->queued_.size() >= route_->maxQueued_) {
+    VLOG(4) << "Rejecting " << msg->getPath() << ", "
+            << route_->limiter_.getInFlight() << " in flight and "
+            << route_->queued_.size() << " queued";
+    upstream_->onError(kErrorDropped);
+    upstream_ = nullptr;
+
+    ResponseBuilder(downstream_).sendCanned(response_);
+    return;
+  }
+  request_ = std::move(msg);
+  queued_ = true;
+  queuePos_ = route_->queued_.insert(route_->queued_.end(), this);
+  downstream_->pauseIngress();
+}
+
+void ConcurrencyLimitFilter::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (queued_) {
+    body_.append(std::move(body));
+  } else if (upstream_) {
+    upstream_->onBody(std::move(body));
+  }
+}
+
+void ConcurrencyLimitFilter::onUpgrade(UpgradeProtocol protocol) noexcept {
+  // not limited, see ConcurrencyLimitFilterFactory
+  if (upstream_ && !queued_) {
+    upstream_->onUpgrade(protocol);
+  }
+}
+
+void ConcurrencyLimitFilter::onEOM() noexcept {
+  if (queued_) {
+    eom_ = true;
+  } else if (upstream_) {
+    upstream_->onEOM();
+  }
+}
+
+void ConcurrencyLimitFilter::start() {
+  queued_ = false;
+  acquired_ = true;
+  start_ = getCurrentTime();
+  upstream_->onRequest(std::move(request_));
+  if (!body_.empty()) {
+    upstream_->onBody(body_.move());
+  }
+  if (eom_) {
+    upstream_->onEOM();
+  } else {
+    // this may deliver the rest of the body right away
+    downstream_->resumeIngress();
+  }
+}
+
+void ConcurrencyLimitFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  if (msg.getStatusCode() >= 500) {
+    // how fast a backend fails says nothing about its capacity
+    failed_ = true;
+  }
+  downstream_->sendHeaders(msg);
+}
+
+void ConcurrencyLimitFilter::dequeue() {
+  if (queued_) {
+    route_->queued_.erase(queuePos_);
+    queued_ = false;
+  }
+}
+
+void ConcurrencyLimitFilter::releaseSlot(bool succeeded) {
+  if (!acquired_) {
+    return;
+  }
+  acquired_ = false;
+  auto& limiter = route_->limiter_;
+  if (succeeded) {
+    limiter.release(std::chrono::duration_cast<microseconds>(
+                      getCurrentTime() - start_));
+  } else {
+    limiter.release();
+  }
+  route_->dispatch();
+}
+
+void ConcurrencyLimitFilter::requestComplete() noexcept {
+  downstream_ = nullptr;
+  dequeue();
+  releaseSlot(!failed_);
+  if (upstream_) {
+    upstream_->requestComplete();
+  }
+  delete this;
+}
+
+void ConcurrencyLimitFilter::onError(ProxygenError err) noexcept {
+  downstream_ = nullptr;
+  dequeue();
+  releaseSlot(false);
+  // If onError is invoked before we forward the error
+  if (upstream_) {
+    upstream_->onError(err);
+    upstream_ = nullptr;
+  }
+  delete this;
+}
+
+const uint32_t ConcurrencyLimitFilterFactory::kDefaultMaxQueued;
+
+ConcurrencyLimitFilterFactory::ConcurrencyLimitFilterFactory()
+    : response_(std::make_shared<const HTTPCannedResponse>(
+                  503, "Service Unavailable", HTTPHeaders(), nullptr)) {
+}
+
+ConcurrencyLimitFilterFactory& ConcurrencyLimitFilterFactory::addRoute(
+  const std::string& pathPrefix,
+  const ConcurrencyLimiter::Options& options,
+  uint32_t maxQueued) {
+  for (auto& route: routes_) {
+    if (route.pathPrefix == pathPrefix) {
+      route.options = options;
+      route.maxQueued = maxQueued;
+      return *this;
+    }
+  }
+  auto it = std::find_if(
+    routes_.begin(), routes_.end(),
+    [&pathPrefix] (const RouteConfig& route) {
+      return route.pathPrefix.size() < pathPrefix.size();
+    });
+  routes_.insert(it, RouteConfig{pathPrefix, options, maxQueued});
+  return *this;
+}
+
+void ConcurrencyLimitFilterFactory::onServerStart() noexcept {
+  auto state = new ThreadState();
+  for (const auto& route: routes_) {
+    state->routes.push_back(std::make_shared<ConcurrencyLimitFilter::Route>(
+                              route.options, route.maxQueued));
+  }
+  state_.reset(state);
+  updateStreamLimit();
+}
+
+void ConcurrencyLimitFilterFactory::onServerStop() noexcept {
+  // the requests still in flight keep their route
+  state_.reset();
+  StreamLimit::get().setLimit(0);
+}
+
+void ConcurrencyLimitFilterFactory::updateStreamLimit() {
+  uint64_t total = 0;
+  for (const auto& route: state_->routes) {
+    total += route->getLimiter().getLimit();
+  }
+  auto& streamLimit = StreamLimit::get();
+  uint32_t current = streamLimit.getLimit();
+  if (current == 0 ||
+      std::abs(double(total) - current) > current * kStreamLimitChange) {
+    streamLimit.setLimit(std::min<uint64_t>(
+      total, std::numeric_limits<uint32_t>::max()));
+  }
+}
+
+RequestHandler* ConcurrencyLimitFilterFactory::onRequest(
+  RequestHandler* h,
+  HTTPMessage* msg) noexcept {
+  if (routes_.empty() || msg->getMethod() == HTTPMethod::CONNECT ||
+      msg->getHeaders().exists(HTTP_HEADER_UPGRADE)) {
+    // No need to insert this filter
+    return h;
+  }
+  // the limits learnt since the last request
+  updateStreamLimit();
+  for (size_t i = 0; i < routes_.size(); ++i) {
+    if (msg->getPath().compare(0, routes_[i].pathPrefix.size(),
+                               routes_[i].pathPrefix) == 0) {
+      return new ConcurrencyLimitFilter(h, state_->routes[i], response_);
+    }
+  }
+  return h;
+}
+
+}
@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/ThreadLocal.h>
+#include <folly/io/IOBufQueue.h>
+#include <list>
+#include <memory>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
+#include <proxygen/lib/utils/Time.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Learns how many requests may be in flight at once from their latency,
+ * the way TCP Vegas sizes a congestion window, instead of relying on a
+ * fixed limit that is either too low for a healthy backend or too high
+ * for an overloaded one.
+ *
+ * The latencies of the successful requests are averaged over windows of
+ * windowSamples. The lowest of these averages is the base latency, that
+ * of the backend without queueing. After each window, the limit moves by
+ * `smoothing` towards limit * gradient + sqrt(limit), where the gradient
+ * is tolerance times the base latency over that of the window, capped to
+ * between 0.5 and 1: it grows by a fraction of its square root while the
+ * latency stays within tolerance of the base, and shrinks as the requests
+ * queue past that. It settles where the latency is about tolerance times
+ * the base. The limit doesn't grow while less than half of it is used,
+ * since the latency then says nothing about more concurrency.
+ *
+ * Every probeWindows windows, the limit is halved and the base latency
+ * measured again, so that a backend that got slower for good doesn't keep
+ * the limit at its floor.
+ *
+ * Not thread safe: each handler thread has its own, see
+ * ConcurrencyLimitFilterFactory.
+ */
+class ConcurrencyLimiter {
+ public:
+  struct Options {
+    uint32_t initialLimit{20};
+    uint32_t minLimit{1};
+    uint32_t maxLimit{1000};
+    // how much the latency may exceed the base latency without queueing
+    double tolerance{1.5};
+    // the weight of each new estimate of the limit
+    double smoothing{0.2};
+    // the number of latencies averaged into each window
+    uint32_t windowSamples{20};
+    // the number of windows between measures of the base latency
+    uint32_t probeWindows{200};
+  };
+
+  explicit ConcurrencyLimiter(const Options& options);
+
+  /**
+   * @return false if the limit is reached and the request must wait or be
+   *         rejected
+   */
+  bool tryAcquire();
+
+  /**
+   * Release the slot of a request that succeeded after latency
+   */
+  void release(std::chrono::microseconds latency);
+
+  /**
+   * Release the slot of a request that failed, whose latency is ignored
+   */
+  void release();
+
+  uint32_t getLimit() const {
+    return uint32_t(limit_);
+  }
+
+  uint32_t getInFlight() const {
+    return inFlight_;
+  }
+
+  /**
+   * @return the base latency, 0 before the first window
+   */
+  std::chrono::microseconds getBaseLatency() const {
+    return std::chrono::microseconds(uint64_t(baseLatency_));
+  }
+
+ private:
+  void update(double latency);
+
+  const Options options_;
+  double limit_;
+  uint32_t inFlight_{0};
+  // in microseconds, 0 until measured
+  double baseLatency_{0};
+  double windowSum_{0};
+  uint32_t windowCount_{0};
+  uint32_t windowMaxInFlight_{0};
+  uint32_t windows_{0};
+};
+
+/**
+ * Holds the requests over the ConcurrencyLimiter of their route until a
+ * slot is released, with their ingress paused, or rejects them with a
+ * canned 503 when more than maxQueued are already waiting. The slot is
+ * released when the request completes; its latency, from when it got
+ * the slot, is a sample for the limiter, unless the response was a 5xx or
+ * the request failed.
+ */
+class ConcurrencyLimitFilter : public Filter {
+ public:
+  /**
+   * The limiter of a route in a handler thread, and the requests waiting
+   * for it, oldest first.
+   */
+  class Route {
+   public:
+    Route(const ConcurrencyLimiter::Options& options, uint32_t maxQueued);
+
+    ConcurrencyLimiter& getLimiter() {
+      return limiter_;
+    }
+
+    size_t getNumQueued() const {
+      return queued_.size();
+    }
+
+   private:
+    friend class ConcurrencyLimitFilter;
+
+    // hand the free slots to the waiting requests
+    void dispatch();
+
+    ConcurrencyLimiter limiter_;
+    const uint32_t maxQueued_;
+    std::list<ConcurrencyLimitFilter*> queued_;
+  };
+
+  ConcurrencyLimitFilter(RequestHandler* upstream,
+                         std::shared_ptr<Route> route,
+                         std::shared_ptr<const HTTPCannedResponse> response);
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+
+ private:
+  // got a slot after waiting for it
+  void start();
+  // gave up waiting
+  void dequeue();
+  void releaseSlot(bool succeeded);
+
+  // keeps the route alive while the request holds a slot or waits
+  const std::shared_ptr<Route> route_;
+  const std::shared_ptr<const HTTPCannedResponse> response_;
+  bool acquired_{false};
+  bool failed_{false};
+  TimePoint start_;
+
+  // while queued, what came of the request
+  bool queued_{false};
+  std::list<ConcurrencyLimitFilter*>::iterator queuePos_;
+  std::unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  bool eom_{false};
+};
+
+/**
+ * Adds a ConcurrencyLimitFilter to the requests whose path starts with a
+ * prefix given to addRoute(), the longest that matches, each route with
+ * its own limiter in each handler thread. The requests of other paths
+ * aren't limited, nor are CONNECTs and upgrades, which are long lived.
+ *
+ * The sum of the limits of the routes of a thread is also its StreamLimit,
+ * which its downstream SPDY and HTTP/2 sessions advertise to their peers
+ * as the maximum number of concurrent streams, so that well behaved
+ * clients queue on their side rather than get rejected. It is only
+ * updated when it changes by more than a tenth, since each change costs
+ * a SETTINGS frame on each session.
+ */
+class ConcurrencyLimitFilterFactory : public RequestHandlerFactory {
+ public:
+  static const uint32_t kDefaultMaxQueued = 100;
+
+  ConcurrencyLimitFilterFactory();
+
+  /**
+   * Must be called before the server starts
+   */
+  ConcurrencyLimitFilterFactory& addRoute(
+    const std::string& pathPrefix,
+    const ConcurrencyLimiter::Options& options,
+    uint32_t maxQueued = kDefaultMaxQueued);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+    noexcept override;
+
+ private:
+  struct RouteConfig {
+    std::string pathPrefix;
+    ConcurrencyLimiter::Options options;
+    uint32_t maxQueued;
+  };
+
+  // the routes of a handler thread, in the order of routes_
+  struct ThreadState {
+    std::vector<std::shared_ptr<ConcurrencyLimitFilter::Route>> routes;
+  };
+
+  void updateStreamLimit();
+
+  // longest prefix first
+  std::vector<RouteConfig> routes_;
+  // shared by the handler threads
+  const std::shared_ptr<const HTTPCannedResponse> response_;
+  folly::ThreadLocalPtr<ThreadState> state_;
+};
+
+}
@@ -26,6 +26,13 @@ class DirectResponseHandler : public RequestHandler {
         body_(folly::IOBuf::copyBuffer(body)) {
   }
 
+  /**
+   * Add a header to the response
+   */
+  void addHeader(const std::string& name, const std::string& value) {
+    headers_.add(name, value);
+  }
+
   void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override {
   }
 
@@ -36,10 +43,12 @@ class DirectResponseHandler : public RequestHandler {
   }
 
   void onEOM() noexcept override {
-    ResponseBuilder(downstream_)
-        .status(code_, message_)
-        .body(std::move(body_))
-        .sendWithEOM();
+    ResponseBuilder builder(downstream_);
+    builder.status(code_, message_);
+    headers_.forEach([&] (const std::string& name, const std::string& value) {
+      builder.header(name, value);
+    });
+    builder.body(std::move(body_)).sendWithEOM();
   }
 
   void requestComplete() noexcept override {
@@ -54,6 +63,7 @@ class DirectResponseHandler : public RequestHandler {
   const int code_;
   const std::string message_;
   std::unique_ptr<folly::IOBuf> body_;
+  HTTPHeaders headers_;
 };
 
 }
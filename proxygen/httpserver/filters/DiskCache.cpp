@@ -0,0 +1,631 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/DiskCache.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <folly/Hash.h>
+#include <glog/logging.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using folly::IOBuf;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using std::string;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+const uint32_t kMagic = 0x43445850; // "PXDC"
+const char kSegmentPrefix[] = "segment.";
+
+/**
+ * Followed by metaLength bytes of metadata, see serialize(), and
+ * bodyLength bytes of body
+ */
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t metaLength;
+  uint64_t bodyLength;
+  // on the system clock
+  int64_t storedMs;
+  int64_t expiresMs;
+  int64_t initialAge;
+  uint64_t bodyChecksum;
+  // of the fields above and of the metadata
+  uint64_t checksum;
+};
+
+int64_t toMs(system_clock::time_point time) {
+  return duration_cast<milliseconds>(time.time_since_epoch()).count();
+}
+
+system_clock::time_point fromMs(int64_t ms) {
+  return system_clock::time_point(
+    duration_cast<system_clock::duration>(milliseconds(ms)));
+}
+
+uint64_t getChecksum(const RecordHeader& header, const char* meta) {
+  uint64_t hash = folly::hash::fnv64_buf(&header,
+                                         offsetof(RecordHeader, checksum));
+  return folly::hash::fnv64_buf(meta, header.metaLength, hash);
+}
+
+void putNumber(string& out, uint32_t n) {
+  out.append((const char*)&n, sizeof(n));
+}
+
+void putString(string& out, const string& s) {
+  putNumber(out, s.size());
+  out.append(s);
+}
+
+void putStrings(string& out, const vector<string>& strings) {
+  putNumber(out, strings.size());
+  for (auto& s: strings) {
+    putString(out, s);
+  }
+}
+
+/**
+ * The key, the Vary names and values, then the status line and the
+ * headers of the response
+ */
+string serialize(const string& key,
+                 const vector<string>& varyNames,
+                 const vector<string>& varyValues,
+                 const HTTPMessage& msg) {
+  string out;
+  putString(out, key);
+  putStrings(out, varyNames);
+  putStrings(out, varyValues);
+  putNumber(out, msg.getStatusCode());
+  putNumber(out, (msg.getHTTPVersion().first << 8) |
+            msg.getHTTPVersion().second);
+  putString(out, msg.getStatusMessage());
+  vector<string> headers;
+  msg.getHeaders().forEach([&] (const string& name, const string& value) {
+      headers.push_back(name);
+      headers.push_back(value);
+    });
+  putStrings(out, headers);
+  return out;
+}
+
+class Reader {
+ public:
+  Reader(const char* data, size_t length): data_(data), left_(length) {}
+
+  bool getNumber(uint32_t& n) {
+    if (left_ < sizeof(n)) {
+      return false;
+    }
+    memcpy(&n, data_, sizeof(n));
+    data_ += sizeof(n);
+    left_ -= sizeof(n);
+    return true;
+  }
+
+  bool getString(string& s) {
+    uint32_t length;
+    if (!getNumber(length) || left_ < length) {
+      return false;
+    }
+    s.assign(data_, length);
+    data_ += length;
+    left_ -= length;
+    return true;
+  }
+
+  bool getStrings(vector<string>& strings) {
+    uint32_t n;
+    if (!getNumber(n) || n > left_) {
+      return false;
+    }
+    strings.resize(n);
+    for (auto& s: strings) {
+      if (!getString(s)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  const char* data_;
+  size_t left_;
+};
+
+bool parseMessage(Reader& reader, HTTPMessage& msg) {
+  uint32_t status;
+  uint32_t version;
+  string message;
+  vector<string> headers;
+  if (!reader.getNumber(status) || !reader.getNumber(version) ||
+      !reader.getString(message) || !reader.getStrings(headers) ||
+      headers.size() % 2 != 0) {
+    return false;
+  }
+  msg.setStatusCode(status);
+  msg.setHTTPVersion(version >> 8, version & 0xff);
+  msg.setStatusMessage(message);
+  for (size_t i = 0; i < headers.size(); i += 2) {
+    msg.getHeaders().add(headers[i], headers[i + 1]);
+  }
+  return true;
+}
+
+bool writeAt(int fd, const char* data, size_t length, off_t offset) {
+  while (length > 0) {
+    ssize_t written = ::pwrite(fd, data, length, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    length -= written;
+    offset += written;
+  }
+  return true;
+}
+
+}
+
+const size_t DiskCache::kDefaultCapacity;
+const size_t DiskCache::kDefaultSegmentSize;
+const size_t DiskCache::kDefaultMaxPending;
+
+DiskCache::Segment::~Segment() {
+  if (map) {
+    ::munmap((void*)map, mapLength);
+  }
+}
+
+DiskCache::DiskCache(const string& dir,
+                     size_t capacity,
+                     size_t segmentSize,
+                     size_t maxPending)
+    : dir_(dir),
+      segmentSize_(segmentSize),
+      maxSegments_(std::max(capacity / segmentSize, size_t(2))),
+      maxPending_(maxPending) {
+  CHECK_GT(segmentSize, sizeof(RecordHeader));
+  if (::mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+    PLOG(ERROR) << "can't create cache directory " << dir;
+  } else {
+    recover();
+    open_ = true;
+  }
+  thread_ = std::thread([this] { run(); });
+}
+
+DiskCache::~DiskCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_one();
+  thread_.join();
+}
+
+std::unique_ptr<DiskCache::Hit> DiskCache::get(const HTTPMessage& request) {
+  if (!open_) {
+    return nullptr;
+  }
+  string key = ResponseCache::getKey(request);
+  std::shared_ptr<Segment> segment;
+  size_t offset = 0;
+  {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    auto& locations = it->second;
+    for (auto location = locations.begin(); location != locations.end();
+         ++location) {
+      if (ResponseCache::getVaryValues(request, location->varyNames) !=
+          location->varyValues) {
+        continue;
+      }
+      if (location->expires <= system_clock::now()) {
+        locations.erase(location);
+        if (locations.empty()) {
+          index_.erase(it);
+        }
+        return nullptr;
+      }
+      segment = location->segment;
+      offset = location->offset;
+      break;
+    }
+  }
+  if (!segment) {
+    return nullptr;
+  }
+
+  // the record was checked when it was written or recovered
+  RecordHeader header;
+  memcpy(&header, segment->map + offset, sizeof(header));
+  const char* meta = segment->map + offset + sizeof(header);
+  Reader reader(meta, header.metaLength);
+  string storedKey;
+  vector<string> varyNames;
+  vector<string> varyValues;
+  std::unique_ptr<Hit> hit(new Hit);
+  if (!reader.getString(storedKey) || !reader.getStrings(varyNames) ||
+      !reader.getStrings(varyValues) ||
+      !parseMessage(reader, hit->headers)) {
+    LOG(ERROR) << "bad record at " << offset << " of " << segment->path;
+    return nullptr;
+  }
+  hit->initialAge = seconds(header.initialAge);
+  hit->stored = getCurrentTime() - duration_cast<ClockType::duration>(
+    system_clock::now() - fromMs(header.storedMs));
+  if (header.bodyLength > 0) {
+    hit->body.reset(new FileRegion(
+                      segment->file,
+                      offset + sizeof(header) + header.metaLength,
+                      header.bodyLength));
+  }
+  return hit;
+}
+
+bool DiskCache::admit(const string& key,
+                      const vector<string>& varyNames,
+                      const vector<string>& varyValues,
+                      std::shared_ptr<const ResponseCache::Response> response) {
+  if (!open_ || response->expires <= getCurrentTime()) {
+    return false;
+  }
+  if (pending_.load(std::memory_order_relaxed) >= maxPending_) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  std::unique_ptr<Pending> pending(new Pending);
+  pending->key = key;
+  pending->varyNames = varyNames;
+  pending->varyValues = varyValues;
+  pending->response = std::move(response);
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  admitted_.fetch_add(1, std::memory_order_relaxed);
+  if (queue_.push(std::move(pending))) {
+    // see AsyncLogWriter::handOver()
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_one();
+  }
+  return true;
+}
+
+void DiskCache::flush() {
+  uint64_t admitted = admitted_.load(std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(mutex_);
+  flushed_.wait(lock, [&] { return written_ >= admitted; });
+}
+
+size_t DiskCache::getNumEntries() const {
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  size_t n = 0;
+  for (auto& entry: index_) {
+    n += entry.second.size();
+  }
+  return n;
+}
+
+size_t DiskCache::getNumSegments() const {
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  return segments_.size();
+}
+
+void DiskCache::recover() {
+  vector<uint32_t> ids;
+  DIR* dir = ::opendir(dir_.c_str());
+  if (!dir) {
+    PLOG(ERROR) << "can't read cache directory " << dir_;
+    return;
+  }
+  const size_t prefixLength = sizeof(kSegmentPrefix) - 1;
+  while (dirent* ent = ::readdir(dir)) {
+    const char* name = ent->d_name;
+    if (strncmp(name, kSegmentPrefix, prefixLength) != 0 ||
+        !isdigit(name[prefixLength])) {
+      continue;
+    }
+    char* end;
+    auto id = strtoul(name + prefixLength, &end, 10);
+    if (*end == '\0') {
+      ids.push_back(id);
+    }
+  }
+  ::closedir(dir);
+  std::sort(ids.begin(), ids.end());
+
+  for (auto id: ids) {
+    auto segment = openSegment(id, false);
+    if (!segment) {
+      continue;
+    }
+    // the segments before the last were synced before it was started
+    if (!scan(segment, id == ids.back()) || segment->size == 0) {
+      ::unlink(segment->path.c_str());
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    segments_.push_back(std::move(segment));
+  }
+  if (!ids.empty()) {
+    nextId_ = ids.back() + 1;
+  }
+  // leave room for the segment to append to
+  while (segments_.size() >= maxSegments_) {
+    dropOldestSegment();
+  }
+  VLOG(2) << "Recovered " << getNumEntries() << " responses from "
+          << segments_.size() << " segments in " << dir_;
+}
+
+bool DiskCache::scan(const std::shared_ptr<Segment>& segment,
+                     bool verifyBodies) {
+  const size_t fileSize = segment->size;
+  const auto now = system_clock::now();
+  size_t offset = 0;
+  while (fileSize - offset >= sizeof(RecordHeader)) {
+    RecordHeader header;
+    memcpy(&header, segment->map + offset, sizeof(header));
+    size_t left = fileSize - offset - sizeof(header);
+    if (header.magic != kMagic || header.metaLength > left ||
+        header.bodyLength > left - header.metaLength) {
+      break;
+    }
+    const char* meta = segment->map + offset + sizeof(header);
+    if (getChecksum(header, meta) != header.checksum ||
+        (verifyBodies &&
+         folly::hash::fnv64_buf(meta + header.metaLength,
+                                header.bodyLength) != header.bodyChecksum)) {
+      break;
+    }
+    Reader reader(meta, header.metaLength);
+    string key;
+    Location location;
+    if (!reader.getString(key) || !reader.getStrings(location.varyNames) ||
+        !reader.getStrings(location.varyValues)) {
+      break;
+    }
+    location.segment = segment;
+    location.offset = offset;
+    location.expires = fromMs(header.expiresMs);
+    if (location.expires > now) {
+      index(key, std::move(location));
+    }
+    offset += sizeof(header) + header.metaLength + header.bodyLength;
+  }
+  segment->size = offset;
+  if (offset < fileSize) {
+    LOG(WARNING) << "Truncating " << segment->path << " at " << offset
+                 << " of " << fileSize << " bytes, after a bad record";
+    if (::ftruncate(segment->file->fd(), offset) < 0) {
+      PLOG(ERROR) << "can't truncate " << segment->path;
+      return false;
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<DiskCache::Segment> DiskCache::openSegment(uint32_t id,
+                                                           bool create) {
+  auto segment = std::make_shared<Segment>();
+  segment->id = id;
+  char name[32];
+  snprintf(name, sizeof(name), "/%s%06u", kSegmentPrefix, id);
+  segment->path = dir_ + name;
+  int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0);
+  int fd = ::open(segment->path.c_str(), flags, 0644);
+  if (fd < 0) {
+    PLOG(ERROR) << "can't open cache segment " << segment->path;
+    return nullptr;
+  }
+  segment->file = std::make_shared<folly::File>(fd, true);
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    PLOG(ERROR) << "can't stat cache segment " << segment->path;
+    return nullptr;
+  }
+  segment->size = st.st_size;
+  // mapped to its full size up front, only the pages written are touched
+  segment->mapLength = std::max(size_t(st.st_size), segmentSize_);
+  void* map = ::mmap(nullptr, segment->mapLength, PROT_READ, MAP_SHARED,
+                     fd, 0);
+  if (map == MAP_FAILED) {
+    PLOG(ERROR) << "can't map cache segment " << segment->path;
+    return nullptr;
+  }
+  segment->map = (const char*)map;
+  return segment;
+}
+
+void DiskCache::index(const string& key, Location location) {
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  auto& locations = index_[key];
+  if (!locations.empty() &&
+      locations.front().varyNames != location.varyNames) {
+    // the variants made for other headers no longer apply
+    locations.clear();
+  }
+  locations.erase(
+    std::remove_if(locations.begin(), locations.end(),
+                   [&] (const Location& other) {
+                     return other.varyValues == location.varyValues;
+                   }),
+    locations.end());
+  if (locations.size() >= ResponseCache::kMaxVariants) {
+    locations.erase(locations.begin());
+  }
+  location.segment->keys.push_back(key);
+  locations.push_back(std::move(location));
+}
+
+void DiskCache::dropOldestSegment() {
+  std::shared_ptr<Segment> oldest;
+  {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    oldest = std::move(segments_.front());
+    segments_.pop_front();
+    for (auto& key: oldest->keys) {
+      auto it = index_.find(key);
+      if (it == index_.end()) {
+        continue;
+      }
+      auto& locations = it->second;
+      locations.erase(
+        std::remove_if(locations.begin(), locations.end(),
+                       [&] (const Location& location) {
+                         return location.segment == oldest;
+                       }),
+        locations.end());
+      if (locations.empty()) {
+        index_.erase(it);
+      }
+    }
+  }
+  // the hits being sent keep the file open
+  VLOG(3) << "Dropping cache segment " << oldest->path;
+  if (::unlink(oldest->path.c_str()) < 0) {
+    PLOG(ERROR) << "can't remove cache segment " << oldest->path;
+  }
+}
+
+void DiskCache::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    bool stopping = stopping_;
+    lock.unlock();
+    auto batch = queue_.popAll();
+    for (auto& pending: batch) {
+      write(*pending);
+    }
+    pending_.fetch_sub(batch.size(), std::memory_order_relaxed);
+    lock.lock();
+    written_ += batch.size();
+    flushed_.notify_all();
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+void DiskCache::write(const Pending& pending) {
+  const auto& response = *pending.response;
+  const auto now = getCurrentTime();
+  if (response.expires <= now) {
+    return;
+  }
+  string meta = serialize(pending.key, pending.varyNames,
+                          pending.varyValues, response.headers);
+  const IOBuf* body = response.body.get();
+  size_t bodyLength = body ? body->computeChainDataLength() : 0;
+  size_t length = sizeof(RecordHeader) + meta.size() + bodyLength;
+  if (length > segmentSize_) {
+    VLOG(3) << "Not caching " << pending.key << " on disk, " << length
+            << " bytes is more than a segment";
+    return;
+  }
+  if ((!active_ || active_->size + length > segmentSize_) &&
+      !startSegment()) {
+    return;
+  }
+
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.metaLength = meta.size();
+  header.bodyLength = bodyLength;
+  const auto systemNow = system_clock::now();
+  header.storedMs = toMs(systemNow - duration_cast<system_clock::duration>(
+                           now - response.stored));
+  header.expiresMs = toMs(systemNow + duration_cast<system_clock::duration>(
+                            response.expires - now));
+  header.initialAge = response.initialAge.count();
+  uint64_t bodyChecksum = folly::hash::FNV_64_HASH_START;
+  if (body) {
+    const IOBuf* buf = body;
+    do {
+      bodyChecksum = folly::hash::fnv64_buf(buf->data(), buf->length(),
+                                            bodyChecksum);
+      buf = buf->next();
+    } while (buf != body);
+  }
+  header.bodyChecksum = bodyChecksum;
+  header.checksum = getChecksum(header, meta.data());
+
+  // a record is only indexed once it is all written, a failed write is
+  // overwritten by the next one
+  const int fd = active_->file->fd();
+  off_t offset = active_->size;
+  bool ok = writeAt(fd, (const char*)&header, sizeof(header), offset);
+  offset += sizeof(header);
+  ok = ok && writeAt(fd, meta.data(), meta.size(), offset);
+  offset += meta.size();
+  if (ok && body) {
+    const IOBuf* buf = body;
+    do {
+      ok = ok && writeAt(fd, (const char*)buf->data(), buf->length(),
+                         offset);
+      offset += buf->length();
+      buf = buf->next();
+    } while (buf != body);
+  }
+  if (!ok) {
+    PLOG(ERROR) << "can't write cache segment " << active_->path;
+    return;
+  }
+
+  Location location;
+  location.varyNames = pending.varyNames;
+  location.varyValues = pending.varyValues;
+  location.segment = active_;
+  location.offset = active_->size;
+  location.expires = fromMs(header.expiresMs);
+  active_->size += length;
+  index(pending.key, std::move(location));
+}
+
+bool DiskCache::startSegment() {
+  if (active_ && ::fdatasync(active_->file->fd()) < 0) {
+    PLOG(ERROR) << "can't sync cache segment " << active_->path;
+  }
+  active_.reset();
+  while (segments_.size() >= maxSegments_) {
+    dropOldestSegment();
+  }
+  auto segment = openSegment(nextId_++, true);
+  if (!segment) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  segments_.push_back(segment);
+  active_ = std::move(segment);
+  return true;
+}
+
+}
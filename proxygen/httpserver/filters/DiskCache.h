@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <folly/File.h>
+#include <memory>
+#include <mutex>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/FileRegion.h>
+#include <proxygen/lib/utils/MPSCQueue.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A second tier under a ResponseCache, that keeps on disk the responses
+ * the memory tier drops to make room. See CacheFilterFactory.
+ *
+ * The responses are appended as records to segment files in dir, the
+ * oldest of which is removed as a whole when the capacity is reached, so
+ * the disk only ever sees sequential writes. The index of the records is
+ * in memory; the segments are mapped to read the headers of a hit, and
+ * its body is sent straight from the file, as a FileRegion.
+ *
+ * admit() only queues the response: a writer thread of the cache appends
+ * it, so the threads that evict never wait for the disk. When the writer
+ * falls behind, past maxPending queued responses, the others are dropped.
+ *
+ * The index is rebuilt from the records when the cache is opened. Each
+ * record has a checksum of its header and metadata; a segment is synced
+ * before the next one is started, so only the bodies of the last segment,
+ * which may have been torn by a crash, are checksummed too. A segment is
+ * truncated at its first bad record, and new records always go to a new
+ * segment.
+ */
+class DiskCache {
+ public:
+  static const size_t kDefaultCapacity = 1024 * 1024 * 1024;
+  static const size_t kDefaultSegmentSize = 64 * 1024 * 1024;
+  static const size_t kDefaultMaxPending = 1024;
+
+  struct Hit {
+    HTTPMessage headers;
+    // the Age the response had when it was stored
+    std::chrono::seconds initialAge;
+    TimePoint stored;
+    // nullptr if the body is empty
+    std::unique_ptr<FileRegion> body;
+  };
+
+  explicit DiskCache(const std::string& dir,
+                     size_t capacity = kDefaultCapacity,
+                     size_t segmentSize = kDefaultSegmentSize,
+                     size_t maxPending = kDefaultMaxPending);
+
+  /**
+   * Writes what was queued
+   */
+  ~DiskCache();
+
+  /**
+   * @return a fresh response to request, or nullptr
+   */
+  std::unique_ptr<Hit> get(const HTTPMessage& request);
+
+  /**
+   * Queue response, stored under key for the values of the headers named
+   * by varyNames, to be written
+   *
+   * @return false if it was dropped
+   */
+  bool admit(const std::string& key,
+             const std::vector<std::string>& varyNames,
+             const std::vector<std::string>& varyValues,
+             std::shared_ptr<const ResponseCache::Response> response);
+
+  /**
+   * Wait until the responses admitted so far are written
+   */
+  void flush();
+
+  /**
+   * @return false if dir can't be used, nothing is cached then
+   */
+  bool isOpen() const {
+    return open_;
+  }
+
+  size_t getNumEntries() const;
+  size_t getNumSegments() const;
+
+  /**
+   * @return the number of responses dropped so far, not written
+   */
+  uint64_t getDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Segment {
+    ~Segment();
+
+    uint32_t id{0};
+    std::string path;
+    std::shared_ptr<folly::File> file;
+    const char* map{nullptr};
+    size_t mapLength{0};
+    // the bytes of the records in it
+    size_t size{0};
+    // of the records, to drop them from the index with the segment
+    std::vector<std::string> keys;
+  };
+
+  struct Location {
+    std::vector<std::string> varyNames;
+    std::vector<std::string> varyValues;
+    std::shared_ptr<Segment> segment;
+    size_t offset{0};
+    // on the system clock, which survives a restart
+    std::chrono::system_clock::time_point expires;
+  };
+
+  struct Pending {
+    std::string key;
+    std::vector<std::string> varyNames;
+    std::vector<std::string> varyValues;
+    std::shared_ptr<const ResponseCache::Response> response;
+  };
+
+  void recover();
+  bool scan(const std::shared_ptr<Segment>& segment, bool verifyBodies);
+  std::shared_ptr<Segment> openSegment(uint32_t id, bool create);
+  void index(const std::string& key, Location location);
+  void dropOldestSegment();
+  void run();
+  void write(const Pending& pending);
+  bool startSegment();
+
+  const std::string dir_;
+  const size_t segmentSize_;
+  const size_t maxSegments_;
+  const size_t maxPending_;
+  bool open_{false};
+
+  // guards segments_ and index_, the writer only adds to them
+  mutable std::mutex indexMutex_;
+  std::deque<std::shared_ptr<Segment>> segments_;
+  std::unordered_map<std::string, std::vector<Location>> index_;
+  // the segment appended to, only used by the writer
+  std::shared_ptr<Segment> active_;
+  uint32_t nextId_{0};
+
+  MPSCQueue<std::unique_ptr<Pending>> queue_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> admitted_{0};
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable flushed_;
+  uint64_t written_{0};
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+}
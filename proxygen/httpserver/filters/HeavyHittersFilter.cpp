@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/HeavyHittersFilter.h>
+
+namespace proxygen {
+
+struct HeavyHittersRegistry::ThreadSketches {
+  ThreadSketches(size_t width, size_t depth, size_t k)
+      : sketches{HeavyHitters(width, depth, k),
+                 HeavyHitters(width, depth, k),
+                 HeavyHitters(width, depth, k)},
+        lastDecay(getCurrentTime()) {
+  }
+
+  std::mutex mutex;
+  HeavyHitters sketches[kNumDimensions];
+  // only read and written under the lock, by the merges
+  TimePoint lastDecay;
+};
+
+HeavyHittersRegistry::HeavyHittersRegistry(
+    size_t k,
+    std::chrono::milliseconds mergeInterval,
+    std::chrono::milliseconds halfLife,
+    size_t width,
+    size_t depth)
+    : k_(k),
+      mergeInterval_(mergeInterval),
+      halfLife_(halfLife),
+      width_(width),
+      depth_(depth),
+      snapshot_(std::make_shared<Snapshot>()) {
+}
+
+HeavyHittersRegistry::~HeavyHittersRegistry() {
+}
+
+HeavyHittersRegistry::ThreadSketches& HeavyHittersRegistry::getLocal() {
+  auto& local = *local_;
+  if (!local) {
+    local = std::make_shared<ThreadSketches>(width_, depth_, k_);
+    std::lock_guard<std::mutex> guard(mutex_);
+    threads_.push_back(local);
+  }
+  return *local;
+}
+
+void HeavyHittersRegistry::record(const HTTPMessage& msg) {
+  auto& local = getLocal();
+  auto host = msg.getHeaders().getSingleOrEmptyView(HTTP_HEADER_HOST);
+  const auto& clientIP = msg.getClientIP();
+  std::lock_guard<std::mutex> guard(local.mutex);
+  local.sketches[static_cast<size_t>(Dimension::PATH)].add(msg.getPath());
+  // a missing header or address isn't worth a place in the top
+  if (!host.empty()) {
+    local.sketches[static_cast<size_t>(Dimension::HOST)].add(host);
+  }
+  if (!clientIP.empty()) {
+    local.sketches[static_cast<size_t>(Dimension::CLIENT_IP)].add(clientIP);
+  }
+}
+
+std::shared_ptr<const HeavyHittersRegistry::Snapshot>
+HeavyHittersRegistry::getSnapshot() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto now = getCurrentTime();
+  if (snapshot_->time != TimePoint() &&
+      now - snapshot_->time < mergeInterval_) {
+    return snapshot_;
+  }
+  std::vector<HeavyHitters> merged(kNumDimensions,
+                                   HeavyHitters(width_, depth_, k_));
+  for (const auto& thread: threads_) {
+    std::lock_guard<std::mutex> threadGuard(thread->mutex);
+    // a merge may come after several half lives
+    uint64_t halvings = 0;
+    if (halfLife_.count() > 0) {
+      halvings = (now - thread->lastDecay) / halfLife_;
+      thread->lastDecay += halvings * halfLife_;
+    }
+    for (auto& sketch: thread->sketches) {
+      if (halvings >= 64) {
+        sketch.clear();
+        continue;
+      }
+      for (uint64_t i = 0; i < halvings; i++) {
+        sketch.decay();
+      }
+    }
+    for (size_t i = 0; i < kNumDimensions; i++) {
+      merged[i].merge(thread->sketches[i]);
+    }
+  }
+  auto snapshot = std::make_shared<Snapshot>();
+  for (size_t i = 0; i < kNumDimensions; i++) {
+    snapshot->totals[i] = merged[i].getTotal();
+    snapshot->top[i] = merged[i].getTop();
+  }
+  snapshot->time = now;
+  snapshot_ = snapshot;
+  return snapshot_;
+}
+
+HeavyHittersFilter::HeavyHittersFilter(RequestHandler* upstream,
+                                       HeavyHittersRegistry* registry)
+    : Filter(upstream),
+      registry_(CHECK_NOTNULL(registry)) {
+}
+
+void HeavyHittersFilter::onRequest(
+    std::unique_ptr<HTTPMessage> headers) noexcept {
+  registry_->record(*headers);
+  Filter::onRequest(std::move(headers));
+}
+
+}
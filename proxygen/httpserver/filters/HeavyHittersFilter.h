@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <folly/ThreadLocal.h>
+#include <memory>
+#include <mutex>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/utils/HeavyHitters.h>
+#include <proxygen/lib/utils/Time.h>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * The paths, Host headers and client IPs with the most requests, see
+ * HeavyHittersFilter.
+ *
+ * Each thread counts in its own HeavyHitters sketches, under a lock only
+ * contended while a merge copies them. getSnapshot() merges the threads,
+ * at most once per mergeInterval, and the snapshot is shared by the
+ * callers until the next merge, so that caching or rate limiting code can
+ * consult it on every request. The counts of a thread are halved every
+ * halfLife, so the snapshot follows the current traffic.
+ */
+class HeavyHittersRegistry {
+ public:
+  enum class Dimension: uint8_t {
+    PATH = 0,
+    HOST = 1,
+    CLIENT_IP = 2,
+  };
+  static const size_t kNumDimensions = 3;
+
+  struct Snapshot {
+    // the requests counted, after decay
+    uint64_t totals[kNumDimensions];
+    std::vector<HeavyHitters::Entry> top[kNumDimensions];
+    TimePoint time;
+
+    Snapshot() {
+      std::fill(totals, totals + kNumDimensions, 0);
+    }
+
+    const std::vector<HeavyHitters::Entry>& getTop(Dimension dim) const {
+      return top[static_cast<size_t>(dim)];
+    }
+
+    uint64_t getTotal(Dimension dim) const {
+      return totals[static_cast<size_t>(dim)];
+    }
+  };
+
+  /**
+   * @param k       the keys kept for each dimension
+   * @param width   counters per row of the sketches, see HeavyHitters
+   * @param depth   rows of the sketches
+   */
+  explicit HeavyHittersRegistry(
+    size_t k = 32,
+    std::chrono::milliseconds mergeInterval = std::chrono::seconds(1),
+    std::chrono::milliseconds halfLife = std::chrono::seconds(60),
+    size_t width = 2048,
+    size_t depth = 4);
+  ~HeavyHittersRegistry();
+
+  /**
+   * Count the path, Host and client IP of msg. Called on the thread that
+   * handles the request.
+   */
+  void record(const HTTPMessage& msg);
+
+  std::shared_ptr<const Snapshot> getSnapshot();
+
+ private:
+  struct ThreadSketches;
+
+  ThreadSketches& getLocal();
+
+  const size_t k_;
+  const std::chrono::milliseconds mergeInterval_;
+  const std::chrono::milliseconds halfLife_;
+  const size_t width_;
+  const size_t depth_;
+
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadSketches>> threads_;
+  folly::ThreadLocal<std::shared_ptr<ThreadSketches>> local_;
+  std::shared_ptr<const Snapshot> snapshot_;
+};
+
+/**
+ * A filter that counts the path, Host and client IP of each request in a
+ * HeavyHittersRegistry. The keys are read from the strings the message
+ * already holds and hashed in place; only the keys that make the top are
+ * copied.
+ */
+class HeavyHittersFilter : public Filter {
+ public:
+  HeavyHittersFilter(RequestHandler* upstream,
+                     HeavyHittersRegistry* registry);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+ private:
+  HeavyHittersRegistry* const registry_;
+};
+
+/**
+ * Makes HeavyHittersFilters that count in registry, which must outlive the
+ * server
+ */
+class HeavyHittersFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit HeavyHittersFilterFactory(HeavyHittersRegistry* registry)
+      : registry_(registry) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage*) noexcept override {
+    return new HeavyHittersFilter(h, registry_);
+  }
+
+ private:
+  HeavyHittersRegistry* const registry_;
+};
+
+}
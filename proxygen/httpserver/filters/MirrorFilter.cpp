@@ -0,0 +1,303 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/MirrorFilter.h>
+
+#include <folly/Memory.h>
+#include <folly/Random.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+using apache::thrift::transport::TTransportException;
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+/**
+ * The mirror of one request. It lives until its transaction detaches or
+ * its connection attempt fails, past the request it mirrors if the
+ * response is slower, and deletes itself.
+ */
+class MirrorFilter::Mirror : public HTTPTransactionHandler,
+                             private HTTPSessionPool::Callback {
+ public:
+  Mirror(Mirrors* mirrors, MirrorFilter* filter,
+         unique_ptr<HTTPMessage> request)
+      : mirrors_(mirrors),
+        filter_(filter),
+        request_(std::move(request)) {
+    mirrors_->mirrors_.insert(this);
+  }
+
+  void start() {
+    connecting_ = true;
+    // This may call back right away, with a pooled session
+    mirrors_->pool_.getSession(mirrors_->upstream_, this,
+                               mirrors_->connectTimeout_);
+  }
+
+  void sendBody(unique_ptr<IOBuf> body) {
+    pendingBody_.append(std::move(body));
+    if (pendingBody_.chainLength() > mirrors_->maxBufferSize_) {
+      abort("the mirror doesn't keep up");
+      return;
+    }
+    flush();
+  }
+
+  void sendEOM() {
+    requestEOM_ = true;
+    flush();
+  }
+
+  // The filter is done with the mirror
+  void release() {
+    filter_ = nullptr;
+    if (!requestEOM_) {
+      abort("incomplete request");
+    }
+  }
+
+  // The mirrors of the thread are going away
+  void abandon() {
+    abort("shutting down");
+    mirrors_ = nullptr;
+  }
+
+  // HTTPTransactionHandler
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+
+  void detachTransaction() noexcept override {
+    txn_ = nullptr;
+    delete this;
+  }
+
+  // The response is discarded
+  void onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept override {
+  }
+
+  void onBody(unique_ptr<IOBuf> chain) noexcept override {
+  }
+
+  void onTrailers(unique_ptr<HTTPHeaders> trailers) noexcept override {
+  }
+
+  void onEOM() noexcept override {
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {
+  }
+
+  void onError(const HTTPException& error) noexcept override {
+    // the transaction detaches next
+    VLOG(4) << "Mirror error " << error.what();
+  }
+
+  void onEgressPaused() noexcept override {
+    egressPaused_ = true;
+  }
+
+  void onEgressResumed() noexcept override {
+    egressPaused_ = false;
+    flush();
+  }
+
+ private:
+  ~Mirror() {
+    CHECK(!txn_);
+    CHECK(!connecting_);
+    if (mirrors_) {
+      mirrors_->mirrors_.erase(this);
+    }
+    if (filter_) {
+      filter_->mirror_ = nullptr;
+    }
+  }
+
+  // HTTPSessionPool::Callback
+  void sessionAvailable(HTTPUpstreamSession* session) override {
+    connecting_ = false;
+    if (!session->newTransaction(this)) {
+      VLOG(4) << "No mirror transaction";
+      delete this;
+      return;
+    }
+    CHECK(txn_);
+    txn_->sendHeaders(*request_);
+    request_.reset();
+    flush();
+  }
+
+  void sessionError(const TTransportException& ex) override {
+    VLOG(4) << "Mirror connection error " << ex.what();
+    connecting_ = false;
+    delete this;
+  }
+
+  void flush() {
+    if (!txn_ || egressPaused_) {
+      return;
+    }
+    if (!pendingBody_.empty()) {
+      txn_->sendBody(pendingBody_.move());
+    }
+    if (requestEOM_ && !txn_->isEgressEOMQueued()) {
+      txn_->sendEOM();
+    }
+  }
+
+  // Deletes the mirror, right away or once its transaction detaches
+  void abort(const char* reason) {
+    VLOG(4) << "Aborting the mirror, " << reason;
+    if (connecting_) {
+      mirrors_->pool_.cancel(this);
+      connecting_ = false;
+    }
+    if (txn_) {
+      pendingBody_.move();
+      txn_->sendAbort();
+    } else {
+      delete this;
+    }
+  }
+
+  Mirrors* mirrors_;
+  MirrorFilter* filter_;
+  // till the transaction is there to send it
+  unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue pendingBody_{folly::IOBufQueue::cacheChainLength()};
+  HTTPTransaction* txn_{nullptr};
+  bool connecting_{false};
+  bool requestEOM_{false};
+  bool egressPaused_{false};
+};
+
+const size_t MirrorFilter::kDefaultMaxBufferSize;
+
+MirrorFilter::Mirrors::Mirrors(folly::EventBase* eventBase,
+                               const HTTPSessionPool::Key& upstream,
+                               std::chrono::milliseconds connectTimeout,
+                               std::chrono::milliseconds transactionTimeout,
+                               uint32_t maxInFlight,
+                               size_t maxBufferSize,
+                               uint32_t maxIdleSessions)
+    : upstream_(upstream),
+      connectTimeout_(connectTimeout),
+      maxInFlight_(maxInFlight),
+      maxBufferSize_(maxBufferSize),
+      timeouts_(new AsyncTimeoutSet(eventBase, transactionTimeout)),
+      pool_(eventBase, timeouts_.get(), maxIdleSessions) {
+}
+
+MirrorFilter::Mirrors::~Mirrors() {
+  // An aborted mirror may only go once its transaction detaches, so they
+  // are let go of first
+  auto mirrors = std::move(mirrors_);
+  mirrors_.clear();
+  for (auto mirror: mirrors) {
+    mirror->abandon();
+  }
+}
+
+MirrorFilter::MirrorFilter(RequestHandler* upstream, Mirrors* mirrors,
+                           double sampleRate)
+    : Filter(upstream),
+      mirrors_(CHECK_NOTNULL(mirrors)),
+      sampleThreshold_(sampleRate * (uint64_t(1) << 32)) {
+}
+
+void MirrorFilter::onRequest(unique_ptr<HTTPMessage> msg) noexcept {
+  if (msg->getMethod() != HTTPMethod::CONNECT &&
+      !msg->getHeaders().exists(HTTP_HEADER_UPGRADE) &&
+      mirrors_->mirrors_.size() < mirrors_->maxInFlight_ &&
+      folly::Random::rand32() < sampleThreshold_) {
+    // The copy shares the headers instead of copying them
+    msg->shareHeaders();
+    mirror_ = new Mirror(mirrors_, this,
+                         folly::make_unique<HTTPMessage>(*msg));
+    // the mirror may be gone already
+    mirror_->start();
+  }
+  upstream_->onRequest(std::move(msg));
+}
+
+void MirrorFilter::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (mirror_) {
+    mirror_->sendBody(body->clone());
+  }
+  upstream_->onBody(std::move(body));
+}
+
+void MirrorFilter::onUpgrade(UpgradeProtocol protocol) noexcept {
+  releaseMirror();
+  upstream_->onUpgrade(protocol);
+}
+
+void MirrorFilter::onEOM() noexcept {
+  if (mirror_) {
+    mirror_->sendEOM();
+  }
+  upstream_->onEOM();
+}
+
+void MirrorFilter::requestComplete() noexcept {
+  releaseMirror();
+  Filter::requestComplete();
+}
+
+void MirrorFilter::onError(ProxygenError err) noexcept {
+  releaseMirror();
+  Filter::onError(err);
+}
+
+void MirrorFilter::releaseMirror() {
+  if (mirror_) {
+    auto mirror = mirror_;
+    mirror_ = nullptr;
+    mirror->release();
+  }
+}
+
+MirrorFilterFactory::MirrorFilterFactory(
+  const HTTPSessionPool::Key& upstream,
+  double sampleRate,
+  uint32_t maxInFlight,
+  std::chrono::milliseconds connectTimeout,
+  std::chrono::milliseconds transactionTimeout,
+  size_t maxBufferSize):
+    upstream_(upstream),
+    sampleRate_(sampleRate),
+    maxInFlight_(maxInFlight),
+    connectTimeout_(connectTimeout),
+    transactionTimeout_(transactionTimeout),
+    maxBufferSize_(maxBufferSize) {
+  CHECK(sampleRate >= 0 && sampleRate <= 1) << "sampleRate=" << sampleRate;
+}
+
+void MirrorFilterFactory::onServerStart() noexcept {
+  auto evb = folly::EventBaseManager::get()->getEventBase();
+  mirrors_.reset(new MirrorFilter::Mirrors(evb, upstream_, connectTimeout_,
+                                           transactionTimeout_, maxInFlight_,
+                                           maxBufferSize_));
+}
+
+void MirrorFilterFactory::onServerStop() noexcept {
+  mirrors_.reset();
+}
+
+RequestHandler* MirrorFilterFactory::onRequest(RequestHandler* h,
+                                               HTTPMessage* msg) noexcept {
+  return new MirrorFilter(h, mirrors_.get(), sampleRate_);
+}
+
+}
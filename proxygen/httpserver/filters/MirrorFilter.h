@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPSessionPool.h>
+#include <unordered_set>
+
+namespace proxygen {
+
+/**
+ * A filter that mirrors a sample of the requests to another server, e.g.
+ * a new backend under validation, while they go on to the handler as
+ * usual. The mirror gets a copy of the request that shares its headers
+ * (see HTTPMessage::shareHeaders()) and clones of its body chains, over a
+ * session of an HTTPSessionPool, and its response is discarded.
+ *
+ * The request never waits on its mirror: the mirror buffers the body
+ * while it connects or while its transaction can't send, and is aborted
+ * once it holds more than maxBufferSize bytes, or if the request fails
+ * before the mirror has all of it. Upgrades and CONNECTs aren't mirrored.
+ */
+class MirrorFilter : public Filter {
+ public:
+  static const size_t kDefaultMaxBufferSize = 64 * 1024;
+
+  class Mirror;
+
+  /**
+   * The mirrors of a handler thread and the pool of their sessions.
+   * Deleting it aborts the mirrors in flight.
+   */
+  class Mirrors {
+   public:
+    Mirrors(folly::EventBase* eventBase,
+            const HTTPSessionPool::Key& upstream,
+            std::chrono::milliseconds connectTimeout,
+            std::chrono::milliseconds transactionTimeout,
+            uint32_t maxInFlight,
+            size_t maxBufferSize = kDefaultMaxBufferSize,
+            uint32_t maxIdleSessions =
+              HTTPSessionPool::kDefaultMaxIdleSessions);
+    ~Mirrors();
+
+    uint32_t getNumInFlight() const {
+      return mirrors_.size();
+    }
+
+   private:
+    friend class Mirror;
+    friend class MirrorFilter;
+
+    const HTTPSessionPool::Key upstream_;
+    const std::chrono::milliseconds connectTimeout_;
+    const uint32_t maxInFlight_;
+    const size_t maxBufferSize_;
+    AsyncTimeoutSet::UniquePtr timeouts_;
+    // destroyed before the timeouts, its sessions use them
+    HTTPSessionPool pool_;
+    std::unordered_set<Mirror*> mirrors_;
+  };
+
+  /**
+   * @param sampleRate the fraction of the requests to mirror, from 0 to 1,
+   *                   as long as fewer than the maxInFlight of mirrors are
+   *                   in flight
+   */
+  MirrorFilter(RequestHandler* upstream, Mirrors* mirrors, double sampleRate);
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+
+ private:
+  friend class Mirror;
+
+  // stop feeding the mirror, which is aborted unless it has the EOM
+  void releaseMirror();
+
+  Mirrors* const mirrors_;
+  // rand32() below it samples a request
+  const uint64_t sampleThreshold_;
+  // null once done with or gone
+  Mirror* mirror_{nullptr};
+};
+
+/**
+ * Makes MirrorFilters that mirror through a session pool for each handler
+ * thread. maxInFlight applies to each handler thread.
+ */
+class MirrorFilterFactory : public RequestHandlerFactory {
+ public:
+  MirrorFilterFactory(const HTTPSessionPool::Key& upstream,
+                      double sampleRate,
+                      uint32_t maxInFlight,
+                      std::chrono::milliseconds connectTimeout,
+                      std::chrono::milliseconds transactionTimeout,
+                      size_t maxBufferSize =
+                        MirrorFilter::kDefaultMaxBufferSize);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+    noexcept override;
+
+ private:
+  const HTTPSessionPool::Key upstream_;
+  const double sampleRate_;
+  const uint32_t maxInFlight_;
+  const std::chrono::milliseconds connectTimeout_;
+  const std::chrono::milliseconds transactionTimeout_;
+  const size_t maxBufferSize_;
+  folly::ThreadLocalPtr<MirrorFilter::Mirrors> mirrors_;
+};
+
+}
@@ -0,0 +1,388 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/PeerFillFilter.h>
+
+#include <folly/Memory.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+using apache::thrift::transport::TTransportException;
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+/**
+ * The request of a PeerFillFilter to the peer that owns the object. It
+ * lives until its transaction detaches or its connection attempt fails,
+ * and deletes itself.
+ */
+class PeerFillFilter::Fill : public HTTPTransactionHandler,
+                             private HTTPSessionPool::Callback {
+ public:
+  Fill(Peers* peers, PeerFillFilter* filter, const Peer& peer,
+       unique_ptr<HTTPMessage> request)
+      : peers_(peers),
+        filter_(filter),
+        peer_(peer),
+        request_(std::move(request)) {
+    peers_->fills_.insert(this);
+  }
+
+  void start() {
+    connecting_ = true;
+    // This may call back right away, with a pooled session
+    peers_->pool_.getSession(peer_.key, this, peers_->connectTimeout_);
+  }
+
+  // The filter is done with the fill
+  void release() {
+    filter_ = nullptr;
+    if (!complete_) {
+      abort("the request is gone");
+    }
+  }
+
+  // The peers of the thread are going away
+  void abandon() {
+    failed();
+    if (connecting_) {
+      peers_->pool_.cancel(this);
+      connecting_ = false;
+    }
+    peers_->fills_.erase(this);
+    peers_ = nullptr;
+    abort("shutting down");
+  }
+
+  void pauseIngress() {
+    if (txn_) {
+      txn_->pauseIngress();
+    }
+  }
+
+  void resumeIngress() {
+    if (txn_) {
+      txn_->resumeIngress();
+    }
+  }
+
+  // HTTPTransactionHandler
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+
+  void detachTransaction() noexcept override {
+    txn_ = nullptr;
+    delete this;
+  }
+
+  void onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept override {
+    headersReceived_ = true;
+    if (filter_) {
+      filter_->fillStarted();
+      filter_->downstream_->sendHeaders(*msg);
+    }
+  }
+
+  void onBody(unique_ptr<IOBuf> chain) noexcept override {
+    if (filter_) {
+      filter_->downstream_->sendBody(std::move(chain));
+    }
+  }
+
+  void onTrailers(unique_ptr<HTTPHeaders> trailers) noexcept override {
+    // ResponseHandler can't send trailers
+  }
+
+  void onEOM() noexcept override {
+    complete_ = true;
+    if (filter_) {
+      filter_->downstream_->sendEOM();
+    }
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {
+  }
+
+  void onError(const HTTPException& error) noexcept override {
+    // the transaction detaches next
+    VLOG(4) << "Error filling from " << peer_.name << ": " << error.what();
+    failed();
+  }
+
+  // only a GET goes out, there is no body to pace
+  void onEgressPaused() noexcept override {
+  }
+
+  void onEgressResumed() noexcept override {
+  }
+
+ private:
+  ~Fill() {
+    CHECK(!txn_);
+    CHECK(!connecting_);
+    if (peers_) {
+      peers_->fills_.erase(this);
+    }
+    if (filter_) {
+      filter_->fill_ = nullptr;
+    }
+  }
+
+  // HTTPSessionPool::Callback
+  void sessionAvailable(HTTPUpstreamSession* session) override {
+    connecting_ = false;
+    if (!session->newTransaction(this)) {
+      VLOG(4) << "No transaction to " << peer_.name;
+      failed();
+      delete this;
+      return;
+    }
+    CHECK(txn_);
+    txn_->sendHeaders(*request_);
+    txn_->sendEOM();
+    request_.reset();
+  }
+
+  void sessionError(const TTransportException& ex) override {
+    VLOG(4) << "Error connecting to " << peer_.name << ": " << ex.what();
+    connecting_ = false;
+    failed();
+    delete this;
+  }
+
+  // Let go of the filter, which serves the request itself if it can
+  void failed() {
+    if (!filter_) {
+      return;
+    }
+    auto filter = filter_;
+    filter_ = nullptr;
+    filter->fill_ = nullptr;
+    if (headersReceived_) {
+      filter->downstream_->sendAbort();
+    } else {
+      filter->fillFailed();
+    }
+  }
+
+  // Deletes the fill, right away or once its transaction detaches
+  void abort(const char* reason) {
+    VLOG(4) << "Aborting the fill from " << peer_.name << ", " << reason;
+    if (connecting_) {
+      peers_->pool_.cancel(this);
+      connecting_ = false;
+    }
+    if (txn_) {
+      txn_->sendAbort();
+    } else {
+      delete this;
+    }
+  }
+
+  Peers* peers_;
+  PeerFillFilter* filter_;
+  const Peer& peer_;
+  // till the transaction is there to send it
+  unique_ptr<HTTPMessage> request_;
+  HTTPTransaction* txn_{nullptr};
+  bool connecting_{false};
+  bool headersReceived_{false};
+  bool complete_{false};
+};
+
+const char* const PeerFillFilter::kDefaultFillHeader = "X-Peer-Fill";
+
+PeerFillFilter::Peers::Peers(folly::EventBase* eventBase,
+                             const ConsistentHash* ring,
+                             const std::vector<Peer>* peers,
+                             size_t selfNode,
+                             const std::string& selfName,
+                             const std::string& fillHeader,
+                             std::chrono::milliseconds connectTimeout,
+                             std::chrono::milliseconds transactionTimeout,
+                             uint32_t maxIdleSessions)
+    : ring_(CHECK_NOTNULL(ring)),
+      peers_(CHECK_NOTNULL(peers)),
+      selfNode_(selfNode),
+      selfName_(selfName),
+      fillHeader_(fillHeader),
+      connectTimeout_(connectTimeout),
+      timeouts_(new AsyncTimeoutSet(eventBase, transactionTimeout)),
+      pool_(eventBase, timeouts_.get(), maxIdleSessions) {
+}
+
+PeerFillFilter::Peers::~Peers() {
+  // An aborted fill may only go once its transaction detaches, so they
+  // are let go of first
+  auto fills = std::move(fills_);
+  fills_.clear();
+  for (auto fill: fills) {
+    fill->abandon();
+  }
+}
+
+PeerFillFilter::PeerFillFilter(RequestHandler* upstream, Peers* peers)
+    : Filter(upstream),
+      peers_(CHECK_NOTNULL(peers)) {
+}
+
+void PeerFillFilter::onRequest(unique_ptr<HTTPMessage> msg) noexcept {
+  // a request from a peer is for an object of ours
+  if (ResponseCache::isCacheableRequest(*msg) &&
+      !msg->getHeaders().exists(HTTP_HEADER_UPGRADE) &&
+      !msg->getHeaders().exists(peers_->fillHeader_)) {
+    size_t node = peers_->ring_->getNode(ResponseCache::getKey(*msg));
+    if (node != ConsistentHash::kNoNode && node != peers_->selfNode_) {
+      auto fillRequest = folly::make_unique<HTTPMessage>(*msg);
+      fillRequest->getHeaders().set(peers_->fillHeader_, peers_->selfName_);
+      request_ = std::move(msg);
+      fill_ = new Fill(peers_, this, (*peers_->peers_)[node],
+                       std::move(fillRequest));
+      // the fill may have failed already, and handed the request over
+      fill_->start();
+      return;
+    }
+  }
+  upstream_->onRequest(std::move(msg));
+}
+
+void PeerFillFilter::onBody(unique_ptr<IOBuf> body) noexcept {
+  if (request_) {
+    // kept for the handler, the peer only gets the GET
+    pendingBody_.append(std::move(body));
+  } else if (upstream_) {
+    upstream_->onBody(std::move(body));
+  }
+}
+
+void PeerFillFilter::onUpgrade(UpgradeProtocol protocol) noexcept {
+  if (upstream_ && !request_) {
+    upstream_->onUpgrade(protocol);
+  }
+}
+
+void PeerFillFilter::onEOM() noexcept {
+  if (request_) {
+    requestEOM_ = true;
+  } else if (upstream_) {
+    upstream_->onEOM();
+  }
+}
+
+void PeerFillFilter::requestComplete() noexcept {
+  releaseFill();
+  if (upstream_) {
+    Filter::requestComplete();
+  } else {
+    delete this;
+  }
+}
+
+void PeerFillFilter::onError(ProxygenError err) noexcept {
+  releaseFill();
+  if (upstream_) {
+    Filter::onError(err);
+  } else {
+    delete this;
+  }
+}
+
+void PeerFillFilter::onEgressPaused() noexcept {
+  if (!upstream_) {
+    // the client doesn't keep up, stop reading the peer's response
+    if (fill_) {
+      fill_->pauseIngress();
+    }
+  } else {
+    upstream_->onEgressPaused();
+  }
+}
+
+void PeerFillFilter::onEgressResumed() noexcept {
+  if (!upstream_) {
+    if (fill_) {
+      fill_->resumeIngress();
+    }
+  } else {
+    upstream_->onEgressResumed();
+  }
+}
+
+void PeerFillFilter::fillStarted() {
+  upstream_->onError(kErrorCanceled);
+  upstream_ = nullptr;
+  request_.reset();
+  pendingBody_.move();
+}
+
+void PeerFillFilter::fillFailed() {
+  VLOG(4) << "Peer fill failed, the handler serves "
+          << request_->getURL();
+  upstream_->onRequest(std::move(request_));
+  if (!pendingBody_.empty()) {
+    upstream_->onBody(pendingBody_.move());
+  }
+  if (requestEOM_) {
+    upstream_->onEOM();
+  }
+}
+
+void PeerFillFilter::releaseFill() {
+  if (fill_) {
+    auto fill = fill_;
+    fill_ = nullptr;
+    fill->release();
+  }
+}
+
+PeerFillFilterFactory::PeerFillFilterFactory(
+  const std::string& self,
+  const std::vector<PeerFillFilter::Peer>& peers,
+  std::chrono::milliseconds connectTimeout,
+  std::chrono::milliseconds transactionTimeout,
+  const std::string& fillHeader,
+  uint32_t virtualNodes):
+    self_(self),
+    fillHeader_(fillHeader),
+    connectTimeout_(connectTimeout),
+    transactionTimeout_(transactionTimeout),
+    ring_(virtualNodes),
+    peers_(peers) {
+  for (const auto& peer: peers_) {
+    size_t node = ring_.addNode(peer.name, peer.weight);
+    if (peer.name == self_) {
+      selfNode_ = node;
+    }
+  }
+  LOG_IF(WARNING, selfNode_ == ConsistentHash::kNoNode)
+    << self << " isn't a peer, all the cacheable requests go to the peers";
+}
+
+void PeerFillFilterFactory::onServerStart() noexcept {
+  auto evb = folly::EventBaseManager::get()->getEventBase();
+  threadPeers_.reset(new PeerFillFilter::Peers(evb, &ring_, &peers_,
+                                               selfNode_, self_, fillHeader_,
+                                               connectTimeout_,
+                                               transactionTimeout_));
+}
+
+void PeerFillFilterFactory::onServerStop() noexcept {
+  threadPeers_.reset();
+}
+
+RequestHandler* PeerFillFilterFactory::onRequest(RequestHandler* h,
+                                                 HTTPMessage* msg) noexcept {
+  return new PeerFillFilter(h, threadPeers_.get());
+}
+
+}
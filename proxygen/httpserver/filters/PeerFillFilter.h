@@ -0,0 +1,168 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/ThreadLocal.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPSessionPool.h>
+#include <proxygen/lib/utils/ConsistentHash.h>
+#include <unordered_set>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A filter that spreads the cacheable requests of a fleet of caching
+ * servers over their caches, so that the fleet caches each object once
+ * rather than on every server. The objects are assigned to the servers by
+ * consistent hashing of ResponseCache::getKey(), and a request for an
+ * object of another server goes to it, its peer, over a session of an
+ * HTTPSessionPool, instead of to the handler. The request carries the
+ * name of the server in fillHeader, which makes the peer serve it itself
+ * whatever its own ring says.
+ *
+ * It goes after a CacheFilter and a CollapseFilter, so that only the
+ * misses of the local cache are forwarded, once for all the concurrent
+ * requests of a handler thread, and the peer's answer is stored by the
+ * CacheFilter like the handler's. On the peer, the same filters collapse
+ * the requests of all the servers, so that the origin is asked once per
+ * object for the fleet.
+ *
+ * If the peer can't be reached, or fails before its response headers,
+ * the request goes on to the handler after all. The handler is told to go
+ * away with onError() once the peer's response starts.
+ */
+class PeerFillFilter : public Filter {
+ public:
+  static const char* const kDefaultFillHeader;
+
+  struct Peer {
+    Peer(const std::string& n, const HTTPSessionPool::Key& k,
+         uint32_t w = 1)
+        : name(n), key(k), weight(w) {}
+
+    // the same on all the servers, e.g. the host:port of the peer
+    std::string name;
+    HTTPSessionPool::Key key;
+    uint32_t weight;
+  };
+
+  class Fill;
+
+  /**
+   * The fills of a handler thread and the pool of their sessions.
+   * Deleting it aborts the fills in flight.
+   */
+  class Peers {
+   public:
+    /**
+     * @param peers    the peers by the node indexes of ring
+     * @param selfNode the node of this server, ConsistentHash::kNoNode if
+     *                 it serves no keys of its own
+     */
+    Peers(folly::EventBase* eventBase,
+          const ConsistentHash* ring,
+          const std::vector<Peer>* peers,
+          size_t selfNode,
+          const std::string& selfName,
+          const std::string& fillHeader,
+          std::chrono::milliseconds connectTimeout,
+          std::chrono::milliseconds transactionTimeout,
+          uint32_t maxIdleSessions =
+            HTTPSessionPool::kDefaultMaxIdleSessions);
+    ~Peers();
+
+    uint32_t getNumInFlight() const {
+      return fills_.size();
+    }
+
+   private:
+    friend class Fill;
+    friend class PeerFillFilter;
+
+    const ConsistentHash* const ring_;
+    const std::vector<Peer>* const peers_;
+    const size_t selfNode_;
+    const std::string selfName_;
+    const std::string fillHeader_;
+    const std::chrono::milliseconds connectTimeout_;
+    AsyncTimeoutSet::UniquePtr timeouts_;
+    // destroyed before the timeouts, its sessions use them
+    HTTPSessionPool pool_;
+    std::unordered_set<Fill*> fills_;
+  };
+
+  PeerFillFilter(RequestHandler* upstream, Peers* peers);
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+  void onEgressPaused() noexcept override;
+  void onEgressResumed() noexcept override;
+
+ private:
+  friend class Fill;
+
+  // the peer's response started, the handler isn't needed
+  void fillStarted();
+  // the peer failed before its response, the handler serves the request
+  void fillFailed();
+  // stop the fill, which is aborted unless it completed
+  void releaseFill();
+
+  Peers* const peers_;
+  // null once done with or gone
+  Fill* fill_{nullptr};
+  // the request while the handler may still get it, see fillFailed()
+  std::unique_ptr<HTTPMessage> request_;
+  folly::IOBufQueue pendingBody_{folly::IOBufQueue::cacheChainLength()};
+  bool requestEOM_{false};
+};
+
+/**
+ * Makes PeerFillFilters over one ring of the servers of the fleet, with a
+ * session pool for each handler thread. self is the name of this server
+ * among peers, the keys of which it serves itself; the others are sent to
+ * their peer.
+ */
+class PeerFillFilterFactory : public RequestHandlerFactory {
+ public:
+  PeerFillFilterFactory(const std::string& self,
+                        const std::vector<PeerFillFilter::Peer>& peers,
+                        std::chrono::milliseconds connectTimeout,
+                        std::chrono::milliseconds transactionTimeout,
+                        const std::string& fillHeader =
+                          PeerFillFilter::kDefaultFillHeader,
+                        uint32_t virtualNodes =
+                          ConsistentHash::kDefaultVirtualNodes);
+
+  void onServerStart() noexcept override;
+  void onServerStop() noexcept override;
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+    noexcept override;
+
+ private:
+  const std::string self_;
+  const std::string fillHeader_;
+  const std::chrono::milliseconds connectTimeout_;
+  const std::chrono::milliseconds transactionTimeout_;
+  ConsistentHash ring_;
+  // by the node indexes of ring_
+  const std::vector<PeerFillFilter::Peer> peers_;
+  size_t selfNode_{ConsistentHash::kNoNode};
+  folly::ThreadLocalPtr<PeerFillFilter::Peers> threadPeers_;
+};
+
+}
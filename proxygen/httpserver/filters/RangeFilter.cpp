@@ -0,0 +1,222 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/RangeFilter.h>
+
+#include <algorithm>
+#include <folly/Conv.h>
+#include <folly/Random.h>
+#include <folly/io/Cursor.h>
+
+using folly::IOBuf;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+bool parseLength(const string& s, size_t* value) {
+  if (s.empty() || s.size() > 18) {
+    return false;
+  }
+  *value = 0;
+  for (char c: s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    *value = *value * 10 + (c - '0');
+  }
+  return true;
+}
+
+string makeBoundary() {
+  static const char kHex[] = "0123456789abcdef";
+  uint64_t bits = folly::Random::rand64();
+  string boundary("proxygen-");
+  for (int i = 0; i < 16; i++) {
+    boundary.push_back(kHex[bits & 0xf]);
+    bits >>= 4;
+  }
+  return boundary;
+}
+
+}
+
+const size_t RangeFilter::kDefaultMaxRanges;
+
+RangeFilter::RangeFilter(RequestHandler* upstream, size_t maxRanges):
+    Filter(upstream),
+    maxRanges_(maxRanges) {
+}
+
+void RangeFilter::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
+  // the RFC has other methods ignore Range
+  if (headers->getMethod() == HTTPMethod::GET) {
+    const auto& reqHeaders = headers->getHeaders();
+    range_ = reqHeaders.getSingleOrEmpty(HTTP_HEADER_RANGE);
+    if (!range_.empty()) {
+      ifRange_ = reqHeaders.getSingleOrEmpty(HTTP_HEADER_IF_RANGE);
+    }
+  }
+  upstream_->onRequest(std::move(headers));
+}
+
+void RangeFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  auto& headers = msg.getHeaders();
+  if (msg.getStatusCode() != 200 || headers.exists(HTTP_HEADER_CONTENT_RANGE) ||
+      !parseLength(headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH),
+                   &size_)) {
+    downstream_->sendHeaders(msg);
+    return;
+  }
+  if (!headers.exists(HTTP_HEADER_ACCEPT_RANGES)) {
+    headers.add(HTTP_HEADER_ACCEPT_RANGES, "bytes");
+  }
+  if (range_.empty() ||
+      !RFC2616::isIfRangeMatched(
+        ifRange_, headers.getSingleOrEmpty(HTTP_HEADER_ETAG),
+        headers.getSingleOrEmpty(HTTP_HEADER_LAST_MODIFIED))) {
+    downstream_->sendHeaders(msg);
+    return;
+  }
+
+  auto result = RFC2616::parseByteRanges(range_, size_, maxRanges_,
+                                         ranges_);
+  if (result == RFC2616::RangeResult::NONE) {
+    downstream_->sendHeaders(msg);
+    return;
+  }
+  if (result == RFC2616::RangeResult::UNSATISFIABLE) {
+    mode_ = Mode::DROP;
+    msg.setStatusCode(416);
+    msg.setStatusMessage("Requested Range Not Satisfiable");
+    headers.remove(HTTP_HEADER_CONTENT_TYPE);
+    headers.set(HTTP_HEADER_CONTENT_RANGE,
+                folly::to<string>("bytes */", size_));
+    headers.set(HTTP_HEADER_CONTENT_LENGTH, "0");
+    downstream_->sendHeaders(msg);
+    return;
+  }
+
+  mode_ = Mode::SLICE;
+  msg.setStatusCode(206);
+  msg.setStatusMessage("Partial Content");
+  if (ranges_.size() == 1) {
+    const auto& range = ranges_[0];
+    headers.set(HTTP_HEADER_CONTENT_RANGE,
+                folly::to<string>("bytes ", range.offset, "-",
+                                  range.offset + range.length - 1, "/",
+                                  size_));
+    headers.set(HTTP_HEADER_CONTENT_LENGTH,
+                folly::to<string>(range.length));
+  } else {
+    boundary_ = makeBoundary();
+    contentType_ = headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE);
+    size_t length = getClosingDelimiter().size();
+    for (const auto& range: ranges_) {
+      length += getPartHeader(range).size() + range.length;
+    }
+    headers.set(HTTP_HEADER_CONTENT_TYPE,
+                "multipart/byteranges; boundary=" + boundary_);
+    headers.set(HTTP_HEADER_CONTENT_LENGTH, folly::to<string>(length));
+  }
+  downstream_->sendHeaders(msg);
+}
+
+void RangeFilter::sendChunkHeader(size_t len) noexcept {
+  // the slices have a Content-Length
+  if (mode_ == Mode::PASS) {
+    downstream_->sendChunkHeader(len);
+  }
+}
+
+void RangeFilter::sendBody(std::unique_ptr<IOBuf> body) noexcept {
+  if (mode_ == Mode::PASS) {
+    downstream_->sendBody(std::move(body));
+    return;
+  }
+  const size_t length = body->computeChainDataLength();
+  forward(length, [&] (size_t offset, size_t sliceLength) {
+      if (sliceLength == length) {
+        downstream_->sendBody(std::move(body));
+        return;
+      }
+      folly::io::Cursor cursor(body.get());
+      cursor.skip(offset);
+      std::unique_ptr<IOBuf> slice;
+      cursor.clone(slice, sliceLength);
+      downstream_->sendBody(std::move(slice));
+    });
+}
+
+void RangeFilter::sendFileRegion(const FileRegion& region) noexcept {
+  if (mode_ == Mode::PASS) {
+    downstream_->sendFileRegion(region);
+    return;
+  }
+  forward(region.getLength(), [&] (size_t offset, size_t length) {
+      downstream_->sendFileRegion(region.slice(offset, length));
+    });
+}
+
+void RangeFilter::sendChunkTerminator() noexcept {
+  if (mode_ == Mode::PASS) {
+    downstream_->sendChunkTerminator();
+  }
+}
+
+void RangeFilter::sendEOM() noexcept {
+  if (mode_ == Mode::SLICE && !boundary_.empty()) {
+    downstream_->sendBody(IOBuf::copyBuffer(getClosingDelimiter()));
+  }
+  downstream_->sendEOM();
+}
+
+template <class SendSlice>
+void RangeFilter::forward(size_t length, SendSlice sendSlice) {
+  const size_t end = position_ + length;
+  if (mode_ == Mode::SLICE && length > 0) {
+    while (next_ < ranges_.size()) {
+      const auto& range = ranges_[next_];
+      const size_t rangeEnd = range.offset + range.length;
+      if (range.offset >= end) {
+        break;
+      }
+      const size_t from = std::max(position_, range.offset);
+      const size_t to = std::min(end, rangeEnd);
+      if (from == range.offset && !boundary_.empty()) {
+        downstream_->sendBody(IOBuf::copyBuffer(getPartHeader(range)));
+      }
+      sendSlice(from - position_, to - from);
+      if (rangeEnd > end) {
+        break;
+      }
+      next_++;
+    }
+  }
+  position_ = end;
+}
+
+string RangeFilter::getPartHeader(const RFC2616::ByteRange& range) const {
+  // the CRLF before the first delimiter is in the preamble
+  string header = "\r\n--" + boundary_ + "\r\n";
+  if (!contentType_.empty()) {
+    header += "Content-Type: " + contentType_ + "\r\n";
+  }
+  header += folly::to<string>("Content-Range: bytes ", range.offset, "-",
+                              range.offset + range.length - 1, "/", size_,
+                              "\r\n\r\n");
+  return header;
+}
+
+string RangeFilter::getClosingDelimiter() const {
+  return "\r\n--" + boundary_ + "--\r\n";
+}
+
+}
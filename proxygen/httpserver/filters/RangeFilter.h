@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A filter that answers the Range of a GET with the requested slices of
+ * the 200 response of the handler: a 206 of the one range, or a
+ * multipart/byteranges 206 of several, or a 416 if none is satisfiable.
+ * Only responses with a Content-Length are cut, and only if the If-Range
+ * of the request, if any, matches their ETag or Last-Modified. Those also
+ * get an Accept-Ranges.
+ *
+ * The handler sends the whole body as usual; the filter forwards the
+ * slices of it without copying them: clones of the IOBufs, and subregions
+ * of the file regions. Handlers that answer ranges themselves, as
+ * StaticFileHandler does, send a 206 that goes through as it is.
+ *
+ * The filter must be between the handler and a CompressionFilter, so that
+ * it cuts the plain body.
+ */
+class RangeFilter : public Filter {
+ public:
+  static const size_t kDefaultMaxRanges = 16;
+
+  explicit RangeFilter(RequestHandler* upstream,
+                       size_t maxRanges = kDefaultMaxRanges);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+  void sendChunkHeader(size_t len) noexcept override;
+  void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void sendFileRegion(const FileRegion& region) noexcept override;
+  void sendChunkTerminator() noexcept override;
+  void sendEOM() noexcept override;
+
+ private:
+  enum class Mode {
+    PASS,
+    // forward the bytes of ranges_ only
+    SLICE,
+    // the 416 has no body
+    DROP,
+  };
+
+  /**
+   * Forward the slices of ranges_ in the length bytes of the body at
+   * position_, with sendSlice(offset, length) for each, offset in those
+   * bytes
+   */
+  template <class SendSlice>
+  void forward(size_t length, SendSlice sendSlice);
+
+  std::string getPartHeader(const RFC2616::ByteRange& range) const;
+  std::string getClosingDelimiter() const;
+
+  const size_t maxRanges_;
+  // of a GET
+  std::string range_;
+  std::string ifRange_;
+  Mode mode_{Mode::PASS};
+  std::vector<RFC2616::ByteRange> ranges_;
+  // the range that is being sent
+  size_t next_{0};
+  // of the next byte of the body in the whole response
+  size_t position_{0};
+  size_t size_{0};
+  // of a multipart response, or empty
+  std::string boundary_;
+  std::string contentType_;
+};
+
+class RangeFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit RangeFilterFactory(
+    size_t maxRanges = RangeFilter::kDefaultMaxRanges):
+      maxRanges_(maxRanges) {}
+
+  void onServerStart() noexcept override {}
+  void onServerStop() noexcept override {}
+
+  RequestHandler* onRequest(RequestHandler* h,
+                            HTTPMessage*) noexcept override {
+    return new RangeFilter(h, maxRanges_);
+  }
+
+ private:
+  const size_t maxRanges_;
+};
+
+}
@@ -0,0 +1,207 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/RateLimitFilter.h>
+
+#include <folly/Hash.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/utils/Time.h>
+#include <time.h>
+
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+namespace {
+
+// fixed point tokens, so that slow rates still refill every millisecond
+const uint32_t kTokenUnit = 1 << 16;
+const uint32_t kMaxBurst = (1 << 16) - 1;
+
+// a time up to this much before the one stored was read by a thread that
+// lost the race to update the bucket, not long enough ago to have wrapped
+const uint32_t kMaxClockSkewMs = 1000;
+
+}
+
+const size_t RateLimiter::kDefaultCapacity;
+const size_t RateLimiter::kSlotsPerShard;
+
+RateLimiter::RateLimiter(double rate, uint32_t burst, size_t capacity)
+    : refillPerMs_(std::max<uint64_t>(rate * kTokenUnit / 1000, 1)),
+      maxTokens_(burst * kTokenUnit),
+      numShards_(std::max<size_t>(
+                   (capacity + kSlotsPerShard - 1) / kSlotsPerShard, 1)),
+      shards_(new Shard[numShards_]) {
+  CHECK(rate > 0) << "rate=" << rate;
+  CHECK(burst > 0 && burst <= kMaxBurst) << "burst=" << burst;
+}
+
+RateLimiter::~RateLimiter() {
+}
+
+milliseconds RateLimiter::getCoarseTime() {
+#ifdef CLOCK_MONOTONIC_COARSE
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return milliseconds(uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+#else
+  return std::chrono::duration_cast<milliseconds>(
+    getCurrentTime().time_since_epoch());
+#endif
+}
+
+bool RateLimiter::admit(const folly::SocketAddress& address) {
+  auto family = address.getFamily();
+  if (family != AF_INET && family != AF_INET6) {
+    return true;
+  }
+  auto ip = address.getIPAddress();
+  return admit(folly::StringPiece(reinterpret_cast<const char*>(ip.bytes()),
+                                  ip.byteCount()));
+}
+
+bool RateLimiter::admit(folly::StringPiece key, milliseconds now) {
+  // 0 marks a free slot
+  uint64_t hash = folly::hash::fnv64_buf(key.data(), key.size()) | 1;
+  uint32_t t = now.count();
+  auto& slot = getSlot(hash, t);
+  // what the bucket lacks to be full, so that a zeroed slot is full
+  auto state = slot.state.load(std::memory_order_relaxed);
+  while (true) {
+    uint32_t deficit = state;
+    uint32_t last = state >> 32;
+    uint32_t time = t;
+    uint64_t elapsed = uint32_t(t - last);
+    if (uint32_t(last - t) <= kMaxClockSkewMs) {
+      time = last;
+      elapsed = 0;
+    }
+    uint64_t refill = elapsed * refillPerMs_;
+    uint64_t next = deficit > refill ? deficit - refill : 0;
+    if (next + kTokenUnit > maxTokens_) {
+      // nothing to write, the refill is computed from the stored time
+      return false;
+    }
+    next += kTokenUnit;
+    if (slot.state.compare_exchange_weak(state, (uint64_t(time) << 32) | next,
+                                         std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+}
+
+RateLimiter::Slot& RateLimiter::getSlot(uint64_t hash, uint32_t now) {
+  auto& shard = shards_[(hash >> 1) % numShards_];
+  Slot* victim = nullptr;
+  uint64_t victimHash = 0;
+  uint32_t victimIdle = 0;
+  for (auto& slot: shard.slots) {
+    auto slotHash = slot.hash.load(std::memory_order_acquire);
+    if (slotHash == hash) {
+      return slot;
+    }
+    if (slotHash == 0) {
+      if (slot.hash.compare_exchange_strong(slotHash, hash)) {
+        return slot;
+      }
+      if (slotHash == hash) {
+        return slot;
+      }
+      // taken by another key meanwhile
+    }
+    uint32_t idle = now - uint32_t(
+      slot.state.load(std::memory_order_relaxed) >> 32);
+    if (!victim || idle > victimIdle) {
+      victim = &slot;
+      victimHash = slotHash;
+      victimIdle = idle;
+    }
+  }
+  // If another thread replaced the victim first, both keys share its
+  // bucket until one of them is replaced in turn
+  if (victim->hash.compare_exchange_strong(victimHash, hash)) {
+    victim->state.store(0, std::memory_order_relaxed);
+  }
+  return *victim;
+}
+
+RateLimitFilter::RateLimitFilter(
+  RequestHandler* upstream,
+  std::shared_ptr<const HTTPCannedResponse> response)
+    : Filter(upstream),
+      response_(std::move(response)) {
+}
+
+void RateLimitFilter::onRequest(std::unique_ptr<HTTPMessage> msg) noexcept {
+  upstream_->onError(kErrorDropped);
+  upstream_ = nullptr;
+
+  ResponseBuilder(downstream_).sendCanned(response_);
+}
+
+void RateLimitFilter::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
+}
+
+void RateLimitFilter::onUpgrade(UpgradeProtocol protocol) noexcept {
+}
+
+void RateLimitFilter::onEOM() noexcept {
+}
+
+void RateLimitFilter::requestComplete() noexcept {
+  CHECK(!upstream_);
+  delete this;
+}
+
+void RateLimitFilter::onError(ProxygenError err) noexcept {
+  // If onError is invoked before we forward the error
+  if (upstream_) {
+    upstream_->onError(err);
+    upstream_ = nullptr;
+  }
+
+  delete this;
+}
+
+RateLimitFilterFactory::RateLimitFilterFactory(RateLimiter* limiter,
+                                               KeyType keyType,
+                                               const std::string& header)
+    : limiter_(CHECK_NOTNULL(limiter)),
+      keyType_(keyType),
+      header_(header),
+      response_(std::make_shared<const HTTPCannedResponse>(
+                  429, "Too Many Requests", HTTPHeaders(), nullptr)) {
+  CHECK(keyType_ != KeyType::HEADER || !header_.empty());
+}
+
+bool RateLimitFilterFactory::admit(const HTTPMessage& msg) {
+  switch (keyType_) {
+    case KeyType::CLIENT_IP:
+      return limiter_->admit(msg.getClientAddress());
+    case KeyType::HEADER: {
+      auto value = msg.getHeaders().getSingleOrEmptyView(header_);
+      return value.empty() || limiter_->admit(value);
+    }
+    case KeyType::PATH:
+      return limiter_->admit(msg.getPath());
+  }
+  return true;
+}
+
+RequestHandler* RateLimitFilterFactory::onRequest(RequestHandler* h,
+                                                  HTTPMessage* msg) noexcept {
+  if (admit(*msg)) {
+    // No need to insert this filter
+    return h;
+  }
+  return new RateLimitFilter(h, response_);
+}
+
+}
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <folly/Range.h>
+#include <folly/SocketAddress.h>
+#include <memory>
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * Token buckets by key, e.g. client IP, that all the handler threads
+ * consult without locks. Each key may take `rate` requests per second on
+ * average, in bursts of up to `burst`.
+ *
+ * The buckets live in a fixed table of cache line sized shards of four
+ * slots, picked by the hash of the key. A slot holds the hash and one
+ * word packing the tokens and the time of the last refill, which is
+ * updated with compare-and-swap, so the threads only contend on the line
+ * of a shared key. When the four slots of a shard are taken, a new key
+ * takes over the one idle the longest, which starts full; with colliding
+ * hashes or a table too small for the active keys the limits are thus
+ * only approximate, erring on admitting. The clock is read at millisecond
+ * granularity from CLOCK_MONOTONIC_COARSE, which needs no system call.
+ */
+class RateLimiter {
+ public:
+  static const size_t kDefaultCapacity = 64 * 1024;
+
+  /**
+   * @param rate      requests per second, refilled continuously
+   * @param burst     the size of the buckets, at most 65535
+   * @param capacity  the number of keys tracked, rounded up to a multiple
+   *                  of four
+   */
+  RateLimiter(double rate, uint32_t burst,
+              size_t capacity = kDefaultCapacity);
+  ~RateLimiter();
+
+  /**
+   * Take a token for key
+   *
+   * @return false if its bucket is empty and the request should be
+   *         rejected
+   */
+  bool admit(folly::StringPiece key) {
+    return admit(key, getCoarseTime());
+  }
+
+  /**
+   * Take a token for the IP of address, from its raw bytes. Addresses
+   * that aren't IP are always admitted.
+   */
+  bool admit(const folly::SocketAddress& address);
+
+  /**
+   * As above, at time now, in milliseconds from any fixed point
+   */
+  bool admit(folly::StringPiece key, std::chrono::milliseconds now);
+
+  static std::chrono::milliseconds getCoarseTime();
+
+ private:
+  struct Slot {
+    // 0 if free
+    std::atomic<uint64_t> hash{0};
+    // tokens, in 1/kTokenUnit, in the low 32 bits, and the time of the
+    // last refill, in milliseconds, in the high ones
+    std::atomic<uint64_t> state{0};
+  };
+
+  static const size_t kSlotsPerShard = 4;
+
+  struct alignas(64) Shard {
+    Slot slots[kSlotsPerShard];
+  };
+
+  Slot& getSlot(uint64_t hash, uint32_t now);
+
+  // in tokens per ms, and kTokenUnit per token
+  const uint64_t refillPerMs_;
+  const uint32_t maxTokens_;
+  const size_t numShards_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+/**
+ * Rejects the requests over the limits of a RateLimiter with a canned 429.
+ */
+class RateLimitFilter : public Filter {
+ public:
+  RateLimitFilter(RequestHandler* upstream,
+                  std::shared_ptr<const HTTPCannedResponse> response);
+
+  void onRequest(std::unique_ptr<HTTPMessage> msg) noexcept override;
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+  void onUpgrade(UpgradeProtocol protocol) noexcept override;
+  void onEOM() noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+
+ private:
+  const std::shared_ptr<const HTTPCannedResponse> response_;
+};
+
+/**
+ * Checks each request against limiter, which must outlive the server, and
+ * only adds a RateLimitFilter to the chain of those that are rejected.
+ * The key of a request is its client IP, the value of a header, or its
+ * path. Requests without the header are not limited.
+ */
+class RateLimitFilterFactory : public RequestHandlerFactory {
+ public:
+  enum class KeyType: uint8_t {
+    CLIENT_IP,
+    HEADER,
+    PATH,
+  };
+
+  /**
+   * @param header  the header to key on, with KeyType::HEADER
+   */
+  RateLimitFilterFactory(RateLimiter* limiter,
+                         KeyType keyType = KeyType::CLIENT_IP,
+                         const std::string& header = "");
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage* msg)
+    noexcept override;
+
+ private:
+  bool admit(const HTTPMessage& msg);
+
+  RateLimiter* const limiter_;
+  const KeyType keyType_;
+  const std::string header_;
+  // shared by the handler threads
+  const std::shared_ptr<const HTTPCannedResponse> response_;
+};
+
+}
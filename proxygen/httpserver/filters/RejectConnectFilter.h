@@ -70,6 +70,9 @@ class RejectConnectFilter : public Filter {
   void sendBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
   }
 
+  void sendFileRegion(const FileRegion& region) noexcept override {
+  }
+
   void sendChunkTerminator() noexcept override {
   }
 
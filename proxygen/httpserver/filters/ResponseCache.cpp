@@ -0,0 +1,368 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+#include <algorithm>
+#include <cctype>
+#include <folly/Optional.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <set>
+
+using folly::IOBuf;
+using folly::Optional;
+using std::chrono::seconds;
+using std::string;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+// Responses that are cacheable by default (RFC 7231, 6.1), so with
+// explicit freshness
+const std::set<uint16_t> kCacheableStatus = {
+  200, 203, 204, 300, 301, 404, 405, 410, 414, 501
+};
+
+Optional<int64_t> parseSeconds(const string& s) {
+  if (s.empty() || s.size() > 18 ||
+      !std::all_of(s.begin(), s.end(), ::isdigit)) {
+    return Optional<int64_t>();
+  }
+  return strtoll(s.c_str(), nullptr, 10);
+}
+
+/**
+ * Split the comma separated values of the header, trimmed and lower cased
+ */
+vector<string> getTokens(const HTTPHeaders& headers, HTTPHeaderCode code) {
+  vector<string> tokens;
+  string value = headers.combine(code, ",");
+  size_t pos = 0;
+  while (pos <= value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == string::npos) {
+      end = value.size();
+    }
+    size_t first = pos;
+    size_t last = end;
+    while (first < last && isspace(value[first])) {
+      first++;
+    }
+    while (last > first && isspace(value[last - 1])) {
+      last--;
+    }
+    if (first < last) {
+      string token = value.substr(first, last - first);
+      std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+      tokens.push_back(std::move(token));
+    }
+    pos = end + 1;
+  }
+  return tokens;
+}
+
+struct CacheControl {
+  explicit CacheControl(const HTTPHeaders& headers) {
+    for (auto& token: getTokens(headers, HTTP_HEADER_CACHE_CONTROL)) {
+      size_t eq = token.find('=');
+      string name = token.substr(0, eq);
+      string value;
+      if (eq != string::npos) {
+        value = token.substr(eq + 1);
+        value.erase(std::remove(value.begin(), value.end(), '"'),
+                    value.end());
+      }
+      if (name == "no-store") {
+        noStore = true;
+      } else if (name == "no-cache") {
+        noCache = true;
+      } else if (name == "private") {
+        isPrivate = true;
+      } else if (name == "max-age") {
+        maxAge = parseSeconds(value);
+      } else if (name == "s-maxage") {
+        sMaxAge = parseSeconds(value);
+      }
+    }
+  }
+
+  bool noStore{false};
+  bool noCache{false};
+  bool isPrivate{false};
+  Optional<int64_t> maxAge;
+  Optional<int64_t> sMaxAge;
+};
+
+int64_t getAge(const HTTPMessage& msg) {
+  auto age = parseSeconds(msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_AGE));
+  return age ? *age : 0;
+}
+
+size_t estimateSize(const HTTPMessage& response, const IOBuf* body) {
+  size_t size = sizeof(ResponseCache::Response) + 256;
+  response.getHeaders().forEach([&] (const string& name, const string& value) {
+      size += name.size() + value.size() + 32;
+    });
+  if (body) {
+    size += body->computeChainDataLength();
+  }
+  return size;
+}
+
+}
+
+const size_t ResponseCache::kDefaultCapacity;
+const size_t ResponseCache::kDefaultMaxEntrySize;
+const size_t ResponseCache::kNumShards;
+const size_t ResponseCache::kMaxVariants;
+
+ResponseCache::ResponseCache(size_t capacity, size_t maxEntrySize):
+    shardCapacity_(std::max(capacity / kNumShards, size_t(1))),
+    maxEntrySize_(maxEntrySize) {
+}
+
+bool ResponseCache::isCacheableRequest(const HTTPMessage& request) {
+  if (request.getMethod() != HTTPMethod::GET ||
+      request.getHeaders().exists(HTTP_HEADER_AUTHORIZATION)) {
+    return false;
+  }
+  return !CacheControl(request.getHeaders()).noStore;
+}
+
+bool ResponseCache::mayServeFromCache(const HTTPMessage& request) {
+  CacheControl cc(request.getHeaders());
+  if (cc.noCache || (cc.maxAge && *cc.maxAge == 0)) {
+    return false;
+  }
+  auto pragma = getTokens(request.getHeaders(), HTTP_HEADER_PRAGMA);
+  return std::find(pragma.begin(), pragma.end(), "no-cache") == pragma.end();
+}
+
+seconds ResponseCache::getFreshness(const HTTPMessage& response) {
+  const HTTPHeaders& headers = response.getHeaders();
+  if (!kCacheableStatus.count(response.getStatusCode()) ||
+      !isShareable(response)) {
+    return seconds(0);
+  }
+  CacheControl cc(headers);
+  if (cc.noCache) {
+    return seconds(0);
+  }
+
+  int64_t lifetime = 0;
+  if (cc.sMaxAge) {
+    lifetime = *cc.sMaxAge;
+  } else if (cc.maxAge) {
+    lifetime = *cc.maxAge;
+  } else if (headers.exists(HTTP_HEADER_EXPIRES)) {
+    auto expires = parseHTTPDateTime(
+      headers.getSingleOrEmpty(HTTP_HEADER_EXPIRES));
+    auto date = parseHTTPDateTime(headers.getSingleOrEmpty(HTTP_HEADER_DATE));
+    if (expires) {
+      lifetime = *expires - (date ? *date : int64_t(time(nullptr)));
+    }
+  }
+  return seconds(std::max(lifetime - getAge(response), int64_t(0)));
+}
+
+bool ResponseCache::isShareable(const HTTPMessage& response) {
+  if (response.getHeaders().exists(HTTP_HEADER_SET_COOKIE)) {
+    return false;
+  }
+  CacheControl cc(response.getHeaders());
+  if (cc.noStore || cc.isPrivate) {
+    return false;
+  }
+  auto vary = getVaryNames(response);
+  return std::find(vary.begin(), vary.end(), "*") == vary.end();
+}
+
+bool ResponseCache::varyMatches(const HTTPMessage& request,
+                                const HTTPMessage& other,
+                                const HTTPMessage& response) {
+  auto varyNames = getVaryNames(response);
+  return getVaryValues(request, varyNames) == getVaryValues(other, varyNames);
+}
+
+std::shared_ptr<const ResponseCache::Response> ResponseCache::get(
+  const HTTPMessage& request) {
+  string key = getKey(request);
+  Shard& shard = getShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return nullptr;
+  }
+  Entry& entry = *it->second;
+  auto values = getVaryValues(request, entry.varyNames);
+  for (auto variant = entry.variants.begin(); variant != entry.variants.end();
+       ++variant) {
+    if (variant->varyValues != values) {
+      continue;
+    }
+    if (variant->response->expires <= getCurrentTime()) {
+      removeVariant(shard, entry, variant);
+      return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return variant->response;
+  }
+  return nullptr;
+}
+
+bool ResponseCache::put(const HTTPMessage& request,
+                        const HTTPMessage& response,
+                        std::unique_ptr<IOBuf> body) {
+  if (!isCacheableRequest(request)) {
+    return false;
+  }
+  auto freshness = getFreshness(response);
+  size_t size = estimateSize(response, body.get());
+  if (freshness.count() == 0 || size > maxEntrySize_) {
+    return false;
+  }
+
+  auto stored = std::make_shared<Response>();
+  stored->headers = response;
+  stored->body = std::move(body);
+  stored->initialAge = seconds(getAge(response));
+  stored->stored = getCurrentTime();
+  stored->expires = stored->stored + freshness;
+
+  Variant variant;
+  auto varyNames = getVaryNames(response);
+  variant.varyValues = getVaryValues(request, varyNames);
+  variant.response = std::move(stored);
+  variant.size = size;
+
+  string key = getKey(request);
+  Shard& shard = getShard(key);
+  // the entries pushed out, handed to the callback once unlocked
+  LRUList evicted;
+  bool kept;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      shard.lru.emplace_front();
+      shard.lru.front().key = key;
+      shard.lru.front().varyNames = varyNames;
+      it = shard.index.emplace(key, shard.lru.begin()).first;
+    } else {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    }
+    Entry& entry = *it->second;
+    if (entry.varyNames != varyNames) {
+      // the variants made for other headers no longer apply
+      shard.size -= entry.size;
+      entry.size = 0;
+      entry.variants.clear();
+      entry.varyNames = varyNames;
+    }
+    for (auto old = entry.variants.begin(); old != entry.variants.end();
+         ++old) {
+      if (old->varyValues == variant.varyValues) {
+        entry.size -= old->size;
+        shard.size -= old->size;
+        entry.variants.erase(old);
+        break;
+      }
+    }
+    entry.size += size;
+    shard.size += size;
+    entry.variants.push_front(std::move(variant));
+    while (entry.variants.size() > kMaxVariants) {
+      entry.size -= entry.variants.back().size;
+      shard.size -= entry.variants.back().size;
+      entry.variants.pop_back();
+    }
+
+    while (shard.size > shardCapacity_ && !shard.lru.empty()) {
+      Entry& oldest = shard.lru.back();
+      shard.size -= oldest.size;
+      shard.index.erase(oldest.key);
+      if (evictionCallback_) {
+        evicted.splice(evicted.end(), shard.lru, std::prev(shard.lru.end()));
+      } else {
+        shard.lru.pop_back();
+      }
+    }
+    kept = shard.index.count(key) > 0;
+  }
+
+  for (auto& entry: evicted) {
+    for (auto& evictedVariant: entry.variants) {
+      evictionCallback_(entry.key, entry.varyNames,
+                        evictedVariant.varyValues, evictedVariant.response);
+    }
+  }
+  return kept;
+}
+
+size_t ResponseCache::getNumEntries() const {
+  size_t n = 0;
+  for (auto& shard: shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto& entry: shard.lru) {
+      n += entry.variants.size();
+    }
+  }
+  return n;
+}
+
+size_t ResponseCache::getSize() const {
+  size_t size = 0;
+  for (auto& shard: shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.size;
+  }
+  return size;
+}
+
+string ResponseCache::getKey(const HTTPMessage& request) {
+  return request.getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST) + " " +
+    request.getURL();
+}
+
+vector<string> ResponseCache::getVaryValues(const HTTPMessage& request,
+                                            const vector<string>& varyNames) {
+  vector<string> values;
+  values.reserve(varyNames.size());
+  for (auto& name: varyNames) {
+    values.push_back(request.getHeaders().combine(name));
+  }
+  return values;
+}
+
+vector<string> ResponseCache::getVaryNames(const HTTPMessage& response) {
+  auto names = getTokens(response.getHeaders(), HTTP_HEADER_VARY);
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return names;
+}
+
+ResponseCache::Shard& ResponseCache::getShard(const string& key) {
+  return shards_[std::hash<string>()(key) % kNumShards];
+}
+
+void ResponseCache::removeVariant(Shard& shard, Entry& entry,
+                                  std::list<Variant>::iterator variant) {
+  entry.size -= variant->size;
+  shard.size -= variant->size;
+  entry.variants.erase(variant);
+  if (entry.variants.empty()) {
+    auto it = shard.index.find(entry.key);
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  }
+}
+
+}
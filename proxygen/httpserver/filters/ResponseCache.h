@@ -0,0 +1,185 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/io/IOBuf.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/Time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * An in memory cache of complete responses to GET requests, that the
+ * handler threads share. The entries are spread over shards with a lock
+ * each, and each shard drops its least recently used entries past its
+ * share of the capacity, in bytes. See CacheFilter.
+ *
+ * Only responses with an explicit freshness lifetime (s-maxage, max-age
+ * or Expires) are stored, and never those marked no-store, no-cache or
+ * private, or that set cookies. For Vary, each URL keeps up to
+ * kMaxVariants responses, one for each set of values of the request
+ * headers named.
+ *
+ * The bodies are stored as the IOBuf chains the handlers sent, and hits
+ * get clones of them, so the data is never copied.
+ */
+class ResponseCache {
+ public:
+  static const size_t kDefaultCapacity = 64 * 1024 * 1024;
+  static const size_t kDefaultMaxEntrySize = 1024 * 1024;
+  static const size_t kNumShards = 16;
+  static const size_t kMaxVariants = 8;
+
+  struct Response {
+    HTTPMessage headers;
+    std::unique_ptr<folly::IOBuf> body;
+    // the Age the response had when it was stored
+    std::chrono::seconds initialAge;
+    TimePoint stored;
+    TimePoint expires;
+  };
+
+  explicit ResponseCache(size_t capacity = kDefaultCapacity,
+                         size_t maxEntrySize = kDefaultMaxEntrySize);
+
+  /**
+   * Called with each response dropped to make room for others, with its
+   * key, the names of the headers it varies on and their values in the
+   * request, such as to keep it in a second tier. Called without a lock
+   * held, from the thread that stored the response that pushed it out.
+   */
+  typedef std::function<void(const std::string& key,
+                             const std::vector<std::string>& varyNames,
+                             const std::vector<std::string>& varyValues,
+                             std::shared_ptr<const Response> response)>
+    EvictionCallback;
+
+  /**
+   * Set before the cache is used
+   */
+  void setEvictionCallback(EvictionCallback callback) {
+    evictionCallback_ = std::move(callback);
+  }
+
+  /**
+   * @return true if the response to request may be stored
+   */
+  static bool isCacheableRequest(const HTTPMessage& request);
+
+  /**
+   * @return true if request may be answered from the cache, false if
+   *         the client asks for a fresh response
+   */
+  static bool mayServeFromCache(const HTTPMessage& request);
+
+  /**
+   * @return how long response stays fresh, or zero if it must not be
+   *         stored
+   */
+  static std::chrono::seconds getFreshness(const HTTPMessage& response);
+
+  /**
+   * @return true if response may be given to other clients than the one
+   *         that asked for it, regardless of its freshness
+   */
+  static bool isShareable(const HTTPMessage& response);
+
+  /**
+   * @return true if response to request is also one to other, as far as
+   *         its Vary header goes
+   */
+  static bool varyMatches(const HTTPMessage& request,
+                          const HTTPMessage& other,
+                          const HTTPMessage& response);
+
+  /**
+   * @return the URL of request, with its host
+   */
+  static std::string getKey(const HTTPMessage& request);
+
+  /**
+   * @return the values in request of the headers named by a Vary
+   */
+  static std::vector<std::string> getVaryValues(
+    const HTTPMessage& request, const std::vector<std::string>& varyNames);
+
+  /**
+   * @return the names of the headers in the Vary of response, lower case
+   */
+  static std::vector<std::string> getVaryNames(const HTTPMessage& response);
+
+  /**
+   * @return a fresh response to request, or nullptr
+   */
+  std::shared_ptr<const Response> get(const HTTPMessage& request);
+
+  /**
+   * Store response, with body, as the answer to request if it may be
+   *
+   * @return true if it was stored
+   */
+  bool put(const HTTPMessage& request, const HTTPMessage& response,
+           std::unique_ptr<folly::IOBuf> body);
+
+  size_t getMaxEntrySize() const {
+    return maxEntrySize_;
+  }
+
+  size_t getNumEntries() const;
+
+  /**
+   * @return the estimated number of bytes held
+   */
+  size_t getSize() const;
+
+ private:
+  struct Variant {
+    // the values of the headers named by Vary, in the request
+    std::vector<std::string> varyValues;
+    std::shared_ptr<const Response> response;
+    size_t size;
+  };
+
+  struct Entry {
+    std::string key;
+    std::vector<std::string> varyNames;
+    // most recently stored first
+    std::list<Variant> variants;
+    size_t size{0};
+  };
+  typedef std::list<Entry> LRUList;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // most recently used first
+    LRUList lru;
+    std::unordered_map<std::string, LRUList::iterator> index;
+    size_t size{0};
+  };
+
+  Shard& getShard(const std::string& key);
+  void removeVariant(Shard& shard, Entry& entry,
+                     std::list<Variant>::iterator variant);
+
+  const size_t shardCapacity_;
+  const size_t maxEntrySize_;
+  EvictionCallback evictionCallback_;
+  Shard shards_[kNumShards];
+};
+
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/SharedMemoryStatsExporter.h>
+
+#include <glog/logging.h>
+#include <map>
+
+namespace proxygen {
+
+const uint32_t SharedMemoryStatsExporter::kDefaultCapacity;
+
+SharedMemoryStatsExporter::SharedMemoryStatsExporter(
+    StatsRegistry* registry,
+    const std::string& name,
+    const std::string& prefix,
+    std::chrono::milliseconds interval,
+    uint32_t capacity)
+    : registry_(CHECK_NOTNULL(registry)),
+      prefix_(prefix),
+      interval_(interval),
+      writer_(name, capacity) {
+  publish();
+  thread_ = std::thread([this] { run(); });
+}
+
+SharedMemoryStatsExporter::~SharedMemoryStatsExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_one();
+  thread_.join();
+  publish();
+}
+
+void SharedMemoryStatsExporter::publish() {
+  std::map<std::string, int64_t> counters;
+  registry_->getSnapshot().exportCounters(counters, prefix_);
+  std::lock_guard<std::mutex> guard(publishMutex_);
+  size_t skipped = writer_.publish(counters);
+  if (skipped && !warned_) {
+    LOG(WARNING) << "left out " << skipped << " of " << counters.size()
+                 << " counters from the shared memory segment";
+    warned_ = true;
+  }
+}
+
+void SharedMemoryStatsExporter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!cond_.wait_for(lock, interval_, [this] { return stopping_; })) {
+    lock.unlock();
+    publish();
+    lock.lock();
+  }
+}
+
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <proxygen/httpserver/filters/StatsRegistry.h>
+#include <proxygen/lib/utils/SharedMemoryCounters.h>
+#include <string>
+#include <thread>
+
+namespace proxygen {
+
+/**
+ * Publishes the counters of a StatsRegistry (see
+ * StatsRegistry::Snapshot::exportCounters()) into a shared memory
+ * segment every interval, from a thread of its own, for an agent that
+ * reads them with a SharedMemoryCounterReader. Unlike a stats handler,
+ * scraping then costs the worker threads nothing.
+ */
+class SharedMemoryStatsExporter {
+ public:
+  static const uint32_t kDefaultCapacity = 4096;
+
+  /**
+   * @param registry   must outlive the exporter
+   * @param name       of the segment, see SharedMemoryCounterWriter
+   *
+   * Throws std::system_error if the segment can't be created.
+   */
+  SharedMemoryStatsExporter(
+    StatsRegistry* registry,
+    const std::string& name,
+    const std::string& prefix = "",
+    std::chrono::milliseconds interval = std::chrono::seconds(1),
+    uint32_t capacity = kDefaultCapacity);
+
+  /**
+   * Stops the thread, after a last publish, and removes the segment
+   */
+  ~SharedMemoryStatsExporter();
+
+  /**
+   * Publish now, on the calling thread
+   */
+  void publish();
+
+ private:
+  void run();
+
+  StatsRegistry* const registry_;
+  const std::string prefix_;
+  const std::chrono::milliseconds interval_;
+  SharedMemoryCounterWriter writer_;
+  // one publisher at a time
+  std::mutex publishMutex_;
+  bool warned_{false};
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+}
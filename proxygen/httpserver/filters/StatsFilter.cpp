@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/StatsFilter.h>
+
+using std::chrono::microseconds;
+
+namespace proxygen {
+
+namespace {
+
+microseconds microsecondsSince(TimePoint start) {
+  return std::chrono::duration_cast<microseconds>(getCurrentTime() - start);
+}
+
+}
+
+StatsFilter::StatsFilter(RequestHandler* upstream, StatsRegistry* registry)
+    : Filter(upstream),
+      registry_(CHECK_NOTNULL(registry)),
+      start_(getCurrentTime()) {
+}
+
+void StatsFilter::onRequest(std::unique_ptr<HTTPMessage> headers) noexcept {
+  start_ = getCurrentTime();
+  registry_->recordRequest();
+  Filter::onRequest(std::move(headers));
+}
+
+void StatsFilter::sendHeaders(HTTPMessage& msg) noexcept {
+  // interim responses, such as a 100 Continue, aren't the first byte
+  if (!responded_ && msg.getStatusCode() >= 200) {
+    responded_ = true;
+    registry_->recordResponse(msg.getStatusCode(), microsecondsSince(start_));
+  }
+  Filter::sendHeaders(msg);
+}
+
+void StatsFilter::requestComplete() noexcept {
+  registry_->recordComplete(microsecondsSince(start_));
+  Filter::requestComplete();
+}
+
+void StatsFilter::onError(ProxygenError err) noexcept {
+  if (!responded_) {
+    registry_->recordError();
+  }
+  Filter::onError(err);
+}
+
+}
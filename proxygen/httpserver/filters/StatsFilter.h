@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/httpserver/Filters.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/filters/StatsRegistry.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * A filter that records each request, the status class of its response,
+ * its time to first byte (up to the final response headers) and its total
+ * time in a StatsRegistry.
+ */
+class StatsFilter : public Filter {
+ public:
+  StatsFilter(RequestHandler* upstream, StatsRegistry* registry);
+
+  void onRequest(std::unique_ptr<HTTPMessage> headers) noexcept override;
+  void requestComplete() noexcept override;
+  void onError(ProxygenError err) noexcept override;
+
+  void sendHeaders(HTTPMessage& msg) noexcept override;
+
+ private:
+  StatsRegistry* const registry_;
+  TimePoint start_;
+  bool responded_{false};
+};
+
+/**
+ * Makes StatsFilters that record in registry, which must outlive the
+ * server
+ */
+class StatsFilterFactory : public RequestHandlerFactory {
+ public:
+  explicit StatsFilterFactory(StatsRegistry* registry): registry_(registry) {
+  }
+
+  void onServerStart() noexcept override {
+  }
+
+  void onServerStop() noexcept override {
+  }
+
+  RequestHandler* onRequest(RequestHandler* h, HTTPMessage*) noexcept override {
+    return new StatsFilter(h, registry_);
+  }
+
+ private:
+  StatsRegistry* const registry_;
+};
+
+}
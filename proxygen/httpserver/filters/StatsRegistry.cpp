@@ -0,0 +1,313 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/filters/StatsRegistry.h>
+
+#include <atomic>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <proxygen/lib/http/session/HTTPSessionStats.h>
+#include <typeindex>
+#include <unordered_map>
+
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+const size_t kCacheLineSize = 64;
+
+// A counter only one thread writes to, that the others may read
+class Counter {
+ public:
+  void add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+class HistogramCounters {
+ public:
+  void addValue(uint64_t value) {
+    buckets_[LatencyHistogram::getBucket(value)].add(1);
+    sum_.add(value);
+  }
+
+  void addTo(LatencyHistogram& histogram) const {
+    for (size_t i = 0; i < LatencyHistogram::kNumBuckets; i++) {
+      uint64_t count = buckets_[i].get();
+      if (count) {
+        histogram.addToBucket(i, count);
+      }
+    }
+    histogram.addToSum(sum_.get());
+  }
+
+ private:
+  Counter buckets_[LatencyHistogram::kNumBuckets];
+  Counter sum_;
+};
+
+}
+
+struct StatsRegistry::ThreadStats {
+  char pad0[kCacheLineSize];
+  Counter requests;
+  Counter errors;
+  Counter statuses[6];
+  Counter transactionsOpened;
+  Counter transactionsClosed;
+  Counter slowReaders;
+  Counter slowReadersReset;
+  HistogramCounters timeToFirstByte;
+  HistogramCounters totalTime;
+  HistogramCounters firstHeaderByte;
+  HistogramCounters firstBodyByte;
+  HistogramCounters ttlba;
+  HistogramCounters transactionDuration;
+  Counter tcpInfoSamples;
+  Counter tcpRetransmits;
+  HistogramCounters tcpRtt;
+  HistogramCounters tcpCwnd;
+  HistogramCounters tcpDeliveryRate;
+  HistogramCounters connectionSetup;
+  // Only written for the sampled requests, so a lock the owner thread
+  // almost never contends on is cheaper than a lock-free map
+  std::mutex handlerCpuMutex;
+  std::unordered_map<std::type_index, Snapshot::HandlerCpu> handlerCpu;
+  char pad1[kCacheLineSize];
+};
+
+class StatsRegistry::SessionStats : public HTTPSessionStats {
+ public:
+  explicit SessionStats(StatsRegistry* registry): registry_(registry) {
+  }
+
+  void recordTransactionOpened() noexcept override {
+    registry_->getLocal().transactionsOpened.add(1);
+  }
+
+  void recordTransactionClosed() noexcept override {
+    registry_->getLocal().transactionsClosed.add(1);
+  }
+
+  void recordTimeToFirstHeaderByte(
+      std::chrono::microseconds latency) noexcept override {
+    registry_->getLocal().firstHeaderByte.addValue(latency.count());
+  }
+
+  void recordTimeToFirstBodyByte(
+      std::chrono::microseconds latency) noexcept override {
+    registry_->getLocal().firstBodyByte.addValue(latency.count());
+  }
+
+  void recordTTLBA(std::chrono::microseconds latency) noexcept override {
+    registry_->getLocal().ttlba.addValue(latency.count());
+  }
+
+  void recordTransactionDuration(
+      std::chrono::microseconds duration) noexcept override {
+    registry_->getLocal().transactionDuration.addValue(duration.count());
+  }
+
+  void recordSlowReader() noexcept override {
+    registry_->getLocal().slowReaders.add(1);
+  }
+
+  void recordSlowReaderReset() noexcept override {
+    registry_->getLocal().slowReadersReset.add(1);
+  }
+
+  void recordTCPInfo(const TCPInfoSample& sample) noexcept override {
+    auto& stats = registry_->getLocal();
+    stats.tcpInfoSamples.add(1);
+    stats.tcpRetransmits.add(sample.newRetransmits);
+    stats.tcpRtt.addValue(sample.rtt.count());
+    stats.tcpCwnd.addValue(sample.cwnd);
+    stats.tcpDeliveryRate.addValue(sample.deliveryRate);
+  }
+
+  void recordConnectionSetup(
+      std::chrono::microseconds duration) noexcept override {
+    registry_->getLocal().connectionSetup.addValue(duration.count());
+  }
+
+  void recordTTLBAExceedLimit() noexcept override {}
+  void recordTTLBAIOBSplitByEom() noexcept override {}
+  void recordTTLBANotFound() noexcept override {}
+  void recordTTLBAReceived() noexcept override {}
+  void recordTTLBATimeout() noexcept override {}
+  void recordTTLBAEomPassed() noexcept override {}
+  void recordTTLBATracked() noexcept override {}
+
+ private:
+  StatsRegistry* const registry_;
+};
+
+void StatsRegistry::Snapshot::exportCounters(
+    std::map<string, int64_t>& counters, const string& prefix) const {
+  counters[prefix + "requests"] = requests;
+  counters[prefix + "errors"] = errors;
+  for (size_t i = 1; i < 6; i++) {
+    counters[folly::to<string>(prefix, "status.", i, "xx")] = statuses[i];
+  }
+  counters[prefix + "transactions_opened"] = transactionsOpened;
+  counters[prefix + "transactions_closed"] = transactionsClosed;
+  counters[prefix + "session.slow_readers"] = slowReaders;
+  counters[prefix + "session.slow_readers_reset"] = slowReadersReset;
+  auto exportHistogram = [&] (const string& name,
+                              const LatencyHistogram& histogram) {
+    counters[prefix + name + ".avg"] = histogram.getMean();
+    counters[prefix + name + ".p50"] = histogram.getPercentile(50);
+    counters[prefix + name + ".p90"] = histogram.getPercentile(90);
+    counters[prefix + name + ".p99"] = histogram.getPercentile(99);
+  };
+  exportHistogram("ttfb_us", timeToFirstByte);
+  exportHistogram("total_us", totalTime);
+  exportHistogram("session.first_header_byte_us", firstHeaderByte);
+  exportHistogram("session.first_body_byte_us", firstBodyByte);
+  exportHistogram("session.ttlba_us", ttlba);
+  exportHistogram("session.transaction_us", transactionDuration);
+  counters[prefix + "session.tcp_info_samples"] = tcpInfoSamples;
+  counters[prefix + "session.tcp_retransmits"] = tcpRetransmits;
+  exportHistogram("session.tcp_rtt_us", tcpRtt);
+  exportHistogram("session.tcp_cwnd", tcpCwnd);
+  exportHistogram("session.tcp_delivery_rate_bps", tcpDeliveryRate);
+  exportHistogram("session.connection_setup_us", connectionSetup);
+  for (const auto& handler: handlerCpu) {
+    auto name = prefix + "handler_cpu." + handler.first;
+    counters[name + ".requests"] = handler.second.requests;
+    counters[name + ".cpu_us"] =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        handler.second.cpuTime).count();
+  }
+  for (const auto& loop: loops) {
+    auto name = "loop." + loop.first;
+    const auto& stats = loop.second;
+    exportHistogram(name + ".iteration_us", stats.iterationTime);
+    exportHistogram(name + ".busy_us", stats.busyTime);
+    counters[prefix + name + ".busy_pct"] = stats.getBusyPercent();
+    counters[prefix + name + ".queue_depth"] = stats.queueDepth;
+    counters[prefix + name + ".max_queue_depth"] = stats.maxQueueDepth;
+    counters[prefix + name + ".slowest_callback_us"] =
+      stats.slowestCallback.count();
+  }
+}
+
+StatsRegistry::StatsRegistry(): sessionStats_(new SessionStats(this)) {
+}
+
+StatsRegistry::~StatsRegistry() {
+}
+
+HTTPSessionStats* StatsRegistry::getSessionStats() const {
+  return sessionStats_.get();
+}
+
+StatsRegistry::ThreadStats& StatsRegistry::getLocal() {
+  auto& local = *local_;
+  if (!local) {
+    local = std::make_shared<ThreadStats>();
+    std::lock_guard<std::mutex> guard(mutex_);
+    threads_.push_back(local);
+  }
+  return *local;
+}
+
+void StatsRegistry::recordRequest() {
+  getLocal().requests.add(1);
+}
+
+void StatsRegistry::recordResponse(uint16_t status,
+                                   std::chrono::microseconds ttfb) {
+  auto& stats = getLocal();
+  if (status >= 100 && status < 600) {
+    stats.statuses[status / 100].add(1);
+  }
+  stats.timeToFirstByte.addValue(ttfb.count());
+}
+
+void StatsRegistry::recordComplete(std::chrono::microseconds total) {
+  getLocal().totalTime.addValue(total.count());
+}
+
+void StatsRegistry::recordError() {
+  getLocal().errors.add(1);
+}
+
+void StatsRegistry::recordHandlerCpu(const std::type_info& handlerType,
+                                     std::chrono::nanoseconds cpuTime,
+                                     uint64_t requests) {
+  auto& stats = getLocal();
+  std::lock_guard<std::mutex> guard(stats.handlerCpuMutex);
+  auto& handler = stats.handlerCpu[std::type_index(handlerType)];
+  handler.requests += requests;
+  handler.cpuTime += cpuTime;
+}
+
+void StatsRegistry::addLoopMonitor(const string& name,
+                                   std::shared_ptr<LoopMonitor> monitor) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  loopMonitors_[name] = std::move(monitor);
+}
+
+StatsRegistry::Snapshot StatsRegistry::getSnapshot() const {
+  std::vector<std::shared_ptr<ThreadStats>> threads;
+  std::map<string, std::shared_ptr<LoopMonitor>> loopMonitors;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    threads = threads_;
+    loopMonitors = loopMonitors_;
+  }
+  Snapshot snapshot;
+  for (const auto& loop: loopMonitors) {
+    snapshot.loops[loop.first] = loop.second->getSnapshot();
+  }
+  for (const auto& stats: threads) {
+    snapshot.requests += stats->requests.get();
+    snapshot.errors += stats->errors.get();
+    for (size_t i = 0; i < 6; i++) {
+      snapshot.statuses[i] += stats->statuses[i].get();
+    }
+    snapshot.transactionsOpened += stats->transactionsOpened.get();
+    snapshot.transactionsClosed += stats->transactionsClosed.get();
+    snapshot.slowReaders += stats->slowReaders.get();
+    snapshot.slowReadersReset += stats->slowReadersReset.get();
+    stats->timeToFirstByte.addTo(snapshot.timeToFirstByte);
+    stats->totalTime.addTo(snapshot.totalTime);
+    stats->firstHeaderByte.addTo(snapshot.firstHeaderByte);
+    stats->firstBodyByte.addTo(snapshot.firstBodyByte);
+    stats->ttlba.addTo(snapshot.ttlba);
+    stats->transactionDuration.addTo(snapshot.transactionDuration);
+    snapshot.tcpInfoSamples += stats->tcpInfoSamples.get();
+    snapshot.tcpRetransmits += stats->tcpRetransmits.get();
+    stats->tcpRtt.addTo(snapshot.tcpRtt);
+    stats->tcpCwnd.addTo(snapshot.tcpCwnd);
+    stats->tcpDeliveryRate.addTo(snapshot.tcpDeliveryRate);
+    stats->connectionSetup.addTo(snapshot.connectionSetup);
+    std::lock_guard<std::mutex> guard(stats->handlerCpuMutex);
+    for (const auto& handler: stats->handlerCpu) {
+      auto& total = snapshot.handlerCpu[
+        folly::demangle(handler.first.name()).toStdString()];
+      total.requests += handler.second.requests;
+      total.cpuTime += handler.second.cpuTime;
+    }
+  }
+  return snapshot;
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <folly/ThreadLocal.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/LatencyHistogram.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace proxygen {
+
+class HTTPSessionStats;
+
+/**
+ * Request counters and latency histograms of a server, see StatsFilter.
+ *
+ * Each thread writes to its own counters, padded away from the ones of
+ * the other threads, with plain relaxed stores: recording takes no lock
+ * and no atomic read-modify-write. getSnapshot() adds the threads up when
+ * it is asked, from any thread. The counters of threads that exited are
+ * kept.
+ */
+class StatsRegistry {
+ public:
+  struct Snapshot {
+    uint64_t requests{0};
+    // requests that failed before their response was sent
+    uint64_t errors{0};
+    // final responses by status class, statuses[2] counts the 2xx ones
+    uint64_t statuses[6];
+    uint64_t transactionsOpened{0};
+    uint64_t transactionsClosed{0};
+    // sessions that drained too slowly, and the ones reset for it
+    uint64_t slowReaders{0};
+    uint64_t slowReadersReset{0};
+    // microseconds from the request headers to the response headers
+    LatencyHistogram timeToFirstByte;
+    // microseconds from the request headers to the end of the response
+    LatencyHistogram totalTime;
+    // microseconds the sessions measured, see HTTPSessionStats: from the
+    // first request byte to the first response header byte, the first
+    // response body byte and the ack of the last one, and how long each
+    // transaction lived
+    LatencyHistogram firstHeaderByte;
+    LatencyHistogram firstBodyByte;
+    LatencyHistogram ttlba;
+    LatencyHistogram transactionDuration;
+    // the TCP_INFO samples of the sessions, and the retransmissions they
+    // saw since the previous sample of their session, see
+    // HTTPServerOptions::tcpInfoSampleInterval; the RTT in microseconds,
+    // the congestion window in segments and the delivery rate in bytes/s
+    uint64_t tcpInfoSamples{0};
+    uint64_t tcpRetransmits{0};
+    LatencyHistogram tcpRtt;
+    LatencyHistogram tcpCwnd;
+    LatencyHistogram tcpDeliveryRate;
+    // microseconds the acceptors took to set up and start the session of
+    // each connection
+    LatencyHistogram connectionSetup;
+
+    struct HandlerCpu {
+      // requests measured, see HTTPServerOptions::handlerCpuStats
+      uint64_t requests{0};
+      std::chrono::nanoseconds cpuTime{0};
+    };
+    // by demangled handler type name
+    std::map<std::string, HandlerCpu> handlerCpu;
+
+    // by the name of the loop, see addLoopMonitor()
+    std::map<std::string, LoopMonitor::Snapshot> loops;
+
+    Snapshot() {
+      std::fill(statuses, statuses + 6, 0);
+    }
+
+    /**
+     * Add the counters and the mean, p50, p90 and p99 of the histograms to
+     * counters, named with prefix
+     */
+    void exportCounters(std::map<std::string, int64_t>& counters,
+                        const std::string& prefix) const;
+  };
+
+  StatsRegistry();
+  ~StatsRegistry();
+
+  // Called on the thread that handles the request
+  void recordRequest();
+  void recordResponse(uint16_t status, std::chrono::microseconds ttfb);
+  void recordComplete(std::chrono::microseconds total);
+  void recordError();
+  void recordHandlerCpu(const std::type_info& handlerType,
+                        std::chrono::nanoseconds cpuTime,
+                        uint64_t requests);
+
+  /**
+   * Add the stats of monitor to the snapshots, as name. The registry
+   * keeps a reference, the monitor may be stopped.
+   */
+  void addLoopMonitor(const std::string& name,
+                      std::shared_ptr<LoopMonitor> monitor);
+
+  Snapshot getSnapshot() const;
+
+  /**
+   * @return the session stats that count transactions in this registry,
+   *         for HTTPServerOptions::sessionStats
+   */
+  HTTPSessionStats* getSessionStats() const;
+
+ private:
+  struct ThreadStats;
+  class SessionStats;
+
+  ThreadStats& getLocal();
+
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadStats>> threads_;
+  folly::ThreadLocal<std::shared_ptr<ThreadStats>> local_;
+  std::map<std::string, std::shared_ptr<LoopMonitor>> loopMonitors_;
+  std::unique_ptr<SessionStats> sessionStats_;
+};
+
+}
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <folly/Memory.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <proxygen/httpserver/samples/loadgen/LoadGenerator.h>
+#include <proxygen/httpserver/samples/loadgen/RequestCorpus.h>
+#include <thread>
+#include <vector>
+
+using namespace LoadGen;
+using namespace proxygen;
+
+using folly::EventBase;
+using folly::SocketAddress;
+
+DEFINE_string(host, "localhost", "Server to load");
+DEFINE_int32(port, 11000, "Port of the server");
+DEFINE_string(protocol, "", "Protocol of the connections: empty for "
+              "HTTP/1.1, else spdy/3, spdy/3.1 or h2c");
+DEFINE_int32(threads, 1, "Threads, each with its own EventBase and "
+             "connections");
+DEFINE_int32(connections, 16, "Connections per thread");
+DEFINE_int32(depth, 1, "Requests outstanding per connection. HTTP/1.1 "
+             "connections take one at a time, so the depth multiplies "
+             "their number instead");
+DEFINE_double(rate, 0, "Requests per second over all the threads, at a "
+              "constant arrival rate (open loop). 0 sends the next request "
+              "as soon as one completes (closed loop)");
+DEFINE_int64(expected_interval_us, 0, "In closed loop, the time between "
+             "the requests of a connection when the server keeps up, to "
+             "correct the latencies for the requests held back by stalls");
+DEFINE_int32(duration_s, 10, "Length of the run");
+DEFINE_string(corpus, "", "File of the requests to replay, as HTTP/1.x "
+              "request heads separated by empty lines");
+DEFINE_string(har, "", "HTTP Archive to replay page by page, each "
+              "connection loading one page at a time with the concurrency "
+              "it had in the archive. --rate is then in pages per second");
+DEFINE_string(url, "/", "Without a corpus, the request to send");
+DEFINE_int32(connect_timeout_ms, 1000, "Connect timeout");
+DEFINE_int32(transaction_timeout_ms, 5000, "Idle timeout of the requests");
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  std::unique_ptr<RequestCorpus> corpus;
+  if (!FLAGS_har.empty()) {
+    corpus = RequestCorpus::fromHAR(FLAGS_har);
+    if (!corpus) {
+      return 1;
+    }
+  } else if (!FLAGS_corpus.empty()) {
+    corpus = RequestCorpus::fromFile(FLAGS_corpus);
+    if (!corpus) {
+      return 1;
+    }
+  } else {
+    HTTPMessage request;
+    request.setMethod(HTTPMethod::GET);
+    request.setURL(FLAGS_url);
+    request.setHTTPVersion(1, 1);
+    request.getHeaders().set(HTTP_HEADER_HOST, FLAGS_host);
+    corpus = folly::make_unique<RequestCorpus>();
+    corpus->add(request);
+  }
+
+  CHECK_GT(FLAGS_threads, 0);
+  LoadGenerator::Options options;
+  options.address = SocketAddress(FLAGS_host, FLAGS_port, true);
+  options.protocol = FLAGS_protocol;
+  options.connections = FLAGS_connections;
+  options.depth = std::max(FLAGS_depth, 1);
+  if (FLAGS_protocol.empty() || FLAGS_protocol == "http/1.1") {
+    // an HTTPUpstreamSession sends one request at a time over HTTP/1.1
+    options.connections *= options.depth;
+    options.depth = 1;
+  }
+  options.rate = FLAGS_rate / FLAGS_threads;
+  options.expectedInterval =
+    std::chrono::microseconds(FLAGS_expected_interval_us);
+  options.duration = std::chrono::seconds(FLAGS_duration_s);
+  options.connectTimeout =
+    std::chrono::milliseconds(FLAGS_connect_timeout_ms);
+  options.transactionTimeout =
+    std::chrono::milliseconds(FLAGS_transaction_timeout_ms);
+
+  std::vector<LoadGenerator::Results> results(FLAGS_threads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < FLAGS_threads; i++) {
+    threads.emplace_back([&, i] {
+      EventBase eventBase;
+      LoadGenerator generator(&eventBase, options, *corpus,
+                              i * corpus->size() / FLAGS_threads);
+      generator.run();
+      results[i] = generator.getResults();
+    });
+  }
+  LoadGenerator::Results total;
+  for (int i = 0; i < FLAGS_threads; i++) {
+    threads[i].join();
+    total.merge(results[i]);
+  }
+
+  auto printLatency = [] (const char* name,
+                          const proxygen::LatencyHistogram& latency) {
+    std::cout << name << " mean " << latency.getMean()
+              << ", p50 " << latency.getPercentile(50)
+              << ", p90 " << latency.getPercentile(90)
+              << ", p99 " << latency.getPercentile(99)
+              << ", p99.9 " << latency.getPercentile(99.9)
+              << ", max " << latency.getPercentile(100) << "\n";
+  };
+  std::cout << "requests:       " << total.completed << " ("
+            << total.completed / std::max(FLAGS_duration_s, 1) << "/s)\n"
+            << "errors:         " << total.errors << "\n"
+            << "connect errors: " << total.connectErrors << "\n"
+            << "body bytes:     " << total.bodyBytes << "\n";
+  if (FLAGS_rate > 0) {
+    std::cout << "backlog:        " << total.backlog << "\n";
+  }
+  printLatency("latency (us):  ", total.latency);
+  if (corpus->getNumPages() > 0) {
+    std::cout << "pages:          " << total.pages << "\n";
+    printLatency("page (us):     ", total.pageLatency);
+  }
+  std::cout.flush();
+  return 0;
+}
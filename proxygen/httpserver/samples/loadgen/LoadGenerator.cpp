@@ -0,0 +1,414 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/samples/loadgen/LoadGenerator.h>
+
+#include <folly/Conv.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+
+using apache::thrift::transport::TTransportException;
+using folly::EventBase;
+using folly::IOBuf;
+using proxygen::AsyncTimeoutSet;
+using proxygen::ClockType;
+using proxygen::HTTPConnector;
+using proxygen::HTTPException;
+using proxygen::HTTPHeaders;
+using proxygen::HTTPMessage;
+using proxygen::HTTPSession;
+using proxygen::HTTPTransaction;
+using proxygen::HTTPTransactionHandler;
+using proxygen::HTTPUpstreamSession;
+using proxygen::ProxygenError;
+using proxygen::TimePoint;
+using proxygen::UpgradeProtocol;
+using proxygen::getCurrentTime;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::unique_ptr;
+
+namespace LoadGen {
+
+namespace {
+
+// after a failed connect, or once a session closed
+const milliseconds kReconnectDelay(100);
+
+}
+
+/**
+ * One connection of the generator, connected again when it closes until
+ * the generator stops
+ */
+class LoadGenerator::Connection : private HTTPConnector::Callback,
+                                  private HTTPSession::InfoCallback {
+ public:
+  explicit Connection(LoadGenerator* generator)
+      : generator_(generator),
+        connector_(this, generator->transactionTimeouts_.get(),
+                   generator->options_.protocol),
+        reconnectTimeout_(generator->eventBase_, [this] { connect(); }) {}
+
+  ~Connection() {
+    close();
+  }
+
+  void connect() {
+    connector_.reset();
+    connector_.connect(generator_->eventBase_, generator_->options_.address,
+                       generator_->options_.connectTimeout);
+  }
+
+  void close() {
+    reconnectTimeout_.cancelTimeout();
+    connector_.reset();
+    if (session_) {
+      auto session = session_;
+      session_ = nullptr;
+      session->setInfoCallback(nullptr);
+      session->dropConnection();
+    }
+  }
+
+  bool canSend(uint32_t limit) const {
+    return session_ && outstanding < limit &&
+      session_->supportsMoreTransactions() && !session_->isDraining();
+  }
+
+  HTTPUpstreamSession* getSession() const {
+    return session_;
+  }
+
+  uint32_t outstanding{0};
+
+  // the page being loaded: its next request and the end of its requests,
+  // and when it was due
+  bool inPage{false};
+  size_t pageNext{0};
+  size_t pageEnd{0};
+  uint32_t pageConcurrency{1};
+  TimePoint pageDue;
+
+ private:
+  void reconnectLater() {
+    if (!generator_->stopping_) {
+      reconnectTimeout_.scheduleTimeout(kReconnectDelay);
+    }
+  }
+
+  // HTTPConnector::Callback
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    session_ = session;
+    session->setInfoCallback(this);
+    generator_->onConnectionReady();
+  }
+
+  void connectError(const TTransportException& ex) override {
+    VLOG(2) << "Connect to " << generator_->options_.address.describe()
+            << " failed: " << ex.what();
+    generator_->onConnectError();
+    reconnectLater();
+  }
+
+  // HTTPSession::InfoCallback
+  void onCreate(const HTTPSession&) override {}
+  void onIngressError(const HTTPSession&, ProxygenError) override {}
+  void onRead(const HTTPSession&, size_t) override {}
+  void onWrite(const HTTPSession&, size_t) override {}
+  void onRequestBegin(const HTTPSession&) override {}
+  void onRequestEnd(const HTTPSession&, uint32_t) override {}
+  void onActivateConnection(const HTTPSession&) override {}
+  void onDeactivateConnection(const HTTPSession&) override {}
+  void onDestroy(const HTTPSession&) override {
+    session_ = nullptr;
+    reconnectLater();
+  }
+  void onIngressMessage(const HTTPSession&, const HTTPMessage&) override {}
+  void onIngressLimitExceeded(const HTTPSession&) override {}
+  void onIngressPaused(const HTTPSession&) override {}
+  void onTransactionDetached(const HTTPSession&) override {}
+  void onPingReply(int64_t) override {}
+  void onSettingsOutgoingStreamsFull(const HTTPSession&) override {}
+  void onSettingsOutgoingStreamsNotFull(const HTTPSession&) override {
+    generator_->onConnectionReady();
+  }
+
+  LoadGenerator* generator_;
+  HTTPConnector connector_;
+  Timeout reconnectTimeout_;
+  HTTPUpstreamSession* session_{nullptr};
+};
+
+/**
+ * Handler of one request, deletes itself once detached
+ */
+class LoadGenerator::Transaction : public HTTPTransactionHandler {
+ public:
+  Transaction(LoadGenerator* generator, Connection* connection,
+              TimePoint due)
+      : generator_(generator),
+        connection_(connection),
+        due_(due) {}
+
+  void setTransaction(HTTPTransaction* txn) noexcept override {}
+
+  void detachTransaction() noexcept override {
+    generator_->onTransactionDone(connection_, due_, complete_ && !failed_,
+                                  bodyBytes_);
+    delete this;
+  }
+
+  void onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept override {
+    failed_ = msg->getStatusCode() >= 500;
+  }
+
+  void onBody(unique_ptr<IOBuf> chain) noexcept override {
+    bodyBytes_ += chain->computeChainDataLength();
+  }
+
+  void onTrailers(unique_ptr<HTTPHeaders> trailers) noexcept override {}
+
+  void onEOM() noexcept override {
+    complete_ = true;
+  }
+
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {}
+
+  void onError(const HTTPException& error) noexcept override {
+    VLOG(3) << "Request failed: " << error.what();
+    failed_ = true;
+  }
+
+  void onEgressPaused() noexcept override {}
+
+  void onEgressResumed() noexcept override {}
+
+ private:
+  LoadGenerator* generator_;
+  Connection* connection_;
+  TimePoint due_;
+  uint64_t bodyBytes_{0};
+  bool complete_{false};
+  bool failed_{false};
+};
+
+void LoadGenerator::Results::merge(const Results& other) {
+  latency.merge(other.latency);
+  pageLatency.merge(other.pageLatency);
+  pages += other.pages;
+  completed += other.completed;
+  errors += other.errors;
+  connectErrors += other.connectErrors;
+  bodyBytes += other.bodyBytes;
+  backlog += other.backlog;
+}
+
+LoadGenerator::LoadGenerator(EventBase* eventBase, const Options& options,
+                             const RequestCorpus& corpus,
+                             size_t corpusOffset)
+    : eventBase_(eventBase),
+      options_(options),
+      corpus_(corpus),
+      nextRequest_(corpusOffset),
+      nextPage_(corpus.getNumPages() ?
+                corpusOffset * corpus.getNumPages() / corpus.size() : 0),
+      transactionTimeouts_(new AsyncTimeoutSet(eventBase,
+                                               options.transactionTimeout)),
+      arrivalTimeout_(eventBase, [this] { onArrivals(); }),
+      stopTimeout_(eventBase, [this] { stop(); }) {
+  CHECK_GT(corpus.size(), 0);
+  CHECK_GT(options.depth, 0);
+}
+
+LoadGenerator::~LoadGenerator() {
+  cancelLoopCallback();
+  // before the timeouts their sessions use
+  connections_.clear();
+}
+
+void LoadGenerator::run() {
+  start_ = getCurrentTime();
+  for (uint32_t i = 0; i < options_.connections; i++) {
+    connections_.emplace_back(new Connection(this));
+    connections_.back()->connect();
+  }
+  if (options_.rate > 0) {
+    onArrivals();
+  }
+  stopTimeout_.scheduleTimeout(options_.duration);
+  eventBase_->loop();
+}
+
+void LoadGenerator::onArrivals() {
+  // the arrival n is due n / rate seconds after the start
+  auto dueTime = [this] (uint64_t n) {
+    return start_ + std::chrono::duration_cast<ClockType::duration>(
+      std::chrono::duration<double>(n / options_.rate));
+  };
+  TimePoint now = getCurrentTime();
+  while (dueTime(arrivals_) <= now) {
+    pending_.push_back(dueTime(arrivals_));
+    arrivals_++;
+  }
+  dispatch();
+  // the timeout may fire up to a millisecond late, the latencies still
+  // count from when the requests were due
+  arrivalTimeout_.scheduleTimeout(
+    std::chrono::duration_cast<milliseconds>(dueTime(arrivals_) - now) +
+    milliseconds(1));
+}
+
+bool LoadGenerator::peekDue(TimePoint& due) {
+  if (options_.rate <= 0) {
+    due = getCurrentTime();
+    return true;
+  }
+  if (pending_.empty()) {
+    return false;
+  }
+  due = pending_.front();
+  return true;
+}
+
+void LoadGenerator::popDue() {
+  if (options_.rate > 0) {
+    pending_.pop_front();
+  }
+}
+
+void LoadGenerator::dispatch() {
+  if (stopping_) {
+    return;
+  }
+  TimePoint due;
+  for (auto& connection : connections_) {
+    if (corpus_.getNumPages() > 0) {
+      dispatchPage(connection.get());
+      continue;
+    }
+    while (connection->canSend(options_.depth) && peekDue(due)) {
+      if (!send(connection.get(), nextRequest_, due)) {
+        break;
+      }
+      nextRequest_++;
+      popDue();
+    }
+  }
+}
+
+void LoadGenerator::dispatchPage(Connection* connection) {
+  TimePoint due;
+  if (!connection->inPage) {
+    if (!connection->canSend(1) || !peekDue(due)) {
+      return;
+    }
+    popDue();
+    const auto& page = corpus_.getPage(nextPage_++);
+    connection->inPage = true;
+    connection->pageNext = page.first;
+    connection->pageEnd = page.first + page.count;
+    connection->pageConcurrency = page.concurrency;
+    connection->pageDue = due;
+  }
+  // the latency of the requests of a page counts from when they are sent,
+  // waiting for their turn in the page is part of the page's
+  while (connection->pageNext < connection->pageEnd &&
+         connection->canSend(connection->pageConcurrency)) {
+    if (!send(connection, connection->pageNext, getCurrentTime())) {
+      break;
+    }
+    connection->pageNext++;
+  }
+}
+
+bool LoadGenerator::send(Connection* connection, size_t request,
+                         TimePoint due) {
+  auto handler = new Transaction(this, connection, due);
+  auto txn = connection->getSession()->newTransaction(handler);
+  if (!txn) {
+    delete handler;
+    return false;
+  }
+  connection->outstanding++;
+  size_t bodySize = corpus_.getBodySize(request);
+  if (bodySize == 0) {
+    txn->sendHeaders(corpus_.get(request));
+  } else {
+    HTTPMessage msg(corpus_.get(request));
+    msg.getHeaders().set(proxygen::HTTP_HEADER_CONTENT_LENGTH,
+                         folly::to<std::string>(bodySize));
+    txn->sendHeaders(msg);
+    txn->sendBody(IOBuf::copyBuffer(std::string(bodySize, 'a')));
+  }
+  txn->sendEOM();
+  return true;
+}
+
+void LoadGenerator::onTransactionDone(Connection* connection, TimePoint due,
+                                      bool succeeded, uint64_t bodyBytes) {
+  connection->outstanding--;
+  if (stopping_) {
+    // cut short by the end of the run
+    return;
+  }
+  if (succeeded) {
+    recordLatency(results_.latency, due);
+    results_.completed++;
+    results_.bodyBytes += bodyBytes;
+  } else {
+    results_.errors++;
+  }
+  if (connection->inPage && connection->pageNext == connection->pageEnd &&
+      connection->outstanding == 0) {
+    connection->inPage = false;
+    recordLatency(results_.pageLatency, connection->pageDue);
+    results_.pages++;
+  }
+  onConnectionReady();
+}
+
+void LoadGenerator::recordLatency(proxygen::LatencyHistogram& histogram,
+                                  TimePoint due) {
+  uint64_t latency = std::chrono::duration_cast<microseconds>(
+    getCurrentTime() - due).count();
+  if (options_.rate > 0) {
+    histogram.addValue(latency);
+  } else {
+    histogram.addCorrectedValue(latency, options_.expectedInterval.count());
+  }
+}
+
+void LoadGenerator::onConnectionReady() {
+  if (!stopping_ && !isLoopCallbackScheduled()) {
+    eventBase_->runInLoop(this);
+  }
+}
+
+void LoadGenerator::onConnectError() {
+  results_.connectErrors++;
+}
+
+void LoadGenerator::stop() {
+  stopping_ = true;
+  results_.backlog = pending_.size();
+  pending_.clear();
+  arrivalTimeout_.cancelTimeout();
+  cancelLoopCallback();
+  for (auto& connection : connections_) {
+    connection->close();
+  }
+}
+
+void LoadGenerator::runLoopCallback() noexcept {
+  dispatch();
+}
+
+}
@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <memory>
+#include <proxygen/httpserver/samples/loadgen/RequestCorpus.h>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/session/HTTPSession.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+#include <proxygen/lib/utils/LatencyHistogram.h>
+#include <proxygen/lib/utils/Time.h>
+#include <vector>
+
+namespace LoadGen {
+
+/**
+ * Sends the requests of a corpus to a server over HTTPUpstreamSessions
+ * from the thread of one EventBase, and measures their latency.
+ *
+ * In closed loop, each connection keeps depth requests outstanding and
+ * sends the next as soon as a response completes. Such a client sends
+ * less while the server stalls, and only measures the requests it did
+ * send; with an expectedInterval, the latencies of the requests it held
+ * back are added, see LatencyHistogram::addCorrectedValue().
+ *
+ * In open loop, requests arrive at a constant rate whatever the server
+ * does, and wait for a connection that can take them. Their latency runs
+ * from when they were due, not from when they were sent, so the time they
+ * waited for the server to catch up is counted too.
+ *
+ * With a corpus of pages, each connection loads pages, one after the
+ * other, like a browser would: the requests of a page go out with at
+ * most the concurrency of the page outstanding, and the page is complete
+ * once they all are. Its latency is measured as well, from when it was
+ * due, and in open loop the arrivals are pages.
+ *
+ * Serial sessions, the HTTP/1.x ones, take one request at a time whatever
+ * the depth or the concurrency of the pages.
+ */
+class LoadGenerator : private folly::EventBase::LoopCallback {
+ public:
+  struct Options {
+    folly::SocketAddress address;
+    // "" for HTTP/1.1, else a SPDY version or h2c, see HTTPConnector
+    std::string protocol;
+    uint32_t connections{1};
+    // the requests outstanding on each parallel session, unless the
+    // corpus has pages
+    uint32_t depth{1};
+    // requests per second in open loop, 0 for closed loop
+    double rate{0};
+    // see the class comment, only for closed loop; the arrivals are pages
+    // if the corpus has some
+    std::chrono::microseconds expectedInterval{0};
+    std::chrono::milliseconds duration{10000};
+    std::chrono::milliseconds connectTimeout{1000};
+    std::chrono::milliseconds transactionTimeout{5000};
+  };
+
+  struct Results {
+    // in microseconds
+    proxygen::LatencyHistogram latency;
+    uint64_t completed{0};
+    // the requests that failed, or got a 5xx response
+    uint64_t errors{0};
+    uint64_t connectErrors{0};
+    uint64_t bodyBytes{0};
+    // in open loop, the arrivals waiting for a connection at the end
+    uint64_t backlog{0};
+    // with pages, in microseconds too
+    proxygen::LatencyHistogram pageLatency;
+    uint64_t pages{0};
+
+    void merge(const Results& other);
+  };
+
+  /**
+   * @param corpusOffset the first request of the corpus to send, so that
+   *                     the generators of several threads don't all send
+   *                     the same requests at once
+   */
+  LoadGenerator(folly::EventBase* eventBase, const Options& options,
+                const RequestCorpus& corpus, size_t corpusOffset = 0);
+  ~LoadGenerator();
+
+  /**
+   * Connect, and send requests for the duration of the options, looping
+   * the EventBase until the connections are closed
+   */
+  void run();
+
+  const Results& getResults() const {
+    return results_;
+  }
+
+ private:
+  class Timeout : public folly::AsyncTimeout {
+   public:
+    Timeout(folly::EventBase* eventBase, std::function<void()> callback)
+        : folly::AsyncTimeout(eventBase),
+          callback_(std::move(callback)) {}
+
+    void timeoutExpired() noexcept override {
+      callback_();
+    }
+
+   private:
+    std::function<void()> callback_;
+  };
+
+  class Connection;
+  class Transaction;
+
+  void onArrivals();
+  void dispatch();
+  // the due time of the next request, or page, to send, if there is one
+  bool peekDue(proxygen::TimePoint& due);
+  void popDue();
+  void dispatchPage(Connection* connection);
+  bool send(Connection* connection, size_t request, proxygen::TimePoint due);
+  void onTransactionDone(Connection* connection, proxygen::TimePoint due,
+                         bool succeeded, uint64_t bodyBytes);
+  void recordLatency(proxygen::LatencyHistogram& histogram,
+                     proxygen::TimePoint due);
+  void onConnectionReady();
+  void onConnectError();
+  void stop();
+
+  // EventBase::LoopCallback, dispatches outside of the session callbacks
+  void runLoopCallback() noexcept override;
+
+  folly::EventBase* eventBase_;
+  const Options options_;
+  const RequestCorpus& corpus_;
+  size_t nextRequest_;
+  size_t nextPage_;
+  proxygen::AsyncTimeoutSet::UniquePtr transactionTimeouts_;
+  std::vector<std::unique_ptr<Connection>> connections_;
+  Timeout arrivalTimeout_;
+  Timeout stopTimeout_;
+  proxygen::TimePoint start_;
+  // open loop: the arrivals so far, and those not sent yet
+  uint64_t arrivals_{0};
+  std::deque<proxygen::TimePoint> pending_;
+  Results results_;
+  bool stopping_{false};
+};
+
+}
@@ -0,0 +1,330 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/httpserver/samples/loadgen/RequestCorpus.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <folly/Memory.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <fstream>
+#include <glog/logging.h>
+#include <map>
+#include <proxygen/lib/utils/ParseURL.h>
+#include <sstream>
+#include <strings.h>
+
+using folly::StringPiece;
+using proxygen::HTTPMessage;
+using proxygen::ParseURL;
+
+namespace LoadGen {
+
+namespace {
+
+StringPiece nextLine(StringPiece& contents) {
+  size_t end = contents.find('\n');
+  StringPiece line = contents;
+  if (end == StringPiece::npos) {
+    contents.clear();
+  } else {
+    line = contents.subpiece(0, end);
+    contents.advance(end + 1);
+  }
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+  return line;
+}
+
+StringPiece trim(StringPiece s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.pop_front();
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.pop_back();
+  }
+  return s;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Can't open " << path;
+    return false;
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  contents = stream.str();
+  return true;
+}
+
+const folly::dynamic* getField(const folly::dynamic& obj, const char* key) {
+  if (!obj.isObject()) {
+    return nullptr;
+  }
+  auto it = obj.find(key);
+  return it == obj.items().end() ? nullptr : &it->second;
+}
+
+size_t getLength(const folly::dynamic* array) {
+  return array && array->isArray() ? array->size() : 0;
+}
+
+std::string getString(const folly::dynamic& obj, const char* key,
+                      const char* defaultValue = "") {
+  auto field = getField(obj, key);
+  return field && field->isString() ? field->asString().toStdString() :
+    defaultValue;
+}
+
+double getNumber(const folly::dynamic& obj, const char* key,
+                 double defaultValue) {
+  auto field = getField(obj, key);
+  return field && field->isNumber() ? field->asDouble() : defaultValue;
+}
+
+// what browsers open to a host, for the pages without timings
+const uint32_t kDefaultPageConcurrency = 6;
+
+// the headers the sessions set themselves, or that only make sense on the
+// recorded hop
+const char* const kSkippedHeaders[] = {
+  "connection",
+  "content-length",
+  "keep-alive",
+  "proxy-connection",
+  "te",
+  "transfer-encoding",
+  "upgrade",
+};
+
+bool isSkippedHeader(const std::string& name) {
+  for (const char* skipped : kSkippedHeaders) {
+    if (strcasecmp(name.c_str(), skipped) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @return the milliseconds of an ISO 8601 time since the epoch, ignoring
+ *         the time zone that the entries of a recording share, or -1
+ */
+double parseTime(const std::string& time) {
+  int year, month, day, hour, minute;
+  double second;
+  if (sscanf(time.c_str(), "%d-%d-%dT%d:%d:%lf", &year, &month, &day,
+             &hour, &minute, &second) != 6) {
+    return -1;
+  }
+  // days since 1970-01-01 of the proleptic Gregorian calendar
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  int yearOfEra = year - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 +
+    dayOfYear;
+  int64_t days = int64_t(era) * 146097 + dayOfEra - 719468;
+  return ((days * 24 + hour) * 60 + minute) * 60000.0 + second * 1000;
+}
+
+/**
+ * @return the most of the entries, (start, duration) in milliseconds, in
+ *         flight at once
+ */
+uint32_t getMaxConcurrency(
+    const std::vector<std::pair<double, double>>& entries) {
+  // +1 at the starts, -1 at the ends, the ends first on ties
+  std::vector<std::pair<double, int>> events;
+  for (const auto& entry : entries) {
+    events.emplace_back(entry.first, 1);
+    events.emplace_back(entry.first + entry.second, -1);
+  }
+  std::sort(events.begin(), events.end());
+  int inFlight = 0;
+  int most = 1;
+  for (const auto& event : events) {
+    inFlight += event.second;
+    most = std::max(most, inFlight);
+  }
+  return most;
+}
+
+}
+
+void RequestCorpus::endPage(uint32_t concurrency) {
+  size_t first = pages_.empty() ? 0 :
+    pages_.back().first + pages_.back().count;
+  if (first < requests_.size()) {
+    pages_.push_back(Page{first, requests_.size() - first,
+                          std::max(concurrency, uint32_t(1))});
+  }
+}
+
+std::unique_ptr<RequestCorpus> RequestCorpus::parse(StringPiece contents) {
+  auto corpus = folly::make_unique<RequestCorpus>();
+  std::unique_ptr<HTTPMessage> request;
+  size_t lineNumber = 0;
+  while (!contents.empty()) {
+    StringPiece line = nextLine(contents);
+    lineNumber++;
+    if (line.empty()) {
+      if (request) {
+        corpus->add(*request);
+        request.reset();
+      }
+      continue;
+    }
+    if (!request) {
+      // METHOD URL [VERSION]
+      size_t space = line.find(' ');
+      if (space == StringPiece::npos || space == 0) {
+        LOG(ERROR) << "Malformed request line " << lineNumber << ": "
+                   << line;
+        return nullptr;
+      }
+      StringPiece url = line.subpiece(space + 1);
+      url = url.subpiece(0, url.find(' '));
+      request = folly::make_unique<HTTPMessage>();
+      request->setMethod(line.subpiece(0, space));
+      request->setURL(url.str());
+      request->setHTTPVersion(1, 1);
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (colon == StringPiece::npos || colon == 0) {
+      LOG(ERROR) << "Malformed header line " << lineNumber << ": " << line;
+      return nullptr;
+    }
+    request->getHeaders().add(line.subpiece(0, colon).str(),
+                              trim(line.subpiece(colon + 1)).str());
+  }
+  if (request) {
+    corpus->add(*request);
+  }
+  if (corpus->size() == 0) {
+    LOG(ERROR) << "No request in the corpus";
+    return nullptr;
+  }
+  return corpus;
+}
+
+std::unique_ptr<RequestCorpus> RequestCorpus::fromFile(
+    const std::string& path) {
+  std::string contents;
+  if (!readFile(path, contents)) {
+    return nullptr;
+  }
+  return parse(contents);
+}
+
+std::unique_ptr<RequestCorpus> RequestCorpus::fromHAR(
+    const std::string& path) {
+  std::string contents;
+  if (!readFile(path, contents)) {
+    return nullptr;
+  }
+  folly::dynamic har = nullptr;
+  try {
+    har = folly::parseJson(contents);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Can't parse the HAR " << path << ": " << ex.what();
+    return nullptr;
+  }
+  const folly::dynamic* log = getField(har, "log");
+  if (!log) {
+    LOG(ERROR) << "No log in the HAR " << path;
+    return nullptr;
+  }
+
+  // the entries of each page, the pages in the order of the log, and then
+  // those of the entries without one, if any
+  std::vector<std::string> pageIds;
+  const folly::dynamic* pages = getField(*log, "pages");
+  for (size_t i = 0; i < getLength(pages); i++) {
+    pageIds.push_back(getString((*pages)[i], "id"));
+  }
+  std::map<std::string, std::vector<size_t>> pageEntries;
+  const folly::dynamic* entries = getField(*log, "entries");
+  for (size_t i = 0; i < getLength(entries); i++) {
+    std::string pageref = getString((*entries)[i], "pageref");
+    auto& page = pageEntries[pageref];
+    if (page.empty() &&
+        std::find(pageIds.begin(), pageIds.end(), pageref) == pageIds.end()) {
+      pageIds.push_back(pageref);
+    }
+    page.push_back(i);
+  }
+
+  auto corpus = folly::make_unique<RequestCorpus>();
+  for (const auto& pageId : pageIds) {
+    std::vector<std::pair<double, double>> timings;
+    bool timed = true;
+    for (size_t i : pageEntries[pageId]) {
+      const folly::dynamic& entry = (*entries)[i];
+      const folly::dynamic* request = getField(entry, "request");
+      std::string url = request ? getString(*request, "url") : "";
+      ParseURL parsed(url);
+      if (!parsed.valid()) {
+        LOG(ERROR) << "Skipping the invalid URL " << url;
+        continue;
+      }
+      HTTPMessage msg;
+      msg.setMethod(getString(*request, "method", "GET"));
+      std::string target = parsed.path().str();
+      if (target.empty()) {
+        target = "/";
+      }
+      if (!parsed.query().empty()) {
+        target += "?" + parsed.query().str();
+      }
+      msg.setURL(target);
+      msg.setHTTPVersion(1, 1);
+      auto& headers = msg.getHeaders();
+      const folly::dynamic* fields = getField(*request, "headers");
+      for (size_t h = 0; h < getLength(fields); h++) {
+        std::string name = getString((*fields)[h], "name");
+        std::string value = getString((*fields)[h], "value");
+        if (name.empty() || isSkippedHeader(name)) {
+          continue;
+        }
+        if (name == ":authority" || strcasecmp(name.c_str(), "host") == 0) {
+          headers.set(proxygen::HTTP_HEADER_HOST, value);
+        } else if (name[0] != ':') {
+          headers.add(name, value);
+        }
+      }
+      if (!headers.exists(proxygen::HTTP_HEADER_HOST) && parsed.hasHost()) {
+        headers.set(proxygen::HTTP_HEADER_HOST, parsed.hostAndPort());
+      }
+      double bodySize = getNumber(*request, "bodySize", -1);
+      if (bodySize < 0) {
+        const folly::dynamic* postData = getField(*request, "postData");
+        bodySize = postData ? getString(*postData, "text").size() : 0;
+      }
+      corpus->add(msg, size_t(bodySize));
+
+      double start = parseTime(getString(entry, "startedDateTime"));
+      timed = timed && start >= 0;
+      timings.emplace_back(start, getNumber(entry, "time", 0));
+    }
+    corpus->endPage(timed ? getMaxConcurrency(timings) :
+                    kDefaultPageConcurrency);
+  }
+  if (corpus->size() == 0) {
+    LOG(ERROR) << "No request in the HAR " << path;
+    return nullptr;
+  }
+  return corpus;
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <memory>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <string>
+#include <vector>
+
+namespace LoadGen {
+
+/**
+ * The requests a load generator sends, in turn. A corpus file holds
+ * request heads as they go on an HTTP/1.x connection, eg. as captured from
+ * real clients: a request line and header lines each, ended by an empty
+ * line. The version of the request lines is ignored, the protocol of the
+ * sessions is used.
+ *
+ * A corpus can also come from a HAR file, as browsers record page loads.
+ * Its requests then have the recorded body sizes, and are grouped in
+ * pages, each with the most requests its recording had in flight at once,
+ * so that a load generator can replay page loads instead of independent
+ * requests.
+ */
+class RequestCorpus {
+ public:
+  struct Page {
+    // the requests first to first + count - 1
+    size_t first;
+    size_t count;
+    uint32_t concurrency;
+  };
+
+  /**
+   * @return the corpus in contents, or nullptr if a request is malformed
+   *         or there is none
+   */
+  static std::unique_ptr<RequestCorpus> parse(folly::StringPiece contents);
+
+  static std::unique_ptr<RequestCorpus> fromFile(const std::string& path);
+
+  /**
+   * The entries of the HAR file at path, the pages in the order of the
+   * log. Pseudo headers become a Host header, and the hop-by-hop headers
+   * are left to the sessions.
+   *
+   * @return nullptr if the file can't be parsed or has no entry
+   */
+  static std::unique_ptr<RequestCorpus> fromHAR(const std::string& path);
+
+  /**
+   * @param bodySize the bytes of body to send after the request
+   */
+  void add(const proxygen::HTTPMessage& request, size_t bodySize = 0) {
+    requests_.push_back(request);
+    bodySizes_.push_back(bodySize);
+  }
+
+  /**
+   * Group the requests added since the last page in a page, that
+   * concurrency of them may load at a time
+   */
+  void endPage(uint32_t concurrency);
+
+  /**
+   * @return the request i, wrapping around the end
+   */
+  const proxygen::HTTPMessage& get(size_t i) const {
+    return requests_[i % requests_.size()];
+  }
+
+  size_t getBodySize(size_t i) const {
+    return bodySizes_[i % bodySizes_.size()];
+  }
+
+  size_t size() const {
+    return requests_.size();
+  }
+
+  /**
+   * @return the page i, wrapping around the end
+   */
+  const Page& getPage(size_t i) const {
+    return pages_[i % pages_.size()];
+  }
+
+  size_t getNumPages() const {
+    return pages_.size();
+  }
+
+ private:
+  std::vector<proxygen::HTTPMessage> requests_;
+  std::vector<size_t> bodySizes_;
+  std::vector<Page> pages_;
+};
+
+}
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <fstream>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/AccessLogFilter.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace proxygen;
+using namespace testing;
+
+TEST(AccessLogFilterTest, LogsCommonFormat) {
+  char path[] = "/tmp/AccessLogFilterTestXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    AsyncLogWriter writer(path);
+    MockRequestHandler handler;
+    auto filter = new AccessLogFilter(&handler, &writer);
+    MockResponseHandler downstream(filter);
+    EXPECT_CALL(handler, setResponseHandler(filter));
+    filter->setResponseHandler(&downstream);
+
+    auto req = folly::make_unique<HTTPMessage>();
+    req->setMethod(HTTPMethod::GET);
+    req->setURL("/index.html?q=1");
+    req->setHTTPVersion(1, 1);
+    req->setClientAddress(folly::SocketAddress("10.0.0.1", 1234));
+    EXPECT_CALL(handler, onRequest(_));
+    filter->onRequest(std::move(req));
+
+    HTTPMessage resp;
+    resp.setStatusCode(200);
+    EXPECT_CALL(downstream, sendHeaders(_));
+    EXPECT_CALL(downstream, sendBody(_));
+    filter->sendHeaders(resp);
+    filter->sendBody(folly::IOBuf::copyBuffer("hello"));
+    EXPECT_CALL(handler, requestComplete());
+    filter->requestComplete();
+    writer.flush();
+  }
+
+  std::ifstream file(path);
+  std::string line;
+  ASSERT_TRUE(std::getline(file, line));
+  EXPECT_EQ(0, line.find("10.0.0.1 - - ["));
+  EXPECT_NE(std::string::npos,
+            line.find("] \"GET /index.html?q=1 HTTP/1.1\" 200 5 "));
+  EXPECT_FALSE(std::getline(file, line));
+  unlink(path);
+}
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/BatchHandler.h>
+#include <proxygen/httpserver/Mocks.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+// Keeps the batches it gets, and answers them right away if asked to
+class TestBatchHandler : public BatchHandler {
+ public:
+  explicit TestBatchHandler(std::vector<Batch>* batches, bool respond):
+      batches_(batches),
+      respond_(respond) {}
+
+  void onBatch(Batch batch) noexcept override {
+    if (respond_) {
+      for (auto& request: batch) {
+        request->respond(200, "OK", IOBuf::copyBuffer(
+                           request->getMessage().getPath()));
+      }
+    }
+    batches_->push_back(std::move(batch));
+  }
+
+ private:
+  std::vector<Batch>* batches_;
+  const bool respond_;
+};
+
+std::unique_ptr<HTTPMessage> makeGet(const std::string& url) {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::GET);
+  req->setURL(url);
+  return req;
+}
+
+}
+
+class BatchHandlerTest : public Test {
+ protected:
+  void start(bool respond, size_t maxBatchSize = 256) {
+    factory_.reset(new BatchHandlerFactory(
+      [this, respond] {
+        return std::unique_ptr<BatchHandler>(
+          new TestBatchHandler(&batches_, respond));
+      },
+      maxBatchSize, 8));
+    factory_->onServerStart();
+  }
+
+  void TearDown() override {
+    for (auto handler: handlers_) {
+      handler->requestComplete();
+    }
+    factory_->onServerStop();
+  }
+
+  // A transaction's handler, with its mock downstream
+  RequestHandler* newHandler() {
+    HTTPMessage msg;
+    auto handler = factory_->onRequest(nullptr, &msg);
+    downstreams_.emplace_back(new StrictMock<MockResponseHandler>(handler));
+    handler->setResponseHandler(downstreams_.back().get());
+    handlers_.push_back(handler);
+    return handler;
+  }
+
+  void send(RequestHandler* handler, const std::string& url,
+            const std::string& body = "") {
+    handler->onRequest(makeGet(url));
+    if (!body.empty()) {
+      handler->onBody(IOBuf::copyBuffer(body));
+    }
+    handler->onEOM();
+  }
+
+  void loop() {
+    folly::EventBaseManager::get()->getEventBase()->loop();
+  }
+
+  std::unique_ptr<BatchHandlerFactory> factory_;
+  std::vector<BatchHandler::Batch> batches_;
+  std::vector<RequestHandler*> handlers_;
+  std::vector<std::unique_ptr<StrictMock<MockResponseHandler>>> downstreams_;
+};
+
+TEST_F(BatchHandlerTest, BatchesOneLoopIteration) {
+  start(false);
+  for (int i = 0; i < 3; i++) {
+    send(newHandler(), "/key/" + folly::to<std::string>(i), "abc");
+  }
+  EXPECT_TRUE(batches_.empty());
+
+  loop();
+  ASSERT_EQ(1, batches_.size());
+  ASSERT_EQ(3, batches_[0].size());
+  for (size_t i = 0; i < 3; i++) {
+    const auto& request = batches_[0][i];
+    EXPECT_EQ("/key/" + folly::to<std::string>(i),
+              request->getMessage().getPath());
+    auto body = request->getBody();
+    EXPECT_EQ("abc", std::string((const char*)body->data(), body->length()));
+    EXPECT_FALSE(request->isDone());
+  }
+
+  send(newHandler(), "/key/3");
+  loop();
+  ASSERT_EQ(2, batches_.size());
+  ASSERT_EQ(1, batches_[1].size());
+  EXPECT_EQ(nullptr, batches_[1][0]->getBody());
+}
+
+TEST_F(BatchHandlerTest, RespondsAndDropsTheGone) {
+  start(true);
+  auto answered = newHandler();
+  auto gone = newHandler();
+  send(answered, "/a");
+  send(gone, "/b");
+
+  // the client of the second one goes away before the batch
+  gone->onError(kErrorConnectionReset);
+  handlers_.pop_back();
+
+  EXPECT_CALL(*downstreams_[0], sendHeaders(_))
+    .WillOnce(Invoke([] (HTTPMessage& msg) {
+          EXPECT_EQ(200, msg.getStatusCode());
+        }));
+  EXPECT_CALL(*downstreams_[0], sendBody(_));
+  EXPECT_CALL(*downstreams_[0], sendEOM());
+  loop();
+  ASSERT_EQ(1, batches_.size());
+  ASSERT_EQ(1, batches_[0].size());
+  auto request = batches_[0][0];
+  EXPECT_TRUE(request->isDone());
+
+  // the transaction ends later; answering again does nothing
+  answered->requestComplete();
+  handlers_.clear();
+  request->respond(500, "Internal Server Error");
+}
+
+TEST_F(BatchHandlerTest, FullBatchGoesRightAway) {
+  start(false, 2);
+  send(newHandler(), "/a");
+  EXPECT_TRUE(batches_.empty());
+  send(newHandler(), "/b");
+  ASSERT_EQ(1, batches_.size());
+  EXPECT_EQ(2, batches_[0].size());
+
+  send(newHandler(), "/c");
+  loop();
+  ASSERT_EQ(2, batches_.size());
+  EXPECT_EQ(1, batches_[1].size());
+}
+
+TEST_F(BatchHandlerTest, RejectsLargeBodies) {
+  start(false);
+  auto handler = newHandler();
+  EXPECT_CALL(*downstreams_[0], sendHeaders(_))
+    .WillOnce(Invoke([] (HTTPMessage& msg) {
+          EXPECT_EQ(413, msg.getStatusCode());
+        }));
+  EXPECT_CALL(*downstreams_[0], sendEOM());
+  EXPECT_CALL(*downstreams_[0], pauseIngress());
+  send(handler, "/a", "more than eight bytes");
+  loop();
+  EXPECT_TRUE(batches_.empty());
+}
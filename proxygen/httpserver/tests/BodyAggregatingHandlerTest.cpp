@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/BodyAggregatingHandler.h>
+#include <proxygen/httpserver/Mocks.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+class TestHandler : public BodyAggregatingHandler {
+ public:
+  explicit TestHandler(size_t maxBodySize):
+      BodyAggregatingHandler(maxBodySize) {}
+
+  void onRequestBody(std::unique_ptr<HTTPMessage> request,
+                     Body body) noexcept override {
+    requests++;
+    buffers = body.getChain() ? body.getChain()->countChainElements() : 0;
+    size = body.size();
+    text = body.getStringPiece().str();
+  }
+
+  uint32_t requests{0};
+  size_t buffers{0};
+  size_t size{0};
+  std::string text;
+};
+
+std::unique_ptr<HTTPMessage> makePost(const std::string& length) {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::POST);
+  req->setURL("/upload");
+  if (!length.empty()) {
+    req->getHeaders().set(HTTP_HEADER_CONTENT_LENGTH, length);
+  }
+  return req;
+}
+
+}
+
+class BodyAggregatingHandlerTest : public Test {
+ protected:
+  void SetUp() override {
+    handler_ = new TestHandler(10);
+    downstream_.reset(new MockResponseHandler(handler_));
+    handler_->setResponseHandler(downstream_.get());
+  }
+
+  void TearDown() override {
+    handler_->requestComplete();
+  }
+
+  void expectRejected() {
+    EXPECT_CALL(*downstream_, sendHeaders(_))
+      .WillOnce(Invoke([] (HTTPMessage& msg) {
+            EXPECT_EQ(413, msg.getStatusCode());
+          }));
+    EXPECT_CALL(*downstream_, sendEOM());
+    EXPECT_CALL(*downstream_, pauseIngress());
+  }
+
+  TestHandler* handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+};
+
+TEST_F(BodyAggregatingHandlerTest, ChainsWithoutCopies) {
+  handler_->onRequest(makePost("9"));
+  handler_->onBody(IOBuf::copyBuffer("abc"));
+  handler_->onBody(IOBuf::copyBuffer("defghi"));
+  // the chain is handed over as it came, and only coalesced on request
+  handler_->onEOM();
+  EXPECT_EQ(1, handler_->requests);
+  EXPECT_EQ(2, handler_->buffers);
+  EXPECT_EQ(9, handler_->size);
+  EXPECT_EQ("abcdefghi", handler_->text);
+}
+
+TEST_F(BodyAggregatingHandlerTest, NoBody) {
+  handler_->onRequest(makePost(""));
+  handler_->onEOM();
+  EXPECT_EQ(1, handler_->requests);
+  EXPECT_EQ(0, handler_->size);
+  EXPECT_EQ("", handler_->text);
+}
+
+TEST_F(BodyAggregatingHandlerTest, RejectsLargeContentLength) {
+  expectRejected();
+  handler_->onRequest(makePost("11"));
+  handler_->onBody(IOBuf::copyBuffer("abc"));
+  handler_->onEOM();
+  EXPECT_EQ(0, handler_->requests);
+}
+
+TEST_F(BodyAggregatingHandlerTest, RejectsLargeChunkedBody) {
+  handler_->onRequest(makePost(""));
+  handler_->onBody(IOBuf::copyBuffer("0123456789"));
+  expectRejected();
+  handler_->onBody(IOBuf::copyBuffer("a"));
+  handler_->onBody(IOBuf::copyBuffer("b"));
+  handler_->onEOM();
+  EXPECT_EQ(0, handler_->requests);
+}
@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/CollapseFilter.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+std::unique_ptr<HTTPMessage> makeGet() {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::GET);
+  req->setURL("/hot");
+  req->getHeaders().set(HTTP_HEADER_HOST, "www.example.com");
+  return req;
+}
+
+}
+
+class CollapseFilterTest : public Test {
+ protected:
+  // A filter over handler, that sends to downstream
+  CollapseFilter* makeFilter(MockRequestHandler& handler,
+                             std::unique_ptr<MockResponseHandler>& downstream) {
+    auto filter = new CollapseFilter(&handler, &fetches_, 10);
+    downstream.reset(new MockResponseHandler(filter));
+    EXPECT_CALL(handler, setResponseHandler(filter));
+    filter->setResponseHandler(downstream.get());
+    return filter;
+  }
+
+  CollapseFilter::Fetches fetches_;
+  MockRequestHandler leaderHandler_;
+  MockRequestHandler waiterHandler_;
+  std::unique_ptr<MockResponseHandler> leaderDownstream_;
+  std::unique_ptr<MockResponseHandler> waiterDownstream_;
+};
+
+TEST_F(CollapseFilterTest, FansOut) {
+  auto leader = makeFilter(leaderHandler_, leaderDownstream_);
+  auto waiter = makeFilter(waiterHandler_, waiterDownstream_);
+
+  EXPECT_CALL(leaderHandler_, onRequest(_));
+  EXPECT_CALL(leaderHandler_, onEOM());
+  leader->onRequest(makeGet());
+  leader->onEOM();
+  // the waiter's handler never sees the request
+  EXPECT_CALL(waiterHandler_, onRequest(_)).Times(0);
+  waiter->onRequest(makeGet());
+  waiter->onEOM();
+  EXPECT_EQ(1, fetches_.size());
+
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  EXPECT_CALL(waiterHandler_, onError(kErrorCanceled));
+  EXPECT_CALL(*waiterDownstream_, sendHeaders(_));
+  EXPECT_CALL(*leaderDownstream_, sendHeaders(_));
+  leader->sendHeaders(resp);
+
+  // a paused waiter holds the body back, past its backlog so does the
+  // handler
+  waiter->onEgressPaused();
+  EXPECT_CALL(*leaderDownstream_, sendBody(_));
+  EXPECT_CALL(leaderHandler_, onEgressPaused());
+  leader->sendBody(IOBuf::copyBuffer("0123456789abc"));
+
+  std::string waiterBody;
+  EXPECT_CALL(*waiterDownstream_, sendBody(_))
+    .WillOnce(Invoke([&] (std::shared_ptr<IOBuf> body) {
+          waiterBody = body->moveToFbString().toStdString();
+        }));
+  EXPECT_CALL(leaderHandler_, onEgressResumed());
+  waiter->onEgressResumed();
+  EXPECT_EQ("0123456789abc", waiterBody);
+
+  EXPECT_CALL(*leaderDownstream_, sendEOM());
+  EXPECT_CALL(*waiterDownstream_, sendEOM());
+  leader->sendEOM();
+  EXPECT_TRUE(fetches_.empty());
+
+  EXPECT_CALL(leaderHandler_, requestComplete());
+  leader->requestComplete();
+  waiter->requestComplete();
+}
+
+TEST_F(CollapseFilterTest, ReleasesOnPrivateResponse) {
+  auto leader = makeFilter(leaderHandler_, leaderDownstream_);
+  auto waiter = makeFilter(waiterHandler_, waiterDownstream_);
+
+  EXPECT_CALL(leaderHandler_, onRequest(_));
+  leader->onRequest(makeGet());
+  waiter->onRequest(makeGet());
+  waiter->onEOM();
+
+  // the waiter goes to its own handler
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "private");
+  EXPECT_CALL(waiterHandler_, onRequest(_));
+  EXPECT_CALL(waiterHandler_, onEOM());
+  EXPECT_CALL(*leaderDownstream_, sendHeaders(_));
+  leader->sendHeaders(resp);
+  EXPECT_TRUE(fetches_.empty());
+
+  EXPECT_CALL(*waiterDownstream_, sendHeaders(_));
+  waiter->sendHeaders(resp);
+
+  EXPECT_CALL(leaderHandler_, requestComplete());
+  EXPECT_CALL(waiterHandler_, requestComplete());
+  leader->requestComplete();
+  waiter->requestComplete();
+}
+
+TEST_F(CollapseFilterTest, LeaderFails) {
+  auto leader = makeFilter(leaderHandler_, leaderDownstream_);
+  auto waiter = makeFilter(waiterHandler_, waiterDownstream_);
+
+  EXPECT_CALL(leaderHandler_, onRequest(_));
+  leader->onRequest(makeGet());
+  waiter->onRequest(makeGet());
+
+  EXPECT_CALL(waiterHandler_, onRequest(_));
+  EXPECT_CALL(leaderHandler_, onError(kErrorConnectionReset));
+  leader->onError(kErrorConnectionReset);
+  EXPECT_TRUE(fetches_.empty());
+
+  EXPECT_CALL(waiterHandler_, onError(kErrorConnectionReset));
+  waiter->onError(kErrorConnectionReset);
+}
@@ -0,0 +1,173 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/CompressionFilter.h>
+#include <zlib.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+std::unique_ptr<HTTPMessage> makeGet(const std::string& acceptEncoding) {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::GET);
+  req->setURL("/index.html");
+  if (!acceptEncoding.empty()) {
+    req->getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, acceptEncoding);
+  }
+  return req;
+}
+
+HTTPMessage makeResponse(const std::string& contentType, size_t length) {
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.getHeaders().set(HTTP_HEADER_CONTENT_TYPE, contentType);
+  resp.getHeaders().set(HTTP_HEADER_CONTENT_LENGTH,
+                        folly::to<std::string>(length));
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  return resp;
+}
+
+std::string gunzip(const std::string& compressed) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  EXPECT_EQ(Z_OK, inflateInit2(&stream, 31));
+  std::string data(64 * 1024, '\0');
+  stream.next_in = (uint8_t*)compressed.data();
+  stream.avail_in = compressed.size();
+  stream.next_out = (uint8_t*)&data[0];
+  stream.avail_out = data.size();
+  EXPECT_EQ(Z_STREAM_END, inflate(&stream, Z_FINISH));
+  data.resize(data.size() - stream.avail_out);
+  inflateEnd(&stream);
+  return data;
+}
+
+}
+
+class CompressionFilterTest : public Test {
+ protected:
+  CompressionFilter* makeFilter(const std::string& acceptEncoding) {
+    auto filter = new CompressionFilter(&handler_, 6);
+    downstream_.reset(new MockResponseHandler(filter));
+    EXPECT_CALL(handler_, setResponseHandler(filter));
+    filter->setResponseHandler(downstream_.get());
+    EXPECT_CALL(handler_, onRequest(_));
+    filter->onRequest(makeGet(acceptEncoding));
+    EXPECT_CALL(*downstream_, sendHeaders(_))
+      .WillOnce(Invoke([this] (HTTPMessage& msg) { response_ = msg; }));
+    EXPECT_CALL(*downstream_, sendBody(_))
+      .WillRepeatedly(Invoke([this] (std::shared_ptr<IOBuf> body) {
+            auto data = body->clone();
+            data->coalesce();
+            body_.append((const char*)data->data(), data->length());
+          }));
+    EXPECT_CALL(*downstream_, sendEOM());
+    return filter;
+  }
+
+  MockRequestHandler handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+  HTTPMessage response_;
+  std::string body_;
+};
+
+TEST_F(CompressionFilterTest, Compresses) {
+  std::string text;
+  for (int i = 0; i < 100; i++) {
+    text += "all work and no play makes jack a dull boy\n";
+  }
+  auto filter = makeFilter("deflate;q=0.5, gzip");
+  auto resp = makeResponse("text/html; charset=utf-8", text.size());
+  // the handler's chunk headers don't get through
+  EXPECT_CALL(*downstream_, sendChunkHeader(_)).Times(0);
+  filter->sendHeaders(resp);
+  filter->sendChunkHeader(100);
+  filter->sendBody(IOBuf::copyBuffer(text.substr(0, 100)));
+  filter->sendChunkTerminator();
+  // the terminator flushed the first chunk
+  EXPECT_LT(0, body_.size());
+  filter->sendBody(IOBuf::copyBuffer(text.substr(100)));
+  filter->sendEOM();
+
+  auto& headers = response_.getHeaders();
+  EXPECT_EQ("gzip", headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_ENCODING));
+  EXPECT_EQ("Accept-Encoding", headers.getSingleOrEmpty(HTTP_HEADER_VARY));
+  EXPECT_EQ("W/\"v1\"", headers.getSingleOrEmpty(HTTP_HEADER_ETAG));
+  EXPECT_FALSE(headers.exists(HTTP_HEADER_CONTENT_LENGTH));
+  EXPECT_GT(text.size() / 4, body_.size());
+  EXPECT_EQ(text, gunzip(body_));
+
+  EXPECT_CALL(handler_, requestComplete());
+  filter->requestComplete();
+}
+
+TEST_F(CompressionFilterTest, PassesThrough) {
+  // not accepted
+  auto filter = makeFilter("identity");
+  auto resp = makeResponse("text/plain", 1000);
+  filter->sendHeaders(resp);
+  filter->sendBody(IOBuf::copyBuffer(std::string(1000, 'a')));
+  filter->sendEOM();
+  EXPECT_FALSE(response_.getHeaders().exists(HTTP_HEADER_CONTENT_ENCODING));
+  EXPECT_EQ("Accept-Encoding",
+            response_.getHeaders().getSingleOrEmpty(HTTP_HEADER_VARY));
+  EXPECT_EQ(1000, body_.size());
+  EXPECT_CALL(handler_, requestComplete());
+  filter->requestComplete();
+
+  // not worth it
+  body_.clear();
+  filter = makeFilter("gzip");
+  resp = makeResponse("image/png", 1000);
+  filter->sendHeaders(resp);
+  filter->sendBody(IOBuf::copyBuffer(std::string(1000, 'a')));
+  filter->sendEOM();
+  EXPECT_FALSE(response_.getHeaders().exists(HTTP_HEADER_CONTENT_ENCODING));
+  EXPECT_FALSE(response_.getHeaders().exists(HTTP_HEADER_VARY));
+  EXPECT_EQ(1000, body_.size());
+  EXPECT_CALL(handler_, onError(kErrorEOF));
+  filter->onError(kErrorEOF);
+}
+
+TEST(CompressionFilter, Negotiation) {
+  ZlibStreamCompressor::Type type;
+  EXPECT_FALSE(CompressionFilter::chooseType(*makeGet(""), &type));
+  EXPECT_FALSE(CompressionFilter::chooseType(*makeGet("gzip;q=0, br"),
+                                             &type));
+  EXPECT_TRUE(CompressionFilter::chooseType(*makeGet("gzip;q=0.5, deflate"),
+                                            &type));
+  EXPECT_EQ(ZlibStreamCompressor::Type::DEFLATE, type);
+  EXPECT_TRUE(CompressionFilter::chooseType(*makeGet("*"), &type));
+  EXPECT_EQ(ZlibStreamCompressor::Type::GZIP, type);
+
+  EXPECT_FALSE(CompressionFilter::isCompressible(
+                 makeResponse("text/plain", 100), 256));
+  EXPECT_TRUE(CompressionFilter::isCompressible(
+                makeResponse("application/vnd.api+json", 1000), 256));
+}
+
+TEST(CompressionFilter, LevelUnderLag) {
+  using std::chrono::milliseconds;
+  EXPECT_EQ(6, CompressionFilter::getLevel(6, milliseconds(50),
+                                           milliseconds(0)));
+  EXPECT_EQ(6, CompressionFilter::getLevel(6, milliseconds(0),
+                                           milliseconds(100)));
+  EXPECT_EQ(4, CompressionFilter::getLevel(6, milliseconds(50),
+                                           milliseconds(100)));
+  EXPECT_EQ(1, CompressionFilter::getLevel(6, milliseconds(200),
+                                           milliseconds(100)));
+}
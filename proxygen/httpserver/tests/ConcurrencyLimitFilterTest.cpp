@@ -0,0 +1,232 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/ConcurrencyLimitFilter.h>
+#include <proxygen/lib/http/session/StreamLimit.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using std::chrono::microseconds;
+
+namespace {
+
+// Sends as many requests as the limiter takes at once to a backend that
+// serves capacity of them in 1ms, and queues the others
+uint32_t runRound(ConcurrencyLimiter& limiter, uint32_t capacity) {
+  uint32_t n = 0;
+  while (limiter.tryAcquire()) {
+    n++;
+  }
+  auto latency = microseconds(1000 * std::max(n, capacity) / capacity);
+  for (uint32_t i = 0; i < n; i++) {
+    limiter.release(latency);
+  }
+  return limiter.getLimit();
+}
+
+ConcurrencyLimiter::Options getOptions() {
+  ConcurrencyLimiter::Options options;
+  // no probing, unless asked for
+  options.probeWindows = 1000000;
+  return options;
+}
+
+}
+
+TEST(ConcurrencyLimiterTest, GrowsWithoutQueueing) {
+  auto options = getOptions();
+  options.initialLimit = 10;
+  options.windowSamples = 10;
+  ConcurrencyLimiter limiter(options);
+  uint32_t last = limiter.getLimit();
+  for (int i = 0; i < 20; i++) {
+    uint32_t limit = runRound(limiter, 1000000);
+    EXPECT_GE(limit, last);
+    last = limit;
+  }
+  EXPECT_GT(last, 30);
+  EXPECT_EQ(1000, limiter.getBaseLatency().count());
+  EXPECT_EQ(0, limiter.getInFlight());
+}
+
+TEST(ConcurrencyLimiterTest, Converges) {
+  ConcurrencyLimiter limiter(getOptions());
+  for (int i = 0; i < 200; i++) {
+    runRound(limiter, 50);
+  }
+  // where the latency is about tolerance times the base
+  EXPECT_GT(limiter.getLimit(), 60);
+  EXPECT_LT(limiter.getLimit(), 110);
+
+  // the backend lost capacity
+  for (int i = 0; i < 200; i++) {
+    runRound(limiter, 10);
+  }
+  EXPECT_GT(limiter.getLimit(), 12);
+  EXPECT_LT(limiter.getLimit(), 30);
+}
+
+TEST(ConcurrencyLimiterTest, HoldsWhileUnderused) {
+  ConcurrencyLimiter limiter(getOptions());
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 5; j++) {
+      EXPECT_TRUE(limiter.tryAcquire());
+    }
+    for (int j = 0; j < 5; j++) {
+      limiter.release(microseconds(1000));
+    }
+  }
+  EXPECT_EQ(20, limiter.getLimit());
+}
+
+TEST(ConcurrencyLimiterTest, IgnoresFailures) {
+  auto options = getOptions();
+  options.windowSamples = 1;
+  ConcurrencyLimiter limiter(options);
+  EXPECT_TRUE(limiter.tryAcquire());
+  limiter.release();
+  EXPECT_EQ(0, limiter.getInFlight());
+  EXPECT_EQ(0, limiter.getBaseLatency().count());
+  EXPECT_EQ(20, limiter.getLimit());
+}
+
+TEST(ConcurrencyLimiterTest, Probes) {
+  auto options = getOptions();
+  options.windowSamples = 1;
+  options.probeWindows = 5;
+  ConcurrencyLimiter limiter(options);
+  for (int i = 0; i < 20; i++) {
+    EXPECT_TRUE(limiter.tryAcquire());
+  }
+  // a window each
+  for (int i = 0; i < 4; i++) {
+    limiter.release(microseconds(1000));
+  }
+  uint32_t limit = limiter.getLimit();
+  EXPECT_GT(limit, 20);
+  limiter.release(microseconds(1000));
+  EXPECT_EQ(limit / 2, limiter.getLimit());
+  EXPECT_EQ(0, limiter.getBaseLatency().count());
+  for (int i = 0; i < 15; i++) {
+    limiter.release();
+  }
+  EXPECT_EQ(0, limiter.getInFlight());
+}
+
+TEST(ConcurrencyLimitFilterTest, QueuesAndRejects) {
+  ConcurrencyLimiter::Options options;
+  options.initialLimit = 1;
+  options.maxLimit = 1;
+  ConcurrencyLimitFilterFactory factory;
+  factory.addRoute("/api", options, 1);
+  factory.onServerStart();
+  EXPECT_EQ(1, StreamLimit::get().getLimit());
+
+  HTTPMessage msg;
+  msg.setURL("/other");
+  MockRequestHandler handler1;
+  EXPECT_EQ(&handler1, factory.onRequest(&handler1, &msg));
+
+  msg.setURL("/api/a");
+  auto filter1 = factory.onRequest(&handler1, &msg);
+  ASSERT_NE(&handler1, filter1);
+  MockResponseHandler downstream1(filter1);
+  EXPECT_CALL(handler1, setResponseHandler(filter1));
+  filter1->setResponseHandler(&downstream1);
+  EXPECT_CALL(handler1, onRequest(_));
+  EXPECT_CALL(handler1, onEOM());
+  filter1->onRequest(folly::make_unique<HTTPMessage>(msg));
+  filter1->onEOM();
+
+  // waits for the slot of the first
+  MockRequestHandler handler2;
+  auto filter2 = factory.onRequest(&handler2, &msg);
+  MockResponseHandler downstream2(filter2);
+  EXPECT_CALL(handler2, setResponseHandler(filter2));
+  filter2->setResponseHandler(&downstream2);
+  EXPECT_CALL(downstream2, pauseIngress());
+  filter2->onRequest(folly::make_unique<HTTPMessage>(msg));
+  filter2->onBody(folly::IOBuf::copyBuffer("body"));
+  filter2->onEOM();
+  Mock::VerifyAndClearExpectations(&handler2);
+
+  // and the queue is full
+  MockRequestHandler handler3;
+  auto filter3 = factory.onRequest(&handler3, &msg);
+  MockResponseHandler downstream3(filter3);
+  EXPECT_CALL(handler3, setResponseHandler(filter3));
+  filter3->setResponseHandler(&downstream3);
+  HTTPMessage response;
+  EXPECT_CALL(handler3, onError(kErrorDropped));
+  EXPECT_CALL(handler3, onRequest(_)).Times(0);
+  EXPECT_CALL(downstream3, sendHeaders(_))
+    .WillOnce(Invoke([&] (HTTPMessage& resp) { response = resp; }));
+  EXPECT_CALL(downstream3, sendEOM());
+  filter3->onRequest(folly::make_unique<HTTPMessage>(msg));
+  EXPECT_EQ(503, response.getStatusCode());
+  filter3->onEOM();
+  filter3->requestComplete();
+
+  // the second gets all it was sent once the first completes
+  EXPECT_CALL(handler1, requestComplete());
+  EXPECT_CALL(handler2, onRequest(_));
+  EXPECT_CALL(handler2, onBody(_))
+    .WillOnce(Invoke([] (std::shared_ptr<folly::IOBuf> body) {
+          EXPECT_EQ("body", body->moveToFbString().toStdString());
+        }));
+  EXPECT_CALL(handler2, onEOM());
+  EXPECT_CALL(downstream2, resumeIngress()).Times(0);
+  filter1->requestComplete();
+  Mock::VerifyAndClearExpectations(&handler2);
+
+  EXPECT_CALL(handler2, onError(kErrorTimeout));
+  filter2->onError(kErrorTimeout);
+
+  factory.onServerStop();
+  EXPECT_EQ(0, StreamLimit::get().getLimit());
+}
+
+TEST(ConcurrencyLimitFilterTest, LeavesQueueOnError) {
+  ConcurrencyLimiter::Options options;
+  options.initialLimit = 1;
+  options.maxLimit = 1;
+  ConcurrencyLimitFilterFactory factory;
+  factory.addRoute("/", options);
+  factory.onServerStart();
+
+  HTTPMessage msg;
+  msg.setURL("/a");
+  MockRequestHandler handler1;
+  auto filter1 = factory.onRequest(&handler1, &msg);
+  MockResponseHandler downstream1(filter1);
+  EXPECT_CALL(handler1, setResponseHandler(filter1));
+  filter1->setResponseHandler(&downstream1);
+  EXPECT_CALL(handler1, onRequest(_));
+  filter1->onRequest(folly::make_unique<HTTPMessage>(msg));
+
+  MockRequestHandler handler2;
+  auto filter2 = factory.onRequest(&handler2, &msg);
+  MockResponseHandler downstream2(filter2);
+  EXPECT_CALL(handler2, setResponseHandler(filter2));
+  filter2->setResponseHandler(&downstream2);
+  EXPECT_CALL(downstream2, pauseIngress());
+  filter2->onRequest(folly::make_unique<HTTPMessage>(msg));
+  // the client gave up waiting
+  EXPECT_CALL(handler2, onRequest(_)).Times(0);
+  EXPECT_CALL(handler2, onError(kErrorEOF));
+  filter2->onError(kErrorEOF);
+
+  EXPECT_CALL(handler1, onError(kErrorEOF));
+  filter1->onError(kErrorEOF);
+  factory.onServerStop();
+}
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/filters/DiskCache.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace proxygen;
+
+using folly::IOBuf;
+using std::chrono::seconds;
+
+class DiskCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/DiskCacheTestXXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    dir_ = dir;
+  }
+
+  void TearDown() override {
+    for (auto& name: listDir()) {
+      unlink((dir_ + "/" + name).c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  std::vector<std::string> listDir() {
+    std::vector<std::string> names;
+    DIR* dir = opendir(dir_.c_str());
+    while (dirent* ent = readdir(dir)) {
+      if (ent->d_name[0] != '.') {
+        names.push_back(ent->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  static HTTPMessage makeRequest(const std::string& url) {
+    HTTPMessage req;
+    req.setMethod(HTTPMethod::GET);
+    req.setURL(url);
+    req.getHeaders().set(HTTP_HEADER_HOST, "www.example.com");
+    return req;
+  }
+
+  static bool admit(DiskCache& cache, const HTTPMessage& request,
+                    const std::string& body,
+                    const std::vector<std::string>& varyNames = {}) {
+    auto response = std::make_shared<ResponseCache::Response>();
+    response->headers.setStatusCode(200);
+    response->headers.setStatusMessage("OK");
+    response->headers.getHeaders().set(HTTP_HEADER_CONTENT_TYPE,
+                                       "text/plain");
+    if (!body.empty()) {
+      response->body = IOBuf::copyBuffer(body);
+    }
+    response->initialAge = seconds(5);
+    response->stored = getCurrentTime();
+    response->expires = response->stored + seconds(60);
+    return cache.admit(ResponseCache::getKey(request), varyNames,
+                       ResponseCache::getVaryValues(request, varyNames),
+                       std::move(response));
+  }
+
+  static std::string getBody(const DiskCache::Hit& hit) {
+    if (!hit.body) {
+      return "";
+    }
+    return hit.body->map()->moveToFbString().toStdString();
+  }
+
+  std::string dir_;
+};
+
+TEST_F(DiskCacheTest, StoresAndServes) {
+  DiskCache cache(dir_);
+  ASSERT_TRUE(cache.isOpen());
+  auto req = makeRequest("/a");
+  EXPECT_EQ(nullptr, cache.get(req));
+  EXPECT_TRUE(admit(cache, req, "hello"));
+  EXPECT_TRUE(admit(cache, makeRequest("/empty"), ""));
+  cache.flush();
+  EXPECT_EQ(2, cache.getNumEntries());
+
+  auto hit = cache.get(req);
+  ASSERT_TRUE(hit != nullptr);
+  EXPECT_EQ(200, hit->headers.getStatusCode());
+  EXPECT_EQ("OK", hit->headers.getStatusMessage());
+  EXPECT_EQ("text/plain", hit->headers.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_TYPE));
+  EXPECT_EQ(5, hit->initialAge.count());
+  ASSERT_TRUE(hit->body != nullptr);
+  EXPECT_EQ(5, hit->body->getLength());
+  EXPECT_EQ("hello", getBody(*hit));
+
+  auto empty = cache.get(makeRequest("/empty"));
+  ASSERT_TRUE(empty != nullptr);
+  EXPECT_EQ(nullptr, empty->body);
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/b")));
+}
+
+TEST_F(DiskCacheTest, Vary) {
+  DiskCache cache(dir_);
+  auto gzip = makeRequest("/a");
+  gzip.getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, "gzip");
+  auto plain = makeRequest("/a");
+  EXPECT_TRUE(admit(cache, gzip, "zipped", {"accept-encoding"}));
+  cache.flush();
+  EXPECT_EQ(nullptr, cache.get(plain));
+  EXPECT_TRUE(admit(cache, plain, "plain", {"accept-encoding"}));
+  cache.flush();
+  EXPECT_EQ("zipped", getBody(*cache.get(gzip)));
+  EXPECT_EQ("plain", getBody(*cache.get(plain)));
+}
+
+TEST_F(DiskCacheTest, Recovers) {
+  {
+    DiskCache cache(dir_);
+    EXPECT_TRUE(admit(cache, makeRequest("/a"), "first"));
+    EXPECT_TRUE(admit(cache, makeRequest("/b"), "second"));
+    // written by the destructor
+  }
+  DiskCache cache(dir_);
+  EXPECT_EQ(2, cache.getNumEntries());
+  auto hit = cache.get(makeRequest("/b"));
+  ASSERT_TRUE(hit != nullptr);
+  EXPECT_EQ("second", getBody(*hit));
+  EXPECT_EQ(5, hit->initialAge.count());
+
+  // appended to a new segment
+  EXPECT_TRUE(admit(cache, makeRequest("/c"), "third"));
+  cache.flush();
+  EXPECT_EQ(2, cache.getNumSegments());
+  EXPECT_EQ("third", getBody(*cache.get(makeRequest("/c"))));
+}
+
+TEST_F(DiskCacheTest, TruncatesTornRecord) {
+  {
+    DiskCache cache(dir_);
+    EXPECT_TRUE(admit(cache, makeRequest("/a"), "first"));
+    EXPECT_TRUE(admit(cache, makeRequest("/b"), "second"));
+  }
+  auto names = listDir();
+  ASSERT_EQ(1, names.size());
+  std::string path = dir_ + "/" + names[0];
+  struct stat st;
+  ASSERT_EQ(0, stat(path.c_str(), &st));
+  // the last byte of the body of /b didn't make it
+  int fd = open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(1, pwrite(fd, "x", 1, st.st_size - 1));
+  close(fd);
+
+  DiskCache cache(dir_);
+  EXPECT_EQ(1, cache.getNumEntries());
+  EXPECT_EQ("first", getBody(*cache.get(makeRequest("/a"))));
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/b")));
+  struct stat truncated;
+  ASSERT_EQ(0, stat(path.c_str(), &truncated));
+  EXPECT_LT(truncated.st_size, st.st_size);
+}
+
+TEST_F(DiskCacheTest, DropsOldestSegment) {
+  // two segments of three records
+  DiskCache cache(dir_, 8192, 4096);
+  std::string body(1000, 'x');
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_TRUE(admit(cache, makeRequest("/" + std::to_string(i)), body));
+  }
+  cache.flush();
+  EXPECT_EQ(2, cache.getNumSegments());
+  EXPECT_EQ(2, listDir().size());
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/0")));
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/5")));
+  EXPECT_EQ(body, getBody(*cache.get(makeRequest("/6"))));
+  EXPECT_EQ(body, getBody(*cache.get(makeRequest("/11"))));
+}
+
+TEST_F(DiskCacheTest, NoDirectory) {
+  DiskCache cache(dir_ + "/missing/cache");
+  EXPECT_FALSE(cache.isOpen());
+  EXPECT_FALSE(admit(cache, makeRequest("/a"), "hello"));
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/a")));
+}
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/DrainScheduler.h>
+
+using namespace proxygen;
+
+using folly::wangle::ManagedConnection;
+using std::chrono::milliseconds;
+
+namespace {
+
+class TestConnection : public ManagedConnection {
+ public:
+  TestConnection(int id, bool busy, std::vector<int>* order)
+      : id_(id), busy_(busy), order_(order) {}
+
+  void timeoutExpired() noexcept override {
+  }
+  void describe(std::ostream& os) const override {
+  }
+  bool isBusy() const override {
+    return busy_;
+  }
+  void notifyPendingShutdown() override {
+    order_->push_back(id_);
+  }
+  void closeWhenIdle() override {
+    closed = true;
+    if (scheduler) {
+      scheduler->remove(this);
+    }
+  }
+  void dropConnection() override {
+  }
+  void dumpConnectionState(uint8_t loglevel) override {
+  }
+
+  bool closed{false};
+  DrainScheduler* scheduler{nullptr};
+
+ private:
+  int id_;
+  bool busy_;
+  std::vector<int>* order_;
+};
+
+}
+
+TEST(DrainSchedulerTest, BusiestLast) {
+  folly::EventBase evb;
+  std::vector<int> order;
+  bool done = false;
+  DrainScheduler scheduler(&evb, milliseconds(40), 1.0, [&] {
+      done = true;
+      evb.terminateLoopSoon();
+    });
+
+  // id, number of streams
+  std::vector<std::pair<int, uint32_t>> loads{{0, 5}, {1, 0}, {2, 2},
+                                               {3, 0}, {4, 9}};
+  std::vector<TestConnection*> conns;
+  std::vector<std::pair<ManagedConnection*, uint32_t>> connections;
+  for (auto& load: loads) {
+    auto conn = new TestConnection(load.first, load.second > 0, &order);
+    conn->scheduler = &scheduler;
+    conns.push_back(conn);
+    connections.emplace_back(conn, load.second);
+  }
+  scheduler.start(connections);
+  EXPECT_TRUE(scheduler.isStarted());
+  EXPECT_EQ(5, scheduler.getProgress().total);
+  EXPECT_EQ(0, scheduler.getProgress().notified);
+
+  auto start = getCurrentTime();
+  evb.loopForever();
+  EXPECT_TRUE(done);
+  EXPECT_LE(milliseconds(20), millisecondsSince(start));
+
+  // the idle ones in their order, then by load
+  EXPECT_EQ(std::vector<int>({1, 3, 2, 0, 4}), order);
+  auto progress = scheduler.getProgress();
+  EXPECT_EQ(5, progress.total);
+  EXPECT_EQ(5, progress.notified);
+  // the busy ones are still open
+  EXPECT_EQ(3, progress.remaining);
+  for (auto conn: conns) {
+    EXPECT_EQ(!conn->isBusy(), conn->closed);
+  }
+
+  for (auto conn: conns) {
+    scheduler.remove(conn);
+    conn->destroy();
+  }
+  EXPECT_EQ(0, scheduler.getProgress().remaining);
+}
+
+TEST(DrainSchedulerTest, Removed) {
+  folly::EventBase evb;
+  std::vector<int> order;
+  bool done = false;
+  DrainScheduler scheduler(&evb, milliseconds(1000), 0.0, [&] {
+      done = true;
+    });
+
+  auto first = new TestConnection(0, true, &order);
+  auto second = new TestConnection(1, true, &order);
+  scheduler.start({{first, 1}, {second, 2}});
+  // the first turn is right away
+  evb.loopOnce();
+  EXPECT_EQ(std::vector<int>({0}), order);
+  EXPECT_FALSE(done);
+
+  // the rest went away before their turn
+  scheduler.remove(second);
+  EXPECT_TRUE(done);
+  EXPECT_EQ(1, scheduler.getProgress().notified);
+  EXPECT_EQ(1, scheduler.getProgress().remaining);
+  scheduler.remove(first);
+  EXPECT_EQ(0, scheduler.getProgress().remaining);
+  first->destroy();
+  second->destroy();
+}
+
+TEST(DrainSchedulerTest, Empty) {
+  folly::EventBase evb;
+  bool done = false;
+  DrainScheduler scheduler(&evb, milliseconds(1000), 1.0, [&] {
+      done = true;
+    });
+  scheduler.start({});
+  EXPECT_TRUE(done);
+  EXPECT_EQ(0, scheduler.getProgress().total);
+}
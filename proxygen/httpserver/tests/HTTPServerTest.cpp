@@ -13,8 +13,12 @@
 #include <folly/io/async/EventBaseManager.h>
 #include <gtest/gtest.h>
 #include <proxygen/httpserver/HTTPServer.h>
+#include <proxygen/httpserver/ProxyHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/httpserver/filters/DirectResponseHandler.h>
+#include <proxygen/httpserver/filters/MirrorFilter.h>
 #include <proxygen/lib/utils/TestUtils.h>
+#include <set>
 
 using namespace proxygen;
 using namespace testing;
@@ -153,3 +157,723 @@ TEST(SSL, SSLTest) {
   evb.loop();
   EXPECT_TRUE(cb.success);
 }
+
+TEST(ReusePort, AcceptsOnWorkerSockets) {
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+
+  HTTPServerOptions options;
+  options.threads = 4;
+  options.reusePort = true;
+
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      success = true;
+      sock_->close();
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      success = false;
+    }
+
+    bool success{false};
+    folly::AsyncSocket* sock_{nullptr};
+  };
+
+  folly::EventBase evb;
+  folly::AsyncSocket::UniquePtr sock(new folly::AsyncSocket(&evb));
+  Cb cb(sock.get());
+  sock->connect(&cb, server->addresses().front().address, 1000);
+  evb.loop();
+  EXPECT_TRUE(cb.success);
+}
+
+TEST(SingleThread, ServesOnMainEventBase) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      return new DirectResponseHandler(200, "OK", "hello");
+    }
+  };
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+
+  HTTPServerOptions options;
+  options.threads = 0;
+  options.handlerFactories.push_back(folly::make_unique<Factory>());
+
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      const std::string req("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+    folly::AsyncSocket* sock_{nullptr};
+    char buf_[1024];
+  };
+
+  folly::EventBase evb;
+  folly::AsyncSocket::UniquePtr sock(new folly::AsyncSocket(&evb));
+  Cb cb(sock.get());
+  sock->connect(&cb, server->addresses().front().address, 1000);
+  evb.loop();
+  EXPECT_EQ(0, cb.response.find("HTTP/1.1 200 OK"));
+}
+
+TEST(Balancing, ServesThroughBalancer) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      return new DirectResponseHandler(200, "OK", "hello");
+    }
+  };
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+
+  HTTPServerOptions options;
+  options.threads = 4;
+  options.balancing = HTTPServerOptions::Balancing::LEAST_CONNECTIONS;
+  options.handlerFactories.push_back(folly::make_unique<Factory>());
+
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      const std::string req("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+    folly::AsyncSocket* sock_{nullptr};
+    char buf_[1024];
+  };
+
+  folly::EventBase evb;
+  std::vector<folly::AsyncSocket::UniquePtr> socks;
+  std::vector<std::unique_ptr<Cb>> cbs;
+  for (int i = 0; i < 8; i++) {
+    socks.emplace_back(new folly::AsyncSocket(&evb));
+    cbs.emplace_back(new Cb(socks.back().get()));
+    socks.back()->connect(cbs.back().get(),
+                          server->addresses().front().address, 1000);
+  }
+  evb.loop();
+  for (auto& cb: cbs) {
+    EXPECT_EQ(0, cb->response.find("HTTP/1.1 200 OK"));
+  }
+}
+
+TEST(Balancing, BatchesAccepts) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      return new DirectResponseHandler(200, "OK", "hello");
+    }
+  };
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+
+  HTTPServerOptions options;
+  options.threads = 4;
+  options.acceptBudget = 4;
+  options.acceptBatchGroupSize = 2;
+  options.handlerFactories.push_back(folly::make_unique<Factory>());
+
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      const std::string req("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+    folly::AsyncSocket* sock_{nullptr};
+    char buf_[1024];
+  };
+
+  folly::EventBase evb;
+  std::vector<folly::AsyncSocket::UniquePtr> socks;
+  std::vector<std::unique_ptr<Cb>> cbs;
+  for (int i = 0; i < 8; i++) {
+    socks.emplace_back(new folly::AsyncSocket(&evb));
+    cbs.emplace_back(new Cb(socks.back().get()));
+    socks.back()->connect(cbs.back().get(),
+                          server->addresses().front().address, 1000);
+  }
+  evb.loop();
+  for (auto& cb: cbs) {
+    EXPECT_EQ(0, cb->response.find("HTTP/1.1 200 OK"));
+  }
+  auto stats = server->getAcceptStats();
+  EXPECT_EQ(8, stats.accepted);
+  EXPECT_LE(2, stats.batches);
+  EXPECT_GE(8, stats.batches);
+  EXPECT_EQ(0, stats.acceptErrors);
+}
+
+TEST(Proxy, ForwardsToUpstream) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      return new DirectResponseHandler(200, "OK", "hello");
+    }
+  };
+
+  std::vector<HTTPServer::IPConfig> upstreamIps = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+  HTTPServerOptions upstreamOptions;
+  upstreamOptions.threads = 1;
+  upstreamOptions.handlerFactories.push_back(folly::make_unique<Factory>());
+  auto upstream = folly::make_unique<HTTPServer>(std::move(upstreamOptions));
+  upstream->bind(upstreamIps);
+  ServerThread upstreamThread(upstream.get());
+  EXPECT_TRUE(upstreamThread.start());
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+  HTTPServerOptions options;
+  options.threads = 2;
+  options.handlerFactories.push_back(folly::make_unique<ProxyHandlerFactory>(
+      HTTPSessionPool::Key(upstream->addresses().front().address),
+      std::chrono::milliseconds(1000), std::chrono::milliseconds(1000)));
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      const std::string req("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+    folly::AsyncSocket* sock_{nullptr};
+    char buf_[1024];
+  };
+
+  folly::EventBase evb;
+  std::vector<folly::AsyncSocket::UniquePtr> socks;
+  std::vector<std::unique_ptr<Cb>> cbs;
+  for (int i = 0; i < 4; i++) {
+    socks.emplace_back(new folly::AsyncSocket(&evb));
+    cbs.emplace_back(new Cb(socks.back().get()));
+    socks.back()->connect(cbs.back().get(),
+                          server->addresses().front().address, 1000);
+  }
+  evb.loop();
+  for (auto& cb: cbs) {
+    EXPECT_EQ(0, cb->response.find("HTTP/1.1 200 OK"));
+    EXPECT_NE(std::string::npos, cb->response.find("hello"));
+  }
+}
+
+TEST(Proxy, MultiplexesOverSPDY) {
+  // records what the upstream gets, from its one thread
+  struct Seen {
+    std::mutex mutex;
+    std::set<std::string> clients;
+    std::vector<std::string> hosts;
+    std::vector<std::string> urls;
+    uint32_t hopHeaders{0};
+  };
+  class Factory : public RequestHandlerFactory {
+   public:
+    explicit Factory(Seen* seen): seen_(seen) {}
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage* msg)
+        noexcept override {
+      std::lock_guard<std::mutex> lock(seen_->mutex);
+      seen_->clients.insert(msg->getClientAddress().describe());
+      seen_->hosts.push_back(
+        msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST));
+      seen_->urls.push_back(msg->getURL());
+      if (msg->getHeaders().exists("X-Hop") ||
+          msg->getHeaders().exists(HTTP_HEADER_KEEP_ALIVE)) {
+        seen_->hopHeaders++;
+      }
+      return new DirectResponseHandler(200, "OK", "hello");
+    }
+   private:
+    Seen* seen_;
+  };
+
+  Seen seen;
+  std::vector<HTTPServer::IPConfig> upstreamIps = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::SPDY
+    }
+  };
+  HTTPServerOptions upstreamOptions;
+  upstreamOptions.threads = 1;
+  upstreamOptions.handlerFactories.push_back(
+    folly::make_unique<Factory>(&seen));
+  auto upstream = folly::make_unique<HTTPServer>(std::move(upstreamOptions));
+  upstream->bind(upstreamIps);
+  ServerThread upstreamThread(upstream.get());
+  EXPECT_TRUE(upstreamThread.start());
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+  HTTPServerOptions options;
+  options.threads = 1;
+  options.handlerFactories.push_back(folly::make_unique<ProxyHandlerFactory>(
+      HTTPSessionPool::Key(upstream->addresses().front().address, nullptr,
+                           "spdy/3.1"),
+      std::chrono::milliseconds(1000), std::chrono::milliseconds(1000)));
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    Cb(folly::AsyncSocket* sock, std::string request)
+        : sock_(sock),
+          request_(std::move(request)) {}
+    void connectSuccess() noexcept override {
+      sock_->write(nullptr, request_.data(), request_.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+   private:
+    folly::AsyncSocket* sock_;
+    std::string request_;
+    char buf_[1024];
+  };
+
+  // HTTP/1.0 without Host, and in absolute form, with hop-by-hop headers
+  const std::vector<std::string> requests = {
+    "GET /a HTTP/1.0\r\nConnection: X-Hop\r\nX-Hop: 1\r\n\r\n",
+    "GET http://example.com/b?c=d HTTP/1.1\r\nHost: other\r\n"
+    "Keep-Alive: 300\r\n\r\n",
+  };
+  folly::EventBase evb;
+  std::vector<folly::AsyncSocket::UniquePtr> socks;
+  std::vector<std::unique_ptr<Cb>> cbs;
+  for (int i = 0; i < 8; i++) {
+    socks.emplace_back(new folly::AsyncSocket(&evb));
+    cbs.emplace_back(new Cb(socks.back().get(), requests[i % 2]));
+    socks.back()->connect(cbs.back().get(),
+                          server->addresses().front().address, 1000);
+  }
+  evb.loop();
+  for (auto& cb: cbs) {
+    EXPECT_NE(std::string::npos, cb->response.find(" 200 OK"));
+    EXPECT_NE(std::string::npos, cb->response.find("hello"));
+  }
+
+  std::lock_guard<std::mutex> lock(seen.mutex);
+  // the requests of the eight clients shared one upstream connection
+  EXPECT_EQ(1, seen.clients.size());
+  EXPECT_EQ(0, seen.hopHeaders);
+  ASSERT_EQ(8, seen.urls.size());
+  for (size_t i = 0; i < seen.urls.size(); i++) {
+    if (seen.urls[i] == "/a") {
+      EXPECT_EQ(upstream->addresses().front().address.describe(),
+                seen.hosts[i]);
+    } else {
+      EXPECT_EQ("/b?c=d", seen.urls[i]);
+      EXPECT_EQ("example.com", seen.hosts[i]);
+    }
+  }
+}
+
+TEST(Mirror, MirrorsToUpstream) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    explicit Factory(std::string body,
+                     std::atomic<uint32_t>* requests = nullptr)
+        : body_(std::move(body)),
+          requests_(requests) {}
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      if (requests_) {
+        ++*requests_;
+      }
+      return new DirectResponseHandler(200, "OK", body_);
+    }
+
+   private:
+    const std::string body_;
+    std::atomic<uint32_t>* requests_;
+  };
+
+  std::atomic<uint32_t> mirrored{0};
+  std::vector<HTTPServer::IPConfig> mirrorIps = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+  HTTPServerOptions mirrorOptions;
+  mirrorOptions.threads = 1;
+  mirrorOptions.handlerFactories.push_back(
+    folly::make_unique<Factory>("mirror", &mirrored));
+  auto mirror = folly::make_unique<HTTPServer>(std::move(mirrorOptions));
+  mirror->bind(mirrorIps);
+  ServerThread mirrorThread(mirror.get());
+  EXPECT_TRUE(mirrorThread.start());
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+  HTTPServerOptions options;
+  options.threads = 1;
+  options.handlerFactories.push_back(folly::make_unique<MirrorFilterFactory>(
+      HTTPSessionPool::Key(mirror->addresses().front().address),
+      1.0, 16, std::chrono::milliseconds(1000),
+      std::chrono::milliseconds(1000)));
+  options.handlerFactories.push_back(folly::make_unique<Factory>("hello"));
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    explicit Cb(folly::AsyncSocket* sock) : sock_(sock) {}
+    void connectSuccess() noexcept override {
+      const std::string req("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("hello") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+    folly::AsyncSocket* sock_{nullptr};
+    char buf_[1024];
+  };
+
+  folly::EventBase evb;
+  folly::AsyncSocket::UniquePtr sock(new folly::AsyncSocket(&evb));
+  Cb cb(sock.get());
+  sock->connect(&cb, server->addresses().front().address, 1000);
+  evb.loop();
+  // The client gets the response of the handler, not of the mirror
+  EXPECT_EQ(0, cb.response.find("HTTP/1.1 200 OK"));
+  EXPECT_NE(std::string::npos, cb.response.find("hello"));
+  EXPECT_EQ(std::string::npos, cb.response.find("mirror"));
+
+  // The mirror is sent in the background
+  for (int i = 0; i < 100 && mirrored.load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(1, mirrored.load());
+}
+
+TEST(WorkerGroups, RoutesByHostAndPath) {
+  class Factory : public RequestHandlerFactory {
+   public:
+    explicit Factory(std::string body) : body_(std::move(body)) {}
+    void onServerStart() noexcept override {}
+    void onServerStop() noexcept override {}
+    RequestHandler* onRequest(RequestHandler*, HTTPMessage*) noexcept override {
+      return new DirectResponseHandler(200, "OK", body_);
+    }
+
+   private:
+    const std::string body_;
+  };
+
+  std::vector<HTTPServer::IPConfig> ips = {
+    {
+      folly::SocketAddress("127.0.0.1", 0),
+      HTTPServer::Protocol::HTTP
+    }
+  };
+
+  HTTPServerOptions options;
+  options.threads = 2;
+  options.handlerFactories.push_back(folly::make_unique<Factory>("main"));
+  HTTPServerOptions::WorkerGroupConfig group;
+  group.name = "tenant";
+  group.threads = 2;
+  group.hosts = {"*.tenant.com"};
+  group.pathPrefixes = {"/tenant/"};
+  group.handlerFactories.push_back(folly::make_unique<Factory>("group"));
+  options.workerGroups.push_back(std::move(group));
+
+  auto server = folly::make_unique<HTTPServer>(std::move(options));
+  server->bind(ips);
+
+  ServerThread st(server.get());
+  EXPECT_TRUE(st.start());
+
+  class Cb : public folly::AsyncSocket::ConnectCallback,
+             public folly::AsyncTransport::ReadCallback {
+   public:
+    Cb(folly::AsyncSocket* sock, std::string host, std::string path)
+        : sock_(sock),
+          host_(std::move(host)),
+          path_(std::move(path)) {}
+    void connectSuccess() noexcept override {
+      const std::string req = "GET " + path_ + " HTTP/1.1\r\nHost: " +
+        host_ + "\r\n\r\n";
+      sock_->write(nullptr, req.data(), req.size());
+      sock_->setReadCB(this);
+    }
+    void connectErr(const folly::AsyncSocketException&)
+      noexcept override {
+      sock_->close();
+    }
+    void getReadBuffer(void** buf, size_t* len) noexcept override {
+      *buf = buf_;
+      *len = sizeof(buf_);
+    }
+    void readDataAvailable(size_t len) noexcept override {
+      response.append(buf_, len);
+      if (response.find("main") != std::string::npos ||
+          response.find("group") != std::string::npos) {
+        sock_->close();
+      }
+    }
+    void readEOF() noexcept override {
+      sock_->close();
+    }
+    void readError(const folly::AsyncSocketException&) noexcept override {
+      sock_->close();
+    }
+
+    std::string response;
+
+   private:
+    folly::AsyncSocket* sock_{nullptr};
+    const std::string host_;
+    const std::string path_;
+    char buf_[1024];
+  };
+
+  // {Host, path, the chain that answers}
+  const std::vector<std::vector<std::string>> requests = {
+    {"localhost", "/", "main"},
+    {"www.tenant.com:8080", "/", "group"},
+    {"WWW.TENANT.COM", "/", "group"},
+    {"tenant.com", "/", "main"},
+    {"localhost", "/tenant/index.html", "group"},
+    {"localhost", "/tenants", "main"},
+  };
+
+  folly::EventBase evb;
+  std::vector<folly::AsyncSocket::UniquePtr> socks;
+  std::vector<std::unique_ptr<Cb>> cbs;
+  for (auto& request: requests) {
+    socks.emplace_back(new folly::AsyncSocket(&evb));
+    cbs.emplace_back(new Cb(socks.back().get(), request[0], request[1]));
+    socks.back()->connect(cbs.back().get(),
+                          server->addresses().front().address, 1000);
+  }
+  evb.loop();
+  for (size_t i = 0; i < requests.size(); i++) {
+    EXPECT_EQ(0, cbs[i]->response.find("HTTP/1.1 200 OK")) << i;
+    EXPECT_NE(std::string::npos, cbs[i]->response.find(requests[i][2]))
+      << i;
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/HeavyHittersFilter.h>
+#include <thread>
+
+using namespace proxygen;
+using namespace testing;
+
+namespace {
+
+std::unique_ptr<HTTPMessage> makeRequest(const std::string& path,
+                                         const std::string& host,
+                                         const std::string& clientIP) {
+  auto msg = folly::make_unique<HTTPMessage>();
+  msg->setURL(path);
+  msg->getHeaders().set(HTTP_HEADER_HOST, host);
+  msg->setClientAddress(folly::SocketAddress(clientIP, 1234));
+  return msg;
+}
+
+typedef HeavyHittersRegistry::Dimension Dimension;
+
+}
+
+TEST(HeavyHittersFilterTest, CountsRequests) {
+  HeavyHittersRegistry registry(4, std::chrono::milliseconds(0));
+  MockRequestHandler handler;
+  EXPECT_CALL(handler, onRequest(_)).Times(5);
+  for (int i = 0; i < 5; i++) {
+    auto filter = new HeavyHittersFilter(&handler, &registry);
+    filter->onRequest(makeRequest(i < 3 ? "/hot" : "/cold",
+                                  "example.com",
+                                  i == 0 ? "10.0.0.1" : "10.0.0.2"));
+    EXPECT_CALL(handler, requestComplete());
+    filter->requestComplete();
+  }
+
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(5, snapshot->getTotal(Dimension::PATH));
+  const auto& paths = snapshot->getTop(Dimension::PATH);
+  ASSERT_EQ(2, paths.size());
+  EXPECT_EQ("/hot", paths[0].key);
+  EXPECT_EQ(3, paths[0].count);
+  EXPECT_EQ("/cold", paths[1].key);
+  const auto& hosts = snapshot->getTop(Dimension::HOST);
+  ASSERT_EQ(1, hosts.size());
+  EXPECT_EQ("example.com", hosts[0].key);
+  EXPECT_EQ(5, hosts[0].count);
+  const auto& clients = snapshot->getTop(Dimension::CLIENT_IP);
+  ASSERT_EQ(2, clients.size());
+  EXPECT_EQ("10.0.0.2", clients[0].key);
+  EXPECT_EQ(4, clients[0].count);
+}
+
+TEST(HeavyHittersFilterTest, MergesThreads) {
+  HeavyHittersRegistry registry(8, std::chrono::hours(1));
+  // merged once, then served from the cache
+  EXPECT_EQ(0, registry.getSnapshot()->getTotal(Dimension::PATH));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&registry, i] {
+        for (int j = 0; j < 1000; j++) {
+          registry.record(*makeRequest(
+                            j % 2 ? "/shared" : folly::to<std::string>("/", i),
+                            "example.com", "10.0.0.1"));
+        }
+      });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, registry.getSnapshot()->getTotal(Dimension::PATH));
+
+  HeavyHittersRegistry fresh(8, std::chrono::milliseconds(0));
+  for (int i = 0; i < 2; i++) {
+    std::thread([&fresh, i] {
+        for (int j = 0; j < 100; j++) {
+          fresh.record(*makeRequest(j % 2 ? "/shared" : "/own",
+                                    "example.com", "10.0.0.1"));
+        }
+      }).join();
+  }
+  auto snapshot = fresh.getSnapshot();
+  EXPECT_EQ(200, snapshot->getTotal(Dimension::PATH));
+  const auto& paths = snapshot->getTop(Dimension::PATH);
+  ASSERT_EQ(2, paths.size());
+  EXPECT_EQ(100, paths[0].count);
+  EXPECT_EQ(100, paths[1].count);
+}
+
+TEST(HeavyHittersFilterTest, Decays) {
+  HeavyHittersRegistry registry(4, std::chrono::milliseconds(0),
+                                std::chrono::milliseconds(10));
+  for (int i = 0; i < 100; i++) {
+    registry.record(*makeRequest("/old", "example.com", "10.0.0.1"));
+  }
+  EXPECT_EQ(100, registry.getSnapshot()->getTotal(Dimension::PATH));
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  // halved at least twice
+  EXPECT_LE(registry.getSnapshot()->getTotal(Dimension::PATH), 25);
+}
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/IdleReaper.h>
+
+using namespace proxygen;
+
+using folly::wangle::ManagedConnection;
+using std::chrono::milliseconds;
+
+namespace {
+
+class TestConnection : public ManagedConnection {
+ public:
+  TestConnection(int id, std::vector<int>* closed)
+      : id_(id), closed_(closed) {}
+
+  void timeoutExpired() noexcept override {
+  }
+  void describe(std::ostream& os) const override {
+  }
+  bool isBusy() const override {
+    return false;
+  }
+  void notifyPendingShutdown() override {
+  }
+  void closeWhenIdle() override {
+    closed_->push_back(id_);
+    if (reaper) {
+      reaper->remove(this);
+    }
+  }
+  void dropConnection() override {
+  }
+  void dumpConnectionState(uint8_t loglevel) override {
+  }
+
+  IdleReaper* reaper{nullptr};
+
+ private:
+  int id_;
+  std::vector<int>* closed_;
+};
+
+}
+
+TEST(IdleReaperTest, Pressure) {
+  folly::EventBase evb;
+  IdleReaper reaper(&evb, milliseconds(1000), milliseconds(200), 100, 0.5);
+  EXPECT_EQ(reaper.getPressure(), 0);
+  EXPECT_EQ(reaper.getIdleTimeout(), milliseconds(1000));
+  reaper.setConnections(50);
+  EXPECT_EQ(reaper.getPressure(), 0);
+  reaper.setConnections(75);
+  EXPECT_DOUBLE_EQ(reaper.getPressure(), 0.5);
+  EXPECT_EQ(reaper.getIdleTimeout(), milliseconds(600));
+  reaper.setConnections(120);
+  EXPECT_EQ(reaper.getPressure(), 1);
+  EXPECT_EQ(reaper.getIdleTimeout(), milliseconds(200));
+}
+
+TEST(IdleReaperTest, EvictOldest) {
+  folly::EventBase evb;
+  std::vector<int> closed;
+  IdleReaper reaper(&evb, milliseconds(1000), milliseconds(200), 10, 0.5);
+  std::vector<std::unique_ptr<TestConnection>> conns;
+  for (int i = 0; i < 3; ++i) {
+    conns.emplace_back(new TestConnection(i, &closed));
+    conns.back()->reaper = &reaper;
+    reaper.onIdle(conns.back().get());
+  }
+  // busy again, then idle the latest
+  reaper.remove(conns[0].get());
+  reaper.onIdle(conns[0].get());
+  EXPECT_EQ(reaper.getIdleConnections(), 3);
+
+  EXPECT_TRUE(reaper.evictOldest());
+  EXPECT_TRUE(reaper.evictOldest());
+  EXPECT_EQ(closed, std::vector<int>({1, 2}));
+  reaper.remove(conns[0].get());
+  EXPECT_FALSE(reaper.evictOldest());
+  EXPECT_EQ(reaper.getIdleConnections(), 0);
+}
+
+TEST(IdleReaperTest, NoPressure) {
+  folly::EventBase evb;
+  std::vector<int> closed;
+  IdleReaper reaper(&evb, milliseconds(1000), milliseconds(10), 10, 0.5);
+  TestConnection conn(0, &closed);
+  conn.reaper = &reaper;
+  reaper.onIdle(&conn);
+  reaper.setConnections(5);
+  evb.runAfterDelay([&] { evb.terminateLoopSoon(); }, 50);
+  evb.loopForever();
+  // the idle timeout of the connection applies
+  EXPECT_TRUE(closed.empty());
+  reaper.remove(&conn);
+}
+
+TEST(IdleReaperTest, ReapUnderPressure) {
+  folly::EventBase evb;
+  std::vector<int> closed;
+  IdleReaper reaper(&evb, milliseconds(10000), milliseconds(20), 4, 0.5);
+  TestConnection first(0, &closed);
+  TestConnection second(1, &closed);
+  first.reaper = &reaper;
+  second.reaper = &reaper;
+  reaper.onIdle(&first);
+  reaper.onIdle(&second);
+  reaper.setConnections(4);
+  EXPECT_EQ(reaper.getIdleTimeout(), milliseconds(20));
+  evb.runAfterDelay([&] { evb.terminateLoopSoon(); }, 200);
+  evb.loopForever();
+  EXPECT_EQ(closed, std::vector<int>({0, 1}));
+  EXPECT_EQ(reaper.getIdleConnections(), 0);
+}
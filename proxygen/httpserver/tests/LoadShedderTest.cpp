@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/LoadShedder.h>
+
+using namespace proxygen;
+
+using std::chrono::milliseconds;
+
+typedef LoadShedder::Criticality Criticality;
+
+TEST(LoadShedderTest, Criticality) {
+  LoadShedder shedder;
+  shedder.setCriticality("/api", Criticality::CRITICAL)
+    .setCriticality("/api/batch", Criticality::SHEDDABLE)
+    .setCriticality("/a", Criticality::SHEDDABLE);
+  EXPECT_EQ(Criticality::CRITICAL, shedder.getCriticality("/api/users"));
+  EXPECT_EQ(Criticality::SHEDDABLE, shedder.getCriticality("/api/batch/1"));
+  EXPECT_EQ(Criticality::SHEDDABLE, shedder.getCriticality("/about"));
+  EXPECT_EQ(Criticality::DEFAULT, shedder.getCriticality("/"));
+
+  shedder.setCriticality("/api/batch", Criticality::DEFAULT);
+  EXPECT_EQ(Criticality::DEFAULT, shedder.getCriticality("/api/batch/1"));
+}
+
+TEST(LoadShedderTest, Order) {
+  LoadShedder shedder;
+  shedder.setCriticality("/critical", Criticality::CRITICAL)
+    .setCriticality("/batch", Criticality::SHEDDABLE);
+  const milliseconds maxLag(160);
+
+  // nothing below the limit
+  EXPECT_FALSE(shedder.shouldReject("/batch", 7, maxLag, maxLag));
+
+  // just past it, only the least important requests
+  milliseconds lag(161);
+  EXPECT_TRUE(shedder.shouldReject("/batch", 7, lag, maxLag));
+  EXPECT_FALSE(shedder.shouldReject("/batch", 6, lag, maxLag));
+  EXPECT_FALSE(shedder.shouldReject("/", 7, lag, maxLag));
+
+  // all the sheddable ones, the lowest default ones
+  lag = milliseconds(241);
+  EXPECT_TRUE(shedder.shouldReject("/batch", 0, lag, maxLag));
+  EXPECT_TRUE(shedder.shouldReject("/", 7, lag, maxLag));
+  EXPECT_FALSE(shedder.shouldReject("/", 6, lag, maxLag));
+
+  lag = milliseconds(320);
+  EXPECT_TRUE(shedder.shouldReject("/", 0, lag, maxLag));
+  EXPECT_FALSE(shedder.shouldReject("/critical", 7, lag, maxLag));
+  EXPECT_FALSE(shedder.shouldReject("/critical", 7, lag * 10, maxLag));
+}
@@ -0,0 +1,670 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <deque>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/dynamic.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/json.h>
+#include <gflags/gflags.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <map>
+#include <proxygen/httpserver/ScopedHTTPServer.h>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+#include <proxygen/lib/utils/LatencyHistogram.h>
+#include <proxygen/lib/utils/Time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * Requests/sec and latency of an HTTPServer and HTTPUpstreamSession
+ * clients talking over loopback, to catch regressions in the sessions and
+ * the codecs. Runs every combination of the modes, payload sizes and
+ * client thread counts given, and prints one JSON object per line:
+ *
+ *   {"mode":"spdy","payload_bytes":1024,"client_threads":4,
+ *    "requests_per_sec":..., "latency_us":{"p50":...}, ...}
+ *
+ * The modes are
+ *   http1     HTTP/1.1 keep-alive, one request at a time per connection
+ *   pipeline  HTTP/1.1 with --depth requests pipelined per connection
+ *   spdy      SPDY/3.1 with --depth concurrent streams per connection
+ *
+ * To see how the server scales over cores, give several --server_threads,
+ * e.g. 1,2,4,8,16,32,64, and --clients_per_server_thread so that the load
+ * grows with them. Each line then also has the requests/sec per server
+ * thread, and "scaling", that rate over the one of the first server thread
+ * count of the sweep: 1 is linear. The clients share the machine, so pin
+ * them apart from the server (taskset) for the large counts.
+ *
+ * With --perf_counters each line gets the hardware and software counters
+ * of the whole process over the run, in total and per request: cycles,
+ * instructions, cache misses, context switches, CPU migrations, and the
+ * futex calls when the syscalls tracepoints are readable. Where the
+ * server stops scaling, the counter that grows per request points at the
+ * contention: cache misses for shared lines (stats, singletons, the
+ * allocator), futex calls and voluntary context switches for locks and
+ * the shared accept socket. perf_event_open may need
+ * kernel.perf_event_paranoid <= 1; the rusage context switches are always
+ * there.
+ */
+
+DEFINE_string(modes, "http1,pipeline,spdy", "Comma separated modes");
+DEFINE_string(payload_sizes, "0,1024,65536",
+              "Comma separated response body sizes, in bytes");
+DEFINE_string(client_threads, "1,4", "Comma separated client thread counts");
+DEFINE_string(server_threads, "4", "Comma separated server thread counts");
+DEFINE_int32(clients_per_server_thread, 0, "If set, client threads per "
+             "server thread, instead of --client_threads");
+DEFINE_bool(perf_counters, false, "Record perf counters for each run");
+DEFINE_int32(connections, 4, "Connections per client thread");
+DEFINE_int32(depth, 16, "Requests in flight per connection, for pipeline "
+             "and spdy");
+DEFINE_int32(requests, 20000, "Requests per client thread");
+
+using namespace proxygen;
+
+using apache::thrift::transport::TTransportException;
+using folly::EventBase;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::SocketAddress;
+using std::string;
+
+namespace {
+
+enum class Mode {
+  HTTP1,
+  PIPELINE,
+  SPDY,
+};
+
+// the body every response is a prefix of
+string gPayload;
+
+class Client;
+
+class Connection {
+ public:
+  explicit Connection(Client* client): client_(client) {
+  }
+
+  virtual ~Connection() {}
+
+  virtual void start(const SocketAddress& addr) = 0;
+
+ protected:
+  Client* const client_;
+};
+
+/**
+ * A client thread: its connections share its EventBase, and take the
+ * requests left until it made --requests, so that the fast ones make more
+ */
+class Client {
+ public:
+  Client(Mode mode, size_t payloadSize, const SocketAddress& addr)
+      : mode_(mode),
+        addr_(addr),
+        url_(folly::to<string>("/?size=", payloadSize)),
+        remaining_(FLAGS_requests),
+        timeouts_(new AsyncTimeoutSet(&evb_, std::chrono::seconds(10))) {
+  }
+
+  void run();
+
+  bool takeRequest() {
+    if (remaining_ == 0) {
+      return false;
+    }
+    remaining_--;
+    return true;
+  }
+
+  void record(bool ok, TimePoint start) {
+    if (ok) {
+      requests_++;
+      latency_.addValue(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          getCurrentTime() - start).count());
+    } else {
+      errors_++;
+    }
+  }
+
+  void recordErrors(uint64_t errors) {
+    errors_ += errors;
+  }
+
+  HTTPMessage makeRequest() const {
+    HTTPMessage req;
+    req.setMethod(HTTPMethod::GET);
+    req.setHTTPVersion(1, 1);
+    req.setURL(url_);
+    req.getHeaders().set(HTTP_HEADER_HOST, "localhost");
+    return req;
+  }
+
+  EventBase* getEventBase() {
+    return &evb_;
+  }
+
+  AsyncTimeoutSet* getTimeouts() {
+    return timeouts_.get();
+  }
+
+  uint64_t getRequests() const {
+    return requests_;
+  }
+
+  uint64_t getErrors() const {
+    return errors_;
+  }
+
+  const LatencyHistogram& getLatency() const {
+    return latency_;
+  }
+
+ private:
+  const Mode mode_;
+  const SocketAddress addr_;
+  const string url_;
+  uint64_t remaining_;
+  uint64_t requests_{0};
+  uint64_t errors_{0};
+  // microseconds
+  LatencyHistogram latency_;
+  EventBase evb_;
+  AsyncTimeoutSet::UniquePtr timeouts_;
+  std::vector<std::unique_ptr<Connection>> connections_;
+};
+
+/**
+ * The requests of an HTTPUpstreamSession, one at a time over HTTP/1.1 and
+ * --depth at a time over SPDY
+ */
+class SessionConnection : public Connection,
+                          private HTTPConnector::Callback {
+ public:
+  SessionConnection(Client* client, const string& proto, size_t depth)
+      : Connection(client),
+        connector_(this, client->getTimeouts(), proto),
+        depth_(depth) {
+  }
+
+  void start(const SocketAddress& addr) override {
+    connector_.connect(client_->getEventBase(), addr,
+                       std::chrono::milliseconds(1000));
+  }
+
+  void requestDone(bool ok, TimePoint start) {
+    client_->record(ok, start);
+    outstanding_--;
+    // the session only takes the next HTTP/1.1 request once this one is
+    // detached from it
+    client_->getEventBase()->runInLoop([this] { sendRequests(); });
+  }
+
+ private:
+  class Request : public HTTPTransactionHandler {
+   public:
+    explicit Request(SessionConnection* conn)
+        : conn_(conn),
+          start_(getCurrentTime()) {
+    }
+
+    void setTransaction(HTTPTransaction*) noexcept override {}
+
+    void detachTransaction() noexcept override {
+      conn_->requestDone(ok_ && complete_, start_);
+      delete this;
+    }
+
+    void onHeadersComplete(std::unique_ptr<HTTPMessage> msg)
+        noexcept override {
+      ok_ = (msg->getStatusCode() == 200);
+    }
+
+    void onBody(std::unique_ptr<IOBuf>) noexcept override {}
+
+    void onEOM() noexcept override {
+      complete_ = true;
+    }
+
+    void onUpgrade(UpgradeProtocol) noexcept override {}
+
+    void onError(const HTTPException&) noexcept override {
+      ok_ = false;
+    }
+
+    void onEgressPaused() noexcept override {}
+
+    void onEgressResumed() noexcept override {}
+
+   private:
+    SessionConnection* const conn_;
+    const TimePoint start_;
+    bool ok_{false};
+    bool complete_{false};
+  };
+
+  void connectSuccess(HTTPUpstreamSession* session) override {
+    session_ = session;
+    sendRequests();
+  }
+
+  void connectError(const TTransportException& ex) override {
+    LOG(ERROR) << "connect failed: " << ex.what();
+  }
+
+  void sendRequests() {
+    if (!session_) {
+      return;
+    }
+    while (outstanding_ < depth_ && client_->takeRequest()) {
+      auto request = new Request(this);
+      auto txn = session_->newTransaction(request);
+      if (!txn) {
+        delete request;
+        client_->recordErrors(1);
+        continue;
+      }
+      outstanding_++;
+      auto msg = client_->makeRequest();
+      txn->sendHeaders(msg);
+      txn->sendEOM();
+    }
+    if (outstanding_ == 0) {
+      session_->drain();
+      session_ = nullptr;
+    }
+  }
+
+  HTTPConnector connector_;
+  const size_t depth_;
+  HTTPUpstreamSession* session_{nullptr};
+  size_t outstanding_{0};
+};
+
+/**
+ * --depth HTTP/1.1 requests pipelined on a socket, written and parsed
+ * with an HTTP1xCodec since HTTPUpstreamSession doesn't pipeline
+ */
+class PipelineConnection : public Connection,
+                           private folly::AsyncSocket::ConnectCallback,
+                           private folly::AsyncTransport::ReadCallback,
+                           private HTTPCodec::Callback {
+ public:
+  PipelineConnection(Client* client, size_t depth)
+      : Connection(client),
+        codec_(TransportDirection::UPSTREAM),
+        depth_(depth),
+        sock_(new folly::AsyncSocket(client->getEventBase())) {
+    codec_.setCallback(this);
+  }
+
+  void start(const SocketAddress& addr) override {
+    sock_->connect(this, addr, 1000);
+  }
+
+ private:
+  void connectSuccess() noexcept override {
+    sock_->setReadCB(this);
+    sendRequests();
+  }
+
+  void connectErr(const folly::AsyncSocketException& ex) noexcept override {
+    LOG(ERROR) << "connect failed: " << ex.what();
+  }
+
+  void getReadBuffer(void** buf, size_t* len) noexcept override {
+    auto space = readBuf_.preallocate(4000, 65536);
+    *buf = space.first;
+    *len = space.second;
+  }
+
+  void readDataAvailable(size_t len) noexcept override {
+    readBuf_.postallocate(len);
+    while (!readBuf_.empty()) {
+      size_t consumed = codec_.onIngress(*readBuf_.front());
+      if (consumed == 0) {
+        break;
+      }
+      readBuf_.trimStart(consumed);
+    }
+  }
+
+  void readEOF() noexcept override {
+    close();
+  }
+
+  void readError(const folly::AsyncSocketException&) noexcept override {
+    close();
+  }
+
+  void onMessageBegin(HTTPCodec::StreamID, HTTPMessage*) override {}
+
+  void onHeadersComplete(HTTPCodec::StreamID,
+                         std::unique_ptr<HTTPMessage> msg) override {
+    ok_ = (msg->getStatusCode() == 200);
+  }
+
+  void onBody(HTTPCodec::StreamID, std::unique_ptr<IOBuf>) override {}
+
+  void onTrailersComplete(HTTPCodec::StreamID,
+                          std::unique_ptr<HTTPHeaders>) override {}
+
+  void onMessageComplete(HTTPCodec::StreamID, bool) override {
+    CHECK(!starts_.empty());
+    client_->record(ok_, starts_.front());
+    starts_.pop_front();
+    ok_ = false;
+    sendRequests();
+  }
+
+  void onError(HTTPCodec::StreamID, const HTTPException& error,
+               bool) override {
+    LOG(ERROR) << "parse error: " << error.what();
+    close();
+  }
+
+  void sendRequests() {
+    IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+    auto msg = client_->makeRequest();
+    while (starts_.size() < depth_ && client_->takeRequest()) {
+      auto stream = codec_.createStream();
+      codec_.generateHeader(writeBuf, stream, msg);
+      codec_.generateEOM(writeBuf, stream);
+      starts_.push_back(getCurrentTime());
+    }
+    if (!writeBuf.empty()) {
+      sock_->writeChain(nullptr, writeBuf.move());
+    } else if (starts_.empty()) {
+      close();
+    }
+  }
+
+  void close() {
+    client_->recordErrors(starts_.size());
+    starts_.clear();
+    sock_->setReadCB(nullptr);
+    sock_->close();
+  }
+
+  HTTP1xCodec codec_;
+  const size_t depth_;
+  folly::AsyncSocket::UniquePtr sock_;
+  IOBufQueue readBuf_{IOBufQueue::cacheChainLength()};
+  // when each request in flight was written, oldest first
+  std::deque<TimePoint> starts_;
+  bool ok_{false};
+};
+
+void Client::run() {
+  for (int i = 0; i < FLAGS_connections; i++) {
+    Connection* conn = nullptr;
+    switch (mode_) {
+      case Mode::HTTP1:
+        conn = new SessionConnection(this, "http/1.1", 1);
+        break;
+      case Mode::PIPELINE:
+        conn = new PipelineConnection(this, FLAGS_depth);
+        break;
+      case Mode::SPDY:
+        conn = new SessionConnection(this, "spdy/3.1", FLAGS_depth);
+        break;
+    }
+    connections_.emplace_back(conn);
+    conn->start(addr_);
+  }
+  evb_.loop();
+  connections_.clear();
+}
+
+/**
+ * Counters of the calling thread and of the threads it starts from now on,
+ * which only add theirs once they exited: the server and the clients must
+ * be gone before stop()
+ */
+class PerfCounters {
+ public:
+  PerfCounters() {
+    add("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    add("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    add("cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    add("context_switches", PERF_TYPE_SOFTWARE,
+        PERF_COUNT_SW_CONTEXT_SWITCHES);
+    add("cpu_migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+    auto futex = getTracepoint("syscalls/sys_enter_futex");
+    if (futex >= 0) {
+      add("futex_calls", PERF_TYPE_TRACEPOINT, futex);
+    }
+    getrusage(RUSAGE_SELF, &usage_);
+  }
+
+  ~PerfCounters() {
+    for (auto& counter: counters_) {
+      close(counter.second);
+    }
+  }
+
+  /**
+   * @return the counts, and the counts per request
+   */
+  folly::dynamic stop(uint64_t requests) {
+    folly::dynamic counts = folly::dynamic::object;
+    for (auto& counter: counters_) {
+      ioctl(counter.second, PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t value = 0;
+      if (read(counter.second, &value, sizeof(value)) == sizeof(value)) {
+        counts[counter.first] = int64_t(value);
+      }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    counts["voluntary_switches"] = int64_t(usage.ru_nvcsw - usage_.ru_nvcsw);
+    counts["involuntary_switches"] =
+      int64_t(usage.ru_nivcsw - usage_.ru_nivcsw);
+
+    folly::dynamic perRequest = folly::dynamic::object;
+    for (auto& count: counts.items()) {
+      perRequest[count.first] =
+        requests ? double(count.second.asInt()) / requests : 0.0;
+    }
+    return folly::dynamic::object
+      ("total", counts)
+      ("per_request", perRequest);
+  }
+
+ private:
+  void add(const char* name, uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = (type == PERF_TYPE_HARDWARE);
+    attr.exclude_hv = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+      LOG(WARNING) << "No " << name << " counter: "
+                   << folly::errnoStr(errno);
+      return;
+    }
+    counters_.emplace_back(name, fd);
+  }
+
+  static int64_t getTracepoint(const string& event) {
+    for (const char* dir: {"/sys/kernel/tracing/events/",
+                           "/sys/kernel/debug/tracing/events/"}) {
+      FILE* f = fopen((dir + event + "/id").c_str(), "r");
+      if (!f) {
+        continue;
+      }
+      long long id = -1;
+      if (fscanf(f, "%lld", &id) != 1) {
+        id = -1;
+      }
+      fclose(f);
+      return id;
+    }
+    return -1;
+  }
+
+  std::vector<std::pair<string, int>> counters_;
+  struct rusage usage_;
+};
+
+folly::dynamic runOnce(Mode mode, const string& modeName,
+                       size_t payloadSize, uint32_t threads,
+                       const SocketAddress& addr) {
+  std::vector<std::unique_ptr<Client>> clients;
+  for (uint32_t i = 0; i < threads; i++) {
+    clients.emplace_back(new Client(mode, payloadSize, addr));
+  }
+  auto start = getCurrentTime();
+  std::vector<std::thread> workers;
+  for (auto& client: clients) {
+    workers.emplace_back([&client] { client->run(); });
+  }
+  for (auto& worker: workers) {
+    worker.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+    getCurrentTime() - start);
+
+  uint64_t requests = 0;
+  uint64_t errors = 0;
+  LatencyHistogram latency;
+  for (const auto& client: clients) {
+    requests += client->getRequests();
+    errors += client->getErrors();
+    latency.merge(client->getLatency());
+  }
+  double seconds = elapsed.count() / 1e6;
+
+  folly::dynamic latencyUs = folly::dynamic::object
+    ("avg", int64_t(latency.getMean()))
+    ("p50", int64_t(latency.getPercentile(50)))
+    ("p90", int64_t(latency.getPercentile(90)))
+    ("p99", int64_t(latency.getPercentile(99)))
+    ("p999", int64_t(latency.getPercentile(99.9)));
+  return folly::dynamic::object
+    ("mode", modeName)
+    ("payload_bytes", int64_t(payloadSize))
+    ("client_threads", int64_t(threads))
+    ("connections", int64_t(threads * FLAGS_connections))
+    ("depth", mode == Mode::HTTP1 ? 1 : FLAGS_depth)
+    ("requests", int64_t(requests))
+    ("errors", int64_t(errors))
+    ("seconds", seconds)
+    ("requests_per_sec", seconds > 0 ? requests / seconds : 0)
+    ("latency_us", latencyUs);
+}
+
+template <typename T>
+std::vector<T> splitFlag(const string& flag) {
+  std::vector<folly::StringPiece> pieces;
+  folly::split(',', flag, pieces);
+  std::vector<T> values;
+  for (auto piece: pieces) {
+    values.push_back(folly::to<T>(piece));
+  }
+  return values;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  auto modes = splitFlag<string>(FLAGS_modes);
+  auto payloadSizes = splitFlag<size_t>(FLAGS_payload_sizes);
+  auto clientThreads = splitFlag<uint32_t>(FLAGS_client_threads);
+  auto serverThreads = splitFlag<uint32_t>(FLAGS_server_threads);
+  size_t maxPayload = 0;
+  for (auto size: payloadSizes) {
+    maxPayload = std::max(maxPayload, size);
+  }
+  gPayload.assign(maxPayload, 'x');
+
+  auto handler = [] (const HTTPMessage& req, std::unique_ptr<IOBuf>,
+                     ResponseBuilder& resp) {
+    size_t size = std::min<size_t>(req.getIntQueryParam("size", 0),
+                                   gPayload.size());
+    resp.status(200, "OK")
+      .body(IOBuf::copyBuffer(gPayload.data(), size));
+  };
+
+  for (const auto& modeName: modes) {
+    Mode mode = Mode::HTTP1;
+    auto protocol = HTTPServer::Protocol::HTTP;
+    if (modeName == "http1") {
+      mode = Mode::HTTP1;
+    } else if (modeName == "pipeline") {
+      mode = Mode::PIPELINE;
+    } else if (modeName == "spdy") {
+      mode = Mode::SPDY;
+      protocol = HTTPServer::Protocol::SPDY;
+    } else {
+      LOG(FATAL) << "unknown mode " << modeName;
+    }
+
+    for (auto payloadSize: payloadSizes) {
+      // the first rate per server thread of each sweep, by client threads
+      std::map<size_t, double> baseRates;
+      for (auto servers: serverThreads) {
+        auto clientCounts = clientThreads;
+        if (FLAGS_clients_per_server_thread > 0) {
+          clientCounts = {servers * FLAGS_clients_per_server_thread};
+        }
+        for (size_t i = 0; i < clientCounts.size(); i++) {
+          // a server per run, so that the counters only have its threads
+          std::unique_ptr<PerfCounters> counters;
+          if (FLAGS_perf_counters) {
+            counters.reset(new PerfCounters());
+          }
+          auto server = ScopedHTTPServer::start(handler, 0, servers,
+                                                protocol);
+          SocketAddress addr("127.0.0.1", server->getPort());
+          auto result = runOnce(mode, modeName, payloadSize,
+                                clientCounts[i], addr);
+          server.reset();
+
+          double rate = result["requests_per_sec"].asDouble() / servers;
+          auto base = baseRates.emplace(i, rate).first->second;
+          result["server_threads"] = int64_t(servers);
+          result["requests_per_sec_per_server_thread"] = rate;
+          if (serverThreads.size() > 1) {
+            result["scaling"] = base > 0 ? rate / base : 0.0;
+          }
+          if (counters) {
+            result["counters"] =
+              counters->stop(result["requests"].asInt());
+          }
+          std::cout << folly::toJson(result) << std::endl;
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/RangeFilter.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+const std::string kBody = "0123456789abcdefghij";
+
+HTTPMessage makeResponse() {
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.getHeaders().set(HTTP_HEADER_CONTENT_TYPE, "text/plain");
+  resp.getHeaders().set(HTTP_HEADER_CONTENT_LENGTH,
+                        folly::to<std::string>(kBody.size()));
+  resp.getHeaders().set(HTTP_HEADER_ETAG, "\"v1\"");
+  return resp;
+}
+
+}
+
+class RangeFilterTest : public Test {
+ protected:
+  RangeFilter* makeFilter(const std::string& range,
+                          const std::string& ifRange = "") {
+    auto filter = new RangeFilter(&handler_);
+    downstream_.reset(new MockResponseHandler(filter));
+    EXPECT_CALL(handler_, setResponseHandler(filter));
+    filter->setResponseHandler(downstream_.get());
+    auto req = folly::make_unique<HTTPMessage>();
+    req->setMethod(HTTPMethod::GET);
+    req->setURL("/video.mp4");
+    if (!range.empty()) {
+      req->getHeaders().set(HTTP_HEADER_RANGE, range);
+    }
+    if (!ifRange.empty()) {
+      req->getHeaders().set(HTTP_HEADER_IF_RANGE, ifRange);
+    }
+    EXPECT_CALL(handler_, onRequest(_));
+    filter->onRequest(std::move(req));
+    EXPECT_CALL(*downstream_, sendHeaders(_))
+      .WillOnce(Invoke([this] (HTTPMessage& msg) { response_ = msg; }));
+    EXPECT_CALL(*downstream_, sendBody(_))
+      .WillRepeatedly(Invoke([this] (std::shared_ptr<IOBuf> body) {
+            auto data = body->clone();
+            data->coalesce();
+            body_.append((const char*)data->data(), data->length());
+          }));
+    EXPECT_CALL(*downstream_, sendFileRegion(_))
+      .WillRepeatedly(Invoke([this] (const FileRegion& region) {
+            body_ += kBody.substr(region.getOffset(), region.getLength());
+          }));
+    EXPECT_CALL(*downstream_, sendEOM());
+    return filter;
+  }
+
+  // the body in IOBufs of chunkSize bytes
+  void sendResponse(RangeFilter* filter, size_t chunkSize) {
+    auto resp = makeResponse();
+    filter->sendHeaders(resp);
+    for (size_t i = 0; i < kBody.size(); i += chunkSize) {
+      filter->sendBody(IOBuf::copyBuffer(kBody.substr(i, chunkSize)));
+    }
+    filter->sendEOM();
+    EXPECT_CALL(handler_, requestComplete());
+    filter->requestComplete();
+  }
+
+  const std::string& getHeader(HTTPHeaderCode code) const {
+    return response_.getHeaders().getSingleOrEmpty(code);
+  }
+
+  MockRequestHandler handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+  HTTPMessage response_;
+  std::string body_;
+};
+
+TEST_F(RangeFilterTest, SingleRange) {
+  for (size_t chunkSize: {1, 3, 20}) {
+    body_.clear();
+    sendResponse(makeFilter("bytes=5-12"), chunkSize);
+    EXPECT_EQ(206, response_.getStatusCode());
+    EXPECT_EQ("bytes 5-12/20", getHeader(HTTP_HEADER_CONTENT_RANGE));
+    EXPECT_EQ("8", getHeader(HTTP_HEADER_CONTENT_LENGTH));
+    EXPECT_EQ("bytes", getHeader(HTTP_HEADER_ACCEPT_RANGES));
+    EXPECT_EQ("56789abc", body_);
+  }
+}
+
+TEST_F(RangeFilterTest, FileRegions) {
+  auto filter = makeFilter("bytes=-4");
+  auto resp = makeResponse();
+  filter->sendHeaders(resp);
+  auto file = std::make_shared<folly::File>();
+  filter->sendFileRegion(FileRegion(file, 0, 10));
+  filter->sendFileRegion(FileRegion(file, 10, 10));
+  filter->sendEOM();
+  EXPECT_EQ(206, response_.getStatusCode());
+  EXPECT_EQ("ghij", body_);
+  EXPECT_CALL(handler_, requestComplete());
+  filter->requestComplete();
+}
+
+TEST_F(RangeFilterTest, Multipart) {
+  sendResponse(makeFilter("bytes=15-, 0-1,1-2"), 4);
+  EXPECT_EQ(206, response_.getStatusCode());
+  const std::string& type = getHeader(HTTP_HEADER_CONTENT_TYPE);
+  const std::string prefix = "multipart/byteranges; boundary=";
+  ASSERT_EQ(0, type.find(prefix));
+  std::string boundary = type.substr(prefix.size());
+  // sorted, and the first two merged
+  std::string expected =
+    "\r\n--" + boundary + "\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Range: bytes 0-2/20\r\n\r\n"
+    "012"
+    "\r\n--" + boundary + "\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Range: bytes 15-19/20\r\n\r\n"
+    "fghij"
+    "\r\n--" + boundary + "--\r\n";
+  EXPECT_EQ(expected, body_);
+  EXPECT_EQ(folly::to<std::string>(expected.size()),
+            getHeader(HTTP_HEADER_CONTENT_LENGTH));
+}
+
+TEST_F(RangeFilterTest, Unsatisfiable) {
+  sendResponse(makeFilter("bytes=20-"), 5);
+  EXPECT_EQ(416, response_.getStatusCode());
+  EXPECT_EQ("bytes */20", getHeader(HTTP_HEADER_CONTENT_RANGE));
+  EXPECT_EQ("0", getHeader(HTTP_HEADER_CONTENT_LENGTH));
+  EXPECT_EQ("", body_);
+}
+
+TEST_F(RangeFilterTest, WholeBody) {
+  // no Range, a malformed one, or one in another unit
+  for (auto range: {"", "bytes=5", "items=1-2"}) {
+    body_.clear();
+    sendResponse(makeFilter(range), 7);
+    EXPECT_EQ(200, response_.getStatusCode());
+    EXPECT_EQ(kBody, body_);
+  }
+  body_.clear();
+  sendResponse(makeFilter("bytes=1-2", "\"v0\""), 7);
+  EXPECT_EQ(200, response_.getStatusCode());
+  EXPECT_EQ("bytes", getHeader(HTTP_HEADER_ACCEPT_RANGES));
+  EXPECT_EQ(kBody, body_);
+
+  body_.clear();
+  sendResponse(makeFilter("bytes=1-2", "\"v1\""), 7);
+  EXPECT_EQ(206, response_.getStatusCode());
+  EXPECT_EQ("12", body_);
+}
+
+TEST_F(RangeFilterTest, PassesThrough) {
+  // no Content-Length
+  auto filter = makeFilter("bytes=1-2");
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  filter->sendHeaders(resp);
+  filter->sendBody(IOBuf::copyBuffer(kBody));
+  filter->sendEOM();
+  EXPECT_EQ(200, response_.getStatusCode());
+  EXPECT_FALSE(response_.getHeaders().exists(HTTP_HEADER_ACCEPT_RANGES));
+  EXPECT_EQ(kBody, body_);
+  EXPECT_CALL(handler_, requestComplete());
+  filter->requestComplete();
+}
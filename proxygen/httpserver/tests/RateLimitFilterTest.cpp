@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/filters/RateLimitFilter.h>
+#include <thread>
+
+using namespace proxygen;
+using namespace testing;
+
+using std::chrono::milliseconds;
+
+TEST(RateLimiterTest, RefillsOverTime) {
+  // 10 per second, in bursts of 3
+  RateLimiter limiter(10, 3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(limiter.admit("a", milliseconds(5000)));
+  }
+  EXPECT_FALSE(limiter.admit("a", milliseconds(5000)));
+  // the other keys have their own buckets
+  EXPECT_TRUE(limiter.admit("b", milliseconds(5000)));
+  EXPECT_FALSE(limiter.admit("a", milliseconds(5050)));
+  EXPECT_TRUE(limiter.admit("a", milliseconds(5110)));
+  EXPECT_FALSE(limiter.admit("a", milliseconds(5110)));
+  // never more than the burst
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(limiter.admit("a", milliseconds(60000)));
+  }
+  EXPECT_FALSE(limiter.admit("a", milliseconds(60000)));
+  // a thread that read the clock a little earlier gets no refill
+  EXPECT_FALSE(limiter.admit("a", milliseconds(59990)));
+}
+
+TEST(RateLimiterTest, ReplacesIdleKeys) {
+  // a single shard of four slots
+  RateLimiter limiter(1, 1, 4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(limiter.admit(folly::to<std::string>(i),
+                              milliseconds(1000 + i)));
+  }
+  // the fifth key takes over the bucket of "0", which starts full
+  EXPECT_TRUE(limiter.admit("4", milliseconds(1004)));
+  EXPECT_FALSE(limiter.admit("4", milliseconds(1004)));
+  EXPECT_FALSE(limiter.admit("3", milliseconds(1004)));
+}
+
+TEST(RateLimiterTest, CountsAcrossThreads) {
+  RateLimiter limiter(1, 1000);
+  std::atomic<uint32_t> admitted{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&limiter, &admitted] {
+        for (int j = 0; j < 1000; j++) {
+          if (limiter.admit("shared", milliseconds(1000))) {
+            ++admitted;
+          }
+        }
+      });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1000, admitted.load());
+}
+
+TEST(RateLimiterTest, KeysByClientIP) {
+  RateLimiter limiter(1, 1);
+  EXPECT_TRUE(limiter.admit(folly::SocketAddress("10.0.0.1", 1234)));
+  EXPECT_FALSE(limiter.admit(folly::SocketAddress("10.0.0.1", 5678)));
+  EXPECT_TRUE(limiter.admit(folly::SocketAddress("10.0.0.2", 1234)));
+}
+
+TEST(RateLimitFilterTest, RejectsOverLimit) {
+  RateLimiter limiter(1, 1);
+  RateLimitFilterFactory factory(&limiter,
+                                 RateLimitFilterFactory::KeyType::HEADER,
+                                 "X-Api-Key");
+  MockRequestHandler handler;
+  HTTPMessage msg;
+  msg.setURL("/");
+  // without the header, never limited
+  EXPECT_EQ(&handler, factory.onRequest(&handler, &msg));
+  EXPECT_EQ(&handler, factory.onRequest(&handler, &msg));
+
+  msg.getHeaders().set("X-Api-Key", "abc");
+  EXPECT_EQ(&handler, factory.onRequest(&handler, &msg));
+  auto filter = factory.onRequest(&handler, &msg);
+  ASSERT_NE(&handler, filter);
+
+  MockResponseHandler downstream(filter);
+  EXPECT_CALL(handler, setResponseHandler(filter));
+  filter->setResponseHandler(&downstream);
+  HTTPMessage response;
+  EXPECT_CALL(handler, onError(kErrorDropped));
+  EXPECT_CALL(handler, onRequest(_)).Times(0);
+  EXPECT_CALL(downstream, sendHeaders(_))
+    .WillOnce(Invoke([&] (HTTPMessage& resp) { response = resp; }));
+  EXPECT_CALL(downstream, sendEOM());
+  filter->onRequest(folly::make_unique<HTTPMessage>(msg));
+  EXPECT_EQ(429, response.getStatusCode());
+  EXPECT_NE(nullptr, response.getCannedResponse());
+  filter->onEOM();
+  filter->requestComplete();
+}
@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/RequestHandlerAdaptor.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
+#include <proxygen/lib/http/session/test/HTTPTransactionMocks.h>
+
+using namespace proxygen;
+using namespace testing;
+
+class RequestHandlerAdaptorTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // The adaptor deletes itself when the transaction detaches
+    adaptor_ = new RequestHandlerAdaptor(&requestHandler_);
+    EXPECT_CALL(requestHandler_, setResponseHandler(_))
+      .WillOnce(SaveArg<0>(&responseHandler_));
+    adaptor_->setTransaction(&txn_);
+  }
+
+  void TearDown() override {
+    EXPECT_CALL(requestHandler_, requestComplete());
+    adaptor_->detachTransaction();
+  }
+
+  // Sends 103 Early Hints from onRequest, then the final response
+  void sendEarlyHintsOnRequest(bool expectSent) {
+    EXPECT_CALL(requestHandler_, onRequest(_))
+      .WillOnce(InvokeWithoutArgs([=] {
+            EXPECT_EQ(expectSent,
+                      ResponseBuilder(responseHandler_)
+                      .status(103, "Early Hints")
+                      .header(HTTP_HEADER_LINK,
+                              "</style.css>; rel=preload; as=style")
+                      .sendInformational());
+            ResponseBuilder(responseHandler_)
+              .status(200, "OK")
+              .sendWithEOM();
+          }));
+  }
+
+ protected:
+  folly::EventBase eventBase_;
+  AsyncTimeoutSet::UniquePtr transactionTimeouts_{
+    new AsyncTimeoutSet(&eventBase_, std::chrono::milliseconds(500))};
+  RoundRobinEgressQueue txnEgressQueue_;
+  StrictMock<MockHTTPTransaction> txn_{
+    TransportDirection::DOWNSTREAM, HTTPCodec::StreamID(1), 1,
+    txnEgressQueue_, transactionTimeouts_.get()};
+  StrictMock<MockRequestHandler> requestHandler_;
+  ResponseHandler* responseHandler_{nullptr};
+  HTTPTransactionHandler* adaptor_{nullptr};
+};
+
+TEST_F(RequestHandlerAdaptorTest, early_hints) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  sendEarlyHintsOnRequest(true);
+  InSequence enforceOrder;
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(103, msg.getStatusCode());
+          EXPECT_EQ("</style.css>; rel=preload; as=style",
+                    msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_LINK));
+          EXPECT_FALSE(msg.getHeaders().exists(HTTP_HEADER_CONTENT_LENGTH));
+        }));
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(200, msg.getStatusCode());
+        }));
+  EXPECT_CALL(txn_, sendEOM());
+
+  adaptor_->onHeadersComplete(makeGetRequest());
+}
+
+TEST_F(RequestHandlerAdaptorTest, early_hints_dropped_on_spdy) {
+  // SPDY streams have a single reply
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(false));
+  sendEarlyHintsOnRequest(false);
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(200, msg.getStatusCode());
+        }));
+  EXPECT_CALL(txn_, sendEOM());
+
+  adaptor_->onHeadersComplete(makeGetRequest());
+}
+
+TEST_F(RequestHandlerAdaptorTest, early_hints_dropped_on_http10) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  sendEarlyHintsOnRequest(false);
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(200, msg.getStatusCode());
+        }));
+  EXPECT_CALL(txn_, sendEOM());
+
+  auto req = makeGetRequest();
+  req->setHTTPVersion(1, 0);
+  adaptor_->onHeadersComplete(std::move(req));
+}
+
+TEST_F(RequestHandlerAdaptorTest, early_hints_after_final_response) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  EXPECT_CALL(requestHandler_, onRequest(_))
+    .WillOnce(InvokeWithoutArgs([this] {
+          ResponseBuilder(responseHandler_)
+            .status(200, "OK")
+            .send();
+          EXPECT_FALSE(ResponseBuilder(responseHandler_)
+                       .status(103, "Early Hints")
+                       .sendInformational());
+        }));
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(200, msg.getStatusCode());
+        }));
+
+  adaptor_->onHeadersComplete(makeGetRequest());
+}
+
+namespace {
+
+std::unique_ptr<HTTPMessage> makeExpectContinueRequest() {
+  auto req = makePostRequest();
+  req->getHeaders().set(HTTP_HEADER_EXPECT, "100-continue");
+  return req;
+}
+
+}
+
+TEST_F(RequestHandlerAdaptorTest, continue_after_on_request) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  InSequence enforceOrder;
+  EXPECT_CALL(requestHandler_, onRequest(_));
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(100, msg.getStatusCode());
+        }));
+
+  adaptor_->onHeadersComplete(makeExpectContinueRequest());
+}
+
+TEST_F(RequestHandlerAdaptorTest, no_continue_when_rejected) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  EXPECT_CALL(txn_.mockCodec_, supportsParallelRequests())
+    .WillRepeatedly(Return(false));
+  EXPECT_CALL(requestHandler_, onRequest(_))
+    .WillOnce(InvokeWithoutArgs([this] {
+          ResponseBuilder(responseHandler_)
+            .status(429, "Too Many Requests")
+            .sendWithEOM();
+        }));
+  // only the final response, after which the client isn't left to upload
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(429, msg.getStatusCode());
+          EXPECT_FALSE(msg.wantsKeepalive());
+        }));
+  EXPECT_CALL(txn_, sendEOM());
+
+  adaptor_->onHeadersComplete(makeExpectContinueRequest());
+}
+
+TEST_F(RequestHandlerAdaptorTest, continue_deferred_while_paused) {
+  EXPECT_CALL(txn_.mockCodec_, supportsInformationalResponses())
+    .WillRepeatedly(Return(true));
+  EXPECT_CALL(requestHandler_, onRequest(_))
+    .WillOnce(InvokeWithoutArgs([this] {
+          responseHandler_->pauseIngress();
+        }));
+  EXPECT_CALL(txn_, pauseIngress());
+  adaptor_->onHeadersComplete(makeExpectContinueRequest());
+  Mock::VerifyAndClearExpectations(&txn_);
+
+  // the handler made up its mind
+  InSequence enforceOrder;
+  EXPECT_CALL(txn_, sendHeaders(_))
+    .WillOnce(Invoke([] (const HTTPMessage& msg) {
+          EXPECT_EQ(100, msg.getStatusCode());
+        }));
+  EXPECT_CALL(txn_, resumeIngress());
+  responseHandler_->resumeIngress();
+}
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/filters/ResponseCache.h>
+
+using namespace proxygen;
+
+using folly::IOBuf;
+
+namespace {
+
+HTTPMessage makeRequest(const std::string& url) {
+  HTTPMessage req;
+  req.setMethod(HTTPMethod::GET);
+  req.setURL(url);
+  req.getHeaders().set(HTTP_HEADER_HOST, "www.example.com");
+  return req;
+}
+
+HTTPMessage makeResponse(const std::string& cacheControl) {
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, cacheControl);
+  return resp;
+}
+
+std::string getBody(const ResponseCache::Response& response) {
+  auto body = response.body->clone();
+  return body->moveToFbString().toStdString();
+}
+
+}
+
+TEST(ResponseCacheTest, StoresFreshResponses) {
+  ResponseCache cache;
+  auto req = makeRequest("/a");
+  EXPECT_TRUE(cache.put(req, makeResponse("public, max-age=60"),
+                        IOBuf::copyBuffer("hello")));
+  auto hit = cache.get(req);
+  ASSERT_TRUE(hit != nullptr);
+  EXPECT_EQ(200, hit->headers.getStatusCode());
+  EXPECT_EQ("hello", getBody(*hit));
+  // hits share the stored body
+  EXPECT_EQ("hello", getBody(*cache.get(req)));
+  EXPECT_EQ(nullptr, cache.get(makeRequest("/b")));
+  EXPECT_EQ(1, cache.getNumEntries());
+}
+
+TEST(ResponseCacheTest, Freshness) {
+  EXPECT_EQ(60, ResponseCache::getFreshness(
+              makeResponse("max-age=60")).count());
+  EXPECT_EQ(600, ResponseCache::getFreshness(
+              makeResponse("max-age=60, s-maxage=\"600\"")).count());
+  auto aged = makeResponse("max-age=60");
+  aged.getHeaders().set(HTTP_HEADER_AGE, "50");
+  EXPECT_EQ(10, ResponseCache::getFreshness(aged).count());
+
+  EXPECT_EQ(0, ResponseCache::getFreshness(makeResponse("")).count());
+  EXPECT_EQ(0, ResponseCache::getFreshness(
+              makeResponse("max-age=60, no-store")).count());
+  EXPECT_EQ(0, ResponseCache::getFreshness(
+              makeResponse("private, max-age=60")).count());
+  auto cookie = makeResponse("max-age=60");
+  cookie.getHeaders().set(HTTP_HEADER_SET_COOKIE, "a=b");
+  EXPECT_EQ(0, ResponseCache::getFreshness(cookie).count());
+  auto error = makeResponse("max-age=60");
+  error.setStatusCode(500);
+  EXPECT_EQ(0, ResponseCache::getFreshness(error).count());
+}
+
+TEST(ResponseCacheTest, RequestDirectives) {
+  auto req = makeRequest("/a");
+  EXPECT_TRUE(ResponseCache::isCacheableRequest(req));
+  EXPECT_TRUE(ResponseCache::mayServeFromCache(req));
+
+  req.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "no-cache");
+  EXPECT_TRUE(ResponseCache::isCacheableRequest(req));
+  EXPECT_FALSE(ResponseCache::mayServeFromCache(req));
+
+  req.getHeaders().set(HTTP_HEADER_CACHE_CONTROL, "no-store");
+  EXPECT_FALSE(ResponseCache::isCacheableRequest(req));
+
+  auto post = makeRequest("/a");
+  post.setMethod(HTTPMethod::POST);
+  EXPECT_FALSE(ResponseCache::isCacheableRequest(post));
+  ResponseCache cache;
+  EXPECT_FALSE(cache.put(post, makeResponse("max-age=60"), nullptr));
+}
+
+TEST(ResponseCacheTest, Vary) {
+  ResponseCache cache;
+  auto resp = makeResponse("max-age=60");
+  resp.getHeaders().set(HTTP_HEADER_VARY, "Accept-Encoding");
+  auto gzip = makeRequest("/a");
+  gzip.getHeaders().set(HTTP_HEADER_ACCEPT_ENCODING, "gzip");
+  auto plain = makeRequest("/a");
+
+  EXPECT_TRUE(cache.put(gzip, resp, IOBuf::copyBuffer("zipped")));
+  EXPECT_EQ(nullptr, cache.get(plain));
+  EXPECT_TRUE(cache.put(plain, resp, IOBuf::copyBuffer("plain")));
+  EXPECT_EQ("zipped", getBody(*cache.get(gzip)));
+  EXPECT_EQ("plain", getBody(*cache.get(plain)));
+  EXPECT_EQ(2, cache.getNumEntries());
+
+  resp.getHeaders().set(HTTP_HEADER_VARY, "*");
+  EXPECT_FALSE(cache.put(plain, resp, nullptr));
+}
+
+TEST(ResponseCacheTest, BoundedMemory) {
+  const size_t capacity = ResponseCache::kNumShards * 4096;
+  ResponseCache cache(capacity, 2048);
+  std::string body(1000, 'a');
+  for (int i = 0; i < 1000; i++) {
+    cache.put(makeRequest("/" + folly::to<std::string>(i)),
+              makeResponse("max-age=60"), IOBuf::copyBuffer(body));
+  }
+  EXPECT_LE(cache.getSize(), capacity);
+  EXPECT_LT(cache.getNumEntries(), 1000);
+  EXPECT_GT(cache.getNumEntries(), 0);
+
+  // too large for an entry
+  EXPECT_FALSE(cache.put(makeRequest("/large"), makeResponse("max-age=60"),
+                         IOBuf::copyBuffer(std::string(4096, 'a'))));
+}
+
+TEST(ResponseCacheTest, EvictionCallback) {
+  const size_t capacity = ResponseCache::kNumShards * 4096;
+  ResponseCache cache(capacity, 2048);
+  size_t evicted = 0;
+  cache.setEvictionCallback(
+    [&] (const std::string& key, const std::vector<std::string>& varyNames,
+         const std::vector<std::string>& varyValues,
+         std::shared_ptr<const ResponseCache::Response> response) {
+      EXPECT_EQ(0, key.find("www.example.com /"));
+      EXPECT_TRUE(varyNames.empty());
+      EXPECT_EQ(1000, response->body->computeChainDataLength());
+      evicted++;
+    });
+  std::string body(1000, 'a');
+  for (int i = 0; i < 1000; i++) {
+    cache.put(makeRequest("/" + folly::to<std::string>(i)),
+              makeResponse("max-age=60"), IOBuf::copyBuffer(body));
+  }
+  EXPECT_GT(evicted, 0);
+  EXPECT_EQ(1000, evicted + cache.getNumEntries());
+}
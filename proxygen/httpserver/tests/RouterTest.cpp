@@ -0,0 +1,163 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Router.h>
+#include <proxygen/httpserver/filters/DirectResponseHandler.h>
+
+using namespace proxygen;
+
+namespace {
+
+// Counts the requests it gets and keeps the last one's path params and
+// deadline
+class TestFactory : public RequestHandlerFactory {
+ public:
+  void onServerStart() noexcept override {}
+  void onServerStop() noexcept override {}
+
+  RequestHandler* onRequest(RequestHandler*, HTTPMessage* msg) noexcept
+      override {
+    requests++;
+    params = msg->getPathParams();
+    deadline = msg->getDeadline();
+    return nullptr;
+  }
+
+  uint32_t requests{0};
+  std::map<std::string, std::string> params;
+  TimePoint deadline;
+};
+
+}
+
+class RouterTest : public testing::Test {
+ protected:
+  TestFactory* add(HTTPMethod method, const std::string& pattern) {
+    auto factory = new TestFactory();
+    router_.add(method, pattern, std::unique_ptr<TestFactory>(factory));
+    return factory;
+  }
+
+  // The handler the router gives for the request
+  RequestHandler* route(HTTPMethod method, const std::string& url) {
+    HTTPMessage msg;
+    msg.setMethod(method);
+    msg.setURL(url);
+    return router_.onRequest(nullptr, &msg);
+  }
+
+  Router router_;
+};
+
+TEST_F(RouterTest, Literals) {
+  auto users = add(HTTPMethod::GET, "/users");
+  auto usersNew = add(HTTPMethod::GET, "/users/new");
+  auto uploads = add(HTTPMethod::GET, "/uploads");
+  auto root = add(HTTPMethod::GET, "/");
+
+  EXPECT_EQ(nullptr, route(HTTPMethod::GET, "/users?page=2"));
+  EXPECT_EQ(1, users->requests);
+  route(HTTPMethod::GET, "/users/new");
+  EXPECT_EQ(1, usersNew->requests);
+  route(HTTPMethod::GET, "/uploads");
+  EXPECT_EQ(1, uploads->requests);
+  route(HTTPMethod::GET, "/");
+  EXPECT_EQ(1, root->requests);
+  EXPECT_EQ(1, users->requests);
+
+  std::unique_ptr<RequestHandler> notFound(
+    route(HTTPMethod::GET, "/user"));
+  EXPECT_NE(nullptr, dynamic_cast<DirectResponseHandler*>(notFound.get()));
+}
+
+TEST_F(RouterTest, Params) {
+  auto user = add(HTTPMethod::GET, "/users/:id");
+  auto post = add(HTTPMethod::GET, "/users/:id/posts/:post");
+  auto me = add(HTTPMethod::GET, "/users/me");
+  auto files = add(HTTPMethod::GET, "/files/*path");
+
+  route(HTTPMethod::GET, "/users/42");
+  EXPECT_EQ(1, user->requests);
+  EXPECT_EQ("42", user->params["id"]);
+
+  route(HTTPMethod::GET, "/users/42/posts/7");
+  EXPECT_EQ(1, post->requests);
+  EXPECT_EQ("42", post->params["id"]);
+  EXPECT_EQ("7", post->params["post"]);
+
+  // literals first, and back to the parameter if they lead nowhere
+  route(HTTPMethod::GET, "/users/me");
+  EXPECT_EQ(1, me->requests);
+  EXPECT_TRUE(me->params.empty());
+  route(HTTPMethod::GET, "/users/me/posts/1");
+  EXPECT_EQ(2, post->requests);
+  EXPECT_EQ("me", post->params["id"]);
+
+  route(HTTPMethod::GET, "/files/css/site.css");
+  EXPECT_EQ(1, files->requests);
+  EXPECT_EQ("css/site.css", files->params["path"]);
+
+  // a parameter doesn't match an empty segment
+  std::unique_ptr<RequestHandler> notFound(
+    route(HTTPMethod::GET, "/users//posts/1"));
+  EXPECT_NE(nullptr, notFound.get());
+  EXPECT_EQ(2, post->requests);
+}
+
+TEST_F(RouterTest, Methods) {
+  auto get = add(HTTPMethod::GET, "/items/:id");
+  auto put = add(HTTPMethod::PUT, "/items/:id");
+
+  route(HTTPMethod::PUT, "/items/1");
+  EXPECT_EQ(1, put->requests);
+  route(HTTPMethod::HEAD, "/items/1");
+  EXPECT_EQ(1, get->requests);
+
+  std::unique_ptr<RequestHandler> notAllowed(
+    route(HTTPMethod::DELETE, "/items/1"));
+  EXPECT_NE(nullptr, dynamic_cast<DirectResponseHandler*>(notAllowed.get()));
+  EXPECT_EQ(1, get->requests);
+  EXPECT_EQ(1, put->requests);
+}
+
+TEST_F(RouterTest, NotFoundFactory) {
+  auto notFound = new TestFactory();
+  router_.setNotFound(std::unique_ptr<TestFactory>(notFound));
+  add(HTTPMethod::GET, "/a");
+  EXPECT_EQ(nullptr, route(HTTPMethod::GET, "/b"));
+  EXPECT_EQ(1, notFound->requests);
+}
+
+TEST_F(RouterTest, Timeouts) {
+  auto slow = new TestFactory();
+  router_.add(HTTPMethod::GET, "/slow", std::unique_ptr<TestFactory>(slow),
+              std::chrono::milliseconds(5000));
+  auto fast = add(HTTPMethod::GET, "/fast");
+
+  HTTPMessage msg;
+  msg.setMethod(HTTPMethod::GET);
+  msg.setURL("/slow");
+  router_.onRequest(nullptr, &msg);
+  EXPECT_EQ(msg.getStartTime() + std::chrono::milliseconds(5000),
+            slow->deadline);
+
+  // the client's own deadline wins
+  HTTPMessage requested;
+  requested.setMethod(HTTPMethod::GET);
+  requested.setURL("/slow");
+  auto deadline = requested.getStartTime() + std::chrono::milliseconds(10);
+  requested.setDeadline(deadline);
+  router_.onRequest(nullptr, &requested);
+  EXPECT_EQ(deadline, slow->deadline);
+
+  route(HTTPMethod::GET, "/fast");
+  EXPECT_EQ(1, fast->requests);
+  EXPECT_EQ(TimePoint(), fast->deadline);
+}
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <proxygen/httpserver/SocketTakeover.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace proxygen;
+
+namespace {
+
+int listenOnLoopback() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0);
+  folly::SocketAddress address("127.0.0.1", 0);
+  sockaddr_storage storage;
+  socklen_t len = address.getAddress(&storage);
+  CHECK_EQ(0, bind(fd, reinterpret_cast<sockaddr*>(&storage), len));
+  CHECK_EQ(0, listen(fd, 16));
+  return fd;
+}
+
+}
+
+TEST(SocketTakeoverTest, SendsFds) {
+  int pair[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, pair));
+  int listening = listenOnLoopback();
+  sendFds(pair[0], {listening, listening});
+
+  auto fds = receiveFds(pair[1]);
+  ASSERT_EQ(2, fds.size());
+  folly::SocketAddress sent, received;
+  sent.setFromLocalAddress(listening);
+  received.setFromLocalAddress(fds[0]);
+  EXPECT_EQ(sent, received);
+  EXPECT_NE(listening, fds[0]);
+
+  for (auto fd: fds) {
+    close(fd);
+  }
+  close(listening);
+  close(pair[0]);
+  EXPECT_THROW(receiveFds(pair[1]), std::runtime_error);
+  close(pair[1]);
+}
+
+TEST(SocketTakeoverTest, DrainsOnlyOnceConfirmed) {
+  std::string path = folly::to<std::string>(
+    "/tmp/SocketTakeoverTest.", getpid());
+  int listening = listenOnLoopback();
+  folly::EventBase evb;
+  int drained = 0;
+  TakeoverServer server(&evb, path, {listening}, [&] {
+      drained++;
+      evb.terminateLoopSoon();
+    });
+  server.start();
+
+  std::thread successors([&] {
+      {
+        // goes away without confirming
+        TakeoverClient client(path);
+      }
+      TakeoverClient client(path);
+      auto fds = client.releaseSockets();
+      ASSERT_EQ(1, fds.size());
+      folly::SocketAddress inherited, original;
+      inherited.setFromLocalAddress(fds[0]);
+      original.setFromLocalAddress(listening);
+      EXPECT_EQ(original, inherited);
+      close(fds[0]);
+      client.confirm();
+    });
+  evb.loopForever();
+  successors.join();
+  EXPECT_EQ(1, drained);
+
+  EXPECT_THROW(TakeoverClient client("/tmp/SocketTakeoverTest.none"),
+               std::system_error);
+  close(listening);
+  unlink(path.c_str());
+}
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/SpoolingBodyHandler.h>
+#include <unistd.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+
+namespace {
+
+// What the last handler got
+struct Delivered {
+  uint32_t requests{0};
+  std::string head;
+  std::string file;
+};
+
+class TestHandler : public SpoolingBodyHandler {
+ public:
+  TestHandler(CPUExecutor* executor, Delivered* delivered):
+      SpoolingBodyHandler(executor, 4, 20),
+      delivered_(delivered) {}
+
+  void onRequestBody(std::unique_ptr<HTTPMessage> request,
+                     Body body) noexcept override {
+    delivered_->requests++;
+    if (body.getHead()) {
+      delivered_->head = body.moveHead()->moveToFbString().toStdString();
+    }
+    if (body.isSpooled()) {
+      std::string file(body.getFileLength(), '\0');
+      EXPECT_EQ(ssize_t(file.size()),
+                pread(body.getFile()->fd(), &file[0], file.size(), 0));
+      delivered_->file = file;
+    }
+    folly::EventBaseManager::get()->getEventBase()->terminateLoopSoon();
+  }
+
+ private:
+  Delivered* delivered_;
+};
+
+std::unique_ptr<HTTPMessage> makePost() {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::POST);
+  req->setURL("/upload");
+  return req;
+}
+
+}
+
+class SpoolingBodyHandlerTest : public Test {
+ protected:
+  void SetUp() override {
+    handler_ = new TestHandler(&executor_, &delivered_);
+    downstream_.reset(new MockResponseHandler(handler_));
+    handler_->setResponseHandler(downstream_.get());
+  }
+
+  CPUExecutor executor_{1};
+  Delivered delivered_;
+  TestHandler* handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+};
+
+TEST_F(SpoolingBodyHandlerTest, SmallBodyInMemory) {
+  handler_->onRequest(makePost());
+  handler_->onBody(IOBuf::copyBuffer("ab"));
+  handler_->onEOM();
+  EXPECT_EQ(1, delivered_.requests);
+  EXPECT_EQ("ab", delivered_.head);
+  EXPECT_EQ("", delivered_.file);
+  handler_->requestComplete();
+}
+
+TEST_F(SpoolingBodyHandlerTest, SpillsToFile) {
+  handler_->onRequest(makePost());
+  handler_->onBody(IOBuf::copyBuffer("01"));
+  handler_->onBody(IOBuf::copyBuffer("2345"));
+  handler_->onBody(IOBuf::copyBuffer("6789"));
+  handler_->onEOM();
+  // the writes are still running
+  EXPECT_EQ(0, delivered_.requests);
+  folly::EventBaseManager::get()->getEventBase()->loopForever();
+  EXPECT_EQ(1, delivered_.requests);
+  EXPECT_EQ("0123", delivered_.head);
+  EXPECT_EQ("456789", delivered_.file);
+  handler_->requestComplete();
+}
+
+TEST_F(SpoolingBodyHandlerTest, RejectsLargeBody) {
+  EXPECT_CALL(*downstream_, sendHeaders(_))
+    .WillOnce(Invoke([] (HTTPMessage& msg) {
+          EXPECT_EQ(413, msg.getStatusCode());
+        }));
+  EXPECT_CALL(*downstream_, sendEOM());
+  EXPECT_CALL(*downstream_, pauseIngress());
+  handler_->onRequest(makePost());
+  handler_->onBody(IOBuf::copyBuffer(std::string(21, 'x')));
+  handler_->onEOM();
+  EXPECT_EQ(0, delivered_.requests);
+  handler_->requestComplete();
+}
@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/StaticChain.h>
+
+using namespace proxygen;
+using namespace testing;
+
+namespace {
+
+std::vector<std::string> events;
+
+// Records the events it sees, under a name
+class TraceFilter : public StaticFilter {
+ public:
+  explicit TraceFilter(const std::string& name): name_(name) {
+  }
+
+  template <typename Chain>
+  void onRequest(Chain& chain, std::unique_ptr<HTTPMessage> msg) {
+    events.push_back(name_ + " onRequest");
+    chain.onRequest(std::move(msg));
+  }
+
+  template <typename Chain>
+  void sendHeaders(Chain& chain, HTTPMessage& msg) {
+    events.push_back(name_ + " sendHeaders");
+    msg.getHeaders().add("X-Trace", name_);
+    chain.sendHeaders(msg);
+  }
+
+ private:
+  std::string name_;
+};
+
+// Answers requests without a header with a 403
+class AuthFilter : public StaticFilter {
+ public:
+  template <typename Chain>
+  void onRequest(Chain& chain, std::unique_ptr<HTTPMessage> msg) {
+    if (!msg->getHeaders().exists("X-Token")) {
+      rejected_ = true;
+      HTTPMessage resp;
+      resp.setStatusCode(403);
+      chain.sendHeaders(resp);
+      chain.sendEOM();
+      return;
+    }
+    chain.onRequest(std::move(msg));
+  }
+
+  template <typename Chain>
+  void onEOM(Chain& chain) {
+    if (!rejected_) {
+      chain.onEOM();
+    }
+  }
+
+ private:
+  bool rejected_{false};
+};
+
+typedef StaticChainFactory<TraceFilter, AuthFilter, TraceFilter> Factory;
+
+}
+
+class StaticChainTest : public Test {
+ protected:
+  void SetUp() override {
+    events.clear();
+    Factory factory(TraceFilter("outer"), AuthFilter(), TraceFilter("inner"));
+    auto h = factory.onRequest(&handler_, nullptr);
+    chain_ = h;
+    downstream_.reset(new MockResponseHandler(h));
+    EXPECT_CALL(handler_, setResponseHandler(_))
+      .WillOnce(Invoke([&] (ResponseHandler* rh) {
+            upstream_ = rh;
+          }));
+    h->setResponseHandler(downstream_.get());
+  }
+
+  MockRequestHandler handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+  RequestHandler* chain_{nullptr};
+  ResponseHandler* upstream_{nullptr};
+};
+
+TEST_F(StaticChainTest, PassThrough) {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->getHeaders().add("X-Token", "1");
+  EXPECT_CALL(handler_, onRequest(_));
+  EXPECT_CALL(handler_, onBody(_));
+  EXPECT_CALL(handler_, onEOM());
+  chain_->onRequest(std::move(req));
+  chain_->onBody(folly::IOBuf::copyBuffer("hello"));
+  chain_->onEOM();
+  EXPECT_EQ(std::vector<std::string>({"outer onRequest", "inner onRequest"}),
+            events);
+
+  // the response goes through the filters the other way
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  EXPECT_CALL(*downstream_, sendHeaders(_))
+    .WillOnce(Invoke([] (HTTPMessage& msg) {
+          std::vector<std::string> traces;
+          msg.getHeaders().forEachValueOfHeader(
+            "X-Trace", [&] (const std::string& value) {
+              traces.push_back(value);
+              return false;
+            });
+          EXPECT_EQ(std::vector<std::string>({"inner", "outer"}), traces);
+        }));
+  EXPECT_CALL(*downstream_, sendEOM());
+  upstream_->sendHeaders(resp);
+  upstream_->sendEOM();
+
+  EXPECT_CALL(handler_, requestComplete());
+  chain_->requestComplete();
+}
+
+TEST_F(StaticChainTest, DirectResponse) {
+  // the 403 only goes through the filters closer to the client
+  EXPECT_CALL(handler_, onRequest(_)).Times(0);
+  EXPECT_CALL(handler_, onEOM()).Times(0);
+  EXPECT_CALL(*downstream_, sendHeaders(_))
+    .WillOnce(Invoke([] (HTTPMessage& msg) {
+          EXPECT_EQ(403, msg.getStatusCode());
+          EXPECT_EQ("outer", msg.getHeaders().getSingleOrEmpty("X-Trace"));
+        }));
+  EXPECT_CALL(*downstream_, sendEOM());
+  chain_->onRequest(folly::make_unique<HTTPMessage>());
+  chain_->onEOM();
+  EXPECT_EQ(std::vector<std::string>({"outer onRequest", "outer sendHeaders"}),
+            events);
+
+  EXPECT_CALL(handler_, onError(kErrorTimeout));
+  chain_->onError(kErrorTimeout);
+}
@@ -0,0 +1,183 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstdlib>
+#include <folly/io/async/EventBase.h>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/StaticFileHandler.h>
+#include <unistd.h>
+
+using namespace proxygen;
+using namespace testing;
+
+class StaticFileHandlerTest : public Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/StaticFileHandlerTestXXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    root_ = dir;
+    writeFile("/small.txt", "hello");
+    writeFile("/large.bin", "0123456789abcdef");
+  }
+
+  void TearDown() override {
+    unlink((root_ + "/small.txt").c_str());
+    unlink((root_ + "/large.bin").c_str());
+    unlink((root_ + "/small.txt.gz").c_str());
+    rmdir(root_.c_str());
+  }
+
+  void writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream(root_ + path) << contents;
+  }
+
+  // Serve a request for path, and expect the response to have status
+  void serve(const std::string& path, uint16_t status,
+             std::function<void(HTTPMessage&)> addHeaders = nullptr) {
+    auto handler = new StaticFileHandler(&cache_, root_);
+    MockResponseHandler downstream(handler);
+    handler->setResponseHandler(&downstream);
+    EXPECT_CALL(downstream, sendHeaders(_))
+      .WillOnce(Invoke([this] (HTTPMessage& msg) { response_ = msg; }));
+    EXPECT_CALL(downstream, sendBody(_))
+      .WillRepeatedly(Invoke([this] (std::shared_ptr<folly::IOBuf> buf) {
+            body_ = std::string((const char*)buf->data(), buf->length());
+          }));
+    EXPECT_CALL(downstream, sendFileRegion(_))
+      .WillRepeatedly(Invoke([this] (const FileRegion& region) {
+            regionLength_ = region.getLength();
+          }));
+    EXPECT_CALL(downstream, sendEOM());
+
+    auto req = folly::make_unique<HTTPMessage>();
+    req->setMethod(HTTPMethod::GET);
+    req->setURL(path);
+    if (addHeaders) {
+      addHeaders(*req);
+    }
+    body_.clear();
+    regionLength_ = 0;
+    handler->onRequest(std::move(req));
+    handler->onEOM();
+    handler->requestComplete();
+    EXPECT_EQ(status, response_.getStatusCode());
+  }
+
+  folly::EventBase evb_;
+  FileCache cache_{&evb_, 16, 8};
+  std::string root_;
+  HTTPMessage response_;
+  std::string body_;
+  size_t regionLength_{0};
+};
+
+TEST_F(StaticFileHandlerTest, ServesFiles) {
+  serve("/small.txt", 200);
+  EXPECT_EQ("hello", body_);
+  EXPECT_EQ("5", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_LENGTH));
+  EXPECT_EQ("text/plain", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_TYPE));
+
+  // too large to keep in memory, sent from the file
+  serve("/large.bin", 200);
+  EXPECT_EQ("", body_);
+  EXPECT_EQ(16, regionLength_);
+  EXPECT_EQ(2, cache_.getNumEntries());
+}
+
+TEST_F(StaticFileHandlerTest, Errors) {
+  serve("/missing.txt", 404);
+  serve("/../etc/passwd", 400);
+  serve("/a/..", 400);
+  EXPECT_EQ(0, cache_.getNumEntries());
+}
+
+TEST_F(StaticFileHandlerTest, NotModified) {
+  serve("/small.txt", 200);
+  std::string etag = response_.getHeaders().getSingleOrEmpty(
+    HTTP_HEADER_ETAG);
+  std::string lastModified = response_.getHeaders().getSingleOrEmpty(
+    HTTP_HEADER_LAST_MODIFIED);
+
+  serve("/small.txt", 304, [&] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_IF_NONE_MATCH,
+                           "\"other\", " + etag);
+    });
+  EXPECT_EQ("", body_);
+  serve("/small.txt", 304, [&] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_IF_MODIFIED_SINCE, lastModified);
+    });
+  serve("/small.txt", 200, [&] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_IF_NONE_MATCH, "\"other\"");
+    });
+}
+
+TEST_F(StaticFileHandlerTest, Ranges) {
+  serve("/small.txt", 206, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=1-3");
+    });
+  EXPECT_EQ("ell", body_);
+  EXPECT_EQ("bytes 1-3/5", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_RANGE));
+
+  serve("/small.txt", 206, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=-2");
+    });
+  EXPECT_EQ("lo", body_);
+
+  serve("/large.bin", 206, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=10-");
+    });
+  EXPECT_EQ(6, regionLength_);
+
+  serve("/small.txt", 416, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=5-");
+    });
+  EXPECT_EQ("bytes */5", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_RANGE));
+
+  // a range of another version, or several ranges, get the whole file
+  serve("/small.txt", 200, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=1-3");
+      req.getHeaders().add(HTTP_HEADER_IF_RANGE, "\"stale\"");
+    });
+  EXPECT_EQ("hello", body_);
+  serve("/small.txt", 200, [] (HTTPMessage& req) {
+      req.getHeaders().add(HTTP_HEADER_RANGE, "bytes=0-1,3-4");
+    });
+}
+
+TEST_F(StaticFileHandlerTest, Invalidate) {
+  serve("/small.txt", 200);
+  writeFile("/small.txt", "changed");
+  cache_.invalidate(root_ + "/small.txt");
+  serve("/small.txt", 200);
+  EXPECT_EQ("changed", body_);
+}
+
+TEST_F(StaticFileHandlerTest, Precompressed) {
+  writeFile("/small.txt.gz", "zipped");
+  auto acceptGzip = [] (HTTPMessage& req) {
+    req.getHeaders().add(HTTP_HEADER_ACCEPT_ENCODING, "gzip, deflate");
+  };
+  serve("/small.txt", 200, acceptGzip);
+  EXPECT_EQ("zipped", body_);
+  EXPECT_EQ("gzip", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_ENCODING));
+  EXPECT_EQ("text/plain", response_.getHeaders().getSingleOrEmpty(
+              HTTP_HEADER_CONTENT_TYPE));
+
+  serve("/small.txt", 200);
+  EXPECT_EQ("hello", body_);
+  EXPECT_FALSE(response_.getHeaders().exists(HTTP_HEADER_CONTENT_ENCODING));
+}
@@ -0,0 +1,228 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/RequestHandlerAdaptor.h>
+#include <proxygen/httpserver/filters/SharedMemoryStatsExporter.h>
+#include <proxygen/httpserver/filters/StatsFilter.h>
+#include <proxygen/lib/http/session/HTTPSessionStats.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace proxygen;
+using namespace testing;
+
+TEST(StatsFilterTest, RecordsResponses) {
+  StatsRegistry registry;
+  MockRequestHandler handler;
+  auto filter = new StatsFilter(&handler, &registry);
+  MockResponseHandler downstream(filter);
+  EXPECT_CALL(handler, setResponseHandler(filter));
+  filter->setResponseHandler(&downstream);
+
+  EXPECT_CALL(handler, onRequest(_));
+  filter->onRequest(folly::make_unique<HTTPMessage>());
+  HTTPMessage resp;
+  resp.setStatusCode(100);
+  EXPECT_CALL(downstream, sendHeaders(_)).Times(2);
+  filter->sendHeaders(resp);
+  EXPECT_EQ(0, registry.getSnapshot().timeToFirstByte.getCount());
+  resp.setStatusCode(404);
+  filter->sendHeaders(resp);
+  EXPECT_CALL(handler, requestComplete());
+  filter->requestComplete();
+
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(1, snapshot.requests);
+  EXPECT_EQ(0, snapshot.statuses[1]);
+  EXPECT_EQ(1, snapshot.statuses[4]);
+  EXPECT_EQ(1, snapshot.timeToFirstByte.getCount());
+  EXPECT_EQ(1, snapshot.totalTime.getCount());
+  EXPECT_EQ(0, snapshot.errors);
+}
+
+TEST(StatsFilterTest, AddsThreadsUp) {
+  StatsRegistry registry;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&] {
+        for (int j = 0; j < 1000; j++) {
+          registry.recordRequest();
+          registry.recordResponse(200, std::chrono::microseconds(j));
+          registry.recordComplete(std::chrono::microseconds(2 * j));
+        }
+        registry.getSessionStats()->recordTransactionOpened();
+      });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  registry.recordError();
+
+  // the threads are gone, their counts aren't
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(4000, snapshot.requests);
+  EXPECT_EQ(4000, snapshot.statuses[2]);
+  EXPECT_EQ(1, snapshot.errors);
+  EXPECT_EQ(4, snapshot.transactionsOpened);
+  EXPECT_EQ(4000, snapshot.totalTime.getCount());
+  EXPECT_EQ(999, snapshot.totalTime.getMean());
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(4000, counters["http.status.2xx"]);
+  EXPECT_EQ(0, counters["http.status.5xx"]);
+  EXPECT_EQ(snapshot.timeToFirstByte.getPercentile(50),
+            counters["http.ttfb_us.p50"]);
+}
+
+TEST(StatsFilterTest, SessionLatencies) {
+  StatsRegistry registry;
+  auto sessionStats = registry.getSessionStats();
+  for (int i = 1; i <= 100; i++) {
+    sessionStats->recordTimeToFirstHeaderByte(std::chrono::microseconds(i));
+    sessionStats->recordTimeToFirstBodyByte(
+      std::chrono::microseconds(2 * i));
+    sessionStats->recordTransactionDuration(
+      std::chrono::microseconds(3 * i));
+  }
+  sessionStats->recordTTLBA(std::chrono::microseconds(5000));
+
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(100, snapshot.firstHeaderByte.getCount());
+  EXPECT_EQ(50, snapshot.firstHeaderByte.getMean());
+  EXPECT_EQ(101, snapshot.firstBodyByte.getMean());
+  EXPECT_EQ(151, snapshot.transactionDuration.getMean());
+  EXPECT_EQ(1, snapshot.ttlba.getCount());
+  EXPECT_EQ(0, snapshot.totalTime.getCount());
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(5000, counters["http.session.ttlba_us.avg"]);
+  EXPECT_EQ(snapshot.firstBodyByte.getPercentile(90),
+            counters["http.session.first_body_byte_us.p90"]);
+}
+
+TEST(StatsFilterTest, TCPInfo) {
+  StatsRegistry registry;
+  TCPInfoSample sample;
+  sample.rtt = std::chrono::microseconds(20000);
+  sample.cwnd = 10;
+  sample.mss = 1448;
+  sample.deliveryRate = 724000;
+  sample.newRetransmits = 2;
+  registry.getSessionStats()->recordTCPInfo(sample);
+  sample.rtt = std::chrono::microseconds(40000);
+  sample.newRetransmits = 0;
+  registry.getSessionStats()->recordTCPInfo(sample);
+
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(2, snapshot.tcpInfoSamples);
+  EXPECT_EQ(2, snapshot.tcpRetransmits);
+  EXPECT_EQ(30000, snapshot.tcpRtt.getMean());
+  EXPECT_EQ(10, snapshot.tcpCwnd.getMean());
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(2, counters["http.session.tcp_info_samples"]);
+  EXPECT_EQ(2, counters["http.session.tcp_retransmits"]);
+  EXPECT_EQ(724000, counters["http.session.tcp_delivery_rate_bps.avg"]);
+}
+
+TEST(StatsFilterTest, ConnectionSetup) {
+  StatsRegistry registry;
+  registry.getSessionStats()->recordConnectionSetup(
+    std::chrono::microseconds(20));
+  registry.getSessionStats()->recordConnectionSetup(
+    std::chrono::microseconds(40));
+
+  auto snapshot = registry.getSnapshot();
+  EXPECT_EQ(2, snapshot.connectionSetup.getCount());
+  EXPECT_EQ(30, snapshot.connectionSetup.getMean());
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(30, counters["http.session.connection_setup_us.avg"]);
+}
+
+TEST(StatsFilterTest, HandlerCpu) {
+  StatsRegistry registry;
+  MockRequestHandler handler;
+  HTTPTransactionHandler* adaptor =
+    new RequestHandlerAdaptor(&handler, &registry, typeid(handler));
+  EXPECT_CALL(handler, setResponseHandler(_));
+  adaptor->setTransaction(nullptr);
+
+  EXPECT_CALL(handler, onEOM())
+    .WillOnce(Invoke([] {
+          auto start = getThreadCpuTime();
+          while (getThreadCpuTime() - start < std::chrono::milliseconds(1)) {
+          }
+        }));
+  adaptor->onEOM();
+  EXPECT_CALL(handler, requestComplete());
+  adaptor->detachTransaction();
+  std::thread([&] {
+      registry.recordHandlerCpu(typeid(handler),
+                                std::chrono::milliseconds(2), 1);
+    }).join();
+
+  auto snapshot = registry.getSnapshot();
+  ASSERT_EQ(1, snapshot.handlerCpu.size());
+  const auto& cpu = snapshot.handlerCpu["proxygen::MockRequestHandler"];
+  EXPECT_EQ(2, cpu.requests);
+  EXPECT_LE(std::chrono::milliseconds(3), cpu.cpuTime);
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(2,
+            counters["http.handler_cpu.proxygen::MockRequestHandler.requests"]);
+}
+
+TEST(StatsFilterTest, LoopStats) {
+  StatsRegistry registry;
+  auto monitor = std::make_shared<LoopMonitor>();
+  registry.addLoopMonitor("http-worker.0", monitor);
+  monitor->onSample(250, 750, 3);
+  monitor->onCallback("HTTPSession::readDataAvailable",
+                      std::chrono::microseconds(200));
+
+  auto snapshot = registry.getSnapshot();
+  ASSERT_EQ(1, snapshot.loops.size());
+  const auto& loop = snapshot.loops["http-worker.0"];
+  EXPECT_EQ(1, loop.iterations);
+  EXPECT_EQ("HTTPSession::readDataAvailable", loop.slowestSource);
+
+  std::map<std::string, int64_t> counters;
+  snapshot.exportCounters(counters, "http.");
+  EXPECT_EQ(25, counters["http.loop.http-worker.0.busy_pct"]);
+  EXPECT_EQ(3, counters["http.loop.http-worker.0.max_queue_depth"]);
+  EXPECT_EQ(200, counters["http.loop.http-worker.0.slowest_callback_us"]);
+  EXPECT_EQ(loop.iterationTime.getPercentile(99),
+            counters["http.loop.http-worker.0.iteration_us.p99"]);
+}
+
+TEST(StatsFilterTest, SharedMemoryExport) {
+  StatsRegistry registry;
+  registry.recordRequest();
+  auto name = "/proxygen_stats_" + std::to_string(::getpid());
+  SharedMemoryStatsExporter exporter(&registry, name, "http.",
+                                     std::chrono::hours(1));
+  SharedMemoryCounterReader reader(name);
+  std::map<std::string, int64_t> counters;
+  reader.read(counters);
+  EXPECT_EQ(1, counters["http.requests"]);
+
+  registry.recordRequest();
+  exporter.publish();
+  reader.read(counters);
+  EXPECT_EQ(2, counters["http.requests"]);
+  EXPECT_EQ(0, counters["http.errors"]);
+}
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/httpserver/Mocks.h>
+#include <proxygen/httpserver/WebSocketHandler.h>
+
+using namespace proxygen;
+using namespace testing;
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+
+namespace {
+
+// What the last handler saw
+struct Seen {
+  uint32_t opened{0};
+  uint16_t closeCode{0};
+};
+
+// Echoes the messages
+class EchoHandler : public WebSocketHandler {
+ public:
+  explicit EchoHandler(Seen* seen): seen_(seen) {}
+
+  void onWebSocketOpen() noexcept override {
+    seen_->opened++;
+  }
+
+  void onWebSocketMessageData(WebSocketOpcode opcode,
+                              std::unique_ptr<IOBuf> data,
+                              bool fin) noexcept override {
+    message_.append(std::move(data));
+    if (fin) {
+      sendMessage(opcode, message_.move());
+    }
+  }
+
+  void onWebSocketClose(uint16_t code,
+                        const std::string& reason) noexcept override {
+    seen_->closeCode = code;
+  }
+
+ private:
+  Seen* seen_;
+  IOBufQueue message_{IOBufQueue::cacheChainLength()};
+};
+
+// what a WebSocket client reads
+class ClientCallback : public WebSocketCodec::Callback {
+ public:
+  void onMessageData(WebSocketOpcode opcode, std::unique_ptr<IOBuf> data,
+                     bool fin) override {
+    messages.push_back(data->moveToFbString().toStdString());
+  }
+
+  void onPing(std::unique_ptr<IOBuf> data) override {
+  }
+
+  void onPong(std::unique_ptr<IOBuf> data) override {
+    pongs++;
+  }
+
+  void onClose(uint16_t code, std::string reason) override {
+    closeCode = code;
+  }
+
+  void onError(uint16_t code) override {
+    errorCode = code;
+  }
+
+  std::vector<std::string> messages;
+  uint32_t pongs{0};
+  uint16_t closeCode{0};
+  uint16_t errorCode{0};
+};
+
+std::unique_ptr<HTTPMessage> makeHandshake() {
+  auto req = folly::make_unique<HTTPMessage>();
+  req->setMethod(HTTPMethod::GET);
+  req->setURL("/chat");
+  req->setHTTPVersion(1, 1);
+  req->getHeaders().add(HTTP_HEADER_UPGRADE, "websocket");
+  req->getHeaders().add(HTTP_HEADER_CONNECTION, "Upgrade");
+  req->getHeaders().add("Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==");
+  req->getHeaders().add("Sec-WebSocket-Version", "13");
+  return req;
+}
+
+}
+
+class WebSocketHandlerTest : public Test {
+ protected:
+  void SetUp() override {
+    handler_ = new EchoHandler(&seen_);
+    downstream_.reset(new MockResponseHandler(handler_));
+    handler_->setResponseHandler(downstream_.get());
+    client_.setCallback(&clientCallback_);
+    EXPECT_CALL(*downstream_, sendBody(_))
+      .WillRepeatedly(Invoke([this] (std::shared_ptr<IOBuf> body) {
+            client_.onIngress(body->clone());
+          }));
+  }
+
+  void open(std::unique_ptr<HTTPMessage> req) {
+    EXPECT_CALL(*downstream_, sendHeaders(_))
+      .WillOnce(Invoke([this] (HTTPMessage& msg) {
+            response_ = msg;
+          }));
+    handler_->onRequest(std::move(req));
+    if (response_.getStatusCode() == 101) {
+      handler_->onUpgrade(UpgradeProtocol::TCP);
+    }
+  }
+
+  // Feeds what the client wrote to the handler
+  void send() {
+    handler_->onBody(output_.move());
+  }
+
+  Seen seen_;
+  EchoHandler* handler_;
+  std::unique_ptr<MockResponseHandler> downstream_;
+  HTTPMessage response_;
+  WebSocketCodec client_{TransportDirection::UPSTREAM};
+  ClientCallback clientCallback_;
+  IOBufQueue output_{IOBufQueue::cacheChainLength()};
+};
+
+TEST_F(WebSocketHandlerTest, Handshake) {
+  open(makeHandshake());
+  EXPECT_EQ(101, response_.getStatusCode());
+  const auto& headers = response_.getHeaders();
+  EXPECT_EQ("websocket", headers.getSingleOrEmpty(HTTP_HEADER_UPGRADE));
+  EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+            headers.getSingleOrEmpty("Sec-WebSocket-Accept"));
+  EXPECT_FALSE(headers.exists("Sec-WebSocket-Extensions"));
+  EXPECT_EQ(1, seen_.opened);
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, BadVersion) {
+  auto req = makeHandshake();
+  req->getHeaders().set("Sec-WebSocket-Version", "8");
+  EXPECT_CALL(*downstream_, sendEOM());
+  open(std::move(req));
+  EXPECT_EQ(426, response_.getStatusCode());
+  EXPECT_EQ("13", response_.getHeaders().getSingleOrEmpty(
+              "Sec-WebSocket-Version"));
+  EXPECT_EQ(0, seen_.opened);
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, NotAnUpgrade) {
+  auto req = makeHandshake();
+  req->getHeaders().remove(HTTP_HEADER_UPGRADE);
+  EXPECT_CALL(*downstream_, sendEOM());
+  open(std::move(req));
+  EXPECT_EQ(400, response_.getStatusCode());
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, EchoAndPing) {
+  open(makeHandshake());
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("Hello"));
+  client_.generatePing(output_, nullptr);
+  send();
+  ASSERT_EQ(1, clientCallback_.messages.size());
+  EXPECT_EQ("Hello", clientCallback_.messages[0]);
+  EXPECT_EQ(1, clientCallback_.pongs);
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, Deflate) {
+  auto req = makeHandshake();
+  req->getHeaders().add("Sec-WebSocket-Extensions",
+                        "x-webkit-deflate-frame, "
+                        "permessage-deflate; server_max_window_bits=10, "
+                        "permessage-deflate; client_max_window_bits");
+  open(std::move(req));
+  EXPECT_EQ("permessage-deflate; server_no_context_takeover",
+            response_.getHeaders().getSingleOrEmpty(
+              "Sec-WebSocket-Extensions"));
+  client_.setDeflate(6, false);
+  std::string text(1000, 'a');
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer(text));
+  send();
+  EXPECT_EQ(0, clientCallback_.errorCode);
+  ASSERT_EQ(1, clientCallback_.messages.size());
+  EXPECT_EQ(text, clientCallback_.messages[0]);
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, ClientCloses) {
+  open(makeHandshake());
+  EXPECT_CALL(*downstream_, sendEOM());
+  client_.generateClose(output_, WebSocketCodec::kCloseGoingAway, "bye");
+  send();
+  EXPECT_EQ(WebSocketCodec::kCloseGoingAway, seen_.closeCode);
+  EXPECT_EQ(WebSocketCodec::kCloseGoingAway, clientCallback_.closeCode);
+  handler_->onEOM();
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, ProtocolError) {
+  open(makeHandshake());
+  EXPECT_CALL(*downstream_, sendEOM());
+  // an unmasked frame from the client
+  const uint8_t frame[] = {0x81, 0x00};
+  handler_->onBody(IOBuf::copyBuffer(frame, sizeof(frame)));
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, seen_.closeCode);
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, clientCallback_.closeCode);
+  handler_->requestComplete();
+}
+
+TEST_F(WebSocketHandlerTest, PausedWithEgress) {
+  open(makeHandshake());
+  EXPECT_CALL(*downstream_, pauseIngress());
+  handler_->onEgressPaused();
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("queued"));
+  send();
+  EXPECT_EQ(0, clientCallback_.messages.size());
+  EXPECT_CALL(*downstream_, resumeIngress());
+  handler_->onEgressResumed();
+  ASSERT_EQ(1, clientCallback_.messages.size());
+  EXPECT_EQ("queued", clientCallback_.messages[0]);
+  handler_->requestComplete();
+}
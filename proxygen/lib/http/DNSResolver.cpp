@@ -0,0 +1,256 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/DNSResolver.h>
+
+#include <cstring>
+#include <glog/logging.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+using folly::SocketAddress;
+using std::string;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+string getAddresses(const string& host, int flags,
+                    vector<SocketAddress>* addresses) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = flags;
+  struct addrinfo* results = nullptr;
+  int rc = getaddrinfo(host.c_str(), nullptr, &hints, &results);
+  if (rc != 0) {
+    return gai_strerror(rc);
+  }
+
+  vector<SocketAddress> v6;
+  vector<SocketAddress> v4;
+  for (auto ai = results; ai; ai = ai->ai_next) {
+    if (ai->ai_family != AF_INET6 && ai->ai_family != AF_INET) {
+      continue;
+    }
+    SocketAddress addr;
+    addr.setFromSockaddr(ai->ai_addr, ai->ai_addrlen);
+    (ai->ai_family == AF_INET6 ? v6 : v4).push_back(addr);
+  }
+  freeaddrinfo(results);
+
+  addresses->clear();
+  for (size_t i = 0; i < v6.size() || i < v4.size(); i++) {
+    if (i < v6.size()) {
+      addresses->push_back(v6[i]);
+    }
+    if (i < v4.size()) {
+      addresses->push_back(v4[i]);
+    }
+  }
+  return addresses->empty() ? "no addresses" : "";
+}
+
+}
+
+const size_t DNSResolver::kDefaultMaxEntries;
+const size_t DNSResolver::kDefaultThreads;
+
+DNSResolver::DNSResolver(folly::EventBase* eventBase,
+                         std::chrono::seconds ttl,
+                         std::chrono::seconds negativeTtl,
+                         size_t maxEntries,
+                         size_t threads):
+    eventBase_(CHECK_NOTNULL(eventBase)),
+    ttl_(ttl),
+    negativeTtl_(negativeTtl),
+    maxEntries_(maxEntries),
+    self_(std::make_shared<DNSResolver*>(this)) {
+  CHECK_GT(threads, 0);
+  for (size_t i = 0; i < threads; i++) {
+    threads_.emplace_back([this] { worker(); });
+  }
+}
+
+DNSResolver::~DNSResolver() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread: threads_) {
+    thread.join();
+  }
+  *self_ = nullptr;
+}
+
+void DNSResolver::resolve(const string& host, uint16_t port, Callback* cb) {
+  CHECK(eventBase_->isInEventBaseThread());
+  vector<SocketAddress> addresses;
+  if (resolveNumeric(host, &addresses)) {
+    for (auto& addr: addresses) {
+      addr.setPort(port);
+    }
+    cb->resolveSuccess(addresses);
+    return;
+  }
+
+  auto it = entries_.find(host);
+  if (it != entries_.end() && !it->second.pending &&
+      it->second.expires <= getCurrentTime() &&
+      it->second.waiters.empty()) {
+    entries_.erase(it);
+    it = entries_.end();
+  }
+  if (it != entries_.end()) {
+    Entry& entry = it->second;
+    if (entry.pending || !entry.waiters.empty()) {
+      // coalesce with the lookup in progress, or queue up behind the
+      // callbacks being delivered
+      entry.waiters.emplace_back(cb, port);
+    } else {
+      deliver(entry, Waiter(cb, port));
+    }
+    return;
+  }
+
+  evict();
+  entries_[host].waiters.emplace_back(cb, port);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(host);
+  }
+  cond_.notify_one();
+}
+
+void DNSResolver::cancel(Callback* cb) {
+  for (auto& entry: entries_) {
+    entry.second.waiters.remove_if([cb] (const Waiter& waiter) {
+        return waiter.cb == cb;
+      });
+  }
+}
+
+bool DNSResolver::getCached(const string& host, uint16_t port,
+                            vector<SocketAddress>* addresses) {
+  if (!resolveNumeric(host, addresses)) {
+    auto it = entries_.find(host);
+    if (it == entries_.end() || it->second.pending ||
+        !it->second.error.empty() || it->second.expires <= getCurrentTime()) {
+      return false;
+    }
+    *addresses = it->second.addresses;
+  }
+  for (auto& addr: *addresses) {
+    addr.setPort(port);
+  }
+  return true;
+}
+
+void DNSResolver::lookupDone(const string& host,
+                             vector<SocketAddress> addresses,
+                             string error) {
+  auto it = entries_.find(host);
+  CHECK(it != entries_.end());
+  Entry& entry = it->second;
+  entry.pending = false;
+  entry.addresses = std::move(addresses);
+  entry.error = std::move(error);
+  entry.expires = getCurrentTime() +
+    (entry.error.empty() ? ttl_ : negativeTtl_);
+  VLOG(4) << "Resolved " << host << " to " << entry.addresses.size()
+          << " addresses " << entry.error;
+
+  // The callbacks may resolve, cancel or delete the resolver
+  auto self = self_;
+  while (*self) {
+    it = entries_.find(host);
+    if (it == entries_.end() || it->second.waiters.empty()) {
+      break;
+    }
+    Waiter waiter = it->second.waiters.front();
+    it->second.waiters.pop_front();
+    deliver(it->second, waiter);
+  }
+}
+
+void DNSResolver::evict() {
+  if (entries_.size() < maxEntries_) {
+    return;
+  }
+  auto now = getCurrentTime();
+  auto oldest = entries_.end();
+  for (auto it = entries_.begin(); it != entries_.end(); ) {
+    if (it->second.pending || !it->second.waiters.empty()) {
+      ++it;
+    } else if (it->second.expires <= now) {
+      it = entries_.erase(it);
+    } else {
+      if (oldest == entries_.end() ||
+          it->second.expires < oldest->second.expires) {
+        oldest = it;
+      }
+      ++it;
+    }
+  }
+  if (entries_.size() >= maxEntries_ && oldest != entries_.end()) {
+    entries_.erase(oldest);
+  }
+}
+
+void DNSResolver::worker() {
+  auto self = self_;
+  while (true) {
+    string host;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      host = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    vector<SocketAddress> addresses;
+    string error = lookup(host, &addresses);
+    eventBase_->runInEventBaseThread([self, host, addresses, error] {
+        if (*self) {
+          (*self)->lookupDone(host, addresses, error);
+        }
+      });
+  }
+}
+
+void DNSResolver::deliver(const Entry& entry, const Waiter& waiter) {
+  if (!entry.error.empty()) {
+    waiter.cb->resolveError(entry.error);
+    return;
+  }
+  vector<SocketAddress> addresses(entry.addresses);
+  for (auto& addr: addresses) {
+    addr.setPort(waiter.port);
+  }
+  waiter.cb->resolveSuccess(addresses);
+}
+
+bool DNSResolver::resolveNumeric(const string& host,
+                                 vector<SocketAddress>* addresses) {
+  // doesn't block, getaddrinfo() doesn't query anything for these
+  return getAddresses(host, AI_NUMERICHOST, addresses).empty();
+}
+
+string DNSResolver::lookup(const string& host,
+                           vector<SocketAddress>* addresses) {
+  return getAddresses(host, AI_ADDRCONFIG, addresses);
+}
+
+}
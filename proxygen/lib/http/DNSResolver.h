@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/EventBase.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/Time.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Resolves host names for the thread of one EventBase without blocking
+ * it. The getaddrinfo() calls run on a few threads of the resolver, and
+ * the results are delivered in the EventBase.
+ *
+ * Answers are cached for ttl, and failures for negativeTtl. getaddrinfo()
+ * doesn't tell the TTLs of the records, so these are fixed. Lookups of a
+ * name that is already being resolved wait for the same answer instead of
+ * asking again. Numeric addresses are answered at once.
+ *
+ * The addresses are ordered IPv6 first, alternating families, so that
+ * racing them (see HTTPConnector) tries both families early.
+ */
+class DNSResolver {
+ public:
+  static const size_t kDefaultMaxEntries = 1024;
+  static const size_t kDefaultThreads = 2;
+
+  class Callback {
+   public:
+    virtual ~Callback() {}
+    /**
+     * addresses is never empty, and has the requested port
+     */
+    virtual void resolveSuccess(
+      const std::vector<folly::SocketAddress>& addresses) noexcept = 0;
+    virtual void resolveError(const std::string& error) noexcept = 0;
+  };
+
+  /**
+   * eventBase must outlive the resolver
+   */
+  explicit DNSResolver(
+    folly::EventBase* eventBase,
+    std::chrono::seconds ttl = std::chrono::seconds(60),
+    std::chrono::seconds negativeTtl = std::chrono::seconds(5),
+    size_t maxEntries = kDefaultMaxEntries,
+    size_t threads = kDefaultThreads);
+
+  /**
+   * Abandons the pending lookups without invoking their callbacks. This
+   * waits for the getaddrinfo() calls in progress to return.
+   */
+  ~DNSResolver();
+
+  /**
+   * Invoke cb with the addresses of host, right away if they are known.
+   * Must be called in the thread of the EventBase. cb must outlive the
+   * lookup, or be cancel()ed.
+   */
+  void resolve(const std::string& host, uint16_t port, Callback* cb);
+
+  /**
+   * Abandon the lookups made for cb. No callbacks will be invoked on it.
+   */
+  void cancel(Callback* cb);
+
+  /**
+   * Get the cached addresses of host, with port, without resolving it
+   *
+   * @return false if there are none
+   */
+  bool getCached(const std::string& host, uint16_t port,
+                 std::vector<folly::SocketAddress>* addresses);
+
+  size_t getNumEntries() const {
+    return entries_.size();
+  }
+
+ private:
+  struct Waiter {
+    Waiter(Callback* c, uint16_t p): cb(c), port(p) {}
+
+    Callback* cb;
+    uint16_t port;
+  };
+
+  struct Entry {
+    // set once the lookup is done
+    TimePoint expires;
+    std::vector<folly::SocketAddress> addresses;
+    std::string error;
+    bool pending{true};
+    std::list<Waiter> waiters;
+  };
+
+  void lookupDone(const std::string& host,
+                  std::vector<folly::SocketAddress> addresses,
+                  std::string error);
+  void evict();
+  void worker();
+
+  static void deliver(const Entry& entry, const Waiter& waiter);
+  static bool resolveNumeric(const std::string& host,
+                             std::vector<folly::SocketAddress>* addresses);
+  static std::string lookup(const std::string& host,
+                            std::vector<folly::SocketAddress>* addresses);
+
+  folly::EventBase* eventBase_;
+  const std::chrono::seconds ttl_;
+  const std::chrono::seconds negativeTtl_;
+  const size_t maxEntries_;
+  std::map<std::string, Entry> entries_;
+  // cleared when the resolver goes away, as the results of the lookups
+  // running then may still be queued in the EventBase
+  std::shared_ptr<DNSResolver*> self_;
+
+  // the host names to resolve, shared with the worker threads
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::string> queue_;
+  bool stopping_{false};
+  std::vector<std::thread> threads_;
+};
+
+}
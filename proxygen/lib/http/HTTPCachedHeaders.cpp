@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/HTTPCachedHeaders.h>
+
+#include <glog/logging.h>
+#include <proxygen/lib/http/codec/SPDYConstants.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+bool isCacheable(HTTPHeaderCode code, const string& name) {
+  switch (code) {
+    case HTTP_HEADER_CONNECTION:
+    case HTTP_HEADER_CONTENT_LENGTH:
+    case HTTP_HEADER_DATE:
+    case HTTP_HEADER_HOST:
+    case HTTP_HEADER_KEEP_ALIVE:
+    case HTTP_HEADER_PROXY_CONNECTION:
+    case HTTP_HEADER_TE:
+    case HTTP_HEADER_TRAILER:
+    case HTTP_HEADER_TRANSFER_ENCODING:
+    case HTTP_HEADER_UPGRADE:
+      return false;
+    default:
+      break;
+  }
+  if (name.empty() || name[0] == ':') {
+    return false;
+  }
+  // the SPDY/2 names for the request and status line
+  for (const string* reserved : { &spdy::kNameVersionv2,
+                                  &spdy::kNameStatusv2,
+                                  &spdy::kNameMethodv2,
+                                  &spdy::kNamePathv2,
+                                  &spdy::kNameSchemev2 }) {
+    if (caseInsensitiveEqual(name, *reserved)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+HTTPCachedHeaders::HTTPCachedHeaders(HTTPHeaders headers)
+    : headers_(std::move(headers)) {
+  headers_.forEachWithCode([] (HTTPHeaderCode code,
+                               const string& name,
+                               const string& value) {
+    CHECK(isCacheable(code, name)) << "header \"" << name
+                                   << "\" can't be cached";
+    CHECK(!value.empty()) << "empty value for cached header \"" << name
+                          << "\"";
+  });
+}
+
+const HTTPCachedHeaders::Serialized& HTTPCachedHeaders::getSerialized(
+    Format format, const Serializer& serialize) const {
+  size_t i = size_t(format);
+  CHECK_LT(i, kNumFormats);
+  std::call_once(serializedOnce_[i], [&] {
+    serialized_[i] = serialize(headers_);
+  });
+  return serialized_[i];
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/http/HTTPHeaders.h>
+
+namespace proxygen {
+
+/**
+ * An immutable set of headers that is sent unchanged with many messages,
+ * like the static headers of a health check or of a CDN response.
+ *
+ * The codecs serialize the set once per wire format and splice the cached
+ * bytes into every message that carries it, instead of walking and
+ * re-serializing the headers each time. Only end-to-end headers that the
+ * codecs pass through untouched may be cached: the constructor CHECKs that
+ * there are no per-hop, framing, Date, Host or SPDY reserved headers, and
+ * no empty names or values.
+ *
+ * An instance may be shared by messages on different threads.
+ */
+class HTTPCachedHeaders {
+ public:
+  enum class Format : uint8_t {
+    HTTP_1X = 0,
+    SPDY2 = 1,
+    SPDY3 = 2,
+    SPDY3_HPACK = 3,
+    NUM_FORMATS = 4,
+  };
+
+  struct Serialized {
+    // nullptr if the format can't reuse serialized headers
+    std::unique_ptr<folly::IOBuf> data;
+    // number of entries in data, for formats that carry a count
+    uint32_t numEntries{0};
+  };
+
+  typedef std::function<Serialized(const HTTPHeaders&)> Serializer;
+
+  explicit HTTPCachedHeaders(HTTPHeaders headers);
+
+  const HTTPHeaders& getHeaders() const {
+    return headers_;
+  }
+
+  /**
+   * @return the headers serialized in the given format. serialize is only
+   * called the first time a format is requested, later calls return the
+   * cached result.
+   */
+  const Serialized& getSerialized(Format format,
+                                  const Serializer& serialize) const;
+
+ private:
+  static const size_t kNumFormats = size_t(Format::NUM_FORMATS);
+
+  const HTTPHeaders headers_;
+  mutable std::once_flag serializedOnce_[kNumFormats];
+  mutable Serialized serialized_[kNumFormats];
+};
+
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/HTTPCannedResponse.h>
+
+#include <folly/Conv.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/RFC2616.h>
+
+using std::string;
+
+namespace proxygen {
+
+const size_t HTTPCannedResponse::kDateLength;
+
+HTTPCannedResponse::HTTPCannedResponse(uint16_t status,
+                                       const string& statusMessage,
+                                       HTTPHeaders headers,
+                                       std::unique_ptr<folly::IOBuf> body)
+    : body_(std::move(body)) {
+  CHECK(status >= 200 && !RFC2616::responseBodyMustBeEmpty(status))
+    << "can't can a " << status << " response";
+  if (body_ && body_->computeChainDataLength() == 0) {
+    body_.reset();
+  }
+  contentLength_ = folly::to<string>(
+    body_ ? body_->computeChainDataLength() : 0);
+  message_.setHTTPVersion(1, 1);
+  message_.setStatusCode(status);
+  message_.setStatusMessage(statusMessage);
+  message_.setCachedHeaders(
+    std::make_shared<const HTTPCachedHeaders>(std::move(headers)));
+  message_.getHeaders().set(HTTP_HEADER_CONTENT_LENGTH, contentLength_);
+  keepaliveHead_ = serializeHTTP1x(true);
+  closeHead_ = serializeHTTP1x(false);
+}
+
+bool HTTPCannedResponse::isUnchanged(const HTTPMessage& msg) const {
+  const auto& headers = msg.getHeaders();
+  return msg.getStatusCode() == message_.getStatusCode() &&
+    msg.getCachedHeaders() == message_.getCachedHeaders() &&
+    headers.size() == 1 &&
+    headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH) == contentLength_;
+}
+
+HTTPCannedResponse::Head HTTPCannedResponse::serializeHTTP1x(
+    bool keepalive) const {
+  // the order of HTTP1xCodec::generateHeader()
+  Head head;
+  message_.getCachedHeaders()->getHeaders().forEach(
+    [&] (const string& name, const string& value) {
+      head.data.append(name).append(": ").append(value).append("\r\n");
+    });
+  head.data.append("Date: ");
+  head.dateOffset = head.data.size();
+  head.data.append(kDateLength, ' ').append("\r\n");
+  head.data.append(keepalive ? "Connection: keep-alive\r\n" :
+                   "Connection: close\r\n");
+  head.data.append("Content-Length: ").append(contentLength_);
+  head.data.append("\r\n\r\n");
+  return head;
+}
+
+}
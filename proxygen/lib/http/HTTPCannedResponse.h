@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * A whole response that is sent unchanged many times, like a health check
+ * answer, a redirect or a fixed error page.
+ *
+ * Its headers go in an HTTPCachedHeaders (so the same restrictions apply),
+ * which the SPDY and HTTP/2 codecs serialize once. For HTTP/1.x the whole
+ * head, from the headers to the empty line, is serialized up front for
+ * both keep-alive and close. Sending it is then one copy of that, with the
+ * current date written over a placeholder. The body is an immutable IOBuf
+ * that is sent as clones.
+ *
+ * An instance may be shared by responses on different threads. Send it
+ * with ResponseBuilder::sendCanned().
+ */
+class HTTPCannedResponse {
+ public:
+  // the length of an HTTP date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+  static const size_t kDateLength = 29;
+
+  struct Head {
+    std::string data;
+    size_t dateOffset{0};
+  };
+
+  /**
+   * status can't be 1xx, 204 or 304, the response always has a
+   * Content-Length
+   */
+  HTTPCannedResponse(uint16_t status,
+                     const std::string& statusMessage,
+                     HTTPHeaders headers,
+                     std::unique_ptr<folly::IOBuf> body);
+
+  /**
+   * @return the message to send, without the body
+   */
+  const HTTPMessage& getMessage() const {
+    return message_;
+  }
+
+  /**
+   * @return the body, nullptr if it is empty
+   */
+  const folly::IOBuf* getBody() const {
+    return body_.get();
+  }
+
+  /**
+   * @return the HTTP/1.x head of the response, after the status line
+   */
+  const Head& getHTTP1xHead(bool keepalive) const {
+    return keepalive ? keepaliveHead_ : closeHead_;
+  }
+
+  /**
+   * @return whether msg is still a copy of getMessage(), if it was changed
+   *         on the way (by a filter, say) the pre-serialized head can't
+   *         be used
+   */
+  bool isUnchanged(const HTTPMessage& msg) const;
+
+ private:
+  Head serializeHTTP1x(bool keepalive) const;
+
+  HTTPMessage message_;
+  std::unique_ptr<folly::IOBuf> body_;
+  std::string contentLength_;
+  Head keepaliveHead_;
+  Head closeHead_;
+};
+
+}
@@ -11,11 +11,21 @@
 
 #include <folly/experimental/wangle/ssl/SSLUtil.h>
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#ifndef PROXYGEN_HTTP1_ONLY
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
 #include <proxygen/lib/http/codec/SPDYCodec.h>
+#endif
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 #include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/LoopClock.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
 
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+
 using namespace apache::thrift::async;
 using namespace apache::thrift::transport;
 using namespace folly;
@@ -27,21 +37,25 @@ namespace {
 
 unique_ptr<HTTPCodec> makeCodec(const string& chosenProto,
                                 bool forceHTTP1xCodecTo1_1) {
+#ifndef PROXYGEN_HTTP1_ONLY
   auto spdyVersion = SPDYCodec::getVersion(chosenProto);
   if (spdyVersion) {
     return folly::make_unique<SPDYCodec>(TransportDirection::UPSTREAM,
                                          *spdyVersion);
-  } else {
-    if (!chosenProto.empty() &&
-        !HTTP1xCodec::supportsNextProtocol(chosenProto)) {
-      LOG(ERROR) << "Chosen upstream protocol " <<
-        "\"" << chosenProto << "\" is unimplemented. " <<
-        "Attempting to use HTTP/1.1";
-    }
-
-    return folly::make_unique<HTTP1xCodec>(TransportDirection::UPSTREAM,
-                                           forceHTTP1xCodecTo1_1);
+  } else if (HTTP2Codec::supportsNextProtocol(chosenProto) ||
+             chosenProto == http2::kProtocolCleartextString) {
+    return folly::make_unique<HTTP2Codec>(TransportDirection::UPSTREAM);
   }
+#endif
+  if (!chosenProto.empty() &&
+      !HTTP1xCodec::supportsNextProtocol(chosenProto)) {
+    LOG(ERROR) << "Chosen upstream protocol " <<
+      "\"" << chosenProto << "\" is unimplemented. " <<
+      "Attempting to use HTTP/1.1";
+  }
+
+  return folly::make_unique<HTTP1xCodec>(TransportDirection::UPSTREAM,
+                                         forceHTTP1xCodecTo1_1);
 }
 
 }
@@ -67,6 +81,17 @@ void HTTPConnector::reset() {
     socket_.reset(); // This invokes connectError() but will be ignored
     cb_ = cb;
   }
+  if (racing_) {
+    endRace();
+  }
+  if (resolve_) {
+    resolver_->cancel(this);
+    resolve_.reset();
+    if (raceSession_) {
+      SSL_SESSION_free(raceSession_);
+      raceSession_ = nullptr;
+    }
+  }
 }
 
 void HTTPConnector::connect(
@@ -80,9 +105,9 @@ void HTTPConnector::connect(
   transportInfo_ = TransportInfo();
   transportInfo_.ssl = false;
   socket_.reset(new TAsyncSocket(eventBase));
-  connectStart_ = getCurrentTime();
+  connectStart_ = getLoopTime();
   socket_->connect(this, connectAddr, timeoutMs.count(),
-                   socketOptions, bindAddr);
+                   withFastOpen(socketOptions), bindAddr);
 }
 
 void HTTPConnector::connectSSL(
@@ -98,13 +123,81 @@ void HTTPConnector::connectSSL(
   transportInfo_ = TransportInfo();
   transportInfo_.ssl = true;
   auto sslSock = new TAsyncSSLSocket(context, eventBase);
+  if (!serverName_.empty()) {
+    sslSock->setServerName(serverName_);
+  }
+  if (!session && sessionCache_) {
+    session = sessionCache_->getSession(connectAddr.describe());
+  }
   if (session) {
     sslSock->setSSLSession(session, true /* take ownership */);
   }
   socket_.reset(sslSock);
-  connectStart_ = getCurrentTime();
+  connectStart_ = getLoopTime();
   socket_->connect(this, connectAddr, timeoutMs.count(),
-                   socketOptions, bindAddr);
+                   withFastOpen(socketOptions), bindAddr);
+}
+
+void HTTPConnector::connect(
+  EventBase* eventBase,
+  const vector<folly::SocketAddress>& connectAddrs,
+  chrono::milliseconds attemptDelay,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  raceContext_.reset();
+  raceSession_ = nullptr;
+  startRace(eventBase, connectAddrs, attemptDelay, timeoutMs,
+            socketOptions, bindAddr);
+}
+
+void HTTPConnector::connectSSL(
+  EventBase* eventBase,
+  const vector<folly::SocketAddress>& connectAddrs,
+  const shared_ptr<SSLContext>& context,
+  chrono::milliseconds attemptDelay,
+  SSL_SESSION* session,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  raceContext_ = CHECK_NOTNULL(context);
+  raceSession_ = session;
+  startRace(eventBase, connectAddrs, attemptDelay, timeoutMs,
+            socketOptions, bindAddr);
+}
+
+void HTTPConnector::connect(
+  EventBase* eventBase,
+  const string& host,
+  uint16_t port,
+  chrono::milliseconds attemptDelay,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  raceContext_.reset();
+  raceSession_ = nullptr;
+  startResolve(eventBase, host, port, attemptDelay, timeoutMs,
+               socketOptions, bindAddr);
+}
+
+void HTTPConnector::connectSSL(
+  EventBase* eventBase,
+  const string& host,
+  uint16_t port,
+  const shared_ptr<SSLContext>& context,
+  chrono::milliseconds attemptDelay,
+  SSL_SESSION* session,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  raceContext_ = CHECK_NOTNULL(context);
+  raceSession_ = session;
+  startResolve(eventBase, host, port, attemptDelay, timeoutMs,
+               socketOptions, bindAddr);
 }
 
 std::chrono::milliseconds HTTPConnector::timeElapsed() {
@@ -114,6 +207,202 @@ std::chrono::milliseconds HTTPConnector::timeElapsed() {
   return std::chrono::milliseconds(0);
 }
 
+std::chrono::milliseconds HTTPConnector::timeElapsed(size_t attempt) const {
+  CHECK_LT(attempt, attempts_.size());
+  const Attempt& a = *attempts_[attempt];
+  if (timePointInitialized(a.end)) {
+    return millisecondsBetween(a.end, a.start);
+  }
+  return millisecondsSince(a.start);
+}
+
+const folly::SocketAddress& HTTPConnector::getAttemptAddress(
+    size_t attempt) const {
+  CHECK_LT(attempt, attempts_.size());
+  return attempts_[attempt]->address;
+}
+
+// Racing
+
+HTTPConnector::Attempt::Attempt(HTTPConnector* c,
+                                const folly::SocketAddress& addr)
+    : connector(c),
+      address(addr) {
+}
+
+void HTTPConnector::Attempt::connectSuccess() noexcept {
+  if (connector) {
+    connector->attemptSuccess(this);
+  }
+}
+
+void HTTPConnector::Attempt::connectError(const TTransportException& ex)
+    noexcept {
+  if (connector) {
+    connector->attemptError(this, ex);
+  }
+}
+
+void HTTPConnector::startRace(
+  EventBase* eventBase,
+  const vector<folly::SocketAddress>& connectAddrs,
+  chrono::milliseconds attemptDelay,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  DCHECK(!isBusy());
+  CHECK(!connectAddrs.empty());
+  transportInfo_ = TransportInfo();
+  transportInfo_.ssl = (raceContext_ != nullptr);
+  if (!attemptTimeout_ || raceEventBase_ != eventBase) {
+    attemptTimeout_.reset(new AttemptTimeout(this, eventBase));
+  }
+  raceEventBase_ = eventBase;
+  raceAddrs_ = connectAddrs;
+  attemptDelay_ = attemptDelay;
+  attemptTimeoutMs_ = timeoutMs;
+  raceSocketOptions_ = withFastOpen(socketOptions);
+  raceBindAddr_ = bindAddr;
+  attempts_.clear();
+  attemptsRunning_ = 0;
+  racing_ = true;
+  connectStart_ = getLoopTime();
+  startAttempt();
+}
+
+void HTTPConnector::startResolve(
+  EventBase* eventBase,
+  const string& host,
+  uint16_t port,
+  chrono::milliseconds attemptDelay,
+  chrono::milliseconds timeoutMs,
+  const TAsyncSocket::OptionMap& socketOptions,
+  const folly::SocketAddress& bindAddr) {
+
+  DCHECK(!isBusy());
+  CHECK(resolver_) << "No resolver to connect to " << host;
+  resolve_.reset(new Resolve{eventBase, attemptDelay, timeoutMs,
+                             socketOptions, bindAddr});
+  // This may call back right away, with a cached answer
+  resolver_->resolve(host, port, this);
+}
+
+void HTTPConnector::startAttempt() {
+  CHECK_LT(attempts_.size(), raceAddrs_.size());
+  const folly::SocketAddress& addr = raceAddrs_[attempts_.size()];
+  attempts_.emplace_back(new Attempt(this, addr));
+  Attempt* attempt = attempts_.back().get();
+
+  if (raceContext_) {
+    auto sslSock = new TAsyncSSLSocket(raceContext_, raceEventBase_);
+    if (!serverName_.empty()) {
+      sslSock->setServerName(serverName_);
+    }
+    SSL_SESSION* session = raceSession_;
+    raceSession_ = nullptr;
+    if (!session && sessionCache_) {
+      session = sessionCache_->getSession(addr.describe());
+    }
+    if (session) {
+      sslSock->setSSLSession(session, true /* take ownership */);
+    }
+    attempt->socket.reset(sslSock);
+  } else {
+    attempt->socket.reset(new TAsyncSocket(raceEventBase_));
+  }
+  ++attemptsRunning_;
+  if (attempts_.size() < raceAddrs_.size()) {
+    attemptTimeout_->scheduleTimeout(attemptDelay_.count());
+  }
+
+  VLOG(4) << "Connect attempt " << attempts_.size() << " to " << addr;
+  attempt->start = getLoopTime();
+  // This may fail right away, and even end the race
+  attempt->socket->connect(attempt, addr, attemptTimeoutMs_.count(),
+                           raceSocketOptions_, raceBindAddr_);
+}
+
+void HTTPConnector::attemptSuccess(Attempt* attempt) {
+  attempt->connector = nullptr;
+  attempt->end = getLoopTime();
+  --attemptsRunning_;
+  VLOG(4) << "Connected to " << attempt->address << " in "
+          << millisecondsBetween(attempt->end, attempt->start).count()
+          << "ms";
+  socket_ = std::move(attempt->socket);
+  endRace();
+  connectSuccess();
+}
+
+void HTTPConnector::attemptError(Attempt* attempt,
+                                 const TTransportException& ex) {
+  attempt->connector = nullptr;
+  attempt->end = getLoopTime();
+  attempt->socket.reset();
+  --attemptsRunning_;
+  VLOG(4) << "Connecting to " << attempt->address << " failed after "
+          << millisecondsBetween(attempt->end, attempt->start).count()
+          << "ms: " << ex.what();
+
+  if (attempts_.size() < raceAddrs_.size()) {
+    // No point waiting out the delay, go on with the next address
+    attemptTimeout_->cancelTimeout();
+    startAttempt();
+  } else if (attemptsRunning_ == 0) {
+    endRace();
+    if (cb_) {
+      cb_->connectError(ex);
+    }
+  }
+}
+
+void HTTPConnector::endRace() {
+  racing_ = false;
+  attemptTimeout_->cancelTimeout();
+  auto now = getLoopTime();
+  for (auto& attempt: attempts_) {
+    if (attempt->connector) {
+      // Abandoned, closing the socket fails the connect but the attempt
+      // no longer reports it
+      attempt->connector = nullptr;
+      attempt->end = now;
+      attempt->socket.reset();
+    }
+  }
+  attemptsRunning_ = 0;
+}
+
+TAsyncSocket::OptionMap HTTPConnector::withFastOpen(
+  const TAsyncSocket::OptionMap& socketOptions) const {
+  TAsyncSocket::OptionMap options(socketOptions);
+  if (fastOpen_) {
+    options[TAsyncSocket::OptionKey{IPPROTO_TCP, TCP_FASTOPEN_CONNECT}] = 1;
+  }
+  return options;
+}
+
+// DNSResolver::Callback interface
+
+void HTTPConnector::resolveSuccess(const vector<folly::SocketAddress>& addrs)
+  noexcept {
+  unique_ptr<Resolve> resolve(std::move(resolve_));
+  startRace(resolve->eventBase, addrs, resolve->attemptDelay,
+            resolve->timeoutMs, resolve->socketOptions, resolve->bindAddr);
+}
+
+void HTTPConnector::resolveError(const string& error) noexcept {
+  resolve_.reset();
+  if (raceSession_) {
+    SSL_SESSION_free(raceSession_);
+    raceSession_ = nullptr;
+  }
+  if (cb_) {
+    cb_->connectError(TTransportException(TTransportException::NOT_OPEN,
+                                          "Failed to resolve: " + error));
+  }
+}
+
 // Callback interface
 
 void HTTPConnector::connectSuccess() noexcept {
@@ -143,6 +432,13 @@ void HTTPConnector::connectSuccess() noexcept {
     transportInfo_.sslVersion = sslSocket->getSSLVersion();
     transportInfo_.sslResume = SSLUtil::getResumeState(sslSocket);
 
+    if (sessionCache_) {
+      SSL_SESSION* session = SSL_get_session(sslSocket->getSSL());
+      if (session) {
+        sessionCache_->addSession(peerAddress.describe(), session);
+      }
+    }
+
     codec = makeCodec(transportInfo_.sslNextProtocol, forceHTTP1xCodecTo1_1_);
   } else {
     codec = makeCodec(plaintextProtocol_, forceHTTP1xCodecTo1_1_);
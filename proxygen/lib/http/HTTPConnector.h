@@ -10,7 +10,10 @@
 #pragma once
 
 #include <folly/experimental/wangle/acceptor/TransportInfo.h>
+#include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/SSLContext.h>
+#include <proxygen/lib/http/DNSResolver.h>
+#include <proxygen/lib/ssl/SSLSessionCache.h>
 #include <proxygen/lib/utils/AsyncTimeoutSet.h>
 #include <proxygen/lib/utils/Time.h>
 #include <thrift/lib/cpp/async/TAsyncSocket.h>
@@ -23,9 +26,16 @@ class HTTPUpstreamSession;
  * This class establishes new connections to HTTP or HTTPS servers. It
  * can be reused, even to connect to different addresses, but it can only
  * service setting up one connection at a time.
+ *
+ * Given several addresses of a server (IPv6 and IPv4 ones, or replicas),
+ * it races connections to them: it tries the first one, and the next one
+ * each time attemptDelay passes or an attempt fails, until one connects.
+ * The others are then abandoned. A black-holed address so only costs
+ * attemptDelay, not the whole connect timeout.
  */
 class HTTPConnector:
-      private apache::thrift::async::TAsyncSocket::ConnectCallback {
+      private apache::thrift::async::TAsyncSocket::ConnectCallback,
+      private DNSResolver::Callback {
  public:
   /**
    * This class defines the pure virtual interface on which to receive the
@@ -67,6 +77,44 @@ class HTTPConnector:
    */
   ~HTTPConnector();
 
+  /**
+   * Remember the TLS sessions of the secure connections in cache, by
+   * destination address, and resume them when connecting to the same
+   * address again without an explicit session. The cache may be shared by
+   * many connectors and threads.
+   */
+  void setSessionCache(std::shared_ptr<SSLSessionCache> cache) {
+    sessionCache_ = std::move(cache);
+  }
+
+  /**
+   * If true, connect with TCP Fast Open (TCP_FASTOPEN_CONNECT, Linux >=
+   * 4.11). Once the kernel has a cookie for the server, the connect
+   * completes at once and the first bytes written, the request or the TLS
+   * ClientHello, go out in the SYN. Without a cookie, or against a server
+   * that doesn't support it, the connection proceeds as usual.
+   */
+  void setFastOpen(bool fastOpen) {
+    fastOpen_ = fastOpen;
+  }
+
+  /**
+   * Send serverName in the SNI extension of the TLS connections, so that
+   * the server presents its certificate for that name.
+   */
+  void setServerName(const std::string& serverName) {
+    serverName_ = serverName;
+  }
+
+  /**
+   * Resolve the host names given to connect() and connectSSL() with
+   * resolver, which must run in the EventBase of the connections and
+   * outlive this connector.
+   */
+  void setResolver(DNSResolver* resolver) {
+    resolver_ = resolver;
+  }
+
   /**
    * Reset the object so that it can begin a new connection. No callbacks
    * will be invoked as a result of executing this function. After this
@@ -122,19 +170,164 @@ class HTTPConnector:
     const folly::SocketAddress& bindAddr =
       apache::thrift::async::TAsyncSocket::anyAddress);
 
+  /**
+   * Race plaintext connections to the servers at 'connectAddrs', see the
+   * class comment. The attempts are made in the given order, so put the
+   * preferred addresses (eg: IPv6 ones) first.
+   *
+   * @param attemptDelay How long to wait on an attempt before starting the
+   *                     next one in parallel.
+   * @param timeoutMs Optional. The connect timeout of each attempt.
+   * The other parameters are the same as in connect().
+   */
+  void connect(
+    folly::EventBase* eventBase,
+    const std::vector<folly::SocketAddress>& connectAddrs,
+    std::chrono::milliseconds attemptDelay,
+    std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0),
+    const apache::thrift::async::TAsyncSocket::OptionMap& socketOptions =
+      apache::thrift::async::TAsyncSocket::emptyOptionMap,
+    const folly::SocketAddress& bindAddr =
+      apache::thrift::async::TAsyncSocket::anyAddress);
+
+  /**
+   * Race secure connections to the servers at 'connectAddrs'. 'session' is
+   * only offered by the first attempt. The other parameters are the same
+   * as in the plaintext version.
+   */
+  void connectSSL(
+    folly::EventBase* eventBase,
+    const std::vector<folly::SocketAddress>& connectAddrs,
+    const std::shared_ptr<folly::SSLContext>& ctx,
+    std::chrono::milliseconds attemptDelay,
+    SSL_SESSION* session = nullptr,
+    std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0),
+    const apache::thrift::async::TAsyncSocket::OptionMap& socketOptions =
+      apache::thrift::async::TAsyncSocket::emptyOptionMap,
+    const folly::SocketAddress& bindAddr =
+      apache::thrift::async::TAsyncSocket::anyAddress);
+
+  /**
+   * Resolve host with the resolver (see setResolver()) and race plaintext
+   * connections to its addresses at port. The other parameters are the
+   * same as in the racing connect().
+   */
+  void connect(
+    folly::EventBase* eventBase,
+    const std::string& host,
+    uint16_t port,
+    std::chrono::milliseconds attemptDelay,
+    std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0),
+    const apache::thrift::async::TAsyncSocket::OptionMap& socketOptions =
+      apache::thrift::async::TAsyncSocket::emptyOptionMap,
+    const folly::SocketAddress& bindAddr =
+      apache::thrift::async::TAsyncSocket::anyAddress);
+
+  /**
+   * Resolve host and race secure connections to its addresses at port
+   */
+  void connectSSL(
+    folly::EventBase* eventBase,
+    const std::string& host,
+    uint16_t port,
+    const std::shared_ptr<folly::SSLContext>& ctx,
+    std::chrono::milliseconds attemptDelay,
+    SSL_SESSION* session = nullptr,
+    std::chrono::milliseconds timeoutMs = std::chrono::milliseconds(0),
+    const apache::thrift::async::TAsyncSocket::OptionMap& socketOptions =
+      apache::thrift::async::TAsyncSocket::emptyOptionMap,
+    const folly::SocketAddress& bindAddr =
+      apache::thrift::async::TAsyncSocket::anyAddress);
+
   /**
    * @returns the number of milliseconds since connecting began, or
    * zero if connecting hasn't started yet.
    */
   std::chrono::milliseconds timeElapsed();
 
+  /**
+   * @returns the number of attempts the last connection started, 1 unless
+   * it raced several addresses
+   */
+  size_t getNumAttempts() const { return attempts_.size(); }
+
+  /**
+   * @returns the number of milliseconds the given attempt took, or has
+   * taken so far if it is still in progress. Abandoned attempts stop
+   * counting when the race is won.
+   */
+  std::chrono::milliseconds timeElapsed(size_t attempt) const;
+
+  /**
+   * @returns the address of the given attempt
+   */
+  const folly::SocketAddress& getAttemptAddress(size_t attempt) const;
+
   /**
    * @returns true iff this connector is busy setting up a connection. If
    * this is false, it is safe to call connect() or connectSSL() on it again.
    */
-  bool isBusy() const { return socket_.get(); }
+  bool isBusy() const { return socket_.get() || racing_ || resolve_; }
 
  private:
+  class Attempt :
+      public apache::thrift::async::TAsyncSocket::ConnectCallback {
+   public:
+    Attempt(HTTPConnector* connector, const folly::SocketAddress& addr);
+
+    void connectSuccess() noexcept override;
+    void connectError(const apache::thrift::transport::TTransportException& ex)
+      noexcept override;
+
+    // null once the attempt is over
+    HTTPConnector* connector;
+    folly::SocketAddress address;
+    apache::thrift::async::TAsyncSocket::UniquePtr socket;
+    TimePoint start;
+    TimePoint end;
+  };
+
+  class AttemptTimeout : public folly::AsyncTimeout {
+   public:
+    AttemptTimeout(HTTPConnector* connector, folly::EventBase* eventBase)
+        : folly::AsyncTimeout(eventBase),
+          connector_(connector) {}
+
+    void timeoutExpired() noexcept override {
+      connector_->startAttempt();
+    }
+   private:
+    HTTPConnector* connector_;
+  };
+
+  void startRace(folly::EventBase* eventBase,
+                 const std::vector<folly::SocketAddress>& connectAddrs,
+                 std::chrono::milliseconds attemptDelay,
+                 std::chrono::milliseconds timeoutMs,
+                 const apache::thrift::async::TAsyncSocket::OptionMap&
+                   socketOptions,
+                 const folly::SocketAddress& bindAddr);
+  void startResolve(folly::EventBase* eventBase,
+                    const std::string& host,
+                    uint16_t port,
+                    std::chrono::milliseconds attemptDelay,
+                    std::chrono::milliseconds timeoutMs,
+                    const apache::thrift::async::TAsyncSocket::OptionMap&
+                      socketOptions,
+                    const folly::SocketAddress& bindAddr);
+  void startAttempt();
+  void attemptSuccess(Attempt* attempt);
+  void attemptError(Attempt* attempt,
+                    const apache::thrift::transport::TTransportException& ex);
+  void endRace();
+  apache::thrift::async::TAsyncSocket::OptionMap withFastOpen(
+    const apache::thrift::async::TAsyncSocket::OptionMap& socketOptions) const;
+
+  // DNSResolver::Callback
+  void resolveSuccess(const std::vector<folly::SocketAddress>& addresses)
+    noexcept override;
+  void resolveError(const std::string& error) noexcept override;
+
   void connectSuccess() noexcept override;
   void connectError(const apache::thrift::transport::TTransportException& ex)
     noexcept override;
@@ -144,8 +337,37 @@ class HTTPConnector:
   apache::thrift::async::TAsyncSocket::UniquePtr socket_;
   folly::TransportInfo transportInfo_;
   std::string plaintextProtocol_;
+  // in loop time, the connect times only need milliseconds
   TimePoint connectStart_;
   bool forceHTTP1xCodecTo1_1_;
+  std::shared_ptr<SSLSessionCache> sessionCache_;
+  bool fastOpen_{false};
+  DNSResolver* resolver_{nullptr};
+  std::string serverName_;
+
+  // The racing parameters while the host name is being resolved
+  struct Resolve {
+    folly::EventBase* eventBase;
+    std::chrono::milliseconds attemptDelay;
+    std::chrono::milliseconds timeoutMs;
+    apache::thrift::async::TAsyncSocket::OptionMap socketOptions;
+    folly::SocketAddress bindAddr;
+  };
+  std::unique_ptr<Resolve> resolve_;
+
+  // Racing state, the attempts are kept past the race for timeElapsed()
+  std::vector<std::unique_ptr<Attempt>> attempts_;
+  std::vector<folly::SocketAddress> raceAddrs_;
+  std::unique_ptr<AttemptTimeout> attemptTimeout_;
+  folly::EventBase* raceEventBase_{nullptr};
+  std::shared_ptr<folly::SSLContext> raceContext_;
+  SSL_SESSION* raceSession_{nullptr};
+  std::chrono::milliseconds attemptDelay_{0};
+  std::chrono::milliseconds attemptTimeoutMs_{0};
+  apache::thrift::async::TAsyncSocket::OptionMap raceSocketOptions_;
+  folly::SocketAddress raceBindAddr_;
+  uint32_t attemptsRunning_{0};
+  bool racing_{false};
 };
 
 }
@@ -25,6 +25,13 @@ std::ostream& operator<<(std::ostream& os, const HTTPException& ex) {
                                  getErrorCodeString(ex.getCodecStatusCode()) :
                                  "-1")
      << ", httpStatusCode=" << ex.getHttpStatusCode();
+  // the details of the errors that come without a formatted message
+  if (ex.hasStreamID()) {
+    os << ", streamID=" << ex.getStreamID();
+  }
+  if (ex.hasErrno()) {
+    os << ", errno=" << ex.getErrno();
+  }
   return os;
 }
 
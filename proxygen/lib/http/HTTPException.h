@@ -49,9 +49,25 @@ class HTTPException : public proxygen::Exception {
       : Exception(std::forward<Args>(args)...),
         dir_(dir) {}
 
+  /**
+   * An exception that allocates nothing, for the errors that come in
+   * floods: malformed input, timeouts, resets. what() is reason, which
+   * must be a string literal, or the name of error. The stream, codes and
+   * errno set on it are only formatted by describe() and operator<<, when
+   * it is logged.
+   */
+  HTTPException(Direction dir, ProxygenError error,
+                const char* reason = nullptr)
+      : Exception(std::string()),
+        dir_(dir),
+        reason_(reason ? reason : getErrorString(error)),
+        proxygenError_(error) {}
+
   HTTPException(const HTTPException& ex) :
       Exception(static_cast<const Exception&>(ex)),
       dir_(ex.dir_),
+      reason_(ex.reason_),
+      streamID_(ex.streamID_),
       proxygenError_(ex.proxygenError_),
       httpStatusCode_(ex.httpStatusCode_),
       codecStatusCode_(ex.codecStatusCode_),
@@ -71,6 +87,11 @@ class HTTPException : public proxygen::Exception {
    */
   std::string describe() const;
 
+  const char* what() const noexcept override {
+    auto msg = Exception::what();
+    return (*msg || !reason_) ? msg : reason_;
+  }
+
   Direction getDirection() const {
     return dir_;
   }
@@ -85,6 +106,18 @@ class HTTPException : public proxygen::Exception {
       dir_ == Direction::INGRESS_AND_EGRESS;
   }
 
+  // Accessors for the stream the error is about
+  bool hasStreamID() const {
+    return streamID_.hasValue();
+  }
+  void setStreamID(uint64_t streamID) {
+    streamID_ = streamID;
+  }
+  uint64_t getStreamID() const {
+    CHECK(hasStreamID());
+    return *streamID_;
+  }
+
   // Accessors for ProxygenError
   bool hasProxygenError() const {
     return (proxygenError_ != kErrorNone);
@@ -153,6 +186,9 @@ class HTTPException : public proxygen::Exception {
  private:
 
   Direction dir_;
+  // static, what() unless there is a formatted message
+  const char* reason_{nullptr};
+  folly::Optional<uint64_t> streamID_;
   ProxygenError proxygenError_{kErrorNone};
   uint32_t httpStatusCode_{0};
   folly::Optional<ErrorCode> codecStatusCode_;
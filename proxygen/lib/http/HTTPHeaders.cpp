@@ -11,6 +11,7 @@
 #include <proxygen/lib/http/HTTPHeaders.h>
 
 #include <glog/logging.h>
+#include <proxygen/lib/utils/UtilInl.h>
 #include <vector>
 
 using std::bitset;
@@ -21,6 +22,8 @@ namespace proxygen {
 
 const string empty_string;
 const std::string HTTPHeaders::COMBINE_SEPARATOR = ", ";
+const size_t HTTPHeaders::kInlineHeaders;
+const size_t HTTPHeaders::kNameTagThreshold;
 
 bitset<256>& HTTPHeaders::perHopHeaderCodes() {
   static bitset<256> perHopHeaderCodes;
@@ -45,9 +48,6 @@ HTTPHeaders::initGlobals() {
 
 HTTPHeaders::HTTPHeaders() :
   deletedCount_(0) {
-  codes_.reserve(kInitialVectorReserve);
-  headerNames_.reserve(kInitialVectorReserve);
-  headerValues_.reserve(kInitialVectorReserve);
 }
 
 void HTTPHeaders::add(folly::StringPiece name, folly::StringPiece value) {
@@ -58,6 +58,7 @@ void HTTPHeaders::add(folly::StringPiece name, folly::StringPiece value) {
       ? new std::string(name.data(), name.size())
       : HTTPCommonHeaders::getPointerToHeaderName(code));
   headerValues_.emplace_back(value.data(), value.size());
+  pushOwnedValueSlot();
 }
 
 void HTTPHeaders::rawAdd(const std::string& name, const std::string& value) {
@@ -71,6 +72,100 @@ void HTTPHeaders::addFromCodec(const char* str, size_t len, string&& value) {
       ? new string(str, len)
       : HTTPCommonHeaders::getPointerToHeaderName(code));
   headerValues_.emplace_back(std::move(value));
+  pushOwnedValueSlot();
+}
+
+void HTTPHeaders::addViewFromCodec(const char* str, size_t len,
+                                   folly::StringPiece value,
+                                   const folly::IOBuf& owner) {
+  DCHECK_GE(value.begin(), (const char*)owner.data());
+  DCHECK_LE(value.end(), (const char*)owner.tail());
+  if (value.empty()) {
+    addFromCodec(str, len, string());
+    return;
+  }
+
+  // Only pin each ingress buffer once, consecutive headers almost always
+  // come from the same one
+  if (!pinnedIngress_) {
+    pinnedIngress_ = owner.cloneOne();
+  } else if (pinnedIngress_->prev()->buffer() != owner.buffer()) {
+    pinnedIngress_->prependChain(owner.cloneOne());
+  }
+
+  if (valueViews_.empty()) {
+    valueViews_.resize(codes_.size());
+  }
+  const HTTPHeaderCode code = HTTPCommonHeaders::hash(str, len);
+  folly::StringPiece nameView;
+  if (code == HTTP_HEADER_OTHER && str >= (const char*)owner.data() &&
+      str + len <= (const char*)owner.tail()) {
+    // pinned along with the value
+    nameView.reset(str, len);
+    if (nameViews_.empty()) {
+      nameViews_.resize(codes_.size());
+    }
+  }
+  codes_.push_back(code);
+  if (code != HTTP_HEADER_OTHER) {
+    headerNames_.push_back(HTTPCommonHeaders::getPointerToHeaderName(code));
+  } else {
+    headerNames_.push_back(nameView.empty() ? new string(str, len) : nullptr);
+  }
+  headerValues_.emplace_back();
+  valueViews_.push_back(value);
+  if (!nameViews_.empty()) {
+    nameViews_.push_back(nameView);
+  }
+  pushNameTag();
+}
+
+uint8_t HTTPHeaders::nameTag(folly::StringPiece name) {
+  // FNV-1a over the lower-cased name
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  return (hash % 255) + 1;
+}
+
+void HTTPHeaders::buildNameTags() const {
+  nameTags_.clear();
+  nameTags_.reserve(codes_.size());
+  for (size_t i = 0; i < codes_.size(); ++i) {
+    nameTags_.push_back(nameTagAt(i));
+  }
+}
+
+void HTTPHeaders::materializeValue(size_t pos) const {
+  headerValues_[pos].assign(valueViews_[pos].data(), valueViews_[pos].size());
+  valueViews_[pos].clear();
+}
+
+void HTTPHeaders::materializeName(size_t pos) const {
+  headerNames_[pos] = new string(nameViews_[pos].data(),
+                                 nameViews_[pos].size());
+  nameViews_[pos].clear();
+}
+
+void HTTPHeaders::unpinIngress() {
+  for (size_t i = 0; i < valueViews_.size(); ++i) {
+    if (!valueViews_[i].empty()) {
+      materializeValue(i);
+    }
+  }
+  for (size_t i = 0; i < nameViews_.size(); ++i) {
+    // the names of removed headers are no longer needed
+    if (!nameViews_[i].empty() && codes_[i] == HTTP_HEADER_OTHER) {
+      materializeName(i);
+    }
+  }
+  valueViews_.clear();
+  nameViews_.clear();
+  pinnedIngress_.reset();
 }
 
 bool HTTPHeaders::exists(folly::StringPiece name) const {
@@ -88,6 +183,40 @@ bool HTTPHeaders::exists(HTTPHeaderCode code) const {
   return memchr((void*)codes_.data(), code, codes_.size()) != nullptr;
 }
 
+folly::StringPiece
+HTTPHeaders::getSingleOrEmptyView(HTTPHeaderCode code) const {
+  folly::StringPiece res;
+  bool found = false;
+  ITERATE_OVER_CODES(code, {
+    if (found) {
+      // a second value is found
+      return folly::StringPiece();
+    }
+    found = true;
+    res = viewAt(pos);
+  });
+  return res;
+}
+
+folly::StringPiece
+HTTPHeaders::getSingleOrEmptyView(folly::StringPiece name) const {
+  const HTTPHeaderCode code = HTTPCommonHeaders::hash(name.data(),
+                                                      name.size());
+  if (code != HTTP_HEADER_OTHER) {
+    return getSingleOrEmptyView(code);
+  }
+  folly::StringPiece res;
+  bool found = false;
+  ITERATE_OVER_STRINGS(name, {
+    if (found) {
+      return folly::StringPiece();
+    }
+    found = true;
+    res = viewAt(pos);
+  });
+  return res;
+}
+
 size_t HTTPHeaders::getNumberOfValues(HTTPHeaderCode code) const {
   size_t count = 0;
   ITERATE_OVER_CODES(code, {
@@ -144,6 +273,8 @@ HTTPHeaders::~HTTPHeaders () {
   disposeOfHeaderNames();
 }
 
+// Copies never share the pinned ingress buffers, any views are copied into
+// owned strings so the copy is independent of the ingress path.
 HTTPHeaders::HTTPHeaders(const HTTPHeaders& hdrs) :
   codes_(hdrs.codes_),
   headerNames_(hdrs.headerNames_),
@@ -151,7 +282,11 @@ HTTPHeaders::HTTPHeaders(const HTTPHeaders& hdrs) :
   deletedCount_(hdrs.deletedCount_) {
   for (size_t i = 0; i < codes_.size(); ++i) {
     if (codes_[i] == HTTP_HEADER_OTHER) {
-      headerNames_[i] = new string(*hdrs.headerNames_[i]);
+      auto name = hdrs.nameViewAt(i);
+      headerNames_[i] = new string(name.data(), name.size());
+    }
+    if (!hdrs.valueViews_.empty()) {
+      headerValues_[i] = hdrs.viewAt(i).str();
     }
   }
 }
@@ -160,8 +295,12 @@ HTTPHeaders::HTTPHeaders(HTTPHeaders&& hdrs) noexcept :
     codes_(std::move(hdrs.codes_)),
     headerNames_(std::move(hdrs.headerNames_)),
     headerValues_(std::move(hdrs.headerValues_)),
+    valueViews_(std::move(hdrs.valueViews_)),
+    nameViews_(std::move(hdrs.nameViews_)),
+    pinnedIngress_(std::move(hdrs.pinnedIngress_)),
+    nameTags_(std::move(hdrs.nameTags_)),
     deletedCount_(hdrs.deletedCount_) {
-  hdrs.removeAll();
+  hdrs.releaseAll();
 }
 
 HTTPHeaders& HTTPHeaders::operator= (const HTTPHeaders& hdrs) {
@@ -170,10 +309,19 @@ HTTPHeaders& HTTPHeaders::operator= (const HTTPHeaders& hdrs) {
     codes_ = hdrs.codes_;
     headerNames_ = hdrs.headerNames_;
     headerValues_ = hdrs.headerValues_;
+    valueViews_.clear();
+    nameViews_.clear();
+    pinnedIngress_.reset();
+    // rebuilt on demand
+    nameTags_.clear();
     deletedCount_ = hdrs.deletedCount_;
     for (size_t i = 0; i < codes_.size(); ++i) {
       if (codes_[i] == HTTP_HEADER_OTHER) {
-        headerNames_[i] = new string(*hdrs.headerNames_[i]);
+        auto name = hdrs.nameViewAt(i);
+      headerNames_[i] = new string(name.data(), name.size());
+      }
+      if (!hdrs.valueViews_.empty()) {
+        headerValues_[i] = hdrs.viewAt(i).str();
       }
     }
   }
@@ -182,12 +330,17 @@ HTTPHeaders& HTTPHeaders::operator= (const HTTPHeaders& hdrs) {
 
 HTTPHeaders& HTTPHeaders::operator= (HTTPHeaders&& hdrs) {
   if (this != &hdrs) {
+    disposeOfHeaderNames();
     codes_ = std::move(hdrs.codes_);
     headerNames_ = std::move(hdrs.headerNames_);
     headerValues_ = std::move(hdrs.headerValues_);
+    valueViews_ = std::move(hdrs.valueViews_);
+    nameViews_ = std::move(hdrs.nameViews_);
+    pinnedIngress_ = std::move(hdrs.pinnedIngress_);
+    nameTags_ = std::move(hdrs.nameTags_);
     deletedCount_ = hdrs.deletedCount_;
 
-    hdrs.removeAll();
+    hdrs.releaseAll();
   }
 
   return *this;
@@ -199,6 +352,24 @@ void HTTPHeaders::removeAll() {
   codes_.clear();
   headerNames_.clear();
   headerValues_.clear();
+  valueViews_.clear();
+  nameViews_.clear();
+  pinnedIngress_.reset();
+  nameTags_.clear();
+  deletedCount_ = 0;
+}
+
+void HTTPHeaders::releaseAll() {
+  // Moving a small_vector with inline storage moves the elements but leaves
+  // them in the source, so the name pointers we copied out must not be
+  // deleted here.
+  codes_.clear();
+  headerNames_.clear();
+  headerValues_.clear();
+  valueViews_.clear();
+  nameViews_.clear();
+  pinnedIngress_.reset();
+  nameTags_.clear();
   deletedCount_ = 0;
 }
 
@@ -206,6 +377,37 @@ size_t HTTPHeaders::size() const {
   return codes_.size() - deletedCount_;
 }
 
+namespace {
+
+template <typename Vector>
+size_t spilledBytes(const Vector& v, size_t inlineCapacity) {
+  if (v.capacity() <= inlineCapacity) {
+    return 0;
+  }
+  return v.capacity() * sizeof(typename Vector::value_type);
+}
+
+}
+
+size_t HTTPHeaders::getMemoryUsage() const {
+  size_t bytes = spilledBytes(codes_, kInlineHeaders) +
+    spilledBytes(headerNames_, kInlineHeaders) +
+    spilledBytes(headerValues_, kInlineHeaders) +
+    spilledBytes(valueViews_, 0) +
+    spilledBytes(nameViews_, 0) +
+    spilledBytes(nameTags_, 0);
+  for (size_t i = 0; i < codes_.size(); ++i) {
+    if (codes_[i] == HTTP_HEADER_OTHER && headerNames_[i]) {
+      bytes += sizeof(std::string) + stringHeapBytes(*headerNames_[i]);
+    }
+    bytes += stringHeapBytes(headerValues_[i]);
+  }
+  if (pinnedIngress_) {
+    bytes += chainCapacity(*pinnedIngress_);
+  }
+  return bytes;
+}
+
 bool
 HTTPHeaders::transferHeaderIfPresent(folly::StringPiece name,
                                      HTTPHeaders& strippedHeaders) {
@@ -216,8 +418,9 @@ HTTPHeaders::transferHeaderIfPresent(folly::StringPiece name,
     ITERATE_OVER_STRINGS(name, {
       strippedHeaders.codes_.push_back(HTTP_HEADER_OTHER);
       // in the next line, ownership of pointer goes to strippedHeaders
-      strippedHeaders.headerNames_.push_back(headerNames_[pos]);
-      strippedHeaders.headerValues_.push_back(headerValues_[pos]);
+      strippedHeaders.headerNames_.push_back(&nameAt(pos));
+      strippedHeaders.headerValues_.push_back(valueAt(pos));
+      strippedHeaders.pushOwnedValueSlot();
       codes_[pos] = HTTP_HEADER_NONE;
       transferred = true;
       ++deletedCount_;
@@ -226,7 +429,8 @@ HTTPHeaders::transferHeaderIfPresent(folly::StringPiece name,
     ITERATE_OVER_CODES(code, {
       strippedHeaders.codes_.push_back(code);
       strippedHeaders.headerNames_.push_back(headerNames_[pos]);
-      strippedHeaders.headerValues_.push_back(headerValues_[pos]);
+      strippedHeaders.headerValues_.push_back(valueAt(pos));
+      strippedHeaders.pushOwnedValueSlot();
       codes_[pos] = HTTP_HEADER_NONE;
       transferred = true;
       ++deletedCount_;
@@ -287,7 +491,8 @@ HTTPHeaders::stripPerHopHeaders(HTTPHeaders& strippedHeaders) {
     if (perHopHeaders[codes_[i]]) {
       strippedHeaders.codes_.push_back(codes_[i]);
       strippedHeaders.headerNames_.push_back(headerNames_[i]);
-      strippedHeaders.headerValues_.push_back(headerValues_[i]);
+      strippedHeaders.headerValues_.push_back(valueAt(i));
+      strippedHeaders.pushOwnedValueSlot();
       codes_[i] = HTTP_HEADER_NONE;
       ++deletedCount_;
       VLOG(3) << "Stripped hop-by-hop header " << *headerNames_[i];
@@ -300,8 +505,9 @@ void HTTPHeaders::copyTo(HTTPHeaders& hdrs) const {
     if (codes_[i] != HTTP_HEADER_NONE) {
       hdrs.codes_.push_back(codes_[i]);
       hdrs.headerNames_.push_back((codes_[i] == HTTP_HEADER_OTHER) ?
-          new string(*headerNames_[i]) : headerNames_[i]);
-      hdrs.headerValues_.push_back(headerValues_[i]);
+          new string(nameViewAt(i).str()) : headerNames_[i]);
+      hdrs.headerValues_.push_back(viewAt(i).str());
+      hdrs.pushOwnedValueSlot();
     }
   }
 }
@@ -10,7 +10,10 @@
 #pragma once
 
 #include <folly/FBVector.h>
+#include <folly/Likely.h>
 #include <folly/Range.h>
+#include <folly/small_vector.h>
+#include <folly/io/IOBuf.h>
 #include <proxygen/lib/http/HTTPCommonHeaders.h>
 #include <proxygen/lib/utils/UtilInl.h>
 
@@ -48,6 +51,10 @@ inline bool isLWS(char c) {
  * them using memchr, which has an x86_64 assembly implementation with
  * complexity O(n/16) ;)
  *
+ * The codes, names and values are kept in small_vectors with room for
+ * kInlineHeaders entries inside the object itself, so building a typical
+ * request or response does not allocate for the containers at all.
+ *
  * Instead of creating strings with header names, we point to a static array
  * of strings in HTTPCommonHeaders. If the header name is not in our set of
  * common header names (this is considered unlikely, because we intend this set
@@ -56,6 +63,20 @@ inline bool isLWS(char c) {
  *
  * The code HTTP_HEADER_NONE signifies a header that has been removed.
  *
+ * Looking up an HTTP_HEADER_OTHER name compares it against every such
+ * header. Once a lookup has had to go through more than kNameTagThreshold
+ * of them, a 1-byte case-insensitive hash ("tag") of each name is kept
+ * as well, and later lookups memchr for the tag instead.
+ *
+ * Codecs may also add values with addViewFromCodec(), in which case the value
+ * is kept as a StringPiece into the ingress buffer (which the headers pin)
+ * and is only copied into a string the first time an accessor needs one.
+ * So is the name of an HTTP_HEADER_OTHER header in the same buffer, so
+ * that headers a proxy only passes through are never copied at all.
+ * Use the *View accessors to read such values without copying them, and
+ * unpinIngress() to copy everything out if the message is kept around long
+ * after it was parsed.
+ *
  * Most methods which take a header name have two versions: one accepting
  * a string, and one accepting a code. It is recommended to use the latter
  * if possible, as in:
@@ -91,6 +112,28 @@ class HTTPHeaders {
 
   void addFromCodec(const char* str, size_t len, std::string&& value);
 
+  /**
+   * Like addFromCodec(), but the value is not copied. `value` must point
+   * into `owner`'s buffer, which is pinned (a reference is kept) for the
+   * lifetime of this object or until unpinIngress() is called. Neither is
+   * the name, if it is not a common one and is in the same buffer.
+   */
+  void addViewFromCodec(const char* str, size_t len, folly::StringPiece value,
+                        const folly::IOBuf& owner);
+
+  /**
+   * Copy all names and values that are still views into the ingress buffer
+   * into owned strings and release the pinned buffers.
+   */
+  void unpinIngress();
+
+  /**
+   * Returns true if some values are still backed by pinned ingress buffers.
+   */
+  bool hasPinnedIngress() const {
+    return pinnedIngress_ != nullptr;
+  }
+
   /**
    * For the header 'name', set its value to the single header 'value',
    * removing any other instances of this header.
@@ -151,6 +194,19 @@ class HTTPHeaders {
   template <typename LAMBDA>
   inline void forEachWithCode(LAMBDA func) const;
 
+  /**
+   * Same as forEachWithCode(), but names and values are passed as
+   * folly::StringPiece so those added with addViewFromCodec() are never
+   * copied. Example use:
+   *     hdrs.forEachWithCodeView([&] (HTTPHeaderCode code,
+   *                                   folly::StringPiece header,
+   *                                   folly::StringPiece val) {
+   *       out.append(header).append(val.data(), val.size());
+   *     });
+   */
+  template <typename LAMBDA>
+  inline void forEachWithCodeView(LAMBDA func) const;
+
   /**
    * Process the list of all headers, in the order that they were seen:
    * for each header:value pair, the function/functor/lambda-expression
@@ -179,6 +235,13 @@ class HTTPHeaders {
     return getSingleOrEmpty(header);
   }
 
+  /**
+   * Same as getSingleOrEmpty(), but returns a view and does not copy values
+   * added with addViewFromCodec().
+   */
+  folly::StringPiece getSingleOrEmptyView(HTTPHeaderCode code) const;
+  folly::StringPiece getSingleOrEmptyView(folly::StringPiece name) const;
+
   /**
    * Get the number of values corresponding to a given header name.
    */
@@ -228,6 +291,13 @@ class HTTPHeaders {
    */
   size_t size() const;
 
+  /**
+   * Bytes the headers hold on the heap, beyond sizeof(HTTPHeaders): the
+   * containers once they spill, the names and values too long to be
+   * inline and the pinned ingress buffers, which other messages may share.
+   */
+  size_t getMemoryUsage() const;
+
   /**
    * Copy all headers from this to hdrs.
    */
@@ -239,25 +309,68 @@ class HTTPHeaders {
    */
   static std::bitset<256>& perHopHeaderCodes();
 
+  /**
+   * Number of headers stored inline before the containers spill to the
+   * heap.
+   */
+  static const size_t kInlineHeaders = 16;
+
+  /**
+   * Number of HTTP_HEADER_OTHER headers a lookup by name may compare
+   * before the name tags are built.
+   */
+  static const size_t kNameTagThreshold = 8;
+
  private:
+  template <typename T>
+  using InlineVector = folly::small_vector<T, kInlineHeaders>;
+
   // vector storing the 1-byte hashes of header names
-  folly::fbvector<HTTPHeaderCode> codes_;
+  InlineVector<HTTPHeaderCode> codes_;
 
   /**
    * Vector storing pointers to header names; we own those pointers which
-   * correspond to HTTP_HEADER_OTHER codes.
+   * correspond to HTTP_HEADER_OTHER codes. Null for names that are still
+   * views into the ingress buffer, until nameAt() copies them.
    */
-  folly::fbvector<const std::string *> headerNames_;
+  mutable InlineVector<const std::string *> headerNames_;
 
-  folly::fbvector<std::string> headerValues_;
+  /**
+   * Owned header values. Entries whose value is still a view into the
+   * ingress buffer are empty until valueAt() copies the view in, which may
+   * happen from const accessors.
+   */
+  mutable InlineVector<std::string> headerValues_;
 
-  size_t deletedCount_;
+  /**
+   * Values that still point into pinnedIngress_. Empty until the first call
+   * to addViewFromCodec(); after that it has one entry per header, and an
+   * empty piece means the value is in headerValues_.
+   */
+  mutable folly::fbvector<folly::StringPiece> valueViews_;
+
+  /**
+   * Names of HTTP_HEADER_OTHER headers that still point into
+   * pinnedIngress_. Empty until addViewFromCodec() gets such a name in the
+   * buffer of its value; after that it has one entry per header, and an
+   * empty piece means the name is in headerNames_.
+   */
+  mutable folly::fbvector<folly::StringPiece> nameViews_;
 
   /**
-   * The initial capacity of the three vectors, reserved right after
-   * construction.
+   * Chain of ingress buffers that valueViews_ point into.
    */
-  static const size_t kInitialVectorReserve = 16;
+  std::unique_ptr<folly::IOBuf> pinnedIngress_;
+
+  /**
+   * Tags of the HTTP_HEADER_OTHER names, 0 for other codes. Empty until a
+   * lookup sees more than kNameTagThreshold such headers; after that it
+   * has one entry per header. Entries of removed headers are stale, so
+   * matches must still check the code.
+   */
+  mutable folly::fbvector<uint8_t> nameTags_;
+
+  size_t deletedCount_;
 
   /**
    * Moves the named header and values from this group to the destination
@@ -266,10 +379,87 @@ class HTTPHeaders {
    */
   bool transferHeaderIfPresent(folly::StringPiece name, HTTPHeaders& dest);
 
+  /**
+   * Returns the value of the header at `pos` as a string, copying it out of
+   * the ingress buffer first if needed.
+   */
+  const std::string& valueAt(size_t pos) const {
+    if (UNLIKELY(!valueViews_.empty()) && !valueViews_[pos].empty()) {
+      materializeValue(pos);
+    }
+    return headerValues_[pos];
+  }
+
+  /**
+   * Returns the value of the header at `pos` without copying it.
+   */
+  folly::StringPiece viewAt(size_t pos) const {
+    if (UNLIKELY(!valueViews_.empty()) && !valueViews_[pos].empty()) {
+      return valueViews_[pos];
+    }
+    return headerValues_[pos];
+  }
+
+  void materializeValue(size_t pos) const;
+
+  /**
+   * Returns the name of the header at `pos`, copying it out of the ingress
+   * buffer first if needed.
+   */
+  const std::string& nameAt(size_t pos) const {
+    if (UNLIKELY(!nameViews_.empty()) && !nameViews_[pos].empty()) {
+      materializeName(pos);
+    }
+    return *headerNames_[pos];
+  }
+
+  folly::StringPiece nameViewAt(size_t pos) const {
+    if (UNLIKELY(!nameViews_.empty()) && !nameViews_[pos].empty()) {
+      return nameViews_[pos];
+    }
+    return *headerNames_[pos];
+  }
+
+  void materializeName(size_t pos) const;
+
+  /**
+   * Keep valueViews_, nameViews_ and nameTags_ parallel to the other
+   * vectors once they are in use. Must be called after every push to
+   * headerValues_.
+   */
+  void pushOwnedValueSlot() {
+    if (UNLIKELY(!valueViews_.empty())) {
+      valueViews_.emplace_back();
+    }
+    if (UNLIKELY(!nameViews_.empty())) {
+      nameViews_.emplace_back();
+    }
+    pushNameTag();
+  }
+
+  void pushNameTag() {
+    if (UNLIKELY(!nameTags_.empty())) {
+      nameTags_.push_back(nameTagAt(codes_.size() - 1));
+    }
+  }
+
+  // case-insensitive 1-byte hash of a name, never 0
+  static uint8_t nameTag(folly::StringPiece name);
+
+  uint8_t nameTagAt(size_t pos) const {
+    return codes_[pos] == HTTP_HEADER_OTHER ? nameTag(nameViewAt(pos)) : 0;
+  }
+
+  void buildNameTags() const;
+
   static void initGlobals() __attribute__ ((__constructor__));
 
   // deletes the strings in headerNames_ that we own
   void disposeOfHeaderNames();
+
+  // empties all containers after their contents were moved elsewhere,
+  // without deleting the header names
+  void releaseAll();
 };
 
 // Implementation follows - it has to be in the .h because of the templates
@@ -283,6 +473,7 @@ void HTTPHeaders::add(folly::StringPiece name, T&& value) {
       ? new std::string(name.data(), name.size())
       : HTTPCommonHeaders::getPointerToHeaderName(code));
   headerValues_.emplace_back(std::forward<T>(value));
+  pushOwnedValueSlot();
 }
 
 template <typename T> // T = string
@@ -290,34 +481,55 @@ void HTTPHeaders::add(HTTPHeaderCode code, T&& value) {
   codes_.push_back(code);
   headerNames_.push_back(HTTPCommonHeaders::getPointerToHeaderName(code));
   headerValues_.emplace_back(std::forward<T>(value));
+  pushOwnedValueSlot();
 }
 
-// iterate over the positions (in vector) of all headers with given code
-#define ITERATE_OVER_CODES(Code, Block) { \
-  const HTTPHeaderCode* ptr = codes_.data(); \
+// iterate over the positions (in vector) of all bytes of Vec equal to Byte
+#define ITERATE_OVER_BYTES(Vec, Byte, Block) { \
+  const uint8_t* ptr = (const uint8_t*)(Vec).data(); \
   while(true) { \
-    ptr = (HTTPHeaderCode*) memchr((void*)ptr, (Code), \
-                            codes_.size() - (ptr - codes_.data())); \
+    ptr = (const uint8_t*) memchr((void*)ptr, (Byte), \
+                    (Vec).size() - (ptr - (const uint8_t*)(Vec).data())); \
     if (ptr == nullptr) break; \
-    const int pos = ptr - codes_.data(); \
+    const int pos = ptr - (const uint8_t*)(Vec).data(); \
     {Block} \
     ptr++; \
   } \
 }
 
+// iterate over the positions (in vector) of all headers with given code
+#define ITERATE_OVER_CODES(Code, Block) \
+    ITERATE_OVER_BYTES(codes_, (Code), Block)
+
 // iterate over the positions of all headers with given name
-#define ITERATE_OVER_STRINGS(String, Block) \
+#define ITERATE_OVER_STRINGS(String, Block) { \
+  if (nameTags_.empty()) { \
+    size_t others = 0; \
     ITERATE_OVER_CODES(HTTP_HEADER_OTHER, { \
-  if (caseInsensitiveEqual((String), *headerNames_[pos])) { \
-    {Block} \
+      ++others; \
+      if (caseInsensitiveEqual((String), nameViewAt(pos))) { \
+        {Block} \
+      } \
+    }); \
+    if (others > kNameTagThreshold) { \
+      buildNameTags(); \
+    } \
+  } else { \
+    const uint8_t tag = nameTag(String); \
+    ITERATE_OVER_BYTES(nameTags_, tag, { \
+      if (codes_[pos] == HTTP_HEADER_OTHER && \
+          caseInsensitiveEqual((String), nameViewAt(pos))) { \
+        {Block} \
+      } \
+    }); \
   } \
-})
+}
 
 template <typename LAMBDA> // (const string &, const string &) -> void
 void HTTPHeaders::forEach(LAMBDA func) const {
   for (size_t i = 0; i < codes_.size(); ++i) {
     if (codes_[i] != HTTP_HEADER_NONE) {
-      func(*headerNames_[i], headerValues_[i]);
+      func(nameAt(i), valueAt(i));
     }
   }
 }
@@ -326,7 +538,16 @@ template <typename LAMBDA>
 void HTTPHeaders::forEachWithCode(LAMBDA func) const {
   for (size_t i = 0; i < codes_.size(); ++i) {
     if (codes_[i] != HTTP_HEADER_NONE) {
-      func(codes_[i], *headerNames_[i], headerValues_[i]);
+      func(codes_[i], nameAt(i), valueAt(i));
+    }
+  }
+}
+
+template <typename LAMBDA>
+void HTTPHeaders::forEachWithCodeView(LAMBDA func) const {
+  for (size_t i = 0; i < codes_.size(); ++i) {
+    if (codes_[i] != HTTP_HEADER_NONE) {
+      func(codes_[i], nameViewAt(i), viewAt(i));
     }
   }
 }
@@ -339,7 +560,7 @@ bool HTTPHeaders::forEachValueOfHeader(folly::StringPiece name,
     return forEachValueOfHeader(code, func);
   } else {
     ITERATE_OVER_STRINGS(name, {
-      if (func(headerValues_[pos])) {
+      if (func(valueAt(pos))) {
         return true;
       }
     });
@@ -351,7 +572,7 @@ template <typename LAMBDA> // const string & -> bool
 bool HTTPHeaders::forEachValueOfHeader(HTTPHeaderCode code,
                                        LAMBDA func) const {
   ITERATE_OVER_CODES(code, {
-    if (func(headerValues_[pos])) {
+    if (func(valueAt(pos))) {
       return true;
     }
   });
@@ -379,7 +600,7 @@ bool HTTPHeaders::removeByPredicate(LAMBDA func) {
   bool removed = false;
   for (size_t i = 0; i < codes_.size(); ++i) {
     if (codes_[i] == HTTP_HEADER_NONE ||
-        !func(codes_[i], *headerNames_[i], headerValues_[i])) {
+        !func(codes_[i], nameAt(i), valueAt(i))) {
       continue;
     }
 
@@ -418,6 +639,7 @@ const std::string & HTTPHeaders::getSingleOrEmpty(const T& nameOrCode) const {
 }
 
 #ifndef PROXYGEN_HTTPHEADERS_IMPL
+#undef ITERATE_OVER_BYTES
 #undef ITERATE_OVER_CODES
 #undef ITERATE_OVER_STRINGS
 #endif // PROXYGEN_HTTPHEADERS_IMPL
@@ -9,14 +9,24 @@
  */
 #include <proxygen/lib/http/HTTPMessage.h>
 
+#include <algorithm>
 #include <array>
 #include <boost/algorithm/string.hpp>
 #include <folly/Format.h>
 #include <folly/Range.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <proxygen/lib/utils/UtilInl.h>
 #include <string>
 #include <utility>
 #include <vector>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define PROXYGEN_COOKIE_SSE2_SCAN 1
+#else
+#define PROXYGEN_COOKIE_SSE2_SCAN 0
+#endif
+
 using folly::IOBuf;
 using folly::Optional;
 using folly::StringPiece;
@@ -36,10 +46,58 @@ const string kCookieStr = "cookie.";
  * approximately 1% of our total CPU time on temporary locale objects.)
  */
 std::locale defaultLocale;
+
+template <class T>
+std::unique_ptr<T> copyIfSet(const std::unique_ptr<T>& p) {
+  return std::unique_ptr<T>(p ? new T(*p) : nullptr);
+}
+
+const std::map<string, string> kEmptyParams;
+
+/**
+ * Calls fn with the position of each ';' and '=' of input, in order. With
+ * SSE2 the bytes are compared 16 at a time, and only the separators found
+ * are visited one by one.
+ */
+template <typename Fn>
+void forEachCookieSeparator(StringPiece input, Fn fn) {
+  const char* data = input.data();
+  const size_t length = input.size();
+  size_t i = 0;
+#if PROXYGEN_COOKIE_SSE2_SCAN
+  const __m128i semicolons = _mm_set1_epi8(';');
+  const __m128i equals = _mm_set1_epi8('=');
+  for (; i + 16 <= length; i += 16) {
+    const __m128i chunk =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    uint32_t mask = _mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, semicolons),
+                   _mm_cmpeq_epi8(chunk, equals)));
+    while (mask) {
+      fn(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    if (data[i] == ';' || data[i] == '=') {
+      fn(i);
+    }
+  }
+}
+
 }
 
 namespace proxygen {
 
+// Every request and response is an HTTPMessage, so its size is on the hot
+// path. Besides its inline HTTPHeaders, a message is about 550 bytes with
+// 64-bit libstdc++. If this fires, prefer allocating the new state lazily
+// (as with the stripped per-hop headers and the param maps) over raising
+// the budget.
+static_assert(sizeof(HTTPMessage) <= sizeof(HTTPHeaders) + 640,
+              "HTTPMessage grew past its size budget");
+
 std::mutex HTTPMessage::mutexDump_;
 
 const pair<uint8_t, uint8_t> HTTPMessage::kHTTPVersion10(1, 0);
@@ -49,7 +107,11 @@ void HTTPMessage::stripPerHopHeaders() {
   // Some code paths end up recyling a single HTTPMessage instance for multiple
   // requests, and adding their own per-hop headers each time. In that case, we
   // don't want to accumulate these headers.
-  strippedPerHopHeaders_.removeAll();
+  if (strippedPerHopHeaders_) {
+    strippedPerHopHeaders_->removeAll();
+  } else {
+    strippedPerHopHeaders_.reset(new HTTPHeaders());
+  }
 
   if (!trailersAllowed_) {
     // Because stripPerHopHeaders can be called multiple times, don't
@@ -57,19 +119,19 @@ void HTTPMessage::stripPerHopHeaders() {
     trailersAllowed_ = checkForHeaderToken(HTTP_HEADER_TE, "trailers", false);
   }
 
-  headers_.stripPerHopHeaders(strippedPerHopHeaders_);
+  getHeaders().stripPerHopHeaders(*strippedPerHopHeaders_);
 }
 
 HTTPMessage::HTTPMessage() :
     startTime_(getCurrentTime()),
     seqNo_(-1),
     localIP_(),
-    versionStr_("1.0"),
     fields_(),
     version_(1,0),
     sslVersion_(0), sslCipher_(nullptr), spdy_(0), pri_(0),
     parsedCookies_(false), parsedQueryParams_(false),
-    chunked_(false), upgraded_(false), wantsKeepalive_(true),
+    indexedQueryParams_(false), chunked_(false), upgraded_(false),
+    wantsKeepalive_(true),
     trailersAllowed_(false), secure_(false) {
 }
 
@@ -79,27 +141,36 @@ HTTPMessage::~HTTPMessage() {
 HTTPMessage::HTTPMessage(const HTTPMessage& message) :
     startTime_(message.startTime_),
     seqNo_(message.seqNo_),
+    deadline_(message.deadline_),
     dstAddress_(message.dstAddress_),
-    dstIP_(message.dstIP_),
-    dstPort_(message.dstPort_),
     localIP_(message.localIP_),
-    versionStr_(message.versionStr_),
     fields_(message.fields_),
-    cookies_(message.cookies_),
-    queryParams_(message.queryParams_),
+    queryParams_(copyIfSet(message.queryParams_)),
+    pathParams_(copyIfSet(message.pathParams_)),
     version_(message.version_),
     headers_(message.headers_),
-    strippedPerHopHeaders_(message.headers_),
+    sharedHeaders_(message.sharedHeaders_),
+    strippedPerHopHeaders_(copyIfSet(message.strippedPerHopHeaders_)),
+    cachedHeaders_(message.cachedHeaders_),
+    cannedResponse_(message.cannedResponse_),
     sslVersion_(message.sslVersion_),
     sslCipher_(message.sslCipher_),
     spdy_(message.spdy_),
-    parsedCookies_(message.parsedCookies_),
+    http2Priority_(message.http2Priority_),
+    // the cookies point into the headers they were parsed from, so they
+    // can only be kept if those are shared
+    parsedCookies_(message.parsedCookies_ && sharedHeaders_),
     parsedQueryParams_(message.parsedQueryParams_),
+    // the index points into message's query string, rebuild ours on demand
+    indexedQueryParams_(false),
     chunked_(message.chunked_),
     upgraded_(message.upgraded_),
     wantsKeepalive_(message.wantsKeepalive_),
     trailersAllowed_(message.trailersAllowed_),
     secure_(message.secure_) {
+  if (parsedCookies_) {
+    cookies_ = message.cookies_;
+  }
   if (message.trailers_) {
     trailers_.reset(new HTTPHeaders(*message.trailers_.get()));
   }
@@ -111,27 +182,38 @@ HTTPMessage& HTTPMessage::operator=(const HTTPMessage& message) {
   }
   startTime_ = message.startTime_;
   seqNo_ = message.seqNo_;
+  deadline_ = message.deadline_;
   dstAddress_ = message.dstAddress_;
-  dstIP_ = message.dstIP_;
-  dstPort_ = message.dstPort_;
   localIP_ = message.localIP_;
-  versionStr_ = message.versionStr_;
   fields_ = message.fields_;
-  cookies_ = message.cookies_;
-  queryParams_ = message.queryParams_;
+  queryParams_ = copyIfSet(message.queryParams_);
+  pathParams_ = copyIfSet(message.pathParams_);
   version_ = message.version_;
   headers_ = message.headers_;
-  strippedPerHopHeaders_ = message.headers_;
+  sharedHeaders_ = message.sharedHeaders_;
+  strippedPerHopHeaders_ = copyIfSet(message.strippedPerHopHeaders_);
+  cachedHeaders_ = message.cachedHeaders_;
+  cannedResponse_ = message.cannedResponse_;
   sslVersion_ = message.sslVersion_;
   sslCipher_ = message.sslCipher_;
   spdy_ = message.spdy_;
-  parsedCookies_ = message.parsedCookies_;
+  http2Priority_ = message.http2Priority_;
+  parsedCookies_ = message.parsedCookies_ && sharedHeaders_;
+  if (parsedCookies_) {
+    cookies_ = message.cookies_;
+  } else {
+    cookies_.clear();
+  }
   parsedQueryParams_ = message.parsedQueryParams_;
+  queryParamIndex_.clear();
+  indexedQueryParams_ = false;
   chunked_ = message.chunked_;
   upgraded_ = message.upgraded_;
   wantsKeepalive_ = message.wantsKeepalive_;
   trailersAllowed_ = message.trailersAllowed_;
   secure_ = message.secure_;
+  // the copied headers own their values
+  rawHeaderLines_.clear();
 
   if (message.trailers_) {
     trailers_.reset(new HTTPHeaders(*message.trailers_.get()));
@@ -141,6 +223,65 @@ HTTPMessage& HTTPMessage::operator=(const HTTPMessage& message) {
   return *this;
 }
 
+void HTTPMessage::reset() {
+  startTime_ = getCurrentTime();
+  seqNo_ = -1;
+  deadline_ = TimePoint();
+  dstAddress_.reset();
+  localIP_.clear();
+  fields_ = boost::blank();
+  cookies_.clear();
+  // the maps and stripped headers are kept for the next message
+  if (queryParams_) {
+    queryParams_->clear();
+  }
+  queryParamIndex_.clear();
+  if (pathParams_) {
+    pathParams_->clear();
+  }
+  version_ = std::make_pair(1, 0);
+  headers_.removeAll();
+  sharedHeaders_.reset();
+  if (strippedPerHopHeaders_) {
+    strippedPerHopHeaders_->removeAll();
+  }
+  size_ = HTTPHeaderSize();
+  trailers_.reset();
+  cachedHeaders_.reset();
+  cannedResponse_.reset();
+  rawHeaderLines_.clear();
+  sslVersion_ = 0;
+  sslCipher_ = nullptr;
+  spdy_ = 0;
+  pri_ = 0;
+  http2Priority_.clear();
+  parsedCookies_ = false;
+  parsedQueryParams_ = false;
+  indexedQueryParams_ = false;
+  chunked_ = false;
+  upgraded_ = false;
+  wantsKeepalive_ = true;
+  trailersAllowed_ = false;
+  secure_ = false;
+}
+
+std::chrono::milliseconds HTTPMessage::getRemainingBudget(
+    TimePoint now) const {
+  if (!hasDeadline()) {
+    return std::chrono::milliseconds::max();
+  }
+  if (now >= deadline_) {
+    return std::chrono::milliseconds(0);
+  }
+  // rounded up, so that zero means expired
+  auto left = deadline_ - now;
+  auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(left);
+  if (budget < left) {
+    budget += std::chrono::milliseconds(1);
+  }
+  return budget;
+}
+
 void HTTPMessage::setMethod(HTTPMethod method) {
   Request& req = request();
   req.method_ = method;
@@ -184,7 +325,14 @@ const std::string& HTTPMessage::getMethodString() const {
 void HTTPMessage::setHTTPVersion(uint8_t maj, uint8_t min) {
   version_.first = maj;
   version_.second = min;
-  versionStr_ = folly::to<string>(maj, ".", min);
+}
+
+string HTTPMessage::getVersionString() const {
+  if (version_.first < 10 && version_.second < 10) {
+    return string{char('0' + version_.first), '.',
+                  char('0' + version_.second)};
+  }
+  return folly::to<string>(version_.first, ".", version_.second);
 }
 
 const pair<uint8_t, uint8_t>& HTTPMessage::getHTTPVersion() const {
@@ -193,7 +341,9 @@ const pair<uint8_t, uint8_t>& HTTPMessage::getHTTPVersion() const {
 
 int HTTPMessage::processMaxForwards() {
   if (getMethod() == HTTPMethod::TRACE || getMethod()  == HTTPMethod::OPTIONS) {
-    const string& value = headers_.getSingleOrEmpty(HTTP_HEADER_MAX_FORWARDS);
+    const HTTPMessage* self = this;
+    const string& value =
+      self->getHeaders().getSingleOrEmpty(HTTP_HEADER_MAX_FORWARDS);
     if (value.length() > 0) {
       int64_t max_forwards = 0;
       try {
@@ -207,8 +357,8 @@ int HTTPMessage::processMaxForwards() {
       } else if (max_forwards == 0) {
         return 501;
       } else {
-        headers_.set(HTTP_HEADER_MAX_FORWARDS,
-                     folly::to<string>(max_forwards - 1));
+        getHeaders().set(HTTP_HEADER_MAX_FORWARDS,
+                         folly::to<string>(max_forwards - 1));
       }
     }
   }
@@ -224,28 +374,21 @@ bool HTTPMessage::isHTTP1_1() const {
 }
 
 string HTTPMessage::formatDateHeader() {
-  const auto now = std::chrono::system_clock::to_time_t(
-    std::chrono::system_clock::now());
-
-  char buff[1024];
-  tm timeTupple;
-  gmtime_r(&now, &timeTupple);
-
-  strftime(buff, 1024, "%a, %d %b %Y %H:%M:%S %Z", &timeTupple);
-  return std::string(buff);
+  return getCachedHTTPDateTime();
 }
 
 void HTTPMessage::ensureHostHeader() {
-  if (!headers_.exists(HTTP_HEADER_HOST)) {
-    headers_.add(HTTP_HEADER_HOST,
-                 getDstAddress().getFamily() == AF_INET6
-                 ? '[' + getDstIP() + ']' : getDstIP());
+  // reading through the const accessor keeps shared headers shared
+  const HTTPMessage* self = this;
+  if (!self->getHeaders().exists(HTTP_HEADER_HOST)) {
+    getHeaders().add(HTTP_HEADER_HOST,
+                     getDstAddress().getFamily() == AF_INET6
+                     ? '[' + getDstIP() + ']' : getDstIP());
   }
 }
 
 void HTTPMessage::setStatusCode(uint16_t status) {
   response().status_ = status;
-  response().statusStr_ = folly::to<string>(status);
 }
 
 uint16_t HTTPMessage::getStatusCode() const {
@@ -267,10 +410,11 @@ HTTPMessage::constructDirectResponse(const pair<uint8_t,uint8_t>& version,
                                      int contentLength) {
   setHTTPVersion(version.first, version.second);
 
-  headers_.set(HTTP_HEADER_CONTENT_LENGTH, folly::to<string>(contentLength));
+  auto& headers = getHeaders();
+  headers.set(HTTP_HEADER_CONTENT_LENGTH, folly::to<string>(contentLength));
 
-  if (!headers_.exists(HTTP_HEADER_CONTENT_TYPE)) {
-    headers_.add(HTTP_HEADER_CONTENT_TYPE, "text/plain");
+  if (!headers.exists(HTTP_HEADER_CONTENT_TYPE)) {
+    headers.add(HTTP_HEADER_CONTENT_TYPE, "text/plain");
   }
   setIsChunked(false);
   setIsUpgraded(false);
@@ -280,15 +424,81 @@ void HTTPMessage::parseCookies() const {
   DCHECK(!parsedCookies_);
   parsedCookies_ = true;
 
-  headers_.forEachValueOfHeader(HTTP_HEADER_COOKIE,
-                                [&](const string& headerval) {
-    splitNameValuePieces(headerval, ';', '=',
-        [this](StringPiece cookieName, StringPiece cookieValue) {
-          cookies_.emplace(cookieName, cookieValue);
-        });
+  // one allocation for the index, however many cookies there are
+  size_t maxCookies = 0;
+  getHeaders().forEachValueOfHeader(HTTP_HEADER_COOKIE,
+                                    [&](const string& headerval) {
+    maxCookies++;
+    forEachCookieSeparator(headerval, [&] (size_t pos) {
+      maxCookies += headerval[pos] == ';';
+    });
+    return false;
+  });
+  cookies_.reserve(maxCookies);
+
+  getHeaders().forEachValueOfHeader(HTTP_HEADER_COOKIE,
+                                    [&](const string& headerval) {
+    // the same split as splitNameValuePieces(headerval, ';', '=')
+    StringPiece input(headerval);
+    size_t pairStart = 0;
+    size_t valueDelim = string::npos;
+    auto endPair = [&] (size_t end) {
+      if (end == pairStart) {
+        return;
+      }
+      if (valueDelim == string::npos) {
+        cookies_.emplace_back(
+          trim(input.subpiece(pairStart, end - pairStart)), StringPiece());
+      } else {
+        cookies_.emplace_back(
+          trim(input.subpiece(pairStart, valueDelim - pairStart)),
+          trim(input.subpiece(valueDelim + 1, end - valueDelim - 1)));
+      }
+    };
+    forEachCookieSeparator(input, [&] (size_t pos) {
+      if (input[pos] == ';') {
+        endPair(pos);
+        pairStart = pos + 1;
+        valueDelim = string::npos;
+      } else if (valueDelim == string::npos) {
+        valueDelim = pos;
+      }
+    });
+    endPair(input.size());
 
     return false; // continue processing "cookie" headers
   });
+
+  if (cookies_.size() > kLinearCookieLookup) {
+    // An insertion sort is stable without a buffer, and quick on the few
+    // dozen cookies of a header
+    for (size_t i = 1; i < cookies_.size(); i++) {
+      auto cookie = cookies_[i];
+      size_t j = i;
+      for (; j > 0 && cookie.first < cookies_[j - 1].first; j--) {
+        cookies_[j] = cookies_[j - 1];
+      }
+      cookies_[j] = cookie;
+    }
+  }
+}
+
+void HTTPMessage::shareHeaders() {
+  if (sharedHeaders_) {
+    return;
+  }
+  // nothing should point into an ingress buffer the copies keep alive
+  headers_.unpinIngress();
+  // moving the values may move their bytes
+  unparseCookies();
+  sharedHeaders_ = std::make_shared<const HTTPHeaders>(std::move(headers_));
+}
+
+void HTTPMessage::unshareHeaders() {
+  headers_ = *sharedHeaders_;
+  sharedHeaders_.reset();
+  // the cookies point into the shared set
+  unparseCookies();
 }
 
 void HTTPMessage::unparseCookies() {
@@ -302,58 +512,114 @@ const StringPiece HTTPMessage::getCookie(const string& name) const {
     parseCookies();
   }
 
-  auto it = cookies_.find(name);
-  if (it == cookies_.end()) {
+  StringPiece key(name);
+  if (cookies_.size() > kLinearCookieLookup) {
+    auto it = std::lower_bound(
+      cookies_.begin(), cookies_.end(), key,
+      [] (const pair<StringPiece, StringPiece>& cookie, StringPiece k) {
+        return cookie.first < k;
+      });
+    if (it != cookies_.end() && it->first == key) {
+      return it->second;
+    }
     return StringPiece();
-  } else {
-    return it->second;
   }
+  // the first of duplicates wins
+  for (const auto& cookie: cookies_) {
+    if (cookie.first == key) {
+      return cookie.second;
+    }
+  }
+  return StringPiece();
 }
 
-void HTTPMessage::parseQueryParams() const {
-  DCHECK(!parsedQueryParams_);
+void HTTPMessage::indexQueryParams() const {
+  DCHECK(!indexedQueryParams_);
   const Request& req = request();
 
-  parsedQueryParams_ = true;
+  indexedQueryParams_ = true;
+  queryParamIndex_.clear();
   if (req.query_.empty()) {
     return;
   }
 
-  splitNameValue(req.query_, '&', '=',
-        [this] (string&& paramName, string&& paramValue) {
+  splitNameValuePieces(req.query_, '&', '=',
+        [this] (StringPiece paramName, StringPiece paramValue) {
+    queryParamIndex_.emplace_back(paramName, paramValue);
+  });
+}
 
-    auto it = queryParams_.find(paramName);
-    if (it == queryParams_.end()) {
-      queryParams_.emplace(std::move(paramName), std::move(paramValue));
-    } else {
-      // We have some unit tests that make sure we always return the last
-      // value when there are duplicate parameters. I don't think this really
-      // matters, but for now we might as well maintain the same behavior.
-      it->second = std::move(paramValue);
+const std::pair<StringPiece, StringPiece>* HTTPMessage::findQueryParam(
+    StringPiece name) const {
+  if (!indexedQueryParams_) {
+    indexQueryParams();
+  }
+
+  // We have some unit tests that make sure we always return the last
+  // value when there are duplicate parameters. I don't think this really
+  // matters, but for now we might as well maintain the same behavior.
+  for (auto it = queryParamIndex_.rbegin(); it != queryParamIndex_.rend();
+       ++it) {
+    if (it->first == name) {
+      return &*it;
     }
-  });
+  }
+  return nullptr;
+}
+
+void HTTPMessage::parseQueryParams() const {
+  DCHECK(!parsedQueryParams_);
+  if (!indexedQueryParams_) {
+    indexQueryParams();
+  }
+
+  parsedQueryParams_ = true;
+  if (!queryParams_) {
+    queryParams_.reset(new std::map<string, string>());
+  }
+  for (const auto& param : queryParamIndex_) {
+    // later duplicates overwrite earlier ones, same as findQueryParam()
+    (*queryParams_)[param.first.str()] = param.second.str();
+  }
 }
 
 void HTTPMessage::unparseQueryParams() {
-  queryParams_.clear();
+  if (queryParams_) {
+    queryParams_->clear();
+  }
   parsedQueryParams_ = false;
+  queryParamIndex_.clear();
+  indexedQueryParams_ = false;
+}
+
+StringPiece HTTPMessage::getQueryParamPiece(StringPiece name) const {
+  auto param = findQueryParam(name);
+  return param ? param->second : StringPiece();
 }
 
 const string* HTTPMessage::getQueryParamPtr(const string& name) const {
+  // Misses are answered from the index without building the map
+  if (!parsedQueryParams_ && !findQueryParam(name)) {
+    return nullptr;
+  }
+
   // Parse the query parameters if we haven't done so yet
   if (!parsedQueryParams_) {
     parseQueryParams();
   }
 
-  auto it = queryParams_.find(name);
-  if (it == queryParams_.end()) {
+  auto it = queryParams_->find(name);
+  if (it == queryParams_->end()) {
     return nullptr;
   }
   return &it->second;
 }
 
 bool HTTPMessage::hasQueryParam(const string& name) const {
-  return getQueryParamPtr(name) != nullptr;
+  if (parsedQueryParams_) {
+    return queryParams_->count(name) != 0;
+  }
+  return findQueryParam(name) != nullptr;
 }
 
 const string& HTTPMessage::getQueryParam(const string& name) const {
@@ -362,7 +628,10 @@ const string& HTTPMessage::getQueryParam(const string& name) const {
 }
 
 int HTTPMessage::getIntQueryParam(const std::string& name) const {
-  return folly::to<int>(getQueryParam(name));
+  if (parsedQueryParams_) {
+    return folly::to<int>(getQueryParam(name));
+  }
+  return folly::to<int>(getQueryParamPiece(name));
 }
 
 int HTTPMessage::getIntQueryParam(const std::string& name, int defval) const {
@@ -375,9 +644,15 @@ int HTTPMessage::getIntQueryParam(const std::string& name, int defval) const {
 }
 
 std::string HTTPMessage::getDecodedQueryParam(const std::string& name) const {
-  auto val = getQueryParam(name);
+  StringPiece val = parsedQueryParams_ ? StringPiece(getQueryParam(name))
+                                       : getQueryParamPiece(name);
 
   std::string result;
+  if (val.find('%') == string::npos && val.find('+') == string::npos) {
+    // nothing to unescape
+    result.assign(val.data(), val.size());
+    return result;
+  }
   try {
     folly::uriUnescape(val, result, folly::UriEscapeMode::QUERY);
   } catch (const std::exception& ex) {
@@ -391,7 +666,7 @@ const std::map<std::string, std::string>& HTTPMessage::getQueryParams() const {
   if (!parsedQueryParams_) {
     parseQueryParams();
   }
-  return queryParams_;
+  return *queryParams_;
 }
 
 bool HTTPMessage::setQueryString(const std::string& query) {
@@ -405,6 +680,10 @@ bool HTTPMessage::setQueryString(const std::string& query) {
                                query, // new query string
                                u.fragment());
     request().query_ = query;
+    // the index pointed into the old query string; the map, if any, is
+    // kept up to date by the callers that change individual params
+    queryParamIndex_.clear();
+    indexedQueryParams_ = false;
     return true;
   }
 
@@ -418,12 +697,12 @@ bool HTTPMessage::removeQueryParam(const std::string& name) {
     parseQueryParams();
   }
 
-  if (!queryParams_.erase(name)) {
+  if (!queryParams_->erase(name)) {
     // Query param was not found.
     return false;
   }
 
-  auto query = createQueryString(queryParams_, request().query_.length());
+  auto query = createQueryString(*queryParams_, request().query_.length());
   return setQueryString(query);
 }
 
@@ -434,11 +713,37 @@ bool HTTPMessage::setQueryParam(const std::string& name,
     parseQueryParams();
   }
 
-  queryParams_[name] = value;
-  auto query = createQueryString(queryParams_, request().query_.length());
+  (*queryParams_)[name] = value;
+  auto query = createQueryString(*queryParams_, request().query_.length());
   return setQueryString(query);
 }
 
+void HTTPMessage::setPathParam(const std::string& name,
+                               folly::StringPiece value) {
+  if (!pathParams_) {
+    pathParams_.reset(new std::map<string, string>());
+  }
+  (*pathParams_)[name] = value.str();
+}
+
+const std::string& HTTPMessage::getPathParam(const std::string& name) const {
+  if (!pathParams_) {
+    return empty_string;
+  }
+  auto it = pathParams_->find(name);
+  return it == pathParams_->end() ? empty_string : it->second;
+}
+
+const std::map<std::string, std::string>&
+HTTPMessage::getPathParams() const {
+  return pathParams_ ? *pathParams_ : kEmptyParams;
+}
+
+const HTTPHeaders& HTTPMessage::getStrippedPerHopHeaders() const {
+  static const HTTPHeaders kNoHeaders;
+  return strippedPerHopHeaders_ ? *strippedPerHopHeaders_ : kNoHeaders;
+}
+
 std::string HTTPMessage::createQueryString(
     const std::map<std::string, std::string>& params, uint32_t maxLength) {
   std::string query;
@@ -511,6 +816,22 @@ void HTTPMessage::splitNameValuePieces(
   }
 }
 
+const folly::SocketAddress& HTTPMessage::getAddress(
+    const std::shared_ptr<const CachedSocketAddress>& addr) {
+  static const folly::SocketAddress empty;
+  return addr ? addr->getAddress() : empty;
+}
+
+const string& HTTPMessage::getAddressStr(
+    const std::shared_ptr<const CachedSocketAddress>& addr) {
+  return addr ? addr->getAddressStr() : empty_string;
+}
+
+const string& HTTPMessage::getPortStr(
+    const std::shared_ptr<const CachedSocketAddress>& addr) {
+  return addr ? addr->getPortStr() : empty_string;
+}
+
 StringPiece HTTPMessage::trim(StringPiece sp) {
   // TODO: use a library function from boost?
   for (; !sp.empty() && sp.front() == ' '; sp.pop_front()) {
@@ -520,67 +841,27 @@ StringPiece HTTPMessage::trim(StringPiece sp) {
   return sp;
 }
 
-void HTTPMessage::splitNameValue(
-        const string& input,
-        char pairDelim,
-        char valueDelim,
-        std::function<void(string&&, string&&)> callback) {
-
-  folly::StringPiece sp(input);
-  while (!sp.empty()) {
-    size_t pairDelimPos = sp.find(pairDelim);
-    folly::StringPiece keyValue;
-
-    if (pairDelimPos == string::npos) {
-      keyValue = sp;
-      sp.advance(sp.size());
-    } else {
-      keyValue = sp.subpiece(0, pairDelimPos);
-      // Skip '&' char
-      sp.advance(pairDelimPos + 1);
-    }
-
-    if (keyValue.empty()) {
-      continue;
-    }
-
-    size_t valueDelimPos = keyValue.find(valueDelim);
-    if (valueDelimPos == string::npos) {
-      // Key only query param
-      string name = keyValue.str();
-      string value;
-
-      boost::trim(name, defaultLocale);
-      callback(std::move(name), std::move(value));
-    } else {
-      string name = keyValue.subpiece(0, valueDelimPos).str();
-      string value = keyValue.subpiece(valueDelimPos + 1).str();
-
-      boost::trim(name, defaultLocale);
-      boost::trim(value, defaultLocale);
-      callback(std::move(name), std::move(value));
-    }
-  }
-}
-
 void HTTPMessage::dumpMessage(int vlogLevel) const {
-  VLOG(vlogLevel) << "Version: " << versionStr_
+  const string version = getVersionString();
+  // outlives the fields that point at it
+  string status;
+  VLOG(vlogLevel) << "Version: " << version
                   << ", chunked: " << chunked_
                   << ", upgraded: " << upgraded_;
 
   // Common fields to both requests and responses.
   std::vector<std::pair<const char*, const std::string*>> fields {{
     {"local_ip", &localIP_},
-    {"version", &versionStr_},
-    {"dst_ip", &dstIP_},
-    {"dst_port", &dstPort_},
+    {"version", &version},
+    {"dst_ip", &getDstIP()},
+    {"dst_port", &getDstPort()},
   }};
 
   if (fields_.type() == typeid(Request)) {
     // Request fields.
     const Request& req = request();
-    fields.push_back(make_pair("client_ip", &req.clientIP_));
-    fields.push_back(make_pair("client_port", &req.clientPort_));
+    fields.push_back(make_pair("client_ip", &getClientIP()));
+    fields.push_back(make_pair("client_port", &getClientPort()));
     fields.push_back(make_pair("method", &getMethodString()));
     fields.push_back(make_pair("path", &req.path_));
     fields.push_back(make_pair("query", &req.query_));
@@ -588,7 +869,8 @@ void HTTPMessage::dumpMessage(int vlogLevel) const {
   } else if (fields_.type() == typeid(Response)) {
     // Response fields.
     const Response& resp = response();
-    fields.push_back(make_pair("status", &resp.statusStr_));
+    status = folly::to<string>(resp.status_);
+    fields.push_back(make_pair("status", &status));
     fields.push_back(make_pair("status_msg", &resp.statusMsg_));
   }
 
@@ -601,11 +883,57 @@ void HTTPMessage::dumpMessage(int vlogLevel) const {
   }
 
   VLOG(vlogLevel) << "Headers for message: ";
-  headers_.forEach([&] (const string& h, const string& v) {
+  getHeaders().forEach([&] (const string& h, const string& v) {
     VLOG(vlogLevel) << " " << stripCntrlChars(h) << ": " << stripCntrlChars(v);
   });
 }
 
+namespace {
+
+// A guess at the bytes a std::map node adds to its entry on 64-bit
+const size_t kMapNodeOverhead = 32;
+
+size_t stringMapBytes(const std::map<std::string, std::string>* strings) {
+  if (!strings) {
+    return 0;
+  }
+  size_t bytes = sizeof(*strings);
+  for (const auto& entry: *strings) {
+    bytes += kMapNodeOverhead + sizeof(entry) +
+      proxygen::stringHeapBytes(entry.first) +
+      proxygen::stringHeapBytes(entry.second);
+  }
+  return bytes;
+}
+
+}
+
+size_t HTTPMessage::getMemoryUsage() const {
+  size_t bytes = sizeof(HTTPMessage) + headers_.getMemoryUsage() +
+    stringHeapBytes(localIP_) +
+    cookies_.capacity() * sizeof(cookies_[0]) +
+    stringMapBytes(queryParams_.get()) + stringMapBytes(pathParams_.get());
+  bytes += rawHeaderLines_.capacity() * sizeof(RawHeaderLine);
+  if (queryParamIndex_.capacity() > kInlineQueryParams) {
+    bytes += queryParamIndex_.capacity() * sizeof(queryParamIndex_[0]);
+  }
+  if (strippedPerHopHeaders_) {
+    bytes += sizeof(HTTPHeaders) + strippedPerHopHeaders_->getMemoryUsage();
+  }
+  if (trailers_) {
+    bytes += sizeof(HTTPHeaders) + trailers_->getMemoryUsage();
+  }
+  if (fields_.type() == typeid(Request)) {
+    const Request& req = request();
+    const std::string* method = boost::get<std::string>(&req.method_);
+    bytes += stringHeapBytes(req.path_) + stringHeapBytes(req.query_) +
+      stringHeapBytes(req.url_) + (method ? stringHeapBytes(*method) : 0);
+  } else if (fields_.type() == typeid(Response)) {
+    bytes += stringHeapBytes(response().statusMsg_);
+  }
+  return bytes;
+}
+
 void
 HTTPMessage::atomicDumpMessage(int vlogLevel) const {
   std::lock_guard<std::mutex> g(mutexDump_);
@@ -613,23 +941,26 @@ HTTPMessage::atomicDumpMessage(int vlogLevel) const {
 }
 
 void HTTPMessage::dumpMessageToSink(google::LogSink* logSink) const {
-  LOG_TO_SINK(logSink, INFO) << "Version: " << versionStr_
+  const string version = getVersionString();
+  // outlives the fields that point at it
+  string status;
+  LOG_TO_SINK(logSink, INFO) << "Version: " << version
                   << ", chunked: " << chunked_
                   << ", upgraded: " << upgraded_;
 
   // Common fields to both requests and responses.
   std::vector<std::pair<const char*, const std::string*>> fields {{
     {"local_ip", &localIP_},
-    {"version", &versionStr_},
-    {"dst_ip", &dstIP_},
-    {"dst_port", &dstPort_},
+    {"version", &version},
+    {"dst_ip", &getDstIP()},
+    {"dst_port", &getDstPort()},
   }};
 
   if (fields_.type() == typeid(Request)) {
     // Request fields.
     const Request& req = request();
-    fields.push_back(make_pair("client_ip", &req.clientIP_));
-    fields.push_back(make_pair("client_port", &req.clientPort_));
+    fields.push_back(make_pair("client_ip", &getClientIP()));
+    fields.push_back(make_pair("client_port", &getClientPort()));
     fields.push_back(make_pair("method", &getMethodString()));
     fields.push_back(make_pair("path", &req.path_));
     fields.push_back(make_pair("query", &req.query_));
@@ -637,7 +968,8 @@ void HTTPMessage::dumpMessageToSink(google::LogSink* logSink) const {
   } else if (fields_.type() == typeid(Response)) {
     // Response fields.
     const Response& resp = response();
-    fields.push_back(make_pair("status", &resp.statusStr_));
+    status = folly::to<string>(resp.status_);
+    fields.push_back(make_pair("status", &status));
     fields.push_back(make_pair("status_msg", &resp.statusMsg_));
   }
 
@@ -650,7 +982,7 @@ void HTTPMessage::dumpMessageToSink(google::LogSink* logSink) const {
   }
 
   LOG_TO_SINK(logSink, INFO) << "Headers for message: ";
-  headers_.forEach([&logSink] (const string& h, const string& v) {
+  getHeaders().forEach([&logSink] (const string& h, const string& v) {
     LOG_TO_SINK(logSink, INFO) << " " << folly::backslashify(h)
                                << ": " << folly::backslashify(v);
   });
@@ -699,7 +1031,8 @@ bool HTTPMessage::checkForHeaderToken(const HTTPHeaderCode headerCode,
   // Search through all of the headers with this name.
   // forEachValueOfHeader will return true iff it was "broken" prematurely
   // with "return true" in the lambda-function
-  return headers_.forEachValueOfHeader(headerCode, [&] (const string& value) {
+  return getHeaders().forEachValueOfHeader(headerCode,
+                                           [&] (const string& value) {
     string lower;
     // Use StringPiece, since it implements a faster find() than std::string
     StringPiece headerValue;
@@ -15,18 +15,39 @@
 #include <folly/Optional.h>
 #include <folly/SocketAddress.h>
 #include <folly/io/IOBufQueue.h>
+#include <folly/small_vector.h>
 #include <glog/logging.h>
 #include <map>
 #include <mutex>
+#include <proxygen/lib/http/HTTPCachedHeaders.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/HTTPHeaders.h>
 #include <proxygen/lib/http/HTTPMethod.h>
+#include <proxygen/lib/utils/CachedSocketAddress.h>
 #include <proxygen/lib/utils/ParseURL.h>
 #include <proxygen/lib/utils/Time.h>
 #include <string>
+#include <vector>
 
 namespace proxygen {
 
+class HTTPCannedResponse;
+
+/**
+ * HTTP/2 priority of a stream: the stream it depends on, and its share of
+ * the bandwidth among the streams that depend on the same one.
+ */
+struct HTTPPriority {
+  HTTPPriority() {}
+  HTTPPriority(uint32_t dependency, bool excl, uint16_t w)
+      : streamDependency(dependency), exclusive(excl), weight(w) {}
+
+  uint32_t streamDependency{0};
+  bool exclusive{false};
+  // from 1 to 256
+  uint16_t weight{16};
+};
+
 /**
  * An HTTP request or response minus the body.
  *
@@ -44,6 +65,13 @@ class HTTPMessage {
   HTTPMessage(const HTTPMessage& message);
   HTTPMessage& operator=(const HTTPMessage& message);
 
+  /**
+   * Put the message back in its default constructed state, keeping the
+   * memory held by the headers so that it can be reused for another
+   * message (see ObjectPool)
+   */
+  void reset();
+
   /**
    * Is this a chunked message? (fpreq, fpresp)
    */
@@ -58,44 +86,52 @@ class HTTPMessage {
 
   /**
    * Set/Get client address
+   *
+   * The IP and port strings are only formatted when first asked for. The
+   * shared_ptr overload lets a session hand the same instance to all of
+   * its messages, so they are formatted at most once per connection.
    */
   void setClientAddress(const folly::SocketAddress& addr) {
-    request().clientAddress_ = addr;
-    request().clientIP_ = addr.getAddressStr();
-    request().clientPort_ = folly::to<std::string>(addr.getPort());
+    request().clientAddress_ = std::make_shared<CachedSocketAddress>(addr);
+  }
+
+  void setClientAddress(std::shared_ptr<const CachedSocketAddress> addr) {
+    request().clientAddress_ = std::move(addr);
   }
 
   const folly::SocketAddress& getClientAddress() const {
-    return request().clientAddress_;
+    return getAddress(request().clientAddress_);
   }
 
   const std::string& getClientIP() const {
-    return request().clientIP_;
+    return getAddressStr(request().clientAddress_);
   }
 
   const std::string& getClientPort() const {
-    return request().clientPort_;
+    return getPortStr(request().clientAddress_);
   }
 
   /**
-   * Set/Get destination (vip) address
+   * Set/Get destination (vip) address, formatted lazily like the client's
    */
   void setDstAddress(const folly::SocketAddress& addr) {
-    dstAddress_ = addr;
-    dstIP_ = addr.getAddressStr();
-    dstPort_ = folly::to<std::string>(addr.getPort());
+    dstAddress_ = std::make_shared<CachedSocketAddress>(addr);
+  }
+
+  void setDstAddress(std::shared_ptr<const CachedSocketAddress> addr) {
+    dstAddress_ = std::move(addr);
   }
 
   const folly::SocketAddress& getDstAddress() const {
-    return dstAddress_;
+    return getAddress(dstAddress_);
   }
 
   const std::string& getDstIP() const {
-    return dstIP_;
+    return getAddressStr(dstAddress_);
   }
 
   const std::string& getDstPort() const {
-    return dstPort_;
+    return getPortStr(dstAddress_);
   }
 
   /**
@@ -140,18 +176,19 @@ class HTTPMessage {
   ParseURL setURL(T&& url) {
     VLOG(9) << "setURL: " << url;
 
-    // Set the URL, path, and query string parameters
-    ParseURL u(url);
+    // Store the URL first and parse the stored copy, so the returned
+    // ParseURL views stay valid for as long as this message does
+    request().url_ = std::forward<T>(url);
+    ParseURL u(request().url_);
     if (u.valid()) {
       VLOG(9) << "set path: " << u.path() << " query:" << u.query();
-      request().path_ = u.path().str();
-      request().query_ = u.query().str();
+      // assign() reuses the strings' capacity when the message is recycled
+      request().path_.assign(u.path().data(), u.path().size());
+      request().query_.assign(u.query().data(), u.query().size());
       unparseQueryParams();
     } else {
-      VLOG(4) << "Error in parsing URL: " << url;
+      VLOG(4) << "Error in parsing URL: " << request().url_;
     }
-
-    request().url_ = std::forward<T>(url);
     return u;
   }
   // The template function above doesn't work with char*,
@@ -209,10 +246,9 @@ class HTTPMessage {
   /**
    * Get/Set the HTTP version string (like "1.1").
    * XXX: Note we only support X.Y format while setting version.
+   * The string is formatted from getHTTPVersion() on each call.
    */
-  const std::string& getVersionString() const {
-    return versionStr_;
-  }
+  std::string getVersionString() const;
   void setVersionString(const std::string& ver) {
     if (ver.size() != 3 ||
         ver[1] != '.' ||
@@ -227,8 +263,81 @@ class HTTPMessage {
   /**
    * Access the headers (fpreq, fpres)
    */
-  HTTPHeaders& getHeaders() { return headers_; }
-  const HTTPHeaders& getHeaders() const { return headers_; }
+  HTTPHeaders& getHeaders() {
+    if (UNLIKELY(sharedHeaders_ != nullptr)) {
+      unshareHeaders();
+    }
+    return headers_;
+  }
+  const HTTPHeaders& getHeaders() const {
+    return sharedHeaders_ ? *sharedHeaders_ : headers_;
+  }
+
+  /**
+   * Make the headers copy-on-write, so that copies of this message share
+   * one read-only set instead of copying every name and value. The first
+   * call to the non-const getHeaders() on any of the copies gives it its
+   * own set again. Meant for sending one message to many recipients, e.g.
+   * a collapsed response; codecs only read the headers, so the copies can
+   * be serialized without ever copying them.
+   *
+   * The const accessors of HTTPHeaders may still update lazy state, so the
+   * copies must stay on one thread.
+   */
+  void shareHeaders();
+
+  bool headersShared() const {
+    return sharedHeaders_ != nullptr;
+  }
+
+  /**
+   * Attach a set of immutable headers that the codecs send after the ones
+   * in getHeaders(), from a serialization cached in the set. The cached
+   * headers are not visible through getHeaders().
+   */
+  void setCachedHeaders(std::shared_ptr<const HTTPCachedHeaders> cached) {
+    cachedHeaders_ = std::move(cached);
+  }
+  const std::shared_ptr<const HTTPCachedHeaders>& getCachedHeaders() const {
+    return cachedHeaders_;
+  }
+
+  /**
+   * Mark this message as a copy of the message of canned, so that the
+   * codecs may send its pre-serialized head instead. Codecs check that the
+   * message wasn't changed since, see HTTPCannedResponse::isUnchanged().
+   */
+  void setCannedResponse(std::shared_ptr<const HTTPCannedResponse> canned) {
+    cannedResponse_ = std::move(canned);
+  }
+  const std::shared_ptr<const HTTPCannedResponse>& getCannedResponse() const {
+    return cannedResponse_;
+  }
+
+  /**
+   * A header line as it came off the wire, with where the value of its
+   * header starts in it
+   */
+  struct RawHeaderLine {
+    folly::StringPiece line;
+    const char* value;
+  };
+
+  /**
+   * The lines of the headers that an HTTP1xCodec with setKeepRawHeaders()
+   * parsed as views into its ingress buffer, in wire order. When the
+   * message goes out over HTTP/1.x again, a header whose value still
+   * points at the one of a line is sent as that line, so the headers a
+   * proxy left alone are copied a run of lines at a time instead of
+   * serialized one by one. The lines are only read through such a value,
+   * which keeps their buffer alive, and are not copied with the message.
+   */
+  void addRawHeaderLine(folly::StringPiece line, const char* value) {
+    rawHeaderLines_.push_back(RawHeaderLine{line, value});
+  }
+  const std::vector<RawHeaderLine>& getRawHeaderLines() const {
+    return rawHeaderLines_;
+  }
 
   /**
    * Access the trailers
@@ -266,7 +375,8 @@ class HTTPMessage {
   bool is1xxResponse() const { return (getStatusCode() / 100) == 1; }
 
   /**
-   * Formats the current time appropriately for a Date header
+   * Formats the current time appropriately for a Date header. Hot paths
+   * should prefer getCachedHTTPDateTime(), which avoids the copy.
    */
   static std::string formatDateHeader();
 
@@ -344,12 +454,22 @@ class HTTPMessage {
    */
   bool hasQueryParam(const std::string& name) const;
 
+  /**
+   * Get the query parameter with the specified name, without copying it.
+   *
+   * Returns a view into the query string, still percent-encoded, or an
+   * empty piece if there is no parameter with the specified name.  The
+   * returned value is only valid until the query string changes.
+   */
+  folly::StringPiece getQueryParamPiece(folly::StringPiece name) const;
+
   /**
    * Get the query parameter with the specified name.
    *
    * Returns a pointer to the query parameter value, or nullptr if there is no
    * parameter with the specified name.  The returned value is only valid as
-   * long as this HTTPMessage object.
+   * long as this HTTPMessage object.  This builds the getQueryParams() map,
+   * prefer getQueryParamPiece() for one-off lookups.
    */
   const std::string* getQueryParamPtr(const std::string& name) const;
 
@@ -391,7 +511,8 @@ class HTTPMessage {
    *
    * Returns a reference to the query parameters map.  The returned
    * value is only valid as long as this
-   * HTTPMessage object.
+   * HTTPMessage object.  The map is only built the first time one of the
+   * std::string based accessors needs it.
    */
   const std::map<std::string, std::string>& getQueryParams() const;
 
@@ -416,6 +537,19 @@ class HTTPMessage {
    */
   bool setQueryParam(const std::string& name, const std::string& value);
 
+  /**
+   * Set a parameter captured from the path, see Router.
+   */
+  void setPathParam(const std::string& name, folly::StringPiece value);
+
+  /**
+   * Get the path parameter with the specified name, or an empty string
+   * if there is none.
+   */
+  const std::string& getPathParam(const std::string& name) const;
+
+  const std::map<std::string, std::string>& getPathParams() const;
+
   /**
    * Get the cookie with the specified name.
    *
@@ -427,6 +561,13 @@ class HTTPMessage {
    */
   const folly::StringPiece getCookie(const std::string& name) const;
 
+  /**
+   * Estimate of the bytes the message holds, sizeof(HTTPMessage) included.
+   * Shared headers and cached or canned responses are left out, the
+   * messages that share them own them as much as this one.
+   */
+  size_t getMemoryUsage() const;
+
   /**
    * Print the message out.
    */
@@ -451,9 +592,7 @@ class HTTPMessage {
    */
   void stripPerHopHeaders();
 
-  const HTTPHeaders& getStrippedPerHopHeaders() const {
-    return strippedPerHopHeaders_;
-  }
+  const HTTPHeaders& getStrippedPerHopHeaders() const;
 
   void setSecure(bool secure) { secure_ = secure; }
   bool isSecure() const { return secure_; }
@@ -485,6 +624,17 @@ class HTTPMessage {
     return pri;
   }
 
+  /**
+   * Setter and getter for the HTTP/2 priority, which is only set for the
+   * messages that carried one
+   */
+  void setHTTP2Priority(const HTTPPriority& priority) {
+    http2Priority_ = priority;
+  }
+  const folly::Optional<HTTPPriority>& getHTTP2Priority() const {
+    return http2Priority_;
+  }
+
   /**
    * get and setter for transaction sequence number
    */
@@ -506,6 +656,29 @@ class HTTPMessage {
    */
   TimePoint getStartTime() const { return startTime_; }
 
+  /**
+   * The time by which the client stops waiting for the response, see
+   * HTTPServerOptions::requestTimeoutHeader. TimePoint() if it waits for
+   * as long as it takes.
+   */
+  void setDeadline(TimePoint deadline) { deadline_ = deadline; }
+  TimePoint getDeadline() const { return deadline_; }
+  bool hasDeadline() const { return deadline_ != TimePoint(); }
+
+  /**
+   * @return true if the deadline passed, and nobody waits for the response
+   */
+  bool isExpired(TimePoint now = getCurrentTime()) const {
+    return hasDeadline() && now >= deadline_;
+  }
+
+  /**
+   * @return the time left until the deadline, zero once it passed, or
+   *         milliseconds::max() without a deadline
+   */
+  std::chrono::milliseconds getRemainingBudget(
+    TimePoint now = getCurrentTime()) const;
+
   /**
    * Check if a particular token value is present in a header that consists of
    * a list of comma separated tokens.  (e.g., a header with a #rule
@@ -564,12 +737,6 @@ class HTTPMessage {
       char valueDelim,
       std::function<void(folly::StringPiece, folly::StringPiece)> callback);
 
-  static void splitNameValue(
-      const std::string& input,
-      char pairDelim,
-      char valueDelim,
-      std::function<void(std::string&&, std::string&&)> callback);
-
   /**
    * Form the URL from the individual components.
    * url -> {scheme}://{authority}{path}?{query}#{fragment}
@@ -591,13 +758,20 @@ class HTTPMessage {
   // Message start time, in msec since the epoch.
   TimePoint startTime_;
   int32_t seqNo_;
+  TimePoint deadline_;
 
  private:
 
   void parseCookies() const;
 
+  // give this copy its own headers again, see shareHeaders()
+  void unshareHeaders();
+
   void parseQueryParams() const;
   void unparseQueryParams();
+  void indexQueryParams() const;
+  const std::pair<folly::StringPiece, folly::StringPiece>* findQueryParam(
+    folly::StringPiece name) const;
 
   /**
    * Trims whitespace from the beggining and end of the StringPiece.
@@ -609,10 +783,15 @@ class HTTPMessage {
    * Once an accessor for either is used, that fixes the type of HTTPMessage.
    * If an access is then used for the other type, a DCHECK will fail.
    */
+  static const folly::SocketAddress& getAddress(
+    const std::shared_ptr<const CachedSocketAddress>& addr);
+  static const std::string& getAddressStr(
+    const std::shared_ptr<const CachedSocketAddress>& addr);
+  static const std::string& getPortStr(
+    const std::shared_ptr<const CachedSocketAddress>& addr);
+
   struct Request {
-    folly::SocketAddress clientAddress_;
-    std::string clientIP_;
-    std::string clientPort_;
+    std::shared_ptr<const CachedSocketAddress> clientAddress_;
     mutable boost::variant<boost::blank, std::string, HTTPMethod> method_;
     std::string path_;
     std::string query_;
@@ -621,16 +800,12 @@ class HTTPMessage {
 
   struct Response {
     uint16_t status_;
-    std::string statusStr_;
     std::string statusMsg_;
   };
 
-  folly::SocketAddress dstAddress_;
-  std::string dstIP_;
-  std::string dstPort_;
+  std::shared_ptr<const CachedSocketAddress> dstAddress_;
 
   std::string localIP_;
-  std::string versionStr_;
 
   mutable boost::variant<boost::blank, Request, Response> fields_;
 
@@ -675,23 +850,47 @@ class HTTPMessage {
    * These are mutable since we parse them lazily in getCookie() and
    * getQueryParam()
    */
-  mutable std::map<folly::StringPiece, folly::StringPiece> cookies_;
-  // TODO: use StringPiece for queryParams_ and delete splitNameValue()
-  mutable std::map<std::string, std::string> queryParams_;
+  // (name, value) views into the Cookie headers, in the order they appear,
+  // or sorted by name (stably, so the first duplicate still wins) past
+  // kLinearCookieLookup of them. Reserved once when parsed.
+  static const size_t kLinearCookieLookup = 8;
+  mutable std::vector<std::pair<folly::StringPiece, folly::StringPiece>>
+    cookies_;
+  // (name, value) views into request().query_, in the order they appear.
+  // Lookups scan it from the back so that the last duplicate wins.
+  static const size_t kInlineQueryParams = 4;
+  mutable folly::small_vector<
+    std::pair<folly::StringPiece, folly::StringPiece>,
+    kInlineQueryParams> queryParamIndex_;
+  // copies built from queryParamIndex_ for getQueryParams() and friends,
+  // never null while parsedQueryParams_ is set
+  mutable std::unique_ptr<std::map<std::string, std::string>> queryParams_;
+  // allocated by the first setPathParam()
+  std::unique_ptr<std::map<std::string, std::string>> pathParams_;
 
   std::pair<uint8_t, uint8_t> version_;
   HTTPHeaders headers_;
-  HTTPHeaders strippedPerHopHeaders_;
+  // when set, the headers, read-only and possibly shared with other copies
+  // of this message; headers_ is empty then
+  std::shared_ptr<const HTTPHeaders> sharedHeaders_;
+  // allocated by the first stripPerHopHeaders(); a second HTTPHeaders
+  // inline would nearly double the size of every message
+  std::unique_ptr<HTTPHeaders> strippedPerHopHeaders_;
   HTTPHeaderSize size_;
   std::unique_ptr<HTTPHeaders> trailers_;
+  std::shared_ptr<const HTTPCachedHeaders> cachedHeaders_;
+  std::shared_ptr<const HTTPCannedResponse> cannedResponse_;
+  std::vector<RawHeaderLine> rawHeaderLines_;
 
   int sslVersion_;
   const char* sslCipher_;
   uint16_t spdy_; // == 0 - no SPDY; > 0 - SPDY Version
   uint8_t pri_;
+  folly::Optional<HTTPPriority> http2Priority_;
 
   mutable bool parsedCookies_:1;
   mutable bool parsedQueryParams_:1;
+  mutable bool indexedQueryParams_:1;
   bool chunked_:1;
   bool upgraded_:1;
   bool wantsKeepalive_:1;
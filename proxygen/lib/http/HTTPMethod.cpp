@@ -9,7 +9,6 @@
  */
 #include <proxygen/lib/http/HTTPMethod.h>
 
-#include <folly/Foreach.h>
 #include <proxygen/lib/http/HTTPHeaders.h>
 #include <vector>
 
@@ -24,10 +23,51 @@ static const std::vector<std::string> kMethodStrings = {
 namespace proxygen {
 
 boost::optional<HTTPMethod> stringToMethod(folly::StringPiece method) {
-  FOR_EACH_ENUMERATE(index, cur, kMethodStrings) {
-    if (caseInsensitiveEqual(*cur, method)) {
-      return HTTPMethod(index);
-    }
+  if (method.empty()) {
+    return boost::none;
+  }
+  // The length and first letter leave at most one candidate to compare
+  HTTPMethod candidate;
+  const char first = method[0] | 0x20;
+  switch (method.size()) {
+    case 3:
+      if (first == 'g') {
+        candidate = HTTPMethod::GET;
+      } else if (first == 'p') {
+        candidate = HTTPMethod::PUT;
+      } else {
+        return boost::none;
+      }
+      break;
+    case 4:
+      if (first == 'p') {
+        candidate = HTTPMethod::POST;
+      } else if (first == 'h') {
+        candidate = HTTPMethod::HEAD;
+      } else {
+        return boost::none;
+      }
+      break;
+    case 5:
+      candidate = HTTPMethod::TRACE;
+      break;
+    case 6:
+      candidate = HTTPMethod::DELETE;
+      break;
+    case 7:
+      if (first == 'o') {
+        candidate = HTTPMethod::OPTIONS;
+      } else if (first == 'c') {
+        candidate = HTTPMethod::CONNECT;
+      } else {
+        return boost::none;
+      }
+      break;
+    default:
+      return boost::none;
+  }
+  if (caseInsensitiveEqual(methodToString(candidate), method)) {
+    return candidate;
   }
   return boost::none;
 }
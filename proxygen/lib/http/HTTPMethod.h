@@ -15,7 +15,7 @@
 
 namespace proxygen {
 
-// Ordered by frequency to minimize time spent in iteration
+// Ordered by frequency
 #define HTTP_METHOD_GEN(x) \
   x(GET),                  \
   x(POST),                 \
@@ -0,0 +1,493 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/HTTPSessionPool.h>
+
+#include <algorithm>
+#include <openssl/x509v3.h>
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/UtilInl.h>
+#include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
+
+using apache::thrift::async::TAsyncSSLSocket;
+using apache::thrift::transport::TTransportException;
+using folly::EventBase;
+using std::chrono::milliseconds;
+using std::string;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+// the DNS names in the subjectAltName of the certificate of the peer
+vector<string> getPeerCertNames(const HTTPSession& session) {
+  vector<string> names;
+  auto sslSocket = dynamic_cast<const TAsyncSSLSocket*>(
+    session.getTransport());
+  if (!sslSocket || !sslSocket->getSSL()) {
+    return names;
+  }
+  X509* cert = SSL_get_peer_certificate(sslSocket->getSSL());
+  if (!cert) {
+    return names;
+  }
+  auto altNames = (GENERAL_NAMES*)X509_get_ext_d2i(
+    cert, NID_subject_alt_name, nullptr, nullptr);
+  if (altNames) {
+    for (int i = 0; i < sk_GENERAL_NAME_num(altNames); ++i) {
+      const GENERAL_NAME* name = sk_GENERAL_NAME_value(altNames, i);
+      if (name->type == GEN_DNS) {
+        names.emplace_back((const char*)ASN1_STRING_data(name->d.dNSName),
+                           ASN1_STRING_length(name->d.dNSName));
+      }
+    }
+    GENERAL_NAMES_free(altNames);
+  }
+  X509_free(cert);
+  return names;
+}
+
+// "*.example.com" covers "www.example.com" but not "example.com" or
+// "a.www.example.com"
+bool certNameCovers(folly::StringPiece certName, folly::StringPiece host) {
+  if (caseInsensitiveEqual(certName, host)) {
+    return true;
+  }
+  if (!certName.startsWith("*.")) {
+    return false;
+  }
+  auto dot = host.find('.');
+  if (dot == string::npos || dot == 0) {
+    return false;
+  }
+  return caseInsensitiveEqual(certName.subpiece(1), host.subpiece(dot));
+}
+
+}
+
+bool HTTPSessionPool::Key::operator<(const Key& other) const {
+  if (!(address == other.address)) {
+    return address < other.address;
+  }
+  if (sslContext != other.sslContext) {
+    return sslContext < other.sslContext;
+  }
+  if (plaintextProtocol != other.plaintextProtocol) {
+    return plaintextProtocol < other.plaintextProtocol;
+  }
+  // last, so that the sessions to a server for any host sort together
+  return host < other.host;
+}
+
+HTTPSessionPool::Connect::Connect(HTTPSessionPool* pool, const Key& key,
+                                  Callback* cb, AsyncTimeoutSet* timeoutSet)
+    : pool_(pool),
+      key_(key),
+      cb_(cb),
+      connector_(this, timeoutSet, key.plaintextProtocol) {
+}
+
+void HTTPSessionPool::Connect::start(EventBase* eventBase,
+                                     milliseconds timeout) {
+  start_ = getCurrentTime();
+  timeout_ = timeout;
+  if (key_.sslContext) {
+    if (!key_.host.empty()) {
+      connector_.setServerName(key_.host);
+    }
+    connector_.connectSSL(eventBase, key_.address, key_.sslContext,
+                          nullptr, timeout);
+  } else {
+    connector_.connect(eventBase, key_.address, timeout);
+  }
+}
+
+void HTTPSessionPool::Connect::connectSuccess(HTTPUpstreamSession* session) {
+  auto pool = pool_;
+  auto cb = cb_;
+  auto waiters = std::move(waiters_);
+  const Key key = key_;
+  auto demand = pool->demand_.find(key);
+  if (demand != pool->demand_.end()) {
+    demand->second.onConnect(millisecondsSince(start_));
+  }
+  if (session->getCodec().supportsParallelRequests()) {
+    pool->multiplexed_.insert(key);
+  } else {
+    pool->multiplexed_.erase(key);
+  }
+  if (!cb) {
+    pool->addSession(key, session);
+    pool->connectDone(this);
+  } else {
+    pool->add(key, session);
+    pool->connectDone(this);
+    cb->sessionAvailable(session);
+  }
+  pool->serveWaiters(key, session, waiters);
+}
+
+void HTTPSessionPool::Connect::connectError(const TTransportException& ex) {
+  auto cb = cb_;
+  auto waiters = std::move(waiters_);
+  pool_->connectDone(this);
+  if (cb) {
+    cb->sessionError(ex);
+  }
+  for (const auto& waiter: waiters) {
+    waiter.cb->sessionError(ex);
+  }
+}
+
+HTTPSessionPool::HTTPSessionPool(EventBase* eventBase,
+                                 AsyncTimeoutSet* timeoutSet,
+                                 uint32_t maxIdleSessions)
+    : folly::AsyncTimeout(eventBase),
+      eventBase_(CHECK_NOTNULL(eventBase)),
+      timeoutSet_(timeoutSet),
+      maxIdleSessions_(maxIdleSessions) {
+}
+
+HTTPSessionPool::~HTTPSessionPool() {
+  // no callbacks for connections still being set up
+  connects_.clear();
+  while (!sessions_.empty()) {
+    close(sessions_.begin()->second.get());
+  }
+}
+
+HTTPUpstreamSession* HTTPSessionPool::getSession(const Key& key) {
+  auto range = byKey_.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    Entry* entry = it->second;
+    if (!entry->full && entry->session->isReusable() &&
+        entry->session->supportsMoreTransactions()) {
+      entry->idleHook.unlink();
+      return entry->session;
+    }
+  }
+  return findCoalesced(key);
+}
+
+HTTPUpstreamSession* HTTPSessionPool::findCoalesced(const Key& key) {
+  if (!key.sslContext || key.host.empty()) {
+    return nullptr;
+  }
+  for (auto it = byKey_.lower_bound(
+         Key(key.address, key.sslContext, key.plaintextProtocol));
+       it != byKey_.end() && it->first.address == key.address &&
+         it->first.sslContext == key.sslContext &&
+         it->first.plaintextProtocol == key.plaintextProtocol;
+       ++it) {
+    Entry* entry = it->second;
+    if (it->first.host != key.host && !entry->full &&
+        entry->session->isReusable() &&
+        entry->session->supportsMoreTransactions() &&
+        canCoalesce(entry, key.host)) {
+      VLOG(4) << "Sharing the session to " << key.address << " for "
+              << it->first.host << " with " << key.host;
+      entry->idleHook.unlink();
+      return entry->session;
+    }
+  }
+  return nullptr;
+}
+
+bool HTTPSessionPool::canCoalesce(Entry* entry, const string& host) {
+  // a request on an HTTP/1.1 session would wait for the others
+  if (!entry->session->getCodec().supportsParallelRequests() ||
+      entry->misdirected.count(host)) {
+    return false;
+  }
+  if (!entry->certNamesRead) {
+    entry->certNames = getPeerCertNames(*entry->session);
+    entry->certNamesRead = true;
+  }
+  for (const auto& certName: entry->certNames) {
+    if (certNameCovers(certName, host)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HTTPSessionPool::setMisdirected(const HTTPSession& session,
+                                     const string& host) {
+  auto entry = find(session);
+  if (entry && entry->key.host != host) {
+    entry->misdirected.insert(host);
+  }
+}
+
+void HTTPSessionPool::getSession(const Key& key, Callback* cb,
+                                 milliseconds connectTimeout) {
+  if (prewarm_) {
+    demand_[key].onRequest();
+  }
+  auto session = getSession(key);
+  if (session) {
+    cb->sessionAvailable(session);
+    return;
+  }
+  if (mayMultiplex(key)) {
+    auto connect = findConnect(key, connectTimeout);
+    if (connect) {
+      VLOG(4) << "Waiting for the session being connected to "
+              << key.address;
+      connect->waiters_.push_back({cb, connectTimeout});
+      return;
+    }
+  }
+  VLOG(4) << "No session to " << key.address << ", connecting";
+  connect(key, cb, connectTimeout);
+}
+
+void HTTPSessionPool::connect(const Key& key, Callback* cb,
+                              milliseconds timeout) {
+  connects_.emplace_back(new Connect(this, key, cb, timeoutSet_));
+  // This may complete, and delete, the connect right away
+  connects_.back()->start(eventBase_, timeout);
+}
+
+bool HTTPSessionPool::mayMultiplex(const Key& key) const {
+  return (!key.sslContext && !key.plaintextProtocol.empty() &&
+          !HTTP1xCodec::supportsNextProtocol(key.plaintextProtocol)) ||
+    multiplexed_.count(key) > 0;
+}
+
+HTTPSessionPool::Connect* HTTPSessionPool::findConnect(const Key& key,
+                                                       milliseconds timeout) {
+  for (const auto& connect: connects_) {
+    if (connect->key_ < key || key < connect->key_) {
+      continue;
+    }
+    // don't wait past the timeout of the caller
+    if (timeout.count() == 0 ||
+        (connect->timeout_.count() != 0 && connect->timeout_ <= timeout)) {
+      return connect.get();
+    }
+  }
+  return nullptr;
+}
+
+void HTTPSessionPool::serveWaiters(const Key& key,
+                                   HTTPUpstreamSession* session,
+                                   const vector<Connect::Waiter>& waiters) {
+  for (const auto& waiter: waiters) {
+    // the previous waiters may have filled or closed the session
+    auto it = sessions_.find(session);
+    if (it != sessions_.end() && !it->second->full && session->isReusable() &&
+        session->supportsMoreTransactions() &&
+        session->getCodec().supportsParallelRequests()) {
+      waiter.cb->sessionAvailable(session);
+      continue;
+    }
+    auto other = getSession(key);
+    if (other) {
+      waiter.cb->sessionAvailable(other);
+    } else {
+      connect(key, waiter.cb, waiter.timeout);
+    }
+  }
+}
+
+void HTTPSessionPool::enablePrewarm(const PrewarmOptions& options) {
+  prewarm_.reset(new PrewarmOptions(options));
+  scheduleTimeout(prewarm_->interval);
+}
+
+void HTTPSessionPool::timeoutExpired() noexcept {
+  prewarm();
+  scheduleTimeout(prewarm_->interval);
+}
+
+void HTTPSessionPool::prewarm() {
+  struct Need {
+    const Key* key;
+    uint32_t sessions;
+    double growth;
+  };
+  std::vector<Need> needs;
+  for (auto it = demand_.begin(); it != demand_.end();) {
+    const Key& key = it->first;
+    uint32_t sessions = 0;
+    uint32_t concurrency = 0;
+    bool canMultiplex = false;
+    auto range = byKey_.equal_range(key);
+    for (auto byKey = range.first; byKey != range.second; ++byKey) {
+      auto session = byKey->second->session;
+      ++sessions;
+      concurrency += session->getNumOutgoingStreams();
+      canMultiplex |= session->getCodec().supportsParallelRequests() &&
+        !byKey->second->full;
+    }
+    for (const auto& connect: connects_) {
+      if (!(connect->key_ < key) && !(key < connect->key_)) {
+        ++sessions;
+      }
+    }
+    auto& demand = it->second;
+    demand.tick(prewarm_->interval, concurrency);
+    if (demand.isIdle() && sessions == 0) {
+      it = demand_.erase(it);
+      continue;
+    }
+    // one session that can take more streams is enough
+    uint32_t target = canMultiplex ? 0 : demand.getTarget(prewarm_->maxPerKey);
+    if (target > sessions) {
+      needs.push_back({&key, target - sessions, demand.getGrowth()});
+    }
+    ++it;
+  }
+  std::stable_sort(needs.begin(), needs.end(),
+                   [] (const Need& a, const Need& b) {
+                     return a.growth > b.growth;
+                   });
+  for (const auto& need: needs) {
+    for (uint32_t i = 0; i < need.sessions; i++) {
+      if (sessions_.size() + connects_.size() >= prewarm_->maxSessions) {
+        return;
+      }
+      VLOG(4) << "Connecting to " << need.key->address << " ahead of demand";
+      connect(*need.key, nullptr, prewarm_->connectTimeout);
+    }
+  }
+}
+
+void HTTPSessionPool::cancel(Callback* cb) {
+  for (auto it = connects_.begin(); it != connects_.end();) {
+    auto& waiters = (*it)->waiters_;
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                 [cb] (const Connect::Waiter& waiter) {
+                                   return waiter.cb == cb;
+                                 }),
+                  waiters.end());
+    if ((*it)->cb_ != cb) {
+      ++it;
+    } else if (!waiters.empty()) {
+      // the others still wait for the session, which goes to the pool
+      (*it)->cb_ = nullptr;
+      ++it;
+    } else {
+      it = connects_.erase(it);
+    }
+  }
+}
+
+void HTTPSessionPool::addSession(const Key& key,
+                                 HTTPUpstreamSession* session) {
+  Entry* entry = add(key, session);
+  if (!session->hasActiveTransactions()) {
+    markIdle(entry);
+  }
+}
+
+HTTPSessionPool::Entry* HTTPSessionPool::add(const Key& key,
+                                             HTTPUpstreamSession* session) {
+  CHECK(sessions_.find(session) == sessions_.end());
+  Entry* entry = new Entry(key, session);
+  sessions_[session].reset(entry);
+  byKey_.insert(std::make_pair(key, entry));
+  entry->full = !session->supportsMoreTransactions();
+  session->setInfoCallback(this);
+  return entry;
+}
+
+HTTPSessionPool::Entry* HTTPSessionPool::find(const HTTPSession& session) {
+  auto it = sessions_.find(&session);
+  return it == sessions_.end() ? nullptr : it->second.get();
+}
+
+void HTTPSessionPool::remove(const HTTPSession& session) {
+  auto it = sessions_.find(&session);
+  if (it == sessions_.end()) {
+    return;
+  }
+  auto range = byKey_.equal_range(it->second->key);
+  for (auto byKey = range.first; byKey != range.second; ++byKey) {
+    if (byKey->second == it->second.get()) {
+      byKey_.erase(byKey);
+      break;
+    }
+  }
+  // unlinks the entry from idle_
+  sessions_.erase(it);
+}
+
+void HTTPSessionPool::close(Entry* entry) {
+  HTTPUpstreamSession* session = entry->session;
+  remove(*session);
+  session->setInfoCallback(nullptr);
+  // closes now if idle, else once the transactions are done
+  session->closeWhenIdle();
+}
+
+void HTTPSessionPool::connectDone(Connect* connect) {
+  for (auto it = connects_.begin(); it != connects_.end(); ++it) {
+    if (it->get() == connect) {
+      // We are in the connector's callback, delete it once that returns
+      Connect* done = it->release();
+      connects_.erase(it);
+      eventBase_->runInLoop([done] { delete done; });
+      return;
+    }
+  }
+}
+
+void HTTPSessionPool::markIdle(Entry* entry) {
+  entry->idleHook.unlink();
+  if (!entry->session->isReusable()) {
+    // it closes by itself
+    return;
+  }
+  idle_.push_front(*entry);
+  while (idle_.size() > maxIdleSessions_) {
+    VLOG(4) << "Closing least recently used idle session to "
+            << idle_.back().key.address;
+    close(&idle_.back());
+  }
+}
+
+void HTTPSessionPool::onActivateConnection(const HTTPSession& session) {
+  auto entry = find(session);
+  if (entry) {
+    entry->idleHook.unlink();
+  }
+}
+
+void HTTPSessionPool::onDeactivateConnection(const HTTPSession& session) {
+  auto entry = find(session);
+  if (entry) {
+    markIdle(entry);
+  }
+}
+
+void HTTPSessionPool::onDestroy(const HTTPSession& session) {
+  remove(session);
+}
+
+void HTTPSessionPool::onSettingsOutgoingStreamsFull(
+    const HTTPSession& session) {
+  auto entry = find(session);
+  if (entry) {
+    entry->full = true;
+  }
+}
+
+void HTTPSessionPool::onSettingsOutgoingStreamsNotFull(
+    const HTTPSession& session) {
+  auto entry = find(session);
+  if (entry) {
+    entry->full = false;
+  }
+}
+
+}
@@ -0,0 +1,262 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/IntrusiveList.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/SSLContext.h>
+#include <list>
+#include <map>
+#include <set>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/UpstreamDemand.h>
+#include <proxygen/lib/http/session/HTTPSession.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+class HTTPUpstreamSession;
+
+/**
+ * A pool of upstream sessions for many destinations, to be used from the
+ * thread of one EventBase. It hands out a session that can take another
+ * transaction if it has one for the destination: an idle HTTP/1.1
+ * session, or a SPDY/HTTP2 session that is not at its concurrent stream
+ * limit. Otherwise it connects a new one with an HTTPConnector. The idle
+ * sessions past maxIdleSessions are closed, least recently used first.
+ *
+ * A request for a host with no session of its own may share, over TLS, a
+ * SPDY/HTTP2 session to the same address made for another host, as long
+ * as the certificate the server presented on it covers the host, like
+ * browsers coalesce connections (RFC 7540 9.1.1). A server that can't
+ * serve the host on that connection answers 421, after which the caller
+ * should setMisdirected() so that the host gets its own session.
+ *
+ * While a session that multiplexes is being connected for a key, the
+ * callers that find no session for it wait for that one rather than each
+ * connect their own, so a burst of requests to a SPDY or HTTP/2 upstream
+ * opens one connection, not one per request. A key is known to multiplex
+ * when its plaintextProtocol isn't HTTP/1.x, or once a session for it
+ * negotiated SPDY or HTTP/2.
+ *
+ * With enablePrewarm(), the pool also connects sessions before they are
+ * asked for. It follows the demand for each key (see UpstreamDemand) and
+ * tops its sessions up to the target, the keys with the fastest rising
+ * demand first, within a budget of sessions for the whole pool.
+ *
+ * The pool installs itself as the InfoCallback of the sessions it holds,
+ * and keeps them until they close. Deleting the pool closes the idle ones
+ * and drains the others.
+ */
+class HTTPSessionPool : private HTTPSession::InfoCallback,
+                        private folly::AsyncTimeout {
+ public:
+  static const uint32_t kDefaultMaxIdleSessions = 64;
+
+  struct PrewarmOptions {
+    // how often the demand is sampled and sessions are connected
+    std::chrono::milliseconds interval{1000};
+    std::chrono::milliseconds connectTimeout{1000};
+    // the sessions of a key connected ahead of demand, at most
+    uint32_t maxPerKey{8};
+    // the sessions held and connecting in the pool above which no more
+    // are connected ahead of demand
+    uint32_t maxSessions{256};
+  };
+
+  /**
+   * Where a session goes to. Sessions are only shared by equal keys.
+   */
+  struct Key {
+    explicit Key(
+      const folly::SocketAddress& addr,
+      const std::shared_ptr<folly::SSLContext>& ctx = nullptr,
+      const std::string& proto = "",
+      const std::string& h = "")
+        : address(addr),
+          sslContext(ctx),
+          plaintextProtocol(proto),
+          host(h) {}
+
+    bool operator<(const Key& other) const;
+
+    folly::SocketAddress address;
+    // null for plaintext connections
+    std::shared_ptr<folly::SSLContext> sslContext;
+    // see HTTPConnector, only used for plaintext connections
+    std::string plaintextProtocol;
+    // the origin, sent as SNI; sessions for other hosts may be shared
+    // when it is set on a TLS key
+    std::string host;
+  };
+
+  class Callback {
+   public:
+    virtual ~Callback() {}
+    /**
+     * The session can take a new transaction, it should be started
+     * before returning to the event loop.
+     */
+    virtual void sessionAvailable(HTTPUpstreamSession* session) = 0;
+    virtual void sessionError(
+      const apache::thrift::transport::TTransportException& ex) = 0;
+  };
+
+  HTTPSessionPool(folly::EventBase* eventBase,
+                  AsyncTimeoutSet* timeoutSet,
+                  uint32_t maxIdleSessions = kDefaultMaxIdleSessions);
+  ~HTTPSessionPool();
+
+  /**
+   * @return a session for key that can take a new transaction, or nullptr
+   *         if there is none. The transaction should be started before
+   *         returning to the event loop.
+   */
+  HTTPUpstreamSession* getSession(const Key& key);
+
+  /**
+   * Invoke cb with a session for key, right away if there is one, else
+   * once a new connection is set up. cb must outlive the connection
+   * attempt, or be cancel()ed.
+   */
+  void getSession(const Key& key, Callback* cb,
+                  std::chrono::milliseconds connectTimeout =
+                    std::chrono::milliseconds(0));
+
+  /**
+   * Abandon the connection attempts made for cb. No callbacks will be
+   * invoked on it.
+   */
+  void cancel(Callback* cb);
+
+  /**
+   * The server answered a request for host on session with 421
+   * (Misdirected Request): don't share the session with host again.
+   */
+  void setMisdirected(const HTTPSession& session, const std::string& host);
+
+  /**
+   * Start connecting sessions ahead of the demand for them. Only the keys
+   * asked for with the Callback version of getSession() are followed.
+   */
+  void enablePrewarm(const PrewarmOptions& options);
+
+  /**
+   * Hand a session set up elsewhere over to the pool
+   */
+  void addSession(const Key& key, HTTPUpstreamSession* session);
+
+  uint32_t getNumSessions() const {
+    return sessions_.size();
+  }
+
+  uint32_t getNumIdleSessions() const {
+    return idle_.size();
+  }
+
+ private:
+  struct Entry {
+    Entry(const Key& k, HTTPUpstreamSession* s): key(k), session(s) {}
+
+    Key key;
+    HTTPUpstreamSession* session;
+    // the remote limit of concurrent streams is reached
+    bool full{false};
+    // the names in the certificate of the server, read on the first
+    // attempt to share the session
+    bool certNamesRead{false};
+    std::vector<std::string> certNames;
+    // the hosts the server refused on this session
+    std::set<std::string> misdirected;
+    folly::IntrusiveListHook idleHook;
+  };
+  typedef folly::IntrusiveList<Entry, &Entry::idleHook> IdleList;
+
+  class Connect : public HTTPConnector::Callback {
+   public:
+    // a caller served by the session being connected
+    struct Waiter {
+      Callback* cb;
+      std::chrono::milliseconds timeout;
+    };
+
+    // null cb for a session connected ahead of demand
+    Connect(HTTPSessionPool* pool, const Key& key, Callback* cb,
+            AsyncTimeoutSet* timeoutSet);
+
+    void start(folly::EventBase* eventBase,
+               std::chrono::milliseconds timeout);
+
+    void connectSuccess(HTTPUpstreamSession* session) override;
+    void connectError(
+      const apache::thrift::transport::TTransportException& ex) override;
+
+    HTTPSessionPool* pool_;
+    Key key_;
+    Callback* cb_;
+    std::vector<Waiter> waiters_;
+    HTTPConnector connector_;
+    TimePoint start_;
+    std::chrono::milliseconds timeout_{0};
+  };
+
+  HTTPUpstreamSession* findCoalesced(const Key& key);
+  bool canCoalesce(Entry* entry, const std::string& host);
+  Entry* add(const Key& key, HTTPUpstreamSession* session);
+  void remove(const HTTPSession& session);
+  Entry* find(const HTTPSession& session);
+  void close(Entry* entry);
+  void connectDone(Connect* connect);
+  void markIdle(Entry* entry);
+  void connect(const Key& key, Callback* cb,
+               std::chrono::milliseconds timeout);
+  bool mayMultiplex(const Key& key) const;
+  Connect* findConnect(const Key& key, std::chrono::milliseconds timeout);
+  void serveWaiters(const Key& key, HTTPUpstreamSession* session,
+                    const std::vector<Connect::Waiter>& waiters);
+  void prewarm();
+
+  // AsyncTimeout method
+  void timeoutExpired() noexcept override;
+
+  // HTTPSession::InfoCallback
+  void onCreate(const HTTPSession&) override {}
+  void onIngressError(const HTTPSession&, ProxygenError) override {}
+  void onRead(const HTTPSession&, size_t) override {}
+  void onWrite(const HTTPSession&, size_t) override {}
+  void onRequestBegin(const HTTPSession&) override {}
+  void onRequestEnd(const HTTPSession&, uint32_t) override {}
+  void onActivateConnection(const HTTPSession& session) override;
+  void onDeactivateConnection(const HTTPSession& session) override;
+  void onDestroy(const HTTPSession& session) override;
+  void onIngressMessage(const HTTPSession&, const HTTPMessage&) override {}
+  void onIngressLimitExceeded(const HTTPSession&) override {}
+  void onIngressPaused(const HTTPSession&) override {}
+  void onTransactionDetached(const HTTPSession&) override {}
+  void onPingReply(int64_t) override {}
+  void onSettingsOutgoingStreamsFull(const HTTPSession& session) override;
+  void onSettingsOutgoingStreamsNotFull(const HTTPSession& session) override;
+
+  folly::EventBase* eventBase_;
+  AsyncTimeoutSet* timeoutSet_;
+  const uint32_t maxIdleSessions_;
+  std::map<const HTTPSession*, std::unique_ptr<Entry>> sessions_;
+  std::multimap<Key, Entry*> byKey_;
+  // most recently used first
+  IdleList idle_;
+  std::list<std::unique_ptr<Connect>> connects_;
+  std::unique_ptr<PrewarmOptions> prewarm_;
+  std::map<Key, UpstreamDemand> demand_;
+  // the keys whose last session multiplexed
+  std::set<Key> multiplexed_;
+};
+
+}
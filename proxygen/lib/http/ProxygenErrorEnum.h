@@ -53,6 +53,7 @@ namespace proxygen {
     x(IngressStateTransition),                  \
     x(ClientSilent),                            \
     x(Canceled),                                \
+    x(SlowReader),                              \
     x(Max)
 
 // Increase this if you add more error types and Max exceeds 63
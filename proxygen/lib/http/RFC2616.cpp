@@ -9,12 +9,41 @@
  */
 #include <proxygen/lib/http/RFC2616.h>
 
-#include <folly/String.h>
-#include <folly/ThreadLocal.h>
+#include <algorithm>
+#include <cstring>
+#include <folly/Conv.h>
 #include <proxygen/lib/http/HTTPHeaders.h>
+#include <proxygen/lib/utils/UtilInl.h>
 
 namespace proxygen { namespace RFC2616 {
 
+namespace {
+
+bool parseNumber(folly::StringPiece s, size_t* value) {
+  if (s.empty() || s.size() > 18) {
+    return false;
+  }
+  *value = 0;
+  for (char c: s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    *value = *value * 10 + (c - '0');
+  }
+  return true;
+}
+
+void trimWhitespace(folly::StringPiece& s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.pop_front();
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.pop_back();
+  }
+}
+
+}
+
 BodyAllowed isRequestBodyAllowed(boost::optional<HTTPMethod> method) {
   if (method == HTTPMethod::TRACE) {
     return BodyAllowed::NOT_ALLOWED;
@@ -36,13 +65,24 @@ bool bodyImplied(const HTTPHeaders& headers) {
     headers.exists(HTTP_HEADER_CONTENT_LENGTH);
 }
 
-bool parseQvalues(folly::StringPiece value, std::vector<TokenQPair> &output) {
-  bool result = true;
-  static folly::ThreadLocal<std::vector<folly::StringPiece>> tokens;
-  tokens->clear();
-  folly::split(",", value, *tokens, true /*ignore empty*/);
-  for (auto& token: *tokens) {
-    auto pos = token.find(';');
+bool QvalueReader::next(TokenQPair& pair) {
+  while (!rest_.empty()) {
+    // memchr is vectorized, unlike a byte loop
+    folly::StringPiece token;
+    auto comma = (const char*)memchr(rest_.data(), ',', rest_.size());
+    if (comma) {
+      token.reset(rest_.data(), comma - rest_.data());
+      rest_.advance(token.size() + 1);
+    } else {
+      token = rest_;
+      rest_.clear();
+    }
+    if (token.empty()) {
+      continue;
+    }
+
+    auto semicolon = (const char*)memchr(token.data(), ';', token.size());
+    auto pos = semicolon ? semicolon - token.data() : std::string::npos;
     double qvalue = 1.0;
     if (pos != std::string::npos) {
       auto qpos = token.find("q=", pos);
@@ -53,13 +93,13 @@ bool parseQvalues(folly::StringPiece value, std::vector<TokenQPair> &output) {
           qvalue = folly::to<double>(&qvalueStr);
         } catch (const std::range_error&) {
           // q=<some garbage>
-          result = false;
+          wellFormed_ = false;
         }
         // we could validate that the remainder of qvalueStr was all whitespace,
         // for now we just discard it
       } else {
         // ; but no q=
-        result = false;
+        wellFormed_ = false;
       }
       token.reset(token.start(), pos);
     }
@@ -69,12 +109,144 @@ bool parseQvalues(folly::StringPiece value, std::vector<TokenQPair> &output) {
     }
     if (token.size() == 0) {
       // empty token
-      result = false;
+      wellFormed_ = false;
+    } else {
+      pair.first = token;
+      pair.second = qvalue;
+      return true;
+    }
+  }
+  return false;
+}
+
+double getAcceptEncodingQvalue(const HTTPHeaders& headers,
+                               folly::StringPiece coding) {
+  double qvalue = 0;
+  double wildcard = -1;
+  bool matched = false;
+  headers.forEachValueOfHeader(HTTP_HEADER_ACCEPT_ENCODING,
+                               [&] (const std::string& value) {
+      QvalueReader reader(value);
+      TokenQPair pair;
+      while (reader.next(pair)) {
+        folly::StringPiece token = pair.first;
+        while (token.size() > 0 && isspace(token.back())) {
+          token.pop_back();
+        }
+        if (caseInsensitiveEqual(token, coding)) {
+          matched = true;
+          qvalue = pair.second;
+        } else if (token == "*") {
+          wildcard = pair.second;
+        }
+      }
+      return false;
+    });
+  if (!matched && wildcard >= 0) {
+    return wildcard;
+  }
+  return qvalue;
+}
+
+RangeResult parseByteRanges(folly::StringPiece value, size_t size,
+                            size_t maxRanges, std::vector<ByteRange>& ranges) {
+  ranges.clear();
+  if (!value.startsWith("bytes=")) {
+    return RangeResult::NONE;
+  }
+  value.advance(6);
+  size_t count = 0;
+  while (!value.empty()) {
+    auto comma = value.find(',');
+    folly::StringPiece spec(value.begin(),
+                            comma == folly::StringPiece::npos ? value.end() :
+                              value.begin() + comma);
+    value.advance(comma == folly::StringPiece::npos ? value.size() :
+                    comma + 1);
+    trimWhitespace(spec);
+    if (spec.empty()) {
+      // the RFC lets lists have empty elements
+      continue;
+    }
+    if (++count > maxRanges) {
+      ranges.clear();
+      return RangeResult::NONE;
+    }
+    auto dash = spec.find('-');
+    if (dash == folly::StringPiece::npos) {
+      ranges.clear();
+      return RangeResult::NONE;
+    }
+    folly::StringPiece first(spec.begin(), spec.begin() + dash);
+    folly::StringPiece last(spec.begin() + dash + 1, spec.end());
+    size_t start;
+    size_t end;
+    if (first.empty()) {
+      // the last bytes
+      if (!parseNumber(last, &end)) {
+        ranges.clear();
+        return RangeResult::NONE;
+      }
+      if (end > 0 && size > 0) {
+        end = std::min(end, size);
+        ranges.push_back(ByteRange{size - end, end});
+      }
+      continue;
+    }
+    if (!parseNumber(first, &start)) {
+      ranges.clear();
+      return RangeResult::NONE;
+    }
+    if (last.empty()) {
+      end = size - 1;
+    } else if (!parseNumber(last, &end) || end < start) {
+      ranges.clear();
+      return RangeResult::NONE;
+    }
+    if (start < size) {
+      end = std::min(end, size - 1);
+      ranges.push_back(ByteRange{start, end - start + 1});
+    }
+  }
+  if (count == 0) {
+    return RangeResult::NONE;
+  }
+  if (ranges.empty()) {
+    return RangeResult::UNSATISFIABLE;
+  }
+
+  std::sort(ranges.begin(), ranges.end(),
+            [] (const ByteRange& a, const ByteRange& b) {
+              return a.offset < b.offset;
+            });
+  size_t merged = 0;
+  for (size_t i = 1; i < ranges.size(); i++) {
+    ByteRange& prev = ranges[merged];
+    const ByteRange& cur = ranges[i];
+    if (cur.offset <= prev.offset + prev.length) {
+      prev.length = std::max(prev.offset + prev.length,
+                             cur.offset + cur.length) - prev.offset;
     } else {
-      output.emplace_back(token, qvalue);
+      ranges[++merged] = cur;
     }
   }
-  return result && output.size() > 0;
+  ranges.resize(merged + 1);
+  return RangeResult::SATISFIABLE;
+}
+
+bool isIfRangeMatched(folly::StringPiece ifRange, folly::StringPiece etag,
+                      folly::StringPiece lastModified) {
+  if (ifRange.empty()) {
+    return true;
+  }
+  if (ifRange.front() == '"') {
+    return ifRange == etag;
+  }
+  if (ifRange.startsWith("W/")) {
+    // a weak etag never matches
+    return false;
+  }
+  return !lastModified.empty() && ifRange == lastModified;
 }
 
 }}
@@ -12,6 +12,7 @@
 #include <folly/Range.h>
 #include <proxygen/lib/http/HTTPMethod.h>
 #include <string>
+#include <vector>
 
 namespace proxygen {
 
@@ -67,6 +68,101 @@ bool bodyImplied(const HTTPHeaders& headers);
  */
 typedef std::pair<folly::StringPiece, double> TokenQPair;
 
-bool parseQvalues(folly::StringPiece value, std::vector<TokenQPair> &output);
+/**
+ * Reads the tokens and qvalues of such a string one at a time, without
+ * allocating; parseQvalues() is a loop around it. The tokens point into
+ * value, which must outlive the reader.
+ *
+ *   QvalueReader reader(value);
+ *   TokenQPair pair;
+ *   while (reader.next(pair)) {
+ *     ...
+ *   }
+ */
+class QvalueReader {
+ public:
+  explicit QvalueReader(folly::StringPiece value): rest_(value) {}
+
+  /**
+   * Sets pair to the next token and its qvalue. Returns false once there
+   * are none left.
+   */
+  bool next(TokenQPair& pair);
+
+  /**
+   * Whether what was read so far was well formed. Malformed entries are
+   * skipped or read best-effort, the way parseQvalues() always did.
+   */
+  bool wellFormed() const {
+    return wellFormed_;
+  }
+
+ private:
+  folly::StringPiece rest_;
+  bool wellFormed_{true};
+};
+
+/**
+ * Output can be any container of TokenQPairs with push_back(), e.g. a
+ * folly::small_vector to parse without allocating.
+ */
+template <class Container>
+bool parseQvalues(folly::StringPiece value, Container& output) {
+  QvalueReader reader(value);
+  TokenQPair pair;
+  while (reader.next(pair)) {
+    output.push_back(pair);
+  }
+  return reader.wellFormed() && output.size() > 0;
+}
+
+/**
+ * Get the qvalue that the Accept-Encoding of request headers gives to
+ * coding, from its own entry or else from "*". A qvalue of 0 means the
+ * coding must not be used. Without an Accept-Encoding this is 0 too: the
+ * RFC lets servers assume any coding is fine then, but not all clients
+ * agree.
+ */
+double getAcceptEncodingQvalue(const HTTPHeaders& headers,
+                               folly::StringPiece coding);
+
+/**
+ * A satisfiable byte range of a representation, resolved against its size
+ */
+struct ByteRange {
+  size_t offset;
+  size_t length;
+};
+
+enum class RangeResult {
+  // no usable Range: send the whole representation
+  NONE,
+  SATISFIABLE,
+  UNSATISFIABLE,
+};
+
+/**
+ * Parse the "bytes=" value of a Range header for a representation of size
+ * bytes, into the ranges to send. They are sorted, and the ones that
+ * overlap or touch are merged, so that they can be cut from a body as it
+ * streams; the parts of a multipart response then come in that order
+ * rather than in the order of the request.
+ *
+ * A malformed value, or one with more than maxRanges ranges, is NONE,
+ * which the RFC allows: a client can't make the server do much with it.
+ * The ranges that start past the end are skipped, UNSATISFIABLE if no
+ * range is left. ranges is only filled for SATISFIABLE.
+ */
+RangeResult parseByteRanges(folly::StringPiece value, size_t size,
+                            size_t maxRanges, std::vector<ByteRange>& ranges);
+
+/**
+ * Whether the Range of a request applies to the representation with etag
+ * and lastModified, either of which may be empty: if the request has no
+ * If-Range (ifRange is empty), or if it is the strong etag or the exact
+ * date.
+ */
+bool isIfRangeMatched(folly::StringPiece ifRange, folly::StringPiece etag,
+                      folly::StringPiece lastModified);
 
 }}
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/StreamWindowSizer.h>
+
+#include <algorithm>
+
+namespace proxygen {
+
+const uint32_t StreamWindowSizer::kGrowAfter;
+const uint32_t StreamWindowSizer::kShrinkAfter;
+
+StreamWindowSizer::StreamWindowSizer(uint32_t minCapacity,
+                                     uint32_t maxCapacity):
+    minCapacity_(minCapacity),
+    maxCapacity_(std::max(minCapacity, maxCapacity)) {
+}
+
+uint32_t StreamWindowSizer::onWindowUpdate(uint32_t capacity) {
+  uint32_t pauses = pauses_;
+  pauses_ = 0;
+  if (pauses > 0) {
+    keptUp_ = 0;
+    if (pauses < kShrinkAfter || capacity <= minCapacity_) {
+      return capacity;
+    }
+    return std::max(capacity / 2, minCapacity_);
+  }
+  if (++keptUp_ < kGrowAfter || capacity >= maxCapacity_) {
+    return capacity;
+  }
+  keptUp_ = 0;
+  return std::min<uint64_t>(uint64_t(capacity) * 2, maxCapacity_);
+}
+
+}
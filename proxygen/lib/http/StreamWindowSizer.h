@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace proxygen {
+
+/**
+ * Sizes the receive window of a stream by how fast its handler consumes
+ * the body. A handler that took the bytes of kGrowAfter window updates in
+ * a row without pausing the ingress could take more, and its window
+ * doubles; one that paused kShrinkAfter times between two updates only
+ * lets the body pile up in the session, and its window halves. The
+ * window stays between the floor and the ceiling.
+ */
+class StreamWindowSizer {
+ public:
+  static const uint32_t kGrowAfter = 2;
+  static const uint32_t kShrinkAfter = 2;
+
+  StreamWindowSizer(uint32_t minCapacity, uint32_t maxCapacity);
+
+  /**
+   * The handler paused the ingress of the stream
+   */
+  void onPause() {
+    pauses_++;
+  }
+
+  /**
+   * Learn from a window update of the stream
+   *
+   * @param capacity the capacity of the window
+   * @return the capacity the window should have
+   */
+  uint32_t onWindowUpdate(uint32_t capacity);
+
+  uint32_t getMinCapacity() const {
+    return minCapacity_;
+  }
+
+  uint32_t getMaxCapacity() const {
+    return maxCapacity_;
+  }
+
+ private:
+  uint32_t minCapacity_;
+  uint32_t maxCapacity_;
+  // since the last window update
+  uint32_t pauses_{0};
+  // window updates in a row without a pause
+  uint32_t keptUp_{0};
+};
+
+}
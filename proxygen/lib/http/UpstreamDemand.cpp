@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/UpstreamDemand.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace proxygen {
+
+namespace {
+
+// the weights of a new sample in the moving averages
+const double kFastWeight = 0.5;
+const double kSlowWeight = 0.05;
+const double kConcurrencyWeight = 0.3;
+const double kConnectWeight = 0.2;
+
+// the fast rate is rising above the slow one past this ratio, below it
+// the difference is noise
+const double kRisingRatio = 1.1;
+
+// below this, the upstream has no demand left
+const double kIdleRate = 0.01;
+
+double ewma(double average, double sample, double weight) {
+  return average + weight * (sample - average);
+}
+
+}
+
+const uint32_t UpstreamDemand::kMaxGrowth;
+
+void UpstreamDemand::onConnect(std::chrono::milliseconds latency) {
+  connectMs_ = connectMs_ == 0 ? latency.count() :
+    ewma(connectMs_, latency.count(), kConnectWeight);
+}
+
+void UpstreamDemand::tick(std::chrono::milliseconds elapsed,
+                          uint32_t concurrency) {
+  if (elapsed.count() <= 0) {
+    return;
+  }
+  double rate = requests_ * 1000.0 / elapsed.count();
+  requests_ = 0;
+  fastRate_ = ewma(fastRate_, rate, kFastWeight);
+  slowRate_ = ewma(slowRate_, rate, kSlowWeight);
+  concurrency_ = ewma(concurrency_, concurrency, kConcurrencyWeight);
+}
+
+double UpstreamDemand::getGrowth() const {
+  if (fastRate_ <= slowRate_ * kRisingRatio) {
+    return 1;
+  }
+  if (slowRate_ < kIdleRate) {
+    return kMaxGrowth;
+  }
+  return std::min<double>(fastRate_ / slowRate_, kMaxGrowth);
+}
+
+uint32_t UpstreamDemand::getTarget(uint32_t max) const {
+  if (isIdle()) {
+    return 0;
+  }
+  double target = (concurrency_ + fastRate_ * connectMs_ / 1000) *
+    getGrowth();
+  return std::min<double>(std::ceil(target), max);
+}
+
+bool UpstreamDemand::isIdle() const {
+  return requests_ == 0 && fastRate_ < kIdleRate && slowRate_ < kIdleRate &&
+    concurrency_ < kIdleRate;
+}
+
+}
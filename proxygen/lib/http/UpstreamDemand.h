@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace proxygen {
+
+/**
+ * The demand for sessions to one upstream, to set them up before the
+ * requests need them. The requests counted since the last tick() are
+ * folded into two moving averages of the request rate: a fast one that
+ * follows bursts and a slow one as the baseline. Sessions are wanted for
+ * the transactions the upstream had lately, and for the requests that
+ * arrive during one connect at the fast rate (Little's law). While the
+ * fast rate is well above the slow one, the demand is rising and that is
+ * scaled up by their ratio, up to kMaxGrowth.
+ */
+class UpstreamDemand {
+ public:
+  static const uint32_t kMaxGrowth = 4;
+
+  void onRequest() {
+    ++requests_;
+  }
+
+  /**
+   * A connection to the upstream was set up in latency
+   */
+  void onConnect(std::chrono::milliseconds latency);
+
+  /**
+   * @param elapsed     since the last tick
+   * @param concurrency the transactions open to the upstream
+   */
+  void tick(std::chrono::milliseconds elapsed, uint32_t concurrency);
+
+  /**
+   * @return the fast rate over the slow one, at least 1
+   */
+  double getGrowth() const;
+
+  /**
+   * @return the sessions the upstream should have, at most max
+   */
+  uint32_t getTarget(uint32_t max) const;
+
+  /**
+   * @return true once the requests and transactions have died down
+   */
+  bool isIdle() const;
+
+ private:
+  uint32_t requests_{0};
+  // requests per second
+  double fastRate_{0};
+  double slowRate_{0};
+  double concurrency_{0};
+  // 0 until the first connect
+  double connectMs_{0};
+};
+
+}
@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/WindowAutoTuner.h>
+
+#include <algorithm>
+
+using std::chrono::microseconds;
+
+namespace proxygen {
+
+const uint32_t WindowAutoTuner::kHeadroom;
+
+WindowAutoTuner::WindowAutoTuner(uint32_t maxCapacity):
+    maxCapacity_(maxCapacity) {
+}
+
+uint32_t WindowAutoTuner::onWindowUpdate(uint32_t capacity,
+                                         uint64_t bytes,
+                                         TimePoint now,
+                                         microseconds rtt) {
+  TimePoint lastUpdate = lastUpdate_;
+  lastUpdate_ = now;
+  if (!timePointInitialized(lastUpdate) || rtt.count() <= 0 ||
+      capacity >= maxCapacity_) {
+    return capacity;
+  }
+  auto elapsed = std::chrono::duration_cast<microseconds>(now - lastUpdate);
+  // bytes/elapsed is the delivery rate, the BDP is that much per RTT
+  uint64_t bdp = bytes * rtt.count() / std::max<int64_t>(elapsed.count(), 1);
+  uint64_t wanted = bdp * kHeadroom;
+  if (wanted <= capacity) {
+    return capacity;
+  }
+  return std::min<uint64_t>(wanted, maxCapacity_);
+}
+
+}
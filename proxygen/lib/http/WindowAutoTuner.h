@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Grows a receive window that limits the transfer, like the receive buffer
+ * auto-tuning of TCP. Between two window updates the peer sent the acked
+ * bytes, which gives the delivery rate, and the delivery rate times the RTT
+ * is the bandwidth-delay product. A window smaller than kHeadroom times the
+ * BDP keeps the peer waiting for updates, so it grows to that, up to the
+ * ceiling.
+ */
+class WindowAutoTuner {
+ public:
+  static const uint32_t kHeadroom = 2;
+
+  explicit WindowAutoTuner(uint32_t maxCapacity);
+
+  /**
+   * Learn from a window update that acked bytes
+   *
+   * @param capacity the capacity of the window
+   * @param rtt      the RTT of the connection, zero if unknown
+   * @return the capacity the window should have, capacity or more
+   */
+  uint32_t onWindowUpdate(uint32_t capacity, uint64_t bytes, TimePoint now,
+                          std::chrono::microseconds rtt);
+
+  uint32_t getMaxCapacity() const {
+    return maxCapacity_;
+  }
+
+ private:
+  uint32_t maxCapacity_;
+  TimePoint lastUpdate_;
+};
+
+}
@@ -20,6 +20,7 @@ static const std::string spdy_3 = "spdy/3";
 static const std::string spdy_3_1 = "spdy/3.1";
 static const std::string spdy_3_1_hpack = "spdy/3.1-hpack";
 static const std::string http_2 = "http/2";
+static const std::string hq = "hq";
 static const std::string empty = "";
 }
 
@@ -31,6 +32,7 @@ extern const std::string& getCodecProtocolString(CodecProtocol proto) {
     case CodecProtocol::SPDY_3_1: return spdy_3_1;
     case CodecProtocol::SPDY_3_1_HPACK: return spdy_3_1_hpack;
     case CodecProtocol::HTTP_2: return http_2;
+    case CodecProtocol::HQ: return hq;
   }
   LOG(FATAL) << "Unreachable";
   return empty;
@@ -42,7 +44,8 @@ extern bool isValidCodecProtocolStr(const std::string& protocolStr) {
          protocolStr == spdy_3 ||
          protocolStr == spdy_3_1 ||
          protocolStr == spdy_3_1_hpack ||
-         protocolStr == http_2;
+         protocolStr == http_2 ||
+         protocolStr == hq;
 }
 
 extern CodecProtocol getCodecProtocolFromStr(const std::string& protocolStr) {
@@ -58,6 +61,8 @@ extern CodecProtocol getCodecProtocolFromStr(const std::string& protocolStr) {
     return CodecProtocol::SPDY_3_1_HPACK;
   } else if (protocolStr == http_2) {
     return CodecProtocol::HTTP_2;
+  } else if (protocolStr == hq) {
+    return CodecProtocol::HQ;
   } else {
     // return default protocol
     return CodecProtocol::HTTP_1_1;
@@ -82,8 +87,11 @@ extern uint8_t maxProtocolPriority(CodecProtocol protocol) {
     case CodecProtocol::SPDY_3_1_HPACK:
       // SPDY 3 Max Priority
       return 7;
-    case CodecProtocol::HTTP_1_1:
     case CodecProtocol::HTTP_2:
+    case CodecProtocol::HQ:
+      // HTTP/2 weights are mapped onto the SPDY 3 priorities
+      return 7;
+    case CodecProtocol::HTTP_1_1:
       //HTTP doesn't support priorities
       return 0;
   }
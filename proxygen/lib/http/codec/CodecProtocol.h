@@ -21,6 +21,8 @@ enum class CodecProtocol : uint8_t {
   SPDY_3_1,
   SPDY_3_1_HPACK,
   HTTP_2,
+  // experimental HTTP over QUIC, see HQCodec
+  HQ,
 };
 
 /**
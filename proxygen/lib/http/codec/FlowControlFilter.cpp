@@ -9,7 +9,7 @@
  */
 #include <proxygen/lib/http/codec/FlowControlFilter.h>
 
-#include <proxygen/lib/http/codec/SPDYConstants.h>
+#include <algorithm>
 
 namespace proxygen {
 
@@ -27,14 +27,15 @@ FlowControlFilter::FlowControlFilter(Callback& callback,
                                      HTTPCodec* codec,
                                      uint32_t recvCapacity):
     notify_(callback),
-    recvWindow_(spdy::kInitialWindow),
-    sendWindow_(spdy::kInitialWindow),
+    recvWindow_(codec->getDefaultWindowSize()),
+    sendWindow_(codec->getDefaultWindowSize()),
     error_(false),
     sendsBlocked_(false) {
-  if (recvCapacity < spdy::kInitialWindow) {
+  const uint32_t initialWindow = codec->getDefaultWindowSize();
+  if (recvCapacity < initialWindow) {
     VLOG(4) << "Ignoring low conn-level recv window size of " << recvCapacity;
-  } else if (recvCapacity > spdy::kInitialWindow) {
-    auto delta = recvCapacity - spdy::kInitialWindow;
+  } else if (recvCapacity > initialWindow) {
+    auto delta = recvCapacity - initialWindow;
     VLOG(4) << "Incrementing default conn-level recv window by " << delta;
     CHECK(recvWindow_.setCapacity(recvCapacity));
     codec->generateWindowUpdate(writeBuf, 0, delta);
@@ -43,7 +44,7 @@ FlowControlFilter::FlowControlFilter(Callback& callback,
 
 void FlowControlFilter::setReceiveWindowSize(folly::IOBufQueue& writeBuf,
                                              uint32_t capacity) {
-  if (capacity < spdy::kInitialWindow) {
+  if (capacity < call_->getDefaultWindowSize()) {
     VLOG(4) << "Ignoring low conn-level recv window size of " << capacity;
     return;
   }
@@ -69,7 +70,11 @@ void FlowControlFilter::setReceiveWindowSize(folly::IOBufQueue& writeBuf,
 bool FlowControlFilter::ingressBytesProcessed(folly::IOBufQueue& writeBuf,
                                               uint32_t delta) {
   toAck_ += delta;
-  if (toAck_ > 0 && uint32_t(toAck_) > recvWindow_.getCapacity() / 2) {
+  uint32_t threshold = recvWindow_.getCapacity() / 2 + 1;
+  if (windowUpdateThreshold_ > 0) {
+    threshold = std::min(windowUpdateThreshold_, recvWindow_.getCapacity());
+  }
+  if (toAck_ > 0 && uint32_t(toAck_) >= threshold) {
     CHECK(recvWindow_.free(toAck_));
     call_->generateWindowUpdate(writeBuf, 0, toAck_);
     toAck_ = 0;
@@ -82,6 +87,10 @@ uint32_t FlowControlFilter::getAvailableSend() const {
   return sendWindow_.getNonNegativeSize();
 }
 
+uint32_t FlowControlFilter::getReceiveWindowCapacity() const {
+  return recvWindow_.getCapacity();
+}
+
 bool FlowControlFilter::isReusable() const {
   if (error_) {
     return false;
@@ -100,6 +109,16 @@ void FlowControlFilter::onBody(StreamID stream,
   }
 }
 
+void FlowControlFilter::onPadding(StreamID stream, uint16_t bytes) {
+  if (!recvWindow_.reserve(bytes)) {
+    error_ = true;
+    HTTPException ex = getException();
+    callback_->onError(0, ex, false);
+  } else {
+    callback_->onPadding(stream, bytes);
+  }
+}
+
 void FlowControlFilter::onWindowUpdate(StreamID stream, uint32_t amount) {
   if (!stream) {
     bool success = sendWindow_.free(amount);
@@ -72,17 +72,33 @@ class FlowControlFilter:
    */
   bool ingressBytesProcessed(folly::IOBufQueue& writeBuf, uint32_t delta);
 
+  /**
+   * Write the WINDOW_UPDATE once threshold bytes are waiting to be acked,
+   * instead of more than half of the receive window's capacity. The
+   * threshold is capped at the capacity. 0 restores the default.
+   */
+  void setWindowUpdateThreshold(uint32_t threshold) {
+    windowUpdateThreshold_ = threshold;
+  }
+
   /**
    * @returns the number of bytes available in the connection-level send window
    */
   uint32_t getAvailableSend() const;
 
+  /**
+   * @returns the capacity of the connection-level receive window
+   */
+  uint32_t getReceiveWindowCapacity() const;
+
   // Filter functions
 
   bool isReusable() const override;
 
   void onBody(StreamID stream, std::unique_ptr<folly::IOBuf> chain) override;
 
+  void onPadding(StreamID stream, uint16_t bytes) override;
+
   void onWindowUpdate(StreamID stream, uint32_t amount) override;
 
   size_t generateBody(folly::IOBufQueue& writeBuf,
@@ -100,6 +116,7 @@ class FlowControlFilter:
   Window recvWindow_;
   Window sendWindow_;
   int32_t toAck_{0};
+  uint32_t windowUpdateThreshold_{0};
   bool error_:1;
   bool sendsBlocked_:1;
 };
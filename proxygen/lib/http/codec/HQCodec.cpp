@@ -0,0 +1,388 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/HQCodec.h>
+
+#include <algorithm>
+#include <folly/Memory.h>
+#include <folly/io/Cursor.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/HTTPHeaderSize.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::io::Cursor;
+using proxygen::compress::Header;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+const uint64_t kMaxVarint = (uint64_t(1) << 62) - 1;
+
+/**
+ * Read a QUIC variable length integer out of the avail bytes after cursor
+ *
+ * @return false if it is not all there yet
+ */
+bool readVarint(Cursor& cursor, size_t& avail, uint64_t& value) {
+  if (avail < 1) {
+    return false;
+  }
+  uint8_t first = cursor.read<uint8_t>();
+  size_t length = size_t(1) << (first >> 6);
+  if (avail < length) {
+    return false;
+  }
+  value = first & 0x3f;
+  for (size_t i = 1; i < length; i++) {
+    value = (value << 8) | cursor.read<uint8_t>();
+  }
+  avail -= length;
+  return true;
+}
+
+}
+
+const uint64_t HQCodec::kFrameData;
+const uint64_t HQCodec::kFrameHeaders;
+
+HQCodec::HQCodec(TransportDirection direction)
+  : HTTP2Codec(direction, 0) {
+  VLOG(4) << "creating HQ codec";
+}
+
+HQCodec::~HQCodec() {
+}
+
+HTTPCodec::StreamID HQCodec::createStream() {
+  LOG(DFATAL) << "HQ streams are opened by the transport";
+  return NoStream;
+}
+
+size_t HQCodec::onIngress(const IOBuf& buf) {
+  LOG(DFATAL) << "HQ ingress goes to onStreamIngress()";
+  return 0;
+}
+
+void HQCodec::setMaxIngressHeaderSize(uint32_t maxBlock,
+                                      uint32_t maxHeader) {
+  HTTP2Codec::setMaxIngressHeaderSize(maxBlock, maxHeader);
+  maxHeaderFrame_ = maxBlock;
+}
+
+size_t HQCodec::getMemoryUsage() const {
+  size_t bytes = HTTP2Codec::getMemoryUsage();
+  for (const auto& stream: streams_) {
+    bytes += sizeof(stream) + chainCapacity(stream.second.buf);
+  }
+  return bytes;
+}
+
+size_t HQCodec::writeVarint(IOBufQueue& writeBuf, uint64_t value) {
+  DCHECK_LE(value, kMaxVarint);
+  size_t length;
+  uint8_t prefix;
+  if (value < (1 << 6)) {
+    length = 1;
+    prefix = 0x00;
+  } else if (value < (1 << 14)) {
+    length = 2;
+    prefix = 0x40;
+  } else if (value < (1 << 30)) {
+    length = 4;
+    prefix = 0x80;
+  } else {
+    length = 8;
+    prefix = 0xc0;
+  }
+  uint8_t bytes[8];
+  for (size_t i = length; i > 0; i--) {
+    bytes[i - 1] = uint8_t(value);
+    value >>= 8;
+  }
+  bytes[0] |= prefix;
+  writeBuf.append(bytes, length);
+  return length;
+}
+
+size_t HQCodec::writeFrame(IOBufQueue& writeBuf, uint64_t type,
+                           unique_ptr<IOBuf> payload) {
+  uint64_t length = payload ? payload->computeChainDataLength() : 0;
+  size_t written = writeVarint(writeBuf, type);
+  written += writeVarint(writeBuf, length);
+  if (payload) {
+    writeBuf.append(std::move(payload));
+  }
+  return written + length;
+}
+
+void HQCodec::onStreamIngress(StreamID stream, const IOBuf& buf) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end()) {
+    if (transportDirection_ == TransportDirection::DOWNSTREAM) {
+      lastIncomingStream_ = std::max(lastIncomingStream_, stream);
+    }
+    it = streams_.emplace(stream, StreamState()).first;
+  }
+  StreamState& state = it->second;
+  if (state.failed) {
+    VLOG(5) << "Dropping " << buf.computeChainDataLength()
+            << " bytes of failed stream=" << stream;
+    return;
+  }
+  state.buf.append(buf.clone());
+  parsingStream_ = stream;
+  parseStream(stream, state);
+  finishStream(stream, false);
+}
+
+void HQCodec::parseStream(StreamID stream, StreamState& state) {
+  while (!state.failed) {
+    if (!state.inFrame) {
+      size_t avail = state.buf.chainLength();
+      Cursor cursor(state.buf.front());
+      uint64_t type;
+      uint64_t length;
+      if (!readVarint(cursor, avail, type) ||
+          !readVarint(cursor, avail, length)) {
+        return;
+      }
+      state.buf.trimStart(state.buf.chainLength() - avail);
+      state.frameType = type;
+      state.frameRemaining = length;
+      state.inFrame = true;
+      if (type == kFrameHeaders && maxHeaderFrame_ > 0 &&
+          length > maxHeaderFrame_) {
+        LOG(ERROR) << "HEADERS frame of " << length << " bytes for stream="
+                   << stream << " exceeds the limit of " << maxHeaderFrame_;
+        failHQStream(stream, state, uint32_t(ErrorCode::ENHANCE_YOUR_CALM),
+                     "HEADERS frame too large");
+        return;
+      }
+      if (type == kFrameData &&
+          (!state.headersDone || state.trailersDone)) {
+        failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                     "Unexpected DATA");
+        return;
+      }
+    }
+
+    const size_t avail = state.buf.chainLength();
+    if (state.frameType == kFrameHeaders) {
+      if (avail < state.frameRemaining) {
+        return;
+      }
+      unique_ptr<IOBuf> block = state.frameRemaining > 0 ?
+        state.buf.split(state.frameRemaining) : IOBuf::create(0);
+      state.inFrame = false;
+      onHeadersFrame(stream, state, std::move(block));
+      continue;
+    }
+
+    const size_t length = std::min<uint64_t>(state.frameRemaining, avail);
+    if (length == 0 && state.frameRemaining > 0) {
+      return;
+    }
+    state.frameRemaining -= length;
+    state.inFrame = state.frameRemaining > 0;
+    if (state.frameType == kFrameData) {
+      if (length > 0) {
+        callback_->onBody(stream, state.buf.split(length));
+      }
+    } else {
+      VLOG(5) << "Skipping " << length << " bytes of frame type="
+              << state.frameType << " on stream=" << stream;
+      state.buf.trimStart(length);
+    }
+  }
+}
+
+void HQCodec::onHeadersFrame(StreamID stream, StreamState& state,
+                             unique_ptr<IOBuf> block) {
+  if (state.trailersDone) {
+    failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 "HEADERS after trailers");
+    return;
+  }
+  const bool isRequest =
+    transportDirection_ == TransportDirection::DOWNSTREAM;
+  MessageBuilder builder(isRequest ? MessageBuilder::Type::REQUEST :
+                         MessageBuilder::Type::RESPONSE, nullptr);
+  const uint32_t blockLength = block->computeChainDataLength();
+  Cursor blockCursor(block.get());
+  auto result = headerCodec_.decodeStreaming(blockCursor, blockLength,
+                                             builder);
+  if (result.isError() || result.ok() != blockLength) {
+    // no dynamic table to get out of sync, only this stream is lost
+    LOG(ERROR) << "Failed decoding header block for stream=" << stream;
+    failHQStream(stream, state, uint32_t(ErrorCode::COMPRESSION_ERROR),
+                 "Bad header block");
+    return;
+  }
+
+  if (state.headersDone && builder.isTrailers()) {
+    unique_ptr<HTTPMessage> msg = builder.release();
+    if (builder.getFailReason()) {
+      failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                   builder.getFailReason());
+      return;
+    }
+    // the end of the stream completes the message
+    state.trailersDone = true;
+    callback_->onTrailersComplete(
+      stream, folly::make_unique<HTTPHeaders>(std::move(msg->getHeaders())));
+    return;
+  }
+  if (state.headersDone && isRequest) {
+    LOG(ERROR) << "Second request header block on stream=" << stream;
+    failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 "Unexpected HEADERS");
+    return;
+  }
+
+  if (!builder.finish()) {
+    unique_ptr<HTTPMessage> partialMsg = builder.release();
+    if (builder.getFailCode() >= 100) {
+      // Let the session answer the bad request
+      callback_->onMessageBegin(stream, nullptr);
+    }
+    failHQStream(stream, state, builder.getFailCode(),
+                 builder.getFailReason(), std::move(partialMsg));
+    return;
+  }
+
+  // the final response may follow a 1xx one, as in HTTP/2
+  state.headersDone = true;
+  unique_ptr<HTTPMessage> msg = builder.release();
+  msg->setIngressHeaderSize(headerCodec_.getDecodedSize());
+  callback_->onMessageBegin(stream, msg.get());
+  callback_->onHeadersComplete(stream, std::move(msg));
+}
+
+void HQCodec::onStreamIngressEOF(StreamID stream) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end()) {
+    // the peer ended a stream it sent nothing on
+    it = streams_.emplace(stream, StreamState()).first;
+  }
+  StreamState& state = it->second;
+  parsingStream_ = stream;
+  if (state.failed) {
+    // already reported
+  } else if (state.inFrame || !state.buf.empty()) {
+    failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 "Stream ended in a frame");
+  } else if (!state.headersDone) {
+    failHQStream(stream, state, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 "Stream ended before HEADERS");
+  } else {
+    callback_->onMessageComplete(stream, false);
+  }
+  finishStream(stream, true);
+}
+
+void HQCodec::onStreamAbort(StreamID stream) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end()) {
+    return;
+  }
+  if (stream == parsingStream_) {
+    it->second.failed = true;
+    it->second.aborted = true;
+    return;
+  }
+  streams_.erase(it);
+}
+
+void HQCodec::finishStream(StreamID stream, bool erase) {
+  parsingStream_ = NoStream;
+  auto it = streams_.find(stream);
+  if (it != streams_.end() && (erase || it->second.aborted)) {
+    streams_.erase(it);
+  }
+}
+
+void HQCodec::generateHeader(IOBufQueue& writeBuf,
+                             StreamID stream,
+                             const HTTPMessage& msg,
+                             StreamID assocStream,
+                             HTTPHeaderSize* size) {
+  if (assocStream != NoStream) {
+    LOG(DFATAL) << "HQ has no push, stream=" << stream;
+    return;
+  }
+  unique_ptr<IOBuf> block =
+    transportDirection_ == TransportDirection::UPSTREAM ?
+    encodeRequestHeaders(msg, false, size) :
+    encodeResponseHeaders(msg, false, size);
+  writeFrame(writeBuf, kFrameHeaders, std::move(block));
+}
+
+size_t HQCodec::generateBody(IOBufQueue& writeBuf,
+                             StreamID stream,
+                             unique_ptr<IOBuf> chain,
+                             bool eom) {
+  // the session ends the stream after the body for eom
+  if (!chain || chain->computeChainDataLength() == 0) {
+    return 0;
+  }
+  return writeFrame(writeBuf, kFrameData, std::move(chain));
+}
+
+size_t HQCodec::generateTrailers(IOBufQueue& writeBuf,
+                                 StreamID stream,
+                                 const HTTPHeaders& trailers) {
+  // the blocks don't depend on each other, so unlike HTTP/2 the trailers
+  // can be encoded and sent right away
+  vector<Header> allHeaders;
+  allHeaders.reserve(trailers.size());
+  trailers.forEachWithCode([&] (HTTPHeaderCode code,
+                                const string& name,
+                                const string& value) {
+    if (perHopHeaderCodes_[code] || name.empty() || name[0] == ':') {
+      VLOG(3) << "Dropping invalid trailer " << name;
+      return;
+    }
+    allHeaders.emplace_back(code, name, value);
+  });
+  return writeFrame(writeBuf, kFrameHeaders,
+                    headerCodec_.encode(allHeaders));
+}
+
+void HQCodec::failHQStream(StreamID stream, StreamState& state,
+                           uint32_t code, const char* reason,
+                           unique_ptr<HTTPMessage> partialMsg) {
+  state.failed = true;
+  state.inFrame = false;
+  state.buf.move();
+  HTTPException err(
+    code >= 100 ?
+    HTTPException::Direction::INGRESS :
+    HTTPException::Direction::INGRESS_AND_EGRESS,
+    kErrorParseHeader,
+    (reason && *reason) ? reason : "HQCodec stream error");
+  err.setStreamID(stream);
+  if (code >= 100) {
+    err.setHttpStatusCode(code);
+  } else {
+    err.setCodecStatusCode(ErrorCode(code));
+  }
+  if (partialMsg) {
+    err.setPartialMsg(std::move(partialMsg));
+  }
+  callback_->onError(stream, err, !state.headersDone && code < 100);
+}
+
+}
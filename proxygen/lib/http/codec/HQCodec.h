@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBufQueue.h>
+#include <map>
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+
+namespace proxygen {
+
+/**
+ * An experimental codec for HTTP over QUIC. Each request and its response
+ * go on a QUIC stream of their own, so the transport frames the streams,
+ * orders their bytes, controls their flow and resets them. What is left
+ * are the frames inside a stream, each a variable length integer type and
+ * length, as QUIC encodes them, followed by the payload:
+ *
+ *  - DATA (0x0), body bytes
+ *  - HEADERS (0x1), an HPACK block with the HTTP/2 pseudo-headers, the
+ *    message headers or the trailers
+ *
+ * Other frame types are skipped. The end of the stream ends the message.
+ *
+ * The streams are independent so that a lost packet stalls only the
+ * stream it was for, which HPACK's dynamic table would undo: a block
+ * could refer to entries that a block still in flight on another stream
+ * adds. Both tables are empty, the static table and Huffman coding remain.
+ *
+ * The stream IDs are the ones of the transport, which feeds the bytes of
+ * each stream to onStreamIngress() rather than onIngress(). The egress of
+ * a stream is written with the generate methods and goes on that stream,
+ * and the session ends it, or resets it, on the transport.
+ */
+class HQCodec: public HTTP2Codec {
+ public:
+  explicit HQCodec(TransportDirection direction);
+  ~HQCodec() override;
+
+  // HTTPCodec API
+  CodecProtocol getProtocol() const override {
+    return CodecProtocol::HQ;
+  }
+  // QUIC controls the flow of the streams and the connection
+  bool supportsStreamFlowControl() const override { return false; }
+  bool supportsSessionFlowControl() const override { return false; }
+  StreamID createStream() override;
+  size_t onIngress(const folly::IOBuf& buf) override;
+  bool isReusable() const override { return true; }
+  bool isWaitingToDrain() const override { return false; }
+  bool supportsPushTransactions() const override { return false; }
+  size_t generateConnectionPreface(folly::IOBufQueue& writeBuf) override {
+    return 0;
+  }
+  void generateHeader(folly::IOBufQueue& writeBuf,
+                      StreamID stream,
+                      const HTTPMessage& msg,
+                      StreamID assocStream = NoStream,
+                      HTTPHeaderSize* size = nullptr) override;
+  size_t generateBody(folly::IOBufQueue& writeBuf,
+                      StreamID stream,
+                      std::unique_ptr<folly::IOBuf> chain,
+                      bool eom) override;
+  size_t generateTrailers(folly::IOBufQueue& writeBuf,
+                          StreamID stream,
+                          const HTTPHeaders& trailers) override;
+  size_t generateEOM(folly::IOBufQueue& writeBuf,
+                     StreamID stream) override {
+    // the end of the stream
+    return 0;
+  }
+  size_t generateRstStream(folly::IOBufQueue& writeBuf,
+                           StreamID stream,
+                           ErrorCode statusCode) override {
+    // the session resets the stream
+    return 0;
+  }
+  size_t generateGoaway(folly::IOBufQueue& writeBuf,
+                        StreamID lastStream,
+                        ErrorCode statusCode) override {
+    return 0;
+  }
+  size_t generatePingRequest(folly::IOBufQueue& writeBuf) override {
+    return 0;
+  }
+  size_t generatePingReply(folly::IOBufQueue& writeBuf,
+                           uint64_t uniqueID) override {
+    return 0;
+  }
+  size_t generateSettings(folly::IOBufQueue& writeBuf) override {
+    return 0;
+  }
+  size_t generateSettingsAck(folly::IOBufQueue& writeBuf) override {
+    return 0;
+  }
+  size_t generateWindowUpdate(folly::IOBufQueue& writeBuf,
+                              StreamID stream,
+                              uint32_t delta) override {
+    return 0;
+  }
+  void setMaxIngressHeaderSize(uint32_t maxBlock,
+                               uint32_t maxHeader) override;
+  size_t getMemoryUsage() const override;
+  // the header tables stay empty
+  void setHeaderTableSize(uint32_t size) override {}
+  uint32_t getHeaderTableSize() const override { return 0; }
+  StreamID getLastIncomingStreamID() const override {
+    return lastIncomingStream_;
+  }
+
+  /**
+   * Parse the bytes that came in on a stream, in order. Body bytes are
+   * passed on as they come, a HEADERS frame once it is complete.
+   */
+  void onStreamIngress(StreamID stream, const folly::IOBuf& buf);
+
+  /**
+   * The peer ended the stream: completes the message, or fails the stream
+   * if it ended in the middle of a frame or before the headers
+   */
+  void onStreamIngressEOF(StreamID stream);
+
+  /**
+   * Forget the ingress of a stream that was reset, by either side
+   */
+  void onStreamAbort(StreamID stream);
+
+  static const uint64_t kFrameData = 0x0;
+  static const uint64_t kFrameHeaders = 0x1;
+
+  /**
+   * Append a QUIC variable length integer, of at most 62 bits
+   *
+   * @return the bytes written
+   */
+  static size_t writeVarint(folly::IOBufQueue& writeBuf, uint64_t value);
+
+ private:
+  struct StreamState {
+    folly::IOBufQueue buf{folly::IOBufQueue::cacheChainLength()};
+    // the frame being parsed, if inFrame
+    uint64_t frameType{0};
+    uint64_t frameRemaining{0};
+    bool inFrame{false};
+    // the headers of the message, or of a 1xx response, went up
+    bool headersDone{false};
+    // the trailers went up, nothing may follow
+    bool trailersDone{false};
+    // the stream was failed, the rest of its ingress is dropped
+    bool failed{false};
+    // onStreamAbort() came while the stream was parsed
+    bool aborted{false};
+  };
+
+  /**
+   * Parse what can be parsed from the buffered ingress of stream
+   */
+  void parseStream(StreamID stream, StreamState& state);
+
+  /**
+   * Decode a complete HEADERS frame and hand the message, trailers or
+   * error to the callback.
+   */
+  void onHeadersFrame(StreamID stream, StreamState& state,
+                      std::unique_ptr<folly::IOBuf> block);
+
+  /**
+   * Done with the ingress of the stream being parsed, unless it was
+   * aborted meanwhile
+   */
+  void finishStream(StreamID stream, bool erase);
+
+  /**
+   * @param code an HTTP status code for bad requests, an ErrorCode
+   *             otherwise
+   * @param reason a string literal, see HTTPException
+   */
+  void failHQStream(StreamID stream, StreamState& state, uint32_t code,
+                    const char* reason,
+                    std::unique_ptr<HTTPMessage> partialMsg = nullptr);
+
+  size_t writeFrame(folly::IOBufQueue& writeBuf, uint64_t type,
+                    std::unique_ptr<folly::IOBuf> payload);
+
+  std::map<StreamID, StreamState> streams_;
+  // the stream whose ingress the callbacks are called for, which
+  // onStreamAbort() must not erase
+  StreamID parsingStream_{NoStream};
+  // see setMaxIngressHeaderSize(), 0 for no limit before decoding
+  uint32_t maxHeaderFrame_{0};
+  StreamID lastIncomingStream_{0};
+};
+
+}
@@ -10,8 +10,13 @@
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
 
 #include <folly/Memory.h>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+#include <proxygen/lib/utils/UtilInl.h>
 
 using folly::IOBuf;
 using folly::IOBufQueue;
@@ -22,6 +27,29 @@ namespace {
 
 const char CRLF[] = "\r\n";
 
+// the buffer a header block is serialized into, when the one at the end of
+// the write queue doesn't have room for the whole block
+const uint32_t kHeaderBlockSize = 2048;
+
+// the buffer chunk framing goes into, when the body it surrounds can't take
+// it; the framing of the next chunks follows in the same buffer
+const uint32_t kChunkFramingBlockSize = 512;
+
+// the length of "HTTP/1.1 200 ", where the reason of a status line starts
+const size_t kStatusLineReasonOffset = 13;
+
+proxygen::HTTPCachedHeaders::Serialized
+serializeCachedHeaders(const proxygen::HTTPHeaders& headers) {
+  std::string lines;
+  headers.forEach([&] (const string& name, const string& value) {
+    lines.append(name).append(": ").append(value).append(CRLF);
+  });
+  proxygen::HTTPCachedHeaders::Serialized serialized;
+  serialized.data = IOBuf::copyBuffer(lines);
+  serialized.numEntries = headers.size();
+  return serialized;
+}
+
 /**
  * Write an ASCII decimal representation of an integer value
  * @note This function does -not- append a trailing null byte.
@@ -51,21 +79,110 @@ unsigned u64toa(uint64_t value, void* dst) {
   return length;
 }
 
-void
-appendUint(IOBufQueue& queue, size_t& len, uint64_t value) {
-  char buf[32];
-  size_t encodedLen = u64toa(value, buf);
-  queue.append(buf, encodedLen);
-  len += encodedLen;
+/**
+ * @return the number of digits u64toa() writes for value
+ */
+size_t u64Length(uint64_t value) {
+  size_t length = 1;
+  while (value >= 10) {
+    value /= 10;
+    ++length;
+  }
+  return length;
+}
+
+/**
+ * @return the number of lowercase hex digits writeHex() writes for value
+ */
+size_t hexLength(uint64_t value) {
+  size_t length = 1;
+  while (value >= 16) {
+    value >>= 4;
+    ++length;
+  }
+  return length;
+}
+
+char* writeHex(char* dst, uint64_t value) {
+  static const char kDigits[] = "0123456789abcdef";
+  size_t length = hexLength(value);
+  for (size_t i = length; i > 0; --i) {
+    dst[i - 1] = kDigits[value & 0xf];
+    value >>= 4;
+  }
+  return dst + length;
+}
+
+template <size_t N>
+constexpr size_t literalLength(const char (&)[N]) {
+  return N - 1;
+}
+
+template <size_t N>
+char* writeLiteral(char* dst, const char (&str)[N]) {
+  memcpy(dst, str, N - 1);
+  return dst + N - 1;
+}
+
+char* writeString(char* dst, folly::StringPiece str) {
+  if (!str.empty()) {
+    memcpy(dst, str.data(), str.size());
+  }
+  return dst + str.size();
+}
+
+char* writeUint(char* dst, uint64_t value) {
+  return dst + u64toa(value, dst);
+}
+
+/**
+ * @return the HTTP/1.1 status line, CRLF included, of the common codes
+ *         with their default reason, or an empty piece for the others
+ */
+folly::StringPiece getCommonStatusLine(uint16_t status) {
+#define STATUS_LINE(code, reason)                                   \
+  case code: {                                                      \
+    static const char kLine[] = "HTTP/1.1 " #code " " reason "\r\n"; \
+    return folly::StringPiece(kLine, sizeof(kLine) - 1);            \
+  }
+  switch (status) {
+    STATUS_LINE(100, "Continue")
+    STATUS_LINE(101, "Switching Protocols")
+    STATUS_LINE(200, "OK")
+    STATUS_LINE(201, "Created")
+    STATUS_LINE(202, "Accepted")
+    STATUS_LINE(204, "No Content")
+    STATUS_LINE(206, "Partial Content")
+    STATUS_LINE(301, "Moved Permanently")
+    STATUS_LINE(302, "Found")
+    STATUS_LINE(303, "See Other")
+    STATUS_LINE(304, "Not Modified")
+    STATUS_LINE(307, "Temporary Redirect")
+    STATUS_LINE(400, "Bad Request")
+    STATUS_LINE(401, "Unauthorized")
+    STATUS_LINE(403, "Forbidden")
+    STATUS_LINE(404, "Not Found")
+    STATUS_LINE(405, "Method Not Allowed")
+    STATUS_LINE(408, "Request Timeout")
+    STATUS_LINE(413, "Request Entity Too Large")
+    STATUS_LINE(429, "Too Many Requests")
+    STATUS_LINE(500, "Internal Server Error")
+    STATUS_LINE(502, "Bad Gateway")
+    STATUS_LINE(503, "Service Unavailable")
+    STATUS_LINE(504, "Gateway Timeout")
+    default:
+      return folly::StringPiece();
+  }
+#undef STATUS_LINE
 }
 
 #define appendLiteral(queue, len, str) (len) += (sizeof(str) - 1); \
   (queue).append(str, sizeof(str) - 1)
 
 void
-appendString(IOBufQueue& queue, size_t& len, const string& str) {
-  queue.append(str.data(), str.length());
-  len += str.length();
+appendString(IOBufQueue& queue, size_t& len, folly::StringPiece str) {
+  queue.append(str.data(), str.size());
+  len += str.size();
 }
 
 const std::pair<uint8_t, uint8_t> kHTTPVersion10(1, 0);
@@ -74,6 +191,106 @@ const std::pair<uint8_t, uint8_t> kHTTPVersion10(1, 0);
 
 namespace proxygen {
 
+namespace {
+
+/**
+ * Maps the method http_parser already identified to ours, without going
+ * through its name. Returns false for the methods HTTPMethod lacks.
+ */
+bool parserMethodToHTTPMethod(http_method in, HTTPMethod& out) {
+  switch (in) {
+    case HTTP_GET: out = HTTPMethod::GET; return true;
+    case HTTP_POST: out = HTTPMethod::POST; return true;
+    case HTTP_OPTIONS: out = HTTPMethod::OPTIONS; return true;
+    case HTTP_DELETE: out = HTTPMethod::DELETE; return true;
+    case HTTP_HEAD: out = HTTPMethod::HEAD; return true;
+    case HTTP_CONNECT: out = HTTPMethod::CONNECT; return true;
+    case HTTP_PUT: out = HTTPMethod::PUT; return true;
+    case HTTP_TRACE: out = HTTPMethod::TRACE; return true;
+    default: return false;
+  }
+}
+
+/**
+ * Whether the line of a header of the message is copied as is into the
+ * head: the Content-Length and Connection ones are regenerated, and only
+ * the first "Transfer-Encoding: chunked" is kept, if the peer can take it.
+ */
+bool isPassedThrough(HTTPHeaderCode code, folly::StringPiece value,
+                     bool mayChunk, bool& seenChunked) {
+  if (code == HTTP_HEADER_CONTENT_LENGTH || code == HTTP_HEADER_CONNECTION) {
+    return false;
+  }
+  if (!seenChunked && code == HTTP_HEADER_TRANSFER_ENCODING) {
+    static const string kChunked = "chunked";
+    if (!caseInsensitiveEqual(value, kChunked)) {
+      return false;
+    }
+    seenChunked = true;
+    return mayChunk;
+  }
+  return true;
+}
+
+/**
+ * Finds the raw lines of a message (see HTTPMessage::getRawHeaderLines())
+ * that its headers, visited in order, were parsed from and still view
+ */
+class RawHeaderLineFinder {
+ public:
+  explicit RawHeaderLineFinder(const HTTPMessage& msg)
+      : lines_(msg.getRawHeaderLines()) {}
+
+  /**
+   * @return the line of the header with value, empty if it has none
+   */
+  folly::StringPiece find(folly::StringPiece value) {
+    // the lines are in order in one buffer, and so are the values of the
+    // headers that still point into it; the others are anywhere else
+    if (lines_.empty() || value.begin() < lines_.front().value ||
+        value.begin() > lines_.back().value) {
+      return folly::StringPiece();
+    }
+    while (next_ < lines_.size() && lines_[next_].value < value.begin()) {
+      next_++;
+    }
+    if (next_ == lines_.size() || lines_[next_].value != value.begin()) {
+      return folly::StringPiece();
+    }
+    return lines_[next_++].line;
+  }
+
+ private:
+  const std::vector<HTTPMessage::RawHeaderLine>& lines_;
+  size_t next_{0};
+};
+
+/**
+ * @return room for size bytes of chunk framing at the end of writeBuf, to
+ *         postallocate() once written: the tailroom of its last buffer, or
+ *         a slab buffer the framing around the next chunks also goes into
+ */
+char* reserveChunkFraming(IOBufQueue& writeBuf, size_t size) {
+  IOBufSlab::get().reserveTailroom(writeBuf, size, kChunkFramingBlockSize);
+  return (char*)writeBuf.preallocate(size, size).first;
+}
+
+/**
+ * The pre-serialized head of canned, if msg can use it
+ */
+const HTTPCannedResponse::Head* getCannedHead(const HTTPCannedResponse& canned,
+                                              const HTTPMessage& msg,
+                                              const string& date,
+                                              bool keepalive) {
+  if (!canned.isUnchanged(msg) ||
+      date.size() != HTTPCannedResponse::kDateLength) {
+    return nullptr;
+  }
+  return &canned.getHTTP1xHead(keepalive);
+}
+
+}
+
 http_parser_settings HTTP1xCodec::kParserSettings;
 
 HTTP1xCodec::HTTP1xCodec(TransportDirection direction, bool forceUpstream1_1)
@@ -81,6 +298,7 @@ HTTP1xCodec::HTTP1xCodec(TransportDirection direction, bool forceUpstream1_1)
     ingressTxnID_(0),
     egressTxnID_(0),
     currentIngressBuf_(nullptr),
+    currentHeaderValueOwner_(nullptr),
     headerParseState_(HeaderParseState::kParsingHeaderIdle),
     transportDirection_(direction),
     keepaliveRequested_(KeepaliveRequested::UNSET),
@@ -105,7 +323,13 @@ HTTP1xCodec::HTTP1xCodec(TransportDirection direction, bool forceUpstream1_1)
     ingressUpgrade_(false),
     ingressUpgradeComplete_(false),
     egressUpgrade_(false),
-    headersComplete_(false) {
+    headersComplete_(false),
+    zeroCopyHeaderValues_(false),
+    headersTooLarge_(false),
+    pipelining_(false),
+    pipelineClosed_(false),
+    coalesceIngressBody_(false),
+    keepRawHeaders_(false) {
   switch (direction) {
   case TransportDirection::DOWNSTREAM:
     http_parser_init(&parser_, HTTP_REQUEST);
@@ -161,16 +385,35 @@ HTTP1xCodec::onIngress(const IOBuf& buf) {
     // Callers responsibility to prevent calling onIngress from a callback
     CHECK(!parserActive_);
     parserActive_ = true;
-    currentIngressBuf_ = &buf;
-    size_t bytesParsed = http_parser_execute(&parser_,
-                                             &kParserSettings,
-                                             (const char*)buf.data(),
-                                             buf.length());
-    // in case we parsed a section of the headers but we're not done parsing
-    // the headers we need to keep accounting of it for total header size
-    if (!headersComplete_) {
-      headerSize_.uncompressed += bytesParsed;
-    }
+    // Each buffer of the chain is parsed in turn. They all stay alive
+    // until we return, so the views into one of them hold across the next
+    size_t bytesParsed = 0;
+    const IOBuf* segment = &buf;
+    do {
+      if (segment->length() == 0) {
+        segment = segment->next();
+        continue;
+      }
+      currentIngressBuf_ = segment;
+      size_t segmentParsed = http_parser_execute(&parser_,
+                                                 &kParserSettings,
+                                                 (const char*)segment->data(),
+                                                 segment->length());
+      bytesParsed += segmentParsed;
+      // in case we parsed a section of the headers but we're not done
+      // parsing the headers we need to keep accounting of it for total
+      // header size
+      if (!headersComplete_) {
+        headerSize_.uncompressed += segmentParsed;
+      }
+      if (segmentParsed < segment->length() ||
+          HTTP_PARSER_ERRNO(&parser_) != HPE_OK) {
+        // paused or failed
+        break;
+      }
+      segment = segment->next();
+    } while (segment != &buf);
+    flushIngressBody();
     parserActive_ = false;
     parserError_ = (HTTP_PARSER_ERRNO(&parser_) != HPE_OK) &&
         (HTTP_PARSER_ERRNO(&parser_) != HPE_PAUSED);
@@ -179,11 +422,17 @@ HTTP1xCodec::onIngress(const IOBuf& buf) {
     }
     if (currentHeaderName_.empty() && !currentHeaderNameStringPiece_.empty()) {
       // we currently are storing a chunk of header name via pointers in
-      // currentHeaderNameStringPiece_, but the currentIngressBuf_ is about to
+      // currentHeaderNameStringPiece_, but the ingress chain is about to
       // vanish and so we need to copy over that data to currentHeaderName_
       currentHeaderName_.assign(currentHeaderNameStringPiece_.begin(),
                                 currentHeaderNameStringPiece_.size());
     }
+    if (!currentHeaderValueStringPiece_.empty()) {
+      // same for a header value we were about to store as a view
+      currentHeaderValue_.assign(currentHeaderValueStringPiece_.begin(),
+                                 currentHeaderValueStringPiece_.size());
+      currentHeaderValueStringPiece_.clear();
+    }
     currentIngressBuf_ = nullptr;
     if (pendingEOF_) {
       onIngressEOF();
@@ -223,11 +472,13 @@ void
 HTTP1xCodec::onParserError(const char* what) {
   inRecvLastChunk_ = false;
   http_errno parser_errno = HTTP_PARSER_ERRNO(&parser_);
-  HTTPException error(HTTPException::Direction::INGRESS,
-                      what ? what : folly::to<std::string>(
-                        "Error parsing message: ",
-                        http_errno_description(parser_errno)
-                      ));
+  // what comes from a caught exception and is copied, the parser's
+  // descriptions are static
+  const char* reason = headersTooLarge_ ? "Headers too large" :
+    (what ? nullptr : http_errno_description(parser_errno));
+  HTTPException error = reason ?
+    HTTPException(HTTPException::Direction::INGRESS, kErrorUnknown, reason) :
+    HTTPException(HTTPException::Direction::INGRESS, std::string(what));
   // generate a string of parsed headers so that we can pass it to callback
   if (msg_) {
     error.setPartialMsg(std::move(msg_));
@@ -238,10 +489,12 @@ HTTP1xCodec::onParserError(const char* what) {
   }
   if (transportDirection_ == TransportDirection::DOWNSTREAM &&
       egressTxnID_ < ingressTxnID_) {
-    error.setHttpStatusCode(400);
+    error.setHttpStatusCode(headersTooLarge_ ? 431 : 400);
   } // else we've already egressed a response for this txn, don't attempt a 400
   // See http_parser.h for what these error codes mean
-  if (parser_errno == HPE_INVALID_EOF_STATE) {
+  if (headersTooLarge_) {
+    error.setProxygenError(kErrorParseHeader);
+  } else if (parser_errno == HPE_INVALID_EOF_STATE) {
     error.setProxygenError(kErrorEOF);
   } else if (parser_errno == HPE_HEADER_OVERFLOW ||
              parser_errno == HPE_INVALID_CONSTANT ||
@@ -259,7 +512,8 @@ HTTP1xCodec::onParserError(const char* what) {
 
 bool
 HTTP1xCodec::isReusable() const {
-  return keepalive_ && !egressUpgrade_ && !ingressUpgrade_;
+  return keepalive_ && !pipelineClosed_ && !egressUpgrade_ &&
+    !ingressUpgrade_;
 }
 
 bool
@@ -267,11 +521,31 @@ HTTP1xCodec::isBusy() const {
   return requestPending_ || responsePending_;
 }
 
+size_t
+HTTP1xCodec::getMemoryUsage() const {
+  size_t bytes = stringHeapBytes(currentHeaderName_) +
+    stringHeapBytes(currentHeaderValue_) + stringHeapBytes(url_) +
+    stringHeapBytes(reason_);
+  if (msg_) {
+    bytes += msg_->getMemoryUsage();
+  }
+  if (trailers_) {
+    bytes += sizeof(HTTPHeaders) + trailers_->getMemoryUsage();
+  }
+  return bytes;
+}
+
 void
-HTTP1xCodec::addDateHeader(IOBufQueue& writeBuf, size_t& len) {
-  appendLiteral(writeBuf, len, "Date: ");
-  appendString(writeBuf, len, HTTPMessage::formatDateHeader());
-  appendLiteral(writeBuf, len, CRLF);
+HTTP1xCodec::releaseIdleBuffers() {
+  if (parserActive_ || !currentHeaderName_.empty() ||
+      !currentHeaderValue_.empty() || !url_.empty() || !reason_.empty()) {
+    return;
+  }
+  // clear() keeps the capacity of the longest header seen so far
+  std::string().swap(currentHeaderName_);
+  std::string().swap(currentHeaderValue_);
+  std::string().swap(url_);
+  std::string().swap(reason_);
 }
 
 void
@@ -282,11 +556,14 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
                             HTTPHeaderSize* size) {
   CHECK(assocStream == 0) << "HTTP does not support pushed transactions, "
     "assocStream=" << assocStream;
-  if (keepalive_ && disableKeepalivePending_) {
+  // a pipelined request parsed after txn still gets its response
+  if (keepalive_ && disableKeepalivePending_ &&
+      (!pipelining_ || txn >= ingressTxnID_)) {
     keepalive_ = false;
   }
   const bool upstream = (transportDirection_ == TransportDirection::UPSTREAM);
   const bool downstream = !upstream;
+  KeepaliveRequested keepaliveRequested = keepaliveRequested_;
   if (upstream) {
     DCHECK(txn == egressTxnID_);
     requestPending_ = true;
@@ -308,6 +585,19 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
       ++egressTxnID_;
     }
     is1xxResponse_ = msg.is1xxResponse();
+    if (!pipelinedRequests_.empty() &&
+        pipelinedRequests_.front().txn == txn) {
+      // the ingress has moved on to later requests since this one
+      const PipelinedRequest& request = pipelinedRequests_.front();
+      connectRequest_ = request.connect;
+      headRequest_ = request.head;
+      mayChunkEgress_ = request.mayChunk;
+      keepaliveRequested = request.keepaliveRequested;
+      if (!request.keepalive) {
+        keepalive_ = false;
+      }
+      pipelinedRequests_.pop_front();
+    }
 
     expectNoResponseBody_ =
       connectRequest_ || headRequest_ ||
@@ -347,37 +637,17 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
     version = HTTPMessage::kHTTPVersion11;
   }
 
-  size_t len = 0;
-  switch (transportDirection_) {
-  case TransportDirection::DOWNSTREAM:
-    appendLiteral(writeBuf, len, "HTTP/");
-    appendUint(writeBuf, len, version.first);
-    appendLiteral(writeBuf, len, ".");
-    appendUint(writeBuf, len, version.second);
-    appendLiteral(writeBuf, len, " ");
-    appendUint(writeBuf, len, msg.getStatusCode());
-    appendLiteral(writeBuf, len, " ");
-    appendString(writeBuf, len, msg.getStatusMessage());
-    break;
-  case TransportDirection::UPSTREAM:
+  if (upstream) {
     if (forceUpstream1_1_ && version < HTTPMessage::kHTTPVersion11) {
       version = HTTPMessage::kHTTPVersion11;
     }
-    appendString(writeBuf, len, msg.getMethodString());
-    appendLiteral(writeBuf, len, " ");
-    appendString(writeBuf, len, msg.getURL());
-    appendLiteral(writeBuf, len, " HTTP/");
-    appendUint(writeBuf, len, version.first);
-    appendLiteral(writeBuf, len, ".");
-    appendUint(writeBuf, len, version.second);
     mayChunkEgress_ = (version.first == 1) && (version.second >= 1);
-    break;
   }
   if (keepalive_ &&
       (!msg.wantsKeepalive() ||
        version.first < 1 ||
        (downstream && version == HTTPMessage::kHTTPVersion10 &&
-        keepaliveRequested_ != KeepaliveRequested::YES))) {
+        keepaliveRequested != KeepaliveRequested::YES))) {
     // Disable keepalive if
     //  - the message asked to turn it off
     //  - it's HTTP/0.9
@@ -385,18 +655,98 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
     keepalive_ = false;
   }
   egressChunked_ &= mayChunkEgress_;
-  appendLiteral(writeBuf, len, CRLF);
-  const string* deferredContentLength = nullptr;
+
+  // The head is sized first and then written with memcpy into a single
+  // buffer, rather than appended a piece at a time
+  const string& date = getCachedHTTPDateTime();
+  folly::StringPiece statusLine;
+  size_t len = 0;
+  if (downstream) {
+    if (version == HTTPMessage::kHTTPVersion11) {
+      statusLine = getCommonStatusLine(msg.getStatusCode());
+      if (!statusLine.empty() &&
+          statusLine.subpiece(kStatusLineReasonOffset,
+                              statusLine.size() - kStatusLineReasonOffset -
+                              literalLength(CRLF)) !=
+          folly::StringPiece(msg.getStatusMessage())) {
+        statusLine.clear();
+      }
+    }
+    if (!statusLine.empty()) {
+      len += statusLine.size();
+    } else {
+      len += literalLength("HTTP/") + u64Length(version.first) +
+        literalLength(".") + u64Length(version.second) + literalLength(" ") +
+        u64Length(msg.getStatusCode()) + literalLength(" ") +
+        msg.getStatusMessage().size() + literalLength(CRLF);
+    }
+  } else {
+    len += msg.getMethodString().size() + literalLength(" ") +
+      msg.getURL().size() + literalLength(" HTTP/") +
+      u64Length(version.first) + literalLength(".") +
+      u64Length(version.second) + literalLength(CRLF);
+  }
+  auto writeStartLine = [&] (char* dst) -> char* {
+    if (!statusLine.empty()) {
+      return writeString(dst, statusLine);
+    }
+    if (downstream) {
+      dst = writeLiteral(dst, "HTTP/");
+      dst = writeUint(dst, version.first);
+      dst = writeLiteral(dst, ".");
+      dst = writeUint(dst, version.second);
+      dst = writeLiteral(dst, " ");
+      dst = writeUint(dst, msg.getStatusCode());
+      dst = writeLiteral(dst, " ");
+      dst = writeString(dst, msg.getStatusMessage());
+    } else {
+      dst = writeString(dst, msg.getMethodString());
+      dst = writeLiteral(dst, " ");
+      dst = writeString(dst, msg.getURL());
+      dst = writeLiteral(dst, " HTTP/");
+      dst = writeUint(dst, version.first);
+      dst = writeLiteral(dst, ".");
+      dst = writeUint(dst, version.second);
+    }
+    return writeLiteral(dst, CRLF);
+  };
+
+  const HTTPCannedResponse::Head* cannedHead = nullptr;
+  if (downstream && !egressUpgrade_ && msg.getCannedResponse()) {
+    cannedHead = getCannedHead(*msg.getCannedResponse(), msg, date,
+                               keepalive_);
+  }
+  if (cannedHead) {
+    // a copy of the head with the date patched in, the Content-Length is
+    // already there and no chunking is needed
+    len += cannedHead->data.size();
+    IOBufSlab::get().reserveTailroom(writeBuf, len, kHeaderBlockSize);
+    char* start = (char*)writeBuf.preallocate(len, len).first;
+    char* dst = writeStartLine(start);
+    memcpy(dst, cannedHead->data.data(), cannedHead->data.size());
+    memcpy(dst + cannedHead->dateOffset, date.data(), date.size());
+    writeBuf.postallocate(len);
+    egressChunked_ = false;
+    if (size) {
+      size->compressed = 0;
+      size->uncompressed = len;
+    }
+    return;
+  }
+
+  folly::StringPiece deferredContentLength;
+  bool hasContentLength = false;
   bool hasTransferEncodingChunked = false;
   bool hasUpgradeHeader = false;
   bool hasDateHeader = false;
-  msg.getHeaders().forEachWithCode([&] (HTTPHeaderCode code,
-                                        const string& header,
-                                        const string& value) {
+  RawHeaderLineFinder rawLines(msg);
+  msg.getHeaders().forEachWithCodeView([&] (HTTPHeaderCode code,
+                                            folly::StringPiece header,
+                                            folly::StringPiece value) {
     if (code == HTTP_HEADER_CONTENT_LENGTH) {
       // Write the Content-Length last (t1071703)
-      deferredContentLength = &value;
-      return; // continue
+      deferredContentLength = value;
+      hasContentLength = true;
     } else if (code == HTTP_HEADER_CONNECTION) {
       // TODO: add support for the case where "close" is part of
       // a comma-separated list of values
@@ -405,38 +755,32 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
         keepalive_ = false;
       }
       // We'll generate a new Connection header based on the keepalive_ state
-      return;
-    } else if (!hasTransferEncodingChunked &&
-               code == HTTP_HEADER_TRANSFER_ENCODING) {
-      static const string kChunked = "chunked";
-      if (!caseInsensitiveEqual(value, kChunked)) {
-        return;
-      }
-      hasTransferEncodingChunked = true;
-      if (!mayChunkEgress_) {
-        return;
-      }
     } else if (code == HTTP_HEADER_UPGRADE) {
       hasUpgradeHeader = true;
     } else if (!hasDateHeader && code == HTTP_HEADER_DATE) {
       hasDateHeader = true;
     }
-    size_t lineLen = header.length() + value.length() + 4; // 4 for ": " + CRLF
-    auto writable = writeBuf.preallocate(lineLen,
-        std::max(lineLen, size_t(2000)));
-    char* dst = (char*)writable.first;
-    memcpy(dst, header.data(), header.length());
-    dst += header.length();
-    *dst++ = ':';
-    *dst++ = ' ';
-    memcpy(dst, value.data(), value.length());
-    dst += value.length();
-    *dst++ = '\r';
-    *dst = '\n';
-    DCHECK(size_t(++dst - (char*)writable.first) == lineLen);
-    writeBuf.postallocate(lineLen);
-    len += lineLen;
+    if (isPassedThrough(code, value, mayChunkEgress_,
+                        hasTransferEncodingChunked)) {
+      auto line = rawLines.find(value);
+      if (!line.empty()) {
+        len += line.size();
+      } else {
+        len += header.size() + value.size() + 4; // 4 for ": " + CRLF
+      }
+    }
   });
+  folly::StringPiece cachedLines;
+  const auto& cached = msg.getCachedHeaders();
+  if (cached) {
+    const auto& serialized = cached->getSerialized(
+      HTTPCachedHeaders::Format::HTTP_1X, &serializeCachedHeaders);
+    // copied rather than chained, writeBuf may write into the tailroom of
+    // its last buffer and the cached one is shared
+    cachedLines = folly::StringPiece((const char*)serialized.data->data(),
+                                     serialized.data->length());
+    len += cachedLines.size();
+  }
   bool bodyCheck =
     (downstream && keepalive_ && !expectNoResponseBody_ && !egressUpgrade_) ||
     // auto chunk POSTs and any request that came to us chunked
@@ -444,7 +788,9 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
   // TODO: 400 a 1.0 POST with no content-length
   // clear egressChunked_ if the header wasn't actually set
   egressChunked_ &= hasTransferEncodingChunked;
-  if (bodyCheck && !egressChunked_ && !deferredContentLength) {
+  static const char kChunkedLine[] = "Transfer-Encoding: chunked\r\n";
+  bool addChunked = false;
+  if (bodyCheck && !egressChunked_ && !hasContentLength) {
     // On a connection that would otherwise be eligible for keep-alive,
     // we're being asked to send a response message with no Content-Length,
     // no chunked encoding, and no special circumstances that would eliminate
@@ -452,32 +798,81 @@ HTTP1xCodec::generateHeader(IOBufQueue& writeBuf,
     // on chunked encoding now.  Otherwise, turn off keepalives on this
     // connection.
     if (!hasTransferEncodingChunked && mayChunkEgress_) {
-      appendLiteral(writeBuf, len, "Transfer-Encoding: chunked\r\n");
+      len += literalLength(kChunkedLine);
+      addChunked = true;
       egressChunked_ = true;
     } else {
       keepalive_ = false;
     }
   }
-  if (downstream && !hasDateHeader) {
-    addDateHeader(writeBuf, len);
+  const bool addDate = downstream && !hasDateHeader;
+  if (addDate) {
+    len += literalLength("Date: ") + date.size() + literalLength(CRLF);
   }
+  folly::StringPiece connectionLine;
   if (!is1xxResponse_ || upstream || hasUpgradeHeader) {
-    appendLiteral(writeBuf, len, "Connection: ");
     if (hasUpgradeHeader) {
       // Upgrade header needs to have 'upgrade' keyword as the connection type
-      appendLiteral(writeBuf, len, "upgrade\r\n");
+      connectionLine = "Connection: upgrade\r\n";
     } else if (keepalive_) {
-      appendLiteral(writeBuf, len, "keep-alive\r\n");
+      connectionLine = "Connection: keep-alive\r\n";
     } else {
-      appendLiteral(writeBuf, len, "close\r\n");
+      connectionLine = "Connection: close\r\n";
+    }
+    len += connectionLine.size();
+  }
+  if (hasContentLength) {
+    len += literalLength("Content-Length: ") + deferredContentLength.size() +
+      literalLength(CRLF);
+  }
+  len += literalLength(CRLF);
+
+  IOBufSlab::get().reserveTailroom(writeBuf, len, kHeaderBlockSize);
+  char* start = (char*)writeBuf.preallocate(len, len).first;
+  char* dst = writeStartLine(start);
+  bool seenChunked = false;
+  // adjacent raw lines are copied together
+  RawHeaderLineFinder rawLinesToWrite(msg);
+  folly::StringPiece rawRun;
+  msg.getHeaders().forEachWithCodeView([&] (HTTPHeaderCode code,
+                                            folly::StringPiece header,
+                                            folly::StringPiece value) {
+    if (!isPassedThrough(code, value, mayChunkEgress_, seenChunked)) {
+      return;
+    }
+    auto line = rawLinesToWrite.find(value);
+    if (!line.empty() && line.begin() == rawRun.end()) {
+      rawRun = folly::StringPiece(rawRun.begin(), line.end());
+      return;
     }
+    dst = writeString(dst, rawRun);
+    rawRun = line;
+    if (line.empty()) {
+      dst = writeString(dst, header);
+      dst = writeLiteral(dst, ": ");
+      dst = writeString(dst, value);
+      dst = writeLiteral(dst, CRLF);
+    }
+  });
+  dst = writeString(dst, rawRun);
+  dst = writeString(dst, cachedLines);
+  if (addChunked) {
+    dst = writeLiteral(dst, kChunkedLine);
+  }
+  if (addDate) {
+    dst = writeLiteral(dst, "Date: ");
+    dst = writeString(dst, date);
+    dst = writeLiteral(dst, CRLF);
   }
-  if (deferredContentLength) {
-    appendLiteral(writeBuf, len, "Content-Length: ");
-    appendString(writeBuf, len, *deferredContentLength);
-    appendString(writeBuf, len, CRLF);
+  dst = writeString(dst, connectionLine);
+  if (hasContentLength) {
+    dst = writeLiteral(dst, "Content-Length: ");
+    dst = writeString(dst, deferredContentLength);
+    dst = writeLiteral(dst, CRLF);
   }
-  appendLiteral(writeBuf, len, CRLF);
+  dst = writeLiteral(dst, CRLF);
+  DCHECK_EQ(size_t(dst - start), len);
+  writeBuf.postallocate(len);
 
   if (size) {
     size->compressed = 0;
@@ -501,17 +896,22 @@ HTTP1xCodec::generateBody(IOBufQueue& writeBuf,
   size_t totLen = buflen;
 
   if (egressChunked_ && !inChunk_) {
-    char chunkLenBuf[32];
-    int rc = snprintf(chunkLenBuf, sizeof(chunkLenBuf), "%zx\r\n", buflen);
-    CHECK(rc > 0);
-    CHECK(size_t(rc) < sizeof(chunkLenBuf));
-
-    writeBuf.append(chunkLenBuf, rc);
-    totLen += rc;
+    const size_t chunkHeaderLen = hexLength(buflen) + literalLength(CRLF);
+    if (!chain->isSharedOne() && chain->headroom() >= chunkHeaderLen) {
+      // the length goes in front of the data, in the body's own buffer
+      chain->prepend(chunkHeaderLen);
+      writeLiteral(writeHex((char*)chain->writableData(), buflen), CRLF);
+    } else {
+      char* dst = reserveChunkFraming(writeBuf, chunkHeaderLen);
+      writeLiteral(writeHex(dst, buflen), CRLF);
+      writeBuf.postallocate(chunkHeaderLen);
+    }
+    totLen += chunkHeaderLen;
 
     writeBuf.append(std::move(chain));
-    writeBuf.append("\r\n", 2);
-    totLen += 2;
+    writeLiteral(reserveChunkFraming(writeBuf, literalLength(CRLF)), CRLF);
+    writeBuf.postallocate(literalLength(CRLF));
+    totLen += literalLength(CRLF);
   } else {
     writeBuf.append(std::move(chain));
   }
@@ -525,22 +925,17 @@ HTTP1xCodec::generateBody(IOBufQueue& writeBuf,
 size_t HTTP1xCodec::generateChunkHeader(IOBufQueue& writeBuf,
                                         StreamID txn,
                                         size_t length) {
-  // TODO: Format directly into the IOBuf, rather than copying after the fact.
-  // IOBufQueue::append() currently forces us to copy.
-
   CHECK(length) << "use sendEOM to terminate the message using the "
                 << "standard zero-length chunk. Don't "
                 << "send zero-length chunks using this API.";
   if (egressChunked_) {
     CHECK(!inChunk_);
     inChunk_ = true;
-    char chunkLenBuf[32];
-    int rc = snprintf(chunkLenBuf, sizeof(chunkLenBuf), "%zx\r\n", length);
-    CHECK(rc > 0);
-    CHECK(size_t(rc) < sizeof(chunkLenBuf));
-
-    writeBuf.append(chunkLenBuf, rc);
-    return rc;
+    const size_t chunkHeaderLen = hexLength(length) + literalLength(CRLF);
+    char* dst = reserveChunkFraming(writeBuf, chunkHeaderLen);
+    writeLiteral(writeHex(dst, length), CRLF);
+    writeBuf.postallocate(chunkHeaderLen);
+    return chunkHeaderLen;
   }
 
   return 0;
@@ -550,8 +945,9 @@ size_t HTTP1xCodec::generateChunkTerminator(IOBufQueue& writeBuf,
                                             StreamID txn) {
   if (egressChunked_ && inChunk_) {
     inChunk_ = false;
-    writeBuf.append("\r\n", 2);
-    return 2;
+    writeLiteral(reserveChunkFraming(writeBuf, literalLength(CRLF)), CRLF);
+    writeBuf.postallocate(literalLength(CRLF));
+    return literalLength(CRLF);
   }
 
   return 0;
@@ -582,11 +978,13 @@ size_t HTTP1xCodec::generateEOM(IOBufQueue& writeBuf, StreamID txn) {
   size_t len = 0;
   if (egressChunked_) {
     CHECK(!inChunk_);
-    if (!lastChunkWritten_) {
-      lastChunkWritten_ = true;
-      appendLiteral(writeBuf, len, "0\r\n");
-    }
-    appendLiteral(writeBuf, len, CRLF);
+    static const char kLastChunk[] = "0\r\n\r\n";
+    // the last chunk and the empty trailer line, or just the latter
+    len = lastChunkWritten_ ? literalLength(CRLF) : literalLength(kLastChunk);
+    lastChunkWritten_ = true;
+    char* dst = reserveChunkFraming(writeBuf, len);
+    memcpy(dst, kLastChunk + literalLength(kLastChunk) - len, len);
+    writeBuf.postallocate(len);
   }
   switch (transportDirection_) {
   case TransportDirection::DOWNSTREAM:
@@ -605,6 +1003,10 @@ size_t HTTP1xCodec::generateRstStream(IOBufQueue& writeBuf,
   // statusCode ignored for HTTP/1.1
   // We won't be able to send anything else on the transport after this.
   disableKeepalivePending_ = true;
+  if (pipelining_) {
+    // nor take more requests than those being answered
+    pipelineClosed_ = true;
+  }
   return 0;
 }
 
@@ -614,6 +1016,10 @@ size_t HTTP1xCodec::generateGoaway(IOBufQueue& writeBuf,
   // statusCode ignored for HTTP/1.1
   // We won't be able to send anything else on the transport after this.
   disableKeepalivePending_ = true;
+  if (pipelining_) {
+    // nor take more requests than those being answered
+    pipelineClosed_ = true;
+  }
   return 0;
 }
 
@@ -621,8 +1027,13 @@ int
 HTTP1xCodec::onMessageBegin() {
   headersComplete_ = false;
   headerSize_.uncompressed = 0;
+  headerBytes_ = 0;
+  currentHeaderBytes_ = 0;
   headerParseState_ = HeaderParseState::kParsingHeaderStart;
-  msg_.reset(new HTTPMessage());
+  // a message the callback didn't take is reused for this one
+  auto& messagePool = ObjectPool<HTTPMessage>::get();
+  messagePool.recycle(std::move(msg_));
+  msg_ = messagePool.acquire();
   trailers_.reset();
   if (transportDirection_ == TransportDirection::DOWNSTREAM) {
     requestPending_ = true;
@@ -640,17 +1051,49 @@ HTTP1xCodec::onMessageBegin() {
 
 int
 HTTP1xCodec::onURL(const char* buf, size_t len) {
+  if (!addIngressHeaderBytes(len)) {
+    return 1;
+  }
   url_.append(buf, len);
   return 0;
 }
 
 int
 HTTP1xCodec::onReason(const char* buf, size_t len) {
+  if (!addIngressHeaderBytes(len)) {
+    return 1;
+  }
   reason_.append(buf, len);
   return 0;
 }
 
 void HTTP1xCodec::pushHeaderNameAndValue(HTTPHeaders& hdrs) {
+  if (!currentHeaderValueStringPiece_.empty()) {
+    // The value is still contiguous in the current ingress buffer, so the
+    // headers can point at it instead of copying it
+    DCHECK(currentHeaderValueOwner_);
+    DCHECK(currentHeaderValue_.empty());
+    if (LIKELY(currentHeaderName_.empty())) {
+      hdrs.addViewFromCodec(currentHeaderNameStringPiece_.begin(),
+                            currentHeaderNameStringPiece_.size(),
+                            currentHeaderValueStringPiece_,
+                            *currentHeaderValueOwner_);
+      if (keepRawHeaders_ &&
+          headerParseState_ == HeaderParseState::kParsingHeaderValue) {
+        addRawHeaderLine(currentHeaderNameStringPiece_,
+                         currentHeaderValueStringPiece_);
+      }
+    } else {
+      hdrs.addViewFromCodec(currentHeaderName_.data(),
+                            currentHeaderName_.size(),
+                            currentHeaderValueStringPiece_,
+                            *currentHeaderValueOwner_);
+      currentHeaderName_.clear();
+    }
+    currentHeaderNameStringPiece_.clear();
+    currentHeaderValueStringPiece_.clear();
+    return;
+  }
   if (LIKELY(currentHeaderName_.empty())) {
     hdrs.addFromCodec(currentHeaderNameStringPiece_.begin(),
                       currentHeaderNameStringPiece_.size(),
@@ -664,6 +1107,29 @@ void HTTP1xCodec::pushHeaderNameAndValue(HTTPHeaders& hdrs) {
   currentHeaderValue_.clear();
 }
 
+void HTTP1xCodec::addRawHeaderLine(folly::StringPiece name,
+                                   folly::StringPiece value) {
+  const char* begin = (const char*)currentHeaderValueOwner_->data();
+  const char* end = begin + currentHeaderValueOwner_->length();
+  if (name.begin() < begin || name.end() > value.begin()) {
+    return;
+  }
+  const auto& lines = msg_->getRawHeaderLines();
+  if (!lines.empty() &&
+      (lines.back().line.begin() < begin ||
+       lines.back().line.end() > name.begin())) {
+    // an earlier line is in another buffer
+    return;
+  }
+  // through the CRLF, past any whitespace the value was trimmed of
+  auto eol = (const char*)memchr(value.end(), '\n', end - value.end());
+  if (!eol) {
+    return;
+  }
+  msg_->addRawHeaderLine(folly::StringPiece(name.begin(), eol + 1),
+                         value.begin());
+}
+
 int
 HTTP1xCodec::onHeaderField(const char* buf, size_t len) {
   if (headerParseState_ == HeaderParseState::kParsingHeaderValue) {
@@ -675,6 +1141,13 @@ HTTP1xCodec::onHeaderField(const char* buf, size_t len) {
     pushHeaderNameAndValue(*trailers_);
   }
 
+  if (!isParsingHeaderOrTrailerName()) {
+    currentHeaderBytes_ = 0;
+  }
+  if (!addIngressHeaderBytes(len)) {
+    return 1;
+  }
+
   if (isParsingHeaderOrTrailerName()) {
 
     // we're already parsing a header name
@@ -715,28 +1188,68 @@ HTTP1xCodec::onHeaderField(const char* buf, size_t len) {
 
 int
 HTTP1xCodec::onHeaderValue(const char* buf, size_t len) {
+  if (!addIngressHeaderBytes(len)) {
+    return 1;
+  }
   if (isParsingHeaders()) {
     headerParseState_ = HeaderParseState::kParsingHeaderValue;
   } else {
     headerParseState_ = HeaderParseState::kParsingTrailerValue;
   }
+  if (zeroCopyHeaderValues_ && currentHeaderValue_.empty()) {
+    if (currentHeaderValueStringPiece_.empty()) {
+      currentHeaderValueStringPiece_.reset(buf, len);
+      currentHeaderValueOwner_ = currentIngressBuf_;
+      return 0;
+    } else if (currentHeaderValueStringPiece_.end() == buf &&
+               currentHeaderValueOwner_ == currentIngressBuf_) {
+      currentHeaderValueStringPiece_.advance(len);
+      return 0;
+    }
+    // the value continues in another buffer of the chain, or after a
+    // discontinuity within one buffer: fall back to copying
+    currentHeaderValue_.assign(currentHeaderValueStringPiece_.begin(),
+                               currentHeaderValueStringPiece_.size());
+    currentHeaderValueStringPiece_.clear();
+  }
   currentHeaderValue_.append(buf, len);
   return 0;
 }
 
+bool
+HTTP1xCodec::addIngressHeaderBytes(size_t len) {
+  headerBytes_ += len;
+  currentHeaderBytes_ += len;
+  if ((maxHeaderBlock_ > 0 && headerBytes_ > maxHeaderBlock_) ||
+      (maxHeaderSize_ > 0 && currentHeaderBytes_ > maxHeaderSize_)) {
+    headersTooLarge_ = true;
+    return false;
+  }
+  return true;
+}
+
 int
 HTTP1xCodec::onHeadersComplete(size_t len) {
   if (headerParseState_ == HeaderParseState::kParsingHeaderValue) {
     pushHeaderNameAndValue(msg_->getHeaders());
   }
+  // the trailers are counted on their own
+  headerBytes_ = 0;
+  currentHeaderBytes_ = 0;
 
   // Update the HTTPMessage with the values parsed from the header
   msg_->setHTTPVersion(parser_.http_major, parser_.http_minor);
   msg_->setIsChunked((parser_.flags & F_CHUNKED));
 
   if (transportDirection_ == TransportDirection::DOWNSTREAM) {
-    // Set the method type
-    msg_->setMethod(http_method_str(static_cast<http_method>(parser_.method)));
+    // Set the method type; only extension methods are kept as strings
+    auto parserMethod = static_cast<http_method>(parser_.method);
+    HTTPMethod method;
+    if (parserMethodToHTTPMethod(parserMethod, method)) {
+      msg_->setMethod(method);
+    } else {
+      msg_->setMethod(http_method_str(parserMethod));
+    }
 
     connectRequest_ = (msg_->getMethod() == HTTPMethod::CONNECT);
 
@@ -791,8 +1304,15 @@ HTTP1xCodec::onHeadersComplete(size_t len) {
 
   headerParseState_ = HeaderParseState::kParsingHeadersComplete;
   bool msgKeepalive = msg_->computeKeepalive();
+  const bool pipelined =
+    pipelining_ && transportDirection_ == TransportDirection::DOWNSTREAM;
   if (!msgKeepalive) {
-     keepalive_ = false;
+    if (pipelined) {
+      // Only the response to this request closes the connection
+      pipelineClosed_ = true;
+    } else {
+      keepalive_ = false;
+    }
   }
   if (transportDirection_ == TransportDirection::DOWNSTREAM) {
     // Remember whether this was an HTTP 1.0 request with keepalive enabled
@@ -804,6 +1324,11 @@ HTTP1xCodec::onHeadersComplete(size_t len) {
       keepaliveRequested_ = KeepaliveRequested::NO;
     }
   }
+  if (pipelined && egressTxnID_ < ingressTxnID_) {
+    pipelinedRequests_.push_back(PipelinedRequest{
+        ingressTxnID_, keepaliveRequested_, connectRequest_, headRequest_,
+        mayChunkEgress_, msgKeepalive});
+  }
 
   // Determine whether the HTTP parser should ignore any headers
   // that indicate the presence of a message body.  This is needed,
@@ -842,20 +1367,32 @@ HTTP1xCodec::onBody(const char* buf, size_t len) {
   const char* dataEnd = dataStart + currentIngressBuf_->length();
   DCHECK_GE(buf, dataStart);
   DCHECK_LE(buf + len, dataEnd);
-  unique_ptr<IOBuf> clone(currentIngressBuf_->clone());
+  unique_ptr<IOBuf> clone(currentIngressBuf_->cloneOne());
   clone->trimStart(buf - dataStart);
   clone->trimEnd(dataEnd - (buf + len));
-  callback_->onBody(ingressTxnID_, std::move(clone));
+  if (!coalesceIngressBody_) {
+    callback_->onBody(ingressTxnID_, std::move(clone));
+  } else if (pendingIngressBody_) {
+    pendingIngressBody_->prependChain(std::move(clone));
+  } else {
+    pendingIngressBody_ = std::move(clone);
+  }
   return 0;
 }
 
+void HTTP1xCodec::flushIngressBody() {
+  if (pendingIngressBody_) {
+    callback_->onBody(ingressTxnID_, std::move(pendingIngressBody_));
+  }
+}
+
 int HTTP1xCodec::onChunkHeader(size_t len) {
-  if (len > 0) {
-    callback_->onChunkHeader(ingressTxnID_, len);
-  } else {
+  if (len == 0) {
     VLOG(5) << "Suppressed onChunkHeader callback for final zero length "
             << "chunk";
     inRecvLastChunk_ = true;
+  } else if (!coalesceIngressBody_) {
+    callback_->onChunkHeader(ingressTxnID_, len);
   }
   return 0;
 }
@@ -863,7 +1400,7 @@ int HTTP1xCodec::onChunkHeader(size_t len) {
 int HTTP1xCodec::onChunkComplete() {
   if (inRecvLastChunk_) {
     inRecvLastChunk_ = false;
-  } else {
+  } else if (!coalesceIngressBody_) {
     callback_->onChunkComplete(ingressTxnID_);
   }
   return 0;
@@ -872,6 +1409,7 @@ int HTTP1xCodec::onChunkComplete() {
 int HTTP1xCodec::onMessageComplete() {
   DCHECK(!isParsingHeaders());
   DCHECK(!inRecvLastChunk_);
+  flushIngressBody();
   if (headerParseState_ == HeaderParseState::kParsingTrailerValue) {
     if (!trailers_) {
       trailers_.reset(new HTTPHeaders());
@@ -12,13 +12,14 @@
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <proxygen/lib/http/codec/HTTPCodec.h>
 #include <proxygen/lib/http/codec/TransportDirection.h>
+#include <deque>
 #include <string>
 
 #include "proxygen/external/http_parser/http_parser.h"
 
 namespace proxygen {
 
-class HTTP1xCodec : public HTTPCodec {
+class HTTP1xCodec final : public HTTPCodec {
  public:
   explicit HTTP1xCodec(TransportDirection direction,
                        bool forceUpstream1_1 = false);
@@ -53,6 +54,10 @@ class HTTP1xCodec : public HTTPCodec {
                       StreamID txn,
                       std::unique_ptr<folly::IOBuf> chain,
                       bool eom) override;
+  bool isEgressBodyUnframed(StreamID txn) const override {
+    // a chunked body is only unframed in a chunk from generateChunkHeader()
+    return txn == egressTxnID_ && (!egressChunked_ || inChunk_);
+  }
   size_t generateChunkHeader(folly::IOBufQueue& writeBuf,
                              StreamID txn,
                              size_t length) override;
@@ -69,12 +74,83 @@ class HTTP1xCodec : public HTTPCodec {
   size_t generateGoaway(folly::IOBufQueue& writeBuf,
                         StreamID lastStream,
                         ErrorCode statusCode) override;
+  size_t getMemoryUsage() const override;
+  void releaseIdleBuffers() override;
 
   /**
    * @returns true if the codec supports the given NPN protocol.
    */
   static bool supportsNextProtocol(const std::string& npn);
 
+  /**
+   * If enabled, ingress header values that arrive in one contiguous piece
+   * are stored in HTTPHeaders as views into the ingress buffer instead of
+   * being copied (see HTTPHeaders::addViewFromCodec). Disabled by default.
+   */
+  void setZeroCopyHeaderValues(bool enabled) {
+    zeroCopyHeaderValues_ = enabled;
+  }
+
+  /**
+   * If enabled, ingress header values are views as above, and the codec
+   * also keeps the wire lines of those headers with the message (see
+   * HTTPMessage::getRawHeaderLines()), so that a proxy sending it on over
+   * HTTP/1.x copies the lines of the headers it didn't touch. Only the
+   * headers of a message that arrived in one ingress buffer are kept.
+   * Disabled by default.
+   */
+  void setKeepRawHeaders(bool enabled) {
+    keepRawHeaders_ = enabled;
+    if (enabled) {
+      zeroCopyHeaderValues_ = true;
+    }
+  }
+
+  /**
+   * If enabled and the CPU supports SSE4.2, the parser skips over runs of
+   * URL, header name and header value bytes 16 at a time instead of
+   * inspecting them one by one. Returns whether it is now enabled.
+   */
+  bool setVectorizedScanning(bool enabled) {
+    return http_parser_set_fast_scan(&parser_, enabled) != 0;
+  }
+
+  /**
+   * If enabled, a downstream codec remembers what it needs to respond to
+   * each request it parses, so that it can go on parsing pipelined
+   * requests while the responses to the earlier ones are generated (see
+   * HTTPSession::setPipelining()). A request with Connection: close, or a
+   * goaway, then only stops the codec from taking more requests; the
+   * responses before the last one keep the connection. Disabled by
+   * default.
+   */
+  void setPipelining(bool enabled) {
+    pipelining_ = enabled;
+  }
+
+  /**
+   * If enabled, the chunk boundaries of the ingress aren't reported, and
+   * the body that one onIngress() call parses for a message goes to
+   * onBody() as a single chain, rather than a callback per chunk. For the
+   * callers that don't need onChunkHeader() and onChunkComplete().
+   * Disabled by default.
+   */
+  void setCoalesceIngressBody(bool enabled) {
+    coalesceIngressBody_ = enabled;
+  }
+
+  /**
+   * The URL and the header fields are counted as the parser hands them
+   * over, and the message fails with a 431 as soon as they add up to more
+   * than maxBlock, or one header to more than maxHeader. maxBlock 0 leaves
+   * the HTTP_MAX_HEADER_SIZE of the parser as the only limit.
+   */
+  void setMaxIngressHeaderSize(uint32_t maxBlock,
+                               uint32_t maxHeader) override {
+    maxHeaderBlock_ = maxBlock;
+    maxHeaderSize_ = maxHeader;
+  }
+
  private:
   /** Simple state model used to track the parsing of HTTP headers */
   enum class HeaderParseState : uint8_t {
@@ -96,7 +172,15 @@ class HTTP1xCodec : public HTTPCodec {
     NO,   // incoming message disabled keepalive
   };
 
-  void addDateHeader(folly::IOBufQueue& writeBuf, size_t& len);
+  /** What the response to a pipelined request depends on */
+  struct PipelinedRequest {
+    StreamID txn;
+    KeepaliveRequested keepaliveRequested;
+    bool connect;
+    bool head;
+    bool mayChunk;
+    bool keepalive;
+  };
 
   /** Check whether we're currently parsing ingress message headers */
   bool isParsingHeaders() const {
@@ -116,9 +200,27 @@ class HTTP1xCodec : public HTTPCodec {
       HTTPException passed to callback_. */
   void onParserError(const char* what = nullptr);
 
+  /**
+   * Count len more bytes of the current header, see
+   * setMaxIngressHeaderSize()
+   *
+   * @return false if that crosses a limit
+   */
+  bool addIngressHeaderBytes(size_t len);
+
+  /** Hand the body coalesced so far to the callback */
+  void flushIngressBody();
+
   /** Push out header name-value pair to hdrs and clear currentHeader*_ */
   void pushHeaderNameAndValue(HTTPHeaders& hdrs);
 
+  /**
+   * Keep the line of the header named name, whose value view was just
+   * added, with msg_ if it is whole in the value's buffer after the
+   * previous lines
+   */
+  void addRawHeaderLine(folly::StringPiece name, folly::StringPiece value);
+
   // Parser callbacks
   int onMessageBegin();
   int onURL(const char* buf, size_t len);
@@ -141,9 +243,21 @@ class HTTP1xCodec : public HTTPCodec {
   std::string currentHeaderName_;
   folly::StringPiece currentHeaderNameStringPiece_;
   std::string currentHeaderValue_;
+  folly::StringPiece currentHeaderValueStringPiece_;
+  // the buffer of the ingress chain currentHeaderValueStringPiece_ is in
+  const folly::IOBuf* currentHeaderValueOwner_;
   std::string url_;
   std::string reason_;
   HTTPHeaderSize headerSize_;
+  uint32_t maxHeaderBlock_{0};
+  uint32_t maxHeaderSize_{0};
+  // of the headers, or trailers, being parsed, and of the current header
+  uint64_t headerBytes_{0};
+  uint64_t currentHeaderBytes_{0};
+  // the body parsed from currentIngressBuf_, with setCoalesceIngressBody()
+  std::unique_ptr<folly::IOBuf> pendingIngressBody_;
+  // the requests parsed ahead of their responses, with setPipelining()
+  std::deque<PipelinedRequest> pipelinedRequests_;
   HeaderParseState headerParseState_;
   TransportDirection transportDirection_;
   KeepaliveRequested keepaliveRequested_; // only used in DOWNSTREAM mode
@@ -170,6 +284,12 @@ class HTTP1xCodec : public HTTPCodec {
   bool ingressUpgradeComplete_:1;
   bool egressUpgrade_:1;
   bool headersComplete_:1;
+  bool zeroCopyHeaderValues_:1;
+  bool headersTooLarge_:1;
+  bool pipelining_:1;
+  bool pipelineClosed_:1;
+  bool coalesceIngressBody_:1;
+  bool keepRawHeaders_:1;
 
   // C-callable wrappers for the http_parser callbacks
   static int onMessageBeginCB(http_parser* parser);
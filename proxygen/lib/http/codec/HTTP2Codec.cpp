@@ -0,0 +1,1234 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+
+#include <algorithm>
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/io/Cursor.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/HTTPHeaderSize.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/codec/SPDYUtil.h>
+#include <proxygen/lib/utils/CryptUtil.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+#include <proxygen/lib/utils/ParseURL.h>
+#include <proxygen/lib/utils/UtilInl.h>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+using folly::io::Cursor;
+using proxygen::compress::Header;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace proxygen {
+
+namespace {
+
+// HTTPMessage priorities go from 0 (highest) to 7, and are spread over the
+// HTTP/2 weights in steps of 32
+const uint8_t kMaxPriority = 7;
+const uint8_t kWeightShift = 5;
+
+uint8_t priorityToWeight(uint8_t pri) {
+  pri = std::min(pri, kMaxPriority);
+  return uint8_t(((kMaxPriority - pri) << kWeightShift) | 0x1f);
+}
+
+uint8_t weightToPriority(uint8_t weight) {
+  return kMaxPriority - (weight >> kWeightShift);
+}
+
+HTTPPriority toHTTPPriority(const http2::PriorityUpdate& priority) {
+  return HTTPPriority(priority.streamDependency, priority.exclusive,
+                      uint16_t(priority.weight) + 1);
+}
+
+bool hasUppercase(StringPiece name) {
+  for (char c: name) {
+    if (c >= 'A' && c <= 'Z') {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+std::bitset<256> HTTP2Codec::perHopHeaderCodes_;
+
+void HTTP2Codec::initPerHopHeaders() {
+  // HTTP/2 connection specific headers
+  perHopHeaderCodes_[HTTP_HEADER_CONNECTION] = true;
+  perHopHeaderCodes_[HTTP_HEADER_KEEP_ALIVE] = true;
+  perHopHeaderCodes_[HTTP_HEADER_PROXY_CONNECTION] = true;
+  perHopHeaderCodes_[HTTP_HEADER_TRANSFER_ENCODING] = true;
+  perHopHeaderCodes_[HTTP_HEADER_UPGRADE] = true;
+}
+
+HTTP2Codec::HTTP2Codec(TransportDirection direction)
+  : HTTP2Codec(direction, http2::kTableSize) {
+}
+
+HTTP2Codec::HTTP2Codec(TransportDirection direction, uint32_t headerTableSize)
+  : transportDirection_(direction),
+    headerCodec_(direction, headerTableSize),
+    headerTableSize_(headerTableSize),
+    frameState_(direction == TransportDirection::DOWNSTREAM ?
+                FrameState::PREFACE : FrameState::FRAME_HEADER),
+    sessionClosing_(ClosingState::OPEN),
+    needsSettings_(true) {
+  VLOG(4) << "creating HTTP/2 codec";
+
+  switch (transportDirection_) {
+  case TransportDirection::DOWNSTREAM:
+    nextEgressStreamID_ = 2;
+    break;
+  case TransportDirection::UPSTREAM:
+    nextEgressStreamID_ = 1;
+    break;
+  default:
+    LOG(FATAL) << "Unknown transport direction.";
+  }
+}
+
+HTTP2Codec::~HTTP2Codec() {
+}
+
+size_t HTTP2Codec::getMemoryUsage() const {
+  size_t bytes = headerCodec_.getMemoryUsage() +
+    chainCapacity(headerBlockFrames_) +
+    (partialMsg_ ? partialMsg_->getMemoryUsage() : 0);
+  for (const auto& push: pendingPushes_) {
+    const auto& msg = push.second.second;
+    bytes += sizeof(push) + (msg ? msg->getMemoryUsage() : 0);
+  }
+  for (const auto& trailers: pendingTrailers_) {
+    bytes += sizeof(trailers) + trailers.second.getMemoryUsage();
+  }
+  return bytes;
+}
+
+void HTTP2Codec::setHeaderTableSize(uint32_t size) {
+  headerTableSize_ = size;
+  egressSettings_.setSetting(SettingsId::HEADER_TABLE_SIZE, size);
+  headerCodec_.setEncoderHeaderTableSize(
+    std::min(size, ingressSettings_.getSetting(SettingsId::HEADER_TABLE_SIZE,
+                                               http2::kTableSize)));
+}
+
+void HTTP2Codec::setMaxIngressHeaderSize(uint32_t maxBlock,
+                                         uint32_t maxHeader) {
+  maxHeaderBlock_ = maxBlock;
+  if (maxBlock) {
+    headerCodec_.setMaxUncompressed(maxBlock);
+  }
+  headerCodec_.setMaxHeaderSize(maxHeader);
+}
+
+HTTPCodec::StreamID HTTP2Codec::createStream() {
+  auto ret = nextEgressStreamID_;
+  nextEgressStreamID_ += 2;
+  return ret;
+}
+
+bool HTTP2Codec::isIdleStream(StreamID stream) const {
+  bool peerInitiated =
+    (transportDirection_ == TransportDirection::DOWNSTREAM) ==
+    ((stream & 0x1) == 1);
+  if (peerInitiated) {
+    return stream > lastStreamID_;
+  }
+  return stream >= nextEgressStreamID_;
+}
+
+size_t HTTP2Codec::onIngress(const IOBuf& buf) {
+  currentIngressBuf_ = &buf;
+  const size_t chainLength = buf.computeChainDataLength();
+  Cursor cursor(&buf);
+  size_t parsed = 0;
+  ErrorCode err = ErrorCode::NO_ERROR;
+
+  // This can parse beyond the current IOBuf
+  while (err == ErrorCode::NO_ERROR) {
+    const size_t avail = chainLength - parsed;
+    if (frameState_ == FrameState::PREFACE) {
+      const size_t prefaceLength = http2::kConnectionPreface.size();
+      if (avail < prefaceLength) {
+        break;
+      }
+      string preface(prefaceLength, '\0');
+      cursor.pull(&preface[0], prefaceLength);
+      if (preface != http2::kConnectionPreface) {
+        LOG(ERROR) << "Invalid connection preface";
+        err = ErrorCode::PROTOCOL_ERROR;
+        break;
+      }
+      parsed += prefaceLength;
+      frameState_ = FrameState::FRAME_HEADER;
+    } else if (frameState_ == FrameState::FRAME_HEADER) {
+      if (avail < http2::kFrameHeaderSize) {
+        // Make the caller buffer until we get a full frame header
+        break;
+      }
+      http2::parseFrameHeader(cursor, curHeader_);
+      parsed += http2::kFrameHeaderSize;
+      frameState_ = FrameState::FRAME_DATA;
+      VLOG(6) << "Parsed " << http2::getFrameTypeString(curHeader_.type)
+              << " frame header, stream=" << curHeader_.stream
+              << " length=" << curHeader_.length
+              << " flags=" << std::hex << unsigned(curHeader_.flags)
+              << std::dec;
+      if (curHeader_.length >
+          egressSettings_.getSetting(SettingsId::MAX_FRAME_SIZE,
+                                     http2::kMaxFramePayloadLengthMin)) {
+        LOG(ERROR) << "excessive frame size length=" << curHeader_.length;
+        err = ErrorCode::FRAME_SIZE_ERROR;
+      } else if (needsSettings_ &&
+                 (curHeader_.type != http2::FrameType::SETTINGS ||
+                  (curHeader_.flags & http2::ACK))) {
+        LOG(ERROR) << "The first frame must be SETTINGS, got "
+                   << http2::getFrameTypeString(curHeader_.type);
+        err = ErrorCode::PROTOCOL_ERROR;
+      }
+      needsSettings_ = false;
+    } else {
+      DCHECK(frameState_ == FrameState::FRAME_DATA);
+      if (avail < curHeader_.length) {
+        // Make the caller buffer the rest of the frame. DATA frames could be
+        // passed up in pieces, but for now we're favoring simplicity.
+        VLOG(6) << "Need more data: length=" << curHeader_.length
+                << " avail=" << avail;
+        break;
+      }
+      // the frame parsers may stop early on errors, so work on a copy and
+      // skip the whole frame
+      Cursor frameCursor(cursor);
+      err = parseFrame(frameCursor);
+      cursor.skip(curHeader_.length);
+      parsed += curHeader_.length;
+      frameState_ = FrameState::FRAME_HEADER;
+    }
+  }
+
+  if (err != ErrorCode::NO_ERROR) {
+    failSession(err);
+    return chainLength;
+  }
+  return parsed;
+}
+
+ErrorCode HTTP2Codec::parseFrame(Cursor& cursor) {
+  if (expectedContinuationStream_ != 0 &&
+      (curHeader_.type != http2::FrameType::CONTINUATION ||
+       curHeader_.stream != expectedContinuationStream_)) {
+    LOG(ERROR) << "Expected CONTINUATION for stream="
+               << expectedContinuationStream_ << ", got "
+               << http2::getFrameTypeString(curHeader_.type)
+               << " for stream=" << curHeader_.stream;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+
+  switch (curHeader_.type) {
+    case http2::FrameType::DATA:
+      return parseData(cursor);
+    case http2::FrameType::HEADERS:
+      return parseHeaders(cursor);
+    case http2::FrameType::PRIORITY:
+    {
+      http2::PriorityUpdate priority;
+      auto err = http2::parsePriority(cursor, curHeader_, priority);
+      if (err == ErrorCode::NO_ERROR) {
+        callback_->onPriority(curHeader_.stream, toHTTPPriority(priority));
+      }
+      return err;
+    }
+    case http2::FrameType::RST_STREAM:
+      return parseRstStream(cursor);
+    case http2::FrameType::SETTINGS:
+      return parseSettings(cursor);
+    case http2::FrameType::PUSH_PROMISE:
+      return parsePushPromise(cursor);
+    case http2::FrameType::PING:
+      return parsePing(cursor);
+    case http2::FrameType::GOAWAY:
+      return parseGoaway(cursor);
+    case http2::FrameType::WINDOW_UPDATE:
+      return parseWindowUpdate(cursor);
+    case http2::FrameType::CONTINUATION:
+      return parseContinuation(cursor);
+  }
+  // Implementations must ignore frames of unknown types
+  VLOG(3) << "Ignoring unknown frame type=" << unsigned(curHeader_.type)
+          << ", frame length: " << curHeader_.length;
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseData(Cursor& cursor) {
+  unique_ptr<IOBuf> body;
+  uint16_t padding = 0;
+  auto err = http2::parseData(cursor, curHeader_, body, padding);
+  RETURN_IF_ERROR(err);
+  const StreamID stream = curHeader_.stream;
+  if (isIdleStream(stream)) {
+    LOG(ERROR) << "DATA for idle stream=" << stream;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  if (body && body->computeChainDataLength() > 0) {
+    callback_->onBody(stream, std::move(body));
+  }
+  if (padding > 0) {
+    callback_->onPadding(stream, padding);
+  }
+  if (curHeader_.flags & http2::END_STREAM) {
+    callback_->onMessageComplete(stream, false);
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseHeaders(Cursor& cursor) {
+  unique_ptr<IOBuf> fragment;
+  auto err = http2::parseHeaders(cursor, curHeader_, headerBlockPriority_,
+                                 fragment);
+  RETURN_IF_ERROR(err);
+  headerBlockHeader_ = curHeader_;
+  promisedStream_ = 0;
+  return onHeaderBlockFragment(std::move(fragment));
+}
+
+ErrorCode HTTP2Codec::parsePushPromise(Cursor& cursor) {
+  if (transportDirection_ == TransportDirection::DOWNSTREAM ||
+      egressSettings_.getSetting(SettingsId::ENABLE_PUSH, 1) == 0) {
+    LOG(ERROR) << "Received PUSH_PROMISE we can't accept";
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  unique_ptr<IOBuf> fragment;
+  uint32_t promisedStream = 0;
+  auto err = http2::parsePushPromise(cursor, curHeader_, promisedStream,
+                                     fragment);
+  RETURN_IF_ERROR(err);
+  if ((promisedStream & 0x1) == 1 || promisedStream <= lastStreamID_) {
+    LOG(ERROR) << "Invalid promised stream=" << promisedStream
+               << " lastStreamID_=" << lastStreamID_;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  headerBlockHeader_ = curHeader_;
+  headerBlockPriority_ = boost::none;
+  promisedStream_ = promisedStream;
+  return onHeaderBlockFragment(std::move(fragment));
+}
+
+ErrorCode HTTP2Codec::parseContinuation(Cursor& cursor) {
+  if (expectedContinuationStream_ == 0) {
+    LOG(ERROR) << "Unexpected CONTINUATION for stream=" << curHeader_.stream;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  unique_ptr<IOBuf> fragment;
+  auto err = http2::parseContinuation(cursor, curHeader_, fragment);
+  RETURN_IF_ERROR(err);
+  return onHeaderBlockFragment(std::move(fragment));
+}
+
+ErrorCode HTTP2Codec::onHeaderBlockFragment(unique_ptr<IOBuf> fragment) {
+  if (fragment) {
+    headerBlockFrames_.append(std::move(fragment));
+  }
+  // a block is hardly ever larger compressed than decoded, so there is no
+  // point waiting for the CONTINUATION frames of one already over the limit
+  if (maxHeaderBlock_ > 0 &&
+      headerBlockFrames_.chainLength() > maxHeaderBlock_) {
+    LOG(ERROR) << "Header block of " << headerBlockFrames_.chainLength()
+               << " bytes for stream=" << curHeader_.stream
+               << " exceeds the limit of " << maxHeaderBlock_;
+    headerBlockFrames_.move();
+    return ErrorCode::ENHANCE_YOUR_CALM;
+  }
+  if (!(curHeader_.flags & http2::END_HEADERS)) {
+    expectedContinuationStream_ = curHeader_.stream;
+    return ErrorCode::NO_ERROR;
+  }
+  expectedContinuationStream_ = 0;
+  return onHeaderBlockComplete();
+}
+
+ErrorCode HTTP2Codec::onHeaderBlockComplete() {
+  const StreamID frameStream = headerBlockHeader_.stream;
+  const StreamID stream = promisedStream_ ? promisedStream_ : frameStream;
+  const bool endStream = !promisedStream_ &&
+    (headerBlockHeader_.flags & http2::END_STREAM);
+
+  // Work out what the block should hold before decoding it
+  MessageBuilder::Type type = MessageBuilder::Type::REQUEST;
+  unique_ptr<HTTPMessage> promisedRequest;
+  StreamID assocStream = HTTPCodec::NoStream;
+  bool isNewStream = false;
+  bool mayBeTrailers = false;
+  if (promisedStream_) {
+    if (isIdleStream(frameStream)) {
+      LOG(ERROR) << "PUSH_PROMISE on idle stream=" << frameStream;
+      return ErrorCode::PROTOCOL_ERROR;
+    }
+    isNewStream = true;
+  } else if (transportDirection_ == TransportDirection::DOWNSTREAM) {
+    if ((stream & 0x1) == 0) {
+      LOG(ERROR) << "Invalid client stream=" << stream;
+      return ErrorCode::PROTOCOL_ERROR;
+    }
+    isNewStream = isIdleStream(stream);
+    mayBeTrailers = !isNewStream;
+  } else {
+    auto it = pendingPushes_.find(stream);
+    if (it != pendingPushes_.end()) {
+      type = MessageBuilder::Type::PUSHED_RESPONSE;
+      assocStream = it->second.first;
+      promisedRequest = std::move(it->second.second);
+      pendingPushes_.erase(it);
+      isNewStream = true;
+    } else if (isIdleStream(stream)) {
+      LOG(ERROR) << "HEADERS for idle stream=" << stream;
+      return ErrorCode::PROTOCOL_ERROR;
+    } else {
+      type = MessageBuilder::Type::RESPONSE;
+      mayBeTrailers = true;
+    }
+  }
+
+  // The block has to be decoded even if the stream is refused, to keep the
+  // compression context in sync with the peer
+  MessageBuilder builder(type, std::move(promisedRequest));
+  unique_ptr<IOBuf> block = headerBlockFrames_.move();
+  if (!block) {
+    block = IOBuf::create(0);
+  }
+  const uint32_t blockLength = block->computeChainDataLength();
+  Cursor blockCursor(block.get());
+  auto result = headerCodec_.decodeStreaming(blockCursor, blockLength,
+                                             builder);
+  if (result.isError() || result.ok() != blockLength) {
+    LOG(ERROR) << "Failed decoding header block for stream=" << stream;
+    return ErrorCode::COMPRESSION_ERROR;
+  }
+
+  if (mayBeTrailers && builder.isTrailers()) {
+    if (!endStream) {
+      failStream(false, stream, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 "Trailers without END_STREAM");
+      return ErrorCode::NO_ERROR;
+    }
+    unique_ptr<HTTPMessage> msg = builder.release();
+    if (builder.getFailReason()) {
+      failStream(false, stream, uint32_t(ErrorCode::PROTOCOL_ERROR),
+                 builder.getFailReason());
+      return ErrorCode::NO_ERROR;
+    }
+    callback_->onTrailersComplete(
+      stream, folly::make_unique<HTTPHeaders>(std::move(msg->getHeaders())));
+    callback_->onMessageComplete(stream, false);
+    return ErrorCode::NO_ERROR;
+  }
+  if (mayBeTrailers && type == MessageBuilder::Type::REQUEST) {
+    LOG(ERROR) << "Second request header block on stream=" << stream;
+    failStream(false, stream, uint32_t(ErrorCode::PROTOCOL_ERROR),
+               "Unexpected HEADERS");
+    return ErrorCode::NO_ERROR;
+  }
+
+  if (isNewStream) {
+    if (sessionClosing_ == ClosingState::CLOSING) {
+      VLOG(4) << "Dropping new stream after final GOAWAY, stream=" << stream;
+      return ErrorCode::NO_ERROR;
+    }
+    lastStreamID_ = stream;
+    if (!promisedStream_ && type == MessageBuilder::Type::REQUEST &&
+        callback_->numIncomingStreams() >=
+        egressSettings_.getSetting(SettingsId::MAX_CONCURRENT_STREAMS,
+                                   std::numeric_limits<uint32_t>::max())) {
+      failStream(true, stream, uint32_t(ErrorCode::REFUSED_STREAM));
+      return ErrorCode::NO_ERROR;
+    }
+  }
+
+  if (!builder.finish()) {
+    partialMsg_ = builder.release();
+    if (builder.getFailCode() >= 100) {
+      // Let the session answer the bad request
+      callback_->onMessageBegin(stream, nullptr);
+      failStream(false, stream, builder.getFailCode(),
+                 builder.getFailReason());
+    } else {
+      failStream(isNewStream, stream, builder.getFailCode(),
+                 builder.getFailReason());
+    }
+    return ErrorCode::NO_ERROR;
+  }
+
+  unique_ptr<HTTPMessage> msg = builder.release();
+  msg->setIngressHeaderSize(headerCodec_.getDecodedSize());
+  if (headerBlockPriority_) {
+    msg->setPriority(weightToPriority(headerBlockPriority_->weight));
+    msg->setHTTP2Priority(toHTTPPriority(*headerBlockPriority_));
+  }
+  if (promisedStream_) {
+    // Delivered with the response HEADERS of the promised stream
+    pendingPushes_[promisedStream_] =
+      std::make_pair(frameStream, std::move(msg));
+    return ErrorCode::NO_ERROR;
+  }
+  if (type == MessageBuilder::Type::PUSHED_RESPONSE) {
+    callback_->onPushMessageBegin(stream, assocStream, msg.get());
+  } else {
+    callback_->onMessageBegin(stream, msg.get());
+  }
+  callback_->onHeadersComplete(stream, std::move(msg));
+  if (endStream) {
+    callback_->onMessageComplete(stream, false);
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseRstStream(Cursor& cursor) {
+  ErrorCode code = ErrorCode::NO_ERROR;
+  auto err = http2::parseRstStream(cursor, curHeader_, code);
+  RETURN_IF_ERROR(err);
+  if (isIdleStream(curHeader_.stream)) {
+    LOG(ERROR) << "RST_STREAM for idle stream=" << curHeader_.stream;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  VLOG(4) << "Got RST_STREAM, stream=" << curHeader_.stream
+          << ", code=" << getErrorCodeString(code);
+  pendingPushes_.erase(curHeader_.stream);
+  callback_->onAbort(curHeader_.stream, code);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseSettings(Cursor& cursor) {
+  std::deque<SettingPair> settings;
+  auto err = http2::parseSettings(cursor, curHeader_, settings);
+  RETURN_IF_ERROR(err);
+  if (curHeader_.flags & http2::ACK) {
+    VLOG(4) << "Got SETTINGS ack";
+    if (!pendingTableSizes_.empty()) {
+      // the peer's encoder is bound by the acknowledged table size now, and
+      // by the ones we sent since
+      uint32_t maxSize = pendingTableSizes_.front();
+      pendingTableSizes_.pop_front();
+      for (auto size : pendingTableSizes_) {
+        maxSize = std::max(maxSize, size);
+      }
+      headerCodec_.setDecoderHeaderTableMaxSize(maxSize);
+    }
+    callback_->onSettingsAck();
+    return ErrorCode::NO_ERROR;
+  }
+  VLOG(4) << "Got " << settings.size() << " settings";
+  SettingsList settingsList;
+  err = applySettings(settings, settingsList);
+  RETURN_IF_ERROR(err);
+  callback_->onSettings(settingsList);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::applySettings(const std::deque<SettingPair>& settings,
+                                    SettingsList& settingsList) {
+  for (const auto& setting: settings) {
+    switch (setting.first) {
+      case SettingsId::HEADER_TABLE_SIZE:
+        // the peer's decoder allows this much, we may use less
+        headerCodec_.setEncoderHeaderTableSize(
+          std::min(setting.second, headerTableSize_));
+        break;
+      case SettingsId::ENABLE_PUSH:
+        if (setting.second > 1 ||
+            (setting.second == 1 &&
+             transportDirection_ == TransportDirection::UPSTREAM)) {
+          LOG(ERROR) << "Invalid ENABLE_PUSH=" << setting.second;
+          return ErrorCode::PROTOCOL_ERROR;
+        }
+        break;
+      case SettingsId::MAX_CONCURRENT_STREAMS:
+        break;
+      case SettingsId::INITIAL_WINDOW_SIZE:
+        if (setting.second > http2::kMaxWindowUpdateSize) {
+          LOG(ERROR) << "Invalid INITIAL_WINDOW_SIZE=" << setting.second;
+          return ErrorCode::FLOW_CONTROL_ERROR;
+        }
+        break;
+      case SettingsId::MAX_FRAME_SIZE:
+        if (setting.second < http2::kMaxFramePayloadLengthMin ||
+            setting.second > http2::kMaxFramePayloadLength) {
+          LOG(ERROR) << "Invalid MAX_FRAME_SIZE=" << setting.second;
+          return ErrorCode::PROTOCOL_ERROR;
+        }
+        break;
+      case SettingsId::MAX_HEADER_LIST_SIZE:
+        break;
+      default:
+        // the framer only passes up HTTP/2 settings
+        LOG(DFATAL) << "Unexpected setting id=" << uint32_t(setting.first);
+        continue;
+    }
+    ingressSettings_.setSetting(setting.first, setting.second);
+    settingsList.push_back(*ingressSettings_.getSetting(setting.first));
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+bool HTTP2Codec::onIngressUpgrade(folly::StringPiece http2Settings) {
+  DCHECK(transportDirection_ == TransportDirection::DOWNSTREAM);
+  DCHECK(lastStreamID_ == 0);
+  string payload;
+  if (!base64UrlDecode(http2Settings, payload)) {
+    VLOG(4) << "Invalid HTTP2-Settings encoding";
+    return false;
+  }
+  auto buf = IOBuf::wrapBuffer(payload.data(), payload.size());
+  Cursor cursor(buf.get());
+  http2::FrameHeader header{uint32_t(payload.size()), 0,
+      http2::FrameType::SETTINGS, 0};
+  std::deque<SettingPair> settings;
+  SettingsList settingsList;
+  if (http2::parseSettings(cursor, header, settings) != ErrorCode::NO_ERROR ||
+      applySettings(settings, settingsList) != ErrorCode::NO_ERROR) {
+    VLOG(4) << "Invalid HTTP2-Settings";
+    return false;
+  }
+  // the request is stream 1, half closed from the client
+  lastStreamID_ = 1;
+  return true;
+}
+
+ErrorCode HTTP2Codec::parsePing(Cursor& cursor) {
+  uint64_t opaqueData = 0;
+  auto err = http2::parsePing(cursor, curHeader_, opaqueData);
+  RETURN_IF_ERROR(err);
+  if (curHeader_.flags & http2::ACK) {
+    callback_->onPingReply(opaqueData);
+  } else {
+    callback_->onPingRequest(opaqueData);
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseGoaway(Cursor& cursor) {
+  uint32_t lastGoodStream = 0;
+  ErrorCode code = ErrorCode::NO_ERROR;
+  unique_ptr<IOBuf> debugData;
+  auto err = http2::parseGoaway(cursor, curHeader_, lastGoodStream, code,
+                                debugData);
+  RETURN_IF_ERROR(err);
+  VLOG(4) << "Got GOAWAY, lastGoodStream=" << lastGoodStream
+          << ", code=" << getErrorCodeString(code);
+  if (lastGoodStream < ingressGoawayAck_) {
+    ingressGoawayAck_ = lastGoodStream;
+    // Drain all streams <= lastGoodStream
+    // and abort streams > lastGoodStream
+    callback_->onGoaway(lastGoodStream, code);
+  } else {
+    LOG(WARNING) << "Received multiple GOAWAY with increasing ack";
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode HTTP2Codec::parseWindowUpdate(Cursor& cursor) {
+  uint32_t delta = 0;
+  auto err = http2::parseWindowUpdate(cursor, curHeader_, delta);
+  RETURN_IF_ERROR(err);
+  if (delta == 0) {
+    if (curHeader_.stream == 0) {
+      LOG(ERROR) << "Invalid connection WINDOW_UPDATE with delta 0";
+      return ErrorCode::PROTOCOL_ERROR;
+    }
+    failStream(false, curHeader_.stream, uint32_t(ErrorCode::PROTOCOL_ERROR),
+               "WINDOW_UPDATE with delta 0");
+    return ErrorCode::NO_ERROR;
+  }
+  if (curHeader_.stream != 0 && isIdleStream(curHeader_.stream)) {
+    LOG(ERROR) << "WINDOW_UPDATE for idle stream=" << curHeader_.stream;
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  callback_->onWindowUpdate(curHeader_.stream, delta);
+  return ErrorCode::NO_ERROR;
+}
+
+bool HTTP2Codec::isReusable() const {
+  return (sessionClosing_ == ClosingState::OPEN ||
+          sessionClosing_ == ClosingState::OPEN_WITH_GRACEFUL_DRAIN_ENABLED ||
+          (transportDirection_ == TransportDirection::DOWNSTREAM &&
+           isWaitingToDrain()))
+    && (ingressGoawayAck_ == std::numeric_limits<uint32_t>::max());
+}
+
+bool HTTP2Codec::isWaitingToDrain() const {
+  return sessionClosing_ == ClosingState::FIRST_GOAWAY_SENT;
+}
+
+size_t HTTP2Codec::generateConnectionPreface(IOBufQueue& writeBuf) {
+  if (transportDirection_ != TransportDirection::UPSTREAM) {
+    // servers start with their SETTINGS
+    return 0;
+  }
+  VLOG(4) << "generating connection preface";
+  writeBuf.append(http2::kConnectionPreface);
+  return http2::kConnectionPreface.size();
+}
+
+unique_ptr<IOBuf> HTTP2Codec::encodeHeaders(
+  const HTTPMessage& msg, vector<Header>& allHeaders, HTTPHeaderSize* size) {
+
+  // Add the HTTP headers supplied by the caller, but skip the connection
+  // specific ones. Host was turned into :authority.
+  msg.getHeaders().forEachWithCode([&] (HTTPHeaderCode code,
+                                        const string& name,
+                                        const string& value) {
+    if (perHopHeaderCodes_[code] || code == HTTP_HEADER_HOST ||
+        code == HTTP_HEADER_TE) {
+      VLOG(3) << "Dropping HTTP/2 connection specific header " << name;
+      return;
+    }
+    if (name.empty() || name[0] == ':') {
+      VLOG(2) << "Dropping header with invalid name \"" << name << "\"";
+      return;
+    }
+    allHeaders.emplace_back(code, name, value);
+  });
+  // HPACK has no serialization the cached headers could reuse
+  if (const HTTPCachedHeaders* cached = msg.getCachedHeaders().get()) {
+    cached->getHeaders().forEachWithCode([&] (HTTPHeaderCode code,
+                                              const string& name,
+                                              const string& value) {
+      allHeaders.emplace_back(code, name, value);
+    });
+  }
+
+  auto out = headerCodec_.encode(allHeaders);
+  if (size) {
+    *size = headerCodec_.getEncodedSize();
+  }
+  return out;
+}
+
+unique_ptr<IOBuf> HTTP2Codec::encodeRequestHeaders(
+  const HTTPMessage& msg, bool isPushPromise, HTTPHeaderSize* size) {
+
+  const HTTPHeaders& headers = msg.getHeaders();
+  vector<Header> allHeaders;
+  allHeaders.reserve(headers.size() + 4);
+
+  const string& method = msg.getMethodString();
+  const string& scheme = msg.isSecure() ? http2::kHttps : http2::kHttp;
+  string authority = headers.getSingleOrEmpty(HTTP_HEADER_HOST);
+  string path = msg.getURL();
+  if (!path.empty() && path[0] != '/' && path != "*") {
+    // :path only holds the path and query of absolute URLs
+    ParseURL url(path);
+    if (url.valid()) {
+      if (authority.empty()) {
+        authority = url.hostAndPort();
+      }
+      string relative = url.path().empty() ? "/" : url.path().str();
+      if (!url.query().empty()) {
+        relative.append("?");
+        relative.append(url.query().data(), url.query().size());
+      }
+      path = std::move(relative);
+    }
+  }
+
+  allHeaders.emplace_back(http2::kMethod, method);
+  allHeaders.emplace_back(http2::kScheme, scheme);
+  if (!authority.empty()) {
+    allHeaders.emplace_back(http2::kAuthority, authority);
+  }
+  allHeaders.emplace_back(http2::kPath, path);
+
+  if (isPushPromise) {
+    auto out = headerCodec_.encode(allHeaders);
+    if (size) {
+      *size = headerCodec_.getEncodedSize();
+    }
+    return out;
+  }
+  return encodeHeaders(msg, allHeaders, size);
+}
+
+unique_ptr<IOBuf> HTTP2Codec::encodeResponseHeaders(
+  const HTTPMessage& msg, bool isPushed, HTTPHeaderSize* size) {
+
+  const HTTPHeaders& headers = msg.getHeaders();
+  vector<Header> allHeaders;
+  allHeaders.reserve(headers.size() + 2);
+
+  // pushed messages are built like requests and don't carry a status
+  const string status = isPushed ? "200" :
+    folly::to<string>(msg.getStatusCode());
+  allHeaders.emplace_back(http2::kStatus, status);
+  // The cached date string is thread-local and outlives this call, so we
+  // can point at it directly
+  if (!headers.exists(HTTP_HEADER_DATE)) {
+    allHeaders.emplace_back(HTTP_HEADER_DATE, getCachedHTTPDateTime());
+  }
+  return encodeHeaders(msg, allHeaders, size);
+}
+
+uint32_t HTTP2Codec::getMaxSendFrameSize() const {
+  return ingressSettings_.getSetting(SettingsId::MAX_FRAME_SIZE,
+                                     http2::kMaxFramePayloadLengthMin);
+}
+
+size_t HTTP2Codec::generateHeaderFrames(
+  IOBufQueue& writeBuf,
+  StreamID stream,
+  StreamID promisedStream,
+  unique_ptr<IOBuf> block,
+  boost::optional<http2::PriorityUpdate> priority,
+  bool endStream) {
+
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  queue.append(std::move(block));
+  const uint32_t maxFrameSize = getMaxSendFrameSize();
+  // the first frame also carries the priority or the promised stream
+  const uint32_t firstFrameSize = maxFrameSize -
+    (priority ? http2::kFramePrioritySize : 0) -
+    (promisedStream ? http2::kFrameStreamIDSize : 0);
+
+  bool endHeaders = queue.chainLength() <= firstFrameSize;
+  auto chunk = queue.split(std::min<size_t>(firstFrameSize,
+                                            queue.chainLength()));
+  size_t written = 0;
+  if (promisedStream) {
+    written = http2::writePushPromise(writeBuf, stream, promisedStream,
+                                      std::move(chunk), boost::none,
+                                      endHeaders);
+  } else {
+    written = http2::writeHeaders(writeBuf, std::move(chunk), stream,
+                                  priority, boost::none, endStream,
+                                  endHeaders);
+  }
+  while (!endHeaders) {
+    endHeaders = queue.chainLength() <= maxFrameSize;
+    chunk = queue.split(std::min<size_t>(maxFrameSize, queue.chainLength()));
+    written += http2::writeContinuation(writeBuf, stream, endHeaders,
+                                        std::move(chunk));
+  }
+  return written;
+}
+
+void HTTP2Codec::generateHeader(IOBufQueue& writeBuf,
+                                StreamID stream,
+                                const HTTPMessage& msg,
+                                StreamID assocStream,
+                                HTTPHeaderSize* size) {
+  if (assocStream != HTTPCodec::NoStream) {
+    // Pushed streams must have an even streamId and an odd assocStream
+    CHECK(transportDirection_ == TransportDirection::DOWNSTREAM &&
+          (stream % 2 == 0) && (assocStream % 2 == 1)) <<
+      "Invalid stream ids stream=" << stream << " assocStream=" << assocStream;
+    // The request goes into the PUSH_PROMISE on the associated stream, and
+    // the headers into the response HEADERS on the pushed stream. Both have
+    // to be encoded in the order they are written.
+    auto promise = encodeRequestHeaders(msg, true, nullptr);
+    generateHeaderFrames(writeBuf, assocStream, stream, std::move(promise),
+                         boost::none, false);
+    generateHeaderFrames(writeBuf, stream, 0,
+                         encodeResponseHeaders(msg, true, size),
+                         boost::none, false);
+  } else if (transportDirection_ == TransportDirection::UPSTREAM) {
+    http2::PriorityUpdate priority{0, false,
+        priorityToWeight(msg.getPriority())};
+    if (msg.getHTTP2Priority()) {
+      const auto& http2Priority = *msg.getHTTP2Priority();
+      priority = {http2Priority.streamDependency, http2Priority.exclusive,
+                  uint8_t(http2Priority.weight - 1)};
+    }
+    generateHeaderFrames(writeBuf, stream, 0,
+                         encodeRequestHeaders(msg, false, size),
+                         priority, false);
+  } else {
+    generateHeaderFrames(writeBuf, stream, 0,
+                         encodeResponseHeaders(msg, false, size),
+                         boost::none, false);
+  }
+}
+
+size_t HTTP2Codec::generateBody(IOBufQueue& writeBuf,
+                                StreamID stream,
+                                unique_ptr<IOBuf> chain,
+                                bool eom) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  queue.append(std::move(chain));
+  if (queue.chainLength() == 0) {
+    return eom ? generateEOM(writeBuf, stream) : 0;
+  }
+  if (eom && pendingTrailers_.count(stream)) {
+    // the trailers end the stream instead
+    size_t written = generateBody(writeBuf, stream, queue.move(), false);
+    return written + generateEOM(writeBuf, stream);
+  }
+
+  // Split the body into frames the peer accepts
+  const uint32_t maxFrameSize = getMaxSendFrameSize();
+  size_t written = 0;
+  while (queue.chainLength() > maxFrameSize) {
+    written += http2::writeData(writeBuf, queue.split(maxFrameSize), stream,
+                                boost::none, false);
+  }
+  written += http2::writeData(writeBuf, queue.move(), stream, boost::none,
+                              eom);
+  return written;
+}
+
+size_t HTTP2Codec::generateTrailers(IOBufQueue& writeBuf,
+                                    StreamID stream,
+                                    const HTTPHeaders& trailers) {
+  // The trailers have to be in the HEADERS frame that ends the stream, so
+  // generateEOM sends them. They are encoded then too: the HPACK context
+  // must see the header blocks in the order they go on the wire.
+  pendingTrailers_[stream] = trailers;
+  return 0;
+}
+
+size_t HTTP2Codec::generateEOM(IOBufQueue& writeBuf,
+                               StreamID stream) {
+  VLOG(4) << "sending EOM for stream=" << stream;
+  auto it = pendingTrailers_.find(stream);
+  if (it == pendingTrailers_.end()) {
+    return http2::writeData(writeBuf, nullptr, stream, boost::none, true);
+  }
+
+  vector<Header> allHeaders;
+  allHeaders.reserve(it->second.size());
+  it->second.forEachWithCode([&] (HTTPHeaderCode code,
+                                  const string& name,
+                                  const string& value) {
+    if (perHopHeaderCodes_[code] || name.empty() || name[0] == ':') {
+      VLOG(3) << "Dropping invalid trailer " << name;
+      return;
+    }
+    allHeaders.emplace_back(code, name, value);
+  });
+  auto block = headerCodec_.encode(allHeaders);
+  size_t written = generateHeaderFrames(writeBuf, stream, 0,
+                                        std::move(block), boost::none, true);
+  pendingTrailers_.erase(it);
+  return written;
+}
+
+size_t HTTP2Codec::generateRstStream(IOBufQueue& writeBuf,
+                                     StreamID stream,
+                                     ErrorCode code) {
+  DCHECK(stream > 0);
+  VLOG(4) << "sending RST_STREAM for stream=" << stream
+          << " with code=" << getErrorCodeString(code);
+  pendingTrailers_.erase(stream);
+  pendingPushes_.erase(stream);
+  if (code == ErrorCode::_SPDY_INVALID_STREAM) {
+    // Only a SPDY code, the session uses it for streams it doesn't know
+    code = ErrorCode::PROTOCOL_ERROR;
+  }
+  return http2::writeRstStream(writeBuf, stream, code);
+}
+
+size_t HTTP2Codec::generateGoaway(IOBufQueue& writeBuf,
+                                  StreamID lastStream,
+                                  ErrorCode code) {
+  if (sessionClosing_ == ClosingState::CLOSING) {
+    VLOG(4) << "Not sending GOAWAY for closed session";
+    return 0;
+  }
+  if (code == ErrorCode::_SPDY_INVALID_STREAM) {
+    code = ErrorCode::PROTOCOL_ERROR;
+  }
+
+  VLOG(4) << "Sending GOAWAY with last acknowledged stream="
+          << lastStream << " with code=" << getErrorCodeString(code);
+
+  switch (sessionClosing_) {
+    case ClosingState::OPEN:
+      sessionClosing_ = ClosingState::CLOSING;
+      break;
+    case ClosingState::OPEN_WITH_GRACEFUL_DRAIN_ENABLED:
+      if (code == ErrorCode::NO_ERROR &&
+          lastStream == std::numeric_limits<int32_t>::max()) {
+        sessionClosing_ = ClosingState::FIRST_GOAWAY_SENT;
+      } else {
+        // The user of this codec decided not to do the double goaway
+        // drain
+        sessionClosing_ = ClosingState::CLOSING;
+      }
+      break;
+    case ClosingState::FIRST_GOAWAY_SENT:
+      sessionClosing_ = ClosingState::CLOSING;
+      break;
+    case ClosingState::CLOSING:
+      break;
+  }
+  return http2::writeGoaway(writeBuf, lastStream, code);
+}
+
+size_t HTTP2Codec::generatePingRequest(IOBufQueue& writeBuf) {
+  const auto id = nextEgressPingID_++;
+  VLOG(4) << "Generating ping request with id=" << id;
+  return http2::writePing(writeBuf, id, false);
+}
+
+size_t HTTP2Codec::generatePingReply(IOBufQueue& writeBuf,
+                                     uint64_t uniqueID) {
+  VLOG(4) << "Generating ping reply with id=" << uniqueID;
+  return http2::writePing(writeBuf, uniqueID, true);
+}
+
+size_t HTTP2Codec::generateSettings(IOBufQueue& writeBuf) {
+  std::deque<SettingPair> settings;
+  for (const auto& setting: egressSettings_.getAllSettings()) {
+    if (!setting.isSet) {
+      continue;
+    }
+    if (uint32_t(setting.id) & SPDY_SETTINGS_MASK) {
+      LOG(WARNING) << "Skipping SPDY only setting " << uint32_t(setting.id);
+      continue;
+    }
+    VLOG(5) << " writing setting with id=" << uint32_t(setting.id)
+            << ", value=" << setting.value;
+    settings.push_back(SettingPair(setting.id, setting.value));
+  }
+  // A larger table can be used by the peer as soon as it gets the
+  // SETTINGS, a smaller one only binds it once it acknowledged them
+  uint32_t tableSize = egressSettings_.getSetting(SettingsId::HEADER_TABLE_SIZE,
+                                                  http2::kTableSize);
+  pendingTableSizes_.push_back(tableSize);
+  if (tableSize > headerCodec_.getDecoderHeaderTableMaxSize()) {
+    headerCodec_.setDecoderHeaderTableMaxSize(tableSize);
+  }
+  VLOG(4) << "generating " << settings.size() << " settings";
+  return http2::writeSettings(writeBuf, settings);
+}
+
+size_t HTTP2Codec::generateSettingsAck(IOBufQueue& writeBuf) {
+  VLOG(4) << "generating settings ack";
+  return http2::writeSettingsAck(writeBuf);
+}
+
+size_t HTTP2Codec::generateWindowUpdate(IOBufQueue& writeBuf,
+                                        StreamID stream,
+                                        uint32_t delta) {
+  if (delta == 0) {
+    return 0;
+  }
+  VLOG(4) << "generating window update for stream=" << stream
+          << ": Processed " << delta << " bytes";
+  return http2::writeWindowUpdate(writeBuf, stream, delta);
+}
+
+void HTTP2Codec::enableDoubleGoawayDrain() {
+  CHECK_EQ(sessionClosing_, ClosingState::OPEN);
+  sessionClosing_ = ClosingState::OPEN_WITH_GRACEFUL_DRAIN_ENABLED;
+}
+
+bool HTTP2Codec::supportsNextProtocol(const std::string& protocol) {
+  return protocol == http2::kProtocolString ||
+    protocol == http2::kProtocolDraftString;
+}
+
+HTTP2Codec::MessageBuilder::MessageBuilder(Type type,
+                                           unique_ptr<HTTPMessage> msg)
+    : type_(type),
+      msg_(std::move(msg)) {
+  if (!msg_) {
+    msg_ = ObjectPool<HTTPMessage>::get().acquire();
+    msg_->setHTTPVersion(1, 1);
+  }
+}
+
+void HTTP2Codec::MessageBuilder::fail(const char* reason) {
+  if (failed_) {
+    return;
+  }
+  failed_ = true;
+  failCode_ = (type_ == Type::REQUEST) ?
+    400 : uint32_t(ErrorCode::PROTOCOL_ERROR);
+  failReason_ = reason;
+}
+
+void HTTP2Codec::MessageBuilder::onHeader(StringPiece name,
+                                          StringPiece value,
+                                          bool multiValued) noexcept {
+  if (failed_) {
+    // keep the message as it was when the error was found
+    return;
+  }
+  VLOG(5) << "Header " << name << ": " << value;
+  if (name.empty()) {
+    fail("Empty header name");
+    return;
+  }
+  if (name[0] == ':') {
+    if (hasRegularHeaders_) {
+      fail("Pseudo-header after regular header");
+      return;
+    }
+    hasPseudoHeaders_ = true;
+    onPseudoHeader(name, value);
+    return;
+  }
+
+  hasRegularHeaders_ = true;
+  if (hasUppercase(name)) {
+    fail("Uppercase header name");
+    return;
+  }
+  if (!SPDYUtil::validateHeaderName(name) ||
+      !SPDYUtil::validateHeaderValue(value, SPDYUtil::STRICT)) {
+    fail("Bad header value");
+    return;
+  }
+  const HTTPHeaderCode code = HTTPCommonHeaders::hash(name.data(),
+                                                      name.size());
+  if (perHopHeaderCodes_[code] ||
+      (code == HTTP_HEADER_TE && value != "trailers")) {
+    fail("Connection specific header");
+    return;
+  }
+  HTTPHeaders& headers = msg_->getHeaders();
+  if (code == HTTP_HEADER_OTHER) {
+    headers.add(name, value);
+  } else {
+    headers.add(code, value.str());
+  }
+}
+
+void HTTP2Codec::MessageBuilder::onPseudoHeader(StringPiece name,
+                                                StringPiece value) {
+  bool* seen = nullptr;
+  if (type_ == Type::REQUEST) {
+    if (name == http2::kMethod) {
+      seen = &hasMethod_;
+    } else if (name == http2::kScheme) {
+      seen = &hasScheme_;
+    } else if (name == http2::kPath) {
+      seen = &hasPath_;
+    } else if (name != http2::kAuthority) {
+      fail("Invalid request pseudo-header");
+      return;
+    }
+  } else if (name == http2::kStatus) {
+    seen = &hasStatus_;
+  } else {
+    fail("Invalid response pseudo-header");
+    return;
+  }
+  if (seen) {
+    if (*seen) {
+      fail("Duplicate pseudo-header");
+      return;
+    }
+    *seen = true;
+  }
+
+  if (name == http2::kMethod) {
+    // We don't support CONNECT request for HTTP/2
+    if (!SPDYUtil::validateMethod(value) || value == "CONNECT") {
+      fail("Bad method");
+      return;
+    }
+    msg_->setMethod(value);
+  } else if (name == http2::kScheme) {
+    if (value == http2::kHttps) {
+      msg_->setSecure(true);
+    } else if (value != http2::kHttp) {
+      fail("Bad scheme");
+    }
+  } else if (name == http2::kPath) {
+    if (value.empty() || !SPDYUtil::validateURL(value)) {
+      fail("Bad path");
+      return;
+    }
+    msg_->setURL(value.str());
+  } else if (name == http2::kAuthority) {
+    if (!SPDYUtil::validateHeaderValue(value, SPDYUtil::STRICT)) {
+      fail("Bad authority");
+      return;
+    }
+    msg_->getHeaders().add(HTTP_HEADER_HOST, value.str());
+  } else {
+    DCHECK(name == http2::kStatus);
+    int32_t code = -1;
+    if (value.size() == 3) {
+      try {
+        code = folly::to<unsigned int>(value);
+      } catch (const std::range_error& ex) {
+      }
+    }
+    if (code < 100 || code > 999) {
+      fail("Invalid status code");
+      return;
+    }
+    // A pushed response is delivered in the promised request, like SPDY
+    // pushes are, so its status is only checked
+    if (type_ == Type::RESPONSE) {
+      msg_->setStatusCode(code);
+    }
+  }
+}
+
+bool HTTP2Codec::MessageBuilder::finish() {
+  if (!failed_) {
+    if (type_ == Type::REQUEST) {
+      if (!hasMethod_ || !hasScheme_ || !hasPath_) {
+        fail("Missing request pseudo-header");
+      }
+    } else if (!hasStatus_) {
+      fail("Missing :status");
+    }
+  }
+  return !failed_;
+}
+
+void HTTP2Codec::failStream(bool newStream, StreamID streamID,
+                            uint32_t code, const char* reason) {
+  HTTPException err(
+    code >= 100 ?
+    HTTPException::Direction::INGRESS :
+    HTTPException::Direction::INGRESS_AND_EGRESS,
+    kErrorParseHeader,
+    (reason && *reason) ? reason : "HTTP2Codec stream error");
+  err.setStreamID(streamID);
+  if (code >= 100) {
+    err.setHttpStatusCode(code);
+  } else {
+    err.setCodecStatusCode(ErrorCode(code));
+  }
+
+  if (partialMsg_) {
+    err.setPartialMsg(std::move(partialMsg_));
+  }
+  // store the ingress buffer
+  if (currentIngressBuf_) {
+    err.setCurrentIngressBuf(std::move(currentIngressBuf_->clone()));
+  }
+  callback_->onError(streamID, err, newStream);
+}
+
+void HTTP2Codec::failSession(ErrorCode code) {
+  HTTPException err(HTTPException::Direction::INGRESS_AND_EGRESS,
+                    kErrorParseHeader, "HTTP2Codec session error");
+  err.setCodecStatusCode(code);
+
+  // store the ingress buffer
+  if (currentIngressBuf_) {
+    err.setCurrentIngressBuf(std::move(currentIngressBuf_->clone()));
+  }
+  callback_->onError(0, err);
+}
+
+}
@@ -0,0 +1,351 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <bitset>
+#include <boost/optional/optional.hpp>
+#include <deque>
+#include <folly/io/IOBufQueue.h>
+#include <limits>
+#include <map>
+#include <proxygen/lib/http/HTTPHeaders.h>
+#include <proxygen/lib/http/codec/HTTP2Constants.h>
+#include <proxygen/lib/http/codec/HTTP2Framer.h>
+#include <proxygen/lib/http/codec/HTTPCodec.h>
+#include <proxygen/lib/http/codec/HTTPSettings.h>
+#include <proxygen/lib/http/codec/compress/HPACKCodec.h>
+
+namespace proxygen {
+
+/**
+ * An implementation of the HTTP/2 framing layer. The header blocks are
+ * compressed with the HPACK implementation the SPDY/3.1-HPACK codec uses.
+ * Instances of this class must not be used from multiple threads
+ * concurrently.
+ */
+class HTTP2Codec: public HTTPCodec {
+public:
+  explicit HTTP2Codec(TransportDirection direction);
+  ~HTTP2Codec() override;
+
+  // HTTPCodec API
+  CodecProtocol getProtocol() const override {
+    return CodecProtocol::HTTP_2;
+  }
+  TransportDirection getTransportDirection() const override {
+    return transportDirection_;
+  }
+  bool supportsStreamFlowControl() const override { return true; }
+  bool supportsSessionFlowControl() const override { return true; }
+  uint32_t getDefaultWindowSize() const override {
+    return http2::kInitialWindow;
+  }
+  StreamID createStream() override;
+  void setCallback(Callback* callback) override { callback_ = callback; }
+  bool isBusy() const override { return false; }
+  void setParserPaused(bool paused) override {}
+  size_t onIngress(const folly::IOBuf& buf) override;
+  void onIngressEOF() override {}
+  bool isReusable() const override;
+  bool isWaitingToDrain() const override;
+  bool closeOnEgressComplete() const override { return false; }
+  bool supportsParallelRequests() const override { return true; }
+  bool supportsPushTransactions() const override { return true; }
+  size_t generateConnectionPreface(folly::IOBufQueue& writeBuf) override;
+  void generateHeader(folly::IOBufQueue& writeBuf,
+                      StreamID stream,
+                      const HTTPMessage& msg,
+                      StreamID assocStream = NoStream,
+                      HTTPHeaderSize* size = nullptr) override;
+  size_t generateBody(folly::IOBufQueue& writeBuf,
+                      StreamID stream,
+                      std::unique_ptr<folly::IOBuf> chain,
+                      bool eom) override;
+  size_t generateChunkHeader(folly::IOBufQueue& writeBuf,
+                             StreamID stream,
+                             size_t length) override {
+    // HTTP/2 has no chunked encoding, the body is framed in DATA frames
+    return 0;
+  }
+  size_t generateChunkTerminator(folly::IOBufQueue& writeBuf,
+                                 StreamID stream) override {
+    return 0;
+  }
+  size_t generateTrailers(folly::IOBufQueue& writeBuf,
+                          StreamID stream,
+                          const HTTPHeaders& trailers) override;
+  size_t generateEOM(folly::IOBufQueue& writeBuf,
+                     StreamID stream) override;
+  size_t generateRstStream(folly::IOBufQueue& writeBuf,
+                           StreamID stream,
+                           ErrorCode statusCode) override;
+  size_t generateGoaway(folly::IOBufQueue& writeBuf,
+                        StreamID lastStream,
+                        ErrorCode statusCode) override;
+  size_t generatePingRequest(folly::IOBufQueue& writeBuf) override;
+  size_t generatePingReply(folly::IOBufQueue& writeBuf,
+                           uint64_t uniqueID) override;
+  size_t generateSettings(folly::IOBufQueue& writeBuf) override;
+  size_t generateSettingsAck(folly::IOBufQueue& writeBuf) override;
+  size_t generateWindowUpdate(folly::IOBufQueue& writeBuf,
+                              StreamID stream,
+                              uint32_t delta) override;
+  HTTPSettings* getEgressSettings() override { return &egressSettings_; }
+  const HTTPSettings* getIngressSettings() const override {
+    return &ingressSettings_;
+  }
+  void enableDoubleGoawayDrain() override;
+  void setHeaderCodecStats(HeaderCodec::Stats* stats) override {
+    headerCodec_.setStats(stats);
+  }
+  void setMaxIngressHeaderSize(uint32_t maxBlock,
+                               uint32_t maxHeader) override;
+  size_t getMemoryUsage() const override;
+  void setHeaderTableSize(uint32_t size) override;
+  uint32_t getHeaderTableSize() const override {
+    return headerTableSize_;
+  }
+  StreamID getLastIncomingStreamID() const override { return lastStreamID_; }
+
+  /**
+   * @return true if the ALPN/NPN protocol string selects HTTP/2
+   */
+  static bool supportsNextProtocol(const std::string& protocol);
+
+  /**
+   * For a downstream codec that replaces HTTP/1.1 after an Upgrade to h2c:
+   * takes the HTTP2-Settings header of the request as the first SETTINGS
+   * of the client, without an ACK, and counts stream 1, which the request
+   * opened. The connection preface is still expected.
+   *
+   * @return false if the header is not a valid SETTINGS payload
+   */
+  bool onIngressUpgrade(folly::StringPiece http2Settings);
+
+ protected:
+  /**
+   * @param headerTableSize the capacity both HPACK tables start with
+   */
+  HTTP2Codec(TransportDirection direction, uint32_t headerTableSize);
+
+  /**
+   * Determines whether header with a given code is connection specific
+   * and must not be sent or received in HTTP/2.
+   */
+  static std::bitset<256> perHopHeaderCodes_;
+
+  static void initPerHopHeaders() __attribute__ ((__constructor__));
+
+  /**
+   * Builds the HTTPMessage of a header block while it is being decoded.
+   * An invalid header does not stop the decode, which has to consume the
+   * whole block to keep the compression state in sync; the first error is
+   * kept and reported after the block is done.
+   */
+  class MessageBuilder : public HeaderCodec::StreamingCallback {
+   public:
+    enum class Type {
+      REQUEST,
+      RESPONSE,
+      // the response HEADERS of a stream the peer promised
+      PUSHED_RESPONSE,
+    };
+
+    /**
+     * @param msg the message to add the headers to, a new one if nullptr
+     */
+    MessageBuilder(Type type, std::unique_ptr<HTTPMessage> msg);
+
+    void onHeader(folly::StringPiece name, folly::StringPiece value,
+                  bool multiValued) noexcept override;
+
+    /**
+     * Run the checks that need the whole block.
+     *
+     * @return false if the block is not a valid message header, with the
+     * error in getFailCode() and getFailReason()
+     */
+    bool finish();
+
+    /**
+     * @return true if the block had no pseudo-headers, as trailers do
+     */
+    bool isTrailers() const {
+      return !hasPseudoHeaders_;
+    }
+
+    std::unique_ptr<HTTPMessage> release() {
+      return std::move(msg_);
+    }
+
+    // an HTTP status code for failed requests, and an ErrorCode otherwise
+    uint32_t getFailCode() const { return failCode_; }
+    const char* getFailReason() const { return failReason_; }
+
+   private:
+    void onPseudoHeader(folly::StringPiece name, folly::StringPiece value);
+    void fail(const char* reason);
+
+    Type type_;
+    std::unique_ptr<HTTPMessage> msg_;
+    bool hasPseudoHeaders_{false};
+    bool hasRegularHeaders_{false};
+    bool hasMethod_{false};
+    bool hasScheme_{false};
+    bool hasPath_{false};
+    bool hasStatus_{false};
+    bool failed_{false};
+    uint32_t failCode_{0};
+    const char* failReason_{nullptr};
+  };
+
+  /**
+   * Encodes the pseudo-headers and the message headers into a header block
+   */
+  std::unique_ptr<folly::IOBuf> encodeHeaders(
+    const HTTPMessage& msg,
+    std::vector<compress::Header>& allHeaders,
+    HTTPHeaderSize* size);
+
+  /**
+   * @param isPushPromise only encode the pseudo-headers of the promised
+   *                      request, the headers go into the pushed response
+   */
+  std::unique_ptr<folly::IOBuf> encodeRequestHeaders(
+    const HTTPMessage& msg, bool isPushPromise, HTTPHeaderSize* size);
+
+  std::unique_ptr<folly::IOBuf> encodeResponseHeaders(
+    const HTTPMessage& msg, bool isPushed, HTTPHeaderSize* size);
+
+  HTTPCodec::Callback* callback_{nullptr};
+  TransportDirection transportDirection_;
+  HPACKCodec headerCodec_;
+
+ private:
+  /**
+   * Parses the body of the current frame. The whole frame must be
+   * available in the cursor.
+   *
+   * @return a connection error, or NO_ERROR
+   */
+  ErrorCode parseFrame(folly::io::Cursor& cursor);
+  ErrorCode parseData(folly::io::Cursor& cursor);
+  ErrorCode parseHeaders(folly::io::Cursor& cursor);
+  ErrorCode parsePushPromise(folly::io::Cursor& cursor);
+  ErrorCode parseContinuation(folly::io::Cursor& cursor);
+  ErrorCode parseRstStream(folly::io::Cursor& cursor);
+  ErrorCode parseSettings(folly::io::Cursor& cursor);
+  ErrorCode applySettings(const std::deque<SettingPair>& settings,
+                          SettingsList& settingsList);
+  ErrorCode parsePing(folly::io::Cursor& cursor);
+  ErrorCode parseGoaway(folly::io::Cursor& cursor);
+  ErrorCode parseWindowUpdate(folly::io::Cursor& cursor);
+
+  /**
+   * Saves part of a header block. The block is decoded once the frame
+   * with END_HEADERS is in.
+   */
+  ErrorCode onHeaderBlockFragment(std::unique_ptr<folly::IOBuf> fragment);
+
+  /**
+   * Decodes the complete header block of a HEADERS or PUSH_PROMISE frame
+   * and hands the message, trailers or error to the callback.
+   */
+  ErrorCode onHeaderBlockComplete();
+
+  /**
+   * @return true if neither side has opened the stream yet
+   */
+  bool isIdleStream(StreamID stream) const;
+
+  /**
+   * Writes a header block as a HEADERS or PUSH_PROMISE frame followed by
+   * as many CONTINUATION frames as the peer's maximum frame size requires.
+   */
+  size_t generateHeaderFrames(folly::IOBufQueue& writeBuf,
+                              StreamID stream,
+                              StreamID promisedStream,
+                              std::unique_ptr<folly::IOBuf> block,
+                              boost::optional<http2::PriorityUpdate> priority,
+                              bool endStream);
+
+  uint32_t getMaxSendFrameSize() const;
+
+  /**
+   * @param reason a string literal, see HTTPException
+   */
+  void failStream(bool newStream, StreamID streamID, uint32_t code,
+                  const char* reason = nullptr);
+
+  void failSession(ErrorCode code);
+
+  // Settings we received from, and sent to, the peer
+  HTTPSettings ingressSettings_{
+    {SettingsId::HEADER_TABLE_SIZE, http2::kTableSize},
+    {SettingsId::ENABLE_PUSH, 1},
+    {SettingsId::MAX_FRAME_SIZE, http2::kMaxFramePayloadLengthMin},
+    {SettingsId::INITIAL_WINDOW_SIZE, http2::kInitialWindow}
+  };
+  HTTPSettings egressSettings_{
+    {SettingsId::HEADER_TABLE_SIZE, http2::kTableSize},
+    {SettingsId::MAX_FRAME_SIZE, http2::kMaxFramePayloadLengthMin},
+    {SettingsId::INITIAL_WINDOW_SIZE, http2::kInitialWindow}
+  };
+
+  // the capacity of both header tables, see setHeaderTableSize()
+  uint32_t headerTableSize_{http2::kTableSize};
+  // HEADER_TABLE_SIZE of each SETTINGS frame the peer didn't acknowledge
+  std::deque<uint32_t> pendingTableSizes_;
+
+  const folly::IOBuf* currentIngressBuf_{nullptr};
+  std::unique_ptr<HTTPMessage> partialMsg_;
+
+  http2::FrameHeader curHeader_;
+  // the start of a header block waiting for its CONTINUATION frames
+  folly::IOBufQueue headerBlockFrames_{folly::IOBufQueue::cacheChainLength()};
+  // see setMaxIngressHeaderSize(), 0 for no limit before decoding
+  uint32_t maxHeaderBlock_{0};
+  http2::FrameHeader headerBlockHeader_;
+  boost::optional<http2::PriorityUpdate> headerBlockPriority_;
+  StreamID promisedStream_{0};
+  StreamID expectedContinuationStream_{0};
+
+  // Promised streams whose response HEADERS have not come in yet, with
+  // their associated stream and the promised request
+  std::map<StreamID,
+           std::pair<StreamID, std::unique_ptr<HTTPMessage>>> pendingPushes_;
+  // Trailers are sent in the HEADERS frame that ends the stream, so they
+  // are held until generateEOM
+  std::map<StreamID, HTTPHeaders> pendingTrailers_;
+
+  StreamID nextEgressStreamID_;
+  uint64_t nextEgressPingID_{1};
+  // the last stream the peer opened, or promised if we are upstream
+  StreamID lastStreamID_{0};
+  StreamID ingressGoawayAck_{std::numeric_limits<uint32_t>::max()};
+
+  enum class FrameState : uint8_t {
+    PREFACE = 0,
+    FRAME_HEADER = 1,
+    FRAME_DATA = 2,
+  } frameState_;
+
+  enum ClosingState {
+    OPEN = 0,
+    OPEN_WITH_GRACEFUL_DRAIN_ENABLED = 1,
+    FIRST_GOAWAY_SENT = 2,
+    CLOSING = 3,
+  } sessionClosing_:2;
+
+  // the first frame from the peer must be SETTINGS
+  bool needsSettings_:1;
+};
+
+}
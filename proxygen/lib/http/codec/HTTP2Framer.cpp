@@ -0,0 +1,484 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/HTTP2Framer.h>
+
+#include <functional>
+#include <glog/logging.h>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::io::Appender;
+using folly::io::Cursor;
+using std::unique_ptr;
+
+namespace proxygen { namespace http2 {
+
+namespace {
+
+const uint32_t kLengthMask = 0x00ffffff;
+const uint32_t kUint31Mask = 0x7fffffff;
+const uint32_t kExclusiveBit = 0x80000000;
+
+// bytes of the HEADERS, PUSH_PROMISE and DATA fields around the payload
+const size_t kMaxFrameOverhead = kFrameHeaderSize + 1 /* pad length */ +
+  kFramePrioritySize;
+
+const uint8_t kZeroPad[256] = {0};
+
+/**
+ * Writes a frame header plus the optional pad length and priority fields
+ * into a new buffer, then appends the payload and the padding.
+ *
+ * @param writeFields writes the frame specific fields that go before the
+ *                    payload, fieldsLength bytes in total
+ */
+size_t writeFrame(IOBufQueue& queue,
+                  FrameType type,
+                  uint8_t flags,
+                  uint32_t stream,
+                  boost::optional<uint8_t> padding,
+                  boost::optional<PriorityUpdate> priority,
+                  const std::function<void(Appender&)>& writeFields,
+                  uint32_t fieldsLength,
+                  unique_ptr<IOBuf> payload) noexcept {
+  uint32_t payloadLength = payload ? payload->computeChainDataLength() : 0;
+  uint32_t length = fieldsLength + payloadLength;
+  if (padding) {
+    flags |= PADDED;
+    length += 1 + *padding;
+  }
+  if (priority) {
+    flags |= PRIORITY;
+    length += kFramePrioritySize;
+  }
+  DCHECK_LE(length, kMaxFramePayloadLength);
+  DCHECK_EQ(0, stream & ~kUint31Mask);
+
+  auto frame = IOBuf::create(kMaxFrameOverhead + fieldsLength);
+  Appender appender(frame.get(), 0);
+  appender.writeBE<uint32_t>((length & kLengthMask) << 8 | uint8_t(type));
+  appender.writeBE<uint8_t>(flags);
+  appender.writeBE<uint32_t>(stream & kUint31Mask);
+  if (padding) {
+    appender.writeBE<uint8_t>(*padding);
+  }
+  if (priority) {
+    appender.writeBE<uint32_t>(
+      (priority->exclusive ? kExclusiveBit : 0) |
+      (priority->streamDependency & kUint31Mask));
+    appender.writeBE<uint8_t>(priority->weight);
+  }
+  if (writeFields) {
+    writeFields(appender);
+  }
+  queue.append(std::move(frame));
+  if (payload) {
+    queue.append(std::move(payload));
+  }
+  if (padding && *padding > 0) {
+    queue.append(kZeroPad, *padding);
+  }
+  return kFrameHeaderSize + length;
+}
+
+/**
+ * Reads the pad length field of a padded frame
+ *
+ * @param lefttoparse the bytes of the frame after the fields read so far,
+ *                    less the padding on return
+ */
+ErrorCode parsePadding(Cursor& cursor,
+                       const FrameHeader& header,
+                       uint8_t& padding,
+                       uint32_t& lefttoparse) noexcept {
+  padding = 0;
+  if (header.flags & PADDED) {
+    if (lefttoparse < 1) {
+      return ErrorCode::FRAME_SIZE_ERROR;
+    }
+    padding = cursor.read<uint8_t>();
+    lefttoparse--;
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode checkPadding(uint8_t padding,
+                       uint32_t& lefttoparse) noexcept {
+  if (padding > lefttoparse) {
+    // the padding must not be larger than the rest of the frame
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  lefttoparse -= padding;
+  return ErrorCode::NO_ERROR;
+}
+
+void parsePriorityCommon(Cursor& cursor,
+                         PriorityUpdate& priority) noexcept {
+  uint32_t dependency = cursor.readBE<uint32_t>();
+  priority.exclusive = (dependency & kExclusiveBit) != 0;
+  priority.streamDependency = dependency & kUint31Mask;
+  priority.weight = cursor.readBE<uint8_t>();
+}
+
+}
+
+const char* getFrameTypeString(FrameType type) {
+  switch (type) {
+    case FrameType::DATA: return "DATA";
+    case FrameType::HEADERS: return "HEADERS";
+    case FrameType::PRIORITY: return "PRIORITY";
+    case FrameType::RST_STREAM: return "RST_STREAM";
+    case FrameType::SETTINGS: return "SETTINGS";
+    case FrameType::PUSH_PROMISE: return "PUSH_PROMISE";
+    case FrameType::PING: return "PING";
+    case FrameType::GOAWAY: return "GOAWAY";
+    case FrameType::WINDOW_UPDATE: return "WINDOW_UPDATE";
+    case FrameType::CONTINUATION: return "CONTINUATION";
+  }
+  return "UNKNOWN";
+}
+
+ErrorCode toErrorCode(uint32_t code) {
+  if (code > kMaxErrorCode) {
+    return ErrorCode::INTERNAL_ERROR;
+  }
+  return ErrorCode(code);
+}
+
+void parseFrameHeader(Cursor& cursor, FrameHeader& header) noexcept {
+  uint32_t lengthAndType = cursor.readBE<uint32_t>();
+  header.length = lengthAndType >> 8;
+  header.type = FrameType(lengthAndType & 0xff);
+  header.flags = cursor.readBE<uint8_t>();
+  header.stream = cursor.readBE<uint32_t>() & kUint31Mask;
+}
+
+ErrorCode parseData(Cursor& cursor,
+                    const FrameHeader& header,
+                    unique_ptr<IOBuf>& outBuf,
+                    uint16_t& padding) noexcept {
+  DCHECK(header.type == FrameType::DATA);
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  uint32_t lefttoparse = header.length;
+  uint8_t padLength = 0;
+  auto err = parsePadding(cursor, header, padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  err = checkPadding(padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  // the pad length field is flow controlled as well
+  padding = (header.flags & PADDED) ? padLength + 1 : 0;
+  cursor.clone(outBuf, lefttoparse);
+  cursor.skip(padLength);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseHeaders(Cursor& cursor,
+                       const FrameHeader& header,
+                       boost::optional<PriorityUpdate>& outPriority,
+                       unique_ptr<IOBuf>& outBuf) noexcept {
+  DCHECK(header.type == FrameType::HEADERS);
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  uint32_t lefttoparse = header.length;
+  uint8_t padLength = 0;
+  auto err = parsePadding(cursor, header, padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  if (header.flags & PRIORITY) {
+    if (lefttoparse < kFramePrioritySize) {
+      return ErrorCode::FRAME_SIZE_ERROR;
+    }
+    PriorityUpdate priority;
+    parsePriorityCommon(cursor, priority);
+    outPriority = priority;
+    lefttoparse -= kFramePrioritySize;
+  } else {
+    outPriority = boost::none;
+  }
+  err = checkPadding(padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  cursor.clone(outBuf, lefttoparse);
+  cursor.skip(padLength);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parsePriority(Cursor& cursor,
+                        const FrameHeader& header,
+                        PriorityUpdate& outPriority) noexcept {
+  DCHECK(header.type == FrameType::PRIORITY);
+  if (header.length != kFramePrioritySize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  parsePriorityCommon(cursor, outPriority);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseRstStream(Cursor& cursor,
+                         const FrameHeader& header,
+                         ErrorCode& outCode) noexcept {
+  DCHECK(header.type == FrameType::RST_STREAM);
+  if (header.length != kFrameRstStreamSize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  outCode = toErrorCode(cursor.readBE<uint32_t>());
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseSettings(Cursor& cursor,
+                        const FrameHeader& header,
+                        std::deque<SettingPair>& settings) noexcept {
+  DCHECK(header.type == FrameType::SETTINGS);
+  if (header.stream != 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  if (header.flags & ACK) {
+    if (header.length != 0) {
+      return ErrorCode::FRAME_SIZE_ERROR;
+    }
+    return ErrorCode::NO_ERROR;
+  }
+  if (header.length % kFrameSettingSize != 0) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  for (uint32_t i = 0; i < header.length; i += kFrameSettingSize) {
+    uint16_t id = cursor.readBE<uint16_t>();
+    uint32_t value = cursor.readBE<uint32_t>();
+    if (id == 0 || id > uint16_t(SettingsId::MAX_HEADER_LIST_SIZE)) {
+      // An endpoint must ignore settings it does not understand
+      VLOG(4) << "Ignoring unknown setting id=" << id;
+      continue;
+    }
+    settings.push_back(SettingPair(SettingsId(id), value));
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parsePushPromise(Cursor& cursor,
+                           const FrameHeader& header,
+                           uint32_t& outPromisedStream,
+                           unique_ptr<IOBuf>& outBuf) noexcept {
+  DCHECK(header.type == FrameType::PUSH_PROMISE);
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  uint32_t lefttoparse = header.length;
+  uint8_t padLength = 0;
+  auto err = parsePadding(cursor, header, padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  if (lefttoparse < kFrameStreamIDSize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  outPromisedStream = cursor.readBE<uint32_t>() & kUint31Mask;
+  lefttoparse -= kFrameStreamIDSize;
+  if (outPromisedStream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  err = checkPadding(padLength, lefttoparse);
+  RETURN_IF_ERROR(err);
+  cursor.clone(outBuf, lefttoparse);
+  cursor.skip(padLength);
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parsePing(Cursor& cursor,
+                    const FrameHeader& header,
+                    uint64_t& outOpaqueData) noexcept {
+  DCHECK(header.type == FrameType::PING);
+  if (header.length != kFramePingSize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  if (header.stream != 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  outOpaqueData = cursor.readBE<uint64_t>();
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseGoaway(Cursor& cursor,
+                      const FrameHeader& header,
+                      uint32_t& outLastStreamID,
+                      ErrorCode& outCode,
+                      unique_ptr<IOBuf>& outDebugData) noexcept {
+  DCHECK(header.type == FrameType::GOAWAY);
+  if (header.length < kFrameGoawaySize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  if (header.stream != 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  outLastStreamID = cursor.readBE<uint32_t>() & kUint31Mask;
+  outCode = toErrorCode(cursor.readBE<uint32_t>());
+  uint32_t debugLength = header.length - kFrameGoawaySize;
+  if (debugLength > 0) {
+    cursor.clone(outDebugData, debugLength);
+  }
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseWindowUpdate(Cursor& cursor,
+                            const FrameHeader& header,
+                            uint32_t& outAmount) noexcept {
+  DCHECK(header.type == FrameType::WINDOW_UPDATE);
+  if (header.length != kFrameWindowUpdateSize) {
+    return ErrorCode::FRAME_SIZE_ERROR;
+  }
+  outAmount = cursor.readBE<uint32_t>() & kUint31Mask;
+  return ErrorCode::NO_ERROR;
+}
+
+ErrorCode parseContinuation(Cursor& cursor,
+                            const FrameHeader& header,
+                            unique_ptr<IOBuf>& outBuf) noexcept {
+  DCHECK(header.type == FrameType::CONTINUATION);
+  if (header.stream == 0) {
+    return ErrorCode::PROTOCOL_ERROR;
+  }
+  cursor.clone(outBuf, header.length);
+  return ErrorCode::NO_ERROR;
+}
+
+size_t writeData(IOBufQueue& writeBuf,
+                 unique_ptr<IOBuf> data,
+                 uint32_t stream,
+                 boost::optional<uint8_t> padding,
+                 bool endStream) noexcept {
+  DCHECK_NE(0, stream);
+  return writeFrame(writeBuf, FrameType::DATA,
+                    endStream ? END_STREAM : 0, stream,
+                    padding, boost::none, nullptr, 0, std::move(data));
+}
+
+size_t writeHeaders(IOBufQueue& writeBuf,
+                    unique_ptr<IOBuf> headers,
+                    uint32_t stream,
+                    boost::optional<PriorityUpdate> priority,
+                    boost::optional<uint8_t> padding,
+                    bool endStream,
+                    bool endHeaders) noexcept {
+  DCHECK_NE(0, stream);
+  uint8_t flags = (endStream ? END_STREAM : 0) |
+    (endHeaders ? END_HEADERS : 0);
+  return writeFrame(writeBuf, FrameType::HEADERS, flags, stream,
+                    padding, priority, nullptr, 0, std::move(headers));
+}
+
+size_t writePriority(IOBufQueue& writeBuf,
+                     uint32_t stream,
+                     PriorityUpdate priority) noexcept {
+  DCHECK_NE(0, stream);
+  // PRIORITY frames carry the same fields as HEADERS with the flag set,
+  // only without the flag
+  return writeFrame(writeBuf, FrameType::PRIORITY, 0, stream,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint32_t>(
+                        (priority.exclusive ? kExclusiveBit : 0) |
+                        (priority.streamDependency & kUint31Mask));
+                      appender.writeBE<uint8_t>(priority.weight);
+                    }, kFramePrioritySize, nullptr);
+}
+
+size_t writeRstStream(IOBufQueue& writeBuf,
+                      uint32_t stream,
+                      ErrorCode errorCode) noexcept {
+  DCHECK_NE(0, stream);
+  return writeFrame(writeBuf, FrameType::RST_STREAM, 0, stream,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint32_t>(uint32_t(errorCode));
+                    }, kFrameRstStreamSize, nullptr);
+}
+
+size_t writeSettings(IOBufQueue& writeBuf,
+                     const std::deque<SettingPair>& settings) noexcept {
+  return writeFrame(writeBuf, FrameType::SETTINGS, 0, 0,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      for (const auto& setting: settings) {
+                        appender.writeBE<uint16_t>(uint16_t(setting.first));
+                        appender.writeBE<uint32_t>(setting.second);
+                      }
+                    }, settings.size() * kFrameSettingSize, nullptr);
+}
+
+size_t writeSettingsAck(IOBufQueue& writeBuf) noexcept {
+  return writeFrame(writeBuf, FrameType::SETTINGS, ACK, 0,
+                    boost::none, boost::none, nullptr, 0, nullptr);
+}
+
+size_t writePushPromise(IOBufQueue& writeBuf,
+                        uint32_t associatedStream,
+                        uint32_t promisedStream,
+                        unique_ptr<IOBuf> headers,
+                        boost::optional<uint8_t> padding,
+                        bool endHeaders) noexcept {
+  DCHECK_NE(0, associatedStream);
+  DCHECK_NE(0, promisedStream);
+  return writeFrame(writeBuf, FrameType::PUSH_PROMISE,
+                    endHeaders ? END_HEADERS : 0, associatedStream,
+                    padding, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint32_t>(promisedStream & kUint31Mask);
+                    }, kFrameStreamIDSize, std::move(headers));
+}
+
+size_t writePing(IOBufQueue& writeBuf,
+                 uint64_t opaqueData,
+                 bool ack) noexcept {
+  return writeFrame(writeBuf, FrameType::PING, ack ? ACK : 0, 0,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint64_t>(opaqueData);
+                    }, kFramePingSize, nullptr);
+}
+
+size_t writeGoaway(IOBufQueue& writeBuf,
+                   uint32_t lastStreamID,
+                   ErrorCode errorCode,
+                   unique_ptr<IOBuf> debugData) noexcept {
+  return writeFrame(writeBuf, FrameType::GOAWAY, 0, 0,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint32_t>(lastStreamID & kUint31Mask);
+                      appender.writeBE<uint32_t>(uint32_t(errorCode));
+                    }, kFrameGoawaySize, std::move(debugData));
+}
+
+size_t writeWindowUpdate(IOBufQueue& writeBuf,
+                         uint32_t stream,
+                         uint32_t amount) noexcept {
+  DCHECK_NE(0, amount);
+  DCHECK_LE(amount, kMaxWindowUpdateSize);
+  return writeFrame(writeBuf, FrameType::WINDOW_UPDATE, 0, stream,
+                    boost::none, boost::none,
+                    [&] (Appender& appender) {
+                      appender.writeBE<uint32_t>(amount & kUint31Mask);
+                    }, kFrameWindowUpdateSize, nullptr);
+}
+
+size_t writeContinuation(IOBufQueue& writeBuf,
+                         uint32_t stream,
+                         bool endHeaders,
+                         unique_ptr<IOBuf> headers) noexcept {
+  DCHECK_NE(0, stream);
+  return writeFrame(writeBuf, FrameType::CONTINUATION,
+                    endHeaders ? END_HEADERS : 0, stream,
+                    boost::none, boost::none, nullptr, 0, std::move(headers));
+}
+
+}}
@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <boost/optional/optional.hpp>
+#include <cstdint>
+#include <deque>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <proxygen/lib/http/codec/ErrorCode.h>
+#include <proxygen/lib/http/codec/HTTP2Constants.h>
+#include <proxygen/lib/http/codec/SettingsId.h>
+
+/**
+ * Parsers and serializers for the HTTP/2 frames (RFC 7540, section 6).
+ *
+ * The parse functions expect the cursor to be positioned just past the
+ * frame header and the whole frame payload to be available. They consume
+ * exactly header.length bytes on success and return NO_ERROR, or return
+ * the connection error to send in a GOAWAY.
+ *
+ * The write functions append a complete frame to the queue and return the
+ * number of bytes written.
+ */
+namespace proxygen { namespace http2 {
+
+enum class FrameType : uint8_t {
+  DATA = 0,
+  HEADERS = 1,
+  PRIORITY = 2,
+  RST_STREAM = 3,
+  SETTINGS = 4,
+  PUSH_PROMISE = 5,
+  PING = 6,
+  GOAWAY = 7,
+  WINDOW_UPDATE = 8,
+  CONTINUATION = 9,
+};
+
+enum Flag : uint8_t {
+  ACK = 0x1,
+  END_STREAM = 0x1,
+  END_HEADERS = 0x4,
+  PADDED = 0x8,
+  PRIORITY = 0x20,
+};
+
+struct FrameHeader {
+  uint32_t length;
+  uint32_t stream;
+  FrameType type;
+  uint8_t flags;
+};
+
+struct PriorityUpdate {
+  uint32_t streamDependency;
+  bool exclusive;
+  // the weight on the wire, which is one less than the actual weight
+  uint8_t weight;
+};
+
+extern const char* getFrameTypeString(FrameType type);
+
+/**
+ * Converts an error code read off the wire. Codes this implementation does
+ * not know are treated as INTERNAL_ERROR, as the spec requires.
+ */
+extern ErrorCode toErrorCode(uint32_t code);
+
+//// Parsing ////
+
+/**
+ * Reads a frame header. The cursor must have at least kFrameHeaderSize
+ * bytes available.
+ */
+extern void parseFrameHeader(folly::io::Cursor& cursor,
+                             FrameHeader& header) noexcept;
+
+/**
+ * @param outBuf the data, without the padding
+ * @param padding the number of padding bytes, including the pad length
+ *                field. They count against flow control even though they
+ *                are dropped.
+ */
+extern ErrorCode parseData(folly::io::Cursor& cursor,
+                           const FrameHeader& header,
+                           std::unique_ptr<folly::IOBuf>& outBuf,
+                           uint16_t& padding) noexcept;
+
+extern ErrorCode parseHeaders(folly::io::Cursor& cursor,
+                              const FrameHeader& header,
+                              boost::optional<PriorityUpdate>& outPriority,
+                              std::unique_ptr<folly::IOBuf>& outBuf) noexcept;
+
+extern ErrorCode parsePriority(folly::io::Cursor& cursor,
+                               const FrameHeader& header,
+                               PriorityUpdate& outPriority) noexcept;
+
+extern ErrorCode parseRstStream(folly::io::Cursor& cursor,
+                                const FrameHeader& header,
+                                ErrorCode& outCode) noexcept;
+
+extern ErrorCode parseSettings(folly::io::Cursor& cursor,
+                               const FrameHeader& header,
+                               std::deque<SettingPair>& settings) noexcept;
+
+extern ErrorCode parsePushPromise(folly::io::Cursor& cursor,
+                                  const FrameHeader& header,
+                                  uint32_t& outPromisedStream,
+                                  std::unique_ptr<folly::IOBuf>& outBuf)
+  noexcept;
+
+extern ErrorCode parsePing(folly::io::Cursor& cursor,
+                           const FrameHeader& header,
+                           uint64_t& outOpaqueData) noexcept;
+
+extern ErrorCode parseGoaway(folly::io::Cursor& cursor,
+                             const FrameHeader& header,
+                             uint32_t& outLastStreamID,
+                             ErrorCode& outCode,
+                             std::unique_ptr<folly::IOBuf>& outDebugData)
+  noexcept;
+
+extern ErrorCode parseWindowUpdate(folly::io::Cursor& cursor,
+                                   const FrameHeader& header,
+                                   uint32_t& outAmount) noexcept;
+
+extern ErrorCode parseContinuation(folly::io::Cursor& cursor,
+                                   const FrameHeader& header,
+                                   std::unique_ptr<folly::IOBuf>& outBuf)
+  noexcept;
+
+//// Egress ////
+
+extern size_t writeData(folly::IOBufQueue& writeBuf,
+                        std::unique_ptr<folly::IOBuf> data,
+                        uint32_t stream,
+                        boost::optional<uint8_t> padding,
+                        bool endStream) noexcept;
+
+/**
+ * @param headers the encoded header block, or the first part of it if
+ *                endHeaders is false and CONTINUATION frames follow
+ */
+extern size_t writeHeaders(folly::IOBufQueue& writeBuf,
+                           std::unique_ptr<folly::IOBuf> headers,
+                           uint32_t stream,
+                           boost::optional<PriorityUpdate> priority,
+                           boost::optional<uint8_t> padding,
+                           bool endStream,
+                           bool endHeaders) noexcept;
+
+extern size_t writePriority(folly::IOBufQueue& writeBuf,
+                            uint32_t stream,
+                            PriorityUpdate priority) noexcept;
+
+extern size_t writeRstStream(folly::IOBufQueue& writeBuf,
+                             uint32_t stream,
+                             ErrorCode errorCode) noexcept;
+
+extern size_t writeSettings(folly::IOBufQueue& writeBuf,
+                            const std::deque<SettingPair>& settings) noexcept;
+
+extern size_t writeSettingsAck(folly::IOBufQueue& writeBuf) noexcept;
+
+extern size_t writePushPromise(folly::IOBufQueue& writeBuf,
+                               uint32_t associatedStream,
+                               uint32_t promisedStream,
+                               std::unique_ptr<folly::IOBuf> headers,
+                               boost::optional<uint8_t> padding,
+                               bool endHeaders) noexcept;
+
+extern size_t writePing(folly::IOBufQueue& writeBuf,
+                        uint64_t opaqueData,
+                        bool ack) noexcept;
+
+extern size_t writeGoaway(folly::IOBufQueue& writeBuf,
+                          uint32_t lastStreamID,
+                          ErrorCode errorCode,
+                          std::unique_ptr<folly::IOBuf> debugData = nullptr)
+  noexcept;
+
+extern size_t writeWindowUpdate(folly::IOBufQueue& writeBuf,
+                                uint32_t stream,
+                                uint32_t amount) noexcept;
+
+extern size_t writeContinuation(folly::IOBufQueue& writeBuf,
+                                uint32_t stream,
+                                bool endHeaders,
+                                std::unique_ptr<folly::IOBuf> headers) noexcept;
+
+}}
@@ -17,12 +17,14 @@
 #include <proxygen/lib/http/codec/HTTPSettings.h>
 #include <proxygen/lib/http/codec/TransportDirection.h>
 #include <proxygen/lib/http/codec/compress/HeaderCodec.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
 
 namespace proxygen {
 
 class HTTPHeaders;
 class HTTPMessage;
 class HTTPTransactionHandler;
+struct HTTPPriority;
 class HTTPErrorPage;
 
 /**
@@ -33,6 +35,14 @@ class HTTPErrorPage;
  */
 class HTTPCodec {
  public:
+  // there is one per connection, with the filters of its session, so they
+  // come from the slabs of the thread like the session
+  static void* operator new(size_t size) {
+    return IOBufSlab::get().allocate(size);
+  }
+  static void operator delete(void* ptr) {
+    IOBufSlab::deallocate(ptr);
+  }
 
   /**
    * Key that uniquely identifies a request/response pair within
@@ -91,6 +101,15 @@ class HTTPCodec {
     virtual void onBody(StreamID stream,
                         std::unique_ptr<folly::IOBuf> chain) = 0;
 
+    /**
+     * Called for the padding of a frame, for protocols that pad their
+     * frames. The padding is dropped, but it still counts against flow
+     * control.
+     * @param stream   The stream ID
+     * @param bytes    The number of padding bytes
+     */
+    virtual void onPadding(StreamID stream, uint16_t bytes) {}
+
     /**
      * Called for each HTTP chunk header.
      *
@@ -182,6 +201,12 @@ class HTTPCodec {
      */
     virtual void onWindowUpdate(StreamID stream, uint32_t amount) {}
 
+    /**
+     * Called when the peer changes the priority of a stream, for protocols
+     * with stream dependencies. For instance HTTP/2.
+     */
+    virtual void onPriority(StreamID stream, const HTTPPriority& priority) {}
+
     /**
      * Called upon receipt of a settings frame, for protocols that support
      * settings.
@@ -242,6 +267,14 @@ class HTTPCodec {
     return false;
   }
 
+  /**
+   * Returns the initial stream and session window size of the protocol,
+   * for codecs that support flow control
+   */
+  virtual uint32_t getDefaultWindowSize() const {
+    return 65536;
+  }
+
   /**
    * Reserve a stream ID.
    * @return           A stream ID on success, or zero on error.
@@ -268,7 +301,8 @@ class HTTPCodec {
 
   /**
    * Parse ingress data.
-   * @param  buf   A single IOBuf of data to parse
+   * @param  buf   A chain of IOBufs of data to parse, as much of which
+   *               is parsed as the codec can
    * @return Number of bytes consumed.
    */
   virtual size_t onIngress(const folly::IOBuf& buf) = 0;
@@ -318,6 +352,14 @@ class HTTPCodec {
    */
   virtual bool supportsPushTransactions() const = 0;
 
+  /**
+   * Check whether the codec can send informational (1xx) responses ahead
+   * of the final response of a stream.
+   */
+  virtual bool supportsInformationalResponses() const {
+    return true;
+  }
+
   /**
    * Generate a connection preface, if there is any for this protocol.
    *
@@ -356,6 +398,15 @@ class HTTPCodec {
                               std::unique_ptr<folly::IOBuf> chain,
                               bool eom) = 0;
 
+  /**
+   * @return true if the next body bytes of the stream go on the wire as
+   * they are, without any framing around them. The session can then send
+   * them straight from a file, without calling generateBody().
+   */
+  virtual bool isEgressBodyUnframed(StreamID stream) const {
+    return false;
+  }
+
   /**
    * Write a body chunk header, if relevant.
    */
@@ -467,6 +518,42 @@ class HTTPCodec {
    */
   virtual void setHeaderCodecStats(HeaderCodec::Stats* stats) {}
 
+  /**
+   * Limit the ingress header blocks to maxBlock bytes, and each header in
+   * them (name plus value) to maxHeader bytes, 0 for the codec's default.
+   * The codec fails the message, or the connection if the compression
+   * state can no longer be kept, as soon as a limit is crossed, rather than
+   * once the whole block was buffered.
+   */
+  virtual void setMaxIngressHeaderSize(uint32_t maxBlock,
+                                       uint32_t maxHeader) {}
+
+  /**
+   * Set the capacity of the header compression tables, if the protocol
+   * negotiates it: the encoder uses at most size bytes, and size is
+   * advertised to the peer with the next generateSettings().
+   */
+  virtual void setHeaderTableSize(uint32_t size) {}
+
+  /**
+   * @return the capacity set with setHeaderTableSize(), 0 if the protocol
+   * does not negotiate it
+   */
+  virtual uint32_t getHeaderTableSize() const { return 0; }
+
+  /**
+   * Estimate of the bytes the codec holds beyond its own size: partial
+   * frames and messages, header strings, compression state.
+   */
+  virtual size_t getMemoryUsage() const { return 0; }
+
+  /**
+   * Free the scratch buffers the codec keeps from one message to the next.
+   * It is only called while no message is being parsed, and the codec
+   * allocates them again for the next message.
+   */
+  virtual void releaseIdleBuffers() {}
+
   /**
    * Get the identifier of the last stream started by the remote.
    */
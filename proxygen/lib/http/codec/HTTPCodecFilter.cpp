@@ -34,6 +34,10 @@ void PassThroughHTTPCodecFilter::onBody(StreamID stream,
   callback_->onBody(stream, std::move(chain));
 }
 
+void PassThroughHTTPCodecFilter::onPadding(StreamID stream, uint16_t bytes) {
+  callback_->onPadding(stream, bytes);
+}
+
 void PassThroughHTTPCodecFilter::onChunkHeader(StreamID stream,
                                                size_t length) {
   callback_->onChunkHeader(stream, length);
@@ -84,6 +88,11 @@ void PassThroughHTTPCodecFilter::onWindowUpdate(StreamID stream,
   callback_->onWindowUpdate(stream, amount);
 }
 
+void PassThroughHTTPCodecFilter::onPriority(StreamID stream,
+                                            const HTTPPriority& priority) {
+  callback_->onPriority(stream, priority);
+}
+
 void PassThroughHTTPCodecFilter::onSettings(const SettingsList& settings) {
   callback_->onSettings(settings);
 }
@@ -117,6 +126,10 @@ bool PassThroughHTTPCodecFilter::supportsSessionFlowControl() const {
   return call_->supportsSessionFlowControl();
 }
 
+uint32_t PassThroughHTTPCodecFilter::getDefaultWindowSize() const {
+  return call_->getDefaultWindowSize();
+}
+
 HTTPCodec::StreamID PassThroughHTTPCodecFilter::createStream() {
   return call_->createStream();
 }
@@ -161,6 +174,15 @@ bool PassThroughHTTPCodecFilter::supportsPushTransactions() const {
   return call_->supportsPushTransactions();
 }
 
+bool PassThroughHTTPCodecFilter::supportsInformationalResponses() const {
+  return call_->supportsInformationalResponses();
+}
+
+size_t PassThroughHTTPCodecFilter::generateConnectionPreface(
+    folly::IOBufQueue& writeBuf) {
+  return call_->generateConnectionPreface(writeBuf);
+}
+
 void PassThroughHTTPCodecFilter::generateHeader(folly::IOBufQueue& writeBuf,
                                                 StreamID stream,
                                                 const HTTPMessage& msg,
@@ -177,6 +199,10 @@ size_t PassThroughHTTPCodecFilter::generateBody(
   return call_->generateBody(writeBuf, stream, std::move(chain), eom);
 }
 
+bool PassThroughHTTPCodecFilter::isEgressBodyUnframed(StreamID stream) const {
+  return call_->isEgressBodyUnframed(stream);
+}
+
 size_t PassThroughHTTPCodecFilter::generateChunkHeader(
     folly::IOBufQueue& writeBuf,
     StreamID stream,
@@ -231,6 +257,11 @@ size_t PassThroughHTTPCodecFilter::generateSettings(folly::IOBufQueue& buf) {
   return call_->generateSettings(buf);
 }
 
+size_t PassThroughHTTPCodecFilter::generateSettingsAck(
+    folly::IOBufQueue& buf) {
+  return call_->generateSettingsAck(buf);
+}
+
 size_t PassThroughHTTPCodecFilter::generateWindowUpdate(
   folly::IOBufQueue& buf,
   StreamID stream,
@@ -255,6 +286,27 @@ void PassThroughHTTPCodecFilter::setHeaderCodecStats(
   call_->setHeaderCodecStats(stats);
 }
 
+void PassThroughHTTPCodecFilter::setMaxIngressHeaderSize(uint32_t maxBlock,
+                                                         uint32_t maxHeader) {
+  call_->setMaxIngressHeaderSize(maxBlock, maxHeader);
+}
+
+void PassThroughHTTPCodecFilter::setHeaderTableSize(uint32_t size) {
+  call_->setHeaderTableSize(size);
+}
+
+uint32_t PassThroughHTTPCodecFilter::getHeaderTableSize() const {
+  return call_->getHeaderTableSize();
+}
+
+size_t PassThroughHTTPCodecFilter::getMemoryUsage() const {
+  return call_->getMemoryUsage();
+}
+
+void PassThroughHTTPCodecFilter::releaseIdleBuffers() {
+  call_->releaseIdleBuffers();
+}
+
 HTTPCodec::StreamID
 PassThroughHTTPCodecFilter::getLastIncomingStreamID() const {
   return call_->getLastIncomingStreamID();
@@ -46,6 +46,8 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
   void onBody(StreamID stream,
               std::unique_ptr<folly::IOBuf> chain) override;
 
+  void onPadding(StreamID stream, uint16_t bytes) override;
+
   void onChunkHeader(StreamID stream, size_t length) override;
 
   void onChunkComplete(StreamID stream) override;
@@ -71,6 +73,8 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
 
   void onWindowUpdate(StreamID stream, uint32_t amount) override;
 
+  void onPriority(StreamID stream, const HTTPPriority& priority) override;
+
   void onSettings(const SettingsList& settings) override;
 
   void onSettingsAck() override;
@@ -88,6 +92,8 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
 
   bool supportsSessionFlowControl() const override;
 
+  uint32_t getDefaultWindowSize() const override;
+
   StreamID createStream() override;
 
   void setCallback(HTTPCodec::Callback* callback) override;
@@ -110,6 +116,10 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
 
   bool supportsPushTransactions() const override;
 
+  bool supportsInformationalResponses() const override;
+
+  size_t generateConnectionPreface(folly::IOBufQueue& writeBuf) override;
+
   void generateHeader(folly::IOBufQueue& writeBuf,
                       StreamID stream,
                       const HTTPMessage& msg,
@@ -121,6 +131,8 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
                       std::unique_ptr<folly::IOBuf> chain,
                       bool eom) override;
 
+  bool isEgressBodyUnframed(StreamID stream) const override;
+
   size_t generateChunkHeader(folly::IOBufQueue& writeBuf,
                              StreamID stream,
                              size_t length) override;
@@ -150,6 +162,8 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
 
   size_t generateSettings(folly::IOBufQueue& writeBuf) override;
 
+  size_t generateSettingsAck(folly::IOBufQueue& writeBuf) override;
+
   size_t generateWindowUpdate(folly::IOBufQueue& writeBuf,
                               StreamID stream,
                               uint32_t delta) override;
@@ -160,6 +174,17 @@ class PassThroughHTTPCodecFilter: public HTTPCodecFilter {
 
   void setHeaderCodecStats(HeaderCodec::Stats* stats) override;
 
+  void setMaxIngressHeaderSize(uint32_t maxBlock,
+                               uint32_t maxHeader) override;
+
+  void setHeaderTableSize(uint32_t size) override;
+
+  uint32_t getHeaderTableSize() const override;
+
+  size_t getMemoryUsage() const override;
+
+  void releaseIdleBuffers() override;
+
   void enableDoubleGoawayDrain() override;
 
   HTTPCodec::StreamID getLastIncomingStreamID() const override;
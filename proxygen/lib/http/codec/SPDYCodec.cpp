@@ -24,7 +24,11 @@
 #include <proxygen/lib/http/codec/SPDYUtil.h>
 #include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
 #include <proxygen/lib/http/codec/compress/HPACKCodec.h>
+#include <proxygen/lib/utils/HTTPTime.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ObjectPool.h>
 #include <proxygen/lib/utils/ParseURL.h>
+#include <proxygen/lib/utils/UtilInl.h>
 #include <vector>
 
 using folly::IOBuf;
@@ -119,44 +123,48 @@ uint32_t parseUint32(Cursor* cursor) {
   return cursor->readBE<uint32_t>();
 }
 
-class SPDYSessionFailed : public std::exception {
- public:
-  explicit SPDYSessionFailed(spdy::GoawayStatusCode inStatus)
-      : statusCode(inStatus) {}
-
-  spdy::GoawayStatusCode statusCode;
-};
+void printCtrlHeader(uint16_t version, uint8_t flags, uint32_t length) {
+  std::cout << "CTRL FRAME: version=" << version << ", flags="
+            <<  std::hex << folly::to<unsigned int>(flags) << std::dec
+            << ", length=" << length << std::endl;
+}
 
-class SPDYStreamFailed : public std::exception {
+/**
+ * Keeps a copy of the decoded headers for the printer and forwards them
+ */
+class HeaderPieceCollector : public HeaderCodec::StreamingCallback {
  public:
-  SPDYStreamFailed(bool inIsNew, uint32_t inStreamID,
-                   uint32_t inStatus,
-                   const std::string& inMsg = empty_string)
-      : isNew(inIsNew),
-        streamID(inStreamID),
-        statusCode(inStatus) {
-    message = folly::to<std::string>("new=", isNew, " streamID=", streamID,
-                                     " statusCode=", statusCode, " message=",
-                                     inMsg);
-  }
+  HeaderPieceCollector(HeaderCodec::StreamingCallback& callback,
+                       HeaderPieceList& pieces)
+      : callback_(callback),
+        pieces_(pieces) {}
 
-  ~SPDYStreamFailed() throw() {}
+  void onHeader(folly::StringPiece name, folly::StringPiece value,
+                bool multiValued) noexcept override {
+    addPiece(name, multiValued);
+    addPiece(value, multiValued);
+    callback_.onHeader(name, value, multiValued);
+  }
 
-  virtual const char* what() const throw() {
-    return message.c_str();
+ private:
+  void addPiece(folly::StringPiece str, bool multiValued) {
+    char* data = new char[str.size()];
+    memcpy(data, str.data(), str.size());
+    pieces_.emplace_back(data, str.size(), true, multiValued);
   }
 
-  bool isNew;
-  uint32_t streamID;
-  uint32_t statusCode;
-  std::string message;
+  HeaderCodec::StreamingCallback& callback_;
+  HeaderPieceList& pieces_;
 };
 
-void printCtrlHeader(uint16_t version, uint8_t flags, uint32_t length) {
-  std::cout << "CTRL FRAME: version=" << version << ", flags="
-            <<  std::hex << folly::to<unsigned int>(flags) << std::dec
-            << ", length=" << length << std::endl;
-}
+/**
+ * Drops the headers of frames we do not act upon
+ */
+class IgnoreHeaders : public HeaderCodec::StreamingCallback {
+ public:
+  void onHeader(folly::StringPiece name, folly::StringPiece value,
+                bool multiValued) noexcept override {}
+};
 
 void printNV(const compress::HeaderPieceList& headers) {
   for (size_t i = 0; i < headers.size(); i += 2) {
@@ -225,10 +233,6 @@ void printDataFrame(uint32_t stream_id, uint8_t flags, uint32_t length) {
             << ", length=" << length << std::endl;
 }
 
-void printException(const std::exception& ex) {
-  std::cout << "Exception: " << folly::exceptionStr(ex) << std::endl;
-}
-
 } // anonynous namespace
 
 std::bitset<256> SPDYCodec::perHopHeaderCodes_;
@@ -290,11 +294,14 @@ SPDYCodec::SPDYCodec(TransportDirection direction, SPDYVersion version,
           << " codec";
   if (version == SPDYVersion::SPDY3_1_HPACK) {
     headerCodec_ = folly::make_unique<HPACKCodec>(transportDirection_);
+    cachedHeadersFormat_ = HTTPCachedHeaders::Format::SPDY3_HPACK;
   } else {
     headerCodec_ = folly::make_unique<GzipHeaderCodec>(
       spdyCompressionLevel, versionSettings_);
     // Use the default value.
     headerCodec_->setMaxUncompressed(proxygen::spdy::kMaxFrameLength);
+    cachedHeadersFormat_ = (versionSettings_.majorVersion == 2) ?
+      HTTPCachedHeaders::Format::SPDY2 : HTTPCachedHeaders::Format::SPDY3;
   }
 
   switch (transportDirection_) {
@@ -322,6 +329,14 @@ void SPDYCodec::setMaxUncompressedHeaders(uint32_t maxUncompressed) {
   headerCodec_->setMaxUncompressed(maxUncompressed);
 }
 
+void SPDYCodec::setMaxIngressHeaderSize(uint32_t maxBlock,
+                                        uint32_t maxHeader) {
+  // the frame length already bounds what is buffered before inflating
+  headerCodec_->setMaxUncompressed(maxBlock ? maxBlock :
+                                   proxygen::spdy::kMaxFrameLength);
+  headerCodec_->setMaxHeaderSize(maxHeader);
+}
+
 CodecProtocol SPDYCodec::getProtocol() const {
   switch (versionSettings_.version) {
     case SPDYVersion::SPDY2: return CodecProtocol::SPDY_2;
@@ -356,37 +371,50 @@ void SPDYCodec::setParserPaused(bool paused) {
   // Not applicable
 }
 
-void SPDYCodec::checkLength(uint32_t expectedLength, const std::string& msg) {
+std::string SPDYCodec::ParseError::describe() const {
+  if (kind == Kind::SESSION) {
+    return folly::to<std::string>("session statusCode=", code);
+  }
+  return folly::to<std::string>("new=", newStream, " streamID=", streamID,
+                                " statusCode=", code, " message=", reason);
+}
+
+SPDYCodec::ParseError SPDYCodec::checkLength(uint32_t expectedLength,
+                                             const char* frame) {
   if (length_ != expectedLength) {
-    LOG(ERROR) << msg << ": invalid length " << length_ << " != " <<
+    LOG(ERROR) << frame << ": invalid length " << length_ << " != " <<
       expectedLength;
-    throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+    return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
   }
+  return ParseError();
 }
 
-void SPDYCodec::checkMinLength(uint32_t minLength, const std::string& msg) {
+SPDYCodec::ParseError SPDYCodec::checkMinLength(uint32_t minLength,
+                                                const char* frame) {
   if (length_ < minLength) {
-    LOG(ERROR) << msg << ": invalid length " << length_ << " < " << minLength;
-    throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+    LOG(ERROR) << frame << ": invalid length " << length_ << " < "
+               << minLength;
+    return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
   }
+  return ParseError();
 }
 
 size_t SPDYCodec::onIngress(const folly::IOBuf& buf) {
-  size_t bytesParsed = 0;
   currentIngressBuf_ = &buf;
-  try {
-    bytesParsed = parseIngress(buf);
-  } catch (const SPDYSessionFailed& ex) {
-    if (printer_) {
-      printException(ex);
-    }
-    failSession(ex.statusCode);
-    bytesParsed = buf.computeChainDataLength();
+  auto result = parseIngress(buf);
+  if (result.isOk()) {
+    return result.ok();
+  }
+  const ParseError& err = result.error();
+  if (printer_) {
+    std::cout << "Error: " << err.describe() << std::endl;
   }
-  return bytesParsed;
+  failSession(err.code);
+  return buf.computeChainDataLength();
 }
 
-size_t SPDYCodec::parseIngress(const folly::IOBuf& buf) {
+Result<size_t, SPDYCodec::ParseError>
+SPDYCodec::parseIngress(const folly::IOBuf& buf) {
   const size_t chainLength = buf.computeChainDataLength();
   Cursor cursor(&buf);
   size_t avail = cursor.totalLength();
@@ -405,7 +433,7 @@ size_t SPDYCodec::parseIngress(const folly::IOBuf& buf) {
         type_  = cursor.readBE<uint16_t>();
         if (version_ != versionSettings_.majorVersion) {
           LOG(ERROR) << "Invalid version=" << version_;
-          throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+          return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
         }
       } else {
         streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
@@ -427,7 +455,7 @@ size_t SPDYCodec::parseIngress(const folly::IOBuf& buf) {
           // and a settings frame would have > 1023 pairs, of which none are
           // allowed to be duplicates. Just fail everything.
           LOG(ERROR) << "excessive frame size length_=" << length_;
-          throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+          return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
         }
         frameState_ = FrameState::CTRL_FRAME_DATA;
         if (printer_) {
@@ -440,20 +468,39 @@ size_t SPDYCodec::parseIngress(const folly::IOBuf& buf) {
         }
       }
     } else if (frameState_ == FrameState::CTRL_FRAME_DATA) {
-      if (avail < length_) {
-        // Make the caller buffer the rest of the control frame.
-        // We could attempt to decompress incomplete name/value blocks,
-        // but for now we're favoring simplicity.
-        VLOG(6) << "Need more data: length_=" << length_ << " avail=" << avail;
-        break;
+      const size_t buffered = ctrlFrameBuf_.chainLength();
+      if (buffered + avail < length_) {
+        // Hold on to what we have so the caller doesn't need to buffer and
+        // present it again. We could attempt to decompress incomplete
+        // name/value blocks, but for now we're favoring simplicity.
+        VLOG(6) << "Need more data: length_=" << length_ << " avail="
+                << buffered + avail;
+        std::unique_ptr<IOBuf> part;
+        cursor.clone(part, avail);
+        ctrlFrameBuf_.append(std::move(part));
+        continue;
+      }
+      ParseError err;
+      if (buffered == 0) {
+        err = onControlFrame(cursor);
+      } else {
+        // The frame spans reads: parse it from the buffered views. The
+        // cursor is past the frame after this, whatever onControlFrame
+        // consumes.
+        std::unique_ptr<IOBuf> rest;
+        cursor.clone(rest, length_ - buffered);
+        ctrlFrameBuf_.append(std::move(rest));
+        auto frame = ctrlFrameBuf_.move();
+        Cursor frameCursor(frame.get());
+        err = onControlFrame(frameCursor);
       }
-      try {
-        onControlFrame(cursor);
-      } catch (const SPDYStreamFailed& ex) {
+      if (err.kind == ParseError::Kind::SESSION) {
+        return err;
+      } else if (err) {
         if (printer_) {
-          printException(ex);
+          std::cout << "Error: " << err.describe() << std::endl;
         }
-        failStream(ex.isNew, ex.streamID, ex.statusCode, ex.what());
+        failStream(err.newStream, err.streamID, err.code, err.reason);
       }
       frameState_ = FrameState::FRAME_HEADER;
     } else if (avail > 0 || length_ == 0) {
@@ -480,41 +527,58 @@ size_t SPDYCodec::parseIngress(const folly::IOBuf& buf) {
   return chainLength - avail;
 }
 
-void SPDYCodec::onControlFrame(Cursor& cursor) {
-  uint32_t stream_id = 0;
+SPDYCodec::ParseError SPDYCodec::onControlFrame(Cursor& cursor) {
+  ParseError err;
   switch (type_) {
     case spdy::SYN_STREAM:
     {
-      checkMinLength(kFrameSizeSynStream, "SYN_STREAM");
+      if ((err = checkMinLength(kFrameSizeSynStream, "SYN_STREAM"))) {
+        break;
+      }
       streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
       uint32_t assocStream = cursor.readBE<uint32_t>();
       uint8_t pri = cursor.read<uint8_t>() >> versionSettings_.priShift;
       uint8_t slot = cursor.read<uint8_t>();
       length_ -= kFrameSizeSynStream;
-      auto result = decodeHeaders(cursor);
-      checkLength(0, "SYN_STREAM");
-      onSynStream(assocStream, pri, slot,
-                  result.headers, headerCodec_->getDecodedSize());
+      MessageBuilder builder(*this, streamId_, assocStream);
+      if ((err = decodeHeaders(cursor, builder)) ||
+          (err = checkLength(0, "SYN_STREAM"))) {
+        break;
+      }
+      if (printer_) {
+        printSynStream(streamId_, assocStream, pri, slot, printedHeaders_);
+      }
+      err = onSynStream(assocStream, pri, slot,
+                        builder, headerCodec_->getDecodedSize());
       break;
     }
     case spdy::SYN_REPLY:
     {
-      checkMinLength(versionSettings_.synReplySize, "SYN_REPLY");
+      if ((err = checkMinLength(versionSettings_.synReplySize, "SYN_REPLY"))) {
+        break;
+      }
       streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
       length_ -= versionSettings_.synReplySize;
       if (version_ == 2) {
         // 2 byte unused
         cursor.skip(2);
       }
-      auto result = decodeHeaders(cursor);
-      checkLength(0, "SYN_REPLY");
-      onSynReply(result.headers,
-                 headerCodec_->getDecodedSize());
+      MessageBuilder builder(*this, streamId_, HTTPCodec::NoStream);
+      if ((err = decodeHeaders(cursor, builder)) ||
+          (err = checkLength(0, "SYN_REPLY"))) {
+        break;
+      }
+      if (printer_) {
+        printSynReply(streamId_, printedHeaders_);
+      }
+      err = onSynReply(builder, headerCodec_->getDecodedSize());
       break;
     }
     case spdy::RST_STREAM:
     {
-      checkLength(kFrameSizeRstStream, "RST");
+      if ((err = checkLength(kFrameSizeRstStream, "RST"))) {
+        break;
+      }
       streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
       uint32_t statusCode = cursor.readBE<uint32_t>();
       onRstStream(statusCode);
@@ -522,13 +586,16 @@ void SPDYCodec::onControlFrame(Cursor& cursor) {
     }
     case spdy::SETTINGS:
     {
-      checkMinLength(kFrameSizeSettings, "SETTINGS");
+      if ((err = checkMinLength(kFrameSizeSettings, "SETTINGS"))) {
+        break;
+      }
       uint32_t numSettings = cursor.readBE<uint32_t>();
       length_ -= sizeof(uint32_t);
       if (length_ / 8 < numSettings) {
         LOG(ERROR) << "SETTINGS: number of settings to high. "
                    << length_ << " < 8 * " << numSettings;
-        throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+        err = ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
+        break;
       }
       SettingList settings;
       for (uint32_t i = 0; i < numSettings; i++) {
@@ -543,23 +610,27 @@ void SPDYCodec::onControlFrame(Cursor& cursor) {
         id &= ~FLAGS_MASK;
         settings.emplace_back(flags, id, value);
       }
-      onSettings(settings);
+      err = onSettings(settings);
       break;
     }
     case spdy::NOOP:
       VLOG(4) << "Noop received. Doing nothing.";
-      checkLength(0, "NOOP");
+      err = checkLength(0, "NOOP");
       break;
     case spdy::PING:
     {
-      checkLength(kFrameSizePing, "PING");
+      if ((err = checkLength(kFrameSizePing, "PING"))) {
+        break;
+      }
       uint32_t unique_id = cursor.readBE<uint32_t>();
       onPing(unique_id);
       break;
     }
     case spdy::GOAWAY:
     {
-      checkLength(versionSettings_.goawaySize, "GOAWAY");
+      if ((err = checkLength(versionSettings_.goawaySize, "GOAWAY"))) {
+        break;
+      }
       uint32_t lastStream = cursor.readBE<uint32_t>();
       uint32_t statusCode = 0;
       if (version_ == 3) {
@@ -571,7 +642,9 @@ void SPDYCodec::onControlFrame(Cursor& cursor) {
     case spdy::HEADERS:
     {
       // Note: this is for the HEADERS frame type, not the initial headers
-      checkMinLength(kFrameSizeHeaders, "HEADERS");
+      if ((err = checkMinLength(kFrameSizeHeaders, "HEADERS"))) {
+        break;
+      }
       streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
       length_ -= kFrameSizeHeaders;
       if (version_ == 2) {
@@ -579,14 +652,19 @@ void SPDYCodec::onControlFrame(Cursor& cursor) {
         cursor.skip(2);
         length_ -= 2;
       }
-      auto result = decodeHeaders(cursor);
-      checkLength(0, "HEADERS");
-      onHeaders(result.headers);
+      IgnoreHeaders ignore;
+      if ((err = decodeHeaders(cursor, ignore)) ||
+          (err = checkLength(0, "HEADERS"))) {
+        break;
+      }
+      onHeaders();
       break;
     }
     case spdy::WINDOW_UPDATE:
     {
-      checkLength(kFrameSizeWindowUpdate, "WINDOW_UPDATE");
+      if ((err = checkLength(kFrameSizeWindowUpdate, "WINDOW_UPDATE"))) {
+        break;
+      }
       streamId_ = cursor.readBE<uint32_t>() & STREAM_ID_MASK;
       uint32_t delta = cursor.readBE<uint32_t>() & DELTA_WINDOW_SIZE_MASK;
       onWindowUpdate(delta);
@@ -608,12 +686,20 @@ void SPDYCodec::onControlFrame(Cursor& cursor) {
       // Consume rest of the frame to skip processing it further
       cursor.skip(length_);
       length_ = 0;
-      return;
+      break;
   }
+  return err;
 }
 
-HeaderDecodeResult SPDYCodec::decodeHeaders(Cursor& cursor) {
-  auto result = headerCodec_->decode(cursor, length_);
+SPDYCodec::ParseError
+SPDYCodec::decodeHeaders(Cursor& cursor,
+                         HeaderCodec::StreamingCallback& callback) {
+  printedHeaders_.clear();
+  HeaderPieceCollector collector(callback, printedHeaders_);
+  auto result = headerCodec_->decodeStreaming(
+    cursor, length_,
+    printer_ ? static_cast<HeaderCodec::StreamingCallback&>(collector) :
+    callback);
   if (result.isError()) {
     auto err = result.error();
     if (err == HeaderDecodeError::HEADERS_TOO_LARGE ||
@@ -623,16 +709,17 @@ HeaderDecodeResult SPDYCodec::decodeHeaders(Cursor& cursor) {
       if (err == HeaderDecodeError::HEADERS_TOO_LARGE) {
         failStream(true, streamId_, spdy::RST_FRAME_TOO_LARGE);
       }
-      throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+      return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
     }
-    // For other types of errors we throw a stream error
+    // For other types of errors we fail the stream
+    VLOG(4) << "Error parsing header: " << static_cast<int>(err);
     bool newStream = (type_ != spdy::HEADERS);
-    throw SPDYStreamFailed(newStream, streamId_, spdy::RST_PROTOCOL_ERROR,
-                           "Error parsing header: " + folly::to<string>(err));
+    return ParseError::stream(newStream, streamId_, spdy::RST_PROTOCOL_ERROR,
+                              "Error parsing header");
   }
 
-  length_ -= result.ok().bytesConsumed;
-  return result.ok();
+  length_ -= result.ok();
+  return ParseError();
 }
 
 void SPDYCodec::onIngressEOF() {
@@ -674,11 +761,21 @@ unique_ptr<IOBuf> SPDYCodec::encodeHeaders(
 
   allHeaders.emplace_back(versionSettings_.versionStr, spdy::httpVersion);
 
+  const HTTPCachedHeaders* cached = msg.getCachedHeaders().get();
+  // A name can only appear once in a header block, so the cached entries
+  // can't be spliced in if the message has values for any of their names
+  bool canShare = (cached != nullptr);
+
   // Add the HTTP headers supplied by the caller, but skip
   // any per-hop headers that aren't supported in SPDY.
   msg.getHeaders().forEachWithCode([&] (HTTPHeaderCode code,
                                         const string& name,
                                         const string& value) {
+    if (canShare &&
+        (code == HTTP_HEADER_OTHER ? cached->getHeaders().exists(name) :
+         cached->getHeaders().exists(code))) {
+      canShare = false;
+    }
     if (perHopHeaderCodes_[code] || isSPDYReserved(name)) {
       VLOG(3) << "Dropping SPDY reserved header " << name;
       return;
@@ -695,8 +792,40 @@ unique_ptr<IOBuf> SPDYCodec::encodeHeaders(
     allHeaders.emplace_back(code, name, value);
   });
 
+  const HTTPCachedHeaders::Serialized* shared = nullptr;
+  if (canShare) {
+    shared = &cached->getSerialized(
+      cachedHeadersFormat_, [this] (const HTTPHeaders& headers) {
+        vector<Header> cachedHeaders;
+        cachedHeaders.reserve(headers.size());
+        headers.forEachWithCode([&] (HTTPHeaderCode code,
+                                     const string& name,
+                                     const string& value) {
+          cachedHeaders.emplace_back(code, name, value);
+        });
+        HTTPCachedHeaders::Serialized serialized;
+        serialized.data = headerCodec_->serializeShared(
+          cachedHeaders, serialized.numEntries);
+        return serialized;
+      });
+    if (!shared->data) {
+      shared = nullptr;
+    }
+  }
+  if (cached && !shared) {
+    // HTTPCachedHeaders only holds headers that are valid in SPDY
+    cached->getHeaders().forEachWithCode([&] (HTTPHeaderCode code,
+                                              const string& name,
+                                              const string& value) {
+      allHeaders.emplace_back(code, name, value);
+    });
+  }
+
   headerCodec_->setEncodeHeadroom(headroom);
-  auto out = headerCodec_->encode(allHeaders);
+  auto out = shared ?
+    headerCodec_->encodeWithShared(allHeaders, *shared->data,
+                                   shared->numEntries) :
+    headerCodec_->encode(allHeaders);
   if (size) {
     *size = headerCodec_->getEncodedSize();
   }
@@ -724,11 +853,10 @@ unique_ptr<IOBuf> SPDYCodec::serializeResponseHeaders(
                                msg.getStatusMessage());
   }
   allHeaders.emplace_back(versionSettings_.statusStr, status);
-  // See comment above regarding status
-  string date;
+  // The cached date string is thread-local and outlives this call, so we
+  // can point at it directly
   if (!headers.exists(HTTP_HEADER_DATE)) {
-    date = std::move(HTTPMessage::formatDateHeader());
-    allHeaders.emplace_back(HTTP_HEADER_DATE, date);
+    allHeaders.emplace_back(HTTP_HEADER_DATE, getCachedHTTPDateTime());
   }
 
   return encodeHeaders(msg, allHeaders, headroom, size);
@@ -888,12 +1016,12 @@ size_t SPDYCodec::generateBody(folly::IOBufQueue& writeBuf,
     return len;
   }
 
-  // TODO if the data length is 2^24 or greater, split it into
-  // multiple data frames.  Proxygen should never be writing that
-  // much data at once, but other apps that use this codec might.
-  CHECK(len < (1 << 24));
-
   uint8_t flags = (eom) ? kFlagFin : 0;
+  if (len > maxFrameLength_) {
+    generateDataFrames(writeBuf, uint32_t(stream), flags, std::move(chain),
+                       len);
+    return len;
+  }
   generateDataFrame(writeBuf, uint32_t(stream), flags, len);
   writeBuf.append(std::move(chain));
   return len;
@@ -1095,6 +1223,13 @@ size_t SPDYCodec::generateWindowUpdate(folly::IOBufQueue& writeBuf,
   return written;
 }
 
+size_t SPDYCodec::getMemoryUsage() const {
+  return headerCodec_->getMemoryUsage() + chainCapacity(ctrlFrameBuf_) +
+    closedStreams_.capacity() * sizeof(StreamID) +
+    printedHeaders_.size() * sizeof(compress::HeaderPiece) +
+    (partialMsg_ ? partialMsg_->getMemoryUsage() : 0);
+}
+
 void SPDYCodec::enableDoubleGoawayDrain() {
   CHECK_EQ(sessionClosing_, ClosingState::OPEN);
   sessionClosing_ = ClosingState::OPEN_WITH_GRACEFUL_DRAIN_ENABLED;
@@ -1121,135 +1256,213 @@ size_t SPDYCodec::generateDataFrame(folly::IOBufQueue& writeBuf,
   return encodedSize;
 }
 
-unique_ptr<HTTPMessage>
-SPDYCodec::parseHeaders(TransportDirection direction, StreamID streamID,
-                        StreamID assocStreamID,
-                        const HeaderPieceList& inHeaders) {
-  unique_ptr<HTTPMessage> msg(new HTTPMessage());
-  HTTPHeaders& headers = msg->getHeaders();
-  bool newStream = (type_ != spdy::HEADERS);
-
-  bool hasScheme = false;
-  bool hasPath = false;
-
-  // Number of fields must be even
-  CHECK((inHeaders.size() & 1) == 0);
-  for (unsigned i = 0; i < inHeaders.size(); i += 2) {
-    uint8_t off = 0;
-    uint32_t len = inHeaders[i].str.size();
-    if (len > 1 && inHeaders[i].str[0] == ':') {
-      off = 1;  // also signals control header
-      len--;
+void SPDYCodec::generateDataFrames(folly::IOBufQueue& writeBuf,
+                                   uint32_t streamID,
+                                   uint8_t flags,
+                                   std::unique_ptr<folly::IOBuf> chain,
+                                   size_t length) {
+  const size_t numFrames = (length + maxFrameLength_ - 1) / maxFrameLength_;
+  const size_t slabSize = numFrames * kFrameSizeDataCommon;
+
+  // All the frame headers go into one buffer, which each frame references
+  // a slice of
+  unique_ptr<IOBuf> slab = IOBufSlab::get().create(slabSize);
+  slab->append(slabSize);
+  RWPrivateCursor headerCursor(slab.get());
+  size_t left = length;
+  for (size_t i = 0; i < numFrames; ++i) {
+    uint32_t frameLength = std::min<size_t>(left, maxFrameLength_);
+    left -= frameLength;
+    headerCursor.writeBE(uint32_t(streamID));
+    headerCursor.writeBE(flagsAndLength(left == 0 ? flags : 0, frameLength));
+  }
+
+  // Interleave the headers with views of the body; neither is copied
+  unique_ptr<IOBuf> out;
+  Cursor bodyCursor(chain.get());
+  left = length;
+  for (size_t i = 0; i < numFrames; ++i) {
+    uint32_t frameLength = std::min<size_t>(left, maxFrameLength_);
+    left -= frameLength;
+    unique_ptr<IOBuf> header = slab->cloneOne();
+    header->trimStart(i * kFrameSizeDataCommon);
+    header->trimEnd(slabSize - (i + 1) * kFrameSizeDataCommon);
+    unique_ptr<IOBuf> body;
+    bodyCursor.clone(body, frameLength);
+    header->prependChain(std::move(body));
+    if (out) {
+      out->prependChain(std::move(header));
+    } else {
+      out = std::move(header);
     }
-    folly::StringPiece name(inHeaders[i].str, off, len);
-    folly::StringPiece value = inHeaders[i + 1].str;
-    VLOG(5) << "Header " << name << ": " << value;
-    bool nameOk = SPDYUtil::validateHeaderName(name);
-    bool valueOk = false;
-    bool isPath = false;
-    bool isMethod = false;
-    if (nameOk) {
-      if ((version_ == 2 && name == "url") ||
-          (version_ == 3 && off && name == "path")) {
-        valueOk = SPDYUtil::validateURL(value);
-        isPath = true;
-        hasPath = true;
-      } else if ((version_ == 2 || off) && name == "method") {
-        valueOk = SPDYUtil::validateMethod(value);
-        isMethod = true;
-        if (value == "CONNECT") {
-          // We don't support CONNECT request for SPDY
-          valueOk = false;
-        }
-      } else {
-        valueOk = SPDYUtil::validateHeaderValue(value, SPDYUtil::STRICT);
+  }
+  writeBuf.append(std::move(out));
+}
+
+SPDYCodec::MessageBuilder::MessageBuilder(SPDYCodec& codec,
+                                          StreamID streamID,
+                                          StreamID assocStreamID)
+    : codec_(codec),
+      msg_(ObjectPool<HTTPMessage>::get().acquire()),
+      streamID_(streamID),
+      assocStreamID_(assocStreamID),
+      newStream_(codec.type_ != spdy::HEADERS) {}
+
+void SPDYCodec::MessageBuilder::fail(bool notifyBegin, bool newStream,
+                                     uint32_t code, const char* reason) {
+  failed_ = true;
+  failNotifyBegin_ = notifyBegin;
+  failNewStream_ = newStream;
+  failCode_ = code;
+  failReason_ = reason;
+}
+
+void SPDYCodec::MessageBuilder::onHeader(folly::StringPiece inName,
+                                         folly::StringPiece value,
+                                         bool multiValued) noexcept {
+  if (failed_) {
+    // keep the message as it was when the error was found
+    return;
+  }
+  HTTPHeaders& headers = msg_->getHeaders();
+  const uint16_t version = codec_.version_;
+
+  uint8_t off = 0;
+  uint32_t len = inName.size();
+  if (len > 1 && inName[0] == ':') {
+    off = 1;  // also signals control header
+    len--;
+  }
+  folly::StringPiece name(inName, off, len);
+  VLOG(5) << "Header " << name << ": " << value;
+  bool nameOk = SPDYUtil::validateHeaderName(name);
+  bool valueOk = false;
+  bool isPath = false;
+  bool isMethod = false;
+  if (nameOk) {
+    if ((version == 2 && name == "url") ||
+        (version == 3 && off && name == "path")) {
+      valueOk = SPDYUtil::validateURL(value);
+      isPath = true;
+      hasPath_ = true;
+    } else if ((version == 2 || off) && name == "method") {
+      valueOk = SPDYUtil::validateMethod(value);
+      isMethod = true;
+      if (value == "CONNECT") {
+        // We don't support CONNECT request for SPDY
+        valueOk = false;
       }
+    } else {
+      valueOk = SPDYUtil::validateHeaderValue(value, SPDYUtil::STRICT);
     }
-    if (!nameOk || !valueOk) {
-      if (newStream) {
-        if (assocStreamID) {
-          callback_->onPushMessageBegin(streamID, assocStreamID, nullptr);
+  }
+  if (!nameOk || !valueOk) {
+    headers.add(name, value);
+    fail(newStream_, false, 400, "Bad header value");
+    return;
+  }
+  bool add = false;
+  if (off || version == 2) {
+    if (isMethod) {
+      msg_->setMethod(value);
+    } else if (isPath) {
+      msg_->setURL(value.str());
+    } else if (name == "version") {
+      if (caseInsensitiveEqual(value, "http/1.0")) {
+        msg_->setHTTPVersion(1, 0);
+      } else {
+        msg_->setHTTPVersion(1, 1);
+      }
+    } else if (version == 3 && name == "host") {
+      headers.add(HTTP_HEADER_HOST, value.str());
+    } else if (name == "scheme") {
+      hasScheme_ = true;
+      if (value == "https") {
+        msg_->setSecure(true);
+      }
+    } else if (name == "status") {
+      if (codec_.transportDirection_ == TransportDirection::UPSTREAM &&
+          !assocStreamID_) {
+        folly::StringPiece codePiece;
+        folly::StringPiece reasonPiece;
+        if (value.contains(' ')) {
+          folly::split<false>(' ', value, codePiece, reasonPiece);
         } else {
-          callback_->onMessageBegin(streamID, nullptr);
+          codePiece = value;
         }
-      }
-      headers.add(name, value);
-      partialMsg_ = std::move(msg);
-      throw SPDYStreamFailed(false, streamID, 400, "Bad header value");
-    }
-    bool add = false;
-    if (off || version_ == 2) {
-      if (isMethod) {
-        msg->setMethod(value);
-      } else if (isPath) {
-        msg->setURL(value.str());
-      } else if (name == "version") {
-        if (caseInsensitiveEqual(value, "http/1.0")) {
-          msg->setHTTPVersion(1, 0);
+        // parsed by hand: a peer picks the status, and a conversion that
+        // throws on garbage would make a bad one costly
+        int32_t code = codePiece.empty() ? -1 : 0;
+        for (char c: codePiece) {
+          if (c < '0' || c > '9' || code > 999) {
+            code = -1;
+            break;
+          }
+          code = code * 10 + (c - '0');
+        }
+        if (code >= 100 && code <= 999) {
+          msg_->setStatusCode(code);
+          msg_->setStatusMessage(reasonPiece.str());
         } else {
-          msg->setHTTPVersion(1, 1);
+          msg_->setStatusCode(0);
+          headers.add(name, value);
+          fail(false, newStream_, spdy::RST_PROTOCOL_ERROR,
+               "Invalid status code");
         }
-      } else if (version_ == 3 && name == "host") {
-        headers.add(HTTP_HEADER_HOST, value.str());
-      } else if (name == "scheme") {
-        hasScheme = true;
-        if (value == "https") {
-          msg->setSecure(true);
+      } else if (!assocStreamID_) {
+        if (version == 2) {
+          headers.add("Status", value);
         }
-      } else if (name == "status") {
-        if (direction == TransportDirection::UPSTREAM && !assocStreamID) {
-          folly::StringPiece codePiece;
-          folly::StringPiece reasonPiece;
-          if (value.contains(' ')) {
-            folly::split<false>(' ', value, codePiece, reasonPiece);
-          } else {
-            codePiece = value;
-          }
-          int32_t code = -1;
-          try {
-            code = folly::to<unsigned int>(codePiece);
-          } catch (const std::range_error& ex) {
-          }
-          if (code >= 100 && code <= 999) {
-            msg->setStatusCode(code);
-            msg->setStatusMessage(reasonPiece.str());
-          } else {
-            msg->setStatusCode(0);
-            headers.add(name, value);
-            partialMsg_ = std::move(msg);
-            throw SPDYStreamFailed(newStream, streamID,
-                                   spdy::RST_PROTOCOL_ERROR,
-                                  "Invalid status code");
-          }
-        } else if (!assocStreamID) {
-          if (version_ == 2) {
-            headers.add("Status", value);
-          }
-        } // else eat the status header because it fails a check in HTTPMessage
-      } else if (version_ == 2) {
-        add = true;
-      }
-    } else {
+      } // else eat the status header because it fails a check in HTTPMessage
+    } else if (version == 2) {
       add = true;
     }
-    if (add) {
-      if (!inHeaders[i].isMultiValued() && headers.exists(name)) {
-        headers.add(name, value);
-        partialMsg_ = std::move(msg);
-        throw SPDYStreamFailed(newStream, streamID, spdy::RST_PROTOCOL_ERROR,
-                               "Duplicate header value");
-      }
+  } else {
+    add = true;
+  }
+  if (add) {
+    // look the name up once for both the duplicate check and the add
+    const HTTPHeaderCode code = HTTPCommonHeaders::hash(name.data(),
+                                                        name.size());
+    bool duplicate = !multiValued &&
+      (code == HTTP_HEADER_OTHER ? headers.exists(name) : headers.exists(code));
+    if (code == HTTP_HEADER_OTHER) {
       headers.add(name, value);
+    } else {
+      headers.add(code, value.str());
+    }
+    if (duplicate) {
+      fail(false, newStream_, spdy::RST_PROTOCOL_ERROR,
+           "Duplicate header value");
     }
   }
-  if (assocStreamID &&
-      (!headers.exists(HTTP_HEADER_HOST) || !hasScheme || !hasPath)) {
+}
+
+Result<unique_ptr<HTTPMessage>, SPDYCodec::ParseError>
+SPDYCodec::MessageBuilder::finish() {
+  if (failed_) {
+    if (failNotifyBegin_) {
+      if (assocStreamID_) {
+        codec_.callback_->onPushMessageBegin(streamID_, assocStreamID_,
+                                             nullptr);
+      } else {
+        codec_.callback_->onMessageBegin(streamID_, nullptr);
+      }
+    }
+    codec_.partialMsg_ = std::move(msg_);
+    return ParseError::stream(failNewStream_, streamID_, failCode_,
+                              failReason_);
+  }
+
+  HTTPHeaders& headers = msg_->getHeaders();
+  if (assocStreamID_ &&
+      (!headers.exists(HTTP_HEADER_HOST) || !hasScheme_ || !hasPath_)) {
     // Fail a server push without host, scheme or path headers
-    throw SPDYStreamFailed(newStream, streamID, 400, "Bad Request");
+    return ParseError::stream(newStream_, streamID_, 400, "Bad Request");
   }
-  if (direction == TransportDirection::DOWNSTREAM) {
-    if (version_ == 2 && !headers.exists(HTTP_HEADER_HOST)) {
-      ParseURL url(msg->getURL());
+  if (codec_.transportDirection_ == TransportDirection::DOWNSTREAM) {
+    if (codec_.version_ == 2 && !headers.exists(HTTP_HEADER_HOST)) {
+      ParseURL url(msg_->getURL());
       if (url.valid()) {
         headers.add(HTTP_HEADER_HOST, url.hostAndPort());
       }
@@ -1274,21 +1487,24 @@ SPDYCodec::parseHeaders(TransportDirection direction, StreamID streamID,
       }
     }
   }
-  return std::move(msg);
+  return std::move(msg_);
 }
 
-void SPDYCodec::onSynCommon(StreamID streamID,
-                            StreamID assocStreamID,
-                            const HeaderPieceList& headers,
-                            int8_t pri,
-                            const HTTPHeaderSize& size) {
+SPDYCodec::ParseError SPDYCodec::onSynCommon(StreamID streamID,
+                                             StreamID assocStreamID,
+                                             MessageBuilder& builder,
+                                             int8_t pri,
+                                             const HTTPHeaderSize& size) {
   if (version_ != versionSettings_.majorVersion) {
     LOG(ERROR) << "Invalid version=" << version_;
-    throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+    return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
   }
 
-  unique_ptr<HTTPMessage> msg = parseHeaders(transportDirection_,
-                                             streamID, assocStreamID, headers);
+  auto result = builder.finish();
+  if (result.isError()) {
+    return result.error();
+  }
+  unique_ptr<HTTPMessage> msg = std::move(result.ok());
   msg->setIngressHeaderSize(size);
 
   msg->setSPDY(version_);
@@ -1300,22 +1516,20 @@ void SPDYCodec::onSynCommon(StreamID streamID,
   }
 
   callback_->onHeadersComplete(streamID, std::move(msg));
+  return ParseError();
 }
 
-void SPDYCodec::onSynStream(uint32_t assocStream,
-                            uint8_t pri, uint8_t slot,
-                            const HeaderPieceList& headers,
-                            const HTTPHeaderSize& size) {
+SPDYCodec::ParseError SPDYCodec::onSynStream(uint32_t assocStream,
+                                             uint8_t pri, uint8_t slot,
+                                             MessageBuilder& builder,
+                                             const HTTPHeaderSize& size) {
   VLOG(4) << "Got SYN_STREAM, stream=" << streamId_
           << " pri=" << folly::to<int>(pri);
-  if (printer_) {
-    printSynStream(streamId_, assocStream, pri, slot, headers);
-  }
   if (sessionClosing_ == ClosingState::CLOSING) {
     VLOG(4) << "Dropping SYN_STREAM after final GOAWAY, stream=" << streamId_;
     // Suppress any EOM callback for the current frame.
     flags_ &= ~spdy::CTRL_FLAG_FIN;
-    return;
+    return ParseError();
   }
   if (streamId_ == 0 ||
       streamId_ < lastStreamID_ ||
@@ -1329,41 +1543,38 @@ void SPDYCodec::onSynStream(uint32_t assocStream,
                << " lastStreamID_=" << lastStreamID_
                << " assocStreamID=" << assocStream
                << " direction=" << transportDirection_;
-    throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+    return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
   }
 
   if (streamId_ == lastStreamID_) {
-    throw SPDYStreamFailed(true, streamId_, spdy::RST_PROTOCOL_ERROR);
+    return ParseError::stream(true, streamId_, spdy::RST_PROTOCOL_ERROR);
   }
   if (callback_->numIncomingStreams() >=
       egressSettings_.getSetting(SettingsId::MAX_CONCURRENT_STREAMS,
                                  spdy::kMaxConcurrentStreams)) {
-    throw SPDYStreamFailed(true, streamId_, spdy::RST_REFUSED_STREAM);
+    return ParseError::stream(true, streamId_, spdy::RST_REFUSED_STREAM);
   }
   if (assocStream != 0 && !(flags_ & spdy::CTRL_FLAG_UNIDIRECTIONAL)) {
-    throw SPDYStreamFailed(true, streamId_, spdy::RST_PROTOCOL_ERROR);
+    return ParseError::stream(true, streamId_, spdy::RST_PROTOCOL_ERROR);
   }
   lastStreamID_ = streamId_;
-  onSynCommon(StreamID(streamId_),
-              StreamID(assocStream), headers, pri, size);
+  return onSynCommon(StreamID(streamId_),
+                     StreamID(assocStream), builder, pri, size);
 }
 
-void SPDYCodec::onSynReply(const HeaderPieceList& headers,
-                           const HTTPHeaderSize& size) {
+SPDYCodec::ParseError SPDYCodec::onSynReply(MessageBuilder& builder,
+                                            const HTTPHeaderSize& size) {
   VLOG(4) << "Got SYN_REPLY, stream=" << streamId_;
-  if (printer_) {
-    printSynReply(streamId_, headers);
-  }
   if (transportDirection_ == TransportDirection::DOWNSTREAM ||
       (streamId_ & 0x1) == 0) {
-    throw SPDYStreamFailed(true, streamId_, spdy::RST_PROTOCOL_ERROR);
+    return ParseError::stream(true, streamId_, spdy::RST_PROTOCOL_ERROR);
   }
   // Server push transactions, short of any better heuristics,
   // should have a background priority. Thus, we pick the largest
   // numerical value for the SPDY priority, which no matter what
   // protocol version this is can be conveyed to onSynCommon by -1.
-  onSynCommon(StreamID(streamId_),
-              HTTPCodec::NoStream, headers, -1, size);
+  return onSynCommon(StreamID(streamId_),
+                     HTTPCodec::NoStream, builder, -1, size);
 }
 
 void SPDYCodec::onRstStream(uint32_t statusCode) noexcept {
@@ -1377,7 +1588,7 @@ void SPDYCodec::onRstStream(uint32_t statusCode) noexcept {
                      spdy::rstToErrorCode(spdy::ResetStatusCode(statusCode)));
 }
 
-void SPDYCodec::onSettings(const SettingList& settings) {
+SPDYCodec::ParseError SPDYCodec::onSettings(const SettingList& settings) {
   VLOG(4) << "Got " << settings.size() << " settings with "
           << "version=" << version_ << " and flags="
           << std::hex << folly::to<unsigned int>(flags_) << std::dec;
@@ -1407,7 +1618,7 @@ void SPDYCodec::onSettings(const SettingList& settings) {
         break;
       case spdy::SETTINGS_INITIAL_WINDOW_SIZE:
         if (cur.value > std::numeric_limits<int32_t>::max()) {
-          throw SPDYSessionFailed(spdy::GOAWAY_PROTOCOL_ERROR);
+          return ParseError::session(spdy::GOAWAY_PROTOCOL_ERROR);
         }
         break;
       default:
@@ -1423,6 +1634,7 @@ void SPDYCodec::onSettings(const SettingList& settings) {
     }
   }
   callback_->onSettings(settingsList);
+  return ParseError();
 }
 
 void SPDYCodec::onPing(uint32_t uniqueID) noexcept {
@@ -1470,9 +1682,9 @@ void SPDYCodec::onGoaway(uint32_t lastGoodStream,
   }
 }
 
-void SPDYCodec::onHeaders(const HeaderPieceList& headers) noexcept {
+void SPDYCodec::onHeaders() noexcept {
   if (printer_) {
-    printHeaders(streamId_, headers);
+    printHeaders(streamId_, printedHeaders_);
   }
   VLOG(3) << "onHeaders is unimplemented.";
 }
@@ -1485,7 +1697,7 @@ void SPDYCodec::onWindowUpdate(uint32_t delta) noexcept {
 }
 
 void SPDYCodec::failStream(bool newStream, StreamID streamID,
-                           uint32_t code, string excStr) {
+                           uint32_t code, const char* reason) {
   // Suppress any EOM callback for the current frame.
   if (streamID == streamId_) {
     flags_ &= ~spdy::CTRL_FLAG_FIN;
@@ -1495,14 +1707,14 @@ void SPDYCodec::failStream(bool newStream, StreamID streamID,
     code >= 100 ?
     HTTPException::Direction::INGRESS :
     HTTPException::Direction::INGRESS_AND_EGRESS,
-    "SPDYCodec stream error: stream=",
-    streamID, " status=", code, " exception: ", excStr);
+    kErrorParseHeader,
+    (reason && *reason) ? reason : "SPDYCodec stream error");
+  err.setStreamID(streamID);
   if (code >= 100) {
     err.setHttpStatusCode(code);
   } else {
     err.setCodecStatusCode(spdy::rstToErrorCode(spdy::ResetStatusCode(code)));
   }
-  err.setProxygenError(kErrorParseHeader);
 
   if (partialMsg_) {
     err.setPartialMsg(std::move(partialMsg_));
@@ -1515,12 +1727,9 @@ void SPDYCodec::failStream(bool newStream, StreamID streamID,
 }
 
 void SPDYCodec::failSession(uint32_t code) {
-  HTTPException err(
-    HTTPException::Direction::INGRESS_AND_EGRESS,
-    "SPDYCodec session error "
-    "lastGoodStream=", lastStreamID_, " status=", code);
+  HTTPException err(HTTPException::Direction::INGRESS_AND_EGRESS,
+                    kErrorParseHeader, "SPDYCodec session error");
   err.setCodecStatusCode(spdy::goawayToErrorCode(spdy::GoawayStatusCode(code)));
-  err.setProxygenError(kErrorParseHeader);
 
   // store the ingress buffer
   if (currentIngressBuf_) {
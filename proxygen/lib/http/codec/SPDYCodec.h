@@ -19,6 +19,7 @@
 #include <proxygen/lib/http/codec/SPDYVersionSettings.h>
 #include <proxygen/lib/http/codec/compress/HPACKCodec.h>
 #include <proxygen/lib/http/codec/compress/HeaderCodec.h>
+#include <proxygen/lib/utils/Result.h>
 #include <zlib.h>
 
 namespace folly { namespace io {
@@ -48,6 +49,9 @@ public:
   }
   bool supportsStreamFlowControl() const override;
   bool supportsSessionFlowControl() const override;
+  uint32_t getDefaultWindowSize() const override {
+    return spdy::kInitialWindow;
+  }
   StreamID createStream() override;
   void setCallback(Callback* callback) override { callback_ = callback; }
   bool isBusy() const override;
@@ -59,6 +63,8 @@ public:
   bool closeOnEgressComplete() const override { return false; }
   bool supportsParallelRequests() const override { return true; }
   bool supportsPushTransactions() const override { return true; }
+  // A stream has a single SYN_REPLY
+  bool supportsInformationalResponses() const override { return false; }
   void generateHeader(folly::IOBufQueue& writeBuf,
                       StreamID stream,
                       const HTTPMessage& msg,
@@ -111,6 +117,10 @@ public:
 
   uint8_t getMinorVersion() const;
 
+  /**
+   * Set the maximum frame length accepted, which is also the size bodies
+   * are split at when they are framed
+   */
   void setMaxFrameLength(uint32_t maxFrameLength);
 
   /**
@@ -121,6 +131,9 @@ public:
   void setHeaderCodecStats(HeaderCodec::Stats* stats) override {
     headerCodec_->setStats(stats);
   }
+  void setMaxIngressHeaderSize(uint32_t maxBlock,
+                               uint32_t maxHeader) override;
+  size_t getMemoryUsage() const override;
 
   struct SettingData {
     SettingData(uint8_t inFlags, uint32_t inId, uint32_t inValue)
@@ -171,24 +184,111 @@ public:
   size_t generatePingCommon(folly::IOBufQueue& writeBuf,
                             uint64_t uniqueID);
   /**
-   * Ingress parser, can throw exceptions
+   * A malformed frame, as reported by the parse functions to the ingress
+   * loop, which fails the stream or the session. Peers can send these at
+   * will, so they are returned instead of thrown.
    */
-  size_t parseIngress(const folly::IOBuf& buf);
+  struct ParseError {
+    enum class Kind : uint8_t {
+      NONE,
+      STREAM,
+      SESSION,
+    };
+
+    static ParseError session(spdy::GoawayStatusCode code) {
+      ParseError err;
+      err.kind = Kind::SESSION;
+      err.code = code;
+      return err;
+    }
+
+    static ParseError stream(bool newStream, uint32_t streamID,
+                             uint32_t code, const char* reason = "") {
+      ParseError err;
+      err.kind = Kind::STREAM;
+      err.newStream = newStream;
+      err.streamID = streamID;
+      err.code = code;
+      err.reason = reason;
+      return err;
+    }
+
+    explicit operator bool() const {
+      return kind != Kind::NONE;
+    }
+
+    std::string describe() const;
+
+    Kind kind{Kind::NONE};
+    bool newStream{false};
+    uint32_t streamID{0};
+    // a GoawayStatusCode for the session, a ResetStatusCode or an HTTP
+    // status (>= 100) for a stream
+    uint32_t code{0};
+    const char* reason{""};
+  };
+
+  /**
+   * Builds the HTTPMessage of a SYN_STREAM or SYN_REPLY while the header
+   * codec decodes the block. An invalid header does not stop the decode,
+   * which has to consume the whole block to keep the compression state in
+   * sync; the first error is kept and returned from finish() instead.
+   */
+  class MessageBuilder : public HeaderCodec::StreamingCallback {
+   public:
+    MessageBuilder(SPDYCodec& codec, StreamID streamID,
+                   StreamID assocStreamID);
+
+    void onHeader(folly::StringPiece name, folly::StringPiece value,
+                  bool multiValued) noexcept override;
+
+    /**
+     * Run the checks that need the whole block and return the message, or
+     * the first error seen while decoding.
+     */
+    Result<std::unique_ptr<HTTPMessage>, ParseError> finish();
+
+   private:
+    void fail(bool notifyBegin, bool newStream, uint32_t code,
+              const char* reason);
+
+    SPDYCodec& codec_;
+    std::unique_ptr<HTTPMessage> msg_;
+    StreamID streamID_;
+    StreamID assocStreamID_;
+    bool newStream_;
+    bool hasScheme_{false};
+    bool hasPath_{false};
+    bool failed_{false};
+    // how to report the first error
+    bool failNotifyBegin_{false};
+    bool failNewStream_{false};
+    uint32_t failCode_{0};
+    const char* failReason_{nullptr};
+  };
+
+  /**
+   * Ingress parser. Stream errors are handled here; a session error ends
+   * the parse and is returned.
+   *
+   * @return the number of bytes consumed, or the session error
+   */
+  Result<size_t, ParseError> parseIngress(const folly::IOBuf& buf);
 
   /**
    * Handle an ingress SYN_STREAM control frame. For a downstream-facing
    * SPDY session, this frame is the equivalent of an HTTP request header.
    */
-  void onSynStream(uint32_t assocStream,
-                   uint8_t pri, uint8_t slot,
-                   const compress::HeaderPieceList& headers,
-                   const HTTPHeaderSize& size);
+  ParseError onSynStream(uint32_t assocStream,
+                         uint8_t pri, uint8_t slot,
+                         MessageBuilder& builder,
+                         const HTTPHeaderSize& size);
   /**
    * Handle an ingress SYN_REPLY control frame. For an upstream-facing
    * SPDY session, this frame is the equivalent of an HTTP response header.
    */
-  void onSynReply(const compress::HeaderPieceList& headers,
-                  const HTTPHeaderSize& size);
+  ParseError onSynReply(MessageBuilder& builder,
+                        const HTTPHeaderSize& size);
   /**
    * Handle an ingress RST_STREAM control frame.
    */
@@ -197,7 +297,7 @@ public:
    * Handle a SETTINGS message that changes/updates settings for the
    * entire SPDY connection (across all transactions)
    */
-  void onSettings(const SettingList& settings);
+  ParseError onSettings(const SettingList& settings);
 
   void onPing(uint32_t uniqueID) noexcept;
 
@@ -208,25 +308,17 @@ public:
    * on a stream are received. This is called when the remote endpoint
    * sends us any additional headers.
    */
-  void onHeaders(const compress::HeaderPieceList& headers) noexcept;
+  void onHeaders() noexcept;
 
   void onWindowUpdate(uint32_t delta) noexcept;
 
   // Helpers
 
-  /**
-   * Parses the headers in the nameValues array and creates an HTTPMessage
-   * object initialized for this transaction.
-   */
-  std::unique_ptr<HTTPMessage> parseHeaders(
-    TransportDirection direction, StreamID streamID,
-    StreamID assocStreamID, const compress::HeaderPieceList& headers);
-
   /**
    * Helper function to parse out a control frame and execute its handler.
-   * All errors are thrown as exceptions.
+   * Errors, of the frame or of its handler, are returned.
    */
-  void onControlFrame(folly::io::Cursor& cursor);
+  ParseError onControlFrame(folly::io::Cursor& cursor);
 
   /**
    * Helper function that contains the common implementation details of
@@ -237,11 +329,11 @@ public:
    * value for this SPDY version (i.e., 3 for SPDY/2 or 7 for SPDY/3),
    * -2 the second largest (i.e., 2 for SPDY/2 or 6 for SPDY/3).
    */
-  void onSynCommon(StreamID streamID,
-                   StreamID assocStreamID,
-                   const compress::HeaderPieceList& headers,
-                   int8_t pri,
-                   const HTTPHeaderSize& size);
+  ParseError onSynCommon(StreamID streamID,
+                         StreamID assocStreamID,
+                         MessageBuilder& builder,
+                         int8_t pri,
+                         const HTTPHeaderSize& size);
 
   /**
    * Generate the header for a SPDY data frame
@@ -256,6 +348,22 @@ public:
                            uint8_t flags,
                            uint32_t length);
 
+  /**
+   * Frame a body longer than the maximum frame length as a sequence of
+   * data frames. The frame headers share a single buffer, and the frames
+   * reference the body instead of copying it.
+   * @param writeBuf Buffer queue to which the frames are written.
+   * @param streamID Stream ID.
+   * @param flags    Flags of the last frame.
+   * @param chain    The body.
+   * @param length   Length of the body, in bytes.
+   */
+  void generateDataFrames(folly::IOBufQueue& writeBuf,
+                          uint32_t streamID,
+                          uint8_t flags,
+                          std::unique_ptr<folly::IOBuf> chain,
+                          size_t length);
+
   /**
    * Serializes headers for requests (aka SYN_STREAM)
    * @param msg      The message to serialize.
@@ -299,19 +407,25 @@ public:
     uint32_t headroom = 0,
     HTTPHeaderSize* size = nullptr);
 
+  /**
+   * @param reason a string literal, see HTTPException
+   */
   void failStream(bool newTxn, StreamID streamID, uint32_t code,
-                  std::string excStr = empty_string);
+                  const char* reason = nullptr);
 
   void failSession(uint32_t statusCode);
 
   /**
-   * Decodes the headers from the cursor and returns the result.
+   * Decodes the header block of the current frame from the cursor, handing
+   * each header to the callback. If the printer is on, a copy of the block
+   * is also kept in printedHeaders_.
    */
-  HeaderDecodeResult decodeHeaders(folly::io::Cursor& cursor);
+  ParseError decodeHeaders(folly::io::Cursor& cursor,
+                           HeaderCodec::StreamingCallback& callback);
 
-  void checkLength(uint32_t expectedLength, const std::string& msg);
+  ParseError checkLength(uint32_t expectedLength, const char* frame);
 
-  void checkMinLength(uint32_t minLength, const std::string& msg);
+  ParseError checkMinLength(uint32_t minLength, const char* frame);
 
   bool isSPDYReserved(const std::string& name);
 
@@ -334,8 +448,13 @@ public:
   };
 
   std::unique_ptr<HTTPMessage> partialMsg_;
+  // copy of the last decoded header block, only kept for the printer
+  compress::HeaderPieceList printedHeaders_;
   HTTPCodec::Callback* callback_{nullptr};
   const folly::IOBuf* currentIngressBuf_{nullptr};
+  // the part of a control frame that came in with earlier reads. It holds
+  // references to the ingress buffers rather than copies of them.
+  folly::IOBufQueue ctrlFrameBuf_{folly::IOBufQueue::cacheChainLength()};
 
   StreamID nextEgressStreamID_;
   StreamID nextEgressPingID_;
@@ -369,6 +488,8 @@ public:
   bool ctrl_:1;
 
   std::unique_ptr<HeaderCodec> headerCodec_;
+  // slot of the HTTPCachedHeaders serializations this codec reuses
+  HTTPCachedHeaders::Format cachedHeadersFormat_;
 };
 
 } // proxygen
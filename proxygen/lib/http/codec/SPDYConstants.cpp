@@ -148,16 +148,4 @@ const std::string kNameHostv3(":host"); // SPDY v3 only
 const std::string https("https");
 const std::string http("http");
 
-// In the future, we may be shifting the SPDY wire priority
-// by this much so we can easily use the lower bits to do our
-// own priority queueing within the bands defined by the SPDY
-// protocol...
-//
-// so far:
-//
-// lower 2 LSB: used to randomly approximate some fairness within
-// priority bands, relying on the poisson events of extracting or
-// appending a frame to gather "entropy".
-const size_t SPDY_PRIO_SHIFT_FACTOR = 2; // up to 60
-
 }}
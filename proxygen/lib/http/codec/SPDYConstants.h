@@ -124,6 +124,4 @@ extern const std::string kNameHostv3;
 extern const std::string https;
 extern const std::string http;
 
-extern const size_t SPDY_PRIO_SHIFT_FACTOR;
-
 }}
@@ -9,11 +9,52 @@
  */
 #include <proxygen/lib/http/codec/SPDYUtil.h>
 
-#include <folly/ThreadLocal.h>
+#include <assert.h>
+#include <proxygen/external/http_parser/http_parser.h>
 #include <proxygen/lib/http/RFC2616.h>
+#include <proxygen/lib/utils/UtilInl.h>
 
 namespace proxygen {
 
+namespace {
+
+// Inclusive byte ranges for the scanner of http_parser, padded to the 16
+// bytes it loads
+
+// the bytes of URLs: no controls or unescaped spaces
+const char kURLRanges[16] __attribute__((aligned(16))) =
+  "\x21\x7e\x80\xff";
+const int kURLRangesLen = 4;
+
+// the bytes of header names: b where http_tokens[b] == b, or >= 0x80
+const char kHeaderNameRanges[16] __attribute__((aligned(16))) =
+  "\x20\x27\x2a\x2b\x2d\x39\x5e\x7a\x7c\x7e\x80\xff";
+const int kHeaderNameRangesLen = 12;
+
+// the bytes of header values that leave the state of the validator as it
+// is: no CTLs, quotes or escapes
+const char kHeaderValueRanges[16] __attribute__((aligned(16))) =
+  "\x20\x21\x23\x5b\x5d\x7e\x80\xff";
+const int kHeaderValueRangesLen = 8;
+
+bool fastScan = http_parser_fast_scan_supported();
+
+/**
+ * @return the number of leading bytes of bytes that are certainly in the
+ *         ranges; the rest is for the scalar loop
+ */
+size_t skipInRanges(folly::ByteRange bytes, const char* ranges,
+                    int rangesLen) {
+  if (!fastScan || bytes.size() < 16) {
+    return 0;
+  }
+  const char* p = reinterpret_cast<const char*>(bytes.data());
+  return http_parser_count_in_ranges(p, p + bytes.size(), ranges,
+                                     rangesLen);
+}
+
+}
+
 /**
  *  Tokens as defined by rfc 2616. Also lowercases them.
  *        token       = 1*<any CHAR except CTLs or separators>
@@ -57,20 +98,127 @@ const char SPDYUtil::http_tokens[256] = {
        'x',     'y',     'z',      0,      '|',     '}',     '~',       0
 };
 
+bool SPDYUtil::setFastScan(bool enabled) {
+  fastScan = enabled && http_parser_fast_scan_supported();
+  return fastScan;
+}
+
+bool SPDYUtil::validateURL(folly::ByteRange url) {
+  url.advance(skipInRanges(url, kURLRanges, kURLRangesLen));
+  for (auto p: url) {
+    if (p <= 0x20 || p == 0x7f) {
+      // no controls or unescaped spaces
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SPDYUtil::validateHeaderName(folly::ByteRange name) {
+  name.advance(skipInRanges(name, kHeaderNameRanges, kHeaderNameRangesLen));
+  for (auto p: name) {
+    if (p < 0x80 && http_tokens[(uint8_t)p] != p) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SPDYUtil::validateHeaderValue(folly::ByteRange value,
+                                   CtlEscapeMode mode) {
+  bool escape = false;
+  bool quote = false;
+  enum { lws_none,
+         lws_expect_nl,
+         lws_expect_ws1,
+         lws_expect_ws2 } state = lws_none;
+
+  for (auto p = std::begin(value); p != std::end(value); ++p) {
+    if (!escape && state == lws_none) {
+      // pass over the run of plain bytes, whatever the quotes
+      p += skipInRanges(folly::ByteRange(p, std::end(value)),
+                        kHeaderValueRanges, kHeaderValueRangesLen);
+      if (p == std::end(value)) {
+        break;
+      }
+    }
+    if (escape) {
+      escape = false;
+      if (mode == COMPLIANT) {
+        // prev char escaped.  Turn off escape and go to next char
+        // COMPLIANT mode only
+        assert(quote);
+        continue;
+      }
+    }
+    switch (state) {
+      case lws_none:
+        switch (*p) {
+          case '\\':
+            if (quote) {
+              escape = true;
+            }
+            break;
+          case '\"':
+            quote = !quote;
+            break;
+          case '\r':
+            state = lws_expect_nl;
+            break;
+          default:
+            if (*p < 0x20 || *p == 0x7f) {
+              // unexpected ctl per rfc2616
+              return false;
+            }
+            break;
+        }
+        break;
+      case lws_expect_nl:
+        if (*p != '\n') {
+          // unescaped \r must be LWS
+          return false;
+        }
+        state = lws_expect_ws1;
+        break;
+      case lws_expect_ws1:
+        if (*p != ' ' && *p != '\t') {
+          // unescaped \r\n must be LWS
+          return false;
+        }
+        state = lws_expect_ws2;
+        break;
+      case lws_expect_ws2:
+        if (*p != ' ' && *p != '\t') {
+          // terminated LWS
+          state = lws_none;
+          // check this char again
+          p--;
+        }
+        break;
+    }
+  }
+  // Unterminated quotes are OK, since the value can be* TEXT which treats
+  // the " like any other char.
+  // Unterminated escapes are bad because it will escape the next character
+  // when converting to HTTP
+  // Unterminated LWS (dangling \r or \r\n) is bad because it could
+  // prematurely terminate the headers when converting to HTTP
+  return !escape && (state == lws_none || state == lws_expect_ws2);
+}
+
 bool SPDYUtil::hasGzipAndDeflate(const std::string& value, bool& hasGzip,
                                  bool& hasDeflate) {
-  static folly::ThreadLocal<std::vector<RFC2616::TokenQPair>> output;
-  output->clear();
   hasGzip = false;
   hasDeflate = false;
-  RFC2616::parseQvalues(value, *output);
-  for (const auto& encodingQ: *output) {
-    std::string lower(std::move(encodingQ.first.str()));
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  RFC2616::QvalueReader reader(value);
+  RFC2616::TokenQPair encodingQ;
+  while (reader.next(encodingQ)) {
     // RFC says 3 sig figs
-    if (lower == "gzip" && encodingQ.second >= 0.001) {
+    if (caseInsensitiveEqual(encodingQ.first, "gzip") &&
+        encodingQ.second >= 0.001) {
       hasGzip = true;
-    } else if (lower == "deflate" && encodingQ.second >= 0.001) {
+    } else if (caseInsensitiveEqual(encodingQ.first, "deflate") &&
+               encodingQ.second >= 0.001) {
       hasDeflate = true;
     }
   }
@@ -0,0 +1,563 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/WebSocketCodec.h>
+
+#include <algorithm>
+#include <cstring>
+#include <folly/Random.h>
+#include <folly/io/Cursor.h>
+#include <glog/logging.h>
+#include <proxygen/lib/utils/CryptUtil.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <zlib.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define PROXYGEN_WEBSOCKET_SSE2_MASK 1
+#else
+#define PROXYGEN_WEBSOCKET_SSE2_MASK 0
+#endif
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+using folly::io::Cursor;
+using std::string;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+const string kAcceptGUID("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+
+const uint8_t kFin = 0x80;
+const uint8_t kRsv1 = 0x40;
+const uint8_t kRsvMask = 0x70;
+const uint8_t kControlBit = 0x08;
+const uint8_t kMaskBit = 0x80;
+
+// shared by the frame headers of a thread
+const uint32_t kFrameHeaderBlockSize = 512;
+
+// the empty stored block that ends a sync flush, which permessage-deflate
+// leaves out of the messages
+const uint8_t kDeflateTail[] = {0x00, 0x00, 0xff, 0xff};
+
+const size_t kMinInflateOutput = 1024;
+const size_t kInflateAllocation = 16 * 1024;
+
+bool isValidCloseCode(uint16_t code) {
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+    (code >= 3000 && code <= 4999);
+}
+
+}
+
+void applyWebSocketMask(uint8_t* data, size_t length, const uint8_t mask[4],
+                        uint64_t offset) {
+  // the key as it lines up with data
+  uint8_t key[8];
+  for (size_t i = 0; i < sizeof(key); i++) {
+    key[i] = mask[(offset + i) & 3];
+  }
+  size_t i = 0;
+#if PROXYGEN_WEBSOCKET_SSE2_MASK
+  if (length >= 16) {
+    int32_t key32;
+    memcpy(&key32, key, sizeof(key32));
+    const __m128i key128 = _mm_set1_epi32(key32);
+    for (; i + 16 <= length; i += 16) {
+      __m128i* p = reinterpret_cast<__m128i*>(data + i);
+      _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+  }
+#endif
+  uint64_t key64;
+  memcpy(&key64, key, sizeof(key64));
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    word ^= key64;
+    memcpy(data + i, &word, sizeof(word));
+  }
+  // i is a multiple of 4, so the key still lines up
+  for (; i < length; i++) {
+    data[i] ^= key[i & 3];
+  }
+}
+
+/**
+ * Raw inflate state, kept in an ObjectPool between the messages of the
+ * connections that don't take the context over
+ */
+class WebSocketCodec::Inflater {
+ public:
+  Inflater() {
+    memset(&stream_, 0, sizeof(stream_));
+    int r = inflateInit2(&stream_, -15);
+    CHECK(r == Z_OK);
+  }
+
+  ~Inflater() {
+    inflateEnd(&stream_);
+  }
+
+  void reset() {
+    int r = inflateReset(&stream_);
+    CHECK(r == Z_OK);
+  }
+
+  /**
+   * Inflate length bytes of data into out, stopping once out holds more
+   * than limit bytes
+   *
+   * @return false if the data is not valid
+   */
+  bool inflate(const uint8_t* data, size_t length, IOBufQueue& out,
+               size_t limit) {
+    stream_.next_in = const_cast<uint8_t*>(data);
+    stream_.avail_in = length;
+    do {
+      auto writable = out.preallocate(kMinInflateOutput, kInflateAllocation);
+      stream_.next_out = static_cast<uint8_t*>(writable.first);
+      stream_.avail_out = writable.second;
+      int r = ::inflate(&stream_, Z_SYNC_FLUSH);
+      out.postallocate(writable.second - stream_.avail_out);
+      if (r == Z_STREAM_END) {
+        // a final block: what follows starts from scratch
+        reset();
+      } else if (r != Z_OK && r != Z_BUF_ERROR) {
+        VLOG(4) << "inflate failed: " << r;
+        return false;
+      }
+      if (out.chainLength() > limit) {
+        return true;
+      }
+    } while (stream_.avail_in > 0 || stream_.avail_out == 0);
+    return true;
+  }
+
+ private:
+  z_stream stream_;
+};
+
+WebSocketCodec::WebSocketCodec(TransportDirection direction):
+    direction_(direction),
+    fin_(false),
+    messageDeflated_(false),
+    ingressNoContextTakeover_(false),
+    parserPaused_(false),
+    parsing_(false),
+    done_(false) {
+  memset(mask_, 0, sizeof(mask_));
+}
+
+WebSocketCodec::~WebSocketCodec() {
+  if (inflater_) {
+    ObjectPool<Inflater>::get().recycle(std::move(inflater_));
+  }
+}
+
+string WebSocketCodec::getAcceptKey(StringPiece key) {
+  string text = key.str() + kAcceptGUID;
+  string digest = sha1Digest(
+    folly::ByteRange(reinterpret_cast<const uint8_t*>(text.data()),
+                     text.size()));
+  return base64Encode(
+    folly::ByteRange(reinterpret_cast<const uint8_t*>(digest.data()),
+                     digest.size()));
+}
+
+void WebSocketCodec::setDeflate(int level, bool ingressNoContextTakeover) {
+  CHECK_GE(level, 0);
+  deflateLevel_ = level;
+  ingressNoContextTakeover_ = ingressNoContextTakeover;
+}
+
+void WebSocketCodec::onIngress(unique_ptr<IOBuf> buf) {
+  if (buf) {
+    ingress_.append(std::move(buf));
+  }
+  if (parsing_) {
+    // resumed from a callback, the loop below goes on
+    return;
+  }
+  parsing_ = true;
+  while (!done_ && !parserPaused_) {
+    const bool progress = state_ == ParseState::FRAME_HEADER ?
+      parseFrameHeader() : parsePayload();
+    if (!progress) {
+      break;
+    }
+  }
+  parsing_ = false;
+  if (done_) {
+    ingress_.move();
+  }
+}
+
+void WebSocketCodec::setParserPaused(bool paused) {
+  parserPaused_ = paused;
+  if (!paused) {
+    onIngress(nullptr);
+  }
+}
+
+bool WebSocketCodec::parseFrameHeader() {
+  const size_t avail = ingress_.chainLength();
+  if (avail < 2) {
+    return false;
+  }
+  Cursor cursor(ingress_.front());
+  const uint8_t first = cursor.read<uint8_t>();
+  const uint8_t second = cursor.read<uint8_t>();
+  const bool masked = second & kMaskBit;
+  uint64_t length = second & ~kMaskBit;
+  const size_t headerSize = 2 + (masked ? 4 : 0) +
+    (length == 126 ? 2 : (length == 127 ? 8 : 0));
+  if (avail < headerSize) {
+    return false;
+  }
+  if (length == 126) {
+    length = cursor.readBE<uint16_t>();
+  } else if (length == 127) {
+    length = cursor.readBE<uint64_t>();
+  }
+  if (masked) {
+    cursor.pull(mask_, sizeof(mask_));
+  }
+  ingress_.trimStart(headerSize);
+
+  fin_ = first & kFin;
+  const uint8_t rsv = first & kRsvMask;
+  opcode_ = WebSocketOpcode(first & 0x0f);
+  VLOG(6) << "WebSocket frame opcode=" << unsigned(opcode_)
+          << " length=" << length << " fin=" << fin_;
+  if (masked != (direction_ == TransportDirection::DOWNSTREAM) ||
+      (length >> 63) != 0) {
+    fail(kCloseProtocolError);
+    return false;
+  }
+  const bool control = uint8_t(opcode_) & kControlBit;
+  if (control) {
+    if ((opcode_ != WebSocketOpcode::CLOSE &&
+         opcode_ != WebSocketOpcode::PING &&
+         opcode_ != WebSocketOpcode::PONG) ||
+        !fin_ || rsv != 0 || length > kMaxControlPayloadSize) {
+      fail(kCloseProtocolError);
+      return false;
+    }
+  } else if (opcode_ == WebSocketOpcode::CONTINUATION) {
+    if (messageOpcode_ == WebSocketOpcode::CONTINUATION || rsv != 0) {
+      fail(kCloseProtocolError);
+      return false;
+    }
+  } else if (opcode_ == WebSocketOpcode::TEXT ||
+             opcode_ == WebSocketOpcode::BINARY) {
+    // only the first frame of a message says it is deflated
+    if (messageOpcode_ != WebSocketOpcode::CONTINUATION ||
+        (rsv & ~kRsv1) != 0 || (rsv != 0 && !isDeflateEnabled())) {
+      fail(kCloseProtocolError);
+      return false;
+    }
+    messageOpcode_ = opcode_;
+    messageDeflated_ = rsv != 0;
+    messageSize_ = 0;
+  } else {
+    fail(kCloseProtocolError);
+    return false;
+  }
+  if (!control && !messageDeflated_ &&
+      length > maxMessageSize_ - messageSize_) {
+    fail(kCloseMessageTooBig);
+    return false;
+  }
+  remaining_ = length;
+  maskOffset_ = 0;
+  state_ = ParseState::PAYLOAD;
+  return true;
+}
+
+bool WebSocketCodec::parsePayload() {
+  const size_t avail = ingress_.chainLength();
+  if (uint8_t(opcode_) & kControlBit) {
+    if (avail < remaining_) {
+      return false;
+    }
+    auto payload = remaining_ > 0 ? ingress_.split(remaining_) :
+      IOBuf::create(0);
+    unmask(payload.get());
+    remaining_ = 0;
+    state_ = ParseState::FRAME_HEADER;
+    onControlFrame(std::move(payload));
+    return true;
+  }
+
+  if (avail == 0 && remaining_ > 0) {
+    return false;
+  }
+  const size_t length = std::min<uint64_t>(avail, remaining_);
+  auto data = length > 0 ? ingress_.split(length) : IOBuf::create(0);
+  unmask(data.get());
+  remaining_ -= length;
+  if (remaining_ == 0) {
+    state_ = ParseState::FRAME_HEADER;
+  }
+  const bool fin = remaining_ == 0 && fin_;
+  const WebSocketOpcode opcode = messageOpcode_;
+  if (messageDeflated_) {
+    IOBufQueue out(IOBufQueue::cacheChainLength());
+    if (!inflateData(data.get(), fin, out)) {
+      return false;
+    }
+    data = out.move();
+    if (!data) {
+      if (!fin) {
+        return true;
+      }
+      data = IOBuf::create(0);
+    }
+  } else {
+    messageSize_ += length;
+    if (length == 0 && !fin) {
+      return true;
+    }
+  }
+  if (fin) {
+    messageOpcode_ = WebSocketOpcode::CONTINUATION;
+  }
+  callback_->onMessageData(opcode, std::move(data), fin);
+  return true;
+}
+
+void WebSocketCodec::unmask(IOBuf* buf) {
+  if (direction_ == TransportDirection::UPSTREAM) {
+    return;
+  }
+  // The bytes were handed over by the transport, nothing else reads them,
+  // even if the buffers are shared
+  IOBuf* current = buf;
+  do {
+    if (current->length() > 0) {
+      applyWebSocketMask(current->writableData(), current->length(), mask_,
+                         maskOffset_);
+      maskOffset_ += current->length();
+    }
+    current = current->next();
+  } while (current != buf);
+}
+
+void WebSocketCodec::onControlFrame(unique_ptr<IOBuf> payload) {
+  switch (opcode_) {
+    case WebSocketOpcode::PING:
+      callback_->onPing(std::move(payload));
+      break;
+    case WebSocketOpcode::PONG:
+      callback_->onPong(std::move(payload));
+      break;
+    case WebSocketOpcode::CLOSE: {
+      const size_t length = payload->computeChainDataLength();
+      uint16_t code = kCloseNoStatus;
+      string reason;
+      if (length == 1) {
+        fail(kCloseProtocolError);
+        return;
+      } else if (length >= 2) {
+        Cursor cursor(payload.get());
+        code = cursor.readBE<uint16_t>();
+        if (!isValidCloseCode(code)) {
+          fail(kCloseProtocolError);
+          return;
+        }
+        reason.resize(length - 2);
+        cursor.pull(&reason[0], reason.size());
+      }
+      done_ = true;
+      callback_->onClose(code, std::move(reason));
+      break;
+    }
+    default:
+      LOG(DFATAL) << "Unexpected control opcode=" << unsigned(opcode_);
+  }
+}
+
+bool WebSocketCodec::inflateData(const IOBuf* data, bool fin,
+                                 IOBufQueue& out) {
+  if (!inflater_) {
+    inflater_ = ObjectPool<Inflater>::get().acquire();
+  }
+  const size_t limit = maxMessageSize_ - messageSize_;
+  bool valid = true;
+  const IOBuf* current = data;
+  do {
+    if (current->length() > 0) {
+      valid = inflater_->inflate(current->data(), current->length(), out,
+                                 limit);
+    }
+    current = current->next();
+  } while (valid && current != data && out.chainLength() <= limit);
+  if (valid && fin && out.chainLength() <= limit) {
+    valid = inflater_->inflate(kDeflateTail, sizeof(kDeflateTail), out,
+                               limit);
+  }
+  if (!valid) {
+    fail(kCloseInvalidPayload);
+    return false;
+  }
+  if (out.chainLength() > limit) {
+    fail(kCloseMessageTooBig);
+    return false;
+  }
+  messageSize_ += out.chainLength();
+  if (fin && ingressNoContextTakeover_) {
+    // the next message may get another one
+    ObjectPool<Inflater>::get().recycle(std::move(inflater_));
+  }
+  return true;
+}
+
+void WebSocketCodec::fail(uint16_t code) {
+  if (done_) {
+    return;
+  }
+  VLOG(4) << "WebSocket protocol error, closing with " << code;
+  done_ = true;
+  callback_->onError(code);
+}
+
+size_t WebSocketCodec::generateMessage(IOBufQueue& writeBuf,
+                                       WebSocketOpcode opcode,
+                                       unique_ptr<IOBuf> data) {
+  DCHECK(opcode == WebSocketOpcode::TEXT ||
+         opcode == WebSocketOpcode::BINARY);
+  uint8_t first = kFin | uint8_t(opcode);
+  const size_t length = data ? data->computeChainDataLength() : 0;
+  if (isDeflateEnabled() && length >= kMinDeflateSize) {
+    auto compressor = ZlibStreamCompressor::acquire(
+      ZlibStreamCompressor::Type::RAW, deflateLevel_);
+    auto compressed = compressor->compress(data.get(), Z_SYNC_FLUSH);
+    ZlibStreamCompressor::release(std::move(compressor));
+    IOBufQueue queue(IOBufQueue::cacheChainLength());
+    if (compressed) {
+      queue.append(std::move(compressed));
+    }
+    // sent as it is if deflate fails or doesn't make it smaller
+    if (queue.chainLength() >= sizeof(kDeflateTail) &&
+        queue.chainLength() - sizeof(kDeflateTail) < length) {
+      queue.trimEnd(sizeof(kDeflateTail));
+      first |= kRsv1;
+      data = queue.move();
+    }
+  }
+  return writeFrame(writeBuf, first, std::move(data));
+}
+
+size_t WebSocketCodec::generateFrame(IOBufQueue& writeBuf,
+                                     WebSocketOpcode opcode,
+                                     unique_ptr<IOBuf> data, bool fin) {
+  DCHECK(!(uint8_t(opcode) & kControlBit));
+  return writeFrame(writeBuf, (fin ? kFin : 0) | uint8_t(opcode),
+                    std::move(data));
+}
+
+size_t WebSocketCodec::generatePing(IOBufQueue& writeBuf,
+                                    unique_ptr<IOBuf> data) {
+  DCHECK(!data || data->computeChainDataLength() <= kMaxControlPayloadSize);
+  return writeFrame(writeBuf, kFin | uint8_t(WebSocketOpcode::PING),
+                    std::move(data));
+}
+
+size_t WebSocketCodec::generatePong(IOBufQueue& writeBuf,
+                                    unique_ptr<IOBuf> data) {
+  DCHECK(!data || data->computeChainDataLength() <= kMaxControlPayloadSize);
+  return writeFrame(writeBuf, kFin | uint8_t(WebSocketOpcode::PONG),
+                    std::move(data));
+}
+
+size_t WebSocketCodec::generateClose(IOBufQueue& writeBuf, uint16_t code,
+                                     StringPiece reason) {
+  unique_ptr<IOBuf> payload;
+  if (code != kCloseNoStatus) {
+    const size_t reasonLength =
+      std::min(reason.size(), kMaxControlPayloadSize - 2);
+    payload = IOBuf::create(2 + reasonLength);
+    uint8_t* dst = payload->writableData();
+    dst[0] = uint8_t(code >> 8);
+    dst[1] = uint8_t(code);
+    if (reasonLength > 0) {
+      memcpy(dst + 2, reason.data(), reasonLength);
+    }
+    payload->append(2 + reasonLength);
+  }
+  return writeFrame(writeBuf, kFin | uint8_t(WebSocketOpcode::CLOSE),
+                    std::move(payload));
+}
+
+size_t WebSocketCodec::writeFrame(IOBufQueue& writeBuf, uint8_t first,
+                                  unique_ptr<IOBuf> data) {
+  const uint64_t length = data ? data->computeChainDataLength() : 0;
+  const bool masked = direction_ == TransportDirection::UPSTREAM;
+  const size_t headerSize = 2 + (masked ? 4 : 0) +
+    (length > 0xffff ? 8 : (length > kMaxControlPayloadSize ? 2 : 0));
+  IOBufSlab::get().reserveTailroom(writeBuf, headerSize,
+                                   kFrameHeaderBlockSize);
+  uint8_t* const start =
+    static_cast<uint8_t*>(writeBuf.preallocate(headerSize, headerSize).first);
+  uint8_t* dst = start;
+  *dst++ = first;
+  const uint8_t maskBit = masked ? kMaskBit : 0;
+  if (length <= kMaxControlPayloadSize) {
+    *dst++ = maskBit | uint8_t(length);
+  } else if (length <= 0xffff) {
+    *dst++ = maskBit | 126;
+    *dst++ = uint8_t(length >> 8);
+    *dst++ = uint8_t(length);
+  } else {
+    *dst++ = maskBit | 127;
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      *dst++ = uint8_t(length >> shift);
+    }
+  }
+  if (masked) {
+    const uint32_t key = folly::Random::rand32();
+    uint8_t mask[4];
+    memcpy(mask, &key, sizeof(mask));
+    memcpy(dst, mask, sizeof(mask));
+    dst += sizeof(mask);
+    if (length > 0) {
+      if (data->isShared()) {
+        // masking in place would change the buffers of others
+        auto copy = IOBuf::create(length);
+        Cursor(data.get()).pull(copy->writableTail(), length);
+        copy->append(length);
+        data = std::move(copy);
+      }
+      uint64_t offset = 0;
+      IOBuf* current = data.get();
+      do {
+        applyWebSocketMask(current->writableData(), current->length(), mask,
+                           offset);
+        offset += current->length();
+        current = current->next();
+      } while (current != data.get());
+    }
+  }
+  DCHECK_EQ(size_t(dst - start), headerSize);
+  writeBuf.postallocate(headerSize);
+  if (length > 0) {
+    writeBuf.append(std::move(data));
+  }
+  return headerSize + length;
+}
+
+}
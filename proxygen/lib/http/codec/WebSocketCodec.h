@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <memory>
+#include <proxygen/lib/http/codec/TransportDirection.h>
+#include <string>
+
+namespace proxygen {
+
+enum class WebSocketOpcode : uint8_t {
+  CONTINUATION = 0x0,
+  TEXT = 0x1,
+  BINARY = 0x2,
+  CLOSE = 0x8,
+  PING = 0x9,
+  PONG = 0xa,
+};
+
+/**
+ * XOR length bytes of data with the 4 byte masking key of a WebSocket
+ * frame, as if the masking had started offset bytes before data. Masking
+ * and unmasking are the same. Done 16 bytes at a time with SSE2 where it
+ * is available and 8 at a time otherwise.
+ */
+void applyWebSocketMask(uint8_t* data, size_t length, const uint8_t mask[4],
+                        uint64_t offset);
+
+/**
+ * The framing of WebSockets (RFC 6455), over the raw bytes of a connection
+ * after an HTTP/1.1 Upgrade, with the permessage-deflate extension (RFC
+ * 7692).
+ *
+ * Ingress is passed up as it arrives: the payload of TEXT and BINARY
+ * frames goes to onMessageData() in pieces, which are the ingress IOBufs
+ * themselves, unmasked in place, and messages of any size are never held
+ * whole. Control frames are passed up once complete. TEXT payloads are
+ * not checked for UTF-8.
+ *
+ * On a protocol violation the codec stops parsing and calls onError()
+ * with the close code; the caller is to send a CLOSE with it and close
+ * the connection. The callbacks must not destroy the codec.
+ */
+class WebSocketCodec {
+ public:
+  static const uint16_t kCloseNormal = 1000;
+  static const uint16_t kCloseGoingAway = 1001;
+  static const uint16_t kCloseProtocolError = 1002;
+  static const uint16_t kCloseUnsupportedData = 1003;
+  // never sent, for a CLOSE without a code
+  static const uint16_t kCloseNoStatus = 1005;
+  static const uint16_t kCloseInvalidPayload = 1007;
+  static const uint16_t kClosePolicyViolation = 1008;
+  static const uint16_t kCloseMessageTooBig = 1009;
+  static const uint16_t kCloseInternalError = 1011;
+
+  static const size_t kMaxFrameHeaderSize = 14;
+  static const size_t kMaxControlPayloadSize = 125;
+  static const size_t kDefaultMaxMessageSize = 16 * 1024 * 1024;
+  // smaller messages are sent as they are even with permessage-deflate
+  static const size_t kMinDeflateSize = 64;
+
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+    /**
+     * Part of a TEXT or BINARY message, possibly empty, in order; fin is
+     * set on the last one. The parts don't follow the frame boundaries.
+     */
+    virtual void onMessageData(WebSocketOpcode opcode,
+                               std::unique_ptr<folly::IOBuf> data,
+                               bool fin) = 0;
+
+    virtual void onPing(std::unique_ptr<folly::IOBuf> data) = 0;
+
+    virtual void onPong(std::unique_ptr<folly::IOBuf> data) = 0;
+
+    /**
+     * The peer sent a CLOSE, with kCloseNoStatus if it had no code. The
+     * codec parses nothing after it.
+     */
+    virtual void onClose(uint16_t code, std::string reason) = 0;
+
+    /**
+     * The peer broke the protocol, the connection is to be closed with
+     * code
+     */
+    virtual void onError(uint16_t code) = 0;
+  };
+
+  /**
+   * A DOWNSTREAM codec is the server: its ingress must be masked and its
+   * egress is not. An UPSTREAM one is the other way around.
+   */
+  explicit WebSocketCodec(TransportDirection direction);
+  ~WebSocketCodec();
+
+  WebSocketCodec(const WebSocketCodec&) = delete;
+  WebSocketCodec& operator=(const WebSocketCodec&) = delete;
+
+  /**
+   * The value of the Sec-WebSocket-Accept header that answers the
+   * Sec-WebSocket-Key of a handshake
+   */
+  static std::string getAcceptKey(folly::StringPiece key);
+
+  void setCallback(Callback* callback) {
+    callback_ = callback;
+  }
+
+  /**
+   * Messages longer than this, once inflated, fail with
+   * kCloseMessageTooBig
+   */
+  void setMaxMessageSize(size_t size) {
+    maxMessageSize_ = size;
+  }
+
+  /**
+   * Turn on permessage-deflate, as negotiated in the handshake. Egress
+   * messages are deflated at level, each on its own with a compressor of
+   * the ZlibStreamCompressor pool, which is what the server_no_context_
+   * takeover parameter promises. With ingressNoContextTakeover, which
+   * the peer must have agreed to with client_no_context_takeover, the
+   * ingress messages are inflated with pooled inflaters too; otherwise
+   * the codec keeps one for the whole connection.
+   */
+  void setDeflate(int level, bool ingressNoContextTakeover);
+
+  bool isDeflateEnabled() const {
+    return deflateLevel_ >= 0;
+  }
+
+  /**
+   * Parse buf, after what was given before; callbacks are made from here.
+   * The bytes after a partial frame are kept for the next call.
+   */
+  void onIngress(std::unique_ptr<folly::IOBuf> buf);
+
+  /**
+   * While paused, onIngress() only queues the bytes. Resuming parses what
+   * is queued.
+   */
+  void setParserPaused(bool paused);
+
+  bool isParserPaused() const {
+    return parserPaused_;
+  }
+
+  /**
+   * @return the ingress bytes that wait for the rest of their frame, or
+   *         for the parser to be resumed
+   */
+  size_t getPendingIngressSize() const {
+    return ingress_.chainLength();
+  }
+
+  /**
+   * Write a whole TEXT or BINARY message as one frame, deflated if
+   * permessage-deflate is on and it is worth it. The payload is chained,
+   * not copied, unless it must be masked and is shared.
+   *
+   * @return the number of bytes written
+   */
+  size_t generateMessage(folly::IOBufQueue& writeBuf, WebSocketOpcode opcode,
+                         std::unique_ptr<folly::IOBuf> data);
+
+  /**
+   * Write one frame of a message sent in pieces: TEXT or BINARY first,
+   * then CONTINUATION, with fin on the last one. These aren't deflated.
+   */
+  size_t generateFrame(folly::IOBufQueue& writeBuf, WebSocketOpcode opcode,
+                       std::unique_ptr<folly::IOBuf> data, bool fin);
+
+  size_t generatePing(folly::IOBufQueue& writeBuf,
+                      std::unique_ptr<folly::IOBuf> data);
+
+  size_t generatePong(folly::IOBufQueue& writeBuf,
+                      std::unique_ptr<folly::IOBuf> data);
+
+  /**
+   * Write a CLOSE with code, or without one for kCloseNoStatus. The reason
+   * is cut to what fits in a control frame.
+   */
+  size_t generateClose(folly::IOBufQueue& writeBuf, uint16_t code,
+                       folly::StringPiece reason);
+
+ private:
+  class Inflater;
+
+  enum class ParseState : uint8_t {
+    FRAME_HEADER,
+    PAYLOAD,
+  };
+
+  bool parseFrameHeader();
+  bool parsePayload();
+  void unmask(folly::IOBuf* buf);
+  void onControlFrame(std::unique_ptr<folly::IOBuf> payload);
+  bool inflateData(const folly::IOBuf* data, bool fin,
+                   folly::IOBufQueue& out);
+  void fail(uint16_t code);
+  size_t writeFrame(folly::IOBufQueue& writeBuf, uint8_t firstByte,
+                    std::unique_ptr<folly::IOBuf> data);
+
+  Callback* callback_{nullptr};
+  folly::IOBufQueue ingress_{folly::IOBufQueue::cacheChainLength()};
+  size_t maxMessageSize_{kDefaultMaxMessageSize};
+
+  // the frame being parsed
+  uint64_t remaining_{0};
+  uint64_t maskOffset_{0};
+  uint8_t mask_[4];
+  WebSocketOpcode opcode_{WebSocketOpcode::CONTINUATION};
+
+  // the message being parsed, CONTINUATION between messages
+  WebSocketOpcode messageOpcode_{WebSocketOpcode::CONTINUATION};
+  uint64_t messageSize_{0};
+  std::unique_ptr<Inflater> inflater_;
+
+  int deflateLevel_{-1};
+
+  const TransportDirection direction_;
+  ParseState state_{ParseState::FRAME_HEADER};
+  bool fin_:1;
+  bool messageDeflated_:1;
+  bool ingressNoContextTakeover_:1;
+  bool parserPaused_:1;
+  bool parsing_:1;
+  // after an error or a CLOSE nothing more is parsed
+  bool done_:1;
+};
+
+}
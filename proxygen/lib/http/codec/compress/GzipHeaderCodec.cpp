@@ -9,12 +9,15 @@
  */
 #include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
 
+#include <algorithm>
 #include <folly/Memory.h>
 #include <folly/String.h>
 #include <folly/ThreadLocal.h>
 #include <folly/io/IOBuf.h>
+#include <mutex>
 #include <proxygen/lib/http/codec/SPDYCodec.h>
 #include <proxygen/lib/http/codec/SPDYConstants.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
 #include <proxygen/lib/utils/UnionBasedStatic.h>
 #include <string>
 
@@ -25,6 +28,7 @@ using proxygen::compress::Header;
 using proxygen::compress::HeaderPiece;
 using proxygen::compress::HeaderPieceList;
 using proxygen::spdy::kMaxFrameLength;
+using std::chrono::nanoseconds;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -62,12 +66,13 @@ namespace proxygen {
 
 GzipHeaderCodec::GzipHeaderCodec(int compressionLevel,
                                  const SPDYVersionSettings& versionSettings)
-    : versionSettings_(versionSettings) {
-  // Create compression and decompression contexts by cloning thread-local
-  // copies of the initial SPDY compression state
-  auto context = getZlibContext(versionSettings, compressionLevel);
-  deflateCopy(&deflater_, const_cast<z_stream*>(&(context->deflater)));
-  inflateCopy(&inflater_, const_cast<z_stream*>(&(context->inflater)));
+    : versionSettings_(versionSettings),
+      compressionLevel_(compressionLevel),
+      // Take compression and decompression contexts in the initial SPDY
+      // compression state from the thread-local pool
+      context_(acquireZlibContext(versionSettings, compressionLevel)),
+      deflaterLevel_(compressionLevel == Z_DEFAULT_COMPRESSION ?
+                     6 : compressionLevel) {
 }
 
 GzipHeaderCodec::GzipHeaderCodec(int compressionLevel,
@@ -77,62 +82,169 @@ GzipHeaderCodec::GzipHeaderCodec(int compressionLevel,
         SPDYCodec::getVersionSettings(version)) {}
 
 GzipHeaderCodec::~GzipHeaderCodec() {
-  deflateEnd(&deflater_);
-  inflateEnd(&inflater_);
+  releaseZlibContext(versionSettings_, compressionLevel_, std::move(context_));
+}
+
+void GzipHeaderCodec::prewarm(SPDYVersion version, int compressionLevel) {
+  const auto& versionSettings = SPDYCodec::getVersionSettings(version);
+  releaseZlibContext(versionSettings, compressionLevel,
+                     acquireZlibContext(versionSettings, compressionLevel));
+}
+
+__thread int GzipHeaderCodec::threadMaxLevel_ = Z_BEST_COMPRESSION;
+
+void GzipHeaderCodec::setThreadMaxLevel(int level) {
+  threadMaxLevel_ = std::max(level, 1);
+}
+
+int GzipHeaderCodec::getDeflateLevel() const {
+  // The window and memLevel of the deflater are fixed for the life of the
+  // stream, which the peer inflates as one, but its level may change
+  // between blocks. The window of a codec without compression is too
+  // small to ever compress.
+  int level = compressionLevel_ == Z_DEFAULT_COMPRESSION ?
+    6 : compressionLevel_;
+  if (level <= 1) {
+    return level;
+  }
+  if (deflatedBlocks_ < kWarmupBlocks) {
+    return 1;
+  }
+  return std::min(level, threadMaxLevel_);
 }
 
 folly::IOBuf& GzipHeaderCodec::getHeaderBuf() {
   return getStaticHeaderBufSpace(maxUncompressed_);
 }
 
-const GzipHeaderCodec::ZlibContext* GzipHeaderCodec::getZlibContext(
-    SPDYVersionSettings versionSettings, int compressionLevel) {
+GzipHeaderCodec::ZlibContext& GzipHeaderCodec::getPrimedZlibContext(
+    const SPDYVersionSettings& versionSettings, int compressionLevel) {
+  // never destroyed, the thread local pools of exiting threads may still
+  // point at its contexts
+  static auto primedContexts =
+    new std::map<ZlibConfig, unique_ptr<ZlibContext>>();
+  static std::mutex primedMutex;
+  std::lock_guard<std::mutex> guard(primedMutex);
+  ZlibConfig zlibConfig(versionSettings.version, compressionLevel);
+  auto& primed = (*primedContexts)[zlibConfig];
+  if (primed) {
+    return *primed;
+  }
+  // This is the first request for the specified SPDY version and compression
+  // level in the process, so we need to construct the initial compressor
+  // and decompressor contexts. They are only read from then on, by
+  // deflateCopy() and inflateCopy(), which is safe from any thread.
+  auto newContext = folly::make_unique<ZlibContext>();
+  newContext->deflater.zalloc = Z_NULL;
+  newContext->deflater.zfree = Z_NULL;
+  newContext->deflater.opaque = Z_NULL;
+  newContext->deflater.avail_in = 0;
+  newContext->deflater.next_in = Z_NULL;
+  int windowBits  = (compressionLevel == Z_NO_COMPRESSION) ? 8 : 11;
+  int r = deflateInit2(
+      &(newContext->deflater),
+      compressionLevel,
+      Z_DEFLATED, // compression method
+      windowBits, // log2 of the compression window size, negative value
+                  // means raw deflate output format w/o libz header
+      1,          // memory size for internal compression state, 1-9
+      Z_DEFAULT_STRATEGY);
+  CHECK(r == Z_OK);
+  if (compressionLevel != Z_NO_COMPRESSION) {
+    r = deflateSetDictionary(&(newContext->deflater), versionSettings.dict,
+                             versionSettings.dictSize);
+    CHECK(r == Z_OK);
+  }
+
+  newContext->inflater.zalloc = Z_NULL;
+  newContext->inflater.zfree = Z_NULL;
+  newContext->inflater.opaque = Z_NULL;
+  newContext->inflater.avail_in = 0;
+  newContext->inflater.next_in = Z_NULL;
+  r = inflateInit(&(newContext->inflater));
+  CHECK(r == Z_OK);
+
+  primed = std::move(newContext);
+  return *primed;
+}
+
+GzipHeaderCodec::ZlibContextPool& GzipHeaderCodec::getZlibContextPool(
+    const SPDYVersionSettings& versionSettings, int compressionLevel) {
   static folly::ThreadLocal<ZlibContextMap> zlibContexts_;
   ZlibConfig zlibConfig(versionSettings.version, compressionLevel);
   auto match = zlibContexts_->find(zlibConfig);
   if (match != zlibContexts_->end()) {
-    return match->second.get();
-  } else {
-    // This is the first request for the specified SPDY version and compression
-    // level in this thread, so we need to construct the initial compressor and
-    // decompressor contexts.
-    auto newContext = folly::make_unique<ZlibContext>();
-    newContext->deflater.zalloc = Z_NULL;
-    newContext->deflater.zfree = Z_NULL;
-    newContext->deflater.opaque = Z_NULL;
-    newContext->deflater.avail_in = 0;
-    newContext->deflater.next_in = Z_NULL;
-    int windowBits  = (compressionLevel == Z_NO_COMPRESSION) ? 8 : 11;
-    int r = deflateInit2(
-        &(newContext->deflater),
-        compressionLevel,
-        Z_DEFLATED, // compression method
-        windowBits, // log2 of the compression window size, negative value
-                    // means raw deflate output format w/o libz header
-        1,          // memory size for internal compression state, 1-9
-        Z_DEFAULT_STRATEGY);
-    CHECK(r == Z_OK);
-    if (compressionLevel != Z_NO_COMPRESSION) {
-      r = deflateSetDictionary(&(newContext->deflater), versionSettings.dict,
-                               versionSettings.dictSize);
-      CHECK(r == Z_OK);
-    }
+    return match->second;
+  }
+  auto& pool = (*zlibContexts_)[zlibConfig];
+  pool.primed = &getPrimedZlibContext(versionSettings, compressionLevel);
+  return pool;
+}
+
+size_t GzipHeaderCodec::getMemoryUsage() const {
+  if (!context_) {
+    return 0;
+  }
+  // from zconf.h: deflate takes (1 << (windowBits + 2)) +
+  // (1 << (memLevel + 9)), inflate a 32K window and about 7K of state
+  int windowBits  = (compressionLevel_ == Z_NO_COMPRESSION) ? 8 : 11;
+  const size_t deflateBytes = (1 << (windowBits + 2)) + (1 << (1 + 9));
+  const size_t inflateBytes = (1 << 15) + 7 * 1024;
+  return sizeof(ZlibContext) + deflateBytes + inflateBytes;
+}
 
-    newContext->inflater.zalloc = Z_NULL;
-    newContext->inflater.zfree = Z_NULL;
-    newContext->inflater.opaque = Z_NULL;
-    newContext->inflater.avail_in = 0;
-    newContext->inflater.next_in = Z_NULL;
-    r = inflateInit(&(newContext->inflater));
+unique_ptr<GzipHeaderCodec::ZlibContext> GzipHeaderCodec::acquireZlibContext(
+    const SPDYVersionSettings& versionSettings, int compressionLevel) {
+  auto& pool = getZlibContextPool(versionSettings, compressionLevel);
+  if (!pool.free.empty()) {
+    // Reuse the context of a codec that went away. deflateReset() would
+    // need the dictionary hashed again, so the deflater is copied from the
+    // primed one instead; the inflater only takes its dictionary once the
+    // stream asks for it, and is reset in place.
+    auto context = std::move(pool.free.back());
+    pool.free.pop_back();
+    deflateEnd(&context->deflater);
+    int r = deflateCopy(&context->deflater, &pool.primed->deflater);
+    CHECK(r == Z_OK);
+    r = inflateReset(&context->inflater);
     CHECK(r == Z_OK);
+    return context;
+  }
+  auto context = folly::make_unique<ZlibContext>();
+  int r = deflateCopy(&context->deflater, &pool.primed->deflater);
+  CHECK(r == Z_OK);
+  r = inflateCopy(&context->inflater, &pool.primed->inflater);
+  CHECK(r == Z_OK);
+  return context;
+}
 
-    auto result = newContext.get();
-    zlibContexts_->emplace(zlibConfig, std::move(newContext));
-    return result;
+void GzipHeaderCodec::releaseZlibContext(
+    const SPDYVersionSettings& versionSettings, int compressionLevel,
+    unique_ptr<ZlibContext> context) {
+  auto& pool = getZlibContextPool(versionSettings, compressionLevel);
+  if (pool.free.size() < kMaxPooledContexts) {
+    pool.free.push_back(std::move(context));
   }
 }
 
-unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
+size_t GzipHeaderCodec::maxSerializedSize(
+    const vector<Header>& headers) const {
+  // This is an upper bound on the amount of space we'll actually need,
+  // because if we end up combining any headers with the same name, the
+  // combined representation will be smaller than the original.
+  size_t maxSize = 0;
+  for (const Header& header : headers) {
+    maxSize += versionSettings_.nameValueSize;
+    maxSize += header.name->length();
+    maxSize += versionSettings_.nameValueSize;
+    maxSize += header.value->length();
+  }
+  return maxSize;
+}
+
+uint8_t* GzipHeaderCodec::serializeNameValues(vector<Header>& headers,
+                                              uint8_t* dst,
+                                              uint32_t& numHeaders) {
   // Build a sequence of the header names and values, sorted by name.
   // The purpose of the sort is to make it easier to combine the
   // values of multiple headers with the same name.  The SPDY spec
@@ -140,37 +252,11 @@ unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
   // Name/Value list, so we must combine values when serializing.
   std::sort(headers.begin(), headers.end());
 
-  auto& uncompressed = getHeaderBuf();
-  // Compute the amount of space needed to hold the uncompressed
-  // representation of the headers.  This is an upper bound on the
-  // amount of space we'll actually need, because if we end up
-  // combining any headers with the same name, the combined
-  // representation will be smaller than the original.
-  size_t maxUncompressedSize = versionSettings_.nameValueSize;
-  for (const Header& header : headers) {
-    maxUncompressedSize += versionSettings_.nameValueSize;
-    maxUncompressedSize += header.name->length();
-    maxUncompressedSize += versionSettings_.nameValueSize;
-    maxUncompressedSize += header.value->length();
-  }
-
-  // TODO: give on 'onError()' callback if the space in uncompressed buf
-  // cannot fit the headers and then skip the "reserve" code below. We
-  // have already reserved the maximum legal amount of space for
-  // uncompressed headers.
-
-  VLOG(4) << "reserving " << maxUncompressedSize
-          << " bytes for uncompressed headers";
-  uncompressed.reserve(0, maxUncompressedSize);
-
-  // Serialize the uncompressed representation of the headers.
-  uint8_t* dst = uncompressed.writableData();
-  dst += versionSettings_.nameValueSize; // Leave space for count of headers.
   HTTPHeaderCode lastCode = HTTP_HEADER_OTHER;
   const string* lastName = &empty_string;
   uint8_t* lastValueLenPtr = nullptr;
   size_t lastValueLen = 0;
-  unsigned numHeaders = 0;
+  numHeaders = 0;
   for (const Header& header : headers) {
     if ((header.code != lastCode) || (*header.name != *lastName)) {
       // Simple case: this header name is different from the previous
@@ -199,6 +285,35 @@ unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
       versionSettings_.appendSizeFun(tmp, lastValueLen);
     }
   }
+  return dst;
+}
+
+unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
+  auto& uncompressed = getHeaderBuf();
+  // Compute the amount of space needed to hold the uncompressed
+  // representation of the headers.
+  size_t maxUncompressedSize =
+    versionSettings_.nameValueSize + maxSerializedSize(headers);
+
+  // TODO: give on 'onError()' callback if the space in uncompressed buf
+  // cannot fit the headers and then skip the "reserve" code below. We
+  // have already reserved the maximum legal amount of space for
+  // uncompressed headers.
+
+  VLOG(4) << "reserving " << maxUncompressedSize
+          << " bytes for uncompressed headers";
+  uncompressed.reserve(0, maxUncompressedSize);
+
+  // Serialize the uncompressed representation of the headers, leaving
+  // space for the count of headers.
+  uint32_t numHeaders = 0;
+  uint8_t* dst = serializeNameValues(
+    headers, uncompressed.writableData() + versionSettings_.nameValueSize,
+    numHeaders);
 
   // Compute the uncompressed length; if we combined any header values,
   // we will have used less space than originally estimated.
@@ -208,21 +323,79 @@ unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
   dst = uncompressed.writableData();
   versionSettings_.appendSizeFun(dst, numHeaders);
 
+  return deflateHeaders(uncompressedLen, start);
+}
+
+unique_ptr<IOBuf> GzipHeaderCodec::serializeShared(
+    vector<Header>& headers, uint32_t& numEntries) noexcept {
+  unique_ptr<IOBuf> out(
+    IOBufSlab::get().create(maxSerializedSize(headers)));
+  uint8_t* dst = serializeNameValues(headers, out->writableData(),
+                                     numEntries);
+  out->append(dst - out->writableData());
+  return out;
+}
+
+unique_ptr<IOBuf> GzipHeaderCodec::encodeWithShared(
+    vector<Header>& headers, const IOBuf& shared,
+    uint32_t sharedEntries) noexcept {
+  DCHECK(!shared.isChained());
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
+  auto& uncompressed = getHeaderBuf();
+  size_t maxUncompressedSize = versionSettings_.nameValueSize +
+    maxSerializedSize(headers) + shared.length();
+  uncompressed.reserve(0, maxUncompressedSize);
+
+  uint32_t numHeaders = 0;
+  uint8_t* dst = serializeNameValues(
+    headers, uncompressed.writableData() + versionSettings_.nameValueSize,
+    numHeaders);
+  // The shared entries were lowercased and combined when they were
+  // serialized, and their names don't collide with the ones above
+  memcpy(dst, shared.data(), shared.length());
+  dst += shared.length();
+  size_t uncompressedLen = dst - uncompressed.writableData();
+
+  dst = uncompressed.writableData();
+  versionSettings_.appendSizeFun(dst, numHeaders + sharedEntries);
+
+  return deflateHeaders(uncompressedLen, start);
+}
+
+unique_ptr<IOBuf> GzipHeaderCodec::deflateHeaders(
+    size_t uncompressedLen, TimePoint start) noexcept {
+  auto& uncompressed = getHeaderBuf();
   // Allocate a contiguous space big enough to hold the compressed headers,
   // plus any headroom requested by the caller.
-  size_t maxDeflatedSize = deflateBound(&deflater_, uncompressedLen);
-  unique_ptr<IOBuf> out(IOBuf::create(maxDeflatedSize + encodeHeadroom_));
+  size_t maxDeflatedSize = deflateBound(&context_->deflater, uncompressedLen);
+  unique_ptr<IOBuf> out(
+    IOBufSlab::get().create(maxDeflatedSize + encodeHeadroom_));
   out->advance(encodeHeadroom_);
 
+  context_->deflater.next_out = out->writableData();
+  context_->deflater.avail_out = maxDeflatedSize;
+  int level = getDeflateLevel();
+  if (level != deflaterLevel_) {
+    // The last block was flushed, so there is nothing left to compress
+    // at the old level; older zlibs still report that as Z_BUF_ERROR
+    context_->deflater.next_in = Z_NULL;
+    context_->deflater.avail_in = 0;
+    int r = deflateParams(&context_->deflater, level, Z_DEFAULT_STRATEGY);
+    CHECK(r == Z_OK || r == Z_BUF_ERROR);
+    deflaterLevel_ = level;
+  }
+  deflatedBlocks_++;
+
   // Compress
-  deflater_.next_in = uncompressed.writableData();
-  deflater_.avail_in = uncompressedLen;
-  deflater_.next_out = out->writableData();
-  deflater_.avail_out = maxDeflatedSize;
-  int r = deflate(&deflater_, Z_SYNC_FLUSH);
+  context_->deflater.next_in = uncompressed.writableData();
+  context_->deflater.avail_in = uncompressedLen;
+  int r = deflate(&context_->deflater, Z_SYNC_FLUSH);
   CHECK(r == Z_OK);
-  CHECK(deflater_.avail_in == 0);
-  out->append(maxDeflatedSize - deflater_.avail_out);
+  CHECK(context_->deflater.avail_in == 0);
+  out->append(maxDeflatedSize - context_->deflater.avail_out);
 
   VLOG(4) << "header size orig=" << uncompressedLen
           << ", max deflated=" << maxDeflatedSize
@@ -232,20 +405,16 @@ unique_ptr<IOBuf> GzipHeaderCodec::encode(vector<Header>& headers) noexcept {
   encodedSize_.uncompressed = uncompressedLen;
   if (stats_) {
     stats_->recordEncode(Type::GZIP, encodedSize_);
+    stats_->recordEncodeTime(
+      Type::GZIP,
+      std::chrono::duration_cast<nanoseconds>(getCurrentTime() - start));
   }
 
   return std::move(out);
 }
 
-Result<HeaderDecodeResult, HeaderDecodeError>
-GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
-  outHeaders_.clear();
-
-  // empty header block
-  if (length == 0) {
-    return HeaderDecodeResult{outHeaders_, 0};
-  }
-
+Result<uint32_t, HeaderDecodeError>
+GzipHeaderCodec::inflateHeaders(Cursor& cursor, uint32_t length) noexcept {
   // Get the thread local buffer space to use
   auto& uncompressed = getHeaderBuf();
   uint32_t consumed = 0;
@@ -253,8 +422,8 @@ GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
   while (length > 0) {
     auto next = cursor.peek();
     uint32_t chunkLen = std::min((uint32_t)next.second, length);
-    inflater_.avail_in = chunkLen;
-    inflater_.next_in = (uint8_t *)next.first;
+    context_->inflater.avail_in = chunkLen;
+    context_->inflater.next_in = (uint8_t *)next.first;
     do {
       if (uncompressed.tailroom() == 0) {
         // This code should not execute, since we throw an error if the
@@ -264,19 +433,24 @@ GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
         uncompressed.reserve(0, uncompressed.capacity());
       }
 
-      inflater_.next_out = uncompressed.writableTail();
-      inflater_.avail_out = uncompressed.tailroom();
-      int r = inflate(&inflater_, Z_NO_FLUSH);
+      // inflate at most one byte past the limit, however much the block
+      // expands
+      uint64_t room = uint64_t(maxUncompressed_) + 1 - uncompressed.length();
+      context_->inflater.next_out = uncompressed.writableTail();
+      context_->inflater.avail_out = std::min<uint64_t>(uncompressed.tailroom(),
+                                                        room);
+      uint32_t availOut = context_->inflater.avail_out;
+      int r = inflate(&context_->inflater, Z_NO_FLUSH);
       if (r == Z_NEED_DICT) {
         // we cannot initialize the inflater dictionary before calling inflate()
         // as it checks the adler-32 checksum of the supplied dictionary
-        r = inflateSetDictionary(&inflater_, versionSettings_.dict,
+        r = inflateSetDictionary(&context_->inflater, versionSettings_.dict,
                                  versionSettings_.dictSize);
         if (r != Z_OK) {
           LOG(ERROR) << "inflate set dictionary failed with error=" << r;
           return HeaderDecodeError::INFLATE_DICTIONARY;
         }
-        inflater_.avail_out = 0;
+        context_->inflater.avail_out = 0;
         continue;
       }
       if (r != 0) {
@@ -284,12 +458,12 @@ GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
         LOG(ERROR) << "inflate failed with error=" << r;
         return HeaderDecodeError::BAD_ENCODING;
       }
-      uncompressed.append(uncompressed.tailroom() - inflater_.avail_out);
+      uncompressed.append(availOut - context_->inflater.avail_out);
       if (uncompressed.length() > maxUncompressed_) {
         LOG(ERROR) << "Decompressed headers too large";
         return HeaderDecodeError::HEADERS_TOO_LARGE;
       }
-    } while (inflater_.avail_in > 0 && inflater_.avail_out == 0);
+    } while (context_->inflater.avail_in > 0 && context_->inflater.avail_out == 0);
     length -= chunkLen;
     consumed += chunkLen;
     cursor.skip(chunkLen);
@@ -300,29 +474,18 @@ GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
   if (stats_) {
     stats_->recordDecode(Type::GZIP, decodedSize_);
   }
-
-  size_t expandedHeaderLineBytes = 0;
-  auto result = parseNameValues(uncompressed);
-  if (result.isError()) {
-    return result.error();
-  }
-  expandedHeaderLineBytes = result.ok();
-
-  if (UNLIKELY(expandedHeaderLineBytes > kMaxExpandedHeaderLineBytes)) {
-    LOG(ERROR) << "expanded headers too large";
-    return HeaderDecodeError::HEADERS_TOO_LARGE;
-  }
-
-  return HeaderDecodeResult{outHeaders_, consumed};
+  return consumed;
 }
 
+template <typename Emit>
 Result<size_t, HeaderDecodeError>
-GzipHeaderCodec::parseNameValues(const folly::IOBuf& uncompressed) noexcept {
+GzipHeaderCodec::parseNameValues(const folly::IOBuf& uncompressed,
+                                 Emit&& emit) noexcept {
 
   size_t expandedHeaderLineBytes = 0;
   Cursor headerCursor(&uncompressed);
   uint32_t numNV = 0;
-  const HeaderPiece* headerName = nullptr;
+  folly::StringPiece headerName;
 
   try {
     numNV = versionSettings_.parseSizeFun(&headerCursor);
@@ -338,76 +501,153 @@ GzipHeaderCodec::parseNameValues(const folly::IOBuf& uncompressed) noexcept {
       return HeaderDecodeError::BAD_ENCODING;
     }
 
-    if (len == 0 && !headerName) {
+    if (len == 0 && i % 2 == 0) {
       LOG(ERROR) << "empty header name";
       return HeaderDecodeError::EMPTY_HEADER_NAME;
     }
+    if (maxHeaderSize_ > 0 && i % 2 == 1 &&
+        uint64_t(headerName.size()) + len > maxHeaderSize_) {
+      LOG(ERROR) << "header too large";
+      return HeaderDecodeError::HEADERS_TOO_LARGE;
+    }
+    // uncompressed is a single buffer, so a string that is not contiguous
+    // runs past the end of the block
     auto next = headerCursor.peek();
-    try {
-      if (next.second >= len) {
-        // string is contiguous, just put a pointer into the headers structure
-        outHeaders_.emplace_back((char *)next.first, len, false, false);
-        headerCursor.skip(len);
-      } else {
-        // string is not contiguous, allocate a buffer and pull into it
-        unique_ptr<char[]> data (new char[len]);
-        headerCursor.pull(data.get(), len);
-        outHeaders_.emplace_back(data.release(), len, true, false);
-      }
-    } catch (const std::out_of_range& ex) {
+    if (next.second < len) {
       return HeaderDecodeError::BAD_ENCODING;
     }
+    folly::StringPiece str((const char*)next.first, len);
+    headerCursor.skip(len);
+
     if (i % 2 == 0) {
-      headerName = &outHeaders_.back();
-      for (const char c: headerName->str) {
+      headerName = str;
+      for (const char c: headerName) {
         if (c < 0x20 || c > 0x7e || ('A' <= c && c <= 'Z')) {
           LOG(ERROR) << "invalid header value";
           return HeaderDecodeError::INVALID_HEADER_VALUE;
         }
       }
-    } else {
-      HeaderPiece& headerValue = outHeaders_.back();
-      bool first = true;
-      const char* valueStart = headerValue.str.data();
-      const char* pos = valueStart;
-      const char* stop = valueStart + headerValue.str.size();
-      while(pos < stop) {
-        if (*pos == '\0') {
-          if (pos - valueStart == 0) {
-            LOG(ERROR) << "empty header value";
-            return HeaderDecodeError::EMPTY_HEADER_VALUE;
-          }
-          if (first) {
-            headerValue.str.reset(valueStart, pos - valueStart);
-            first = false;
-          } else {
-            outHeaders_.emplace_back(headerName->str.data(),
-                                     headerName->str.size(),
-                                     false, true);
-            outHeaders_.emplace_back(valueStart, pos - valueStart, false, true);
-            expandedHeaderLineBytes += ((pos - valueStart) +
-                                        headerName->str.size());
-          }
-          valueStart = pos + 1;
-        }
-        pos++;
-      }
-      if (!first) {
-        // value contained at least one \0, add the last value
+      continue;
+    }
+
+    // the value may hold several NUL separated values for the same name
+    bool first = true;
+    const char* valueStart = str.begin();
+    const char* pos = valueStart;
+    const char* stop = str.end();
+    while (pos < stop) {
+      if (*pos == '\0') {
         if (pos - valueStart == 0) {
           LOG(ERROR) << "empty header value";
           return HeaderDecodeError::EMPTY_HEADER_VALUE;
         }
-        outHeaders_.emplace_back(headerName->str.data(),
-                                 headerName->str.size(),
-                                 false, true);
-        outHeaders_.emplace_back(valueStart, pos - valueStart, false, true);
-        expandedHeaderLineBytes += (pos - valueStart) + headerName->str.size();
+        emit(headerName, folly::StringPiece(valueStart, pos), !first);
+        if (!first) {
+          expandedHeaderLineBytes += (pos - valueStart) + headerName.size();
+        }
+        first = false;
+        valueStart = pos + 1;
       }
-      headerName = nullptr;
+      pos++;
+    }
+    if (first) {
+      emit(headerName, str, false);
+    } else {
+      // value contained at least one \0, add the last value
+      if (pos - valueStart == 0) {
+        LOG(ERROR) << "empty header value";
+        return HeaderDecodeError::EMPTY_HEADER_VALUE;
+      }
+      emit(headerName, folly::StringPiece(valueStart, pos), true);
+      expandedHeaderLineBytes += (pos - valueStart) + headerName.size();
     }
   }
+
+  if (UNLIKELY(expandedHeaderLineBytes > kMaxExpandedHeaderLineBytes)) {
+    LOG(ERROR) << "expanded headers too large";
+    return HeaderDecodeError::HEADERS_TOO_LARGE;
+  }
   return expandedHeaderLineBytes;
 }
 
+
+Result<HeaderDecodeResult, HeaderDecodeError>
+GzipHeaderCodec::decode(Cursor& cursor, uint32_t length) noexcept {
+  outHeaders_.clear();
+
+  // empty header block
+  if (length == 0) {
+    return HeaderDecodeResult{outHeaders_, 0};
+  }
+
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
+  auto inflated = inflateHeaders(cursor, length);
+  if (inflated.isError()) {
+    recordDecodeResult(true, start);
+    return inflated.error();
+  }
+
+  // the names and values point into the thread local buffer, which stays
+  // untouched until the next decode
+  auto result = parseNameValues(
+    getHeaderBuf(),
+    [this] (folly::StringPiece name, folly::StringPiece value,
+            bool multiValued) {
+      outHeaders_.emplace_back(name.data(), name.size(), false, multiValued);
+      outHeaders_.emplace_back(value.data(), value.size(), false, multiValued);
+    });
+  recordDecodeResult(result.isError(), start);
+  if (result.isError()) {
+    return result.error();
+  }
+  return HeaderDecodeResult{outHeaders_, inflated.ok()};
+}
+
+Result<uint32_t, HeaderDecodeError>
+GzipHeaderCodec::decodeStreaming(Cursor& cursor, uint32_t length,
+                                 StreamingCallback& callback) noexcept {
+  if (length == 0) {
+    return 0u;
+  }
+
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
+  auto inflated = inflateHeaders(cursor, length);
+  if (inflated.isError()) {
+    recordDecodeResult(true, start);
+    return inflated.error();
+  }
+
+  auto result = parseNameValues(
+    getHeaderBuf(),
+    [&callback] (folly::StringPiece name, folly::StringPiece value,
+                 bool multiValued) {
+      callback.onHeader(name, value, multiValued);
+    });
+  recordDecodeResult(result.isError(), start);
+  if (result.isError()) {
+    return result.error();
+  }
+  return inflated.ok();
+}
+
+void GzipHeaderCodec::recordDecodeResult(bool error,
+                                         TimePoint start) noexcept {
+  if (!stats_) {
+    return;
+  }
+  if (error) {
+    stats_->recordDecodeError(Type::GZIP);
+  } else {
+    stats_->recordDecodeTime(
+      Type::GZIP,
+      std::chrono::duration_cast<nanoseconds>(getCurrentTime() - start));
+  }
+}
+
 }
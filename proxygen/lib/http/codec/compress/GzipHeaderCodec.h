@@ -16,6 +16,8 @@
 #include <memory>
 #include <proxygen/lib/http/codec/SPDYVersionSettings.h>
 #include <proxygen/lib/http/codec/compress/HeaderCodec.h>
+#include <proxygen/lib/utils/Time.h>
+#include <vector>
 #include <zlib.h>
 
 namespace proxygen {
@@ -32,22 +34,96 @@ class GzipHeaderCodec : public HeaderCodec {
   std::unique_ptr<folly::IOBuf> encode(
     std::vector<compress::Header>& headers) noexcept override;
 
+  std::unique_ptr<folly::IOBuf> serializeShared(
+    std::vector<compress::Header>& headers,
+    uint32_t& numEntries) noexcept override;
+
+  std::unique_ptr<folly::IOBuf> encodeWithShared(
+    std::vector<compress::Header>& headers,
+    const folly::IOBuf& shared, uint32_t sharedEntries) noexcept override;
+
   Result<HeaderDecodeResult, HeaderDecodeError>
   decode(folly::io::Cursor& cursor, uint32_t length) noexcept override;
 
+  Result<uint32_t, HeaderDecodeError>
+  decodeStreaming(folly::io::Cursor& cursor, uint32_t length,
+                  StreamingCallback& callback) noexcept override;
+
+  /**
+   * The zlib state of the context, as deflateInit2() and inflateInit()
+   * size it; the thread local header buffer is shared and not counted
+   */
+  size_t getMemoryUsage() const override;
+
+  /**
+   * Build the primed zlib context of the process for version and
+   * compressionLevel, with its dictionary, and one ready copy of it for
+   * the calling thread, so that the first codec of the thread doesn't pay
+   * for them
+   */
+  static void prewarm(SPDYVersion version, int compressionLevel);
+
+  /**
+   * Cap the level of the codecs of the calling thread, from their next
+   * header block on, e.g. to 1 while the thread is short of CPU; 9 lifts
+   * the cap. Codecs made without compression stay so.
+   */
+  static void setThreadMaxLevel(int level);
+
+  /**
+   * The level the next header block is deflated with
+   */
+  int getDeflateLevel() const;
+
+  // Header blocks deflated at level 1 before the codec moves to its own
+  // level, so that the many short lived sessions are cheap
+  static const uint32_t kWarmupBlocks = 8;
+
  private:
 
   folly::IOBuf& getHeaderBuf();
 
   /**
-   * Parse the decompressed name/value header block.
+   * Upper bound of the size of the name/value entries for the headers
    */
-  Result<size_t, HeaderDecodeError>
-  parseNameValues(const folly::IOBuf&) noexcept;
+  size_t maxSerializedSize(const std::vector<compress::Header>& headers) const;
 
-  const SPDYVersionSettings& versionSettings_;
-  z_stream deflater_;
-  z_stream inflater_;
+  /**
+   * Sort the headers and write their name/value entries at dst, combining
+   * the values of the same name. Sets numHeaders to the number of entries.
+   *
+   * @return the end of the entries
+   */
+  uint8_t* serializeNameValues(std::vector<compress::Header>& headers,
+                               uint8_t* dst, uint32_t& numHeaders);
+
+  /**
+   * Compress the first uncompressedLen bytes of the thread local header
+   * buffer. start is when the encode began, for the stats.
+   */
+  std::unique_ptr<folly::IOBuf> deflateHeaders(size_t uncompressedLen,
+                                               TimePoint start) noexcept;
+
+  /**
+   * Report the outcome of a decode that started at start to the stats
+   */
+  void recordDecodeResult(bool error, TimePoint start) noexcept;
+
+  /**
+   * Inflate length bytes from the cursor into the thread local header
+   * buffer. Returns the number of bytes consumed.
+   */
+  Result<uint32_t, HeaderDecodeError>
+  inflateHeaders(folly::io::Cursor& cursor, uint32_t length) noexcept;
+
+  /**
+   * Parse the decompressed name/value header block, calling
+   * emit(name, value, multiValued) for every value. Returns the size of the
+   * header lines added by splitting multi-valued headers.
+   */
+  template <typename Emit>
+  Result<size_t, HeaderDecodeError>
+  parseNameValues(const folly::IOBuf& uncompressed, Emit&& emit) noexcept;
 
   // Pre-initialized compression contexts seeded with the
   // starting dictionary for different SPDY versions - cloning
@@ -83,12 +159,59 @@ class GzipHeaderCodec : public HeaderCodec {
   };
 
   /**
-   * get the thread local cached zlib context
+   * Per thread, per config pool of contexts. Contexts of codecs destroyed on
+   * this thread are kept in `free` and brought back to the state of
+   * `primed`, shared by the process, when they are handed out again, which
+   * avoids allocating new inflate state for every new codec.
+   */
+  struct ZlibContextPool {
+    // only read, zlib just doesn't take a const source
+    ZlibContext* primed{nullptr};
+    std::vector<std::unique_ptr<ZlibContext>> free;
+  };
+
+  // Maximum number of idle contexts kept per thread and config
+  static const size_t kMaxPooledContexts = 64;
+
+  /**
+   * get the context of the process for the given config, with the
+   * dictionary already hashed into the deflater, creating it on first use
    */
-  static const ZlibContext* getZlibContext(SPDYVersionSettings versionSettings,
-                                           int compressionLevel);
+  static ZlibContext& getPrimedZlibContext(
+    const SPDYVersionSettings& versionSettings, int compressionLevel);
 
-  typedef std::map<ZlibConfig, std::unique_ptr<ZlibContext>> ZlibContextMap;
+  /**
+   * get the thread local pool for the given config
+   */
+  static ZlibContextPool& getZlibContextPool(
+    const SPDYVersionSettings& versionSettings, int compressionLevel);
+
+  /**
+   * get a context in the initial state for the given config, either from the
+   * thread local pool or cloned from the primed one
+   */
+  static std::unique_ptr<ZlibContext> acquireZlibContext(
+    const SPDYVersionSettings& versionSettings, int compressionLevel);
+
+  /**
+   * hand a context back to the thread local pool, or free it if the pool is
+   * full
+   */
+  static void releaseZlibContext(const SPDYVersionSettings& versionSettings,
+                                 int compressionLevel,
+                                 std::unique_ptr<ZlibContext> context);
+
+  typedef std::map<ZlibConfig, ZlibContextPool> ZlibContextMap;
+
+  static __thread int threadMaxLevel_;
+
+  const SPDYVersionSettings& versionSettings_;
+  int compressionLevel_;
+  std::unique_ptr<ZlibContext> context_;
+  // the level the deflater was last set to, which starts at the one of
+  // the primed context
+  int deflaterLevel_;
+  uint32_t deflatedBlocks_{0};
 };
 
 }
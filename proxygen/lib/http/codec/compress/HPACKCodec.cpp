@@ -13,20 +13,46 @@
 #include <folly/String.h>
 #include <folly/io/Cursor.h>
 #include <proxygen/lib/http/codec/compress/HPACKHeader.h>
+#include <proxygen/lib/utils/Time.h>
 
 using folly::IOBuf;
 using folly::io::Cursor;
 using proxygen::compress::Header;
 using proxygen::compress::HeaderPiece;
 using proxygen::compress::HeaderPieceList;
+using std::chrono::nanoseconds;
 using std::unique_ptr;
 using std::vector;
 
 namespace proxygen {
 
+namespace {
+
+/**
+ * Forwards the decoded headers and adds up their uncompressed size
+ */
+class SizeCountingCallback : public HeaderCodec::StreamingCallback {
+ public:
+  explicit SizeCountingCallback(HeaderCodec::StreamingCallback& callback)
+      : callback_(callback) {}
+
+  void onHeader(folly::StringPiece name, folly::StringPiece value,
+                bool multiValued) noexcept override {
+    uncompressed += name.size() + value.size() + 2;
+    callback_.onHeader(name, value, multiValued);
+  }
+
+  uint32_t uncompressed{0};
+
+ private:
+  HeaderCodec::StreamingCallback& callback_;
+};
+
+}
+
 const std::string kHpackNpn = "spdy/3.1-fb-0.5";
 
-HPACKCodec::HPACKCodec(TransportDirection direction) {
+HPACKCodec::HPACKCodec(TransportDirection direction, uint32_t tableSize) {
   HPACK::MessageType encoderType;
   HPACK::MessageType decoderType;
   if (direction == TransportDirection::DOWNSTREAM) {
@@ -37,16 +63,20 @@ HPACKCodec::HPACKCodec(TransportDirection direction) {
     decoderType = HPACK::MessageType::RESP;
     encoderType = HPACK::MessageType::REQ;
   }
-  encoder_ = folly::make_unique<HPACKEncoder>(encoderType, true);
-  decoder_ = folly::make_unique<HPACKDecoder>(decoderType);
+  encoder_ = folly::make_unique<HPACKEncoder>(encoderType, true, tableSize);
+  decoder_ = folly::make_unique<HPACKDecoder>(decoderType, tableSize);
 }
 
 unique_ptr<IOBuf> HPACKCodec::encode(vector<Header>& headers) noexcept {
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
   vector<HPACKHeader> converted;
   // convert to HPACK API format
   uint32_t uncompressed = 0;
   for (const auto& h : headers) {
-    HPACKHeader header(*h.name, *h.value);
+    HPACKHeader header(h.code, *h.name, *h.value);
     // This is ugly but since we're not changing the size
     // of the string I'm assuming this is OK
     char* mutableName = const_cast<char*>(header.name.data());
@@ -54,6 +84,7 @@ unique_ptr<IOBuf> HPACKCodec::encode(vector<Header>& headers) noexcept {
     converted.push_back(header);
     uncompressed += header.name.size() + header.value.size() + 2;
   }
+  uint64_t evictions = encoder_->getTable().evictions();
   auto buf = encoder_->encode(converted, encodeHeadroom_);
   encodedSize_.compressed = 0;
   if (buf) {
@@ -62,20 +93,39 @@ unique_ptr<IOBuf> HPACKCodec::encode(vector<Header>& headers) noexcept {
   encodedSize_.uncompressed = uncompressed;
   if (stats_) {
     stats_->recordEncode(Type::HPACK, encodedSize_);
+    stats_->recordTableUsage(
+      Type::HPACK, converted.size(), encoder_->getLastHits(),
+      encoder_->getTable().evictions() - evictions);
+    stats_->recordEncodeTime(
+      Type::HPACK,
+      std::chrono::duration_cast<nanoseconds>(getCurrentTime() - start));
   }
   return std::move(buf);
 }
 
+HeaderDecodeError HPACKCodec::getDecodeError() const {
+  if (decoder_->getError() == HPACKDecoder::Error::HEADERS_TOO_LARGE) {
+    return HeaderDecodeError::HEADERS_TOO_LARGE;
+  }
+  return HeaderDecodeError::BAD_ENCODING;
+}
+
 Result<HeaderDecodeResult, HeaderDecodeError>
 HPACKCodec::decode(Cursor& cursor, uint32_t length) noexcept {
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
   outHeaders_.clear();
   decodedHeaders_.clear();
+  decoder_->setMaxUncompressed(maxUncompressed_);
+  decoder_->setMaxHeaderSize(maxHeaderSize_);
   auto consumed = decoder_->decode(cursor, length, decodedHeaders_);
   if (decoder_->hasError()) {
     if (stats_) {
       stats_->recordDecodeError(Type::HPACK);
     }
-    return HeaderDecodeError::BAD_ENCODING;
+    return getDecodeError();
   }
   // convert to HeaderPieceList
   uint32_t uncompressed = 0;
@@ -99,8 +149,39 @@ HPACKCodec::decode(Cursor& cursor, uint32_t length) noexcept {
   decodedSize_.uncompressed = uncompressed;
   if (stats_) {
     stats_->recordDecode(Type::HPACK, decodedSize_);
+    stats_->recordDecodeTime(
+      Type::HPACK,
+      std::chrono::duration_cast<nanoseconds>(getCurrentTime() - start));
   }
   return HeaderDecodeResult{outHeaders_, consumed};
 }
 
+Result<uint32_t, HeaderDecodeError>
+HPACKCodec::decodeStreaming(Cursor& cursor, uint32_t length,
+                            StreamingCallback& callback) noexcept {
+  TimePoint start;
+  if (stats_) {
+    start = getCurrentTime();
+  }
+  SizeCountingCallback counter(callback);
+  decoder_->setMaxUncompressed(maxUncompressed_);
+  decoder_->setMaxHeaderSize(maxHeaderSize_);
+  auto consumed = decoder_->decodeStreaming(cursor, length, counter);
+  if (decoder_->hasError()) {
+    if (stats_) {
+      stats_->recordDecodeError(Type::HPACK);
+    }
+    return getDecodeError();
+  }
+  decodedSize_.compressed = consumed;
+  decodedSize_.uncompressed = counter.uncompressed;
+  if (stats_) {
+    stats_->recordDecode(Type::HPACK, decodedSize_);
+    stats_->recordDecodeTime(
+      Type::HPACK,
+      std::chrono::duration_cast<nanoseconds>(getCurrentTime() - start));
+  }
+  return consumed;
+}
+
 }
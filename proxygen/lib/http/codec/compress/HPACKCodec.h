@@ -39,7 +39,12 @@ extern const std::string kHpackNpn; // NPN string for SPDY w/ HPACK
 
 class HPACKCodec : public HeaderCodec {
  public:
-  explicit HPACKCodec(TransportDirection direction);
+  /**
+   * @param tableSize the capacity both header tables start with, 0 for
+   *                  blocks that can be decoded in any order
+   */
+  explicit HPACKCodec(TransportDirection direction,
+                      uint32_t tableSize = HPACK::kTableSize);
   virtual ~HPACKCodec() {}
 
   std::unique_ptr<folly::IOBuf> encode(
@@ -48,19 +53,54 @@ class HPACKCodec : public HeaderCodec {
   Result<HeaderDecodeResult, HeaderDecodeError>
   decode(folly::io::Cursor& cursor, uint32_t length) noexcept override;
 
+  Result<uint32_t, HeaderDecodeError>
+  decodeStreaming(folly::io::Cursor& cursor, uint32_t length,
+                  StreamingCallback& callback) noexcept override;
+
   void setEncoderHeaderTableSize(uint32_t size) {
     encoder_->setHeaderTableSize(size);
   }
 
+  void setEncoderIndexingPolicy(std::unique_ptr<HPACKIndexingPolicy> policy) {
+    encoder_->setIndexingPolicy(std::move(policy));
+  }
+
   void setDecoderHeaderTableMaxSize(uint32_t size) {
     decoder_->setHeaderTableMaxSize(size);
   }
 
+  uint32_t getDecoderHeaderTableMaxSize() const {
+    return decoder_->getHeaderTableMaxSize();
+  }
+
+  uint32_t getEncoderHeaderTableSize() const {
+    return encoder_->getTable().capacity();
+  }
+
+  /**
+   * Bytes the entries of the encoder's and the decoder's dynamic tables
+   * take, as the spec counts them
+   */
+  uint32_t getEncoderTableBytes() const {
+    return encoder_->getTable().bytes();
+  }
+
+  uint32_t getDecoderTableBytes() const {
+    return decoder_->getTable().bytes();
+  }
+
+  size_t getMemoryUsage() const override {
+    return getEncoderTableBytes() + getDecoderTableBytes() +
+      decodedHeaders_.capacity() * sizeof(HPACKHeader);
+  }
+
  protected:
   std::unique_ptr<HPACKEncoder> encoder_;
   std::unique_ptr<HPACKDecoder> decoder_;
 
  private:
+  HeaderDecodeError getDecodeError() const;
+
   std::vector<HPACKHeader> decodedHeaders_;
 };
 
@@ -36,6 +36,13 @@ enum HeaderEncoding : uint8_t {
   INDEXED = 0x80                // 1-bit
 };
 
+// the byte after an INDEXED representation of index 0 tells if it empties
+// the reference set, or changes the table size to the 7-bit prefix integer
+enum ContextUpdate : uint8_t {
+  TABLE_SIZE = 0x00,            // 1-bit
+  REFSET_EMPTYING = 0x80
+};
+
 enum LiteralEncoding : uint8_t {
   PLAIN = 0x00,
   HUFFMAN = 0x80
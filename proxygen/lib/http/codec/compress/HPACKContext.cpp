@@ -24,7 +24,7 @@ uint32_t HPACKContext::getIndex(const HPACKHeader& header) const {
   if (index) {
     return dynamicToGlobalIndex(index);
   }
-  index = getStaticTable().getIndex(header);
+  index = getStaticIndex(header);
   if (index) {
     return staticToGlobalIndex(index);
   }
@@ -36,7 +36,19 @@ uint32_t HPACKContext::nameIndex(const string& name) const {
   if (index) {
     return dynamicToGlobalIndex(index);
   }
-  index = getStaticTable().nameIndex(name);
+  index = getStaticNameIndex(HTTP_HEADER_OTHER, name);
+  if (index) {
+    return staticToGlobalIndex(index);
+  }
+  return 0;
+}
+
+uint32_t HPACKContext::nameIndex(const HPACKHeader& header) const {
+  uint32_t index = table_.nameIndex(header.name);
+  if (index) {
+    return dynamicToGlobalIndex(index);
+  }
+  index = getStaticNameIndex(header.code, header.name);
   if (index) {
     return staticToGlobalIndex(index);
   }
@@ -36,6 +36,12 @@ class HPACKContext {
    */
   uint32_t nameIndex(const std::string& name) const;
 
+  /**
+   * same as above, using the code of the header to skip hashing its name
+   * when looking into the static table
+   */
+  uint32_t nameIndex(const HPACKHeader& header) const;
+
   /**
    * @return true if the given index points to a static header entry
    */
@@ -55,6 +61,20 @@ class HPACKContext {
     return StaticHeaderTable::get();
   }
 
+  /**
+   * lookups into the static table, they must be overridden together with
+   * getStaticTable()
+   */
+  virtual uint32_t getStaticIndex(const HPACKHeader& header) const {
+    return StaticHeaderTable::lookupHeader(header.code, header.name,
+                                           header.value);
+  }
+
+  virtual uint32_t getStaticNameIndex(HTTPHeaderCode code,
+                                      const std::string& name) const {
+    return StaticHeaderTable::lookupName(code, name);
+  }
+
   const HPACKHeader& getStaticHeader(uint32_t index);
 
   const HPACKHeader& getDynamicHeader(uint32_t index);
@@ -40,8 +40,10 @@ uint8_t HPACKDecodeBuffer::peek() {
   return *cursor_.data();
 }
 
-bool HPACKDecodeBuffer::decodeLiteral(std::string& literal) {
+bool HPACKDecodeBuffer::decodeLiteral(std::string& literal,
+                                      uint32_t maxSize) {
   literal.clear();
+  literalTooLarge_ = false;
   if (remainingBytes_ == 0) {
     return false;
   }
@@ -55,6 +57,12 @@ bool HPACKDecodeBuffer::decodeLiteral(std::string& literal) {
   if (size > remainingBytes_ || size > HPACK::kMaxLiteralSize) {
     return false;
   }
+  // a plain literal is refused before it is copied, a Huffman coded one,
+  // which expands at most 8/5 times, once decoded
+  if (!huffman && size > maxSize) {
+    literalTooLarge_ = true;
+    return false;
+  }
   const uint8_t* data;
   unique_ptr<IOBuf> tmpbuf;
   // handle the case where the buffer spans multiple buffers
@@ -69,7 +77,13 @@ bool HPACKDecodeBuffer::decodeLiteral(std::string& literal) {
     data = tmpbuf->data();
   }
   if (huffman) {
-    huffmanTree_.decode(data, size, literal);
+    if (!huffmanTree_.decode(data, size, literal)) {
+      return false;
+    }
+    if (literal.size() > maxSize) {
+      literalTooLarge_ = true;
+      return false;
+    }
   } else {
     literal.append((const char *)data, size);
   }
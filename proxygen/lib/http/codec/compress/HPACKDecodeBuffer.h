@@ -70,15 +70,25 @@ class HPACKDecodeBuffer {
   bool decodeInteger(uint8_t nbit, uint32_t& integer);
 
   /**
-   * decode a literal starting from the current position
+   * decode a literal starting from the current position, failing if it
+   * is longer than maxSize, see isLiteralTooLarge()
    */
-  bool decodeLiteral(std::string& literal);
+  bool decodeLiteral(std::string& literal,
+                     uint32_t maxSize = HPACK::kMaxLiteralSize);
+
+  /**
+   * @return true if the last decodeLiteral() failed on the size limit
+   */
+  bool isLiteralTooLarge() const {
+    return literalTooLarge_;
+  }
 
 private:
   const huffman::HuffTree& huffmanTree_;
   folly::io::Cursor& cursor_;
   uint32_t totalBytes_;
   uint32_t remainingBytes_;
+  bool literalTooLarge_{false};
 };
 
 }
@@ -15,7 +15,6 @@
 
 using folly::IOBuf;
 using folly::io::Cursor;
-using std::list;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -37,6 +36,7 @@ uint32_t HPACKDecoder::decode(Cursor& cursor,
   auto& huffmanTree = msgType_ == HPACK::MessageType::REQ ?
     huffman::reqHuffTree05() : huffman::respHuffTree05();
   HPACKDecodeBuffer dbuf(huffmanTree, cursor, totalBytes);
+  uncompressed_ = 0;
   while (!hasError() && !dbuf.empty()) {
     decodeHeader(dbuf, headers);
   }
@@ -44,20 +44,28 @@ uint32_t HPACKDecoder::decode(Cursor& cursor,
   return dbuf.consumedBytes();
 }
 
+uint32_t HPACKDecoder::decodeStreaming(
+    Cursor& cursor,
+    uint32_t totalBytes,
+    HeaderCodec::StreamingCallback& callback) {
+  streamed_.clear();
+  streamingCallback_ = &callback;
+  uint32_t consumed = decode(cursor, totalBytes, streamed_);
+  streamingCallback_ = nullptr;
+  return consumed;
+}
+
 void HPACKDecoder::emitRefset(headers_t& emitted) {
   // emit the reference set
   std::sort(emitted.begin(), emitted.end());
-  list<uint32_t> refset = table_.referenceSet();
+  vector<uint32_t> refset = table_.referenceSet();
   // remove the refset entries that have already been emitted
-  list<uint32_t>::iterator refit = refset.begin();
-  while (refit != refset.end()) {
-    const HPACKHeader& header = getDynamicHeader(dynamicToGlobalIndex(*refit));
-    if (std::binary_search(emitted.begin(), emitted.end(), header)) {
-      refit = refset.erase(refit);
-    } else {
-      refit++;
-    }
-  }
+  refset.erase(
+    std::remove_if(refset.begin(), refset.end(), [&] (uint32_t index) {
+      const HPACKHeader& header = getDynamicHeader(dynamicToGlobalIndex(index));
+      return std::binary_search(emitted.begin(), emitted.end(), header);
+    }),
+    refset.end());
   // try to avoid multiple resizing of the headers vector
   emitted.reserve(emitted.size() + refset.size());
   for (const auto& index : refset) {
@@ -89,16 +97,27 @@ void HPACKDecoder::decodeLiteralHeader(HPACKDecodeBuffer& dbuf,
   } else {
     // skip current byte
     dbuf.next();
-    if (!dbuf.decodeLiteral(header.name)) {
-      LOG(ERROR) << "buffer overflow decoding header name";
-      err_ = Error::BUFFER_OVERFLOW;
+    if (!dbuf.decodeLiteral(header.name, getLiteralLimit(0))) {
+      if (dbuf.isLiteralTooLarge()) {
+        LOG(ERROR) << "header name too large";
+        err_ = Error::HEADERS_TOO_LARGE;
+      } else {
+        LOG(ERROR) << "buffer overflow decoding header name";
+        err_ = Error::BUFFER_OVERFLOW;
+      }
       return;
     }
   }
   // value
-  if (!dbuf.decodeLiteral(header.value)) {
-    LOG(ERROR) << "buffer overflow decoding header value";
-    err_ = Error::BUFFER_OVERFLOW;
+  if (!dbuf.decodeLiteral(header.value,
+                          getLiteralLimit(header.name.size()))) {
+    if (dbuf.isLiteralTooLarge()) {
+      LOG(ERROR) << "header value too large";
+      err_ = Error::HEADERS_TOO_LARGE;
+    } else {
+      LOG(ERROR) << "buffer overflow decoding header value";
+      err_ = Error::BUFFER_OVERFLOW;
+    }
     return;
   }
 
@@ -119,7 +138,7 @@ void HPACKDecoder::decodeIndexedHeader(HPACKDecodeBuffer& dbuf,
     return;
   }
   if (index == 0) {
-    table_.clearReferenceSet();
+    decodeContextUpdate(dbuf);
     return;
   }
   // validate the index
@@ -145,6 +164,46 @@ void HPACKDecoder::decodeIndexedHeader(HPACKDecodeBuffer& dbuf,
   }
 }
 
+void HPACKDecoder::decodeContextUpdate(HPACKDecodeBuffer& dbuf) {
+  if (dbuf.empty()) {
+    LOG(ERROR) << "buffer overflow decoding context update";
+    err_ = Error::BUFFER_OVERFLOW;
+    return;
+  }
+  if (dbuf.peek() & HPACK::ContextUpdate::REFSET_EMPTYING) {
+    dbuf.next();
+    table_.clearReferenceSet();
+    return;
+  }
+  uint32_t size;
+  if (!dbuf.decodeInteger(7, size)) {
+    LOG(ERROR) << "buffer overflow decoding table size";
+    err_ = Error::BUFFER_OVERFLOW;
+    return;
+  }
+  if (size > maxTableSize_) {
+    LOG(ERROR) << "table size " << size << " larger than the maximum "
+               << maxTableSize_;
+    err_ = Error::INVALID_TABLE_SIZE;
+    return;
+  }
+  table_.setCapacity(size);
+}
+
+uint32_t HPACKDecoder::getLiteralLimit(uint32_t used) const {
+  uint64_t limit = HPACK::kMaxLiteralSize;
+  if (maxHeaderSize_ > 0) {
+    limit = std::min<uint64_t>(
+      limit, used < maxHeaderSize_ ? maxHeaderSize_ - used : 0);
+  }
+  if (maxUncompressed_ > 0) {
+    uint64_t total = uncompressed_ + used;
+    limit = std::min<uint64_t>(
+      limit, total < maxUncompressed_ ? maxUncompressed_ - total : 0);
+  }
+  return limit;
+}
+
 bool HPACKDecoder::isValid(uint32_t index) {
   if (!isStatic(index)) {
     return table_.isValid(globalToDynamicIndex(index));
@@ -164,7 +223,23 @@ void HPACKDecoder::decodeHeader(HPACKDecodeBuffer& dbuf, headers_t& emitted) {
 
 void HPACKDecoder::emit(const HPACKHeader& header,
                         headers_t& emitted) {
+  if (hasError()) {
+    return;
+  }
+  // indexed headers and the reference set are not checked while decoding
+  uint64_t size = header.name.size() + header.value.size();
+  uncompressed_ += size + 2;
+  if ((maxHeaderSize_ > 0 && size > maxHeaderSize_) ||
+      (maxUncompressed_ > 0 && uncompressed_ > maxUncompressed_)) {
+    LOG(ERROR) << "headers larger than the limit, " << uncompressed_
+               << " bytes so far";
+    err_ = Error::HEADERS_TOO_LARGE;
+    return;
+  }
   emitted.push_back(header);
+  if (streamingCallback_) {
+    streamingCallback_->onHeader(header.name, header.value, true);
+  }
 }
 
 }
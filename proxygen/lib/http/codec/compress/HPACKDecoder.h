@@ -16,6 +16,7 @@
 #include <proxygen/lib/http/codec/compress/HPACKContext.h>
 #include <proxygen/lib/http/codec/compress/HPACKDecodeBuffer.h>
 #include <proxygen/lib/http/codec/compress/HPACKHeader.h>
+#include <proxygen/lib/http/codec/compress/HeaderCodec.h>
 #include <vector>
 
 namespace proxygen {
@@ -29,6 +30,7 @@ class HPACKDecoder : public HPACKContext {
     INVALID_ENCODING = 3,
     BUFFER_OVERFLOW = 4,
     INVALID_TABLE_SIZE = 5,
+    HEADERS_TOO_LARGE = 6,
   };
 
   explicit HPACKDecoder(HPACK::MessageType msgType,
@@ -52,6 +54,15 @@ class HPACKDecoder : public HPACKContext {
    */
   std::unique_ptr<headers_t> decode(const folly::IOBuf* buffer);
 
+  /**
+   * same as the cursor based decode(), but each header is passed to the
+   * callback as soon as it is emitted, including the ones coming from the
+   * reference set at the end of the block.
+   */
+  uint32_t decodeStreaming(folly::io::Cursor& cursor,
+                           uint32_t totalBytes,
+                           HeaderCodec::StreamingCallback& callback);
+
   Error getError() const {
     return err_;
   }
@@ -60,10 +71,32 @@ class HPACKDecoder : public HPACKContext {
     return err_ != Error::NONE;
   }
 
+  /**
+   * The largest table size the encoder may switch to, ie. the size we
+   * advertised to the peer
+   */
   void setHeaderTableMaxSize(uint32_t maxSize) {
     maxTableSize_ = maxSize;
   }
 
+  uint32_t getHeaderTableMaxSize() const {
+    return maxTableSize_;
+  }
+
+  /**
+   * Fail the decode with HEADERS_TOO_LARGE as soon as the headers of a
+   * block add up to more than maxUncompressed bytes, or a single header to
+   * more than maxHeaderSize, without copying the offending literal. 0
+   * disables the limit.
+   */
+  void setMaxUncompressed(uint32_t maxUncompressed) {
+    maxUncompressed_ = maxUncompressed;
+  }
+
+  void setMaxHeaderSize(uint32_t maxHeaderSize) {
+    maxHeaderSize_ = maxHeaderSize;
+  }
+
  protected:
   bool isValid(uint32_t index);
 
@@ -77,8 +110,29 @@ class HPACKDecoder : public HPACKContext {
 
   void decodeHeader(HPACKDecodeBuffer& dbuf, headers_t& emitted);
 
+  /**
+   * Reference set emptying or table size change, after an index 0
+   */
+  void decodeContextUpdate(HPACKDecodeBuffer& dbuf);
+
+  /**
+   * The longest literal that still fits the limits, after used bytes of
+   * the current header
+   */
+  uint32_t getLiteralLimit(uint32_t used) const;
+
   Error err_{Error::NONE};
   uint32_t maxTableSize_;
+  uint32_t maxUncompressed_{0};
+  uint32_t maxHeaderSize_{0};
+  // uncompressed size of the block decoded so far
+  uint64_t uncompressed_{0};
+
+ private:
+  // set for the duration of decodeStreaming()
+  HeaderCodec::StreamingCallback* streamingCallback_{nullptr};
+  // headers emitted while streaming, kept to dedupe the reference set
+  headers_t streamed_;
 };
 
 }
@@ -13,6 +13,7 @@
 #include <memory>
 #include <proxygen/lib/http/codec/compress/HPACKConstants.h>
 #include <proxygen/lib/http/codec/compress/Logging.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
 
 using folly::IOBuf;
 using proxygen::huffman::HuffTree;
@@ -21,6 +22,27 @@ using std::unique_ptr;
 
 namespace proxygen {
 
+namespace {
+
+/**
+ * number of bytes encodeInteger() uses for the value with an nbit prefix
+ */
+uint32_t getIntegerSize(uint32_t value, uint8_t nbit) {
+  uint32_t mask = ~HPACK::NBIT_MASKS[nbit] & 0xFF;
+  if (value < mask) {
+    return 1;
+  }
+  value -= mask;
+  uint32_t count = 2;
+  while (value >= 128) {
+    value = value >> 7;
+    ++count;
+  }
+  return count;
+}
+
+}
+
 HPACKEncodeBuffer::HPACKEncodeBuffer(
   uint32_t growthSize,
   const HuffTree& huffmanTree,
@@ -42,7 +64,8 @@ void HPACKEncodeBuffer::addHeadroom(uint32_t headroom) {
   // we expect that this function is called before any encoding happens
   CHECK(bufQueue_.front() == nullptr);
   // create a custom IOBuf and add it to the queue
-  unique_ptr<IOBuf> buf = IOBuf::create(std::max(headroom, growthSize_));
+  unique_ptr<IOBuf> buf =
+    IOBufSlab::get().create(std::max(headroom, growthSize_));
   buf->advance(headroom);
   bufQueue_.append(std::move(buf));
 }
@@ -88,20 +111,37 @@ uint32_t HPACKEncodeBuffer::encodeInteger(uint32_t value, uint8_t prefix,
 }
 
 uint32_t HPACKEncodeBuffer::encodeHuffman(const std::string& literal) {
-  uint32_t size = huffmanTree_.getEncodeSize(literal);
+  uint32_t plainSize = literal.size();
+  // the huffman output is kept only if it's not longer than the plain one,
+  // so its length never needs more bytes than the plain length
+  uint32_t lengthSize = getIntegerSize(plainSize, 7);
+  // make room for the worst case, contiguously, so that encodeInteger()
+  // below doesn't move the speculatively encoded data
+  buf_.ensure(lengthSize + plainSize);
+  uint8_t* data = buf_.writableData() + lengthSize;
+  uint32_t size = huffmanTree_.encode(literal, data, plainSize);
+  if (size > plainSize) {
+    return encodePlain(literal);
+  }
   // add the length
   uint32_t count = encodeInteger(size, HPACK::LiteralEncoding::HUFFMAN, 7);
-  // ensure we have enough bytes before performing the encoding
-  buf_.ensure(size);
-  count += huffmanTree_.encode(literal, buf_);
-  return count;
+  if (count < lengthSize) {
+    // the length got shorter, close the gap
+    memmove(buf_.writableData(), data, size);
+  }
+  buf_.append(size);
+  return count + size;
 }
 
 uint32_t HPACKEncodeBuffer::encodeLiteral(const std::string& literal) {
   if (huffmanEnabled_) {
     return encodeHuffman(literal);
   }
-  // otherwise use simple layout
+  return encodePlain(literal);
+}
+
+uint32_t HPACKEncodeBuffer::encodePlain(const std::string& literal) {
+  // use simple layout
   uint32_t count =
     encodeInteger(literal.size(), HPACK::LiteralEncoding::PLAIN, 7);
   // copy the entire string
@@ -70,7 +70,11 @@ class HPACKEncodeBuffer {
   uint32_t encodeLiteral(const std::string& literal);
 
   /**
-   * encodes a string using huffman encoding
+   * encodes a string using huffman encoding, unless the plain layout is
+   * shorter. The huffman output is written speculatively in the buffer and
+   * the literal is laid out again as plain if it turns out to be longer.
+   *
+   * @return bytes used for encoding
    */
   uint32_t encodeHuffman(const std::string& literal);
 
@@ -86,6 +90,11 @@ class HPACKEncodeBuffer {
    */
   void append(uint8_t byte);
 
+  /**
+   * encodes a string using the simple layout, without huffman
+   */
+  uint32_t encodePlain(const std::string& literal);
+
   uint32_t growthSize_;
   folly::IOBufQueue bufQueue_;
   folly::io::QueueAppender buf_;
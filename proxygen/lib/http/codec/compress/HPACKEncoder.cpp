@@ -10,11 +10,11 @@
 #include <proxygen/lib/http/codec/compress/HPACKEncoder.h>
 
 #include <algorithm>
+#include <folly/Memory.h>
 #include <unordered_set>
 #include <utility>
 
 using folly::IOBuf;
-using std::list;
 using std::unique_ptr;
 using std::unordered_set;
 using std::vector;
@@ -26,6 +26,7 @@ HPACKEncoder::HPACKEncoder(HPACK::MessageType msgType,
                            uint32_t tableSize) :
     HPACKContext(msgType, tableSize),
     huffman_(huffman),
+    indexingPolicy_(folly::make_unique<DefaultIndexingPolicy>()),
     buffer_(kBufferGrowth,
             (msgType == HPACK::MessageType::REQ) ?
             huffman::reqHuffTree05() : huffman::respHuffTree05(),
@@ -38,6 +39,7 @@ HPACKEncoder::HPACKEncoder(const huffman::HuffTree& huffmanTree,
     // since we already have the huffman tree, msgType doesn't matter
     HPACKContext(HPACK::MessageType::REQ, tableSize),
     huffman_(huffman),
+    indexingPolicy_(folly::make_unique<DefaultIndexingPolicy>()),
     buffer_(kBufferGrowth, huffmanTree, huffman) {
 }
 
@@ -47,19 +49,33 @@ unique_ptr<IOBuf> HPACKEncoder::encode(const vector<HPACKHeader>& headers,
   if (headroom) {
     buffer_.addHeadroom(headroom);
   }
+  if (pendingContextUpdate_) {
+    encodeContextUpdate();
+  }
   encodeDelta(headers);
+  lastHits_ = 0;
   for (const auto& header : headers) {
-    if (willBeAdded(header)) {
+    // encoding the evicted references does not change the table, so the
+    // index can be shared by both steps
+    uint32_t index = getIndex(header);
+    // ask the policy exactly once per literal, it may keep state
+    bool indexing = false;
+    if (index == 0) {
+      indexing = indexingPolicy_->shouldIndex(header);
+    } else if (!isStatic(index)) {
+      indexingPolicy_->onHit(header);
+      ++lastHits_;
+    }
+    if (willBeAdded(index, indexing)) {
       encodeEvictedReferences(header);
     }
-    encodeHeader(header);
+    encodeHeader(header, index, indexing);
   }
   return buffer_.release();
 }
 
-bool HPACKEncoder::willBeAdded(const HPACKHeader& header) {
-  auto index = getIndex(header);
-  return isStatic(index) || (index == 0 && header.isIndexable());
+bool HPACKEncoder::willBeAdded(uint32_t index, bool indexing) {
+  return isStatic(index) || (index == 0 && indexing);
 }
 
 void HPACKEncoder::encodeEvictedReferences(const HPACKHeader& header) {
@@ -83,7 +99,7 @@ void HPACKEncoder::encodeDelta(const vector<HPACKHeader>& headers) {
   // compute the difference between what's in reference set and what's in the
   // reference set
 
-  list<uint32_t> refset = table_.referenceSet();
+  vector<uint32_t> refset = table_.referenceSet();
   // what's in the headers list and in the reference set - O(N)
   vector<uint32_t> toEncode;
   toEncode.reserve(headers.size());
@@ -117,13 +133,13 @@ void HPACKEncoder::encodeDelta(const vector<HPACKHeader>& headers) {
   }
 }
 
-void HPACKEncoder::encodeAsLiteral(const HPACKHeader& header) {
-  bool indexing = header.isIndexable();
+void HPACKEncoder::encodeAsLiteral(const HPACKHeader& header,
+                                   bool indexing) {
   uint8_t prefix = indexing ?
     HPACK::HeaderEncoding::LITERAL_INCR_INDEXING :
     HPACK::HeaderEncoding::LITERAL_NO_INDEXING;
   // name
-  uint32_t index = nameIndex(header.name);
+  uint32_t index = nameIndex(header);
   if (index) {
     buffer_.encodeInteger(index, prefix, 6);
   } else {
@@ -146,11 +162,23 @@ void HPACKEncoder::encodeAsIndex(uint32_t index) {
 
 void HPACKEncoder::clearReferenceSet() {
   encodeAsIndex(0);
+  buffer_.encodeInteger(0, HPACK::ContextUpdate::REFSET_EMPTYING, 7);
   table_.clearReferenceSet();
 }
 
-void HPACKEncoder::encodeHeader(const HPACKHeader& header) {
-  uint32_t index = getIndex(header);
+void HPACKEncoder::encodeContextUpdate() {
+  if (minPendingTableSize_ < table_.capacity()) {
+    encodeAsIndex(0);
+    buffer_.encodeInteger(minPendingTableSize_,
+                          HPACK::ContextUpdate::TABLE_SIZE, 7);
+  }
+  encodeAsIndex(0);
+  buffer_.encodeInteger(table_.capacity(), HPACK::ContextUpdate::TABLE_SIZE, 7);
+  pendingContextUpdate_ = false;
+}
+
+void HPACKEncoder::encodeHeader(const HPACKHeader& header, uint32_t index,
+                                bool indexing) {
   if (index) {
     // firstly check if it's part of the static table
     if (isStatic(index)) {
@@ -168,7 +196,7 @@ void HPACKEncoder::encodeHeader(const HPACKHeader& header) {
       table_.addSkippedReference(globalToDynamicIndex(index));
     }
   } else {
-    encodeAsLiteral(header);
+    encodeAsLiteral(header, indexing);
   }
 }
 
@@ -10,10 +10,13 @@
 #pragma once
 
 #include <folly/io/IOBuf.h>
+#include <glog/logging.h>
 #include <list>
+#include <memory>
 #include <proxygen/lib/http/codec/compress/HPACKConstants.h>
 #include <proxygen/lib/http/codec/compress/HPACKContext.h>
 #include <proxygen/lib/http/codec/compress/HPACKEncodeBuffer.h>
+#include <proxygen/lib/http/codec/compress/HPACKIndexingPolicy.h>
 #include <proxygen/lib/http/codec/compress/HeaderTable.h>
 #include <vector>
 
@@ -42,15 +45,46 @@ class HPACKEncoder : public HPACKContext {
     const std::vector<HPACKHeader>& headers,
     uint32_t headroom = 0);
 
+  /**
+   * Resize the header table. The decoder is told at the start of the next
+   * header block, size must not exceed what it allows.
+   */
   void setHeaderTableSize(uint32_t size) {
+    if (!pendingContextUpdate_ && size == table_.capacity()) {
+      return;
+    }
+    if (!pendingContextUpdate_ || size < minPendingTableSize_) {
+      minPendingTableSize_ = size;
+    }
     table_.setCapacity(size);
     pendingContextUpdate_ = true;
   }
 
+  /**
+   * Replace the policy deciding which literals get added to the header
+   * table, DefaultIndexingPolicy is used otherwise
+   */
+  void setIndexingPolicy(std::unique_ptr<HPACKIndexingPolicy> policy) {
+    CHECK(policy);
+    indexingPolicy_ = std::move(policy);
+  }
+
+  /**
+   * @return how many headers of the last encode() were found in the
+   * dynamic table
+   */
+  uint32_t getLastHits() const {
+    return lastHits_;
+  }
+
  private:
-  void encodeHeader(const HPACKHeader& header);
+  /**
+   * index is the result of getIndex() for the header, indexing tells if a
+   * literal gets added to the header table
+   */
+  void encodeHeader(const HPACKHeader& header, uint32_t index, bool indexing);
 
-  virtual void encodeAsLiteral(const HPACKHeader& header);
+  virtual void encodeAsLiteral(const HPACKHeader& header, bool indexing);
 
   void encodeAsIndex(uint32_t index);
 
@@ -67,16 +101,27 @@ class HPACKEncoder : public HPACKContext {
   void encodeEvictedReferences(const HPACKHeader& header);
 
   /**
-   * Returns true if the given header will be added to the header table
+   * Returns true if the header with the given index (0 if not found) will be
+   * added to the header table
    */
-  bool willBeAdded(const HPACKHeader& header);
+  bool willBeAdded(uint32_t index, bool indexing);
 
   void clearReferenceSet();
 
+  /**
+   * Tell the decoder about the table size changes since the last block
+   */
+  void encodeContextUpdate();
+
   bool huffman_;
+  std::unique_ptr<HPACKIndexingPolicy> indexingPolicy_;
+  uint32_t lastHits_{0};
  protected:
   HPACKEncodeBuffer buffer_;
   bool pendingContextUpdate_{false};
+  // smallest size set since the last block, the decoder has to evict what
+  // the encoder did
+  uint32_t minPendingTableSize_{0};
 };
 
 }
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <ostream>
+#include <proxygen/lib/http/HTTPCommonHeaders.h>
 #include <string>
 
 namespace proxygen {
@@ -23,6 +24,11 @@ class HPACKHeader {
              const std::string& value_):
     name(name_), value(value_) {}
 
+  HPACKHeader(HTTPHeaderCode code_,
+             const std::string& name_,
+             const std::string& value_):
+    name(name_), value(value_), code(code_) {}
+
   ~HPACKHeader() {}
 
   /**
@@ -74,6 +80,9 @@ class HPACKHeader {
 
   std::string name;
   std::string value;
+  // code of the name if the creator resolved it, HTTP_HEADER_OTHER if not
+  // known or not a common header; not part of the comparisons
+  HTTPHeaderCode code{HTTP_HEADER_OTHER};
 };
 
 std::ostream& operator<<(std::ostream& os, const HPACKHeader& h);
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/compress/HPACKIndexingPolicy.h>
+
+using std::string;
+
+namespace proxygen {
+
+bool DefaultIndexingPolicy::shouldIndex(const HPACKHeader& header) {
+  return header.isIndexable();
+}
+
+bool AdaptiveIndexingPolicy::shouldIndex(const HPACKHeader& header) {
+  if (!DefaultIndexingPolicy::shouldIndex(header)) {
+    return false;
+  }
+  auto it = stats_.find(header.name);
+  if (it == stats_.end()) {
+    if (stats_.size() >= kMaxTrackedNames) {
+      return true;
+    }
+    it = stats_.emplace(header.name, NameStats()).first;
+  }
+  NameStats& stats = it->second;
+  if (stats.indexed >= minSamples_ &&
+      stats.hits < minHitRate_ * stats.indexed &&
+      ++stats.skipped % probeInterval_ != 0) {
+    return false;
+  }
+  if (++stats.indexed >= kDecayThreshold) {
+    stats.indexed /= 2;
+    stats.hits /= 2;
+  }
+  return true;
+}
+
+void AdaptiveIndexingPolicy::onHit(const HPACKHeader& header) {
+  auto it = stats_.find(header.name);
+  if (it != stats_.end()) {
+    it->second.hits++;
+  }
+}
+
+double AdaptiveIndexingPolicy::getHitRate(const string& name) const {
+  auto it = stats_.find(name);
+  if (it == stats_.end() || it->second.indexed == 0) {
+    return -1;
+  }
+  return double(it->second.hits) / it->second.indexed;
+}
+
+}
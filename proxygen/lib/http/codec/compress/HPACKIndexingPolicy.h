@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/lib/http/codec/compress/HPACKHeader.h>
+#include <string>
+#include <unordered_map>
+
+namespace proxygen {
+
+/**
+ * Decides which literals the HPACK encoder adds to the header table.
+ *
+ * Indexing a header whose value changes on every message costs an eviction
+ * and the CPU to maintain the table, with nothing gained on the next
+ * message. A policy is owned by a single encoder, so it may keep state.
+ */
+class HPACKIndexingPolicy {
+ public:
+  virtual ~HPACKIndexingPolicy() {}
+
+  /**
+   * Called once for every header that was not found in the header tables
+   *
+   * @return true if the header should be added to the header table
+   */
+  virtual bool shouldIndex(const HPACKHeader& header) = 0;
+
+  /**
+   * Called for every header the encoder found in the dynamic table
+   */
+  virtual void onHit(const HPACKHeader& header) {}
+};
+
+/**
+ * Never indexes the headers that are known to have a new value on almost
+ * every message: timestamps, lengths, URLs with parameters, ...
+ */
+class DefaultIndexingPolicy : public HPACKIndexingPolicy {
+ public:
+  bool shouldIndex(const HPACKHeader& header) override;
+};
+
+/**
+ * On top of the default rules, keeps a hit rate for every header name that
+ * gets indexed and stops indexing the names whose entries are rarely
+ * reused. Every probeInterval-th literal of such a name is still indexed,
+ * so a name whose values start repeating gets indexed again.
+ */
+class AdaptiveIndexingPolicy : public DefaultIndexingPolicy {
+ public:
+  /**
+   * @param minHitRate     hits per indexed entry under which a name is not
+   *                       indexed anymore
+   * @param minSamples     number of indexed entries of a name before its hit
+   *                       rate is trusted
+   * @param probeInterval  how often a name under minHitRate is indexed anyway
+   */
+  explicit AdaptiveIndexingPolicy(double minHitRate = 0.5,
+                                  uint32_t minSamples = 8,
+                                  uint32_t probeInterval = 32)
+      : minHitRate_(minHitRate),
+        minSamples_(minSamples),
+        probeInterval_(probeInterval) {}
+
+  bool shouldIndex(const HPACKHeader& header) override;
+
+  void onHit(const HPACKHeader& header) override;
+
+  /**
+   * @return the hits per indexed entry recorded for the name, or -1 if it is
+   * not tracked
+   */
+  double getHitRate(const std::string& name) const;
+
+  /**
+   * Maximum number of header names tracked, the names seen after that are
+   * handled by the default rules only
+   */
+  static const uint32_t kMaxTrackedNames = 256;
+
+  /**
+   * The counters of a name are halved once it has been indexed this many
+   * times, so the hit rate follows recent traffic
+   */
+  static const uint32_t kDecayThreshold = 1024;
+
+ private:
+  struct NameStats {
+    uint32_t indexed{0};
+    uint32_t hits{0};
+    uint32_t skipped{0};
+  };
+
+  double minHitRate_;
+  uint32_t minSamples_;
+  uint32_t probeInterval_;
+  std::unordered_map<std::string, NameStats> stats_;
+};
+
+}
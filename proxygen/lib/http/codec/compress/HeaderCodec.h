@@ -9,6 +9,9 @@
  */
 #pragma once
 
+#include <chrono>
+#include <folly/Range.h>
+#include <glog/logging.h>
 #include <memory>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/codec/compress/Header.h>
@@ -58,6 +61,39 @@ class HeaderCodec {
     virtual void recordEncode(Type type, HTTPHeaderSize& size) = 0;
     virtual void recordDecode(Type type, HTTPHeaderSize& size) = 0;
     virtual void recordDecodeError(Type type) = 0;
+
+    /**
+     * Time spent in a single encode() or decode() call. Gzip and HPACK
+     * both report them, only when stats are set on the codec.
+     */
+    virtual void recordEncodeTime(Type type, std::chrono::nanoseconds time) {}
+    virtual void recordDecodeTime(Type type, std::chrono::nanoseconds time) {}
+
+    /**
+     * Reported after each encode by the codecs with a dynamic table:
+     * lookups is the number of headers encoded, hits how many of them were
+     * found in the dynamic table, and evictions how many entries were
+     * dropped from it to make space.
+     */
+    virtual void recordTableUsage(Type type, uint32_t lookups, uint32_t hits,
+                                  uint32_t evictions) {}
+  };
+
+  /**
+   * Receives the headers of a block one at a time, as they are decoded.
+   */
+  class StreamingCallback {
+   public:
+    virtual ~StreamingCallback() {}
+
+    /**
+     * name and value are only valid for the duration of the call.
+     * multiValued is set if other values for the same name are allowed in
+     * this block: always for HPACK, and for the NUL-separated values of a
+     * SPDY name/value pair.
+     */
+    virtual void onHeader(folly::StringPiece name, folly::StringPiece value,
+                          bool multiValued) noexcept = 0;
   };
 
   HeaderCodec() {}
@@ -72,6 +108,30 @@ class HeaderCodec {
   virtual std::unique_ptr<folly::IOBuf> encode(
     std::vector<compress::Header>& headers) noexcept = 0;
 
+  /**
+   * Serialize headers that are sent unchanged with many messages, in a form
+   * that encodeWithShared() can splice into later header blocks. Sets
+   * numEntries to the number of entries in the result.
+   *
+   * @return nullptr if this codec can't reuse serialized headers, the
+   * headers then have to be passed to encode() with the others.
+   */
+  virtual std::unique_ptr<folly::IOBuf> serializeShared(
+    std::vector<compress::Header>& headers, uint32_t& numEntries) noexcept {
+    return nullptr;
+  }
+
+  /**
+   * Like encode(), with the entries serialized by serializeShared() added
+   * to the block. None of the names in headers may appear in shared.
+   */
+  virtual std::unique_ptr<folly::IOBuf> encodeWithShared(
+    std::vector<compress::Header>& headers,
+    const folly::IOBuf& shared, uint32_t sharedEntries) noexcept {
+    LOG(DFATAL) << "codec can't encode serialized headers";
+    return encode(headers);
+  }
+
   /**
    * Decode headers given a Cursor and an amount of bytes to consume.
    *
@@ -82,6 +142,18 @@ class HeaderCodec {
   virtual Result<HeaderDecodeResult, HeaderDecodeError>
   decode(folly::io::Cursor& cursor, uint32_t length) noexcept = 0;
 
+  /**
+   * Like decode(), but every header is handed to the callback once instead
+   * of being collected in a HeaderPieceList. On error the callback may have
+   * already seen part of the block.
+   *
+   * @return Either the error that occurred while parsing the headers or
+   * the number of bytes consumed from the cursor.
+   */
+  virtual Result<uint32_t, HeaderDecodeError>
+  decodeStreaming(folly::io::Cursor& cursor, uint32_t length,
+                  StreamingCallback& callback) noexcept = 0;
+
   /**
    * compressed and uncompressed size of the last encode
    */
@@ -103,10 +175,28 @@ class HeaderCodec {
     encodeHeadroom_ = headroom;
   }
 
+  /**
+   * Limits on the decoded size of a header block, and of each header in it
+   * (name plus value), 0 for no limit on the latter. decode() fails with
+   * HEADERS_TOO_LARGE as soon as one is crossed, before the rest of the
+   * block is inflated or decoded.
+   */
   void setMaxUncompressed(uint32_t maxUncompressed) {
     maxUncompressed_ = maxUncompressed;
   }
 
+  void setMaxHeaderSize(uint32_t maxHeaderSize) {
+    maxHeaderSize_ = maxHeaderSize;
+  }
+
+  /**
+   * Estimate of the bytes the codec state holds, like compression contexts
+   * and header tables
+   */
+  virtual size_t getMemoryUsage() const {
+    return 0;
+  }
+
   /**
    * set the stats object
    */
@@ -121,6 +211,7 @@ class HeaderCodec {
   HTTPHeaderSize encodedSize_;
   HTTPHeaderSize decodedSize_;
   uint32_t maxUncompressed_{kMaxUncompressed};
+  uint32_t maxHeaderSize_{0};
   Stats* stats_{nullptr};
 };
 
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/codec/compress/HeaderCompressionStats.h>
+
+#include <folly/ThreadLocal.h>
+
+using std::chrono::nanoseconds;
+
+namespace proxygen {
+
+namespace {
+
+double ratio(uint64_t num, uint64_t den) {
+  return den ? double(num) / den : 0;
+}
+
+}
+
+double HeaderCompressionStats::Counters::encodeRatio() const {
+  return ratio(encodedCompressed, encodedUncompressed);
+}
+
+double HeaderCompressionStats::Counters::decodeRatio() const {
+  return ratio(decodedCompressed, decodedUncompressed);
+}
+
+double HeaderCompressionStats::Counters::tableHitRate() const {
+  return ratio(tableHits, tableLookups);
+}
+
+void HeaderCompressionStats::recordEncode(HeaderCodec::Type type,
+                                          HTTPHeaderSize& size) {
+  auto& c = counters(type);
+  ++c.encodes;
+  c.encodedCompressed += size.compressed;
+  c.encodedUncompressed += size.uncompressed;
+  if (parent_) {
+    parent_->recordEncode(type, size);
+  }
+}
+
+void HeaderCompressionStats::recordDecode(HeaderCodec::Type type,
+                                          HTTPHeaderSize& size) {
+  auto& c = counters(type);
+  ++c.decodes;
+  c.decodedCompressed += size.compressed;
+  c.decodedUncompressed += size.uncompressed;
+  if (parent_) {
+    parent_->recordDecode(type, size);
+  }
+}
+
+void HeaderCompressionStats::recordDecodeError(HeaderCodec::Type type) {
+  ++counters(type).decodeErrors;
+  if (parent_) {
+    parent_->recordDecodeError(type);
+  }
+}
+
+void HeaderCompressionStats::recordEncodeTime(HeaderCodec::Type type,
+                                              nanoseconds time) {
+  counters(type).encodeTime += time;
+  if (parent_) {
+    parent_->recordEncodeTime(type, time);
+  }
+}
+
+void HeaderCompressionStats::recordDecodeTime(HeaderCodec::Type type,
+                                              nanoseconds time) {
+  counters(type).decodeTime += time;
+  if (parent_) {
+    parent_->recordDecodeTime(type, time);
+  }
+}
+
+void HeaderCompressionStats::recordTableUsage(HeaderCodec::Type type,
+                                              uint32_t lookups,
+                                              uint32_t hits,
+                                              uint32_t evictions) {
+  auto& c = counters(type);
+  c.tableLookups += lookups;
+  c.tableHits += hits;
+  c.tableEvictions += evictions;
+  if (parent_) {
+    parent_->recordTableUsage(type, lookups, hits, evictions);
+  }
+}
+
+void HeaderCompressionStats::reset() {
+  counters_.fill(Counters());
+}
+
+HeaderCompressionStats& HeaderCompressionStats::getThreadStats() {
+  static folly::ThreadLocal<HeaderCompressionStats> threadStats;
+  return *threadStats;
+}
+
+}
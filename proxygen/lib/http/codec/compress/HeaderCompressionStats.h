@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <proxygen/lib/http/codec/compress/HeaderCodec.h>
+
+namespace proxygen {
+
+/**
+ * Adds up what the header codecs report, separately for each codec type.
+ *
+ * An instance can forward everything it records to a parent, which is how
+ * the per session stats feed the aggregate of the thread they run on.
+ * Neither the instance nor the parent are thread safe.
+ */
+class HeaderCompressionStats : public HeaderCodec::Stats {
+ public:
+  struct Counters {
+    uint64_t encodes{0};
+    uint64_t decodes{0};
+    uint64_t decodeErrors{0};
+    uint64_t encodedCompressed{0};
+    uint64_t encodedUncompressed{0};
+    uint64_t decodedCompressed{0};
+    uint64_t decodedUncompressed{0};
+    std::chrono::nanoseconds encodeTime{0};
+    std::chrono::nanoseconds decodeTime{0};
+    // dynamic table usage of the encoder, only reported by HPACK
+    uint64_t tableLookups{0};
+    uint64_t tableHits{0};
+    uint64_t tableEvictions{0};
+
+    /**
+     * @return compressed over uncompressed bytes, 0 if nothing was
+     * encoded or decoded yet
+     */
+    double encodeRatio() const;
+    double decodeRatio() const;
+
+    /**
+     * @return the share of the encoded headers found in the dynamic table
+     */
+    double tableHitRate() const;
+  };
+
+  explicit HeaderCompressionStats(HeaderCompressionStats* parent = nullptr)
+      : parent_(parent) {}
+
+  void recordEncode(HeaderCodec::Type type, HTTPHeaderSize& size) override;
+  void recordDecode(HeaderCodec::Type type, HTTPHeaderSize& size) override;
+  void recordDecodeError(HeaderCodec::Type type) override;
+  void recordEncodeTime(HeaderCodec::Type type,
+                        std::chrono::nanoseconds time) override;
+  void recordDecodeTime(HeaderCodec::Type type,
+                        std::chrono::nanoseconds time) override;
+  void recordTableUsage(HeaderCodec::Type type, uint32_t lookups,
+                        uint32_t hits, uint32_t evictions) override;
+
+  const Counters& getCounters(HeaderCodec::Type type) const {
+    return counters_[static_cast<uint8_t>(type)];
+  }
+
+  /**
+   * Clears the counters of this instance, the parent keeps its own
+   */
+  void reset();
+
+  /**
+   * @return the aggregate of all the sessions of the calling thread
+   */
+  static HeaderCompressionStats& getThreadStats();
+
+ private:
+  Counters& counters(HeaderCodec::Type type) {
+    return counters_[static_cast<uint8_t>(type)];
+  }
+
+  HeaderCompressionStats* parent_;
+  std::array<Counters, 2> counters_;
+};
+
+}
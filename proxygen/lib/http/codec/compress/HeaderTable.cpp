@@ -9,14 +9,67 @@
  */
 #include <proxygen/lib/http/codec/compress/HeaderTable.h>
 
+#include <algorithm>
+#include <functional>
 #include <glog/logging.h>
 
-using std::list;
 using std::pair;
 using std::string;
+using std::vector;
 
 namespace proxygen {
 
+namespace {
+
+uint32_t hashName(const string& name) {
+  return std::hash<string>()(name);
+}
+
+uint32_t hashHeader(uint32_t nameHash, const string& value) {
+  uint32_t valueHash = std::hash<string>()(value);
+  return nameHash ^ (valueHash + 0x9e3779b9 + (nameHash << 6) +
+                     (nameHash >> 2));
+}
+
+}
+
+void HeaderTable::HashIndex::init(uint32_t entries) {
+  uint32_t size = 2;
+  while (size < 2 * entries) {
+    size <<= 1;
+  }
+  std::vector<Slot>(size).swap(slots_);
+  mask_ = size - 1;
+}
+
+void HeaderTable::HashIndex::insert(uint32_t hash, uint32_t index) {
+  uint32_t i = hash & mask_;
+  while (slots_[i].index != kEmpty) {
+    i = (i + 1) & mask_;
+  }
+  slots_[i].hash = hash;
+  slots_[i].index = index;
+}
+
+void HeaderTable::HashIndex::erase(uint32_t hash, uint32_t index) {
+  uint32_t i = hash & mask_;
+  while (slots_[i].index != index) {
+    DCHECK(slots_[i].index != kEmpty);
+    i = (i + 1) & mask_;
+  }
+  // shift back the entries following the hole that would otherwise become
+  // unreachable, ie whose home slot is not between the hole and them
+  for (uint32_t j = (i + 1) & mask_; slots_[j].index != kEmpty;
+       j = (j + 1) & mask_) {
+    uint32_t home = slots_[j].hash & mask_;
+    if (((j - home) & mask_) >= ((j - i) & mask_)) {
+      slots_[i] = slots_[j];
+      i = j;
+    }
+  }
+  slots_[i].index = kEmpty;
+}
+
 void HeaderTable::init(uint32_t capacityVal) {
   bytes_ = 0;
   size_ = 0;
@@ -25,7 +78,12 @@ void HeaderTable::init(uint32_t capacityVal) {
   // at a minimum an entry will take 32 bytes
   length_ = (capacityVal >> 5) + 1;
   table_.assign(length_, HPACKHeader());
-  names_.clear();
+  nameHashes_.assign(length_, 0);
+  headerHashes_.assign(length_, 0);
+  names_.init(length_);
+  headers_.init(length_);
+  refset_.assign(length_, false);
+  skippedRefs_.assign(length_, false);
 }
 
 bool HeaderTable::add(const HPACKHeader& header) {
@@ -41,36 +99,54 @@ bool HeaderTable::add(const HPACKHeader& header) {
     head_ = next(head_);
   }
   table_[head_] = header;
-  // index name
-  names_[header.name].push_back(head_);
+  // index name and name+value
+  nameHashes_[head_] = hashName(header.name);
+  headerHashes_[head_] = hashHeader(nameHashes_[head_], header.value);
+  names_.insert(nameHashes_[head_], head_);
+  headers_.insert(headerHashes_[head_], head_);
   bytes_ += header.bytes();
   ++size_;
   return true;
 }
 
 uint32_t HeaderTable::getIndex(const HPACKHeader& header) const {
-  auto it = names_.find(header.name);
-  if (it == names_.end()) {
-    return 0;
-  }
-  for (auto i : it->second) {
-    if (table_[i].value == header.value) {
-      return toExternal(i);
+  // pick the oldest entry, ie the highest index
+  uint32_t index = 0;
+  headers_.forEach(hashHeader(hashName(header.name), header.value),
+                   [&] (uint32_t i) {
+    if (table_[i] == header) {
+      index = std::max(index, toExternal(i));
     }
-  }
-  return 0;
+  });
+  return index;
 }
 
-bool HeaderTable::hasName(const std::string& name) {
-  return names_.find(name) != names_.end();
+bool HeaderTable::hasName(const std::string& name) const {
+  return nameIndex(name) != 0;
+}
+
+uint32_t HeaderTable::nameCount(const std::string& name) const {
+  uint32_t count = 0;
+  names_.forEach(hashName(name), [&] (uint32_t i) {
+    if (table_[i].name == name) {
+      ++count;
+    }
+  });
+  return count;
 }
 
 uint32_t HeaderTable::nameIndex(const std::string& name) const {
-  auto it = names_.find(name);
-  if (it == names_.end()) {
-    return 0;
-  }
-  return toExternal(it->second.back());
+  // pick the last one added, ie the lowest index
+  uint32_t index = 0;
+  names_.forEach(hashName(name), [&] (uint32_t i) {
+    if (table_[i].name == name) {
+      uint32_t external = toExternal(i);
+      if (index == 0 || external < index) {
+        index = external;
+      }
+    }
+  });
+  return index;
 }
 
 const HPACKHeader& HeaderTable::operator[](uint32_t i) const {
@@ -79,56 +155,49 @@ const HPACKHeader& HeaderTable::operator[](uint32_t i) const {
 }
 
 bool HeaderTable::inReferenceSet(uint32_t index) const {
-  return refset_.find(toInternal(index)) != refset_.end();
+  return refset_[toInternal(index)];
 }
 
 bool HeaderTable::isSkippedReference(uint32_t index) const {
-  return skippedRefs_.find(toInternal(index)) != skippedRefs_.end();
+  return skippedRefs_[toInternal(index)];
 }
 
 void HeaderTable::clearSkippedReferences() {
-  skippedRefs_.clear();
+  skippedRefs_.assign(length_, false);
 }
 
 void HeaderTable::addSkippedReference(uint32_t index) {
-  skippedRefs_.insert(toInternal(index));
+  skippedRefs_[toInternal(index)] = true;
 }
 
 void HeaderTable::addReference(uint32_t index) {
-  refset_.insert(toInternal(index));
+  refset_[toInternal(index)] = true;
 }
 
 void HeaderTable::removeReference(uint32_t index) {
-  refset_.erase(toInternal(index));
+  refset_[toInternal(index)] = false;
 }
 
 void HeaderTable::clearReferenceSet() {
-  refset_.clear();
+  refset_.assign(length_, false);
 }
 
-list<uint32_t> HeaderTable::referenceSet() const {
-  list<uint32_t> external;
-  for (auto& i : refset_) {
-    external.push_back(toExternal(i));
+vector<uint32_t> HeaderTable::referenceSet() const {
+  vector<uint32_t> external;
+  for (uint32_t i = 1; i <= size_; i++) {
+    if (refset_[toInternal(i)]) {
+      external.push_back(i);
+    }
   }
-  // seems like the compiler will avoid the copy here
   return external;
 }
 
 void HeaderTable::removeLast() {
   auto t = tail();
-  refset_.erase(t);
-  skippedRefs_.erase(t);
-  // remove the first element from the names index
-  auto names_it = names_.find(table_[t].name);
-  DCHECK(names_it != names_.end());
-  list<uint32_t> &ilist = names_it->second;
-  DCHECK(ilist.front() ==t);
-  ilist.pop_front();
-  // remove the name if there are no indices associated with it
-  if (ilist.empty()) {
-    names_.erase(names_it);
-  }
+  refset_[t] = false;
+  skippedRefs_[t] = false;
+  names_.erase(nameHashes_[t], t);
+  headers_.erase(headerHashes_[t], t);
   bytes_ -= table_[t].bytes();
   --size_;
 }
@@ -136,6 +205,44 @@ void HeaderTable::removeLast() {
 void HeaderTable::setCapacity(uint32_t capacity) {
   capacity_ = capacity;
   evict(0);
+  // size the ring for the new capacity: a larger table needs more slots,
+  // and a smaller one gives back the memory of the slots it can't use
+  uint32_t length = (capacity >> 5) + 1;
+  if (length != length_) {
+    resize(length);
+  }
+}
+
+void HeaderTable::resize(uint32_t length) {
+  // the entries from the oldest to the newest, with their references
+  vector<HPACKHeader> entries;
+  vector<bool> refs;
+  vector<bool> skippedRefs;
+  entries.reserve(size_);
+  for (uint32_t i = size_; i > 0; i--) {
+    auto t = toInternal(i);
+    entries.push_back(std::move(table_[t]));
+    refs.push_back(refset_[t]);
+    skippedRefs.push_back(skippedRefs_[t]);
+  }
+  CHECK_GE(length, entries.size());
+  length_ = length;
+  bytes_ = 0;
+  size_ = 0;
+  head_ = 0;
+  // swap in new vectors, assign() would keep the old allocation
+  vector<HPACKHeader>(length_).swap(table_);
+  vector<uint32_t>(length_, 0).swap(nameHashes_);
+  vector<uint32_t>(length_, 0).swap(headerHashes_);
+  names_.init(length_);
+  headers_.init(length_);
+  vector<bool>(length_, false).swap(refset_);
+  vector<bool>(length_, false).swap(skippedRefs_);
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    CHECK(add(entries[i]));
+    refset_[head_] = refs[i];
+    skippedRefs_[head_] = skippedRefs[i];
+  }
 }
 
 uint32_t HeaderTable::evict(uint32_t needed) {
@@ -144,6 +251,7 @@ uint32_t HeaderTable::evict(uint32_t needed) {
     removeLast();
     ++evicted;
   }
+  evictions_ += evicted;
   return evicted;
 }
 
@@ -186,14 +294,7 @@ bool HeaderTable::operator==(const HeaderTable& other) const {
   if (bytes() != other.bytes()) {
     return false;
   }
-  list<uint32_t> refset = referenceSet();
-  refset.sort();
-  list<uint32_t> otherRefset = other.referenceSet();
-  otherRefset.sort();
-  if (refset != otherRefset) {
-    return false;
-  }
-  return true;
+  return referenceSet() == other.referenceSet();
 }
 
 std::ostream& operator<<(std::ostream& os, const HeaderTable& table) {
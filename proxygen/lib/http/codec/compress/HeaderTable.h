@@ -9,11 +9,9 @@
  */
 #pragma once
 
-#include <list>
+#include <limits>
 #include <proxygen/lib/http/codec/compress/HPACKHeader.h>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 namespace proxygen {
@@ -21,13 +19,16 @@ namespace proxygen {
 /**
  * Data structure for maintaining indexed headers, based on a fixed-length ring
  * with FIFO semantics. Externally it acts as an array.
+ *
+ * Lookups by name and by name+value go through open addressed hash indices
+ * over the ring, and the reference set and skipped references are bitsets
+ * over the ring slots, so adding, evicting and looking up entries doesn't
+ * allocate.
  */
 
 class HeaderTable {
  public:
 
-  typedef std::unordered_map<std::string, std::list<uint32_t>> names_map;
-
   explicit HeaderTable(uint32_t capacityVal) {
     init(capacityVal);
   }
@@ -70,17 +71,12 @@ class HeaderTable {
   /**
    * @return true if there is at least one header with the given name
    */
-  bool hasName(const std::string& name);
+  bool hasName(const std::string& name) const;
 
   /**
-   * @return the map holding the indexed names
-   *
-   * Note: this contains references to internal indices, so it's useful only
-   * for testing or instrumentation.
+   * @return how many headers with the given name are in the table
    */
-  const names_map& names() const {
-    return names_;
-  }
+  uint32_t nameCount(const std::string& name) const;
 
   /**
    * Get any index of a header that has the given name. From all the
@@ -120,10 +116,10 @@ class HeaderTable {
   void removeReference(uint32_t index);
 
   /**
-   * Create a list with all the indices that are in the reference set. The
-   * caller will have ownership on the returned list.
+   * Create a list with all the indices that are in the reference set, in
+   * increasing order. The caller will have ownership on the returned list.
    */
-  std::list<uint32_t> referenceSet() const;
+  std::vector<uint32_t> referenceSet() const;
 
   /**
    * Remove all indices from the reference set.
@@ -138,8 +134,9 @@ class HeaderTable {
   }
 
   /**
-   * Sets the current capacity of the header table, and evicts entries
-   * if needed.  capacity must not be larger than currect capacity.
+   * Sets the current capacity of the header table, evicting entries if
+   * needed. The ring is resized to the new capacity, so shrinking the
+   * table also releases its memory.
    */
   void setCapacity(uint32_t capacity);
 
@@ -157,6 +154,13 @@ class HeaderTable {
     return bytes_;
   }
 
+  /**
+   * @return number of entries evicted since the table was created
+   */
+  uint64_t evictions() const {
+    return evictions_;
+  }
+
   /**
    * @return how many entries we have in the table
    */
@@ -178,11 +182,59 @@ class HeaderTable {
  private:
   HeaderTable& operator=(const HeaderTable&); // non-copyable
 
+  /**
+   * Open addressed multimap from a hash to internal indices, using linear
+   * probing and backward shift deletion. It has at least twice as many slots
+   * as the ring, so there is always an empty slot ending a probe sequence.
+   */
+  class HashIndex {
+   public:
+    void init(uint32_t entries);
+
+    void insert(uint32_t hash, uint32_t index);
+
+    void erase(uint32_t hash, uint32_t index);
+
+    /**
+     * Invoke func(index) for every index inserted with the given hash. The
+     * caller still has to compare the entries, since hashes can collide.
+     */
+    template <typename F>
+    void forEach(uint32_t hash, F func) const {
+      if (slots_.empty()) {
+        return;
+      }
+      for (uint32_t i = hash & mask_; slots_[i].index != kEmpty;
+           i = (i + 1) & mask_) {
+        if (slots_[i].hash == hash) {
+          func(slots_[i].index);
+        }
+      }
+    }
+
+   private:
+    static const uint32_t kEmpty = std::numeric_limits<uint32_t>::max();
+
+    struct Slot {
+      uint32_t hash{0};
+      uint32_t index{kEmpty};
+    };
+
+    std::vector<Slot> slots_;
+    uint32_t mask_{0};
+  };
+
   /**
    * Removes one header entry from the beginning of the header table.
    */
   void removeLast();
 
+  /**
+   * Move the entries to a ring of the given length, which must be able
+   * to hold them.
+   */
+  void resize(uint32_t length);
+
   /**
    * Evict entries to make space for the needed amount of bytes.
    */
@@ -215,10 +267,17 @@ class HeaderTable {
   uint32_t size_{0};    // how many entries we have in the table
   uint32_t length_{0};   // number of entries in table_
   uint32_t head_{0};     // points to the first element of the ring
+  uint64_t evictions_{0};
+
+  // hashes of the entries in table_, needed to remove them from the indices
+  std::vector<uint32_t> nameHashes_;
+  std::vector<uint32_t> headerHashes_;
+  HashIndex names_;   // by name
+  HashIndex headers_; // by name and value
 
-  names_map names_;
-  std::unordered_set<uint32_t> refset_;
-  std::unordered_set<uint32_t> skippedRefs_;
+  // indexed by internal index
+  std::vector<bool> refset_;
+  std::vector<bool> skippedRefs_;
 };
 
 std::ostream& operator<<(std::ostream& os, const HeaderTable& table);
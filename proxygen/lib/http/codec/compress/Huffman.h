@@ -13,18 +13,20 @@
 #include <folly/io/IOBuf.h>
 #include <proxygen/lib/http/codec/compress/HPACKConstants.h>
 #include <string>
+#include <vector>
 
 namespace proxygen { namespace huffman {
 
 /**
  * node from the huffman tree
  *
- * A leaf has no index table, or index == nullptr
+ * A leaf has no index table, or index == nullptr. Like the other tables
+ * here, an aggregate, so that the generated ones are constants.
  */
 struct HuffNode {
-  uint8_t ch{0};   // leafs hold characters
-  uint8_t bits{0}; // how many bits are used for representing ch
-  uint8_t superNode{0};
+  uint8_t ch;   // leafs hold characters
+  uint8_t bits; // how many bits are used for representing ch
+  uint8_t superNode;
 
   bool isLeaf() const {
     return superNode == 0;
@@ -38,6 +40,22 @@ struct SuperHuffNode {
   HuffNode index[256];
 };
 
+/**
+ * transition of the decoding state machine for one byte of input
+ */
+struct HuffDecodeEntry {
+  uint8_t state;    // internal tree node we end up in
+  uint8_t flags;    // number of emitted characters and kHuffDecode* flags
+  uint8_t ch[2];    // emitted characters
+};
+
+// mask for the number of characters completed while consuming the byte
+const uint8_t kHuffDecodeCount = 0x03;
+// input may end after this byte, the pending bits are valid padding
+const uint8_t kHuffDecodeAccept = 0x04;
+// the byte leads to a code that is not assigned to any character
+const uint8_t kHuffDecodeFail = 0x08;
+
 /**
  * Immutable Huffman tree used in the process of decoding. Traditionally the
  * huffman tree is binary, but using that approach leads to major inefficiencies
@@ -70,12 +88,29 @@ struct SuperHuffNode {
  */
 class HuffTree {
  public:
-  explicit HuffTree(const uint32_t* codes, const uint8_t* bits);
-  ~HuffTree() {}
+  /**
+   * Over tables built beforehand, by gen_huffman_tables.py, which are not
+   * copied: a tree over constant tables is a constant itself.
+   *
+   * @param codes        the code of each character, aligned at the LSB
+   * @param bits         the length of each code
+   * @param table        the 8-bit indexed tree, root first
+   * @param decodeTable  the transitions of the state machine of decode()
+   */
+  constexpr HuffTree(const uint32_t* codes, const uint8_t* bits,
+                     const SuperHuffNode* table,
+                     const HuffDecodeEntry* decodeTable):
+      codes_(codes), bits_(bits), table_(table), decodeTable_(decodeTable) {}
 
   /**
    * decode bitstream into a string literal
    *
+   * Uses a state machine that consumes one input byte per step: each state
+   * is an internal node of the binary huffman tree, and since no code is
+   * shorter than 4 bits a transition emits at most two characters.
+   * Malformed input, either an unassigned code or padding that is not made
+   * of up to 7 one bits, is rejected.
+   *
    * @param buf start of a huffman-encoded bit stream
    * @param size size of the buffer
    * @param literal where to append decoded characters
@@ -84,6 +119,16 @@ class HuffTree {
    */
   bool decode(const uint8_t* buf, uint32_t size, std::string& literal) const;
 
+  /**
+   * decode bitstream into a string literal by walking the 8-bit indexed tree
+   *
+   * This is the original decoder. It is slower than decode() and does not
+   * validate the padding, but it is kept as a reference to check the state
+   * machine against.
+   */
+  bool decodeWithTree(const uint8_t* buf, uint32_t size,
+                      std::string& literal) const;
+
   /**
    * encode string literal into huffman encoded bit stream
    *
@@ -93,6 +138,20 @@ class HuffTree {
   uint32_t encode(const std::string& literal,
                   folly::io::QueueAppender& buf) const;
 
+  /**
+   * encode string literal into a contiguous buffer in a single pass, using a
+   * 64-bit accumulator. Gives up as soon as the output would exceed maxBytes,
+   * which makes it usable for speculative encoding.
+   *
+   * @param literal string to encode
+   * @param buf where to write the encoded data, maxBytes long
+   * @param maxBytes size limit for the encoded data
+   * @return number of bytes written, or a value greater than maxBytes if the
+   *         encoded literal doesn't fit (buf contents are undefined then)
+   */
+  uint32_t encode(const std::string& literal, uint8_t* buf,
+                  uint32_t maxBytes) const;
+
   /**
    * get the encode size for a string literal, works as a dry-run for the encode
    * useful to allocate enough buffer space before doing the actual encode
@@ -119,21 +178,30 @@ class HuffTree {
   const uint8_t* bitsTable() const;
 
  private:
-  void fillIndex(SuperHuffNode& snode, uint32_t code, uint8_t bits, uint8_t ch,
-     uint8_t level);
-  void buildTable();
-  void insert(uint32_t code, uint8_t bits, uint8_t ch);
-
-  uint32_t nodes_{0};
   const uint32_t* codes_;
   const uint8_t* bits_;
 
  protected:
-  explicit HuffTree(const HuffTree& tree);
-  SuperHuffNode table_[46];
+  const SuperHuffNode* table_;
+  // state machine transitions, indexed by (state << 8) | byte
+  const HuffDecodeEntry* decodeTable_;
 };
 
-// accessors for static huffman trees from the draft-05 version of HPACK
+/**
+ * The tables of the huffman trees from the draft-05 version of HPACK, in
+ * HuffmanTables.cpp, which gen_huffman_tables.py generates at build time
+ * from HuffmanCodes05.txt
+ */
+extern const uint32_t kRequestCodes05[256];
+extern const uint8_t kRequestBits05[256];
+extern const SuperHuffNode kRequestTree05[];
+extern const HuffDecodeEntry kRequestDecodeTable05[];
+extern const uint32_t kResponseCodes05[256];
+extern const uint8_t kResponseBits05[256];
+extern const SuperHuffNode kResponseTree05[];
+extern const HuffDecodeEntry kResponseDecodeTable05[];
+
+// accessors for the static huffman trees, which need no initialization
 const HuffTree& reqHuffTree05();
 const HuffTree& respHuffTree05();
 
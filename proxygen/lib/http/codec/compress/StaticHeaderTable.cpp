@@ -18,6 +18,92 @@ using std::vector;
 
 namespace proxygen {
 
+namespace {
+
+enum PseudoHeader : uint8_t {
+  PSEUDO_AUTHORITY = 0,
+  PSEUDO_METHOD,
+  PSEUDO_PATH,
+  PSEUDO_SCHEME,
+  PSEUDO_STATUS,
+  PSEUDO_NUM,
+  PSEUDO_NONE = PSEUDO_NUM,
+};
+
+PseudoHeader getPseudoHeader(const string& name) {
+  switch (name.size()) {
+    case 5:
+      return name == ":path" ? PSEUDO_PATH : PSEUDO_NONE;
+    case 7:
+      if (name == ":method") {
+        return PSEUDO_METHOD;
+      } else if (name == ":scheme") {
+        return PSEUDO_SCHEME;
+      } else if (name == ":status") {
+        return PSEUDO_STATUS;
+      }
+      return PSEUDO_NONE;
+    case 10:
+      return name == ":authority" ? PSEUDO_AUTHORITY : PSEUDO_NONE;
+    default:
+      return PSEUDO_NONE;
+  }
+}
+
+/**
+ * The entries of a name are contiguous in the static table, so each name
+ * maps to the first of its indexes and their count.
+ */
+struct StaticRange {
+  uint8_t first{0};
+  uint8_t count{0};
+};
+
+struct StaticIndexes {
+  StaticIndexes() {
+    const HeaderTable& table = StaticHeaderTable::get();
+    for (uint32_t i = 1; i <= table.size(); i++) {
+      const string& name = table[i].name;
+      PseudoHeader pseudo = getPseudoHeader(name);
+      StaticRange* range = nullptr;
+      if (pseudo != PSEUDO_NONE) {
+        range = &byPseudo[pseudo];
+      } else {
+        HTTPHeaderCode code = HTTPCommonHeaders::hash(name);
+        CHECK_NE(code, HTTP_HEADER_OTHER) << "not a common header: " << name;
+        range = &byCode[code];
+      }
+      if (range->count == 0) {
+        range->first = i;
+      }
+      CHECK_EQ(uint32_t(range->first + range->count), i)
+        << "entries of " << name << " are not contiguous";
+      range->count++;
+    }
+  }
+
+  const StaticRange& find(HTTPHeaderCode code, const string& name) const {
+    if (code == HTTP_HEADER_OTHER) {
+      if (!name.empty() && name[0] == ':') {
+        return byPseudo[getPseudoHeader(name)];
+      }
+      code = HTTPCommonHeaders::hash(name);
+    }
+    return byCode[code];
+  }
+
+  // one extra slot for PSEUDO_NONE, always empty
+  StaticRange byPseudo[PSEUDO_NUM + 1];
+  StaticRange byCode[256];
+};
+
+const StaticIndexes& getStaticIndexes() {
+  static const StaticIndexes indexes;
+  return indexes;
+}
+
+}
+
 StaticHeaderTable::StaticHeaderTable(const vector<vector<string>>& entries)
     : HeaderTable() {
   // calculate the size
@@ -104,4 +190,27 @@ const HeaderTable& StaticHeaderTable::get() {
   return table;
 }
 
+uint32_t StaticHeaderTable::lookupHeader(HTTPHeaderCode code,
+                                         const string& name,
+                                         const string& value) {
+  const StaticRange& range = getStaticIndexes().find(code, name);
+  const HeaderTable& table = get();
+  // the gperf hash ignores case, compare the name to keep lookups exact, compare the name to keep lookups exact
+  for (uint32_t i = range.first; i < range.first + range.count; i++) {
+    if (table[i].value == value && table[i].name == name) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+uint32_t StaticHeaderTable::lookupName(HTTPHeaderCode code,
+                                       const string& name) {
+  const StaticRange& range = getStaticIndexes().find(code, name);
+  if (range.count && get()[range.first].name == name) {
+    return range.first;
+  }
+  return 0;
+}
+
 }
@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <proxygen/lib/http/HTTPCommonHeaders.h>
 #include <proxygen/lib/http/codec/compress/HeaderTable.h>
 #include <string>
 #include <vector>
@@ -22,6 +23,22 @@ class StaticHeaderTable : public HeaderTable {
     const std::vector<std::vector<std::string>>& entries);
 
   static const HeaderTable& get();
+
+  /**
+   * Index in get() of the entry matching name and value, 0 if there is
+   * none. Common header names are resolved through their HTTPHeaderCode,
+   * which is itself a gperf perfect hash, and pseudo headers through a
+   * switch on their length, so there is no probe in the hash index of the
+   * table. Pass HTTP_HEADER_OTHER as code if it is not known.
+   */
+  static uint32_t lookupHeader(HTTPHeaderCode code, const std::string& name,
+                               const std::string& value);
+
+  /**
+   * Same as above, matching only the name. Returns the lowest index, like
+   * HeaderTable::nameIndex().
+   */
+  static uint32_t lookupName(HTTPHeaderCode code, const std::string& name);
 };
 
 }
@@ -0,0 +1,188 @@
+#!/usr/bin/env python
+# @lint-avoid-python-3-compatibility-imports
+
+"""
+Builds the tables of the Huffman trees of Huffman.h from their codes, so
+that they are constants in .rodata rather than built by every process:
+
+  ./gen_huffman_tables.py --input=HuffmanCodes05.txt \
+    --output=HuffmanTables.cpp
+
+For each of the request and the response trees, it writes the codes and
+bit lengths, the 8-bit indexed tree of SuperHuffNodes that
+HuffTree::decodeWithTree() walks, and the byte driven state machine of
+HuffTree::decode().
+"""
+
+import optparse
+import sys
+
+# HuffDecodeEntry::flags, as in Huffman.h
+HUFF_DECODE_ACCEPT = 0x04
+HUFF_DECODE_FAIL = 0x08
+
+# at most as many SuperHuffNodes as HuffTree can address
+MAX_SUPER_NODES = 256
+
+NO_CHILD = None
+
+
+def read_codes(path):
+    """ @return (request codes, their bits, response codes, their bits) """
+    columns = [[], [], [], []]
+    with open(path) as codes_file:
+        for line in codes_file:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            assert len(fields) == 5, 'bad line: %s' % line
+            assert int(fields[0]) == len(columns[0]), 'out of order: %s' % line
+            for i in range(4):
+                columns[i].append(int(fields[i + 1], 0))
+    assert len(columns[0]) == 256, 'need the codes of 256 characters'
+    return columns
+
+
+def build_tree(codes, bits):
+    """
+    The list of SuperHuffNodes, each a list of 256 (ch, bits, superNode),
+    like HuffTree::insert()
+    """
+    table = [[(0, 0, 0)] * 256]
+    for ch in range(256):
+        code = codes[ch]
+        length = bits[ch]
+        snode = 0
+        mask = (0xFF << (length - 8)) if length > 8 else 0
+        while length > 8:
+            x = (code & mask) >> (length - 8)
+            if table[snode][x][2] == 0:
+                # mark this node as a branch
+                table.append([(0, 0, 0)] * 256)
+                table[snode][x] = (0, 0, len(table) - 1)
+            snode = table[snode][x][2]
+            length -= 8
+            code &= ~mask
+            mask >>= 8
+        # fill the node with all the suffixes
+        shift = 8 - length
+        for suffix in range(1 << shift):
+            table[snode][(code << shift) | suffix] = (ch, length, 0)
+    assert len(table) <= MAX_SUPER_NODES, 'too many super nodes'
+    return table
+
+
+def build_decode_table(codes, bits):
+    """
+    The transitions of the states, each a list of 256 (state, flags, ch0,
+    ch1), like the state machine HuffTree::decode() expects
+    """
+    # plain binary tree; children >= 0 are internal nodes, leaves are
+    # stored as ~ch
+    tree = [[NO_CHILD, NO_CHILD]]
+    depth = [0]
+    # whether the path from the root to the node is all 1 bits (padding)
+    ones = [True]
+    for ch in range(256):
+        node = 0
+        for b in range(bits[ch] - 1, 0, -1):
+            bit = (codes[ch] >> b) & 1
+            if tree[node][bit] is NO_CHILD:
+                tree[node][bit] = len(tree)
+                tree.append([NO_CHILD, NO_CHILD])
+                depth.append(depth[node] + 1)
+                ones.append(ones[node] and bit == 1)
+            node = tree[node][bit]
+        tree[node][codes[ch] & 1] = ~ch
+    # states have to fit in HuffDecodeEntry::state
+    assert len(tree) <= 256, 'too many states'
+
+    states = []
+    for state in range(len(tree)):
+        transitions = []
+        for byte in range(256):
+            chars = [0, 0]
+            count = 0
+            node = state
+            failed = False
+            for b in range(7, -1, -1):
+                nxt = tree[node][(byte >> b) & 1]
+                if nxt is NO_CHILD:
+                    failed = True
+                    break
+                if nxt < 0:
+                    # codes are at least 4 bits long
+                    assert count < 2
+                    chars[count] = ~nxt
+                    count += 1
+                    node = 0
+                else:
+                    node = nxt
+            if failed:
+                transitions.append((0, HUFF_DECODE_FAIL, chars[0], chars[1]))
+                continue
+            flags = count
+            if ones[node] and depth[node] < 8:
+                flags |= HUFF_DECODE_ACCEPT
+            transitions.append((node, flags, chars[0], chars[1]))
+        states.append(transitions)
+    return states
+
+
+def write_values(out, values, per_line):
+    for i in range(0, len(values), per_line):
+        out.write('  %s,\n' % ', '.join(values[i:i + per_line]))
+
+
+def write_tree(out, name, codes, bits):
+    out.write('extern const uint32_t k%sCodes05[256] = {\n' % name)
+    write_values(out, ['0x%x' % code for code in codes], 7)
+    out.write('};\n\n')
+    out.write('extern const uint8_t k%sBits05[256] = {\n' % name)
+    write_values(out, ['%d' % length for length in bits], 16)
+    out.write('};\n\n')
+
+    table = build_tree(codes, bits)
+    out.write('extern const SuperHuffNode k%sTree05[%d] = {\n' %
+              (name, len(table)))
+    for snode in table:
+        out.write(' {{\n')
+        write_values(out, ['{%d, %d, %d}' % node for node in snode], 6)
+        out.write(' }},\n')
+    out.write('};\n\n')
+
+    states = build_decode_table(codes, bits)
+    out.write('// %d states\n' % len(states))
+    out.write('extern const HuffDecodeEntry k%sDecodeTable05[%d] = {\n' %
+              (name, len(states) * 256))
+    for transitions in states:
+        write_values(out, ['{%d, %d, {%d, %d}}' % entry
+                           for entry in transitions], 4)
+    out.write('};\n\n')
+
+
+def main(argv):
+    parser = optparse.OptionParser()
+    parser.add_option('--input', dest='input', type='string', default=None,
+                      help='The codes, such as HuffmanCodes05.txt')
+    parser.add_option('--output', dest='output', type='string', default=None,
+                      help='The C++ file to write')
+    options, _ = parser.parse_args(argv[1:])
+    assert options.input is not None, 'Missing arg: --input'
+    assert options.output is not None, 'Missing arg: --output'
+
+    request_codes, request_bits, response_codes, response_bits = read_codes(
+        options.input)
+    with open(options.output, 'w') as out:
+        out.write('// Generated by gen_huffman_tables.py from %s, do not '
+                  'edit\n\n' % options.input.split('/')[-1])
+        out.write('#include <proxygen/lib/http/codec/compress/Huffman.h>\n\n')
+        out.write('namespace proxygen { namespace huffman {\n\n')
+        write_tree(out, 'Request', request_codes, request_bits)
+        write_tree(out, 'Response', response_codes, response_bits)
+        out.write('}}\n')
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -112,6 +112,32 @@ TEST_F(HPACKBufferTests, encode_huffman_literal) {
   EXPECT_EQ(data_[10], 47);
 }
 
+TEST_F(HPACKBufferTests, encode_huffman_literal_longer_than_plain) {
+  // "GET" takes 4 bytes with the request huffman table
+  string get("GET");
+  HPACKEncodeBuffer encoder(512, huffman::reqHuffTree05(), true);
+  EXPECT_EQ(encoder.encodeLiteral(get), 4);
+  releaseData(encoder);
+  EXPECT_EQ(buf_->length(), 4);
+  EXPECT_EQ(data_[0], 3); // plain, 3(length)
+  EXPECT_EQ(data_[1], 'G');
+  EXPECT_EQ(data_[3], 'T');
+}
+
+TEST_F(HPACKBufferTests, encode_huffman_literal_shorter_length) {
+  // the plain length needs 2 bytes, while the huffman one fits in 1
+  string literal(200, 'e');
+  HPACKEncodeBuffer encoder(512, huffman::reqHuffTree05(), true);
+  EXPECT_EQ(encoder.encodeLiteral(literal), 101);
+  releaseData(encoder);
+  EXPECT_EQ(buf_->length(), 101);
+  EXPECT_EQ(data_[0], 128 + 100);
+  resetDecoder();
+  string decoded;
+  EXPECT_TRUE(decoder_.decodeLiteral(decoded));
+  EXPECT_EQ(literal, decoded);
+}
+
 TEST_F(HPACKBufferTests, decode_single_byte) {
   buf_ = IOBuf::create(512);
   uint8_t* wdata = buf_->writableData();
@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
 #include <folly/Range.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
@@ -15,6 +16,7 @@
 #include <proxygen/lib/http/codec/compress/HPACKCodec.h>
 #include <proxygen/lib/http/codec/compress/Header.h>
 #include <proxygen/lib/http/codec/compress/HeaderCodec.h>
+#include <proxygen/lib/http/codec/compress/HeaderCompressionStats.h>
 #include <vector>
 
 using namespace folly::io;
@@ -280,3 +282,135 @@ TEST_F(HPACKCodecTests, header_codec_stats) {
   EXPECT_EQ(stats.encodedBytesUncompr, 0);
   client.setStats(nullptr);
 }
+
+TEST_F(HPACKCodecTests, compression_stats) {
+  vector<vector<string>> headers = {
+    {"Content-Length", "80"},
+    {"Content-Encoding", "gzip"},
+    {"X-FB-Debug", "eirtijvdgtccffkutnbttcgbfieghgev"}
+  };
+  vector<Header> resp = headersFromArray(headers);
+
+  HeaderCompressionStats aggregate;
+  HeaderCompressionStats stats(&aggregate);
+  server.setStats(&stats);
+  client.setStats(&stats);
+  for (int i = 0; i < 2; i++) {
+    unique_ptr<IOBuf> encodedResp = server.encode(resp);
+    Cursor cursor(encodedResp.get());
+    auto result = client.decode(cursor, encodedResp->computeChainDataLength());
+    EXPECT_TRUE(result.isOk());
+  }
+
+  const auto& c = stats.getCounters(HeaderCodec::Type::HPACK);
+  EXPECT_EQ(2, c.encodes);
+  EXPECT_EQ(2, c.decodes);
+  EXPECT_EQ(c.encodedCompressed, c.decodedCompressed);
+  EXPECT_GT(c.encodeRatio(), 0);
+  EXPECT_LT(c.encodeRatio(), 1);
+  // the second response finds all of its headers in the dynamic table
+  EXPECT_EQ(6, c.tableLookups);
+  EXPECT_EQ(3, c.tableHits);
+  EXPECT_EQ(0.5, c.tableHitRate());
+  EXPECT_EQ(0, c.tableEvictions);
+  EXPECT_EQ(0, stats.getCounters(HeaderCodec::Type::GZIP).encodes);
+
+  const auto& total = aggregate.getCounters(HeaderCodec::Type::HPACK);
+  EXPECT_EQ(c.encodes, total.encodes);
+  EXPECT_EQ(c.tableHits, total.tableHits);
+  EXPECT_EQ(c.encodeTime, total.encodeTime);
+
+  // a table too small for all three headers has to evict
+  stats.reset();
+  HPACKCodec small{TransportDirection::DOWNSTREAM};
+  small.setEncoderHeaderTableSize(100);
+  small.setStats(&stats);
+  small.encode(resp);
+  EXPECT_GT(stats.getCounters(HeaderCodec::Type::HPACK).tableEvictions, 0);
+  EXPECT_EQ(3, aggregate.getCounters(HeaderCodec::Type::HPACK).encodes);
+  server.setStats(nullptr);
+  client.setStats(nullptr);
+}
+
+class CollectingCallback : public HeaderCodec::StreamingCallback {
+ public:
+  void onHeader(StringPiece name, StringPiece value,
+                bool multiValued) noexcept override {
+    EXPECT_TRUE(multiValued);
+    headers.emplace_back(name.str(), value.str());
+  }
+
+  vector<pair<string, string>> headers;
+};
+
+TEST_F(HPACKCodecTests, decode_streaming) {
+  vector<vector<string>> headers = {
+    {":path", "/index.php"},
+    {":host", "www.facebook.com"},
+    {"cookie", "a=b"},
+    {"cookie", "c=d"}
+  };
+  vector<Header> req = headersFromArray(headers);
+
+  // after the first round the headers come out of the reference set
+  for (int i = 0; i < 3; i++) {
+    unique_ptr<IOBuf> encodedReq = client.encode(req);
+    Cursor cursor(encodedReq.get());
+    uint32_t len = 0;
+    if (encodedReq) {
+      len = encodedReq->computeChainDataLength();
+    }
+    CollectingCallback callback;
+    auto result = server.decodeStreaming(cursor, len, callback);
+    EXPECT_TRUE(result.isOk());
+    EXPECT_EQ(result.ok(), len);
+
+    vector<pair<string, string>> expected;
+    uint32_t uncompressed = 0;
+    for (auto& h : headers) {
+      expected.emplace_back(h[0], h[1]);
+      uncompressed += h[0].size() + h[1].size() + 2;
+    }
+    sort(expected.begin(), expected.end());
+    sort(callback.headers.begin(), callback.headers.end());
+    EXPECT_EQ(callback.headers, expected);
+    EXPECT_EQ(server.getDecodedSize().uncompressed, uncompressed);
+  }
+}
+
+TEST_F(HPACKCodecTests, headers_too_large) {
+  vector<vector<string>> headers = {
+    {":path", "/index.php"},
+    {"cookie", string(100, 'a')}
+  };
+  vector<Header> req = headersFromArray(headers);
+  unique_ptr<IOBuf> encodedReq = client.encode(req);
+  uint32_t len = encodedReq->computeChainDataLength();
+
+  // the literal is refused before it is copied
+  TestHeaderCodecStats stats;
+  server.setStats(&stats);
+  server.setMaxHeaderSize(64);
+  Cursor cursor(encodedReq.get());
+  auto result = server.decode(cursor, len);
+  EXPECT_TRUE(result.isError());
+  EXPECT_EQ(result.error(), HeaderDecodeError::HEADERS_TOO_LARGE);
+  EXPECT_EQ(stats.errors, 1);
+  server.setStats(nullptr);
+
+  // a block over the limit fails as well, though each header fits
+  HPACKCodec block(TransportDirection::DOWNSTREAM);
+  block.setMaxUncompressed(110);
+  Cursor blockCursor(encodedReq.get());
+  result = block.decode(blockCursor, len);
+  EXPECT_TRUE(result.isError());
+  EXPECT_EQ(result.error(), HeaderDecodeError::HEADERS_TOO_LARGE);
+
+  HPACKCodec fits(TransportDirection::DOWNSTREAM);
+  fits.setMaxUncompressed(200);
+  fits.setMaxHeaderSize(110);
+  Cursor fitsCursor(encodedReq.get());
+  result = fits.decode(fitsCursor, len);
+  EXPECT_TRUE(result.isOk());
+  EXPECT_EQ(result.ok().headers.size(), 4);
+}
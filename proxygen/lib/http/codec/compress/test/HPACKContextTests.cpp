@@ -85,6 +85,34 @@ TEST_F(HPACKContextTests, static_index) {
   EXPECT_EQ(context.getHeader(27), contentLength);
 }
 
+TEST_F(HPACKContextTests, static_lookup) {
+  auto& table = StaticHeaderTable::get();
+  for (uint32_t i = 1; i <= table.size(); i++) {
+    const HPACKHeader& header = table[i];
+    EXPECT_EQ(StaticHeaderTable::lookupHeader(HTTP_HEADER_OTHER, header.name,
+                                              header.value), i);
+    EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_OTHER, header.name),
+              table.nameIndex(header.name));
+    if (header.name[0] != ':') {
+      HTTPHeaderCode code = HTTPCommonHeaders::hash(header.name);
+      EXPECT_EQ(StaticHeaderTable::lookupHeader(code, header.name,
+                                                header.value), i);
+      EXPECT_EQ(StaticHeaderTable::lookupName(code, header.name),
+                table.nameIndex(header.name));
+    }
+  }
+  EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_OTHER, ":method"), 2);
+  EXPECT_EQ(StaticHeaderTable::lookupHeader(HTTP_HEADER_OTHER, ":status",
+                                            "302"), 0);
+  EXPECT_EQ(StaticHeaderTable::lookupHeader(HTTP_HEADER_CONTENT_TYPE,
+                                            "content-type", "text/html"), 0);
+  EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_OTHER, ":foo"), 0);
+  EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_OTHER, "x-foo"), 0);
+  EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_OTHER, ""), 0);
+  // the name must match exactly, like in the hash index of the table
+  EXPECT_EQ(StaticHeaderTable::lookupName(HTTP_HEADER_ACCEPT, "Accept"), 0);
+}
+
 TEST_F(HPACKContextTests, encoder_multiple_values) {
   HPACKEncoder encoder(HPACK::MessageType::RESP, true);
   vector<HPACKHeader> req;
@@ -199,3 +227,35 @@ TEST_F(HPACKContextTests, decode_errors) {
   buf->writableData()[2] = 0x80;
   checkError(buf.get(), HPACKDecoder::Error::BUFFER_OVERFLOW);
 }
+
+TEST_F(HPACKContextTests, context_update) {
+  HPACKEncoder encoder(HPACK::MessageType::REQ, true);
+  HPACKDecoder decoder(HPACK::MessageType::REQ);
+  vector<HPACKHeader> headers;
+  for (int i = 0; i < 10; i++) {
+    headers.push_back(HPACKHeader("name" + folly::to<string>(i),
+                                  "value" + folly::to<string>(i)));
+  }
+  auto buf = encoder.encode(headers);
+  auto decoded = decoder.decode(buf.get());
+  EXPECT_EQ(10, decoder.getTable().size());
+
+  // shrinking then growing again, the decoder must evict what the encoder
+  // did with the smaller size
+  encoder.setHeaderTableSize(100);
+  encoder.setHeaderTableSize(4096);
+  headers.resize(1);
+  buf = encoder.encode(headers);
+  decoded = decoder.decode(buf.get());
+  EXPECT_FALSE(decoder.hasError());
+  EXPECT_EQ(4096, decoder.getTable().capacity());
+  EXPECT_EQ(encoder.getTable(), decoder.getTable());
+  EXPECT_EQ(1, decoded->size());
+
+  // the encoder can't go beyond the size the decoder allows
+  decoder.setHeaderTableMaxSize(1024);
+  encoder.setHeaderTableSize(2048);
+  buf = encoder.encode(headers);
+  decoded = decoder.decode(buf.get());
+  EXPECT_EQ(HPACKDecoder::Error::INVALID_TABLE_SIZE, decoder.getError());
+}
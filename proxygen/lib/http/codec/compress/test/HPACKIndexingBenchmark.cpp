@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Memory.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/codec/compress/HPACKEncoder.h>
+#include <proxygen/lib/http/codec/compress/HPACKIndexingPolicy.h>
+#include <proxygen/lib/http/codec/compress/test/HTTPArchive.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+DEFINE_string(har_file, "",
+              "HAR file whose requests are encoded, like a single connection");
+
+namespace {
+
+class IndexEverythingPolicy : public HPACKIndexingPolicy {
+ public:
+  bool shouldIndex(const HPACKHeader& header) override {
+    return true;
+  }
+};
+
+const vector<vector<HPACKHeader>>& requests() {
+  static unique_ptr<HTTPArchive> har;
+  if (!har) {
+    CHECK(!FLAGS_har_file.empty()) << "--har_file is required";
+    har = HTTPArchive::fromFile(FLAGS_har_file);
+    CHECK(har) << "failed to load " << FLAGS_har_file;
+  }
+  return har->requests;
+}
+
+/**
+ * Encode all the requests with a fresh encoder using the given policy
+ *
+ * @return compressed bytes
+ */
+template <class Policy>
+uint64_t encodeRequests() {
+  HPACKEncoder encoder(HPACK::MessageType::REQ, true);
+  encoder.setIndexingPolicy(folly::make_unique<Policy>());
+  uint64_t compressed = 0;
+  for (const auto& req : requests()) {
+    auto encoded = encoder.encode(req);
+    if (encoded) {
+      compressed += encoded->computeChainDataLength();
+    }
+  }
+  return compressed;
+}
+
+template <class Policy>
+void benchEncode(unsigned numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    doNotOptimizeAway(encodeRequests<Policy>());
+  }
+}
+
+}
+
+BENCHMARK(encode_index_everything, numIters) {
+  benchEncode<IndexEverythingPolicy>(numIters);
+}
+
+BENCHMARK_RELATIVE(encode_default_policy, numIters) {
+  benchEncode<DefaultIndexingPolicy>(numIters);
+}
+
+BENCHMARK_RELATIVE(encode_adaptive_policy, numIters) {
+  benchEncode<AdaptiveIndexingPolicy>(numIters);
+}
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  uint64_t uncompressed = 0;
+  for (const auto& req : requests()) {
+    uncompressed += HTTPArchive::getSize(req);
+  }
+  LOG(INFO) << "uncompressed=" << uncompressed
+            << " index_everything=" << encodeRequests<IndexEverythingPolicy>()
+            << " default=" << encodeRequests<DefaultIndexingPolicy>()
+            << " adaptive=" << encodeRequests<AdaptiveIndexingPolicy>();
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/codec/compress/HPACKEncoder.h>
+#include <proxygen/lib/http/codec/compress/HPACKIndexingPolicy.h>
+#include <string>
+#include <vector>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+using namespace testing;
+
+class HPACKIndexingPolicyTests : public testing::Test {
+};
+
+class NeverIndexPolicy : public HPACKIndexingPolicy {
+ public:
+  bool shouldIndex(const HPACKHeader& header) override {
+    return false;
+  }
+};
+
+TEST_F(HPACKIndexingPolicyTests, default_policy) {
+  DefaultIndexingPolicy policy;
+  EXPECT_FALSE(policy.shouldIndex(HPACKHeader(":path", "/index.php?q=42")));
+  EXPECT_FALSE(policy.shouldIndex(HPACKHeader("content-length", "512")));
+  EXPECT_TRUE(policy.shouldIndex(HPACKHeader("accept-encoding", "gzip")));
+}
+
+TEST_F(HPACKIndexingPolicyTests, encoder_uses_policy) {
+  HPACKEncoder encoder(HPACK::MessageType::REQ, true);
+  encoder.setIndexingPolicy(folly::make_unique<NeverIndexPolicy>());
+  vector<HPACKHeader> req;
+  req.push_back(HPACKHeader("accept-encoding", "gzip"));
+  req.push_back(HPACKHeader("x-custom", "value"));
+  EXPECT_NE(encoder.encode(req), nullptr);
+  EXPECT_EQ(encoder.getTable().size(), 0);
+  // nothing is in the reference set, so the headers are sent again
+  EXPECT_NE(encoder.encode(req), nullptr);
+}
+
+TEST_F(HPACKIndexingPolicyTests, adaptive_stops_indexing) {
+  AdaptiveIndexingPolicy policy(0.5, 4, 8);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(policy.shouldIndex(
+                  HPACKHeader("x-request-id", folly::to<string>(i))));
+  }
+  EXPECT_EQ(policy.getHitRate("x-request-id"), 0);
+  // only every 8th literal is indexed from now on
+  uint32_t indexed = 0;
+  for (int i = 0; i < 64; i++) {
+    if (policy.shouldIndex(
+          HPACKHeader("x-request-id", folly::to<string>(i + 4)))) {
+      indexed++;
+    }
+  }
+  EXPECT_EQ(indexed, 8);
+  EXPECT_EQ(policy.getHitRate("x-unknown"), -1);
+  // the default rules still apply
+  EXPECT_FALSE(policy.shouldIndex(HPACKHeader("content-length", "1")));
+}
+
+TEST_F(HPACKIndexingPolicyTests, adaptive_keeps_hits) {
+  AdaptiveIndexingPolicy policy(0.5, 4, 8);
+  HPACKHeader host(":host", "www.facebook.com");
+  for (int i = 0; i < 16; i++) {
+    EXPECT_TRUE(policy.shouldIndex(host));
+    policy.onHit(host);
+  }
+  EXPECT_EQ(policy.getHitRate(":host"), 1);
+}
+
+TEST_F(HPACKIndexingPolicyTests, adaptive_encoder) {
+  HPACKEncoder encoder(HPACK::MessageType::REQ, true);
+  encoder.setIndexingPolicy(
+    folly::make_unique<AdaptiveIndexingPolicy>(0.5, 4, 1000));
+  for (int i = 0; i < 32; i++) {
+    vector<HPACKHeader> req;
+    req.push_back(HPACKHeader(":host", "www.facebook.com"));
+    req.push_back(HPACKHeader("x-request-id", folly::to<string>(i)));
+    encoder.encode(req);
+  }
+  // :host and the first 4 request ids
+  EXPECT_EQ(encoder.getTable().size(), 5);
+}
@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cinttypes>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <functional>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
+#include <proxygen/lib/http/codec/compress/HPACKCodec.h>
+#include <proxygen/lib/http/codec/compress/test/HTTPArchive.h>
+#include <proxygen/lib/utils/Time.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+DEFINE_string(har_file, "",
+              "HAR file whose requests and responses are replayed, like a "
+              "single connection");
+DEFINE_string(hpack_table_sizes, "0,1024,4096,16384,65536",
+              "Comma separated HPACK dynamic table sizes to try");
+DEFINE_int32(rounds, 20, "Times the session is replayed, with fresh "
+             "codecs, for the timings");
+
+/**
+ * Replays the requests of a HAR file from a client codec to a server
+ * codec and its responses back, through GzipHeaderCodec for each SPDY
+ * version and HPACKCodec for each table size, and prints for each the
+ * bytes on the wire, the compression ratio, the encode and decode time
+ * per header block and the peak memory of the compression state.
+ */
+
+namespace {
+
+struct Report {
+  uint64_t blocks{0};
+  uint64_t uncompressed{0};
+  uint64_t compressed{0};
+  std::chrono::nanoseconds encodeTime{0};
+  std::chrono::nanoseconds decodeTime{0};
+  // of both directions
+  uint64_t peakTableBytes{0};
+};
+
+// The headers of a message, as the header codecs take them
+vector<compress::Header> toHeaders(const vector<HPACKHeader>& msg) {
+  vector<compress::Header> headers;
+  headers.reserve(msg.size());
+  for (const auto& header: msg) {
+    headers.emplace_back(header.name, header.value);
+  }
+  return headers;
+}
+
+/**
+ * Encode the messages with encoder and decode them with decoder, adding
+ * up the sizes and times in report
+ */
+void replay(const vector<vector<HPACKHeader>>& messages,
+            HeaderCodec& encoder, HeaderCodec& decoder,
+            const function<uint64_t()>& tableBytes,
+            Report& report) {
+  for (const auto& msg: messages) {
+    auto headers = toHeaders(msg);
+    auto start = getCurrentTime();
+    auto encoded = encoder.encode(headers);
+    auto encodedAt = getCurrentTime();
+    uint32_t len = encoded ? encoded->computeChainDataLength() : 0;
+    io::Cursor cursor(encoded.get());
+    auto result = decoder.decode(cursor, len);
+    auto decodedAt = getCurrentTime();
+    CHECK(result.isOk()) << "decode failed";
+
+    report.blocks++;
+    report.uncompressed += HTTPArchive::getSize(msg);
+    report.compressed += len;
+    report.encodeTime += encodedAt - start;
+    report.decodeTime += decodedAt - encodedAt;
+    report.peakTableBytes = std::max(report.peakTableBytes, tableBytes());
+  }
+}
+
+/**
+ * Replay the session FLAGS_rounds times through codecs made by
+ * makeCodec(direction); the sizes are those of one round
+ */
+template <class Codec>
+Report run(const HTTPArchive& har,
+           const function<unique_ptr<Codec>(TransportDirection)>& makeCodec,
+           const function<uint64_t(const Codec&, const Codec&)>& tableBytes) {
+  Report total;
+  for (int round = 0; round < FLAGS_rounds; round++) {
+    auto client = makeCodec(TransportDirection::UPSTREAM);
+    auto server = makeCodec(TransportDirection::DOWNSTREAM);
+    auto bytes = [&] {
+      return tableBytes(*client, *server);
+    };
+    Report report;
+    replay(har.requests, *client, *server, bytes, report);
+    replay(har.responses, *server, *client, bytes, report);
+    total.encodeTime += report.encodeTime;
+    total.decodeTime += report.decodeTime;
+    if (round == 0) {
+      total.blocks = report.blocks;
+      total.uncompressed = report.uncompressed;
+      total.compressed = report.compressed;
+      total.peakTableBytes = report.peakTableBytes;
+    }
+  }
+  total.encodeTime /= FLAGS_rounds;
+  total.decodeTime /= FLAGS_rounds;
+  return total;
+}
+
+void print(const string& name, const Report& report) {
+  auto perBlock = [&] (std::chrono::nanoseconds time) {
+    return report.blocks ? time.count() / report.blocks : 0;
+  };
+  printf("%-20s %12" PRIu64 " %12" PRIu64 " %8.3f %10" PRId64 " %10" PRId64
+         " %12" PRIu64 "\n",
+         name.c_str(), report.uncompressed, report.compressed,
+         report.uncompressed ?
+           double(report.compressed) / report.uncompressed : 0,
+         int64_t(perBlock(report.encodeTime)),
+         int64_t(perBlock(report.decodeTime)),
+         report.peakTableBytes);
+}
+
+/**
+ * What the deflate and inflate streams of a GzipHeaderCodec allocate, by
+ * the formulas of zconf.h: the codec deflates with windowBits 11 and
+ * memLevel 1, and inflates with a full window
+ */
+uint64_t zlibStateBytes() {
+  const uint64_t deflateBytes = (1 << (11 + 2)) + (1 << (1 + 9));
+  const uint64_t inflateBytes = (1 << 15) + 7 * 1024;
+  return 2 * (deflateBytes + inflateBytes);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_har_file.empty()) << "--har_file is required";
+  auto har = HTTPArchive::fromFile(FLAGS_har_file);
+  CHECK(har) << "failed to load " << FLAGS_har_file;
+
+  printf("%-20s %12s %12s %8s %10s %10s %12s\n", "codec", "bytes",
+         "wire_bytes", "ratio", "encode_ns", "decode_ns", "table_bytes");
+
+  const pair<const char*, SPDYVersion> versions[] = {
+    {"gzip_spdy2", SPDYVersion::SPDY2},
+    {"gzip_spdy3", SPDYVersion::SPDY3},
+    {"gzip_spdy3.1", SPDYVersion::SPDY3_1},
+  };
+  for (const auto& version: versions) {
+    auto spdyVersion = version.second;
+    auto report = run<GzipHeaderCodec>(
+      *har,
+      [spdyVersion] (TransportDirection) {
+        return folly::make_unique<GzipHeaderCodec>(Z_DEFAULT_COMPRESSION,
+                                                   spdyVersion);
+      },
+      [] (const GzipHeaderCodec&, const GzipHeaderCodec&) {
+        return zlibStateBytes();
+      });
+    print(version.first, report);
+  }
+
+  vector<StringPiece> tableSizes;
+  folly::split(',', FLAGS_hpack_table_sizes, tableSizes);
+  for (auto piece: tableSizes) {
+    auto tableSize = folly::to<uint32_t>(piece);
+    auto report = run<HPACKCodec>(
+      *har,
+      [tableSize] (TransportDirection direction) {
+        auto codec = folly::make_unique<HPACKCodec>(direction);
+        codec->setEncoderHeaderTableSize(tableSize);
+        codec->setDecoderHeaderTableMaxSize(tableSize);
+        return codec;
+      },
+      [] (const HPACKCodec& client, const HPACKCodec& server) {
+        return uint64_t(client.getEncoderTableBytes()) +
+          client.getDecoderTableBytes() + server.getEncoderTableBytes() +
+          server.getDecoderTableBytes();
+      });
+    print(folly::to<string>("hpack_", tableSize), report);
+  }
+  return 0;
+}
@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/Conv.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <memory>
@@ -14,6 +15,7 @@
 #include <proxygen/lib/http/codec/compress/Logging.h>
 #include <proxygen/lib/http/codec/compress/StaticHeaderTable.h>
 #include <sstream>
+#include <vector>
 
 using namespace std;
 using namespace testing;
@@ -51,11 +53,11 @@ TEST_F(HeaderTableTests, add) {
   table.add(HPACKHeader("accept-encoding", "gzip"));
   table.add(HPACKHeader("accept-encoding", "gzip"));
   table.add(HPACKHeader("accept-encoding", "gzip"));
-  EXPECT_EQ(table.names().size(), 1);
   EXPECT_EQ(table.hasName("accept-encoding"), true);
-  auto it = table.names().find("accept-encoding");
-  EXPECT_EQ(it->second.size(), 3);
+  EXPECT_EQ(table.nameCount("accept-encoding"), 3);
   EXPECT_EQ(table.nameIndex("accept-encoding"), 1);
+  EXPECT_EQ(table.getIndex(HPACKHeader("accept-encoding", "gzip")), 3);
+  EXPECT_EQ(table.hasName("accept"), false);
 }
 
 TEST_F(HeaderTableTests, evict) {
@@ -73,15 +75,17 @@ TEST_F(HeaderTableTests, evict) {
   EXPECT_EQ(table.add(accept2), true);
   // evict the first one
   EXPECT_EQ(table[1], accept2);
-  auto ilist = table.names().find("accept-encoding")->second;
-  EXPECT_EQ(ilist.size(), max);
+  EXPECT_EQ(table.nameCount("accept-encoding"), max);
+  EXPECT_EQ(table.getIndex(accept2), 1);
+  EXPECT_EQ(table.getIndex(accept), max);
   // evict all the 'accept' headers
   for (size_t i = 0; i < max - 1; i++) {
     EXPECT_EQ(table.add(accept2), true);
   }
   EXPECT_EQ(table.size(), max);
   EXPECT_EQ(table[max], accept2);
-  EXPECT_EQ(table.names().size(), 1);
+  EXPECT_EQ(table.nameCount("accept-encoding"), max);
+  EXPECT_EQ(table.getIndex(accept), 0);
   // add an entry that will cause 2 evictions
   EXPECT_EQ(table.add(accept3), true);
   EXPECT_EQ(table[1], accept3);
@@ -93,7 +97,7 @@ TEST_F(HeaderTableTests, evict) {
   HPACKHeader bigheader("user-agent", bigvalue);
   EXPECT_EQ(table.add(bigheader), false);
   EXPECT_EQ(table.size(), 0);
-  EXPECT_EQ(table.names().size(), 0);
+  EXPECT_EQ(table.hasName("accept-encoding"), false);
 }
 
 TEST_F(HeaderTableTests, set_capacity) {
@@ -112,6 +116,90 @@ TEST_F(HeaderTableTests, set_capacity) {
   EXPECT_EQ(table.bytes(), capacity / 2);
 }
 
+TEST_F(HeaderTableTests, grow_capacity) {
+  HeaderTable table(200);
+  for (uint32_t i = 0; i < 3; i++) {
+    EXPECT_TRUE(table.add(HPACKHeader(folly::to<string>("name", i), "v")));
+  }
+  table.addReference(2);
+  uint32_t length = table.length();
+
+  // the entries keep their index and references in the larger ring
+  table.setCapacity(4096);
+  EXPECT_GT(table.length(), length);
+  EXPECT_EQ(3, table.size());
+  EXPECT_EQ(HPACKHeader("name2", "v"), table[1]);
+  EXPECT_EQ(HPACKHeader("name0", "v"), table[3]);
+  EXPECT_EQ(3, table.getIndex(HPACKHeader("name0", "v")));
+  EXPECT_EQ(vector<uint32_t>({2}), table.referenceSet());
+  for (uint32_t i = 3; i < 100; i++) {
+    EXPECT_TRUE(table.add(HPACKHeader(folly::to<string>("name", i), "v")));
+  }
+  EXPECT_EQ(100, table.size());
+  EXPECT_EQ(0, table.evictions());
+
+  // and shrinking back evicts the oldest ones
+  table.setCapacity(200);
+  EXPECT_EQ(length, table.length());
+  EXPECT_EQ(5, table.size());
+  EXPECT_EQ(HPACKHeader("name99", "v"), table[1]);
+  EXPECT_EQ(95, table.evictions());
+}
+
+/*
+ * lookups through the hash indices have to agree with a linear scan while
+ * entries keep wrapping around and getting evicted
+ */
+TEST_F(HeaderTableTests, index_after_wrap) {
+  HeaderTable table(400);
+  for (uint32_t i = 0; i < 500; i++) {
+    string name = folly::to<string>("name", i % 7);
+    string value(i % 13, 'v');
+    EXPECT_TRUE(table.add(HPACKHeader(name, value)));
+
+    for (uint32_t n = 0; n < 8; n++) {
+      HPACKHeader query(folly::to<string>("name", n), string(i % 3, 'v'));
+      uint32_t index = 0;
+      uint32_t nameIndex = 0;
+      uint32_t count = 0;
+      for (uint32_t j = 1; j <= table.size(); j++) {
+        if (table[j] == query) {
+          index = j;
+        }
+        if (table[j].name == query.name) {
+          nameIndex = nameIndex ? nameIndex : j;
+          ++count;
+        }
+      }
+      EXPECT_EQ(table.getIndex(query), index);
+      EXPECT_EQ(table.nameIndex(query.name), nameIndex);
+      EXPECT_EQ(table.nameCount(query.name), count);
+    }
+  }
+}
+
+TEST_F(HeaderTableTests, reference_set_order) {
+  HeaderTable table(4096);
+  for (uint32_t i = 0; i < 5; i++) {
+    table.add(HPACKHeader("accept-encoding", folly::to<string>(i)));
+  }
+  table.addReference(4);
+  table.addReference(1);
+  table.addReference(3);
+  vector<uint32_t> expected = {1, 3, 4};
+  EXPECT_EQ(table.referenceSet(), expected);
+  // indices shift as new entries come in
+  table.add(HPACKHeader("accept-encoding", "gzip"));
+  expected = {2, 4, 5};
+  EXPECT_EQ(table.referenceSet(), expected);
+  table.removeReference(4);
+  table.clearSkippedReferences();
+  expected = {2, 5};
+  EXPECT_EQ(table.referenceSet(), expected);
+  table.clearReferenceSet();
+  EXPECT_TRUE(table.referenceSet().empty());
+}
+
 TEST_F(HeaderTableTests, comparison) {
   uint32_t capacity = 128;
   HeaderTable t1(capacity);
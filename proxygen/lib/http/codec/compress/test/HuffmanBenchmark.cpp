@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+#include <gflags/gflags.h>
+#include <proxygen/lib/http/codec/compress/Huffman.h>
+#include <proxygen/lib/http/codec/compress/test/HTTPArchive.h>
+
+using namespace folly::io;
+using namespace folly;
+using namespace proxygen::huffman;
+using namespace proxygen;
+using namespace std;
+
+DEFINE_string(har_file, "",
+              "HAR file whose header names and values are used as input");
+
+namespace {
+
+struct EncodedCorpus {
+  unique_ptr<IOBuf> data;
+  // (offset, length) of every encoded literal in data
+  vector<pair<uint32_t, uint32_t>> literals;
+};
+
+void appendLiteral(const HuffTree& tree, const string& literal,
+                   IOBufQueue& queue, EncodedCorpus& corpus) {
+  QueueAppender appender(&queue, 512);
+  appender.ensure(tree.getEncodeSize(literal));
+  uint32_t offset = queue.chainLength();
+  uint32_t size = tree.encode(literal, appender);
+  corpus.literals.emplace_back(offset, size);
+}
+
+EncodedCorpus encodeCorpus(const HuffTree& tree, bool requests) {
+  vector<vector<HPACKHeader>> messages;
+  if (!FLAGS_har_file.empty()) {
+    auto har = HTTPArchive::fromFile(FLAGS_har_file);
+    CHECK(har) << "failed to load " << FLAGS_har_file;
+    messages = requests ? har->requests : har->responses;
+  } else {
+    // fall back to a single typical message
+    if (requests) {
+      messages.push_back({
+        HPACKHeader(":method", "GET"),
+        HPACKHeader(":path", "/index.php?id=1234567&ref=bookmarks"),
+        HPACKHeader(":host", "www.facebook.com"),
+        HPACKHeader("accept-encoding", "gzip, deflate, sdch"),
+        HPACKHeader("user-agent", "Mozilla/5.0 (Macintosh; Intel Mac OS X "
+                    "10_9_2) AppleWebKit/537.36 (KHTML, like Gecko) "
+                    "Chrome/34.0.1847.116 Safari/537.36"),
+        HPACKHeader("cookie", "datr=QgHjUoYw7mwqQyoMVtvEjdfF; c_user=100000"
+                    "9876543; xs=123%3AaBcDeFgHiJkLmN%3A2%3A1390000000")
+      });
+    } else {
+      messages.push_back({
+        HPACKHeader(":status", "200"),
+        HPACKHeader("content-type", "text/html; charset=utf-8"),
+        HPACKHeader("cache-control", "private, no-cache, no-store, "
+                    "must-revalidate"),
+        HPACKHeader("date", "Fri, 18 Apr 2014 22:01:11 GMT"),
+        HPACKHeader("expires", "Sat, 01 Jan 2000 00:00:00 GMT")
+      });
+    }
+  }
+  // concatenate everything in a single buffer, like a header block
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  EncodedCorpus corpus;
+  for (const auto& msg : messages) {
+    for (const auto& header : msg) {
+      appendLiteral(tree, header.name, queue, corpus);
+      appendLiteral(tree, header.value, queue, corpus);
+    }
+  }
+  corpus.data = queue.move();
+  if (corpus.data) {
+    corpus.data->coalesce();
+  }
+  return corpus;
+}
+
+template <bool stateMachine>
+void decodeCorpus(const HuffTree& tree, const EncodedCorpus& corpus,
+                  unsigned numIters) {
+  string literal;
+  for (unsigned i = 0; i < numIters; ++i) {
+    for (const auto& lit : corpus.literals) {
+      const uint8_t* data = corpus.data->data() + lit.first;
+      literal.clear();
+      if (stateMachine) {
+        tree.decode(data, lit.second, literal);
+      } else {
+        tree.decodeWithTree(data, lit.second, literal);
+      }
+      doNotOptimizeAway(literal.size());
+    }
+  }
+}
+
+const EncodedCorpus& requestCorpus() {
+  static const EncodedCorpus corpus = encodeCorpus(reqHuffTree05(), true);
+  return corpus;
+}
+
+const EncodedCorpus& responseCorpus() {
+  static const EncodedCorpus corpus = encodeCorpus(respHuffTree05(), false);
+  return corpus;
+}
+
+}
+
+BENCHMARK(tree_decode_requests, numIters) {
+  decodeCorpus<false>(reqHuffTree05(), requestCorpus(), numIters);
+}
+
+BENCHMARK_RELATIVE(state_machine_decode_requests, numIters) {
+  decodeCorpus<true>(reqHuffTree05(), requestCorpus(), numIters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(tree_decode_responses, numIters) {
+  decodeCorpus<false>(respHuffTree05(), responseCorpus(), numIters);
+}
+
+BENCHMARK_RELATIVE(state_machine_decode_responses, numIters) {
+  decodeCorpus<true>(respHuffTree05(), responseCorpus(), numIters);
+}
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -179,6 +179,68 @@ TEST_F(HuffmanTests, user_agent) {
   }
 }
 
+/*
+ * the state machine decoder has to agree with the tree based one on every
+ * valid input
+ */
+TEST_F(HuffmanTests, decode_matches_tree) {
+  for (int i = 0; i < 2; i++) {
+    const HuffTree& tree = (i == 0) ? reqHuffTree05() : respHuffTree05();
+    for (uint32_t len = 0; len < 64; len++) {
+      // cycle through all the characters, including the long codes
+      string literal;
+      for (uint32_t j = 0; j < len; j++) {
+        literal.push_back((char)((len * 31 + j * 7) & 0xFF));
+      }
+      IOBufQueue bufQueue;
+      QueueAppender appender(&bufQueue, 512);
+      appender.ensure(512);
+      uint32_t size = tree.encode(literal, appender);
+      const uint8_t* data = size ? bufQueue.front()->data() : nullptr;
+
+      string decoded;
+      string reference;
+      EXPECT_TRUE(tree.decode(data, size, decoded));
+      EXPECT_TRUE(tree.decodeWithTree(data, size, reference));
+      EXPECT_EQ(literal, decoded);
+      EXPECT_EQ(reference, decoded);
+    }
+  }
+}
+
+TEST_F(HuffmanTests, decode_appends) {
+  uint8_t buffer[1] = {1}; // "/e"
+  string literal("prefix");
+  EXPECT_TRUE(reqTree_.decode(buffer, 1, literal));
+  EXPECT_EQ(literal, "prefix/e");
+}
+
+TEST_F(HuffmanTests, decode_invalid_padding) {
+  string literal;
+  // "g" followed by padding containing a 0 bit
+  uint8_t buffer1[2] = {200, 0x7E};
+  EXPECT_FALSE(reqTree_.decode(buffer1, 2, literal));
+  EXPECT_TRUE(literal.empty());
+
+  // a full byte of padding
+  uint8_t buffer2[1] = {0xFF};
+  EXPECT_FALSE(reqTree_.decode(buffer2, 1, literal));
+  EXPECT_TRUE(literal.empty());
+}
+
+TEST_F(HuffmanTests, encode_limit) {
+  string accept("accept-encoding");
+  uint8_t buffer[32];
+  uint32_t size = reqTree_.getEncodeSize(accept);
+  EXPECT_EQ(reqTree_.encode(accept, buffer, sizeof(buffer)), size);
+  string decoded;
+  EXPECT_TRUE(reqTree_.decode(buffer, size, decoded));
+  EXPECT_EQ(accept, decoded);
+  // one byte short, in the tail and in a full 4-byte word
+  EXPECT_GT(reqTree_.encode(accept, buffer, size - 1), size - 1);
+  EXPECT_GT(reqTree_.encode(accept, buffer, 3), 3);
+}
+
 /*
  * this test is verifying the CHECK for length at the end of huffman::encode()
  */
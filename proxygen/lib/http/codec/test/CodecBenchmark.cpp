@@ -0,0 +1,681 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <folly/Benchmark.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBufQueue.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <proxygen/lib/http/codec/FlowControlFilter.h>
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/codec/HTTPChecks.h>
+#include <proxygen/lib/http/codec/SPDYCodec.h>
+#include <proxygen/lib/http/codec/SPDYUtil.h>
+#include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
+#include <proxygen/lib/http/codec/compress/HPACKCodec.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+/**
+ * ns/op of the codecs on a fixed browser-like request and its response,
+ * and, once the benchmarks ran, the heap allocations per op of each.
+ *
+ * Stateful ones (SPDY, header compression) parse or decode, in order, a
+ * corpus generated by a peer codec, and start over with fresh codecs,
+ * outside of the timing, when they reach its end.
+ */
+
+namespace {
+
+// Every malloc, including the ones of operator new and of IOBuf
+std::atomic<uint64_t> gAllocations{0};
+// the ones made by UncountedScopes
+std::atomic<uint64_t> gUncounted{0};
+
+// Leaves the allocations of a BENCHMARK_SUSPEND block out of the count
+class UncountedScope {
+ public:
+  UncountedScope(): start_(gAllocations.load()) {
+  }
+
+  ~UncountedScope() {
+    gUncounted += gAllocations.load() - start_;
+  }
+
+ private:
+  const uint64_t start_;
+};
+
+const size_t kCorpusSize = 1000;
+const size_t kDataFrameSize = 1024;
+
+const char kRequest[] =
+  "GET /static/images/logo.png?v=2 HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+  "(KHTML, like Gecko) Chrome/40.0.2214.111 Safari/537.36\r\n"
+  "Accept: image/webp,*/*;q=0.8\r\n"
+  "Accept-Encoding: gzip, deflate, sdch\r\n"
+  "Accept-Language: en-US,en;q=0.8\r\n"
+  "Referer: https://www.example.com/\r\n"
+  "Cookie: datr=1a2b3c4d5e6f7g8h9i0j; locale=en_US; c_user=100000000\r\n"
+  "Connection: keep-alive\r\n"
+  "\r\n";
+
+HTTPMessage makeRequest() {
+  HTTPMessage req = getGetRequest("/static/images/logo.png?v=2");
+  auto& headers = req.getHeaders();
+  headers.set(HTTP_HEADER_USER_AGENT,
+              "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+              "(KHTML, like Gecko) Chrome/40.0.2214.111 Safari/537.36");
+  headers.set(HTTP_HEADER_ACCEPT, "image/webp,*/*;q=0.8");
+  headers.set(HTTP_HEADER_ACCEPT_ENCODING, "gzip, deflate, sdch");
+  headers.set(HTTP_HEADER_ACCEPT_LANGUAGE, "en-US,en;q=0.8");
+  headers.set(HTTP_HEADER_REFERER, "https://www.example.com/");
+  headers.set(HTTP_HEADER_COOKIE,
+              "datr=1a2b3c4d5e6f7g8h9i0j; locale=en_US; c_user=100000000");
+  return req;
+}
+
+HTTPMessage makeResponse() {
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.setStatusMessage("OK");
+  resp.setHTTPVersion(1, 1);
+  auto& headers = resp.getHeaders();
+  headers.set(HTTP_HEADER_CONTENT_TYPE, "image/png");
+  headers.set(HTTP_HEADER_CONTENT_LENGTH, "1024");
+  headers.set(HTTP_HEADER_CACHE_CONTROL, "public, max-age=31536000");
+  headers.set(HTTP_HEADER_DATE, "Tue, 03 Mar 2015 18:00:00 GMT");
+  headers.set(HTTP_HEADER_LAST_MODIFIED, "Mon, 02 Feb 2015 12:00:00 GMT");
+  headers.set(HTTP_HEADER_ETAG, "\"5e1d-50e1b3f8c2e40\"");
+  return resp;
+}
+
+// The request headers, as the header codecs take them
+class HeaderList {
+ public:
+  HeaderList() {
+    makeRequest().getHeaders().forEach(
+      [this] (const string& name, const string& value) {
+        names_.push_back(name);
+        std::transform(name.begin(), name.end(), names_.back().begin(),
+                       ::tolower);
+        values_.push_back(value);
+      });
+    names_.push_back(":method");
+    values_.push_back("GET");
+    names_.push_back(":path");
+    values_.push_back("/static/images/logo.png?v=2");
+    names_.push_back(":scheme");
+    values_.push_back("https");
+    for (size_t i = 0; i < names_.size(); i++) {
+      headers_.emplace_back(names_[i], values_[i]);
+    }
+  }
+
+  // the codecs may reorder it
+  vector<compress::Header>& get() {
+    return headers_;
+  }
+
+ private:
+  // deques so that the headers' pointers stay valid
+  deque<string> names_;
+  deque<string> values_;
+  vector<compress::Header> headers_;
+};
+
+HeaderList& headerList() {
+  static HeaderList list;
+  return list;
+}
+
+/**
+ * Header blocks encoded in order by a fresh codec, for a fresh codec of
+ * the same kind to decode
+ */
+template <class Codec, class... Args>
+vector<unique_ptr<IOBuf>> makeHeaderCorpus(Args... args) {
+  Codec encoder(args...);
+  vector<unique_ptr<IOBuf>> corpus;
+  for (size_t i = 0; i < kCorpusSize; i++) {
+    corpus.push_back(encoder.encode(headerList().get()));
+    CHECK(corpus.back());
+  }
+  return corpus;
+}
+
+/**
+ * The SYN_STREAMs of kCorpusSize requests of a connection, one per
+ * buffer, for a downstream codec
+ */
+vector<unique_ptr<IOBuf>> makeSynStreamCorpus() {
+  SPDYCodec upstream(TransportDirection::UPSTREAM, SPDYVersion::SPDY3_1);
+  auto req = makeRequest();
+  vector<unique_ptr<IOBuf>> corpus;
+  for (size_t i = 0; i < kCorpusSize; i++) {
+    IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+    upstream.generateHeader(writeBuf, upstream.createStream(), req);
+    corpus.push_back(writeBuf.move());
+    corpus.back()->coalesce();
+  }
+  return corpus;
+}
+
+/**
+ * The SYN_REPLYs of kCorpusSize responses of a connection, one per
+ * buffer. A downstream codec rejects each as a malformed stream.
+ */
+vector<unique_ptr<IOBuf>> makeSynReplyCorpus() {
+  SPDYCodec downstream(TransportDirection::DOWNSTREAM, SPDYVersion::SPDY3_1);
+  auto resp = makeResponse();
+  vector<unique_ptr<IOBuf>> corpus;
+  for (size_t i = 0; i < kCorpusSize; i++) {
+    IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+    downstream.generateHeader(writeBuf, 2 * i + 1, resp);
+    corpus.push_back(writeBuf.move());
+    corpus.back()->coalesce();
+  }
+  return corpus;
+}
+
+template <class Codec>
+void benchEncode(unsigned iters, unique_ptr<Codec> (*makeCodec)()) {
+  unique_ptr<Codec> codec;
+  for (unsigned i = 0; i < iters; i++) {
+    if (i % kCorpusSize == 0) {
+      BENCHMARK_SUSPEND {
+        UncountedScope uncounted;
+        codec = makeCodec();
+      }
+    }
+    doNotOptimizeAway(codec->encode(headerList().get()));
+  }
+}
+
+template <class Codec>
+void benchDecode(unsigned iters,
+                 const vector<unique_ptr<IOBuf>>& corpus,
+                 unique_ptr<Codec> (*makeCodec)()) {
+  unique_ptr<Codec> codec;
+  for (unsigned i = 0; i < iters; i++) {
+    size_t index = i % corpus.size();
+    if (index == 0) {
+      BENCHMARK_SUSPEND {
+        UncountedScope uncounted;
+        codec = makeCodec();
+      }
+    }
+    io::Cursor cursor(corpus[index].get());
+    auto result = codec->decode(cursor,
+                                corpus[index]->computeChainDataLength());
+    CHECK(result.isOk());
+  }
+}
+
+unique_ptr<GzipHeaderCodec> makeGzipCodec() {
+  return folly::make_unique<GzipHeaderCodec>(Z_DEFAULT_COMPRESSION,
+                                             SPDYVersion::SPDY3_1);
+}
+
+unique_ptr<HPACKCodec> makeHPACKCodec() {
+  return folly::make_unique<HPACKCodec>(TransportDirection::DOWNSTREAM);
+}
+
+void http1xParseRequest(unsigned iters) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  FakeHTTPCodecCallback callback;
+  codec.setCallback(&callback);
+  auto buf = IOBuf::wrapBuffer(kRequest, sizeof(kRequest) - 1);
+  for (unsigned i = 0; i < iters; i++) {
+    CHECK_EQ(buf->length(), codec.onIngress(*buf));
+  }
+  CHECK_EQ(iters, callback.messageComplete);
+}
+
+void http1xGenerateRequest(unsigned iters) {
+  HTTP1xCodec codec(TransportDirection::UPSTREAM);
+  auto req = makeRequest();
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    auto stream = codec.createStream();
+    codec.generateHeader(writeBuf, stream, req);
+    codec.generateEOM(writeBuf, stream);
+    writeBuf.move();
+  }
+}
+
+void http1xGenerateResponse(unsigned iters) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  FakeHTTPCodecCallback callback;
+  codec.setCallback(&callback);
+  auto request = IOBuf::wrapBuffer(kRequest, sizeof(kRequest) - 1);
+  auto resp = makeResponse();
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    BENCHMARK_SUSPEND {
+      UncountedScope uncounted;
+      // the codec only answers requests it parsed
+      codec.onIngress(*request);
+    }
+    codec.generateHeader(writeBuf, i + 1, resp);
+    writeBuf.move();
+  }
+}
+
+void spdyParseSynStream(unsigned iters) {
+  static auto corpus = makeSynStreamCorpus();
+  unique_ptr<SPDYCodec> codec;
+  FakeHTTPCodecCallback callback;
+  for (unsigned i = 0; i < iters; i++) {
+    size_t index = i % corpus.size();
+    if (index == 0) {
+      BENCHMARK_SUSPEND {
+        UncountedScope uncounted;
+        codec = folly::make_unique<SPDYCodec>(TransportDirection::DOWNSTREAM,
+                                              SPDYVersion::SPDY3_1);
+        codec->setCallback(&callback);
+      }
+    }
+    CHECK_EQ(corpus[index]->length(), codec->onIngress(*corpus[index]));
+  }
+  CHECK_EQ(iters, callback.headersComplete);
+}
+
+void spdyParseBadSynReply(unsigned iters) {
+  static auto corpus = makeSynReplyCorpus();
+  unique_ptr<SPDYCodec> codec;
+  FakeHTTPCodecCallback callback;
+  for (unsigned i = 0; i < iters; i++) {
+    size_t index = i % corpus.size();
+    if (index == 0) {
+      BENCHMARK_SUSPEND {
+        UncountedScope uncounted;
+        codec = folly::make_unique<SPDYCodec>(TransportDirection::DOWNSTREAM,
+                                              SPDYVersion::SPDY3_1);
+        codec->setCallback(&callback);
+      }
+    }
+    CHECK_EQ(corpus[index]->length(), codec->onIngress(*corpus[index]));
+  }
+  CHECK_EQ(iters, callback.streamErrors);
+  CHECK_EQ(0u, callback.sessionErrors);
+}
+
+void spdyParseBadPing(unsigned iters) {
+  // a PING one byte too long, which fails the session
+  const uint8_t kBadPing[] = {
+    0x80, 0x03, 0x00, 0x06, 0x00, 0x00, 0x00, 0x05,
+    0x00, 0x00, 0x00, 0x01, 0x00,
+  };
+  auto buf = IOBuf::wrapBuffer(kBadPing, sizeof(kBadPing));
+  FakeHTTPCodecCallback callback;
+  for (unsigned i = 0; i < iters; i++) {
+    unique_ptr<SPDYCodec> codec;
+    BENCHMARK_SUSPEND {
+      UncountedScope uncounted;
+      codec = folly::make_unique<SPDYCodec>(TransportDirection::DOWNSTREAM,
+                                            SPDYVersion::SPDY3_1);
+      codec->setCallback(&callback);
+    }
+    CHECK_EQ(buf->length(), codec->onIngress(*buf));
+    BENCHMARK_SUSPEND {
+      UncountedScope uncounted;
+      codec.reset();
+    }
+  }
+  CHECK_EQ(iters, callback.sessionErrors);
+}
+
+void spdyGenerateSynReply(unsigned iters) {
+  unique_ptr<SPDYCodec> codec;
+  auto resp = makeResponse();
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    if (i % kCorpusSize == 0) {
+      BENCHMARK_SUSPEND {
+        UncountedScope uncounted;
+        codec = folly::make_unique<SPDYCodec>(TransportDirection::DOWNSTREAM,
+                                              SPDYVersion::SPDY3_1);
+      }
+    }
+    codec->generateHeader(writeBuf, 2 * (i % kCorpusSize) + 1, resp);
+    writeBuf.move();
+  }
+}
+
+void spdyGenerateDataFrame(unsigned iters) {
+  SPDYCodec codec(TransportDirection::DOWNSTREAM, SPDYVersion::SPDY3_1);
+  unique_ptr<IOBuf> body;
+  BENCHMARK_SUSPEND {
+    UncountedScope uncounted;
+    body = makeBuf(1024);
+  }
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    codec.generateBody(writeBuf, 1, body->clone(), false);
+    writeBuf.move();
+  }
+}
+
+class NoFlowControlCallback: public FlowControlFilter::Callback {
+ public:
+  void onConnectionSendWindowOpen() override {
+  }
+};
+
+/**
+ * A SPDY/3.1 codec behind the filters of HTTPSession, HTTPChecks and
+ * FlowControlFilter: two filters of the chain, or both in one
+ */
+class FilteredSPDYCodec {
+ public:
+  FilteredSPDYCodec(TransportDirection direction, bool composed):
+      chain_(folly::make_unique<SPDYCodec>(direction, SPDYVersion::SPDY3_1)) {
+    if (composed) {
+      auto filter = folly::make_unique<WithHTTPChecks<FlowControlFilter>>(
+        notify_, writeBuf_, chain_.call(), 0);
+      flowControl_ = filter.get();
+      chain_.addFilters(std::move(filter));
+    } else {
+      chain_.add<HTTPChecks>();
+      flowControl_ = new FlowControlFilter(notify_, writeBuf_, chain_.call(),
+                                           0);
+      chain_.addFilters(unique_ptr<FlowControlFilter>(flowControl_));
+    }
+    chain_.setCallback(&callback_);
+  }
+
+  HTTPCodecFilterChain& chain() {
+    return chain_;
+  }
+
+  FlowControlFilter& flowControl() {
+    return *flowControl_;
+  }
+
+  const FakeHTTPCodecCallback& callback() const {
+    return callback_;
+  }
+
+ private:
+  NoFlowControlCallback notify_;
+  IOBufQueue writeBuf_{IOBufQueue::cacheChainLength()};
+  FakeHTTPCodecCallback callback_;
+  HTTPCodecFilterChain chain_;
+  FlowControlFilter* flowControl_{nullptr};
+};
+
+// DATA frames for the same stream through the filters and the codec
+void spdyChainParseData(unsigned iters, bool composed) {
+  FilteredSPDYCodec codec(TransportDirection::DOWNSTREAM, composed);
+  unique_ptr<IOBuf> frame;
+  BENCHMARK_SUSPEND {
+    UncountedScope uncounted;
+    SPDYCodec upstream(TransportDirection::UPSTREAM, SPDYVersion::SPDY3_1);
+    IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+    upstream.generateBody(writeBuf, 1, makeBuf(kDataFrameSize), false);
+    frame = writeBuf.move();
+    frame->coalesce();
+  }
+  IOBufQueue acks(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    CHECK_EQ(frame->length(), codec.chain()->onIngress(*frame));
+    // as the session does once the body is read
+    if (codec.flowControl().ingressBytesProcessed(acks, kDataFrameSize)) {
+      acks.move();
+    }
+  }
+  CHECK_EQ(iters, codec.callback().bodyCalls);
+  CHECK_EQ(0, codec.callback().sessionErrors);
+}
+
+void spdyChainGenerateData(unsigned iters, bool composed) {
+  FilteredSPDYCodec codec(TransportDirection::DOWNSTREAM, composed);
+  unique_ptr<IOBuf> body;
+  BENCHMARK_SUSPEND {
+    UncountedScope uncounted;
+    body = makeBuf(kDataFrameSize);
+  }
+  IOBufQueue writeBuf(IOBufQueue::cacheChainLength());
+  for (unsigned i = 0; i < iters; i++) {
+    codec.chain()->generateBody(writeBuf, 1, body->clone(), false);
+    writeBuf.move();
+    // the WINDOW_UPDATE of the peer
+    codec.flowControl().onWindowUpdate(0, kDataFrameSize);
+  }
+}
+
+void spdyChainParseDataTwoFilters(unsigned iters) {
+  spdyChainParseData(iters, false);
+}
+
+void spdyChainParseDataComposed(unsigned iters) {
+  spdyChainParseData(iters, true);
+}
+
+void spdyChainGenerateDataTwoFilters(unsigned iters) {
+  spdyChainGenerateData(iters, false);
+}
+
+void spdyChainGenerateDataComposed(unsigned iters) {
+  spdyChainGenerateData(iters, true);
+}
+
+/**
+ * The SPDY and HTTP/2 checks of the request headers, with or without the
+ * SSE4.2 scans
+ */
+void validateHeaders(unsigned iters, bool fastScan) {
+  BENCHMARK_SUSPEND {
+    SPDYUtil::setFastScan(fastScan);
+  }
+  auto& headers = headerList().get();
+  for (unsigned i = 0; i < iters; i++) {
+    for (const auto& header: headers) {
+      folly::StringPiece name(*header.name);
+      if (name[0] == ':') {
+        name.advance(1);
+      }
+      doNotOptimizeAway(SPDYUtil::validateHeaderName(name));
+      folly::StringPiece value(*header.value);
+      doNotOptimizeAway(SPDYUtil::validateHeaderValue(value,
+                                                      SPDYUtil::STRICT));
+    }
+  }
+  BENCHMARK_SUSPEND {
+    SPDYUtil::setFastScan(true);
+  }
+}
+
+void validateHeadersScalar(unsigned iters) {
+  validateHeaders(iters, false);
+}
+
+void validateHeadersFastScan(unsigned iters) {
+  validateHeaders(iters, true);
+}
+
+void gzipEncode(unsigned iters) {
+  benchEncode<GzipHeaderCodec>(iters, makeGzipCodec);
+}
+
+void gzipDecode(unsigned iters) {
+  static auto corpus = makeHeaderCorpus<GzipHeaderCodec>(
+    Z_DEFAULT_COMPRESSION, SPDYVersion::SPDY3_1);
+  benchDecode<GzipHeaderCodec>(iters, corpus, makeGzipCodec);
+}
+
+void hpackEncode(unsigned iters) {
+  benchEncode<HPACKCodec>(iters, makeHPACKCodec);
+}
+
+void hpackDecode(unsigned iters) {
+  static auto corpus = makeHeaderCorpus<HPACKCodec>(
+    TransportDirection::UPSTREAM);
+  benchDecode<HPACKCodec>(iters, corpus, makeHPACKCodec);
+}
+
+struct Case {
+  const char* name;
+  void (*run)(unsigned);
+};
+
+const Case kCases[] = {
+  {"http1x_parse_request", http1xParseRequest},
+  {"http1x_generate_request", http1xGenerateRequest},
+  {"http1x_generate_response", http1xGenerateResponse},
+  {"spdy_parse_syn_stream", spdyParseSynStream},
+  {"spdy_parse_bad_syn_reply", spdyParseBadSynReply},
+  {"spdy_parse_bad_ping", spdyParseBadPing},
+  {"spdy_generate_syn_reply", spdyGenerateSynReply},
+  {"spdy_generate_data_frame", spdyGenerateDataFrame},
+  {"spdy_chain_parse_data_two_filters", spdyChainParseDataTwoFilters},
+  {"spdy_chain_parse_data_composed", spdyChainParseDataComposed},
+  {"spdy_chain_generate_data_two_filters", spdyChainGenerateDataTwoFilters},
+  {"spdy_chain_generate_data_composed", spdyChainGenerateDataComposed},
+  {"gzip_encode", gzipEncode},
+  {"gzip_decode", gzipDecode},
+  {"hpack_encode", hpackEncode},
+  {"hpack_decode", hpackDecode},
+};
+
+}
+
+#ifdef __GLIBC__
+// Count the allocations by interposing malloc over glibc's
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+}
+#endif
+
+BENCHMARK(http1x_parse_request, iters) {
+  http1xParseRequest(iters);
+}
+
+BENCHMARK(http1x_generate_request, iters) {
+  http1xGenerateRequest(iters);
+}
+
+BENCHMARK(http1x_generate_response, iters) {
+  http1xGenerateResponse(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(spdy_parse_syn_stream, iters) {
+  spdyParseSynStream(iters);
+}
+
+BENCHMARK(spdy_parse_bad_syn_reply, iters) {
+  spdyParseBadSynReply(iters);
+}
+
+BENCHMARK(spdy_parse_bad_ping, iters) {
+  spdyParseBadPing(iters);
+}
+
+BENCHMARK(spdy_generate_syn_reply, iters) {
+  spdyGenerateSynReply(iters);
+}
+
+BENCHMARK(spdy_generate_data_frame, iters) {
+  spdyGenerateDataFrame(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(spdy_chain_parse_data_two_filters, iters) {
+  spdyChainParseDataTwoFilters(iters);
+}
+
+BENCHMARK_RELATIVE(spdy_chain_parse_data_composed, iters) {
+  spdyChainParseDataComposed(iters);
+}
+
+BENCHMARK(spdy_chain_generate_data_two_filters, iters) {
+  spdyChainGenerateDataTwoFilters(iters);
+}
+
+BENCHMARK_RELATIVE(spdy_chain_generate_data_composed, iters) {
+  spdyChainGenerateDataComposed(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(validate_headers_scalar, iters) {
+  validateHeadersScalar(iters);
+}
+
+BENCHMARK_RELATIVE(validate_headers_fast_scan, iters) {
+  validateHeadersFastScan(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(gzip_encode, iters) {
+  gzipEncode(iters);
+}
+
+BENCHMARK(gzip_decode, iters) {
+  gzipDecode(iters);
+}
+
+BENCHMARK(hpack_encode, iters) {
+  hpackEncode(iters);
+}
+
+BENCHMARK(hpack_decode, iters) {
+  hpackDecode(iters);
+}
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+
+#ifdef __GLIBC__
+  const unsigned kIters = 10 * kCorpusSize;
+  for (const auto& benchmark: kCases) {
+    // once first, for the lazily built corpora
+    benchmark.run(1);
+    auto before = gAllocations.load() - gUncounted.load();
+    benchmark.run(kIters);
+    auto after = gAllocations.load() - gUncounted.load();
+    double perOp = double(after - before) / kIters;
+    printf("%-40s %10.2f allocs/op\n", benchmark.name, perOp);
+  }
+#endif
+  return 0;
+}
@@ -139,6 +139,27 @@ TEST_F(DefaultFlowControl, send_update) {
   filter_->ingressBytesProcessed(writeBuf_, 1);
 }
 
+TEST_F(DefaultFlowControl, update_threshold) {
+  InSequence enforceSequence;
+  EXPECT_CALL(callback_, onBody(_, _))
+    .WillRepeatedly(Return());
+  filter_->setWindowUpdateThreshold(spdy::kInitialWindow / 4);
+
+  callbackStart_->onBody(1, makeBuf(spdy::kInitialWindow / 2));
+  ASSERT_FALSE(filter_->ingressBytesProcessed(writeBuf_,
+                                              spdy::kInitialWindow / 4 - 1));
+  EXPECT_CALL(*codec_, generateWindowUpdate(_, 0, spdy::kInitialWindow / 4));
+  ASSERT_TRUE(filter_->ingressBytesProcessed(writeBuf_, 1));
+
+  // a threshold above the capacity waits for the whole window only
+  filter_->setWindowUpdateThreshold(spdy::kInitialWindow * 2);
+  callbackStart_->onBody(1, makeBuf(spdy::kInitialWindow / 4 * 3));
+  ASSERT_FALSE(filter_->ingressBytesProcessed(writeBuf_,
+                                              spdy::kInitialWindow - 1));
+  EXPECT_CALL(*codec_, generateWindowUpdate(_, 0, spdy::kInitialWindow));
+  ASSERT_TRUE(filter_->ingressBytesProcessed(writeBuf_, 1));
+}
+
 TEST_F(BigWindow, recv_too_much) {
   // Constructing the filter with a large capacity causes a WINDOW_UPDATE
   // for stream zero to be generated
@@ -219,3 +240,43 @@ TEST_F(HTTPChecksTest, recv_trace_body) {
 
   callbackStart_->onHeadersComplete(0, std::move(msg));
 }
+
+// HTTPChecks and FlowControlFilter in one filter, as in HTTPSession
+class CheckedFlowControlTest: public FilterTest {
+ public:
+  void SetUp() override {
+    EXPECT_CALL(*codec_, isReusable()).WillRepeatedly(Return(true));
+    filter_ = new WithHTTPChecks<FlowControlFilter>(flowCallback_, writeBuf_,
+                                                    codec_, 0);
+    chain_.addFilters(std::unique_ptr<FlowControlFilter>(filter_));
+  }
+  StrictMock<MockFlowControlCallback> flowCallback_;
+  FlowControlFilter* filter_;
+};
+
+TEST_F(CheckedFlowControlTest, recv_trace_body) {
+  EXPECT_CALL(callback_, onError(_, _, _))
+    .WillOnce(Invoke([] (HTTPCodec::StreamID,
+                         std::shared_ptr<HTTPException> exc,
+                         bool newTxn) {
+                       ASSERT_TRUE(newTxn);
+                       ASSERT_EQ(exc->getHttpStatusCode(), 400);
+        }));
+
+  auto msg = makePostRequest();
+  msg->setMethod("TRACE");
+
+  callbackStart_->onHeadersComplete(0, std::move(msg));
+}
+
+TEST_F(CheckedFlowControlTest, recv_too_much) {
+  InSequence enforceSequence;
+  EXPECT_CALL(callback_, onHeadersComplete(1, _));
+  EXPECT_CALL(callback_, onBody(1, _));
+  EXPECT_CALL(callback_, onError(0, IsFlowException(), _));
+
+  callbackStart_->onHeadersComplete(1, makePostRequest());
+  callbackStart_->onBody(1, makeBuf(spdy::kInitialWindow));
+  callbackStart_->onBody(1, makeBuf(1));
+  ASSERT_FALSE(chain_->isReusable());
+}
@@ -0,0 +1,251 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/codec/HQCodec.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+using namespace testing;
+
+class HQCodecTest : public testing::Test {
+ public:
+  void SetUp() override {
+    upstreamCodec_.setCallback(&upstreamCallbacks_);
+    downstreamCodec_.setCallback(&callbacks_);
+  }
+
+  // Feeds what the upstream codec wrote for stream to the downstream codec
+  void parse(HTTPCodec::StreamID stream, bool eof) {
+    auto buf = output_.move();
+    if (buf) {
+      downstreamCodec_.onStreamIngress(stream, *buf);
+    }
+    if (eof) {
+      downstreamCodec_.onStreamIngressEOF(stream);
+    }
+  }
+
+  // Feeds what the downstream codec wrote for stream to the upstream codec
+  void parseUpstream(HTTPCodec::StreamID stream, bool eof) {
+    auto buf = downstreamOutput_.move();
+    if (buf) {
+      upstreamCodec_.onStreamIngress(stream, *buf);
+    }
+    if (eof) {
+      upstreamCodec_.onStreamIngressEOF(stream);
+    }
+  }
+
+ protected:
+  HQCodec upstreamCodec_{TransportDirection::UPSTREAM};
+  HQCodec downstreamCodec_{TransportDirection::DOWNSTREAM};
+  FakeHTTPCodecCallback callbacks_;
+  FakeHTTPCodecCallback upstreamCallbacks_;
+  IOBufQueue output_{IOBufQueue::cacheChainLength()};
+  IOBufQueue downstreamOutput_{IOBufQueue::cacheChainLength()};
+};
+
+TEST_F(HQCodecTest, Varint) {
+  const vector<pair<uint64_t, size_t>> values = {
+    {0, 1}, {63, 1}, {64, 2}, {16383, 2}, {16384, 4},
+    {(1 << 30) - 1, 4}, {1 << 30, 8}, {(uint64_t(1) << 62) - 1, 8},
+  };
+  for (const auto& value: values) {
+    IOBufQueue buf{IOBufQueue::cacheChainLength()};
+    EXPECT_EQ(value.second, HQCodec::writeVarint(buf, value.first));
+    EXPECT_EQ(value.second, buf.chainLength());
+  }
+  IOBufQueue buf{IOBufQueue::cacheChainLength()};
+  HQCodec::writeVarint(buf, 15293);
+  auto bytes = buf.move();
+  bytes->coalesce();
+  EXPECT_EQ(0x7b, bytes->data()[0]);
+  EXPECT_EQ(0xbd, bytes->data()[1]);
+}
+
+TEST_F(HQCodecTest, BasicRequest) {
+  HTTPMessage req = getGetRequest("/guacamole?x=y");
+  req.getHeaders().add("user-agent", "coolio");
+  upstreamCodec_.generateHeader(output_, 4, req);
+  upstreamCodec_.generateEOM(output_, 4);
+
+  parse(4, true);
+  EXPECT_EQ(callbacks_.messageBegin, 1);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ("GET", callbacks_.msg->getMethodString());
+  EXPECT_EQ("/guacamole?x=y", callbacks_.msg->getURL());
+  const auto& headers = callbacks_.msg->getHeaders();
+  EXPECT_EQ("www.foo.com", headers.getSingleOrEmpty(HTTP_HEADER_HOST));
+  EXPECT_EQ("coolio", headers.getSingleOrEmpty(HTTP_HEADER_USER_AGENT));
+  EXPECT_EQ(4, downstreamCodec_.getLastIncomingStreamID());
+}
+
+TEST_F(HQCodecTest, ResponseWithBodyAndTrailers) {
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.setStatusMessage("OK");
+  resp.getHeaders().add("content-type", "text/plain");
+  downstreamCodec_.generateHeader(downstreamOutput_, 4, resp);
+  downstreamCodec_.generateBody(downstreamOutput_, 4,
+                                makeBuf(100), false);
+  HTTPHeaders trailers;
+  trailers.add("x-trailer", "pico");
+  downstreamCodec_.generateTrailers(downstreamOutput_, 4, trailers);
+
+  parseUpstream(4, true);
+  EXPECT_EQ(upstreamCallbacks_.messageBegin, 1);
+  EXPECT_EQ(upstreamCallbacks_.headersComplete, 1);
+  EXPECT_EQ(upstreamCallbacks_.bodyLength, 100);
+  EXPECT_EQ(upstreamCallbacks_.trailers, 1);
+  EXPECT_EQ(upstreamCallbacks_.messageComplete, 1);
+  EXPECT_EQ(upstreamCallbacks_.streamErrors, 0);
+  ASSERT_TRUE(upstreamCallbacks_.msg);
+  EXPECT_EQ(200, upstreamCallbacks_.msg->getStatusCode());
+}
+
+TEST_F(HQCodecTest, SplitIngress) {
+  HTTPMessage req = getPostRequest();
+  upstreamCodec_.generateHeader(output_, 4, req);
+  upstreamCodec_.generateBody(output_, 4, makeBuf(1000), true);
+
+  // one byte at a time, the HEADERS frame goes up only once complete
+  auto buf = output_.move();
+  buf->coalesce();
+  for (size_t i = 0; i < buf->length(); i++) {
+    auto one = IOBuf::wrapBuffer(buf->data() + i, 1);
+    downstreamCodec_.onStreamIngress(4, *one);
+  }
+  downstreamCodec_.onStreamIngressEOF(4);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.bodyLength, 1000);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+}
+
+TEST_F(HQCodecTest, IndependentStreams) {
+  // no dynamic table, so the blocks decode in any order
+  HTTPMessage req1 = getGetRequest("/first");
+  req1.getHeaders().add("x-custom", "value");
+  upstreamCodec_.generateHeader(output_, 4, req1);
+  auto first = output_.move();
+  HTTPMessage req2 = getGetRequest("/second");
+  req2.getHeaders().add("x-custom", "value");
+  upstreamCodec_.generateHeader(output_, 8, req2);
+  auto second = output_.move();
+
+  downstreamCodec_.onStreamIngress(8, *second);
+  downstreamCodec_.onStreamIngressEOF(8);
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ("/second", callbacks_.msg->getURL());
+  downstreamCodec_.onStreamIngress(4, *first);
+  downstreamCodec_.onStreamIngressEOF(4);
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ("/first", callbacks_.msg->getURL());
+  EXPECT_EQ(callbacks_.messageComplete, 2);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+  EXPECT_EQ(8, downstreamCodec_.getLastIncomingStreamID());
+}
+
+TEST_F(HQCodecTest, UnknownFrameSkipped) {
+  HTTPMessage req = getGetRequest();
+  upstreamCodec_.generateHeader(output_, 4, req);
+  HQCodec::writeVarint(output_, 0x21);
+  HQCodec::writeVarint(output_, 3);
+  output_.append("abc", 3);
+
+  parse(4, true);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.bodyCalls, 0);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+}
+
+TEST_F(HQCodecTest, DataBeforeHeaders) {
+  upstreamCodec_.generateBody(output_, 4, makeBuf(10), true);
+
+  parse(4, true);
+  EXPECT_EQ(callbacks_.headersComplete, 0);
+  EXPECT_EQ(callbacks_.bodyCalls, 0);
+  EXPECT_EQ(callbacks_.messageComplete, 0);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+  ASSERT_TRUE(callbacks_.lastParseError);
+  EXPECT_EQ(ErrorCode::PROTOCOL_ERROR,
+            callbacks_.lastParseError->getCodecStatusCode());
+}
+
+TEST_F(HQCodecTest, StreamEndsInFrame) {
+  HTTPMessage req = getPostRequest();
+  upstreamCodec_.generateHeader(output_, 4, req);
+  upstreamCodec_.generateBody(output_, 4, makeBuf(10), true);
+  output_.trimEnd(4);
+
+  parse(4, true);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.bodyLength, 6);
+  EXPECT_EQ(callbacks_.messageComplete, 0);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+}
+
+TEST_F(HQCodecTest, BadHeaderBlockFailsOnlyItsStream) {
+  HQCodec::writeVarint(output_, HQCodec::kFrameHeaders);
+  HQCodec::writeVarint(output_, 2);
+  output_.append("\xff\xff", 2);
+  parse(4, false);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  ASSERT_TRUE(callbacks_.lastParseError);
+  EXPECT_EQ(ErrorCode::COMPRESSION_ERROR,
+            callbacks_.lastParseError->getCodecStatusCode());
+
+  // the rest of the stream is dropped, the next stream is fine
+  upstreamCodec_.generateBody(output_, 4, makeBuf(10), true);
+  parse(4, true);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  HTTPMessage req = getGetRequest();
+  upstreamCodec_.generateHeader(output_, 8, req);
+  parse(8, true);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HQCodecTest, HeaderFrameTooLarge) {
+  downstreamCodec_.setMaxIngressHeaderSize(16, 16);
+  HTTPMessage req = getGetRequest();
+  req.getHeaders().add("x-big", string(100, 'a'));
+  upstreamCodec_.generateHeader(output_, 4, req);
+
+  parse(4, true);
+  EXPECT_EQ(callbacks_.headersComplete, 0);
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  ASSERT_TRUE(callbacks_.lastParseError);
+  EXPECT_EQ(ErrorCode::ENHANCE_YOUR_CALM,
+            callbacks_.lastParseError->getCodecStatusCode());
+}
+
+TEST_F(HQCodecTest, AbortDropsIngress) {
+  HTTPMessage req = getPostRequest();
+  upstreamCodec_.generateHeader(output_, 4, req);
+  parse(4, false);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  auto memory = downstreamCodec_.getMemoryUsage();
+
+  downstreamCodec_.onStreamAbort(4);
+  EXPECT_LT(downstreamCodec_.getMemoryUsage(), memory);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+}
@@ -7,10 +7,13 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/Conv.h>
 #include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
 
 using namespace proxygen;
 using namespace std;
@@ -27,6 +30,7 @@ class HTTP1xCodecCallback : public HTTPCodec::Callback {
                          std::unique_ptr<HTTPMessage> msg) {
     headersComplete++;
     headerSize = msg->getIngressHeaderSize();
+    msg_ = std::move(msg);
   }
   void onBody(HTTPCodec::StreamID stream,
               std::unique_ptr<folly::IOBuf> chain) {}
@@ -42,6 +46,7 @@ class HTTP1xCodecCallback : public HTTPCodec::Callback {
 
   uint32_t headersComplete{0};
   HTTPHeaderSize headerSize;
+  std::unique_ptr<HTTPMessage> msg_;
 };
 
 unique_ptr<folly::IOBuf> getSimpleRequestData() {
@@ -61,6 +66,139 @@ TEST(HTTP1xCodecTest, TestSimpleHeaders) {
   EXPECT_EQ(callbacks.headerSize.compressed, 0);
 }
 
+TEST(HTTP1xCodecTest, TestReleaseIdleBuffers) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  HTTP1xCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  codec.onIngress(*getSimpleRequestData());
+  codec.releaseIdleBuffers();
+  codec.onIngress(*getSimpleRequestData());
+  EXPECT_EQ(callbacks.headersComplete, 2);
+  ASSERT_TRUE(callbacks.msg_);
+  EXPECT_EQ("/yeah", callbacks.msg_->getURL());
+  EXPECT_EQ("www.facebook.com",
+            callbacks.msg_->getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST));
+}
+
+TEST(HTTP1xCodecTest, TestZeroCopyHeaderValues) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  codec.setZeroCopyHeaderValues(true);
+  HTTP1xCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  auto buffer = getSimpleRequestData();
+  codec.onIngress(*buffer);
+  EXPECT_EQ(callbacks.headersComplete, 1);
+  ASSERT_TRUE(callbacks.msg_);
+  auto& headers = callbacks.msg_->getHeaders();
+  EXPECT_TRUE(headers.hasPinnedIngress());
+  auto host = headers.getSingleOrEmptyView(HTTP_HEADER_HOST);
+  EXPECT_EQ("www.facebook.com", host);
+  EXPECT_GE(host.begin(), (const char*)buffer->data());
+  EXPECT_LE(host.end(), (const char*)buffer->tail());
+}
+
+TEST(HTTP1xCodecTest, TestRawHeaderPassthrough) {
+  HTTP1xCodec downstream(TransportDirection::DOWNSTREAM);
+  downstream.setKeepRawHeaders(true);
+  HTTP1xCodecCallback callbacks;
+  downstream.setCallback(&callbacks);
+  downstream.onIngress(*folly::IOBuf::copyBuffer(
+      "GET / HTTP/1.1\r\nhost:a\r\nx-keep:  kept\r\nX-Drop: d\r\n"
+      "x-also: y\r\n\r\n"));
+  ASSERT_TRUE(callbacks.msg_);
+  auto& msg = *callbacks.msg_;
+  EXPECT_EQ(4, msg.getRawHeaderLines().size());
+  // read as a string, so it no longer points at its line
+  EXPECT_EQ("a", msg.getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST));
+  msg.getHeaders().remove("X-Drop");
+  msg.getHeaders().add("X-New", "n");
+
+  HTTP1xCodec upstream(TransportDirection::UPSTREAM);
+  folly::IOBufQueue writeBuf(folly::IOBufQueue::cacheChainLength());
+  upstream.generateHeader(writeBuf, upstream.createStream(), msg);
+  // the lines of the untouched headers are copied as they came
+  EXPECT_EQ("GET / HTTP/1.1\r\nHost: a\r\nx-keep:  kept\r\n"
+            "x-also: y\r\nX-New: n\r\nConnection: keep-alive\r\n\r\n",
+            writeBuf.move()->moveToFbString().toStdString());
+
+  // a copy owns its values and serializes them
+  HTTPMessage copy(msg);
+  EXPECT_TRUE(copy.getRawHeaderLines().empty());
+}
+
+TEST(HTTP1xCodecTest, TestIngressChain) {
+  // split in a header name, after a value and in the body
+  const char* pieces[] = {
+    "POST / HTTP/1.1\r\nHo", "st: www.facebook.com\r\n",
+    "User-Agent: test\r\nContent-Length: 10\r\n\r\nHello", "World"};
+  unique_ptr<folly::IOBuf> chain;
+  for (const char* piece : pieces) {
+    auto buf = folly::IOBuf::copyBuffer(piece, strlen(piece));
+    if (chain) {
+      chain->prependChain(std::move(buf));
+    } else {
+      chain = std::move(buf);
+    }
+  }
+  // an empty buffer in the middle is skipped
+  chain->prev()->prependChain(folly::IOBuf::create(0));
+
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  codec.setZeroCopyHeaderValues(true);
+  codec.setCoalesceIngressBody(true);
+  FakeHTTPCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  EXPECT_EQ(codec.onIngress(*chain), chain->computeChainDataLength());
+  EXPECT_EQ(callbacks.headersComplete, 1);
+  EXPECT_EQ(callbacks.messageComplete, 1);
+  EXPECT_EQ(callbacks.bodyCalls, 1);
+  ASSERT_TRUE(callbacks.msg);
+  auto& headers = callbacks.msg->getHeaders();
+  EXPECT_EQ("www.facebook.com",
+            headers.getSingleOrEmptyView(HTTP_HEADER_HOST));
+  auto agent = headers.getSingleOrEmptyView(HTTP_HEADER_USER_AGENT);
+  EXPECT_EQ("test", agent);
+  const folly::IOBuf* third = chain->next()->next();
+  EXPECT_GE(agent.begin(), (const char*)third->data());
+  EXPECT_LE(agent.end(), (const char*)third->tail());
+  EXPECT_EQ(callbacks.data.move()->moveToFbString(), "HelloWorld");
+}
+
+TEST(HTTP1xCodecTest, TestVectorizedScanning) {
+  // Long path, query, names and values so the parser takes whole 16-byte
+  // blocks, with stop bytes placed at various offsets within a block.
+  string req("GET /some/fairly/long/path/to/a/resource.html?first=1&"
+             "second=two&third=three%20four HTTP/1.1\r\n"
+             "Host: www.facebook.com\r\n"
+             "X-Some-Really-Long-Header-Name: value that is longer than "
+             "sixteen bytes\r\n"
+             "X-Quoted: prefix \"quoted, with \\\" escape\" suffix text\r\n"
+             "Accept-Encoding: gzip, deflate, sdch\r\n"
+             "\r\n");
+  for (auto vectorized : {false, true}) {
+    HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+    codec.setVectorizedScanning(vectorized);
+    HTTP1xCodecCallback callbacks;
+    codec.setCallback(&callbacks);
+    auto buffer = folly::IOBuf::copyBuffer(req);
+    codec.onIngress(*buffer);
+    EXPECT_EQ(callbacks.headersComplete, 1);
+    ASSERT_TRUE(callbacks.msg_);
+    EXPECT_EQ("/some/fairly/long/path/to/a/resource.html",
+              callbacks.msg_->getPath());
+    EXPECT_EQ("first=1&second=two&third=three%20four",
+              callbacks.msg_->getQueryString());
+    auto& headers = callbacks.msg_->getHeaders();
+    EXPECT_EQ("value that is longer than sixteen bytes",
+              headers.getSingleOrEmpty("X-Some-Really-Long-Header-Name"));
+    EXPECT_EQ("prefix \"quoted, with \\\" escape\" suffix text",
+              headers.getSingleOrEmpty("X-Quoted"));
+    EXPECT_EQ("gzip, deflate, sdch",
+              headers.getSingleOrEmpty(HTTP_HEADER_ACCEPT_ENCODING));
+    EXPECT_EQ(callbacks.headerSize.uncompressed, req.size());
+  }
+}
+
 unique_ptr<folly::IOBuf> getChunkedRequest1st() {
   string req("GET /aha HTTP/1.1\n");
   auto buffer = folly::IOBuf::copyBuffer(req);
@@ -127,3 +265,259 @@ TEST(HTTP1xCodecTest, TestChunkedUpstream) {
   auto eomFromBuf = buf.split(buf.chainLength());
   ASSERT_EQ("5\r\nWorld\r\n0\r\n\r\n", eomFromBuf->moveToFbString());
 }
+
+TEST(HTTP1xCodecTest, TestChunkFramingInPlace) {
+  HTTP1xCodec codec(TransportDirection::UPSTREAM);
+  auto txnID = codec.createStream();
+
+  HTTPMessage msg;
+  msg.setHTTPVersion(1, 1);
+  msg.setURL("/");
+  msg.getHeaders().set("Transfer-Encoding", "chunked");
+  msg.setIsChunked(true);
+  folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+  codec.generateHeader(buf, txnID, msg, 0, nullptr);
+  buf.move();
+
+  // the length goes in the headroom and the CRLF in the tailroom
+  string data(0x1abc, 'a');
+  auto body = folly::IOBuf::create(32 + data.size() + 32);
+  body->advance(32);
+  memcpy(body->writableTail(), data.data(), data.size());
+  body->append(data.size());
+  EXPECT_EQ(codec.generateBody(buf, txnID, std::move(body), false),
+            data.size() + 8);
+  EXPECT_EQ(buf.front()->countChainElements(), 1);
+  EXPECT_EQ(buf.move()->moveToFbString(), "1abc\r\n" + data + "\r\n");
+
+  // a shared body is left alone, the framing around it is one buffer
+  auto shared = folly::IOBuf::copyBuffer("Hello");
+  codec.generateBody(buf, txnID, shared->clone(), false);
+  codec.generateBody(buf, txnID, shared->clone(), true);
+  auto out = buf.move();
+  EXPECT_EQ(out->countChainElements(), 5);
+  EXPECT_EQ(out->moveToFbString(), "5\r\nHello\r\n5\r\nHello\r\n0\r\n\r\n");
+}
+
+TEST(HTTP1xCodecTest, TestCachedHeaders) {
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  HTTP1xCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  auto buffer = getSimpleRequestData();
+  codec.onIngress(*buffer);
+
+  HTTPHeaders staticHeaders;
+  staticHeaders.add("X-Static", "1");
+  staticHeaders.add(HTTP_HEADER_CACHE_CONTROL, "no-cache");
+  HTTPMessage resp;
+  resp.setHTTPVersion(1, 1);
+  resp.setStatusCode(204);
+  resp.setStatusMessage("No Content");
+  resp.getHeaders().set(HTTP_HEADER_DATE, "Thu, 01 Jan 1970 00:00:00 GMT");
+  resp.setCachedHeaders(std::make_shared<const HTTPCachedHeaders>(
+                          std::move(staticHeaders)));
+
+  HTTPHeaderSize size;
+  folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+  codec.generateHeader(buf, 1, resp, 0, &size);
+  auto out = buf.move()->moveToFbString();
+  EXPECT_EQ(out, "HTTP/1.1 204 No Content\r\n"
+            "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n"
+            "X-Static: 1\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: keep-alive\r\n\r\n");
+  EXPECT_EQ(size.uncompressed, out.size());
+}
+
+TEST(HTTP1xCodecTest, TestStatusLines) {
+  // the precomputed status lines only stand in for the same bytes
+  auto generate = [] (uint16_t status, const std::string& reason,
+                      uint8_t minorVersion) {
+    HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+    HTTP1xCodecCallback callbacks;
+    codec.setCallback(&callbacks);
+    auto buffer = getSimpleRequestData();
+    codec.onIngress(*buffer);
+
+    HTTPMessage resp;
+    resp.setHTTPVersion(1, minorVersion);
+    resp.setStatusCode(status);
+    resp.setStatusMessage(reason);
+    resp.getHeaders().set(HTTP_HEADER_CONTENT_LENGTH, "0");
+    resp.getHeaders().set(HTTP_HEADER_DATE, "Thu, 01 Jan 1970 00:00:00 GMT");
+    resp.getHeaders().set("X-Test", "1");
+    HTTPHeaderSize size;
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    codec.generateHeader(buf, 1, resp, 0, &size);
+    auto out = buf.move()->moveToFbString().toStdString();
+    EXPECT_EQ(size.uncompressed, out.size());
+    return out.substr(0, out.find("\r\n") + 2);
+  };
+  EXPECT_EQ(generate(200, "OK", 1), "HTTP/1.1 200 OK\r\n");
+  EXPECT_EQ(generate(404, "Not Found", 1), "HTTP/1.1 404 Not Found\r\n");
+  EXPECT_EQ(generate(404, "Nope", 1), "HTTP/1.1 404 Nope\r\n");
+  EXPECT_EQ(generate(200, "", 1), "HTTP/1.1 200 \r\n");
+  EXPECT_EQ(generate(200, "OK", 0), "HTTP/1.0 200 OK\r\n");
+  EXPECT_EQ(generate(299, "Custom", 1), "HTTP/1.1 299 Custom\r\n");
+}
+
+TEST(HTTP1xCodecTest, TestCannedResponse) {
+  HTTPHeaders headers;
+  headers.add(HTTP_HEADER_CONTENT_TYPE, "text/plain");
+  auto canned = std::make_shared<const HTTPCannedResponse>(
+    200, "OK", std::move(headers), folly::IOBuf::copyBuffer("healthy"));
+
+  // the same bytes as the message would have been serialized to
+  auto generate = [&] (const HTTPMessage& msg) {
+    HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+    HTTP1xCodecCallback callbacks;
+    codec.setCallback(&callbacks);
+    auto buffer = getSimpleRequestData();
+    codec.onIngress(*buffer);
+    HTTPHeaderSize size;
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    codec.generateHeader(buf, 1, msg, 0, &size);
+    auto out = buf.move()->moveToFbString();
+    EXPECT_EQ(size.uncompressed, out.size());
+    return out;
+  };
+  HTTPMessage msg(canned->getMessage());
+  auto plain = generate(msg);
+  msg.setCannedResponse(canned);
+  auto fast = generate(msg);
+  EXPECT_EQ(plain, fast);
+  EXPECT_EQ(0, fast.find("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                         "Date: "));
+  EXPECT_NE(std::string::npos, fast.find(
+              "\r\nConnection: keep-alive\r\nContent-Length: 7\r\n\r\n"));
+
+  // changed on the way, the message is serialized as usual
+  msg.getHeaders().add("X-Filter", "1");
+  EXPECT_FALSE(canned->isUnchanged(msg));
+  EXPECT_NE(std::string::npos, generate(msg).find("X-Filter: 1\r\n"));
+}
+
+TEST(HTTP1xCodecTest, TestCoalesceIngressBody) {
+  string req("POST / HTTP/1.1\r\nHost: www.facebook.com\r\n"
+             "Transfer-Encoding: chunked\r\n\r\n"
+             "5\r\nHello\r\n1\r\n \r\n5\r\nWorld\r\n0\r\n\r\n");
+  for (bool coalesce : {false, true}) {
+    HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+    codec.setCoalesceIngressBody(coalesce);
+    FakeHTTPCodecCallback callbacks;
+    codec.setCallback(&callbacks);
+    auto buffer = folly::IOBuf::copyBuffer(req);
+    codec.onIngress(*buffer);
+    EXPECT_EQ(callbacks.messageComplete, 1);
+    EXPECT_EQ(callbacks.bodyCalls, coalesce ? 1 : 3);
+    EXPECT_EQ(callbacks.chunkHeaders, coalesce ? 0 : 3);
+    EXPECT_EQ(callbacks.chunkComplete, coalesce ? 0 : 3);
+    EXPECT_EQ(callbacks.data.move()->moveToFbString(), "Hello World");
+  }
+
+  // the body of each read goes up as it is parsed
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  codec.setCoalesceIngressBody(true);
+  FakeHTTPCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  size_t split = req.find("1\r\n ");
+  auto first = folly::IOBuf::copyBuffer(req.substr(0, split));
+  codec.onIngress(*first);
+  EXPECT_EQ(callbacks.bodyCalls, 1);
+  EXPECT_EQ(callbacks.bodyLength, 5);
+  auto second = folly::IOBuf::copyBuffer(req.substr(split));
+  codec.onIngress(*second);
+  EXPECT_EQ(callbacks.bodyCalls, 2);
+  EXPECT_EQ(callbacks.bodyLength, 11);
+  EXPECT_EQ(callbacks.messageComplete, 1);
+}
+
+TEST(HTTP1xCodecTest, TestPipelining) {
+  string reqs("GET /first HTTP/1.1\r\nHost: www.facebook.com\r\n\r\n"
+              "GET /last HTTP/1.1\r\nHost: www.facebook.com\r\n"
+              "Connection: close\r\n\r\n");
+  HTTPMessage resp;
+  resp.setHTTPVersion(1, 1);
+  resp.setStatusCode(204);
+  resp.setStatusMessage("No Content");
+
+  auto generate = [&] (HTTP1xCodec& codec, HTTPCodec::StreamID txn) {
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    codec.generateHeader(buf, txn, resp);
+    codec.generateEOM(buf, txn);
+    return buf.move()->moveToFbString();
+  };
+
+  // both requests are parsed before the first response
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  codec.setPipelining(true);
+  HTTP1xCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  codec.onIngress(*folly::IOBuf::copyBuffer(reqs));
+  EXPECT_EQ(callbacks.headersComplete, 2);
+  // no more requests after the last one
+  EXPECT_FALSE(codec.isReusable());
+  EXPECT_NE(std::string::npos,
+            generate(codec, 1).find("\r\nConnection: keep-alive\r\n"));
+  EXPECT_NE(std::string::npos,
+            generate(codec, 2).find("\r\nConnection: close\r\n"));
+
+  // one request at a time, the last one closes the first response too
+  HTTP1xCodec serial(TransportDirection::DOWNSTREAM);
+  HTTP1xCodecCallback serialCallbacks;
+  serial.setCallback(&serialCallbacks);
+  serial.onIngress(*folly::IOBuf::copyBuffer(reqs));
+  EXPECT_EQ(serialCallbacks.headersComplete, 2);
+  EXPECT_NE(std::string::npos,
+            generate(serial, 1).find("\r\nConnection: close\r\n"));
+}
+
+TEST(HTTP1xCodecTest, TestMaxIngressHeaderSize) {
+  // a header value over the per-header limit, delivered in two pieces
+  HTTP1xCodec codec(TransportDirection::DOWNSTREAM);
+  codec.setMaxIngressHeaderSize(1000, 40);
+  FakeHTTPCodecCallback callbacks;
+  codec.setCallback(&callbacks);
+  codec.onIngress(*folly::IOBuf::copyBuffer(
+                    "GET / HTTP/1.1\r\nHost: www.facebook.com\r\n"
+                    "Cookie: " + string(20, 'a')));
+  EXPECT_EQ(callbacks.streamErrors, 0);
+  codec.onIngress(*folly::IOBuf::copyBuffer(string(20, 'a') + "\r\n\r\n"));
+  EXPECT_EQ(callbacks.headersComplete, 0);
+  EXPECT_EQ(callbacks.streamErrors, 1);
+  ASSERT_TRUE(callbacks.lastParseError);
+  EXPECT_EQ(callbacks.lastParseError->getHttpStatusCode(), 431);
+  EXPECT_EQ(callbacks.lastParseError->getProxygenError(), kErrorParseHeader);
+
+  // many small headers over the block limit
+  string req("GET / HTTP/1.1\r\n");
+  for (int i = 0; i < 20; i++) {
+    req += folly::to<string>("X-Header-", i, ": value\r\n");
+  }
+  HTTP1xCodec block(TransportDirection::DOWNSTREAM);
+  block.setMaxIngressHeaderSize(200, 40);
+  FakeHTTPCodecCallback blockCallbacks;
+  block.setCallback(&blockCallbacks);
+  block.onIngress(*folly::IOBuf::copyBuffer(req + "\r\n"));
+  EXPECT_EQ(blockCallbacks.headersComplete, 0);
+  EXPECT_EQ(blockCallbacks.streamErrors, 1);
+
+  // both limits are per message
+  HTTP1xCodec fits(TransportDirection::DOWNSTREAM);
+  fits.setMaxIngressHeaderSize(1000, 40);
+  FakeHTTPCodecCallback fitsCallbacks;
+  fits.setCallback(&fitsCallbacks);
+  fits.onIngress(*folly::IOBuf::copyBuffer(req + "\r\n" + req + "\r\n"));
+  EXPECT_EQ(fitsCallbacks.headersComplete, 2);
+  EXPECT_EQ(fitsCallbacks.streamErrors, 0);
+}
+
+TEST(HTTP1xCodecTest, TestFromThreadSlabs) {
+  // the codecs of the connections come and go with them, without malloc
+  auto& slab = IOBufSlab::get();
+  size_t used = slab.getUsedBytes();
+  auto codec = folly::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM);
+  EXPECT_LT(used, slab.getUsedBytes());
+  codec.reset();
+  EXPECT_EQ(used, slab.getUsedBytes());
+}
@@ -0,0 +1,481 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPHeaderSize.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+#include <proxygen/lib/http/codec/HTTP2Framer.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+using namespace testing;
+
+class HTTP2CodecTest : public testing::Test {
+ public:
+  void SetUp() override {
+    upstreamCodec_.setCallback(&upstreamCallbacks_);
+    downstreamCodec_.setCallback(&callbacks_);
+    // the client preface, and the SETTINGS each side must start with
+    upstreamCodec_.generateConnectionPreface(output_);
+    upstreamCodec_.generateSettings(output_);
+    downstreamCodec_.generateSettings(downstreamOutput_);
+  }
+
+  // Feeds what the upstream codec wrote to the downstream codec
+  void parse() {
+    auto buf = output_.move();
+    if (buf) {
+      EXPECT_EQ(buf->computeChainDataLength(),
+                downstreamCodec_.onIngress(*buf));
+    }
+  }
+
+  // Feeds what the downstream codec wrote to the upstream codec
+  void parseUpstream() {
+    auto buf = downstreamOutput_.move();
+    if (buf) {
+      EXPECT_EQ(buf->computeChainDataLength(),
+                upstreamCodec_.onIngress(*buf));
+    }
+  }
+
+ protected:
+  HTTP2Codec upstreamCodec_{TransportDirection::UPSTREAM};
+  HTTP2Codec downstreamCodec_{TransportDirection::DOWNSTREAM};
+  FakeHTTPCodecCallback callbacks_;
+  FakeHTTPCodecCallback upstreamCallbacks_;
+  IOBufQueue output_{IOBufQueue::cacheChainLength()};
+  IOBufQueue downstreamOutput_{IOBufQueue::cacheChainLength()};
+};
+
+TEST_F(HTTP2CodecTest, BasicRequest) {
+  HTTPMessage req = getGetRequest("/guacamole?x=y");
+  req.getHeaders().add("user-agent", "coolio");
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  upstreamCodec_.generateEOM(output_, id);
+
+  parse();
+  EXPECT_EQ(callbacks_.messageBegin, 1);
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+  EXPECT_EQ(callbacks_.settings, 1);
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ("GET", callbacks_.msg->getMethodString());
+  EXPECT_EQ("/guacamole?x=y", callbacks_.msg->getURL());
+  const auto& headers = callbacks_.msg->getHeaders();
+  EXPECT_EQ("www.foo.com", headers.getSingleOrEmpty(HTTP_HEADER_HOST));
+  EXPECT_EQ("coolio", headers.getSingleOrEmpty(HTTP_HEADER_USER_AGENT));
+}
+
+TEST_F(HTTP2CodecTest, AbsoluteURL) {
+  HTTPMessage req = getGetRequest("http://www.bar.com:8080/path?q=1");
+  req.getHeaders().remove(HTTP_HEADER_HOST);
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+
+  parse();
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ("/path?q=1", callbacks_.msg->getURL());
+  EXPECT_EQ("www.bar.com:8080",
+            callbacks_.msg->getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST));
+}
+
+TEST_F(HTTP2CodecTest, ConnectionSpecificHeaders) {
+  HTTPMessage req = getGetRequest();
+  req.getHeaders().add(HTTP_HEADER_CONNECTION, "keep-alive");
+  req.getHeaders().add(HTTP_HEADER_TRANSFER_ENCODING, "chunked");
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+
+  parse();
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+  ASSERT_TRUE(callbacks_.msg);
+  const auto& headers = callbacks_.msg->getHeaders();
+  EXPECT_FALSE(headers.exists(HTTP_HEADER_CONNECTION));
+  EXPECT_FALSE(headers.exists(HTTP_HEADER_TRANSFER_ENCODING));
+}
+
+TEST_F(HTTP2CodecTest, BadPreface) {
+  output_.move();
+  output_.append("PRI * HTTP/1.1\r\n\r\nSM\r\n\r\n");
+
+  parse();
+  EXPECT_EQ(callbacks_.sessionErrors, 1);
+  EXPECT_EQ(ErrorCode::PROTOCOL_ERROR,
+            callbacks_.lastParseError->getCodecStatusCode());
+}
+
+TEST_F(HTTP2CodecTest, MissingSettings) {
+  output_.move();
+  upstreamCodec_.generateConnectionPreface(output_);
+  upstreamCodec_.generatePingRequest(output_);
+
+  parse();
+  EXPECT_EQ(callbacks_.recvPingRequest, 0);
+  EXPECT_EQ(callbacks_.sessionErrors, 1);
+}
+
+TEST_F(HTTP2CodecTest, PartialFrames) {
+  HTTPMessage req = getPostRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  upstreamCodec_.generateBody(output_, id, makeBuf(200), true);
+
+  auto buf = output_.move();
+  buf->coalesce();
+  size_t unconsumed = proxygen::parse(&downstreamCodec_, buf->data(),
+                                      buf->length(), -1);
+  EXPECT_EQ(unconsumed, 0);
+  EXPECT_EQ(callbacks_.messageBegin, 1);
+  EXPECT_EQ(callbacks_.bodyLength, 200);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, LargeBody) {
+  HTTPMessage req = getPostRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  // split into DATA frames of the peer's maximum frame size
+  upstreamCodec_.generateBody(output_, id,
+                              makeBuf(3 * http2::kMaxFramePayloadLengthMin),
+                              true);
+
+  parse();
+  EXPECT_EQ(callbacks_.bodyCalls, 3);
+  EXPECT_EQ(callbacks_.bodyLength, 3 * http2::kMaxFramePayloadLengthMin);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, LargeHeaders) {
+  HTTPMessage req = getGetRequest();
+  // more than fits in a frame, so CONTINUATION frames are needed
+  string value(2 * http2::kMaxFramePayloadLengthMin, 'a');
+  req.getHeaders().add("x-huge", value);
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+
+  parse();
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ(value, callbacks_.msg->getHeaders().getSingleOrEmpty("x-huge"));
+}
+
+TEST_F(HTTP2CodecTest, InterleavedContinuation) {
+  HTTPMessage req = getGetRequest();
+  req.getHeaders().add("x-huge",
+                       string(2 * http2::kMaxFramePayloadLengthMin, 'a'));
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  // cut the header block after the first frame, and send something else
+  // where its CONTINUATION should be
+  auto first = output_.split(http2::kConnectionPreface.size() +
+                             http2::kFrameHeaderSize +
+                             3 * http2::kFrameSettingSize +
+                             http2::kFrameHeaderSize +
+                             http2::kMaxFramePayloadLengthMin);
+  output_.move();
+  output_.append(std::move(first));
+  upstreamCodec_.generatePingRequest(output_);
+
+  parse();
+  EXPECT_EQ(callbacks_.messageBegin, 0);
+  EXPECT_EQ(callbacks_.sessionErrors, 1);
+}
+
+TEST_F(HTTP2CodecTest, Trailers) {
+  HTTPMessage req = getPostRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  upstreamCodec_.generateBody(output_, id, makeBuf(10), false);
+  HTTPHeaders trailers;
+  trailers.add("x-trailer", "done");
+  EXPECT_EQ(0, upstreamCodec_.generateTrailers(output_, id, trailers));
+  upstreamCodec_.generateEOM(output_, id);
+
+  parse();
+  EXPECT_EQ(callbacks_.headersComplete, 1);
+  EXPECT_EQ(callbacks_.bodyLength, 10);
+  EXPECT_EQ(callbacks_.trailers, 1);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+  EXPECT_EQ(callbacks_.streamErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, Padding) {
+  HTTPMessage req = getPostRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  http2::writeData(output_, makeBuf(10), id, uint8_t(20), true);
+
+  parse();
+  EXPECT_EQ(callbacks_.bodyLength, 10);
+  EXPECT_EQ(callbacks_.paddingBytes, 21);
+  EXPECT_EQ(callbacks_.messageComplete, 1);
+}
+
+TEST_F(HTTP2CodecTest, DataOnIdleStream) {
+  upstreamCodec_.generateBody(output_, 1, makeBuf(10), true);
+
+  parse();
+  EXPECT_EQ(callbacks_.bodyCalls, 0);
+  EXPECT_EQ(callbacks_.sessionErrors, 1);
+}
+
+TEST_F(HTTP2CodecTest, Response) {
+  HTTPMessage req = getGetRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  parse();
+
+  HTTPMessage resp;
+  resp.setStatusCode(200);
+  resp.setStatusMessage("nifty-nice");
+  resp.getHeaders().add(HTTP_HEADER_CONTENT_TYPE, "x-coolio");
+  downstreamCodec_.generateHeader(downstreamOutput_, id, resp);
+  downstreamCodec_.generateBody(downstreamOutput_, id, makeBuf(100), true);
+
+  parseUpstream();
+  EXPECT_EQ(upstreamCallbacks_.messageBegin, 1);
+  EXPECT_EQ(upstreamCallbacks_.bodyLength, 100);
+  EXPECT_EQ(upstreamCallbacks_.messageComplete, 1);
+  EXPECT_EQ(upstreamCallbacks_.sessionErrors, 0);
+  ASSERT_TRUE(upstreamCallbacks_.msg);
+  EXPECT_EQ(200, upstreamCallbacks_.msg->getStatusCode());
+  const auto& headers = upstreamCallbacks_.msg->getHeaders();
+  EXPECT_EQ("x-coolio", headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE));
+  EXPECT_TRUE(headers.exists(HTTP_HEADER_DATE));
+}
+
+TEST_F(HTTP2CodecTest, Priority) {
+  HTTPMessage req = getGetRequest();
+  req.setPriority(2);
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+
+  parse();
+  ASSERT_TRUE(callbacks_.msg);
+  EXPECT_EQ(2, callbacks_.msg->getPriority());
+}
+
+TEST_F(HTTP2CodecTest, StreamDependency) {
+  HTTPMessage req = getGetRequest();
+  req.setHTTP2Priority(HTTPPriority(0, true, 200));
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  http2::writePriority(output_, id + 2, {id, false, 9});
+
+  parse();
+  ASSERT_TRUE(callbacks_.msg);
+  const auto& priority = callbacks_.msg->getHTTP2Priority();
+  ASSERT_TRUE(priority);
+  EXPECT_EQ(0, priority->streamDependency);
+  EXPECT_TRUE(priority->exclusive);
+  EXPECT_EQ(200, priority->weight);
+
+  EXPECT_EQ(1, callbacks_.priorities);
+  EXPECT_EQ(id, callbacks_.priority.streamDependency);
+  EXPECT_FALSE(callbacks_.priority.exclusive);
+  EXPECT_EQ(10, callbacks_.priority.weight);
+  EXPECT_EQ(0, callbacks_.sessionErrors);
+}
+
+TEST_F(HTTP2CodecTest, ServerPush) {
+  HTTPMessage req = getGetRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  parse();
+
+  HTTPMessage push = getGetRequest("/pushed.js");
+  auto pushId = downstreamCodec_.createStream();
+  downstreamCodec_.generateHeader(downstreamOutput_, pushId, push, id);
+  downstreamCodec_.generateEOM(downstreamOutput_, pushId);
+
+  parseUpstream();
+  EXPECT_EQ(upstreamCallbacks_.messageBegin, 1);
+  EXPECT_EQ(upstreamCallbacks_.assocStreamId, id);
+  EXPECT_EQ(upstreamCallbacks_.messageComplete, 1);
+  EXPECT_EQ(upstreamCallbacks_.streamErrors, 0);
+  EXPECT_EQ(upstreamCallbacks_.sessionErrors, 0);
+  ASSERT_TRUE(upstreamCallbacks_.msg);
+  EXPECT_EQ("/pushed.js", upstreamCallbacks_.msg->getURL());
+  EXPECT_EQ("www.foo.com", upstreamCallbacks_.msg->getHeaders()
+            .getSingleOrEmpty(HTTP_HEADER_HOST));
+}
+
+TEST_F(HTTP2CodecTest, PushDisabled) {
+  HTTPMessage req = getGetRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  parse();
+
+  upstreamCodec_.getEgressSettings()->setSetting(SettingsId::ENABLE_PUSH, 0);
+  HTTPMessage push = getGetRequest("/pushed.js");
+  downstreamCodec_.generateHeader(downstreamOutput_,
+                                  downstreamCodec_.createStream(), push, id);
+
+  parseUpstream();
+  EXPECT_EQ(upstreamCallbacks_.messageBegin, 0);
+  EXPECT_EQ(upstreamCallbacks_.sessionErrors, 1);
+}
+
+TEST_F(HTTP2CodecTest, Settings) {
+  upstreamCodec_.getEgressSettings()->setSetting(
+    SettingsId::INITIAL_WINDOW_SIZE, 12345);
+  upstreamCodec_.getEgressSettings()->setSetting(
+    SettingsId::MAX_CONCURRENT_STREAMS, 77);
+  upstreamCodec_.generateSettings(output_);
+  upstreamCodec_.generateSettingsAck(output_);
+
+  parse();
+  EXPECT_EQ(callbacks_.settings, 2);
+  EXPECT_EQ(callbacks_.settingsAcks, 1);
+  EXPECT_EQ(callbacks_.windowSize, 12345);
+  EXPECT_EQ(callbacks_.maxStreams, 77);
+  EXPECT_EQ(12345, downstreamCodec_.getIngressSettings()->getSetting(
+              SettingsId::INITIAL_WINDOW_SIZE, 0));
+}
+
+TEST_F(HTTP2CodecTest, HeaderTableSize) {
+  // both sides allow a larger table, which the client uses right away
+  upstreamCodec_.setHeaderTableSize(16384);
+  downstreamCodec_.setHeaderTableSize(16384);
+  EXPECT_EQ(16384, downstreamCodec_.getHeaderTableSize());
+  downstreamCodec_.generateSettings(downstreamOutput_);
+  parseUpstream();
+  // one for the initial SETTINGS, one for these
+  upstreamCodec_.generateSettingsAck(output_);
+  upstreamCodec_.generateSettingsAck(output_);
+  HTTPMessage req = getGetRequest();
+  upstreamCodec_.generateHeader(output_, upstreamCodec_.createStream(), req);
+  parse();
+  EXPECT_EQ(callbacks_.messageBegin, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+
+  // a smaller table only binds the client once it acknowledged it, until
+  // then it may still use the larger one
+  downstreamCodec_.setHeaderTableSize(0);
+  downstreamCodec_.generateSettings(downstreamOutput_);
+  upstreamCodec_.generateHeader(output_, upstreamCodec_.createStream(), req);
+  parse();
+  EXPECT_EQ(callbacks_.messageBegin, 2);
+  parseUpstream();
+  upstreamCodec_.generateSettingsAck(output_);
+  upstreamCodec_.generateHeader(output_, upstreamCodec_.createStream(), req);
+  parse();
+  EXPECT_EQ(callbacks_.settingsAcks, 3);
+  EXPECT_EQ(callbacks_.messageBegin, 3);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, BadSettings) {
+  upstreamCodec_.getEgressSettings()->setSetting(
+    SettingsId::INITIAL_WINDOW_SIZE, 0xffffffff);
+  upstreamCodec_.generateSettings(output_);
+
+  parse();
+  EXPECT_EQ(callbacks_.sessionErrors, 1);
+  EXPECT_EQ(ErrorCode::FLOW_CONTROL_ERROR,
+            callbacks_.lastParseError->getCodecStatusCode());
+}
+
+TEST_F(HTTP2CodecTest, IngressUpgrade) {
+  // INITIAL_WINDOW_SIZE=12345, as in the HTTP2-Settings of the request
+  EXPECT_TRUE(downstreamCodec_.onIngressUpgrade("AAQAADA5"));
+  EXPECT_EQ(callbacks_.settings, 0);
+  EXPECT_EQ(12345, downstreamCodec_.getIngressSettings()->getSetting(
+              SettingsId::INITIAL_WINDOW_SIZE, 0));
+  EXPECT_EQ(1, downstreamCodec_.getLastIncomingStreamID());
+
+  // the request was stream 1, the client goes on with the preface, its
+  // SETTINGS and stream 3
+  upstreamCodec_.createStream();
+  HTTPMessage req = getGetRequest();
+  upstreamCodec_.generateHeader(output_, upstreamCodec_.createStream(), req);
+  parse();
+  EXPECT_EQ(callbacks_.settings, 1);
+  EXPECT_EQ(callbacks_.messageBegin, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+  EXPECT_EQ(3, downstreamCodec_.getLastIncomingStreamID());
+}
+
+TEST_F(HTTP2CodecTest, BadIngressUpgrade) {
+  // not a whole setting
+  EXPECT_FALSE(downstreamCodec_.onIngressUpgrade("AAQAADA"));
+  // not base64url
+  EXPECT_FALSE(downstreamCodec_.onIngressUpgrade("AAQ+ADA5"));
+  // INITIAL_WINDOW_SIZE=2^31
+  EXPECT_FALSE(downstreamCodec_.onIngressUpgrade("AASAAAAA"));
+}
+
+TEST_F(HTTP2CodecTest, Ping) {
+  upstreamCodec_.generatePingRequest(output_);
+  upstreamCodec_.generatePingReply(output_, 17);
+
+  parse();
+  EXPECT_EQ(callbacks_.recvPingRequest, 1);
+  EXPECT_EQ(callbacks_.recvPingReply, 17);
+}
+
+TEST_F(HTTP2CodecTest, WindowUpdate) {
+  HTTPMessage req = getGetRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  upstreamCodec_.generateWindowUpdate(output_, 0, 10);
+  upstreamCodec_.generateWindowUpdate(output_, id, 20);
+  // not a valid stream window update
+  http2::writeWindowUpdate(output_, id, 0);
+
+  parse();
+  EXPECT_EQ(callbacks_.windowUpdateCalls, 2);
+  EXPECT_EQ(callbacks_.windowUpdates[0], vector<uint32_t>{10});
+  EXPECT_EQ(callbacks_.windowUpdates[id], vector<uint32_t>{20});
+  EXPECT_EQ(callbacks_.streamErrors, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, RstStream) {
+  HTTPMessage req = getGetRequest();
+  auto id = upstreamCodec_.createStream();
+  upstreamCodec_.generateHeader(output_, id, req);
+  upstreamCodec_.generateRstStream(output_, id, ErrorCode::CANCEL);
+
+  parse();
+  EXPECT_EQ(callbacks_.aborts, 1);
+  EXPECT_EQ(callbacks_.sessionErrors, 0);
+}
+
+TEST_F(HTTP2CodecTest, DoubleGoaway) {
+  downstreamCodec_.enableDoubleGoawayDrain();
+  downstreamCodec_.generateGoaway(downstreamOutput_,
+                                  std::numeric_limits<int32_t>::max(),
+                                  ErrorCode::NO_ERROR);
+  EXPECT_TRUE(downstreamCodec_.isWaitingToDrain());
+  EXPECT_TRUE(downstreamCodec_.isReusable());
+  downstreamCodec_.generateGoaway(downstreamOutput_, 0, ErrorCode::NO_ERROR);
+  EXPECT_FALSE(downstreamCodec_.isWaitingToDrain());
+  EXPECT_FALSE(downstreamCodec_.isReusable());
+
+  parseUpstream();
+  EXPECT_EQ(upstreamCallbacks_.goaways, 2);
+  EXPECT_FALSE(upstreamCodec_.isReusable());
+}
+
+TEST(HTTP2CodecProtocolTest, SupportsNextProtocol) {
+  EXPECT_TRUE(HTTP2Codec::supportsNextProtocol("h2"));
+  EXPECT_TRUE(HTTP2Codec::supportsNextProtocol("h2-14"));
+  EXPECT_FALSE(HTTP2Codec::supportsNextProtocol("spdy/3.1"));
+  EXPECT_FALSE(HTTP2Codec::supportsNextProtocol("http/1.1"));
+}
@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/Cursor.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/codec/HTTP2Framer.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+
+using namespace folly::io;
+using namespace folly;
+using namespace proxygen::http2;
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+// Checks the frame header and leaves the cursor at the start of the payload
+void parseHeader(Cursor& cursor, FrameType type, FrameHeader& header) {
+  parseFrameHeader(cursor, header);
+  EXPECT_EQ(type, header.type);
+  EXPECT_EQ(header.length, cursor.totalLength());
+}
+
+}
+
+TEST(HTTP2FramerTest, DataFrameZeroLength) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  auto written = writeData(queue, nullptr, 1, boost::none, true);
+  EXPECT_EQ(kFrameHeaderSize, written);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::DATA, header);
+  unique_ptr<IOBuf> data;
+  uint16_t padding = 0;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseData(cursor, header, data, padding));
+  EXPECT_EQ(0, data->computeChainDataLength());
+  EXPECT_EQ(0, padding);
+  EXPECT_EQ(END_STREAM, header.flags);
+  EXPECT_EQ(1, header.stream);
+}
+
+TEST(HTTP2FramerTest, DataFramePadded) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeData(queue, makeBuf(100), 3, uint8_t(10), false);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::DATA, header);
+  EXPECT_EQ(111, header.length);
+  unique_ptr<IOBuf> data;
+  uint16_t padding = 0;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseData(cursor, header, data, padding));
+  EXPECT_EQ(100, data->computeChainDataLength());
+  // the pad length field counts as padding
+  EXPECT_EQ(11, padding);
+  EXPECT_EQ(0, cursor.totalLength());
+}
+
+TEST(HTTP2FramerTest, DataFrameBadPadding) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeData(queue, makeBuf(10), 1, uint8_t(5), false);
+  // make the pad length larger than the frame
+  auto buf = queue.move();
+  buf->coalesce();
+  buf->writableData()[kFrameHeaderSize] = 20;
+
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::DATA, header);
+  unique_ptr<IOBuf> data;
+  uint16_t padding = 0;
+  EXPECT_EQ(ErrorCode::PROTOCOL_ERROR,
+            parseData(cursor, header, data, padding));
+}
+
+TEST(HTTP2FramerTest, HeadersWithPriority) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  PriorityUpdate priority{7, true, 200};
+  writeHeaders(queue, makeBuf(50), 5, priority, boost::none, true, true);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::HEADERS, header);
+  EXPECT_EQ(END_STREAM | END_HEADERS | PRIORITY, header.flags);
+  boost::optional<PriorityUpdate> outPriority;
+  unique_ptr<IOBuf> block;
+  EXPECT_EQ(ErrorCode::NO_ERROR,
+            parseHeaders(cursor, header, outPriority, block));
+  ASSERT_TRUE(outPriority);
+  EXPECT_EQ(7, outPriority->streamDependency);
+  EXPECT_TRUE(outPriority->exclusive);
+  EXPECT_EQ(200, outPriority->weight);
+  EXPECT_EQ(50, block->computeChainDataLength());
+}
+
+TEST(HTTP2FramerTest, Priority) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writePriority(queue, 3, {1, false, 16});
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::PRIORITY, header);
+  PriorityUpdate priority;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parsePriority(cursor, header, priority));
+  EXPECT_EQ(1, priority.streamDependency);
+  EXPECT_FALSE(priority.exclusive);
+  EXPECT_EQ(16, priority.weight);
+}
+
+TEST(HTTP2FramerTest, RstStream) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeRstStream(queue, 1, ErrorCode::CANCEL);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::RST_STREAM, header);
+  ErrorCode code = ErrorCode::NO_ERROR;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseRstStream(cursor, header, code));
+  EXPECT_EQ(ErrorCode::CANCEL, code);
+}
+
+TEST(HTTP2FramerTest, UnknownErrorCode) {
+  EXPECT_EQ(ErrorCode::INTERNAL_ERROR, toErrorCode(0xffff));
+  EXPECT_EQ(ErrorCode::REFUSED_STREAM,
+            toErrorCode(uint32_t(ErrorCode::REFUSED_STREAM)));
+}
+
+TEST(HTTP2FramerTest, Settings) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  std::deque<SettingPair> settings = {
+    {SettingsId::HEADER_TABLE_SIZE, 3},
+    {SettingsId::MAX_CONCURRENT_STREAMS, 100},
+  };
+  writeSettings(queue, settings);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::SETTINGS, header);
+  EXPECT_EQ(2 * kFrameSettingSize, header.length);
+  std::deque<SettingPair> outSettings;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseSettings(cursor, header, outSettings));
+  EXPECT_EQ(settings, outSettings);
+}
+
+TEST(HTTP2FramerTest, SettingsAck) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeSettingsAck(queue);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::SETTINGS, header);
+  EXPECT_EQ(ACK, header.flags);
+  std::deque<SettingPair> settings;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseSettings(cursor, header, settings));
+  EXPECT_TRUE(settings.empty());
+}
+
+TEST(HTTP2FramerTest, BadSettingsLength) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeSettings(queue, {{SettingsId::ENABLE_PUSH, 0}});
+  auto buf = queue.move();
+  // drop the last byte of the setting
+  buf->coalesce();
+  buf->writableData()[2] = kFrameSettingSize - 1;
+  buf->trimEnd(1);
+
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::SETTINGS, header);
+  std::deque<SettingPair> settings;
+  EXPECT_EQ(ErrorCode::FRAME_SIZE_ERROR,
+            parseSettings(cursor, header, settings));
+}
+
+TEST(HTTP2FramerTest, PushPromise) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writePushPromise(queue, 1, 2, makeBuf(20), uint8_t(3), true);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::PUSH_PROMISE, header);
+  EXPECT_EQ(1, header.stream);
+  uint32_t promised = 0;
+  unique_ptr<IOBuf> block;
+  EXPECT_EQ(ErrorCode::NO_ERROR,
+            parsePushPromise(cursor, header, promised, block));
+  EXPECT_EQ(2, promised);
+  EXPECT_EQ(20, block->computeChainDataLength());
+  EXPECT_EQ(0, cursor.totalLength());
+}
+
+TEST(HTTP2FramerTest, Ping) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writePing(queue, 0x123456789abcdefULL, true);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::PING, header);
+  EXPECT_EQ(ACK, header.flags);
+  uint64_t data = 0;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parsePing(cursor, header, data));
+  EXPECT_EQ(0x123456789abcdefULL, data);
+}
+
+TEST(HTTP2FramerTest, Goaway) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeGoaway(queue, 7, ErrorCode::ENHANCE_YOUR_CALM,
+              IOBuf::copyBuffer("debug"));
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::GOAWAY, header);
+  uint32_t lastStream = 0;
+  ErrorCode code = ErrorCode::NO_ERROR;
+  unique_ptr<IOBuf> debugData;
+  EXPECT_EQ(ErrorCode::NO_ERROR,
+            parseGoaway(cursor, header, lastStream, code, debugData));
+  EXPECT_EQ(7, lastStream);
+  EXPECT_EQ(ErrorCode::ENHANCE_YOUR_CALM, code);
+  EXPECT_EQ("debug", debugData->moveToFbString().toStdString());
+}
+
+TEST(HTTP2FramerTest, WindowUpdate) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeWindowUpdate(queue, 0, kMaxWindowUpdateSize);
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseHeader(cursor, FrameType::WINDOW_UPDATE, header);
+  uint32_t amount = 0;
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseWindowUpdate(cursor, header, amount));
+  EXPECT_EQ(kMaxWindowUpdateSize, amount);
+}
+
+TEST(HTTP2FramerTest, Continuation) {
+  IOBufQueue queue(IOBufQueue::cacheChainLength());
+  writeHeaders(queue, makeBuf(10), 1, boost::none, boost::none, false, false);
+  writeContinuation(queue, 1, true, makeBuf(30));
+
+  auto buf = queue.move();
+  Cursor cursor(buf.get());
+  FrameHeader header;
+  parseFrameHeader(cursor, header);
+  EXPECT_EQ(FrameType::HEADERS, header.type);
+  EXPECT_EQ(0, header.flags & END_HEADERS);
+  boost::optional<PriorityUpdate> priority;
+  unique_ptr<IOBuf> block;
+  EXPECT_EQ(ErrorCode::NO_ERROR,
+            parseHeaders(cursor, header, priority, block));
+  EXPECT_EQ(10, block->computeChainDataLength());
+
+  parseHeader(cursor, FrameType::CONTINUATION, header);
+  EXPECT_EQ(END_HEADERS, header.flags);
+  EXPECT_EQ(ErrorCode::NO_ERROR, parseContinuation(cursor, header, block));
+  EXPECT_EQ(30, block->computeChainDataLength());
+}
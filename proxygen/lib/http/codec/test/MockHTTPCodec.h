@@ -32,6 +32,7 @@ class MockHTTPCodec: public HTTPCodec {
   MOCK_CONST_METHOD0(closeOnEgressComplete, bool());
   MOCK_CONST_METHOD0(supportsParallelRequests, bool());
   MOCK_CONST_METHOD0(supportsPushTransactions, bool());
+  MOCK_CONST_METHOD0(supportsInformationalResponses, bool());
   MOCK_METHOD5(generateHeader, void(folly::IOBufQueue&,
                                     HTTPCodec::StreamID,
                                     const HTTPMessage&,
@@ -13,8 +13,10 @@
 #include <proxygen/lib/http/codec/SPDYCodec.h>
 #include <proxygen/lib/http/codec/SPDYConstants.h>
 #include <proxygen/lib/http/codec/SPDYVersionSettings.h>
+#include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
 #include <proxygen/lib/http/codec/test/TestUtils.h>
 #include <random>
+#include <thread>
 
 using namespace folly;
 using namespace proxygen;
@@ -504,6 +506,66 @@ TEST(SPDYCodecTest, HeaderWithManyValues) {
             kNumValues);
 }
 
+// Codecs created after others went away reuse their pooled zlib contexts,
+// which have to start over from the initial dictionary state
+TEST(SPDYCodecTest, ReusedCompressionContexts) {
+  for (unsigned i = 0; i < 3; ++i) {
+    FakeHTTPCodecCallback callbacks;
+    SPDYCodec egressCodec(TransportDirection::UPSTREAM,
+                          SPDYVersion::SPDY3);
+    SPDYCodec ingressCodec(TransportDirection::DOWNSTREAM,
+                           SPDYVersion::SPDY3);
+    ingressCodec.setCallback(&callbacks);
+
+    HTTPMessage req = getGetRequest();
+    req.getHeaders().add("X-Iteration", folly::to<string>(i));
+    for (unsigned stream = 1; stream <= 5; stream += 2) {
+      auto syn = getSynStream(egressCodec, stream, req);
+      ingressCodec.onIngress(*syn);
+      EXPECT_EQ(callbacks.sessionErrors, 0);
+      CHECK_NOTNULL(callbacks.msg.get());
+      EXPECT_EQ(callbacks.msg->getHeaders().getSingleOrEmpty("X-Iteration"),
+                folly::to<string>(i));
+    }
+    EXPECT_EQ(callbacks.headersComplete, 3);
+  }
+}
+
+// The level of the deflater changes between header blocks, which the
+// inflater of the peer follows
+TEST(SPDYCodecTest, AdaptiveHeaderCompressionLevel) {
+  GzipHeaderCodec egress(Z_DEFAULT_COMPRESSION, SPDYVersion::SPDY3);
+  GzipHeaderCodec ingress(Z_DEFAULT_COMPRESSION, SPDYVersion::SPDY3);
+  const string name("x-block");
+  for (unsigned i = 0; i < GzipHeaderCodec::kWarmupBlocks + 4; ++i) {
+    if (i < GzipHeaderCodec::kWarmupBlocks) {
+      EXPECT_EQ(1, egress.getDeflateLevel());
+    } else if (i == GzipHeaderCodec::kWarmupBlocks + 2) {
+      // short of CPU
+      GzipHeaderCodec::setThreadMaxLevel(1);
+      EXPECT_EQ(1, egress.getDeflateLevel());
+    } else {
+      GzipHeaderCodec::setThreadMaxLevel(Z_BEST_COMPRESSION);
+      EXPECT_EQ(6, egress.getDeflateLevel());
+    }
+    const string value = folly::to<string>(i);
+    vector<compress::Header> headers;
+    headers.emplace_back(name, value);
+    auto block = egress.encode(headers);
+    folly::io::Cursor cursor(block.get());
+    auto result = ingress.decode(cursor, block->computeChainDataLength());
+    ASSERT_FALSE(result.isError());
+    ASSERT_EQ(2u, result.ok().headers.size());
+    EXPECT_EQ(name, result.ok().headers[0].str);
+    EXPECT_EQ(value, result.ok().headers[1].str);
+  }
+  GzipHeaderCodec::setThreadMaxLevel(Z_BEST_COMPRESSION);
+
+  // without compression, there is no level to adapt
+  GzipHeaderCodec plain(Z_NO_COMPRESSION, SPDYVersion::SPDY3);
+  EXPECT_EQ(Z_NO_COMPRESSION, plain.getDeflateLevel());
+}
+
 TEST(SPDYCodecTest, LargeFrameEncoding) {
   const std::string kMultiValued = "X-Multi-Valued";
   const unsigned kNumValues = 1000;
@@ -1225,3 +1287,139 @@ TEST(SPDYCodecTest, ColonHeaders) {
   EXPECT_EQ(callbacks.sessionErrors, 0);
 
 }
+
+// Cached headers are serialized once and spliced into every reply, or
+// merged with the message headers when they share a name
+TEST(SPDYCodecTest, CachedHeaders) {
+  HTTPHeaders staticHeaders;
+  staticHeaders.add("X-Static", "1");
+  staticHeaders.add(HTTP_HEADER_CACHE_CONTROL, "max-age=60");
+  staticHeaders.add(HTTP_HEADER_VARY, "Accept-Encoding");
+  auto cached = std::make_shared<const HTTPCachedHeaders>(
+    std::move(staticHeaders));
+
+  for (auto version : {SPDYVersion::SPDY2, SPDYVersion::SPDY3,
+                       SPDYVersion::SPDY3_1_HPACK}) {
+    FakeHTTPCodecCallback callbacks;
+    SPDYCodec egressCodec(TransportDirection::DOWNSTREAM, version);
+    SPDYCodec ingressCodec(TransportDirection::UPSTREAM, version);
+    ingressCodec.setCallback(&callbacks);
+
+    for (unsigned stream = 1; stream <= 5; stream += 2) {
+      HTTPMessage resp;
+      resp.setStatusCode(200);
+      resp.setStatusMessage("OK");
+      resp.getHeaders().add("X-Stream", folly::to<string>(stream));
+      if (stream == 5) {
+        resp.getHeaders().add("X-Static", "2");
+      }
+      resp.setCachedHeaders(cached);
+      auto reply = getSynStream(egressCodec, stream, resp);
+      ingressCodec.onIngress(*reply);
+      EXPECT_EQ(callbacks.sessionErrors, 0);
+      EXPECT_EQ(callbacks.streamErrors, 0);
+      CHECK_NOTNULL(callbacks.msg.get());
+      const auto& headers = callbacks.msg->getHeaders();
+      EXPECT_EQ(headers.getSingleOrEmpty("X-Stream"),
+                folly::to<string>(stream));
+      EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_CACHE_CONTROL),
+                "max-age=60");
+      EXPECT_EQ(headers.getSingleOrEmpty(HTTP_HEADER_VARY),
+                "Accept-Encoding");
+      EXPECT_EQ(headers.getNumberOfValues("X-Static"), stream == 5 ? 2 : 1);
+    }
+    EXPECT_EQ(callbacks.headersComplete, 3);
+  }
+}
+
+TEST(SPDYCodecTest, SplitDataFrames) {
+  FakeHTTPCodecCallback callbacks;
+  SPDYCodec egressCodec(TransportDirection::UPSTREAM,
+                        SPDYVersion::SPDY3_1);
+  SPDYCodec ingressCodec(TransportDirection::DOWNSTREAM,
+                         SPDYVersion::SPDY3_1);
+  ingressCodec.setCallback(&callbacks);
+  const uint32_t kMaxFrame = 8192;
+  egressCodec.setMaxFrameLength(kMaxFrame);
+
+  HTTPMessage req = getPostRequest();
+  folly::IOBufQueue output(folly::IOBufQueue::cacheChainLength());
+  auto stream = egressCodec.createStream();
+  egressCodec.generateHeader(output, stream, req);
+  auto syn = output.move();
+
+  auto body = makeBuf(3 * kMaxFrame + 100);
+  const uint8_t* bodyData = body->data();
+  EXPECT_EQ(3 * kMaxFrame + 100,
+            egressCodec.generateBody(output, stream, std::move(body), true));
+  auto frames = output.move();
+  // header, data, header, data... with the data pointing into the body
+  EXPECT_EQ(8, frames->countChainElements());
+  auto current = frames->next();
+  for (unsigned i = 0; i < 4; ++i) {
+    EXPECT_EQ(bodyData + i * kMaxFrame, current->data());
+    current = current->next()->next();
+  }
+
+  ingressCodec.onIngress(*syn);
+  ingressCodec.onIngress(*frames);
+  EXPECT_EQ(callbacks.headersComplete, 1);
+  EXPECT_EQ(callbacks.bodyLength, 3 * kMaxFrame + 100);
+  EXPECT_EQ(callbacks.messageComplete, 1);
+  EXPECT_EQ(callbacks.sessionErrors, 0);
+  EXPECT_EQ(callbacks.streamErrors, 0);
+}
+
+// A control frame split across reads is consumed as it arrives, so the
+// caller never has to buffer and present it again
+TEST(SPDYCodecTest, ControlFrameAcrossReads) {
+  FakeHTTPCodecCallback callbacks;
+  SPDYCodec egressCodec(TransportDirection::UPSTREAM,
+                        SPDYVersion::SPDY3);
+  SPDYCodec ingressCodec(TransportDirection::DOWNSTREAM,
+                         SPDYVersion::SPDY3);
+  ingressCodec.setCallback(&callbacks);
+
+  HTTPMessage req = getGetRequest();
+  req.getHeaders().add("X-Padding", string(1000, 'x'));
+  auto syn = getSynStream(egressCodec, 1, req);
+  syn->coalesce();
+  const size_t len = syn->length();
+  const size_t cuts[] = {12, len / 2, len - 1, len};
+  size_t start = 0;
+  for (auto cut: cuts) {
+    auto piece = IOBuf::copyBuffer(syn->data() + start, cut - start);
+    EXPECT_EQ(cut - start, ingressCodec.onIngress(*piece));
+    start = cut;
+  }
+  EXPECT_EQ(callbacks.headersComplete, 1);
+  EXPECT_EQ(callbacks.sessionErrors, 0);
+  EXPECT_EQ(callbacks.streamErrors, 0);
+  ASSERT_NE(callbacks.msg, nullptr);
+  EXPECT_EQ(string(1000, 'x'),
+            callbacks.msg->getHeaders().getSingleOrEmpty("X-Padding"));
+}
+
+// The primed zlib contexts are shared by the process, a codec on another
+// thread starts from the same state and compresses to the same bytes
+TEST(SPDYCodecTest, SharedPrimedContexts) {
+  HTTPMessage req = getGetRequest();
+  auto encode = [&req] {
+    SPDYCodec egressCodec(TransportDirection::UPSTREAM,
+                          SPDYVersion::SPDY3);
+    return getSynStream(egressCodec, 1, req)->moveToFbString();
+  };
+  auto local = encode();
+  folly::fbstring remote;
+  std::thread thread([&] { remote = encode(); });
+  thread.join();
+  EXPECT_EQ(local, remote);
+
+  FakeHTTPCodecCallback callbacks;
+  SPDYCodec ingressCodec(TransportDirection::DOWNSTREAM,
+                         SPDYVersion::SPDY3);
+  ingressCodec.setCallback(&callbacks);
+  ingressCodec.onIngress(*folly::IOBuf::copyBuffer(remote));
+  EXPECT_EQ(callbacks.headersComplete, 1);
+  EXPECT_EQ(callbacks.sessionErrors, 0);
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/codec/SPDYUtil.h>
+#include <string>
+
+using namespace proxygen;
+using std::string;
+
+namespace {
+
+folly::ByteRange bytes(const string& str) {
+  return folly::ByteRange(reinterpret_cast<const uint8_t*>(str.data()),
+                          str.size());
+}
+
+}
+
+// The validators with and without the SSE4.2 scans, which only handle
+// whole blocks of 16 bytes: the byte under test goes at every offset of
+// strings that have blocks and a tail
+class SPDYUtilTest: public testing::TestWithParam<bool> {
+ public:
+  void SetUp() override {
+    if (SPDYUtil::setFastScan(GetParam()) != GetParam()) {
+      // no CPU support, the scalar case already covers it
+      SPDYUtil::setFastScan(false);
+    }
+  }
+
+  void TearDown() override {
+    SPDYUtil::setFastScan(true);
+  }
+
+  template <class Validator>
+  void expectAtEveryOffset(string str, char c, bool valid,
+                           Validator validator) {
+    for (size_t i = 0; i < str.size(); i++) {
+      string s = str;
+      s[i] = c;
+      EXPECT_EQ(valid, validator(bytes(s))) << "byte " << int(uint8_t(c))
+                                            << " at " << i;
+    }
+  }
+};
+
+TEST_P(SPDYUtilTest, url) {
+  const string url(40, 'a');
+  EXPECT_TRUE(SPDYUtil::validateURL(bytes(url)));
+  for (int c = 0; c < 256; c++) {
+    bool valid = c > 0x20 && c != 0x7f;
+    expectAtEveryOffset(url, char(c), valid, SPDYUtil::validateURL);
+  }
+}
+
+TEST_P(SPDYUtilTest, header_name) {
+  const string name(40, 'x');
+  EXPECT_TRUE(SPDYUtil::validateHeaderName(bytes(name)));
+  for (int c = 0; c < 256; c++) {
+    bool valid = c >= 0x80 || SPDYUtil::http_tokens[c] == c;
+    expectAtEveryOffset(name, char(c), valid, SPDYUtil::validateHeaderName);
+  }
+}
+
+TEST_P(SPDYUtilTest, header_value) {
+  const string value(40, 'v');
+  auto strict = [] (folly::ByteRange v) {
+    return SPDYUtil::validateHeaderValue(v, SPDYUtil::STRICT);
+  };
+  EXPECT_TRUE(strict(bytes(value)));
+  for (int c = 0; c < 256; c++) {
+    // CTLs, a lone \r included, are invalid
+    bool valid = c >= 0x20 && c != 0x7f;
+    expectAtEveryOffset(value, char(c), valid, strict);
+  }
+}
+
+TEST_P(SPDYUtilTest, header_value_state) {
+  auto check = [] (const string& value, SPDYUtil::CtlEscapeMode mode) {
+    return SPDYUtil::validateHeaderValue(bytes(value), mode);
+  };
+  const string pad(20, 'v');
+  // folded lines, before and after the scanned blocks
+  EXPECT_TRUE(check(pad + "\r\n  " + pad, SPDYUtil::STRICT));
+  EXPECT_TRUE(check(pad + pad + "\r\n\t", SPDYUtil::STRICT));
+  EXPECT_FALSE(check(pad + "\r\n" + pad, SPDYUtil::STRICT));
+  EXPECT_FALSE(check(pad + pad + "\r", SPDYUtil::STRICT));
+  // an escaped CTL in quotes
+  string escaped = "\"" + pad + "\\\x01" + pad + "\"";
+  EXPECT_TRUE(check(escaped, SPDYUtil::COMPLIANT));
+  EXPECT_FALSE(check(escaped, SPDYUtil::STRICT));
+  // a dangling escape
+  EXPECT_FALSE(check("\"" + pad + pad + "\\", SPDYUtil::STRICT));
+}
+
+INSTANTIATE_TEST_CASE_P(FastScan, SPDYUtilTest, testing::Values(false, true));
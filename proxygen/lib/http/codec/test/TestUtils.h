@@ -85,6 +85,9 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
     bodyLength += chain->computeChainDataLength();
     data.append(std::move(chain));
   }
+  void onPadding(HTTPCodec::StreamID stream, uint16_t bytes) override {
+    paddingBytes += bytes;
+  }
   void onChunkHeader(HTTPCodec::StreamID stream, size_t length) {
     chunkHeaders++;
   }
@@ -130,6 +133,12 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
     windowUpdates[stream].push_back(amount);
   }
 
+  void onPriority(HTTPCodec::StreamID stream,
+                  const HTTPPriority& pri) override {
+    priorities++;
+    priority = pri;
+  }
+
   void onSettings(const SettingsList& settings) override {
     this->settings++;
     for (auto& setting: settings) {
@@ -160,6 +169,7 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
     messageComplete = 0;
     bodyCalls = 0;
     bodyLength = 0;
+    paddingBytes = 0;
     chunkHeaders = 0;
     chunkComplete = 0;
     trailers = 0;
@@ -170,6 +180,8 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
     recvPingRequest = 0;
     recvPingReply = 0;
     windowUpdateCalls = 0;
+    priorities = 0;
+    priority = HTTPPriority();
     settings = 0;
     settingsAcks = 0;
     windowSize = 0;
@@ -186,6 +198,7 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
   uint32_t messageComplete{0};
   uint32_t bodyCalls{0};
   uint32_t bodyLength{0};
+  uint32_t paddingBytes{0};
   uint32_t chunkHeaders{0};
   uint32_t chunkComplete{0};
   uint32_t trailers{0};
@@ -196,6 +209,8 @@ class FakeHTTPCodecCallback : public HTTPCodec::Callback {
   uint64_t recvPingRequest{0};
   uint64_t recvPingReply{0};
   uint32_t windowUpdateCalls{0};
+  uint32_t priorities{0};
+  HTTPPriority priority;
   uint32_t settings{0};
   uint32_t settingsAcks{0};
   uint32_t windowSize{0};
@@ -0,0 +1,362 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/codec/WebSocketCodec.h>
+#include <string>
+#include <vector>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+class FakeWebSocketCallback : public WebSocketCodec::Callback {
+ public:
+  void onMessageData(WebSocketOpcode opcode, unique_ptr<IOBuf> data,
+                     bool fin) override {
+    current.append(data->clone()->moveToFbString().toStdString());
+    if (fin) {
+      opcodes.push_back(opcode);
+      messages.push_back(current);
+      current.clear();
+    }
+  }
+
+  void onPing(unique_ptr<IOBuf> data) override {
+    pings.push_back(data->moveToFbString().toStdString());
+  }
+
+  void onPong(unique_ptr<IOBuf> data) override {
+    pongs++;
+  }
+
+  void onClose(uint16_t code, string reason) override {
+    closeCode = code;
+    closeReason = reason;
+  }
+
+  void onError(uint16_t code) override {
+    errorCode = code;
+  }
+
+  string current;
+  vector<WebSocketOpcode> opcodes;
+  vector<string> messages;
+  vector<string> pings;
+  int pongs{0};
+  uint16_t closeCode{0};
+  string closeReason;
+  uint16_t errorCode{0};
+};
+
+// The frames of the examples of RFC 6455 section 5.7
+const uint8_t kMaskedHello[] = {
+  0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58
+};
+const uint8_t kUnmaskedHello[] = {
+  0x81, 0x05, 0x48, 0x65, 0x6c, 0x6c, 0x6f
+};
+
+unique_ptr<IOBuf> makeBuf(const uint8_t* data, size_t length) {
+  return IOBuf::copyBuffer(data, length);
+}
+
+}
+
+class WebSocketCodecTest : public testing::Test {
+ public:
+  void SetUp() override {
+    client_.setCallback(&clientCallback_);
+    server_.setCallback(&callback_);
+  }
+
+  // Feeds what the client wrote to the server
+  void parse() {
+    auto buf = output_.move();
+    if (buf) {
+      server_.onIngress(std::move(buf));
+    }
+  }
+
+  // Feeds what the server wrote to the client
+  void parseClient() {
+    auto buf = serverOutput_.move();
+    if (buf) {
+      client_.onIngress(std::move(buf));
+    }
+  }
+
+ protected:
+  WebSocketCodec client_{TransportDirection::UPSTREAM};
+  WebSocketCodec server_{TransportDirection::DOWNSTREAM};
+  FakeWebSocketCallback clientCallback_;
+  FakeWebSocketCallback callback_;
+  IOBufQueue output_{IOBufQueue::cacheChainLength()};
+  IOBufQueue serverOutput_{IOBufQueue::cacheChainLength()};
+};
+
+TEST(WebSocketMaskTest, MatchesBytewise) {
+  const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+  vector<uint8_t> data(100);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = uint8_t(i * 7);
+  }
+  // every alignment, offset and length around the 8 and 16 byte steps
+  for (size_t start = 0; start < 4; start++) {
+    for (uint64_t offset = 0; offset < 5; offset++) {
+      for (size_t length = 0; length + start <= 40; length++) {
+        auto masked = data;
+        applyWebSocketMask(masked.data() + start, length, mask, offset);
+        for (size_t i = 0; i < data.size(); i++) {
+          uint8_t expected = data[i];
+          if (i >= start && i < start + length) {
+            expected ^= mask[(i - start + offset) % 4];
+          }
+          ASSERT_EQ(expected, masked[i]);
+        }
+      }
+    }
+  }
+}
+
+TEST(WebSocketCodecAcceptKeyTest, RFCExample) {
+  EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=",
+            WebSocketCodec::getAcceptKey("dGhlIHNhbXBsZSBub25jZQ=="));
+}
+
+TEST_F(WebSocketCodecTest, MaskedHello) {
+  server_.onIngress(makeBuf(kMaskedHello, sizeof(kMaskedHello)));
+  ASSERT_EQ(1, callback_.messages.size());
+  EXPECT_EQ(WebSocketOpcode::TEXT, callback_.opcodes[0]);
+  EXPECT_EQ("Hello", callback_.messages[0]);
+  EXPECT_EQ(0, callback_.errorCode);
+  EXPECT_EQ(0, server_.getPendingIngressSize());
+}
+
+TEST_F(WebSocketCodecTest, MaskedHelloSplit) {
+  for (size_t i = 0; i < sizeof(kMaskedHello); i++) {
+    server_.onIngress(makeBuf(kMaskedHello + i, 1));
+  }
+  ASSERT_EQ(1, callback_.messages.size());
+  EXPECT_EQ("Hello", callback_.messages[0]);
+  EXPECT_EQ(0, callback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, UnmaskedToClient) {
+  client_.onIngress(makeBuf(kUnmaskedHello, sizeof(kUnmaskedHello)));
+  ASSERT_EQ(1, clientCallback_.messages.size());
+  EXPECT_EQ("Hello", clientCallback_.messages[0]);
+}
+
+TEST_F(WebSocketCodecTest, UnmaskedToServer) {
+  server_.onIngress(makeBuf(kUnmaskedHello, sizeof(kUnmaskedHello)));
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+  EXPECT_EQ(0, callback_.messages.size());
+}
+
+TEST_F(WebSocketCodecTest, MaskedToClient) {
+  client_.onIngress(makeBuf(kMaskedHello, sizeof(kMaskedHello)));
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, clientCallback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, RoundTrip) {
+  string big(100000, 'x');
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("hi"));
+  client_.generateMessage(output_, WebSocketOpcode::BINARY,
+                          IOBuf::copyBuffer(big));
+  parse();
+  ASSERT_EQ(2, callback_.messages.size());
+  EXPECT_EQ("hi", callback_.messages[0]);
+  EXPECT_EQ(WebSocketOpcode::BINARY, callback_.opcodes[1]);
+  EXPECT_EQ(big, callback_.messages[1]);
+
+  server_.generateMessage(serverOutput_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("there"));
+  parseClient();
+  ASSERT_EQ(1, clientCallback_.messages.size());
+  EXPECT_EQ("there", clientCallback_.messages[0]);
+}
+
+TEST_F(WebSocketCodecTest, SharedPayloadIsNotMasked) {
+  auto data = IOBuf::copyBuffer("unchanged");
+  client_.generateMessage(output_, WebSocketOpcode::TEXT, data->clone());
+  EXPECT_EQ("unchanged", data->moveToFbString().toStdString());
+  parse();
+  ASSERT_EQ(1, callback_.messages.size());
+  EXPECT_EQ("unchanged", callback_.messages[0]);
+}
+
+TEST_F(WebSocketCodecTest, FragmentedWithPing) {
+  client_.generateFrame(output_, WebSocketOpcode::TEXT,
+                        IOBuf::copyBuffer("Hel"), false);
+  client_.generatePing(output_, IOBuf::copyBuffer("ping"));
+  client_.generateFrame(output_, WebSocketOpcode::CONTINUATION,
+                        IOBuf::copyBuffer("lo"), true);
+  parse();
+  ASSERT_EQ(1, callback_.pings.size());
+  EXPECT_EQ("ping", callback_.pings[0]);
+  ASSERT_EQ(1, callback_.messages.size());
+  EXPECT_EQ(WebSocketOpcode::TEXT, callback_.opcodes[0]);
+  EXPECT_EQ("Hello", callback_.messages[0]);
+}
+
+TEST_F(WebSocketCodecTest, ContinuationWithoutMessage) {
+  client_.generateFrame(output_, WebSocketOpcode::CONTINUATION,
+                        IOBuf::copyBuffer("lo"), true);
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, NewMessageInsideMessage) {
+  client_.generateFrame(output_, WebSocketOpcode::TEXT,
+                        IOBuf::copyBuffer("Hel"), false);
+  client_.generateFrame(output_, WebSocketOpcode::TEXT,
+                        IOBuf::copyBuffer("lo"), true);
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+  EXPECT_EQ(0, callback_.messages.size());
+}
+
+TEST_F(WebSocketCodecTest, ControlFrameTooLong) {
+  // a PING claiming 126 bytes, masked with zeros
+  const uint8_t frame[] = {0x89, 0xfe, 0x00, 0x7e, 0, 0, 0, 0};
+  server_.onIngress(makeBuf(frame, sizeof(frame)));
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+  EXPECT_EQ(0, callback_.pings.size());
+}
+
+TEST_F(WebSocketCodecTest, ReservedBits) {
+  const uint8_t frame[] = {0xc1, 0x80, 0, 0, 0, 0};
+  server_.onIngress(makeBuf(frame, sizeof(frame)));
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, Close) {
+  client_.generateClose(output_, WebSocketCodec::kCloseGoingAway, "bye");
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("ignored"));
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseGoingAway, callback_.closeCode);
+  EXPECT_EQ("bye", callback_.closeReason);
+  EXPECT_EQ(0, callback_.messages.size());
+  EXPECT_EQ(0, callback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, CloseWithoutCode) {
+  client_.generateClose(output_, WebSocketCodec::kCloseNoStatus, "");
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseNoStatus, callback_.closeCode);
+  EXPECT_EQ("", callback_.closeReason);
+}
+
+TEST_F(WebSocketCodecTest, BadCloseCode) {
+  client_.generateClose(output_, 1004, "");
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+  EXPECT_EQ(0, callback_.closeCode);
+}
+
+TEST_F(WebSocketCodecTest, MessageTooBig) {
+  server_.setMaxMessageSize(10);
+  client_.generateFrame(output_, WebSocketOpcode::BINARY,
+                        IOBuf::copyBuffer("123456"), false);
+  client_.generateFrame(output_, WebSocketOpcode::CONTINUATION,
+                        IOBuf::copyBuffer("789012"), true);
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseMessageTooBig, callback_.errorCode);
+  EXPECT_EQ(0, callback_.messages.size());
+}
+
+TEST_F(WebSocketCodecTest, InflateRFCExample) {
+  client_.setDeflate(6, false);
+  // "Hello" compressed, from RFC 7692 section 7.2.3.1, sent unmasked
+  const uint8_t frame[] = {
+    0xc1, 0x07, 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00
+  };
+  client_.onIngress(makeBuf(frame, sizeof(frame)));
+  client_.onIngress(makeBuf(frame, sizeof(frame)));
+  EXPECT_EQ(0, clientCallback_.errorCode);
+  ASSERT_EQ(2, clientCallback_.messages.size());
+  EXPECT_EQ("Hello", clientCallback_.messages[0]);
+  EXPECT_EQ("Hello", clientCallback_.messages[1]);
+}
+
+TEST_F(WebSocketCodecTest, DeflateRoundTrip) {
+  for (bool noContextTakeover : {false, true}) {
+    WebSocketCodec server(TransportDirection::DOWNSTREAM);
+    FakeWebSocketCallback callback;
+    server.setCallback(&callback);
+    server.setDeflate(6, noContextTakeover);
+    client_.setDeflate(6, false);
+
+    string text;
+    for (int i = 0; i < 1000; i++) {
+      text += "all work and no play makes jack a dull boy ";
+    }
+    client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                            IOBuf::copyBuffer(text));
+    EXPECT_LT(output_.chainLength(), text.size() / 10);
+    client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                            IOBuf::copyBuffer("short"));
+    client_.generateMessage(output_, WebSocketOpcode::BINARY,
+                            IOBuf::copyBuffer(text));
+    // one byte at a time through the inflater
+    auto buf = output_.move();
+    for (auto& range : *buf) {
+      for (size_t i = 0; i < range.size(); i++) {
+        server.onIngress(makeBuf(range.data() + i, 1));
+      }
+    }
+    EXPECT_EQ(0, callback.errorCode);
+    ASSERT_EQ(3, callback.messages.size());
+    EXPECT_EQ(text, callback.messages[0]);
+    EXPECT_EQ("short", callback.messages[1]);
+    EXPECT_EQ(text, callback.messages[2]);
+  }
+}
+
+TEST_F(WebSocketCodecTest, DeflatedWithoutExtension) {
+  client_.setDeflate(6, false);
+  string text(1000, 'a');
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer(text));
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseProtocolError, callback_.errorCode);
+}
+
+TEST_F(WebSocketCodecTest, InflatedTooBig) {
+  server_.setDeflate(6, false);
+  server_.setMaxMessageSize(1000);
+  client_.setDeflate(6, false);
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer(string(100000, 'a')));
+  EXPECT_LT(output_.chainLength(), 1000);
+  parse();
+  EXPECT_EQ(WebSocketCodec::kCloseMessageTooBig, callback_.errorCode);
+  EXPECT_EQ(0, callback_.messages.size());
+}
+
+TEST_F(WebSocketCodecTest, PauseParser) {
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("one"));
+  client_.generateMessage(output_, WebSocketOpcode::TEXT,
+                          IOBuf::copyBuffer("two"));
+  server_.setParserPaused(true);
+  parse();
+  EXPECT_EQ(0, callback_.messages.size());
+  EXPECT_LT(0, server_.getPendingIngressSize());
+  server_.setParserPaused(false);
+  ASSERT_EQ(2, callback_.messages.size());
+  EXPECT_EQ("one", callback_.messages[0]);
+  EXPECT_EQ("two", callback_.messages[1]);
+  EXPECT_EQ(0, server_.getPendingIngressSize());
+}
@@ -17,8 +17,10 @@ OptionParser.new do |opts|
   end
   opts.on("-F", "--fbcode_dir DIR" "fbcode dir") do |f|
   end
+  # Extra common header names, one per line, e.g. as produced by
+  # sample_common_headers.rb. Relative paths are relative to fbcode_dir.
   opts.on("-H", "--custom_header FILE", "Additional header files") do |f|
-    headerFiles.push(File.join(fbcodeDir, f))
+    headerFiles.push(File.expand_path(f, fbcodeDir))
   end
 end.parse!
 
@@ -34,22 +36,41 @@ templateHPath = File.join(proxygenHttpPath, "HTTPCommonHeaders.template.h")
 templateGperfPath = File.join(proxygenHttpPath,
                               "HTTPCommonHeaders.template.gperf")
 headerNamesListPath = File.join(proxygenHttpPath, "HTTPCommonHeaders.txt")
-headerFiles.push(headerNamesListPath)
+# the built-in list goes first, so that its spelling wins over the extra
+# files' for names that are in both
+headerFiles.unshift(headerNamesListPath)
 
 # the destinations
 hPath = File.join(installDir, "HTTPCommonHeaders.h")
 gperfPath = File.join(installDir, "HTTPCommonHeaders.gperf")
 cppPath = File.join(installDir, "HTTPCommonHeaders.cpp")
 
+# codes are uint8_t and the first two are reserved
+maxHeaders = 254
+
 headerLines = []
+seen = {}
 headerFiles.each {|headerFile|
   File.open(headerFile, "r").each_line { |line|
     headerName = line.strip
-    next if headerName.empty?
+    next if headerName.empty? || headerName.start_with?("#")
+    # the enum names are derived from these, so stick to what maps to an
+    # identifier
+    if headerName !~ /\A[A-Za-z0-9_-]+\z/
+      abort("#{headerFile}: '#{headerName}' can't be a common header name")
+    end
+    # gperf matches ignoring case, and '-' and '_' give the same enum name
+    key = headerName.gsub('-', '_').upcase
+    next if seen[key]
+    seen[key] = true
     headerLines.push(headerName)
   }
 }
-headerLines = headerLines.sort.uniq
+if headerLines.length > maxHeaders
+  abort("#{headerLines.length} common headers, at most #{maxHeaders} fit " +
+        "in an HTTPHeaderCode")
+end
+headerLines = headerLines.sort
 insertedContentH = ""
 insertedContentGperf = "%%\n"
 nextEnumValue = 2
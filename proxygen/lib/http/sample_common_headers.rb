@@ -0,0 +1,69 @@
+#! /opt/local/bin/ruby
+
+# Picks the header names that are common in sampled traffic but missing from
+# HTTPCommonHeaders.txt, for use with --with-extra-common-headers.
+#
+# The input is one header per line, either a bare name or a "Name: value"
+# line as found in header dumps, read from the files given or stdin. The
+# output is the names seen in at least --min-share of the sampled requests
+# (counting each name once per blank-line separated request), most common
+# first, limited to what still fits in an HTTPHeaderCode.
+#
+#   ruby sample_common_headers.rb --min-share 0.01 dump.txt > extra.txt
+
+require 'optparse'
+
+minShare = 0.01
+maxHeaders = nil
+OptionParser.new do |opts|
+  opts.banner = "Usage: sample_common_headers.rb [options] [FILE...]"
+  opts.on("-s", "--min-share SHARE", Float,
+          "Fraction of requests a name must appear in") do |s|
+    minShare = s
+  end
+  opts.on("-n", "--max-headers N", Integer,
+          "Emit at most N names") do |n|
+    maxHeaders = n
+  end
+end.parse!
+
+builtinPath = File.join(File.dirname(__FILE__), "HTTPCommonHeaders.txt")
+builtin = {}
+File.open(builtinPath, "r").each_line { |line|
+  name = line.strip
+  builtin[name.downcase] = true unless name.empty?
+}
+
+# codes are uint8_t, the first two are reserved
+room = 254 - builtin.length
+maxHeaders = maxHeaders.nil? ? room : [maxHeaders, room].min
+
+counts = Hash.new(0)
+spelling = {}
+requests = 0
+inRequest = {}
+sawHeader = false
+ARGF.each_line { |line|
+  line = line.strip
+  if line.empty?
+    requests += 1 if sawHeader
+    inRequest = {}
+    sawHeader = false
+    next
+  end
+  sawHeader = true
+  name = line.split(":", 2)[0].strip
+  next if name !~ /\A[A-Za-z0-9_-]+\z/
+  key = name.downcase
+  next if builtin[key] || inRequest[key]
+  inRequest[key] = true
+  counts[key] += 1
+  spelling[key] ||= name
+}
+requests += 1 if sawHeader
+exit if requests == 0
+
+counts.select { |key, count| count >= minShare * requests }
+      .sort_by { |key, count| [-count, key] }
+      .first(maxHeaders)
+      .each { |key, count| puts spelling[key] }
@@ -61,7 +61,8 @@ void ByteEventTracker::processByteEvents(uint64_t bytesWritten,
     }
 
     VLOG(5) << " removing ByteEvent " << event;
-    delete &event;
+    byteEvents_.pop_front();
+    event.release();
   }
 
   if (eorTrackingEnabled && advanceEOM) {
@@ -82,7 +83,9 @@ size_t ByteEventTracker::drainByteEvents() {
   size_t numEvents = 0;
   // everything is dead from here on, let's just drop all extra refs to txns
   while (!byteEvents_.empty()) {
-    delete &byteEvents_.front();
+    ByteEvent& event = byteEvents_.front();
+    byteEvents_.pop_front();
+    event.release();
     ++numEvents;
   }
   nextLastByteEvent_ = nullptr;
@@ -94,9 +97,7 @@ void ByteEventTracker::addLastByteEvent(
     uint64_t byteNo,
     bool eorTrackingEnabled) noexcept {
   VLOG(5) << " adding last byte event for " << byteNo;
-  TransactionByteEvent* event = new TransactionByteEvent(
-      byteNo, ByteEvent::LAST_BYTE, HTTPTransaction::CallbackGuard(*txn));
-  byteEvents_.push_back(*event);
+  ByteEvent* event = addTransactionByteEvent(byteNo, ByteEvent::LAST_BYTE, txn);
 
   if (eorTrackingEnabled && !nextLastByteEvent_) {
     VLOG(5) << " set nextLastByteNo to " << event->byteOffset_;
@@ -121,7 +122,7 @@ void ByteEventTracker::addPingByteEvent(size_t pingSize,
     }
   }
 
-  ByteEvent* be = new PingByteEvent(offset, timestamp);
+  ByteEvent* be = PingByteEvent::create(offset, timestamp);
   if (i == byteEvents_.rend()) {
     byteEvents_.push_front(*be);
   } else if (i == byteEvents_.rbegin()) {
@@ -150,19 +151,27 @@ uint64_t ByteEventTracker::preSend(bool* cork,
 
 void ByteEventTracker::addFirstBodyByteEvent(uint64_t offset,
                                              HTTPTransaction* txn) {
-  byteEvents_.push_back(
-      *new TransactionByteEvent(
-          offset, ByteEvent::FIRST_BYTE, HTTPTransaction::CallbackGuard(*txn)));
+  addTransactionByteEvent(offset, ByteEvent::FIRST_BYTE, txn);
 }
 
 void ByteEventTracker::addFirstHeaderByteEvent(uint64_t offset,
                                                HTTPTransaction* txn) {
   // onWriteSuccess() is called after the entire header has been written.
   // It does not catch partial write case.
-  byteEvents_.push_back(
-      *new TransactionByteEvent(offset,
-                                ByteEvent::FIRST_HEADER_BYTE,
-                                HTTPTransaction::CallbackGuard(*txn)));
+  addTransactionByteEvent(offset, ByteEvent::FIRST_HEADER_BYTE, txn);
+}
+
+ByteEvent* ByteEventTracker::addTransactionByteEvent(
+    uint64_t offset,
+    ByteEvent::EventType eventType,
+    HTTPTransaction* txn) {
+  ByteEvent* event = txn->getByteEvent(eventType, offset);
+  if (!event) {
+    // the embedded event is still queued
+    event = new TransactionByteEvent(offset, eventType, txn);
+  }
+  byteEvents_.push_back(*event);
+  return event;
 }
 
 } // proxygen
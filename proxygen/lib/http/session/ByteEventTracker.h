@@ -12,6 +12,7 @@
 #include <proxygen/lib/http/session/AckLatencyEvent.h>
 #include <proxygen/lib/http/session/ByteEvents.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
 #include <proxygen/lib/utils/Time.h>
 #include <thrift/lib/cpp/async/TAsyncSocket.h>
 
@@ -22,6 +23,14 @@ class TTLBAStats;
 // An API for using TCP events from the HTTP level
 class ByteEventTracker {
  public:
+  // one per session, from the slabs of its thread
+  static void* operator new(size_t size) {
+    return IOBufSlab::get().allocate(size);
+  }
+  static void operator delete(void* ptr) {
+    IOBufSlab::deallocate(ptr);
+  }
+
   class Callback {
    public:
     virtual ~Callback() {}
@@ -55,6 +64,11 @@ class ByteEventTracker {
    */
   virtual uint64_t preSend(bool* cork, bool* eom, uint64_t bytesWritten);
 
+  /**
+   * Called before every read from the transport
+   */
+  virtual void preRead() {}
+
   virtual void addAckToLastByteEvent(HTTPTransaction* txn,
                                      const ByteEvent& lastByteEvent,
                                      bool eorTrackingEnabled) {}
@@ -72,6 +86,14 @@ class ByteEventTracker {
   virtual void onAckLatencyEvent(const AckLatencyEvent&) {}
 
  private:
+  /**
+   * Queue the event of txn that is embedded in it, or a new one if it is
+   * in use
+   */
+  ByteEvent* addTransactionByteEvent(uint64_t offset,
+                                     ByteEvent::EventType eventType,
+                                     HTTPTransaction* txn);
+
   // byteEvents_ is in the ascending order of ByteEvent::byteOffset_
   folly::IntrusiveList<ByteEvent, &ByteEvent::listHook> byteEvents_;
 
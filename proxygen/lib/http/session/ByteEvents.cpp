@@ -9,6 +9,8 @@
  */
 #include <proxygen/lib/http/session/ByteEvents.h>
 
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/utils/ObjectPool.h>
 #include <proxygen/lib/utils/Time.h>
 
 namespace proxygen {
@@ -26,8 +28,32 @@ std::ostream& operator<<(std::ostream& os, const ByteEvent& be) {
   return os;
 }
 
+TransactionByteEvent::TransactionByteEvent(uint64_t byteNo,
+                                           EventType eventType,
+                                           HTTPTransaction* txn)
+    : ByteEvent(byteNo, eventType), txn_(txn) {
+  txn_->incrementPendingByteEvents();
+}
+
+TransactionByteEvent::~TransactionByteEvent() {
+  txn_->decrementPendingByteEvents();
+}
+
+PingByteEvent* PingByteEvent::create(uint64_t byteOffset,
+                                     TimePoint pingRequestReceivedTime) {
+  PingByteEvent* event = ObjectPool<PingByteEvent>::get().acquire().release();
+  event->byteOffset_ = byteOffset;
+  event->pingRequestReceivedTime_ = pingRequestReceivedTime;
+  return event;
+}
+
 int64_t PingByteEvent::getLatency() {
   return millisecondsSince(pingRequestReceivedTime_).count();
 }
 
+void PingByteEvent::release() {
+  ObjectPool<PingByteEvent>::get().recycle(
+    std::unique_ptr<PingByteEvent>(this));
+}
+
 } // proxygen
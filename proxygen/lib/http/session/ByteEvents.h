@@ -10,12 +10,13 @@
 #pragma once
 
 #include <folly/IntrusiveList.h>
-#include <proxygen/lib/http/session/HTTPTransaction.h>
 #include <proxygen/lib/utils/AsyncTimeoutSet.h>
 #include <proxygen/lib/utils/Time.h>
 
 namespace proxygen {
 
+class HTTPTransaction;
+
 class ByteEvent {
  public:
   enum EventType {
@@ -31,6 +32,14 @@ class ByteEvent {
   virtual HTTPTransaction* getTransaction() { return nullptr; }
   virtual int64_t getLatency() { return -1; }
 
+  /**
+   * Called by the ByteEventTracker once the event is out of its queue.
+   * The events that are embedded or pooled don't free themselves.
+   */
+  virtual void release() {
+    delete this;
+  }
+
   folly::IntrusiveListHook listHook;
   EventType eventType_:3; // packed w/ byteOffset_
   size_t eomTracked_:1;
@@ -39,18 +48,25 @@ class ByteEvent {
 
 std::ostream& operator<<(std::ostream& os, const ByteEvent& txn);
 
+/**
+ * ByteEvent of a transaction, that keeps the transaction alive until the
+ * event is released. The transactions embed their first header byte,
+ * first byte and last byte events, so this is only allocated for the
+ * others.
+ */
 class TransactionByteEvent : public ByteEvent {
  public:
   TransactionByteEvent(uint64_t byteNo,
                        EventType eventType,
-                       HTTPTransaction::CallbackGuard cg)
-      : ByteEvent(byteNo, eventType), cg_(cg) {}
+                       HTTPTransaction* txn);
+  ~TransactionByteEvent() override;
 
   HTTPTransaction* getTransaction() override {
-    return &(cg_.peekTransaction());
+    return txn_;
   }
 
-  HTTPTransaction::CallbackGuard cg_; // refcounted transaction
+ private:
+  HTTPTransaction* txn_;
 };
 
 class AckTimeout
@@ -83,21 +99,35 @@ class AckByteEvent : public TransactionByteEvent {
   AckByteEvent(AckTimeout::Callback* callback,
                uint64_t byteNo,
                EventType eventType,
-               HTTPTransaction::CallbackGuard cg)
-      : TransactionByteEvent(byteNo, eventType, cg),
+               HTTPTransaction* txn)
+      : TransactionByteEvent(byteNo, eventType, txn),
         timeout(callback, byteNo) {}
 
   AckTimeout timeout;
 };
 
+/**
+ * The PingByteEvents come from a per-thread ObjectPool
+ */
 class PingByteEvent : public ByteEvent {
  public:
-  PingByteEvent(uint64_t byteOffset, TimePoint pingRequestReceivedTime)
-      : ByteEvent(byteOffset, PING_REPLY_SENT),
-        pingRequestReceivedTime_(pingRequestReceivedTime) {}
+  PingByteEvent(): ByteEvent(0, PING_REPLY_SENT) {}
+
+  /**
+   * @return a PingByteEvent from the pool of the thread
+   */
+  static PingByteEvent* create(uint64_t byteOffset,
+                               TimePoint pingRequestReceivedTime);
 
   int64_t getLatency() override;
 
+  void release() override;
+
+  void reset() {
+    byteOffset_ = 0;
+    pingRequestReceivedTime_ = TimePoint();
+  }
+
   TimePoint pingRequestReceivedTime_;
 };
 
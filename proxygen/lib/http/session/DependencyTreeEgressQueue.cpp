@@ -0,0 +1,182 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/DependencyTreeEgressQueue.h>
+
+#include <algorithm>
+#include <proxygen/lib/http/HTTPMessage.h>
+
+namespace proxygen {
+
+namespace {
+
+// virtual time a child with weight 1 spends sending a byte
+const uint64_t kStride = 1 << 16;
+
+const uint16_t kMaxWeight = 256;
+
+}
+
+DependencyTreeEgressQueue::DependencyTreeEgressQueue() {
+}
+
+DependencyTreeEgressQueue::~DependencyTreeEgressQueue() {
+  DCHECK(nodes_.empty());
+}
+
+EgressQueue::Handle
+DependencyTreeEgressQueue::addTransaction(HTTPCodec::StreamID id,
+                                          int8_t priority,
+                                          HTTPTransaction* txn) {
+  TreeNode* node = nodes_.emplace(id);
+  CHECK(node) << "stream=" << id << " is already in the queue";
+  node->id = id;
+  node->txn = txn;
+  node->weight = (kNumPriorities - toLevel(priority)) * 32;
+  attach(node, &root_);
+  return node;
+}
+
+void DependencyTreeEgressQueue::removeTransaction(Handle handle) {
+  TreeNode* node = toNode(handle);
+  clearPendingEgress(node);
+  TreeNode* parent = node->parent;
+  while (!node->children.empty()) {
+    TreeNode* child = &node->children.front();
+    detach(child);
+    attach(child, parent);
+  }
+  detach(node);
+  nodes_.erase(node->id);
+}
+
+void DependencyTreeEgressQueue::updatePriority(Handle handle,
+                                               const HTTPPriority& priority) {
+  TreeNode* node = toNode(handle);
+  TreeNode* parent = nullptr;
+  if (priority.streamDependency != 0) {
+    parent = nodes_.find(priority.streamDependency);
+  }
+  if (!parent || parent == node) {
+    parent = &root_;
+  }
+  // Depending on one of our own dependents moves it up to our place first
+  for (TreeNode* ancestor = parent->parent; ancestor;
+       ancestor = ancestor->parent) {
+    if (ancestor == node) {
+      TreeNode* oldParent = node->parent;
+      detach(parent);
+      attach(parent, oldParent);
+      break;
+    }
+  }
+  detach(node);
+  if (priority.exclusive) {
+    while (!parent->children.empty()) {
+      TreeNode* child = &parent->children.front();
+      detach(child);
+      attach(child, node);
+    }
+  }
+  node->weight = std::min(std::max(priority.weight, uint16_t(1)), kMaxWeight);
+  attach(node, parent);
+}
+
+void DependencyTreeEgressQueue::signalPendingEgress(Handle handle) {
+  TreeNode* node = toNode(handle);
+  if (!node->isEnqueued()) {
+    node->setEnqueued(true);
+    addActive(node, 1);
+  }
+}
+
+void DependencyTreeEgressQueue::clearPendingEgress(Handle handle) {
+  TreeNode* node = toNode(handle);
+  if (node->isEnqueued()) {
+    node->setEnqueued(false);
+    removeActive(node, 1);
+  }
+}
+
+HTTPTransaction* DependencyTreeEgressQueue::top() {
+  if (empty()) {
+    return nullptr;
+  }
+  TreeNode* node = &root_;
+  while (node == &root_ || !node->isEnqueued()) {
+    // the child whose turn starts first
+    TreeNode* next = nullptr;
+    for (auto& child: node->activeChildren) {
+      if (!next || child.pass < next->pass) {
+        next = &child;
+      }
+    }
+    DCHECK(next);
+    node = next;
+  }
+  return node->txn;
+}
+
+void DependencyTreeEgressQueue::onSent(Handle handle, size_t bytes) {
+  for (TreeNode* node = toNode(handle); node->parent; node = node->parent) {
+    node->parent->vtime = node->pass;
+    node->pass += bytes * kStride / node->weight;
+  }
+}
+
+HTTPCodec::StreamID
+DependencyTreeEgressQueue::getDependency(Handle handle) const {
+  TreeNode* parent = toNode(handle)->parent;
+  return parent == &root_ ? 0 : parent->id;
+}
+
+void DependencyTreeEgressQueue::attach(TreeNode* node, TreeNode* parent) {
+  DCHECK(!node->parent);
+  node->parent = parent;
+  parent->children.push_back(*node);
+  if (node->activeCount > 0) {
+    node->pass = std::max(node->pass, parent->vtime);
+    parent->activeChildren.push_back(*node);
+    addActive(parent, node->activeCount);
+  }
+}
+
+void DependencyTreeEgressQueue::detach(TreeNode* node) {
+  DCHECK(node->parent);
+  if (node->activeCount > 0) {
+    node->activeHook.unlink();
+    removeActive(node->parent, node->activeCount);
+  }
+  node->childHook.unlink();
+  node->parent = nullptr;
+}
+
+void DependencyTreeEgressQueue::addActive(TreeNode* node, uint32_t count) {
+  for (; node; node = node->parent) {
+    bool wasIdle = node->activeCount == 0;
+    node->activeCount += count;
+    if (wasIdle && node->parent) {
+      // an idle subtree doesn't get credit for the time it didn't use
+      node->pass = std::max(node->pass, node->parent->vtime);
+      node->parent->activeChildren.push_back(*node);
+    }
+  }
+}
+
+void DependencyTreeEgressQueue::removeActive(TreeNode* node, uint32_t count) {
+  for (; node; node = node->parent) {
+    DCHECK_GE(node->activeCount, count);
+    node->activeCount -= count;
+    if (node->activeCount == 0 && node->parent) {
+      node->activeHook.unlink();
+    }
+  }
+}
+
+}
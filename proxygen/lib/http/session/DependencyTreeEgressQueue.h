@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/IntrusiveList.h>
+#include <proxygen/lib/http/session/EgressQueue.h>
+#include <proxygen/lib/http/session/StreamTable.h>
+
+namespace proxygen {
+
+/**
+ * EgressQueue that follows the HTTP/2 stream dependencies. A transaction
+ * with egress pending is served before the ones that depend on it, and the
+ * bandwidth is shared between siblings in proportion to their weights,
+ * with start-time fair queueing over the bytes they send.
+ *
+ * The transactions created with a SPDY priority depend on the root, with
+ * a weight of 256 for priority 0 down to 32 for priority 7.
+ */
+class DependencyTreeEgressQueue : public EgressQueue {
+ public:
+  DependencyTreeEgressQueue();
+  ~DependencyTreeEgressQueue() override;
+
+  Handle addTransaction(HTTPCodec::StreamID id,
+                        int8_t priority,
+                        HTTPTransaction* txn) override;
+
+  /**
+   * The transactions that depended on this one now depend on its parent
+   */
+  void removeTransaction(Handle handle) override;
+
+  /**
+   * Move the transaction under the one it now depends on, as in HTTP/2.
+   * An exclusive dependency makes the other dependents of the new parent
+   * depend on this transaction. A dependency on a stream that is not in
+   * the queue is a dependency on the root.
+   */
+  void updatePriority(Handle handle, const HTTPPriority& priority) override;
+
+  void signalPendingEgress(Handle handle) override;
+
+  void clearPendingEgress(Handle handle) override;
+
+  HTTPTransaction* top() override;
+
+  void onSent(Handle handle, size_t bytes) override;
+
+  bool empty() const override {
+    return root_.activeCount == 0;
+  }
+
+  /**
+   * @return the ID of the stream the transaction depends on, 0 for the root
+   */
+  HTTPCodec::StreamID getDependency(Handle handle) const;
+
+ private:
+  struct TreeNode : public Node {
+    void setEnqueued(bool enqueued) {
+      enqueued_ = enqueued;
+    }
+
+    HTTPCodec::StreamID id{0};
+    HTTPTransaction* txn{nullptr};
+    TreeNode* parent{nullptr};
+    uint16_t weight{16};
+    // transactions with egress pending in the subtree, this one included
+    uint32_t activeCount{0};
+    // virtual time at which the subtree starts its next turn
+    uint64_t pass{0};
+    // start time of the last turn of a child, new children start there
+    uint64_t vtime{0};
+
+    folly::IntrusiveListHook childHook;
+    folly::IntrusiveListHook activeHook;
+    folly::IntrusiveList<TreeNode, &TreeNode::childHook> children;
+    // the children with activeCount > 0
+    folly::IntrusiveList<TreeNode, &TreeNode::activeHook> activeChildren;
+  };
+
+  static TreeNode* toNode(Handle handle) {
+    return static_cast<TreeNode*>(handle);
+  }
+
+  void attach(TreeNode* node, TreeNode* parent);
+  void detach(TreeNode* node);
+
+  void addActive(TreeNode* node, uint32_t count);
+  void removeActive(TreeNode* node, uint32_t count);
+
+  TreeNode root_;
+  StreamTable<TreeNode> nodes_;
+};
+
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/EgressFlusher.h>
+
+#include <algorithm>
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+#include <limits>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <unordered_map>
+
+namespace proxygen {
+
+std::shared_ptr<EgressFlusher> EgressFlusher::get(
+    folly::EventBase* eventBase) {
+  typedef std::unordered_map<folly::EventBase*, std::weak_ptr<EgressFlusher>>
+    FlusherMap;
+  static folly::ThreadLocal<FlusherMap> flushers;
+  DCHECK(eventBase->isInEventBaseThread());
+  auto& weak = (*flushers)[eventBase];
+  auto flusher = weak.lock();
+  if (!flusher) {
+    flusher = std::make_shared<EgressFlusher>(eventBase);
+    weak = flusher;
+  }
+  return flusher;
+}
+
+EgressFlusher::EgressFlusher(folly::EventBase* eventBase):
+    eventBase_(eventBase) {
+}
+
+EgressFlusher::~EgressFlusher() {
+  // the clients hold a reference, so there are none left in line
+  DCHECK(clients_.empty());
+  clients_.clear();
+  if (isLoopCallbackScheduled()) {
+    cancelLoopCallback();
+  }
+}
+
+void EgressFlusher::schedule(Client* client) {
+  if (!client->isFlushScheduled()) {
+    clients_.push_back(*client);
+  }
+  if (!isLoopCallbackScheduled()) {
+    eventBase_->runInLoop(this);
+  }
+}
+
+void EgressFlusher::runLoopCallback() noexcept {
+  LoopMonitor::CallbackScope monitorScope("EgressFlusher::runLoopCallback");
+  numFlushes_++;
+  // the clients that get in line during their turns wait for the next
+  // iteration
+  ClientList clients;
+  clients.swap(clients_);
+  uint64_t allowed = bytesPerLoop_ > 0 ? bytesPerLoop_ :
+    std::numeric_limits<uint64_t>::max();
+  while (!clients.empty()) {
+    if (allowed == 0) {
+      // the rest go before the ones that got back in line
+      VLOG(4) << "Egress budget of the loop exhausted";
+      clients.splice(clients.end(), clients_);
+      clients_.swap(clients);
+      eventBase_->runInLoop(this);
+      return;
+    }
+    Client& client = clients.front();
+    clients.pop_front();
+    // a client that goes away during the turn of another one unlinks
+    // itself from clients
+    uint64_t written = client.flushEgress(allowed);
+    allowed -= std::min(written, allowed);
+  }
+}
+
+}
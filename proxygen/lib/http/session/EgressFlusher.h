@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <folly/IntrusiveList.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+
+namespace proxygen {
+
+/**
+ * The writes of the sessions of an EventBase, run from one loop callback
+ * instead of one per session. The sessions that have egress get in line
+ * with schedule(), and the flusher hands them their turn in that order at
+ * the end of the loop iteration, within a budget of bytes for all of them
+ * together. The ones the budget leaves out go first in the next
+ * iteration, and a session that still has egress after its turn gets back
+ * in line behind the others, so each gets its share of the socket
+ * buffers and of the loop.
+ *
+ * Since the writes of all the sessions are issued back to back, an
+ * IoUringBackend submits them together, in one io_uring_enter().
+ *
+ * Owned by the sessions that use it, like IoUringBackend.
+ */
+class EgressFlusher : private folly::EventBase::LoopCallback {
+ public:
+  class Client {
+   public:
+    virtual ~Client() {}
+
+    /**
+     * Write the egress that is ready, stopping once bytesAllowed have
+     * been handed to the transport.
+     *
+     * @return the number of bytes handed to the transport
+     */
+    virtual uint64_t flushEgress(uint64_t bytesAllowed) noexcept = 0;
+
+    bool isFlushScheduled() const {
+      return hook_.is_linked();
+    }
+
+   private:
+    friend class EgressFlusher;
+
+    folly::IntrusiveListHook hook_;
+  };
+
+  /**
+   * The flusher of eventBase, made on the first call from the thread of
+   * eventBase while no other one is alive
+   */
+  static std::shared_ptr<EgressFlusher> get(folly::EventBase* eventBase);
+
+  explicit EgressFlusher(folly::EventBase* eventBase);
+  ~EgressFlusher();
+
+  /**
+   * @param bytesPerLoop what all the clients together write per loop
+   *                     iteration, 0 for no limit
+   */
+  void setBudget(uint64_t bytesPerLoop) {
+    bytesPerLoop_ = bytesPerLoop;
+  }
+
+  uint64_t getBudget() const {
+    return bytesPerLoop_;
+  }
+
+  /**
+   * Give client a turn at the end of this loop iteration, or keep its
+   * place in line if it already has one
+   */
+  void schedule(Client* client);
+
+  /**
+   * Take client out of the line
+   */
+  void cancel(Client* client) {
+    client->hook_.unlink();
+  }
+
+  /**
+   * @return the number of loop iterations that ran the clients, for tests
+   */
+  uint64_t getNumFlushes() const {
+    return numFlushes_;
+  }
+
+ private:
+  typedef folly::IntrusiveList<Client, &Client::hook_> ClientList;
+
+  // LoopCallback methods
+  void runLoopCallback() noexcept override;
+
+  folly::EventBase* eventBase_;
+  ClientList clients_;
+  uint64_t bytesPerLoop_{0};
+  uint64_t numFlushes_{0};
+};
+
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <proxygen/lib/http/codec/HTTPCodec.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+
+namespace proxygen {
+
+class HTTPTransaction;
+struct HTTPPriority;
+
+/**
+ * Decides in which order the transactions of a session send their egress.
+ *
+ * Every transaction is added to the queue for its whole life, and signals
+ * when it has egress pending. The session then asks for the next
+ * transaction to serve with top(), and reports how much it sent with
+ * onSent().
+ */
+class EgressQueue {
+ public:
+  // one per session, from the slabs of its thread
+  static void* operator new(size_t size) {
+    return IOBufSlab::get().allocate(size);
+  }
+  static void operator delete(void* ptr) {
+    IOBufSlab::deallocate(ptr);
+  }
+
+  /**
+   * Per transaction state of the queue
+   */
+  class Node {
+   public:
+    virtual ~Node() {}
+
+    bool isEnqueued() const {
+      return enqueued_;
+    }
+
+   protected:
+    bool enqueued_{false};
+  };
+
+  typedef Node* Handle;
+
+  // SPDY/3 priorities, from 0 (highest) to 7
+  static const uint8_t kNumPriorities = 8;
+
+  /**
+   * Map a signed SPDY priority to 0 - 7. Negative values count from the
+   * lowest priority.
+   */
+  static uint8_t toLevel(int8_t priority) {
+    if (priority < 0) {
+      return priority < -kNumPriorities ? 0 : kNumPriorities + priority;
+    }
+    return priority < kNumPriorities ? priority : kNumPriorities - 1;
+  }
+
+  virtual ~EgressQueue() {}
+
+  /**
+   * Add a transaction to the queue, with its SPDY priority.
+   *
+   * @return the handle of the transaction, valid until removeTransaction()
+   */
+  virtual Handle addTransaction(HTTPCodec::StreamID id,
+                                int8_t priority,
+                                HTTPTransaction* txn) = 0;
+
+  virtual void removeTransaction(Handle handle) = 0;
+
+  /**
+   * Change the priority of a transaction to an HTTP/2 dependency and weight
+   */
+  virtual void updatePriority(Handle handle,
+                              const HTTPPriority& priority) = 0;
+
+  /**
+   * The transaction has egress to send
+   */
+  virtual void signalPendingEgress(Handle handle) = 0;
+
+  /**
+   * The transaction has nothing left to send, or can't send it
+   */
+  virtual void clearPendingEgress(Handle handle) = 0;
+
+  /**
+   * @return the transaction to serve next, nullptr if none has egress
+   */
+  virtual HTTPTransaction* top() = 0;
+
+  /**
+   * Account for the bytes that a transaction returned by top() sent
+   */
+  virtual void onSent(Handle handle, size_t bytes) = 0;
+
+  /**
+   * @return true if no transaction has egress pending
+   */
+  virtual bool empty() const = 0;
+};
+
+}
@@ -0,0 +1,178 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <folly/IntrusiveList.h>
+#include <glog/logging.h>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Queue of the streams with pending egress, made of one round-robin list
+ * per priority level and a bitmap of the levels that are not empty. All
+ * operations are constant time.
+ *
+ * By default the levels are served in strict priority order, level 0
+ * first, and the streams of a level take turns. With setWeights(), the
+ * levels share the bandwidth instead, by deficit round-robin over the
+ * bytes reported to onSent().
+ */
+template <typename T>
+class EgressScheduler {
+ public:
+  static const uint8_t kNumLevels = 8;
+  // bytes a level may send per unit of weight on each round
+  static const int64_t kQuantum = 1024;
+
+  /**
+   * Position of a stream in the queue, owned by the stream
+   */
+  class Handle {
+   public:
+    explicit Handle(T* stream) : stream_(stream) {}
+    Handle(const Handle&) = delete;
+    Handle& operator=(const Handle&) = delete;
+
+    bool isEnqueued() const {
+      return hook_.is_linked();
+    }
+
+   private:
+    friend class EgressScheduler;
+
+    folly::IntrusiveListHook hook_;
+    T* stream_;
+    uint8_t level_{0};
+  };
+
+  EgressScheduler() {
+    deficits_.fill(0);
+  }
+
+  EgressScheduler(const EgressScheduler&) = delete;
+  EgressScheduler& operator=(const EgressScheduler&) = delete;
+
+  ~EgressScheduler() {
+    DCHECK(empty());
+  }
+
+  bool empty() const {
+    return nonEmpty_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  /**
+   * Add the stream at the back of its level
+   */
+  void push(Handle& handle, uint8_t level) {
+    DCHECK(!handle.isEnqueued());
+    DCHECK_LT(level, kNumLevels);
+    handle.level_ = level;
+    levels_[level].push_back(handle);
+    nonEmpty_ |= 1 << level;
+    ++size_;
+  }
+
+  void erase(Handle& handle) {
+    DCHECK(handle.isEnqueued());
+    auto& list = levels_[handle.level_];
+    list.erase(list.iterator_to(handle));
+    if (list.empty()) {
+      nonEmpty_ &= ~(1 << handle.level_);
+      deficits_[handle.level_] = 0;
+    }
+    --size_;
+  }
+
+  /**
+   * @return the stream to serve next, nullptr if the queue is empty
+   */
+  T* top() {
+    if (empty()) {
+      return nullptr;
+    }
+    if (weights_.empty()) {
+      return levels_[__builtin_ctz(nonEmpty_)].front().stream_;
+    }
+    // Move on to the next level once this one has used its quantum. The
+    // deficit of a level can be below a quantum after a large write, then
+    // it waits for more than one round.
+    while (!(nonEmpty_ & (1 << current_)) || deficits_[current_] <= 0) {
+      current_ = nextLevel(current_);
+      deficits_[current_] += weights_[current_] * kQuantum;
+    }
+    return levels_[current_].front().stream_;
+  }
+
+  /**
+   * Account for bytes sent by a stream that top() returned, and move it to
+   * the back of its level if it is still enqueued.
+   */
+  void onSent(Handle& handle, size_t bytes) {
+    if (!weights_.empty() && (nonEmpty_ & (1 << handle.level_))) {
+      deficits_[handle.level_] -= bytes;
+    }
+    if (handle.isEnqueued()) {
+      auto& list = levels_[handle.level_];
+      list.erase(list.iterator_to(handle));
+      list.push_back(handle);
+    }
+  }
+
+  /**
+   * Share the bandwidth between levels in proportion to weights, which
+   * holds one positive weight per level. An empty vector goes back to
+   * strict priority.
+   */
+  void setWeights(const std::vector<uint32_t>& weights) {
+    CHECK(weights.empty() || weights.size() == kNumLevels);
+    for (auto weight: weights) {
+      CHECK_GT(weight, 0);
+    }
+    weights_ = weights;
+    deficits_.fill(0);
+    current_ = 0;
+  }
+
+ private:
+  typedef folly::IntrusiveList<Handle, &Handle::hook_> List;
+
+  /**
+   * @return the first non empty level after level, wrapping around
+   */
+  uint8_t nextLevel(uint8_t level) const {
+    DCHECK(!empty());
+    uint32_t after = nonEmpty_ & ~((2 << level) - 1);
+    return __builtin_ctz(after ? after : nonEmpty_);
+  }
+
+  std::array<List, kNumLevels> levels_;
+  // bit i is set if levels_[i] is not empty
+  uint32_t nonEmpty_{0};
+  size_t size_{0};
+
+  std::vector<uint32_t> weights_;
+  std::array<int64_t, kNumLevels> deficits_;
+  uint8_t current_{0};
+};
+
+template <typename T>
+const uint8_t EgressScheduler<T>::kNumLevels;
+
+template <typename T>
+const int64_t EgressScheduler<T>::kQuantum;
+
+}
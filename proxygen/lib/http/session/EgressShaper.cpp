@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/EgressShaper.h>
+
+#include <algorithm>
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <unordered_map>
+
+using std::chrono::microseconds;
+
+namespace proxygen {
+
+namespace {
+
+// what a bucket with any tokens left grants, a packet's worth
+const int64_t kMinGrant = 1400;
+
+}
+
+int EgressShaperConfig::getPathClass(folly::StringPiece path) const {
+  for (const auto& route: pathClasses) {
+    if (path.startsWith(route.first)) {
+      return route.second;
+    }
+  }
+  return -1;
+}
+
+EgressShaper::Bucket::Bucket(uint64_t r, std::chrono::milliseconds burst)
+    : rate(r),
+      max(std::max<int64_t>(r * burst.count() / 1000, kMinGrant)) {
+  tokens = max;
+}
+
+void EgressShaper::Bucket::refill(microseconds elapsed) {
+  tokens = std::min<int64_t>(tokens + rate * elapsed.count() / 1000000, max);
+}
+
+void EgressShaper::Bucket::take(uint64_t bytes) {
+  // the debt of a burst at most, so that a class that is assured more
+  // than the thread has can't starve the others for long
+  tokens = std::max<int64_t>(tokens - bytes, -max);
+}
+
+std::shared_ptr<EgressShaper> EgressShaper::get(
+    folly::EventBase* eventBase,
+    std::shared_ptr<const EgressShaperConfig> config) {
+  typedef std::unordered_map<folly::EventBase*, std::weak_ptr<EgressShaper>>
+    ShaperMap;
+  static folly::ThreadLocal<ShaperMap> shapers;
+  DCHECK(eventBase->isInEventBaseThread());
+  auto& weak = (*shapers)[eventBase];
+  auto shaper = weak.lock();
+  if (!shaper) {
+    shaper = std::make_shared<EgressShaper>(eventBase, std::move(config));
+    weak = shaper;
+  }
+  return shaper;
+}
+
+EgressShaper::EgressShaper(folly::TimeoutManager* timeoutManager,
+                           std::shared_ptr<const EgressShaperConfig> config,
+                           TimePoint now)
+    : folly::AsyncTimeout(timeoutManager),
+      config_(std::move(config)),
+      root_(config_->rate, config_->burst),
+      lastRefill_(now) {
+  CHECK_GT(config_->rate, 0);
+  CHECK(!config_->classes.empty());
+  for (const auto& cls: config_->classes) {
+    classes_.push_back({
+        Bucket(cls.rate, config_->burst),
+        Bucket(cls.ceil > 0 ? cls.ceil : config_->rate, config_->burst)});
+  }
+  for (auto cls: config_->priorityClasses) {
+    CHECK_LT(cls, classes_.size());
+  }
+  for (const auto& route: config_->pathClasses) {
+    CHECK_LT(route.second, classes_.size());
+  }
+}
+
+EgressShaper::~EgressShaper() {
+  // the clients hold a reference, so there are none waiting
+  DCHECK(waiting_.empty());
+  waiting_.clear();
+}
+
+uint8_t EgressShaper::getClass(int txnClass, uint8_t priority) const {
+  if (txnClass >= 0 && size_t(txnClass) < classes_.size()) {
+    return txnClass;
+  }
+  return config_->priorityClasses[std::min<uint8_t>(priority, 7)];
+}
+
+void EgressShaper::refill(TimePoint now) {
+  auto elapsed = std::chrono::duration_cast<microseconds>(now - lastRefill_);
+  if (elapsed.count() <= 0) {
+    return;
+  }
+  lastRefill_ = now;
+  root_.refill(elapsed);
+  for (auto& cls: classes_) {
+    cls.assured.refill(elapsed);
+    cls.ceil.refill(elapsed);
+  }
+}
+
+uint64_t EgressShaper::getAllowed(uint8_t cls, TimePoint now) {
+  refill(now);
+  const auto& buckets = classes_[cls];
+  int64_t allowed = std::min(std::max(buckets.assured.tokens, root_.tokens),
+                             buckets.ceil.tokens);
+  if (allowed <= 0) {
+    return 0;
+  }
+  return std::max(allowed, kMinGrant);
+}
+
+void EgressShaper::consume(uint8_t cls, uint64_t bytes) {
+  auto& buckets = classes_[cls];
+  buckets.assured.take(bytes);
+  buckets.ceil.take(bytes);
+  root_.take(bytes);
+}
+
+void EgressShaper::wait(Client* client) {
+  if (!client->isEgressShaped()) {
+    waiting_.push_back(*client);
+  }
+  if (!isScheduled()) {
+    scheduleTimeout(config_->retryInterval);
+  }
+}
+
+void EgressShaper::timeoutExpired() noexcept {
+  LoopMonitor::CallbackScope monitorScope("EgressShaper::timeoutExpired");
+  // the clients still short of tokens wait again
+  ClientList clients;
+  clients.swap(waiting_);
+  while (!clients.empty()) {
+    Client& client = clients.front();
+    clients.pop_front();
+    client.onEgressAllowed();
+  }
+}
+
+}
@@ -0,0 +1,169 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <folly/IntrusiveList.h>
+#include <folly/Range.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <proxygen/lib/utils/Time.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * The classes of an EgressShaper, and how the transactions are put in
+ * them. Rates are in bytes per second.
+ */
+struct EgressShaperConfig {
+  struct Class {
+    Class(uint64_t r, uint64_t c = 0): rate(r), ceil(c) {}
+
+    // assured even while the others use up the rate of the thread
+    uint64_t rate;
+    // the most it gets by borrowing what the others leave, 0 for the
+    // rate of the thread
+    uint64_t ceil;
+  };
+
+  // the egress of the sessions of a thread together
+  uint64_t rate{0};
+  // what each bucket holds, as time at its rate
+  std::chrono::milliseconds burst{20};
+  // how long the sessions left without tokens wait before trying again
+  std::chrono::milliseconds retryInterval{5};
+  // at least one
+  std::vector<Class> classes;
+  // the class of the transactions of each priority, unless a path prefix
+  // gives them one
+  uint8_t priorityClasses[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  // longest prefix first
+  std::vector<std::pair<std::string, uint8_t>> pathClasses;
+
+  /**
+   * @return the class of the longest prefix of path in pathClasses, or -1
+   */
+  int getPathClass(folly::StringPiece path) const;
+};
+
+/**
+ * A hierarchical token bucket for the egress of the sessions of an
+ * EventBase, so that bulk transfers on some connections leave bandwidth
+ * to the latency sensitive responses of the others.
+ *
+ * The thread has a bucket filled at config.rate, and each class one at
+ * its assured rate and one at its ceil. A transaction may send what
+ * is left in the bucket of its class or, borrowing, in the one of the
+ * thread, whichever is more, but never more than its ceiling. Every byte
+ * sent is taken from all three. A session whose next transaction finds
+ * no tokens stops writing and waits(), and the shaper schedules its write
+ * again after retryInterval.
+ *
+ * A bucket with any tokens grants at least a packet, going into debt, so
+ * that slow classes don't send in slivers.
+ *
+ * Owned by the sessions that use it, like EgressFlusher.
+ */
+class EgressShaper : private folly::AsyncTimeout {
+ public:
+  class Client {
+   public:
+    virtual ~Client() {}
+
+    /**
+     * There may be tokens again, try writing
+     */
+    virtual void onEgressAllowed() noexcept = 0;
+
+    bool isEgressShaped() const {
+      return hook_.is_linked();
+    }
+
+   private:
+    friend class EgressShaper;
+
+    folly::IntrusiveListHook hook_;
+  };
+
+  /**
+   * The shaper of eventBase, made with config on the first call from the
+   * thread of eventBase while no other one is alive
+   */
+  static std::shared_ptr<EgressShaper> get(
+    folly::EventBase* eventBase,
+    std::shared_ptr<const EgressShaperConfig> config);
+
+  EgressShaper(folly::TimeoutManager* timeoutManager,
+               std::shared_ptr<const EgressShaperConfig> config,
+               TimePoint now = getCurrentTime());
+  ~EgressShaper();
+
+  /**
+   * @param txnClass the class the transaction was given, -1 if none
+   */
+  uint8_t getClass(int txnClass, uint8_t priority) const;
+
+  /**
+   * @return how many bytes a transaction of cls may send now, 0 if none
+   */
+  uint64_t getAllowed(uint8_t cls, TimePoint now = getCurrentTime());
+
+  /**
+   * Take the bytes that a transaction of cls sent from its buckets
+   */
+  void consume(uint8_t cls, uint64_t bytes);
+
+  /**
+   * Call client back after retryInterval, unless it is cancel()ed
+   */
+  void wait(Client* client);
+
+  void cancel(Client* client) {
+    client->hook_.unlink();
+  }
+
+ private:
+  typedef folly::IntrusiveList<Client, &Client::hook_> ClientList;
+
+  struct Bucket {
+    Bucket(uint64_t rate, std::chrono::milliseconds burst);
+
+    void refill(std::chrono::microseconds elapsed);
+
+    void take(uint64_t bytes);
+
+    int64_t tokens;
+    uint64_t rate;
+    int64_t max;
+  };
+
+  struct ClassBuckets {
+    Bucket assured;
+    Bucket ceil;
+  };
+
+  void refill(TimePoint now);
+
+  // AsyncTimeout method
+  void timeoutExpired() noexcept override;
+
+  const std::shared_ptr<const EgressShaperConfig> config_;
+  Bucket root_;
+  std::vector<ClassBuckets> classes_;
+  TimePoint lastRefill_;
+  ClientList waiting_;
+};
+
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/FileRegionWriter.h>
+
+#include <cerrno>
+#include <glog/logging.h>
+#include <sys/sendfile.h>
+
+using apache::thrift::transport::TTransportException;
+
+namespace proxygen {
+
+FileRegionWriter::FileRegionWriter(folly::EventBase* eventBase,
+                                   int fd,
+                                   Callback* callback):
+    folly::EventHandler(eventBase, fd),
+    fd_(fd),
+    callback_(callback) {
+}
+
+void FileRegionWriter::write(const FileRegion& region) {
+  CHECK(!isWriting());
+  region_ = region;
+  bytesWritten_ = 0;
+  writeMore();
+}
+
+void FileRegionWriter::cancel() {
+  unregisterHandler();
+  region_.clear();
+}
+
+void FileRegionWriter::handlerReady(uint16_t events) noexcept {
+  writeMore();
+}
+
+void FileRegionWriter::writeMore() {
+  while (bytesWritten_ < region_->getLength()) {
+    off_t offset = region_->getOffset() + bytesWritten_;
+    ssize_t n = sendfile(fd_, region_->getFd(), &offset,
+                         region_->getLength() - bytesWritten_);
+    if (n > 0) {
+      bytesWritten_ += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // wait for room in the socket buffer
+      if (!isHandlerRegistered()) {
+        registerHandler(EventHandler::WRITE | EventHandler::PERSIST);
+      }
+      return;
+    }
+    int err = n < 0 ? errno : 0;
+    uint64_t bytesWritten = bytesWritten_;
+    cancel();
+    // sendfile() returns 0 at the end of the file
+    callback_->onFileRegionError(bytesWritten, TTransportException(
+        TTransportException::INTERNAL_ERROR,
+        err ? "sendfile() failed" : "file is shorter than the region",
+        err));
+    return;
+  }
+  uint64_t bytesWritten = bytesWritten_;
+  cancel();
+  // may delete this
+  callback_->onFileRegionWritten(bytesWritten);
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/io/async/EventHandler.h>
+#include <proxygen/lib/utils/FileRegion.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+
+namespace proxygen {
+
+/**
+ * Writes file regions to a socket with sendfile(), waiting for the socket
+ * to be writable when its buffer is full. The socket must have no other
+ * write in progress while a region is written.
+ */
+class FileRegionWriter : private folly::EventHandler {
+ public:
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+    virtual void onFileRegionWritten(uint64_t bytesWritten) noexcept = 0;
+
+    virtual void onFileRegionError(
+      uint64_t bytesWritten,
+      const apache::thrift::transport::TTransportException& ex) noexcept = 0;
+  };
+
+  FileRegionWriter(folly::EventBase* eventBase, int fd, Callback* callback);
+
+  /**
+   * Start writing region. The callback gets the outcome, possibly before
+   * write() returns.
+   */
+  void write(const FileRegion& region);
+
+  /**
+   * Stop writing the current region, without notifying the callback
+   */
+  void cancel();
+
+  bool isWriting() const {
+    return region_.hasValue();
+  }
+
+ private:
+  void handlerReady(uint16_t events) noexcept override;
+
+  void writeMore();
+
+  int fd_;
+  Callback* callback_;
+  folly::Optional<FileRegion> region_;
+  uint64_t bytesWritten_{0};
+};
+
+}
@@ -0,0 +1,382 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/HQSession.h>
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+#include <proxygen/lib/http/HTTPException.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/session/HTTPSessionController.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <proxygen/lib/utils/Time.h>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using std::unique_ptr;
+
+namespace proxygen {
+
+HQSession::HQSession(AsyncTimeoutSet* transactionTimeouts,
+                     unique_ptr<QuicTransport> transport,
+                     HTTPSessionController* controller,
+                     const folly::TransportInfo& tinfo,
+                     HTTPSessionStats* sessionStats)
+    : transactionTimeouts_(transactionTimeouts),
+      transport_(std::move(transport)),
+      controller_(controller),
+      transportInfo_(tinfo),
+      sessionStats_(sessionStats) {
+  CHECK(transport_);
+  codec_.setCallback(this);
+}
+
+HQSession::~HQSession() {
+  VLOG(4) << *this << " closing";
+  CHECK(transactions_.empty());
+  transport_->setCallback(nullptr);
+}
+
+void HQSession::startNow() {
+  CHECK(!started_);
+  started_ = true;
+  transport_->setCallback(this);
+}
+
+void HQSession::timeoutExpired() noexcept {
+  if (!transactions_.empty()) {
+    // the transactions have timeouts of their own
+    resetTimeout();
+    return;
+  }
+  VLOG(4) << *this << " idle timeout";
+  dropConnection();
+}
+
+void HQSession::describe(std::ostream& os) const {
+  os << "[hq downstream = " << getPeerAddress() << ", "
+     << getLocalAddress() << " = local]";
+}
+
+bool HQSession::isBusy() const {
+  return !transactions_.empty();
+}
+
+void HQSession::notifyPendingShutdown() {
+  VLOG(4) << *this << " notified pending shutdown";
+  draining_ = true;
+}
+
+void HQSession::closeWhenIdle() {
+  draining_ = true;
+  if (!isBusy()) {
+    dropConnection();
+  }
+}
+
+void HQSession::dropConnection() {
+  VLOG(4) << "dropping " << *this;
+  if (closed_) {
+    return;
+  }
+  DestructorGuard dg(this);
+  // errors the transactions and destroys the session, through
+  // onConnectionEnd()
+  transport_->close(!transactions_.empty());
+}
+
+void HQSession::dumpConnectionState(uint8_t loglevel) {
+  VLOG(loglevel) << *this << " has " << transactions_.size()
+                 << " transactions, codec " << codec_.getMemoryUsage();
+}
+
+void HQSession::onStreamData(QuicTransport::StreamID id,
+                             unique_ptr<IOBuf> data,
+                             bool fin) noexcept {
+  DestructorGuard dg(this);
+  if (data && !data->empty()) {
+    codec_.onStreamIngress(id, *data);
+  }
+  if (fin) {
+    codec_.onStreamIngressEOF(id);
+  }
+}
+
+void HQSession::onStreamReset(QuicTransport::StreamID id,
+                              ErrorCode code) noexcept {
+  VLOG(4) << *this << " stream reset, streamID=" << id
+          << ", code=" << getErrorCodeString(code);
+  DestructorGuard dg(this);
+  codec_.onStreamAbort(id);
+  HTTPTransaction* txn = transactions_.find(id);
+  if (txn) {
+    HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS,
+                     kErrorStreamAbort);
+    ex.setCodecStatusCode(code);
+    txn->onError(ex);
+  }
+}
+
+void HQSession::onStreamWritable(QuicTransport::StreamID id) noexcept {
+  HTTPTransaction* txn = transactions_.find(id);
+  if (txn) {
+    txn->resumeEgress();
+  }
+}
+
+void HQSession::onConnectionEnd(bool error) noexcept {
+  VLOG(4) << *this << " connection ended, error=" << error;
+  DestructorGuard dg(this);
+  closed_ = true;
+  if (isLoopCallbackScheduled()) {
+    cancelLoopCallback();
+  }
+  HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS,
+                   error ? kErrorConnectionReset : kErrorEOF);
+  transactions_.forEachSafe(
+    [&ex] (HTTPCodec::StreamID, HTTPTransaction& txn) {
+      txn.onError(ex);
+    });
+  checkForShutdown();
+}
+
+void HQSession::onMessageBegin(HTTPCodec::StreamID streamID,
+                               HTTPMessage* msg) {
+  VLOG(4) << "processing new message on " << *this << ", streamID="
+          << streamID;
+  if (transactions_.find(streamID)) {
+    return;
+  }
+  if (draining_ || closed_) {
+    resetStream(streamID, ErrorCode::REFUSED_STREAM);
+    return;
+  }
+  HTTPTransaction* txn = transactions_.emplace(
+    streamID,
+    TransportDirection::DOWNSTREAM, streamID, transactionSeqNo_, *this,
+    txnEgressQueue_, transactionTimeouts_, sessionStats_,
+    false, 0, 0,
+    msg ? msg->getPriority() : 0);
+  ++transactionSeqNo_;
+  txn->setFirstByteReadTime(getCurrentTime());
+}
+
+void HQSession::onHeadersComplete(HTTPCodec::StreamID streamID,
+                                  unique_ptr<HTTPMessage> msg) {
+  HTTPTransaction* txn = transactions_.find(streamID);
+  if (!txn) {
+    // refused
+    return;
+  }
+  // QUIC is always encrypted
+  msg->setSecure(true);
+
+  // The handler frees itself when it is done, and the transaction once
+  // both its ingress and egress completed, as on TCP
+  auto handler = controller_->getRequestHandler(*txn, msg.get());
+  CHECK(handler);
+  txn->setHandler(handler);
+
+  // the handler may have aborted the transaction
+  txn = transactions_.find(streamID);
+  if (txn) {
+    txn->onIngressHeadersComplete(std::move(msg));
+  }
+}
+
+void HQSession::onBody(HTTPCodec::StreamID streamID,
+                       unique_ptr<IOBuf> chain) {
+  HTTPTransaction* txn = transactions_.find(streamID);
+  if (txn) {
+    txn->onIngressBody(std::move(chain));
+  }
+}
+
+void HQSession::onTrailersComplete(HTTPCodec::StreamID streamID,
+                                   unique_ptr<HTTPHeaders> trailers) {
+  HTTPTransaction* txn = transactions_.find(streamID);
+  if (txn) {
+    txn->onIngressTrailers(std::move(trailers));
+  }
+}
+
+void HQSession::onMessageComplete(HTTPCodec::StreamID streamID,
+                                  bool upgrade) {
+  HTTPTransaction* txn = transactions_.find(streamID);
+  if (txn) {
+    txn->onIngressEOM();
+  }
+}
+
+void HQSession::onError(HTTPCodec::StreamID streamID,
+                        const HTTPException& error, bool newTxn) {
+  VLOG(4) << "Error on " << *this << ", streamID=" << streamID
+          << ", " << error;
+  HTTPTransaction* txn = transactions_.find(streamID);
+  if (!txn) {
+    resetStream(streamID, error.hasCodecStatusCode() ?
+                error.getCodecStatusCode() : ErrorCode::PROTOCOL_ERROR);
+    return;
+  }
+  if (!txn->getHandler() &&
+      txn->getEgressState() == HTTPTransactionEgressSM::State::Start) {
+    // a bad request, answered with an error page
+    auto handler = controller_->getParseErrorHandler(txn, error,
+                                                     getLocalAddress());
+    if (!handler) {
+      txn->sendAbort();
+      return;
+    }
+    txn->setHandler(handler);
+  }
+  txn->onError(error);
+}
+
+void HQSession::pauseIngress(HTTPTransaction* txn) noexcept {
+  VLOG(4) << *this << " pausing streamID=" << txn->getID();
+  transport_->pauseRead(txn->getID());
+}
+
+void HQSession::resumeIngress(HTTPTransaction* txn) noexcept {
+  VLOG(4) << *this << " resuming streamID=" << txn->getID();
+  transport_->resumeRead(txn->getID());
+}
+
+void HQSession::transactionTimeout(HTTPTransaction* txn) noexcept {
+  VLOG(3) << "Transaction timeout for streamID=" << txn->getID();
+  if (!txn->getHandler() &&
+      txn->getEgressState() == HTTPTransactionEgressSM::State::Start) {
+    txn->setHandler(controller_->getTransactionTimeoutHandler(
+                      txn, getLocalAddress()));
+  }
+  txn->onIngressTimeout();
+}
+
+void HQSession::writeStream(HTTPCodec::StreamID streamID, IOBufQueue& buf,
+                            bool fin) {
+  if (closed_) {
+    return;
+  }
+  transport_->writeStream(streamID, buf.move(), fin);
+}
+
+void HQSession::sendHeaders(HTTPTransaction* txn,
+                            const HTTPMessage& headers,
+                            HTTPHeaderSize* size) noexcept {
+  IOBufQueue buf(IOBufQueue::cacheChainLength());
+  codec_.generateHeader(buf, txn->getID(), headers, HTTPCodec::NoStream,
+                        size);
+  writeStream(txn->getID(), buf, false);
+}
+
+size_t HQSession::sendBody(HTTPTransaction* txn,
+                           unique_ptr<IOBuf> body,
+                           bool includeEOM) noexcept {
+  IOBufQueue buf(IOBufQueue::cacheChainLength());
+  size_t encodedSize = codec_.generateBody(buf, txn->getID(),
+                                           std::move(body), includeEOM);
+  if (!txn->testAndSetFirstByteSent()) {
+    txn->onEgressBodyFirstByte();
+  }
+  writeStream(txn->getID(), buf, includeEOM);
+  if (includeEOM) {
+    VLOG(4) << *this << " sending EOM in body for streamID=" << txn->getID();
+    txn->onEgressBodyLastByte();
+  }
+  return encodedSize;
+}
+
+size_t HQSession::sendTrailers(HTTPTransaction* txn,
+                               const HTTPHeaders& trailers) noexcept {
+  IOBufQueue buf(IOBufQueue::cacheChainLength());
+  size_t encodedSize = codec_.generateTrailers(buf, txn->getID(), trailers);
+  writeStream(txn->getID(), buf, false);
+  return encodedSize;
+}
+
+size_t HQSession::sendEOM(HTTPTransaction* txn) noexcept {
+  VLOG(4) << *this << " sending EOM for streamID=" << txn->getID();
+  IOBufQueue buf(IOBufQueue::cacheChainLength());
+  writeStream(txn->getID(), buf, true);
+  if (!txn->testAndSetFirstByteSent()) {
+    txn->onEgressBodyFirstByte();
+  }
+  txn->onEgressBodyLastByte();
+  return 0;
+}
+
+size_t HQSession::sendAbort(HTTPTransaction* txn,
+                            ErrorCode statusCode) noexcept {
+  VLOG(4) << *this << " sending abort for streamID=" << txn->getID();
+  resetStream(txn->getID(), statusCode);
+  return 0;
+}
+
+void HQSession::resetStream(HTTPCodec::StreamID streamID, ErrorCode code) {
+  codec_.onStreamAbort(streamID);
+  if (!closed_) {
+    transport_->resetStream(streamID, code);
+  }
+}
+
+void HQSession::notifyPendingEgress() noexcept {
+  if (!isLoopCallbackScheduled() && !closed_) {
+    transport_->getEventBase()->runInLoop(this);
+  }
+}
+
+void HQSession::runLoopCallback() noexcept {
+  LoopMonitor::CallbackScope monitorScope("HQSession::runLoopCallback");
+  DestructorGuard dg(this);
+  while (!txnEgressQueue_.empty() && !closed_) {
+    auto txn = txnEgressQueue_.top();
+    uint64_t allowed = transport_->getWritableBytes(txn->getID());
+    if (allowed == 0) {
+      // out of the queue until the stream is writable again, only this
+      // transaction waits
+      VLOG(4) << *this << " streamID=" << txn->getID()
+              << " has no send window";
+      txn->pauseEgress();
+      continue;
+    }
+    txn->onWriteReady(
+      std::min<uint64_t>(allowed, std::numeric_limits<uint32_t>::max()));
+  }
+}
+
+void HQSession::detach(HTTPTransaction* txn) noexcept {
+  DestructorGuard dg(this);
+  HTTPCodec::StreamID streamID = txn->getID();
+  VLOG(4) << *this << " removing streamID=" << streamID;
+  transactions_.erase(streamID);
+  if (transactions_.empty()) {
+    resetTimeout();
+    if (draining_ && !closed_) {
+      transport_->close(false);
+      return;
+    }
+  }
+  checkForShutdown();
+}
+
+bool HQSession::getCurrentTransportInfo(folly::TransportInfo* tinfo) {
+  // no TCP_INFO, the QUIC implementation has the RTT of the connection
+  *tinfo = transportInfo_;
+  return false;
+}
+
+void HQSession::checkForShutdown() {
+  if (closed_ && transactions_.empty() && !isLoopCallbackScheduled()) {
+    VLOG(4) << "destroying " << *this;
+    destroy();
+  }
+}
+
+}
@@ -0,0 +1,207 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/experimental/wangle/ManagedConnection.h>
+#include <folly/experimental/wangle/acceptor/TransportInfo.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <proxygen/lib/http/codec/HQCodec.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/http/session/QuicTransport.h>
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
+#include <proxygen/lib/http/session/StreamTable.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+
+namespace proxygen {
+
+class HTTPSessionController;
+class HTTPSessionStats;
+
+/**
+ * An experimental downstream session for HTTP over QUIC, see HQCodec. It
+ * serves the requests of a QuicTransport with HTTPTransactions and the
+ * handlers of an HTTPSessionController, as HTTPDownstreamSession does on
+ * TCP, so the same handlers serve both.
+ *
+ * Each transaction has a QUIC stream of its own. Pausing the ingress of a
+ * transaction pauses the reads of its stream only, and a transaction
+ * whose stream has no send window left pauses its egress until the
+ * transport calls onStreamWritable(). The transactions with egress take
+ * turns in a RoundRobinEgressQueue, at the end of the loop.
+ *
+ * Not supported yet: push, which QUIC would do with server streams, and
+ * the GOAWAY of HTTP/2. A draining session refuses the new streams, the
+ * client retries them on a new connection.
+ */
+class HQSession:
+  private HTTPCodec::Callback,
+  private folly::EventBase::LoopCallback,
+  private QuicTransport::Callback,
+  public HTTPTransaction::Transport,
+  public folly::wangle::ManagedConnection {
+ public:
+  /**
+   * @param transactionTimeouts the timeouts of the transactions, which
+   *                            must outlive the session
+   * @param tinfo               the setup of the connection
+   */
+  HQSession(AsyncTimeoutSet* transactionTimeouts,
+            std::unique_ptr<QuicTransport> transport,
+            HTTPSessionController* controller,
+            const folly::TransportInfo& tinfo,
+            HTTPSessionStats* sessionStats = nullptr);
+
+  /**
+   * Start taking the streams of the transport
+   */
+  void startNow();
+
+  QuicTransport* getQuicTransport() const {
+    return transport_.get();
+  }
+
+  size_t getNumTransactions() const {
+    return transactions_.size();
+  }
+
+  // ManagedConnection methods
+  void timeoutExpired() noexcept override;
+  void describe(std::ostream& os) const override;
+  bool isBusy() const override;
+  void notifyPendingShutdown() override;
+  void closeWhenIdle() override;
+  void dropConnection() override;
+  void dumpConnectionState(uint8_t loglevel) override;
+
+  // HTTPTransaction::Transport methods
+  void pauseIngress(HTTPTransaction* txn) noexcept override;
+  void resumeIngress(HTTPTransaction* txn) noexcept override;
+  void transactionTimeout(HTTPTransaction* txn) noexcept override;
+  void sendHeaders(HTTPTransaction* txn,
+                   const HTTPMessage& headers,
+                   HTTPHeaderSize* size) noexcept override;
+  size_t sendBody(HTTPTransaction* txn,
+                  std::unique_ptr<folly::IOBuf> body,
+                  bool includeEOM) noexcept override;
+  size_t sendChunkHeader(HTTPTransaction* txn,
+                         size_t length) noexcept override {
+    return 0;
+  }
+  size_t sendChunkTerminator(HTTPTransaction* txn) noexcept override {
+    return 0;
+  }
+  size_t sendTrailers(HTTPTransaction* txn,
+                      const HTTPHeaders& trailers) noexcept override;
+  size_t sendEOM(HTTPTransaction* txn) noexcept override;
+  size_t sendAbort(HTTPTransaction* txn,
+                   ErrorCode statusCode) noexcept override;
+  size_t sendWindowUpdate(HTTPTransaction* txn,
+                          uint32_t bytes) noexcept override {
+    // the transport opens the windows as the session reads
+    return 0;
+  }
+  void notifyPendingEgress() noexcept override;
+  void detach(HTTPTransaction* txn) noexcept override;
+  void notifyIngressBodyProcessed(uint32_t bytes) noexcept override {}
+  void notifyEgressBodyBuffered(int64_t bytes) noexcept override {}
+  const folly::SocketAddress& getLocalAddress() const noexcept override {
+    return transport_->getLocalAddress();
+  }
+  const folly::SocketAddress& getPeerAddress() const noexcept override {
+    return transport_->getPeerAddress();
+  }
+  const folly::TransportInfo& getSetupTransportInfo() const noexcept
+    override {
+    return transportInfo_;
+  }
+  bool getCurrentTransportInfo(folly::TransportInfo* tinfo) override;
+  const HTTPCodec& getCodec() const noexcept override {
+    return codec_;
+  }
+  bool isDraining() const override {
+    return draining_;
+  }
+  HTTPTransaction* newPushedTransaction(
+    HTTPCodec::StreamID assocStreamId,
+    HTTPTransaction::PushHandler* handler,
+    int8_t priority) noexcept override {
+    return nullptr;
+  }
+
+ protected:
+  ~HQSession() override;
+
+ private:
+  // HTTPCodec::Callback methods
+  void onMessageBegin(HTTPCodec::StreamID streamID,
+                      HTTPMessage* msg) override;
+  void onPushMessageBegin(HTTPCodec::StreamID streamID,
+                          HTTPCodec::StreamID assocStreamID,
+                          HTTPMessage* msg) override {}
+  void onHeadersComplete(HTTPCodec::StreamID streamID,
+                         std::unique_ptr<HTTPMessage> msg) override;
+  void onBody(HTTPCodec::StreamID streamID,
+              std::unique_ptr<folly::IOBuf> chain) override;
+  void onTrailersComplete(HTTPCodec::StreamID streamID,
+                          std::unique_ptr<HTTPHeaders> trailers) override;
+  void onMessageComplete(HTTPCodec::StreamID streamID,
+                         bool upgrade) override;
+  void onError(HTTPCodec::StreamID streamID,
+               const HTTPException& error, bool newTxn) override;
+  uint32_t numIncomingStreams() const override {
+    return transactions_.size();
+  }
+
+  // QuicTransport::Callback methods
+  void onStreamData(QuicTransport::StreamID id,
+                    std::unique_ptr<folly::IOBuf> data,
+                    bool fin) noexcept override;
+  void onStreamReset(QuicTransport::StreamID id,
+                     ErrorCode code) noexcept override;
+  void onStreamWritable(QuicTransport::StreamID id) noexcept override;
+  void onConnectionEnd(bool error) noexcept override;
+
+  // EventBase::LoopCallback method, writes the egress of the transactions
+  void runLoopCallback() noexcept override;
+
+  /**
+   * Reset a stream that has or gets no transaction
+   */
+  void resetStream(HTTPCodec::StreamID streamID, ErrorCode code);
+
+  /**
+   * Hand the bytes the codec wrote to the stream
+   */
+  void writeStream(HTTPCodec::StreamID streamID, folly::IOBufQueue& buf,
+                   bool fin);
+
+  /**
+   * Destroy the session once the connection ended and the transactions
+   * are gone
+   */
+  void checkForShutdown();
+
+  AsyncTimeoutSet* transactionTimeouts_;
+  std::unique_ptr<QuicTransport> transport_;
+  HTTPSessionController* controller_;
+  folly::TransportInfo transportInfo_;
+  HTTPSessionStats* sessionStats_;
+  HQCodec codec_{TransportDirection::DOWNSTREAM};
+  RoundRobinEgressQueue txnEgressQueue_;
+  StreamTable<HTTPTransaction> transactions_;
+  uint32_t transactionSeqNo_{0};
+  bool started_{false};
+  bool draining_{false};
+  // the transport called onConnectionEnd()
+  bool closed_{false};
+};
+
+}
@@ -10,7 +10,10 @@
 #include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
 
 #include <folly/Conv.h>
+#include <folly/ThreadLocal.h>
+#include <proxygen/lib/http/RFC2616.h>
 #include <proxygen/lib/http/session/HTTPErrorPage.h>
+#include <vector>
 
 using folly::IOBuf;
 using std::string;
@@ -18,6 +21,57 @@ using std::unique_ptr;
 
 namespace proxygen {
 
+namespace {
+
+// the canned responses of a thread; there are a handful of distinct ones,
+// past kMaxCannedResponses the others are built each time
+const size_t kMaxCannedResponses = 32;
+
+struct CannedEntry {
+  unsigned statusCode;
+  string statusMessage;
+  // 0 without an error page
+  uint64_t errorPageId;
+  std::shared_ptr<const HTTPCannedResponse> response;
+};
+
+}
+
+std::shared_ptr<const HTTPCannedResponse>
+HTTPDirectResponseHandler::getCannedResponse(unsigned statusCode,
+                                             const string& statusMsg,
+                                             const HTTPErrorPage* errorPage) {
+  if (statusCode < 200 ||
+      RFC2616::responseBodyMustBeEmpty(statusCode) ||
+      (errorPage && !errorPage->isStatic())) {
+    return nullptr;
+  }
+
+  static folly::ThreadLocal<std::vector<CannedEntry>> cache;
+  const uint64_t errorPageId = errorPage ? errorPage->getId() : 0;
+  for (const auto& entry: *cache) {
+    if (entry.statusCode == statusCode && entry.errorPageId == errorPageId &&
+        entry.statusMessage == statusMsg) {
+      return entry.response;
+    }
+  }
+
+  HTTPHeaders headers;
+  unique_ptr<IOBuf> body;
+  if (errorPage) {
+    HTTPErrorPage::Page page = errorPage->generate(0, statusCode, statusMsg,
+                                                   nullptr, empty_string);
+    headers.add(HTTP_HEADER_CONTENT_TYPE, page.contentType);
+    body = std::move(page.content);
+  }
+  auto response = std::make_shared<const HTTPCannedResponse>(
+    statusCode, statusMsg, std::move(headers), std::move(body));
+  if (cache->size() < kMaxCannedResponses) {
+    cache->push_back({statusCode, statusMsg, errorPageId, response});
+  }
+  return response;
+}
+
 HTTPDirectResponseHandler::HTTPDirectResponseHandler(
     unsigned statusCode, const std::string& statusMsg,
     const HTTPErrorPage* errorPage):
@@ -48,6 +102,26 @@ HTTPDirectResponseHandler::onHeadersComplete(
     std::unique_ptr<HTTPMessage> msg) noexcept {
   VLOG(4) << "processing request";
   headersSent_ = true;
+  auto canned = getCannedResponse(
+    statusCode_,
+    statusMessage_.empty() ? HTTPMessage::getDefaultReason(statusCode_)
+                           : statusMessage_,
+    errorPage_);
+  if (canned) {
+    HTTPMessage response(canned->getMessage());
+    response.setCannedResponse(canned);
+    if (forceConnectionClose_) {
+      // the codec writes "Connection: close" then, without making the
+      // head differ from the canned one
+      response.setWantsKeepalive(false);
+    }
+    txn_->sendHeaders(response);
+    if (canned->getBody()) {
+      txn_->sendBody(canned->getBody()->clone());
+    }
+    return;
+  }
+
   HTTPMessage response;
   std::unique_ptr<folly::IOBuf> responseBody;
   response.setHTTPVersion(1, 1);
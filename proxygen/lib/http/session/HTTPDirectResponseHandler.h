@@ -9,18 +9,38 @@
  */
 #pragma once
 
+#include <memory>
+#include <proxygen/lib/http/HTTPCannedResponse.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 
 namespace proxygen {
 
 class HTTPErrorPage;
 
+/**
+ * Answers a request with a fixed status and, optionally, an error page,
+ * e.g. for parse errors, timeouts and overload.
+ *
+ * Those come in floods exactly when the server is stressed, so unless the
+ * page depends on the request, the response is built and serialized once
+ * per thread, as an HTTPCannedResponse, and each handler only sends a copy
+ * of its head and a clone of its body.
+ */
 class HTTPDirectResponseHandler:
   public HTTPTransaction::Handler {
 public:
   HTTPDirectResponseHandler(unsigned statusCode, const std::string& statusMsg,
       const HTTPErrorPage* errorPage = nullptr);
 
+  /**
+   * @return the canned response of this thread for statusCode, statusMsg
+   *         and errorPage, or nullptr if it can't be canned: errorPage is
+   *         not static, or the status has no body
+   */
+  static std::shared_ptr<const HTTPCannedResponse> getCannedResponse(
+    unsigned statusCode, const std::string& statusMsg,
+    const HTTPErrorPage* errorPage);
+
   void forceConnectionClose(bool close) {
     forceConnectionClose_ = close;
   }
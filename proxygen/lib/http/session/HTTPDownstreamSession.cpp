@@ -78,12 +78,14 @@ HTTPDownstreamSession::onHeadersSent(const HTTPMessage& headers,
 }
 
 bool HTTPDownstreamSession::allTransactionsStarted() const {
-  for (const auto& txn: transactions_) {
-    if (txn.second.isPushed() && !txn.second.isEgressStarted()) {
-      return false;
-    }
-  }
-  return true;
+  bool started = true;
+  transactions_.forEach(
+    [&started] (HTTPCodec::StreamID, const HTTPTransaction& txn) {
+      if (txn.isPushed() && !txn.isEgressStarted()) {
+        started = false;
+      }
+    });
+  return started;
 }
 
 } // proxygen
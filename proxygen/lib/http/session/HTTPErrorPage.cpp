@@ -9,12 +9,23 @@
  */
 #include <proxygen/lib/http/session/HTTPErrorPage.h>
 
+#include <atomic>
 #include <folly/io/IOBuf.h>
 
 using std::string;
 
 namespace proxygen {
 
+namespace {
+
+std::atomic<uint64_t> nextErrorPageId{1};
+
+}
+
+HTTPErrorPage::HTTPErrorPage():
+    id_(nextErrorPageId.fetch_add(1, std::memory_order_relaxed)) {
+}
+
 HTTPStaticErrorPage::HTTPStaticErrorPage(std::unique_ptr<folly::IOBuf> content,
                                          const string& contentType):
     content_(std::move(content)),
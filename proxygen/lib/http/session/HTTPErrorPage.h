@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -38,13 +39,34 @@ public:
     std::unique_ptr<folly::IOBuf> content;
   };
 
+  HTTPErrorPage();
   virtual ~HTTPErrorPage() {}
 
+  /**
+   * @return an id that no other error page of the process has, even once
+   *         this one is gone
+   */
+  uint64_t getId() const {
+    return id_;
+  }
+
+  /**
+   * @return true if generate() gives the same page for a status whatever
+   *         the request, so that the responses with it can be serialized
+   *         once, see HTTPDirectResponseHandler
+   */
+  virtual bool isStatic() const {
+    return false;
+  }
+
   virtual Page generate(uint64_t requestID,
                         unsigned httpStatusCode,
                         const std::string& reason,
                         std::unique_ptr<folly::IOBuf> body,
                         const std::string& detailReason) const = 0;
+
+private:
+  const uint64_t id_;
 };
 
 /**
@@ -62,6 +84,10 @@ public:
                 std::unique_ptr<folly::IOBuf> body,
                 const std::string& detailReason) const override;
 
+  bool isStatic() const override {
+    return true;
+  }
+
 private:
   std::unique_ptr<folly::IOBuf> content_;
   std::string contentType_;
@@ -10,9 +10,24 @@
 #include <proxygen/lib/http/session/HTTPEvent.h>
 
 #include <iostream>
+#include <proxygen/lib/utils/UtilInl.h>
 
 namespace proxygen {
 
+size_t HTTPEvent::getMemoryUsage() const {
+  size_t bytes = sizeof(HTTPEvent);
+  if (headers_) {
+    bytes += headers_->getMemoryUsage();
+  }
+  if (body_) {
+    bytes += chainCapacity(*body_);
+  }
+  if (trailers_) {
+    bytes += sizeof(HTTPHeaders) + trailers_->getMemoryUsage();
+  }
+  return bytes;
+}
+
 std::ostream& operator<<(std::ostream& os, HTTPEvent::Type e) {
   switch (e) {
     case HTTPEvent::Type::MESSAGE_BEGIN:
@@ -108,6 +108,11 @@ class HTTPEvent {
     return protocol_;
   }
 
+  /**
+   * Bytes the event holds, sizeof(HTTPEvent) included
+   */
+  size_t getMemoryUsage() const;
+
  private:
   std::unique_ptr<HTTPMessage> headers_;
   std::unique_ptr<folly::IOBuf> body_;
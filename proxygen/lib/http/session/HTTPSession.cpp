@@ -9,14 +9,38 @@
  */
 #include <proxygen/lib/http/session/HTTPSession.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
+#include <folly/dynamic.h>
 #include <folly/experimental/wangle/ConnectionManager.h>
 #include <folly/experimental/wangle/acceptor/SocketOptions.h>
+#include <folly/io/Cursor.h>
+#include <functional>
+#include <limits>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <openssl/err.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
+#ifdef PROXYGEN_HTTP1_ONLY
+#include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#else
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+#include <proxygen/lib/http/codec/HTTP2Constants.h>
+#endif
 #include <proxygen/lib/http/codec/HTTPChecks.h>
+#include <proxygen/lib/http/session/DependencyTreeEgressQueue.h>
 #include <proxygen/lib/http/session/HTTPSessionController.h>
 #include <proxygen/lib/http/session/HTTPSessionStats.h>
+#include <proxygen/lib/http/session/HeaderTableBudget.h>
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
+#include <proxygen/lib/http/session/StreamLimit.h>
+#include <proxygen/lib/http/session/TimestampingByteEventTracker.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+#include <proxygen/lib/utils/ReadBufferPool.h>
+#include <proxygen/lib/utils/UtilInl.h>
 #include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
 
 using apache::thrift::async::TAsyncSSLSocket;
@@ -34,12 +58,16 @@ using std::unique_ptr;
 using std::vector;
 
 namespace {
+// Smallest tailroom worth reading into, one TCP segment
 static const uint32_t kMinReadSize = 1460;
-static const uint32_t kMaxReadSize = 4000;
+// Size of the first read of a session
+static const uint32_t kInitialReadSize = 4096;
+
+// Header table capacity of idle sessions when the budget is exceeded
+static const uint32_t kIdleHeaderTableSize = 0;
 
-// Lower = higher latency, better prioritization
-// Higher = lower latency, less prioritization
-static const uint32_t kMaxWritesPerLoop = 32;
+// Paths that wasRecentlyFetched() remembers
+static const uint32_t kMaxRecentFetches = 32;
 
 } // anonymous namespace
 
@@ -47,6 +75,37 @@ namespace proxygen {
 
 uint32_t HTTPSession::kDefaultReadBufLimit = 65536;
 uint32_t HTTPSession::kPendingWriteMax = 8192;
+const uint32_t HTTPSession::kMaxWritesPerLoop;
+const uint32_t HTTPSession::kDefaultMaxConcurrentIncomingStreams;
+
+#ifndef PROXYGEN_HTTP1_ONLY
+namespace {
+
+const string kHTTP2Settings("HTTP2-Settings");
+
+/**
+ * A request may upgrade to h2c if it has no body, and exactly one
+ * HTTP2-Settings header, which the Connection header names too, see
+ * RFC 7540 section 3.2. Upgrades with a body would need the body to be
+ * read over HTTP/1.1 while the response goes out over HTTP/2.
+ */
+bool isH2CUpgradeRequest(const HTTPMessage& msg) {
+  const auto& headers = msg.getHeaders();
+  if (!msg.isHTTP1_1() || msg.getIsChunked() ||
+      msg.getMethod() == HTTPMethod::CONNECT ||
+      headers.getNumberOfValues(kHTTP2Settings) != 1 ||
+      !msg.checkForHeaderToken(HTTP_HEADER_UPGRADE, "h2c", false) ||
+      !msg.checkForHeaderToken(HTTP_HEADER_CONNECTION, "upgrade", false) ||
+      !msg.checkForHeaderToken(HTTP_HEADER_CONNECTION, "http2-settings",
+                               false)) {
+    return false;
+  }
+  return !headers.exists(HTTP_HEADER_CONTENT_LENGTH) ||
+    headers.getSingleOrEmpty(HTTP_HEADER_CONTENT_LENGTH) == "0";
+}
+
+}
+#endif
 
 HTTPSession::WriteSegment::WriteSegment(
     HTTPSession* session,
@@ -108,16 +167,11 @@ HTTPSession::HTTPSession(
   unique_ptr<HTTPCodec> codec,
   const TransportInfo& tinfo,
   InfoCallback* infoCallback):
-    localAddr_(localAddr),
-    peerAddr_(peerAddr),
-    sock_(std::move(sock)),
-    controller_(controller),
-    codec_(std::move(codec)),
-    infoCallback_(infoCallback),
-    writeTimeout_(this),
-    transactionTimeouts_(CHECK_NOTNULL(transactionTimeouts)),
-    transportInfo_(tinfo),
-    direction_(codec_->getTransportDirection()),
+    readSize_(ReadBufferPool::kMinBufferSize,
+              kInitialReadSize,
+              ReadBufferPool::kMaxBufferSize),
+    // codec_ isn't constructed yet
+    direction_(codec->getTransportDirection()),
     reads_(SocketState::PAUSED),
     writes_(SocketState::UNPAUSED),
     draining_(false),
@@ -126,14 +180,48 @@ HTTPSession::HTTPSession(
     writesDraining_(false),
     resetAfterDrainingWrites_(false),
     ingressError_(false),
-    inLoopCallback_(false) {
+    inLoopCallback_(false),
+    h2cSniffing_(false),
+    sock_(std::move(sock)),
+    controller_(controller),
+    codec_(std::move(codec)),
+    infoCallback_(infoCallback),
+    writeTimeout_(this),
+    transactionTimeouts_(CHECK_NOTNULL(transactionTimeouts)),
+    localAddr_(localAddr),
+    peerAddr_(peerAddr),
+    transportInfo_(tinfo) {
+#ifdef PROXYGEN_HTTP1_ONLY
+  http1xCodec_ = CHECK_NOTNULL(dynamic_cast<HTTP1xCodec*>(codec_.call()));
+#endif
 
-  codec_.add<HTTPChecks>();
+  if (codec_->supportsSessionFlowControl()) {
+    // the usual filters, as one
+    auto filter = folly::make_unique<WithHTTPChecks<FlowControlFilter>>(
+      *this, writeBuf_, codec_.call(), kDefaultReadBufLimit);
+    connFlowControl_ = filter.get();
+    codec_.addFilters(std::move(filter));
+  } else {
+    codec_.add<HTTPChecks>();
+  }
+  codec_->setHeaderCodecStats(&headerCompressionStats_);
+
+  if (codec_->getProtocol() == CodecProtocol::HTTP_2) {
+    txnEgressQueue_.reset(new DependencyTreeEgressQueue());
+  } else {
+    txnEgressQueue_.reset(new RoundRobinEgressQueue());
+  }
 
   if (!codec_->supportsParallelRequests()) {
     // until we support upstream pipelining
     maxConcurrentIncomingStreams_ = 1;
     maxConcurrentOutgoingStreamsConfig_ = isDownstream() ? 0 : 1;
+  } else if (isDownstream()) {
+    auto& limit = StreamLimit::get();
+    streamLimitGeneration_ = limit.getGeneration();
+    if (limit.getLimit() > 0) {
+      maxConcurrentIncomingStreams_ = limit.getLimit();
+    }
   }
 
   HTTPSettings* settings = codec_->getEgressSettings();
@@ -141,18 +229,16 @@ HTTPSession::HTTPSession(
     settings->setSetting(SettingsId::MAX_CONCURRENT_STREAMS,
                          maxConcurrentIncomingStreams_);
   }
-  if (codec_->supportsSessionFlowControl()) {
-    connFlowControl_ = new FlowControlFilter(*this,
-                                             writeBuf_,
-                                             codec_.call(),
-                                             kDefaultReadBufLimit);
-    codec_.addFilters(std::unique_ptr<FlowControlFilter>(connFlowControl_));
-  }
-
   if (!codec_->supportsPushTransactions()) {
     maxConcurrentPushTransactions_ = 0;
   }
 
+  // the encoder and the decoder table
+  headerTableSize_ = codec_->getHeaderTableSize();
+  curHeaderTableSize_ = headerTableSize_;
+  HeaderTableBudget::get().add(2 * curHeaderTableSize_);
+  MemoryBudget::get().add(*this);
+
   // If we receive IPv4-mapped IPv6 addresses, convert them to IPv4.
   localAddr_.tryConvertToIPv4();
   peerAddr_.tryConvertToIPv4();
@@ -168,12 +254,25 @@ HTTPSession::HTTPSession(
 }
 
 HTTPSession::~HTTPSession() {
-  VLOG(4) << *this << " closing";
+  VLOG(4) << *this << " closing after " << numReads_ << " reads and "
+          << numWrites_ << " writes";
 
   CHECK(transactions_.empty());
-  CHECK(txnEgressQueue_.empty());
+  CHECK(txnEgressQueue_->empty());
   DCHECK(!sock_->getReadCallback());
 
+  HeaderTableBudget::get().remove(2 * curHeaderTableSize_);
+  if (egressFlusher_) {
+    egressFlusher_->cancel(this);
+  }
+  if (egressShaper_) {
+    egressShaper_->cancel(this);
+  }
+  if (sessionStats_) {
+    sessionStats_->recordHeaderCompression(headerCompressionStats_);
+    sessionStats_->recordTransportCalls(numReads_, bytesRead_,
+                                        numWrites_, bytesWritten_);
+  }
   if (infoCallback_) {
     infoCallback_->onDestroy(*this);
   }
@@ -209,6 +308,7 @@ void HTTPSession::setFlowControl(size_t initialReceiveWindow,
   CHECK(!started_);
   initialReceiveWindow_ = initialReceiveWindow;
   receiveStreamWindowSize_ = receiveStreamWindowSize;
+  receiveSessionWindowSize_ = receiveSessionWindowSize;
   HTTPSettings* settings = codec_->getEgressSettings();
   if (settings) {
     settings->setSetting(SettingsId::INITIAL_WINDOW_SIZE,
@@ -220,6 +320,15 @@ void HTTPSession::setFlowControl(size_t initialReceiveWindow,
   }
 }
 
+void HTTPSession::setWindowUpdateThresholds(uint32_t streamThreshold,
+                                            uint32_t connThreshold) {
+  streamWindowUpdateThreshold_ = streamThreshold;
+  connWindowUpdateThreshold_ = connThreshold;
+  if (connFlowControl_) {
+    connFlowControl_->setWindowUpdateThreshold(connThreshold);
+  }
+}
+
 void HTTPSession::setMaxConcurrentOutgoingStreams(uint32_t num) {
   CHECK(!started_);
   if (codec_->supportsParallelRequests()) {
@@ -227,6 +336,24 @@ void HTTPSession::setMaxConcurrentOutgoingStreams(uint32_t num) {
   }
 }
 
+void HTTPSession::setMaxConcurrentIncomingStreams(uint32_t num) {
+  if (!codec_->supportsParallelRequests() ||
+      num == maxConcurrentIncomingStreams_) {
+    return;
+  }
+  VLOG(4) << *this << " advertising max concurrent streams=" << num;
+  maxConcurrentIncomingStreams_ = num;
+  HTTPSettings* settings = codec_->getEgressSettings();
+  if (!settings) {
+    return;
+  }
+  settings->setSetting(SettingsId::MAX_CONCURRENT_STREAMS, num);
+  if (started_ && !writesShutdown() &&
+      codec_->generateSettings(writeBuf_) > 0) {
+    scheduleWrite();
+  }
+}
+
 void HTTPSession::setMaxConcurrentPushTransactions(uint32_t num) {
   CHECK(!started_);
   if (codec_->supportsPushTransactions()) {
@@ -234,6 +361,96 @@ void HTTPSession::setMaxConcurrentPushTransactions(uint32_t num) {
   }
 }
 
+void HTTPSession::setPriorityWeights(const std::vector<uint32_t>& weights) {
+  setEgressQueue(folly::make_unique<RoundRobinEgressQueue>(weights));
+}
+
+void HTTPSession::setEgressQueue(std::unique_ptr<EgressQueue> queue) {
+  CHECK(transactions_.empty());
+  txnEgressQueue_ = std::move(queue);
+}
+
+#ifndef PROXYGEN_HTTP1_ONLY
+void HTTPSession::setH2CCodec(std::unique_ptr<HTTP2Codec> codec) {
+  CHECK(!started_);
+  CHECK(isDownstream());
+  CHECK(codec->getTransportDirection() == TransportDirection::DOWNSTREAM);
+  DCHECK(!codec_->supportsParallelRequests());
+  h2cCodec_ = std::move(codec);
+  h2cSniffing_ = true;
+}
+
+bool HTTPSession::sniffH2CPreface() {
+  const string& preface = http2::kConnectionPreface;
+  const size_t avail = std::min(readBuf_.chainLength(), preface.size());
+  string start(avail, '\0');
+  folly::io::Cursor(readBuf_.front()).pull(&start[0], avail);
+  if (preface.compare(0, avail, start) != 0) {
+    // HTTP/1.x, which may still ask for an Upgrade
+    h2cSniffing_ = false;
+    return true;
+  }
+  if (avail < preface.size()) {
+    return false;
+  }
+  VLOG(4) << *this << " got the HTTP/2 connection preface";
+  installH2CCodec();
+  return true;
+}
+
+bool HTTPSession::upgradeToH2C(HTTPTransaction* txn,
+                               const HTTPMessage& msg) {
+  if (txn->getID() != 1 || !isH2CUpgradeRequest(msg) ||
+      !h2cCodec_->onIngressUpgrade(
+        msg.getHeaders().getSingleOrEmptyView(kHTTP2Settings))) {
+    return false;
+  }
+  VLOG(4) << *this << " upgrading to h2c";
+  HTTPMessage response;
+  response.setHTTPVersion(1, 1);
+  response.setStatusCode(101);
+  response.setStatusMessage("Switching Protocols");
+  response.getHeaders().set(HTTP_HEADER_UPGRADE, "h2c");
+  codec_->generateHeader(writeBuf_, txn->getID(), response);
+  installH2CCodec();
+  // the request was the only one, and the response goes out as HTTP/2
+  pipelinedEgress_.clear();
+  txn->enableFlowControl(getCodecSendWindowSize());
+  return true;
+}
+
+void HTTPSession::installH2CCodec() {
+  DCHECK(h2cCodec_);
+  h2cSniffing_ = false;
+  // The HTTP/1.x codec may be the one parsing, and calling back, right
+  // now. It stops after the upgrade request, see processReadData().
+  retiredCodec_ = codec_.setDestination(std::move(h2cCodec_));
+  codec_->setHeaderCodecStats(&headerCompressionStats_);
+
+  maxConcurrentIncomingStreams_ = kDefaultMaxConcurrentIncomingStreams;
+  HTTPSettings* settings = codec_->getEgressSettings();
+  settings->setSetting(SettingsId::MAX_CONCURRENT_STREAMS,
+                       maxConcurrentIncomingStreams_);
+  settings->setSetting(SettingsId::INITIAL_WINDOW_SIZE,
+                       initialReceiveWindow_);
+
+  HeaderTableBudget::get().remove(2 * curHeaderTableSize_);
+  headerTableSize_ = codec_->getHeaderTableSize();
+  curHeaderTableSize_ = headerTableSize_;
+  HeaderTableBudget::get().add(2 * curHeaderTableSize_);
+
+  codec_->generateConnectionPreface(writeBuf_);
+  codec_->generateSettings(writeBuf_);
+  connFlowControl_ = new FlowControlFilter(*this,
+                                           writeBuf_,
+                                           codec_.call(),
+                                           receiveSessionWindowSize_);
+  connFlowControl_->setWindowUpdateThreshold(connWindowUpdateThreshold_);
+  codec_.addFilters(std::unique_ptr<FlowControlFilter>(connFlowControl_));
+  scheduleWrite();
+}
+#endif
+
 void
 HTTPSession::readTimeoutExpired() noexcept {
   VLOG(3) << "session-level timeout on " << *this;
@@ -333,6 +550,11 @@ HTTPSession::dropConnection() {
 
 void
 HTTPSession::dumpConnectionState(uint8_t loglevel) {
+  auto usage = getMemoryUsage();
+  VLOG(loglevel) << *this << " holds " << usage.total() << " bytes: read "
+                 << usage.readBuffer << ", write " << usage.writeBuffer
+                 << ", " << transactions_.size() << " transactions "
+                 << usage.transactions << ", codec " << usage.codec;
 }
 
 bool HTTPSession::isUpstream() const {
@@ -345,8 +567,19 @@ bool HTTPSession::isDownstream() const {
 
 void
 HTTPSession::getReadBuffer(void** buf, size_t* bufSize) {
+  if (byteEventTracker_) {
+    byteEventTracker_->preRead();
+  }
+  if (zeroCopyWriter_) {
+    // the completions wake up the reads of the socket too
+    zeroCopyWriter_->readCompletions();
+  }
+  const IOBuf* head = readBuf_.front();
+  if (!head || head->prev()->tailroom() < kMinReadSize) {
+    readBuf_.append(ReadBufferPool::get().acquire(readSize_.getSize()));
+  }
   pair<void*,uint32_t> readSpace = readBuf_.preallocate(kMinReadSize,
-                                                        kMaxReadSize);
+                                                        readSize_.getSize());
   *buf = readSpace.first;
   *bufSize = readSpace.second;
 }
@@ -355,9 +588,14 @@ void
 HTTPSession::readDataAvailable(size_t readSize) noexcept {
   VLOG(10) << "read completed on " << *this << ", bytes=" << readSize;
 
+  LoopMonitor::CallbackScope monitorScope("HTTPSession::readDataAvailable");
   DestructorGuard dg(this);
   resetTimeout();
   readBuf_.postallocate(readSize);
+  readSize_.onRead(readSize);
+  numReads_++;
+  bytesRead_ += readSize;
+  lastReadTime_ = getCurrentTime();
 
   if (infoCallback_) {
     infoCallback_->onRead(*this, readSize);
@@ -367,7 +605,7 @@ HTTPSession::readDataAvailable(size_t readSize) noexcept {
 }
 
 void
-HTTPSession::processReadData() {
+HTTPSession::processReadData(bool withBudget) {
   // Pass the ingress data through the codec to parse it. The codec
   // will invoke various methods of the HTTPSession as callbacks.
   const IOBuf* currentReadBuf;
@@ -375,20 +613,74 @@ HTTPSession::processReadData() {
   // TAsyncTransport saw fd activity so asked for a read buffer, but it was
   // SSL traffic and not enough to decrypt a whole record.  Later we invoke
   // this function from the loop callback.
+  auto& messagePool = ObjectPool<HTTPMessage>::get();
+  uint64_t messagePoolHits = messagePool.getHits();
+  uint64_t messagePoolMisses = messagePool.getMisses();
+#ifndef PROXYGEN_HTTP1_ONLY
+  if (h2cSniffing_ && !sniffH2CPreface()) {
+    // wait for the rest of the preface
+    return;
+  }
+#endif
+  uint64_t budget = (withBudget && ingressBudget_) ?
+    ingressBudget_ : std::numeric_limits<uint64_t>::max();
   while (!ingressError_ &&
          readsUnpaused() &&
+         budget > 0 &&
          ((currentReadBuf = readBuf_.front()) != nullptr &&
-          currentReadBuf->length() != 0)) {
-    // We're about to parse, make sure the parser is not paused
+          readBuf_.chainLength() != 0)) {
+    // We're about to parse, make sure the parser is not paused. The codec
+    // takes the whole chain, the buffers don't need to be coalesced.
     codec_->setParserPaused(false);
-    size_t bytesParsed = codec_->onIngress(*currentReadBuf);
+    size_t bytesParsed = 0;
+    if (readBuf_.chainLength() > budget) {
+      // only what is left of the budget, unless that doesn't even hold
+      // the frame the codec is at
+      folly::IOBufQueue prefix;
+      prefix.append(currentReadBuf->clone());
+      bytesParsed = passThroughCodec()->onIngress(*prefix.split(budget));
+    }
+    if (bytesParsed == 0) {
+      bytesParsed = passThroughCodec()->onIngress(*currentReadBuf);
+    }
+    budget -= std::min<uint64_t>(budget, bytesParsed);
+#ifndef PROXYGEN_HTTP1_ONLY
+    // After an Upgrade to h2c, the HTTP/1.x codec paused itself after the
+    // request, and the rest goes to the new codec
+    retiredCodec_.reset();
+#endif
     if (bytesParsed == 0) {
       // If the codec didn't make any progress with current input, we
       // better get more.
       break;
     }
-    readBuf_.trimStart(bytesParsed);
+    if (bytesParsed == readBuf_.chainLength()) {
+      // keep the buffers for the next read of any session
+      ReadBufferPool::get().recycle(readBuf_.move());
+    } else {
+      readBuf_.trimStart(bytesParsed);
+    }
+  }
+  if (readBuf_.front() && readBuf_.chainLength() == 0) {
+    // nothing left to parse, don't hold on to the buffer while idle
+    ReadBufferPool::get().recycle(readBuf_.move());
   }
+  if (budget == 0 && !ingressError_ && readsUnpaused() &&
+      readBuf_.chainLength() != 0 && !isLoopCallbackScheduled()) {
+    // over the budget, the rest is parsed from the loop callback, after
+    // the reads of the other sessions of the loop
+    VLOG(4) << *this << " yielding with " << readBuf_.chainLength()
+            << " bytes to parse";
+    sock_->getEventBase()->runInLoop(this);
+  }
+  if (sessionStats_) {
+    // the messages parsed by the codec, and the ones the handlers built
+    // from the callbacks
+    sessionStats_->recordMessagePoolLookups(
+      messagePool.getHits() - messagePoolHits,
+      messagePool.getMisses() - messagePoolMisses);
+  }
+  updateMemoryUsage();
 }
 
 void
@@ -403,6 +695,11 @@ HTTPSession::readEOF() noexcept {
     infoCallback_->onIngressError(*this, kErrorClientSilent);
   }
 
+  if (ingressBudget_ && readBuf_.chainLength() != 0) {
+    // what was left over the budget comes before the EOF
+    processReadData(false);
+  }
+
   // Shut down reads, and also shut down writes if there are no
   // transactions.  (If there are active transactions, leave the
   // write side of the socket open so those transactions can
@@ -464,12 +761,35 @@ HTTPSession::newPushedTransaction(HTTPCodec::StreamID assocStreamId,
   return txn;
 }
 
+void HTTPSession::recordFetched(const string& path) noexcept {
+  if (!codec_->supportsPushTransactions() || path.empty()) {
+    return;
+  }
+  size_t hash = std::hash<string>()(path);
+  if (recentFetches_.size() < kMaxRecentFetches) {
+    recentFetches_.push_back(hash);
+    return;
+  }
+  recentFetches_[nextRecentFetch_] = hash;
+  nextRecentFetch_ = (nextRecentFetch_ + 1) % kMaxRecentFetches;
+}
+
+bool HTTPSession::wasRecentlyFetched(const string& path) const noexcept {
+  if (recentFetches_.empty()) {
+    return false;
+  }
+  size_t hash = std::hash<string>()(path);
+  return std::find(recentFetches_.begin(), recentFetches_.end(), hash) !=
+    recentFetches_.end();
+}
+
 size_t HTTPSession::getCodecSendWindowSize() const {
   const HTTPSettings* settings = codec_->getIngressSettings();
   if (settings) {
-    return settings->getSetting(SettingsId::INITIAL_WINDOW_SIZE, 65536);
+    return settings->getSetting(SettingsId::INITIAL_WINDOW_SIZE,
+                                codec_->getDefaultWindowSize());
   }
-  return 65536;
+  return codec_->getDefaultWindowSize();
 }
 
 void
@@ -536,6 +856,10 @@ HTTPSession::onMessageBeginImpl(HTTPCodec::StreamID streamID,
     // This could happen if the socket is bad.
     return nullptr;
   }
+  txn->setFirstByteReadTime(lastReadTime_);
+  if (msg && msg->getHTTP2Priority()) {
+    txn->updatePriority(*msg->getHTTP2Priority());
+  }
 
   if (assocStream && !assocStream->onPushedTransaction(txn)) {
     VLOG(1) << "Failed to add pushed transaction " << streamID << " on "
@@ -546,11 +870,32 @@ HTTPSession::onMessageBeginImpl(HTTPCodec::StreamID streamID,
     return nullptr;
   }
 
-  if (!codec_->supportsParallelRequests() && transactions_.size() > 1) {
+  if (isPipelining()) {
+    auto& egress = pipelinedEgress_[streamID];
+    if (pipelinedEgress_.size() == 1) {
+      egress.head = true;
+    } else {
+      // its response waits for the ones before it
+      txn->pauseEgress();
+    }
+    if (transactions_.size() > 1) {
+      // The ingress of the previous transactions is complete; only this
+      // one reads, the others only count toward the limits.
+      transactions_.forEach(
+        [txn] (HTTPCodec::StreamID, HTTPTransaction& other) {
+          if (&other != txn && !other.isIngressPaused()) {
+            DCHECK(other.isIngressComplete());
+            other.pauseIngress();
+          }
+        });
+      updatePipelinePauseState();
+    }
+  } else if (!codec_->supportsParallelRequests() &&
+             transactions_.size() > 1) {
     // The previous transaction hasn't completed yet. Pause reads until
     // it completes; this requires pausing both transactions.
     DCHECK(transactions_.size() == 2);
-    auto prevTxn = &transactions_.begin()->second;
+    auto prevTxn = transactions_.front();
     if (!prevTxn->isIngressPaused()) {
       DCHECK(prevTxn->isIngressComplete());
       prevTxn->pauseIngress();
@@ -583,6 +928,18 @@ HTTPSession::onHeadersComplete(HTTPCodec::StreamID streamID,
   }
   msg->setSecureInfo(transportInfo_.sslVersion, transportInfo_.sslCipher);
   msg->setSecure(transportInfo_.ssl);
+  if (isDownstream()) {
+    recordFetched(msg->getPath());
+    // the headers are in, the rest is timed as any transaction
+    txn->setTransactionTimeouts(transactionTimeouts_);
+  }
+
+#ifndef PROXYGEN_HTTP1_ONLY
+  if (h2cCodec_ && !upgradeToH2C(txn, *msg)) {
+    // only the first request may upgrade
+    h2cCodec_.reset();
+  }
+#endif
 
   setupOnHeadersComplete(txn, msg.get());
 
@@ -634,6 +991,19 @@ HTTPSession::onBody(HTTPCodec::StreamID streamID,
   }
 }
 
+void HTTPSession::onPadding(HTTPCodec::StreamID streamID,
+                            uint16_t bytes) {
+  // The padding was counted against both flow control windows by the peer,
+  // but is never seen by the transaction, so it is acked right away.
+  VLOG(5) << *this << " acking " << bytes << " bytes of padding on streamID="
+          << streamID;
+  HTTPTransaction* txn = findTransaction(streamID);
+  if (txn) {
+    sendWindowUpdate(txn, bytes);
+  }
+  connIngressBytesProcessed(bytes);
+}
+
 void HTTPSession::onChunkHeader(HTTPCodec::StreamID streamID,
                                 size_t length) {
   // The codec's parser detected a chunk header (meaning that this
@@ -803,8 +1173,8 @@ void HTTPSession::onAbort(HTTPCodec::StreamID streamID,
       << streamID;
     return;
   }
-  HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS);
-  ex.setProxygenError(kErrorStreamAbort);
+  HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS,
+                   kErrorStreamAbort);
   DestructorGuard dg(this);
   if (isDownstream() && txn->getAssocTxnId() == 0 &&
       code == ErrorCode::CANCEL) {
@@ -832,13 +1202,13 @@ void HTTPSession::onGoaway(uint64_t lastGoodStreamID,
   // successfully at the remote end. Upstream transactions are created
   // with odd transaction IDs and downstream transactions with even IDs.
   vector<HTTPCodec::StreamID> ids;
-  for (const auto& txn: transactions_) {
-    auto streamID = txn.first;
-    if (((bool)(streamID & 0x01) == isUpstream()) &&
-        (streamID > lastGoodStreamID)) {
-      ids.push_back(streamID);
-    }
-  }
+  transactions_.forEach(
+    [&] (HTTPCodec::StreamID streamID, const HTTPTransaction&) {
+      if (((bool)(streamID & 0x01) == isUpstream()) &&
+          (streamID > lastGoodStreamID)) {
+        ids.push_back(streamID);
+      }
+    });
   errorOnTransactionIds(ids, kErrorStreamUnacknowledged);
 }
 
@@ -882,6 +1252,19 @@ void HTTPSession::onWindowUpdate(HTTPCodec::StreamID streamID,
   txn->onIngressWindowUpdate(amount);
 }
 
+void HTTPSession::onPriority(HTTPCodec::StreamID streamID,
+                             const HTTPPriority& priority) {
+  VLOG(4) << *this << " got priority on streamID=" << streamID
+          << " dependency=" << priority.streamDependency
+          << " weight=" << priority.weight;
+  HTTPTransaction* txn = findTransaction(streamID);
+  if (!txn) {
+    // the stream is either done, or not created yet
+    return;
+  }
+  txn->updatePriority(priority);
+}
+
 void HTTPSession::onSettings(const SettingsList& settings) {
   for (auto& setting: settings) {
     if (setting.id == SettingsId::INITIAL_WINDOW_SIZE) {
@@ -890,6 +1273,9 @@ void HTTPSession::onSettings(const SettingsList& settings) {
       onSetMaxInitiatedStreams(setting.value);
     }
   }
+  if (codec_->generateSettingsAck(writeBuf_) > 0) {
+    scheduleWrite();
+  }
 }
 
 void HTTPSession::onSetSendWindow(uint32_t windowSize) {
@@ -960,10 +1346,49 @@ HTTPSession::transactionTimeout(HTTPTransaction* txn) noexcept {
   txn->onIngressTimeout();
 }
 
+void
+HTTPSession::transactionSlow(HTTPTransaction* txn) noexcept {
+  if (!slowTransactionSampler_) {
+    return;
+  }
+  folly::dynamic sample = folly::dynamic::object;
+  describeMemory(sample);
+  sample["pending_write_bytes"] = (int64_t)pendingWriteSize_;
+  sample["reads_paused"] = readsPaused();
+  sample["writes_paused"] = writesPaused();
+  if (connFlowControl_) {
+    sample["conn_send_window"] = (int64_t)connFlowControl_->getAvailableSend();
+  }
+  // the place of txn in the egress queue: the transactions with egress
+  // pending, and those of them with a higher priority
+  int64_t pending = 0;
+  int64_t ahead = 0;
+  transactions_.forEach(
+    [&] (HTTPCodec::StreamID, const HTTPTransaction& other) {
+      if (other.isEnqueued()) {
+        pending++;
+        if (other.getPriority() < txn->getPriority()) {
+          ahead++;
+        }
+      }
+    });
+  sample["egress_pending_transactions"] = pending;
+  sample["egress_ahead"] = ahead;
+  folly::dynamic transaction = folly::dynamic::object;
+  txn->describeState(transaction);
+  sample["transaction"] = std::move(transaction);
+  VLOG(3) << *this << " streamID=" << txn->getID() << " is slow";
+  slowTransactionSampler_->record(std::move(sample));
+}
+
 void HTTPSession::sendHeaders(HTTPTransaction* txn,
                               const HTTPMessage& headers,
                               HTTPHeaderSize* size) noexcept {
   CHECK(started_);
+  if (auto egress = getBlockedEgress(txn)) {
+    egress->headers.push_back(headers);
+    return;
+  }
   if (shouldShutdown()) {
     // For HTTP/1.1, add Connection: close
     drainImpl();
@@ -997,11 +1422,13 @@ size_t
 HTTPSession::sendBody(HTTPTransaction* txn,
                       std::unique_ptr<folly::IOBuf> body,
                       bool includeEOM) noexcept {
+  // the body of a waiting pipelined transaction stays in it
+  DCHECK(!getBlockedEgress(txn));
   uint64_t offset = sessionByteOffset();
-  size_t encodedSize = codec_->generateBody(writeBuf_,
-                                            txn->getID(),
-                                            std::move(body),
-                                            includeEOM);
+  size_t encodedSize = passThroughCodec()->generateBody(writeBuf_,
+                                                        txn->getID(),
+                                                        std::move(body),
+                                                        includeEOM);
   if (encodedSize > 0 && !txn->testAndSetFirstByteSent() && byteEventTracker_) {
     byteEventTracker_->addFirstBodyByteEvent(offset, txn);
   }
@@ -1020,19 +1447,43 @@ HTTPSession::sendBody(HTTPTransaction* txn,
   return encodedSize;
 }
 
+bool HTTPSession::canSendFileRegion(HTTPTransaction* txn) noexcept {
+  if (transportInfo_.ssl || writesShutdown() || getBlockedEgress(txn) ||
+      !codec_->isEgressBodyUnframed(txn->getID())) {
+    return false;
+  }
+  // sendfile() needs the socket itself, not a filter or an SSL socket
+  auto sock = dynamic_cast<TAsyncSocket*>(sock_.get());
+  return sock && !dynamic_cast<TAsyncSSLSocket*>(sock) && sock->getFd() >= 0;
+}
+
+size_t HTTPSession::sendFileRegion(HTTPTransaction* txn,
+                                   const FileRegion& region) noexcept {
+  if (region.getLength() == 0) {
+    return 0;
+  }
+  uint64_t offset = sessionByteOffset();
+  if (!txn->testAndSetFirstByteSent() && byteEventTracker_) {
+    byteEventTracker_->addFirstBodyByteEvent(offset, txn);
+  }
+  fileRegions_.emplace_back(offset, region);
+  pendingFileBytes_ += region.getLength();
+  scheduleWrite();
+  return region.getLength();
+}
+
 size_t HTTPSession::sendChunkHeader(HTTPTransaction* txn,
     size_t length) noexcept {
-  size_t encodedSize = codec_->generateChunkHeader(writeBuf_,
-                                                   txn->getID(),
-                                                   length);
+  size_t encodedSize = passThroughCodec()->generateChunkHeader(
+    writeBuf_, txn->getID(), length);
   scheduleWrite();
   return encodedSize;
 }
 
 size_t HTTPSession::sendChunkTerminator(
     HTTPTransaction* txn) noexcept {
-  size_t encodedSize = codec_->generateChunkTerminator(writeBuf_,
-                                                       txn->getID());
+  size_t encodedSize = passThroughCodec()->generateChunkTerminator(
+    writeBuf_, txn->getID());
   scheduleWrite();
   return encodedSize;
 }
@@ -1040,9 +1491,13 @@ size_t HTTPSession::sendChunkTerminator(
 size_t
 HTTPSession::sendTrailers(HTTPTransaction* txn,
         const HTTPHeaders& trailers) noexcept {
-  size_t encodedSize = codec_->generateTrailers(writeBuf_,
-                                                txn->getID(),
-                                                trailers);
+  if (auto egress = getBlockedEgress(txn)) {
+    egress->trailers = folly::make_unique<HTTPHeaders>(trailers);
+    return 0;
+  }
+  size_t encodedSize = passThroughCodec()->generateTrailers(writeBuf_,
+                                                            txn->getID(),
+                                                            trailers);
   scheduleWrite();
   return encodedSize;
 }
@@ -1056,6 +1511,7 @@ HTTPSession::onEgressMessageFinished(HTTPTransaction* txn, bool withRST) {
   if (infoCallback_) {
     infoCallback_->onRequestEnd(*this, txn->getMaxDeferredSize());
   }
+  finishPipelinedEgress(txn);
   decrementTransactionCount(txn, false, true);
   if (withRST || ((!codec_->isReusable() || readsShutdown()) &&
                   transactions_.size() == 1)) {
@@ -1098,7 +1554,16 @@ HTTPSession::sendEOM(HTTPTransaction* txn) noexcept {
   // Schedule a network write to send out whatever egress we might
   // have queued up.
   VLOG(4) << *this << " sending EOM for streamID=" << txn->getID();
-  size_t encodedSize = codec_->generateEOM(writeBuf_, txn->getID());
+  if (auto egress = getBlockedEgress(txn)) {
+    if (!egress->held && !writesShutdown()) {
+      egress->held = true;
+      txn->incrementPendingByteEvents();
+    }
+    egress->eom = true;
+    return 0;
+  }
+  size_t encodedSize = passThroughCodec()->generateEOM(writeBuf_,
+                                                       txn->getID());
   // PRIO_TODO: boost this transaction's priority? evaluate impact...
   if (!txn->testAndSetFirstByteSent()) {
     txn->onEgressBodyFirstByte();
@@ -1122,6 +1587,16 @@ size_t HTTPSession::sendAbort(HTTPTransaction* txn,
   // Schedule a network write to send out whatever egress we might
   // have queued up.
   VLOG(4) << *this << " sending abort for streamID=" << txn->getID();
+  if (auto egress = getBlockedEgress(txn)) {
+    // the responses before it still go out, then the connection is reset
+    if (!egress->held && !writesShutdown()) {
+      egress->held = true;
+      txn->incrementPendingByteEvents();
+    }
+    egress->abort = true;
+    egress->abortCode = statusCode;
+    return 0;
+  }
   // drain this transaction's writeBuf instead of flushing it
   // then enqueue the abort directly into the Session buffer,
   // hence with max priority.
@@ -1162,8 +1637,7 @@ void
 HTTPSession::detach(HTTPTransaction* txn) noexcept {
   DestructorGuard guard(this);
   HTTPCodec::StreamID streamID = txn->getID();
-  auto it = transactions_.find(txn->getID());
-  DCHECK(it != transactions_.end());
+  DCHECK(transactions_.find(streamID) == txn);
   if (!txn->isIngressPaused()) {
     VLOG(4) << *this << " removing streamID=" << streamID <<
         ", liveTransactions was " << liveTransactions_;
@@ -1181,20 +1655,37 @@ HTTPSession::detach(HTTPTransaction* txn) noexcept {
     }
   }
   decrementTransactionCount(txn, true, true);
-  transactions_.erase(it);
+  finishPipelinedEgress(txn);
+  transactions_.erase(streamID);
+  if (transactions_.empty() && HeaderTableBudget::get().isExceeded()) {
+    resizeHeaderTables(kIdleHeaderTableSize);
+  }
+  if (tcpInfoSampleInterval_.count() > 0) {
+    sampleTCPInfo(getCurrentTime());
+    txn->setTCPInfo(lastTCPInfo_);
+  }
+  if (sessionStats_) {
+    recordLatencies(txn->getTimings());
+  }
   if (infoCallback_) {
+    infoCallback_->onTransactionTimings(*this, txn->getTimings());
     if (transactions_.empty()) {
       infoCallback_->onDeactivateConnection(*this);
     } else {
       infoCallback_->onTransactionDetached(*this);
     }
   }
+  updatePipelinePauseState();
   if (!readsShutdown()) {
     if (!codec_->supportsParallelRequests() && !transactions_.empty()) {
+      if (isPipelining()) {
+        // the next requests were handed out already
+        return;
+      }
       // If we had more than one transaction, then someone tried to pipeline and
       // we paused reads
       DCHECK(transactions_.size() == 1);
-      auto& nextTxn = transactions_.begin()->second;
+      auto& nextTxn = *transactions_.front();
       DCHECK(nextTxn.isIngressPaused());
       DCHECK(!nextTxn.isIngressComplete());
       nextTxn.resumeIngress();
@@ -1208,6 +1699,9 @@ HTTPSession::detach(HTTPTransaction* txn) noexcept {
   if (liveTransactions_ == 0 && transactions_.empty() && !isScheduled()) {
     resetTimeout();
   }
+  if (transactions_.empty()) {
+    scheduleHibernate();
+  }
 
   // It's possible that this is the last transaction in the session,
   // so check whether the conditions for shutdown are satisfied.
@@ -1228,6 +1722,11 @@ HTTPSession::detach(HTTPTransaction* txn) noexcept {
 size_t
 HTTPSession::sendWindowUpdate(HTTPTransaction* txn,
                               uint32_t bytes) noexcept {
+  if (batchWindowUpdates_) {
+    pendingWindowUpdates_[txn->getID()] += bytes;
+    scheduleWrite();
+    return 0;
+  }
   size_t sent = codec_->generateWindowUpdate(writeBuf_, txn->getID(), bytes);
   if (sent) {
     scheduleWrite();
@@ -1235,6 +1734,165 @@ HTTPSession::sendWindowUpdate(HTTPTransaction* txn,
   return sent;
 }
 
+void HTTPSession::connIngressBytesProcessed(uint32_t bytes) {
+  if (!connFlowControl_) {
+    return;
+  }
+  if (batchWindowUpdates_) {
+    pendingConnAck_ += bytes;
+    scheduleWrite();
+    return;
+  }
+  ackConnIngress(bytes);
+}
+
+void HTTPSession::ackConnIngress(uint32_t bytes) {
+  autoTuneBytes_ += bytes;
+  if (!connFlowControl_->ingressBytesProcessed(writeBuf_, bytes)) {
+    return;
+  }
+  if (windowAutoTuner_) {
+    auto now = getCurrentTime();
+    // both refresh transportInfo_.rtt, the sample only once per interval
+    if (tcpInfoSampleInterval_.count() > 0) {
+      sampleTCPInfo(now);
+    } else {
+      TransportInfo tinfo;
+      getCurrentTransportInfo(&tinfo);
+    }
+    uint32_t capacity = connFlowControl_->getReceiveWindowCapacity();
+    uint32_t newCapacity = windowAutoTuner_->onWindowUpdate(
+      capacity, autoTuneBytes_, now, transportInfo_.rtt);
+    autoTuneBytes_ = 0;
+    if (newCapacity > capacity) {
+      VLOG(4) << *this << " growing receive windows from " << capacity
+              << " to " << newCapacity << " bytes";
+      connFlowControl_->setReceiveWindowSize(writeBuf_, newCapacity);
+      if (newCapacity > receiveStreamWindowSize_) {
+        receiveStreamWindowSize_ = newCapacity;
+        invokeOnAllTransactions(&HTTPTransaction::setReceiveWindow,
+                                newCapacity);
+      }
+    }
+  }
+  scheduleWrite();
+}
+
+void HTTPSession::flushWindowUpdates() {
+  for (auto& update: pendingWindowUpdates_) {
+    // the credit of a stream that is gone is no use to the peer
+    if (findTransaction(update.first)) {
+      codec_->generateWindowUpdate(writeBuf_, update.first, update.second);
+    }
+  }
+  pendingWindowUpdates_.clear();
+  if (pendingConnAck_ > 0 && connFlowControl_) {
+    uint32_t bytes = pendingConnAck_;
+    pendingConnAck_ = 0;
+    ackConnIngress(bytes);
+  }
+}
+
+HTTPSession::PipelinedEgress*
+HTTPSession::getBlockedEgress(HTTPTransaction* txn) {
+  if (pipelinedEgress_.empty()) {
+    return nullptr;
+  }
+  auto it = pipelinedEgress_.find(txn->getID());
+  if (it == pipelinedEgress_.end() || it->second.head) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+void HTTPSession::flushPipelinedEgress() {
+  while (!pipelinedEgress_.empty() && !writesShutdown() &&
+         !pipelinedEgress_.begin()->second.head) {
+    auto it = pipelinedEgress_.begin();
+    HTTPTransaction* txn = findTransaction(it->first);
+    CHECK(txn);
+    VLOG(4) << *this << " streamID=" << it->first
+            << " is at the head of the pipeline";
+    PipelinedEgress egress = std::move(it->second);
+    it->second = PipelinedEgress();
+    it->second.head = true;
+
+    // Finishing the response erases it, and makes the next one the head
+    for (const auto& headers: egress.headers) {
+      sendHeaders(txn, headers, nullptr);
+    }
+    if (egress.abort) {
+      sendAbort(txn, egress.abortCode);
+    } else if (egress.eom) {
+      if (egress.trailers) {
+        sendTrailers(txn, *egress.trailers);
+      }
+      sendEOM(txn);
+    }
+    if (!writesPaused()) {
+      txn->resumeEgress();
+    }
+    if (egress.held) {
+      // this may detach it
+      txn->decrementPendingByteEvents();
+    }
+  }
+}
+
+void HTTPSession::finishPipelinedEgress(HTTPTransaction* txn) {
+  if (pipelinedEgress_.empty()) {
+    return;
+  }
+  auto it = pipelinedEgress_.find(txn->getID());
+  if (it == pipelinedEgress_.end()) {
+    return;
+  }
+  const bool head = it->second.head;
+  pipelinedEgress_.erase(it);
+  if (head && !pipelinedEgress_.empty() && !isLoopCallbackScheduled()) {
+    sock_->getEventBase()->runInLoop(this);
+  }
+}
+
+void HTTPSession::dropPipelinedEgress() {
+  // The entries stay, so that the waiting transactions go on holding
+  // their egress instead of generating it out of order
+  std::vector<HTTPCodec::StreamID> held;
+  for (auto& it: pipelinedEgress_) {
+    if (it.second.held) {
+      held.push_back(it.first);
+    }
+    const bool head = it.second.head;
+    it.second = PipelinedEgress();
+    it.second.head = head;
+  }
+  for (auto id: held) {
+    auto txn = findTransaction(id);
+    if (txn) {
+      txn->decrementPendingByteEvents();
+    }
+  }
+}
+
+void HTTPSession::updatePipelinePauseState() {
+  if (!isPipelining()) {
+    return;
+  }
+  const bool full = transactions_.size() > maxPipelinedRequests_ ||
+    (transactions_.size() > 1 &&
+     egressBodyBuffered_ > maxPipelinedBufferBytes_);
+  if (full) {
+    // onMessageBeginImpl() comes back here if something resumes them
+    pipelinePaused_ = true;
+    pauseReads();
+  } else if (pipelinePaused_) {
+    pipelinePaused_ = false;
+    if (liveTransactions_ > 0 || transactions_.empty()) {
+      resumeReads();
+    }
+  }
+}
+
 void
 HTTPSession::notifyIngressBodyProcessed(uint32_t bytes) noexcept {
   CHECK(pendingReadSize_ >= bytes);
@@ -1243,14 +1901,193 @@ HTTPSession::notifyIngressBodyProcessed(uint32_t bytes) noexcept {
   VLOG(4) << *this << " Dequeued " << bytes << " bytes of ingress. "
     << "Ingress buffer uses " << pendingReadSize_  << " of "
     << kDefaultReadBufLimit << " bytes.";
-  if (connFlowControl_ &&
-      connFlowControl_->ingressBytesProcessed(writeBuf_, bytes)) {
-    scheduleWrite();
-  }
+  connIngressBytesProcessed(bytes);
   if (oldSize > kDefaultReadBufLimit &&
       pendingReadSize_ <= kDefaultReadBufLimit) {
     resumeReads();
   }
+  updateMemoryUsage();
+}
+
+uint32_t HTTPSession::capReceiveWindow(const HTTPTransaction* txn,
+                                       uint32_t capacity) noexcept {
+  uint32_t current = txn->getReceiveWindow().getCapacity();
+  // more than the session window would never be used
+  if (connFlowControl_) {
+    capacity = std::min(capacity,
+                        connFlowControl_->getReceiveWindowCapacity());
+  }
+  // the growth lets the peer send that much more to buffer
+  const MemoryBudget& budget = MemoryBudget::get();
+  if (budget.getLimit() > 0) {
+    uint64_t room = budget.getLimit() > budget.getUsed() ?
+      budget.getLimit() - budget.getUsed() : 0;
+    capacity = std::min<uint64_t>(capacity, current + room);
+  }
+  return std::max(capacity, current);
+}
+
+void HTTPSession::notifyEgressBodyBuffered(int64_t bytes) noexcept {
+  DCHECK(bytes >= 0 || uint64_t(-bytes) <= egressBodyBuffered_);
+  egressBodyBuffered_ += bytes;
+  updateMemoryUsage();
+  updatePipelinePauseState();
+}
+
+void HTTPSession::updateMemoryUsage() {
+  setMemoryUsed(readBuf_.chainLength() + pendingReadSize_ +
+                writeBuf_.chainLength() + pendingWriteSize_ +
+                egressBodyBuffered_);
+}
+
+void HTTPSession::checkSlowReader(uint64_t bytesWritten) {
+  auto now = getCurrentTime();
+  uint64_t buffered = writeBuf_.chainLength() + pendingWriteSize_ +
+    egressBodyBuffered_;
+  if (buffered == 0) {
+    slowReaderDetector_->reset(now);
+    return;
+  }
+  auto previous = slowReaderDetector_->getState();
+  auto state = slowReaderDetector_->onDrained(bytesWritten, buffered, now);
+  if (state == previous) {
+    return;
+  }
+  switch (state) {
+    case SlowReaderDetector::State::OK:
+      VLOG(4) << *this << " caught up with its egress";
+      break;
+    case SlowReaderDetector::State::SLOW:
+      VLOG(3) << *this << " reads slowly, " << buffered
+              << " bytes of egress are buffered";
+      if (sessionStats_) {
+        sessionStats_->recordSlowReader();
+      }
+      transactions_.forEachSafe(
+        [] (HTTPCodec::StreamID, HTTPTransaction& txn) {
+          txn.shrinkReceiveWindow(txn.getReceiveWindow().getCapacity() / 2);
+        });
+      drain();
+      break;
+    case SlowReaderDetector::State::EXPIRED:
+      VLOG(3) << *this << " reset, it still reads too slowly";
+      if (sessionStats_) {
+        sessionStats_->recordSlowReaderReset();
+      }
+      setCloseReason(ConnectionCloseReason::TIMEOUT);
+      shutdownTransportWithReset(kErrorSlowReader);
+      break;
+  }
+}
+
+void HTTPSession::pauseForMemory() noexcept {
+  VLOG(3) << *this << " pausing reads, the memory budget is exceeded";
+  if (infoCallback_) {
+    infoCallback_->onMemoryBudgetExceeded(*this);
+  }
+  pauseReads();
+}
+
+void HTTPSession::resumeForMemory() noexcept {
+  VLOG(3) << *this << " resuming reads within the memory budget";
+  // a serial codec stays paused while its transaction's handler is
+  if (codec_->supportsParallelRequests() || liveTransactions_ > 0 ||
+      transactions_.empty()) {
+    resumeReads();
+  }
+}
+
+void HTTPSession::recordLatencies(const HTTPTransactionTimings& timings) {
+  typedef HTTPTransactionTimings T;
+  if (isDownstream() && T::isSet(timings.firstByteRead)) {
+    auto start = timings.firstByteRead;
+    if (T::isSet(timings.firstByteWritten)) {
+      sessionStats_->recordTimeToFirstHeaderByte(
+        T::between(start, timings.firstByteWritten));
+    }
+    if (T::isSet(timings.firstBodyByteWritten)) {
+      sessionStats_->recordTimeToFirstBodyByte(
+        T::between(start, timings.firstBodyByteWritten));
+    }
+    if (T::isSet(timings.lastByteAcked)) {
+      sessionStats_->recordTTLBA(T::between(start, timings.lastByteAcked));
+    }
+  }
+
+  TimePoint start = timings.firstByteRead;
+  if (!T::isSet(start) || (T::isSet(timings.firstByteWritten) &&
+                           timings.firstByteWritten < start)) {
+    start = timings.firstByteWritten;
+  }
+  if (T::isSet(start)) {
+    sessionStats_->recordTransactionDuration(
+      T::between(start, getCurrentTime()));
+  }
+}
+
+void HTTPSession::sampleTCPInfo(TimePoint now) {
+  // failed reads wait for the interval too
+  if (lastTCPInfoRead_ != TimePoint() &&
+      now - lastTCPInfoRead_ < tcpInfoSampleInterval_) {
+    return;
+  }
+  lastTCPInfoRead_ = now;
+  TransportInfo tinfo;
+  if (!getCurrentTransportInfo(&tinfo)) {
+    return;
+  }
+#if defined(__linux__)
+  const auto& info = tinfo.tcpinfo;
+  TCPInfoSample sample;
+  sample.time = now;
+  sample.rtt = std::chrono::microseconds(info.tcpi_rtt);
+  sample.rttVar = std::chrono::microseconds(info.tcpi_rttvar);
+  sample.cwnd = info.tcpi_snd_cwnd;
+  sample.mss = info.tcpi_snd_mss;
+  sample.unacked = info.tcpi_unacked;
+  sample.totalRetransmits = info.tcpi_total_retrans;
+  if (sample.totalRetransmits > lastTCPInfo_.totalRetransmits) {
+    sample.newRetransmits =
+      sample.totalRetransmits - lastTCPInfo_.totalRetransmits;
+  }
+  if (info.tcpi_rtt > 0) {
+    sample.deliveryRate =
+      uint64_t(sample.cwnd) * sample.mss * 1000000 / info.tcpi_rtt;
+  }
+  lastTCPInfo_ = sample;
+  if (sessionStats_) {
+    sessionStats_->recordTCPInfo(sample);
+  }
+#endif
+}
+
+HTTPSession::MemoryUsage HTTPSession::getMemoryUsage() const {
+  MemoryUsage usage;
+  usage.readBuffer = chainCapacity(readBuf_);
+  usage.writeBuffer = chainCapacity(writeBuf_) + pendingWriteSize_;
+  transactions_.forEach(
+    [&] (HTTPCodec::StreamID, const HTTPTransaction& txn) {
+      usage.transactions += txn.getMemoryUsage();
+    });
+  usage.codec = codec_->getMemoryUsage();
+  return usage;
+}
+
+uint64_t HTTPSession::getMemoryFootprint() const {
+  return getMemoryUsage().total();
+}
+
+void HTTPSession::describeMemory(folly::dynamic& out) const {
+  auto usage = getMemoryUsage();
+  out["local"] = localAddr_.describe();
+  out["peer"] = peerAddr_.describe();
+  out["protocol"] = getCodecProtocolString(codec_->getProtocol());
+  out["transactions"] = (int64_t)transactions_.size();
+  out["bytes"] = (int64_t)usage.total();
+  out["read_buffer"] = (int64_t)usage.readBuffer;
+  out["write_buffer"] = (int64_t)usage.writeBuffer;
+  out["transaction_bytes"] = (int64_t)usage.transactions;
+  out["codec_bytes"] = (int64_t)usage.codec;
 }
 
 const SocketAddress& HTTPSession::getLocalAddress() const noexcept {
@@ -1261,6 +2098,22 @@ const SocketAddress& HTTPSession::getPeerAddress() const noexcept {
   return peerAddr_;
 }
 
+std::shared_ptr<const CachedSocketAddress>
+HTTPSession::getCachedLocalAddress() const {
+  if (!cachedLocalAddr_) {
+    cachedLocalAddr_ = std::make_shared<CachedSocketAddress>(localAddr_);
+  }
+  return cachedLocalAddr_;
+}
+
+std::shared_ptr<const CachedSocketAddress>
+HTTPSession::getCachedPeerAddress() const {
+  if (!cachedPeerAddr_) {
+    cachedPeerAddr_ = std::make_shared<CachedSocketAddress>(peerAddr_);
+  }
+  return cachedPeerAddr_;
+}
+
 TransportInfo& HTTPSession::getSetupTransportInfo() noexcept {
   return transportInfo_;
 }
@@ -1301,6 +2154,90 @@ void HTTPSession::setByteEventTracker(
   byteEventTracker_->setTTLBAStats(sessionStats_);
 }
 
+bool HTTPSession::enableAckTimestamps(uint32_t maxAckTracked,
+                                      AsyncTimeoutSet* ackLatencyTimeouts) {
+  CHECK(transactions_.empty());
+  if (zeroCopyWriter_) {
+    return false;
+  }
+  auto tracker = folly::make_unique<TimestampingByteEventTracker>(this);
+  if (!tracker->setMaxTcpAckTracked(maxAckTracked, ackLatencyTimeouts,
+                                    sock_.get())) {
+    return false;
+  }
+  setByteEventTracker(std::move(tracker));
+  return true;
+}
+
+bool HTTPSession::enableZeroCopyWrites(uint64_t minWriteSize) {
+  if (transportInfo_.ssl ||
+      dynamic_cast<TimestampingByteEventTracker*>(byteEventTracker_.get())) {
+    return false;
+  }
+  auto sock = dynamic_cast<TAsyncSocket*>(sock_.get());
+  if (!sock || dynamic_cast<TAsyncSSLSocket*>(sock) || sock->getFd() < 0 ||
+      !ZeroCopyWriter::enable(sock->getFd())) {
+    return false;
+  }
+  zeroCopyWriter_.reset(new ZeroCopyWriter(sock_->getEventBase(),
+                                           sock->getFd()));
+  zeroCopyMinWriteSize_ = minWriteSize;
+  return true;
+}
+
+bool HTTPSession::enableNotSentLowat(uint32_t lowat) {
+#ifdef TCP_NOTSENT_LOWAT
+  auto sock = dynamic_cast<TAsyncSocket*>(sock_.get());
+  if (!sock || sock->getFd() < 0 || lowat == 0) {
+    return false;
+  }
+  if (setsockopt(sock->getFd(), IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                 &lowat, sizeof(lowat)) != 0) {
+    VLOG(2) << *this << " TCP_NOTSENT_LOWAT not supported: "
+            << strerror(errno);
+    return false;
+  }
+  notSentLowat_ = lowat;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool HTTPSession::enableReceiveWindowAutoTuning(uint32_t maxWindow) {
+  if (!connFlowControl_) {
+    return false;
+  }
+  windowAutoTuner_.reset(new WindowAutoTuner(maxWindow));
+  autoTuneBytes_ = 0;
+  return true;
+}
+
+void HTTPSession::enableSlowReaderDetection(
+    std::chrono::milliseconds maxDrainTime,
+    std::chrono::milliseconds deadline,
+    uint64_t minBuffered) {
+  slowReaderDetector_.reset(
+    new SlowReaderDetector(maxDrainTime, deadline, minBuffered));
+}
+
+void HTTPSession::setSlowTransactionSampler(
+    std::shared_ptr<SlowTransactionSampler> sampler,
+    AsyncTimeoutSet* timeouts) {
+  slowTransactionSampler_ = std::move(sampler);
+  slowTransactionTimeouts_ = slowTransactionSampler_ ? timeouts : nullptr;
+}
+
+bool HTTPSession::enableStreamWindowSizing(uint32_t minWindow,
+                                           uint32_t maxWindow) {
+  if (!codec_->supportsStreamFlowControl()) {
+    return false;
+  }
+  minStreamWindow_ = minWindow;
+  maxStreamWindow_ = maxWindow;
+  return true;
+}
+
 unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* eom) {
   // limit ourselves to one outstanding write at a time (onWriteSuccess calls
   // scheduleWrite)
@@ -1312,7 +2249,7 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* eom) {
 
   // We always tack on at least one body packet to the current write buf
   // This ensures that a short HTTPS response will go out in a single SSL record
-  while (!txnEgressQueue_.empty()) {
+  while (!txnEgressQueue_->empty()) {
     uint32_t allowed = std::numeric_limits<uint32_t>::max();
     if (connFlowControl_) {
       allowed = connFlowControl_->getAvailableSend();
@@ -1322,25 +2259,70 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* eom) {
         break;
       }
     }
-    auto txn = txnEgressQueue_.top();
+    if (notSentLowat_ > 0) {
+      // the kernel takes about that much before the write has to wait, a
+      // bigger write would fix the order of the bytes after it too early
+      allowed = std::min(allowed, notSentLowat_);
+    }
+    if (egressBatchBytes_ > 0 && writeBuf_.chainLength() < egressBatchBytes_) {
+      allowed = std::min<uint64_t>(allowed,
+                                   egressBatchBytes_ - writeBuf_.chainLength());
+    }
+    auto txn = txnEgressQueue_->top();
+    uint8_t egressClass = 0;
+    if (egressShaper_) {
+      egressClass = egressShaper_->getClass(txn->getEgressClass(),
+                                            txn->getPriority());
+      uint64_t shaped = egressShaper_->getAllowed(egressClass);
+      if (shaped == 0) {
+        VLOG(4) << *this << " egress class " << int(egressClass)
+                << " is out of tokens, waiting";
+        egressShaper_->wait(this);
+        break;
+      }
+      allowed = std::min<uint64_t>(allowed, shaped);
+    }
+    const uint64_t lengthBefore = writeBuf_.chainLength();
     // returns true if there is more egress pending for this txn
-    if (txn->onWriteReady(allowed) || writeBuf_.front()) {
+    bool more = txn->onWriteReady(allowed);
+    if (egressShaper_) {
+      egressShaper_->consume(egressClass,
+                             writeBuf_.chainLength() - lengthBefore);
+    }
+    if (egressBatchBytes_ > 0) {
+      // keep adding the egress of the next transactions to this write
+      if (writeBuf_.chainLength() >= egressBatchBytes_) {
+        break;
+      }
+    } else if (more || writeBuf_.front()) {
       break;
     }
   }
   *eom = false;
+  if (!fileRegions_.empty()) {
+    // the bytes before the next file region, runLoopCallback() writes the
+    // region once they are written
+    uint64_t before = fileRegions_.front().first - bytesScheduled_;
+    if (before == 0) {
+      return nullptr;
+    }
+    if (before < writeBuf_.chainLength()) {
+      *cork = true;
+      return writeBuf_.split(before);
+    }
+  }
   if (byteEventTracker_) {
     uint64_t needed = byteEventTracker_->preSend(cork, eom, bytesWritten_);
     if (needed > 0) {
       VLOG(5) << *this << " writeBuf_.chainLength(): "
               << writeBuf_.chainLength() << " txnEgressQueue_.empty(): "
-              << txnEgressQueue_.empty();
+              << txnEgressQueue_->empty();
 
       if (needed < writeBuf_.chainLength()) {
         // split the next EOM chunk
         VLOG(5) << *this << " splitting " << needed << " bytes out of a "
                 << writeBuf_.chainLength() << " bytes IOBuf";
-        *cork = !txnEgressQueue_.empty();
+        *cork = !txnEgressQueue_->empty();
         if (sessionStats_) {
           sessionStats_->recordTTLBAIOBSplitByEom();
         }
@@ -1352,7 +2334,7 @@ unique_ptr<IOBuf> HTTPSession::getNextToSend(bool* cork, bool* eom) {
   }
 
   // cork if there are txns with pending egress
-  *cork = !txnEgressQueue_.empty();
+  *cork = !txnEgressQueue_->empty();
   return writeBuf_.move();
 }
 
@@ -1362,13 +2344,31 @@ HTTPSession::runLoopCallback() noexcept {
   // loop iteration if either of two conditions has happened:
   //   * The session has generated some egress data (see scheduleWrite())
   //   * Reads have become unpaused (see resumeReads())
+  LoopMonitor::CallbackScope monitorScope("HTTPSession::runLoopCallback");
   DestructorGuard dg(this);
   inLoopCallback_ = true;
   folly::ScopeGuard scopeg = folly::makeGuard(
     [this] { inLoopCallback_ = false;});
   VLOG(4) << *this << " in loop callback";
 
-  for (uint32_t i = 0; i < kMaxWritesPerLoop; ++i) {
+  flushWindowUpdates();
+  flushPipelinedEgress();
+
+  const uint64_t scheduledBefore = bytesScheduled_;
+  for (uint32_t i = 0; i < maxWritesPerLoop_; ++i) {
+    if (bytesScheduled_ - scheduledBefore >= flushBytesAllowed_) {
+      // the turn of the next session of the EgressFlusher
+      break;
+    }
+    if (!fileRegions_.empty() &&
+        fileRegions_.front().first == bytesScheduled_ &&
+        numActiveWrites_ == 0 && !writesShutdown()) {
+      writeFileRegion();
+      if (numActiveWrites_ > 0) {
+        break;
+      }
+      continue;
+    }
     bool cork = true;
     bool eom = false;
     unique_ptr<IOBuf> writeBuf = getNextToSend(&cork, &eom);
@@ -1398,7 +2398,14 @@ HTTPSession::runLoopCallback() noexcept {
     VLOG(4) << *this << " writing " << len << ", activeWrites="
              << numActiveWrites_ << " cork=" << cork << " eom=" << eom;
     bytesScheduled_ += len;
-    sock_->writeChain(segment, std::move(writeBuf), segment->getFlags());
+    numWrites_++;
+    if (zeroCopyWriter_ && len >= zeroCopyMinWriteSize_ &&
+        zeroCopyWriter_->canWrite()) {
+      zeroCopyWriter_->writeChain(segment, std::move(writeBuf),
+                                  segment->getFlags());
+    } else {
+      sock_->writeChain(segment, std::move(writeBuf), segment->getFlags());
+    }
     if (numActiveWrites_ > 0) {
       updateWriteBufSize(len);
       break;
@@ -1406,7 +2413,8 @@ HTTPSession::runLoopCallback() noexcept {
     // writeChain can result in a writeError and trigger the shutdown code path
   }
   if (numActiveWrites_ == 0 && !writesShutdown() && hasMoreWrites() &&
-      (!connFlowControl_ || connFlowControl_->getAvailableSend())) {
+      (!connFlowControl_ || connFlowControl_->getAvailableSend()) &&
+      !isEgressShaped()) {
     scheduleWrite();
   }
 
@@ -1421,16 +2429,84 @@ HTTPSession::runLoopCallback() noexcept {
   checkForShutdown();
 }
 
+uint64_t HTTPSession::flushEgress(uint64_t bytesAllowed) noexcept {
+  DestructorGuard dg(this);
+  const uint64_t scheduledBefore = bytesScheduled_;
+  flushBytesAllowed_ = bytesAllowed;
+  runLoopCallback();
+  flushBytesAllowed_ = std::numeric_limits<uint64_t>::max();
+  return bytesScheduled_ - scheduledBefore;
+}
+
+void HTTPSession::setEgressFlusher(std::shared_ptr<EgressFlusher> flusher) {
+  if (egressFlusher_) {
+    egressFlusher_->cancel(this);
+  }
+  egressFlusher_ = std::move(flusher);
+  scheduleWrite();
+}
+
+void HTTPSession::setEgressShaper(std::shared_ptr<EgressShaper> shaper) {
+  if (egressShaper_) {
+    egressShaper_->cancel(this);
+  }
+  egressShaper_ = std::move(shaper);
+  scheduleWrite();
+}
+
+void HTTPSession::onEgressAllowed() noexcept {
+  scheduleWrite();
+}
+
+void HTTPSession::writeFileRegion() {
+  FileRegion region = std::move(fileRegions_.front().second);
+  fileRegions_.pop_front();
+  uint64_t len = region.getLength();
+  pendingFileBytes_ -= len;
+  if (!fileWriter_) {
+    auto sock = CHECK_NOTNULL(dynamic_cast<TAsyncSocket*>(sock_.get()));
+    fileWriter_.reset(new FileRegionWriter(sock_->getEventBase(),
+                                           sock->getFd(), this));
+  }
+  if (!writeTimeout_.isScheduled()) {
+    transactionTimeouts_->scheduleTimeout(&writeTimeout_);
+  }
+  numActiveWrites_++;
+  VLOG(4) << *this << " writing " << len << " bytes from fd="
+          << region.getFd() << ", activeWrites=" << numActiveWrites_;
+  bytesScheduled_ += len;
+  numWrites_++;
+  fileWriter_->write(region);
+  if (numActiveWrites_ > 0) {
+    updateWriteBufSize(len);
+  }
+}
+
+void HTTPSession::onFileRegionWritten(uint64_t bytesWritten) noexcept {
+  onWriteSuccess(bytesWritten);
+}
+
+void HTTPSession::onFileRegionError(uint64_t bytesWritten,
+                                    const TTransportException& ex) noexcept {
+  onWriteError(bytesWritten, ex);
+}
+
 void
 HTTPSession::scheduleWrite() {
   // Do all the network writes for this connection in one batch at
   // the end of the current event loop iteration.  Writing in a
   // batch helps us packetize the network traffic more efficiently,
   // as well as saving a few system calls.
-  if (!isLoopCallbackScheduled() &&
-      (writeBuf_.front() || !txnEgressQueue_.empty())) {
+  if (!isLoopCallbackScheduled() && !isFlushScheduled() &&
+      (writeBuf_.front() || !txnEgressQueue_->empty() ||
+       !fileRegions_.empty() || !pendingWindowUpdates_.empty() ||
+       pendingConnAck_ > 0)) {
     VLOG(4) << *this << " scheduling write callback";
-    sock_->getEventBase()->runInLoop(this);
+    if (egressFlusher_) {
+      egressFlusher_->schedule(this);
+    } else {
+      sock_->getEventBase()->runInLoop(this);
+    }
   }
 }
 
@@ -1442,6 +2518,7 @@ void
 HTTPSession::updateWriteBufSize(int64_t delta) {
   DCHECK(delta >= 0 || uint64_t(-delta) <= pendingWriteSize_);
   pendingWriteSize_ += delta;
+  updateMemoryUsage();
 
   if (egressLimitExceeded() && writesUnpaused()) {
     // Exceeded limit. Pause reading on the incoming stream.
@@ -1452,7 +2529,14 @@ HTTPSession::updateWriteBufSize(int64_t delta) {
     // Dropped below limit. Resume reading on the incoming stream if needed.
     VLOG(3) << "Resuming egress for " << *this;
     writes_ = SocketState::UNPAUSED;
-    invokeOnAllTransactions(&HTTPTransaction::resumeEgress);
+    DestructorGuard g(this);
+    transactions_.forEachSafe(
+      [this] (HTTPCodec::StreamID, HTTPTransaction& txn) {
+        // a waiting pipelined transaction resumes when its turn comes
+        if (!getBlockedEgress(&txn)) {
+          txn.resumeEgress();
+        }
+      });
   }
 }
 
@@ -1500,6 +2584,7 @@ HTTPSession::shutdownTransport(bool shutdownReads,
       if (byteEventTracker_) {
         byteEventTracker_->drainByteEvents();
       }
+      dropPipelinedEgress();
       if (resetAfterDrainingWrites_) {
         VLOG(4) << *this << " writes drained, sending RST";
         sock_->closeWithReset();
@@ -1537,8 +2622,7 @@ HTTPSession::shutdownTransport(bool shutdownReads,
       HTTPException::Direction::INGRESS_AND_EGRESS :
       (notifyIngressShutdown ? HTTPException::Direction::INGRESS :
          HTTPException::Direction::EGRESS);
-    HTTPException ex(dir);
-    ex.setProxygenError(error);
+    HTTPException ex(dir, error);
     invokeOnAllTransactions(&HTTPTransaction::onError, ex);
   }
 
@@ -1552,6 +2636,12 @@ void HTTPSession::shutdownTransportWithReset(ProxygenError errorCode) {
   if (isLoopCallbackScheduled()) {
     cancelLoopCallback();
   }
+  if (egressFlusher_) {
+    egressFlusher_->cancel(this);
+  }
+  if (egressShaper_) {
+    egressShaper_->cancel(this);
+  }
   if (!readsShutdown()) {
     sock_->setReadCallback(nullptr);
     reads_ = SocketState::SHUTDOWN;
@@ -1563,6 +2653,16 @@ void HTTPSession::shutdownTransportWithReset(ProxygenError errorCode) {
       pendingWrites_.front().detach();
       numActiveWrites_--;
     }
+    if (zeroCopyWriter_) {
+      // its segment is detached above, the error only deletes it
+      zeroCopyWriter_->cancel();
+    }
+    if (fileWriter_ && fileWriter_->isWriting()) {
+      fileWriter_->cancel();
+      numActiveWrites_--;
+    }
+    fileRegions_.clear();
+    pendingFileBytes_ = 0;
     VLOG(4) << *this << " cancel write timer";
     writeTimeout_.cancelTimeout();
     sock_->closeWithReset();
@@ -1575,6 +2675,7 @@ void HTTPSession::shutdownTransportWithReset(ProxygenError errorCode) {
   if (byteEventTracker_) {
     byteEventTracker_->drainByteEvents();
   }
+  dropPipelinedEgress();
   checkForShutdown();
 }
 
@@ -1588,7 +2689,7 @@ HTTPSession::checkForShutdown() {
   //   * All writes have been finished.
   //   * There are no transactions remaining on the session.
   if (writesShutdown() && transactions_.empty() &&
-      !isLoopCallbackScheduled()) {
+      !isLoopCallbackScheduled() && !isFlushScheduled()) {
     VLOG(4) << "destroying " << *this;
     sock_->setReadCallback(nullptr);
     reads_ = SocketState::SHUTDOWN;
@@ -1628,6 +2729,63 @@ void HTTPSession::drainImpl() {
   }
 }
 
+void HTTPSession::resizeHeaderTables(uint32_t size) {
+  if (size == curHeaderTableSize_ || !started_ || writesShutdown()) {
+    return;
+  }
+  VLOG(4) << *this << " resizing header tables from " << curHeaderTableSize_
+          << " to " << size;
+  auto& budget = HeaderTableBudget::get();
+  budget.remove(2 * curHeaderTableSize_);
+  budget.add(2 * size);
+  curHeaderTableSize_ = size;
+  codec_->setHeaderTableSize(size);
+  if (codec_->generateSettings(writeBuf_) > 0) {
+    scheduleWrite();
+  }
+}
+
+void HTTPSession::applyStreamLimit() {
+  auto& limit = StreamLimit::get();
+  if (limit.getGeneration() == streamLimitGeneration_) {
+    return;
+  }
+  streamLimitGeneration_ = limit.getGeneration();
+  if (limit.getLimit() > 0) {
+    setMaxConcurrentIncomingStreams(limit.getLimit());
+  }
+}
+
+void HTTPSession::scheduleHibernate() {
+  if (!hibernateEnabled_) {
+    return;
+  }
+  auto wheel = transactionTimeouts_->getWheelTimer();
+  if (wheel && hibernateTimeout_.count() > 0) {
+    wheel->scheduleTimeout(&hibernateCallback_, hibernateTimeout_);
+  } else {
+    hibernate();
+  }
+}
+
+void HTTPSession::hibernate() {
+  if (!transactions_.empty() || numActiveWrites_ > 0 || writeBuf_.front() ||
+      !fileRegions_.empty() || readBuf_.chainLength() > 0) {
+    // busy again, or in the middle of a message
+    return;
+  }
+  VLOG(4) << *this << " hibernating";
+  if (readBuf_.front()) {
+    ReadBufferPool::get().recycle(readBuf_.move());
+  }
+  readSize_ = ReadSizeEstimator(ReadBufferPool::kMinBufferSize,
+                                kInitialReadSize,
+                                ReadBufferPool::kMaxBufferSize);
+  fileWriter_.reset();
+  codec_->releaseIdleBuffers();
+  resizeHeaderTables(kIdleHeaderTableSize);
+}
+
 bool HTTPSession::shouldShutdown() const {
   return draining_ &&
     allTransactionsStarted() &&
@@ -1646,43 +2804,50 @@ size_t HTTPSession::sendPing() {
 
 HTTPTransaction*
 HTTPSession::findTransaction(HTTPCodec::StreamID streamID) {
-  auto it = transactions_.find(streamID);
-  if (it == transactions_.end()) {
-    return nullptr;
-  } else {
-    return &it->second;
-  }
+  return transactions_.find(streamID);
 }
 
 HTTPTransaction*
 HTTPSession::createTransaction(HTTPCodec::StreamID streamID,
                                HTTPCodec::StreamID assocStreamID,
                                int8_t priority) {
-  if (!sock_->good() || transactions_.count(streamID)) {
+  if (!sock_->good() || transactions_.find(streamID)) {
     // Refuse to add a transaction on a closing session or if a
     // transaction of that ID already exists.
     return nullptr;
   }
 
-  if (transactions_.empty() && infoCallback_) {
-    infoCallback_->onActivateConnection(*this);
+  if (transactions_.empty()) {
+    if (hibernateCallback_.isScheduled()) {
+      hibernateCallback_.cancelTimeout();
+    }
+    if (curHeaderTableSize_ < headerTableSize_) {
+      resizeHeaderTables(headerTableSize_);
+    }
+    if (infoCallback_) {
+      infoCallback_->onActivateConnection(*this);
+    }
   }
 
-  auto matchPair = transactions_.emplace(
-    std::piecewise_construct,
-    std::forward_as_tuple(streamID),
-    std::forward_as_tuple(
-      direction_, streamID, transactionSeqNo_, *this,
-      txnEgressQueue_, transactionTimeouts_, sessionStats_,
-      codec_->supportsStreamFlowControl(),
-      initialReceiveWindow_,
-      getCodecSendWindowSize(),
-      priority, assocStreamID));
-
-  CHECK(matchPair.second) << "Emplacement failed, despite earlier "
-    "existence check.";
+  // a pushed stream has no headers to wait for
+  AsyncTimeoutSet* timeouts =
+    (headerTimeouts_ && isDownstream() && !assocStreamID) ?
+    headerTimeouts_ : transactionTimeouts_;
+  bool pooled = StreamTable<HTTPTransaction>::getPoolSize() > 0;
+  HTTPTransaction* txn = transactions_.emplace(
+    streamID,
+    direction_, streamID, transactionSeqNo_, *this,
+    *txnEgressQueue_, timeouts, sessionStats_,
+    codec_->supportsStreamFlowControl(),
+    initialReceiveWindow_,
+    getCodecSendWindowSize(),
+    priority, assocStreamID);
 
-  HTTPTransaction* txn = &matchPair.first->second;
+  CHECK(txn) << "Emplacement failed, despite earlier existence check.";
+  if (sessionStats_) {
+    sessionStats_->recordTransactionPoolLookups(pooled ? 1 : 0,
+                                                pooled ? 0 : 1);
+  }
 
   VLOG(4) << *this << " adding streamID=" << txn->getID()
           << ", liveTransactions was " << liveTransactions_;
@@ -1690,12 +2855,23 @@ HTTPSession::createTransaction(HTTPCodec::StreamID streamID,
   ++liveTransactions_;
   ++transactionSeqNo_;
   txn->setReceiveWindow(receiveStreamWindowSize_);
+  txn->setLazyTimeouts(lazyTransactionTimeouts_);
+  if (slowTransactionTimeouts_) {
+    txn->scheduleSlowTimeout(slowTransactionTimeouts_);
+  }
+  txn->setWindowUpdateThreshold(streamWindowUpdateThreshold_);
+  if (maxStreamWindow_ > 0) {
+    txn->setReceiveWindowSizing(minStreamWindow_, maxStreamWindow_);
+  }
 
   if ((isUpstream() && !txn->isPushed()) ||
       (isDownstream() && txn->isPushed())) {
     outgoingStreams_++;
   } else {
     incomingStreams_++;
+    if (isDownstream()) {
+      applyStreamLimit();
+    }
   }
 
   if (txn->isPushed()) {
@@ -1747,10 +2923,18 @@ HTTPSession::onWriteSuccess(uint64_t bytesWritten) {
     //             whereby the socket asks us for a given amount of
     //             data to send...
     if (numActiveWrites_ == 0 && hasMoreWrites()) {
-      runLoopCallback();
+      if (egressFlusher_) {
+        // in its turn, within the budget of the loop
+        scheduleWrite();
+      } else {
+        runLoopCallback();
+      }
     }
   }
   onWriteCompleted();
+  if (slowReaderDetector_ && !writesShutdown()) {
+    checkSlowReader(bytesWritten);
+  }
 }
 
 void
@@ -1839,7 +3023,8 @@ HTTPSession::pauseReads() {
   codec_->setParserPaused(true);
   if (!readsUnpaused() ||
       (codec_->supportsParallelRequests() &&
-       pendingReadSize_ <= kDefaultReadBufLimit)) {
+       pendingReadSize_ <= kDefaultReadBufLimit &&
+       !isPausedForMemory())) {
     return;
   }
   VLOG(4) << *this << ": pausing reads";
@@ -1853,7 +3038,7 @@ HTTPSession::pauseReads() {
 
 void
 HTTPSession::resumeReads() {
-  if (!readsPaused() ||
+  if (!readsPaused() || isPausedForMemory() ||
       (codec_->supportsParallelRequests() &&
        pendingReadSize_ > kDefaultReadBufLimit)) {
     return;
@@ -1873,19 +3058,19 @@ HTTPSession::hasMoreWrites() const {
     << " numActiveWrites_: " << numActiveWrites_
     << " pendingWrites_.empty(): " << pendingWrites_.empty()
     << " pendingWrites_.size(): " << pendingWrites_.size()
-    << " txnEgressQueue_.empty(): " << txnEgressQueue_.empty();
+    << " txnEgressQueue_.empty(): " << txnEgressQueue_->empty();
 
   return (numActiveWrites_ != 0) ||
     !pendingWrites_.empty() || writeBuf_.front() ||
-    !txnEgressQueue_.empty();
+    !txnEgressQueue_->empty() || !fileRegions_.empty();
 }
 
 void HTTPSession::errorOnAllTransactions(ProxygenError err) {
-  std::vector<HTTPCodec::StreamID> ids;
-  for (const auto& txn: transactions_) {
-    ids.push_back(txn.first);
-  }
-  errorOnTransactionIds(ids, err);
+  transactions_.forEachSafe(
+    [err] (HTTPCodec::StreamID, HTTPTransaction& txn) {
+      HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS, err);
+      txn.onError(ex);
+    });
 }
 
 void HTTPSession::errorOnTransactionIds(
@@ -1895,8 +3080,7 @@ void HTTPSession::errorOnTransactionIds(
   for (auto id: ids) {
     auto txn = findTransaction(id);
     if (txn != nullptr) {
-      HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS);
-      ex.setProxygenError(err);
+      HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS, err);
       txn->onError(ex);
     }
   }
@@ -1924,7 +3108,8 @@ void HTTPSession::invalidStream(HTTPCodec::StreamID stream, ErrorCode code) {
   }
 
   HTTPException err(HTTPException::Direction::INGRESS_AND_EGRESS,
-                    "invalid stream=", stream);
+                    kErrorNone, "invalid stream");
+  err.setStreamID(stream);
   // TODO: Below line will change for HTTP/2 -- just call a const getter
   // function for the status code.
   err.setCodecStatusCode(code);
@@ -9,19 +9,36 @@
  */
 #pragma once
 
+#include <deque>
 #include <folly/IntrusiveList.h>
 #include <folly/experimental/wangle/ManagedConnection.h>
 #include <folly/experimental/wangle/acceptor/TransportInfo.h>
 #include <folly/io/IOBufQueue.h>
 #include <folly/io/async/EventBase.h>
+#include <limits>
+#include <map>
 #include <proxygen/lib/http/HTTPConstants.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
+#include <proxygen/lib/http/WindowAutoTuner.h>
 #include <proxygen/lib/http/codec/FlowControlFilter.h>
 #include <proxygen/lib/http/codec/HTTPCodec.h>
 #include <proxygen/lib/http/codec/HTTPCodecFilter.h>
+#include <proxygen/lib/http/codec/compress/HeaderCompressionStats.h>
 #include <proxygen/lib/http/session/ByteEventTracker.h>
+#include <proxygen/lib/http/session/EgressFlusher.h>
+#include <proxygen/lib/http/session/EgressShaper.h>
+#include <proxygen/lib/http/session/EgressQueue.h>
+#include <proxygen/lib/http/session/FileRegionWriter.h>
 #include <proxygen/lib/http/session/HTTPEvent.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/http/session/MemoryBudget.h>
+#include <proxygen/lib/http/session/SlowReaderDetector.h>
+#include <proxygen/lib/http/session/SlowTransactionSampler.h>
+#include <proxygen/lib/http/session/StreamTable.h>
+#include <proxygen/lib/http/session/ZeroCopyWriter.h>
+#include <proxygen/lib/utils/HHWheelTimer.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ReadSizeEstimator.h>
 #include <proxygen/lib/utils/Time.h>
 #include <queue>
 #include <set>
@@ -30,6 +47,8 @@
 
 namespace proxygen {
 
+class HTTP1xCodec;
+class HTTP2Codec;
 class HTTPSessionController;
 class HTTPSessionStats;
 
@@ -37,13 +56,26 @@ class HTTPSession:
   private FlowControlFilter::Callback,
   private HTTPCodec::Callback,
   private folly::EventBase::LoopCallback,
+  private EgressFlusher::Client,
+  private EgressShaper::Client,
   public ByteEventTracker::Callback,
+  private FileRegionWriter::Callback,
+  private MemoryBudget::Consumer,
   public HTTPTransaction::Transport,
   public apache::thrift::async::TAsyncTransport::ReadCallback,
   public folly::wangle::ManagedConnection {
  public:
   typedef std::unique_ptr<HTTPSession, Destructor> UniquePtr;
 
+  // the sessions come from the slabs of their thread, next to the buffers
+  // of the other sessions
+  static void* operator new(size_t size) {
+    return IOBufSlab::get().allocate(size);
+  }
+  static void operator delete(void* ptr) {
+    IOBufSlab::deallocate(ptr);
+  }
+
   /**
    * Optional callback interface that the HTTPSession
    * notifies of connection lifecycle events.
@@ -72,6 +104,11 @@ class HTTPSession:
     virtual void onPingReply(int64_t latency) = 0;
     virtual void onSettingsOutgoingStreamsFull(const HTTPSession&) = 0;
     virtual void onSettingsOutgoingStreamsNotFull(const HTTPSession&) = 0;
+    // The MemoryBudget of the thread paused the reads of the session
+    virtual void onMemoryBudgetExceeded(const HTTPSession&) {}
+    // Per-phase timestamps of a transaction, delivered as it detaches
+    virtual void onTransactionTimings(const HTTPSession&,
+                                      const HTTPTransactionTimings&) {}
   };
 
   class WriteTimeout :
@@ -87,6 +124,18 @@ class HTTPSession:
     HTTPSession* session_;
   };
 
+  class HibernateTimeout :
+      public HHWheelTimer::Callback {
+   public:
+    explicit HibernateTimeout(HTTPSession* session) : session_(session) {}
+
+    void timeoutExpired() noexcept override {
+      session_->hibernate();
+    }
+   private:
+    HTTPSession* session_;
+  };
+
   /**
    * Set the read buffer limit to be used for all new HTTPSession objects.
    */
@@ -193,10 +242,59 @@ class HTTPSession:
     return closeReason_;
   }
 
+  /**
+   * Built with PROXYGEN_HTTP1_ONLY, the filters added here don't see the
+   * calls of passThroughCodec()
+   */
   HTTPCodecFilterChain& getCodecFilterChain() {
     return codec_;
   }
 
+  /**
+   * Header compression totals of this session. They also go into
+   * HeaderCompressionStats::getThreadStats(), and are passed to the
+   * session stats when the session is destroyed.
+   */
+  const HeaderCompressionStats& getHeaderCompressionStats() const {
+    return headerCompressionStats_;
+  }
+
+  /**
+   * Number of reads from the transport, each one a read() of the socket,
+   * and number of writes handed to it. The reads grow up to
+   * ReadBufferPool::kMaxBufferSize bytes while they fill their buffers.
+   * The totals are passed to the session stats when the session is
+   * destroyed.
+   */
+  uint64_t getNumReads() const {
+    return numReads_;
+  }
+  uint64_t getNumWrites() const {
+    return numWrites_;
+  }
+
+  struct MemoryUsage {
+    // capacity of the read buffers
+    uint64_t readBuffer{0};
+    // egress not written yet, in the session or handed to the transport
+    uint64_t writeBuffer{0};
+    // see HTTPTransaction::getMemoryUsage()
+    uint64_t transactions{0};
+    // see HTTPCodec::getMemoryUsage()
+    uint64_t codec{0};
+
+    uint64_t total() const {
+      return sizeof(HTTPSession) + readBuffer + writeBuffer + transactions +
+        codec;
+    }
+  };
+
+  /**
+   * Estimate of the bytes the session holds. MemoryBudget::getFootprint()
+   * adds up the sessions of a thread with it.
+   */
+  MemoryUsage getMemoryUsage() const;
+
   /**
    * Set flow control properties on the session.
    *
@@ -220,12 +318,127 @@ class HTTPSession:
    */
   void setMaxConcurrentOutgoingStreams(uint32_t num);
 
+  /**
+   * Set the maximum number of concurrent transactions the peer may open,
+   * as advertised in SETTINGS. Unlike the above, this may be called at any
+   * time: a started session sends the new value right away. The limit is
+   * only advertised, the session doesn't refuse the streams over it.
+   * Downstream sessions also follow the StreamLimit of their thread.
+   */
+  void setMaxConcurrentIncomingStreams(uint32_t num);
+
   /*
    * The maximum number of concurrent push transactions that can be supported
    * on this session.
    */
   void setMaxConcurrentPushTransactions(uint32_t num);
 
+  /**
+   * Share the egress bandwidth between the priority levels in proportion
+   * to weights, one per level, instead of serving them in strict priority
+   * order. An empty vector goes back to strict priority. This replaces the
+   * egress queue of the session with a RoundRobinEgressQueue, so it must be
+   * called before any transaction is created.
+   */
+  void setPriorityWeights(const std::vector<uint32_t>& weights);
+
+  /**
+   * Replace the queue that decides in which order the transactions send
+   * their egress. Must be called before any transaction is created.
+   * By default HTTP/2 sessions follow the stream dependencies with a
+   * DependencyTreeEgressQueue, and the others use a RoundRobinEgressQueue.
+   */
+  void setEgressQueue(std::unique_ptr<EgressQueue> queue);
+
+  /**
+   * For a downstream session that starts on HTTP/1.x over plaintext: switch
+   * to codec, an HTTP/2 codec, if the client starts with the HTTP/2
+   * connection preface (prior knowledge), or if its first request asks for
+   * an Upgrade to h2c, which is answered with a 101 and stays stream 1.
+   * Must be called before startNow().
+   */
+#ifndef PROXYGEN_HTTP1_ONLY
+  void setH2CCodec(std::unique_ptr<HTTP2Codec> codec);
+#endif
+
+  /**
+   * Give the new transactions lazy timeouts, see
+   * HTTPTransaction::setLazyTimeouts()
+   */
+  void setLazyTransactionTimeouts(bool lazy) {
+    lazyTransactionTimeouts_ = lazy;
+  }
+
+  /**
+   * Once the session has had no transaction for idleTime, free what it
+   * only needs while messages are exchanged, see hibernate(). This needs
+   * a timeout set that uses an HHWheelTimer, without one the session
+   * hibernates as soon as it becomes idle.
+   */
+  void setHibernateTimeout(std::chrono::milliseconds idleTime) {
+    hibernateEnabled_ = true;
+    hibernateTimeout_ = idleTime;
+  }
+
+  /**
+   * With a serial codec downstream, hand up to maxRequests pipelined
+   * requests to their handlers at once instead of one after the other.
+   * The responses that are ready before those of the earlier requests
+   * stay in their transactions, with their handlers' egress paused, and
+   * are written in order. Reads pause while maxRequests transactions are
+   * open or while more than maxBufferBytes of egress body is held. The
+   * codec must have been set up for it, see HTTP1xCodec::setPipelining().
+   * A maxRequests of 0 or 1 keeps one request at a time.
+   */
+  void setPipelining(uint32_t maxRequests, uint64_t maxBufferBytes) {
+    maxPipelinedRequests_ = maxRequests;
+    maxPipelinedBufferBytes_ = maxBufferBytes;
+  }
+
+  /**
+   * Hold the window credits of the streams and of the connection until the
+   * end of the event loop iteration, and write all the WINDOW_UPDATEs then,
+   * one per stream. Uploads on many streams then add one frame per stream
+   * and loop instead of one per processed body chunk.
+   */
+  void setBatchWindowUpdates(bool batch) {
+    batchWindowUpdates_ = batch;
+  }
+
+  /**
+   * Set the number of processed bytes after which a WINDOW_UPDATE is due,
+   * for the new transactions and for the connection. 0 keeps the default
+   * of half the receive window.
+   */
+  void setWindowUpdateThresholds(uint32_t streamThreshold,
+                                 uint32_t connThreshold);
+
+  /**
+   * Set the most writes runLoopCallback() hands to the transport per loop,
+   * and the number of bytes it gathers from the egress of several
+   * transactions before it writes them together in one writev. With a
+   * batchBytes of 0 each write carries the egress of one transaction.
+   */
+  void setEgressBatching(uint32_t maxWritesPerLoop, uint32_t batchBytes) {
+    CHECK_GT(maxWritesPerLoop, 0);
+    maxWritesPerLoop_ = maxWritesPerLoop;
+    egressBatchBytes_ = batchBytes;
+  }
+
+  /**
+   * Write through the flusher of the EventBase, in turn with the other
+   * sessions that use it and within its budget, rather than from a loop
+   * callback of this session. See EgressFlusher.
+   */
+  void setEgressFlusher(std::shared_ptr<EgressFlusher> flusher);
+
+  /**
+   * Send the egress of the transactions within the rates of their classes
+   * in shaper, shared with the other sessions of the EventBase. See
+   * EgressShaper.
+   */
+  void setEgressShaper(std::shared_ptr<EgressShaper> shaper);
+
   /**
    * Get the number of egress bytes this session will buffer before
    * pausing all transactions' egress.
@@ -431,7 +644,8 @@ class HTTPSession:
   // TAsyncTransport::ReadCallback methods
   void getReadBuffer(void** buf, size_t* bufSize);
   void readDataAvailable(size_t readSize) noexcept;
-  void processReadData();
+  // withBudget false parses past setIngressBudget()
+  void processReadData(bool withBudget = true);
   void readEOF() noexcept;
   void readError(
       const apache::thrift::transport::TTransportException&) noexcept;
@@ -445,6 +659,7 @@ class HTTPSession:
                          std::unique_ptr<HTTPMessage> msg);
   void onBody(HTTPCodec::StreamID streamID,
       std::unique_ptr<folly::IOBuf> chain);
+  void onPadding(HTTPCodec::StreamID streamID, uint16_t bytes);
   void onChunkHeader(HTTPCodec::StreamID stream, size_t length);
   void onChunkComplete(HTTPCodec::StreamID stream);
   void onTrailersComplete(HTTPCodec::StreamID streamID,
@@ -459,6 +674,7 @@ class HTTPSession:
   void onPingRequest(uint64_t uniqueID);
   void onPingReply(uint64_t uniqueID);
   void onWindowUpdate(HTTPCodec::StreamID stream, uint32_t amount);
+  void onPriority(HTTPCodec::StreamID stream, const HTTPPriority& priority);
   void onSettings(const SettingsList& settings);
   uint32_t numOutgoingStreams() const { return outgoingStreams_; }
   uint32_t numIncomingStreams() const { return incomingStreams_; }
@@ -467,11 +683,15 @@ class HTTPSession:
   void pauseIngress(HTTPTransaction* txn) noexcept override;
   void resumeIngress(HTTPTransaction* txn) noexcept override;
   void transactionTimeout(HTTPTransaction* txn) noexcept override;
+  void transactionSlow(HTTPTransaction* txn) noexcept override;
   void sendHeaders(HTTPTransaction* txn,
                    const HTTPMessage& headers,
                    HTTPHeaderSize* size) noexcept override;
   size_t sendBody(HTTPTransaction* txn, std::unique_ptr<folly::IOBuf>,
                   bool includeEOM) noexcept override;
+  bool canSendFileRegion(HTTPTransaction* txn) noexcept override;
+  size_t sendFileRegion(HTTPTransaction* txn,
+                        const FileRegion& region) noexcept override;
   size_t sendChunkHeader(HTTPTransaction* txn,
                          size_t length) noexcept override;
   size_t sendChunkTerminator(HTTPTransaction* txn) noexcept override;
@@ -485,15 +705,24 @@ class HTTPSession:
                           uint32_t bytes) noexcept override;
   void notifyPendingEgress() noexcept override;
   void notifyIngressBodyProcessed(uint32_t bytes) noexcept override;
+  uint32_t capReceiveWindow(const HTTPTransaction* txn,
+                            uint32_t capacity) noexcept override;
+  void notifyEgressBodyBuffered(int64_t bytes) noexcept override;
   HTTPTransaction* newPushedTransaction(HTTPCodec::StreamID assocStreamId,
                                         HTTPTransaction::PushHandler* handler,
                                         int8_t priority) noexcept override;
+  void recordFetched(const std::string& path) noexcept override;
+  bool wasRecentlyFetched(const std::string& path) const noexcept override;
 
  public:
   const folly::SocketAddress& getLocalAddress()
     const noexcept override;
   const folly::SocketAddress& getPeerAddress()
     const noexcept;
+  std::shared_ptr<const CachedSocketAddress> getCachedLocalAddress()
+    const override;
+  std::shared_ptr<const CachedSocketAddress> getCachedPeerAddress()
+    const override;
 
   folly::TransportInfo& getSetupTransportInfo() noexcept;
   const folly::TransportInfo& getSetupTransportInfo() const noexcept override;
@@ -508,6 +737,122 @@ class HTTPSession:
   void setByteEventTracker(std::unique_ptr<ByteEventTracker> byteEventTracker);
   ByteEventTracker* getByteEventTracker() { return byteEventTracker_.get(); }
 
+  /**
+   * Measure the time to the ack of the last byte of each transaction with
+   * the TX timestamps of the kernel, see TimestampingByteEventTracker. Must
+   * be called before any transaction is created.
+   *
+   * @return false if the socket doesn't support them, the session keeps its
+   * ByteEventTracker then
+   */
+  bool enableAckTimestamps(uint32_t maxAckTracked,
+                           AsyncTimeoutSet* ackLatencyTimeouts);
+
+  /**
+   * Write the chains of at least minWriteSize bytes with MSG_ZEROCOPY, see
+   * ZeroCopyWriter. This needs a plaintext socket. The ack timestamps read
+   * the same error queue, so only one of the two can be on.
+   *
+   * @return false if the socket doesn't support it
+   */
+  bool enableZeroCopyWrites(uint64_t minWriteSize);
+
+  /**
+   * Set TCP_NOTSENT_LOWAT on the socket, so that the kernel takes new
+   * bytes only while less than lowat of them are waiting to be sent. A
+   * write then completes when the socket needs more data, and the bytes
+   * stay in the egress queue of the session until then, where a late high
+   * priority transaction can still go first. The writes from the egress
+   * queue are limited to lowat bytes.
+   *
+   * @return false if the socket doesn't support it
+   */
+  bool enableNotSentLowat(uint32_t lowat);
+
+  /**
+   * Grow the receive windows of the session and of its streams when they
+   * are smaller than the bandwidth-delay product, see WindowAutoTuner. The
+   * RTT comes from TCP_INFO. maxWindow is the most a window may grow to,
+   * and so the ingress memory the session commits to.
+   *
+   * @return false if the codec has no connection flow control
+   */
+  bool enableReceiveWindowAutoTuning(uint32_t maxWindow);
+
+  /**
+   * Size the receive window of each new stream by how fast its handler
+   * consumes the body, between minWindow and maxWindow, see
+   * StreamWindowSizer. A stream window grows no larger than the session
+   * window, nor by more than the room left in the MemoryBudget of the
+   * thread.
+   *
+   * @return false if the codec has no stream flow control
+   */
+  bool enableStreamWindowSizing(uint32_t minWindow, uint32_t maxWindow);
+
+  /**
+   * Watch how fast the peer takes the buffered egress, see
+   * SlowReaderDetector. A slow reader is drained, so it starts no new
+   * streams, and the receive windows of its streams are halved, which
+   * caps what it buffers in the session until it catches up. Past the
+   * deadline it is reset, even if the write timeout wasn't reached. Both
+   * are counted in HTTPSessionStats.
+   */
+  void enableSlowReaderDetection(std::chrono::milliseconds maxDrainTime,
+                                 std::chrono::milliseconds deadline,
+                                 uint64_t minBuffered);
+
+  /**
+   * Record the state of the session and of each transaction still open
+   * after the interval of timeouts in sampler. The interval should be the
+   * threshold of the sampler; the set usually serves all the sessions of
+   * a thread. Applies to the transactions created from now on.
+   */
+  void setSlowTransactionSampler(
+    std::shared_ptr<SlowTransactionSampler> sampler,
+    AsyncTimeoutSet* timeouts);
+
+  /**
+   * Parse at most about this many bytes of ingress at once, from a read or
+   * from the loop callback, and leave the rest to the loop callback, so
+   * that a session that got a large batch of pipelined requests or of
+   * frames doesn't hold the loop while the other sessions of the thread
+   * wait. A frame or message head larger than the budget is parsed whole.
+   * 0, the default, parses all there is.
+   */
+  void setIngressBudget(uint64_t bytes) {
+    ingressBudget_ = bytes;
+  }
+
+  /**
+   * Time the requests out with the interval of timeouts, rather than the
+   * transaction timeouts of the session, until their headers arrived, so
+   * that clients that send them slowly don't hold the server for as long
+   * as idle transactions may be. Downstream only; applies to the
+   * transactions created from now on, null to stop.
+   */
+  void setHeaderTimeouts(AsyncTimeoutSet* timeouts) {
+    headerTimeouts_ = timeouts;
+  }
+
+  /**
+   * Read TCP_INFO as transactions detach, at most once per interval, and
+   * hand each sample to the session stats and to the timings of the
+   * transactions (HTTPTransactionTimings::tcpInfo). The window autotuner
+   * then takes its RTT from the samples too, instead of reading TCP_INFO
+   * on each connection window update. 0, the default, samples nothing.
+   */
+  void setTCPInfoSampleInterval(std::chrono::milliseconds interval) {
+    tcpInfoSampleInterval_ = interval;
+  }
+
+  /**
+   * @return the last TCP_INFO sample, unset if there was none
+   */
+  const TCPInfoSample& getLastTCPInfo() const {
+    return lastTCPInfo_;
+  }
+
  protected:
 
   /**
@@ -521,6 +866,12 @@ class HTTPSession:
   // EventBase::LoopCallback methods
   void runLoopCallback() noexcept override;
 
+  // EgressFlusher::Client methods
+  uint64_t flushEgress(uint64_t bytesAllowed) noexcept override;
+
+  // EgressShaper::Client methods
+  void onEgressAllowed() noexcept override;
+
   /**
    * Schedule a write to occur at the end of this event loop.
    */
@@ -542,9 +893,21 @@ class HTTPSession:
    * enqueued within the whole session.
    */
   inline uint64_t sessionByteOffset() {
-    return bytesScheduled_ + writeBuf_.chainLength();
+    return bytesScheduled_ + writeBuf_.chainLength() + pendingFileBytes_;
   }
 
+  /**
+   * Start writing the file region at the front of fileRegions_
+   */
+  void writeFileRegion();
+
+  // FileRegionWriter::Callback
+  void onFileRegionWritten(uint64_t bytesWritten) noexcept override;
+  void onFileRegionError(
+    uint64_t bytesWritten,
+    const apache::thrift::transport::TTransportException& ex)
+    noexcept override;
+
   /**
    * Check whether the socket is shut down in both directions; if it is,
    * initiate the destruction of this HTTPSession.
@@ -605,35 +968,128 @@ class HTTPSession:
    */
   void resumeReads();
 
+  /**
+   * Ack ingress bytes on the connection flow control window, and grow the
+   * receive windows if auto tuning is on and an update went out.
+   */
+  void connIngressBytesProcessed(uint32_t bytes);
+
+  /**
+   * Free the buffers of an idle session: the empty read buffer goes back to
+   * the pool and the next read starts small again, the codec drops its
+   * scratch buffers and the header tables shrink like for an exceeded
+   * HeaderTableBudget. They come back with the next transaction. The
+   * stateful zlib contexts of SPDY stay, they can't be rebuilt.
+   */
+  void hibernate();
+
+  /**
+   * Hand the latencies of a detaching transaction to sessionStats_
+   */
+  void recordLatencies(const HTTPTransactionTimings& timings);
+
+  /**
+   * Read TCP_INFO into lastTCPInfo_ if the sample interval has passed
+   * since the last sample
+   */
+  void sampleTCPInfo(TimePoint now);
+
+  // Hibernate now or later, once the session became idle
+  void scheduleHibernate();
+
+  // MemoryBudget::Consumer methods
+  void pauseForMemory() noexcept override;
+  void resumeForMemory() noexcept override;
+  uint64_t getMemoryFootprint() const override;
+  void describeMemory(folly::dynamic& out) const override;
+
+  /**
+   * Charge the buffers of the session to the MemoryBudget of the thread
+   */
+  void updateMemoryUsage();
+
+  /**
+   * Feed slowReaderDetector_ with a completed write, and act if the peer
+   * became a slow reader or stayed one too long
+   */
+  void checkSlowReader(uint64_t bytesWritten);
+  void ackConnIngress(uint32_t bytes);
+
+  /**
+   * Write the WINDOW_UPDATEs held back by setBatchWindowUpdates()
+   */
+  void flushWindowUpdates();
+
+  /**
+   * The egress a pipelined transaction generated while the responses
+   * before its own weren't written yet; its body waits in the transaction
+   */
+  struct PipelinedEgress {
+    std::vector<HTTPMessage> headers;
+    std::unique_ptr<HTTPHeaders> trailers;
+    ErrorCode abortCode{ErrorCode::NO_ERROR};
+    bool eom{false};
+    bool abort{false};
+    // the transaction is kept until the EOM or abort is written
+    bool held{false};
+    // the first one, writing directly
+    bool head{false};
+  };
+
+  bool isPipelining() const {
+    return maxPipelinedRequests_ > 1 && isDownstream() &&
+      !codec_->supportsParallelRequests();
+  }
+
+  /**
+   * @return where the egress of txn goes while it has to wait for the
+   *         responses before its own, nullptr once it can be written
+   */
+  PipelinedEgress* getBlockedEgress(HTTPTransaction* txn);
+
+  /**
+   * Write the egress the transaction at the head of the pipeline held
+   * while it waited, and let it write from then on, as many times as that
+   * finishes its response. Called in the loop callback.
+   */
+  void flushPipelinedEgress();
+
+  /**
+   * The transaction is done with the pipeline; the next one gets its turn
+   */
+  void finishPipelinedEgress(HTTPTransaction* txn);
+
+  /**
+   * Forget the egress the pipelined transactions hold, once it can't be
+   * written anymore
+   */
+  void dropPipelinedEgress();
+
+  // Pause or resume reads for the limits of setPipelining()
+  void updatePipelinePauseState();
+
   /** Check whether the session has any writes in progress or upcoming */
   bool hasMoreWrites() const;
 
   /**
    * This function invokes a callback on all transactions. It is safe,
-   * but runs in O(n*log n) and if the callback *adds* transactions,
-   * they will not get the callback.
+   * the callback may detach transactions, but if the callback *adds*
+   * transactions, they will not get the callback.
    */
   template<typename... Args1, typename... Args2>
   void invokeOnAllTransactions(void (HTTPTransaction::*fn)(Args1...),
                                Args2&&... args) {
     DestructorGuard g(this);
-    std::vector<HTTPCodec::StreamID> ids;
-    for (const auto& txn: transactions_) {
-      ids.push_back(txn.first);
-    }
-    for (auto idit = ids.begin(); idit != ids.end() && !transactions_.empty();
-         ++idit) {
-      auto txn = findTransaction(*idit);
-      if (txn != nullptr) {
-        (txn->*fn)(std::forward<Args2>(args)...);
-      }
-    }
+    transactions_.forEachSafe(
+      [&] (HTTPCodec::StreamID, HTTPTransaction& txn) {
+        (txn.*fn)(std::forward<Args2>(args)...);
+      });
   }
 
   /**
    * This function invokes a callback on all transactions. It is safe,
-   * but runs in O(n*log n) and if the callback *adds* transactions,
-   * they will not get the callback.
+   * the callback may detach transactions, but if the callback *adds*
+   * transactions, they will not get the callback.
    */
   void errorOnAllTransactions(ProxygenError err);
 
@@ -654,16 +1110,77 @@ class HTTPSession:
 
   void drainImpl();
 
+  /**
+   * Change the capacity of the header tables, keeping the thread's
+   * HeaderTableBudget up to date, and send it to the peer.
+   */
+  void resizeHeaderTables(uint32_t size);
+
+  /**
+   * Advertise the StreamLimit of the thread if it changed since the last
+   * look.
+   */
+  void applyStreamLimit();
+
+#ifndef PROXYGEN_HTTP1_ONLY
+  /**
+   * Switch to h2cCodec_ once the first bytes are the HTTP/2 connection
+   * preface.
+   *
+   * @return false while the bytes read so far may still be the preface
+   */
+  bool sniffH2CPreface();
+
+  /**
+   * Answer the h2c Upgrade request of txn with a 101 and switch to
+   * h2cCodec_.
+   *
+   * @return false if the request doesn't qualify
+   */
+  bool upgradeToH2C(HTTPTransaction* txn, const HTTPMessage& msg);
+
+  /**
+   * Put h2cCodec_ at the end of the codec chain in place of the HTTP/1.x
+   * codec, with connection flow control, and send the SETTINGS of the
+   * server.
+   */
+  void installH2CCodec();
+#endif
+
+  /**
+   * The codec for the calls that the filters of an HTTP/1.x session pass
+   * through untouched: onIngress() and the egress of the bodies. Built
+   * with PROXYGEN_HTTP1_ONLY, where every session is HTTP/1.x, it is the
+   * HTTP1xCodec at the end of the chain, which is final, so those calls
+   * are direct instead of two virtual calls through the chain.
+   */
+#ifdef PROXYGEN_HTTP1_ONLY
+  HTTP1xCodec* passThroughCodec() {
+    return http1xCodec_;
+  }
+#else
+  HTTPCodec* passThroughCodec() {
+    return codec_.call();
+  }
+#endif
+
   /** Chain of ingress IOBufs */
   folly::IOBufQueue readBuf_{folly::IOBufQueue::cacheChainLength()};
 
+  /**
+   * Size of the next read from sock_, learnt from the recent reads. The
+   * buffers come from the ReadBufferPool of the thread, and go back to it
+   * once parsed, so that idle sessions hold no read buffer.
+   */
+  ReadSizeEstimator readSize_;
+
   /** Queue of egress IOBufs */
   folly::IOBufQueue writeBuf_{folly::IOBufQueue::cacheChainLength()};
 
   /** Priority queue of transactions with egress pending */
-  HTTPTransaction::PriorityQueue txnEgressQueue_;
+  std::unique_ptr<EgressQueue> txnEgressQueue_;
 
-  std::map<HTTPCodec::StreamID, HTTPTransaction> transactions_;
+  StreamTable<HTTPTransaction> transactions_;
 
   /** Count of transactions awaiting input */
   uint32_t liveTransactions_{0};
@@ -671,11 +1188,37 @@ class HTTPSession:
   /** Transaction sequence number */
   uint32_t transactionSeqNo_{0};
 
-  /** Address of this end of the TCP connection */
-  folly::SocketAddress localAddr_;
+  const TransportDirection direction_;
 
-  /** Address of the remote end of the TCP connection */
-  folly::SocketAddress peerAddr_;
+  enum SocketState {
+    UNPAUSED = 0,
+    PAUSED = 1,
+    SHUTDOWN = 2,
+  };
+
+  SocketState reads_:2;
+  SocketState writes_:2;
+
+  /**
+   * Indicates if the session is waiting for existing transactions to close.
+   * Once all transactions close, the session will be deleted.
+   */
+  bool draining_:1;
+
+  /**
+   * Indicates whether an upgrade request has been received from the codec.
+   */
+  bool ingressUpgraded_:1;
+
+  bool started_:1;
+
+  bool writesDraining_:1;
+  bool resetAfterDrainingWrites_:1;
+  // indicates a fatal error that prevents further ingress data processing
+  bool ingressError_:1;
+  bool inLoopCallback_:1;
+  // the first bytes may still turn out to be the HTTP/2 preface
+  bool h2cSniffing_:1;
 
   WriteSegmentList pendingWrites_;
 
@@ -683,8 +1226,24 @@ class HTTPSession:
 
   HTTPSessionController* controller_{nullptr};
 
+  // declared before codec_, which keeps a pointer to it
+  HeaderCompressionStats headerCompressionStats_{
+    &HeaderCompressionStats::getThreadStats()};
+
   HTTPCodecFilterChain codec_;
 
+#ifdef PROXYGEN_HTTP1_ONLY
+  // see passThroughCodec()
+  HTTP1xCodec* http1xCodec_{nullptr};
+#else
+  /**
+   * See setH2CCodec(). The HTTP/1.x codec it replaces is kept until it
+   * returns from onIngress().
+   */
+  std::unique_ptr<HTTP2Codec> h2cCodec_;
+  std::unique_ptr<HTTPCodec> retiredCodec_;
+#endif
+
   InfoCallback* infoCallback_{nullptr};
 
   /**
@@ -694,13 +1253,12 @@ class HTTPSession:
     {ConnectionCloseReason::kMAX_REASON};
 
   WriteTimeout writeTimeout_;
+  HibernateTimeout hibernateCallback_{this};
 
   AsyncTimeoutSet* transactionTimeouts_{nullptr};
 
   HTTPSessionStats* sessionStats_{nullptr};
 
-  folly::TransportInfo transportInfo_;
-
   /**
    * Connection level flow control for SPDY >= 3.1 and HTTP/2
    */
@@ -717,6 +1275,14 @@ class HTTPSession:
    */
   uint32_t pushedTxns_{0};
 
+  /**
+   * Hashes of the paths of the last resources the peer requested or was
+   * pushed, oldest at nextRecentFetch_ once full. Only kept by the
+   * sessions that can push. See wasRecentlyFetched().
+   */
+  std::vector<size_t> recentFetches_;
+  uint32_t nextRecentFetch_{0};
+
   /**
    * Bytes of egress data sent to the socket but not yet written
    * to the network.
@@ -742,7 +1308,13 @@ class HTTPSession:
    * The maximum number of concurrent transactions that this session's peer
    * may create.
    */
-  uint32_t maxConcurrentIncomingStreams_{100};
+  uint32_t maxConcurrentIncomingStreams_{
+    kDefaultMaxConcurrentIncomingStreams};
+
+  /**
+   * The generation of the StreamLimit of the thread last applied
+   */
+  uint64_t streamLimitGeneration_{0};
 
   /**
    * The number concurrent transactions initiated by this session
@@ -771,44 +1343,158 @@ class HTTPSession:
    */
   uint64_t bytesWritten_{0};
 
+  /**
+   * Time of the most recent read; stamped on transactions created from it.
+   */
+  TimePoint lastReadTime_;
+
+  /**
+   * Number of reads and bytes read, and of writes handed to the transport
+   */
+  uint64_t numReads_{0};
+  uint64_t bytesRead_{0};
+  uint64_t numWrites_{0};
+
+  /**
+   * Body bytes the transactions hold until they can send them
+   */
+  uint64_t egressBodyBuffered_{0};
+
   /**
    * Number of bytes scheduled so far.
    */
   uint64_t bytesScheduled_{0};
 
-  // Flow control settings
-  size_t initialReceiveWindow_{65536};
-  size_t receiveStreamWindowSize_{65536};
+  /**
+   * Body regions of files queued by sendFileRegion(), with the session
+   * byte offset at which each of them starts. The egress in writeBuf_
+   * that comes after a region is not written until the region is.
+   */
+  std::deque<std::pair<uint64_t, FileRegion>> fileRegions_;
 
-  const TransportDirection direction_;
+  /**
+   * Bytes in fileRegions_
+   */
+  uint64_t pendingFileBytes_{0};
 
-  enum SocketState {
-    UNPAUSED = 0,
-    PAUSED = 1,
-    SHUTDOWN = 2,
-  };
+  /**
+   * Writes the file regions with sendfile(), created on first use
+   */
+  std::unique_ptr<FileRegionWriter> fileWriter_;
 
-  SocketState reads_:2;
-  SocketState writes_:2;
+  /**
+   * Writes the large chains when zero copy writes are on
+   */
+  std::unique_ptr<ZeroCopyWriter> zeroCopyWriter_;
+  uint64_t zeroCopyMinWriteSize_{0};
 
   /**
-   * Indicates if the session is waiting for existing transactions to close.
-   * Once all transactions close, the session will be deleted.
+   * TCP_NOTSENT_LOWAT of the socket, 0 if it isn't set
    */
-  bool draining_:1;
+  uint32_t notSentLowat_{0};
 
   /**
-   * Indicates whether an upgrade request has been received from the codec.
+   * Grows the receive windows, with the bytes acked since the last
+   * connection window update
    */
-  bool ingressUpgraded_:1;
+  std::unique_ptr<WindowAutoTuner> windowAutoTuner_;
+  uint64_t autoTuneBytes_{0};
 
-  bool started_:1;
+  // bounds of the stream windows sized by their handlers, 0 if they aren't
+  uint32_t minStreamWindow_{0};
+  uint32_t maxStreamWindow_{0};
 
-  bool writesDraining_:1;
-  bool resetAfterDrainingWrites_:1;
-  // indicates a fatal error that prevents further ingress data processing
-  bool ingressError_:1;
-  bool inLoopCallback_:1;
+  std::unique_ptr<SlowReaderDetector> slowReaderDetector_;
+
+  std::shared_ptr<SlowTransactionSampler> slowTransactionSampler_;
+  AsyncTimeoutSet* slowTransactionTimeouts_{nullptr};
+
+  // of the requests until their headers arrived, see setHeaderTimeouts()
+  AsyncTimeoutSet* headerTimeouts_{nullptr};
+
+  // see setIngressBudget()
+  uint64_t ingressBudget_{0};
+
+  std::chrono::milliseconds tcpInfoSampleInterval_{0};
+  TimePoint lastTCPInfoRead_;
+  TCPInfoSample lastTCPInfo_;
+
+  bool lazyTransactionTimeouts_{false};
+
+  /**
+   * See setHibernateTimeout()
+   */
+  bool hibernateEnabled_{false};
+  std::chrono::milliseconds hibernateTimeout_{0};
+
+  /**
+   * Window credits waiting for flushWindowUpdates(), by stream, and the
+   * ingress bytes not yet acked to the connection window
+   */
+  bool batchWindowUpdates_{false};
+  std::map<HTTPCodec::StreamID, uint32_t> pendingWindowUpdates_;
+  uint32_t pendingConnAck_{0};
+  uint32_t streamWindowUpdateThreshold_{0};
+
+  /**
+   * See setEgressBatching()
+   */
+  uint32_t maxWritesPerLoop_{kMaxWritesPerLoop};
+  uint32_t egressBatchBytes_{0};
+
+  /**
+   * See setEgressFlusher(). runLoopCallback() stops writing once it has
+   * handed flushBytesAllowed_ to the transport in a turn of the flusher.
+   */
+  std::shared_ptr<EgressFlusher> egressFlusher_;
+  uint64_t flushBytesAllowed_{std::numeric_limits<uint64_t>::max()};
+
+  /**
+   * See setEgressShaper()
+   */
+  std::shared_ptr<EgressShaper> egressShaper_;
+
+  /**
+   * See setPipelining(). The open transactions while pipelining, in
+   * order, until their responses are finished.
+   */
+  uint32_t maxPipelinedRequests_{0};
+  uint64_t maxPipelinedBufferBytes_{0};
+  std::map<HTTPCodec::StreamID, PipelinedEgress> pipelinedEgress_;
+  bool pipelinePaused_{false};
+
+  /**
+   * Capacity of the header tables the codec was set up with, and the one
+   * in use, which is lower while the session is idle and the thread's
+   * HeaderTableBudget is exceeded.
+   */
+  uint32_t headerTableSize_{0};
+  uint32_t curHeaderTableSize_{0};
+
+  // Flow control settings
+  size_t initialReceiveWindow_{65536};
+  size_t receiveStreamWindowSize_{65536};
+  // for the connection flow control of a codec installed later
+  size_t receiveSessionWindowSize_{kDefaultReadBufLimit};
+  uint32_t connWindowUpdateThreshold_{0};
+
+
+  /*
+   * The members above are used on every read and write, the ones below
+   * only when the session is set up or logged.
+   */
+
+  /** Address of this end of the TCP connection */
+  folly::SocketAddress localAddr_;
+
+  /** Address of the remote end of the TCP connection */
+  folly::SocketAddress peerAddr_;
+
+  /** The two addresses above, shared by all messages of this session */
+  mutable std::shared_ptr<const CachedSocketAddress> cachedLocalAddr_;
+  mutable std::shared_ptr<const CachedSocketAddress> cachedPeerAddr_;
+
+  folly::TransportInfo transportInfo_;
 
   /**
    * Maximum number of ingress body bytes that can be buffered across all
@@ -816,12 +1502,21 @@ class HTTPSession:
    */
   static uint32_t kDefaultReadBufLimit;
 
+  static const uint32_t kDefaultMaxConcurrentIncomingStreams = 100;
+
   /**
    * Maximum number of bytes that can be buffered in sock_ before
    * this session will start applying backpressure to its transactions.
    */
   static uint32_t kPendingWriteMax;
 
+  /**
+   * Default maximum number of writes per event loop iteration.
+   * Lower = higher latency, better prioritization
+   * Higher = lower latency, less prioritization
+   */
+  static const uint32_t kMaxWritesPerLoop = 32;
+
  private:
   void onSetSendWindow(uint32_t windowSize);
   void onSetMaxInitiatedStreams(uint32_t maxTxns);
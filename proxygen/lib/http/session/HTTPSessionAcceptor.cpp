@@ -10,9 +10,20 @@
 #include <proxygen/lib/http/session/HTTPSessionAcceptor.h>
 
 #include <proxygen/lib/http/codec/HTTP1xCodec.h>
+#ifndef PROXYGEN_HTTP1_ONLY
+#include <proxygen/lib/http/codec/HTTP2Codec.h>
+#include <proxygen/lib/http/codec/compress/GzipHeaderCodec.h>
+#include <proxygen/lib/http/codec/compress/StaticHeaderTable.h>
+#include <proxygen/lib/http/session/HQSession.h>
+#endif
 #include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
+#include <proxygen/lib/http/session/IoUringTransport.h>
+#include <proxygen/lib/ssl/KernelTLS.h>
+#include <proxygen/lib/utils/ReadBufferPool.h>
+#include <proxygen/lib/utils/Time.h>
 
 using apache::thrift::async::TAsyncSocket;
+using apache::thrift::async::TAsyncTransport;
 using folly::SocketAddress;
 using std::list;
 using std::string;
@@ -26,12 +37,22 @@ HTTPSessionAcceptor::HTTPSessionAcceptor(
   const AcceptorConfiguration& accConfig):
     HTTPAcceptor(accConfig),
     simpleController_(this) {
+#ifdef PROXYGEN_HTTP1_ONLY
+  CHECK(isSSL() || accConfig.plaintextProtocol.empty() ||
+        HTTP1xCodec::supportsNextProtocol(accConfig.plaintextProtocol))
+    << "Built with HTTP/1.x only, can't speak "
+    << accConfig.plaintextProtocol;
+#else
   if (!isSSL()) {
     auto version = SPDYCodec::getVersion(accConfig.plaintextProtocol);
     if (version) {
       alwaysUseSPDYVersion_ = *version;
+    } else if (accConfig.plaintextProtocol ==
+               http2::kProtocolCleartextString) {
+      alwaysUseHTTP2_ = true;
     }
   }
+#endif
 }
 
 HTTPSessionAcceptor::~HTTPSessionAcceptor() {
@@ -51,29 +72,82 @@ const HTTPErrorPage* HTTPSessionAcceptor::getErrorPage(
   return errorPage;
 }
 
+void HTTPSessionAcceptor::prewarm() {
+  // about the read buffers of as many connections reading at once
+  const size_t kReadBuffers = 16;
+
+#ifndef PROXYGEN_HTTP1_ONLY
+  StaticHeaderTable::get();
+  if (alwaysUseSPDYVersion_) {
+    if (alwaysUseSPDYVersion_.value() != SPDYVersion::SPDY3_1_HPACK) {
+      GzipHeaderCodec::prewarm(alwaysUseSPDYVersion_.value(),
+                               accConfig_.spdyCompressionLevel);
+    }
+  } else if (isSSL()) {
+    // the zlib versions clients mostly negotiate
+    for (auto version: {SPDYVersion::SPDY3, SPDYVersion::SPDY3_1}) {
+      GzipHeaderCodec::prewarm(version, accConfig_.spdyCompressionLevel);
+    }
+  }
+#endif
+  ReadBufferPool::get().reserve(ReadBufferPool::kMinBufferSize, kReadBuffers);
+}
+
 void HTTPSessionAcceptor::onNewConnection(
   folly::AsyncSocket::UniquePtr ssock,
     const SocketAddress* peerAddress,
     const string& nextProtocol,
   const folly::TransportInfo& tinfo) {
+  TimePoint start;
+  if (downstreamSessionStats_) {
+    start = getCurrentTime();
+  }
   unique_ptr<HTTPCodec> codec;
-  SPDYVersion spdyVersion;
+#ifndef PROXYGEN_HTTP1_ONLY
+  unique_ptr<HTTP2Codec> h2cCodec;
+#endif
 
   TAsyncSocket::UniquePtr sock(dynamic_cast<TAsyncSocket*>(ssock.release()));
 
+  if (isSSL() && (accConfig_.sslSessionCache || accConfig_.sslTicketKeys)) {
+    attachSSLSessionSharing(sock.get());
+  }
+  if (isSSL() && accConfig_.kernelTLS && !installKernelTLS(sock)) {
+    return;
+  }
+
+#ifndef PROXYGEN_HTTP1_ONLY
   if (!isSSL() && alwaysUseSPDYVersion_) {
     codec = folly::make_unique<SPDYCodec>(
       TransportDirection::DOWNSTREAM,
       alwaysUseSPDYVersion_.value(),
       accConfig_.spdyCompressionLevel);
-  } else if (nextProtocol.empty() ||
+  } else if (!isSSL() && alwaysUseHTTP2_) {
+    codec = folly::make_unique<HTTP2Codec>(TransportDirection::DOWNSTREAM);
+  } else
+#endif
+  if (nextProtocol.empty() ||
              HTTP1xCodec::supportsNextProtocol(nextProtocol)) {
-    codec = folly::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM);
+    auto http1xCodec =
+      folly::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM);
+    http1xCodec->setPipelining(accConfig_.maxPipelinedRequests > 1);
+    http1xCodec->setCoalesceIngressBody(accConfig_.coalesceIngressBody);
+    http1xCodec->setKeepRawHeaders(accConfig_.keepRawHeaders);
+    codec = std::move(http1xCodec);
+#ifndef PROXYGEN_HTTP1_ONLY
+    if (!isSSL() && accConfig_.allowH2C) {
+      h2cCodec =
+        folly::make_unique<HTTP2Codec>(TransportDirection::DOWNSTREAM);
+      h2cCodec->setHeaderTableSize(accConfig_.headerTableSize);
+    }
   } else if (auto version = SPDYCodec::getVersion(nextProtocol)) {
     codec = folly::make_unique<SPDYCodec>(
       TransportDirection::DOWNSTREAM,
       *version,
       accConfig_.spdyCompressionLevel);
+  } else if (HTTP2Codec::supportsNextProtocol(nextProtocol)) {
+    codec = folly::make_unique<HTTP2Codec>(TransportDirection::DOWNSTREAM);
+#endif
   } else {
     // Either we advertised a protocol we don't support or the
     // client requested a protocol we didn't advertise.
@@ -82,6 +156,7 @@ void HTTPSessionAcceptor::onNewConnection(
   }
 
   CHECK(codec);
+  codec->setHeaderTableSize(accConfig_.headerTableSize);
 
   auto controller = getController();
   SocketAddress localAddress;
@@ -91,14 +166,133 @@ void HTTPSessionAcceptor::onNewConnection(
     VLOG(3) << "couldn't get local address for socket";
     localAddress = unknownSocketAddress_;
   }
+  TAsyncTransport::UniquePtr transport;
+  if (!isSSL() && accConfig_.ioUring) {
+    transport = makeIoUringTransport(sock);
+  }
+  if (!transport) {
+    transport.reset(sock.release());
+  }
   VLOG(4) << "Created new session for peer " << *peerAddress;
   HTTPDownstreamSession* session =
-    new HTTPDownstreamSession(getTransactionTimeoutSet(), std::move(sock),
+    new HTTPDownstreamSession(getTransactionTimeoutSet(), std::move(transport),
                               localAddress, *peerAddress,
                               controller, std::move(codec), tinfo, this);
   session->setSessionStats(downstreamSessionStats_);
+  session->setHeaderTimeouts(getHeaderTimeoutSet());
+  if (accConfig_.slowTransactionSampler) {
+    session->setSlowTransactionSampler(accConfig_.slowTransactionSampler,
+                                       getSlowTransactionTimeoutSet());
+  }
+#ifndef PROXYGEN_HTTP1_ONLY
+  if (h2cCodec) {
+    session->setH2CCodec(std::move(h2cCodec));
+  }
+#endif
+  session->setEgressBatching(accConfig_.maxWritesPerLoop,
+                             accConfig_.egressBatchBytes);
+  if (accConfig_.sharedEgressFlusher) {
+    auto flusher = EgressFlusher::get(session->getTransport()->getEventBase());
+    flusher->setBudget(accConfig_.egressBytesPerLoop);
+    session->setEgressFlusher(std::move(flusher));
+  }
+  if (accConfig_.egressShaping) {
+    session->setEgressShaper(EgressShaper::get(
+      session->getTransport()->getEventBase(), accConfig_.egressShaping));
+  }
+  session->setPipelining(accConfig_.maxPipelinedRequests,
+                         accConfig_.maxPipelinedBufferBytes);
+  session->setIngressBudget(accConfig_.ingressBytesPerLoop);
+  if (accConfig_.hibernateIdleSessions) {
+    session->setHibernateTimeout(accConfig_.hibernateTimeout);
+  }
+  session->setTCPInfoSampleInterval(accConfig_.tcpInfoSampleInterval);
+  Acceptor::addConnection(session);
+  session->startNow();
+  if (downstreamSessionStats_) {
+    downstreamSessionStats_->recordConnectionSetup(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        getCurrentTime() - start));
+  }
+}
+
+void HTTPSessionAcceptor::onNewQuicConnection(
+    unique_ptr<QuicTransport> transport,
+    const folly::TransportInfo& tinfo) {
+#ifdef PROXYGEN_HTTP1_ONLY
+  LOG(ERROR) << "Built with HTTP/1.x only, dropping a QUIC connection";
+  transport->close(true);
+#else
+  VLOG(4) << "Created new HQ session for peer "
+          << transport->getPeerAddress();
+  HQSession* session =
+    new HQSession(getTransactionTimeoutSet(), std::move(transport),
+                  getController(), tinfo, downstreamSessionStats_);
   Acceptor::addConnection(session);
   session->startNow();
+#endif
+}
+
+void HTTPSessionAcceptor::attachSSLSessionSharing(TAsyncSocket* sock) {
+  auto sslSock = dynamic_cast<TAsyncSSLSocket*>(sock);
+  if (!sslSock) {
+    return;
+  }
+  // The SSL_CTXs are made by the Acceptor, so they are hooked up with the
+  // first connection they handshake. Doing it again is a no-op.
+  SSL_CTX* ctx = SSL_get_SSL_CTX(sslSock->getSSL());
+  if (accConfig_.sslSessionCache) {
+    SSLSessionCache::attachServer(ctx, accConfig_.sslSessionCache);
+  }
+  if (accConfig_.sslTicketKeys) {
+    SSLTicketKeys::attachServer(ctx, accConfig_.sslTicketKeys);
+  }
+}
+
+TAsyncTransport::UniquePtr HTTPSessionAcceptor::makeIoUringTransport(
+    TAsyncSocket::UniquePtr& sock) {
+  if (!ioUring_) {
+    if (ioUringUnavailable_) {
+      return nullptr;
+    }
+    ioUring_ = IoUringBackend::get(sock->getEventBase(),
+                                   IoUringBackend::Options());
+    if (!ioUring_) {
+      LOG(WARNING) << "io_uring is unavailable, using plain sockets";
+      ioUringUnavailable_ = true;
+      return nullptr;
+    }
+  }
+  auto transport = IoUringTransport::make(ioUring_, sock->getFd());
+  if (!transport) {
+    // out of fixed file slots
+    return nullptr;
+  }
+  sock->detachFd();
+  return TAsyncTransport::UniquePtr(transport.release());
+}
+
+bool HTTPSessionAcceptor::installKernelTLS(TAsyncSocket::UniquePtr& sock) {
+  auto sslSock = dynamic_cast<TAsyncSSLSocket*>(sock.get());
+  if (!sslSock) {
+    return true;
+  }
+  SSL* ssl = const_cast<SSL*>(sslSock->getSSL());
+  switch (KernelTLS::install(sslSock->getFd(), ssl)) {
+    case KernelTLS::Result::UNSUPPORTED:
+      return true;
+    case KernelTLS::Result::FAILED:
+      return false;
+    case KernelTLS::Result::OFFLOADED:
+      break;
+  }
+  // OpenSSL must not send its close_notify on the kernel's record stream
+  SSL_set_quiet_shutdown(ssl, 1);
+  SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  auto evb = sslSock->getEventBase();
+  int fd = sslSock->detachFd();
+  sock.reset(new TAsyncSocket(evb, fd));
+  return true;
 }
 
 } // proxygen
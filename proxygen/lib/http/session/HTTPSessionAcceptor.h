@@ -14,11 +14,13 @@
 #include <proxygen/lib/http/session/HTTPErrorPage.h>
 #include <proxygen/lib/http/session/SimpleController.h>
 #include <proxygen/lib/services/HTTPAcceptor.h>
+#include <proxygen/lib/utils/IoUringBackend.h>
 #include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
 
 namespace proxygen {
 
 class HTTPSessionStats;
+class QuicTransport;
 
 /**
  * Specialization of Acceptor that serves as an abstract base for
@@ -80,6 +82,23 @@ public:
   virtual HTTPTransaction::Handler* newHandler(
     HTTPTransaction& txn, HTTPMessage* msg) noexcept = 0;
 
+  /**
+   * Build what the codecs and sessions would otherwise build lazily on the
+   * first connections: the static HPACK table of the process, and the
+   * SPDY zlib contexts and read buffers of the calling thread; the Huffman
+   * trees are constants. Call it in the thread of the acceptor before it
+   * accepts.
+   */
+  void prewarm();
+
+  /**
+   * Serve a connection that a QUIC implementation accepted for this
+   * acceptor with an HQSession, and the handlers of the connections the
+   * acceptor accepts itself. Call it in the thread of the acceptor.
+   */
+  void onNewQuicConnection(std::unique_ptr<QuicTransport> transport,
+                           const folly::TransportInfo& tinfo);
+
 protected:
   /**
    * This function is invoked when a new session is created to get the
@@ -107,6 +126,10 @@ protected:
   virtual folly::AsyncSSLSocket::UniquePtr makeNewAsyncSSLSocket(
     const std::shared_ptr<folly::SSLContext>& ctx,
     folly::EventBase* base, int fd) {
+    if (accConfig_.sslCertCache) {
+      // before the handshake, which picks its certificate by SNI
+      SSLCertCache::attachServer(ctx->getSSLCtx(), accConfig_.sslCertCache);
+    }
     return folly::AsyncSSLSocket::UniquePtr(
       new apache::thrift::async::TAsyncSSLSocket(ctx, base, fd));
   }
@@ -115,6 +138,27 @@ private:
   HTTPSessionAcceptor(const HTTPSessionAcceptor&) = delete;
   HTTPSessionAcceptor& operator=(const HTTPSessionAcceptor&) = delete;
 
+  /**
+   * Share the TLS sessions of the connection's SSL_CTX through the
+   * configured sslSessionCache and sslTicketKeys
+   */
+  void attachSSLSessionSharing(apache::thrift::async::TAsyncSocket* sock);
+
+  /**
+   * Replace sock with a plain socket on the same fd if the kernel takes
+   * over its TLS records.
+   *
+   * @return false if the connection can no longer be used
+   */
+  bool installKernelTLS(apache::thrift::async::TAsyncSocket::UniquePtr& sock);
+
+  /**
+   * Move the fd of sock to an IoUringTransport, leaving sock alone and
+   * returning null if io_uring can't take it.
+   */
+  apache::thrift::async::TAsyncTransport::UniquePtr makeIoUringTransport(
+    apache::thrift::async::TAsyncSocket::UniquePtr& sock);
+
   // HTTPSession::InfoCallback methods
   void onCreate(const HTTPSession&) override {}
   void onIngressError(const HTTPSession&, ProxygenError error) override {}
@@ -141,9 +185,15 @@ private:
   std::unique_ptr<HTTPErrorPage> diagnosticErrorPage_;
 
   folly::Optional<SPDYVersion> alwaysUseSPDYVersion_{};
+  // set if the plaintext protocol is h2c, HTTP/2 with prior knowledge
+  bool alwaysUseHTTP2_{false};
 
   SimpleController simpleController_;
 
+  // the io_uring of the thread, kept for the connections to come
+  std::shared_ptr<IoUringBackend> ioUring_;
+  bool ioUringUnavailable_{false};
+
   /**
    * 0.0.0.0:0, a valid address to use if getsockname() or getpeername() fails
    */
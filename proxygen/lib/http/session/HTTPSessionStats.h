@@ -9,10 +9,15 @@
  */
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <proxygen/lib/http/session/TCPInfoSample.h>
 #include <proxygen/lib/http/session/TTLBAStats.h>
 
 namespace proxygen {
 
+class HeaderCompressionStats;
+
 // This may be retired with a byte events refactor
 class HTTPSessionStats : public TTLBAStats {
  public:
@@ -20,6 +25,70 @@ class HTTPSessionStats : public TTLBAStats {
 
   virtual void recordTransactionOpened() noexcept = 0;
   virtual void recordTransactionClosed() noexcept = 0;
+
+  /**
+   * Latencies of the transactions, for the stats that keep distributions
+   * of them, called as each transaction detaches. The ones that start
+   * from the first byte of the request are only measured for downstream
+   * transactions, and only once the phase they end with happened: the
+   * first byte of the response headers, or of its body, taken by the
+   * transport, and the peer's ack of the last byte.
+   */
+  virtual void recordTimeToFirstHeaderByte(
+    std::chrono::microseconds latency) noexcept {}
+  virtual void recordTimeToFirstBodyByte(
+    std::chrono::microseconds latency) noexcept {}
+  virtual void recordTTLBA(std::chrono::microseconds latency) noexcept {}
+  // from the first byte read or written to the detach, in any direction
+  virtual void recordTransactionDuration(
+    std::chrono::microseconds duration) noexcept {}
+
+  /**
+   * Called with the header compression totals of a session as it is
+   * destroyed
+   */
+  virtual void recordHeaderCompression(
+    const HeaderCompressionStats& stats) noexcept {}
+
+  /**
+   * Called with the number of transactions and messages a session took
+   * from the object pools of its thread, as hits, and the number the pools
+   * had to allocate, as misses
+   */
+  virtual void recordTransactionPoolLookups(uint64_t hits,
+                                            uint64_t misses) noexcept {}
+  virtual void recordMessagePoolLookups(uint64_t hits,
+                                        uint64_t misses) noexcept {}
+
+  /**
+   * Called with the number of reads from the transport and of writes
+   * handed to it by a session as it is destroyed, together with the bytes
+   * they moved
+   */
+  virtual void recordTransportCalls(uint64_t reads, uint64_t bytesRead,
+                                    uint64_t writes,
+                                    uint64_t bytesWritten) noexcept {}
+
+  /**
+   * A session found to drain its egress too slowly, and one reset for
+   * staying so past the deadline, see
+   * HTTPSession::enableSlowReaderDetection()
+   */
+  virtual void recordSlowReader() noexcept {}
+  virtual void recordSlowReaderReset() noexcept {}
+
+  /**
+   * Each TCP_INFO sample of a session that samples them, see
+   * HTTPSession::setTCPInfoSampleInterval()
+   */
+  virtual void recordTCPInfo(const TCPInfoSample& sample) noexcept {}
+
+  /**
+   * How long an acceptor took to set up and start the downstream session
+   * of an accepted connection, TLS handshake aside
+   */
+  virtual void recordConnectionSetup(
+    std::chrono::microseconds duration) noexcept {}
 };
 
 }
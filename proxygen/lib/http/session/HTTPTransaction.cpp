@@ -10,10 +10,12 @@
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 
 #include <algorithm>
+#include <folly/dynamic.h>
 #include <glog/logging.h>
 #include <proxygen/lib/http/HTTPHeaderSize.h>
-#include <proxygen/lib/http/codec/SPDYConstants.h>
 #include <proxygen/lib/http/session/HTTPSessionStats.h>
+#include <proxygen/lib/utils/UtilInl.h>
+#include <sstream>
 
 using folly::IOBuf;
 using std::unique_ptr;
@@ -35,29 +37,30 @@ HTTPTransaction::HTTPTransaction(TransportDirection direction,
                                  uint32_t sendInitialWindowSize,
                                  int8_t priority,
                                  HTTPCodec::StreamID assocId):
-    deferredEgressBody_(folly::IOBufQueue::cacheChainLength()),
-    direction_(direction),
-    id_(id),
-    seqNo_(seqNo),
     transport_(transport),
-    transactionTimeouts_(transactionTimeouts),
-    stats_(stats),
-    recvWindow_(receiveInitialWindowSize),
-    sendWindow_(sendInitialWindowSize),
     egressQueue_(egressQueue),
-    assocStreamId_(assocId),
-    priority_(priority << spdy::SPDY_PRIO_SHIFT_FACTOR),
+    queueHandle_(egressQueue.addTransaction(id, priority, this)),
+    direction_(direction),
+    priority_(PriorityQueue::toLevel(priority)),
     ingressPaused_(false),
     egressPaused_(false),
     handlerEgressPaused_(false),
     useFlowControl_(useFlowControl),
     aborted_(false),
     deleting_(false),
-    enqueued_(false),
     firstByteSent_(false),
     firstHeaderByteSent_(false),
     inResume_(false),
-    inActiveSet_(true) {
+    inActiveSet_(true),
+    id_(id),
+    assocStreamId_(assocId),
+    seqNo_(seqNo),
+    recvWindow_(receiveInitialWindowSize),
+    sendWindow_(sendInitialWindowSize),
+    transactionTimeouts_(transactionTimeouts),
+    stats_(stats),
+    deferredEgressBody_(folly::IOBufQueue::cacheChainLength()),
+    chunkHeaders_(RequestArena::Allocator<Chunk>(&arena_)) {
 
   if (assocStreamId_) {
     if (isUpstream()) {
@@ -80,10 +83,16 @@ HTTPTransaction::~HTTPTransaction() {
   if (isEnqueued()) {
     dequeue();
   }
+  egressQueue_.removeTransaction(queueHandle_);
+}
+
+void HTTPTransaction::updatePriority(const HTTPPriority& priority) {
+  egressQueue_.updatePriority(queueHandle_, priority);
 }
 
 void HTTPTransaction::onIngressHeadersComplete(
   std::unique_ptr<HTTPMessage> msg) {
+  timings_.headersParsed = getCurrentTime();
   msg->setSeqNo(seqNo_);
   if (transportCallback_) {
     transportCallback_->headerBytesReceived(msg->getIngressHeaderSize());
@@ -97,8 +106,8 @@ void HTTPTransaction::onIngressHeadersComplete(
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::HEADERS_COMPLETE,
-                             std::move(msg));
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::HEADERS_COMPLETE,
+                                  std::move(msg));
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::HEADERS_COMPLETE;
   } else {
@@ -114,6 +123,7 @@ void HTTPTransaction::processIngressHeadersComplete(
   }
   refreshTimeout();
   if (handler_ && !isIngressComplete()) {
+    timings_.handlerDispatched = getCurrentTime();
     handler_->onHeadersComplete(std::move(msg));
   }
 }
@@ -140,8 +150,8 @@ void HTTPTransaction::onIngressBody(unique_ptr<IOBuf> chain) {
       sendAbort(ErrorCode::FLOW_CONTROL_ERROR);
     } else {
       checkCreateDeferredIngress();
-      deferredIngress_->emplace(id_, HTTPEvent::Type::BODY,
-                               std::move(chain));
+      deferredIngress_->emplace_back(id_, HTTPEvent::Type::BODY,
+                                    std::move(chain));
       VLOG(4) << *this << " Queued ingress event of type " <<
         HTTPEvent::Type::BODY << " size=" << len;
     }
@@ -164,14 +174,26 @@ void HTTPTransaction::processIngressBody(unique_ptr<IOBuf> chain, size_t len) {
 
     if (useFlowControl_ && !isIngressEOMSeen()) {
       recvToAck_ += len;
+      if (recvShrinkTo_ > 0 && recvToAck_ >= 0) {
+        // the withheld credit is paid back, the peer can't have more than
+        // the smaller window in flight anymore
+        CHECK(recvWindow_.setCapacity(recvShrinkTo_));
+        recvShrinkTo_ = 0;
+      }
       if (recvToAck_ > 0) {
-        uint32_t divisor = 2;
+        uint32_t threshold = recvWindow_.getCapacity() / 2;
         if (transport_.isDraining()) {
           // only send window updates for draining transports when window is
           // closed
-          divisor = 1;
+          threshold = recvWindow_.getCapacity();
+        } else if (windowUpdateThreshold_ > 0) {
+          threshold = std::min(windowUpdateThreshold_,
+                               recvWindow_.getCapacity());
         }
-        if (uint32_t(recvToAck_) >= (recvWindow_.getCapacity() / divisor)) {
+        if (uint32_t(recvToAck_) >= threshold) {
+          if (cold_ && cold_->windowSizer) {
+            resizeReceiveWindow();
+          }
           flushWindowUpdate();
         }
       }
@@ -186,7 +208,7 @@ void HTTPTransaction::onIngressChunkHeader(size_t length) {
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::CHUNK_HEADER, length);
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::CHUNK_HEADER, length);
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::CHUNK_HEADER << " size=" << length;
   } else {
@@ -212,7 +234,7 @@ void HTTPTransaction::onIngressChunkComplete() {
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::CHUNK_COMPLETE);
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::CHUNK_COMPLETE);
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::CHUNK_COMPLETE;
   } else {
@@ -238,7 +260,7 @@ void HTTPTransaction::onIngressTrailers(unique_ptr<HTTPHeaders> trailers) {
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::TRAILERS_COMPLETE,
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::TRAILERS_COMPLETE,
         std::move(trailers));
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::TRAILERS_COMPLETE;
@@ -265,7 +287,7 @@ void HTTPTransaction::onIngressUpgrade(UpgradeProtocol protocol) {
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::UPGRADE, protocol);
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::UPGRADE, protocol);
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::UPGRADE;
   } else {
@@ -301,7 +323,7 @@ void HTTPTransaction::onIngressEOM() {
   }
   if (mustQueueIngress()) {
     checkCreateDeferredIngress();
-    deferredIngress_->emplace(id_, HTTPEvent::Type::MESSAGE_COMPLETE);
+    deferredIngress_->emplace_back(id_, HTTPEvent::Type::MESSAGE_COMPLETE);
     VLOG(4) << *this << " Queued ingress event of type " <<
       HTTPEvent::Type::MESSAGE_COMPLETE;
   } else {
@@ -336,6 +358,19 @@ bool HTTPTransaction::isExpectingIngress() const {
            (useFlowControl_ && sendWindow_.getSize() <= 0)));
 }
 
+void HTTPTransaction::timeoutExpired() noexcept {
+  if (lazyTimeouts_) {
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+      getLoopTime() - lastActivity_);
+    auto interval = transactionTimeouts_->getInterval();
+    if (idle < interval) {
+      transactionTimeouts_->scheduleTimeout(this, interval - idle);
+      return;
+    }
+  }
+  transport_.transactionTimeout(this);
+}
+
 void HTTPTransaction::updateReadTimeout() {
   if (isExpectingIngress()) {
     refreshTimeout();
@@ -352,6 +387,10 @@ void HTTPTransaction::markIngressComplete() {
 }
 
 void HTTPTransaction::markEgressComplete() {
+  if (deferredEgressBody_.chainLength() > 0) {
+    transport_.notifyEgressBodyBuffered(
+      -int64_t(deferredEgressBody_.chainLength()));
+  }
   deferredEgressBody_.move();
   if (isEnqueued()) {
     dequeue();
@@ -364,8 +403,8 @@ bool HTTPTransaction::validateIngressStateTransition(
   CallbackGuard guard(*this);
 
   if (!HTTPTransactionIngressSM::transit(ingressState_, event)) {
-    HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS);
-    ex.setProxygenError(kErrorIngressStateTransition);
+    HTTPException ex(HTTPException::Direction::INGRESS_AND_EGRESS,
+                     kErrorIngressStateTransition);
     ex.setCodecStatusCode(ErrorCode::PROTOCOL_ERROR);
     // This will invoke sendAbort() and also inform the handler of the
     // error and detach the handler.
@@ -435,8 +474,7 @@ void HTTPTransaction::onIngressTimeout() {
   pauseIngress();
   markIngressComplete();
   if (handler_) {
-    HTTPException ex(HTTPException::Direction::INGRESS);
-    ex.setProxygenError(kErrorTimeout);
+    HTTPException ex(HTTPException::Direction::INGRESS, kErrorTimeout);
     handler_->onError(ex);
   } else {
     markEgressComplete();
@@ -469,12 +507,18 @@ void HTTPTransaction::onIngressSetSendWindow(const uint32_t newWindowSize) {
   }
 }
 
+void HTTPTransaction::enableFlowControl(uint32_t sendWindowSize) {
+  DCHECK(!useFlowControl_);
+  DCHECK(egressState_ == HTTPTransactionEgressSM::State::Start);
+  useFlowControl_ = true;
+  CHECK(sendWindow_.setCapacity(sendWindowSize));
+}
+
 void HTTPTransaction::onEgressTimeout() {
   CallbackGuard guard(*this);
   VLOG(4) << "egress timeout on " << *this;
   if (handler_) {
-    HTTPException ex(HTTPException::Direction::EGRESS);
-    ex.setProxygenError(kErrorTimeout);
+    HTTPException ex(HTTPException::Direction::EGRESS, kErrorTimeout);
     handler_->onError(ex);
   } else {
     markEgressComplete();
@@ -483,6 +527,7 @@ void HTTPTransaction::onEgressTimeout() {
 
 void HTTPTransaction::onEgressHeaderFirstByte() {
   CallbackGuard guard(*this);
+  timings_.firstByteWritten = getCurrentTime();
   if (transportCallback_) {
     transportCallback_->firstHeaderByteFlushed();
   }
@@ -490,6 +535,7 @@ void HTTPTransaction::onEgressHeaderFirstByte() {
 
 void HTTPTransaction::onEgressBodyFirstByte() {
   CallbackGuard guard(*this);
+  timings_.firstBodyByteWritten = getCurrentTime();
   if (transportCallback_) {
     transportCallback_->firstByteFlushed();
   }
@@ -497,6 +543,7 @@ void HTTPTransaction::onEgressBodyFirstByte() {
 
 void HTTPTransaction::onEgressBodyLastByte() {
   CallbackGuard guard(*this);
+  timings_.lastByteWritten = getCurrentTime();
   if (transportCallback_) {
     transportCallback_->lastByteFlushed();
   }
@@ -504,6 +551,7 @@ void HTTPTransaction::onEgressBodyLastByte() {
 
 void HTTPTransaction::onEgressLastByteAck(std::chrono::milliseconds latency) {
   CallbackGuard guard(*this);
+  timings_.lastByteAcked = getCurrentTime();
   if (transportCallback_) {
     transportCallback_->lastByteAcked(latency);
   }
@@ -527,16 +575,45 @@ void HTTPTransaction::sendHeaders(const HTTPMessage& headers) {
 void HTTPTransaction::sendBody(std::unique_ptr<folly::IOBuf> body) {
   CHECK(HTTPTransactionEgressSM::transit(
       egressState_, HTTPTransactionEgressSM::Event::sendBody));
+  size_t oldLength = deferredEgressBody_.chainLength();
   deferredEgressBody_.append(std::move(body));
+  transport_.notifyEgressBodyBuffered(
+    deferredEgressBody_.chainLength() - oldLength);
   notifyTransportPendingEgress();
 }
 
+void HTTPTransaction::sendFileRegion(const FileRegion& region) {
+  CallbackGuard guard(*this);
+  if (useFlowControl_ || deferredEgressBody_.chainLength() > 0 ||
+      !chunkHeaders_.empty() || isEnqueued() ||
+      !transport_.canSendFileRegion(this)) {
+    std::unique_ptr<folly::IOBuf> body = region.map();
+    if (!body) {
+      HTTPException ex(HTTPException::Direction::EGRESS, kErrorWrite,
+                       "failed to read the file region of the body");
+      onError(ex);
+      return;
+    }
+    sendBody(std::move(body));
+    return;
+  }
+  CHECK(HTTPTransactionEgressSM::transit(
+      egressState_, HTTPTransactionEgressSM::Event::sendBody));
+  VLOG(4) << *this << " Sending " << region.getLength()
+          << " bytes of body from fd=" << region.getFd();
+  updateReadTimeout();
+  size_t nbytes = transport_.sendFileRegion(this, region);
+  if (transportCallback_) {
+    transportCallback_->bodyBytesGenerated(nbytes);
+  }
+}
+
 bool HTTPTransaction::onWriteReady(const uint32_t maxEgress) {
   CallbackGuard guard(*this);
   DCHECK(isEnqueued());
-  // this txn is being serviced so lower it's priority -> higher numerical value
-  priority_ |= 0x2;
-  sendDeferredBody(maxEgress);
+  size_t nbytes = sendDeferredBody(maxEgress);
+  // charge the bytes to our share of the egress
+  egressQueue_.onSent(queueHandle_, nbytes);
   return isEnqueued();
 }
 
@@ -601,6 +678,9 @@ size_t HTTPTransaction::sendDeferredBody(const uint32_t maxEgress) {
     nbytes += sendEOMNow();
   }
 
+  transport_.notifyEgressBodyBuffered(
+    int64_t(deferredEgressBody_.chainLength()) - int64_t(bytesLeft));
+
   // Update the handler's pause state
   notifyTransportPendingEgress();
   updateHandlerPauseState();
@@ -614,10 +694,10 @@ size_t HTTPTransaction::sendDeferredBody(const uint32_t maxEgress) {
 size_t HTTPTransaction::sendEOMNow() {
   size_t nbytes = 0;
   VLOG(4) << "egress EOM on " << *this;
-  if (trailers_) {
+  if (cold_ && cold_->trailers) {
     VLOG(4) << "egress trailers on " << *this;
-    nbytes += transport_.sendTrailers(this, *trailers_.get());
-    trailers_.reset();
+    nbytes += transport_.sendTrailers(this, *cold_->trailers);
+    cold_->trailers.reset();
   }
   // TODO: with ByteEvent refactor, we will have to delay changing this
   // state until later
@@ -674,7 +754,7 @@ HTTPTransaction::sendEOM() {
         << "egressPaused=" << egressPaused_ << ", "
         << "ingressPaused=" << ingressPaused_ << ", "
         << "aborted=" << aborted_ << ", "
-        << "enqueued=" << enqueued_ << ", "
+        << "enqueued=" << isEnqueued() << ", "
         << "chainLength=" << deferredEgressBody_.chainLength() << "]";
     }
   } else {
@@ -717,7 +797,8 @@ HTTPTransaction::checkForCompletion() {
   if (deleting_) {
     return;
   }
-  if (isEgressComplete() && isIngressComplete() && !isEnqueued()) {
+  if (isEgressComplete() && isIngressComplete() && !isEnqueued() &&
+      pendingByteEvents_ == 0) {
     VLOG(4) << "destroying transaction " << *this;
     deleting_ = true;
     if (handler_) {
@@ -733,6 +814,37 @@ HTTPTransaction::checkForCompletion() {
   }
 }
 
+ByteEvent* HTTPTransaction::getByteEvent(ByteEvent::EventType eventType,
+                                         uint64_t byteOffset) {
+  EmbeddedByteEvent* event = nullptr;
+  switch (eventType) {
+    case ByteEvent::FIRST_HEADER_BYTE:
+      event = &firstHeaderByteEvent_;
+      break;
+    case ByteEvent::FIRST_BYTE:
+      event = &firstByteEvent_;
+      break;
+    case ByteEvent::LAST_BYTE:
+      event = &lastByteEvent_;
+      break;
+    case ByteEvent::PING_REPLY_SENT:
+      break;
+  }
+  if (!event || event->listHook.is_linked()) {
+    return nullptr;
+  }
+  event->byteOffset_ = byteOffset;
+  incrementPendingByteEvents();
+  return event;
+}
+
+void HTTPTransaction::decrementPendingByteEvents() {
+  // the last event may complete the transaction
+  CallbackGuard guard(*this);
+  DCHECK_GT(pendingByteEvents_, 0);
+  pendingByteEvents_--;
+}
+
 void HTTPTransaction::pauseIngress() {
   VLOG(4) << *this << " pauseIngress request";
   CallbackGuard guard(*this);
@@ -742,6 +854,9 @@ void HTTPTransaction::pauseIngress() {
     return;
   }
   ingressPaused_ = true;
+  if (cold_ && cold_->windowSizer) {
+    cold_->windowSizer->onPause();
+  }
   cancelTimeout();
   transport_.pauseIngress(this);
 }
@@ -763,8 +878,10 @@ void HTTPTransaction::resumeIngress() {
   }
   inResume_ = true;
 
-  if (deferredIngress_ && (maxDeferredIngress_ <= deferredIngress_->size())) {
-    maxDeferredIngress_ = deferredIngress_->size();
+  if (deferredIngress_ && !deferredIngress_->empty()) {
+    auto& cold = getColdState();
+    cold.maxDeferredIngress = std::max<uint32_t>(cold.maxDeferredIngress,
+                                                 deferredIngress_->size());
   }
 
   // Process any deferred ingress callbacks
@@ -805,7 +922,7 @@ void HTTPTransaction::resumeIngress() {
         break;
     }
     if (deferredIngress_) {
-      deferredIngress_->pop();
+      deferredIngress_->pop_front();
     }
   }
   updateReadTimeout();
@@ -839,14 +956,9 @@ void HTTPTransaction::notifyTransportPendingEgress() {
       (deferredEgressBody_.chainLength() > 0 ||
        isEgressEOMQueued()) &&
       (!useFlowControl_ || sendWindow_.getSize() > 0)) {
-    if (isEnqueued()) {
-      // We're already in the queue, jiggle our priority
-      priority_ ^= 0x3;
-      egressQueue_.update(queueHandle_);
-    } else {
+    if (!isEnqueued()) {
       // Insert into the queue and let the session know we've got something
-      queueHandle_ = egressQueue_.push(this);
-      enqueued_ = true;
+      egressQueue_.signalPendingEgress(queueHandle_);
       transport_.notifyPendingEgress();
     }
   } else if (isEnqueued()) {
@@ -870,13 +982,32 @@ void HTTPTransaction::updateHandlerPauseState() {
   }
 }
 
+size_t HTTPTransaction::getMemoryUsage() const {
+  size_t bytes = sizeof(HTTPTransaction) +
+    chainCapacity(deferredEgressBody_) +
+    arena_.getBlockBytes();
+  if (deferredIngress_) {
+    for (const auto& event: *deferredIngress_) {
+      bytes += event.getMemoryUsage();
+    }
+  }
+  if (cold_) {
+    bytes += sizeof(ColdState);
+    if (cold_->trailers) {
+      bytes += sizeof(HTTPHeaders) + cold_->trailers->getMemoryUsage();
+    }
+  }
+  return bytes;
+}
+
 bool HTTPTransaction::mustQueueIngress() const {
   return ingressPaused_ || (deferredIngress_ && !deferredIngress_->empty());
 }
 
 void HTTPTransaction::checkCreateDeferredIngress() {
   if (!deferredIngress_) {
-    deferredIngress_ = folly::make_unique<std::queue<HTTPEvent>>();
+    deferredIngress_ = folly::make_unique<DeferredIngress>(
+      RequestArena::Allocator<HTTPEvent>(&arena_));
   }
 }
 
@@ -892,7 +1023,7 @@ bool HTTPTransaction::onPushedTransaction(HTTPTransaction* pushTxn) {
     VLOG(1) << "Failed to create a handler for push transaction";
     return false;
   }
-  pushedTransactions_.insert(pushTxn->getID());
+  getColdState().pushedTransactions.insert(pushTxn->getID());
   return true;
 }
 
@@ -902,6 +1033,43 @@ HTTPTransaction::describe(std::ostream& os) const {
   os << " streamID=" << id_;
 }
 
+void HTTPTransaction::describeState(folly::dynamic& out) const {
+  std::ostringstream ingressState;
+  ingressState << ingressState_;
+  std::ostringstream egressState;
+  egressState << egressState_;
+  out["stream_id"] = (int64_t)id_;
+  out["priority"] = (int64_t)priority_;
+  out["ingress_state"] = ingressState.str();
+  out["egress_state"] = egressState.str();
+  out["ingress_paused"] = (bool)ingressPaused_;
+  out["egress_paused"] = (bool)egressPaused_;
+  out["handler_egress_paused"] = (bool)handlerEgressPaused_;
+  out["send_window"] = (int64_t)sendWindow_.getSize();
+  out["send_window_capacity"] = (int64_t)sendWindow_.getCapacity();
+  out["recv_window"] = (int64_t)recvWindow_.getSize();
+  out["recv_window_capacity"] = (int64_t)recvWindow_.getCapacity();
+  out["recv_to_ack"] = (int64_t)recvToAck_;
+  out["egress_enqueued"] = isEnqueued();
+  out["deferred_egress_bytes"] = (int64_t)deferredEgressBody_.chainLength();
+  out["deferred_ingress_events"] =
+    (int64_t)(deferredIngress_ ? deferredIngress_->size() : 0);
+  out["last_status"] = (int64_t)lastResponseStatus_;
+
+  // microseconds from the first byte read to each phase reached so far
+  TimePoint start = timings_.firstByteRead;
+  auto since = [start] (TimePoint t) {
+    return (int64_t)HTTPTransactionTimings::between(start, t).count();
+  };
+  if (HTTPTransactionTimings::isSet(start)) {
+    out["age_us"] = since(getCurrentTime());
+    out["headers_parsed_us"] = since(timings_.headersParsed);
+    out["handler_dispatched_us"] = since(timings_.handlerDispatched);
+    out["first_byte_written_us"] = since(timings_.firstByteWritten);
+    out["last_byte_written_us"] = since(timings_.lastByteWritten);
+  }
+}
+
 /*
  * TODO: when HTTPSession sends a SETTINGS frame indicating a
  * different initial window, it should call this function on all its
@@ -917,13 +1085,57 @@ void HTTPTransaction::setReceiveWindow(uint32_t capacity) {
     VLOG(4) << "Refusing to shrink the recv window";
     return;
   }
+  if (recvShrinkTo_ > 0) {
+    // this replaces the pending shrink, give its credit back too
+    delta = capacity - recvShrinkTo_;
+  }
   if (!recvWindow_.setCapacity(capacity)) {
     return;
   }
+  recvShrinkTo_ = 0;
   recvToAck_ += delta;
   flushWindowUpdate();
 }
 
+void HTTPTransaction::setReceiveWindowSizing(uint32_t minCapacity,
+                                             uint32_t maxCapacity) {
+  getColdState().windowSizer.reset(
+    new StreamWindowSizer(minCapacity, maxCapacity));
+}
+
+void HTTPTransaction::resizeReceiveWindow() {
+  uint32_t capacity = recvWindow_.getCapacity();
+  uint32_t wanted = cold_->windowSizer->onWindowUpdate(capacity);
+  if (wanted > capacity) {
+    wanted = transport_.capReceiveWindow(this, wanted);
+    if (wanted > capacity && recvWindow_.setCapacity(wanted)) {
+      VLOG(4) << *this << " growing recv_window to " << wanted;
+      recvToAck_ += int32_t(wanted - capacity);
+    }
+  } else if (wanted < capacity) {
+    shrinkReceiveWindow(wanted);
+  }
+}
+
+void HTTPTransaction::shrinkReceiveWindow(uint32_t capacity) {
+  uint32_t current = recvShrinkTo_ > 0 ? recvShrinkTo_ :
+    recvWindow_.getCapacity();
+  if (!useFlowControl_ || capacity == 0 || capacity >= current) {
+    return;
+  }
+  // The peer may have the whole window in flight already, so it only
+  // shrinks for the peer by acking less, and for us once the difference
+  // was received
+  VLOG(4) << *this << " shrinking recv_window to " << capacity;
+  recvToAck_ -= int32_t(current - capacity);
+  if (recvToAck_ >= 0) {
+    CHECK(recvWindow_.setCapacity(capacity));
+    recvShrinkTo_ = 0;
+  } else {
+    recvShrinkTo_ = capacity;
+  }
+}
+
 void HTTPTransaction::flushWindowUpdate() {
 
   if (recvToAck_ > 0 &&
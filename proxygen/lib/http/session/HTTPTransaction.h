@@ -9,8 +9,8 @@
  */
 #pragma once
 
-#include <boost/heap/d_ary_heap.hpp>
 #include <climits>
+#include <deque>
 #include <folly/SocketAddress.h>
 #include <folly/experimental/wangle/acceptor/TransportInfo.h>
 #include <ostream>
@@ -18,14 +18,26 @@
 #include <proxygen/lib/http/HTTPHeaderSize.h>
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <proxygen/lib/http/ProxygenErrorEnum.h>
+#include <proxygen/lib/http/StreamWindowSizer.h>
 #include <proxygen/lib/http/Window.h>
 #include <proxygen/lib/http/codec/HTTPCodec.h>
+#include <proxygen/lib/http/session/ByteEvents.h>
+#include <proxygen/lib/http/session/EgressQueue.h>
 #include <proxygen/lib/http/session/HTTPEvent.h>
+#include <proxygen/lib/http/session/HTTPTransactionTimings.h>
 #include <proxygen/lib/http/session/HTTPTransactionEgressSM.h>
 #include <proxygen/lib/http/session/HTTPTransactionIngressSM.h>
 #include <proxygen/lib/utils/AsyncTimeoutSet.h>
+#include <proxygen/lib/utils/CachedSocketAddress.h>
+#include <proxygen/lib/utils/FileRegion.h>
+#include <proxygen/lib/utils/LoopClock.h>
+#include <proxygen/lib/utils/RequestArena.h>
 #include <set>
 
+namespace folly {
+struct dynamic;
+}
+
 namespace proxygen {
 
 /**
@@ -251,6 +263,11 @@ class HTTPTransaction :
 
     virtual void transactionTimeout(HTTPTransaction* txn) noexcept = 0;
 
+    /**
+     * txn is still open after the timeout of scheduleSlowTimeout()
+     */
+    virtual void transactionSlow(HTTPTransaction* txn) noexcept {}
+
     virtual void sendHeaders(HTTPTransaction* txn,
                              const HTTPMessage& headers,
                              HTTPHeaderSize* size) noexcept = 0;
@@ -259,6 +276,24 @@ class HTTPTransaction :
                             std::unique_ptr<folly::IOBuf>,
                             bool eom) noexcept = 0;
 
+    /**
+     * @return true if the transport can send the next body bytes of txn
+     * straight from a file, with sendFileRegion()
+     */
+    virtual bool canSendFileRegion(HTTPTransaction* txn) noexcept {
+      return false;
+    }
+
+    /**
+     * Queue a region of a file as body of txn, after the egress generated
+     * so far. Only called if canSendFileRegion() is true.
+     */
+    virtual size_t sendFileRegion(HTTPTransaction* txn,
+                                  const FileRegion& region) noexcept {
+      LOG(FATAL) << "sendFileRegion() is not supported";
+      return 0;
+    }
+
     virtual size_t sendChunkHeader(HTTPTransaction* txn,
                                    size_t length) noexcept = 0;
 
@@ -281,12 +316,42 @@ class HTTPTransaction :
 
     virtual void notifyIngressBodyProcessed(uint32_t bytes) noexcept = 0;
 
+    /**
+     * @return what the receive window of txn may grow to now, from its
+     *         capacity to at most capacity
+     */
+    virtual uint32_t capReceiveWindow(const HTTPTransaction* txn,
+                                      uint32_t capacity) noexcept {
+      return capacity;
+    }
+
+    /**
+     * The body bytes the transaction holds until it can send them grew, or
+     * shrank if bytes is negative
+     */
+    virtual void notifyEgressBodyBuffered(int64_t bytes) noexcept = 0;
+
     virtual const folly::SocketAddress& getLocalAddress()
       const noexcept = 0;
 
     virtual const folly::SocketAddress& getPeerAddress()
       const noexcept = 0;
 
+    /**
+     * The addresses above, with their strings formatted on first use.
+     * Transports that outlive many transactions should return the same
+     * instance each time.
+     */
+    virtual std::shared_ptr<const CachedSocketAddress> getCachedLocalAddress()
+      const {
+      return std::make_shared<CachedSocketAddress>(getLocalAddress());
+    }
+
+    virtual std::shared_ptr<const CachedSocketAddress> getCachedPeerAddress()
+      const {
+      return std::make_shared<CachedSocketAddress>(getPeerAddress());
+    }
+
     virtual void describe(std::ostream&) const = 0;
 
     virtual const folly::TransportInfo& getSetupTransportInfo() const noexcept = 0;
@@ -301,6 +366,21 @@ class HTTPTransaction :
       HTTPCodec::StreamID assocStreamId,
       HTTPTransaction::PushHandler* handler,
       int8_t priority) noexcept = 0;
+
+    /**
+     * Note that the peer got the resource at path on this transport, by
+     * requesting it or by a push
+     */
+    virtual void recordFetched(const std::string& path) noexcept {}
+
+    /**
+     * @return true if the peer got the resource at path among the last
+     *         ones it fetched on this transport, so that it likely has it
+     *         in its cache: a hint not to push it again
+     */
+    virtual bool wasRecentlyFetched(const std::string& path) const noexcept {
+      return false;
+    }
   };
 
   /**
@@ -327,21 +407,7 @@ class HTTPTransaction :
     virtual ~TransportCallback() {};
   };
 
-  struct LessP {
-    bool operator()(const HTTPTransaction* left,
-                    const HTTPTransaction* right) const {
-      // larger values are logically smaller
-      return left->priority_ > right->priority_;
-    }
-  };
-
-  typedef boost::heap::d_ary_heap<HTTPTransaction*,
-                                  boost::heap::arity<2>,
-                                  boost::heap::stable<false>,
-                                  boost::heap::compare<LessP>,
-                                  boost::heap::mutable_<true>,
-                                  boost::heap::constant_time_size<true>
-                                  > PriorityQueue;
+  typedef EgressQueue PriorityQueue;
 
   /**
    * readBufLimit and sendWindow are only used if useFlowControl is
@@ -386,10 +452,37 @@ class HTTPTransaction :
     return handler_;
   }
 
-  uint32_t getPriority() const {
+  /**
+   * @return true if the transaction waits in the egress queue of its
+   *         session, with egress pending
+   */
+  bool isEnqueued() const { return queueHandle_->isEnqueued(); }
+
+  uint8_t getPriority() const {
     return priority_;
   }
 
+  /**
+   * Put the egress of the transaction in a class of the EgressShaper of
+   * its session, instead of the one of its priority
+   */
+  void setEgressClass(uint8_t cls) {
+    egressClass_ = cls;
+  }
+
+  /**
+   * @return the class set with setEgressClass(), -1 if none
+   */
+  int getEgressClass() const {
+    return egressClass_;
+  }
+
+  /**
+   * Change the HTTP/2 dependency and weight of the transaction in the
+   * egress queue
+   */
+  void updatePriority(const HTTPPriority& priority);
+
   HTTPTransactionEgressSM::State getEgressState() const {
     return egressState_;
   }
@@ -424,6 +517,14 @@ class HTTPTransaction :
     return transport_.getPeerAddress();
   }
 
+  std::shared_ptr<const CachedSocketAddress> getCachedLocalAddress() const {
+    return transport_.getCachedLocalAddress();
+  }
+
+  std::shared_ptr<const CachedSocketAddress> getCachedPeerAddress() const {
+    return transport_.getCachedPeerAddress();
+  }
+
   const folly::TransportInfo& getSetupTransportInfo() const noexcept {
     return transport_.getSetupTransportInfo();
   }
@@ -432,6 +533,38 @@ class HTTPTransaction :
     transport_.getCurrentTransportInfo(tinfo);
   }
 
+  /**
+   * Bytes the transaction holds, sizeof(HTTPTransaction) included: the
+   * ingress events queued while it is paused and the egress body waiting
+   * for flow control
+   */
+  size_t getMemoryUsage() const;
+
+  /**
+   * When this transaction went through each phase so far. The session
+   * hands the complete record to its InfoCallback when it detaches the
+   * transaction.
+   */
+  const HTTPTransactionTimings& getTimings() const {
+    return timings_;
+  }
+
+  /**
+   * Called by the session with the time of the read that brought in the
+   * start of the ingress message
+   */
+  void setFirstByteReadTime(TimePoint t) {
+    timings_.firstByteRead = t;
+  }
+
+  /**
+   * Called by the session with its last TCP_INFO sample as it detaches
+   * the transaction
+   */
+  void setTCPInfo(const TCPInfoSample& sample) {
+    timings_.tcpInfo = sample;
+  }
+
   /**
    * Check whether more response is expected. One or more 1xx status
    * responses can be received prior to the regular response.
@@ -452,6 +585,30 @@ class HTTPTransaction :
    */
   virtual void setReceiveWindow(uint32_t capacity);
 
+  /**
+   * Send the WINDOW_UPDATE once threshold bytes were processed, instead of
+   * half of the receive window's capacity. The threshold is capped at the
+   * capacity, where the peer stalls until the update arrives. 0 restores
+   * the default.
+   */
+  void setWindowUpdateThreshold(uint32_t threshold) {
+    windowUpdateThreshold_ = threshold;
+  }
+
+  /**
+   * Size the receive window by how fast the handler consumes the body,
+   * between minCapacity and maxCapacity, see StreamWindowSizer. The
+   * transport caps the growth with capReceiveWindow(). A window shrinks
+   * by holding back the credit of the next window updates, so the peer
+   * never has more in flight than it was allowed.
+   */
+  void setReceiveWindowSizing(uint32_t minCapacity, uint32_t maxCapacity);
+
+  /**
+   * Make the receive window smaller, the same way as the sizing does
+   */
+  void shrinkReceiveWindow(uint32_t capacity);
+
   /**
    * Get the receive window of the transaction
    */
@@ -460,7 +617,7 @@ class HTTPTransaction :
   }
 
   uint32_t getMaxDeferredSize() {
-    return maxDeferredIngress_;
+    return cold_ ? cold_->maxDeferredIngress : 0;
   }
 
   /**
@@ -533,6 +690,13 @@ class HTTPTransaction :
    */
   void onIngressSetSendWindow(uint32_t newWindowSize);
 
+  /**
+   * Invoked by the session when the connection moves to a version of HTTP
+   * with per transaction flow control, as on an Upgrade to h2c, before
+   * any egress.
+   */
+  void enableFlowControl(uint32_t sendWindowSize);
+
   /**
    * Notify this transaction that it is ok to egress.  Returns true if there
    * is additional pending egress
@@ -668,6 +832,15 @@ class HTTPTransaction :
    */
   virtual void sendBody(std::unique_ptr<folly::IOBuf> body);
 
+  /**
+   * Send a region of a file as part of the egress message body. Plaintext
+   * HTTP/1.x sessions send it with sendfile(), so that it is never copied
+   * in user space. The other transports, and the transactions with some
+   * deferred body or flow control, get the file mapped and sent as with
+   * sendBody().
+   */
+  virtual void sendFileRegion(const FileRegion& region);
+
   /**
    * Write any protocol framing required for the subsequent call(s)
    * to sendBody(). This method does not actually write the message out on
@@ -716,7 +889,7 @@ class HTTPTransaction :
       }
     } else {
       // HTTP requires them to go right before EOM
-      trailers_.reset(new HTTPHeaders(trailers));
+      getColdState().trailers.reset(new HTTPHeaders(trailers));
     }
   }
 
@@ -819,7 +992,7 @@ class HTTPTransaction :
     }
     auto txn = transport_.newPushedTransaction(id_, handler, priority);
     if (txn) {
-      pushedTransactions_.insert(txn->getID());
+      getColdState().pushedTransactions.insert(txn->getID());
     }
     return txn;
   }
@@ -850,7 +1023,16 @@ class HTTPTransaction :
    * Get a set of server-pushed transactions associated with this transaction.
    */
   const std::set<HTTPCodec::StreamID>& getPushedTransactions() const {
-    return pushedTransactions_;
+    static const std::set<HTTPCodec::StreamID> kNone;
+    return cold_ ? cold_->pushedTransactions : kNone;
+  }
+
+  /**
+   * The arena for what lives as long as this transaction, such as the
+   * state of its handler chain, freed at once when it is destroyed
+   */
+  RequestArena& getArena() {
+    return arena_;
   }
 
   /**
@@ -858,18 +1040,62 @@ class HTTPTransaction :
    * associated with this txn.
    */
   void removePushedTransaction(HTTPCodec::StreamID pushStreamId) {
-    pushedTransactions_.erase(pushStreamId);
+    if (cold_) {
+      cold_->pushedTransactions.erase(pushStreamId);
+    }
   }
 
   /**
    * Schedule or refresh the timeout for this transaction
    */
   void refreshTimeout() {
-    if (transactionTimeouts_) {
-      transactionTimeouts_->scheduleTimeout(this);
+    if (!transactionTimeouts_) {
+      return;
+    }
+    if (lazyTimeouts_ && isScheduled()) {
+      // timeoutExpired() re-arms the timeout for the rest of the interval
+      lastActivity_ = getLoopTime();
+      return;
+    }
+    if (lazyTimeouts_) {
+      lastActivity_ = getLoopTime();
+    }
+    transactionTimeouts_->scheduleTimeout(this);
+  }
+
+  /**
+   * Move the timeout of this transaction to another set, such as from the
+   * header timeouts of its session to the transaction timeouts once its
+   * headers arrived. A scheduled timeout starts over with the interval of
+   * the new set.
+   */
+  void setTransactionTimeouts(AsyncTimeoutSet* timeouts) {
+    if (timeouts == transactionTimeouts_) {
+      return;
+    }
+    bool scheduled = isScheduled();
+    if (scheduled) {
+      cancelTimeout();
+    }
+    transactionTimeouts_ = timeouts;
+    if (scheduled) {
+      refreshTimeout();
     }
   }
 
+  /**
+   * Make refreshTimeout() only record the time of the activity, instead of
+   * rescheduling the timeout each time. When the timeout fires before the
+   * transaction was idle for the whole interval, it is scheduled again for
+   * the rest of it. Streaming transactions then no longer move their
+   * timeout for every chunk. This needs a timeout set that uses an
+   * HHWheelTimer, the others can only schedule whole intervals.
+   */
+  void setLazyTimeouts(bool lazy) {
+    lazyTimeouts_ = lazy && transactionTimeouts_ &&
+      transactionTimeouts_->getWheelTimer();
+  }
+
   /**
    * Tests if the first byte has already been sent, and if it
    * hasn't yet then it marks it as sent.
@@ -900,15 +1126,28 @@ class HTTPTransaction :
    * Timeout callback for this transaction.  The timer is active while
    * until the ingress message is complete or terminated by error.
    */
-  void timeoutExpired() noexcept {
-    transport_.transactionTimeout(this);
-  }
+  void timeoutExpired() noexcept;
 
   /**
    * Write a description of the transaction to a stream
    */
   void describe(std::ostream& os) const;
 
+  /**
+   * Add the state of the transaction to out: its state machines, flow
+   * control windows, place in the egress queue, buffered bytes and the
+   * times of its phases so far. See SlowTransactionSampler.
+   */
+  void describeState(folly::dynamic& out) const;
+
+  /**
+   * Have the transport's transactionSlow() called if the transaction is
+   * still open after the interval of timeouts
+   */
+  void scheduleSlowTimeout(AsyncTimeoutSet* timeouts) {
+    timeouts->scheduleTimeout(&slowTimeout_);
+  }
+
   /**
    * Set the maximum egress body size for any outbound body bytes
    */
@@ -946,10 +1185,44 @@ class HTTPTransaction :
     HTTPTransaction& txn_;
   };
 
+  /**
+   * @return the event of type eventType embedded in the transaction, set to
+   * byteOffset, or nullptr if it is in use already. Only FIRST_HEADER_BYTE,
+   * FIRST_BYTE and LAST_BYTE are embedded. The transaction stays alive
+   * until the event is released.
+   */
+  ByteEvent* getByteEvent(ByteEvent::EventType eventType, uint64_t byteOffset);
+
+  /**
+   * The transaction is not destroyed while some byte events refer to it
+   */
+  void incrementPendingByteEvents() {
+    pendingByteEvents_++;
+  }
+
+  void decrementPendingByteEvents();
+
  private:
   HTTPTransaction(const HTTPTransaction&) = delete;
   HTTPTransaction& operator=(const HTTPTransaction&) = delete;
 
+  class EmbeddedByteEvent : public ByteEvent {
+   public:
+    EmbeddedByteEvent(HTTPTransaction& txn, EventType eventType):
+        ByteEvent(0, eventType), txn_(txn) {}
+
+    HTTPTransaction* getTransaction() override {
+      return &txn_;
+    }
+
+    void release() override {
+      txn_.decrementPendingByteEvents();
+    }
+
+   private:
+    HTTPTransaction& txn_;
+  };
+
   /**
    * Check whether the ingress and egress messages are both complete;
    * if they are, detach from the Transport and Handler and delete this
@@ -996,12 +1269,9 @@ class HTTPTransaction :
 
   size_t sendDeferredBody(uint32_t maxEgress);
 
-  bool isEnqueued() const { return enqueued_; }
-
   void dequeue() {
     DCHECK(isEnqueued());
-    egressQueue_.erase(queueHandle_);
-    enqueued_ = false;
+    egressQueue_.clearPendingEgress(queueHandle_);
   }
 
   bool hasPendingEOM() const {
@@ -1039,44 +1309,66 @@ class HTTPTransaction :
   void flushWindowUpdate();
 
   /**
-   * Queue to hold any events that we receive from the Transaction
-   * while the ingress is supposed to be paused.
+   * Apply the capacity the windowSizer wants before a window update
    */
-  std::unique_ptr<std::queue<HTTPEvent>> deferredIngress_;
+  void resizeReceiveWindow();
 
-  uint32_t maxDeferredIngress_{0};
+  /*
+   * The members used on every event come first, so that they share the
+   * first two cache lines of the transaction. State that few transactions
+   * need is in cold_.
+   */
+
+  Transport& transport_;
+  Handler* handler_{nullptr};
 
   /**
-   * Queue to hold any body bytes to be sent out
-   * while egress to the remote is supposed to be paused.
+   * Reference to our priority queue
    */
-  folly::IOBufQueue deferredEgressBody_{folly::IOBufQueue::cacheChainLength()};
+  PriorityQueue& egressQueue_;
+
+  /**
+   * Our position in the priority queue
+   */
+  PriorityQueue::Handle queueHandle_;
+
+  TransportCallback* transportCallback_{nullptr};
 
   const TransportDirection direction_;
-  HTTPCodec::StreamID id_;
-  uint32_t seqNo_;
-  Handler* handler_{nullptr};
-  Transport& transport_;
   HTTPTransactionEgressSM::State egressState_{
     HTTPTransactionEgressSM::getNewInstance()};
   HTTPTransactionIngressSM::State ingressState_{
     HTTPTransactionIngressSM::getNewInstance()};
-  AsyncTimeoutSet* transactionTimeouts_{nullptr};
-  HTTPSessionStats* stats_{nullptr};
 
   /**
-   * The recv window and associated data. This keeps track of how many
-   * bytes we are allowed to buffer.
+   * SPDY priority, the level of the transaction in the egress queue
    */
-  Window recvWindow_;
+  uint8_t priority_;
 
   /**
-   * The send window and associated data. This keeps track of how many
-   * bytes we are allowed to send and have outstanding.
+   * See setEgressClass()
    */
-  Window sendWindow_;
+  int8_t egressClass_{-1};
 
-  TransportCallback* transportCallback_{nullptr};
+  bool ingressPaused_:1;
+  bool egressPaused_:1;
+  bool handlerEgressPaused_:1;
+  bool useFlowControl_:1;
+  bool aborted_:1;
+  bool deleting_:1;
+  bool firstByteSent_:1;
+  bool firstHeaderByteSent_:1;
+  bool inResume_:1;
+  bool inActiveSet_:1;
+
+  HTTPCodec::StreamID id_;
+
+  /**
+   * ID of request transaction (for pushed txns only)
+   */
+  HTTPCodec::StreamID assocStreamId_{0};
+
+  uint32_t seqNo_;
 
   /**
    * Number of callbacks currently active.  Used to prevent destruction
@@ -1086,47 +1378,42 @@ class HTTPTransaction :
   unsigned callbackDepth_{0};
 
   /**
-   * Trailers to send, if any.
-   */
-  std::unique_ptr<HTTPHeaders> trailers_;
-
-  struct Chunk {
-    explicit Chunk(size_t inLength) : length(inLength), headerSent(false) {}
-    size_t length;
-    bool headerSent;
-  };
-  std::list<Chunk> chunkHeaders_;
-
-  /**
-   * Reference to our priority queue
+   * The recv window and associated data. This keeps track of how many
+   * bytes we are allowed to buffer.
    */
-  PriorityQueue& egressQueue_;
+  Window recvWindow_;
 
   /**
-   * Handle to our position in the priority queue. Only valid when
-   * enqueued_ == true
+   * The send window and associated data. This keeps track of how many
+   * bytes we are allowed to send and have outstanding.
    */
-  PriorityQueue::handle_type queueHandle_;
+  Window sendWindow_;
 
   /**
    * bytes we need to acknowledge to the remote end using a window update
    */
   int32_t recvToAck_{0};
+  uint32_t windowUpdateThreshold_{0};
 
   /**
-   * ID of request transaction (for pushed txns only)
+   * The capacity recvWindow_ shrinks to once recvToAck_ paid back the
+   * withheld credit, 0 if none
    */
-  HTTPCodec::StreamID assocStreamId_{0};
+  uint32_t recvShrinkTo_{0};
 
   /**
-   * Set of all push transactions IDs associated with this transaction.
+   * Number of byte events that refer to this transaction
    */
-  std::set<HTTPCodec::StreamID> pushedTransactions_;
+  uint32_t pendingByteEvents_{0};
+
+  AsyncTimeoutSet* transactionTimeouts_{nullptr};
+  HTTPSessionStats* stats_{nullptr};
 
   /**
-   * SPDY priority in the high bits, randomness in the low bits
+   * Last refreshTimeout() with lazy timeouts, in loop time
    */
-  uint32_t priority_;
+  TimePoint lastActivity_;
+  bool lazyTimeouts_{false};
 
   /**
    * If this transaction represents a request (ie, it is backed by an
@@ -1137,17 +1424,78 @@ class HTTPTransaction :
    */
   uint16_t lastResponseStatus_{0};
 
-  bool ingressPaused_:1;
-  bool egressPaused_:1;
-  bool handlerEgressPaused_:1;
-  bool useFlowControl_:1;
-  bool aborted_:1;
-  bool deleting_:1;
-  bool enqueued_:1;
-  bool firstByteSent_:1;
-  bool firstHeaderByteSent_:1;
-  bool inResume_:1;
-  bool inActiveSet_:1;
+  /**
+   * Declared before the members whose memory comes from it, to outlive
+   * them
+   */
+  RequestArena arena_;
+
+  typedef std::deque<HTTPEvent, RequestArena::Allocator<HTTPEvent>>
+    DeferredIngress;
+
+  /**
+   * Queue to hold any events that we receive from the Transaction
+   * while the ingress is supposed to be paused.
+   */
+  std::unique_ptr<DeferredIngress> deferredIngress_;
+
+  /**
+   * Queue to hold any body bytes to be sent out
+   * while egress to the remote is supposed to be paused.
+   */
+  folly::IOBufQueue deferredEgressBody_{folly::IOBufQueue::cacheChainLength()};
+
+  struct Chunk {
+    explicit Chunk(size_t inLength) : length(inLength), headerSent(false) {}
+    size_t length;
+    bool headerSent;
+  };
+  std::list<Chunk, RequestArena::Allocator<Chunk>> chunkHeaders_;
+
+  class SlowTimeout : public AsyncTimeoutSet::Callback {
+   public:
+    explicit SlowTimeout(HTTPTransaction& txn): txn_(txn) {}
+
+    void timeoutExpired() noexcept override {
+      txn_.transport_.transactionSlow(&txn_);
+    }
+
+   private:
+    HTTPTransaction& txn_;
+  };
+  SlowTimeout slowTimeout_{*this};
+
+  HTTPTransactionTimings timings_;
+
+  /**
+   * The byte events that most transactions have, so that tracking them
+   * allocates nothing
+   */
+  EmbeddedByteEvent firstHeaderByteEvent_{*this, ByteEvent::FIRST_HEADER_BYTE};
+  EmbeddedByteEvent firstByteEvent_{*this, ByteEvent::FIRST_BYTE};
+  EmbeddedByteEvent lastByteEvent_{*this, ByteEvent::LAST_BYTE};
+
+  /**
+   * What few transactions have, allocated by getColdState() the first
+   * time one needs it
+   */
+  struct ColdState {
+    // trailers to send, if any
+    std::unique_ptr<HTTPHeaders> trailers;
+    // all push transactions IDs associated with this transaction
+    std::set<HTTPCodec::StreamID> pushedTransactions;
+    // sizes recvWindow_ if set
+    std::unique_ptr<StreamWindowSizer> windowSizer;
+    uint32_t maxDeferredIngress{0};
+  };
+  std::unique_ptr<ColdState> cold_;
+
+  ColdState& getColdState() {
+    if (!cold_) {
+      cold_.reset(new ColdState());
+    }
+    return *cold_;
+  }
 
   static uint64_t egressBodySizeLimit_;
   static uint64_t egressBufferLimit_;
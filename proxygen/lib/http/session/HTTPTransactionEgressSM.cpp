@@ -9,17 +9,19 @@
  */
 #include <proxygen/lib/http/session/HTTPTransactionEgressSM.h>
 
-#include <proxygen/lib/utils/UnionBasedStatic.h>
-
 namespace proxygen {
 
 namespace {
 
 typedef typename HTTPTransactionEgressSMData::State State;
-typedef typename HTTPTransactionEgressSMData::Event Event;
-typedef std::map<std::pair<State, Event>, State> TransitionTable;
 
-DEFINE_UNION_STATIC_CONST_NO_INIT(TransitionTable, Table, s_transitions);
+constexpr uint8_t to(State s) {
+  return static_cast<uint8_t>(s);
+}
+
+const uint8_t kNone = HTTPTransactionEgressSMData::kInvalid;
+
+} // namespace
 
 //             +--> ChunkHeaderSent -> ChunkBodySent
 //             |      ^                    v
@@ -29,52 +31,42 @@ DEFINE_UNION_STATIC_CONST_NO_INIT(TransitionTable, Table, s_transitions);
 // Start -> HeadersSent                   +----> EOMQueued --> SendingDone
 //             |                                     ^
 //             +------------> RegularBodySent -------+
-__attribute__((__constructor__))
-void initTableUnion() {
-  // Use const_cast for the placement new initialization since we want this to
-  // be const after construction.
-  new (const_cast<TransitionTable*>(&s_transitions.data)) TransitionTable {
-    {{State::Start, Event::sendHeaders}, State::HeadersSent},
-
-    // For HTTP sending 100 response, then a regular response
-    {{State::HeadersSent, Event::sendHeaders}, State::HeadersSent},
-
-    {{State::HeadersSent, Event::sendBody}, State::RegularBodySent},
-    {{State::HeadersSent, Event::sendChunkHeader}, State::ChunkHeaderSent},
-    {{State::HeadersSent, Event::sendEOM}, State::EOMQueued},
-
-    {{State::RegularBodySent, Event::sendBody}, State::RegularBodySent},
-    {{State::RegularBodySent, Event::sendEOM}, State::EOMQueued},
-
-    {{State::ChunkHeaderSent, Event::sendBody}, State::ChunkBodySent},
-
-    {{State::ChunkBodySent, Event::sendBody}, State::ChunkBodySent},
-    {{State::ChunkBodySent, Event::sendChunkTerminator},
-     State::ChunkTerminatorSent},
-
-    {{State::ChunkTerminatorSent, Event::sendChunkHeader},
-     State::ChunkHeaderSent},
-    {{State::ChunkTerminatorSent, Event::sendTrailers}, State::TrailersSent},
-    {{State::ChunkTerminatorSent, Event::sendEOM}, State::EOMQueued},
-
-    {{State::TrailersSent, Event::sendEOM}, State::EOMQueued},
-
-    {{State::EOMQueued, Event::eomFlushed}, State::SendingDone},
-  };
-}
-
-} // namespace
-
-std::pair<HTTPTransactionEgressSMData::State, bool>
-HTTPTransactionEgressSMData::find(HTTPTransactionEgressSMData::State s,
-                                  HTTPTransactionEgressSMData::Event e) {
-  auto const &it = s_transitions.data.find(std::make_pair(s, e));
-  if (it == s_transitions.data.end()) {
-    return std::make_pair(s, false);
-  }
-
-  return std::make_pair(it->second, true);
-}
+//
+// The columns are the events, in order:
+//   sendHeaders, sendBody, sendChunkHeader, sendChunkTerminator,
+//   sendTrailers, sendEOM, eomFlushed
+const uint8_t HTTPTransactionEgressSMData::kTransitions[kNumStates]
+                                                       [kNumEvents] = {
+  // Start
+  {to(State::HeadersSent), kNone, kNone, kNone,
+   kNone, kNone, kNone},
+  // HeadersSent. Headers again for HTTP sending a 100 response, then a
+  // regular response.
+  {to(State::HeadersSent), to(State::RegularBodySent),
+   to(State::ChunkHeaderSent), kNone,
+   kNone, to(State::EOMQueued), kNone},
+  // RegularBodySent
+  {kNone, to(State::RegularBodySent), kNone, kNone,
+   kNone, to(State::EOMQueued), kNone},
+  // ChunkHeaderSent
+  {kNone, to(State::ChunkBodySent), kNone, kNone,
+   kNone, kNone, kNone},
+  // ChunkBodySent
+  {kNone, to(State::ChunkBodySent), kNone, to(State::ChunkTerminatorSent),
+   kNone, kNone, kNone},
+  // ChunkTerminatorSent
+  {kNone, kNone, to(State::ChunkHeaderSent), kNone,
+   to(State::TrailersSent), to(State::EOMQueued), kNone},
+  // TrailersSent
+  {kNone, kNone, kNone, kNone,
+   kNone, to(State::EOMQueued), kNone},
+  // EOMQueued
+  {kNone, kNone, kNone, kNone,
+   kNone, kNone, to(State::SendingDone)},
+  // SendingDone
+  {kNone, kNone, kNone, kNone,
+   kNone, kNone, kNone},
+};
 
 std::ostream& operator<<(std::ostream& os,
                          HTTPTransactionEgressSMData::State s) {
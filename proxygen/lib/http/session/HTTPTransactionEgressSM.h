@@ -9,8 +9,10 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <map>
+#include <utility>
 #include <proxygen/lib/utils/StateMachine.h>
 
 namespace proxygen {
@@ -42,11 +44,30 @@ class HTTPTransactionEgressSMData {
     eomFlushed,
   };
 
+  // no transition, in the table of find()
+  static const uint8_t kInvalid = 0xff;
+
   static State getInitialState() {
     return State::Start;
   }
 
-  static std::pair<State, bool> find(State s, Event e);
+  static std::pair<State, bool> find(State s, Event e) {
+    const uint8_t next = kTransitions[static_cast<size_t>(s)]
+                                     [static_cast<size_t>(e)];
+    if (next == kInvalid) {
+      return std::make_pair(s, false);
+    }
+    return std::make_pair(static_cast<State>(next), true);
+  }
+
+ private:
+  static const size_t kNumStates =
+    static_cast<size_t>(State::SendingDone) + 1;
+  static const size_t kNumEvents =
+    static_cast<size_t>(Event::eomFlushed) + 1;
+  // the State reached from [state][event], or kInvalid; a constant
+  // table, so that the checks of each transaction event are loads
+  static const uint8_t kTransitions[kNumStates][kNumEvents];
 };
 
 std::ostream& operator<<(std::ostream& os,
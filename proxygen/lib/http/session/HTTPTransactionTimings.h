@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <proxygen/lib/http/session/TCPInfoSample.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * When a transaction went through each phase, on the steady clock, for
+ * breaking its latency down into parsing, handler and network time.
+ * Phases that didn't happen, such as an ack when the transport doesn't
+ * report acks, stay at TimePoint().
+ *
+ * The times are taken with getCurrentTime(). That is a vDSO
+ * clock_gettime() on Linux, which reads the TSC without a system call,
+ * so a handful per transaction costs tens of nanoseconds.
+ */
+struct HTTPTransactionTimings {
+  // the read that brought in the start of the ingress message
+  TimePoint firstByteRead;
+  // the codec finished parsing the ingress headers
+  TimePoint headersParsed;
+  // the handler got the headers; later than headersParsed if ingress was
+  // queued, e.g. behind a paused transaction
+  TimePoint handlerDispatched;
+  // the transport took the first byte of the egress headers
+  TimePoint firstByteWritten;
+  // the transport took the first byte of the egress body
+  TimePoint firstBodyByteWritten;
+  // the transport took the last byte of the egress message
+  TimePoint lastByteWritten;
+  // the peer acked the last byte of the egress message
+  TimePoint lastByteAcked;
+  // the last TCP_INFO sample of the connection as the transaction
+  // detached, to tell the network's share of the phases from the ones of
+  // the server; unset if the session doesn't sample
+  TCPInfoSample tcpInfo;
+
+  static bool isSet(TimePoint t) {
+    return t != TimePoint();
+  }
+
+  /**
+   * The time from one phase to a later one, or zero if either is unset
+   */
+  static std::chrono::microseconds between(TimePoint from, TimePoint to) {
+    if (!isSet(from) || !isSet(to) || to < from) {
+      return std::chrono::microseconds(0);
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from);
+  }
+};
+
+}
@@ -93,12 +93,14 @@ HTTPUpstreamSession::getTransactionTimeoutHandler(HTTPTransaction* txn) {
 }
 
 bool HTTPUpstreamSession::allTransactionsStarted() const {
-  for (const auto& txn: transactions_) {
-    if (!txn.second.isPushed() && !txn.second.isEgressStarted()) {
-      return false;
-    }
-  }
-  return true;
+  bool started = true;
+  transactions_.forEach(
+    [&started] (HTTPCodec::StreamID, const HTTPTransaction& txn) {
+      if (!txn.isPushed() && !txn.isEgressStarted()) {
+        started = false;
+      }
+    });
+  return started;
 }
 
 } // proxygen
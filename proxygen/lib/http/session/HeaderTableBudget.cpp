@@ -0,0 +1,27 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/HeaderTableBudget.h>
+
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+HeaderTableBudget& HeaderTableBudget::get() {
+  static folly::ThreadLocal<HeaderTableBudget> budget;
+  return *budget;
+}
+
+void HeaderTableBudget::remove(uint64_t bytes) {
+  DCHECK_GE(used_, bytes);
+  used_ -= bytes;
+}
+
+}
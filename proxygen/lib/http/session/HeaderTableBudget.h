@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace proxygen {
+
+/**
+ * Memory budget for the header compression tables of the sessions of a
+ * thread. Each session accounts for the capacity of its encoder and
+ * decoder tables. While the budget is exceeded, sessions that become idle
+ * shrink their tables, and they grow them back once they get a new
+ * transaction.
+ */
+class HeaderTableBudget {
+ public:
+  /**
+   * @return the budget of the calling thread
+   */
+  static HeaderTableBudget& get();
+
+  /**
+   * @param limit in bytes, 0 for no limit
+   */
+  void setLimit(uint64_t limit) {
+    limit_ = limit;
+  }
+
+  uint64_t getLimit() const {
+    return limit_;
+  }
+
+  uint64_t getUsed() const {
+    return used_;
+  }
+
+  void add(uint64_t bytes) {
+    used_ += bytes;
+  }
+
+  void remove(uint64_t bytes);
+
+  bool isExceeded() const {
+    return limit_ > 0 && used_ > limit_;
+  }
+
+ private:
+  uint64_t limit_{0};
+  uint64_t used_{0};
+};
+
+}
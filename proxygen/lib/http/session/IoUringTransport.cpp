@@ -0,0 +1,559 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/IoUringTransport.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <sys/socket.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+#include <unistd.h>
+
+using apache::thrift::async::WriteFlags;
+using apache::thrift::transport::TTransportException;
+using folly::IOBuf;
+using folly::SocketAddress;
+
+namespace proxygen {
+
+void IoUringTransport::RecvOp::complete(
+    const IoUring::Completion& completion) noexcept {
+  DestructorGuard dg(transport_);
+  transport_->onRecv(completion);
+}
+
+void IoUringTransport::SendOp::complete(
+    const IoUring::Completion& completion) noexcept {
+  DestructorGuard dg(transport_);
+  transport_->onSend(completion);
+}
+
+IoUringTransport::UniquePtr IoUringTransport::make(
+    std::shared_ptr<IoUringBackend> backend, int fd) {
+  int slot = backend->getRing().addFile(fd);
+  if (slot < 0) {
+    return nullptr;
+  }
+  return UniquePtr(new IoUringTransport(std::move(backend), fd, slot));
+}
+
+IoUringTransport::IoUringTransport(std::shared_ptr<IoUringBackend> backend,
+                                   int fd, int slot):
+    AsyncTimeout(backend->getEventBase()),
+    backend_(std::move(backend)),
+    fd_(fd),
+    slot_(slot) {
+  try {
+    localAddr_.setFromLocalAddress(fd_);
+    peerAddr_.setFromPeerAddress(fd_);
+  } catch (const std::exception& ex) {
+    VLOG(3) << "couldn't get the addresses of fd " << fd_ << ": "
+            << ex.what();
+  }
+}
+
+IoUringTransport::~IoUringTransport() {
+  CHECK(!opsPending());
+  if (!released_) {
+    backend_->getRing().removeFile(slot_);
+    ::close(fd_);
+  }
+}
+
+void IoUringTransport::destroy() {
+  DestructorGuard dg(this);
+  closeNow();
+  if (opsPending()) {
+    // the kernel still writes to the buffers and the ops of this
+    destroyOnRelease_ = true;
+    return;
+  }
+  TAsyncTransport::destroy();
+}
+
+void IoUringTransport::setReadCallback(ReadCallback* callback) {
+  if (readCallback_ == callback) {
+    return;
+  }
+  readCallback_ = callback;
+  if (!callback) {
+    // don't receive what nobody reads, the socket buffer pushes back
+    cancelRecv();
+    return;
+  }
+
+  DestructorGuard dg(this);
+  deliverStash();
+  if (readCallback_ != callback) {
+    return;
+  }
+  if (readState_ == kStateOpen) {
+    if (!recvArmed_ && !eofPending_) {
+      armRecv();
+    }
+    // else armed, or cancelled and rearmed when the cancel completes
+    return;
+  }
+  readCallback_ = nullptr;
+  if (readState_ == kStateClosed) {
+    callback->readEOF();
+  } else {
+    callback->readError(TTransportException(
+        TTransportException::NOT_OPEN,
+        "setReadCallback() called with socket in invalid state"));
+  }
+}
+
+IoUringTransport::ReadCallback* IoUringTransport::getReadCallback() const {
+  return readCallback_;
+}
+
+void IoUringTransport::armRecv() {
+  backend_->getRing().prepareRecvMultishot(slot_, recvOp_.getUserData());
+  backend_->scheduleSubmit();
+  recvArmed_ = true;
+  recvCancelled_ = false;
+}
+
+void IoUringTransport::cancelRecv() {
+  if (recvArmed_ && !recvCancelled_) {
+    backend_->getRing().prepareCancel(recvOp_.getUserData());
+    backend_->scheduleSubmit();
+    recvCancelled_ = true;
+  }
+}
+
+void IoUringTransport::onRecv(const IoUring::Completion& completion) {
+  auto& ring = backend_->getRing();
+  if (completion.hasBuffer()) {
+    uint16_t id = completion.getBufferId();
+    if (completion.result > 0 && readState_ == kStateOpen) {
+      const uint8_t* data = ring.getBuffer(id);
+      size_t len = completion.result;
+      bytesReceived_ += len;
+      size_t taken = stash_.empty() ? deliver(data, len) : 0;
+      if (taken < len && readState_ == kStateOpen) {
+        stash_.append(IOBuf::copyBuffer(data + taken, len - taken));
+      }
+    }
+    ring.recycleBuffer(id);
+  }
+  if (!completion.hasMore()) {
+    recvArmed_ = false;
+    recvCancelled_ = false;
+  }
+
+  if (readState_ == kStateOpen) {
+    if (completion.result == 0) {
+      if (stash_.empty()) {
+        readEOF();
+      } else {
+        // after the stash
+        eofPending_ = true;
+      }
+    } else if (completion.result < 0 && completion.result != -ECANCELED &&
+               completion.result != -ENOBUFS) {
+      // out of provided buffers is only a pause
+      fail(TTransportException(TTransportException::INTERNAL_ERROR,
+                               "recv() failed", -completion.result));
+    } else if (!stash_.empty()) {
+      deliverStash();
+    }
+  }
+  if (!recvArmed_ && readCallback_ && readState_ == kStateOpen &&
+      !eofPending_) {
+    armRecv();
+  }
+  maybeRelease();
+}
+
+size_t IoUringTransport::deliver(const uint8_t* data, size_t len) {
+  size_t taken = 0;
+  while (taken < len && readCallback_) {
+    void* buf = nullptr;
+    size_t bufLen = 0;
+    readCallback_->getReadBuffer(&buf, &bufLen);
+    if (buf == nullptr || bufLen == 0) {
+      fail(TTransportException(
+          TTransportException::BAD_ARGS,
+          "ReadCallback::getReadBuffer() returned empty buffer"));
+      return len;
+    }
+    size_t n = std::min(bufLen, len - taken);
+    memcpy(buf, data + taken, n);
+    taken += n;
+    readCallback_->readDataAvailable(n);
+  }
+  return taken;
+}
+
+void IoUringTransport::deliverStash() {
+  while (!stash_.empty() && readCallback_) {
+    // the callback may close this, and drop the stash
+    std::unique_ptr<IOBuf> buf = stash_.pop_front();
+    size_t taken = deliver(buf->data(), buf->length());
+    if (taken < buf->length() && readState_ == kStateOpen) {
+      buf->trimStart(taken);
+      auto rest = stash_.move();
+      stash_.append(std::move(buf));
+      stash_.append(std::move(rest));
+    }
+  }
+  if (stash_.empty() && eofPending_ && readCallback_) {
+    readEOF();
+  }
+}
+
+void IoUringTransport::readEOF() {
+  readState_ = kStateClosed;
+  eofPending_ = false;
+  cancelRecv();
+  ReadCallback* callback = readCallback_;
+  readCallback_ = nullptr;
+  if (callback) {
+    callback->readEOF();
+  }
+}
+
+void IoUringTransport::write(WriteCallback* callback,
+                             const void* buf, size_t bytes,
+                             WriteFlags flags) {
+  writeChain(callback, IOBuf::copyBuffer(buf, bytes), flags);
+}
+
+void IoUringTransport::writev(WriteCallback* callback,
+                              const iovec* vec, size_t count,
+                              WriteFlags flags) {
+  // the caller may reuse its buffers once this returns, and most of them
+  // are small anyway
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += vec[i].iov_len;
+  }
+  auto buf = IOBuf::create(len);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(buf->writableTail(), vec[i].iov_base, vec[i].iov_len);
+    buf->append(vec[i].iov_len);
+  }
+  writeChain(callback, std::move(buf), flags);
+}
+
+void IoUringTransport::writeChain(WriteCallback* callback,
+                                  std::unique_ptr<IOBuf>&& iob,
+                                  WriteFlags flags) {
+  if (writeState_ != kStateOpen || shutdownWritePending_ || closePending_) {
+    if (callback) {
+      callback->writeError(0, TTransportException(
+          TTransportException::NOT_OPEN,
+          "write() called on non-open IoUringTransport"));
+    }
+    return;
+  }
+  std::unique_ptr<WriteRequest> request(new WriteRequest);
+  request->callback = callback;
+  request->data.append(std::move(iob));
+  request->cork = isSet(flags, WriteFlags::CORK);
+  writes_.push_back(std::move(request));
+  if (!sending_) {
+    sendNext();
+  }
+}
+
+void IoUringTransport::sendNext() {
+  WriteRequest& request = *writes_.front();
+  request.iov.clear();
+  bool more = request.cork;
+  const IOBuf* head = request.data.front();
+  if (head) {
+    const IOBuf* buf = head;
+    do {
+      if (request.iov.size() == IOV_MAX) {
+        // the rest goes with the next sendmsg()
+        more = true;
+        break;
+      }
+      if (buf->length() > 0) {
+        iovec iov;
+        iov.iov_base = const_cast<uint8_t*>(buf->data());
+        iov.iov_len = buf->length();
+        request.iov.push_back(iov);
+      }
+      buf = buf->next();
+    } while (buf != head);
+  }
+  memset(&request.msg, 0, sizeof(request.msg));
+  request.msg.msg_iov = request.iov.data();
+  request.msg.msg_iovlen = request.iov.size();
+
+  backend_->getRing().prepareSendmsg(
+    slot_, &request.msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0),
+    sendOp_.getUserData());
+  backend_->scheduleSubmit();
+  sending_ = true;
+  if (sendTimeout_ > 0) {
+    scheduleTimeout(sendTimeout_);
+  }
+}
+
+void IoUringTransport::cancelSend() {
+  if (sending_) {
+    backend_->getRing().prepareCancel(sendOp_.getUserData());
+    backend_->scheduleSubmit();
+  }
+}
+
+void IoUringTransport::onSend(const IoUring::Completion& completion) {
+  CHECK(!writes_.empty());
+  sending_ = false;
+  WriteRequest& request = *writes_.front();
+  if (completion.result > 0) {
+    bytesWritten_ += completion.result;
+    request.bytesWritten += completion.result;
+    request.data.trimStart(completion.result);
+  }
+  if (request.failed) {
+    writes_.pop_front();
+    maybeRelease();
+    return;
+  }
+  if (completion.result < 0) {
+    fail(TTransportException(TTransportException::INTERNAL_ERROR,
+                             "sendmsg() failed", -completion.result));
+    return;
+  }
+  if (!request.data.empty()) {
+    // partial write
+    sendNext();
+    return;
+  }
+
+  WriteCallback* callback = request.callback;
+  writes_.pop_front();
+  if (writes_.empty()) {
+    cancelTimeout();
+  }
+  if (callback) {
+    callback->writeSuccess();
+  }
+  // the callback may have written more, or closed
+  if (!sending_ && writeState_ == kStateOpen) {
+    if (!writes_.empty()) {
+      sendNext();
+    } else {
+      finishWrites();
+    }
+  }
+}
+
+void IoUringTransport::finishWrites() {
+  if (closePending_) {
+    closeNow();
+  } else if (shutdownWritePending_) {
+    shutdownWriteNow();
+  }
+}
+
+void IoUringTransport::failWrites(const TTransportException& ex) {
+  cancelTimeout();
+  std::deque<std::unique_ptr<WriteRequest>> failed;
+  failed.swap(writes_);
+  if (sending_) {
+    // the kernel may still read the iovecs of this one
+    writes_.push_back(std::move(failed.front()));
+    failed.pop_front();
+    writes_.front()->failed = true;
+    cancelSend();
+    WriteCallback* callback = writes_.front()->callback;
+    if (callback) {
+      callback->writeError(writes_.front()->bytesWritten, ex);
+    }
+  }
+  for (auto& request: failed) {
+    if (request->callback) {
+      request->callback->writeError(request->bytesWritten, ex);
+    }
+  }
+}
+
+void IoUringTransport::fail(const TTransportException& ex) {
+  DestructorGuard dg(this);
+  if (readState_ == kStateOpen) {
+    readState_ = kStateError;
+  }
+  if (writeState_ == kStateOpen) {
+    writeState_ = kStateError;
+  }
+  stash_.move();
+  cancelRecv();
+  ReadCallback* callback = readCallback_;
+  readCallback_ = nullptr;
+  if (callback) {
+    callback->readError(ex);
+  }
+  failWrites(ex);
+  maybeRelease();
+}
+
+void IoUringTransport::close() {
+  if (writes_.empty() || writeState_ != kStateOpen) {
+    closeNow();
+    return;
+  }
+  // finish the writes first
+  DestructorGuard dg(this);
+  closePending_ = true;
+  if (readState_ == kStateOpen) {
+    readState_ = kStateClosed;
+  }
+  stash_.move();
+  cancelRecv();
+  ReadCallback* callback = readCallback_;
+  readCallback_ = nullptr;
+  if (callback) {
+    callback->readEOF();
+  }
+}
+
+void IoUringTransport::closeNow() {
+  DestructorGuard dg(this);
+  closePending_ = false;
+  if (readState_ == kStateOpen) {
+    readState_ = kStateClosed;
+  }
+  stash_.move();
+  cancelRecv();
+  ReadCallback* callback = readCallback_;
+  readCallback_ = nullptr;
+  if (callback) {
+    callback->readEOF();
+  }
+  if (writeState_ == kStateOpen) {
+    writeState_ = kStateClosed;
+  }
+  failWrites(TTransportException(TTransportException::END_OF_FILE,
+                                 "socket closing"));
+  maybeRelease();
+}
+
+void IoUringTransport::closeWithReset() {
+  if (!released_) {
+    linger optLinger = {1, 0};
+    if (setsockopt(fd_, SOL_SOCKET, SO_LINGER, &optLinger,
+                   sizeof(optLinger)) != 0) {
+      VLOG(2) << "Failed to set SO_LINGER on fd " << fd_;
+    }
+  }
+  closeNow();
+}
+
+void IoUringTransport::shutdownWrite() {
+  if (writes_.empty() || writeState_ != kStateOpen) {
+    shutdownWriteNow();
+  } else {
+    shutdownWritePending_ = true;
+  }
+}
+
+void IoUringTransport::shutdownWriteNow() {
+  DestructorGuard dg(this);
+  shutdownWritePending_ = false;
+  if (writeState_ != kStateOpen) {
+    return;
+  }
+  writeState_ = kStateClosed;
+  failWrites(TTransportException(TTransportException::END_OF_FILE,
+                                 "socket shutting down"));
+  ::shutdown(fd_, SHUT_WR);
+  maybeRelease();
+}
+
+void IoUringTransport::maybeRelease() {
+  if (released_ || opsPending() || readState_ == kStateOpen ||
+      writeState_ == kStateOpen) {
+    return;
+  }
+  released_ = true;
+  auto& ring = backend_->getRing();
+  if (ring.getNumPrepared() > 0) {
+    // a cancellation targeting this must not outlive it, and hit whatever
+    // comes to live at the same address
+    ring.submit();
+  }
+  ring.removeFile(slot_);
+  ::close(fd_);
+  if (destroyOnRelease_) {
+    destroyOnRelease_ = false;
+    TAsyncTransport::destroy();
+  }
+}
+
+void IoUringTransport::timeoutExpired() noexcept {
+  fail(TTransportException(TTransportException::TIMED_OUT,
+                           "write timed out"));
+}
+
+void IoUringTransport::getPeerAddress(SocketAddress* addr) const {
+  *addr = peerAddr_;
+}
+
+void IoUringTransport::getLocalAddress(SocketAddress* addr) const {
+  *addr = localAddr_;
+}
+
+bool IoUringTransport::good() const {
+  return readState_ == kStateOpen && writeState_ == kStateOpen &&
+    !closePending_;
+}
+
+bool IoUringTransport::readable() const {
+  return !stash_.empty();
+}
+
+bool IoUringTransport::connecting() const {
+  return false;
+}
+
+bool IoUringTransport::error() const {
+  return readState_ == kStateError || writeState_ == kStateError;
+}
+
+void IoUringTransport::attachEventBase(folly::EventBase* eventBase) {
+  CHECK_EQ(eventBase, getEventBase());
+}
+
+void IoUringTransport::detachEventBase() {
+  LOG(FATAL) << "IoUringTransport can't leave the EventBase of its ring";
+}
+
+bool IoUringTransport::isDetachable() const {
+  return false;
+}
+
+folly::EventBase* IoUringTransport::getEventBase() const {
+  return backend_->getEventBase();
+}
+
+void IoUringTransport::setSendTimeout(uint32_t milliseconds) {
+  sendTimeout_ = milliseconds;
+  if (sendTimeout_ == 0) {
+    cancelTimeout();
+  } else if (sending_) {
+    scheduleTimeout(sendTimeout_);
+  }
+}
+
+uint32_t IoUringTransport::getSendTimeout() const {
+  return sendTimeout_;
+}
+
+}
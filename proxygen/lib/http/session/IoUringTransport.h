@@ -0,0 +1,192 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <folly/SocketAddress.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <memory>
+#include <proxygen/lib/utils/IoUringBackend.h>
+#include <thrift/lib/cpp/async/TAsyncTransport.h>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * A TAsyncTransport for a connected socket, doing its I/O through the
+ * io_uring of its EventBase instead of readiness callbacks and a system
+ * call per read and write:
+ *
+ * - one multishot receive stays armed while there is a read callback, and
+ *   the kernel picks its buffers from the provided ring of the backend; the
+ *   data is copied to the buffer of the callback, and the ring buffer
+ *   recycled right away
+ * - writes are sendmsg() operations, one at a time so that their bytes stay
+ *   in order, prepared when queued and submitted with everything else at
+ *   the end of the loop iteration
+ * - the socket is a fixed file of the ring
+ *
+ * Closing cancels the operations in flight, and the socket is only closed,
+ * and the transport destroyed, once the kernel is done with them. Can't be
+ * detached from its EventBase.
+ */
+class IoUringTransport : public apache::thrift::async::TAsyncTransport,
+                         private folly::AsyncTimeout {
+ public:
+  typedef std::unique_ptr<IoUringTransport, Destructor> UniquePtr;
+
+  /**
+   * Take fd over, or return null, leaving fd alone, if the fixed file
+   * table of backend is full
+   */
+  static UniquePtr make(std::shared_ptr<IoUringBackend> backend, int fd);
+
+  // TAsyncTransport methods
+  void setReadCallback(ReadCallback* callback) override;
+  ReadCallback* getReadCallback() const override;
+  void write(WriteCallback* callback,
+             const void* buf, size_t bytes,
+             apache::thrift::async::WriteFlags flags =
+             apache::thrift::async::WriteFlags::NONE) override;
+  void writev(WriteCallback* callback,
+              const struct iovec* vec, size_t count,
+              apache::thrift::async::WriteFlags flags =
+              apache::thrift::async::WriteFlags::NONE) override;
+  void writeChain(WriteCallback* callback,
+                  std::unique_ptr<folly::IOBuf>&& iob,
+                  apache::thrift::async::WriteFlags flags =
+                  apache::thrift::async::WriteFlags::NONE) override;
+  void close() override;
+  void closeNow() override;
+  void closeWithReset() override;
+  void shutdownWrite() override;
+  void shutdownWriteNow() override;
+  void getPeerAddress(folly::SocketAddress* addr) const override;
+  void getLocalAddress(folly::SocketAddress* addr) const override;
+  bool good() const override;
+  bool readable() const override;
+  bool connecting() const override;
+  bool error() const override;
+  void attachEventBase(folly::EventBase* eventBase) override;
+  void detachEventBase() override;
+  bool isDetachable() const override;
+  folly::EventBase* getEventBase() const override;
+  void setSendTimeout(uint32_t milliseconds) override;
+  uint32_t getSendTimeout() const override;
+  void setEorTracking(bool track) override {}
+  size_t getAppBytesWritten() const override { return bytesWritten_; }
+  size_t getRawBytesWritten() const override { return bytesWritten_; }
+  size_t getAppBytesReceived() const override { return bytesReceived_; }
+  size_t getRawBytesReceived() const override { return bytesReceived_; }
+  bool isEorTrackingEnabled() const { return false; }
+
+  // DelayedDestruction methods
+  void destroy() override;
+
+  int getFd() const {
+    return fd_;
+  }
+
+ private:
+  enum StateEnum {
+    kStateOpen,
+    kStateClosed,
+    kStateError,
+  };
+
+  class RecvOp : public IoUringBackend::Op {
+   public:
+    explicit RecvOp(IoUringTransport* transport): transport_(transport) {}
+    void complete(const IoUring::Completion& completion) noexcept override;
+    IoUringTransport* transport_;
+  };
+
+  class SendOp : public IoUringBackend::Op {
+   public:
+    explicit SendOp(IoUringTransport* transport): transport_(transport) {}
+    void complete(const IoUring::Completion& completion) noexcept override;
+    IoUringTransport* transport_;
+  };
+
+  struct WriteRequest {
+    WriteCallback* callback{nullptr};
+    folly::IOBufQueue data{folly::IOBufQueue::cacheChainLength()};
+    bool cork{false};
+    size_t bytesWritten{0};
+    // the callback was told already, and the request is only kept for the
+    // kernel to finish sending from it
+    bool failed{false};
+    std::vector<iovec> iov;
+    msghdr msg;
+  };
+
+  IoUringTransport(std::shared_ptr<IoUringBackend> backend, int fd,
+                   int slot);
+  ~IoUringTransport();
+
+  void armRecv();
+  void cancelRecv();
+  void onRecv(const IoUring::Completion& completion);
+  // hand data to the read callback, returning how much it took
+  size_t deliver(const uint8_t* data, size_t len);
+  void deliverStash();
+  void readEOF();
+
+  void sendNext();
+  void cancelSend();
+  void onSend(const IoUring::Completion& completion);
+  void failWrites(const apache::thrift::transport::TTransportException& ex);
+  void finishWrites();
+
+  // error out the reads and the writes
+  void fail(const apache::thrift::transport::TTransportException& ex);
+
+  bool opsPending() const {
+    return recvArmed_ || sending_;
+  }
+  // close the socket, and destroy this if asked to, once the kernel's done
+  void maybeRelease();
+
+  // AsyncTimeout methods, for the send timeout
+  void timeoutExpired() noexcept override;
+
+  std::shared_ptr<IoUringBackend> backend_;
+  int fd_;
+  int slot_;
+  folly::SocketAddress localAddr_;
+  folly::SocketAddress peerAddr_;
+
+  RecvOp recvOp_{this};
+  SendOp sendOp_{this};
+
+  ReadCallback* readCallback_{nullptr};
+  StateEnum readState_{kStateOpen};
+  bool recvArmed_{false};
+  bool recvCancelled_{false};
+  // received while there was no read callback
+  folly::IOBufQueue stash_{folly::IOBufQueue::cacheChainLength()};
+  // the peer shut its side down behind the stash
+  bool eofPending_{false};
+
+  StateEnum writeState_{kStateOpen};
+  std::deque<std::unique_ptr<WriteRequest>> writes_;
+  bool sending_{false};
+  bool shutdownWritePending_{false};
+  bool closePending_{false};
+  uint32_t sendTimeout_{0};
+
+  bool released_{false};
+  bool destroyOnRelease_{false};
+  size_t bytesWritten_{0};
+  size_t bytesReceived_{0};
+};
+
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/MemoryBudget.h>
+
+#include <algorithm>
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+#include <vector>
+
+namespace proxygen {
+
+std::atomic<uint64_t> MemoryBudget::processLimit_{0};
+std::atomic<uint64_t> MemoryBudget::processUsed_{0};
+
+// the paused consumers are resumed once the usage is below 3/4 of the limit
+static uint64_t lowWatermark(uint64_t limit) {
+  return limit - limit / 4;
+}
+
+MemoryBudget::Consumer::~Consumer() {
+  if (budget_) {
+    budget_->remove(*this);
+  }
+}
+
+void MemoryBudget::Consumer::setMemoryUsed(uint64_t used) {
+  if (budget_) {
+    budget_->update(*this, used);
+  }
+}
+
+MemoryBudget& MemoryBudget::get() {
+  static folly::ThreadLocal<MemoryBudget> budget;
+  return *budget;
+}
+
+MemoryBudget::~MemoryBudget() {
+  while (!consumers_.empty()) {
+    remove(consumers_.front());
+  }
+}
+
+void MemoryBudget::add(Consumer& consumer) {
+  CHECK(!consumer.budget_);
+  consumer.budget_ = this;
+  consumers_.push_back(consumer);
+}
+
+void MemoryBudget::remove(Consumer& consumer) {
+  CHECK_EQ(consumer.budget_, this);
+  update(consumer, 0);
+  if (consumer.paused_) {
+    consumer.paused_ = false;
+    numPaused_--;
+  }
+  consumer.hook_.unlink();
+  consumer.budget_ = nullptr;
+}
+
+MemoryBudget::Footprint MemoryBudget::getFootprint(size_t numLargest) const {
+  Footprint footprint;
+  std::vector<std::pair<uint64_t, const Consumer*>> consumers;
+  for (const auto& consumer: consumers_) {
+    uint64_t bytes = consumer.getMemoryFootprint();
+    footprint.bytes += bytes;
+    footprint.consumers++;
+    consumers.emplace_back(bytes, &consumer);
+  }
+  numLargest = std::min(numLargest, consumers.size());
+  std::partial_sort(
+    consumers.begin(), consumers.begin() + numLargest, consumers.end(),
+    [] (const std::pair<uint64_t, const Consumer*>& a,
+        const std::pair<uint64_t, const Consumer*>& b) {
+      return a.first > b.first;
+    });
+  for (size_t i = 0; i < numLargest; ++i) {
+    footprint.largest.push_back(consumers[i].second);
+  }
+  return footprint;
+}
+
+void MemoryBudget::update(Consumer& consumer, uint64_t used) {
+  DCHECK_EQ(consumer.budget_, this);
+  DCHECK_GE(used_, consumer.used_);
+  used_ = used_ - consumer.used_ + used;
+  processUsed_ += used;
+  processUsed_ -= consumer.used_;
+  consumer.used_ = used;
+  if (isExceeded()) {
+    if (used_ >= nextShed_) {
+      shed();
+    }
+  } else if (numPaused_ > 0 && isBelowLowWatermark()) {
+    resumeAll();
+  }
+}
+
+bool MemoryBudget::isExceeded() const {
+  uint64_t processLimit = processLimit_;
+  return (limit_ > 0 && used_ > limit_) ||
+    (processLimit > 0 && processUsed_ > processLimit);
+}
+
+bool MemoryBudget::isBelowLowWatermark() const {
+  uint64_t processLimit = processLimit_;
+  return (limit_ == 0 || used_ <= lowWatermark(limit_)) &&
+    (processLimit == 0 || processUsed_ <= lowWatermark(processLimit));
+}
+
+void MemoryBudget::shed() {
+  uint64_t excess = 0;
+  if (limit_ > 0 && used_ > lowWatermark(limit_)) {
+    excess = used_ - lowWatermark(limit_);
+  }
+  uint64_t processLimit = processLimit_;
+  uint64_t processUsed = processUsed_;
+  if (processLimit > 0 && processUsed > lowWatermark(processLimit)) {
+    // this thread sheds its share of the process excess, at most its usage
+    excess = std::max(excess, std::min(used_, processUsed -
+                                       lowWatermark(processLimit)));
+  }
+  std::vector<Consumer*> running;
+  for (auto& consumer: consumers_) {
+    if (!consumer.paused_ && consumer.used_ > 0) {
+      running.push_back(&consumer);
+    }
+  }
+  std::sort(running.begin(), running.end(),
+            [] (const Consumer* a, const Consumer* b) {
+              return a->used_ > b->used_;
+            });
+  uint64_t shed = 0;
+  for (auto consumer: running) {
+    if (shed >= excess) {
+      break;
+    }
+    shed += consumer->used_;
+    consumer->paused_ = true;
+    numPaused_++;
+    consumer->pauseForMemory();
+  }
+  VLOG(3) << "memory budget exceeded with " << used_ << " bytes, paused "
+          << numPaused_ << " consumers";
+  // don't scan all the consumers again for each byte while this drains
+  uint64_t limit = limit_ > 0 ? limit_ : processLimit;
+  nextShed_ = used_ + std::max<uint64_t>(limit / 16, 1);
+}
+
+void MemoryBudget::resumeAll() {
+  std::vector<Consumer*> paused;
+  for (auto& consumer: consumers_) {
+    if (consumer.paused_) {
+      paused.push_back(&consumer);
+    }
+  }
+  numPaused_ = 0;
+  nextShed_ = 0;
+  for (auto consumer: paused) {
+    consumer->paused_ = false;
+    consumer->resumeForMemory();
+  }
+}
+
+}
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <folly/IntrusiveList.h>
+#include <vector>
+
+namespace folly {
+struct dynamic;
+}
+
+namespace proxygen {
+
+/**
+ * Memory budget for the buffers of the sessions of a thread: what they
+ * read and haven't parsed, the bodies waiting for their handlers, and the
+ * egress that waits for flow control or for the socket. Each session
+ * keeps its Consumer up to date. When the sessions of the thread, or of
+ * the whole process, use more than the limit, the largest consumers are
+ * paused until they fit under the low watermark again, and they are all
+ * resumed once the usage falls below it.
+ */
+class MemoryBudget {
+ public:
+  class Consumer {
+   public:
+    virtual ~Consumer();
+
+    /**
+     * Stop taking ingress until resumeForMemory()
+     */
+    virtual void pauseForMemory() noexcept = 0;
+    virtual void resumeForMemory() noexcept = 0;
+
+    uint64_t getMemoryUsed() const {
+      return used_;
+    }
+
+    bool isPausedForMemory() const {
+      return paused_;
+    }
+
+    /**
+     * Everything the consumer holds, the buffers it reports with
+     * setMemoryUsed() included. getFootprint() ranks consumers by it.
+     */
+    virtual uint64_t getMemoryFootprint() const {
+      return used_;
+    }
+
+    /**
+     * Add what identifies the consumer, and the breakdown of its
+     * footprint, to out, an object
+     */
+    virtual void describeMemory(folly::dynamic& out) const {
+    }
+
+   protected:
+    /**
+     * Report the bytes in use now to the budget this was added to
+     */
+    void setMemoryUsed(uint64_t used);
+
+   private:
+    friend class MemoryBudget;
+
+    folly::IntrusiveListHook hook_;
+    MemoryBudget* budget_{nullptr};
+    uint64_t used_{0};
+    bool paused_{false};
+  };
+
+  /**
+   * @return the budget of the calling thread
+   */
+  static MemoryBudget& get();
+
+  /**
+   * Limit for the sessions of all the threads together, in bytes, 0 for no
+   * limit
+   */
+  static void setProcessLimit(uint64_t limit) {
+    processLimit_ = limit;
+  }
+
+  static uint64_t getProcessUsed() {
+    return processUsed_;
+  }
+
+  ~MemoryBudget();
+
+  /**
+   * @param limit in bytes, 0 for no limit
+   */
+  void setLimit(uint64_t limit) {
+    limit_ = limit;
+  }
+
+  uint64_t getLimit() const {
+    return limit_;
+  }
+
+  uint64_t getUsed() const {
+    return used_;
+  }
+
+  void add(Consumer& consumer);
+  void remove(Consumer& consumer);
+
+  struct Footprint {
+    uint64_t bytes{0};
+    uint32_t consumers{0};
+    // the largest consumers, largest first
+    std::vector<const Consumer*> largest;
+  };
+
+  /**
+   * Add up the footprints of the consumers and find the numLargest largest
+   * ones. Like the rest of the budget, only usable from its thread.
+   */
+  Footprint getFootprint(size_t numLargest) const;
+
+  /**
+   * Set the bytes a consumer uses now, and pause or resume consumers if
+   * that crossed a watermark
+   */
+  void update(Consumer& consumer, uint64_t used);
+
+  bool isExceeded() const;
+
+ private:
+  typedef folly::IntrusiveList<Consumer, &Consumer::hook_> ConsumerList;
+
+  // Pause the largest consumers until the rest fit under the low watermark
+  void shed();
+  void resumeAll();
+  bool isBelowLowWatermark() const;
+
+  static std::atomic<uint64_t> processLimit_;
+  static std::atomic<uint64_t> processUsed_;
+
+  ConsumerList consumers_;
+  uint64_t limit_{0};
+  uint64_t used_{0};
+  // usage at which shed() runs again while the budget stays exceeded
+  uint64_t nextShed_{0};
+  uint32_t numPaused_{0};
+};
+
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/SocketAddress.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <proxygen/lib/http/codec/ErrorCode.h>
+#include <proxygen/lib/http/codec/HTTPCodec.h>
+
+namespace proxygen {
+
+/**
+ * A QUIC connection, as HQSession uses it: reliable, ordered byte streams
+ * that are delivered, flow controlled and reset independently of each
+ * other over one UDP flow. The QUIC implementation, its handshake and its
+ * loss recovery live behind this interface, in the thread of
+ * getEventBase().
+ *
+ * Streams are numbered by the transport, never 0.
+ */
+class QuicTransport {
+ public:
+  typedef HTTPCodec::StreamID StreamID;
+
+  class Callback {
+   public:
+    virtual ~Callback() {}
+
+    /**
+     * Bytes of a stream came in, in order. The first ones of a stream the
+     * peer opened are how the callback learns of it. fin is set with the
+     * last bytes, or alone.
+     */
+    virtual void onStreamData(StreamID id,
+                              std::unique_ptr<folly::IOBuf> data,
+                              bool fin) noexcept = 0;
+
+    /**
+     * The peer reset the stream, nothing more comes in or goes out on it
+     */
+    virtual void onStreamReset(StreamID id, ErrorCode code) noexcept = 0;
+
+    /**
+     * The flow control window of the stream opened, see getWritableBytes()
+     */
+    virtual void onStreamWritable(StreamID id) noexcept = 0;
+
+    /**
+     * The connection was closed, by either side; error is false for a
+     * graceful close or an idle timeout. No callback follows.
+     */
+    virtual void onConnectionEnd(bool error) noexcept = 0;
+  };
+
+  virtual ~QuicTransport() {}
+
+  virtual void setCallback(Callback* callback) = 0;
+
+  /**
+   * Open a stream of our own
+   *
+   * @return the new stream, 0 if the peer allows no more
+   */
+  virtual StreamID createStream() = 0;
+
+  /**
+   * @return how many bytes the flow control windows of the stream and of
+   *         the connection let writeStream() send now
+   */
+  virtual uint64_t getWritableBytes(StreamID id) const = 0;
+
+  /**
+   * Queue bytes on a stream, fin to end it after them. Bytes beyond
+   * getWritableBytes() are buffered by the transport.
+   */
+  virtual void writeStream(StreamID id,
+                           std::unique_ptr<folly::IOBuf> data,
+                           bool fin) = 0;
+
+  /**
+   * Abandon a stream in both directions, dropping what wasn't sent
+   */
+  virtual void resetStream(StreamID id, ErrorCode code) = 0;
+
+  /**
+   * Stop delivering the data of a stream, so that its receive window
+   * fills and the peer stops sending
+   */
+  virtual void pauseRead(StreamID id) = 0;
+
+  virtual void resumeRead(StreamID id) = 0;
+
+  /**
+   * Close the connection. Calls onConnectionEnd(), unless the callback was
+   * unset.
+   */
+  virtual void close(bool error) = 0;
+
+  virtual const folly::SocketAddress& getLocalAddress() const = 0;
+
+  virtual const folly::SocketAddress& getPeerAddress() const = 0;
+
+  virtual folly::EventBase* getEventBase() const = 0;
+};
+
+}
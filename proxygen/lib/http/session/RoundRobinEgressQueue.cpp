@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
+
+#include <algorithm>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+
+namespace proxygen {
+
+RoundRobinEgressQueue::RoundRobinEgressQueue(
+  const std::vector<uint32_t>& weights) {
+  scheduler_.setWeights(weights);
+}
+
+RoundRobinEgressQueue::~RoundRobinEgressQueue() {
+}
+
+EgressQueue::Handle
+RoundRobinEgressQueue::addTransaction(HTTPCodec::StreamID id,
+                                      int8_t priority,
+                                      HTTPTransaction* txn) {
+  LevelNode* node = ObjectPool<LevelNode>::get().acquire().release();
+  node->txn = txn;
+  node->level = toLevel(priority);
+  node->setEnqueued(false);
+  return node;
+}
+
+void RoundRobinEgressQueue::removeTransaction(Handle handle) {
+  LevelNode* node = toNode(handle);
+  clearPendingEgress(node);
+  ObjectPool<LevelNode>::get().recycle(std::unique_ptr<LevelNode>(node));
+}
+
+void RoundRobinEgressQueue::updatePriority(Handle handle,
+                                           const HTTPPriority& priority) {
+  LevelNode* node = toNode(handle);
+  // one level per 32 weights, the heaviest first
+  uint16_t weight = std::min<uint16_t>(std::max<uint16_t>(priority.weight, 1),
+                                       256);
+  uint8_t level = kNumPriorities - 1 - ((weight - 1) >> 5);
+  if (level == node->level) {
+    return;
+  }
+  bool enqueued = node->isEnqueued();
+  clearPendingEgress(node);
+  node->level = level;
+  if (enqueued) {
+    signalPendingEgress(node);
+  }
+}
+
+void RoundRobinEgressQueue::signalPendingEgress(Handle handle) {
+  LevelNode* node = toNode(handle);
+  if (!node->isEnqueued()) {
+    scheduler_.push(node->handle, node->level);
+    node->setEnqueued(true);
+  }
+}
+
+void RoundRobinEgressQueue::clearPendingEgress(Handle handle) {
+  LevelNode* node = toNode(handle);
+  if (node->isEnqueued()) {
+    scheduler_.erase(node->handle);
+    node->setEnqueued(false);
+  }
+}
+
+HTTPTransaction* RoundRobinEgressQueue::top() {
+  LevelNode* node = scheduler_.top();
+  return node ? node->txn : nullptr;
+}
+
+void RoundRobinEgressQueue::onSent(Handle handle, size_t bytes) {
+  scheduler_.onSent(toNode(handle)->handle, bytes);
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/lib/http/session/EgressQueue.h>
+#include <proxygen/lib/http/session/EgressScheduler.h>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * EgressQueue over the 8 SPDY priority levels. The levels are served in
+ * strict priority order, or by weight if the queue is given one weight per
+ * level (see EgressScheduler), and the transactions of a level take turns.
+ *
+ * HTTP/2 priorities only keep their weight, which picks the level.
+ */
+class RoundRobinEgressQueue : public EgressQueue {
+ public:
+  explicit RoundRobinEgressQueue(
+    const std::vector<uint32_t>& weights = std::vector<uint32_t>());
+  ~RoundRobinEgressQueue() override;
+
+  Handle addTransaction(HTTPCodec::StreamID id,
+                        int8_t priority,
+                        HTTPTransaction* txn) override;
+
+  void removeTransaction(Handle handle) override;
+
+  void updatePriority(Handle handle, const HTTPPriority& priority) override;
+
+  void signalPendingEgress(Handle handle) override;
+
+  void clearPendingEgress(Handle handle) override;
+
+  HTTPTransaction* top() override;
+
+  void onSent(Handle handle, size_t bytes) override;
+
+  bool empty() const override {
+    return scheduler_.empty();
+  }
+
+ private:
+  struct LevelNode : public Node {
+    LevelNode() : handle(this) {}
+
+    // for ObjectPool, the nodes are reinitialized by addTransaction()
+    void reset() {}
+
+    void setEnqueued(bool enqueued) {
+      enqueued_ = enqueued;
+    }
+
+    HTTPTransaction* txn{nullptr};
+    uint8_t level{0};
+    EgressScheduler<LevelNode>::Handle handle;
+  };
+
+  static LevelNode* toNode(Handle handle) {
+    return static_cast<LevelNode*>(handle);
+  }
+
+  EgressScheduler<LevelNode> scheduler_;
+};
+
+}
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/SlowReaderDetector.h>
+
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+const milliseconds SlowReaderDetector::kSampleInterval(1000);
+
+SlowReaderDetector::SlowReaderDetector(milliseconds maxDrainTime,
+                                       milliseconds deadline,
+                                       uint64_t minBuffered):
+    maxDrainTime_(maxDrainTime),
+    deadline_(deadline),
+    minBuffered_(minBuffered) {
+}
+
+SlowReaderDetector::State SlowReaderDetector::onDrained(uint64_t bytes,
+                                                        uint64_t buffered,
+                                                        TimePoint now) {
+  if (!timePointInitialized(sampleStart_)) {
+    reset(now);
+  }
+  sampleBytes_ += bytes;
+  auto elapsed = std::chrono::duration_cast<milliseconds>(now - sampleStart_);
+  if (elapsed < kSampleInterval) {
+    return state_;
+  }
+  // buffered / rate > maxDrainTime, with rate = sampleBytes_ / elapsed
+  bool slow = buffered >= minBuffered_ &&
+    buffered * uint64_t(elapsed.count()) >
+    sampleBytes_ * uint64_t(maxDrainTime_.count());
+  sampleStart_ = now;
+  sampleBytes_ = 0;
+  if (!slow) {
+    state_ = State::OK;
+  } else if (state_ == State::OK) {
+    state_ = State::SLOW;
+    slowSince_ = now;
+  } else if (now - slowSince_ > deadline_) {
+    state_ = State::EXPIRED;
+  }
+  return state_;
+}
+
+void SlowReaderDetector::reset(TimePoint now) {
+  sampleStart_ = now;
+  sampleBytes_ = 0;
+  state_ = State::OK;
+}
+
+}
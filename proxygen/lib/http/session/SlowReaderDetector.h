@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Tells a peer that reads too slowly from one whose egress is only large.
+ * As the socket takes the egress of a session, the bytes it took since
+ * the previous sample, at least kSampleInterval ago, give the drain rate.
+ * A session whose buffered egress would take longer than maxDrainTime to
+ * go out at that rate, and which buffers at least minBuffered bytes, is
+ * slow. One that stays slow for longer than the deadline is expired, even
+ * though each of its writes completes before the write timeout.
+ */
+class SlowReaderDetector {
+ public:
+  static const std::chrono::milliseconds kSampleInterval;
+
+  enum class State: uint8_t {
+    OK,
+    SLOW,
+    EXPIRED,
+  };
+
+  SlowReaderDetector(std::chrono::milliseconds maxDrainTime,
+                     std::chrono::milliseconds deadline,
+                     uint64_t minBuffered);
+
+  /**
+   * The socket took bytes, and buffered bytes are left to send
+   */
+  State onDrained(uint64_t bytes, uint64_t buffered, TimePoint now);
+
+  /**
+   * All the egress went out, the next sample starts from now
+   */
+  void reset(TimePoint now);
+
+  State getState() const {
+    return state_;
+  }
+
+ private:
+  const std::chrono::milliseconds maxDrainTime_;
+  const std::chrono::milliseconds deadline_;
+  const uint64_t minBuffered_;
+  TimePoint sampleStart_;
+  uint64_t sampleBytes_{0};
+  TimePoint slowSince_;
+  State state_{State::OK};
+};
+
+}
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/SlowTransactionSampler.h>
+
+#include <algorithm>
+
+namespace proxygen {
+
+const size_t SlowTransactionSampler::kDefaultCapacity;
+
+SlowTransactionSampler::SlowTransactionSampler(
+    std::chrono::milliseconds threshold, size_t capacity)
+    : threshold_(threshold),
+      capacity_(std::max(capacity, size_t(1))) {
+}
+
+void SlowTransactionSampler::record(folly::dynamic sample) {
+  sample["time_ms"] = (int64_t)std::chrono::duration_cast<
+    std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::lock_guard<std::mutex> guard(mutex_);
+  recorded_++;
+  if (ring_.size() < capacity_) {
+    ring_.push_back(std::move(sample));
+    return;
+  }
+  ring_[next_] = std::move(sample);
+  next_ = (next_ + 1) % capacity_;
+}
+
+std::vector<folly::dynamic> SlowTransactionSampler::getSamples() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::vector<folly::dynamic> samples(ring_.begin() + next_, ring_.end());
+  samples.insert(samples.end(), ring_.begin(), ring_.begin() + next_);
+  return samples;
+}
+
+uint64_t SlowTransactionSampler::getNumRecorded() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return recorded_;
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/dynamic.h>
+#include <mutex>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Keeps the state of the last transactions that went past a latency
+ * threshold, captured as they passed it: the session as
+ * HTTPSession::describeMemory() reports it, and the transaction's state
+ * machines, flow control windows, place in the egress queue and buffered
+ * bytes (see HTTPTransaction::describeState()). The sessions given a
+ * sampler (see HTTPSession::setSlowTransactionSampler()) arm a timeout
+ * with the threshold for each transaction.
+ *
+ * The samples are folly::dynamic objects, ready for a debug endpoint, in
+ * a ring of the last `capacity`. Usually shared by the sessions of all
+ * the threads; thread safe.
+ */
+class SlowTransactionSampler {
+ public:
+  static const size_t kDefaultCapacity = 256;
+
+  explicit SlowTransactionSampler(std::chrono::milliseconds threshold,
+                                  size_t capacity = kDefaultCapacity);
+
+  std::chrono::milliseconds getThreshold() const {
+    return threshold_;
+  }
+
+  /**
+   * Keep sample, adding the wall clock time to it as "time_ms", in place
+   * of the oldest one if the ring is full
+   */
+  void record(folly::dynamic sample);
+
+  /**
+   * @return the samples in the ring, the oldest first
+   */
+  std::vector<folly::dynamic> getSamples() const;
+
+  /**
+   * @return all the samples recorded, including the ones the ring dropped
+   */
+  uint64_t getNumRecorded() const;
+
+ private:
+  const std::chrono::milliseconds threshold_;
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  std::vector<folly::dynamic> ring_;
+  // where the next sample goes once the ring is full
+  size_t next_{0};
+  uint64_t recorded_{0};
+};
+
+}
@@ -0,0 +1,28 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/StreamLimit.h>
+
+#include <folly/ThreadLocal.h>
+
+namespace proxygen {
+
+StreamLimit& StreamLimit::get() {
+  static folly::ThreadLocal<StreamLimit> limit;
+  return *limit;
+}
+
+void StreamLimit::setLimit(uint32_t limit) {
+  if (limit != limit_) {
+    limit_ = limit;
+    ++generation_;
+  }
+}
+
+}
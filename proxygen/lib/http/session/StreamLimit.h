@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace proxygen {
+
+/**
+ * The number of concurrent streams the downstream sessions of a thread
+ * advertise to their peers in SETTINGS_MAX_CONCURRENT_STREAMS, when
+ * something, e.g. a ConcurrencyLimitFilterFactory, learns it at run time.
+ * A session picks up a new limit with its next incoming stream, and sends
+ * it to its peer then.
+ */
+class StreamLimit {
+ public:
+  /**
+   * @return the limit of the calling thread
+   */
+  static StreamLimit& get();
+
+  /**
+   * @param limit 0 to leave the sessions with their own setting
+   */
+  void setLimit(uint32_t limit);
+
+  uint32_t getLimit() const {
+    return limit_;
+  }
+
+  /**
+   * @return a number that changes with each new limit
+   */
+  uint64_t getGeneration() const {
+    return generation_;
+  }
+
+ private:
+  uint32_t limit_{0};
+  uint64_t generation_{0};
+};
+
+}
@@ -0,0 +1,314 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <glog/logging.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <proxygen/lib/utils/ObjectPool.h>
+#include <type_traits>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Map from stream ID to T, for IDs that mostly grow as streams come and
+ * go. The entries in a sliding window of IDs are found by indexing an
+ * array, the ones that fell behind the window go into an ordered overflow
+ * map. The values are built in place in entries taken from a per-thread
+ * ObjectPool, which the tables of the thread share. The values keep their
+ * address for as long as they are in the table, and the steady state
+ * doesn't allocate.
+ *
+ * Iteration is in increasing ID order.
+ */
+template <typename T>
+class StreamTable {
+ public:
+  typedef uint32_t StreamID;
+
+  StreamTable() : window_(kInitialWindow, nullptr) {}
+
+  ~StreamTable() {
+    forEachEntry([] (Entry* entry) {
+      entry->get()->~T();
+      release(entry);
+    });
+  }
+
+  StreamTable(const StreamTable&) = delete;
+  StreamTable& operator=(const StreamTable&) = delete;
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /**
+   * @return the value of the stream, nullptr if it is not in the table
+   */
+  T* find(StreamID id) const {
+    Entry* entry = findEntry(id);
+    return entry ? entry->get() : nullptr;
+  }
+
+  /**
+   * Build the value of a new stream from args.
+   *
+   * @return the new value, or nullptr if the ID is already in the table
+   */
+  template <typename... Args>
+  T* emplace(StreamID id, Args&&... args) {
+    if (findEntry(id)) {
+      return nullptr;
+    }
+    Entry* entry = allocate();
+    new (entry->get()) T(std::forward<Args>(args)...);
+    entry->id = id;
+    entry->seqNo = nextSeqNo_++;
+    if (id < base_) {
+      overflow_.emplace(id, entry);
+    } else {
+      if (id - base_ >= window_.size()) {
+        slide(id);
+      }
+      window_[id & mask()] = entry;
+    }
+    ++size_;
+    return entry->get();
+  }
+
+  /**
+   * Remove the stream and destroy its value, if it is in the table
+   */
+  void erase(StreamID id) {
+    Entry* entry = nullptr;
+    if (inWindow(id)) {
+      std::swap(entry, window_[id & mask()]);
+    } else {
+      auto it = overflow_.find(id);
+      if (it != overflow_.end()) {
+        entry = it->second;
+        overflow_.erase(it);
+      }
+    }
+    if (!entry) {
+      return;
+    }
+    --size_;
+    entry->get()->~T();
+    release(entry);
+  }
+
+  /**
+   * @return the value with the lowest ID, nullptr if the table is empty
+   */
+  T* front() const {
+    Entry* entry = nextEntry(0);
+    return entry ? entry->get() : nullptr;
+  }
+
+  /**
+   * @return the number of free entries in the pool of the calling thread,
+   *         the next emplace() allocates if it is 0
+   */
+  static size_t getPoolSize() {
+    return ObjectPool<Entry>::get().size();
+  }
+
+  /**
+   * Call func(id, value) on every entry. func must not add or erase
+   * entries.
+   */
+  template <typename F>
+  void forEach(F func) {
+    forEachEntry([&func] (Entry* entry) {
+      func(entry->id, *entry->get());
+    });
+  }
+
+  template <typename F>
+  void forEach(F func) const {
+    forEachEntry([&func] (const Entry* entry) {
+      func(entry->id, static_cast<const T&>(*entry->get()));
+    });
+  }
+
+  /**
+   * Like forEach(), but func may erase any entry or add new ones. The
+   * entries added while iterating are not visited.
+   */
+  template <typename F>
+  void forEachSafe(F func) {
+    uint64_t endSeqNo = nextSeqNo_;
+    StreamID from = 0;
+    while (Entry* entry = nextEntry(from)) {
+      StreamID id = entry->id;
+      if (entry->seqNo < endSeqNo) {
+        func(id, *entry->get());
+      }
+      if (id == std::numeric_limits<StreamID>::max()) {
+        break;
+      }
+      from = id + 1;
+    }
+  }
+
+ private:
+  static const uint32_t kInitialWindow = 16;
+  static const uint32_t kMaxWindow = 1024;
+
+  struct Entry {
+    // from the slabs of the thread, as the sessions
+    static void* operator new(size_t size) {
+      return IOBufSlab::get().allocate(size);
+    }
+    static void operator delete(void* ptr) {
+      IOBufSlab::deallocate(ptr);
+    }
+
+    // the value is destroyed before the entry goes back to the pool
+    void reset() {}
+
+    T* get() {
+      return reinterpret_cast<T*>(&storage);
+    }
+    const T* get() const {
+      return reinterpret_cast<const T*>(&storage);
+    }
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    StreamID id;
+    // insertion order, to skip the entries added by forEachSafe() callbacks
+    uint64_t seqNo;
+  };
+
+  uint32_t mask() const {
+    return window_.size() - 1;
+  }
+
+  bool inWindow(StreamID id) const {
+    return id >= base_ && id - base_ < window_.size();
+  }
+
+  Entry* findEntry(StreamID id) const {
+    if (inWindow(id)) {
+      Entry* entry = window_[id & mask()];
+      DCHECK(!entry || entry->id == id);
+      return entry;
+    }
+    if (overflow_.empty()) {
+      return nullptr;
+    }
+    auto it = overflow_.find(id);
+    return it == overflow_.end() ? nullptr : it->second;
+  }
+
+  /**
+   * @return the entry with the lowest ID not below id
+   */
+  Entry* nextEntry(StreamID id) const {
+    if (id < base_) {
+      auto it = overflow_.lower_bound(id);
+      if (it != overflow_.end()) {
+        return it->second;
+      }
+      id = base_;
+    }
+    for (; inWindow(id); ++id) {
+      if (Entry* entry = window_[id & mask()]) {
+        return entry;
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename F>
+  void forEachEntry(F func) const {
+    for (const auto& entry: overflow_) {
+      func(entry.second);
+    }
+    for (StreamID id = base_; inWindow(id); ++id) {
+      if (Entry* entry = window_[id & mask()]) {
+        func(entry);
+      }
+    }
+  }
+
+  /**
+   * Move the window so that it covers id, which is past its end
+   */
+  void slide(StreamID id) {
+    // skip the free slots at the start of the window
+    uint32_t skipped = 0;
+    while (skipped < window_.size() && !window_[base_ & mask()]) {
+      ++base_;
+      ++skipped;
+    }
+    if (skipped == window_.size()) {
+      base_ = id;
+      return;
+    }
+    if (id - base_ < window_.size()) {
+      return;
+    }
+    if (id - base_ < kMaxWindow) {
+      grow(id - base_ + 1);
+      return;
+    }
+    // the streams that can't keep up with the window go to the overflow
+    StreamID newBase = id - window_.size() + 1;
+    for (; base_ < newBase; ++base_) {
+      Entry*& entry = window_[base_ & mask()];
+      if (entry) {
+        overflow_.emplace(entry->id, entry);
+        entry = nullptr;
+      }
+    }
+  }
+
+  void grow(uint32_t length) {
+    uint32_t newLength = window_.size();
+    while (newLength < length) {
+      newLength <<= 1;
+    }
+    std::vector<Entry*> window(newLength, nullptr);
+    for (StreamID id = base_; inWindow(id); ++id) {
+      window[id & (newLength - 1)] = window_[id & mask()];
+    }
+    window_.swap(window);
+  }
+
+  static Entry* allocate() {
+    return ObjectPool<Entry>::get().acquire().release();
+  }
+
+  static void release(Entry* entry) {
+    ObjectPool<Entry>::get().recycle(std::unique_ptr<Entry>(entry));
+  }
+
+  // entries of the IDs from base_ to base_ + window_.size() - 1, the
+  // length is a power of 2
+  std::vector<Entry*> window_;
+  StreamID base_{0};
+  // streams below base_
+  std::map<StreamID, Entry*> overflow_;
+  size_t size_{0};
+  uint64_t nextSeqNo_{0};
+};
+
+}
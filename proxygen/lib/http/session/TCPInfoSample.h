@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * What TCP_INFO said of a connection at one point, see
+ * HTTPSession::setTCPInfoSampleInterval(). All zero if the connection
+ * was never sampled, or isn't a TCP socket on Linux.
+ */
+struct TCPInfoSample {
+  TimePoint time;
+  // smoothed RTT and its mean deviation
+  std::chrono::microseconds rtt{0};
+  std::chrono::microseconds rttVar{0};
+  // congestion window, in segments of mss bytes
+  uint32_t cwnd{0};
+  uint32_t mss{0};
+  // segments sent and not yet acked
+  uint32_t unacked{0};
+  // segments retransmitted over the life of the connection, and since the
+  // previous sample of the same session
+  uint32_t totalRetransmits{0};
+  uint32_t newRetransmits{0};
+  // bytes/s the congestion window lets through at this RTT: cwnd * mss /
+  // rtt. The tcp_info of the libc has no tcpi_delivery_rate.
+  uint64_t deliveryRate{0};
+
+  bool isSet() const {
+    return time != TimePoint();
+  }
+};
+
+}
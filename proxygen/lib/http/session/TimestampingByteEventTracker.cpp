@@ -0,0 +1,211 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/TimestampingByteEventTracker.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <proxygen/lib/http/session/TTLBAStats.h>
+#include <thrift/lib/cpp/async/TAsyncSocket.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+using apache::thrift::async::TAsyncSocket;
+using apache::thrift::async::TAsyncTransport;
+using std::chrono::system_clock;
+
+namespace proxygen {
+
+const uint32_t TimestampingByteEventTracker::kMaxAckPolls;
+
+TimestampingByteEventTracker::TimestampingByteEventTracker(
+  Callback* callback): ByteEventTracker(callback) {
+}
+
+TimestampingByteEventTracker::~TimestampingByteEventTracker() {
+  drainByteEvents();
+}
+
+bool TimestampingByteEventTracker::setMaxTcpAckTracked(
+    uint32_t maxAckTracked,
+    AsyncTimeoutSet* ackLatencyTimeouts,
+    TAsyncTransport* transport) {
+#ifdef __linux__
+  auto sock = dynamic_cast<TAsyncSocket*>(transport);
+  if (!sock || sock->getFd() < 0) {
+    return false;
+  }
+  int flags = SOF_TIMESTAMPING_TX_ACK | SOF_TIMESTAMPING_SOFTWARE |
+    SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  if (setsockopt(sock->getFd(), SOL_SOCKET, SO_TIMESTAMPING,
+                 &flags, sizeof(flags)) != 0) {
+    VLOG(2) << "SO_TIMESTAMPING not supported on fd=" << sock->getFd()
+            << ": " << strerror(errno);
+    return false;
+  }
+  fd_ = sock->getFd();
+  // OPT_ID counts the bytes from here
+  rawBytesBase_ = callback_->getRawBytesWritten();
+  maxAckTracked_ = maxAckTracked;
+  ackLatencyTimeouts_ = ackLatencyTimeouts;
+  sock->setEorTracking(true);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TimestampingByteEventTracker::addAckToLastByteEvent(
+    HTTPTransaction* txn,
+    const ByteEvent& lastByteEvent,
+    bool eorTrackingEnabled) {
+  if (fd_ < 0) {
+    return;
+  }
+  if (acks_.size() >= maxAckTracked_) {
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBAExceedLimit();
+    }
+    return;
+  }
+  if (!eorTrackingEnabled && ttlbaStats_) {
+    // the write may end past the last byte, the timestamp will be late
+    ttlbaStats_->recordTTLBAEomPassed();
+  }
+  // the write that ends with the last byte is done, so it is the last one
+  // the kernel got
+  uint32_t id = callback_->getRawBytesWritten() - rawBytesBase_ - 1;
+  acks_.emplace_back(id, system_clock::now(), polls_ + kMaxAckPolls,
+                     HTTPTransaction::CallbackGuard(*txn));
+  if (ttlbaStats_) {
+    ttlbaStats_->recordTTLBATracked();
+  }
+  scheduleTimeout();
+}
+
+void TimestampingByteEventTracker::processByteEvents(
+    uint64_t bytesWritten,
+    bool eorTrackingEnabled) {
+  ByteEventTracker::processByteEvents(bytesWritten, eorTrackingEnabled);
+  readTimestamps();
+}
+
+size_t TimestampingByteEventTracker::drainByteEvents() {
+  size_t numEvents = ByteEventTracker::drainByteEvents() + acks_.size();
+  acks_.clear();
+  cancelTimeout();
+  return numEvents;
+}
+
+void TimestampingByteEventTracker::preRead() {
+  // the timestamps wake up the reads of the socket too, until they are
+  // read
+  readTimestamps();
+}
+
+void TimestampingByteEventTracker::onAck(uint32_t id,
+                                         system_clock::time_point ackTime) {
+  // the offsets wrap at 4GB
+  while (!acks_.empty() && int32_t(acks_.front().id - id) <= 0) {
+    PendingAck& ack = acks_.front();
+    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+      ackTime - ack.sentTime);
+    VLOG(5) << "ack of byte " << ack.id << " after " << latency.count()
+            << "ms";
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBAReceived();
+    }
+    ack.cg.peekTransaction().onEgressLastByteAck(
+      std::max(latency, std::chrono::milliseconds(0)));
+    acks_.pop_front();
+    callback_->onDeleteAckEvent();
+  }
+  if (acks_.empty()) {
+    cancelTimeout();
+  }
+}
+
+void TimestampingByteEventTracker::timeoutExpired() noexcept {
+  polls_++;
+  readTimestamps();
+  while (!acks_.empty() && acks_.front().deadlinePoll <= polls_) {
+    VLOG(4) << "no ack timestamp for byte " << acks_.front().id;
+    if (ttlbaStats_) {
+      ttlbaStats_->recordTTLBATimeout();
+    }
+    acks_.pop_front();
+    callback_->onDeleteAckEvent();
+  }
+  scheduleTimeout();
+}
+
+void TimestampingByteEventTracker::readTimestamps() {
+#ifdef __linux__
+  if (fd_ < 0) {
+    return;
+  }
+  // every write gets a timestamp, drain them all so that the error queue
+  // doesn't keep the socket readable
+  char control[512];
+  while (true) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        VLOG(4) << "failed to read the error queue of fd=" << fd_ << ": "
+                << strerror(errno);
+      }
+      return;
+    }
+    const struct scm_timestamping* ts = nullptr;
+    const struct sock_extended_err* err = nullptr;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_TIMESTAMPING) {
+        ts = reinterpret_cast<const struct scm_timestamping*>(
+          CMSG_DATA(cmsg));
+      } else if ((cmsg->cmsg_level == SOL_IP &&
+                  cmsg->cmsg_type == IP_RECVERR) ||
+                 (cmsg->cmsg_level == SOL_IPV6 &&
+                  cmsg->cmsg_type == IPV6_RECVERR)) {
+        err = reinterpret_cast<const struct sock_extended_err*>(
+          CMSG_DATA(cmsg));
+      }
+    }
+    if (!ts || !err || err->ee_errno != ENOMSG ||
+        err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING ||
+        err->ee_info != SCM_TSTAMP_ACK) {
+      continue;
+    }
+    // the software timestamps are in CLOCK_REALTIME
+    auto ackTime = system_clock::time_point(
+      std::chrono::duration_cast<system_clock::duration>(
+        std::chrono::seconds(ts->ts[0].tv_sec) +
+        std::chrono::nanoseconds(ts->ts[0].tv_nsec)));
+    onAck(err->ee_data, ackTime);
+  }
+#endif
+}
+
+void TimestampingByteEventTracker::scheduleTimeout() {
+  if (ackLatencyTimeouts_ && !acks_.empty() && !isScheduled()) {
+    ackLatencyTimeouts_->scheduleTimeout(this);
+  }
+}
+
+} // proxygen
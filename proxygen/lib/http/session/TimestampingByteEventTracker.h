@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <proxygen/lib/http/session/ByteEventTracker.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+
+namespace proxygen {
+
+/**
+ * ByteEventTracker that measures the time to the ack of the last byte of
+ * the transactions with the TX timestamps of the kernel, SO_TIMESTAMPING
+ * with SOF_TIMESTAMPING_TX_ACK and OPT_ID. Unlike the pings, this works
+ * for every protocol and sends nothing on the wire.
+ *
+ * The kernel timestamps the ack of the last byte of every write, and
+ * identifies it by its offset in the stream. With EOR tracking the session
+ * ends a write at the last byte of each transaction, so the acks map back
+ * to the last byte events. The timestamps are read from the error queue
+ * of the socket before each read and after each write, and from a timeout
+ * while some acks are outstanding.
+ */
+class TimestampingByteEventTracker : public ByteEventTracker,
+                                     private AsyncTimeoutSet::Callback {
+ public:
+  // timeouts after which an ack that never got a timestamp is dropped
+  static const uint32_t kMaxAckPolls = 10;
+
+  explicit TimestampingByteEventTracker(Callback* callback);
+  ~TimestampingByteEventTracker() override;
+
+  /**
+   * Turn on the TX timestamps of transport, and EOR tracking. At most
+   * maxAckTracked acks are outstanding at once. ackLatencyTimeouts sets
+   * how often the error queue is read while nothing is written.
+   *
+   * @return false if transport is not a socket, or the kernel doesn't
+   * support the timestamps. No ack is tracked then.
+   */
+  bool setMaxTcpAckTracked(
+    uint32_t maxAckTracked,
+    AsyncTimeoutSet* ackLatencyTimeouts,
+    apache::thrift::async::TAsyncTransport* transport) override;
+
+  void setTTLBAStats(TTLBAStats* stats) override {
+    ttlbaStats_ = stats;
+  }
+
+  void addAckToLastByteEvent(HTTPTransaction* txn,
+                             const ByteEvent& lastByteEvent,
+                             bool eorTrackingEnabled) override;
+
+  void processByteEvents(uint64_t bytesWritten,
+                         bool eorTrackingEnabled) override;
+
+  size_t drainByteEvents() override;
+
+  void preRead() override;
+
+  /**
+   * Deliver the acks of the bytes up to id, the offset of a byte in the
+   * stream since the timestamps were turned on
+   */
+  void onAck(uint32_t id, std::chrono::system_clock::time_point ackTime);
+
+  /**
+   * @return the number of acks that are outstanding
+   */
+  size_t getNumPendingAcks() const {
+    return acks_.size();
+  }
+
+ private:
+  struct PendingAck {
+    PendingAck(uint32_t i,
+               std::chrono::system_clock::time_point sent,
+               uint64_t deadline,
+               HTTPTransaction::CallbackGuard guard):
+        id(i), sentTime(sent), deadlinePoll(deadline), cg(guard) {}
+
+    // offset of the last byte of the transaction in the stream
+    uint32_t id;
+    // when the last byte went to the kernel
+    std::chrono::system_clock::time_point sentTime;
+    uint64_t deadlinePoll;
+    HTTPTransaction::CallbackGuard cg;
+  };
+
+  void timeoutExpired() noexcept override;
+
+  /**
+   * Read the timestamps in the error queue of the socket
+   */
+  void readTimestamps();
+
+  void scheduleTimeout();
+
+  std::deque<PendingAck> acks_;
+  int fd_{-1};
+  // raw bytes written on the socket before the timestamps were turned on
+  uint64_t rawBytesBase_{0};
+  uint32_t maxAckTracked_{0};
+  uint64_t polls_{0};
+  AsyncTimeoutSet* ackLatencyTimeouts_{nullptr};
+  TTLBAStats* ttlbaStats_{nullptr};
+};
+
+} // proxygen
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/ZeroCopyWriter.h>
+
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define PROXYGEN_HAVE_ZEROCOPY 1
+#endif
+
+using apache::thrift::async::TAsyncTransport;
+using apache::thrift::async::WriteFlags;
+using apache::thrift::transport::TTransportException;
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+const size_t kMaxIovecs = 64;
+
+}
+
+const uint64_t ZeroCopyWriter::kDefaultMaxPinnedBytes;
+
+ZeroCopyWriter::ZeroCopyWriter(folly::EventBase* eventBase, int fd):
+    folly::EventHandler(eventBase, fd),
+    fd_(fd) {
+}
+
+ZeroCopyWriter::~ZeroCopyWriter() {
+  cancel();
+}
+
+bool ZeroCopyWriter::enable(int fd) {
+#ifdef PROXYGEN_HAVE_ZEROCOPY
+  int on = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+    VLOG(2) << "SO_ZEROCOPY not supported on fd=" << fd << ": "
+            << strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ZeroCopyWriter::writeChain(TAsyncTransport::WriteCallback* callback,
+                                unique_ptr<IOBuf> chain,
+                                WriteFlags flags) {
+  CHECK(!isWriting());
+  callback_ = callback;
+  length_ = chain->computeChainDataLength();
+  buf_ = std::move(chain);
+  bytesWritten_ = 0;
+  cork_ = isSet(flags, WriteFlags::CORK);
+  numZeroCopySends_ = 0;
+  writeMore();
+}
+
+void ZeroCopyWriter::cancel() {
+  if (!isWriting()) {
+    return;
+  }
+  auto callback = callback_;
+  uint64_t bytesWritten = bytesWritten_;
+  finishWrite();
+  callback->writeError(bytesWritten, TTransportException(
+      TTransportException::NOT_OPEN, "write cancelled"));
+}
+
+void ZeroCopyWriter::handlerReady(uint16_t events) noexcept {
+  writeMore();
+}
+
+void ZeroCopyWriter::writeMore() {
+#ifdef PROXYGEN_HAVE_ZEROCOPY
+  while (bytesWritten_ < length_) {
+    // the whole chain stays in buf_, skip what the kernel already has
+    struct iovec vec[kMaxIovecs];
+    size_t count = 0;
+    uint64_t skip = bytesWritten_;
+    const IOBuf* current = buf_.get();
+    do {
+      if (current->length() > skip) {
+        vec[count].iov_base = const_cast<uint8_t*>(current->data() + skip);
+        vec[count].iov_len = current->length() - skip;
+        count++;
+        skip = 0;
+      } else {
+        skip -= current->length();
+      }
+      current = current->next();
+    } while (current != buf_.get() && count < kMaxIovecs);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = count;
+    int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+    if (cork_ || current != buf_.get()) {
+      flags |= MSG_MORE;
+    }
+    ssize_t n = sendmsg(fd_, &msg, flags | MSG_ZEROCOPY);
+    if (n > 0) {
+      nextId_++;
+      numZeroCopySends_++;
+    } else if (n < 0 && errno == ENOBUFS) {
+      // the kernel can't pin more pages for this socket, copy them
+      n = sendmsg(fd_, &msg, flags);
+    }
+    if (n > 0) {
+      bytesWritten_ += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // wait for room in the socket buffer
+      if (!isHandlerRegistered()) {
+        registerHandler(EventHandler::WRITE | EventHandler::PERSIST);
+      }
+      return;
+    }
+    int err = n < 0 ? errno : 0;
+    auto callback = callback_;
+    uint64_t bytesWritten = bytesWritten_;
+    finishWrite();
+    callback->writeError(bytesWritten, TTransportException(
+        TTransportException::INTERNAL_ERROR, "sendmsg() failed", err));
+    return;
+  }
+  auto callback = callback_;
+  finishWrite();
+  // may delete this
+  callback->writeSuccess();
+#else
+  auto callback = callback_;
+  finishWrite();
+  callback->writeError(0, TTransportException(
+      TTransportException::INTERNAL_ERROR, "no MSG_ZEROCOPY"));
+#endif
+}
+
+void ZeroCopyWriter::finishWrite() {
+  unregisterHandler();
+  callback_ = nullptr;
+  if (numZeroCopySends_ > 0) {
+    pinnedBytes_ += length_;
+    pinned_.emplace_back(nextId_ - 1, std::move(buf_), length_);
+  } else {
+    buf_.reset();
+  }
+}
+
+void ZeroCopyWriter::readCompletions() {
+#ifdef PROXYGEN_HAVE_ZEROCOPY
+  if (pinned_.empty()) {
+    return;
+  }
+  char control[128];
+  while (true) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        VLOG(4) << "failed to read the error queue of fd=" << fd_ << ": "
+                << strerror(errno);
+      }
+      return;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if ((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) &&
+          (cmsg->cmsg_level != SOL_IPV6 || cmsg->cmsg_type != IPV6_RECVERR)) {
+        continue;
+      }
+      auto err = reinterpret_cast<const struct sock_extended_err*>(
+        CMSG_DATA(cmsg));
+      if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+        // the sends from ee_info to ee_data are complete, in order with TCP
+        release(err->ee_data);
+      }
+    }
+  }
+#endif
+}
+
+void ZeroCopyWriter::release(uint32_t lastId) {
+  // the IDs wrap at 4G sends
+  while (!pinned_.empty() && int32_t(pinned_.front().lastId - lastId) <= 0) {
+    pinnedBytes_ -= pinned_.front().length;
+    pinned_.pop_front();
+  }
+}
+
+}
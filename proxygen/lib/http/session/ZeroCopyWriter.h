@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventHandler.h>
+#include <thrift/lib/cpp/async/TAsyncTransport.h>
+
+namespace proxygen {
+
+/**
+ * Writes chains to a socket with MSG_ZEROCOPY, so that the kernel sends
+ * the bytes from the IOBufs instead of copying them. The write succeeds
+ * once the kernel took all the bytes, as with TAsyncSocket::writeChain(),
+ * but the kernel keeps reading the IOBufs until the peer acks them. So the
+ * writer keeps them until their completion notifications are read from
+ * the error queue of the socket, which readCompletions() does.
+ *
+ * The socket must have no other write in progress while a chain is
+ * written, and nothing else may read its error queue.
+ */
+class ZeroCopyWriter : private folly::EventHandler {
+ public:
+  // bytes the kernel may hold at once before writes fall back to copies
+  static const uint64_t kDefaultMaxPinnedBytes = 4 * 1024 * 1024;
+
+  ZeroCopyWriter(folly::EventBase* eventBase, int fd);
+  ~ZeroCopyWriter() override;
+
+  /**
+   * Turn on SO_ZEROCOPY on the socket
+   *
+   * @return false if the kernel doesn't support it
+   */
+  static bool enable(int fd);
+
+  /**
+   * Start writing chain. The callback gets the outcome, possibly before
+   * writeChain() returns. Only CORK is used from flags.
+   */
+  void writeChain(
+    apache::thrift::async::TAsyncTransport::WriteCallback* callback,
+    std::unique_ptr<folly::IOBuf> chain,
+    apache::thrift::async::WriteFlags flags);
+
+  /**
+   * Fail the write in progress, if any. The buffers the kernel got stay
+   * pinned.
+   */
+  void cancel();
+
+  bool isWriting() const {
+    return callback_ != nullptr;
+  }
+
+  /**
+   * Release the buffers the kernel is done with
+   */
+  void readCompletions();
+
+  /**
+   * @return true if a new write should be zero copy, false if the kernel
+   * holds too many bytes already
+   */
+  bool canWrite() {
+    readCompletions();
+    return pinnedBytes_ < maxPinnedBytes_;
+  }
+
+  void setMaxPinnedBytes(uint64_t maxPinnedBytes) {
+    maxPinnedBytes_ = maxPinnedBytes;
+  }
+
+  uint64_t getPinnedBytes() const {
+    return pinnedBytes_;
+  }
+
+ private:
+  struct PinnedBuffer {
+    PinnedBuffer(uint32_t id, std::unique_ptr<folly::IOBuf> b, uint64_t len):
+        lastId(id), buf(std::move(b)), length(len) {}
+
+    // notification ID of the last zero copy send of the chain
+    uint32_t lastId;
+    std::unique_ptr<folly::IOBuf> buf;
+    uint64_t length;
+  };
+
+  void handlerReady(uint16_t events) noexcept override;
+
+  void writeMore();
+
+  /**
+   * Done with the current chain, keep it until the kernel is done too
+   */
+  void finishWrite();
+
+  /**
+   * Release the buffers up to notification ID lastId
+   */
+  void release(uint32_t lastId);
+
+  int fd_;
+  apache::thrift::async::TAsyncTransport::WriteCallback* callback_{nullptr};
+  std::unique_ptr<folly::IOBuf> buf_;
+  uint64_t length_{0};
+  uint64_t bytesWritten_{0};
+  bool cork_{false};
+  // zero copy sends of the current chain, the kernel copies some of them
+  uint32_t numZeroCopySends_{0};
+  // the kernel numbers the zero copy sends of the socket from 0
+  uint32_t nextId_{0};
+  std::deque<PinnedBuffer> pinned_;
+  uint64_t pinnedBytes_{0};
+  uint64_t maxPinnedBytes_{kDefaultMaxPinnedBytes};
+};
+
+}
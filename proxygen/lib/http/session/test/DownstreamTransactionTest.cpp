@@ -11,6 +11,7 @@
 #include <proxygen/lib/http/codec/SPDYConstants.h>
 #include <proxygen/lib/http/codec/test/MockHTTPCodec.h>
 #include <proxygen/lib/http/codec/test/TestUtils.h>
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
 #include <proxygen/lib/http/session/test/HTTPSessionMocks.h>
 #include <proxygen/lib/http/session/test/HTTPTransactionMocks.h>
 #include <proxygen/lib/test/TestAsyncTransport.h>
@@ -85,7 +86,7 @@ class DownstreamTransactionTest : public testing::Test {
     new AsyncTimeoutSet(&eventBase_, std::chrono::milliseconds(500))};
   MockHTTPTransactionTransport transport_;
   StrictMock<MockHTTPHandler> handler_;
-  HTTPTransaction::PriorityQueue txnEgressQueue_;
+  RoundRobinEgressQueue txnEgressQueue_;
   uint32_t received_{0};
   uint32_t sent_{0};
 };
@@ -188,6 +189,87 @@ TEST_F(DownstreamTransactionTest, window_decrease) {
   eventBase_.loop();
 }
 
+/**
+ * Testing that a sized window doubles for a handler that keeps up, with
+ * the growth credited in the window update
+ */
+TEST_F(DownstreamTransactionTest, window_sizing_grows) {
+  HTTPTransaction txn(
+    TransportDirection::DOWNSTREAM,
+    HTTPCodec::StreamID(1), 1, transport_,
+    txnEgressQueue_, transactionTimeouts_.get(),
+    nullptr,
+    true, // flow control enabled
+    1000,
+    spdy::kInitialWindow);
+  txn.setReceiveWindowSizing(500, 4000);
+
+  EXPECT_CALL(transport_, describe(_))
+    .WillRepeatedly(Return());
+  EXPECT_CALL(handler_, setTransaction(&txn));
+  EXPECT_CALL(handler_, onHeadersComplete(_));
+  EXPECT_CALL(handler_, onBody(_))
+    .Times(2);
+  {
+    InSequence enforceOrder;
+    EXPECT_CALL(transport_, sendWindowUpdate(&txn, 500));
+    EXPECT_CALL(transport_, sendWindowUpdate(&txn, 500 + 1000));
+  }
+  EXPECT_CALL(transport_, sendAbort(&txn, _));
+  EXPECT_CALL(handler_, detachTransaction());
+  EXPECT_CALL(transport_, detach(&txn));
+
+  txn.setHandler(&handler_);
+  txn.onIngressHeadersComplete(makePostRequest());
+  txn.onIngressBody(makeBuf(500));
+  txn.onIngressBody(makeBuf(500));
+  EXPECT_EQ(txn.getReceiveWindow().getCapacity(), 2000);
+  txn.sendAbort();
+}
+
+/**
+ * Testing that a sized window halves for a handler that keeps pausing,
+ * by acking less
+ */
+TEST_F(DownstreamTransactionTest, window_sizing_shrinks) {
+  HTTPTransaction txn(
+    TransportDirection::DOWNSTREAM,
+    HTTPCodec::StreamID(1), 1, transport_,
+    txnEgressQueue_, transactionTimeouts_.get(),
+    nullptr,
+    true, // flow control enabled
+    1000,
+    spdy::kInitialWindow);
+  txn.setReceiveWindowSizing(250, 4000);
+
+  EXPECT_CALL(transport_, describe(_))
+    .WillRepeatedly(Return());
+  EXPECT_CALL(handler_, setTransaction(&txn));
+  EXPECT_CALL(handler_, onHeadersComplete(_));
+  EXPECT_CALL(transport_, pauseIngress(&txn))
+    .Times(2);
+  EXPECT_CALL(transport_, resumeIngress(&txn))
+    .Times(2);
+  EXPECT_CALL(handler_, onBody(_))
+    .Times(2);
+  // the first 500 bytes pay for the shrink, and aren't acked
+  EXPECT_CALL(transport_, sendWindowUpdate(&txn, 250));
+  EXPECT_CALL(transport_, sendAbort(&txn, _));
+  EXPECT_CALL(handler_, detachTransaction());
+  EXPECT_CALL(transport_, detach(&txn));
+
+  txn.setHandler(&handler_);
+  txn.onIngressHeadersComplete(makePostRequest());
+  for (int i = 0; i < 2; i++) {
+    txn.pauseIngress();
+    txn.resumeIngress();
+  }
+  txn.onIngressBody(makeBuf(500));
+  EXPECT_EQ(txn.getReceiveWindow().getCapacity(), 500);
+  txn.onIngressBody(makeBuf(250));
+  txn.sendAbort();
+}
+
 TEST_F(DownstreamTransactionTest, parse_error_cbs) {
   // Test where the transaction gets on parse error and then a body
   // callback. This is possible because codecs are stateless between
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/EgressFlusher.h>
+#include <vector>
+
+using namespace proxygen;
+
+namespace {
+
+/**
+ * Writes up to writeSize bytes of its egress per turn, and gets back in
+ * line while it has more
+ */
+class TestClient: public EgressFlusher::Client {
+ public:
+  TestClient(EgressFlusher* flusher, int id, std::vector<int>* turns,
+             uint64_t egress, uint64_t writeSize):
+      flusher_(flusher), id_(id), turns_(turns), egress_(egress),
+      writeSize_(writeSize) {}
+
+  uint64_t flushEgress(uint64_t bytesAllowed) noexcept override {
+    turns_->push_back(id_);
+    uint64_t written = std::min(egress_, writeSize_);
+    egress_ -= written;
+    if (egress_ > 0) {
+      flusher_->schedule(this);
+    }
+    return written;
+  }
+
+  uint64_t getEgress() const {
+    return egress_;
+  }
+
+ private:
+  EgressFlusher* flusher_;
+  int id_;
+  std::vector<int>* turns_;
+  uint64_t egress_;
+  uint64_t writeSize_;
+};
+
+}
+
+TEST(EgressFlusherTest, OneCallbackPerLoop) {
+  folly::EventBase evb;
+  auto flusher = EgressFlusher::get(&evb);
+  EXPECT_EQ(flusher, EgressFlusher::get(&evb));
+  std::vector<int> turns;
+  TestClient a(flusher.get(), 1, &turns, 100, 100);
+  TestClient b(flusher.get(), 2, &turns, 100, 100);
+  flusher->schedule(&a);
+  flusher->schedule(&b);
+  // keeps its place
+  flusher->schedule(&a);
+  EXPECT_TRUE(a.isFlushScheduled());
+  evb.loopOnce();
+  EXPECT_EQ(std::vector<int>({1, 2}), turns);
+  EXPECT_EQ(1, flusher->getNumFlushes());
+  EXPECT_FALSE(a.isFlushScheduled());
+}
+
+TEST(EgressFlusherTest, RoundRobin) {
+  folly::EventBase evb;
+  EgressFlusher flusher(&evb);
+  std::vector<int> turns;
+  TestClient a(&flusher, 1, &turns, 300, 100);
+  TestClient b(&flusher, 2, &turns, 100, 100);
+  flusher.schedule(&a);
+  flusher.schedule(&b);
+  evb.loop();
+  // a gets back in line behind b
+  EXPECT_EQ(std::vector<int>({1, 2, 1, 1}), turns);
+  EXPECT_EQ(3, flusher.getNumFlushes());
+}
+
+TEST(EgressFlusherTest, Budget) {
+  folly::EventBase evb;
+  EgressFlusher flusher(&evb);
+  flusher.setBudget(150);
+  std::vector<int> turns;
+  TestClient a(&flusher, 1, &turns, 100, 100);
+  TestClient b(&flusher, 2, &turns, 100, 100);
+  TestClient c(&flusher, 3, &turns, 100, 100);
+  flusher.schedule(&a);
+  flusher.schedule(&b);
+  flusher.schedule(&c);
+  evb.loopOnce();
+  // b crosses the budget, c waits for the next iteration
+  EXPECT_EQ(std::vector<int>({1, 2}), turns);
+  EXPECT_TRUE(c.isFlushScheduled());
+  evb.loopOnce();
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), turns);
+  EXPECT_EQ(0, c.getEgress());
+}
+
+TEST(EgressFlusherTest, Cancel) {
+  folly::EventBase evb;
+  EgressFlusher flusher(&evb);
+  std::vector<int> turns;
+  TestClient a(&flusher, 1, &turns, 100, 100);
+  {
+    TestClient b(&flusher, 2, &turns, 100, 100);
+    flusher.schedule(&b);
+    flusher.schedule(&a);
+    flusher.cancel(&b);
+  }
+  evb.loop();
+  EXPECT_EQ(std::vector<int>({1}), turns);
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <map>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/session/DependencyTreeEgressQueue.h>
+#include <proxygen/lib/http/session/RoundRobinEgressQueue.h>
+
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+// The queues never look at the transactions, so the tests use fake ones
+HTTPTransaction* fakeTxn(uint32_t i) {
+  static char txns[64];
+  return reinterpret_cast<HTTPTransaction*>(&txns[i]);
+}
+
+// Serve the top transaction with bytes
+HTTPTransaction* serve(EgressQueue& queue,
+                       map<HTTPTransaction*, EgressQueue::Handle>& handles,
+                       size_t bytes) {
+  HTTPTransaction* txn = queue.top();
+  queue.onSent(handles[txn], bytes);
+  return txn;
+}
+
+}
+
+TEST(EgressQueueTest, Levels) {
+  EXPECT_EQ(0, EgressQueue::toLevel(0));
+  EXPECT_EQ(3, EgressQueue::toLevel(3));
+  EXPECT_EQ(7, EgressQueue::toLevel(-1));
+  EXPECT_EQ(6, EgressQueue::toLevel(-2));
+  EXPECT_EQ(7, EgressQueue::toLevel(20));
+  EXPECT_EQ(0, EgressQueue::toLevel(-20));
+}
+
+TEST(EgressQueueTest, RoundRobin) {
+  RoundRobinEgressQueue queue;
+  map<HTTPTransaction*, EgressQueue::Handle> handles;
+  for (uint32_t i = 1; i <= 3; i++) {
+    handles[fakeTxn(i)] = queue.addTransaction(i, 3, fakeTxn(i));
+    queue.signalPendingEgress(handles[fakeTxn(i)]);
+  }
+  EXPECT_EQ(fakeTxn(1), serve(queue, handles, 100));
+  EXPECT_EQ(fakeTxn(2), serve(queue, handles, 100));
+
+  // the heaviest weights get the highest priority
+  queue.updatePriority(handles[fakeTxn(3)], HTTPPriority(0, false, 256));
+  EXPECT_EQ(fakeTxn(3), serve(queue, handles, 100));
+  EXPECT_EQ(fakeTxn(3), serve(queue, handles, 100));
+  queue.clearPendingEgress(handles[fakeTxn(3)]);
+  EXPECT_FALSE(handles[fakeTxn(3)]->isEnqueued());
+  EXPECT_EQ(fakeTxn(1), serve(queue, handles, 100));
+
+  for (auto& handle: handles) {
+    queue.removeTransaction(handle.second);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+class DependencyTreeEgressQueueTest : public testing::Test {
+ protected:
+  void TearDown() override {
+    for (auto& handle: handles_) {
+      queue_.removeTransaction(handle.second);
+    }
+    EXPECT_TRUE(queue_.empty());
+  }
+
+  EgressQueue::Handle add(uint32_t id, int8_t priority = 0) {
+    auto handle = queue_.addTransaction(id, priority, fakeTxn(id));
+    handles_[fakeTxn(id)] = handle;
+    return handle;
+  }
+
+  EgressQueue::Handle handle(uint32_t id) {
+    return handles_[fakeTxn(id)];
+  }
+
+  HTTPTransaction* serve(size_t bytes = 1000) {
+    return ::serve(queue_, handles_, bytes);
+  }
+
+  DependencyTreeEgressQueue queue_;
+  map<HTTPTransaction*, EgressQueue::Handle> handles_;
+};
+
+TEST_F(DependencyTreeEgressQueueTest, Weights) {
+  // SPDY priority 0 weighs 256, priority 7 weighs 32
+  queue_.signalPendingEgress(add(1, 0));
+  queue_.signalPendingEgress(add(3, 7));
+  EXPECT_FALSE(queue_.empty());
+
+  map<HTTPTransaction*, size_t> sent;
+  for (int i = 0; i < 900; i++) {
+    sent[serve()] += 1000;
+  }
+  EXPECT_EQ(800000, sent[fakeTxn(1)]);
+  EXPECT_EQ(100000, sent[fakeTxn(3)]);
+}
+
+TEST_F(DependencyTreeEgressQueueTest, ParentFirst) {
+  add(1);
+  add(3);
+  queue_.updatePriority(handle(3), HTTPPriority(1, false, 16));
+  EXPECT_EQ(1, queue_.getDependency(handle(3)));
+
+  queue_.signalPendingEgress(handle(3));
+  EXPECT_EQ(fakeTxn(3), serve());
+  queue_.signalPendingEgress(handle(1));
+  EXPECT_EQ(fakeTxn(1), serve());
+  EXPECT_EQ(fakeTxn(1), serve());
+  queue_.clearPendingEgress(handle(1));
+  EXPECT_EQ(fakeTxn(3), serve());
+}
+
+TEST_F(DependencyTreeEgressQueueTest, Exclusive) {
+  add(1);
+  add(3);
+  add(5);
+  queue_.signalPendingEgress(handle(1));
+  queue_.signalPendingEgress(handle(3));
+  queue_.updatePriority(handle(5), HTTPPriority(0, true, 16));
+  EXPECT_EQ(5, queue_.getDependency(handle(1)));
+  EXPECT_EQ(5, queue_.getDependency(handle(3)));
+  EXPECT_EQ(0, queue_.getDependency(handle(5)));
+
+  EXPECT_EQ(fakeTxn(1), serve());
+  EXPECT_EQ(fakeTxn(3), serve());
+  queue_.signalPendingEgress(handle(5));
+  EXPECT_EQ(fakeTxn(5), serve());
+}
+
+TEST_F(DependencyTreeEgressQueueTest, DependOnDependent) {
+  add(1);
+  add(3);
+  queue_.updatePriority(handle(3), HTTPPriority(1, false, 16));
+  // 1 now depends on 3, which takes the place of 1 first
+  queue_.updatePriority(handle(1), HTTPPriority(3, false, 16));
+  EXPECT_EQ(0, queue_.getDependency(handle(3)));
+  EXPECT_EQ(3, queue_.getDependency(handle(1)));
+
+  // a missing stream, or the stream itself, means the root
+  queue_.updatePriority(handle(1), HTTPPriority(7, false, 16));
+  EXPECT_EQ(0, queue_.getDependency(handle(1)));
+  queue_.updatePriority(handle(1), HTTPPriority(1, false, 16));
+  EXPECT_EQ(0, queue_.getDependency(handle(1)));
+}
+
+TEST_F(DependencyTreeEgressQueueTest, RemoveParent) {
+  add(1);
+  add(3);
+  queue_.updatePriority(handle(3), HTTPPriority(1, false, 16));
+  queue_.signalPendingEgress(handle(1));
+  queue_.signalPendingEgress(handle(3));
+
+  queue_.removeTransaction(handle(1));
+  handles_.erase(fakeTxn(1));
+  EXPECT_EQ(0, queue_.getDependency(handle(3)));
+  EXPECT_EQ(fakeTxn(3), serve());
+}
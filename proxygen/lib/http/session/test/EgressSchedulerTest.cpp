@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <map>
+#include <proxygen/lib/http/session/EgressScheduler.h>
+
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+struct Stream {
+  explicit Stream(uint8_t l) : level(l), handle(this) {}
+
+  uint8_t level;
+  EgressScheduler<Stream>::Handle handle;
+};
+
+typedef EgressScheduler<Stream> Scheduler;
+
+// Serve the top stream with bytes, and requeue it
+Stream* serve(Scheduler& scheduler, size_t bytes) {
+  Stream* stream = scheduler.top();
+  scheduler.onSent(stream->handle, bytes);
+  return stream;
+}
+
+}
+
+TEST(EgressSchedulerTest, StrictPriority) {
+  Scheduler scheduler;
+  EXPECT_TRUE(scheduler.empty());
+  EXPECT_EQ(nullptr, scheduler.top());
+
+  Stream low(5);
+  Stream high(1);
+  scheduler.push(low.handle, low.level);
+  scheduler.push(high.handle, high.level);
+  EXPECT_EQ(2, scheduler.size());
+  EXPECT_TRUE(high.handle.isEnqueued());
+  EXPECT_EQ(&high, serve(scheduler, 100));
+  EXPECT_EQ(&high, serve(scheduler, 100));
+
+  scheduler.erase(high.handle);
+  EXPECT_FALSE(high.handle.isEnqueued());
+  EXPECT_EQ(&low, serve(scheduler, 100));
+  scheduler.erase(low.handle);
+  EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(EgressSchedulerTest, RoundRobin) {
+  Scheduler scheduler;
+  Stream a(3);
+  Stream b(3);
+  Stream c(3);
+  scheduler.push(a.handle, a.level);
+  scheduler.push(b.handle, b.level);
+  scheduler.push(c.handle, c.level);
+
+  EXPECT_EQ(&a, serve(scheduler, 10));
+  EXPECT_EQ(&b, serve(scheduler, 10));
+  EXPECT_EQ(&c, serve(scheduler, 10));
+  EXPECT_EQ(&a, serve(scheduler, 10));
+
+  // a stream that finishes while it is served leaves the rotation
+  Stream* top = scheduler.top();
+  EXPECT_EQ(&b, top);
+  scheduler.erase(top->handle);
+  scheduler.onSent(top->handle, 10);
+  EXPECT_EQ(&c, serve(scheduler, 10));
+  EXPECT_EQ(&a, serve(scheduler, 10));
+
+  scheduler.erase(a.handle);
+  scheduler.erase(c.handle);
+}
+
+TEST(EgressSchedulerTest, Weighted) {
+  Scheduler scheduler;
+  scheduler.setWeights({3, 1, 1, 1, 1, 1, 1, 1});
+  Stream high(0);
+  Stream low(7);
+  scheduler.push(high.handle, high.level);
+  scheduler.push(low.handle, low.level);
+
+  map<Stream*, size_t> sent;
+  for (int i = 0; i < 400; i++) {
+    sent[serve(scheduler, 512)] += 512;
+  }
+  // both levels get served, in proportion to their weights
+  EXPECT_EQ(3 * sent[&low], sent[&high]);
+
+  // back to strict priority
+  scheduler.setWeights({});
+  EXPECT_EQ(&high, serve(scheduler, 512));
+  EXPECT_EQ(&high, serve(scheduler, 512));
+
+  scheduler.erase(high.handle);
+  scheduler.erase(low.handle);
+}
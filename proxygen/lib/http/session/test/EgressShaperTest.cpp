@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/EgressShaper.h>
+
+using namespace proxygen;
+
+using std::chrono::milliseconds;
+
+namespace {
+
+class TestClient: public EgressShaper::Client {
+ public:
+  void onEgressAllowed() noexcept override {
+    calls++;
+  }
+
+  uint32_t calls{0};
+};
+
+// 1MB/s for the thread: interactive traffic is assured 800KB/s, bulk
+// 100KB/s and may borrow up to 500KB/s
+std::shared_ptr<EgressShaperConfig> makeConfig() {
+  auto config = std::make_shared<EgressShaperConfig>();
+  config->rate = 1000000;
+  config->burst = milliseconds(10);
+  config->classes = {EgressShaperConfig::Class(800000),
+                     EgressShaperConfig::Class(100000, 500000)};
+  config->priorityClasses[7] = 1;
+  config->pathClasses = {{"/downloads/", 1}};
+  return config;
+}
+
+}
+
+TEST(EgressShaperTest, Classify) {
+  folly::EventBase evb;
+  EgressShaper shaper(&evb, makeConfig());
+  EXPECT_EQ(0, shaper.getClass(-1, 0));
+  EXPECT_EQ(1, shaper.getClass(-1, 7));
+  EXPECT_EQ(0, shaper.getClass(0, 7));
+  EXPECT_EQ(1, makeConfig()->getPathClass("/downloads/big.iso"));
+  EXPECT_EQ(-1, makeConfig()->getPathClass("/api"));
+}
+
+TEST(EgressShaperTest, BulkBorrowsWithinCeiling) {
+  folly::EventBase evb;
+  auto start = getCurrentTime();
+  EgressShaper shaper(&evb, makeConfig(), start);
+  // the buckets start full: 10ms at the ceiling of bulk
+  EXPECT_EQ(5000, shaper.getAllowed(1, start));
+  shaper.consume(1, 5000);
+  EXPECT_EQ(0, shaper.getAllowed(1, start));
+  // interactive traffic still has the rest of the thread's bucket
+  EXPECT_EQ(8000, shaper.getAllowed(0, start));
+  // 2ms refill 1000 bytes of the bulk ceiling, granted as a packet
+  EXPECT_EQ(1400, shaper.getAllowed(1, start + milliseconds(2)));
+}
+
+TEST(EgressShaperTest, InteractiveKeepsItsShare) {
+  folly::EventBase evb;
+  auto start = getCurrentTime();
+  EgressShaper shaper(&evb, makeConfig(), start);
+  // interactive traffic uses up the thread's bucket
+  shaper.consume(0, 10000);
+  EXPECT_EQ(0, shaper.getAllowed(0, start));
+  // bulk has nothing to borrow but what it is assured
+  EXPECT_EQ(1400, shaper.getAllowed(1, start));
+  shaper.consume(1, 1400);
+  EXPECT_EQ(0, shaper.getAllowed(1, start));
+  // interactive refills its own bucket faster than the thread's debt
+  EXPECT_LT(0, shaper.getAllowed(0, start + milliseconds(5)));
+}
+
+TEST(EgressShaperTest, WakesWaitingClients) {
+  folly::EventBase evb;
+  auto shaper = EgressShaper::get(&evb, makeConfig());
+  EXPECT_EQ(shaper, EgressShaper::get(&evb, makeConfig()));
+  TestClient a;
+  TestClient b;
+  shaper->wait(&a);
+  shaper->wait(&b);
+  // keeps its place
+  shaper->wait(&a);
+  EXPECT_TRUE(a.isEgressShaped());
+  shaper->cancel(&b);
+  evb.loop();
+  EXPECT_EQ(1, a.calls);
+  EXPECT_EQ(0, b.calls);
+  EXPECT_FALSE(a.isEgressShaped());
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/HTTPDirectResponseHandler.h>
+#include <proxygen/lib/http/session/HTTPErrorPage.h>
+
+using namespace proxygen;
+
+using folly::IOBuf;
+
+namespace {
+
+// A page that says which request it is for
+class DynamicErrorPage : public HTTPErrorPage {
+ public:
+  Page generate(uint64_t requestID, unsigned httpStatusCode,
+                const std::string& reason, std::unique_ptr<IOBuf> body,
+                const std::string& detailReason) const override {
+    return Page("text/plain", IOBuf::copyBuffer(
+                  folly::to<std::string>(requestID)));
+  }
+};
+
+}
+
+TEST(HTTPDirectResponseHandler, CansOncePerThread) {
+  auto overloaded = HTTPDirectResponseHandler::getCannedResponse(
+    503, "Service Unavailable", nullptr);
+  ASSERT_NE(nullptr, overloaded);
+  EXPECT_EQ(503, overloaded->getMessage().getStatusCode());
+  EXPECT_EQ(nullptr, overloaded->getBody());
+  EXPECT_EQ(overloaded, HTTPDirectResponseHandler::getCannedResponse(
+              503, "Service Unavailable", nullptr));
+
+  // each status, message and page has its own
+  EXPECT_NE(overloaded, HTTPDirectResponseHandler::getCannedResponse(
+              504, "Gateway Timeout", nullptr));
+  EXPECT_NE(overloaded, HTTPDirectResponseHandler::getCannedResponse(
+              503, "Overloaded", nullptr));
+
+  HTTPStaticErrorPage page(IOBuf::copyBuffer("<h1>Bad Request</h1>"));
+  auto badRequest = HTTPDirectResponseHandler::getCannedResponse(
+    400, "Bad Request", &page);
+  ASSERT_NE(nullptr, badRequest);
+  EXPECT_EQ("<h1>Bad Request</h1>",
+            badRequest->getBody()->clone()->moveToFbString().toStdString());
+  EXPECT_EQ("text/html; charset=utf-8",
+            badRequest->getMessage().getCachedHeaders()->getHeaders()
+              .getSingleOrEmpty(HTTP_HEADER_CONTENT_TYPE));
+  EXPECT_EQ(badRequest, HTTPDirectResponseHandler::getCannedResponse(
+              400, "Bad Request", &page));
+
+  // not the one of a page that was at the same address before
+  HTTPStaticErrorPage other(IOBuf::copyBuffer("other"));
+  EXPECT_NE(page.getId(), other.getId());
+  EXPECT_NE(badRequest, HTTPDirectResponseHandler::getCannedResponse(
+              400, "Bad Request", &other));
+}
+
+TEST(HTTPDirectResponseHandler, DoesNotCanEverything) {
+  DynamicErrorPage page;
+  EXPECT_EQ(nullptr, HTTPDirectResponseHandler::getCannedResponse(
+              500, "Internal Server Error", &page));
+  EXPECT_EQ(nullptr, HTTPDirectResponseHandler::getCannedResponse(
+              304, "Not Modified", nullptr));
+  EXPECT_EQ(nullptr, HTTPDirectResponseHandler::getCannedResponse(
+              100, "Continue", nullptr));
+}
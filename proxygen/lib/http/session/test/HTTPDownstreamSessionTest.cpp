@@ -196,6 +196,81 @@ TEST_F(HTTPDownstreamSessionTest, http_1_0_no_headers_eof) {
   eventBase_.loop();
 }
 
+TEST_F(HTTPDownstreamSessionTest, transaction_timings) {
+  NiceMock<MockHTTPSessionInfoCallback> infoCallback;
+  httpSession_->setInfoCallback(&infoCallback);
+  MockHTTPHandler handler;
+
+  EXPECT_CALL(mockController_, getRequestHandler(_, _))
+    .WillOnce(Return(&handler));
+  EXPECT_CALL(handler, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler.txn_));
+  EXPECT_CALL(handler, onHeadersComplete(_));
+  EXPECT_CALL(handler, onEOM())
+    .WillOnce(InvokeWithoutArgs([&handler] {
+          handler.sendReplyWithBody(200, 100);
+        }));
+  EXPECT_CALL(handler, detachTransaction());
+  EXPECT_CALL(infoCallback, onTransactionTimings(_, _))
+    .WillOnce(Invoke([] (const HTTPSession&,
+                         const HTTPTransactionTimings& timings) {
+          typedef HTTPTransactionTimings T;
+          EXPECT_TRUE(T::isSet(timings.firstByteRead));
+          EXPECT_TRUE(T::isSet(timings.handlerDispatched));
+          EXPECT_TRUE(T::isSet(timings.lastByteWritten));
+          EXPECT_LE(timings.firstByteRead, timings.headersParsed);
+          EXPECT_LE(timings.headersParsed, timings.handlerDispatched);
+          EXPECT_LE(timings.firstByteWritten, timings.lastByteWritten);
+        }));
+  EXPECT_CALL(mockController_, detachSession(_));
+
+  transport_->addReadEvent("GET / HTTP/1.1\r\n"
+                           "\r\n", std::chrono::milliseconds(0));
+  transport_->addReadEOF(std::chrono::milliseconds(0));
+  transport_->startReadEvents();
+  eventBase_.loop();
+}
+
+TEST_F(HTTPDownstreamSessionTest, slow_transaction_sample) {
+  auto sampler = std::make_shared<SlowTransactionSampler>(
+    std::chrono::milliseconds(20));
+  AsyncTimeoutSet::UniquePtr slowTimeouts(
+    new AsyncTimeoutSet(&eventBase_, sampler->getThreshold()));
+  httpSession_->setSlowTransactionSampler(sampler, slowTimeouts.get());
+  MockHTTPHandler handler;
+
+  EXPECT_CALL(mockController_, getRequestHandler(_, _))
+    .WillOnce(Return(&handler));
+  EXPECT_CALL(handler, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler.txn_));
+  EXPECT_CALL(handler, onHeadersComplete(_));
+  HTTPCodec::StreamID streamID = 0;
+  EXPECT_CALL(handler, onEOM())
+    .WillOnce(InvokeWithoutArgs([this, &handler, &streamID] {
+          streamID = handler.txn_->getID();
+          eventBase_.runAfterDelay([&handler] {
+              handler.sendReplyWithBody(200, 100);
+            }, 100);
+        }));
+  EXPECT_CALL(handler, detachTransaction());
+  EXPECT_CALL(mockController_, detachSession(_));
+
+  transport_->addReadEvent("GET / HTTP/1.1\r\n"
+                           "\r\n", std::chrono::milliseconds(0));
+  transport_->addReadEOF(std::chrono::milliseconds(200));
+  transport_->startReadEvents();
+  eventBase_.loop();
+
+  auto samples = sampler->getSamples();
+  ASSERT_EQ(1, samples.size());
+  EXPECT_EQ(1, samples[0]["transactions"].asInt());
+  const auto& txn = samples[0]["transaction"];
+  EXPECT_EQ(streamID, txn["stream_id"].asInt());
+  EXPECT_EQ("Start", txn["egress_state"].asString());
+  EXPECT_EQ("ReceivingDone", txn["ingress_state"].asString());
+  EXPECT_LE(20000, txn["age_us"].asInt());
+}
+
 TEST_F(HTTPDownstreamSessionTest, single_bytes) {
   MockHTTPHandler* handler = new MockHTTPHandler();
 
@@ -894,6 +969,139 @@ TEST_F(HTTPDownstreamSessionTest, write_timeout_pipeline) {
   eventBase_.loop();
 }
 
+// The second request is answered first, its response waits for the first
+TEST(HTTPDownstreamTest, concurrent_pipeline) {
+  EventBase evb;
+  auto transport = new TestAsyncTransport(&evb);
+  auto transactionTimeouts = makeTimeoutSet(&evb);
+  NiceMock<MockController> mockController;
+  auto codec = folly::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM);
+  codec->setPipelining(true);
+  auto session = new HTTPDownstreamSession(
+    transactionTimeouts.get(),
+    TAsyncTransport::UniquePtr(transport),
+    localAddr, peerAddr,
+    &mockController, std::move(codec),
+    mockTransportInfo);
+  session->setPipelining(4, 1 << 20);
+  session->startNow();
+
+  NiceMock<MockHTTPHandler> handler1;
+  NiceMock<MockHTTPHandler> handler2;
+  bool replied2 = false;
+  EXPECT_CALL(mockController, getRequestHandler(_, _))
+    .WillOnce(Return(&handler1))
+    .WillOnce(Return(&handler2));
+  EXPECT_CALL(handler1, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler1.txn_));
+  EXPECT_CALL(handler2, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler2.txn_));
+  EXPECT_CALL(handler1, onEOM())
+    .WillOnce(InvokeWithoutArgs([&] {
+          evb.runAfterDelay([&] {
+              EXPECT_TRUE(replied2);
+              handler1.sendReplyWithBody(200, 50);
+            }, 50);
+        }));
+  EXPECT_CALL(handler2, onEOM())
+    .WillOnce(InvokeWithoutArgs([&] {
+          // the other handler is still working on the first request
+          handler2.sendReplyWithBody(200, 100);
+          replied2 = true;
+        }));
+  EXPECT_CALL(handler1, detachTransaction());
+  EXPECT_CALL(handler2, detachTransaction());
+
+  transport->addReadEvent("GET /1 HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                          "GET /2 HTTP/1.1\r\nHost: localhost\r\n\r\n",
+                          std::chrono::milliseconds(0));
+  transport->addReadEOF(std::chrono::milliseconds(0));
+  transport->startReadEvents();
+  // keeps the transport for the checks below
+  HTTPSession::DestructorGuard g(session);
+  evb.loop();
+
+  HTTP1xCodec clientCodec(TransportDirection::UPSTREAM);
+  NiceMock<MockHTTPCodecCallback> callbacks;
+  clientCodec.setCallback(&callbacks);
+  InSequence dummy;
+  EXPECT_CALL(callbacks, onHeadersComplete(1, _))
+    .WillOnce(Invoke([] (HTTPCodec::StreamID,
+                         std::shared_ptr<HTTPMessage> msg) {
+          EXPECT_EQ("50", msg->getHeaders().getSingleOrEmpty(
+                      HTTP_HEADER_CONTENT_LENGTH));
+        }));
+  EXPECT_CALL(callbacks, onMessageComplete(1, _));
+  EXPECT_CALL(callbacks, onHeadersComplete(2, _))
+    .WillOnce(Invoke([] (HTTPCodec::StreamID,
+                         std::shared_ptr<HTTPMessage> msg) {
+          EXPECT_EQ("100", msg->getHeaders().getSingleOrEmpty(
+                      HTTP_HEADER_CONTENT_LENGTH));
+        }));
+  EXPECT_CALL(callbacks, onMessageComplete(2, _));
+  for (auto event: *transport->getWriteEvents()) {
+    auto vec = event->getIoVec();
+    for (auto i = 0; i < event->getCount(); i++) {
+      clientCodec.onIngress(
+        *IOBuf::wrapBuffer(vec[i].iov_base, vec[i].iov_len));
+    }
+  }
+}
+
+// Over its ingress budget, the session parses the rest after the loop
+// callbacks scheduled meanwhile
+TEST(HTTPDownstreamTest, ingress_budget) {
+  EventBase evb;
+  auto transport = new TestAsyncTransport(&evb);
+  auto transactionTimeouts = makeTimeoutSet(&evb);
+  NiceMock<MockController> mockController;
+  auto codec = folly::make_unique<HTTP1xCodec>(TransportDirection::DOWNSTREAM);
+  codec->setPipelining(true);
+  auto session = new HTTPDownstreamSession(
+    transactionTimeouts.get(),
+    TAsyncTransport::UniquePtr(transport),
+    localAddr, peerAddr,
+    &mockController, std::move(codec),
+    mockTransportInfo);
+  session->setPipelining(4, 1 << 20);
+  const string request1("GET /1 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  session->setIngressBudget(request1.size());
+  session->startNow();
+
+  NiceMock<MockHTTPHandler> handler1;
+  NiceMock<MockHTTPHandler> handler2;
+  bool otherCallback = false;
+  EXPECT_CALL(mockController, getRequestHandler(_, _))
+    .WillOnce(Return(&handler1))
+    .WillOnce(Return(&handler2));
+  EXPECT_CALL(handler1, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler1.txn_));
+  EXPECT_CALL(handler2, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler2.txn_));
+  EXPECT_CALL(handler1, onEOM())
+    .WillOnce(InvokeWithoutArgs([&] {
+          evb.runInLoop([&] { otherCallback = true; });
+          handler1.sendReplyWithBody(200, 50);
+        }));
+  EXPECT_CALL(handler2, onHeadersComplete(_))
+    .WillOnce(InvokeWithoutArgs([&] {
+          EXPECT_TRUE(otherCallback);
+        }));
+  EXPECT_CALL(handler2, onEOM())
+    .WillOnce(InvokeWithoutArgs([&] {
+          handler2.sendReplyWithBody(200, 100);
+        }));
+  EXPECT_CALL(handler1, detachTransaction());
+  EXPECT_CALL(handler2, detachTransaction());
+
+  transport->addReadEvent(request1 +
+                          "GET /2 HTTP/1.1\r\nHost: localhost\r\n\r\n",
+                          std::chrono::milliseconds(0));
+  transport->addReadEOF(std::chrono::milliseconds(10));
+  transport->startReadEvents();
+  evb.loop();
+}
+
 TEST_F(HTTPDownstreamSessionTest, body_packetization) {
   IOBufQueue requests;
   MockHTTPHandler handler1;
@@ -220,6 +220,8 @@ class MockHTTPSessionInfoCallback: public HTTPSession::InfoCallback {
   MOCK_METHOD1(onPingReply, void(int64_t));
   MOCK_METHOD1(onSettingsOutgoingStreamsFull, void(const HTTPSession&));
   MOCK_METHOD1(onSettingsOutgoingStreamsNotFull, void(const HTTPSession&));
+  MOCK_METHOD2(onTransactionTimings, void(const HTTPSession&,
+                                          const HTTPTransactionTimings&));
 };
 
 }
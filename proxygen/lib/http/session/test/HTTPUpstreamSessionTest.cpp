@@ -12,6 +12,7 @@
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/TimeoutManager.h>
 #include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPSessionPool.h>
 #include <proxygen/lib/http/codec/test/MockHTTPCodec.h>
 #include <proxygen/lib/http/codec/test/TestUtils.h>
 #include <proxygen/lib/http/session/HTTPUpstreamSession.h>
@@ -373,6 +374,59 @@ TEST_F(HTTPUpstreamSessionTest, basic_request) {
   httpSession_->destroy();
 }
 
+TEST_F(HTTPUpstreamSessionTest, transport_calls) {
+  testBasicRequest();
+  // the whole response fits in the first read
+  EXPECT_EQ(httpSession_->getNumReads(), 1);
+  EXPECT_GE(httpSession_->getNumWrites(), 1);
+  testBasicRequest();
+  EXPECT_EQ(httpSession_->getNumReads(), 2);
+  httpSession_->destroy();
+}
+
+TEST_F(HTTPUpstreamSessionTest, session_pool) {
+  HTTPSessionPool pool(&eventBase_, transactionTimeouts_.get());
+  HTTPSessionPool::Key key(peerAddr_);
+  EXPECT_EQ(pool.getSession(key), nullptr);
+
+  pool.addSession(key, httpSession_);
+  EXPECT_EQ(pool.getNumIdleSessions(), 1);
+  EXPECT_EQ(pool.getSession(HTTPSessionPool::Key(localAddr_)), nullptr);
+  EXPECT_EQ(pool.getSession(key), httpSession_);
+  EXPECT_EQ(pool.getNumIdleSessions(), 0);
+
+  // back to idle once the response is in
+  testBasicRequest();
+  EXPECT_EQ(pool.getNumIdleSessions(), 1);
+  EXPECT_EQ(pool.getSession(key), httpSession_);
+  testBasicRequest();
+  EXPECT_EQ(pool.getNumSessions(), 1);
+  EXPECT_EQ(pool.getNumIdleSessions(), 1);
+}
+
+TEST_F(HTTPUpstreamSessionTest, session_pool_by_host) {
+  HTTPSessionPool pool(&eventBase_, transactionTimeouts_.get());
+  auto ctx = std::make_shared<folly::SSLContext>();
+  HTTPSessionPool::Key a(peerAddr_, ctx, "", "a.example.com");
+  pool.addSession(a, httpSession_);
+  EXPECT_EQ(pool.getSession(a), httpSession_);
+  testBasicRequest();
+  // an HTTP/1.1 session is never shared with other hosts
+  EXPECT_EQ(pool.getSession(
+      HTTPSessionPool::Key(peerAddr_, ctx, "", "b.example.com")), nullptr);
+  EXPECT_EQ(pool.getSession(HTTPSessionPool::Key(peerAddr_, ctx)), nullptr);
+  EXPECT_EQ(pool.getSession(a), httpSession_);
+  testBasicRequest();
+}
+
+TEST_F(HTTPUpstreamSessionTest, session_pool_evicts_idle) {
+  HTTPSessionPool pool(&eventBase_, transactionTimeouts_.get(), 0);
+  pool.addSession(HTTPSessionPool::Key(peerAddr_), httpSession_);
+  // there is no room for idle sessions
+  EXPECT_EQ(pool.getNumSessions(), 0);
+  EXPECT_FALSE(transportGood_);
+}
+
 TEST_F(HTTPUpstreamSessionTest, two_requests) {
   testBasicRequest();
   testBasicRequest();
@@ -0,0 +1,251 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/IoUringTransport.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace proxygen;
+
+using apache::thrift::async::TAsyncTransport;
+using apache::thrift::transport::TTransportException;
+
+namespace {
+
+class Reader: public TAsyncTransport::ReadCallback {
+ public:
+  void getReadBuffer(void** buf, size_t* len) override {
+    *buf = buf_;
+    *len = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    data.append(buf_, len);
+    if (onData) {
+      onData();
+    }
+  }
+  void readEOF() noexcept override {
+    eof = true;
+  }
+  void readError(const TTransportException& ex) noexcept override {
+    error = true;
+  }
+
+  std::string data;
+  bool eof{false};
+  bool error{false};
+  std::function<void()> onData;
+
+ private:
+  // small, so that a receive takes several reads
+  char buf_[7];
+};
+
+class Writer: public TAsyncTransport::WriteCallback {
+ public:
+  void writeSuccess() noexcept override {
+    successes++;
+  }
+  void writeError(size_t bytesWritten,
+                  const TTransportException& ex) noexcept override {
+    errors++;
+  }
+
+  int successes{0};
+  int errors{0};
+};
+
+}
+
+class IoUringTransportTest : public testing::Test {
+ public:
+  void SetUp() override {
+    backend_ = IoUringBackend::get(&evb_, IoUringBackend::Options());
+    if (!backend_) {
+      return;
+    }
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds_));
+    transport_ = IoUringTransport::make(backend_, fds_[0]);
+    ASSERT_TRUE(transport_ != nullptr);
+  }
+
+  void TearDown() override {
+    transport_.reset();
+    if (backend_) {
+      // for the cancellations
+      for (int i = 0; i < 10; i++) {
+        evb_.loopOnce();
+      }
+      close(fds_[1]);
+    }
+  }
+
+  // loop until done() or a second passed
+  template <class Predicate>
+  bool loopUntil(Predicate done) {
+    for (int i = 0; i < 1000 && !done(); i++) {
+      evb_.loopOnce();
+    }
+    return done();
+  }
+
+  std::string readPeer(size_t len) {
+    std::string data;
+    while (data.size() < len) {
+      char buf[64];
+      ssize_t n = read(fds_[1], buf, std::min(sizeof(buf), len - data.size()));
+      if (n <= 0) {
+        break;
+      }
+      data.append(buf, n);
+    }
+    return data;
+  }
+
+ protected:
+  folly::EventBase evb_;
+  std::shared_ptr<IoUringBackend> backend_;
+  int fds_[2];
+  Reader reader_;
+  Writer writer_;
+  IoUringTransport::UniquePtr transport_;
+};
+
+TEST_F(IoUringTransportTest, ReadAndEOF) {
+  if (!backend_) {
+    return;
+  }
+  transport_->setReadCallback(&reader_);
+  std::string data = "GET / HTTP/1.1\r\nHost: www.facebook.com\r\n\r\n";
+  ASSERT_EQ(data.size(), write(fds_[1], data.data(), data.size()));
+  EXPECT_TRUE(loopUntil([&] { return reader_.data.size() == data.size(); }));
+  EXPECT_EQ(data, reader_.data);
+  EXPECT_EQ(data.size(), transport_->getRawBytesReceived());
+
+  shutdown(fds_[1], SHUT_WR);
+  EXPECT_TRUE(loopUntil([&] { return reader_.eof; }));
+  EXPECT_EQ(nullptr, transport_->getReadCallback());
+  EXPECT_FALSE(reader_.error);
+}
+
+TEST_F(IoUringTransportTest, PauseReads) {
+  if (!backend_) {
+    return;
+  }
+  transport_->setReadCallback(&reader_);
+  // stop reading in the middle of a receive
+  reader_.onData = [&] {
+    transport_->setReadCallback(nullptr);
+  };
+  ASSERT_EQ(5, write(fds_[1], "hello world", 5));
+  ASSERT_EQ(6, write(fds_[1], " world", 6));
+  shutdown(fds_[1], SHUT_WR);
+  EXPECT_TRUE(loopUntil([&] { return !reader_.data.empty(); }));
+  for (int i = 0; i < 10; i++) {
+    evb_.loopOnce();
+  }
+  EXPECT_FALSE(reader_.eof);
+
+  reader_.onData = nullptr;
+  transport_->setReadCallback(&reader_);
+  EXPECT_TRUE(loopUntil([&] { return reader_.eof; }));
+  EXPECT_EQ("hello world", reader_.data);
+}
+
+TEST_F(IoUringTransportTest, Writes) {
+  if (!backend_) {
+    return;
+  }
+  auto chain = folly::IOBuf::copyBuffer("HTTP/1.1 200 OK\r\n", 17);
+  chain->prependChain(
+    folly::IOBuf::copyBuffer("Content-Length: 0\r\n\r\n", 21));
+  transport_->writeChain(&writer_, std::move(chain),
+                         apache::thrift::async::WriteFlags::CORK);
+  transport_->write(&writer_, "abc", 3);
+  iovec vec[2];
+  vec[0].iov_base = const_cast<char*>("de");
+  vec[0].iov_len = 2;
+  vec[1].iov_base = const_cast<char*>("f");
+  vec[1].iov_len = 1;
+  transport_->writev(&writer_, vec, 2);
+  // nothing goes out before the end of the loop
+  EXPECT_EQ(0, writer_.successes);
+
+  EXPECT_TRUE(loopUntil([&] { return writer_.successes == 3; }));
+  EXPECT_EQ(0, writer_.errors);
+  EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\nabcdef",
+            readPeer(44));
+  EXPECT_EQ(44, transport_->getRawBytesWritten());
+}
+
+TEST_F(IoUringTransportTest, CloseAfterWrites) {
+  if (!backend_) {
+    return;
+  }
+  transport_->setReadCallback(&reader_);
+  transport_->write(&writer_, "bye", 3);
+  transport_->close();
+  EXPECT_TRUE(reader_.eof);
+  EXPECT_FALSE(transport_->good());
+  EXPECT_TRUE(loopUntil([&] { return writer_.successes == 1; }));
+  EXPECT_EQ("bye", readPeer(3));
+  // the socket is closed once the write is done
+  EXPECT_TRUE(loopUntil([&] {
+        char buf[1];
+        return read(fds_[1], buf, 1) == 0;
+      }));
+}
+
+TEST_F(IoUringTransportTest, DestroyWithOpsInFlight) {
+  if (!backend_) {
+    return;
+  }
+  transport_->setReadCallback(&reader_);
+  evb_.loopOnce();
+  transport_->write(&writer_, "lost", 4);
+  // the receive and the send are still armed
+  transport_.reset();
+  EXPECT_EQ(1, writer_.errors);
+  EXPECT_TRUE(reader_.eof);
+  for (int i = 0; i < 10; i++) {
+    evb_.loopOnce();
+  }
+  // the cancellations went through, and the socket was closed; the send
+  // was prepared before its cancellation, and may have gone out anyway
+  std::string data = readPeer(8);
+  EXPECT_TRUE(data.empty() || data == "lost");
+}
+
+TEST_F(IoUringTransportTest, BatchedSubmits) {
+  if (!backend_) {
+    return;
+  }
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  auto other = IoUringTransport::make(backend_, fds[0]);
+  ASSERT_TRUE(other != nullptr);
+
+  Reader otherReader;
+  transport_->setReadCallback(&reader_);
+  other->setReadCallback(&otherReader);
+  transport_->write(&writer_, "one", 3);
+  other->write(&writer_, "two", 3);
+  uint64_t submits = backend_->getNumSubmits();
+  evb_.loopOnce();
+  // the receives and the sends of both went in one io_uring_enter()
+  EXPECT_EQ(submits + 1, backend_->getNumSubmits());
+  EXPECT_TRUE(loopUntil([&] { return writer_.successes == 2; }));
+
+  other.reset();
+  evb_.loopOnce();
+  close(fds[1]);
+}
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/MemoryBudget.h>
+
+using namespace proxygen;
+
+namespace {
+
+class TestConsumer: public MemoryBudget::Consumer {
+ public:
+  void pauseForMemory() noexcept override {
+    pauses++;
+  }
+  void resumeForMemory() noexcept override {
+    resumes++;
+  }
+
+  uint32_t pauses{0};
+  uint32_t resumes{0};
+};
+
+}
+
+TEST(MemoryBudgetTest, PauseLargest) {
+  MemoryBudget budget;
+  budget.setLimit(1000);
+  TestConsumer small, medium, large;
+  budget.add(small);
+  budget.add(medium);
+  budget.add(large);
+  budget.update(small, 100);
+  budget.update(medium, 300);
+  budget.update(large, 600);
+  EXPECT_EQ(budget.getUsed(), 1000);
+  EXPECT_FALSE(budget.isExceeded());
+
+  // 1200 bytes, pausing the largest one is enough to get under 750
+  budget.update(medium, 500);
+  EXPECT_TRUE(budget.isExceeded());
+  EXPECT_EQ(small.pauses, 0);
+  EXPECT_EQ(medium.pauses, 0);
+  EXPECT_EQ(large.pauses, 1);
+  EXPECT_TRUE(large.isPausedForMemory());
+
+  // under the limit, but still over the low watermark
+  budget.update(large, 200);
+  EXPECT_FALSE(budget.isExceeded());
+  EXPECT_EQ(large.resumes, 0);
+  budget.update(medium, 400);
+  EXPECT_EQ(large.resumes, 1);
+  EXPECT_FALSE(large.isPausedForMemory());
+
+  budget.remove(small);
+  EXPECT_EQ(budget.getUsed(), 600);
+  budget.remove(medium);
+  budget.remove(large);
+}
+
+TEST(MemoryBudgetTest, ProcessLimit) {
+  MemoryBudget budget;
+  TestConsumer consumer;
+  budget.add(consumer);
+  MemoryBudget::setProcessLimit(1000);
+  budget.update(consumer, 2000);
+  EXPECT_EQ(MemoryBudget::getProcessUsed(), 2000);
+  EXPECT_EQ(consumer.pauses, 1);
+  budget.update(consumer, 0);
+  EXPECT_EQ(consumer.resumes, 1);
+  MemoryBudget::setProcessLimit(0);
+}
+
+TEST(MemoryBudgetTest, DestroyConsumer) {
+  MemoryBudget budget;
+  {
+    TestConsumer consumer;
+    budget.add(consumer);
+    budget.update(consumer, 100);
+  }
+  EXPECT_EQ(budget.getUsed(), 0);
+  EXPECT_EQ(MemoryBudget::getProcessUsed(), 0);
+}
+
+TEST(MemoryBudgetTest, Footprint) {
+  MemoryBudget budget;
+  TestConsumer a, b, c;
+  budget.add(a);
+  budget.add(b);
+  budget.add(c);
+  budget.update(a, 200);
+  budget.update(b, 700);
+  budget.update(c, 100);
+
+  auto footprint = budget.getFootprint(2);
+  EXPECT_EQ(footprint.bytes, 1000);
+  EXPECT_EQ(footprint.consumers, 3);
+  ASSERT_EQ(footprint.largest.size(), 2);
+  EXPECT_EQ(footprint.largest[0], &b);
+  EXPECT_EQ(footprint.largest[1], &a);
+
+  EXPECT_EQ(budget.getFootprint(10).largest.size(), 3);
+  EXPECT_TRUE(budget.getFootprint(0).largest.empty());
+}
@@ -267,6 +267,47 @@ TEST_F(MockCodecDownstreamTest, server_push) {
   httpSession_->shutdownTransportWithReset(kErrorConnectionReset);
 }
 
+TEST_F(MockCodecDownstreamTest, recently_fetched) {
+  MockHTTPHandler handler;
+  auto req = makeGetRequest();
+  req->setURL<std::string>("/page");
+
+  EXPECT_CALL(mockController_, getRequestHandler(_, _))
+    .WillOnce(Return(&handler));
+  EXPECT_CALL(handler, setTransaction(_))
+    .WillOnce(SaveArg<0>(&handler.txn_));
+  EXPECT_CALL(handler, onHeadersComplete(_))
+    .WillOnce(Invoke([&] (std::shared_ptr<HTTPMessage> msg) {
+          auto& transport = handler.txn_->getTransport();
+          // the request itself
+          EXPECT_TRUE(transport.wasRecentlyFetched("/page"));
+          EXPECT_FALSE(transport.wasRecentlyFetched("/style.css"));
+          transport.recordFetched("/style.css");
+          EXPECT_TRUE(transport.wasRecentlyFetched("/style.css"));
+          // the oldest ones are forgotten
+          for (int i = 0; i < 32; i++) {
+            transport.recordFetched(folly::to<std::string>("/", i));
+          }
+          EXPECT_FALSE(transport.wasRecentlyFetched("/page"));
+          EXPECT_TRUE(transport.wasRecentlyFetched("/31"));
+        }));
+  EXPECT_CALL(handler, onEOM())
+    .WillOnce(Invoke([&] {
+          handler.sendReplyWithBody(200, 100);
+        }));
+  EXPECT_CALL(*codec_, generateHeader(_, 1, _, _, _));
+  EXPECT_CALL(*codec_, generateBody(_, 1, PtrBufHasLen(100), true));
+  EXPECT_CALL(handler, detachTransaction());
+
+  codecCallback_->onMessageBegin(HTTPCodec::StreamID(1), req.get());
+  codecCallback_->onHeadersComplete(HTTPCodec::StreamID(1), std::move(req));
+  codecCallback_->onMessageComplete(HTTPCodec::StreamID(1), false);
+  eventBase_.loop();
+
+  EXPECT_CALL(mockController_, detachSession(_));
+  httpSession_->shutdownTransportWithReset(kErrorConnectionReset);
+}
+
 TEST_F(MockCodecDownstreamTest, server_push_after_goaway) {
   // Tests if goaway
   //   - drains acknowledged server push transactions
@@ -0,0 +1,409 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/http/session/test/SessionSimulator.h>
+
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <proxygen/lib/http/codec/test/TestUtils.h>
+#include <proxygen/lib/http/session/HTTPDownstreamSession.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <proxygen/lib/http/session/test/TestUtils.h>
+#include <proxygen/lib/test/TestAsyncTransport.h>
+
+using apache::thrift::async::TAsyncTransport;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using std::chrono::nanoseconds;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+// Far beyond any simulated run: the transaction and write timeouts go by
+// the wall clock, which must not influence the results
+const std::chrono::milliseconds kTimeout(3600 * 1000);
+
+nanoseconds oneWayDelay(uint32_t rttMs) {
+  return nanoseconds(std::chrono::milliseconds(rttMs)) / 2;
+}
+
+double toMs(nanoseconds time) {
+  return time.count() / 1e6;
+}
+
+}
+
+/**
+ * The SPDY/3.1 client at the far end of the link. It sends every request at
+ * once, consumes responses as they arrive and credits their windows back.
+ */
+class SessionSimulator::Client : public HTTPCodec::Callback {
+ public:
+  explicit Client(SessionSimulator& sim)
+      : sim_(sim),
+        codec_(TransportDirection::UPSTREAM, SPDYVersion::SPDY3_1),
+        results_(sim.config_.streams.size()),
+        incomplete_(sim.config_.streams.size()) {
+    codec_.setCallback(this);
+  }
+
+  unique_ptr<IOBuf> start() {
+    const auto& config = sim_.config_;
+    IOBufQueue out(IOBufQueue::cacheChainLength());
+    codec_.getEgressSettings()->setSetting(SettingsId::INITIAL_WINDOW_SIZE,
+                                          config.streamWindow);
+    codec_.generateSettings(out);
+    if (config.sessionWindow > spdy::kInitialWindow) {
+      codec_.generateWindowUpdate(
+        out, 0, config.sessionWindow - spdy::kInitialWindow);
+    }
+    for (size_t i = 0; i < config.streams.size(); ++i) {
+      auto stream = codec_.createStream();
+      streams_[stream] = i;
+      results_[i].priority = config.streams[i].priority;
+      results_[i].responseBytes = config.streams[i].responseBytes;
+
+      HTTPMessage req = getGetRequest(folly::to<std::string>("/", i));
+      req.setPriority(config.streams[i].priority);
+      codec_.generateHeader(out, stream, req);
+      codec_.generateEOM(out, stream);
+    }
+    return out.move();
+  }
+
+  // Returns the WINDOW_UPDATEs for what buf completed, if any
+  unique_ptr<IOBuf> onIngress(unique_ptr<IOBuf> buf) {
+    ingress_.append(std::move(buf));
+    while (!ingress_.empty()) {
+      size_t consumed = codec_.onIngress(*ingress_.front());
+      if (consumed == 0) {
+        break;
+      }
+      ingress_.trimStart(consumed);
+    }
+
+    IOBufQueue out(IOBufQueue::cacheChainLength());
+    uint32_t sessionCredit = 0;
+    for (const auto& credit: credits_) {
+      if (!complete(credit.first)) {
+        codec_.generateWindowUpdate(out, credit.first, credit.second);
+      }
+      sessionCredit += credit.second;
+    }
+    credits_.clear();
+    if (sessionCredit > 0) {
+      codec_.generateWindowUpdate(out, 0, sessionCredit);
+    }
+    return out.move();
+  }
+
+  bool done() const {
+    return incomplete_ == 0;
+  }
+
+  void report(Report& report) const {
+    report.responseBytes = responseBytes_;
+    report.duration = lastByteTime_;
+    if (lastByteTime_.count() > 0) {
+      report.goodputBytesPerSec = responseBytes_ * 1e9 / lastByteTime_.count();
+    }
+    report.streams = results_;
+
+    std::map<uint8_t, size_t> holBytes;
+    for (const auto& result: results_) {
+      auto& priority = report.priorities[result.priority];
+      priority.streams++;
+      priority.meanCompletionTime += result.completionTime;
+      priority.maxCompletionTime = std::max(priority.maxCompletionTime,
+                                            result.completionTime);
+      holBytes[result.priority] += result.headOfLineBytes;
+    }
+    for (auto& priority: report.priorities) {
+      auto& result = priority.second;
+      result.meanCompletionTime /= result.streams;
+      result.meanHeadOfLineBytes = holBytes[priority.first] / result.streams;
+    }
+  }
+
+  // HTTPCodec::Callback
+  void onMessageBegin(HTTPCodec::StreamID stream, HTTPMessage*) override {}
+  void onPushMessageBegin(HTTPCodec::StreamID stream,
+                          HTTPCodec::StreamID assocStream,
+                          HTTPMessage*) override {
+    LOG(FATAL) << "unexpected push on stream " << stream;
+  }
+  void onHeadersComplete(HTTPCodec::StreamID stream,
+                         unique_ptr<HTTPMessage> msg) override {
+    CHECK_EQ(msg->getStatusCode(), 200);
+  }
+  void onBody(HTTPCodec::StreamID stream,
+              unique_ptr<IOBuf> chain) override {
+    size_t length = chain->computeChainDataLength();
+    auto index = streams_.at(stream);
+    responseBytes_ += length;
+    lastByteTime_ = sim_.now_;
+    credits_[stream] += length;
+
+    // Whatever more urgent response is still in flight waited for this
+    for (auto& result: results_) {
+      if (result.priority < results_[index].priority &&
+          result.completionTime.count() == 0) {
+        result.headOfLineBytes += length;
+      }
+    }
+  }
+  void onTrailersComplete(HTTPCodec::StreamID stream,
+                          unique_ptr<HTTPHeaders> trailers) override {}
+  void onMessageComplete(HTTPCodec::StreamID stream, bool upgrade) override {
+    auto& result = results_[streams_.at(stream)];
+    CHECK_EQ(result.completionTime.count(), 0);
+    // Requests went out at time 0; keep a finished stream distinguishable
+    result.completionTime = std::max(sim_.now_, nanoseconds(1));
+    incomplete_--;
+  }
+  void onError(HTTPCodec::StreamID stream,
+               const HTTPException& error, bool newTxn) override {
+    LOG(FATAL) << "error on stream " << stream << ": " << error.what();
+  }
+  void onAbort(HTTPCodec::StreamID stream, ErrorCode code) override {
+    LOG(FATAL) << "abort of stream " << stream << ": "
+               << getErrorCodeString(code);
+  }
+
+ private:
+  bool complete(HTTPCodec::StreamID stream) const {
+    return results_[streams_.at(stream)].completionTime.count() != 0;
+  }
+
+  SessionSimulator& sim_;
+  SPDYCodec codec_;
+  IOBufQueue ingress_{IOBufQueue::cacheChainLength()};
+  std::map<HTTPCodec::StreamID, size_t> streams_;
+  std::vector<StreamResult> results_;
+  // Bytes received in the current delivery, by stream
+  std::map<HTTPCodec::StreamID, uint32_t> credits_;
+  size_t incomplete_;
+  uint64_t responseBytes_{0};
+  nanoseconds lastByteTime_{0};
+};
+
+/**
+ * Answers a request with the configured number of bytes all at once, which
+ * leaves the pacing of the response to the transaction and the session.
+ */
+class SessionSimulator::ResponseHandler : public HTTPTransactionHandler {
+ public:
+  explicit ResponseHandler(size_t bytes): bytes_(bytes) {}
+
+  void setTransaction(HTTPTransaction* txn) noexcept override {
+    txn_ = txn;
+  }
+  void detachTransaction() noexcept override {
+    delete this;
+  }
+  void onHeadersComplete(unique_ptr<HTTPMessage> msg) noexcept override {}
+  void onBody(unique_ptr<IOBuf> chain) noexcept override {}
+  void onEOM() noexcept override {
+    HTTPMessage resp;
+    resp.setHTTPVersion(1, 1);
+    resp.setStatusCode(200);
+    resp.setStatusMessage("OK");
+    resp.getHeaders().set(HTTP_HEADER_CONTENT_LENGTH,
+                          folly::to<std::string>(bytes_));
+    txn_->sendHeaders(resp);
+    if (bytes_ > 0) {
+      auto body = IOBuf::create(bytes_);
+      memset(body->writableData(), 'a', bytes_);
+      body->append(bytes_);
+      txn_->sendBody(std::move(body));
+    }
+    txn_->sendEOM();
+  }
+  void onUpgrade(UpgradeProtocol protocol) noexcept override {}
+  void onError(const HTTPException& error) noexcept override {
+    LOG(FATAL) << "transaction error: " << error.what();
+  }
+  void onEgressPaused() noexcept override {}
+  void onEgressResumed() noexcept override {}
+
+ private:
+  const size_t bytes_;
+  HTTPTransaction* txn_{nullptr};
+};
+
+SessionSimulator::SessionSimulator(const Config& config)
+    : config_(config),
+      transactionTimeouts_(new AsyncTimeoutSet(&eventBase_, kTimeout)) {
+  CHECK_GT(config_.bandwidthBytesPerSec, 0);
+  CHECK_GT(config_.segmentBytes, 0);
+
+  transport_ = new TestAsyncTransport(&eventBase_);
+  transport_->pauseWrites();
+  session_ = new HTTPDownstreamSession(
+    transactionTimeouts_.get(),
+    TAsyncTransport::UniquePtr(transport_),
+    localAddr, peerAddr, this,
+    folly::make_unique<SPDYCodec>(TransportDirection::DOWNSTREAM,
+                                  SPDYVersion::SPDY3_1),
+    mockTransportInfo);
+  session_->startNow();
+  client_ = folly::make_unique<Client>(*this);
+}
+
+SessionSimulator::~SessionSimulator() {
+  if (session_) {
+    session_->dropConnection();
+  }
+  eventBase_.loop();
+  CHECK(!session_);
+}
+
+SessionSimulator::Report SessionSimulator::run() {
+  schedule(nanoseconds(0), [this] {
+      deliverToServer(client_->start());
+    });
+  runSession();
+  while (!events_.empty()) {
+    auto next = events_.begin();
+    now_ = next->first;
+    auto fn = std::move(next->second);
+    events_.erase(next);
+    fn();
+    runSession();
+  }
+  CHECK(client_->done()) << "incomplete responses, with nothing in flight";
+
+  Report report;
+  client_->report(report);
+  return report;
+}
+
+HTTPTransactionHandler* SessionSimulator::getRequestHandler(
+    HTTPTransaction& txn, HTTPMessage* msg) {
+  auto index = folly::to<size_t>(msg->getPath().substr(1));
+  return new ResponseHandler(config_.streams.at(index).responseBytes);
+}
+
+HTTPTransactionHandler* SessionSimulator::getParseErrorHandler(
+    HTTPTransaction* txn,
+    const HTTPException& error,
+    const folly::SocketAddress& localAddress) {
+  LOG(FATAL) << "parse error: " << error.what();
+  return nullptr;
+}
+
+HTTPTransactionHandler* SessionSimulator::getTransactionTimeoutHandler(
+    HTTPTransaction* txn,
+    const folly::SocketAddress& localAddress) {
+  LOG(FATAL) << "transaction timed out";
+  return nullptr;
+}
+
+void SessionSimulator::detachSession(const HTTPSession* session) {
+  session_ = nullptr;
+  transport_ = nullptr;
+}
+
+void SessionSimulator::schedule(nanoseconds delay, std::function<void()> fn) {
+  events_.emplace(now_ + delay, std::move(fn));
+}
+
+void SessionSimulator::runSession() {
+  // The session writes from loop callbacks, and a completed write can make
+  // it schedule another: run the loop until a pass leaves nothing to accept
+  for (unsigned idle = 0; idle < 2 && session_; ) {
+    eventBase_.loopOnce(EVLOOP_NONBLOCK);
+    idle = acceptWrites() ? 0 : idle + 1;
+  }
+}
+
+bool SessionSimulator::acceptWrites() {
+  bool accepted = false;
+  while (transport_ && sendBuffer_.chainLength() < config_.sendBufferBytes &&
+         transport_->completeNextWrite()) {
+    auto writeEvents = transport_->getWriteEvents();
+    for (const auto& event: *writeEvents) {
+      auto vec = event->getIoVec();
+      for (size_t i = 0; i < event->getCount(); ++i) {
+        sendBuffer_.append(vec[i].iov_base, vec[i].iov_len);
+      }
+    }
+    writeEvents->clear();
+    accepted = true;
+  }
+  if (!transmitting_ && !sendBuffer_.empty()) {
+    transmit();
+  }
+  return accepted;
+}
+
+void SessionSimulator::transmit() {
+  size_t segment = std::min(sendBuffer_.chainLength(), config_.segmentBytes);
+  transmitting_ = true;
+  schedule(nanoseconds(segment * 1000000000 / config_.bandwidthBytesPerSec),
+           [this, segment] {
+      transmitting_ = false;
+      std::shared_ptr<IOBuf> buf(sendBuffer_.split(segment));
+      schedule(oneWayDelay(config_.rttMs), [this, buf] {
+          deliverToClient(buf->clone());
+        });
+      if (!sendBuffer_.empty()) {
+        transmit();
+      }
+    });
+}
+
+void SessionSimulator::deliverToServer(unique_ptr<IOBuf> buf) {
+  if (!buf || !session_) {
+    return;
+  }
+  auto callback = transport_->getReadCallback();
+  CHECK(callback) << "the session stopped reading";
+  folly::io::Cursor cursor(buf.get());
+  while (cursor.totalLength() > 0) {
+    void* readBuf;
+    size_t readLen;
+    callback->getReadBuffer(&readBuf, &readLen);
+    readLen = std::min(readLen, cursor.totalLength());
+    cursor.pull(readBuf, readLen);
+    callback->readDataAvailable(readLen);
+  }
+}
+
+void SessionSimulator::deliverToClient(unique_ptr<IOBuf> buf) {
+  auto updates = client_->onIngress(std::move(buf));
+  if (updates) {
+    std::shared_ptr<IOBuf> shared(std::move(updates));
+    schedule(oneWayDelay(config_.rttMs), [this, shared] {
+        deliverToServer(shared->clone());
+      });
+  }
+}
+
+std::string SessionSimulator::Report::toString() const {
+  std::string out = folly::stringPrintf(
+    "duration_ms=%.3f response_bytes=%lu goodput_kBps=%.1f\n",
+    toMs(duration), (unsigned long)responseBytes, goodputBytesPerSec / 1000);
+  for (const auto& priority: priorities) {
+    const auto& result = priority.second;
+    folly::stringAppendf(
+      &out,
+      "priority=%u streams=%zu mean_ms=%.3f max_ms=%.3f hol_bytes=%zu\n",
+      (unsigned)priority.first, result.streams,
+      toMs(result.meanCompletionTime), toMs(result.maxCompletionTime),
+      result.meanHeadOfLineBytes);
+  }
+  return out;
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <proxygen/lib/http/codec/SPDYCodec.h>
+#include <proxygen/lib/http/session/HTTPSessionController.h>
+#include <proxygen/lib/utils/AsyncTimeoutSet.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+class HTTPDownstreamSession;
+class TestAsyncTransport;
+
+/**
+ * Runs a set of SPDY/3.1 transactions through an HTTPDownstreamSession on a
+ * TestAsyncTransport, modelling the link to the client on a virtual clock:
+ *
+ *  - write-readiness: a write completes as soon as it fits in a send buffer
+ *    of sendBufferBytes, like a non-blocking socket would accept it;
+ *  - bandwidth: the send buffer drains onto the link one segment at a time;
+ *  - RTT: a segment reaches the client rttMs / 2 after it left, and the
+ *    WINDOW_UPDATEs the client sends back for it as many after that.
+ *
+ * The client consumes what it receives at once, so the server's egress is
+ * only held back by the windows it advertised, the send buffer and the
+ * link. Nothing depends on the wall clock, so a given Config always yields
+ * the same Report, and the effect of a change to egress scheduling or flow
+ * control shows up as a change to the numbers.
+ */
+class SessionSimulator : private HTTPSessionController {
+ public:
+  struct Stream {
+    uint8_t priority;       // SPDY/3 priority, 0 is the most urgent
+    size_t responseBytes;
+  };
+
+  struct Config {
+    uint64_t bandwidthBytesPerSec{1250000}; // 10Mbps
+    uint32_t rttMs{100};
+    size_t sendBufferBytes{64 * 1024};
+    size_t segmentBytes{1460};
+    // Windows the client advertises for the server's egress
+    uint32_t streamWindow{spdy::kInitialWindow};
+    uint32_t sessionWindow{spdy::kInitialWindow};
+    std::vector<Stream> streams;
+  };
+
+  struct StreamResult {
+    uint8_t priority{0};
+    size_t responseBytes{0};
+    // From the time the request was sent to the last byte of the response
+    std::chrono::nanoseconds completionTime{0};
+    // Bytes of less urgent responses the client received in that time
+    size_t headOfLineBytes{0};
+  };
+
+  struct PriorityResult {
+    size_t streams{0};
+    std::chrono::nanoseconds meanCompletionTime{0};
+    std::chrono::nanoseconds maxCompletionTime{0};
+    size_t meanHeadOfLineBytes{0};
+  };
+
+  struct Report {
+    std::chrono::nanoseconds duration{0};
+    uint64_t responseBytes{0};
+    double goodputBytesPerSec{0};
+    std::vector<StreamResult> streams;  // in the order of Config::streams
+    std::map<uint8_t, PriorityResult> priorities;
+
+    std::string toString() const;
+  };
+
+  explicit SessionSimulator(const Config& config);
+  ~SessionSimulator();
+
+  Report run();
+
+ private:
+  class Client;
+  class ResponseHandler;
+
+  // HTTPSessionController
+  HTTPTransactionHandler* getRequestHandler(
+    HTTPTransaction& txn, HTTPMessage* msg) override;
+  HTTPTransactionHandler* getParseErrorHandler(
+    HTTPTransaction* txn,
+    const HTTPException& error,
+    const folly::SocketAddress& localAddress) override;
+  HTTPTransactionHandler* getTransactionTimeoutHandler(
+    HTTPTransaction* txn,
+    const folly::SocketAddress& localAddress) override;
+  void attachSession(HTTPSession* session) override {}
+  void detachSession(const HTTPSession* session) override;
+
+  void schedule(std::chrono::nanoseconds delay, std::function<void()> fn);
+  void runSession();
+  bool acceptWrites();
+  void transmit();
+  void deliverToServer(std::unique_ptr<folly::IOBuf> buf);
+  void deliverToClient(std::unique_ptr<folly::IOBuf> buf);
+
+  const Config config_;
+  folly::EventBase eventBase_;
+  AsyncTimeoutSet::UniquePtr transactionTimeouts_;
+  TestAsyncTransport* transport_{nullptr};  // owned by session_
+  HTTPDownstreamSession* session_{nullptr};
+  std::unique_ptr<Client> client_;
+
+  std::chrono::nanoseconds now_{0};
+  // Pending events in time order, FIFO for equal times
+  std::multimap<std::chrono::nanoseconds, std::function<void()>> events_;
+
+  folly::IOBufQueue sendBuffer_{folly::IOBufQueue::cacheChainLength()};
+  bool transmitting_{false};
+};
+
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <proxygen/lib/http/session/test/SessionSimulator.h>
+#include <vector>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+/**
+ * Prints the SessionSimulator report for the given link and workload, e.g.
+ *
+ *   SessionSimulatorBenchmark --rtt_ms=200 --streams=0:20000,7:500000x6
+ *
+ * to compare egress scheduling and flow-control changes.
+ */
+
+DEFINE_uint64(bandwidth_kbps, 10000, "Link bandwidth, in kilobits/s");
+DEFINE_int32(rtt_ms, 100, "Round trip time");
+DEFINE_int32(send_buffer, 64 * 1024, "Bytes the socket accepts unsent");
+DEFINE_int32(segment, 1460, "Bytes put on the link at a time");
+DEFINE_int32(stream_window, 65536, "Window the client grants each stream");
+DEFINE_int32(session_window, 65536, "Window the client grants the session");
+DEFINE_string(streams, "0:20000,3:100000x4,7:500000x4",
+              "Comma separated priority:response_bytes[xcount]");
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  SessionSimulator::Config config;
+  config.bandwidthBytesPerSec = FLAGS_bandwidth_kbps * 1000 / 8;
+  config.rttMs = FLAGS_rtt_ms;
+  config.sendBufferBytes = FLAGS_send_buffer;
+  config.segmentBytes = FLAGS_segment;
+  config.streamWindow = FLAGS_stream_window;
+  config.sessionWindow = FLAGS_session_window;
+
+  vector<StringPiece> specs;
+  split(',', FLAGS_streams, specs);
+  for (auto spec: specs) {
+    StringPiece priority, rest;
+    CHECK(split(':', spec, priority, rest)) << "bad stream " << spec;
+    StringPiece bytes = rest;
+    size_t count = 1;
+    auto x = rest.find('x');
+    if (x != StringPiece::npos) {
+      bytes = rest.subpiece(0, x);
+      count = to<size_t>(rest.subpiece(x + 1));
+    }
+    for (size_t i = 0; i < count; ++i) {
+      config.streams.push_back({to<uint8_t>(priority), to<size_t>(bytes)});
+    }
+  }
+
+  cout << SessionSimulator(config).run().toString();
+  return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/test/SessionSimulator.h>
+
+using namespace proxygen;
+using namespace std::chrono;
+
+namespace {
+
+SessionSimulator::Config mixedPriorities() {
+  SessionSimulator::Config config;
+  config.streamWindow = 1 << 20;
+  config.sessionWindow = 1 << 24;
+  for (uint8_t i = 0; i < 8; ++i) {
+    config.streams.push_back({7, 100000});
+  }
+  config.streams.push_back({0, 20000});
+  config.streams.push_back({3, 50000});
+  return config;
+}
+
+}
+
+TEST(SessionSimulatorTest, deterministic) {
+  auto config = mixedPriorities();
+  auto first = SessionSimulator(config).run();
+  auto second = SessionSimulator(config).run();
+  EXPECT_EQ(first.toString(), second.toString());
+  EXPECT_EQ(first.responseBytes, 870000);
+}
+
+TEST(SessionSimulatorTest, goodput_bounded_by_bandwidth) {
+  auto config = mixedPriorities();
+  auto report = SessionSimulator(config).run();
+  EXPECT_LE(report.goodputBytesPerSec, config.bandwidthBytesPerSec);
+  // The windows are open, so only the link and one RTT hold it back
+  EXPECT_GT(report.goodputBytesPerSec, config.bandwidthBytesPerSec / 2);
+}
+
+TEST(SessionSimulatorTest, urgent_streams_first) {
+  auto report = SessionSimulator(mixedPriorities()).run();
+  ASSERT_EQ(report.priorities.size(), 3);
+  EXPECT_LT(report.priorities[0].maxCompletionTime,
+            report.priorities[3].maxCompletionTime);
+  EXPECT_LT(report.priorities[3].maxCompletionTime,
+            report.priorities[7].meanCompletionTime);
+  // Less urgent bytes only get ahead of the urgent response while it is
+  // queued behind what the send buffer already took
+  EXPECT_LT(report.priorities[0].meanHeadOfLineBytes,
+            SessionSimulator::Config().sendBufferBytes * 2);
+  EXPECT_EQ(report.priorities[7].meanHeadOfLineBytes, 0);
+}
+
+TEST(SessionSimulatorTest, stream_window_limits_throughput) {
+  SessionSimulator::Config config;
+  config.streamWindow = 16 * 1024;
+  config.sessionWindow = 1 << 24;
+  config.streams.push_back({0, 256 * 1024});
+  auto report = SessionSimulator(config).run();
+  // At most a window per round trip
+  EXPECT_GE(report.streams[0].completionTime,
+            milliseconds(config.rttMs) * 15);
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/SlowReaderDetector.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+typedef SlowReaderDetector::State State;
+
+TEST(SlowReaderDetectorTest, FastReader) {
+  SlowReaderDetector detector(seconds(10), seconds(30), 1000);
+  TimePoint now = getCurrentTime();
+  // 1MB buffered, drained at 200KB/s, goes in 5s
+  for (int i = 0; i < 10; i++) {
+    now += milliseconds(500);
+    ASSERT_EQ(detector.onDrained(100000, 1000000, now), State::OK);
+  }
+}
+
+TEST(SlowReaderDetectorTest, SlowReaderExpires) {
+  SlowReaderDetector detector(seconds(10), seconds(30), 1000);
+  TimePoint now = getCurrentTime();
+  detector.reset(now);
+  // 1MB buffered, drained at 10KB/s, takes 100s
+  now += seconds(1);
+  ASSERT_EQ(detector.onDrained(10000, 1000000, now), State::SLOW);
+  now += seconds(30);
+  ASSERT_EQ(detector.onDrained(300000, 1000000, now), State::SLOW);
+  now += seconds(1);
+  ASSERT_EQ(detector.onDrained(10000, 1000000, now), State::EXPIRED);
+}
+
+TEST(SlowReaderDetectorTest, CatchesUp) {
+  SlowReaderDetector detector(seconds(10), seconds(30), 1000);
+  TimePoint now = getCurrentTime();
+  detector.reset(now);
+  now += seconds(1);
+  ASSERT_EQ(detector.onDrained(10000, 1000000, now), State::SLOW);
+  now += seconds(1);
+  ASSERT_EQ(detector.onDrained(500000, 1000000, now), State::OK);
+  // little buffered is never slow
+  now += seconds(20);
+  ASSERT_EQ(detector.onDrained(1, 999, now), State::OK);
+}
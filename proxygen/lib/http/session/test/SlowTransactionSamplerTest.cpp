@@ -0,0 +1,32 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/SlowTransactionSampler.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+TEST(SlowTransactionSamplerTest, Ring) {
+  SlowTransactionSampler sampler(milliseconds(100), 3);
+  EXPECT_EQ(milliseconds(100), sampler.getThreshold());
+  EXPECT_TRUE(sampler.getSamples().empty());
+  for (int64_t i = 0; i < 5; i++) {
+    folly::dynamic sample = folly::dynamic::object;
+    sample["id"] = i;
+    sampler.record(std::move(sample));
+  }
+  EXPECT_EQ(5, sampler.getNumRecorded());
+  auto samples = sampler.getSamples();
+  ASSERT_EQ(3, samples.size());
+  for (int64_t i = 0; i < 3; i++) {
+    EXPECT_EQ(i + 2, samples[i]["id"].asInt());
+    EXPECT_LT(0, samples[i]["time_ms"].asInt());
+  }
+}
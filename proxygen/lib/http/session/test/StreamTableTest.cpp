@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/session/StreamTable.h>
+#include <vector>
+
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+struct Counted {
+  explicit Counted(uint32_t v) : value(v) {
+    ++live;
+  }
+  ~Counted() {
+    --live;
+  }
+  Counted(const Counted&) = delete;
+
+  uint32_t value;
+  static int live;
+};
+
+int Counted::live = 0;
+
+vector<uint32_t> ids(const StreamTable<Counted>& table) {
+  vector<uint32_t> out;
+  table.forEach([&] (uint32_t id, const Counted& c) {
+    EXPECT_EQ(id, c.value);
+    out.push_back(id);
+  });
+  return out;
+}
+
+}
+
+TEST(StreamTableTest, Basic) {
+  {
+    StreamTable<Counted> table;
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(nullptr, table.front());
+    auto c1 = table.emplace(1, 1);
+    auto c3 = table.emplace(3, 3);
+    ASSERT_NE(nullptr, c1);
+    EXPECT_EQ(nullptr, table.emplace(1, 1));
+    EXPECT_EQ(c1, table.find(1));
+    EXPECT_EQ(c3, table.find(3));
+    EXPECT_EQ(nullptr, table.find(2));
+    EXPECT_EQ(c1, table.front());
+    EXPECT_EQ(2, table.size());
+
+    table.erase(1);
+    table.erase(5);
+    EXPECT_EQ(nullptr, table.find(1));
+    EXPECT_EQ(c3, table.front());
+    EXPECT_EQ(1, Counted::live);
+    table.emplace(7, 7);
+  }
+  // the table destroys what is left
+  EXPECT_EQ(0, Counted::live);
+}
+
+TEST(StreamTableTest, SlidingWindow) {
+  StreamTable<Counted> table;
+  // a long lived stream, and many short ones after it
+  auto first = table.emplace(1, 1);
+  vector<Counted*> live;
+  for (uint32_t id = 3; id < 10000; id += 2) {
+    live.push_back(table.emplace(id, id));
+    if (live.size() > 8) {
+      table.erase(live.front()->value);
+      live.erase(live.begin());
+    }
+    // the addresses are stable while the window moves
+    ASSERT_EQ(first, table.find(1));
+    ASSERT_EQ(live.front(), table.find(live.front()->value));
+  }
+  EXPECT_EQ(9, table.size());
+  auto expected = vector<uint32_t>{1};
+  for (auto c : live) {
+    expected.push_back(c->value);
+  }
+  EXPECT_EQ(expected, ids(table));
+
+  // a stream below the window, like a push with a lower ID
+  table.emplace(2, 2);
+  EXPECT_EQ(Counted::live, table.size());
+  expected.insert(expected.begin() + 1, 2);
+  EXPECT_EQ(expected, ids(table));
+}
+
+TEST(StreamTableTest, ForEachSafe) {
+  StreamTable<Counted> table;
+  for (uint32_t id = 1; id <= 20; id++) {
+    table.emplace(id, id);
+  }
+  vector<uint32_t> visited;
+  table.forEachSafe([&] (uint32_t id, Counted& c) {
+    visited.push_back(id);
+    // erase the next one, and add streams before and after this one
+    table.erase(id + 1);
+    table.emplace(id + 100, id + 100);
+    if (id == 5) {
+      table.erase(4);
+      table.emplace(4, 4);
+    }
+  });
+  EXPECT_EQ(vector<uint32_t>({1, 3, 5, 7, 9, 11, 13, 15, 17, 19}), visited);
+  EXPECT_EQ(21, table.size());
+}
+
+TEST(StreamTableTest, PoolReuse) {
+  StreamTable<Counted> table;
+  table.emplace(1, 1);
+  table.erase(1);
+  size_t pooled = StreamTable<Counted>::getPoolSize();
+  EXPECT_LT(0, pooled);
+
+  table.emplace(2, 2);
+  EXPECT_EQ(pooled - 1, StreamTable<Counted>::getPoolSize());
+  {
+    // the tables of a thread share the pool
+    StreamTable<Counted> other;
+    other.emplace(1, 1);
+    EXPECT_EQ(pooled - 2, StreamTable<Counted>::getPoolSize());
+  }
+  EXPECT_EQ(pooled - 1, StreamTable<Counted>::getPoolSize());
+  table.erase(2);
+  EXPECT_EQ(pooled, StreamTable<Counted>::getPoolSize());
+}
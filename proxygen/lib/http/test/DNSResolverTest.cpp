@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/DNSResolver.h>
+
+using namespace folly;
+using namespace proxygen;
+using namespace std;
+
+namespace {
+
+class Lookup : public DNSResolver::Callback {
+ public:
+  explicit Lookup(EventBase* evb = nullptr): evb_(evb) {}
+
+  void resolveSuccess(const vector<SocketAddress>& addrs) noexcept override {
+    addresses = addrs;
+    done();
+  }
+
+  void resolveError(const string& err) noexcept override {
+    error = err;
+    done();
+  }
+
+  void done() {
+    calls++;
+    if (evb_) {
+      evb_->terminateLoopSoon();
+    }
+  }
+
+  EventBase* evb_;
+  vector<SocketAddress> addresses;
+  string error;
+  uint32_t calls{0};
+};
+
+}
+
+TEST(DNSResolverTest, Numeric) {
+  EventBase evb;
+  DNSResolver resolver(&evb);
+  Lookup lookup;
+  resolver.resolve("::1", 443, &lookup);
+  EXPECT_EQ(1, lookup.calls);
+  ASSERT_EQ(1, lookup.addresses.size());
+  EXPECT_EQ(SocketAddress("::1", 443), lookup.addresses[0]);
+  // nothing to cache
+  EXPECT_EQ(0, resolver.getNumEntries());
+}
+
+TEST(DNSResolverTest, CoalesceAndCache) {
+  EventBase evb;
+  DNSResolver resolver(&evb);
+  Lookup first;
+  Lookup second(&evb);
+  Lookup cancelled;
+  resolver.resolve("localhost", 80, &first);
+  resolver.resolve("localhost", 8080, &cancelled);
+  resolver.resolve("localhost", 443, &second);
+  resolver.cancel(&cancelled);
+  EXPECT_EQ(1, resolver.getNumEntries());
+  evb.loopForever();
+
+  EXPECT_EQ(1, first.calls);
+  EXPECT_EQ(1, second.calls);
+  EXPECT_EQ(0, cancelled.calls);
+  ASSERT_FALSE(first.addresses.empty());
+  EXPECT_EQ(first.addresses.size(), second.addresses.size());
+  EXPECT_EQ(80, first.addresses[0].getPort());
+  EXPECT_EQ(443, second.addresses[0].getPort());
+
+  // answered from the cache
+  Lookup cached;
+  resolver.resolve("localhost", 80, &cached);
+  EXPECT_EQ(1, cached.calls);
+  EXPECT_EQ(first.addresses, cached.addresses);
+  vector<SocketAddress> addresses;
+  EXPECT_TRUE(resolver.getCached("localhost", 80, &addresses));
+  EXPECT_EQ(first.addresses, addresses);
+  EXPECT_FALSE(resolver.getCached("example.com", 80, &addresses));
+}
+
+TEST(DNSResolverTest, Expire) {
+  EventBase evb;
+  DNSResolver resolver(&evb, chrono::seconds(0));
+  Lookup first(&evb);
+  resolver.resolve("localhost", 80, &first);
+  evb.loopForever();
+  EXPECT_EQ(1, first.calls);
+
+  // resolved again
+  Lookup second(&evb);
+  resolver.resolve("localhost", 80, &second);
+  EXPECT_EQ(0, second.calls);
+  evb.loopForever();
+  EXPECT_EQ(1, second.calls);
+  EXPECT_EQ(1, resolver.getNumEntries());
+}
@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPException.h>
+
+using namespace proxygen;
+
+TEST(HTTPExceptionTest, StaticReason) {
+  HTTPException ex(HTTPException::Direction::INGRESS, kErrorParseHeader,
+                   "HTTP2Codec stream error");
+  ex.setStreamID(5);
+  ex.setCodecStatusCode(ErrorCode::PROTOCOL_ERROR);
+  EXPECT_STREQ("HTTP2Codec stream error", ex.what());
+  EXPECT_EQ(kErrorParseHeader, ex.getProxygenError());
+  // the details are only formatted here
+  auto description = ex.describe();
+  EXPECT_NE(std::string::npos, description.find("streamID=5"));
+  EXPECT_NE(std::string::npos, description.find("PROTOCOL_ERROR"));
+
+  HTTPException copy(ex);
+  EXPECT_EQ(ex.what(), copy.what());
+  EXPECT_EQ(5, copy.getStreamID());
+}
+
+TEST(HTTPExceptionTest, ErrorName) {
+  HTTPException ex(HTTPException::Direction::EGRESS, kErrorTimeout);
+  EXPECT_STREQ(getErrorString(kErrorTimeout), ex.what());
+  EXPECT_FALSE(ex.hasStreamID());
+}
+
+TEST(HTTPExceptionTest, FormattedMessage) {
+  HTTPException ex(HTTPException::Direction::INGRESS, "bad chunk ", 42);
+  EXPECT_STREQ("bad chunk 42", ex.what());
+  EXPECT_FALSE(ex.hasProxygenError());
+}
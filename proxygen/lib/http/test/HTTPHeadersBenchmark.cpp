@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/FBVector.h>
+#include <proxygen/lib/http/HTTPHeaders.h>
+
+using namespace folly;
+using namespace proxygen;
+
+namespace {
+
+/**
+ * The previous HTTPHeaders layout: three heap vectors reserved up front.
+ */
+struct VectorHeaders {
+  VectorHeaders() {
+    codes.reserve(16);
+    names.reserve(16);
+    values.reserve(16);
+  }
+
+  void add(HTTPHeaderCode code, const std::string& value) {
+    codes.push_back(code);
+    names.push_back(HTTPCommonHeaders::getPointerToHeaderName(code));
+    values.emplace_back(value);
+  }
+
+  folly::fbvector<HTTPHeaderCode> codes;
+  folly::fbvector<const std::string*> names;
+  folly::fbvector<std::string> values;
+};
+
+const std::string kHost("www.facebook.com");
+const std::string kAccept("text/html");
+const std::string kEncoding("gzip");
+const std::string kLanguage("en-US");
+const std::string kLength("1024");
+const std::string kConn("keep-alive");
+const std::string kUA("curl/7.35");
+const std::string kCache("no-cache");
+
+template <typename H>
+void __attribute__ ((__noinline__)) addTypicalRequest(H& h) {
+  h.add(HTTP_HEADER_HOST, kHost);
+  h.add(HTTP_HEADER_ACCEPT, kAccept);
+  h.add(HTTP_HEADER_ACCEPT_ENCODING, kEncoding);
+  h.add(HTTP_HEADER_ACCEPT_LANGUAGE, kLanguage);
+  h.add(HTTP_HEADER_CONTENT_LENGTH, kLength);
+  h.add(HTTP_HEADER_CONNECTION, kConn);
+  h.add(HTTP_HEADER_USER_AGENT, kUA);
+  h.add(HTTP_HEADER_CACHE_CONTROL, kCache);
+  h.add(HTTP_HEADER_PRAGMA, kCache);
+  h.add(HTTP_HEADER_REFERER, kHost);
+}
+
+}
+
+BENCHMARK(vector_headers_typical_request, numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    VectorHeaders h;
+    addTypicalRequest(h);
+    doNotOptimizeAway(h.codes.size());
+  }
+}
+
+BENCHMARK_RELATIVE(inline_headers_typical_request, numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    HTTPHeaders h;
+    addTypicalRequest(h);
+    doNotOptimizeAway(h.size());
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::runBenchmarks();
+  return 0;
+}
@@ -16,6 +16,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/utils/ObjectPool.h>
 #include <proxygen/lib/utils/TestUtils.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -66,6 +67,34 @@ TEST(HTTPMessage, TestParseCookiesMultipleCookies) {
   EXPECT_EQ(msg.getCookie("Name"), "");
 }
 
+TEST(HTTPMessage, TestParseCookiesMany) {
+  HTTPMessage msg;
+
+  // enough of them for the sorted index, with separators past the first
+  // 16 bytes of each header
+  string cookies;
+  for (int i = 39; i >= 0; i--) {
+    cookies += folly::to<string>("cookie_", i, "=value_", i, "; ");
+  }
+  msg.getHeaders().add("Cookie", cookies + "dup=first; flag");
+  msg.getHeaders().add("Cookie", "dup=second;  spaced = out  ;a=b=c");
+  for (int i = 0; i < 40; i++) {
+    EXPECT_EQ(msg.getCookie(folly::to<string>("cookie_", i)),
+              folly::to<string>("value_", i));
+  }
+  EXPECT_EQ(msg.getCookie("dup"), "first");
+  EXPECT_EQ(msg.getCookie("flag"), "");
+  EXPECT_EQ(msg.getCookie("spaced"), "out");
+  EXPECT_EQ(msg.getCookie("a"), "b=c");
+  EXPECT_EQ(msg.getCookie("cookie_40"), "");
+  EXPECT_EQ(msg.getCookie(""), "");
+
+  msg.getHeaders().set("Cookie", "one=1");
+  msg.unparseCookies();
+  EXPECT_EQ(msg.getCookie("one"), "1");
+  EXPECT_EQ(msg.getCookie("dup"), "");
+}
+
 TEST(HTTPMessage, TestParseQueryParamsSimple) {
   HTTPMessage msg;
   string url = "/test?seq=123456&userid=1256679245&dup=1&dup=2&helloWorld"
@@ -133,6 +162,70 @@ TEST(HTTPMessage, TestParseQueryParamsComplex) {
   }
 }
 
+TEST(HTTPMessage, TestQueryParamPieces) {
+  HTTPMessage msg;
+  msg.setURL("/test?a=1&b=x%20y&a=2&c");
+
+  auto a = msg.getQueryParamPiece("a");
+  EXPECT_EQ("2", a);
+  const auto& query = msg.getQueryString();
+  EXPECT_TRUE(a.begin() >= query.data() &&
+              a.end() <= query.data() + query.size());
+  EXPECT_EQ("x%20y", msg.getQueryParamPiece("b"));
+  EXPECT_EQ("x y", msg.getDecodedQueryParam("b"));
+  EXPECT_TRUE(msg.hasQueryParam("c"));
+  EXPECT_TRUE(msg.getQueryParamPiece("d").empty());
+  EXPECT_EQ(nullptr, msg.getQueryParamPtr("d"));
+
+  // changing the query string rebuilds the index
+  EXPECT_TRUE(msg.setQueryParam("d", "4"));
+  EXPECT_EQ("4", msg.getQueryParamPiece("d"));
+  EXPECT_EQ("2", msg.getQueryParamPiece("a"));
+  EXPECT_EQ(4, msg.getQueryParams().size());
+
+  // copies index their own query string
+  HTTPMessage copy(msg);
+  msg.setURL("/other?a=5");
+  EXPECT_EQ("2", copy.getQueryParamPiece("a"));
+  EXPECT_EQ("5", msg.getQueryParamPiece("a"));
+}
+
+TEST(HTTPMessage, TestSharedHeaders) {
+  HTTPMessage msg;
+  msg.getHeaders().add(HTTP_HEADER_COOKIE, "id=1");
+  msg.getHeaders().add("X-Fanout", "a");
+  EXPECT_EQ("1", msg.getCookie("id"));
+  msg.shareHeaders();
+  EXPECT_TRUE(msg.headersShared());
+
+  // copies share the set until something asks to write to it
+  HTTPMessage copy(msg);
+  const HTTPMessage& constCopy = copy;
+  EXPECT_TRUE(copy.headersShared());
+  EXPECT_EQ(&msg.getHeaders(), &constCopy.getHeaders());
+  EXPECT_EQ("a", constCopy.getHeaders().getSingleOrEmpty("X-Fanout"));
+  EXPECT_EQ("1", copy.getCookie("id"));
+
+  copy.getHeaders().set("X-Fanout", "b");
+  EXPECT_FALSE(copy.headersShared());
+  EXPECT_EQ("b", copy.getHeaders().getSingleOrEmpty("X-Fanout"));
+  EXPECT_EQ("1", copy.getCookie("id"));
+  const HTTPMessage& constMsg = msg;
+  EXPECT_EQ("a", constMsg.getHeaders().getSingleOrEmpty("X-Fanout"));
+
+  // ensureHostHeader() only unshares when it has to add the header
+  HTTPMessage other;
+  other = msg;
+  EXPECT_TRUE(other.headersShared());
+  other.setDstAddress(folly::SocketAddress("127.0.0.1", 80));
+  other.ensureHostHeader();
+  EXPECT_FALSE(other.headersShared());
+  EXPECT_EQ("127.0.0.1", other.getHeaders().getSingleOrEmpty(HTTP_HEADER_HOST));
+  other.shareHeaders();
+  other.ensureHostHeader();
+  EXPECT_TRUE(other.headersShared());
+}
+
 TEST(HTTPMessage, TestHeaderPreservation) {
   HTTPMessage msg;
   HTTPHeaders& hdrs = msg.getHeaders();
@@ -212,6 +305,25 @@ TEST(HTTPMessage, TestProxification) {
   EXPECT_FALSE(msg.wantsKeepalive());
 }
 
+TEST(HTTPMessage, TestSharedAddress) {
+  auto client = std::make_shared<CachedSocketAddress>(
+    folly::SocketAddress("74.125.127.9", 1987));
+  HTTPMessage msg1;
+  HTTPMessage msg2;
+  msg1.setClientAddress(client);
+  msg2.setClientAddress(client);
+
+  EXPECT_EQ("74.125.127.9", msg1.getClientIP());
+  EXPECT_EQ("1987", msg2.getClientPort());
+  // both read the strings formatted once by the shared instance
+  EXPECT_EQ(&msg1.getClientIP(), &msg2.getClientIP());
+  EXPECT_EQ(client->getAddress(), msg2.getClientAddress());
+
+  HTTPMessage unset;
+  EXPECT_EQ("", unset.getDstIP());
+  EXPECT_EQ("", unset.getDstPort());
+}
+
 TEST(HTTPMessage, TestKeepaliveCheck) {
   {
     HTTPMessage msg;
@@ -353,6 +465,27 @@ TEST(HTTPMessage, TestMethod) {
   msg.setMethod(HTTPMethod::CONNECT);
   EXPECT_EQ("CONNECT", msg.getMethodString());
   EXPECT_EQ(HTTPMethod::CONNECT, msg.getMethod());
+
+  msg.setMethod("options");
+  EXPECT_EQ(HTTPMethod::OPTIONS, msg.getMethod());
+  msg.setMethod("PUSH");
+  EXPECT_EQ("PUSH", msg.getMethodString());
+  EXPECT_EQ(boost::none, msg.getMethod());
+  msg.setMethod("GETS");
+  EXPECT_EQ(boost::none, msg.getMethod());
+}
+
+TEST(HTTPMethod, StringToMethod) {
+  for (auto method : {HTTPMethod::GET, HTTPMethod::POST, HTTPMethod::OPTIONS,
+                      HTTPMethod::DELETE, HTTPMethod::HEAD,
+                      HTTPMethod::CONNECT, HTTPMethod::PUT,
+                      HTTPMethod::TRACE}) {
+    EXPECT_EQ(method, stringToMethod(methodToString(method)));
+  }
+  EXPECT_EQ(HTTPMethod::DELETE, stringToMethod("delete"));
+  EXPECT_EQ(boost::none, stringToMethod(""));
+  EXPECT_EQ(boost::none, stringToMethod("PATCH"));
+  EXPECT_EQ(boost::none, stringToMethod("GOT"));
 }
 
 void testPathAndQuery(const string& url,
@@ -384,6 +517,95 @@ TEST(HTTPHeaders, AddStringPiece) {
   EXPECT_EQ("value", headers.getSingleOrEmpty("name"));
 }
 
+TEST(HTTPHeaders, ManyUncommonNames) {
+  HTTPHeaders headers;
+  for (int i = 0; i < 20; ++i) {
+    headers.add(folly::to<string>("X-Custom-", i), folly::to<string>(i));
+  }
+
+  // the first lookups go through the codes, later ones through the tags
+  for (int pass = 0; pass < 2; ++pass) {
+    EXPECT_EQ("3", headers.getSingleOrEmpty(string("x-custom-3")));
+    EXPECT_EQ("19", headers.getSingleOrEmpty(string("X-CUSTOM-19")));
+    EXPECT_FALSE(headers.exists("X-Custom-20"));
+  }
+
+  headers.add("X-Custom-20", "20");
+  EXPECT_TRUE(headers.exists("x-custom-20"));
+  EXPECT_TRUE(headers.remove("X-Custom-3"));
+  EXPECT_FALSE(headers.exists("X-Custom-3"));
+  headers.add("X-Custom-3", "new");
+  EXPECT_EQ("new", headers.getSingleOrEmpty(string("X-Custom-3")));
+
+  HTTPHeaders copy(headers);
+  EXPECT_EQ("20", copy.getSingleOrEmpty(string("x-custom-20")));
+  HTTPHeaders moved(std::move(copy));
+  EXPECT_EQ("new", moved.getSingleOrEmpty(string("x-custom-3")));
+}
+
+TEST(HTTPHeaders, ViewFromCodec) {
+  auto buf = folly::IOBuf::copyBuffer("www.facebook.com|text/html");
+  folly::StringPiece data((const char*)buf->data(), buf->length());
+  folly::StringPiece host = data.split_step('|');
+
+  HTTPHeaders headers;
+  headers.addViewFromCodec("Host", 4, host, *buf);
+  headers.addViewFromCodec("X-Type", 6, data, *buf);
+  EXPECT_TRUE(headers.hasPinnedIngress());
+
+  // Views point straight into the ingress buffer
+  EXPECT_EQ(host.data(), headers.getSingleOrEmptyView(HTTP_HEADER_HOST).data());
+  EXPECT_EQ("text/html", headers.getSingleOrEmptyView("X-Type"));
+
+  // The pinned buffer keeps the views alive after the caller drops it
+  buf.reset();
+  EXPECT_EQ("www.facebook.com", headers.getSingleOrEmpty(HTTP_HEADER_HOST));
+
+  HTTPHeaders copy(headers);
+  EXPECT_FALSE(copy.hasPinnedIngress());
+  EXPECT_EQ("text/html", copy.getSingleOrEmpty("X-Type"));
+
+  headers.unpinIngress();
+  EXPECT_FALSE(headers.hasPinnedIngress());
+  EXPECT_EQ("text/html", headers.getSingleOrEmpty("X-Type"));
+  EXPECT_EQ(2, headers.size());
+}
+
+TEST(HTTPHeaders, NameViewFromCodec) {
+  auto buf = folly::IOBuf::copyBuffer("X-Type|text/html|X-Other|1");
+  folly::StringPiece data((const char*)buf->data(), buf->length());
+  folly::StringPiece type = data.split_step('|');
+  folly::StringPiece typeValue = data.split_step('|');
+  folly::StringPiece other = data.split_step('|');
+
+  HTTPHeaders headers;
+  headers.addViewFromCodec(type.data(), type.size(), typeValue, *buf);
+  headers.addViewFromCodec(other.data(), other.size(), data, *buf);
+  // passed through without copying the names either
+  headers.forEachWithCodeView([&] (HTTPHeaderCode,
+                                   folly::StringPiece name,
+                                   folly::StringPiece) {
+    EXPECT_GE(name.data(), (const char*)buf->data());
+    EXPECT_LT(name.data(), (const char*)buf->tail());
+  });
+  EXPECT_EQ("1", headers.getSingleOrEmptyView("x-other"));
+
+  HTTPHeaders stripped;
+  EXPECT_TRUE(headers.transferHeaderIfPresent("X-TYPE", stripped));
+
+  // the transferred name was copied out
+  buf.reset();
+  stripped.forEach([&] (const string& name, const string& value) {
+    EXPECT_EQ("X-Type", name);
+    EXPECT_EQ("text/html", value);
+  });
+  HTTPHeaders copy(headers);
+  headers.unpinIngress();
+  EXPECT_TRUE(headers.exists("X-Other"));
+  EXPECT_TRUE(copy.exists("X-Other"));
+  EXPECT_EQ(2, copy.size());
+}
+
 void testRemoveQueryParam(const string& url,
                           const string& queryParam,
                           const string& expectedUrl,
@@ -460,3 +682,124 @@ TEST(HTTPMessage, SetQueryParamTests) {
                     "localhost:80/foo?param2=b#qqq",
                     "param2=b");
 }
+
+TEST(HTTPMessage, Reset) {
+  HTTPMessage msg;
+  msg.setURL("/foo?bar=1");
+  msg.setMethod(HTTPMethod::POST);
+  msg.setHTTPVersion(1, 1);
+  msg.setIsChunked(true);
+  msg.setWantsKeepalive(false);
+  msg.getHeaders().add("X-Custom", "value");
+  msg.getHeaders().add(HTTP_HEADER_COOKIE, "a=b");
+  EXPECT_EQ("b", msg.getCookie("a"));
+  EXPECT_EQ("1", msg.getQueryParam("bar"));
+
+  msg.reset();
+  EXPECT_EQ(0, msg.getHeaders().size());
+  EXPECT_EQ("", msg.getCookie("a"));
+  EXPECT_FALSE(msg.getIsChunked());
+  EXPECT_TRUE(msg.wantsKeepalive());
+  EXPECT_EQ("1.0", msg.getVersionString());
+  // the type is no longer fixed to a request
+  msg.setStatusCode(200);
+  EXPECT_EQ(200, msg.getStatusCode());
+}
+
+TEST(HTTPMessage, LazyMembers) {
+  HTTPMessage msg;
+  EXPECT_EQ(0, msg.getStrippedPerHopHeaders().size());
+  EXPECT_TRUE(msg.getPathParams().empty());
+  EXPECT_EQ("", msg.getPathParam("id"));
+  msg.setHTTPVersion(1, 1);
+  EXPECT_EQ("1.1", msg.getVersionString());
+  msg.setHTTPVersion(2, 10);
+  EXPECT_EQ("2.10", msg.getVersionString());
+
+  msg.setURL("/item?a=1");
+  msg.setPathParam("id", "7");
+  msg.getHeaders().add(HTTP_HEADER_CONNECTION, "close");
+  msg.stripPerHopHeaders();
+  EXPECT_EQ("1", msg.getQueryParams().at("a"));
+
+  HTTPMessage copy(msg);
+  EXPECT_EQ("7", copy.getPathParam("id"));
+  EXPECT_EQ(1, copy.getStrippedPerHopHeaders().size());
+  EXPECT_EQ("1", copy.getQueryParam("a"));
+  EXPECT_FALSE(copy.getHeaders().exists(HTTP_HEADER_CONNECTION));
+
+  msg.reset();
+  EXPECT_EQ(0, msg.getStrippedPerHopHeaders().size());
+  EXPECT_TRUE(msg.getPathParams().empty());
+  EXPECT_TRUE(msg.getQueryParams().empty());
+}
+
+TEST(HTTPMessage, Pool) {
+  auto& pool = ObjectPool<HTTPMessage>::get();
+  auto hits = pool.getHits();
+  auto misses = pool.getMisses();
+
+  auto msg = pool.acquire();
+  EXPECT_EQ(hits + misses + 1, pool.getHits() + pool.getMisses());
+  hits = pool.getHits();
+  msg->setStatusCode(404);
+  msg->getHeaders().add(HTTP_HEADER_CONTENT_LENGTH, "0");
+  HTTPMessage* raw = msg.get();
+  pool.recycle(std::move(msg));
+  EXPECT_LE(1, pool.size());
+
+  // the last recycled message comes out first
+  msg = pool.acquire();
+  EXPECT_EQ(hits + 1, pool.getHits());
+  EXPECT_EQ(raw, msg.get());
+  EXPECT_EQ(0, msg->getHeaders().size());
+  msg->setURL("/");
+  EXPECT_EQ("/", msg->getPath());
+
+  pool.setMaxSize(0);
+  pool.recycle(std::move(msg));
+  EXPECT_EQ(0, pool.size());
+  pool.setMaxSize(ObjectPool<HTTPMessage>::kDefaultMaxSize);
+}
+
+TEST(HTTPMessage, MemoryUsage) {
+  HTTPMessage msg;
+  EXPECT_EQ(sizeof(HTTPMessage), msg.getMemoryUsage());
+
+  // short enough to stay inside the strings
+  msg.getHeaders().add(HTTP_HEADER_HOST, "a");
+  EXPECT_EQ(sizeof(HTTPMessage), msg.getMemoryUsage());
+
+  const std::string value(1000, 'v');
+  msg.getHeaders().add("X-Custom-Header-Of-Some-Length", value);
+  auto withValue = msg.getMemoryUsage();
+  EXPECT_LE(sizeof(HTTPMessage) + value.size(), withValue);
+
+  msg.setURL("/" + std::string(500, 'p'));
+  EXPECT_LE(withValue + 500, msg.getMemoryUsage());
+}
+
+TEST(HTTPMessage, Deadline) {
+  HTTPMessage msg;
+  auto now = getCurrentTime();
+  EXPECT_FALSE(msg.hasDeadline());
+  EXPECT_FALSE(msg.isExpired(now));
+  EXPECT_EQ(std::chrono::milliseconds::max(), msg.getRemainingBudget(now));
+
+  msg.setDeadline(now + std::chrono::milliseconds(100));
+  EXPECT_TRUE(msg.hasDeadline());
+  EXPECT_FALSE(msg.isExpired(now));
+  EXPECT_EQ(std::chrono::milliseconds(100), msg.getRemainingBudget(now));
+  // rounded up, only zero once expired
+  EXPECT_EQ(std::chrono::milliseconds(1), msg.getRemainingBudget(
+              now + std::chrono::microseconds(99500)));
+
+  HTTPMessage copy(msg);
+  EXPECT_EQ(msg.getDeadline(), copy.getDeadline());
+  EXPECT_TRUE(copy.isExpired(now + std::chrono::milliseconds(100)));
+  EXPECT_EQ(std::chrono::milliseconds(0), copy.getRemainingBudget(
+              now + std::chrono::milliseconds(200)));
+
+  msg.reset();
+  EXPECT_FALSE(msg.hasDeadline());
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/small_vector.h>
+#include <proxygen/lib/http/RFC2616.h>
+#include <vector>
+
+using namespace folly;
+using namespace proxygen;
+
+namespace {
+
+const std::string kAcceptEncoding("gzip, deflate, sdch;q=0.8, *;q=0.1");
+const std::string kAcceptLanguage("en-US,en;q=0.8,fr;q=0.6,de;q=0.4");
+
+}
+
+BENCHMARK(parse_qvalues_vector, numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    std::vector<RFC2616::TokenQPair> output;
+    RFC2616::parseQvalues(kAcceptEncoding, output);
+    RFC2616::parseQvalues(kAcceptLanguage, output);
+    doNotOptimizeAway(output.size());
+  }
+}
+
+BENCHMARK_RELATIVE(parse_qvalues_small_vector, numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    folly::small_vector<RFC2616::TokenQPair, 8> output;
+    RFC2616::parseQvalues(kAcceptEncoding, output);
+    RFC2616::parseQvalues(kAcceptLanguage, output);
+    doNotOptimizeAway(output.size());
+  }
+}
+
+BENCHMARK_RELATIVE(qvalue_reader, numIters) {
+  for (unsigned i = 0; i < numIters; ++i) {
+    double sum = 0;
+    RFC2616::TokenQPair pair;
+    RFC2616::QvalueReader encoding(kAcceptEncoding);
+    while (encoding.next(pair)) {
+      sum += pair.second;
+    }
+    RFC2616::QvalueReader language(kAcceptLanguage);
+    while (language.next(pair)) {
+      sum += pair.second;
+    }
+    doNotOptimizeAway(sum);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  folly::runBenchmarks();
+  return 0;
+}
@@ -7,7 +7,9 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/small_vector.h>
 #include <gtest/gtest.h>
+#include <proxygen/lib/http/HTTPHeaders.h>
 #include <proxygen/lib/http/RFC2616.h>
 
 using namespace proxygen;
@@ -125,3 +127,46 @@ TEST(QvalueTest, invalids) {
   output.clear();
 
 }
+
+TEST(QvalueTest, acceptEncoding) {
+  HTTPHeaders headers;
+  EXPECT_DOUBLE_EQ(0, RFC2616::getAcceptEncodingQvalue(headers, "gzip"));
+
+  headers.add(HTTP_HEADER_ACCEPT_ENCODING, "GZIP ;q=0.5, deflate");
+  EXPECT_DOUBLE_EQ(0.5, RFC2616::getAcceptEncodingQvalue(headers, "gzip"));
+  EXPECT_DOUBLE_EQ(1, RFC2616::getAcceptEncodingQvalue(headers, "deflate"));
+  EXPECT_DOUBLE_EQ(0, RFC2616::getAcceptEncodingQvalue(headers, "br"));
+
+  // an explicit entry wins over the wildcard, in any header
+  headers.add(HTTP_HEADER_ACCEPT_ENCODING, "*;q=0.2, deflate;q=0");
+  EXPECT_DOUBLE_EQ(0.2, RFC2616::getAcceptEncodingQvalue(headers, "br"));
+  EXPECT_DOUBLE_EQ(0, RFC2616::getAcceptEncodingQvalue(headers, "deflate"));
+}
+
+TEST(QvalueTest, reader) {
+  string value("gzip;q=1.0, identity; q=0.5, ;q=0.1, *;q=0");
+  RFC2616::QvalueReader reader(value);
+  RFC2616::TokenQPair pair;
+
+  EXPECT_TRUE(reader.next(pair));
+  EXPECT_EQ("gzip", pair.first);
+  EXPECT_DOUBLE_EQ(1, pair.second);
+  EXPECT_TRUE(reader.next(pair));
+  EXPECT_EQ("identity", pair.first);
+  EXPECT_DOUBLE_EQ(0.5, pair.second);
+  EXPECT_TRUE(reader.wellFormed());
+  // the empty token is skipped, and marks the string malformed
+  EXPECT_TRUE(reader.next(pair));
+  EXPECT_EQ("*", pair.first);
+  EXPECT_DOUBLE_EQ(0, pair.second);
+  EXPECT_FALSE(reader.next(pair));
+  EXPECT_FALSE(reader.wellFormed());
+}
+
+TEST(QvalueTest, smallVector) {
+  folly::small_vector<RFC2616::TokenQPair, 4> output;
+  EXPECT_TRUE(RFC2616::parseQvalues("da, en-gb;q=0.8, en;q=0.7", output));
+  ASSERT_EQ(3, output.size());
+  EXPECT_EQ("en-gb", output[1].first);
+  EXPECT_DOUBLE_EQ(0.7, output[2].second);
+}
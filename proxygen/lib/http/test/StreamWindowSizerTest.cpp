@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/StreamWindowSizer.h>
+
+using namespace proxygen;
+
+TEST(StreamWindowSizerTest, GrowsWhileKeepingUp) {
+  StreamWindowSizer sizer(16384, 200000);
+  ASSERT_EQ(sizer.onWindowUpdate(65536), 65536);
+  ASSERT_EQ(sizer.onWindowUpdate(65536), 131072);
+  ASSERT_EQ(sizer.onWindowUpdate(131072), 131072);
+  ASSERT_EQ(sizer.onWindowUpdate(131072), 200000);
+  ASSERT_EQ(sizer.onWindowUpdate(200000), 200000);
+  ASSERT_EQ(sizer.onWindowUpdate(200000), 200000);
+}
+
+TEST(StreamWindowSizerTest, ShrinksWhenPausing) {
+  StreamWindowSizer sizer(16384, 200000);
+  // a single pause is plain back pressure
+  sizer.onPause();
+  ASSERT_EQ(sizer.onWindowUpdate(65536), 65536);
+  // and restarts the count towards growing
+  ASSERT_EQ(sizer.onWindowUpdate(65536), 65536);
+  sizer.onPause();
+  sizer.onPause();
+  ASSERT_EQ(sizer.onWindowUpdate(65536), 32768);
+  sizer.onPause();
+  sizer.onPause();
+  ASSERT_EQ(sizer.onWindowUpdate(32768), 16384);
+  sizer.onPause();
+  sizer.onPause();
+  ASSERT_EQ(sizer.onWindowUpdate(16384), 16384);
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/UpstreamDemand.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+namespace {
+
+void addRequests(UpstreamDemand& demand, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    demand.onRequest();
+  }
+}
+
+}
+
+TEST(UpstreamDemandTest, SteadyDemand) {
+  UpstreamDemand demand;
+  EXPECT_TRUE(demand.isIdle());
+  demand.onConnect(milliseconds(100));
+  // 10 requests per second, 2 at a time, for long enough to settle
+  for (int i = 0; i < 200; i++) {
+    addRequests(demand, 10);
+    demand.tick(milliseconds(1000), 2);
+  }
+  EXPECT_FALSE(demand.isIdle());
+  EXPECT_NEAR(1, demand.getGrowth(), 0.01);
+  // 2 busy, and 1 for the requests of a 100ms connect
+  EXPECT_EQ(3, demand.getTarget(16));
+  EXPECT_EQ(2, demand.getTarget(2));
+}
+
+TEST(UpstreamDemandTest, RisingDemand) {
+  UpstreamDemand demand;
+  demand.onConnect(milliseconds(100));
+  for (int i = 0; i < 200; i++) {
+    addRequests(demand, 10);
+    demand.tick(milliseconds(1000), 1);
+  }
+  uint32_t steady = demand.getTarget(64);
+  addRequests(demand, 40);
+  demand.tick(milliseconds(1000), 1);
+  EXPECT_GT(demand.getGrowth(), 2);
+  EXPECT_GT(demand.getTarget(64), steady);
+}
+
+TEST(UpstreamDemandTest, DiesDown) {
+  UpstreamDemand demand;
+  addRequests(demand, 5);
+  demand.tick(milliseconds(500), 1);
+  EXPECT_FALSE(demand.isIdle());
+  // never connected, the busy sessions scaled up by the burst
+  EXPECT_EQ(2, demand.getTarget(16));
+  for (int i = 0; i < 500; i++) {
+    demand.tick(milliseconds(1000), 0);
+  }
+  EXPECT_TRUE(demand.isIdle());
+  EXPECT_EQ(0, demand.getTarget(16));
+}
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/http/WindowAutoTuner.h>
+
+using namespace proxygen;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+TEST(WindowAutoTunerTest, GrowsToBDP) {
+  WindowAutoTuner tuner(1 << 24);
+  TimePoint now = getCurrentTime();
+  // the first update has nothing to compare with
+  ASSERT_EQ(tuner.onWindowUpdate(65536, 32768, now, milliseconds(100)),
+            65536);
+  // 32KB in 10ms is 3.2MB/s, or 320KB per 100ms RTT
+  now += milliseconds(10);
+  ASSERT_EQ(tuner.onWindowUpdate(65536, 32768, now, milliseconds(100)),
+            2 * 327680);
+}
+
+TEST(WindowAutoTunerTest, LargeEnough) {
+  WindowAutoTuner tuner(1 << 24);
+  TimePoint now = getCurrentTime();
+  tuner.onWindowUpdate(65536, 32768, now, milliseconds(1));
+  // 32KB in 10ms is only 32KB per 10ms RTT
+  now += milliseconds(10);
+  ASSERT_EQ(tuner.onWindowUpdate(65536, 32768, now, milliseconds(10)),
+            65536);
+  // without an RTT nothing changes
+  now += milliseconds(1);
+  ASSERT_EQ(tuner.onWindowUpdate(65536, 32768, now, microseconds(0)), 65536);
+}
+
+TEST(WindowAutoTunerTest, Ceiling) {
+  WindowAutoTuner tuner(100000);
+  TimePoint now = getCurrentTime();
+  tuner.onWindowUpdate(65536, 32768, now, milliseconds(100));
+  now += milliseconds(1);
+  ASSERT_EQ(tuner.onWindowUpdate(65536, 32768, now, milliseconds(100)),
+            100000);
+  now += milliseconds(1);
+  ASSERT_EQ(tuner.onWindowUpdate(100000, 50000, now, milliseconds(100)),
+            100000);
+}
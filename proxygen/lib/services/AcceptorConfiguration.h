@@ -14,6 +14,10 @@
 #include <folly/String.h>
 #include <folly/experimental/wangle/acceptor/ServerSocketConfig.h>
 #include <list>
+#include <memory>
+#include <proxygen/lib/ssl/SSLCertCache.h>
+#include <proxygen/lib/ssl/SSLSessionCache.h>
+#include <proxygen/lib/ssl/SSLTicketKeys.h>
 #include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -22,6 +26,9 @@
 
 namespace proxygen {
 
+class SlowTransactionSampler;
+struct EgressShaperConfig;
+
 /**
  * Configuration for a single Acceptor.
  *
@@ -42,6 +49,13 @@ struct AcceptorConfiguration : public folly::ServerSocketConfig {
    */
   std::chrono::milliseconds transactionIdleTimeout{600000};
 
+  /**
+   * The number of milliseconds a request may take to send its headers,
+   * from its first byte, before we time it out, 0 for the
+   * transactionIdleTimeout. See HTTPSession::setHeaderTimeouts().
+   */
+  std::chrono::milliseconds headerTimeout{0};
+
   /**
    * The compression level to use for SPDY headers with responses from
    * this Acceptor.
@@ -53,6 +67,140 @@ struct AcceptorConfiguration : public folly::ServerSocketConfig {
    */
   std::string plaintextProtocol;
 
+  /**
+   * The capacity of the header compression tables of the sessions of
+   * this Acceptor, advertised in SETTINGS for the protocols that
+   * negotiate it.
+   */
+  uint32_t headerTableSize{4096};
+
+  /**
+   * Memory budget in bytes for the header compression tables of all the
+   * sessions of the thread this Acceptor runs on, 0 for no limit. See
+   * HeaderTableBudget.
+   */
+  uint64_t headerTableBudget{0};
+
+  /**
+   * Memory budget in bytes for the buffers of all the sessions of the
+   * thread this Acceptor runs on, and of all the threads of the process,
+   * 0 for no limit. See MemoryBudget.
+   */
+  uint64_t memoryBudget{0};
+  uint64_t processMemoryBudget{0};
+
+  /**
+   * The most writes a session of this Acceptor hands to its socket per
+   * event loop iteration, and the number of bytes of egress it gathers
+   * from several transactions into one write, 0 for one transaction per
+   * write. See HTTPSession::setEgressBatching().
+   */
+  uint32_t maxWritesPerLoop{32};
+  uint32_t egressBatchBytes{0};
+
+  /**
+   * If true, the sessions of this Acceptor write in turns from one loop
+   * callback of their thread, at most egressBytesPerLoop together per
+   * loop iteration, 0 for no limit. See EgressFlusher.
+   */
+  bool sharedEgressFlusher{false};
+  uint64_t egressBytesPerLoop{0};
+
+  /**
+   * The most bytes of ingress a session of this Acceptor parses at once
+   * before it lets the other sessions of its thread run, 0 for no limit.
+   * See HTTPSession::setIngressBudget().
+   */
+  uint64_t ingressBytesPerLoop{0};
+
+  /**
+   * If set, the sessions of this Acceptor share an EgressShaper per
+   * thread with these classes.
+   */
+  std::shared_ptr<const EgressShaperConfig> egressShaping;
+
+  /**
+   * If true, the sessions of this Acceptor free their buffers once they
+   * have been idle for hibernateTimeout. See
+   * HTTPSession::setHibernateTimeout().
+   */
+  bool hibernateIdleSessions{false};
+  std::chrono::milliseconds hibernateTimeout{1000};
+
+  /**
+   * If greater than 1, the HTTP/1.x sessions of this Acceptor hand up to
+   * this many pipelined requests to their handlers at once, holding the
+   * responses that are ready early, up to maxPipelinedBufferBytes of body
+   * per session, until they can be written in order. See
+   * HTTPSession::setPipelining().
+   */
+  uint32_t maxPipelinedRequests{0};
+  uint64_t maxPipelinedBufferBytes{1 << 20};
+
+  /**
+   * If true, the HTTP/1.x sessions of this Acceptor hand the body of each
+   * read to the transaction at once, without the chunk boundaries. See
+   * HTTP1xCodec::setCoalesceIngressBody().
+   */
+  bool coalesceIngressBody{false};
+
+  /**
+   * If true, the HTTP/1.x sessions of this Acceptor keep the wire lines of
+   * the request headers, for proxies that send the requests on over
+   * HTTP/1.x. See HTTP1xCodec::setKeepRawHeaders().
+   */
+  bool keepRawHeaders{false};
+
+  /**
+   * If true, the plaintext HTTP/1.x sessions of this Acceptor switch to
+   * HTTP/2 when the client sends the HTTP/2 connection preface, or asks
+   * for an Upgrade to h2c in its first request. See
+   * HTTPSession::setH2CCodec().
+   */
+  bool allowH2C{false};
+
+  /**
+   * TLS session cache and session ticket keys, usually shared by the
+   * Acceptors of all the threads so that clients resume on any of them.
+   * Null to leave sessions to the per-thread SSL contexts. See
+   * SSLSessionCache and SSLTicketKeys.
+   */
+  std::shared_ptr<SSLSessionCache> sslSessionCache;
+  std::shared_ptr<SSLTicketKeys> sslTicketKeys;
+
+  /**
+   * Certificates selected by SNI and loaded as they are asked for,
+   * usually shared by the Acceptors of all the threads. Null to serve
+   * only the certificates of sslContextConfigs. See SSLCertCache.
+   */
+  std::shared_ptr<SSLCertCache> sslCertCache;
+
+  /**
+   * If true, TLS connections are handed to the kernel once the handshake
+   * is done, where it supports their cipher. See KernelTLS.
+   */
+  bool kernelTLS{false};
+
+  /**
+   * If true, the plaintext connections of this Acceptor do their I/O
+   * through an io_uring per thread, when the kernel supports it. See
+   * IoUringTransport.
+   */
+  bool ioUring{false};
+
+  /**
+   * If set, the sessions of this Acceptor record the state of their
+   * transactions still open after its threshold. Usually shared by the
+   * Acceptors of all the threads. See SlowTransactionSampler.
+   */
+  std::shared_ptr<SlowTransactionSampler> slowTransactionSampler;
+
+  /**
+   * If not 0, the sessions of this Acceptor read TCP_INFO as their
+   * transactions end, at most once per interval each. See
+   * HTTPSession::setTCPInfoSampleInterval().
+   */
+  std::chrono::milliseconds tcpInfoSampleInterval{0};
 };
 
 } // proxygen
@@ -11,8 +11,12 @@
 
 #include <folly/experimental/wangle/acceptor/Acceptor.h>
 #include <folly/io/async/AsyncServerSocket.h>
+#include <proxygen/lib/http/session/HeaderTableBudget.h>
+#include <proxygen/lib/http/session/MemoryBudget.h>
+#include <proxygen/lib/http/session/SlowTransactionSampler.h>
 #include <proxygen/lib/services/AcceptorConfiguration.h>
 #include <proxygen/lib/utils/AsyncTimeoutSet.h>
+#include <proxygen/lib/utils/HHWheelTimer.h>
 
 namespace proxygen {
 
@@ -36,11 +40,54 @@ class HTTPAcceptor : public folly::Acceptor {
     return transactionTimeouts_.get();
   }
 
+  /**
+   * Access the timer that holds all the timeouts of this acceptor's
+   * EventBase, including the ones of getTransactionTimeoutSet().
+   */
+  HHWheelTimer* getWheelTimer() {
+    return wheelTimer_.get();
+  }
+
+  /**
+   * The timeouts with the threshold of the slowTransactionSampler of the
+   * configuration, null without one
+   */
+  AsyncTimeoutSet* getSlowTransactionTimeoutSet() {
+    return slowTransactionTimeouts_.get();
+  }
+
+  /**
+   * The timeouts with the headerTimeout of the configuration, null without
+   * one
+   */
+  AsyncTimeoutSet* getHeaderTimeoutSet() {
+    return headerTimeouts_.get();
+  }
+
   virtual void init(folly::AsyncServerSocket* serverSocket,
                     folly::EventBase* eventBase) {
     Acceptor::init(serverSocket, eventBase);
+    wheelTimer_.reset(new HHWheelTimer(eventBase));
     transactionTimeouts_.reset(new AsyncTimeoutSet(
-                                 eventBase, accConfig_.transactionIdleTimeout));
+                                 wheelTimer_.get(),
+                                 accConfig_.transactionIdleTimeout));
+    if (accConfig_.headerTimeout.count() > 0) {
+      headerTimeouts_.reset(new AsyncTimeoutSet(wheelTimer_.get(),
+                                                accConfig_.headerTimeout));
+    }
+    if (accConfig_.slowTransactionSampler) {
+      slowTransactionTimeouts_.reset(new AsyncTimeoutSet(
+        wheelTimer_.get(), accConfig_.slowTransactionSampler->getThreshold()));
+    }
+    if (accConfig_.headerTableBudget) {
+      HeaderTableBudget::get().setLimit(accConfig_.headerTableBudget);
+    }
+    if (accConfig_.memoryBudget) {
+      MemoryBudget::get().setLimit(accConfig_.memoryBudget);
+    }
+    if (accConfig_.processMemoryBudget) {
+      MemoryBudget::setProcessLimit(accConfig_.processMemoryBudget);
+    }
 
   }
 
@@ -49,7 +96,11 @@ class HTTPAcceptor : public folly::Acceptor {
  protected:
   AcceptorConfiguration accConfig_;
  private:
+  // declared first, the sets must be destroyed before it
+  HHWheelTimer::UniquePtr wheelTimer_;
   AsyncTimeoutSet::UniquePtr transactionTimeouts_;
+  AsyncTimeoutSet::UniquePtr slowTransactionTimeouts_;
+  AsyncTimeoutSet::UniquePtr headerTimeouts_;
   AsyncTimeoutSet::UniquePtr tcpEventsTimeouts_;
 };
 
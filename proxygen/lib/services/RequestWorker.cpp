@@ -14,6 +14,8 @@
 
 namespace proxygen {
 
+__thread RequestWorker* RequestWorker::currentRequestWorker_ = nullptr;
+
 RequestWorker::RequestWorker(FinishCallback& callback, uint8_t threadId)
     : WorkerThread(folly::EventBaseManager::get()),
       nextRequestId_(static_cast<uint64_t>(threadId) << 56),
@@ -26,12 +28,20 @@ uint64_t RequestWorker::nextRequestId() {
 
 void RequestWorker::flushStats() {
   CHECK(getEventBase()->isInEventBaseThread());
-  FOR_EACH_KV (service, worker, serviceWorkers_) {
-    worker->flushStats();
+  for (auto worker: serviceWorkers_) {
+    if (worker) {
+      worker->flushStats();
+    }
   }
 }
 
+void RequestWorker::setup() {
+  WorkerThread::setup();
+  currentRequestWorker_ = this;
+}
+
 void RequestWorker::cleanup() {
+  currentRequestWorker_ = nullptr;
   WorkerThread::cleanup();
   callback_.workerFinished(this);
 }
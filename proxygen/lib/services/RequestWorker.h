@@ -10,12 +10,12 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
+#include <proxygen/lib/services/Service.h>
 #include <proxygen/lib/services/WorkerThread.h>
+#include <vector>
 
 namespace proxygen {
 
-class Service;
 class ServiceWorker;
 
 /**
@@ -40,19 +40,26 @@ class RequestWorker : public WorkerThread {
 
   static uint64_t nextRequestId();
 
+  /**
+   * The RequestWorker of the calling thread, from a thread-local pointer
+   * rather than a dynamic_cast of getCurrentWorkerThread(), as it is
+   * looked up for every request
+   */
   static RequestWorker* getRequestWorker() {
-    RequestWorker* self = dynamic_cast<RequestWorker*>(
-      WorkerThread::getCurrentWorkerThread());
-    CHECK_NOTNULL(self);
-    return self;
+    CHECK_NOTNULL(currentRequestWorker_);
+    return currentRequestWorker_;
   }
 
   /**
    * Track the ServiceWorker objects in-use by this worker.
    */
   void addServiceWorker(Service* service, ServiceWorker* sw) {
-    CHECK(serviceWorkers_.find(service) == serviceWorkers_.end());
-    serviceWorkers_[service] = sw;
+    size_t id = service->getServiceId();
+    if (id >= serviceWorkers_.size()) {
+      serviceWorkers_.resize(id + 1, nullptr);
+    }
+    CHECK(!serviceWorkers_[id]);
+    serviceWorkers_[id] = sw;
   }
 
   /**
@@ -60,9 +67,9 @@ class RequestWorker : public WorkerThread {
    * RequestWorker
    */
   ServiceWorker* getServiceWorker(Service* service) const {
-    auto it = serviceWorkers_.find(service);
-    CHECK(it != serviceWorkers_.end());
-    return it->second;
+    size_t id = service->getServiceId();
+    CHECK(id < serviceWorkers_.size() && serviceWorkers_[id]);
+    return serviceWorkers_[id];
   }
 
   /**
@@ -73,14 +80,17 @@ class RequestWorker : public WorkerThread {
   void flushStats();
 
  private:
+  void setup() override;
   void cleanup() override;
 
+  static __thread RequestWorker* currentRequestWorker_;
+
   // The next request id within this thread. The id has its highest byte set to
   // the thread id, so is unique across the process.
   uint64_t nextRequestId_;
 
-  // The ServiceWorkers executing in this worker
-  std::map<Service*, ServiceWorker*> serviceWorkers_;
+  // The ServiceWorkers executing in this worker, by Service::getServiceId()
+  std::vector<ServiceWorker*> serviceWorkers_;
 
   FinishCallback& callback_;
 };
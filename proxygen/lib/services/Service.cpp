@@ -11,13 +11,21 @@
 
 #include <proxygen/lib/services/RequestWorker.h>
 #include <proxygen/lib/services/ServiceWorker.h>
+#include <vector>
 
 namespace proxygen {
 
-Service::Service() {
+namespace {
+
+std::atomic<uint32_t> nextServiceId{0};
+
+}
+
+Service::Service(): serviceId_(nextServiceId++) {
 }
 
 Service::~Service() {
+  stopExecutor();
 }
 
 void Service::addServiceWorker(std::unique_ptr<ServiceWorker> worker,
@@ -30,4 +38,18 @@ void Service::clearServiceWorkers() {
   workers_.clear();
 }
 
+void Service::startExecutor(const std::list<RequestWorker*>& workers,
+                            size_t threadsPerWorker) {
+  CHECK(!executor_);
+  std::vector<folly::EventBase*> eventBases;
+  for (auto worker: workers) {
+    eventBases.push_back(worker->getEventBase());
+  }
+  executor_.reset(new WorkStealingExecutor(eventBases, threadsPerWorker));
+}
+
+void Service::stopExecutor() {
+  executor_.reset();
+}
+
 } // proxygen
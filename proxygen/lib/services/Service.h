@@ -9,9 +9,12 @@
  */
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <folly/io/async/EventBase.h>
 #include <list>
 #include <memory>
+#include <proxygen/lib/utils/WorkStealingExecutor.h>
 
 namespace proxygen {
 
@@ -34,6 +37,14 @@ class Service {
   Service();
   virtual ~Service();
 
+  /**
+   * A small number unique to this Service in the process, for the
+   * RequestWorkers to index their ServiceWorkers with
+   */
+  uint32_t getServiceId() const {
+    return serviceId_;
+  }
+
   /**
    * Start the service.
    *
@@ -118,6 +129,30 @@ class Service {
    */
   void clearServiceWorkers();
 
+  /**
+   * Create the pool of threads that the ServiceWorkers of workers run their
+   * CPU heavy tasks on, see ServiceWorker::runCPUTask(). Call it from
+   * start(), before the workers add any task. The pool balances the tasks
+   * between the workers, so that one busy worker can use the threads of
+   * the idle ones.
+   */
+  void startExecutor(const std::list<RequestWorker*>& workers,
+                     size_t threadsPerWorker = 1);
+
+  /**
+   * The executor created by startExecutor(), nullptr if there is none
+   */
+  WorkStealingExecutor* getExecutor() const {
+    return executor_.get();
+  }
+
+  /**
+   * Wait for the running tasks and drop the others. Their callbacks would
+   * run in the workers, so call it once they stopped; otherwise the
+   * destructor does it.
+   */
+  void stopExecutor();
+
   /**
    * Start even when config_test_only is set - default to false
    */
@@ -130,8 +165,12 @@ class Service {
   Service(Service const &) = delete;
   Service& operator=(Service const &) = delete;
 
+  const uint32_t serviceId_;
+
   // Workers
   std::list<std::unique_ptr<ServiceWorker>> workers_;
+
+  std::unique_ptr<WorkStealingExecutor> executor_;
 };
 
 } // proxygen
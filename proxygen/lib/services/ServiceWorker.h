@@ -14,6 +14,9 @@
 #include <folly/io/async/AsyncServerSocket.h>
 #include <list>
 #include <memory>
+#include <proxygen/lib/services/RequestWorker.h>
+#include <proxygen/lib/services/Service.h>
+#include <proxygen/lib/utils/WorkStealingExecutor.h>
 
 namespace proxygen {
 
@@ -57,6 +60,17 @@ class ServiceWorker {
     return acceptors_;
   }
 
+  /**
+   * Run task on a thread of the Service's executor, see
+   * Service::startExecutor(), and the callback it returns, if any, back in
+   * the thread of this worker
+   */
+  void runCPUTask(WorkStealingExecutor::Task task) {
+    auto executor = service_->getExecutor();
+    CHECK(executor);
+    executor->add(worker_->getEventBase(), std::move(task));
+  }
+
   // Flush any thread-local stats that the service is tracking
   virtual void flushStats() {
   }
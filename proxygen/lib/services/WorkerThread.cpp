@@ -11,12 +11,44 @@
 
 #include <boost/thread.hpp>
 #include <folly/String.h>
+#include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <glog/logging.h>
+#include <proxygen/lib/utils/Time.h>
 #include <signal.h>
+#include <sys/socket.h>
 
 namespace proxygen {
 
+namespace {
+
+// Keeps an event registered, so that a blocking poll of an EventBase with
+// nothing else to wait on sleeps, as in loopForever(), instead of
+// returning at once
+class KeepAlive : public folly::AsyncTimeout {
+ public:
+  explicit KeepAlive(folly::EventBase* eventBase):
+      folly::AsyncTimeout(eventBase) {
+    timeoutExpired();
+  }
+
+  void timeoutExpired() noexcept override {
+    scheduleTimeout(kInterval);
+  }
+
+ private:
+  static const uint32_t kInterval = 3600 * 1000;
+};
+
+void addTime(std::atomic<uint64_t>& total, TimePoint start, TimePoint end) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    end - start).count();
+  total.store(total.load(std::memory_order_relaxed) + ns,
+              std::memory_order_relaxed);
+}
+
+}
+
 __thread WorkerThread* WorkerThread::currentWorker_ = nullptr;
 
 std::atomic_uint WorkerThread::objectCounter_;
@@ -52,6 +84,38 @@ void WorkerThread::start() {
   // The server has been set up and is now in the loop implementation
 }
 
+void WorkerThread::setBusyPoll(std::chrono::microseconds spinBudget) {
+  CHECK(state_ == State::IDLE);
+  CHECK_GE(spinBudget.count(), 0);
+  busyPollBudget_ = spinBudget;
+}
+
+void WorkerThread::setLoopMonitor(uint32_t sampleRate) {
+  CHECK(state_ == State::IDLE);
+  loopMonitorSampleRate_ = sampleRate;
+}
+
+void WorkerThread::enableSocketBusyPoll(int fd) const {
+  if (busyPollBudget_.count() == 0) {
+    return;
+  }
+  int usec = busyPollBudget_.count();
+  if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0) {
+    LOG(WARNING) << "Failed to set SO_BUSY_POLL=" << usec << ": "
+                 << folly::errnoStr(errno);
+  }
+}
+
+WorkerThread::BusyPollStats WorkerThread::getBusyPollStats() const {
+  BusyPollStats stats;
+  stats.spinTime = std::chrono::nanoseconds(
+    spinNs_.load(std::memory_order_relaxed));
+  stats.blockingTime = std::chrono::nanoseconds(
+    blockingNs_.load(std::memory_order_relaxed));
+  stats.blockingWaits = blockingWaits_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 void WorkerThread::stopWhenIdle() {
   // Call runInEventBaseThread() to perform all of the work in the actual
   // worker thread.
@@ -123,9 +187,16 @@ void WorkerThread::setup() {
   if (eventBaseManager_) {
     eventBaseManager_->setEventBase(&eventBase_, false);
   }
+
+  if (loopMonitorSampleRate_ > 0) {
+    loopMonitor_ = LoopMonitor::start(&eventBase_, loopMonitorSampleRate_);
+  }
 }
 
 void WorkerThread::cleanup() {
+  if (loopMonitor_) {
+    loopMonitor_->stop();
+  }
   currentWorker_ = nullptr;
   if (eventBaseManager_) {
     eventBaseManager_->clearEventBase();
@@ -139,9 +210,13 @@ void WorkerThread::runLoop() {
 
   VLOG(1) << "WorkerThread " << this << " starting";
 
-  // Call loopForever().  This will only return after stopWhenIdle() or
-  // forceStop() has been called.
-  eventBase_.loopForever();
+  // Call loopForever(), or spin in busyPollLoop().  This will only return
+  // after stopWhenIdle() or forceStop() has been called.
+  if (busyPollBudget_.count() > 0) {
+    busyPollLoop();
+  } else {
+    eventBase_.loopForever();
+  }
 
   if (state_ == State::STOP_WHEN_IDLE) {
     // We have been asked to stop when there are no more events left.
@@ -157,4 +232,28 @@ void WorkerThread::runLoop() {
   VLOG(1) << "WorkerThread " << this << " terminated";
 }
 
+void WorkerThread::busyPollLoop() {
+  // loopOnce() forgets terminateLoopSoon(), so this watches state_, which
+  // stopWhenIdle() and forceStop() change before calling it
+  KeepAlive keepAlive(&eventBase_);
+  while (state_ == State::RUNNING) {
+    TimePoint start = getCurrentTime();
+    TimePoint deadline = start + busyPollBudget_;
+    TimePoint now;
+    do {
+      eventBase_.loopOnce(EVLOOP_NONBLOCK);
+      now = getCurrentTime();
+    } while (state_ == State::RUNNING && now < deadline);
+    addTime(spinNs_, start, now);
+    if (state_ != State::RUNNING) {
+      break;
+    }
+
+    eventBase_.loopOnce();
+    addTime(blockingNs_, now, getCurrentTime());
+    blockingWaits_.store(blockingWaits_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+  }
+}
+
 } // proxygen
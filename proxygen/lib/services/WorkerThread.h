@@ -10,9 +10,12 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <folly/io/async/EventBase.h>
+#include <memory>
 #include <mutex>
+#include <proxygen/lib/utils/LoopMonitor.h>
 #include <thread>
 
 namespace folly {
@@ -27,9 +30,61 @@ namespace proxygen {
  */
 class WorkerThread {
  public:
+  struct BusyPollStats {
+    // in the non-blocking polls, including the handlers they ran
+    std::chrono::nanoseconds spinTime{0};
+    // in the blocking waits, including the handlers of their wakeups
+    std::chrono::nanoseconds blockingTime{0};
+    // the blocking waits, each after a spin found nothing to do
+    uint64_t blockingWaits{0};
+  };
+
   explicit WorkerThread(folly::EventBaseManager* ebm);
   virtual ~WorkerThread();
 
+  /**
+   * Trade CPU for latency: after each wakeup, keep polling the EventBase
+   * without blocking for spinBudget, so that the next request is picked
+   * up without the wakeup latency of epoll_wait(), and only block once a
+   * whole budget went by. Zero, the default, always blocks.
+   *
+   * Must be called before start().
+   */
+  void setBusyPoll(std::chrono::microseconds spinBudget);
+
+  std::chrono::microseconds getBusyPoll() const {
+    return busyPollBudget_;
+  }
+
+  /**
+   * Set SO_BUSY_POLL on fd to the spin budget, if there is one, so that
+   * the reads of its connections also poll the device queue rather than
+   * wait for the interrupt. Sockets accepted from a listening socket
+   * inherit it. Raising it above net.core.busy_read needs CAP_NET_ADMIN;
+   * failure is logged and not fatal.
+   */
+  void enableSocketBusyPoll(int fd) const;
+
+  /**
+   * Where the thread spent its time in busy poll mode; can be called from
+   * any thread
+   */
+  BusyPollStats getBusyPollStats() const;
+
+  /**
+   * Observe one in sampleRate iterations of the loop with a LoopMonitor,
+   * zero, the default, for none. Must be called before start().
+   */
+  void setLoopMonitor(uint32_t sampleRate);
+
+  /**
+   * The monitor of the loop, once started, for a stats registry; null
+   * without setLoopMonitor()
+   */
+  std::shared_ptr<LoopMonitor> getLoopMonitor() const {
+    return loopMonitor_;
+  }
+
   /**
    * Begin execution of the worker.
    *
@@ -112,6 +167,7 @@ class WorkerThread {
   WorkerThread& operator=(WorkerThread const &) = delete;
 
   void runLoop();
+  void busyPollLoop();
 
   State state_{State::IDLE};
   std::thread thread_;
@@ -119,6 +175,15 @@ class WorkerThread {
   folly::EventBase eventBase_;
   folly::EventBaseManager* eventBaseManager_{nullptr};
 
+  std::chrono::microseconds busyPollBudget_{0};
+  // only written by the thread of the loop
+  std::atomic<uint64_t> spinNs_{0};
+  std::atomic<uint64_t> blockingNs_{0};
+  std::atomic<uint64_t> blockingWaits_{0};
+
+  uint32_t loopMonitorSampleRate_{0};
+  std::shared_ptr<LoopMonitor> loopMonitor_;
+
   // A thread-local pointer to the current WorkerThread for this thread
   static __thread WorkerThread* currentWorker_;
 
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/ssl/KernelTLS.h>
+
+#include <algorithm>
+#include <cstring>
+#include <glog/logging.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/hmac.h>
+#include <string>
+#include <sys/socket.h>
+
+// From linux/tls.h, which older kernels don't ship
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TLS_TX
+#define TLS_TX 1
+#define TLS_RX 2
+#endif
+
+namespace proxygen {
+
+namespace {
+
+const uint16_t kTLSCipherAESGCM128 = 51;
+const size_t kKeySize = 16;
+const size_t kSaltSize = 4;
+const size_t kIVSize = 8;
+const size_t kSeqSize = 8;
+
+struct CryptoInfoAESGCM128 {
+  uint16_t version;
+  uint16_t cipherType;
+  unsigned char iv[kIVSize];
+  unsigned char key[kKeySize];
+  unsigned char salt[kSaltSize];
+  unsigned char recSeq[kSeqSize];
+};
+
+/**
+ * The TLS 1.2 PRF with SHA256, P_SHA256(secret, label + seed)
+ */
+bool prf(const unsigned char* secret, int secretLen, const std::string& seed,
+         unsigned char* out, size_t outLen) {
+  unsigned char a[EVP_MAX_MD_SIZE];
+  unsigned int aLen = 0;
+  // A(1)
+  if (!HMAC(EVP_sha256(), secret, secretLen,
+            reinterpret_cast<const unsigned char*>(seed.data()),
+            seed.size(), a, &aLen)) {
+    return false;
+  }
+  while (outLen > 0) {
+    std::string input(reinterpret_cast<char*>(a), aLen);
+    input += seed;
+    unsigned char block[EVP_MAX_MD_SIZE];
+    unsigned int blockLen = 0;
+    if (!HMAC(EVP_sha256(), secret, secretLen,
+              reinterpret_cast<const unsigned char*>(input.data()),
+              input.size(), block, &blockLen)) {
+      return false;
+    }
+    size_t n = std::min(outLen, size_t(blockLen));
+    memcpy(out, block, n);
+    out += n;
+    outLen -= n;
+    // A(i + 1)
+    if (!HMAC(EVP_sha256(), secret, secretLen, a, aLen, a, &aLen)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void fillCryptoInfo(CryptoInfoAESGCM128* info, const unsigned char* key,
+                    const unsigned char* salt, const unsigned char* seq) {
+  info->version = TLS1_2_VERSION;
+  info->cipherType = kTLSCipherAESGCM128;
+  memcpy(info->key, key, kKeySize);
+  memcpy(info->salt, salt, kSaltSize);
+  memcpy(info->recSeq, seq, kSeqSize);
+  // OpenSSL uses the sequence number as the explicit nonce too
+  memcpy(info->iv, seq, kIVSize);
+}
+
+}
+
+bool KernelTLS::isSupported(const SSL* ssl) {
+  if (SSL_version(ssl) != TLS1_2_VERSION) {
+    return false;
+  }
+  const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+  if (!cipher) {
+    return false;
+  }
+  // the AES-128-GCM suites all use the SHA256 PRF
+  std::string name(SSL_CIPHER_get_name(cipher));
+  return name == "AES128-GCM-SHA256" ||
+    name == "ECDHE-RSA-AES128-GCM-SHA256" ||
+    name == "ECDHE-ECDSA-AES128-GCM-SHA256" ||
+    name == "DHE-RSA-AES128-GCM-SHA256";
+}
+
+KernelTLS::Result KernelTLS::install(int fd, SSL* ssl) {
+  if (!isSupported(ssl) || !ssl->session || !ssl->s3) {
+    return Result::UNSUPPORTED;
+  }
+
+  // key_block = client key | server key | client salt | server salt
+  std::string seed("key expansion");
+  seed.append(reinterpret_cast<char*>(ssl->s3->server_random),
+              SSL3_RANDOM_SIZE);
+  seed.append(reinterpret_cast<char*>(ssl->s3->client_random),
+              SSL3_RANDOM_SIZE);
+  unsigned char keyBlock[2 * (kKeySize + kSaltSize)];
+  if (!prf(ssl->session->master_key, ssl->session->master_key_length,
+           seed, keyBlock, sizeof(keyBlock))) {
+    return Result::UNSUPPORTED;
+  }
+  const unsigned char* clientKey = keyBlock;
+  const unsigned char* serverKey = keyBlock + kKeySize;
+  const unsigned char* clientSalt = keyBlock + 2 * kKeySize;
+  const unsigned char* serverSalt = clientSalt + kSaltSize;
+
+  CryptoInfoAESGCM128 tx;
+  fillCryptoInfo(&tx, serverKey, serverSalt, ssl->s3->write_sequence);
+  CryptoInfoAESGCM128 rx;
+  fillCryptoInfo(&rx, clientKey, clientSalt, ssl->s3->read_sequence);
+
+  // Without the tls module, or its receive side (Linux < 4.17), this
+  // fails before anything changes
+  Result result = Result::UNSUPPORTED;
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 &&
+      setsockopt(fd, SOL_TLS, TLS_RX, &rx, sizeof(rx)) == 0) {
+    result = setsockopt(fd, SOL_TLS, TLS_TX, &tx, sizeof(tx)) == 0 ?
+      Result::OFFLOADED : Result::FAILED;
+  }
+  if (result != Result::OFFLOADED) {
+    VLOG(4) << "Failed to offload TLS to the kernel: " << strerror(errno);
+  }
+  OPENSSL_cleanse(keyBlock, sizeof(keyBlock));
+  OPENSSL_cleanse(&tx, sizeof(tx));
+  OPENSSL_cleanse(&rx, sizeof(rx));
+  return result;
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <openssl/ssl.h>
+
+namespace proxygen {
+
+/**
+ * Hands the record layer of established TLS connections over to the
+ * kernel (Linux >= 4.17, with the tls module). The socket then carries
+ * plaintext from the application's point of view, so writes need no
+ * copy into SSL buffers and files can be sendfile()d.
+ *
+ * Only TLS 1.2 with AES-128-GCM is offloaded. The record keys are derived
+ * again from the master secret, as the ones OpenSSL holds can't be read
+ * back.
+ */
+class KernelTLS {
+ public:
+  /**
+   * @return true if the negotiated version and cipher of ssl can be
+   *         offloaded
+   */
+  static bool isSupported(const SSL* ssl);
+
+  enum class Result {
+    // the kernel does the record layer, ssl must not read or write on fd
+    OFFLOADED,
+    // fd is left as it was, ssl goes on as usual
+    UNSUPPORTED,
+    // the kernel took one direction only, the connection is unusable
+    FAILED,
+  };
+
+  /**
+   * Install the keys and sequence numbers of the server side of ssl on
+   * fd, for both directions
+   */
+  static Result install(int fd, SSL* ssl);
+};
+
+}
@@ -0,0 +1,230 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/ssl/SSLCertCache.h>
+
+#include <algorithm>
+#include <cctype>
+#include <folly/io/async/EventBaseManager.h>
+#include <functional>
+#include <glog/logging.h>
+
+using folly::EventBase;
+using std::shared_ptr;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+void freeCacheRef(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx,
+                  long argl, void* argp) {
+  delete static_cast<shared_ptr<SSLCertCache>*>(ptr);
+}
+
+int getCacheIndex() {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                              freeCacheRef);
+  return index;
+}
+
+SSLCertCache* getCache(SSL_CTX* ctx) {
+  auto ref = static_cast<shared_ptr<SSLCertCache>*>(
+    SSL_CTX_get_ex_data(ctx, getCacheIndex()));
+  return ref ? ref->get() : nullptr;
+}
+
+int onServerNameCallback(SSL* ssl, int* alert, void* arg) {
+  return static_cast<SSLCertCache*>(arg)->onServerName(ssl, alert);
+}
+
+string toLower(const string& name) {
+  string lower(name);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  return lower;
+}
+
+}
+
+const size_t SSLCertCache::kDefaultCapacity;
+const size_t SSLCertCache::kNumShards;
+
+SSLCertCache::SSLCertCache(): SSLCertCache(Options()) {
+}
+
+SSLCertCache::SSLCertCache(const Options& options)
+    : shardCapacity_(std::max(options.capacity / kNumShards, size_t(1))),
+      rejectCold_(options.rejectCold),
+      loader_(options.loaderThreads) {
+}
+
+bool SSLCertCache::addCert(const std::vector<string>& names,
+                           const string& certPath,
+                           const string& keyPath,
+                           bool pinned) {
+  std::unique_ptr<Cert> cert(new Cert);
+  cert->certPath = certPath;
+  cert->keyPath = keyPath;
+  cert->pinned = pinned;
+  if (pinned) {
+    cert->ctx = load(*cert);
+    if (!cert->ctx) {
+      return false;
+    }
+    getShard(*cert).numPinned++;
+  }
+  for (auto& name: names) {
+    names_[toLower(name)] = cert.get();
+  }
+  certs_.push_back(std::move(cert));
+  return true;
+}
+
+SSLCertCache::Lookup SSLCertCache::lookup(const string& serverName,
+                                          EventBase* eventBase,
+                                          shared_ptr<SSL_CTX>* ctx) {
+  Cert* cert = findCert(serverName);
+  if (!cert) {
+    return Lookup::UNKNOWN;
+  }
+  if (cert->pinned) {
+    // never changes once added
+    *ctx = cert->ctx;
+    return Lookup::HIT;
+  }
+  {
+    Shard& shard = getShard(*cert);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    if (cert->ctx) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, cert->lruPos);
+      *ctx = cert->ctx;
+      return Lookup::HIT;
+    }
+    if (cert->loading) {
+      return Lookup::LOADING;
+    }
+    cert->loading = true;
+  }
+  if (!eventBase) {
+    auto loaded = load(*cert);
+    install(cert, loaded);
+    if (!loaded) {
+      return Lookup::UNKNOWN;
+    }
+    *ctx = std::move(loaded);
+    return Lookup::HIT;
+  }
+  // The certificate is installed from the loader thread, under the lock
+  // of its shard, so there is nothing to call back on eventBase
+  loader_.add(eventBase, [this, cert] () -> CPUExecutor::Callback {
+      install(cert, load(*cert));
+      return nullptr;
+    });
+  return Lookup::LOADING;
+}
+
+size_t SSLCertCache::getNumResident() const {
+  size_t size = 0;
+  for (auto& shard: shards_) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    size += shard.lru.size() + shard.numPinned;
+  }
+  return size;
+}
+
+void SSLCertCache::attachServer(SSL_CTX* ctx,
+                                const shared_ptr<SSLCertCache>& cache) {
+  CHECK(cache);
+  if (getCache(ctx) == cache.get()) {
+    return;
+  }
+  auto old = SSL_CTX_get_ex_data(ctx, getCacheIndex());
+  delete static_cast<shared_ptr<SSLCertCache>*>(old);
+  SSL_CTX_set_ex_data(ctx, getCacheIndex(),
+                      new shared_ptr<SSLCertCache>(cache));
+  SSL_CTX_set_tlsext_servername_callback(ctx, onServerNameCallback);
+  SSL_CTX_set_tlsext_servername_arg(ctx, cache.get());
+}
+
+int SSLCertCache::onServerName(SSL* ssl, int* alert) {
+  const char* serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  if (!serverName) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  shared_ptr<SSL_CTX> ctx;
+  auto eventBase = folly::EventBaseManager::get()->getExistingEventBase();
+  auto result = lookup(serverName, eventBase, &ctx);
+  if (result == Lookup::HIT) {
+    // the connection takes its own reference to ctx
+    SSL_set_SSL_CTX(ssl, ctx.get());
+    return SSL_TLSEXT_ERR_OK;
+  }
+  if (result == Lookup::LOADING && rejectCold_) {
+    VLOG(4) << "Rejecting " << serverName << " while its certificate loads";
+    *alert = SSL_AD_UNRECOGNIZED_NAME;
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+  }
+  // the default certificate of the SSL_CTX
+  return SSL_TLSEXT_ERR_NOACK;
+}
+
+shared_ptr<SSL_CTX> SSLCertCache::load(const Cert& cert) {
+  shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_server_method()), SSL_CTX_free);
+  if (!ctx ||
+      SSL_CTX_use_certificate_chain_file(ctx.get(),
+                                         cert.certPath.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx.get(), cert.keyPath.c_str(),
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx.get()) != 1) {
+    LOG(ERROR) << "Failed to load the certificate " << cert.certPath
+               << " with the key " << cert.keyPath;
+    return nullptr;
+  }
+  return ctx;
+}
+
+SSLCertCache::Shard& SSLCertCache::getShard(const Cert& cert) {
+  return shards_[std::hash<string>()(cert.certPath) % kNumShards];
+}
+
+SSLCertCache::Cert* SSLCertCache::findCert(const string& serverName) const {
+  string name = toLower(serverName);
+  auto it = names_.find(name);
+  if (it != names_.end()) {
+    return it->second;
+  }
+  // "*.example.com" covers "www.example.com" but not "example.com" or
+  // "a.www.example.com"
+  auto dot = name.find('.');
+  if (dot == string::npos || dot == 0) {
+    return nullptr;
+  }
+  it = names_.find("*" + name.substr(dot));
+  return it != names_.end() ? it->second : nullptr;
+}
+
+void SSLCertCache::install(Cert* cert, shared_ptr<SSL_CTX> ctx) {
+  Shard& shard = getShard(*cert);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  cert->loading = false;
+  if (!ctx) {
+    // the next handshake tries again
+    return;
+  }
+  cert->ctx = std::move(ctx);
+  shard.lru.push_front(cert);
+  cert->lruPos = shard.lru.begin();
+  if (shard.lru.size() > shardCapacity_) {
+    Cert* coldest = shard.lru.back();
+    shard.lru.pop_back();
+    coldest->ctx.reset();
+  }
+}
+
+}
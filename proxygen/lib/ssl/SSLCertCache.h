@@ -0,0 +1,156 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/EventBase.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <proxygen/lib/utils/CPUExecutor.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Certificates for many hostnames, selected by SNI, and loaded when they
+ * are first asked for rather than all at startup. A server attaches the
+ * cache to the SSL_CTXs of its threads with attachServer(): a handshake
+ * for one of the names of a certificate that is resident switches to the
+ * SSL_CTX of that certificate. One for a certificate that isn't has its
+ * certificate and key read on a thread of the loader pool, so the
+ * EventBase never waits on the disk, and meanwhile gets the default
+ * certificate of the SSL_CTX, or an unrecognized_name alert with
+ * rejectCold.
+ *
+ * The pinned certificates, the hot set, are loaded by addCert() and stay
+ * resident. The others are kept up to the capacity of the cache and then
+ * dropped least recently used first; the connections that use one keep
+ * it until they close. Like SSLSessionCache, the certificates are spread
+ * over shards with a lock each, so threads rarely wait on each other.
+ *
+ * Only the certificate and key come from the SSL_CTX of the certificate:
+ * the ciphers, options and session caching are those of the SSL_CTX the
+ * connection was accepted with.
+ */
+class SSLCertCache {
+ public:
+  static const size_t kDefaultCapacity = 1024;
+  static const size_t kNumShards = 16;
+
+  struct Options {
+    // resident certificates that aren't pinned
+    size_t capacity{kDefaultCapacity};
+    // threads reading certificates and keys
+    size_t loaderThreads{2};
+    // refuse the handshakes for certificates that aren't resident yet
+    // instead of answering them with the default certificate
+    bool rejectCold{false};
+  };
+
+  enum class Lookup {
+    HIT,
+    LOADING,
+    UNKNOWN,
+  };
+
+  SSLCertCache();
+  explicit SSLCertCache(const Options& options);
+
+  /**
+   * Serve the certificate chain and key of these PEM files to the
+   * handshakes for names, such as "www.example.com", or "*.example.com"
+   * for the names one label below example.com. Names are case
+   * insensitive; an exact name wins over a wildcard. Call it for all the
+   * certificates before attaching the cache.
+   *
+   * @param pinned Load the certificate now, on the calling thread, and
+   *               never drop it
+   * @return false if a pinned certificate couldn't be loaded
+   */
+  bool addCert(const std::vector<std::string>& names,
+               const std::string& certPath,
+               const std::string& keyPath,
+               bool pinned = false);
+
+  /**
+   * Find the certificate for serverName. If it has to be loaded first,
+   * start loading it on the loader pool unless it already is, and return
+   * LOADING. Can be called from any thread; eventBase is the one of the
+   * calling thread, or null to load on the calling thread.
+   *
+   * @param ctx set to the SSL_CTX of the certificate on HIT
+   * @return UNKNOWN if no certificate has serverName, or if it couldn't be
+   *         loaded on the calling thread
+   */
+  Lookup lookup(const std::string& serverName,
+                folly::EventBase* eventBase,
+                std::shared_ptr<SSL_CTX>* ctx);
+
+  /**
+   * @return the number of certificates loaded, pinned ones included
+   */
+  size_t getNumResident() const;
+
+  /**
+   * Select the certificates of ctx's handshakes by SNI from cache. ctx
+   * keeps a reference to cache. This replaces the servername callback of
+   * ctx. Does nothing if ctx already uses cache.
+   */
+  static void attachServer(SSL_CTX* ctx,
+                           const std::shared_ptr<SSLCertCache>& cache);
+
+  /**
+   * The servername callback of OpenSSL, see
+   * SSL_CTX_set_tlsext_servername_callback()
+   */
+  int onServerName(SSL* ssl, int* alert);
+
+ private:
+  struct Cert;
+  typedef std::list<Cert*> LRUList;
+
+  struct Cert {
+    std::string certPath;
+    std::string keyPath;
+    bool pinned{false};
+    // the rest is guarded by the mutex of the shard
+    std::shared_ptr<SSL_CTX> ctx;
+    bool loading{false};
+    // in the LRUList of the shard while resident and not pinned
+    LRUList::iterator lruPos;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // most recently used first
+    LRUList lru;
+    size_t numPinned{0};
+  };
+
+  static std::shared_ptr<SSL_CTX> load(const Cert& cert);
+
+  Shard& getShard(const Cert& cert);
+  Cert* findCert(const std::string& serverName) const;
+  void install(Cert* cert, std::shared_ptr<SSL_CTX> ctx);
+
+  const size_t shardCapacity_;
+  const bool rejectCold_;
+  std::vector<std::unique_ptr<Cert>> certs_;
+  // lower case exact and wildcard names
+  std::unordered_map<std::string, Cert*> names_;
+  Shard shards_[kNumShards];
+  // last, so that it stops before the certificates go away
+  CPUExecutor loader_;
+};
+
+}
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/ssl/SSLSessionCache.h>
+
+#include <algorithm>
+#include <functional>
+#include <glog/logging.h>
+
+using std::shared_ptr;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+void freeCacheRef(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx,
+                  long argl, void* argp) {
+  delete static_cast<shared_ptr<SSLSessionCache>*>(ptr);
+}
+
+int getCacheIndex() {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                              freeCacheRef);
+  return index;
+}
+
+SSLSessionCache* getCache(SSL_CTX* ctx) {
+  auto ref = static_cast<shared_ptr<SSLSessionCache>*>(
+    SSL_CTX_get_ex_data(ctx, getCacheIndex()));
+  return ref ? ref->get() : nullptr;
+}
+
+string getSessionKey(SSL_SESSION* session) {
+  unsigned int len = 0;
+  const unsigned char* id = SSL_SESSION_get_id(session, &len);
+  return string(reinterpret_cast<const char*>(id), len);
+}
+
+int onNewSession(SSL* ssl, SSL_SESSION* session) {
+  auto cache = getCache(SSL_get_SSL_CTX(ssl));
+  if (cache) {
+    cache->addSession(getSessionKey(session), session);
+  }
+  // we keep a copy, not a reference
+  return 0;
+}
+
+SSL_SESSION* onGetSession(SSL* ssl, unsigned char* id, int len, int* copy) {
+  // OpenSSL owns the copy we return
+  *copy = 0;
+  auto cache = getCache(SSL_get_SSL_CTX(ssl));
+  if (!cache) {
+    return nullptr;
+  }
+  return cache->getSession(string(reinterpret_cast<char*>(id), len));
+}
+
+void onRemoveSession(SSL_CTX* ctx, SSL_SESSION* session) {
+  auto cache = getCache(ctx);
+  if (cache) {
+    cache->remove(getSessionKey(session));
+  }
+}
+
+}
+
+const size_t SSLSessionCache::kDefaultCapacity;
+const size_t SSLSessionCache::kNumShards;
+
+SSLSessionCache::SSLSessionCache(size_t capacity)
+    : shardCapacity_(std::max(capacity / kNumShards, size_t(1))) {
+}
+
+SSLSessionCache::Shard& SSLSessionCache::getShard(const string& key) {
+  return shards_[std::hash<string>()(key) % kNumShards];
+}
+
+void SSLSessionCache::addSession(const string& key, SSL_SESSION* session) {
+  int len = i2d_SSL_SESSION(session, nullptr);
+  if (len <= 0) {
+    VLOG(4) << "Failed to serialize TLS session";
+    return;
+  }
+  string value(len, '\0');
+  auto p = reinterpret_cast<unsigned char*>(&value[0]);
+  i2d_SSL_SESSION(session, &p);
+  set(key, std::move(value));
+}
+
+SSL_SESSION* SSLSessionCache::getSession(const string& key) {
+  string value;
+  if (!get(key, &value)) {
+    return nullptr;
+  }
+  auto p = reinterpret_cast<const unsigned char*>(value.data());
+  return d2i_SSL_SESSION(nullptr, &p, value.size());
+}
+
+void SSLSessionCache::set(const string& key, string value) {
+  Shard& shard = getShard(key);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    it->second->second = std::move(value);
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return;
+  }
+  shard.lru.emplace_front(key, std::move(value));
+  shard.index[key] = shard.lru.begin();
+  if (shard.lru.size() > shardCapacity_) {
+    shard.index.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+  }
+}
+
+bool SSLSessionCache::get(const string& key, string* value) {
+  Shard& shard = getShard(key);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  *value = it->second->second;
+  return true;
+}
+
+void SSLSessionCache::remove(const string& key) {
+  Shard& shard = getShard(key);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+  }
+}
+
+size_t SSLSessionCache::size() const {
+  size_t size = 0;
+  for (auto& shard: shards_) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    size += shard.lru.size();
+  }
+  return size;
+}
+
+void SSLSessionCache::attachServer(SSL_CTX* ctx,
+                                   const shared_ptr<SSLSessionCache>& cache) {
+  CHECK(cache);
+  if (getCache(ctx) == cache.get()) {
+    return;
+  }
+  auto old = SSL_CTX_get_ex_data(ctx, getCacheIndex());
+  delete static_cast<shared_ptr<SSLSessionCache>*>(old);
+  SSL_CTX_set_ex_data(ctx, getCacheIndex(),
+                      new shared_ptr<SSLSessionCache>(cache));
+  SSL_CTX_set_session_cache_mode(
+    ctx, SSL_CTX_get_session_cache_mode(ctx) | SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+  SSL_CTX_sess_set_get_cb(ctx, onGetSession);
+  SSL_CTX_sess_set_remove_cb(ctx, onRemoveSession);
+}
+
+}
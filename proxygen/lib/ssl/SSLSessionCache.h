@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+#include <unordered_map>
+
+namespace proxygen {
+
+/**
+ * A cache of serialized TLS sessions that any number of threads can share.
+ * The keys are spread over shards with a lock each, so threads rarely
+ * wait on each other, and (de)serializing happens outside of the locks.
+ * Each shard drops its least recently used sessions past its share of the
+ * capacity. Expired sessions are left to OpenSSL, which checks the
+ * timeout of the sessions it resumes.
+ *
+ * A server shares one cache between the SSL_CTXs of all its threads with
+ * attachServer(), so that a client can resume on any thread. A client
+ * keys sessions by destination, see HTTPConnector::setSessionCache().
+ */
+class SSLSessionCache {
+ public:
+  static const size_t kDefaultCapacity = 20480;
+  static const size_t kNumShards = 16;
+
+  explicit SSLSessionCache(size_t capacity = kDefaultCapacity);
+
+  /**
+   * Store a copy of the session under key
+   */
+  void addSession(const std::string& key, SSL_SESSION* session);
+
+  /**
+   * @return a new copy of the session stored under key, that the caller
+   *         owns, or nullptr
+   */
+  SSL_SESSION* getSession(const std::string& key);
+
+  void set(const std::string& key, std::string value);
+  bool get(const std::string& key, std::string* value);
+  void remove(const std::string& key);
+
+  size_t size() const;
+
+  /**
+   * Make the server side session cache of ctx store the sessions in cache
+   * too, and look them up there when they are not in its own. ctx keeps a
+   * reference to cache. Does nothing if ctx already uses cache.
+   */
+  static void attachServer(SSL_CTX* ctx,
+                           const std::shared_ptr<SSLSessionCache>& cache);
+
+ private:
+  typedef std::list<std::pair<std::string, std::string>> LRUList;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // most recently used first
+    LRUList lru;
+    std::unordered_map<std::string, LRUList::iterator> index;
+  };
+
+  Shard& getShard(const std::string& key);
+
+  const size_t shardCapacity_;
+  Shard shards_[kNumShards];
+};
+
+}
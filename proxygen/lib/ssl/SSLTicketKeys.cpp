@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/ssl/SSLTicketKeys.h>
+
+#include <cstring>
+#include <glog/logging.h>
+#include <openssl/rand.h>
+
+using std::shared_ptr;
+using std::string;
+
+namespace proxygen {
+
+namespace {
+
+void freeKeysRef(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx,
+                 long argl, void* argp) {
+  delete static_cast<shared_ptr<SSLTicketKeys>*>(ptr);
+}
+
+int getKeysIndex() {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                              freeKeysRef);
+  return index;
+}
+
+SSLTicketKeys* getKeys(SSL_CTX* ctx) {
+  auto ref = static_cast<shared_ptr<SSLTicketKeys>*>(
+    SSL_CTX_get_ex_data(ctx, getKeysIndex()));
+  return ref ? ref->get() : nullptr;
+}
+
+int onTicketKey(SSL* ssl, unsigned char* name, unsigned char* iv,
+                EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int encrypt) {
+  auto keys = getKeys(SSL_get_SSL_CTX(ssl));
+  if (!keys) {
+    return encrypt ? -1 : 0;
+  }
+  return keys->onTicket(name, iv, cipherCtx, hmacCtx, encrypt);
+}
+
+}
+
+SSLTicketKeys::SSLTicketKeys(const std::vector<string>& keys)
+    : keys_(keys) {
+  CHECK(!keys_.empty());
+  for (auto& key: keys_) {
+    CHECK_EQ(key.size(), kKeySize);
+  }
+}
+
+int SSLTicketKeys::onTicket(unsigned char* name, unsigned char* iv,
+                            EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx,
+                            int encrypt) {
+  const string* key = nullptr;
+  if (encrypt) {
+    key = &keys_.front();
+    memcpy(name, key->data(), kNameSize);
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+      return -1;
+    }
+  } else {
+    for (auto& k: keys_) {
+      if (memcmp(name, k.data(), kNameSize) == 0) {
+        key = &k;
+        break;
+      }
+    }
+    if (!key) {
+      // unknown key, do a full handshake
+      return 0;
+    }
+  }
+
+  auto bytes = reinterpret_cast<const unsigned char*>(key->data());
+  HMAC_Init_ex(hmacCtx, bytes + kNameSize, kSecretSize, EVP_sha256(),
+               nullptr);
+  if (encrypt) {
+    EVP_EncryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr,
+                       bytes + kNameSize + kSecretSize, iv);
+    return 1;
+  }
+  EVP_DecryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr,
+                     bytes + kNameSize + kSecretSize, iv);
+  // renew the tickets of the keys being rotated out
+  return key == &keys_.front() ? 1 : 2;
+}
+
+void SSLTicketKeys::attachServer(SSL_CTX* ctx,
+                                 const shared_ptr<SSLTicketKeys>& keys) {
+  CHECK(keys);
+  if (getKeys(ctx) == keys.get()) {
+    return;
+  }
+  auto old = SSL_CTX_get_ex_data(ctx, getKeysIndex());
+  delete static_cast<shared_ptr<SSLTicketKeys>*>(old);
+  SSL_CTX_set_ex_data(ctx, getKeysIndex(),
+                      new shared_ptr<SSLTicketKeys>(keys));
+  SSL_CTX_set_tlsext_ticket_key_cb(ctx, onTicketKey);
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Session ticket keys for servers. The SSL_CTXs of all the threads of a
+ * server, or of several servers, attached to the same keys accept each
+ * other's tickets, so a client can resume without a full handshake
+ * wherever it reconnects. The first key encrypts the new tickets and all
+ * of them decrypt, so a new key can be added last, moved first once all
+ * the servers have it, and dropped only after that.
+ */
+class SSLTicketKeys {
+ public:
+  // the name, the HMAC secret and the AES key, in that order
+  static const size_t kNameSize = 16;
+  static const size_t kSecretSize = 16;
+  static const size_t kKeySize = 48;
+
+  /**
+   * @param keys At least one key of kKeySize random bytes
+   */
+  explicit SSLTicketKeys(const std::vector<std::string>& keys);
+
+  /**
+   * The ticket key callback of OpenSSL, see
+   * SSL_CTX_set_tlsext_ticket_key_cb()
+   */
+  int onTicket(unsigned char* name, unsigned char* iv,
+               EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int encrypt);
+
+  /**
+   * Make ctx issue and accept tickets with keys. ctx keeps a reference to
+   * keys. Does nothing if ctx already uses keys.
+   */
+  static void attachServer(SSL_CTX* ctx,
+                           const std::shared_ptr<SSLTicketKeys>& keys);
+
+ private:
+  std::vector<std::string> keys_;
+};
+
+}
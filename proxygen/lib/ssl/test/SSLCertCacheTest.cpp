@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/ssl/SSLCertCache.h>
+#include <proxygen/lib/utils/TestUtils.h>
+#include <thread>
+
+using namespace proxygen;
+using std::shared_ptr;
+using std::string;
+
+namespace {
+
+const string kCertDir = getContainingDirectory(__FILE__).str() +
+  "../../../httpserver/tests/certs/";
+
+string certPath(int i) {
+  return kCertDir + "test_cert" + std::to_string(i) + ".pem";
+}
+
+string keyPath(int i) {
+  return kCertDir + "test_key" + std::to_string(i) + ".pem";
+}
+
+SSLCertCache::Lookup waitForLoad(SSLCertCache& cache, const string& name,
+                                 folly::EventBase* evb,
+                                 shared_ptr<SSL_CTX>* ctx) {
+  auto result = cache.lookup(name, evb, ctx);
+  for (int i = 0; i < 1000 && result == SSLCertCache::Lookup::LOADING; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    result = cache.lookup(name, evb, ctx);
+  }
+  return result;
+}
+
+}
+
+TEST(SSLCertCacheTest, Names) {
+  SSLCertCache cache;
+  EXPECT_TRUE(cache.addCert({"www.example.com"}, certPath(1), keyPath(1),
+                            true));
+  EXPECT_TRUE(cache.addCert({"*.example.com"}, certPath(2), keyPath(2),
+                            true));
+  EXPECT_EQ(2, cache.getNumResident());
+
+  shared_ptr<SSL_CTX> exact;
+  shared_ptr<SSL_CTX> wildcard;
+  shared_ptr<SSL_CTX> ctx;
+  EXPECT_EQ(SSLCertCache::Lookup::HIT,
+            cache.lookup("WWW.Example.com", nullptr, &exact));
+  EXPECT_EQ(SSLCertCache::Lookup::HIT,
+            cache.lookup("api.example.com", nullptr, &wildcard));
+  EXPECT_NE(exact, wildcard);
+  EXPECT_EQ(SSLCertCache::Lookup::UNKNOWN,
+            cache.lookup("example.com", nullptr, &ctx));
+  EXPECT_EQ(SSLCertCache::Lookup::UNKNOWN,
+            cache.lookup("a.api.example.com", nullptr, &ctx));
+  EXPECT_FALSE(ctx);
+}
+
+TEST(SSLCertCacheTest, LoadsOffTheEventBase) {
+  folly::EventBase evb;
+  SSLCertCache cache;
+  EXPECT_TRUE(cache.addCert({"a.test"}, certPath(1), keyPath(1)));
+  EXPECT_EQ(0, cache.getNumResident());
+
+  shared_ptr<SSL_CTX> ctx;
+  EXPECT_EQ(SSLCertCache::Lookup::LOADING, cache.lookup("a.test", &evb, &ctx));
+  EXPECT_EQ(SSLCertCache::Lookup::HIT,
+            waitForLoad(cache, "a.test", &evb, &ctx));
+  EXPECT_TRUE(ctx);
+  EXPECT_EQ(1, cache.getNumResident());
+}
+
+TEST(SSLCertCacheTest, BadCert) {
+  SSLCertCache cache;
+  EXPECT_FALSE(cache.addCert({"a.test"}, certPath(1), keyPath(2), true));
+  EXPECT_TRUE(cache.addCert({"b.test"}, kCertDir + "missing.pem",
+                            keyPath(1)));
+  shared_ptr<SSL_CTX> ctx;
+  EXPECT_EQ(SSLCertCache::Lookup::UNKNOWN,
+            cache.lookup("a.test", nullptr, &ctx));
+  EXPECT_EQ(SSLCertCache::Lookup::UNKNOWN,
+            cache.lookup("b.test", nullptr, &ctx));
+  EXPECT_EQ(0, cache.getNumResident());
+}
+
+TEST(SSLCertCacheTest, EvictsColdest) {
+  SSLCertCache::Options options;
+  // one certificate per shard
+  options.capacity = SSLCertCache::kNumShards;
+  SSLCertCache cache(options);
+  EXPECT_TRUE(cache.addCert({"pinned.test"}, certPath(5), keyPath(5),
+                            true));
+  for (int i = 0; i < 64; i++) {
+    string name = std::to_string(i) + ".test";
+    // the same file under other paths, so that they spread over shards
+    string dots;
+    for (int j = 0; j < i; j++) {
+      dots += "./";
+    }
+    EXPECT_TRUE(cache.addCert({name}, kCertDir + dots + "test_cert1.pem",
+                              keyPath(1)));
+  }
+  shared_ptr<SSL_CTX> ctx;
+  for (int i = 0; i < 64; i++) {
+    EXPECT_EQ(SSLCertCache::Lookup::HIT,
+              cache.lookup(std::to_string(i) + ".test", nullptr, &ctx));
+  }
+  EXPECT_LE(cache.getNumResident(), SSLCertCache::kNumShards + 1);
+  // the pinned one stays
+  EXPECT_EQ(SSLCertCache::Lookup::HIT,
+            cache.lookup("pinned.test", nullptr, &ctx));
+}
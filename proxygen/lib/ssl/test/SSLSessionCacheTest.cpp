@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/ssl/SSLSessionCache.h>
+#include <thread>
+#include <vector>
+
+using namespace proxygen;
+using std::string;
+
+TEST(SSLSessionCacheTest, SetGetRemove) {
+  SSLSessionCache cache;
+  string value;
+  EXPECT_FALSE(cache.get("a", &value));
+
+  cache.set("a", "1");
+  cache.set("b", "2");
+  EXPECT_TRUE(cache.get("a", &value));
+  EXPECT_EQ("1", value);
+  cache.set("a", "3");
+  EXPECT_TRUE(cache.get("a", &value));
+  EXPECT_EQ("3", value);
+  EXPECT_EQ(2, cache.size());
+
+  cache.remove("a");
+  EXPECT_FALSE(cache.get("a", &value));
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(SSLSessionCacheTest, Capacity) {
+  // one entry per shard
+  SSLSessionCache cache(SSLSessionCache::kNumShards);
+  for (int i = 0; i < 1000; i++) {
+    cache.set(folly::to<string>(i), "x");
+  }
+  EXPECT_LE(cache.size(), SSLSessionCache::kNumShards);
+  // the most recent one is never evicted
+  string value;
+  EXPECT_TRUE(cache.get("999", &value));
+}
+
+TEST(SSLSessionCacheTest, Threads) {
+  SSLSessionCache cache;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, t] {
+        for (int i = 0; i < 1000; i++) {
+          string key = folly::to<string>(t, ":", i);
+          cache.set(key, key);
+          string value;
+          EXPECT_TRUE(cache.get(key, &value));
+          EXPECT_EQ(key, value);
+        }
+      });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  EXPECT_EQ(4000, cache.size());
+}
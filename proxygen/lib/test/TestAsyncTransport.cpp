@@ -404,6 +404,18 @@ TestAsyncTransport::resumeWrites() {
   }
 }
 
+bool
+TestAsyncTransport::completeNextWrite() {
+  if (pendingWriteEvents_.empty()) {
+    return false;
+  }
+  auto event = pendingWriteEvents_.front();
+  pendingWriteEvents_.pop_front();
+  writeEvents_.push_back(event.first);
+  event.second->writeSuccess();
+  return true;
+}
+
 void
 TestAsyncTransport::failPendingWrites() {
   // writeError() callback might try to delete this object
@@ -96,6 +96,17 @@ class TestAsyncTransport : public apache::thrift::async::TAsyncTransport,
   void pauseWrites();
   void resumeWrites();
 
+  /**
+   * Complete the oldest write held back by pauseWrites(), leaving writes
+   * paused. Lets a caller model write-readiness one write at a time.
+   * Returns false if no write was pending.
+   */
+  bool completeNextWrite();
+
+  size_t getPendingWriteCount() const {
+    return pendingWriteEvents_.size();
+  }
+
   // Methods to get the data written to this transport
   std::deque< std::shared_ptr<WriteEvent> >* getWriteEvents() {
     return &writeEvents_;
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/AsyncLogWriter.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const size_t AsyncLogWriter::kDefaultBufferSize;
+const size_t AsyncLogWriter::kDefaultMaxPendingBuffers;
+const uint32_t AsyncLogWriter::kSampleRate;
+
+AsyncLogWriter::AsyncLogWriter(const std::string& path,
+                               size_t bufferSize,
+                               size_t maxPendingBuffers,
+                               std::chrono::milliseconds flushInterval)
+    : bufferSize_(bufferSize),
+      maxPendingBuffers_(maxPendingBuffers),
+      flushInterval_(flushInterval) {
+  CHECK_GT(bufferSize, 0);
+  CHECK_GT(maxPendingBuffers, 0);
+  fd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    PLOG(ERROR) << "can't open log file " << path;
+  }
+  thread_ = std::thread([this] { run(); });
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_one();
+  thread_.join();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+IOBuf* AsyncLogWriter::getBuffer(size_t length) {
+  auto& local = *local_;
+  auto now = std::chrono::steady_clock::now();
+  if (local.buf && (local.buf->tailroom() < length ||
+                    (local.buf->length() > 0 &&
+                     now - local.handedOver >= flushInterval_))) {
+    handOver(local);
+  }
+  if (local.buf && local.buf->tailroom() < length) {
+    // an empty buffer too small for this record
+    local.buf.reset();
+  }
+
+  size_t pending = pending_.load(std::memory_order_relaxed);
+  if (pending >= maxPendingBuffers_ ||
+      (pending >= maxPendingBuffers_ / 2 &&
+       local.sampled++ % kSampleRate != 0)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  if (!local.buf) {
+    local.buf = IOBuf::create(std::max(bufferSize_, length));
+    local.handedOver = now;
+  }
+  return local.buf.get();
+}
+
+void AsyncLogWriter::flush() {
+  auto& local = *local_;
+  if (local.buf) {
+    handOver(local);
+  }
+}
+
+void AsyncLogWriter::handOver(Local& local) {
+  local.handedOver = std::chrono::steady_clock::now();
+  if (local.buf->length() == 0) {
+    return;
+  }
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  if (queue_.push(std::move(local.buf))) {
+    // taking the lock makes sure the writer is either waiting or will see
+    // the buffer before it waits
+    std::lock_guard<std::mutex> lock(mutex_);
+    cond_.notify_one();
+  }
+}
+
+void AsyncLogWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait_for(lock, flushInterval_, [this] {
+        return stopping_ || !queue_.empty();
+      });
+    bool stopping = stopping_;
+    lock.unlock();
+    write(queue_.popAll());
+    if (stopping) {
+      return;
+    }
+    lock.lock();
+  }
+}
+
+void AsyncLogWriter::write(std::vector<unique_ptr<IOBuf>> bufs) {
+  if (bufs.empty()) {
+    return;
+  }
+  pending_.fetch_sub(bufs.size(), std::memory_order_relaxed);
+  if (fd_ < 0) {
+    return;
+  }
+  std::vector<iovec> iov;
+  for (const auto& buf: bufs) {
+    iovec vec;
+    vec.iov_base = (void*)buf->data();
+    vec.iov_len = buf->length();
+    iov.push_back(vec);
+  }
+  size_t start = 0;
+  while (start < iov.size()) {
+    int count = std::min(iov.size() - start, size_t(IOV_MAX));
+    ssize_t written = ::writev(fd_, &iov[start], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "can't write log";
+      return;
+    }
+    bytesWritten_.fetch_add(written, std::memory_order_relaxed);
+    // skip what was written, a short write leaves part of a buffer
+    while (start < iov.size() && size_t(written) >= iov[start].iov_len) {
+      written -= iov[start].iov_len;
+      start++;
+    }
+    if (start < iov.size()) {
+      iov[start].iov_base = (char*)iov[start].iov_base + written;
+      iov[start].iov_len -= written;
+    }
+  }
+}
+
+}
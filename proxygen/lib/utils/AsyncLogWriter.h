@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <folly/ThreadLocal.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/MPSCQueue.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Appends records, such as access log lines, to a file without blocking
+ * the threads that make them on disk I/O. Each thread formats its records
+ * straight into a buffer of its own; full buffers go through a lock-free
+ * queue to a writer thread, which writes all the queued buffers with one
+ * writev() each time it wakes up.
+ *
+ * When the writer falls behind, records are dropped rather than queued
+ * without bound: past half of maxPendingBuffers only one record in
+ * kSampleRate is kept, and past maxPendingBuffers none is.
+ */
+class AsyncLogWriter {
+ public:
+  static const size_t kDefaultBufferSize = 64 * 1024;
+  static const size_t kDefaultMaxPendingBuffers = 256;
+  static const uint32_t kSampleRate = 10;
+
+  explicit AsyncLogWriter(
+    const std::string& path,
+    size_t bufferSize = kDefaultBufferSize,
+    size_t maxPendingBuffers = kDefaultMaxPendingBuffers,
+    std::chrono::milliseconds flushInterval = std::chrono::milliseconds(1000));
+
+  /**
+   * Writes what was queued, the buffers the threads haven't handed over
+   * yet are lost, see flush()
+   */
+  ~AsyncLogWriter();
+
+  /**
+   * Append a record of at most maxLength bytes, that format writes to the
+   * char* it is given and whose length it returns
+   *
+   * @return false if the record was dropped
+   */
+  template <typename F>
+  bool append(size_t maxLength, F&& format) {
+    folly::IOBuf* buf = getBuffer(maxLength);
+    if (!buf) {
+      return false;
+    }
+    buf->append(format((char*)buf->writableTail()));
+    return true;
+  }
+
+  /**
+   * Hand the buffer of this thread to the writer, even if it isn't full
+   */
+  void flush();
+
+  /**
+   * @return the number of records dropped so far
+   */
+  uint64_t getDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @return the number of bytes written to the file so far
+   */
+  uint64_t getBytesWritten() const {
+    return bytesWritten_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // the buffer of a thread
+  struct Local {
+    std::unique_ptr<folly::IOBuf> buf;
+    std::chrono::steady_clock::time_point handedOver;
+    uint32_t sampled{0};
+  };
+
+  /**
+   * @return the buffer of this thread with at least length bytes of
+   *         tailroom, or nullptr to drop the record
+   */
+  folly::IOBuf* getBuffer(size_t length);
+  void handOver(Local& local);
+  void run();
+  void write(std::vector<std::unique_ptr<folly::IOBuf>> bufs);
+
+  int fd_{-1};
+  const size_t bufferSize_;
+  const size_t maxPendingBuffers_;
+  const std::chrono::milliseconds flushInterval_;
+  folly::ThreadLocal<Local> local_;
+  MPSCQueue<std::unique_ptr<folly::IOBuf>> queue_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> bytesWritten_{0};
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+}
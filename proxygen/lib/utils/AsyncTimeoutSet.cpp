@@ -12,6 +12,7 @@
 #include <cassert>
 #include <folly/ScopeGuard.h>
 #include <folly/io/async/Request.h>
+#include <glog/logging.h>
 
 using std::chrono::milliseconds;
 
@@ -23,8 +24,13 @@ AsyncTimeoutSet::Callback::~Callback() {
   }
 }
 
+void AsyncTimeoutSet::Callback::WheelCallback::timeoutExpired() noexcept {
+  callback_->wheelTimeoutExpired();
+}
+
 void AsyncTimeoutSet::Callback::setScheduled(AsyncTimeoutSet* timeoutSet,
-                                             Callback* prev) {
+                                             Callback* prev,
+                                             milliseconds timeout) {
   assert(timeoutSet_ == nullptr);
   assert(prev_ == nullptr);
   assert(next_ == nullptr);
@@ -33,10 +39,11 @@ void AsyncTimeoutSet::Callback::setScheduled(AsyncTimeoutSet* timeoutSet,
   timeoutSet_ = timeoutSet;
   prev_ = prev;
   next_ = nullptr;
-  expiration_ = millisecondsSinceEpoch() + timeoutSet_->getInterval();
+  expiration_ = millisecondsSinceEpoch() + timeout;
 }
 
 void AsyncTimeoutSet::Callback::cancelTimeoutImpl() {
+  wheelCallback_.cancelTimeout();
   if (next_ == nullptr) {
     assert(timeoutSet_->tail_ == this);
     timeoutSet_->tail_ = prev_;
@@ -60,6 +67,12 @@ void AsyncTimeoutSet::Callback::cancelTimeoutImpl() {
   expiration_ = {};
 }
 
+void AsyncTimeoutSet::Callback::wheelTimeoutExpired() {
+  // The wheel already restored the RequestContext
+  cancelTimeout();
+  timeoutExpired();
+}
+
 AsyncTimeoutSet::AsyncTimeoutSet(folly::TimeoutManager* timeoutManager,
                                  milliseconds intervalMS,
                                  milliseconds atMostEveryN)
@@ -81,6 +94,14 @@ AsyncTimeoutSet::AsyncTimeoutSet(folly::TimeoutManager* timeoutManager,
       atMostEveryN_(atMostEveryN) {
 }
 
+AsyncTimeoutSet::AsyncTimeoutSet(HHWheelTimer* wheel, milliseconds intervalMS)
+    : wheel_(wheel),
+      head_(nullptr),
+      tail_(nullptr),
+      interval_(intervalMS),
+      atMostEveryN_(0) {
+}
+
 AsyncTimeoutSet::~AsyncTimeoutSet() {
   // DelayedDestruction should ensure that we are never destroyed while inside
   // a call to timeoutExpired().
@@ -109,6 +130,10 @@ void AsyncTimeoutSet::destroy() {
 }
 
 void AsyncTimeoutSet::scheduleTimeout(Callback* callback) {
+  if (wheel_) {
+    scheduleTimeout(callback, interval_);
+    return;
+  }
   // Cancel the callback if it happens to be scheduled already.
   callback->cancelTimeout();
   assert(callback->prev_ == nullptr);
@@ -135,10 +160,32 @@ void AsyncTimeoutSet::scheduleTimeout(Callback* callback) {
   }
 
   // callback->prev_ = tail_;
-  callback->setScheduled(this, old_tail);
+  callback->setScheduled(this, old_tail, interval_);
+}
+
+void AsyncTimeoutSet::scheduleTimeout(Callback* callback,
+                                      milliseconds timeout) {
+  CHECK(wheel_) << "timeouts other than the interval need an HHWheelTimer";
+  callback->cancelTimeout();
+
+  // The list only keeps track of the callbacks of the set, so that
+  // destroy() cancels them, the wheel fires them.
+  Callback* old_tail = tail_;
+  if (head_ == nullptr) {
+    head_ = callback;
+  } else {
+    tail_->next_ = callback;
+  }
+  tail_ = callback;
+  callback->setScheduled(this, old_tail, timeout);
+  wheel_->scheduleTimeout(&callback->wheelCallback_, timeout);
 }
 
 void AsyncTimeoutSet::headChanged() {
+  if (wheel_) {
+    // The wheel fires the callbacks, we have no AsyncTimeout of our own
+    return;
+  }
   if (inTimeoutExpired_) {
     // timeoutExpired() will always update the scheduling correctly before it
     // returns.  No need to change the state now, since we are just going to
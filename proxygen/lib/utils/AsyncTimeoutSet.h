@@ -15,6 +15,7 @@
 #include <folly/io/async/DelayedDestruction.h>
 #include <folly/io/async/TimeoutManager.h>
 #include <memory>
+#include <proxygen/lib/utils/HHWheelTimer.h>
 #include <proxygen/lib/utils/Time.h>
 
 namespace proxygen {
@@ -34,6 +35,10 @@ namespace proxygen {
  * For example, managing idle timeouts for thousands of connection, or
  * scheduling health checks for a large group of servers.
  *
+ * An AsyncTimeoutSet can also use an HHWheelTimer instead of its own
+ * AsyncTimeout. Then all the sets of an EventBase share the timer, and
+ * their callbacks can be scheduled with any timeout, not just the interval.
+ *
  * Note, this class may not be needed given libevent's
  * event_base_init_common_timeout(). We should look into using that.
  */
@@ -83,6 +88,17 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
     }
 
    private:
+    // Schedules this callback in the HHWheelTimer of the set, if it has one
+    class WheelCallback : public HHWheelTimer::Callback {
+     public:
+      explicit WheelCallback(Callback* callback): callback_(callback) {}
+
+      void timeoutExpired() noexcept override;
+
+     private:
+      Callback* callback_;
+    };
+
     // Get the time remaining until this timeout expires
     std::chrono::milliseconds getTimeRemaining(
       std::chrono::milliseconds now) const {
@@ -92,8 +108,10 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
       return expiration_ - now;
     }
 
-    void setScheduled(AsyncTimeoutSet* timeoutSet, Callback* prev);
+    void setScheduled(AsyncTimeoutSet* timeoutSet, Callback* prev,
+                      std::chrono::milliseconds timeout);
     void cancelTimeoutImpl();
+    void wheelTimeoutExpired();
 
     std::shared_ptr<folly::RequestContext> context_;
 
@@ -101,6 +119,7 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
     Callback* prev_{nullptr};
     Callback* next_{nullptr};
     std::chrono::milliseconds expiration_{0};
+    WheelCallback wheelCallback_{this};
 
     // Give AsyncTimeoutSet direct access to our members so it can take care
     // of scheduling/cancelling.
@@ -126,6 +145,12 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
                   std::chrono::milliseconds atMostEveryN =
                       std::chrono::milliseconds(0));
 
+  /**
+   * Create a new AsyncTimeoutSet with the specified interval, whose
+   * callbacks are scheduled in wheel. The wheel must outlive the set.
+   */
+  AsyncTimeoutSet(HHWheelTimer* wheel, std::chrono::milliseconds intervalMS);
+
   /**
    * Destroy the AsyncTimeoutSet.
    *
@@ -157,6 +182,19 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
    */
   void scheduleTimeout(Callback* callback);
 
+  /**
+   * Schedule the specified Callback to be invoked after timeout instead of
+   * the interval. This needs a set that uses an HHWheelTimer.
+   */
+  void scheduleTimeout(Callback* callback, std::chrono::milliseconds timeout);
+
+  /**
+   * Return the HHWheelTimer of this set, or nullptr if it has its own timer
+   */
+  HHWheelTimer* getWheelTimer() const {
+    return wheel_;
+  }
+
   /**
    * Limit how frequently this AsyncTimeoutSet will fire.
    */
@@ -166,6 +204,7 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
 
   /**
    * Get a pointer to the next Callback scheduled to be invoked (may be null).
+   * With an HHWheelTimer, this is the first one scheduled instead.
    */
   Callback* front() { return head_; }
   const Callback* front() const { return head_; }
@@ -190,6 +229,7 @@ class AsyncTimeoutSet : private folly::AsyncTimeout,
   // Methods inherited from TAsyncTimeout
   virtual void timeoutExpired() noexcept;
 
+  HHWheelTimer* wheel_{nullptr};
   Callback* head_;
   Callback* tail_;
   std::chrono::milliseconds interval_;
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/CPUExecutor.h>
+
+#include <exception>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+CPUExecutor::CPUExecutor(size_t numThreads) {
+  CHECK_GT(numThreads, 0);
+  for (size_t i = 0; i < numThreads; i++) {
+    threads_.emplace_back([this] { worker(); });
+  }
+}
+
+CPUExecutor::~CPUExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    jobs_.clear();
+  }
+  cond_.notify_all();
+  for (auto& thread: threads_) {
+    thread.join();
+  }
+}
+
+void CPUExecutor::add(folly::EventBase* eventBase, Task task) {
+  CHECK(eventBase);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Job job;
+    job.completions = getCompletions(eventBase);
+    job.task = std::move(task);
+    jobs_.push_back(std::move(job));
+  }
+  cond_.notify_one();
+}
+
+size_t CPUExecutor::getNumPending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size();
+}
+
+std::shared_ptr<CompletionQueue> CPUExecutor::getCompletions(
+    folly::EventBase* eventBase) {
+  auto& completions = completions_[eventBase];
+  if (!completions) {
+    completions = std::make_shared<CompletionQueue>(eventBase);
+  }
+  return completions;
+}
+
+void CPUExecutor::worker() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    Callback cb;
+    try {
+      cb = job.task();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "CPUExecutor task threw: " << ex.what();
+      continue;
+    }
+    if (cb) {
+      CompletionQueue::post(job.completions, std::move(cb));
+    }
+  }
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/CompletionQueue.h>
+#include <thread>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Pool of threads for the CPU heavy or blocking work of the EventBase
+ * threads. Each task runs on a thread of the pool and returns a callback,
+ * which is then run in the thread of the EventBase that added the task,
+ * through a CompletionQueue.
+ */
+class CPUExecutor {
+ public:
+  typedef CompletionQueue::Callback Callback;
+  typedef std::function<Callback()> Task;
+
+  explicit CPUExecutor(size_t numThreads);
+
+  /**
+   * Waits for the tasks that are running to finish. The tasks that
+   * haven't started are dropped, and their callbacks never run.
+   */
+  ~CPUExecutor();
+
+  /**
+   * Run task on a thread of the pool, and the callback it returns, if
+   * any, in the thread of eventBase. Can be called from any thread.
+   * eventBase must outlive the callback.
+   */
+  void add(folly::EventBase* eventBase, Task task);
+
+  size_t getNumThreads() const {
+    return threads_.size();
+  }
+
+  /**
+   * @return the number of tasks that haven't started
+   */
+  size_t getNumPending();
+
+ private:
+  struct Job {
+    std::shared_ptr<CompletionQueue> completions;
+    Task task;
+  };
+
+  std::shared_ptr<CompletionQueue> getCompletions(
+    folly::EventBase* eventBase);
+  void worker();
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Job> jobs_;
+  std::map<folly::EventBase*, std::shared_ptr<CompletionQueue>> completions_;
+  bool stopping_{false};
+  std::vector<std::thread> threads_;
+};
+
+}
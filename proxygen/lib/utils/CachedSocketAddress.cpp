@@ -0,0 +1,26 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/CachedSocketAddress.h>
+
+#include <folly/Conv.h>
+
+namespace proxygen {
+
+void CachedSocketAddress::format() const {
+  std::call_once(formatted_, [this] {
+    if (!address_.isInitialized()) {
+      return;
+    }
+    addressStr_ = address_.getAddressStr();
+    portStr_ = folly::to<std::string>(address_.getPort());
+  });
+}
+
+}
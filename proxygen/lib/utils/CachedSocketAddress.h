@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/SocketAddress.h>
+#include <mutex>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * A SocketAddress along with its IP and port strings, which are only
+ * formatted the first time someone asks for them. It is immutable once
+ * built, so one instance can be shared by every message of a connection,
+ * from any thread.
+ */
+class CachedSocketAddress {
+ public:
+  explicit CachedSocketAddress(const folly::SocketAddress& address):
+      address_(address) {}
+
+  const folly::SocketAddress& getAddress() const {
+    return address_;
+  }
+
+  /**
+   * @return the IP, as SocketAddress::getAddressStr() formats it
+   */
+  const std::string& getAddressStr() const {
+    format();
+    return addressStr_;
+  }
+
+  const std::string& getPortStr() const {
+    format();
+    return portStr_;
+  }
+
+ private:
+  void format() const;
+
+  const folly::SocketAddress address_;
+  mutable std::once_flag formatted_;
+  mutable std::string addressStr_;
+  mutable std::string portStr_;
+};
+
+}
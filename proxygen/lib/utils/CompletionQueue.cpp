@@ -0,0 +1,29 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/CompletionQueue.h>
+
+namespace proxygen {
+
+void CompletionQueue::post(std::shared_ptr<CompletionQueue> self,
+                           Callback cb) {
+  // only the push onto an empty queue schedules a run, the others are
+  // picked up by it
+  if (self->queue_.push(std::move(cb))) {
+    self->eventBase_->runInEventBaseThread([self] { self->runAll(); });
+  }
+}
+
+void CompletionQueue::runAll() {
+  for (auto& cb: queue_.popAll()) {
+    cb();
+  }
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <memory>
+#include <proxygen/lib/utils/MPSCQueue.h>
+
+namespace proxygen {
+
+/**
+ * Callbacks that other threads hand back to the thread of an EventBase.
+ * They go through a lock-free queue and run in batches, so that a busy
+ * producer wakes the EventBase up once per loop and not once per
+ * callback.
+ *
+ * Shared with the loop callback that runs the batch, which may still be
+ * queued in the EventBase when the owner of the queue goes away.
+ */
+class CompletionQueue {
+ public:
+  typedef std::function<void()> Callback;
+
+  explicit CompletionQueue(folly::EventBase* eventBase):
+      eventBase_(eventBase) {}
+
+  folly::EventBase* getEventBase() const {
+    return eventBase_;
+  }
+
+  /**
+   * Run cb in the thread of the EventBase of self, from any thread
+   */
+  static void post(std::shared_ptr<CompletionQueue> self, Callback cb);
+
+ private:
+  void runAll();
+
+  folly::EventBase* const eventBase_;
+  MPSCQueue<Callback> queue_;
+};
+
+}
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/ConsistentHash.h>
+
+#include <algorithm>
+#include <folly/SpookyHashV2.h>
+#include <glog/logging.h>
+
+using folly::hash::SpookyHashV2;
+
+namespace proxygen {
+
+const uint32_t ConsistentHash::kDefaultVirtualNodes;
+const size_t ConsistentHash::kNoNode;
+
+ConsistentHash::ConsistentHash(uint32_t virtualNodes)
+    : virtualNodes_(virtualNodes) {
+  CHECK_GT(virtualNodes, 0);
+}
+
+size_t ConsistentHash::addNode(const std::string& name, uint32_t weight) {
+  size_t node = names_.size();
+  names_.push_back(name);
+  uint64_t numPoints = uint64_t(virtualNodes_) * weight;
+  points_.reserve(points_.size() + numPoints);
+  for (uint64_t i = 0; i < numPoints; i++) {
+    // the index of the point seeds the hash, so the points of a node
+    // don't depend on the other nodes
+    points_.emplace_back(SpookyHashV2::Hash64(name.data(), name.size(), i),
+                         node);
+  }
+  // ties go to the node with the lowest name, not to the first added
+  std::sort(points_.begin(), points_.end(),
+            [this] (const Point& a, const Point& b) {
+              if (a.first != b.first) {
+                return a.first < b.first;
+              }
+              return names_[a.second] < names_[b.second];
+            });
+  return node;
+}
+
+bool ConsistentHash::removeNode(const std::string& name) {
+  // the latest node of that name, if it was added again after a removal
+  auto it = std::find(names_.rbegin(), names_.rend(), name);
+  if (it == names_.rend()) {
+    return false;
+  }
+  size_t node = names_.rend() - it - 1;
+  size_t before = points_.size();
+  points_.erase(std::remove_if(points_.begin(), points_.end(),
+                               [node] (const Point& point) {
+                                 return point.second == node;
+                               }),
+                points_.end());
+  return points_.size() < before;
+}
+
+size_t ConsistentHash::getNode(folly::StringPiece key) const {
+  if (points_.empty()) {
+    return kNoNode;
+  }
+  uint64_t hash = SpookyHashV2::Hash64(key.data(), key.size(), 0);
+  auto it = std::lower_bound(points_.begin(), points_.end(), hash,
+                             [] (const Point& point, uint64_t h) {
+                               return point.first < h;
+                             });
+  if (it == points_.end()) {
+    // around the ring
+    it = points_.begin();
+  }
+  return it->second;
+}
+
+}
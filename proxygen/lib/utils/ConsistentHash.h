@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <folly/Range.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Maps keys to nodes so that adding or removing a node only moves the
+ * keys of that node: each node is hashed to virtualNodes points on a ring
+ * of 64 bit hashes, times its weight, and a key belongs to the node of the
+ * first point at or after the hash of the key.
+ *
+ * The points depend only on the names of the nodes, so that every server
+ * given the same nodes maps the keys the same way, whatever the order the
+ * nodes were added in. Not thread safe to change, safe to read from any
+ * number of threads.
+ */
+class ConsistentHash {
+ public:
+  static const uint32_t kDefaultVirtualNodes = 160;
+  static const size_t kNoNode = size_t(-1);
+
+  explicit ConsistentHash(uint32_t virtualNodes = kDefaultVirtualNodes);
+
+  /**
+   * Add a node, with weight times the points of a node of weight 1
+   *
+   * @return the index of the node, for getNode()
+   */
+  size_t addNode(const std::string& name, uint32_t weight = 1);
+
+  /**
+   * Remove the points of a node. Its index stays taken.
+   *
+   * @return false if there is no such node
+   */
+  bool removeNode(const std::string& name);
+
+  /**
+   * @return the index of the node that owns key, kNoNode if there is none
+   */
+  size_t getNode(folly::StringPiece key) const;
+
+  const std::string& getName(size_t node) const {
+    return names_[node];
+  }
+
+  size_t getNumPoints() const {
+    return points_.size();
+  }
+
+ private:
+  // the hash of a point, and its node
+  typedef std::pair<uint64_t, size_t> Point;
+
+  const uint32_t virtualNodes_;
+  std::vector<std::string> names_;
+  // sorted by hash
+  std::vector<Point> points_;
+};
+
+}
@@ -9,68 +9,328 @@
  */
 #include <proxygen/lib/utils/CryptUtil.h>
 
-#include <iomanip>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
+#include <cstring>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
 #include <openssl/evp.h>
 #include <openssl/md5.h>
-#include <sstream>
+#include <openssl/sha.h>
+
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PROXYGEN_BASE64_SSSE3 1
+#else
+#define PROXYGEN_BASE64_SSSE3 0
+#endif
 
 namespace proxygen {
 
-// Base64 encode using openssl
-std::string base64Encode(folly::ByteRange text) {
-  std::string result;
-  BIO *b64 = BIO_new(BIO_f_base64());
-  if (b64 == nullptr) {
-    return result;
+namespace {
+
+const char kBase64Chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const char kHexChars[] = "0123456789abcdef";
+
+// The value of each character of the alphabet, 0xFF for the others
+struct DecodeTable {
+  DecodeTable(char c62, char c63) {
+    memset(values, 0xFF, sizeof(values));
+    for (uint8_t i = 0; i < 62; i++) {
+      values[uint8_t(kBase64Chars[i])] = i;
+    }
+    values[uint8_t(c62)] = 62;
+    values[uint8_t(c63)] = 63;
   }
-  BIO *bmem = BIO_new(BIO_s_mem());
-  if (bmem == nullptr) {
-    BIO_free_all(b64);
-    return result;
+
+  uint8_t values[256];
+};
+
+const DecodeTable& getDecodeTable() {
+  static const DecodeTable table('+', '/');
+  return table;
+}
+
+const DecodeTable& getUrlDecodeTable() {
+  static const DecodeTable table('-', '_');
+  return table;
+}
+
+#if PROXYGEN_BASE64_SSSE3
+
+// The 16 characters of the 12 bytes at in, after W. Mula's
+// https://arxiv.org/abs/1704.00605
+inline __m128i encode12(const uint8_t* in) {
+  // reads 16 bytes, uses 12
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  bytes = _mm_shuffle_epi8(bytes, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                               4, 5, 3, 4, 1, 2, 0, 1));
+  // the four 6 bit indices of each 3 bytes, one per byte
+  const __m128i t0 = _mm_and_si128(bytes, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(bytes, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i indices = _mm_or_si128(t1, t3);
+  // the offset from each index to its character, by range of indices
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  const __m128i offsets = _mm_setr_epi8(
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+    '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+// The 12 bytes of the 16 characters of in, in the low bytes of out.
+// Returns false if one of them isn't of the alphabet.
+inline bool decode16(__m128i in, __m128i& out) {
+  const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+  const __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), nibbleMask);
+  const __m128i low = _mm_and_si128(in, nibbleMask);
+  // bit h of the mask of low nibble l is set if 16 * h + l is valid
+  const __m128i lowMasks = _mm_setr_epi8(
+    char(0xa8), char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf8),
+    char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf0), 0x54,
+    0x50, 0x50, 0x50, 0x54);
+  const __m128i highBits = _mm_setr_epi8(
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, char(0x80),
+    0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i valid = _mm_and_si128(_mm_shuffle_epi8(lowMasks, low),
+                                      _mm_shuffle_epi8(highBits, high));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128()))) {
+    return false;
   }
-  BUF_MEM *bptr;
+  // the offset from each character to its value, by high nibble, but
+  // '/' shares its nibble with '+'
+  const __m128i shifts = _mm_setr_epi8(
+    0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i shift = _mm_shuffle_epi8(shifts, high);
+  const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+  shift = _mm_add_epi8(shift, _mm_and_si128(slash, _mm_set1_epi8(-3)));
+  const __m128i values = _mm_add_epi8(in, shift);
+  // pack the four 6 bit values of each 32 bits into 3 bytes
+  const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  out = _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                              14, 13, 12, -1, -1, -1, -1));
+  return true;
+}
 
-  // chain base64 filter with the memory buffer
-  // so that text will be encoded by base64 and flushed to buffer
-  BIO *chain = BIO_push(b64, bmem);
-  if (chain == nullptr) {
-    BIO_free_all(b64);
-    return result;
+#endif
+
+bool base64DecodeWith(const DecodeTable& table, folly::StringPiece text,
+                      uint8_t* out, size_t& outSize) {
+  size_t size = text.size();
+  while (size > 0 && text.data()[size - 1] == '=') {
+    size--;
+  }
+  if (size % 4 == 1 || text.size() - size > 2) {
+    return false;
+  }
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(text.data());
+  size_t i = 0;
+  uint8_t* o = out;
+#if PROXYGEN_BASE64_SSSE3
+  if (&table == &getDecodeTable()) {
+    // each 16 characters write 16 bytes of which 12 are used, so leave
+    // the last 8 characters, at least 4 bytes, to the loop below
+    for (; i + 24 <= size; i += 16, o += 12) {
+      __m128i decoded;
+      if (!decode16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)),
+                    decoded)) {
+        return false;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o), decoded);
+    }
+  }
+#endif
+  for (; i + 4 <= size; i += 4) {
+    const uint32_t a = table.values[in[i]];
+    const uint32_t b = table.values[in[i + 1]];
+    const uint32_t c = table.values[in[i + 2]];
+    const uint32_t d = table.values[in[i + 3]];
+    if ((a | b | c | d) & 0x80) {
+      return false;
+    }
+    const uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+    *o++ = uint8_t(bits >> 16);
+    *o++ = uint8_t(bits >> 8);
+    *o++ = uint8_t(bits);
   }
-  BIO_set_flags(chain, BIO_FLAGS_BASE64_NO_NL);
-  BIO_write(chain, text.begin(), text.size());
-  if (BIO_flush(chain) != 1) {
-    BIO_free_all(chain);
-    return result;
+  if (i < size) {
+    // 2 or 3 characters, the bits past the last byte are ignored
+    const uint32_t a = table.values[in[i]];
+    const uint32_t b = table.values[in[i + 1]];
+    const uint32_t c = size - i == 3 ? table.values[in[i + 2]] : 0;
+    if ((a | b | c) & 0x80) {
+      return false;
+    }
+    const uint32_t bits = (a << 18) | (b << 12) | (c << 6);
+    *o++ = uint8_t(bits >> 16);
+    if (size - i == 3) {
+      *o++ = uint8_t(bits >> 8);
+    }
   }
+  outSize = o - out;
+  return true;
+}
+
+bool base64DecodeWith(const DecodeTable& table, folly::StringPiece text,
+                      std::string& out) {
+  out.resize(base64DecodedMaxSize(text.size()));
+  size_t size = 0;
+  bool ok = base64DecodeWith(table, text,
+                             reinterpret_cast<uint8_t*>(&out[0]), size);
+  out.resize(ok ? size : 0);
+  return ok;
+}
 
-  BIO_get_mem_ptr(chain, &bptr);
+}
 
-  if (bptr && bptr->length > 0) {
-    result = std::string((char *)bptr->data, bptr->length);
+size_t base64Encode(folly::ByteRange text, char* out) {
+  const uint8_t* in = text.begin();
+  const size_t size = text.size();
+  size_t i = 0;
+  char* o = out;
+#if PROXYGEN_BASE64_SSSE3
+  // each 12 bytes read 16
+  for (; i + 16 <= size; i += 12, o += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(o), encode12(in + i));
+  }
+#endif
+  for (; i + 3 <= size; i += 3) {
+    const uint32_t bits = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    *o++ = kBase64Chars[bits >> 18];
+    *o++ = kBase64Chars[(bits >> 12) & 0x3F];
+    *o++ = kBase64Chars[(bits >> 6) & 0x3F];
+    *o++ = kBase64Chars[bits & 0x3F];
   }
+  if (i < size) {
+    const uint32_t bits =
+      (in[i] << 16) | (i + 1 < size ? in[i + 1] << 8 : 0);
+    *o++ = kBase64Chars[bits >> 18];
+    *o++ = kBase64Chars[(bits >> 12) & 0x3F];
+    *o++ = i + 1 < size ? kBase64Chars[(bits >> 6) & 0x3F] : '=';
+    *o++ = '=';
+  }
+  return o - out;
+}
 
-  // free the whole BIO chain (b64 and mem)
-  BIO_free_all(chain);
+std::string base64Encode(folly::ByteRange text) {
+  std::string result(base64EncodedSize(text.size()), '\0');
+  if (!result.empty()) {
+    base64Encode(text, &result[0]);
+  }
   return result;
 }
 
+bool base64Decode(folly::StringPiece text, uint8_t* out, size_t& outSize) {
+  return base64DecodeWith(getDecodeTable(), text, out, outSize);
+}
+
+bool base64Decode(folly::StringPiece text, std::string& out) {
+  return base64DecodeWith(getDecodeTable(), text, out);
+}
+
+bool base64UrlDecode(folly::StringPiece text, std::string& out) {
+  return base64DecodeWith(getUrlDecodeTable(), text, out);
+}
+
 // MD5 encode using openssl
 std::string md5Encode(folly::ByteRange text) {
   static_assert(MD5_DIGEST_LENGTH == 16, "");
 
   unsigned char digest[MD5_DIGEST_LENGTH];
   MD5(text.begin(), text.size(), digest);
+  return hexEncode(folly::ByteRange(digest, MD5_DIGEST_LENGTH));
+}
+
+// SHA-1 digest using openssl
+std::string sha1Digest(folly::ByteRange text) {
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  SHA1(text.begin(), text.size(), digest);
+  return std::string(reinterpret_cast<char*>(digest), SHA_DIGEST_LENGTH);
+}
 
-  // convert digest to hex string
-  std::ostringstream ss;
-  ss << std::hex << std::setfill('0');
-  for(int i = 0; i < MD5_DIGEST_LENGTH; i++) {
-    ss << std::setw(2) << (unsigned int)digest[i];
+std::string hexEncode(folly::ByteRange digest) {
+  std::string hex(digest.size() * 2, '\0');
+  for (size_t i = 0; i < digest.size(); i++) {
+    hex[2 * i] = kHexChars[digest[i] >> 4];
+    hex[2 * i + 1] = kHexChars[digest[i] & 0xF];
   }
-  return ss.str();
+  return hex;
+}
+
+StreamingDigest::StreamingDigest(Type type)
+    : type_(type) {
+  if (type_ != Type::SPOOKY) {
+    ctx_ = EVP_MD_CTX_create();
+    CHECK(ctx_);
+  }
+  init();
+}
+
+StreamingDigest::~StreamingDigest() {
+  if (ctx_) {
+    EVP_MD_CTX_destroy(ctx_);
+  }
+}
+
+void StreamingDigest::init() {
+  switch (type_) {
+    case Type::MD5:
+      CHECK_EQ(1, EVP_DigestInit_ex(ctx_, EVP_md5(), nullptr));
+      break;
+    case Type::SHA1:
+      CHECK_EQ(1, EVP_DigestInit_ex(ctx_, EVP_sha1(), nullptr));
+      break;
+    case Type::SHA256:
+      CHECK_EQ(1, EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr));
+      break;
+    case Type::SPOOKY:
+      spooky_.Init(0, 0);
+      break;
+  }
+}
+
+void StreamingDigest::update(folly::ByteRange data) {
+  if (data.empty()) {
+    return;
+  }
+  if (ctx_) {
+    EVP_DigestUpdate(ctx_, data.data(), data.size());
+  } else {
+    spooky_.Update(data.data(), data.size());
+  }
+}
+
+void StreamingDigest::update(const folly::IOBuf& chain) {
+  for (auto range: chain) {
+    update(range);
+  }
+}
+
+std::string StreamingDigest::finish() {
+  std::string digest;
+  if (ctx_) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    CHECK_EQ(1, EVP_DigestFinal_ex(ctx_, md, &size));
+    digest.assign(reinterpret_cast<char*>(md), size);
+  } else {
+    uint64_t hash[2];
+    spooky_.Final(&hash[0], &hash[1]);
+    digest.assign(reinterpret_cast<char*>(hash), sizeof(hash));
+  }
+  init();
+  return digest;
+}
+
+std::string StreamingDigest::finishHex() {
+  auto digest = finish();
+  return hexEncode(folly::ByteRange(
+    reinterpret_cast<const uint8_t*>(digest.data()), digest.size()));
 }
 
 }
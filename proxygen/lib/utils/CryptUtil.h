@@ -10,13 +10,97 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <folly/SpookyHashV2.h>
+#include <openssl/ossl_typ.h>
 #include <string>
 
+namespace folly {
+class IOBuf;
+}
+
 namespace proxygen {
 
-// Base64 encode using openssl, may return empty string on allocation failure
+// The size of the padded base64 of size bytes
+inline size_t base64EncodedSize(size_t size) {
+  return (size + 2) / 3 * 4;
+}
+
+// The most bytes the base64 text of size characters decodes to
+inline size_t base64DecodedMaxSize(size_t size) {
+  return size / 4 * 3 + 2;
+}
+
+// Base64 encode text, with padding, into the base64EncodedSize(text.size())
+// characters at out. Returns the number written.
+size_t base64Encode(folly::ByteRange text, char* out);
+
+// Base64 encode, may return empty string on allocation failure
 std::string base64Encode(folly::ByteRange text);
 
+// Decode the base64 of RFC 4648, with or without padding, into the up to
+// base64DecodedMaxSize(text.size()) bytes at out. Returns false on any
+// other character, otherwise sets outSize to the number written.
+bool base64Decode(folly::StringPiece text, uint8_t* out, size_t& outSize);
+
+bool base64Decode(folly::StringPiece text, std::string& out);
+
+// Decode the URL and filename safe base64 of RFC 4648, with or without
+// padding, into out. Returns false on any other character.
+bool base64UrlDecode(folly::StringPiece text, std::string& out);
+
 // MD5 encode using openssl
 std::string md5Encode(folly::ByteRange text);
+
+// SHA-1 digest using openssl, the 20 bytes of it rather than hex
+std::string sha1Digest(folly::ByteRange text);
+
+// The lowercase hex of digest
+std::string hexEncode(folly::ByteRange digest);
+
+/**
+ * A digest computed a piece at a time, e.g. over the body of a response as
+ * it streams through, and over IOBuf chains without coalescing them.
+ *
+ * MD5 and the SHAs are computed by openssl. SPOOKY is the 128 bit
+ * SpookyHashV2 of folly, which is not cryptographic but hashes several
+ * times faster, for ETags and cache keys that no one has an interest in
+ * colliding.
+ */
+class StreamingDigest {
+ public:
+  enum class Type {
+    MD5,
+    SHA1,
+    SHA256,
+    SPOOKY,
+  };
+
+  explicit StreamingDigest(Type type);
+  ~StreamingDigest();
+
+  StreamingDigest(const StreamingDigest&) = delete;
+  StreamingDigest& operator=(const StreamingDigest&) = delete;
+
+  void update(folly::ByteRange data);
+
+  // Each buffer of chain
+  void update(const folly::IOBuf& chain);
+
+  /**
+   * @return the digest of all the data so far, its raw bytes. The digest
+   *         starts over after.
+   */
+  std::string finish();
+
+  // As above, in lowercase hex
+  std::string finishHex();
+
+ private:
+  void init();
+
+  const Type type_;
+  EVP_MD_CTX* ctx_{nullptr};
+  folly::hash::SpookyHashV2 spooky_;
+};
+
 }
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/FileRegion.h>
+
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+void unmap(void* buf, void* userData) {
+  munmap(buf, reinterpret_cast<uintptr_t>(userData));
+}
+
+}
+
+unique_ptr<IOBuf> FileRegion::map() const {
+  if (length_ == 0) {
+    return IOBuf::create(0);
+  }
+  // mmap() wants an offset aligned on a page
+  static const off_t pageSize = sysconf(_SC_PAGESIZE);
+  off_t start = offset_ - offset_ % pageSize;
+  size_t mapLength = length_ + (offset_ - start);
+  void* addr = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED, getFd(), start);
+  if (addr != MAP_FAILED) {
+    unique_ptr<IOBuf> buf = IOBuf::takeOwnership(
+      addr, mapLength, mapLength, unmap,
+      reinterpret_cast<void*>(uintptr_t(mapLength)));
+    buf->trimStart(offset_ - start);
+    return buf;
+  }
+  VLOG(4) << "failed to map fd=" << getFd() << ", reading it instead: "
+          << strerror(errno);
+  unique_ptr<IOBuf> buf = IOBuf::create(length_);
+  size_t done = 0;
+  while (done < length_) {
+    ssize_t n = pread(getFd(), buf->writableTail(), length_ - done,
+                      offset_ + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      LOG(ERROR) << "failed to read " << length_ << " bytes at " << offset_
+                 << " from fd=" << getFd();
+      return nullptr;
+    }
+    buf->append(n);
+    done += n;
+  }
+  return buf;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <sys/types.h>
+
+namespace proxygen {
+
+/**
+ * length bytes of a file from offset, to send as a body without reading
+ * them in user space. The file stays open as long as some region of it has
+ * not been sent.
+ */
+class FileRegion {
+ public:
+  FileRegion(std::shared_ptr<folly::File> file, off_t offset, size_t length):
+      file_(std::move(file)),
+      offset_(offset),
+      length_(length) {}
+
+  int getFd() const {
+    return file_->fd();
+  }
+
+  off_t getOffset() const {
+    return offset_;
+  }
+
+  size_t getLength() const {
+    return length_;
+  }
+
+  /**
+   * @return the length bytes from offset in this region, of the same file
+   */
+  FileRegion slice(size_t offset, size_t length) const {
+    return FileRegion(file_, offset_ + offset, length);
+  }
+
+  /**
+   * @return the bytes of the region in an IOBuf, for the transports that
+   * can't send the file directly. The IOBuf maps the file when it can,
+   * and holds a copy read with pread() otherwise. nullptr if the file
+   * can't be read.
+   */
+  std::unique_ptr<folly::IOBuf> map() const;
+
+ private:
+  std::shared_ptr<folly::File> file_;
+  off_t offset_;
+  size_t length_;
+};
+
+}
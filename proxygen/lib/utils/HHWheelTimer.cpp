@@ -0,0 +1,221 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/HHWheelTimer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <folly/ScopeGuard.h>
+
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+const milliseconds HHWheelTimer::kDefaultTickInterval(1);
+
+const uint32_t HHWheelTimer::kLevelBits;
+const uint32_t HHWheelTimer::kNumSlots;
+const uint32_t HHWheelTimer::kSlotMask;
+const uint32_t HHWheelTimer::kNumLevels;
+
+HHWheelTimer::Callback::~Callback() {
+  if (isScheduled()) {
+    cancelTimeout();
+  }
+}
+
+void HHWheelTimer::Callback::cancelTimeoutImpl() {
+  assert(hook_.is_linked());
+  hook_.unlink();
+  HHWheelTimer* wheel = wheel_;
+  wheel_ = nullptr;
+  expiration_ = 0;
+  context_.reset();
+  wheel->callbackCancelled();
+}
+
+HHWheelTimer::HHWheelTimer(folly::TimeoutManager* timeoutManager,
+                           milliseconds tickInterval)
+    : folly::AsyncTimeout(timeoutManager),
+      tickInterval_(std::max(tickInterval, milliseconds(1))),
+      start_(getCurrentTime()) {
+}
+
+HHWheelTimer::HHWheelTimer(folly::TimeoutManager* timeoutManager,
+                           InternalEnum internal,
+                           milliseconds tickInterval)
+    : folly::AsyncTimeout(timeoutManager, internal),
+      tickInterval_(std::max(tickInterval, milliseconds(1))),
+      start_(getCurrentTime()) {
+}
+
+HHWheelTimer::~HHWheelTimer() {
+  // DelayedDestruction should ensure that we are never destroyed while inside
+  // a call to timeoutExpired().
+  assert(!inTimeoutExpired_);
+  // destroy() should have already cancelled all the callbacks
+  assert(count_ == 0);
+}
+
+void HHWheelTimer::destroy() {
+  for (auto& level: slots_) {
+    for (auto& slot: level) {
+      while (!slot.empty()) {
+        slot.front().cancelTimeout();
+      }
+    }
+  }
+  DelayedDestruction::destroy();
+}
+
+void HHWheelTimer::scheduleTimeout(Callback* callback, milliseconds timeout) {
+  // Cancel the callback if it happens to be scheduled already.
+  callback->cancelTimeout();
+
+  if (count_ == 0 && !inTimeoutExpired_) {
+    // Nothing is scheduled, skip the ticks the wheel was idle
+    nextTick_ = currentTick();
+  }
+  // Round up, so that the callback never fires early
+  auto due = getCurrentTime() - start_ + std::max(timeout, milliseconds(0));
+  uint64_t ticks = (due + tickInterval_ - std::chrono::nanoseconds(1)) /
+    tickInterval_;
+
+  callback->context_ = folly::RequestContext::saveContext();
+  callback->wheel_ = this;
+  callback->expiration_ = ticks;
+  count_++;
+  uint64_t wakeup = addCallback(callback);
+
+  if (!inTimeoutExpired_ &&
+      (!this->folly::AsyncTimeout::isScheduled() || wakeup < wakeupTick_)) {
+    scheduleWakeup(wakeup);
+  }
+}
+
+uint64_t HHWheelTimer::currentTick() const {
+  return (getCurrentTime() - start_) / tickInterval_;
+}
+
+uint64_t HHWheelTimer::addCallback(Callback* callback) {
+  if (callback->expiration_ < nextTick_) {
+    // Late, it goes to the next tick
+    slots_[0][nextTick_ & kSlotMask].push_back(*callback);
+    return nextTick_;
+  }
+  uint64_t delta = callback->expiration_ - nextTick_;
+  const uint64_t maxDelta = (uint64_t(1) << (kLevelBits * kNumLevels)) - 1;
+  if (delta > maxDelta) {
+    callback->expiration_ = nextTick_ + maxDelta;
+    delta = maxDelta;
+  }
+  uint32_t level = 0;
+  while (delta >= (uint64_t(1) << (kLevelBits * (level + 1)))) {
+    level++;
+  }
+  uint32_t slot = (callback->expiration_ >> (kLevelBits * level)) & kSlotMask;
+  slots_[level][slot].push_back(*callback);
+  if (level == 0) {
+    return callback->expiration_;
+  }
+  // The first level wraps around here, which may move the callback down
+  return nextWrap();
+}
+
+uint64_t HHWheelTimer::nextWrap() const {
+  // nextTick_ itself if it is the first tick of a turn
+  return ((nextTick_ - 1) | kSlotMask) + 1;
+}
+
+void HHWheelTimer::cascade(uint32_t level, uint32_t slot) {
+  CallbackList callbacks;
+  callbacks.swap(slots_[level][slot]);
+  while (!callbacks.empty()) {
+    Callback* callback = &callbacks.front();
+    callback->hook_.unlink();
+    addCallback(callback);
+  }
+}
+
+void HHWheelTimer::callbackCancelled() {
+  assert(count_ > 0);
+  count_--;
+  if (count_ == 0 && !inTimeoutExpired_) {
+    this->folly::AsyncTimeout::cancelTimeout();
+  }
+}
+
+void HHWheelTimer::scheduleWakeup(uint64_t tick) {
+  wakeupTick_ = tick;
+  // Round up, waking up before the tick would only cost a loop
+  auto delay = std::chrono::duration_cast<milliseconds>(
+    start_ + int64_t(tick) * tickInterval_ - getCurrentTime() +
+    milliseconds(1) - std::chrono::nanoseconds(1));
+  this->folly::AsyncTimeout::scheduleTimeout(
+    std::max<int64_t>(delay.count(), 0));
+}
+
+void HHWheelTimer::scheduleNextWakeup() {
+  if (count_ == 0) {
+    this->folly::AsyncTimeout::cancelTimeout();
+    return;
+  }
+  // The first slot with callbacks before the first level wraps around
+  uint64_t tick = nextTick_;
+  uint64_t wrap = nextWrap();
+  while (tick < wrap && slots_[0][tick & kSlotMask].empty()) {
+    tick++;
+  }
+  scheduleWakeup(tick);
+}
+
+void HHWheelTimer::timeoutExpired() noexcept {
+  // If destroy() is called inside timeoutExpired(), delay actual destruction
+  // until timeoutExpired() returns
+  DestructorGuard dg(this);
+
+  // Don't reschedule the AsyncTimeout while the callbacks run, it is done
+  // once before returning.
+  assert(!inTimeoutExpired_);
+  inTimeoutExpired_ = true;
+  SCOPE_EXIT { inTimeoutExpired_ = false; };
+
+  uint64_t now = currentTick();
+  while (nextTick_ <= now && count_ > 0) {
+    uint32_t slot = nextTick_ & kSlotMask;
+    if (slot == 0) {
+      // The first level wrapped around, move the callbacks of the next
+      // ticks down, and so on for each level that wrapped
+      for (uint32_t level = 1; level < kNumLevels; level++) {
+        uint32_t upperSlot = (nextTick_ >> (kLevelBits * level)) & kSlotMask;
+        cascade(level, upperSlot);
+        if (upperSlot != 0) {
+          break;
+        }
+      }
+    }
+    nextTick_++;
+
+    CallbackList expired;
+    expired.swap(slots_[0][slot]);
+    while (!expired.empty()) {
+      // Remember the callback to invoke, since calling cancelTimeout()
+      // on it will unlink it from the list.
+      Callback* cb = &expired.front();
+      auto context = cb->context_;
+      cb->cancelTimeout();
+      auto old_ctx = folly::RequestContext::setContext(context);
+      cb->timeoutExpired();
+      folly::RequestContext::setContext(old_ctx);
+    }
+  }
+  scheduleNextWakeup();
+}
+
+} // proxygen
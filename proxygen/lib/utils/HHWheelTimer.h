@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <folly/IntrusiveList.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/DelayedDestruction.h>
+#include <folly/io/async/Request.h>
+#include <folly/io/async/TimeoutManager.h>
+#include <memory>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Hashed hierarchical timing wheel. Unlike AsyncTimeoutSet, each callback
+ * is scheduled with its own timeout, and scheduling or cancelling one is
+ * O(1) whatever the mix of timeouts. So a single HHWheelTimer per
+ * EventBase can hold all its timeouts, behind one AsyncTimeout.
+ *
+ * The wheel has 4 levels of 256 slots. The first level holds the callbacks
+ * that expire in the next 256 ticks, one slot per tick, and each level
+ * after it holds 256 times longer timeouts. The callbacks move down a level
+ * each time the level below wraps around. Timeouts longer than 2^32 ticks
+ * are cut to that.
+ *
+ * The callbacks fire at the first tick at or after their expiration, so
+ * never early, and at most one tick late when the event loop keeps up. The
+ * AsyncTimeout only fires for the ticks that have callbacks, and once per
+ * 256 ticks while some are on the upper levels.
+ */
+class HHWheelTimer : private folly::AsyncTimeout,
+                     public folly::DelayedDestruction {
+ public:
+  typedef std::unique_ptr<HHWheelTimer, Destructor> UniquePtr;
+
+  static const std::chrono::milliseconds kDefaultTickInterval;
+
+  /**
+   * A callback to be notified when a timeout has expired.
+   */
+  class Callback {
+   public:
+    Callback() {}
+
+    virtual ~Callback();
+
+    /**
+     * timeoutExpired() is invoked when the timeout has expired.
+     */
+    virtual void timeoutExpired() noexcept = 0;
+
+    /**
+     * Cancel the timeout, if it is running.
+     *
+     * If the timeout is not scheduled, cancelTimeout() does nothing.
+     */
+    void cancelTimeout() {
+      if (wheel_ == nullptr) {
+        // We're not scheduled, so there's nothing to do.
+        return;
+      }
+      cancelTimeoutImpl();
+    }
+
+    /**
+     * Return true if this timeout is currently scheduled, and false otherwise.
+     */
+    bool isScheduled() const {
+      return wheel_ != nullptr;
+    }
+
+   private:
+    void cancelTimeoutImpl();
+
+    folly::IntrusiveListHook hook_;
+    HHWheelTimer* wheel_{nullptr};
+    // tick at which the callback expires
+    uint64_t expiration_{0};
+    std::shared_ptr<folly::RequestContext> context_;
+
+    // Give HHWheelTimer direct access to our members so it can take care
+    // of scheduling/cancelling.
+    friend class HHWheelTimer;
+  };
+
+  /**
+   * Create a new HHWheelTimer that counts time in ticks of tickInterval
+   */
+  explicit HHWheelTimer(folly::TimeoutManager* timeoutManager,
+                        std::chrono::milliseconds tickInterval =
+                          kDefaultTickInterval);
+
+  HHWheelTimer(folly::TimeoutManager* timeoutManager,
+               InternalEnum internal,
+               std::chrono::milliseconds tickInterval = kDefaultTickInterval);
+
+  /**
+   * Destroy the HHWheelTimer. The callbacks that are still scheduled are
+   * cancelled, and never invoked.
+   */
+  virtual void destroy();
+
+  std::chrono::milliseconds getTickInterval() const {
+    return tickInterval_;
+  }
+
+  /**
+   * Schedule callback to be invoked after timeout. If the callback is
+   * already scheduled, this cancels the existing timeout first.
+   */
+  void scheduleTimeout(Callback* callback, std::chrono::milliseconds timeout);
+
+  /**
+   * Return the number of callbacks scheduled
+   */
+  size_t count() const {
+    return count_;
+  }
+
+ protected:
+  /**
+   * Protected destructor.
+   *
+   * Use destroy() instead.  See the comments in TDelayedDestruction for more
+   * details.
+   */
+  virtual ~HHWheelTimer();
+
+ private:
+  static const uint32_t kLevelBits = 8;
+  static const uint32_t kNumSlots = 1 << kLevelBits;
+  static const uint32_t kSlotMask = kNumSlots - 1;
+  static const uint32_t kNumLevels = 4;
+
+  typedef folly::IntrusiveList<Callback, &Callback::hook_> CallbackList;
+
+  // Forbidden copy constructor and assignment operator
+  HHWheelTimer(HHWheelTimer const &) = delete;
+  HHWheelTimer& operator=(HHWheelTimer const &) = delete;
+
+  // Methods inherited from TAsyncTimeout
+  virtual void timeoutExpired() noexcept;
+
+  uint64_t currentTick() const;
+
+  /**
+   * Put callback in the slot of its expiration
+   *
+   * @return the tick at which the wheel must look at the slot
+   */
+  uint64_t addCallback(Callback* callback);
+
+  /**
+   * Return the next tick at which the first level wraps around
+   */
+  uint64_t nextWrap() const;
+
+  /**
+   * Move the callbacks of a slot of an upper level down the wheel
+   */
+  void cascade(uint32_t level, uint32_t slot);
+
+  void callbackCancelled();
+
+  /**
+   * Schedule the AsyncTimeout for tick
+   */
+  void scheduleWakeup(uint64_t tick);
+
+  /**
+   * Schedule the AsyncTimeout for the next tick that has callbacks
+   */
+  void scheduleNextWakeup();
+
+  std::chrono::milliseconds tickInterval_;
+  TimePoint start_;
+  CallbackList slots_[kNumLevels][kNumSlots];
+  // next tick to process
+  uint64_t nextTick_{0};
+  // tick the AsyncTimeout is scheduled for
+  uint64_t wakeupTick_{0};
+  size_t count_{0};
+  bool inTimeoutExpired_{false};
+};
+
+} // proxygen
@@ -9,35 +9,212 @@
  */
 #include <proxygen/lib/utils/HTTPTime.h>
 
+#include <cstring>
 #include <ctime>
+#include <folly/ThreadLocal.h>
 #include <glog/logging.h>
 
 namespace proxygen {
 
-folly::Optional<int64_t> parseHTTPDateTime(const std::string& s) {
-  struct tm tm = {0};
+namespace {
+
+const char kWeekdays[] = "SunMonTueWedThuFriSat";
+const char kMonths[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+// Days since 1970-01-01 of a proleptic Gregorian date, with month in
+// [1, 12]. See http://howardhinnant.github.io/date_algorithms.html
+int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// The inverse of daysFromCivil()
+void civilFromDays(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+  z += 719468;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned doe = static_cast<unsigned>(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+int64_t secondsFromTm(const struct tm& tm) {
+  return daysFromCivil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 86400 +
+    tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+}
+
+// Index of the three letter name at p in names, or -1
+int findName(const char* names, size_t count, const char* p) {
+  for (size_t i = 0; i < count; ++i) {
+    if (memcmp(names + i * 3, p, 3) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool parseDigits(const char* p, size_t n, unsigned& out) {
+  out = 0;
+  for (size_t i = 0; i < n; ++i) {
+    unsigned digit = static_cast<unsigned char>(p[i]) - '0';
+    if (digit > 9) {
+      return false;
+    }
+    out = out * 10 + digit;
+  }
+  return true;
+}
+
+bool isLeapYear(unsigned y) {
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+unsigned daysInMonth(unsigned y, unsigned m) {
+  static const unsigned char kDays[] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+  };
+  return (m == 2 && isLeapYear(y)) ? 29 : kDays[m - 1];
+}
+
+// Sun, 06 Nov 1994 08:49:37 GMT  ; IMF-fixdate (RFC 7231)
+// 0123456789012345678901234567890
+folly::Optional<int64_t> parseIMFFixdate(folly::StringPiece s) {
+  const char* p = s.data();
+  if (s.size() != kHTTPDateTimeLength ||
+      p[3] != ',' || p[4] != ' ' || p[7] != ' ' || p[11] != ' ' ||
+      p[16] != ' ' || p[19] != ':' || p[22] != ':' ||
+      memcmp(p + 25, " GMT", 4) != 0 ||
+      findName(kWeekdays, 7, p) < 0) {
+    return folly::Optional<int64_t>();
+  }
+  int month = findName(kMonths, 12, p + 8);
+  unsigned day, year, hour, minute, second;
+  if (month < 0 ||
+      !parseDigits(p + 5, 2, day) || !parseDigits(p + 12, 4, year) ||
+      !parseDigits(p + 17, 2, hour) || !parseDigits(p + 20, 2, minute) ||
+      !parseDigits(p + 23, 2, second) ||
+      day == 0 || day > daysInMonth(year, month + 1) ||
+      hour > 23 || minute > 59 || second > 60) {
+    return folly::Optional<int64_t>();
+  }
+  return daysFromCivil(year, month + 1, day) * 86400 +
+    hour * 3600 + minute * 60 + second;
+}
 
+void writeDigits(char* out, unsigned value, size_t n) {
+  while (n-- > 0) {
+    out[n] = '0' + value % 10;
+    value /= 10;
+  }
+}
+
+}
+
+folly::Optional<int64_t> parseHTTPDateTime(folly::StringPiece s) {
   if (s.empty()) {
     return folly::Optional<int64_t>();
   }
 
+  // Neither obsolete form has a comma after three letters and a space two
+  // digits later, so a date of this shape is never handed to strptime()
+  if (s.size() == kHTTPDateTimeLength && s[3] == ',' && s[7] == ' ') {
+    auto fixdate = parseIMFFixdate(s);
+    if (!fixdate) {
+      LOG(INFO) << "Invalid http time: " << s;
+    }
+    return fixdate;
+  }
+
+  // strptime needs a terminated string, but only the obsolete forms and
+  // garbage get this far
+  std::string str = s.str();
+  struct tm tm = {0};
+
   // Sun, 06 Nov 1994 08:49:37 GMT  ; RFC 822, updated by RFC 1123
-  if (strptime(s.c_str(), "%a, %d %b %Y %H:%M:%S %Z", &tm) != nullptr) {
-    return folly::Optional<int64_t>(mktime(&tm));
+  if (strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S %Z", &tm) != nullptr) {
+    return secondsFromTm(tm);
   }
 
   // Sunday, 06-Nov-94 08:49:37 GMT ; RFC 850, obsoleted by RFC 1036
-  if (strptime(s.c_str(), "%a, %d-%b-%y %H:%M:%S %Z", &tm) != nullptr) {
-    return folly::Optional<int64_t>(mktime(&tm));
+  if (strptime(str.c_str(), "%a, %d-%b-%y %H:%M:%S %Z", &tm) != nullptr) {
+    return secondsFromTm(tm);
   }
 
   // Sun Nov  6 08:49:37 1994       ; ANSI C's asctime() format
-  if(strptime(s.c_str(), "%a %b %d %H:%M:%S %Y", &tm) != nullptr) {
-    return folly::Optional<int64_t>(mktime(&tm));
+  if(strptime(str.c_str(), "%a %b %d %H:%M:%S %Y", &tm) != nullptr) {
+    return secondsFromTm(tm);
   }
 
   LOG(INFO) << "Invalid http time: " << s;
   return folly::Optional<int64_t>();
 }
 
+namespace {
+
+struct DateCache {
+  time_t formattedAt{-1};
+  std::string value;
+};
+
+}
+
+void formatHTTPDateTime(time_t t, char* out) {
+  int64_t days = t / 86400;
+  int64_t secs = t % 86400;
+  if (secs < 0) {
+    secs += 86400;
+    --days;
+  }
+  int64_t year;
+  unsigned month, day;
+  civilFromDays(days, year, month, day);
+  // 1970-01-01 was a Thursday
+  int64_t weekday = (days + 4) % 7;
+  if (weekday < 0) {
+    weekday += 7;
+  }
+
+  memcpy(out, kWeekdays + weekday * 3, 3);
+  memcpy(out + 3, ", ", 2);
+  writeDigits(out + 5, day, 2);
+  out[7] = ' ';
+  memcpy(out + 8, kMonths + (month - 1) * 3, 3);
+  out[11] = ' ';
+  writeDigits(out + 12, year, 4);
+  out[16] = ' ';
+  writeDigits(out + 17, secs / 3600, 2);
+  out[19] = ':';
+  writeDigits(out + 20, secs / 60 % 60, 2);
+  out[22] = ':';
+  writeDigits(out + 23, secs % 60, 2);
+  memcpy(out + 25, " GMT", 4);
+}
+
+std::string formatHTTPDateTime(time_t t) {
+  char buff[kHTTPDateTimeLength];
+  formatHTTPDateTime(t, buff);
+  return std::string(buff, sizeof(buff));
+}
+
+const std::string& getCachedHTTPDateTime() {
+  static folly::ThreadLocal<DateCache> cache;
+
+  const time_t now = time(nullptr);
+  DateCache& c = *cache;
+  if (now != c.formattedAt) {
+    // Formatting in place keeps the string's buffer across seconds
+    c.value.resize(kHTTPDateTimeLength);
+    formatHTTPDateTime(now, &c.value[0]);
+    c.formattedAt = now;
+  }
+  return c.value;
+}
+
 } // proxygen
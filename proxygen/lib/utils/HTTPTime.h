@@ -10,11 +10,44 @@
 #pragma once
 
 #include <folly/Optional.h>
+#include <folly/Range.h>
+#include <ctime>
 #include <stddef.h>
 #include <string>
 
 namespace proxygen {
 
-folly::Optional<int64_t> parseHTTPDateTime(const std::string& s);
+/**
+ * Length of an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ */
+constexpr size_t kHTTPDateTimeLength = 29;
+
+/**
+ * Parse an HTTP date into seconds since the epoch (UTC). IMF-fixdate, the
+ * form every current sender uses, is decoded at fixed offsets; the obsolete
+ * RFC 850 and asctime() forms go through strptime().
+ */
+folly::Optional<int64_t> parseHTTPDateTime(folly::StringPiece s);
+
+/**
+ * Format `t` the way the Date header wants it, e.g.
+ * "Sun, 06 Nov 1994 08:49:37 GMT".
+ */
+std::string formatHTTPDateTime(time_t t);
+
+/**
+ * Same as above, but writes the kHTTPDateTimeLength bytes into `out`, which
+ * must have room for them. It is not NUL terminated.
+ */
+void formatHTTPDateTime(time_t t, char* out);
+
+/**
+ * Get the current time formatted for a Date header. The string is cached per
+ * thread and reformatted at most once per second, so this is cheap enough to
+ * call for every response. The returned reference stays valid for the
+ * lifetime of the thread, but its contents change when the second rolls
+ * over.
+ */
+const std::string& getCachedHTTPDateTime();
 
 } // proxygen
@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/HeavyHitters.h>
+
+#include <algorithm>
+#include <folly/Hash.h>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+namespace {
+
+struct CountGreater {
+  template <class T>
+  bool operator()(const T& a, const T& b) const {
+    return a.count > b.count;
+  }
+};
+
+}
+
+HeavyHitters::HeavyHitters(size_t width, size_t depth, size_t k)
+    : width_(width),
+      depth_(depth),
+      k_(k),
+      counters_(width * depth, 0) {
+  CHECK_GT(width_, 0);
+  CHECK_GT(depth_, 0);
+  top_.reserve(k_);
+}
+
+uint64_t HeavyHitters::hash(folly::StringPiece key) {
+  return folly::hash::fnv64_buf(key.data(), key.size());
+}
+
+size_t HeavyHitters::getIndex(uint64_t hash, size_t row) const {
+  // double hashing: the rows only need pairwise independent indices
+  uint32_t h1 = hash;
+  uint32_t h2 = (hash >> 32) | 1;
+  return row * width_ + (h1 + row * h2) % width_;
+}
+
+uint64_t HeavyHitters::estimate(uint64_t hash) const {
+  uint64_t result = counters_[getIndex(hash, 0)];
+  for (size_t row = 1; row < depth_; row++) {
+    result = std::min(result, counters_[getIndex(hash, row)]);
+  }
+  return result;
+}
+
+uint64_t HeavyHitters::estimate(folly::StringPiece key) const {
+  return estimate(hash(key));
+}
+
+void HeavyHitters::add(folly::StringPiece key, uint64_t count) {
+  uint64_t h = hash(key);
+  // conservative update: only raise the counters below the new estimate,
+  // which keeps the overestimates of the other keys down
+  uint64_t updated = estimate(h) + count;
+  for (size_t row = 0; row < depth_; row++) {
+    auto& counter = counters_[getIndex(h, row)];
+    counter = std::max(counter, updated);
+  }
+  total_ += count;
+  offer(key, h, updated);
+}
+
+void HeavyHitters::offer(folly::StringPiece key, uint64_t h,
+                         uint64_t count) {
+  if (k_ == 0) {
+    return;
+  }
+  // The count of a key in the heap only grows with its estimate, so a key
+  // estimated at most at the minimum isn't there: the long tail stops here
+  if (top_.size() == k_ && count <= top_.front().count) {
+    return;
+  }
+  for (auto& candidate: top_) {
+    if (candidate.hash == h && candidate.key == key) {
+      candidate.count = count;
+      std::make_heap(top_.begin(), top_.end(), CountGreater());
+      return;
+    }
+  }
+  if (top_.size() == k_) {
+    std::pop_heap(top_.begin(), top_.end(), CountGreater());
+    top_.pop_back();
+  }
+  top_.push_back(Candidate{key.str(), h, count});
+  std::push_heap(top_.begin(), top_.end(), CountGreater());
+}
+
+void HeavyHitters::merge(const HeavyHitters& other) {
+  CHECK_EQ(width_, other.width_);
+  CHECK_EQ(depth_, other.depth_);
+  for (size_t i = 0; i < counters_.size(); i++) {
+    counters_[i] += other.counters_[i];
+  }
+  total_ += other.total_;
+  // the heavy hitters of the sum are heavy in at least one of the parts
+  // (with high probability), so the candidates of both are enough
+  std::vector<Candidate> candidates;
+  candidates.swap(top_);
+  candidates.insert(candidates.end(), other.top_.begin(), other.top_.end());
+  for (const auto& candidate: candidates) {
+    offer(candidate.key, candidate.hash, estimate(candidate.hash));
+  }
+}
+
+void HeavyHitters::decay() {
+  for (auto& counter: counters_) {
+    counter /= 2;
+  }
+  total_ /= 2;
+  for (auto& candidate: top_) {
+    candidate.count = estimate(candidate.hash);
+  }
+  std::make_heap(top_.begin(), top_.end(), CountGreater());
+}
+
+void HeavyHitters::clear() {
+  std::fill(counters_.begin(), counters_.end(), 0);
+  top_.clear();
+  total_ = 0;
+}
+
+std::vector<HeavyHitters::Entry> HeavyHitters::getTop() const {
+  std::vector<Entry> result;
+  result.reserve(top_.size());
+  for (const auto& candidate: top_) {
+    if (candidate.count > 0) {
+      result.push_back(Entry{candidate.key, candidate.count});
+    }
+  }
+  std::sort(result.begin(), result.end(), CountGreater());
+  return result;
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <folly/Range.h>
+#include <string>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * The most frequent keys of a stream, in a fixed amount of memory however
+ * many distinct keys there are: a count-min sketch of depth rows of width
+ * counters estimates the count of any key, never below its true count and
+ * above it by at most about e / width of the total with probability
+ * 1 - e^-depth, and a min-heap keeps the k keys with the highest
+ * estimates. Only the keys of the heap are copied.
+ *
+ * Sketches of the same dimensions merge by adding their counters, so that
+ * each thread can count in its own, see HeavyHittersRegistry. Not thread
+ * safe.
+ */
+class HeavyHitters {
+ public:
+  struct Entry {
+    std::string key;
+    // estimated, see estimate()
+    uint64_t count;
+  };
+
+  explicit HeavyHitters(size_t width = 2048, size_t depth = 4,
+                        size_t k = 32);
+
+  void add(folly::StringPiece key, uint64_t count = 1);
+
+  /**
+   * @return an upper bound of the count of key, see above
+   */
+  uint64_t estimate(folly::StringPiece key) const;
+
+  /**
+   * Add the counts of other, which must have the same width and depth
+   */
+  void merge(const HeavyHitters& other);
+
+  /**
+   * Halve all the counts, so that past traffic fades out
+   */
+  void decay();
+
+  void clear();
+
+  /**
+   * @return up to k keys with their estimated counts, the highest first
+   */
+  std::vector<Entry> getTop() const;
+
+  /**
+   * @return the sum of the counts added, so that a count can be read as a
+   *         share of the traffic
+   */
+  uint64_t getTotal() const {
+    return total_;
+  }
+
+ private:
+  struct Candidate {
+    std::string key;
+    uint64_t hash;
+    uint64_t count;
+  };
+
+  static uint64_t hash(folly::StringPiece key);
+
+  size_t getIndex(uint64_t hash, size_t row) const;
+  uint64_t estimate(uint64_t hash) const;
+  void offer(folly::StringPiece key, uint64_t hash, uint64_t count);
+
+  const size_t width_;
+  const size_t depth_;
+  const size_t k_;
+  // depth_ rows of width_
+  std::vector<uint64_t> counters_;
+  // a min-heap on the count, so top_.front() is the key to evict
+  std::vector<Candidate> top_;
+  uint64_t total_{0};
+};
+
+}
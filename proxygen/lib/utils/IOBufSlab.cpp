@@ -0,0 +1,314 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/IOBufSlab.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <folly/ThreadLocal.h>
+#include <new>
+#include <sys/mman.h>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const uint32_t IOBufSlab::kMinBlockSize;
+const uint32_t IOBufSlab::kMaxBlockSize;
+const size_t IOBufSlab::kSlabSize;
+const size_t IOBufSlab::kRegionSize;
+
+namespace {
+
+// kMinBlockSize << i, up to kMaxBlockSize
+const size_t kNumSizeClasses = 9;
+
+// in front of the objects of allocate(), the class of their block, and
+// enough to keep them aligned
+const size_t kHeaderSize = 16;
+
+std::atomic<bool> s_useHugePages{false};
+
+/**
+ * @return a kRegionSize aligned region, or nullptr, and whether reserved
+ * huge pages back it
+ */
+char* mapRegion(bool& hugetlb) {
+  const size_t size = IOBufSlab::kRegionSize;
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED) {
+    hugetlb = true;
+    return static_cast<char*>(ptr);
+  }
+  hugetlb = false;
+  // twice the size, to keep the aligned part that transparent huge pages
+  // can back
+  ptr = mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  char* raw = static_cast<char*>(ptr);
+  char* region = reinterpret_cast<char*>(
+    (reinterpret_cast<uintptr_t>(raw) + size - 1) & ~(uintptr_t(size) - 1));
+  if (region > raw) {
+    munmap(raw, region - raw);
+  }
+  if (region + size < raw + 2 * size) {
+    munmap(region + size, raw + 2 * size - (region + size));
+  }
+  madvise(region, size, MADV_HUGEPAGE);
+  return region;
+}
+
+}
+
+struct IOBufSlab::SizeClass {
+  Arena* arena{nullptr};
+  uint32_t size{0};
+  // the blocks of all the slabs, the free list never grows beyond
+  size_t numBlocks{0};
+  std::vector<void*> free;
+  // the blocks freed on other threads, linked through their first bytes
+  std::atomic<void*> remote{nullptr};
+};
+
+struct IOBufSlab::Arena {
+  Arena() {
+    for (size_t i = 0; i < kNumSizeClasses; i++) {
+      classes[i].arena = this;
+      classes[i].size = kMinBlockSize << i;
+    }
+  }
+
+  ~Arena() {
+    for (void* slab: slabs) {
+      ::free(slab);
+    }
+    for (char* region: regions) {
+      munmap(region, kRegionSize);
+    }
+  }
+
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  char* newSlab() {
+    if (s_useHugePages.load(std::memory_order_relaxed)) {
+      if (regionLeft < kSlabSize) {
+        bool hugetlb = false;
+        char* region = mapRegion(hugetlb);
+        if (region) {
+          regions.push_back(region);
+          regionNext = region;
+          regionLeft = kRegionSize;
+          numHugetlbRegions += hugetlb ? 1 : 0;
+        }
+      }
+      if (regionLeft >= kSlabSize) {
+        char* slab = regionNext;
+        regionNext += kSlabSize;
+        regionLeft -= kSlabSize;
+        slabBytes += kSlabSize;
+        return slab;
+      }
+      // no region to be had, the slab is still better than nothing
+    }
+    char* slab = static_cast<char*>(malloc(kSlabSize));
+    if (!slab) {
+      throw std::bad_alloc();
+    }
+    slabs.push_back(slab);
+    slabBytes += kSlabSize;
+    return slab;
+  }
+
+  const std::thread::id owner{std::this_thread::get_id()};
+  // one for the IOBufSlab, and one per block that is out
+  std::atomic<size_t> refs{1};
+  SizeClass classes[kNumSizeClasses];
+  std::atomic<size_t> usedBytes{0};
+  std::atomic<uint64_t> remoteFrees{0};
+
+  // the slabs from malloc, and the huge page regions
+  std::vector<void*> slabs;
+  std::vector<char*> regions;
+  char* regionNext{nullptr};
+  size_t regionLeft{0};
+  size_t slabBytes{0};
+  size_t numHugetlbRegions{0};
+};
+
+IOBufSlab& IOBufSlab::get() {
+  static folly::ThreadLocal<IOBufSlab> slab;
+  return *slab;
+}
+
+void IOBufSlab::setUseHugePages(bool useHugePages) {
+  s_useHugePages.store(useHugePages, std::memory_order_relaxed);
+}
+
+IOBufSlab::IOBufSlab(): arena_(new Arena()) {
+}
+
+IOBufSlab::~IOBufSlab() {
+  arena_->release();
+}
+
+unique_ptr<IOBuf> IOBufSlab::create(uint32_t size) {
+  SizeClass* sizeClass = size < kMinBlockSize ? nullptr : findClass(size);
+  if (!sizeClass) {
+    return IOBuf::create(size);
+  }
+  void* block = takeBlock(*sizeClass);
+  return IOBuf::takeOwnership(block, sizeClass->size, &IOBufSlab::freeBlock,
+                              sizeClass);
+}
+
+unique_ptr<IOBuf> IOBufSlab::maybeCopyBuffer(folly::StringPiece data) {
+  if (data.empty()) {
+    return nullptr;
+  }
+  if (data.size() > kMaxBlockSize) {
+    return IOBuf::copyBuffer(data.data(), data.size());
+  }
+  auto buf = create(data.size());
+  memcpy(buf->writableTail(), data.data(), data.size());
+  buf->append(data.size());
+  return buf;
+}
+
+void IOBufSlab::reserveTailroom(folly::IOBufQueue& queue, uint32_t min,
+                                uint32_t size) {
+  const IOBuf* head = queue.front();
+  if (head && !head->prev()->isSharedOne() &&
+      head->prev()->tailroom() >= min) {
+    return;
+  }
+  queue.append(create(std::max(min, size)));
+}
+
+void* IOBufSlab::allocate(size_t size) {
+  SizeClass* sizeClass = findClass(std::max<size_t>(size + kHeaderSize,
+                                                    kMinBlockSize));
+  void* block;
+  if (sizeClass) {
+    block = takeBlock(*sizeClass);
+  } else {
+    block = malloc(size + kHeaderSize);
+    if (!block) {
+      throw std::bad_alloc();
+    }
+  }
+  memcpy(block, &sizeClass, sizeof(sizeClass));
+  return static_cast<char*>(block) + kHeaderSize;
+}
+
+void IOBufSlab::deallocate(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  void* block = static_cast<char*>(ptr) - kHeaderSize;
+  SizeClass* sizeClass;
+  memcpy(&sizeClass, block, sizeof(sizeClass));
+  if (sizeClass) {
+    freeBlock(block, sizeClass);
+  } else {
+    free(block);
+  }
+}
+
+size_t IOBufSlab::getUsedBytes() const {
+  return arena_->usedBytes.load(std::memory_order_relaxed);
+}
+
+size_t IOBufSlab::getSlabBytes() const {
+  return arena_->slabBytes;
+}
+
+size_t IOBufSlab::getRegionBytes() const {
+  return arena_->regions.size() * kRegionSize;
+}
+
+size_t IOBufSlab::getNumHugetlbRegions() const {
+  return arena_->numHugetlbRegions;
+}
+
+uint64_t IOBufSlab::getRemoteFrees() const {
+  return arena_->remoteFrees.load(std::memory_order_relaxed);
+}
+
+IOBufSlab::SizeClass* IOBufSlab::findClass(size_t size) const {
+  if (size > kMaxBlockSize) {
+    return nullptr;
+  }
+  // the smallest class that fits
+  size_t index = 0;
+  while ((kMinBlockSize << index) < size) {
+    index++;
+  }
+  return &arena_->classes[index];
+}
+
+void* IOBufSlab::takeBlock(SizeClass& sizeClass) {
+  if (sizeClass.free.empty()) {
+    // take over the blocks the other threads gave back
+    void* block = sizeClass.remote.exchange(nullptr,
+                                            std::memory_order_acquire);
+    while (block) {
+      void* next;
+      memcpy(&next, block, sizeof(next));
+      sizeClass.free.push_back(block);
+      block = next;
+    }
+  }
+  if (sizeClass.free.empty()) {
+    char* slab = arena_->newSlab();
+    size_t blocks = kSlabSize / sizeClass.size;
+    sizeClass.numBlocks += blocks;
+    // so that freeBlock() never allocates
+    sizeClass.free.reserve(sizeClass.numBlocks);
+    // handed out from the start of the slab
+    for (size_t i = blocks; i > 0; i--) {
+      sizeClass.free.push_back(slab + (i - 1) * sizeClass.size);
+    }
+  }
+  void* block = sizeClass.free.back();
+  sizeClass.free.pop_back();
+  // given back by freeBlock(), also if takeOwnership() fails
+  arena_->refs.fetch_add(1, std::memory_order_relaxed);
+  arena_->usedBytes.fetch_add(sizeClass.size, std::memory_order_relaxed);
+  return block;
+}
+
+void IOBufSlab::freeBlock(void* block, void* userData) {
+  SizeClass* sizeClass = static_cast<SizeClass*>(userData);
+  Arena* arena = sizeClass->arena;
+  arena->usedBytes.fetch_sub(sizeClass->size, std::memory_order_relaxed);
+  if (std::this_thread::get_id() == arena->owner) {
+    sizeClass->free.push_back(block);
+  } else {
+    void* head = sizeClass->remote.load(std::memory_order_relaxed);
+    do {
+      memcpy(block, &head, sizeof(head));
+    } while (!sizeClass->remote.compare_exchange_weak(
+               head, block, std::memory_order_release,
+               std::memory_order_relaxed));
+    arena->remoteFrees.fetch_add(1, std::memory_order_relaxed);
+  }
+  arena->release();
+}
+
+}
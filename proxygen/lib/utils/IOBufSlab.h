@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Allocates the data of IOBufs from slabs, split in blocks of a few size
+ * classes, so that the buffers a thread creates for reads, serialized
+ * headers and frames come from its own free lists instead of malloc. There
+ * is one per thread, and so per EventBase.
+ *
+ * The blocks go back to the free lists of the thread that created them:
+ * directly when the IOBuf is freed on that thread, and through a lock free
+ * list that the owner takes over on its next miss otherwise. The slabs are
+ * freed once the IOBufSlab and all of its blocks are gone, so that IOBufs
+ * may outlive the thread.
+ *
+ * The sizes below kMinBlockSize, which IOBuf::create() allocates together
+ * with the IOBuf, and the ones above kMaxBlockSize come from IOBuf::create().
+ *
+ * The objects that come with each connection, such as the sessions and the
+ * entries of their stream tables, may come from the slabs too, see
+ * allocate().
+ *
+ * With setUseHugePages(), the slabs are carved from 2MB regions that huge
+ * pages back, reserved ones (MAP_HUGETLB) if the system has some left and
+ * transparent ones otherwise, so that the memory of many connections takes
+ * few TLB entries. The regions of a thread are first touched by that
+ * thread, and so with the default memory policy stay on its NUMA node.
+ */
+class IOBufSlab {
+ public:
+  static const uint32_t kMinBlockSize = 256;
+  static const uint32_t kMaxBlockSize = 65536;
+  // bytes of each slab, split in as many blocks as fit
+  static const size_t kSlabSize = 65536;
+  // bytes of each huge page region
+  static const size_t kRegionSize = 2 * 1024 * 1024;
+
+  /**
+   * @return the IOBufSlab of the calling thread
+   */
+  static IOBufSlab& get();
+
+  /**
+   * From now on, carve the new slabs of all the threads from huge page
+   * regions
+   */
+  static void setUseHugePages(bool useHugePages);
+
+  IOBufSlab();
+  ~IOBufSlab();
+
+  IOBufSlab(const IOBufSlab&) = delete;
+  IOBufSlab& operator=(const IOBufSlab&) = delete;
+
+  /**
+   * @return an empty buffer with at least size bytes of tailroom
+   */
+  std::unique_ptr<folly::IOBuf> create(uint32_t size);
+
+  /**
+   * @return a copy of data, or nullptr if it is empty, as
+   * IOBuf::maybeCopyBuffer()
+   */
+  std::unique_ptr<folly::IOBuf> maybeCopyBuffer(folly::StringPiece data);
+
+  /**
+   * Append a buffer of size bytes to queue unless its last buffer already
+   * has min bytes of unshared tailroom, so that the following appends to
+   * queue write into the slab
+   */
+  void reserveTailroom(folly::IOBufQueue& queue, uint32_t min, uint32_t size);
+
+  /**
+   * @return size bytes aligned for any type, to be given back with
+   * deallocate() on any thread. Meant for the operator new of the classes
+   * that have an instance per connection or stream.
+   */
+  void* allocate(size_t size);
+  static void deallocate(void* ptr);
+
+  /**
+   * @return the bytes of the blocks that are out, from all threads
+   */
+  size_t getUsedBytes() const;
+
+  /**
+   * @return the bytes of all the slabs
+   */
+  size_t getSlabBytes() const;
+
+  /**
+   * @return the bytes of the huge page regions, of which getSlabBytes()
+   * are carved out already, and how many of them have reserved huge pages
+   */
+  size_t getRegionBytes() const;
+  size_t getNumHugetlbRegions() const;
+
+  /**
+   * @return the blocks that came back from other threads
+   */
+  uint64_t getRemoteFrees() const;
+
+ private:
+  struct Arena;
+  struct SizeClass;
+
+  // a block of the class for size, or nullptr if size has none
+  SizeClass* findClass(size_t size) const;
+  void* takeBlock(SizeClass& sizeClass);
+
+  static void freeBlock(void* block, void* userData);
+
+  // shared with the blocks, which free it with the last of them
+  Arena* arena_;
+};
+
+}
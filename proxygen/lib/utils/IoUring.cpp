@@ -0,0 +1,348 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/IoUring.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace proxygen {
+
+namespace {
+
+const uint16_t kBufferGroup = 0;
+
+int ioUringSetup(uint32_t entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg,
+                    unsigned numArgs) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, numArgs);
+}
+
+void* mapRing(int fd, size_t bytes, off_t offset) {
+  void* ring = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, offset);
+  if (ring == MAP_FAILED) {
+    throw std::system_error(errno, std::system_category(),
+                            "mmap() of the io_uring failed");
+  }
+  return ring;
+}
+
+template <class T>
+T* at(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+}
+
+struct IoUring::Sqe : io_uring_sqe {};
+
+bool IoUring::Completion::hasMore() const {
+  return flags & IORING_CQE_F_MORE;
+}
+
+bool IoUring::Completion::hasBuffer() const {
+  return flags & IORING_CQE_F_BUFFER;
+}
+
+uint16_t IoUring::Completion::getBufferId() const {
+  return flags >> IORING_CQE_BUFFER_SHIFT;
+}
+
+bool IoUring::isSupported() {
+  static const bool supported = [] {
+    // buffer rings came in 5.19 and multishot receives in 6.0; probing
+    // the opcode doesn't tell about the latter, so try to set both up
+    try {
+      IoUring ring(2, 1, 1, 64);
+      return true;
+    } catch (const std::system_error& ex) {
+      LOG(INFO) << "No io_uring: " << ex.what();
+      return false;
+    }
+  }();
+  return supported;
+}
+
+IoUring::IoUring(uint32_t entries, uint32_t files, uint16_t bufferCount,
+                 uint32_t bufferSize) {
+  CHECK_GT(files, 0);
+  CHECK(bufferCount > 0 && (bufferCount & (bufferCount - 1)) == 0);
+
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  ringFd_ = ioUringSetup(entries, &params);
+  if (ringFd_ < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "io_uring_setup() failed");
+  }
+
+  try {
+    sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingBytes_ = params.cq_off.cqes +
+      params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sqRingBytes_ = cqRingBytes_ = std::max(sqRingBytes_, cqRingBytes_);
+    }
+    sqRing_ = mapRing(ringFd_, sqRingBytes_, IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mapRing(ringFd_, cqRingBytes_, IORING_OFF_CQ_RING);
+    }
+    sqesBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mapRing(ringFd_, sqesBytes_, IORING_OFF_SQES);
+
+    sqHead_ = at<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = at<unsigned>(sqRing_, params.sq_off.tail);
+    sqFlags_ = at<unsigned>(sqRing_, params.sq_off.flags);
+    sqArray_ = at<unsigned>(sqRing_, params.sq_off.array);
+    sqMask_ = *at<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqeHead_ = sqeTail_ = *sqTail_;
+
+    cqHead_ = at<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = at<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *at<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = at<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+
+    // the kernel won't make a table larger than the fd limit
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < files) {
+      files = limit.rlim_cur;
+    }
+    io_uring_rsrc_register files_reg;
+    memset(&files_reg, 0, sizeof(files_reg));
+    files_reg.nr = files;
+    files_reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (ioUringRegister(ringFd_, IORING_REGISTER_FILES2, &files_reg,
+                        sizeof(files_reg)) < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "registering the fixed files failed");
+    }
+    for (int slot = files - 1; slot >= 0; slot--) {
+      freeSlots_.push_back(slot);
+    }
+
+    bufferCount_ = bufferCount;
+    bufferSize_ = bufferSize;
+    bufferRingBytes_ = bufferCount * sizeof(io_uring_buf);
+    bufferRing_ = mmap(nullptr, bufferRingBytes_, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (bufferRing_ == MAP_FAILED) {
+      bufferRing_ = nullptr;
+      throw std::system_error(errno, std::system_category(),
+                              "mmap() of the buffer ring failed");
+    }
+    buffersBytes_ = size_t(bufferCount) * bufferSize;
+    void* buffers = mmap(nullptr, buffersBytes_, PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buffers == MAP_FAILED) {
+      throw std::system_error(errno, std::system_category(),
+                              "mmap() of the receive buffers failed");
+    }
+    buffers_ = static_cast<uint8_t*>(buffers);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufferRing_);
+    reg.ring_entries = bufferCount;
+    reg.bgid = kBufferGroup;
+    if (ioUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "registering the buffer ring failed");
+    }
+    for (uint32_t id = 0; id < bufferCount; id++) {
+      recycleBuffer(id);
+    }
+  } catch (...) {
+    release();
+    throw;
+  }
+}
+
+IoUring::~IoUring() {
+  release();
+}
+
+void IoUring::release() {
+  if (ringFd_ >= 0) {
+    // also unregisters the files and the buffer ring
+    close(ringFd_);
+    ringFd_ = -1;
+  }
+  if (buffers_) {
+    munmap(buffers_, buffersBytes_);
+    buffers_ = nullptr;
+  }
+  if (bufferRing_) {
+    munmap(bufferRing_, bufferRingBytes_);
+    bufferRing_ = nullptr;
+  }
+  if (sqes_) {
+    munmap(sqes_, sqesBytes_);
+    sqes_ = nullptr;
+  }
+  if (cqRing_ && cqRing_ != sqRing_) {
+    munmap(cqRing_, cqRingBytes_);
+  }
+  cqRing_ = nullptr;
+  if (sqRing_) {
+    munmap(sqRing_, sqRingBytes_);
+    sqRing_ = nullptr;
+  }
+}
+
+void IoUring::registerEventFd(int efd) {
+  if (ioUringRegister(ringFd_, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "registering the eventfd failed");
+  }
+}
+
+int IoUring::addFile(int fd) {
+  if (freeSlots_.empty()) {
+    return -1;
+  }
+  int slot = freeSlots_.back();
+  io_uring_files_update update;
+  memset(&update, 0, sizeof(update));
+  update.offset = slot;
+  update.fds = reinterpret_cast<uint64_t>(&fd);
+  if (ioUringRegister(ringFd_, IORING_REGISTER_FILES_UPDATE, &update, 1)
+      != 1) {
+    PLOG(WARNING) << "Failed to add fd " << fd << " to the fixed files";
+    return -1;
+  }
+  freeSlots_.pop_back();
+  return slot;
+}
+
+void IoUring::removeFile(int slot) {
+  int fd = -1;
+  io_uring_files_update update;
+  memset(&update, 0, sizeof(update));
+  update.offset = slot;
+  update.fds = reinterpret_cast<uint64_t>(&fd);
+  PCHECK(ioUringRegister(ringFd_, IORING_REGISTER_FILES_UPDATE, &update, 1)
+         == 1);
+  freeSlots_.push_back(slot);
+}
+
+void IoUring::recycleBuffer(uint16_t id) {
+  // not through io_uring_buf_ring::bufs, whose flexible array member
+  // doesn't start at 0 when the header is compiled as C++
+  auto bufs = static_cast<io_uring_buf*>(bufferRing_);
+  io_uring_buf& buf = bufs[bufferTail_ & (bufferCount_ - 1)];
+  buf.addr = reinterpret_cast<uint64_t>(getBuffer(id));
+  buf.len = bufferSize_;
+  buf.bid = id;
+  bufferTail_++;
+  // the tail overlays the reserved field of the first entry
+  __atomic_store_n(&bufs[0].resv, bufferTail_, __ATOMIC_RELEASE);
+}
+
+IoUring::Sqe* IoUring::getSqe() {
+  unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  if (sqeTail_ - head >= sqEntries_) {
+    // full, make room
+    submit();
+    head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    CHECK_LT(sqeTail_ - head, sqEntries_);
+  }
+  Sqe* sqe = static_cast<Sqe*>(sqes_) + (sqeTail_ & sqMask_);
+  sqeTail_++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+void IoUring::prepareRecvMultishot(int slot, uint64_t userData) {
+  Sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = slot;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = userData;
+}
+
+void IoUring::prepareSendmsg(int slot, const msghdr* msg, int flags,
+                             uint64_t userData) {
+  Sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = slot;
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->addr = reinterpret_cast<uint64_t>(msg);
+  sqe->len = 1;
+  sqe->msg_flags = flags;
+  sqe->user_data = userData;
+}
+
+void IoUring::prepareCancel(uint64_t target) {
+  Sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = target;
+  sqe->user_data = 0;
+}
+
+uint32_t IoUring::submit() {
+  uint32_t toSubmit = sqeTail_ - sqeHead_;
+  if (toSubmit == 0 && !(__atomic_load_n(sqFlags_, __ATOMIC_RELAXED) &
+                         IORING_SQ_CQ_OVERFLOW)) {
+    return 0;
+  }
+  unsigned tail = *sqTail_;
+  while (sqeHead_ != sqeTail_) {
+    sqArray_[tail & sqMask_] = sqeHead_ & sqMask_;
+    tail++;
+    sqeHead_++;
+  }
+  __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+  // GETEVENTS also flushes the completions that overflowed the ring
+  int rc = enter(toSubmit, IORING_ENTER_GETEVENTS);
+  if (rc < 0) {
+    // the entries stay in the ring, and go with the next submit
+    PLOG_IF(ERROR, errno != EAGAIN && errno != EBUSY && errno != EINTR)
+      << "io_uring_enter() failed";
+    return 0;
+  }
+  return rc;
+}
+
+IoUring::Completion IoUring::getCompletion(unsigned head) const {
+  const io_uring_cqe& cqe =
+    static_cast<const io_uring_cqe*>(cqes_)[head & cqMask_];
+  Completion completion;
+  completion.userData = cqe.user_data;
+  completion.result = cqe.res;
+  completion.flags = cqe.flags;
+  return completion;
+}
+
+int IoUring::enter(uint32_t toSubmit, uint32_t flags) {
+  return syscall(__NR_io_uring_enter, ringFd_, toSubmit, 0, flags,
+                 nullptr, 0);
+}
+
+}
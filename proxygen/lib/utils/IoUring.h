@@ -0,0 +1,202 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * The parts of io_uring that the sockets of an EventBase need, through
+ * the raw system calls: a submission and a completion queue, a table of
+ * fixed files, one ring of provided receive buffers, multishot receives,
+ * sendmsg and cancellation.
+ *
+ * Operations are only queued when prepared, and go to the kernel with the
+ * next submit(), so that the operations of a whole loop iteration cost
+ * one io_uring_enter(). Completions are read from the shared ring without
+ * a system call.
+ *
+ * Needs Linux >= 6.0, for the multishot receives; isSupported() tells.
+ * Not thread safe.
+ */
+class IoUring {
+ public:
+  struct Completion {
+    // as passed when the operation was prepared
+    uint64_t userData;
+    // bytes, or -errno
+    int32_t result;
+    uint32_t flags;
+
+    // the kernel will post more completions for this operation
+    bool hasMore() const;
+    // the data is in the provided buffer getBufferId()
+    bool hasBuffer() const;
+    uint16_t getBufferId() const;
+  };
+
+  /**
+   * @return true if the kernel supports everything used here
+   */
+  static bool isSupported();
+
+  /**
+   * @param entries        submission queue entries, rounded up to a power
+   *                       of two; the completion queue has four times more
+   * @param files          slots in the fixed file table, at most the
+   *                       RLIMIT_NOFILE of the process
+   * @param bufferCount    provided receive buffers, a power of two
+   * @param bufferSize     bytes of each
+   *
+   * Throws std::system_error if the kernel refuses.
+   */
+  IoUring(uint32_t entries, uint32_t files, uint16_t bufferCount,
+          uint32_t bufferSize);
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  int getFd() const {
+    return ringFd_;
+  }
+
+  /**
+   * Have the kernel signal efd when a completion is posted
+   */
+  void registerEventFd(int efd);
+
+  /**
+   * Put fd in a free slot of the fixed file table, so that its operations
+   * skip the file lookup and reference counting of the kernel
+   *
+   * @return the slot, or -1 if the table is full
+   */
+  int addFile(int fd);
+
+  /**
+   * Empty the slot. The operations on it must be done.
+   */
+  void removeFile(int slot);
+
+  const uint8_t* getBuffer(uint16_t id) const {
+    return buffers_ + size_t(id) * bufferSize_;
+  }
+
+  /**
+   * Give the buffer of a completion back to the kernel, once its data was
+   * consumed
+   */
+  void recycleBuffer(uint16_t id);
+
+  /**
+   * Receive into the provided buffers from the socket in slot until it
+   * fails, posting a completion per receive
+   */
+  void prepareRecvMultishot(int slot, uint64_t userData);
+
+  /**
+   * sendmsg() msg to the socket in slot; msg and what it points to must
+   * stay valid until the completion
+   */
+  void prepareSendmsg(int slot, const msghdr* msg, int flags,
+                      uint64_t userData);
+
+  /**
+   * Cancel the operation prepared with target as user data. Its own
+   * completion has user data 0.
+   */
+  void prepareCancel(uint64_t target);
+
+  /**
+   * @return the operations prepared since the last submit()
+   */
+  uint32_t getNumPrepared() const {
+    return sqeTail_ - sqeHead_;
+  }
+
+  /**
+   * Hand the prepared operations to the kernel, without waiting
+   *
+   * @return the number submitted
+   */
+  uint32_t submit();
+
+  /**
+   * Call callback(const Completion&) for each posted completion, which may
+   * prepare new operations
+   *
+   * @return the number of completions
+   */
+  template <class Callback>
+  size_t reap(Callback&& callback) {
+    size_t count = 0;
+    unsigned head = *cqHead_;
+    while (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      const Completion completion = getCompletion(head);
+      // release the entry before the callback, which may reap too
+      head++;
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+      callback(completion);
+      count++;
+      head = *cqHead_;
+    }
+    return count;
+  }
+
+ private:
+  struct Sqe;
+
+  void release();
+  Sqe* getSqe();
+  Completion getCompletion(unsigned head) const;
+  int enter(uint32_t toSubmit, uint32_t flags);
+
+  int ringFd_{-1};
+
+  void* sqRing_{nullptr};
+  size_t sqRingBytes_{0};
+  void* cqRing_{nullptr};
+  size_t cqRingBytes_{0};
+  void* sqes_{nullptr};
+  size_t sqesBytes_{0};
+
+  unsigned* sqHead_{nullptr};
+  unsigned* sqTail_{nullptr};
+  unsigned* sqFlags_{nullptr};
+  unsigned* sqArray_{nullptr};
+  unsigned sqMask_{0};
+  unsigned sqEntries_{0};
+  // the entries prepared but not yet in the array of the ring
+  unsigned sqeHead_{0};
+  unsigned sqeTail_{0};
+
+  unsigned* cqHead_{nullptr};
+  unsigned* cqTail_{nullptr};
+  unsigned cqMask_{0};
+  void* cqes_{nullptr};
+
+  std::vector<int> freeSlots_;
+
+  // the provided buffer ring, and the buffers it hands out
+  void* bufferRing_{nullptr};
+  size_t bufferRingBytes_{0};
+  uint8_t* buffers_{nullptr};
+  size_t buffersBytes_{0};
+  uint16_t bufferCount_{0};
+  uint32_t bufferSize_{0};
+  uint16_t bufferTail_{0};
+};
+
+}
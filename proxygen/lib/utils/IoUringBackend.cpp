@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/IoUringBackend.h>
+
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace proxygen {
+
+std::shared_ptr<IoUringBackend> IoUringBackend::get(
+    folly::EventBase* eventBase, const Options& options) {
+  typedef std::unordered_map<folly::EventBase*, std::weak_ptr<IoUringBackend>>
+    BackendMap;
+  static folly::ThreadLocal<BackendMap> backends;
+  DCHECK(eventBase->isInEventBaseThread());
+  if (!IoUring::isSupported()) {
+    return nullptr;
+  }
+  auto& weak = (*backends)[eventBase];
+  auto backend = weak.lock();
+  if (!backend) {
+    try {
+      backend = std::make_shared<IoUringBackend>(eventBase, options);
+    } catch (const std::system_error& ex) {
+      // e.g. out of locked memory for the rings
+      LOG(ERROR) << "Failed to set up io_uring: " << ex.what();
+      backends->erase(eventBase);
+      return nullptr;
+    }
+    weak = backend;
+  }
+  return backend;
+}
+
+IoUringBackend::IoUringBackend(folly::EventBase* eventBase,
+                               const Options& options):
+    eventBase_(eventBase),
+    ring_(options.entries, options.files, options.bufferCount,
+          options.bufferSize) {
+  eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd_ < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "eventfd() failed");
+  }
+  try {
+    ring_.registerEventFd(eventFd_);
+  } catch (...) {
+    close(eventFd_);
+    throw;
+  }
+  initHandler(eventBase_, eventFd_);
+  registerHandler(EventHandler::READ | EventHandler::PERSIST);
+}
+
+IoUringBackend::~IoUringBackend() {
+  cancelLoopCallback();
+  unregisterHandler();
+  close(eventFd_);
+}
+
+void IoUringBackend::scheduleSubmit() {
+  if (!isLoopCallbackScheduled()) {
+    eventBase_->runInLoop(this);
+  }
+}
+
+void IoUringBackend::handlerReady(uint16_t events) noexcept {
+  uint64_t count;
+  if (read(eventFd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    PLOG(ERROR) << "Failed to read the io_uring eventfd";
+  }
+  reap();
+}
+
+void IoUringBackend::runLoopCallback() noexcept {
+  if (ring_.getNumPrepared() > 0) {
+    ring_.submit();
+    numSubmits_++;
+  }
+  // receives that had data at hand complete inline, without the eventfd
+  // waking the loop first
+  reap();
+}
+
+void IoUringBackend::reap() {
+  ring_.reap([] (const IoUring::Completion& completion) {
+      // cancellations complete with 0, there is nothing to tell about them
+      if (completion.userData != 0) {
+        reinterpret_cast<Op*>(completion.userData)->complete(completion);
+      }
+    });
+  if (ring_.getNumPrepared() > 0) {
+    scheduleSubmit();
+  }
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <memory>
+#include <proxygen/lib/utils/IoUring.h>
+
+namespace proxygen {
+
+/**
+ * The io_uring of an EventBase, and the glue that drives it from the loop.
+ * The operations prepared while the loop runs its events and callbacks go
+ * to the kernel together, in one io_uring_enter() at the end of the loop
+ * iteration, and the kernel signals an eventfd the loop watches when
+ * completions are posted, which are then dispatched to their Op.
+ *
+ * Owned by the transports that use it, so that it outlives their
+ * operations.
+ */
+class IoUringBackend : private folly::EventHandler,
+                       private folly::EventBase::LoopCallback {
+ public:
+  /**
+   * An operation in flight, whose address is the user data of its
+   * submissions
+   */
+  class Op {
+   public:
+    virtual ~Op() {}
+
+    virtual void complete(const IoUring::Completion& completion) noexcept = 0;
+
+    uint64_t getUserData() {
+      return reinterpret_cast<uint64_t>(this);
+    }
+  };
+
+  struct Options {
+    uint32_t entries{256};
+    uint32_t files{4096};
+    uint16_t bufferCount{512};
+    uint32_t bufferSize{16384};
+  };
+
+  /**
+   * The backend of eventBase, made with options on the first call from the
+   * thread of eventBase while another one is alive. Null if the kernel
+   * can't run it.
+   */
+  static std::shared_ptr<IoUringBackend> get(folly::EventBase* eventBase,
+                                             const Options& options);
+
+  IoUringBackend(folly::EventBase* eventBase, const Options& options);
+  ~IoUringBackend();
+
+  folly::EventBase* getEventBase() const {
+    return eventBase_;
+  }
+
+  IoUring& getRing() {
+    return ring_;
+  }
+
+  /**
+   * Submit the prepared operations at the end of this loop iteration
+   */
+  void scheduleSubmit();
+
+  /**
+   * @return the number of io_uring_enter() calls so far, for tests
+   */
+  uint64_t getNumSubmits() const {
+    return numSubmits_;
+  }
+
+ private:
+  // EventHandler methods, for the eventfd
+  void handlerReady(uint16_t events) noexcept override;
+
+  // LoopCallback methods
+  void runLoopCallback() noexcept override;
+
+  void reap();
+
+  folly::EventBase* eventBase_;
+  IoUring ring_;
+  int eventFd_{-1};
+  uint64_t numSubmits_{0};
+};
+
+}
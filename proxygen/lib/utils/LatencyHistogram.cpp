@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/LatencyHistogram.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace proxygen {
+
+const size_t LatencyHistogram::kSubBucketBits;
+const size_t LatencyHistogram::kSubBuckets;
+const size_t LatencyHistogram::kMaxBit;
+const size_t LatencyHistogram::kNumBuckets;
+const uint64_t LatencyHistogram::kMaxValue;
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+void LatencyHistogram::addCorrectedValue(uint64_t value,
+                                         uint64_t expectedInterval) {
+  addValue(value);
+  if (expectedInterval == 0) {
+    return;
+  }
+  for (uint64_t missed = value - std::min(value, expectedInterval);
+       missed >= expectedInterval; missed -= expectedInterval) {
+    addValue(missed);
+  }
+}
+
+uint64_t LatencyHistogram::getPercentile(double pct) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // the rank of the value, starting at 1
+  uint64_t rank = std::max(uint64_t(1), uint64_t(std::ceil(
+    std::min(std::max(pct, 0.0), 100.0) / 100 * count_)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return getBucketMax(i);
+    }
+  }
+  return kMaxValue;
+}
+
+}
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace proxygen {
+
+/**
+ * Histogram of latencies, or of any non-negative values, with log-linear
+ * buckets as in HDR histograms: the values below 2^kSubBucketBits have a
+ * bucket each, and above that each power of two range is split into
+ * 2^kSubBucketBits buckets, so that a bucket is never wider than about 6%
+ * of its values. Values past kMaxValue are counted in the last bucket.
+ */
+class LatencyHistogram {
+ public:
+  static const size_t kSubBucketBits = 4;
+  static const size_t kSubBuckets = 1 << kSubBucketBits;
+  // the highest power of two range
+  static const size_t kMaxBit = 39;
+  static const size_t kNumBuckets = (kMaxBit - kSubBucketBits + 2) *
+    kSubBuckets;
+  static const uint64_t kMaxValue = (uint64_t(1) << (kMaxBit + 1)) - 1;
+
+  static size_t getBucket(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    if (value > kMaxValue) {
+      return kNumBuckets - 1;
+    }
+    size_t msb = 63 - __builtin_clzll(value);
+    size_t shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  /**
+   * @return the lowest value counted in bucket
+   */
+  static uint64_t getBucketMin(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    size_t shift = bucket / kSubBuckets - 1;
+    return (kSubBuckets + bucket % kSubBuckets) << shift;
+  }
+
+  /**
+   * @return the highest value counted in bucket
+   */
+  static uint64_t getBucketMax(size_t bucket) {
+    return bucket + 1 < kNumBuckets ? getBucketMin(bucket + 1) - 1 :
+      kMaxValue;
+  }
+
+  LatencyHistogram() {
+    counts_.fill(0);
+  }
+
+  void addValue(uint64_t value) {
+    counts_[getBucket(value)]++;
+    count_++;
+    sum_ += value;
+  }
+
+  /**
+   * Add value, measured by a client that waits for each response before
+   * sending the next request and means to send one every expectedInterval.
+   * A latency past the interval held back the requests that should have
+   * gone out meanwhile, so their latencies (value - expectedInterval,
+   * value - 2 * expectedInterval...) are added too, as in HDR histograms,
+   * instead of being omitted. An expectedInterval of 0 adds value alone.
+   */
+  void addCorrectedValue(uint64_t value, uint64_t expectedInterval);
+
+  /**
+   * Add count values to bucket, without their sum, see addToSum()
+   */
+  void addToBucket(size_t bucket, uint64_t count) {
+    counts_[bucket] += count;
+    count_ += count;
+  }
+
+  void addToSum(uint64_t sum) {
+    sum_ += sum;
+  }
+
+  void merge(const LatencyHistogram& other);
+
+  uint64_t getCount() const {
+    return count_;
+  }
+
+  uint64_t getBucketCount(size_t bucket) const {
+    return counts_[bucket];
+  }
+
+  uint64_t getMean() const {
+    return count_ ? sum_ / count_ : 0;
+  }
+
+  /**
+   * @return the highest value of the bucket holding the value below which
+   *         pct percent of the values are, 0 if there are none
+   */
+  uint64_t getPercentile(double pct) const;
+
+ private:
+  std::array<uint64_t, kNumBuckets> counts_;
+  uint64_t count_{0};
+  uint64_t sum_{0};
+};
+
+}
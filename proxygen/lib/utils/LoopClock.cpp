@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/LoopClock.h>
+
+#include <glog/logging.h>
+
+namespace proxygen {
+
+__thread LoopClock* LoopClock::current_ = nullptr;
+
+LoopClock::LoopClock(folly::EventBase* eventBase)
+    : eventBase_(CHECK_NOTNULL(eventBase)) {
+  CHECK(eventBase->isInEventBaseThread());
+  DCHECK(!current_) << "the thread has a LoopClock already";
+  current_ = this;
+}
+
+LoopClock::~LoopClock() {
+  if (current_ == this) {
+    current_ = nullptr;
+  }
+  if (isLoopCallbackScheduled()) {
+    cancelLoopCallback();
+  }
+}
+
+void LoopClock::refresh() {
+  now_ = getCurrentTime();
+  cached_ = true;
+  eventBase_->runInLoop(this);
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/EventBase.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * The time of the current iteration of an event loop, for the timestamps
+ * that only need millisecond resolution, such as idle timeouts and
+ * connect times, and are taken many times per iteration.
+ *
+ * The first now() of an iteration reads getCurrentTime() and schedules a
+ * loop callback that forgets it at the end of the iteration, so an idle
+ * loop isn't woken up, and the later calls of that iteration return the
+ * same time. The time lags by how long the iteration has run so far,
+ * which LoopMonitor measures.
+ *
+ * One per thread, see getLoopTime().
+ */
+class LoopClock : private folly::EventBase::LoopCallback {
+ public:
+  /**
+   * Cache the time for the loop of eventBase, on its thread, the calling
+   * one, until deleted there
+   */
+  explicit LoopClock(folly::EventBase* eventBase);
+  ~LoopClock() override;
+
+  TimePoint now() {
+    if (!cached_) {
+      refresh();
+    }
+    return now_;
+  }
+
+  /**
+   * @return the clock of the calling thread, or nullptr
+   */
+  static LoopClock* get() {
+    return current_;
+  }
+
+ private:
+  void refresh();
+
+  // forget the time at the end of the iteration
+  void runLoopCallback() noexcept override {
+    cached_ = false;
+  }
+
+  static __thread LoopClock* current_;
+
+  folly::EventBase* const eventBase_;
+  TimePoint now_;
+  bool cached_{false};
+};
+
+/**
+ * The time of the iteration of the calling thread's loop if it has a
+ * LoopClock, getCurrentTime() otherwise
+ */
+inline TimePoint getLoopTime() {
+  auto clock = LoopClock::get();
+  return clock ? clock->now() : getCurrentTime();
+}
+
+/**
+ * A TimeUtil for getLoopTime(), e.g. for TraceEvents
+ */
+class LoopTimeUtil : public TimeUtil {
+ public:
+  TimePoint now() const override {
+    return getLoopTime();
+  }
+};
+
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/LoopLagMonitor.h>
+
+#include <algorithm>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace proxygen {
+
+const milliseconds LoopLagMonitor::kDefaultInterval(100);
+
+LoopLagMonitor::LoopLagMonitor(folly::TimeoutManager* timeoutManager,
+                               milliseconds interval)
+    : folly::AsyncTimeout(timeoutManager),
+      interval_(std::max(interval, milliseconds(1))) {
+}
+
+void LoopLagMonitor::start() {
+  deadline_ = getCurrentTime() + interval_;
+  scheduleTimeout(interval_.count());
+}
+
+void LoopLagMonitor::stop() {
+  cancelTimeout();
+  lag_.store(microseconds(0), std::memory_order_relaxed);
+}
+
+void LoopLagMonitor::onSample(TimePoint deadline, TimePoint now) {
+  auto sample = std::max(
+    std::chrono::duration_cast<microseconds>(now - deadline),
+    microseconds(0));
+  // decay by a quarter per sample towards a lower lag
+  auto lag = lag_.load(std::memory_order_relaxed);
+  lag_.store(std::max(sample, lag - lag / 4), std::memory_order_relaxed);
+}
+
+void LoopLagMonitor::timeoutExpired() noexcept {
+  TimePoint now = getCurrentTime();
+  onSample(deadline_, now);
+  deadline_ = now + interval_;
+  scheduleTimeout(interval_.count());
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/TimeoutManager.h>
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * Measures how late the event loop runs its timeouts, which is how long
+ * new events wait behind the ones already being processed. A timeout
+ * fires every interval, and the time it fired after its deadline is the
+ * lag. getLag() follows a higher lag right away and decays towards a lower
+ * one, so that a busy loop is seen at once and a single quiet interval
+ * doesn't hide it. getLag() may be called from any thread.
+ */
+class LoopLagMonitor : private folly::AsyncTimeout {
+ public:
+  static const std::chrono::milliseconds kDefaultInterval;
+
+  explicit LoopLagMonitor(
+    folly::TimeoutManager* timeoutManager,
+    std::chrono::milliseconds interval = kDefaultInterval);
+
+  void start();
+  void stop();
+
+  std::chrono::milliseconds getLag() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+      lag_.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * Learn from a timeout that should have fired at deadline, and fired at
+   * now
+   */
+  void onSample(TimePoint deadline, TimePoint now);
+
+ private:
+  void timeoutExpired() noexcept override;
+
+  std::chrono::milliseconds interval_;
+  TimePoint deadline_;
+  std::atomic<std::chrono::microseconds> lag_{std::chrono::microseconds(0)};
+};
+
+}
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/LoopMonitor.h>
+
+#include <algorithm>
+#include <glog/logging.h>
+
+using std::chrono::microseconds;
+
+namespace proxygen {
+
+__thread LoopMonitor* LoopMonitor::current_ = nullptr;
+
+uint32_t LoopMonitor::Snapshot::getBusyPercent() const {
+  auto total = totalBusy + totalIdle;
+  return total.count() > 0 ? totalBusy.count() * 100 / total.count() : 0;
+}
+
+LoopMonitor::CallbackScope::CallbackScope(const char* source)
+    : monitor_(current_),
+      source_(source) {
+  if (monitor_) {
+    start_ = getCurrentTime();
+  }
+}
+
+LoopMonitor::CallbackScope::~CallbackScope() {
+  if (monitor_) {
+    monitor_->onCallback(source_, std::chrono::duration_cast<microseconds>(
+                           getCurrentTime() - start_));
+  }
+}
+
+std::shared_ptr<LoopMonitor> LoopMonitor::start(folly::EventBase* eventBase,
+                                                uint32_t sampleRate) {
+  CHECK(eventBase->isInEventBaseThread());
+  auto monitor = std::make_shared<LoopMonitor>(sampleRate);
+  monitor->eventBase_ = eventBase;
+  eventBase->setObserver(monitor);
+  current_ = monitor.get();
+  return monitor;
+}
+
+LoopMonitor::LoopMonitor(uint32_t sampleRate)
+    : sampleRate_(std::max(sampleRate, uint32_t(1))) {
+}
+
+void LoopMonitor::stop() {
+  if (current_ == this) {
+    current_ = nullptr;
+  }
+  if (eventBase_) {
+    CHECK(eventBase_->isInEventBaseThread());
+    // may drop the last reference to this
+    auto eventBase = eventBase_;
+    eventBase_ = nullptr;
+    eventBase->setObserver(nullptr);
+  }
+}
+
+LoopMonitor::Snapshot LoopMonitor::getSnapshot() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return stats_;
+}
+
+void LoopMonitor::onSample(int64_t busyTime, int64_t idleTime,
+                           size_t queueDepth) {
+  busyTime = std::max(busyTime, int64_t(0));
+  idleTime = std::max(idleTime, int64_t(0));
+  std::lock_guard<std::mutex> guard(mutex_);
+  stats_.iterationTime.addValue(busyTime + idleTime);
+  stats_.busyTime.addValue(busyTime);
+  stats_.iterations++;
+  stats_.totalBusy += microseconds(busyTime);
+  stats_.totalIdle += microseconds(idleTime);
+  stats_.queueDepth = queueDepth;
+  stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, queueDepth);
+}
+
+void LoopMonitor::onCallback(const char* source, microseconds time) {
+  // only this thread writes it, reading it unlocked is safe
+  if (time <= stats_.slowestCallback) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  stats_.slowestCallback = time;
+  stats_.slowestSource = source;
+}
+
+void LoopMonitor::loopSample(int64_t busyTime, int64_t idleTime) {
+  onSample(busyTime, idleTime,
+           eventBase_ ? eventBase_->getNotificationQueueSize() : 0);
+}
+
+}
@@ -0,0 +1,112 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/LatencyHistogram.h>
+#include <proxygen/lib/utils/Time.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * Where the event loop of a thread spends its time, as folly measures it
+ * for each iteration (see folly::EventBaseObserver): busy running the
+ * handlers and loop callbacks, or idle waiting in epoll. Also follows the
+ * depth of the runInEventBaseThread() queue, sampled at the end of the
+ * iterations, and the slowest callback timed with a CallbackScope.
+ *
+ * Recorded on the thread of the loop, snapshots may be taken from any
+ * thread. The lock this takes is only contended by the snapshots.
+ */
+class LoopMonitor : public folly::EventBaseObserver {
+ public:
+  struct Snapshot {
+    // microseconds of the sampled iterations, busy and idle
+    LatencyHistogram iterationTime;
+    // microseconds of their busy part
+    LatencyHistogram busyTime;
+    uint64_t iterations{0};
+    std::chrono::microseconds totalBusy{0};
+    std::chrono::microseconds totalIdle{0};
+    // functions queued by other threads, when last sampled, and at most
+    size_t queueDepth{0};
+    size_t maxQueueDepth{0};
+    // the slowest CallbackScope so far, and its source
+    std::chrono::microseconds slowestCallback{0};
+    std::string slowestSource;
+
+    /**
+     * @return the percentage of the sampled time spent busy
+     */
+    uint32_t getBusyPercent() const;
+  };
+
+  /**
+   * Times a callback on the loop of the calling thread, if it has a
+   * started LoopMonitor, and does nothing otherwise. source must be a
+   * string literal, such as "HTTPSession::readDataAvailable".
+   */
+  class CallbackScope {
+   public:
+    explicit CallbackScope(const char* source);
+    ~CallbackScope();
+
+   private:
+    LoopMonitor* const monitor_;
+    const char* const source_;
+    TimePoint start_;
+  };
+
+  /**
+   * Observe eventBase, one iteration in sampleRate, and time the
+   * CallbackScopes of the calling thread, which must be the thread of the
+   * loop. The EventBase keeps a reference.
+   */
+  static std::shared_ptr<LoopMonitor> start(folly::EventBase* eventBase,
+                                            uint32_t sampleRate = 1);
+
+  explicit LoopMonitor(uint32_t sampleRate = 1);
+
+  /**
+   * Stop observing, on the thread of the loop. The snapshots keep what
+   * was recorded.
+   */
+  void stop();
+
+  Snapshot getSnapshot() const;
+
+  /**
+   * Learn from an iteration, in microseconds, that left queueDepth
+   * functions queued
+   */
+  void onSample(int64_t busyTime, int64_t idleTime, size_t queueDepth);
+
+  void onCallback(const char* source, std::chrono::microseconds time);
+
+  // EventBaseObserver methods
+  uint32_t getSampleRate() const override {
+    return sampleRate_;
+  }
+  void loopSample(int64_t busyTime, int64_t idleTime) override;
+
+ private:
+  static __thread LoopMonitor* current_;
+
+  const uint32_t sampleRate_;
+  folly::EventBase* eventBase_{nullptr};
+  mutable std::mutex mutex_;
+  Snapshot stats_;
+};
+
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Lock-free queue with any number of producers and a single consumer,
+ * which takes everything queued at once. Producers push onto a shared
+ * list with one compare-and-swap, and the consumer swaps the whole list
+ * out, so that a batch of items costs the consumer one atomic operation.
+ */
+template <class T>
+class MPSCQueue {
+ public:
+  MPSCQueue() {}
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  ~MPSCQueue() {
+    freeList(head_.load(std::memory_order_acquire));
+  }
+
+  /**
+   * Queue value, from any thread
+   *
+   * @return true if the queue was empty, so that the consumer may have
+   *         to be woken up
+   */
+  bool push(T value) {
+    Node* node = new Node(std::move(value));
+    node->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(node->next, node,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    return node->next == nullptr;
+  }
+
+  /**
+   * Take all of the queued values, in the order they were pushed. Only
+   * one thread may call this at a time.
+   */
+  std::vector<T> popAll() {
+    std::vector<T> values;
+    Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+    Node* reversed = nullptr;
+    while (node) {
+      Node* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+    for (node = reversed; node; node = node->next) {
+      values.push_back(std::move(node->value));
+    }
+    freeList(reversed);
+    return values;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  struct Node {
+    explicit Node(T v): value(std::move(v)) {}
+
+    T value;
+    Node* next{nullptr};
+  };
+
+  static void freeList(Node* node) {
+    while (node) {
+      Node* next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+  std::atomic<Node*> head_{nullptr};
+};
+
+}
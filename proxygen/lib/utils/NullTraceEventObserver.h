@@ -15,7 +15,7 @@ namespace proxygen {
 
 struct NullTraceEventObserver : public TraceEventObserver {
   // Do nothing.
-  void traceEventAvailable(TraceEvent event) noexcept override {}
+  void traceEventAvailable(const TraceEvent& event) noexcept override {}
 
   static NullTraceEventObserver nullObserver;
 };
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <folly/ThreadLocal.h>
+#include <memory>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Free list of objects of type T, so that objects that come and go at a
+ * steady rate are reused instead of being allocated every time. There is
+ * one pool per thread, and so per EventBase.
+ *
+ * T is default constructed when the pool is empty, and must have a reset()
+ * that puts a recycled object back in its default constructed state while
+ * keeping the memory it already holds.
+ */
+template <typename T>
+class ObjectPool {
+ public:
+  static const size_t kDefaultMaxSize = 1024;
+
+  /**
+   * @return the pool of the calling thread
+   */
+  static ObjectPool& get() {
+    static folly::ThreadLocal<ObjectPool> pool;
+    return *pool;
+  }
+
+  /**
+   * @return a recycled object if there is one, a new one otherwise
+   */
+  std::unique_ptr<T> acquire() {
+    if (free_.empty()) {
+      misses_++;
+      return std::unique_ptr<T>(new T());
+    }
+    hits_++;
+    std::unique_ptr<T> obj = std::move(free_.back());
+    free_.pop_back();
+    return obj;
+  }
+
+  /**
+   * Reset obj and keep it for a later acquire(). obj is freed instead if
+   * the pool is full.
+   */
+  void recycle(std::unique_ptr<T> obj) {
+    if (!obj || free_.size() >= maxSize_) {
+      return;
+    }
+    obj->reset();
+    free_.push_back(std::move(obj));
+  }
+
+  /**
+   * @param maxSize the number of free objects the pool keeps at most
+   */
+  void setMaxSize(size_t maxSize) {
+    maxSize_ = maxSize;
+    if (free_.size() > maxSize_) {
+      free_.resize(maxSize_);
+    }
+  }
+
+  size_t getMaxSize() const {
+    return maxSize_;
+  }
+
+  /**
+   * @return the number of free objects in the pool
+   */
+  size_t size() const {
+    return free_.size();
+  }
+
+  /**
+   * @return the number of acquire() calls that got a recycled object
+   */
+  uint64_t getHits() const {
+    return hits_;
+  }
+
+  /**
+   * @return the number of acquire() calls that allocated
+   */
+  uint64_t getMisses() const {
+    return misses_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<T>> free_;
+  size_t maxSize_{kDefaultMaxSize};
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+}
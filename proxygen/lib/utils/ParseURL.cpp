@@ -21,7 +21,9 @@ using std::string;
 namespace proxygen {
 
 void ParseURL::parse() noexcept {
-  if (caseInsensitiveEqual(url_.subpiece(0, 4), "http")) {
+  if (!url_.empty() && url_.front() == '/') {
+    parseOriginForm();
+  } else if (caseInsensitiveEqual(url_.subpiece(0, 4), "http")) {
     struct http_parser_url u;
     memset(&u, 0, sizeof(struct http_parser_url)); // init before used
     valid_ = !(http_parser_parse_url(url_.data(), url_.size(), 0, &u));
@@ -54,8 +56,15 @@ void ParseURL::parse() noexcept {
       fragment_ = url_.subpiece(u.field_data[UF_FRAGMENT].off,
                                 u.field_data[UF_FRAGMENT].len);
 
-      authority_ = (port_) ? folly::to<std::string>(host_, ":", port_)
-                           : host_.str();
+      // host[:port] is contiguous in the url, so point at it rather than
+      // rebuilding it
+      auto authorityStart = host_.begin() - url_.begin();
+      auto authorityEnd = host_.end() - url_.begin();
+      if (port_) {
+        authorityEnd = u.field_data[UF_PORT].off + u.field_data[UF_PORT].len;
+      }
+      authority_ = url_.subpiece(authorityStart,
+                                 authorityEnd - authorityStart);
     }
   } else {
     parseNonFully();
@@ -76,7 +85,7 @@ void ParseURL::parseNonFully() noexcept {
   auto pathEnd = std::min(queryStart, hashStart);
   auto authorityEnd = std::min(pathStart, pathEnd);
 
-  authority_ = url_.subpiece(0, authorityEnd).str();
+  authority_ = url_.subpiece(0, authorityEnd);
 
   if (pathStart < pathEnd) {
     path_ = url_.subpiece(pathStart, pathEnd - pathStart);
@@ -104,15 +113,44 @@ void ParseURL::parseNonFully() noexcept {
   valid_ = true;
 }
 
+void ParseURL::parseOriginForm() noexcept {
+  // no authority to look for, so one pass for the first '?' or '#' is
+  // enough to split the rest
+  size_t pathEnd = 0;
+  while (pathEnd < url_.size() && url_[pathEnd] != '?' &&
+         url_[pathEnd] != '#') {
+    ++pathEnd;
+  }
+  path_ = url_.subpiece(0, pathEnd);
+
+  if (pathEnd < url_.size() && url_[pathEnd] == '?') {
+    auto hashStart = url_.find('#', pathEnd + 1);
+    if (hashStart == std::string::npos) {
+      query_ = url_.subpiece(pathEnd + 1);
+    } else {
+      query_ = url_.subpiece(pathEnd + 1, hashStart - pathEnd - 1);
+      fragment_ = url_.subpiece(hashStart + 1);
+    }
+  } else if (pathEnd < url_.size()) {
+    // same as parseNonFully(), a query may not follow the fragment
+    if (url_.find('?', pathEnd + 1) != std::string::npos) {
+      valid_ = false;
+      return;
+    }
+    fragment_ = url_.subpiece(pathEnd + 1);
+  }
+
+  valid_ = true;
+}
+
 bool ParseURL::parseAuthority() noexcept {
-  auto left = authority_.find("[");
-  auto right = authority_.find("]");
+  auto left = authority_.find('[');
+  auto right = authority_.find(']');
 
-  auto pos = authority_.find(":", right != std::string::npos ? right : 0);
+  auto pos = authority_.find(':', right != std::string::npos ? right : 0);
   if (pos != std::string::npos) {
     try {
-      port_ = folly::to<uint16_t>(
-        folly::StringPiece(authority_, pos+1, std::string::npos));
+      port_ = folly::to<uint16_t>(authority_.subpiece(pos + 1));
     } catch (...) {
       return false;
     }
@@ -120,11 +158,11 @@ bool ParseURL::parseAuthority() noexcept {
 
   if (left == std::string::npos && right == std::string::npos) {
     // not a ipv6 literal
-    host_ = folly::StringPiece(authority_, 0, pos);
+    host_ = authority_.subpiece(0, pos);
     return true;
   } else if (left < right && right != std::string::npos) {
     // a ipv6 literal
-    host_ = folly::StringPiece(authority_, left, right - left + 1);
+    host_ = authority_.subpiece(left, right - left + 1);
     return true;
   } else {
     return false;
@@ -140,10 +178,15 @@ bool ParseURL::hostIsIPAddress() {
   int af = hostNoBrackets_.find(':') == std::string::npos ? AF_INET : AF_INET6;
   char buf4[sizeof(in_addr)];
   char buf6[sizeof(in6_addr)];
-  // we have to make a copy of hostNoBrackets_ since the string piece is not
-  // null-terminated
-  return inet_pton(af, hostNoBrackets_.str().c_str(),
-                   af == AF_INET ? buf4 : buf6) == 1;
+  // inet_pton needs a null-terminated string, which the piece isn't; copy
+  // it to the stack, anything that doesn't fit can't be an address anyway
+  char host[INET6_ADDRSTRLEN];
+  if (hostNoBrackets_.size() >= sizeof(host)) {
+    return false;
+  }
+  memcpy(host, hostNoBrackets_.data(), hostNoBrackets_.size());
+  host[hostNoBrackets_.size()] = '\0';
+  return inet_pton(af, host, af == AF_INET ? buf4 : buf6) == 1;
 }
 
 void ParseURL::stripBrackets() noexcept {
@@ -17,6 +17,10 @@ namespace proxygen {
 
 // ParseURL can handle non-fully-formed URLs. This class must not persist beyond
 // the lifetime of the buffer underlying the input StringPiece
+//
+// Every component is a view into the input, so parsing never allocates.
+// Origin-form URLs ("/path?query", what almost every request line carries)
+// are split with a single scan instead of going through http_parser.
 
 class ParseURL {
  public:
@@ -40,7 +44,7 @@ class ParseURL {
     return scheme_;
   }
 
-  std::string authority() const {
+  folly::StringPiece authority() const {
     return authority_;
   }
 
@@ -94,11 +98,13 @@ class ParseURL {
 
   void parseNonFully() noexcept;
 
+  void parseOriginForm() noexcept;
+
   bool parseAuthority() noexcept;
 
   folly::StringPiece url_;
   folly::StringPiece scheme_;
-  std::string authority_;
+  folly::StringPiece authority_;
   folly::StringPiece host_;
   folly::StringPiece hostNoBrackets_;
   folly::StringPiece path_;
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/ReadBufferPool.h>
+
+#include <folly/ThreadLocal.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace proxygen {
+
+const uint32_t ReadBufferPool::kMinBufferSize;
+const uint32_t ReadBufferPool::kMaxBufferSize;
+const size_t ReadBufferPool::kDefaultMaxBytes;
+const size_t ReadBufferPool::kNumSizes;
+
+ReadBufferPool& ReadBufferPool::get() {
+  static folly::ThreadLocal<ReadBufferPool> pool;
+  return *pool;
+}
+
+unique_ptr<IOBuf> ReadBufferPool::acquire(uint32_t size) {
+  // the smallest size that fits
+  size_t index = 0;
+  while (index < kNumSizes - 1 && (kMinBufferSize << index) < size) {
+    index++;
+  }
+  auto& bufs = free_[index];
+  if (bufs.empty()) {
+    misses_++;
+    return IOBufSlab::get().create(kMinBufferSize << index);
+  }
+  hits_++;
+  unique_ptr<IOBuf> buf = std::move(bufs.back());
+  bufs.pop_back();
+  bytes_ -= buf->capacity();
+  return buf;
+}
+
+void ReadBufferPool::recycle(unique_ptr<IOBuf> chain) {
+  while (chain) {
+    unique_ptr<IOBuf> buf = std::move(chain);
+    chain = buf->pop();
+    uint64_t capacity = buf->capacity();
+    if (buf->isSharedOne() || capacity < kMinBufferSize ||
+        bytes_ + capacity > maxBytes_) {
+      continue;
+    }
+    // the largest size that the buffer can serve
+    size_t index = 0;
+    while (index < kNumSizes - 1 &&
+           (kMinBufferSize << (index + 1)) <= capacity) {
+      index++;
+    }
+    buf->clear();
+    bytes_ += capacity;
+    free_[index].push_back(std::move(buf));
+  }
+}
+
+void ReadBufferPool::reserve(uint32_t size, size_t count) {
+  size_t index = 0;
+  while (index < kNumSizes - 1 && (kMinBufferSize << index) < size) {
+    index++;
+  }
+  uint32_t bufferSize = kMinBufferSize << index;
+  while (free_[index].size() < count && bytes_ + bufferSize <= maxBytes_) {
+    auto buf = IOBufSlab::get().create(bufferSize);
+    bytes_ += buf->capacity();
+    free_[index].push_back(std::move(buf));
+  }
+}
+
+void ReadBufferPool::setMaxBytes(size_t maxBytes) {
+  maxBytes_ = maxBytes;
+  for (auto& bufs: free_) {
+    while (bytes_ > maxBytes_ && !bufs.empty()) {
+      bytes_ -= bufs.back()->capacity();
+      bufs.pop_back();
+    }
+  }
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Free lists of the buffers that connections read into, so that the
+ * connections of a thread can share a few buffers instead of each holding
+ * its own while it waits for data. There is one pool per thread, and so per
+ * EventBase.
+ *
+ * The buffers come in powers of two from kMinBufferSize to kMaxBufferSize,
+ * from the IOBufSlab of the thread.
+ */
+class ReadBufferPool {
+ public:
+  static const uint32_t kMinBufferSize = 2048;
+  static const uint32_t kMaxBufferSize = 65536;
+  // bytes a pool keeps at most in its free lists
+  static const size_t kDefaultMaxBytes = 1024 * 1024;
+
+  /**
+   * @return the pool of the calling thread
+   */
+  static ReadBufferPool& get();
+
+  /**
+   * @return an empty buffer with at least size bytes of tailroom, or
+   * kMaxBufferSize bytes if size is larger
+   */
+  std::unique_ptr<folly::IOBuf> acquire(uint32_t size);
+
+  /**
+   * Keep the buffers of chain for later acquire() calls, once emptied. The
+   * buffers that are still shared with some other IOBuf, and the ones the
+   * pool has no room for, are freed instead.
+   */
+  void recycle(std::unique_ptr<folly::IOBuf> chain);
+
+  /**
+   * Fill the free list of size with up to count buffers, as far as
+   * getMaxBytes() allows, so that the first connections of the thread
+   * don't allocate. Doesn't count as misses.
+   */
+  void reserve(uint32_t size, size_t count);
+
+  void setMaxBytes(size_t maxBytes);
+
+  size_t getMaxBytes() const {
+    return maxBytes_;
+  }
+
+  /**
+   * @return the capacity of all the free buffers of the pool
+   */
+  size_t getBytes() const {
+    return bytes_;
+  }
+
+  /**
+   * @return the number of acquire() calls that got a recycled buffer
+   */
+  uint64_t getHits() const {
+    return hits_;
+  }
+
+  /**
+   * @return the number of acquire() calls that allocated
+   */
+  uint64_t getMisses() const {
+    return misses_;
+  }
+
+ private:
+  static const size_t kNumSizes = 6;
+
+  std::vector<std::unique_ptr<folly::IOBuf>> free_[kNumSizes];
+  size_t maxBytes_{kDefaultMaxBytes};
+  size_t bytes_{0};
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+/**
+ * Guesses how many bytes the next read of a connection will return from
+ * the sizes of the recent reads. A read that fills the estimate doubles
+ * it, right away, so that bulk transfers quickly get large reads. A few
+ * reads in a row that return less than half of it halve it, so that
+ * connections with small messages don't hold large buffers.
+ */
+class ReadSizeEstimator {
+ public:
+  // number of small reads in a row after which the estimate shrinks
+  static const uint32_t kShrinkAfter = 3;
+
+  ReadSizeEstimator(uint32_t minSize, uint32_t initialSize, uint32_t maxSize):
+      minSize_(minSize),
+      maxSize_(maxSize),
+      size_(std::min(std::max(initialSize, minSize), maxSize)) {
+    CHECK_LE(minSize, maxSize);
+  }
+
+  /**
+   * @return the number of bytes the next read should ask for
+   */
+  uint32_t getSize() const {
+    return size_;
+  }
+
+  /**
+   * Learn from a read that returned readSize bytes
+   */
+  void onRead(size_t readSize) {
+    if (readSize >= size_) {
+      size_ = std::min(size_ * 2, maxSize_);
+      smallReads_ = 0;
+    } else if (readSize < size_ / 2) {
+      if (++smallReads_ >= kShrinkAfter) {
+        size_ = std::max(size_ / 2, minSize_);
+        smallReads_ = 0;
+      }
+    } else {
+      smallReads_ = 0;
+    }
+  }
+
+ private:
+  uint32_t minSize_;
+  uint32_t maxSize_;
+  uint32_t size_;
+  uint32_t smallReads_{0};
+};
+
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/RequestArena.h>
+
+#include <algorithm>
+#include <cstring>
+#include <proxygen/lib/utils/IOBufSlab.h>
+
+namespace proxygen {
+
+const size_t RequestArena::kInlineSize;
+const size_t RequestArena::kBlockSize;
+const size_t RequestArena::kMaxRecycledSize;
+const size_t RequestArena::kAlignment;
+const size_t RequestArena::kNumRecycledSizes;
+
+struct RequestArena::Block {
+  Block* next;
+};
+
+namespace {
+
+// the header of the blocks, keeping the allocations after it aligned
+const size_t kHeaderSize = 16;
+
+}
+
+RequestArena::RequestArena():
+    next_(inline_),
+    end_(inline_ + kInlineSize) {
+  std::fill(recycled_, recycled_ + kNumRecycledSizes, nullptr);
+}
+
+RequestArena::~RequestArena() {
+  reset();
+}
+
+size_t RequestArena::recycledIndex(size_t size) {
+  size_t index = 0;
+  while ((kAlignment << index) < size) {
+    index++;
+  }
+  return index;
+}
+
+void* RequestArena::allocate(size_t size) {
+  if (size <= kMaxRecycledSize) {
+    size_t index = recycledIndex(size);
+    if (recycled_[index]) {
+      void* ptr = recycled_[index];
+      memcpy(&recycled_[index], ptr, sizeof(void*));
+      return ptr;
+    }
+    // the size it will be recycled as
+    size = kAlignment << index;
+  } else {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+  }
+  if (size > size_t(end_ - next_)) {
+    // the large ones get a block of their own, the space left in the
+    // current block stays in use
+    size_t blockSize = std::max(kBlockSize, size + kHeaderSize);
+    Block* block = static_cast<Block*>(
+      IOBufSlab::get().allocate(blockSize));
+    block->next = blocks_;
+    blocks_ = block;
+    blockBytes_ += blockSize;
+    char* start = reinterpret_cast<char*>(block) + kHeaderSize;
+    if (blockSize > kBlockSize) {
+      return start;
+    }
+    next_ = start;
+    end_ = reinterpret_cast<char*>(block) + blockSize;
+  }
+  void* ptr = next_;
+  next_ += size;
+  return ptr;
+}
+
+void RequestArena::deallocate(void* ptr, size_t size) {
+  if (!ptr || size > kMaxRecycledSize) {
+    return;
+  }
+  size_t index = recycledIndex(size);
+  memcpy(ptr, &recycled_[index], sizeof(void*));
+  recycled_[index] = ptr;
+}
+
+void RequestArena::reset() {
+  while (blocks_) {
+    Block* block = blocks_;
+    blocks_ = block->next;
+    IOBufSlab::deallocate(block);
+  }
+  blockBytes_ = 0;
+  next_ = inline_;
+  end_ = inline_ + kInlineSize;
+  std::fill(recycled_, recycled_ + kNumRecycledSizes, nullptr);
+}
+
+}
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace proxygen {
+
+/**
+ * Monotonic allocator for what lives as long as one request, so that it is
+ * all freed at once with the request instead of piece by piece. The first
+ * kInlineSize bytes are in the arena itself, the rest in blocks from the
+ * IOBufSlab of the thread.
+ *
+ * The allocations of up to kMaxRecycledSize bytes that are given back are
+ * kept for the next allocations of their size, so that containers whose
+ * elements come and go, such as queues, don't grow the arena for as long as
+ * the request lasts.
+ *
+ * Allocations are aligned for any type. Not thread safe.
+ */
+class RequestArena {
+ public:
+  static const size_t kInlineSize = 256;
+  static const size_t kBlockSize = 4096;
+  static const size_t kMaxRecycledSize = 1024;
+
+  /**
+   * For the standard containers
+   */
+  template <class T>
+  class Allocator;
+
+  RequestArena();
+  ~RequestArena();
+
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+
+  void* allocate(size_t size);
+
+  /**
+   * Give back ptr, from allocate(size)
+   */
+  void deallocate(void* ptr, size_t size);
+
+  /**
+   * Free everything, the allocations must not be used anymore
+   */
+  void reset();
+
+  /**
+   * @return the bytes of the blocks, beyond the inline ones
+   */
+  size_t getBlockBytes() const {
+    return blockBytes_;
+  }
+
+ private:
+  struct Block;
+
+  static const size_t kAlignment = 16;
+  // kAlignment << i, up to kMaxRecycledSize
+  static const size_t kNumRecycledSizes = 7;
+
+  // the index of the recycled size of size, which must not exceed
+  // kMaxRecycledSize
+  static size_t recycledIndex(size_t size);
+
+  char* next_;
+  char* end_;
+  Block* blocks_{nullptr};
+  size_t blockBytes_{0};
+  // the given back allocations of each size, linked through their first
+  // bytes
+  void* recycled_[kNumRecycledSizes];
+  alignas(kAlignment) char inline_[kInlineSize];
+};
+
+template <class T>
+class RequestArena::Allocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind {
+    typedef Allocator<U> other;
+  };
+
+  explicit Allocator(RequestArena* arena): arena_(arena) {}
+
+  template <class U>
+  Allocator(const Allocator<U>& other): arena_(other.getArena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    arena_->deallocate(ptr, n * sizeof(T));
+  }
+
+  template <class U, class... Args>
+  void construct(U* ptr, Args&&... args) {
+    ::new((void*)ptr) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  void destroy(U* ptr) {
+    ptr->~U();
+  }
+
+  size_t max_size() const {
+    return std::numeric_limits<size_t>::max() / sizeof(T);
+  }
+
+  RequestArena* getArena() const {
+    return arena_;
+  }
+
+  template <class U>
+  bool operator==(const Allocator<U>& other) const {
+    return arena_ == other.getArena();
+  }
+
+  template <class U>
+  bool operator!=(const Allocator<U>& other) const {
+    return arena_ != other.getArena();
+  }
+
+ private:
+  RequestArena* arena_;
+};
+
+}
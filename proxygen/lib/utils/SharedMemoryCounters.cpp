@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/SharedMemoryCounters.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace proxygen {
+
+const uint32_t SharedMemoryCounters::kMagic;
+const uint32_t SharedMemoryCounters::kVersion;
+const size_t SharedMemoryCounters::kNameSize;
+
+namespace {
+
+SharedMemoryCounters::Entry* getEntries(SharedMemoryCounters::Header* h) {
+  return reinterpret_cast<SharedMemoryCounters::Entry*>(h + 1);
+}
+
+const SharedMemoryCounters::Entry* getEntries(
+    const SharedMemoryCounters::Header* h) {
+  return reinterpret_cast<const SharedMemoryCounters::Entry*>(h + 1);
+}
+
+}
+
+SharedMemoryCounterWriter::SharedMemoryCounterWriter(const std::string& name,
+                                                     uint32_t capacity)
+    : name_(name),
+      size_(SharedMemoryCounters::getSegmentSize(capacity)) {
+  // a new segment, so that readers of an old one aren't handed a
+  // different size under their feet
+  ::shm_unlink(name_.c_str());
+  int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "shm_open " + name_);
+  }
+  if (::ftruncate(fd, size_) != 0) {
+    int err = errno;
+    ::close(fd);
+    ::shm_unlink(name_.c_str());
+    throw std::system_error(err, std::system_category(), "ftruncate");
+  }
+  void* addr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    ::shm_unlink(name_.c_str());
+    throw std::system_error(err, std::system_category(), "mmap");
+  }
+  // the pages are zero: seq is 0 and the table empty
+  header_ = new (addr) SharedMemoryCounters::Header();
+  header_->capacity = capacity;
+  header_->pid = ::getpid();
+  header_->version = SharedMemoryCounters::kVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  // last, so that a reader that sees it sees the rest
+  header_->magic = SharedMemoryCounters::kMagic;
+}
+
+SharedMemoryCounterWriter::~SharedMemoryCounterWriter() {
+  ::munmap(header_, size_);
+  ::shm_unlink(name_.c_str());
+}
+
+size_t SharedMemoryCounterWriter::publish(
+    const std::map<std::string, int64_t>& counters) {
+  uint64_t seq = header_->seq.load(std::memory_order_relaxed);
+  header_->seq.store(seq + 1, std::memory_order_relaxed);
+  // the table writes may not move above the odd seq
+  std::atomic_thread_fence(std::memory_order_release);
+
+  auto entries = getEntries(header_);
+  uint32_t count = 0;
+  size_t skipped = 0;
+  for (const auto& counter: counters) {
+    if (count == header_->capacity ||
+        counter.first.size() >= SharedMemoryCounters::kNameSize) {
+      skipped++;
+      continue;
+    }
+    auto& entry = entries[count++];
+    memcpy(entry.name, counter.first.data(), counter.first.size());
+    entry.name[counter.first.size()] = '\0';
+    entry.value = counter.second;
+  }
+  header_->count = count;
+  header_->publishedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  header_->seq.store(seq + 2, std::memory_order_release);
+  return skipped;
+}
+
+SharedMemoryCounterReader::SharedMemoryCounterReader(const std::string& name) {
+  int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "shm_open " + name);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::system_category(), "fstat");
+  }
+  size_ = st.st_size;
+  void* addr = size_ >= sizeof(SharedMemoryCounters::Header) ?
+    ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  int err = errno;
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::system_error(err, std::system_category(), "mmap " + name);
+  }
+  header_ = static_cast<const SharedMemoryCounters::Header*>(addr);
+  if (header_->magic != SharedMemoryCounters::kMagic ||
+      header_->version != SharedMemoryCounters::kVersion ||
+      SharedMemoryCounters::getSegmentSize(header_->capacity) > size_) {
+    ::munmap(addr, size_);
+    throw std::runtime_error(name + " isn't a counter segment of version " +
+                             std::to_string(SharedMemoryCounters::kVersion));
+  }
+}
+
+SharedMemoryCounterReader::~SharedMemoryCounterReader() {
+  ::munmap(const_cast<SharedMemoryCounters::Header*>(header_), size_);
+}
+
+uint64_t SharedMemoryCounterReader::read(
+    std::map<std::string, int64_t>& counters) const {
+  std::vector<SharedMemoryCounters::Entry> entries;
+  for (;;) {
+    uint64_t seq = header_->seq.load(std::memory_order_acquire);
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    // the count may be torn, so it is bounded before use
+    uint32_t count = std::min(header_->count, header_->capacity);
+    entries.assign(getEntries(header_), getEntries(header_) + count);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->seq.load(std::memory_order_relaxed) != seq) {
+      continue;
+    }
+    counters.clear();
+    for (auto& entry: entries) {
+      entry.name[SharedMemoryCounters::kNameSize - 1] = '\0';
+      counters[entry.name] = entry.value;
+    }
+    return seq;
+  }
+}
+
+uint64_t SharedMemoryCounterReader::getPublishedMs() const {
+  return header_->publishedMs;
+}
+
+}
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * A table of named counters in a POSIX shared memory segment, which an
+ * agent in another process maps once and then reads with plain loads: no
+ * system call, and nothing for the threads of the writer to do.
+ *
+ * The segment is a Header followed by Header::capacity Entries. The
+ * writer publishes whole tables under a seqlock: Header::seq is odd while
+ * a table is being written, and a reader copies the table and retries if
+ * seq was odd or changed meanwhile. A reader never blocks the writer.
+ */
+class SharedMemoryCounters {
+ public:
+  static const uint32_t kMagic = 0x54535850; // "PXST"
+  // of the layout below, bumped on any change to it
+  static const uint32_t kVersion = 1;
+  static const size_t kNameSize = 120;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    // entries the segment has room for
+    uint32_t capacity;
+    // entries of the current table
+    uint32_t count;
+    std::atomic<uint64_t> seq;
+    // of the writer, and the milliseconds since the epoch of the last
+    // publish, to tell a stale segment
+    uint64_t pid;
+    uint64_t publishedMs;
+  };
+
+  struct Entry {
+    // NUL terminated
+    char name[kNameSize];
+    int64_t value;
+  };
+
+  static size_t getSegmentSize(uint32_t capacity) {
+    return sizeof(Header) + capacity * sizeof(Entry);
+  }
+};
+
+/**
+ * Creates the segment, replacing any of the same name, and publishes
+ * tables into it. Not thread safe: one thread publishes.
+ */
+class SharedMemoryCounterWriter {
+ public:
+  /**
+   * @param name       of the segment, "/" and then no other "/", see
+   *                   shm_open(3)
+   * @param capacity   counters the segment has room for
+   *
+   * Throws std::system_error if the segment can't be created.
+   */
+  SharedMemoryCounterWriter(const std::string& name, uint32_t capacity);
+
+  /**
+   * Unmaps and unlinks the segment; readers that have it mapped keep
+   * their last table
+   */
+  ~SharedMemoryCounterWriter();
+
+  SharedMemoryCounterWriter(const SharedMemoryCounterWriter&) = delete;
+  SharedMemoryCounterWriter& operator=(const SharedMemoryCounterWriter&) =
+    delete;
+
+  /**
+   * Replace the table with counters. Counters past the capacity, and the
+   * ones with a name of kNameSize bytes or more, are left out.
+   *
+   * @return the number of counters left out
+   */
+  size_t publish(const std::map<std::string, int64_t>& counters);
+
+ private:
+  const std::string name_;
+  const size_t size_;
+  SharedMemoryCounters::Header* header_{nullptr};
+};
+
+/**
+ * Maps the segment of a writer, in the agent that scrapes it
+ */
+class SharedMemoryCounterReader {
+ public:
+  /**
+   * Throws std::system_error if the segment can't be mapped, and
+   * std::runtime_error if it isn't of this version
+   */
+  explicit SharedMemoryCounterReader(const std::string& name);
+  ~SharedMemoryCounterReader();
+
+  SharedMemoryCounterReader(const SharedMemoryCounterReader&) = delete;
+  SharedMemoryCounterReader& operator=(const SharedMemoryCounterReader&) =
+    delete;
+
+  /**
+   * Copy the current table into counters, retrying while the writer is
+   * publishing
+   *
+   * @return the seq of the table copied, different for each table
+   */
+  uint64_t read(std::map<std::string, int64_t>& counters) const;
+
+  /**
+   * @return the milliseconds since the epoch of the last publish
+   */
+  uint64_t getPublishedMs() const;
+
+ private:
+  size_t size_{0};
+  const SharedMemoryCounters::Header* header_{nullptr};
+};
+
+}
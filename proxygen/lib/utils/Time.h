@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <chrono>
 #include <cinttypes>
+#include <ctime>
 
 namespace proxygen {
 
@@ -35,6 +36,16 @@ inline TimePoint getCurrentTime() {
   return ClockType::now();
 }
 
+/**
+ * CPU time the calling thread has used. Unlike getCurrentTime(), this is a
+ * system call, a few hundred nanoseconds.
+ */
+inline std::chrono::nanoseconds getThreadCpuTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
 inline std::chrono::system_clock::time_point toSystemTimePoint(TimePoint t) {
   return std::chrono::system_clock::now() +
     std::chrono::duration_cast<std::chrono::system_clock::duration>(
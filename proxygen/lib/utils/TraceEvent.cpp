@@ -9,7 +9,6 @@
  */
 #include <proxygen/lib/utils/TraceEvent.h>
 
-#include <folly/DynamicConverter.h>
 #include <folly/ThreadLocal.h>
 #include <random>
 #include <sstream>
@@ -73,33 +72,17 @@ bool TraceEvent::hasEnded() const {
   return stateFlags_ & State::ENDED;
 }
 
-bool TraceEvent::addMeta(TraceFieldType key, folly::dynamic&& value) {
-  auto rc = metaData_.emplace(key, value);
-
-  // replace if key already exist
-  if (!rc.second) {
-    rc.first->second = value;
-  }
-
-  return rc.second;
-}
-
 bool TraceEvent::readBoolMeta(TraceFieldType key, bool& dest) const {
-  if (metaData_.count(key)) {
-    DCHECK(metaData_.at(key).isBool());
-    dest = metaData_.at(key).asBool();
+  if (metaData_.getBool(key, dest)) {
     return true;
   }
+  DCHECK(!metaData_.has(key)) << "not a bool";
   return false;
 }
 
 bool TraceEvent::readStrMeta(TraceFieldType key, std::string& dest) const {
-  if (metaData_.count(key)) {
-    // no need to check if value is string type
-    dest = metaData_.at(key).asString().toStdString();
-    return true;
-  }
-  return false;
+  // no need to check if value is string type
+  return metaData_.format(key, dest);
 }
 
 std::string TraceEvent::toString() const {
@@ -115,10 +98,11 @@ std::string TraceEvent::toString() const {
   out << "start='" << startSinceEpoch << "', ";
   out << "end='" << endSinceEpoch << "', ";
   out << "metaData='{";
-  for (auto data : metaData_) {
-    out << getTraceFieldTypeString(data.first) << ": "
-        << folly::convertTo<std::string>(data.second) << ", ";
-  }
+  std::string value;
+  metaData_.forEach([&] (TraceFieldType key, TraceMetaData::Kind kind) {
+    metaData_.format(key, value);
+    out << getTraceFieldTypeString(key) << ": " << value << ", ";
+  });
   out << "}')";
   return out.str();
 }
@@ -10,9 +10,11 @@
 #pragma once
 
 #include <folly/dynamic.h>
+#include <glog/logging.h>
 #include <proxygen/lib/utils/Time.h>
 #include <proxygen/lib/utils/TraceEventType.h>
 #include <proxygen/lib/utils/TraceFieldType.h>
+#include <proxygen/lib/utils/TraceMetaData.h>
 #include <string>
 
 namespace proxygen {
@@ -23,7 +25,7 @@ namespace proxygen {
  */
 class TraceEvent {
  public:
-  typedef std::map<TraceFieldType, folly::dynamic> MetaDataMap;
+  typedef TraceMetaData::Map MetaDataMap;
 
   explicit TraceEvent(TraceEventType type, uint32_t parentID = 0);
 
@@ -82,14 +84,24 @@ class TraceEvent {
   }
 
   void setMetaData(MetaDataMap&& input) {
-    metaData_ = input;
+    metaData_.setFromMap(input);
   }
 
-  const MetaDataMap& getMetaData() const {
+  const TraceMetaData& getMetaData() const {
     return metaData_;
   }
 
-  bool addMeta(TraceFieldType key, folly::dynamic&& value);
+  /**
+   * Set the value of key to an integer, double, bool, string, TimePoint or
+   * folly::dynamic, see TraceMetaData::set(). Returns true if key had no
+   * value before.
+   */
+  template<typename T>
+  bool addMeta(TraceFieldType key, T&& value) {
+    bool added = !metaData_.has(key);
+    metaData_.set(key, std::forward<T>(value));
+    return added;
+  }
 
   template<typename T>
   bool increaseIntMeta(TraceFieldType key, const T delta) {
@@ -101,11 +113,12 @@ class TraceEvent {
 
   template<typename T>
   bool readIntMeta(TraceFieldType key, T& dest) const {
-    if (getMetaData().count(key)) {
-      DCHECK(getMetaData().at(key).isInt());
-      dest = getMetaData().at(key).asInt();
+    int64_t value;
+    if (metaData_.getInt(key, value)) {
+      dest = value;
       return true;
     }
+    DCHECK(!metaData_.has(key)) << "not an int";
     return false;
   };
 
@@ -132,7 +145,7 @@ class TraceEvent {
   uint32_t parentID_;
   TimePoint start_;
   TimePoint end_;
-  MetaDataMap metaData_;
+  TraceMetaData metaData_;
 };
 
 }
@@ -0,0 +1,154 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/TraceEventExporter.h>
+
+#include <chrono>
+#include <cstring>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+namespace {
+
+// u32 length, u16 type, u8 flags, u32 id, u32 parent, i64 start, i64 end,
+// u16 field count
+const size_t kHeaderSize = 4 + 2 + 1 + 4 + 4 + 8 + 8 + 2;
+// u16 key, u8 kind
+const size_t kFieldHeaderSize = 2 + 1;
+
+template <typename T>
+char* put(char* out, T value) {
+  memcpy(out, &value, sizeof(value));
+  return out + sizeof(value);
+}
+
+size_t valueSize(const TraceMetaData& meta, TraceFieldType key,
+                 TraceMetaData::Kind kind) {
+  switch (kind) {
+    case TraceMetaData::Kind::BOOL:
+      return 1;
+    case TraceMetaData::Kind::STRING: {
+      folly::StringPiece str;
+      meta.getString(key, str);
+      return 4 + str.size();
+    }
+    default:
+      return 8;
+  }
+}
+
+}
+
+TraceEventExporter::TraceEventExporter(const std::string& path,
+                                       uint32_t sampleRate,
+                                       size_t bufferSize,
+                                       size_t maxPendingBuffers)
+    : sampleRate_(sampleRate ? sampleRate : 1),
+      writer_(path, bufferSize, maxPendingBuffers) {
+}
+
+void TraceEventExporter::traceEventAvailable(
+    const TraceEvent& event) noexcept {
+  uint32_t& counter = *sampleCounter_;
+  if (counter++ % sampleRate_ != 0) {
+    sampledOut_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (writer_.append(encodedSize(event), [&] (char* out) {
+        return encode(event, out);
+      })) {
+    exported_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+size_t TraceEventExporter::encodedSize(const TraceEvent& event) {
+  const auto& meta = event.getMetaData();
+  size_t size = kHeaderSize;
+  meta.forEach([&] (TraceFieldType key, TraceMetaData::Kind kind) {
+    size += kFieldHeaderSize + valueSize(meta, key, kind);
+  });
+  return size;
+}
+
+size_t TraceEventExporter::encode(const TraceEvent& event, char* out) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  // steady times to wall clock, with one pair of clock reads per event
+  const int64_t offset =
+    duration_cast<microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count() -
+    duration_cast<microseconds>(
+      ClockType::now().time_since_epoch()).count();
+  auto wallMicros = [offset] (TimePoint t) -> int64_t {
+    return duration_cast<microseconds>(t.time_since_epoch()).count() +
+      offset;
+  };
+
+  const auto& meta = event.getMetaData();
+  char* const begin = out;
+  uint8_t flags = (event.hasStarted() ? 1 : 0) | (event.hasEnded() ? 2 : 0);
+  out += 4;  // the length, once known
+  out = put<uint16_t>(out, static_cast<uint16_t>(event.getType()));
+  out = put<uint8_t>(out, flags);
+  out = put<uint32_t>(out, event.getID());
+  out = put<uint32_t>(out, event.getParentID());
+  out = put<int64_t>(out,
+                     event.hasStarted() ? wallMicros(event.getStartTime()) : 0);
+  out = put<int64_t>(out,
+                     event.hasEnded() ? wallMicros(event.getEndTime()) : 0);
+  out = put<uint16_t>(out, meta.size());
+
+  meta.forEach([&] (TraceFieldType key, TraceMetaData::Kind kind) {
+    out = put<uint16_t>(out, static_cast<uint16_t>(key));
+    out = put<uint8_t>(out, static_cast<uint8_t>(kind));
+    switch (kind) {
+      case TraceMetaData::Kind::INT: {
+        int64_t value = 0;
+        meta.getInt(key, value);
+        out = put<int64_t>(out, value);
+        break;
+      }
+      case TraceMetaData::Kind::DOUBLE: {
+        double value = 0;
+        meta.getDouble(key, value);
+        out = put<double>(out, value);
+        break;
+      }
+      case TraceMetaData::Kind::BOOL: {
+        bool value = false;
+        meta.getBool(key, value);
+        out = put<uint8_t>(out, value);
+        break;
+      }
+      case TraceMetaData::Kind::TIME: {
+        TimePoint value;
+        meta.getTime(key, value);
+        out = put<int64_t>(out, wallMicros(value));
+        break;
+      }
+      case TraceMetaData::Kind::STRING: {
+        folly::StringPiece value;
+        meta.getString(key, value);
+        out = put<uint32_t>(out, value.size());
+        memcpy(out, value.data(), value.size());
+        out += value.size();
+        break;
+      }
+    }
+  });
+
+  size_t size = out - begin;
+  put<uint32_t>(begin, size - 4);
+  DCHECK_EQ(size, encodedSize(event));
+  return size;
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <folly/ThreadLocal.h>
+#include <proxygen/lib/utils/AsyncLogWriter.h>
+#include <proxygen/lib/utils/TraceEventObserver.h>
+#include <string>
+
+namespace proxygen {
+
+/**
+ * A TraceEventObserver that keeps exporting traces off the request path.
+ * Each event is encoded straight into a buffer of the thread reporting
+ * it, and an AsyncLogWriter thread writes the full buffers to a file (or
+ * a FIFO or character device) in batches. Reporting never waits on I/O or
+ * on another thread. If the writer falls behind, events are dropped and
+ * counted rather than queued.
+ *
+ * Only one event in sampleRate is kept, per thread.
+ *
+ * Each record is, in host byte order:
+ *   u32  length of the rest of the record
+ *   u16  TraceEventType
+ *   u8   flags: 1 if started, 2 if ended
+ *   u32  id
+ *   u32  parent id
+ *   i64  start, i64 end: microseconds since the epoch, 0 if unset
+ *   u16  number of fields, then for each field:
+ *     u16  TraceFieldType
+ *     u8   TraceMetaData::Kind, then the value:
+ *          INT: i64; DOUBLE: f64; BOOL: u8;
+ *          TIME: i64 microseconds since the epoch;
+ *          STRING: u32 length, then the bytes
+ */
+class TraceEventExporter : public TraceEventObserver {
+ public:
+  explicit TraceEventExporter(
+    const std::string& path,
+    uint32_t sampleRate = 1,
+    size_t bufferSize = AsyncLogWriter::kDefaultBufferSize,
+    size_t maxPendingBuffers = AsyncLogWriter::kDefaultMaxPendingBuffers);
+
+  void traceEventAvailable(const TraceEvent& event) noexcept override;
+
+  /**
+   * Hand the events this thread encoded to the writer, see
+   * AsyncLogWriter::flush()
+   */
+  void flush() {
+    writer_.flush();
+  }
+
+  uint64_t getExported() const {
+    return exported_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t getSampledOut() const {
+    return sampledOut_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @return the number of sampled events dropped because the writer was
+   *         behind
+   */
+  uint64_t getDropped() const {
+    return writer_.getDropped();
+  }
+
+  /**
+   * The length of the record of event, and the encoding of it into out,
+   * which must have room for encodedSize(event) bytes
+   */
+  static size_t encodedSize(const TraceEvent& event);
+  static size_t encode(const TraceEvent& event, char* out);
+
+ private:
+  const uint32_t sampleRate_;
+  folly::ThreadLocal<uint32_t> sampleCounter_;
+  std::atomic<uint64_t> exported_{0};
+  std::atomic<uint64_t> sampledOut_{0};
+  AsyncLogWriter writer_;
+};
+
+}
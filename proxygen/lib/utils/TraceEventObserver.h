@@ -18,7 +18,8 @@ namespace proxygen {
  */
 struct TraceEventObserver {
   virtual ~TraceEventObserver() {}
-  virtual void traceEventAvailable(TraceEvent event) noexcept {}
+  // the event is only valid during the call; copy it to keep it
+  virtual void traceEventAvailable(const TraceEvent& event) noexcept {}
 };
 
 }
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/TraceMetaData.h>
+
+#include <cstring>
+#include <folly/Conv.h>
+#include <folly/json.h>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+const size_t TraceMetaData::kInlineSlots;
+
+void TraceMetaData::clear() {
+  present_.reset();
+  slots_.clear();
+  strings_.clear();
+}
+
+const TraceMetaData::Slot* TraceMetaData::find(TraceFieldType key) const {
+  if (!has(key)) {
+    return nullptr;
+  }
+  for (const auto& slot : slots_) {
+    if (slot.key == key) {
+      return &slot;
+    }
+  }
+  LOG(DFATAL) << "field present but has no slot";
+  return nullptr;
+}
+
+TraceMetaData::Slot& TraceMetaData::slotFor(TraceFieldType key) {
+  if (has(key)) {
+    return const_cast<Slot&>(*find(key));
+  }
+  present_.set(static_cast<size_t>(key));
+  slots_.emplace_back();
+  Slot& slot = slots_.back();
+  slot.key = key;
+  return slot;
+}
+
+void TraceMetaData::set(TraceFieldType key, bool value) {
+  Slot& slot = slotFor(key);
+  slot.kind = Kind::BOOL;
+  slot.b = value;
+}
+
+void TraceMetaData::setInt(TraceFieldType key, int64_t value) {
+  Slot& slot = slotFor(key);
+  slot.kind = Kind::INT;
+  slot.i = value;
+}
+
+void TraceMetaData::setDouble(TraceFieldType key, double value) {
+  Slot& slot = slotFor(key);
+  slot.kind = Kind::DOUBLE;
+  slot.d = value;
+}
+
+void TraceMetaData::set(TraceFieldType key, folly::StringPiece value) {
+  bool existed = has(key);
+  Slot& slot = slotFor(key);
+  if (existed && slot.kind == Kind::STRING &&
+      value.size() <= slot.str.size) {
+    // overwrite in place
+    memmove(&strings_[slot.str.offset], value.data(), value.size());
+    slot.str.size = value.size();
+    return;
+  }
+  slot.kind = Kind::STRING;
+  slot.str.offset = strings_.size();
+  slot.str.size = value.size();
+  strings_.append(value.data(), value.size());
+}
+
+void TraceMetaData::set(TraceFieldType key, TimePoint value) {
+  Slot& slot = slotFor(key);
+  slot.kind = Kind::TIME;
+  slot.ticks = value.time_since_epoch().count();
+}
+
+void TraceMetaData::set(TraceFieldType key, const folly::dynamic& value) {
+  if (value.isInt()) {
+    setInt(key, value.asInt());
+  } else if (value.isDouble()) {
+    setDouble(key, value.asDouble());
+  } else if (value.isBool()) {
+    set(key, value.asBool());
+  } else if (value.isString()) {
+    set(key, folly::StringPiece(value.data(), value.size()));
+  } else {
+    set(key, folly::StringPiece(folly::toJson(value)));
+  }
+}
+
+bool TraceMetaData::getInt(TraceFieldType key, int64_t& dest) const {
+  auto slot = find(key);
+  if (!slot || slot->kind != Kind::INT) {
+    return false;
+  }
+  dest = slot->i;
+  return true;
+}
+
+bool TraceMetaData::getDouble(TraceFieldType key, double& dest) const {
+  auto slot = find(key);
+  if (!slot || slot->kind != Kind::DOUBLE) {
+    return false;
+  }
+  dest = slot->d;
+  return true;
+}
+
+bool TraceMetaData::getBool(TraceFieldType key, bool& dest) const {
+  auto slot = find(key);
+  if (!slot || slot->kind != Kind::BOOL) {
+    return false;
+  }
+  dest = slot->b;
+  return true;
+}
+
+bool TraceMetaData::getString(TraceFieldType key,
+                              folly::StringPiece& dest) const {
+  auto slot = find(key);
+  if (!slot || slot->kind != Kind::STRING) {
+    return false;
+  }
+  dest.reset(strings_.data() + slot->str.offset, slot->str.size);
+  return true;
+}
+
+bool TraceMetaData::getTime(TraceFieldType key, TimePoint& dest) const {
+  auto slot = find(key);
+  if (!slot || slot->kind != Kind::TIME) {
+    return false;
+  }
+  dest = TimePoint(TimePoint::duration(slot->ticks));
+  return true;
+}
+
+bool TraceMetaData::format(TraceFieldType key, std::string& dest) const {
+  auto slot = find(key);
+  if (!slot) {
+    return false;
+  }
+  switch (slot->kind) {
+    case Kind::INT:
+      dest = folly::to<std::string>(slot->i);
+      break;
+    case Kind::DOUBLE:
+      dest = folly::to<std::string>(slot->d);
+      break;
+    case Kind::BOOL:
+      dest = slot->b ? "true" : "false";
+      break;
+    case Kind::STRING:
+      dest.assign(strings_, slot->str.offset, slot->str.size);
+      break;
+    case Kind::TIME:
+      dest = folly::to<std::string>(millisecondsSinceEpoch(
+        TimePoint(TimePoint::duration(slot->ticks))).count());
+      break;
+  }
+  return true;
+}
+
+TraceMetaData::Map TraceMetaData::toMap() const {
+  Map map;
+  for (const auto& slot : slots_) {
+    switch (slot.kind) {
+      case Kind::INT:
+        map.emplace(slot.key, slot.i);
+        break;
+      case Kind::DOUBLE:
+        map.emplace(slot.key, slot.d);
+        break;
+      case Kind::BOOL:
+        map.emplace(slot.key, slot.b);
+        break;
+      case Kind::STRING:
+        map.emplace(slot.key,
+                    strings_.substr(slot.str.offset, slot.str.size));
+        break;
+      case Kind::TIME:
+        map.emplace(slot.key, millisecondsSinceEpoch(
+          TimePoint(TimePoint::duration(slot.ticks))).count());
+        break;
+    }
+  }
+  return map;
+}
+
+void TraceMetaData::setFromMap(const Map& map) {
+  clear();
+  for (const auto& entry : map) {
+    set(entry.first, entry.second);
+  }
+}
+
+}
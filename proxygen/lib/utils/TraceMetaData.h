@@ -0,0 +1,154 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <bitset>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <folly/small_vector.h>
+#include <map>
+#include <proxygen/lib/utils/Time.h>
+#include <proxygen/lib/utils/TraceFieldType.h>
+#include <string>
+#include <type_traits>
+
+namespace proxygen {
+
+/**
+ * The metadata of a TraceEvent: at most one typed value per TraceFieldType.
+ *
+ * A presence bitmap answers lookups of absent fields without a search.
+ * Integers, doubles, bools and times live in fixed-size slots, the first
+ * kInlineSlots of them inside the object. String bytes go into a single
+ * arena string. Adding a field costs no allocation in the common case,
+ * and copying or moving the metadata moves a few flat buffers instead of
+ * a tree of folly::dynamic nodes.
+ */
+class TraceMetaData {
+ public:
+  typedef std::map<TraceFieldType, folly::dynamic> Map;
+
+  enum class Kind : uint8_t {
+    INT,
+    DOUBLE,
+    BOOL,
+    STRING,
+    TIME,
+  };
+
+  static const size_t kInlineSlots = 6;
+
+  bool has(TraceFieldType key) const {
+    return present_[static_cast<size_t>(key)];
+  }
+
+  size_t size() const {
+    return slots_.size();
+  }
+
+  bool empty() const {
+    return slots_.empty();
+  }
+
+  void clear();
+
+  /**
+   * Set the value of key, replacing any value it had, of any kind.
+   */
+  void set(TraceFieldType key, bool value);
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type
+  set(TraceFieldType key, T value) {
+    setInt(key, static_cast<int64_t>(value));
+  }
+  template <typename T>
+  typename std::enable_if<std::is_floating_point<T>::value>::type
+  set(TraceFieldType key, T value) {
+    setDouble(key, static_cast<double>(value));
+  }
+  void set(TraceFieldType key, folly::StringPiece value);
+  void set(TraceFieldType key, const std::string& value) {
+    set(key, folly::StringPiece(value));
+  }
+  void set(TraceFieldType key, const char* value) {
+    set(key, folly::StringPiece(value));
+  }
+  void set(TraceFieldType key, TimePoint value);
+  // ints, doubles, bools and strings keep their kind; anything else is
+  // stored as its JSON
+  void set(TraceFieldType key, const folly::dynamic& value);
+
+  void setInt(TraceFieldType key, int64_t value);
+  void setDouble(TraceFieldType key, double value);
+
+  /**
+   * Each getter returns false, leaving dest alone, if key is absent or
+   * holds another kind.
+   */
+  bool getInt(TraceFieldType key, int64_t& dest) const;
+  bool getDouble(TraceFieldType key, double& dest) const;
+  bool getBool(TraceFieldType key, bool& dest) const;
+  // dest points into the arena and is valid until the next change
+  bool getString(TraceFieldType key, folly::StringPiece& dest) const;
+  bool getTime(TraceFieldType key, TimePoint& dest) const;
+
+  /**
+   * Format the value of key, of any kind, into dest. Times are formatted
+   * as milliseconds since the epoch.
+   */
+  bool format(TraceFieldType key, std::string& dest) const;
+
+  /**
+   * Call fn(key, kind) for each field, in the order they were first set.
+   */
+  template <typename F>
+  void forEach(F fn) const {
+    for (const auto& slot : slots_) {
+      fn(slot.key, slot.kind);
+    }
+  }
+
+  /**
+   * The fields as folly::dynamics. This allocates; it is meant for
+   * callers that still want the old map representation.
+   */
+  Map toMap() const;
+
+  void setFromMap(const Map& map);
+
+ private:
+  struct Slot {
+    TraceFieldType key;
+    Kind kind;
+    union {
+      int64_t i;
+      double d;
+      bool b;
+      // time_since_epoch().count() of a TimePoint
+      TimePoint::rep ticks;
+      struct {
+        uint32_t offset;
+        uint32_t size;
+      } str;
+    };
+  };
+
+  const Slot* find(TraceFieldType key) const;
+  // the slot of key, created if absent
+  Slot& slotFor(TraceFieldType key);
+
+  std::bitset<kTraceFieldTypeCount> present_;
+  folly::small_vector<Slot, kInlineSlots> slots_;
+  // the bytes of all the string values; a replaced value that doesn't fit
+  // in place leaves its old bytes behind until clear()
+  std::string strings_;
+};
+
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/TscClock.h>
+
+#include <glog/logging.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define PROXYGEN_TSC_CLOCK 1
+#else
+#define PROXYGEN_TSC_CLOCK 0
+#endif
+
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+namespace proxygen {
+
+namespace {
+
+struct Calibration {
+  Calibration();
+
+  bool useTsc{false};
+  // the counter and the time when calibrated
+  uint64_t tsc0{0};
+  TimePoint time0;
+  // nanoseconds per tick, in 32.32 fixed point
+  uint64_t scale{0};
+};
+
+Calibration::Calibration() {
+#if PROXYGEN_TSC_CLOCK
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1 << 8))) {
+    LOG(INFO) << "No invariant TSC, TscClock is the steady clock";
+    return;
+  }
+  const auto start = getCurrentTime();
+  const uint64_t startTsc = __rdtsc();
+  auto end = start;
+  while (end - start < milliseconds(10)) {
+    end = getCurrentTime();
+  }
+  const uint64_t ticks = __rdtsc() - startTsc;
+  const uint64_t ns =
+    std::chrono::duration_cast<nanoseconds>(end - start).count();
+  if (ticks == 0) {
+    return;
+  }
+  scale = (ns << 32) / ticks;
+  tsc0 = startTsc;
+  time0 = start;
+  useTsc = true;
+  VLOG(2) << "TscClock at " << (ticks * 1000 / ns) << " ticks per us";
+#endif
+}
+
+const Calibration& getCalibration() {
+  static const Calibration calibration;
+  return calibration;
+}
+
+}
+
+TimePoint TscClock::now() {
+#if PROXYGEN_TSC_CLOCK
+  const auto& calibration = getCalibration();
+  if (calibration.useTsc) {
+    const uint64_t ticks = __rdtsc() - calibration.tsc0;
+    const uint64_t ns =
+      (static_cast<unsigned __int128>(ticks) * calibration.scale) >> 32;
+    return calibration.time0 +
+      std::chrono::duration_cast<ClockType::duration>(nanoseconds(ns));
+  }
+#endif
+  return getCurrentTime();
+}
+
+bool TscClock::isTscUsed() {
+  return getCalibration().useTsc;
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <proxygen/lib/utils/Time.h>
+
+namespace proxygen {
+
+/**
+ * A steady clock read from the time stamp counter of the CPU, to time
+ * short intervals precisely for less than getCurrentTime(): rdtsc takes a
+ * few nanoseconds, clock_gettime() 20 or more, and much more on the VMs
+ * that don't expose a vDSO clock.
+ *
+ * The counter is calibrated against getCurrentTime() once per process,
+ * in about 10 milliseconds on the first call, and converted with a
+ * multiply and a shift. The conversion may drift from getCurrentTime() by
+ * a few parts in 10^5 and doesn't follow NTP adjustments, so it is meant
+ * for durations of up to minutes, compared with other TscClock times.
+ *
+ * Without an invariant TSC, one that ticks at the same rate in all power
+ * states and on all cores, or off x86-64, it is getCurrentTime().
+ */
+class TscClock {
+ public:
+  static TimePoint now();
+
+  /**
+   * @return false if now() is getCurrentTime()
+   */
+  static bool isTscUsed();
+};
+
+/**
+ * The time from TscClock, see there for when to prefer it over
+ * getCurrentTime() and getLoopTime()
+ */
+inline TimePoint getPreciseTime() {
+  return TscClock::now();
+}
+
+/**
+ * A TimeUtil for getPreciseTime(), e.g. for TraceEvents
+ */
+class PreciseTimeUtil : public TimeUtil {
+ public:
+  TimePoint now() const override {
+    return getPreciseTime();
+  }
+};
+
+}
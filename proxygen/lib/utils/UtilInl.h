@@ -9,16 +9,64 @@
  */
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <folly/Range.h>
+#include <folly/io/IOBufQueue.h>
+#include <string>
 
 namespace proxygen {
 
-// Case-insensitive string comparison
+// Lower-cases the ASCII letters among the 8 bytes of w at once; other
+// bytes, including non-ASCII ones, are left alone
+inline uint64_t asciiToLower8(uint64_t w) {
+  const uint64_t kOnes = 0x0101010101010101ULL;
+  const uint64_t heptets = w & (0x7f * kOnes);
+  // the high bit of each byte says whether it is >= 'A', and > 'Z'
+  const uint64_t geA = heptets + (0x80 - 'A') * kOnes;
+  const uint64_t gtZ = heptets + (0x7f - 'Z') * kOnes;
+  const uint64_t upper = geA & ~gtZ & ~w & (0x80 * kOnes);
+  return w | (upper >> 2);
+}
+
+// Case-insensitive string comparison, 8 bytes at a time
 inline bool caseInsensitiveEqual(folly::StringPiece s, folly::StringPiece t) {
   if (s.size() != t.size()) {
     return false;
   }
-  return std::equal(s.begin(), s.end(), t.begin(), folly::asciiCaseInsensitive);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= s.size(); i += sizeof(uint64_t)) {
+    uint64_t a;
+    uint64_t b;
+    memcpy(&a, s.data() + i, sizeof(a));
+    memcpy(&b, t.data() + i, sizeof(b));
+    if (a != b && asciiToLower8(a) != asciiToLower8(b)) {
+      return false;
+    }
+  }
+  return std::equal(s.begin() + i, s.end(), t.begin() + i,
+                    folly::asciiCaseInsensitive);
+}
+
+// Bytes s allocated on the heap, 0 while it fits in the string itself
+inline size_t stringHeapBytes(const std::string& s) {
+  static const size_t kInlineCapacity = std::string().capacity();
+  return s.capacity() > kInlineCapacity ? s.capacity() + 1 : 0;
+}
+
+// Bytes allocated for the buffers of a chain, used or not
+inline size_t chainCapacity(const folly::IOBuf& chain) {
+  size_t capacity = 0;
+  const folly::IOBuf* buf = &chain;
+  do {
+    capacity += buf->capacity();
+    buf = buf->next();
+  } while (buf != &chain);
+  return capacity;
+}
+
+inline size_t chainCapacity(const folly::IOBufQueue& queue) {
+  return queue.front() ? chainCapacity(*queue.front()) : 0;
 }
 
 }
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/WorkStealingExecutor.h>
+
+#include <exception>
+#include <glog/logging.h>
+
+namespace proxygen {
+
+WorkStealingExecutor::WorkStealingExecutor(
+    const std::vector<folly::EventBase*>& eventBases,
+    size_t threadsPerBase) {
+  CHECK(!eventBases.empty());
+  CHECK_GT(threadsPerBase, 0);
+  for (auto eventBase: eventBases) {
+    CHECK(eventBase);
+    CHECK(queueByBase_.find(eventBase) == queueByBase_.end());
+    queues_.emplace_back(new Queue(eventBase));
+    queueByBase_[eventBase] = queues_.back().get();
+  }
+  for (size_t i = 0; i < queues_.size() * threadsPerBase; i++) {
+    size_t home = i % queues_.size();
+    threads_.emplace_back([this, home] { worker(home); });
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    stopping_ = true;
+  }
+  idleCond_.notify_all();
+  for (auto& thread: threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingExecutor::add(folly::EventBase* eventBase, Task task) {
+  auto it = queueByBase_.find(eventBase);
+  CHECK(it != queueByBase_.end());
+  {
+    std::lock_guard<std::mutex> lock(it->second->mutex);
+    it->second->tasks.push_back(std::move(task));
+    pending_++;
+  }
+  // a thread that counted itself idle either sees the task or is waiting
+  // by the time we have the lock, so the wakeup can't be lost
+  if (idle_ > 0) {
+    { std::lock_guard<std::mutex> lock(idleMutex_); }
+    idleCond_.notify_one();
+  }
+}
+
+bool WorkStealingExecutor::take(size_t home, Task& task, Queue*& from) {
+  for (size_t i = 0; i < queues_.size(); i++) {
+    Queue* queue = queues_[(home + i) % queues_.size()].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->tasks.empty()) {
+      continue;
+    }
+    // the owner takes the oldest task, thieves the newest, so that they
+    // rarely want the same one
+    if (i == 0) {
+      task = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+    } else {
+      task = std::move(queue->tasks.back());
+      queue->tasks.pop_back();
+      stolen_++;
+    }
+    pending_--;
+    from = queue;
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingExecutor::worker(size_t home) {
+  while (!stopping_) {
+    Task task;
+    Queue* from = nullptr;
+    if (!take(home, task, from)) {
+      std::unique_lock<std::mutex> lock(idleMutex_);
+      idle_++;
+      idleCond_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+      idle_--;
+      continue;
+    }
+
+    Callback cb;
+    try {
+      cb = task();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "WorkStealingExecutor task threw: " << ex.what();
+      continue;
+    }
+    if (cb) {
+      CompletionQueue::post(from->completions, std::move(cb));
+    }
+  }
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <folly/io/async/EventBase.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/utils/CompletionQueue.h>
+#include <thread>
+#include <vector>
+
+namespace proxygen {
+
+/**
+ * Pool of threads for the CPU heavy work of a fixed set of EventBase
+ * threads, such as the RequestWorkers of a Service, that balances the
+ * load between them.
+ *
+ * Each EventBase has its own deque of tasks, and its own threads in the
+ * pool that take from the front of it. A pool thread whose deque is
+ * empty steals from the back of the others, so that an EventBase with
+ * expensive requests borrows the threads of the idle ones instead of
+ * queueing behind its own. As with CPUExecutor, the callback a task
+ * returns runs in the thread of the EventBase that added the task.
+ *
+ * Each deque has its own lock, so adding and taking tasks only contends
+ * with the threads of the same EventBase, and with thieves.
+ */
+class WorkStealingExecutor {
+ public:
+  typedef CompletionQueue::Callback Callback;
+  typedef std::function<Callback()> Task;
+
+  /**
+   * @param eventBases     the EventBases that may add tasks; they must
+   *                       outlive the callbacks
+   * @param threadsPerBase the pool threads whose home is the deque of each
+   *                       EventBase
+   */
+  explicit WorkStealingExecutor(
+    const std::vector<folly::EventBase*>& eventBases,
+    size_t threadsPerBase = 1);
+
+  /**
+   * Waits for the tasks that are running to finish. The tasks that
+   * haven't started are dropped, and their callbacks never run.
+   */
+  ~WorkStealingExecutor();
+
+  /**
+   * Run task on a thread of the pool, and the callback it returns, if
+   * any, in the thread of eventBase, which must be one of those the
+   * executor was created with. Can be called from any thread.
+   */
+  void add(folly::EventBase* eventBase, Task task);
+
+  size_t getNumThreads() const {
+    return threads_.size();
+  }
+
+  /**
+   * @return the number of tasks that haven't started
+   */
+  size_t getNumPending() const {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @return the number of tasks that ran on a thread of another EventBase
+   *         than the one that added them
+   */
+  uint64_t getNumStolen() const {
+    return stolen_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Queue {
+    explicit Queue(folly::EventBase* eventBase):
+        completions(std::make_shared<CompletionQueue>(eventBase)) {}
+
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::shared_ptr<CompletionQueue> completions;
+  };
+
+  void worker(size_t home);
+
+  /**
+   * Take a task from the front of the home deque, or else from the back
+   * of another one
+   *
+   * @return false if all of them were empty
+   */
+  bool take(size_t home, Task& task, Queue*& from);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::map<folly::EventBase*, Queue*> queueByBase_;
+
+  // tasks in all the deques, for the idle threads to wait on
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> idle_{0};
+  std::atomic<uint64_t> stolen_{0};
+  std::atomic<bool> stopping_{false};
+  std::mutex idleMutex_;
+  std::condition_variable idleCond_;
+  std::vector<std::thread> threads_;
+};
+
+}
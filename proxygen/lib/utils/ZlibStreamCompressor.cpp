@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+#include <vector>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using std::unique_ptr;
+
+namespace proxygen {
+
+namespace {
+
+const size_t kMinOutput = 1024;
+const size_t kOutputAllocation = 16 * 1024;
+
+struct Pool {
+  std::vector<ZlibStreamCompressor::UniquePtr> free[3];
+};
+
+Pool& getPool() {
+  static folly::ThreadLocal<Pool> pool;
+  return *pool;
+}
+
+size_t index(ZlibStreamCompressor::Type type) {
+  return static_cast<size_t>(type);
+}
+
+}
+
+const size_t ZlibStreamCompressor::kMaxPooled;
+
+ZlibStreamCompressor::UniquePtr ZlibStreamCompressor::acquire(Type type,
+                                                              int level) {
+  auto& free = getPool().free[index(type)];
+  if (!free.empty()) {
+    auto compressor = std::move(free.back());
+    free.pop_back();
+    compressor->reset(level);
+    return compressor;
+  }
+  return UniquePtr(new ZlibStreamCompressor(type, level));
+}
+
+void ZlibStreamCompressor::release(UniquePtr compressor) {
+  if (!compressor || compressor->error_) {
+    return;
+  }
+  auto& free = getPool().free[index(compressor->type_)];
+  if (free.size() < kMaxPooled) {
+    free.push_back(std::move(compressor));
+  }
+}
+
+ZlibStreamCompressor::ZlibStreamCompressor(Type type, int level):
+    type_(type) {
+  stream_.zalloc = Z_NULL;
+  stream_.zfree = Z_NULL;
+  stream_.opaque = Z_NULL;
+  stream_.avail_in = 0;
+  stream_.next_in = Z_NULL;
+  // 16 more window bits ask for the gzip header and trailer, negative
+  // ones for neither a header nor a trailer
+  int windowBits = 15;
+  if (type == Type::GZIP) {
+    windowBits += 16;
+  } else if (type == Type::RAW) {
+    windowBits = -windowBits;
+  }
+  int r = deflateInit2(&stream_, level, Z_DEFLATED, windowBits,
+                       8, // memory size for internal compression state
+                       Z_DEFAULT_STRATEGY);
+  CHECK(r == Z_OK);
+}
+
+ZlibStreamCompressor::~ZlibStreamCompressor() {
+  deflateEnd(&stream_);
+}
+
+void ZlibStreamCompressor::reset(int level) {
+  int r = deflateReset(&stream_);
+  CHECK(r == Z_OK);
+  // nothing was compressed since the reset, so this doesn't flush
+  r = deflateParams(&stream_, level, Z_DEFAULT_STRATEGY);
+  CHECK(r == Z_OK);
+  error_ = false;
+}
+
+unique_ptr<IOBuf> ZlibStreamCompressor::compress(const IOBuf* in, int flush) {
+  if (error_) {
+    return nullptr;
+  }
+  IOBufQueue out(IOBufQueue::cacheChainLength());
+  if (in) {
+    const IOBuf* buf = in;
+    do {
+      if (buf->length() > 0 &&
+          !deflateBuf(buf->data(), buf->length(), Z_NO_FLUSH, out)) {
+        return nullptr;
+      }
+      buf = buf->next();
+    } while (buf != in);
+  }
+  if (flush != Z_NO_FLUSH && !deflateBuf(nullptr, 0, flush, out)) {
+    return nullptr;
+  }
+  auto result = out.move();
+  return result ? std::move(result) : IOBuf::create(0);
+}
+
+bool ZlibStreamCompressor::deflateBuf(const uint8_t* data, size_t length,
+                                      int flush, IOBufQueue& out) {
+  stream_.next_in = const_cast<uint8_t*>(data);
+  stream_.avail_in = length;
+  do {
+    auto writable = out.preallocate(kMinOutput, kOutputAllocation);
+    stream_.next_out = static_cast<uint8_t*>(writable.first);
+    stream_.avail_out = writable.second;
+    int r = deflate(&stream_, flush);
+    // Z_BUF_ERROR only says there was nothing to do
+    if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+      LOG(ERROR) << "deflate failed: " << r;
+      error_ = true;
+      return false;
+    }
+    out.postallocate(writable.second - stream_.avail_out);
+  } while (stream_.avail_out == 0);
+  return true;
+}
+
+}
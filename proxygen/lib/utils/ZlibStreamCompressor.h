@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <memory>
+#include <zlib.h>
+
+namespace proxygen {
+
+/**
+ * Compresses a stream of IOBufs with zlib, in the gzip or the zlib
+ * ("deflate") format, or as raw deflate data without a header, as the
+ * permessage-deflate of WebSockets wants. Compressors are pooled per thread: acquire() resets
+ * one that was released by an earlier stream instead of allocating the
+ * zlib state again.
+ */
+class ZlibStreamCompressor {
+ public:
+  enum class Type {
+    GZIP,
+    DEFLATE,
+    RAW,
+  };
+
+  typedef std::unique_ptr<ZlibStreamCompressor> UniquePtr;
+
+  // released compressors kept by each thread, for each type
+  static const size_t kMaxPooled = 32;
+
+  /**
+   * @return a compressor for a new stream, from the pool of this thread
+   *         if it has one
+   */
+  static UniquePtr acquire(Type type, int level);
+
+  /**
+   * Give compressor back to the pool of this thread, once its stream is
+   * done or abandoned
+   */
+  static void release(UniquePtr compressor);
+
+  ZlibStreamCompressor(Type type, int level);
+  ~ZlibStreamCompressor();
+
+  /**
+   * Compress in, which may be nullptr, and flush as zlib's flush says:
+   * Z_NO_FLUSH, Z_SYNC_FLUSH to send what was compressed so far, or
+   * Z_FINISH to end the stream.
+   *
+   * @return the compressed bytes, possibly none, or nullptr on error
+   */
+  std::unique_ptr<folly::IOBuf> compress(const folly::IOBuf* in, int flush);
+
+  Type getType() const {
+    return type_;
+  }
+
+  bool hasError() const {
+    return error_;
+  }
+
+ private:
+  void reset(int level);
+  bool deflateBuf(const uint8_t* data, size_t length, int flush,
+                  folly::IOBufQueue& out);
+
+  const Type type_;
+  z_stream stream_;
+  bool error_{false};
+};
+
+}
@@ -98,6 +98,7 @@ def gen_cpp_header(items, class_name, install_dir, output_scope):
         outf.write('// Copyright 2004-present Facebook. All Rights Reserved.\n')
         outf.write('// ** AUTOGENERATED FILE. DO NOT HAND-EDIT **\n\n')
         outf.write('#pragma once\n\n')
+        outf.write('#include <cstddef>\n')
         outf.write('#include <string>\n\n')
         for ns in namespaces:
             outf.write('namespace %s { ' % ns)
@@ -109,6 +110,10 @@ def gen_cpp_header(items, class_name, install_dir, output_scope):
             outf.write('    %s,\n' % item[0])
         outf.write('};\n\n')
 
+        # the values are 0..count-1, so they can index a bitset or array
+        outf.write('constexpr size_t k%sCount = %d;\n\n'
+                   % (class_name, len(items)))
+
         # enum to string convert function
         outf.write('extern const std::string& get%sString(%s);\n'
                    % (class_name, class_name))
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/AsyncLogWriter.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace proxygen;
+
+namespace {
+
+std::string makeTempPath() {
+  char path[] = "/tmp/AsyncLogWriterTestXXXXXX";
+  int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  close(fd);
+  return path;
+}
+
+bool appendLine(AsyncLogWriter& writer, const std::string& line) {
+  return writer.append(line.size() + 1, [&] (char* dst) {
+      memcpy(dst, line.data(), line.size());
+      dst[line.size()] = '\n';
+      return line.size() + 1;
+    });
+}
+
+}
+
+TEST(AsyncLogWriterTest, WritesFromThreads) {
+  auto path = makeTempPath();
+  {
+    AsyncLogWriter writer(path, 256);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+      threads.emplace_back([&writer, i] {
+          for (int j = 0; j < 1000; j++) {
+            EXPECT_TRUE(appendLine(writer, "thread " + std::to_string(i)));
+          }
+          writer.flush();
+        });
+    }
+    for (auto& thread: threads) {
+      thread.join();
+    }
+    // bigger than a buffer
+    EXPECT_TRUE(appendLine(writer, std::string(1000, 'x')));
+    writer.flush();
+  }
+
+  std::ifstream file(path);
+  std::string line;
+  std::map<std::string, int> lines;
+  while (std::getline(file, line)) {
+    lines[line]++;
+  }
+  EXPECT_EQ(5, lines.size());
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(1000, lines["thread " + std::to_string(i)]);
+  }
+  EXPECT_EQ(1, lines[std::string(1000, 'x')]);
+  unlink(path.c_str());
+}
+
+TEST(AsyncLogWriterTest, KeepsUnflushedUntilFull) {
+  auto path = makeTempPath();
+  AsyncLogWriter writer(path, 4096, 16, std::chrono::milliseconds(60000));
+  EXPECT_TRUE(appendLine(writer, "first"));
+  usleep(20000);
+  EXPECT_EQ(0, writer.getBytesWritten());
+  writer.flush();
+  for (int i = 0; i < 100 && writer.getBytesWritten() == 0; i++) {
+    usleep(10000);
+  }
+  EXPECT_EQ(6, writer.getBytesWritten());
+  EXPECT_EQ(0, writer.getDropped());
+  unlink(path.c_str());
+}
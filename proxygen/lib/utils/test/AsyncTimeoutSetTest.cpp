@@ -349,3 +349,41 @@ TEST(TimeoutSet, AtMostEveryN) {
     }
   }
 }
+
+/*
+ * Test timeout sets that share an HHWheelTimer, with the interval and with
+ * other timeouts
+ */
+TEST(TimeoutSet, WheelTimer) {
+  folly::EventBase eventBase;
+  folly::UndelayedDestruction<HHWheelTimer> wheel(&eventBase);
+  StackTimeoutSet ts5(&wheel, milliseconds(5));
+  StackTimeoutSet ts10(&wheel, milliseconds(10));
+  ASSERT_EQ(ts5.getWheelTimer(), &wheel);
+  const AsyncTimeoutSet::Callback* nullCallback = nullptr;
+
+  TestTimeout t1(&ts10, &ts5);
+  TestTimeout t2;
+  TestTimeout t3;
+  ts10.scheduleTimeout(&t2, milliseconds(20));
+  ts5.scheduleTimeout(&t3);
+  ASSERT_EQ(wheel.count(), 3);
+  ASSERT_EQ(ts10.front(), &t1);
+
+  folly::TimePoint start;
+  eventBase.loop();
+  folly::TimePoint end;
+
+  ASSERT_EQ(t1.timestamps.size(), 2);
+  ASSERT_EQ(t2.timestamps.size(), 1);
+  ASSERT_EQ(t3.timestamps.size(), 1);
+  ASSERT_FALSE(t2.isScheduled());
+  ASSERT_EQ(ts10.front(), nullCallback);
+  ASSERT_EQ(wheel.count(), 0);
+
+  T_CHECK_TIMEOUT(start, t1.timestamps[0], milliseconds(10));
+  T_CHECK_TIMEOUT(t1.timestamps[0], t1.timestamps[1], milliseconds(5));
+  T_CHECK_TIMEOUT(start, t2.timestamps[0], milliseconds(20));
+  T_CHECK_TIMEOUT(start, t3.timestamps[0], milliseconds(5));
+  T_CHECK_TIMEOUT(start, end, milliseconds(20));
+}
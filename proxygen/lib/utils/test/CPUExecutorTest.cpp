@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <atomic>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/CPUExecutor.h>
+#include <proxygen/lib/utils/MPSCQueue.h>
+#include <thread>
+#include <vector>
+
+using namespace proxygen;
+
+TEST(MPSCQueueTest, PopsInOrder) {
+  MPSCQueue<int> queue;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.push(1));
+  EXPECT_FALSE(queue.push(2));
+  EXPECT_FALSE(queue.push(3));
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), queue.popAll());
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.popAll().empty());
+  EXPECT_TRUE(queue.push(4));
+}
+
+TEST(MPSCQueueTest, ManyProducers) {
+  const int kProducers = 4;
+  const int kPerProducer = 10000;
+  MPSCQueue<int> queue;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([&queue, p] {
+        for (int i = 0; i < kPerProducer; i++) {
+          queue.push(p * kPerProducer + i);
+        }
+      });
+  }
+
+  // each producer's values come out in the order it pushed them
+  std::vector<int> last(kProducers, -1);
+  int popped = 0;
+  while (popped < kProducers * kPerProducer) {
+    for (int value: queue.popAll()) {
+      int p = value / kPerProducer;
+      EXPECT_LT(last[p], value);
+      last[p] = value;
+      popped++;
+    }
+  }
+  for (auto& producer: producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(CPUExecutorTest, RunsCallbacksInEventBase) {
+  const int kTasks = 100;
+  folly::EventBase evb;
+  CPUExecutor executor(4);
+  std::atomic<int> ran{0};
+  int done = 0;
+  for (int i = 0; i < kTasks; i++) {
+    executor.add(&evb, [&] () -> CPUExecutor::Callback {
+        EXPECT_FALSE(evb.isInEventBaseThread());
+        ran++;
+        return [&] {
+          EXPECT_TRUE(evb.isInEventBaseThread());
+          if (++done == kTasks) {
+            evb.terminateLoopSoon();
+          }
+        };
+      });
+  }
+  evb.loopForever();
+  EXPECT_EQ(kTasks, ran);
+  EXPECT_EQ(kTasks, done);
+}
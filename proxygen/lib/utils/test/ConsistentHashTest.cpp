@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/ConsistentHash.h>
+
+using namespace proxygen;
+
+TEST(ConsistentHashTest, Empty) {
+  ConsistentHash ring;
+  EXPECT_EQ(ConsistentHash::kNoNode, ring.getNode("/a"));
+}
+
+TEST(ConsistentHashTest, SpreadsKeys) {
+  ConsistentHash ring;
+  for (int i = 0; i < 4; i++) {
+    ring.addNode(folly::to<std::string>("10.0.0.", i, ":80"));
+  }
+  EXPECT_EQ(4 * ConsistentHash::kDefaultVirtualNodes, ring.getNumPoints());
+  size_t counts[4] = {0};
+  for (int i = 0; i < 40000; i++) {
+    size_t node = ring.getNode(folly::to<std::string>("/object/", i));
+    ASSERT_LT(node, 4);
+    counts[node]++;
+  }
+  for (auto count: counts) {
+    // a quarter each, give or take
+    EXPECT_GT(count, 7000);
+    EXPECT_LT(count, 13000);
+  }
+}
+
+TEST(ConsistentHashTest, SameNodesSameMapping) {
+  ConsistentHash ring1;
+  ring1.addNode("a");
+  ring1.addNode("b");
+  ring1.addNode("c");
+  ConsistentHash ring2;
+  ring2.addNode("c");
+  ring2.addNode("a");
+  ring2.addNode("b");
+  for (int i = 0; i < 1000; i++) {
+    auto key = folly::to<std::string>("/object/", i);
+    EXPECT_EQ(ring1.getName(ring1.getNode(key)),
+              ring2.getName(ring2.getNode(key)));
+  }
+}
+
+TEST(ConsistentHashTest, RemovingANodeOnlyMovesItsKeys) {
+  ConsistentHash ring;
+  ring.addNode("a");
+  ring.addNode("b");
+  ring.addNode("c");
+  std::vector<std::string> before;
+  for (int i = 0; i < 1000; i++) {
+    auto key = folly::to<std::string>("/object/", i);
+    before.push_back(ring.getName(ring.getNode(key)));
+  }
+  EXPECT_TRUE(ring.removeNode("b"));
+  EXPECT_FALSE(ring.removeNode("b"));
+  EXPECT_FALSE(ring.removeNode("d"));
+  for (int i = 0; i < 1000; i++) {
+    auto key = folly::to<std::string>("/object/", i);
+    auto owner = ring.getName(ring.getNode(key));
+    EXPECT_NE("b", owner);
+    if (before[i] != "b") {
+      EXPECT_EQ(before[i], owner);
+    }
+  }
+
+  // back again, with the same keys as before
+  ring.addNode("b");
+  for (int i = 0; i < 1000; i++) {
+    auto key = folly::to<std::string>("/object/", i);
+    EXPECT_EQ(before[i], ring.getName(ring.getNode(key)));
+  }
+}
+
+TEST(ConsistentHashTest, Weight) {
+  ConsistentHash ring(100);
+  ring.addNode("small");
+  ring.addNode("big", 3);
+  EXPECT_EQ(400, ring.getNumPoints());
+  size_t big = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (ring.getName(ring.getNode(folly::to<std::string>(i))) == "big") {
+      big++;
+    }
+  }
+  EXPECT_GT(big, 6500);
+  EXPECT_LT(big, 8500);
+}
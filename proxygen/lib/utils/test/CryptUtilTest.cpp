@@ -7,9 +7,11 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <folly/io/IOBuf.h>
 #include <gtest/gtest.h>
 #include <proxygen/lib/utils/CryptUtil.h>
 #include <string>
+#include <vector>
 
 using namespace proxygen;
 
@@ -34,6 +36,75 @@ TEST(CryptUtilTest, Base64EncodeTest) {
           reinterpret_cast<const unsigned char*>("Aladdin:open sesame"), 19)));
 }
 
+TEST(CryptUtilTest, Base64UrlDecodeTest) {
+  std::string out;
+  ASSERT_TRUE(base64UrlDecode("", out));
+  ASSERT_EQ("", out);
+  ASSERT_TRUE(base64UrlDecode("YQ", out));
+  ASSERT_EQ("a", out);
+  ASSERT_TRUE(base64UrlDecode("YWE=", out));
+  ASSERT_EQ("aa", out);
+  ASSERT_TRUE(base64UrlDecode("QWxhZGRpbjpvcGVuIHNlc2FtZQ", out));
+  ASSERT_EQ("Aladdin:open sesame", out);
+  ASSERT_TRUE(base64UrlDecode("-_8", out));
+  ASSERT_EQ(std::string("\xfb\xff"), out);
+  ASSERT_TRUE(base64UrlDecode("AAMAAABkAAQAAP__", out));
+  ASSERT_EQ(std::string("\x00\x03\x00\x00\x00\x64\x00\x04\x00\x00\xff\xff",
+                        12), out);
+
+  ASSERT_FALSE(base64UrlDecode("YW+=", out));
+  ASSERT_FALSE(base64UrlDecode("YW/=", out));
+  ASSERT_FALSE(base64UrlDecode("Y", out));
+  ASSERT_FALSE(base64UrlDecode("Y===", out));
+  ASSERT_FALSE(base64UrlDecode("Y W", out));
+}
+
+TEST(CryptUtilTest, Base64DecodeTest) {
+  std::string out;
+  ASSERT_TRUE(base64Decode("QWxhZGRpbjpvcGVuIHNlc2FtZQ==", out));
+  ASSERT_EQ("Aladdin:open sesame", out);
+  ASSERT_TRUE(base64Decode("+/8", out));
+  ASSERT_EQ(std::string("\xfb\xff"), out);
+
+  ASSERT_FALSE(base64Decode("-_8=", out));
+  ASSERT_FALSE(base64Decode("QWxhZGRpbjpvcGVuIHNlc2FtZQ=\n", out));
+}
+
+TEST(CryptUtilTest, Base64RoundTripTest) {
+  // long enough for the vectorized loops, and every length of tail
+  std::string text;
+  for (int i = 0; i < 100; i++) {
+    text.push_back(char(i * 37));
+    ByteRange bytes(reinterpret_cast<const unsigned char*>(text.data()),
+                    text.size());
+    std::string encoded(base64EncodedSize(text.size()), '\0');
+    size_t size = base64Encode(bytes, &encoded[0]);
+    ASSERT_EQ(base64EncodedSize(text.size()), size);
+    ASSERT_EQ(base64Encode(bytes), encoded);
+
+    std::vector<uint8_t> decoded(base64DecodedMaxSize(size));
+    size_t decodedSize = 0;
+    ASSERT_TRUE(base64Decode(encoded, decoded.data(), decodedSize));
+    ASSERT_EQ(text, std::string(reinterpret_cast<char*>(decoded.data()),
+                                decodedSize));
+    if (size > 4) {
+      encoded[size / 2] = '.';
+      ASSERT_FALSE(base64Decode(encoded, decoded.data(), decodedSize));
+    }
+  }
+}
+
+TEST(CryptUtilTest, SHA1DigestTest) {
+  auto digest = sha1Digest(
+    ByteRange(reinterpret_cast<const unsigned char*>("abc"), 3));
+  ASSERT_EQ(20, digest.size());
+  ASSERT_EQ("qZk+NkcGgWq6PiVxeFDCbJzQ2J0=",
+            base64Encode(
+              ByteRange(
+                reinterpret_cast<const unsigned char*>(digest.data()),
+                digest.size())));
+}
+
 TEST(CryptUtilTest, MD5EncodeTest) {
   ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e",
             md5Encode(
@@ -46,3 +117,29 @@ TEST(CryptUtilTest, MD5EncodeTest) {
                 reinterpret_cast<const unsigned char*>("Aladdin:open sesame"),
                 19)));
 }
+
+TEST(CryptUtilTest, StreamingDigestTest) {
+  auto chain = folly::IOBuf::copyBuffer("Aladdin:");
+  chain->prependChain(folly::IOBuf::copyBuffer("open "));
+  chain->prependChain(folly::IOBuf::copyBuffer("sesame"));
+
+  StreamingDigest md5(StreamingDigest::Type::MD5);
+  md5.update(*chain);
+  ASSERT_EQ("a7a93b8ac14a48faa68e4afb57b00fc7", md5.finishHex());
+  // starts over
+  ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e", md5.finishHex());
+
+  StreamingDigest sha256(StreamingDigest::Type::SHA256);
+  sha256.update(ByteRange(reinterpret_cast<const unsigned char*>("abc"), 3));
+  ASSERT_EQ("ba7816bf8f01cfea414140de5dae2223"
+            "b00361a396177a9cb410ff61f20015ad", sha256.finishHex());
+
+  // the same however the data is split
+  StreamingDigest spooky(StreamingDigest::Type::SPOOKY);
+  spooky.update(*chain);
+  auto whole = spooky.finish();
+  ASSERT_EQ(16, whole.size());
+  chain->coalesce();
+  spooky.update(ByteRange(chain->data(), chain->length()));
+  ASSERT_EQ(whole, spooky.finish());
+}
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/test/UndelayedDestruction.h>
+#include <folly/io/async/test/Util.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/HHWheelTimer.h>
+#include <vector>
+
+using namespace proxygen;
+
+using std::chrono::milliseconds;
+
+typedef folly::UndelayedDestruction<HHWheelTimer> StackWheelTimer;
+
+class TestTimeout : public HHWheelTimer::Callback {
+ public:
+  virtual void timeoutExpired() noexcept {
+    timestamps.emplace_back();
+    if (fn) {
+      fn();
+    }
+  }
+
+  std::deque<folly::TimePoint> timestamps;
+  std::function<void()> fn;
+};
+
+/*
+ * Test callbacks with different timeouts in the same wheel
+ */
+TEST(HHWheelTimer, FireOnce) {
+  folly::EventBase eventBase;
+  StackWheelTimer t(&eventBase);
+
+  TestTimeout t5;
+  TestTimeout t10;
+  TestTimeout t20;
+  t.scheduleTimeout(&t20, milliseconds(20));
+  t.scheduleTimeout(&t5, milliseconds(5));
+  t.scheduleTimeout(&t10, milliseconds(10));
+  ASSERT_EQ(t.count(), 3);
+
+  folly::TimePoint start;
+  eventBase.loop();
+  folly::TimePoint end;
+
+  ASSERT_EQ(t5.timestamps.size(), 1);
+  ASSERT_EQ(t10.timestamps.size(), 1);
+  ASSERT_EQ(t20.timestamps.size(), 1);
+  ASSERT_EQ(t.count(), 0);
+
+  T_CHECK_TIMEOUT(start, t5.timestamps[0], milliseconds(5));
+  T_CHECK_TIMEOUT(start, t10.timestamps[0], milliseconds(10));
+  T_CHECK_TIMEOUT(start, t20.timestamps[0], milliseconds(20));
+  T_CHECK_TIMEOUT(start, end, milliseconds(20));
+}
+
+/*
+ * Test timeouts that move down the levels of the wheel
+ */
+TEST(HHWheelTimer, Cascade) {
+  folly::EventBase eventBase;
+  StackWheelTimer t(&eventBase);
+
+  TestTimeout t300;
+  TestTimeout t600;
+  t.scheduleTimeout(&t600, milliseconds(600));
+  t.scheduleTimeout(&t300, milliseconds(300));
+
+  folly::TimePoint start;
+  eventBase.loop();
+
+  ASSERT_EQ(t300.timestamps.size(), 1);
+  ASSERT_EQ(t600.timestamps.size(), 1);
+  T_CHECK_TIMEOUT(start, t300.timestamps[0], milliseconds(300));
+  T_CHECK_TIMEOUT(start, t600.timestamps[0], milliseconds(600));
+}
+
+/*
+ * Test cancelling and rescheduling callbacks, from callbacks too
+ */
+TEST(HHWheelTimer, CancelTimeout) {
+  folly::EventBase eventBase;
+  StackWheelTimer t(&eventBase);
+
+  TestTimeout t5_1;
+  TestTimeout t5_2;
+  TestTimeout t10;
+  TestTimeout t20;
+  t.scheduleTimeout(&t5_1, milliseconds(5));
+  t.scheduleTimeout(&t5_2, milliseconds(5));
+  t.scheduleTimeout(&t10, milliseconds(10));
+  t.scheduleTimeout(&t20, milliseconds(20));
+
+  // t5_1 cancels t5_2 in the same slot, and t20 in another one, then
+  // reschedules itself
+  t5_1.fn = [&] {
+    t5_2.cancelTimeout();
+    t20.cancelTimeout();
+    auto fn = std::move(t5_1.fn);
+    t.scheduleTimeout(&t5_1, milliseconds(10));
+  };
+  t10.cancelTimeout();
+  ASSERT_FALSE(t10.isScheduled());
+
+  folly::TimePoint start;
+  eventBase.loop();
+  folly::TimePoint end;
+
+  ASSERT_EQ(t5_1.timestamps.size(), 2);
+  T_CHECK_TIMEOUT(start, t5_1.timestamps[0], milliseconds(5));
+  T_CHECK_TIMEOUT(t5_1.timestamps[0], t5_1.timestamps[1], milliseconds(10));
+  ASSERT_EQ(t5_2.timestamps.size(), 0);
+  ASSERT_EQ(t10.timestamps.size(), 0);
+  ASSERT_EQ(t20.timestamps.size(), 0);
+  T_CHECK_TIMEOUT(start, end, milliseconds(15));
+}
+
+/*
+ * Test destroying a wheel with callbacks outstanding, from a callback
+ */
+TEST(HHWheelTimer, DestroyTimer) {
+  folly::EventBase eventBase;
+  HHWheelTimer::UniquePtr t(new HHWheelTimer(&eventBase));
+
+  TestTimeout t5_1;
+  TestTimeout t5_2;
+  TestTimeout t10;
+  t.get()->scheduleTimeout(&t5_1, milliseconds(5));
+  t.get()->scheduleTimeout(&t5_2, milliseconds(5));
+  t.get()->scheduleTimeout(&t10, milliseconds(10));
+  t5_1.fn = [&] { t.reset(); };
+
+  folly::TimePoint start;
+  eventBase.loop();
+  folly::TimePoint end;
+
+  ASSERT_EQ(t5_1.timestamps.size(), 1);
+  ASSERT_EQ(t5_2.timestamps.size(), 0);
+  ASSERT_EQ(t10.timestamps.size(), 0);
+  ASSERT_FALSE(t5_2.isScheduled());
+  T_CHECK_TIMEOUT(start, end, milliseconds(5));
+}
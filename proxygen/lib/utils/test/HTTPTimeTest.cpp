@@ -10,6 +10,8 @@
 #include <gtest/gtest.h>
 #include <proxygen/lib/utils/HTTPTime.h>
 
+using proxygen::formatHTTPDateTime;
+using proxygen::getCachedHTTPDateTime;
 using proxygen::parseHTTPDateTime;
 
 TEST(HTTPTimeTests, InvalidTimeTest) {
@@ -51,3 +53,40 @@ TEST(HTTPTimeTests, ReallyOldTimeTest) {
   EXPECT_LT(a, c);
   EXPECT_LT(b, c);
 }
+
+TEST(HTTPTimeTests, FormatTimeTest) {
+  EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", formatHTTPDateTime(784111777));
+  auto t = parseHTTPDateTime(formatHTTPDateTime(784111777));
+  EXPECT_TRUE(t.hasValue());
+}
+
+TEST(HTTPTimeTests, CachedTimeTest) {
+  const std::string& a = getCachedHTTPDateTime();
+  EXPECT_TRUE(parseHTTPDateTime(a).hasValue());
+  // Same thread gets the same cached object back
+  EXPECT_EQ(&a, &getCachedHTTPDateTime());
+}
+
+TEST(HTTPTimeTests, FixdateIsUTCTest) {
+  auto t = parseHTTPDateTime("Sun, 06 Nov 1994 08:49:37 GMT");
+  ASSERT_TRUE(t.hasValue());
+  EXPECT_EQ(784111777, t.value());
+  EXPECT_EQ(0, parseHTTPDateTime("Thu, 01 Jan 1970 00:00:00 GMT").value());
+  EXPECT_EQ(t.value(),
+            parseHTTPDateTime("Sunday, 06-Nov-94 08:49:37 GMT").value());
+  EXPECT_FALSE(parseHTTPDateTime("Sun, 29 Feb 1994 08:49:37 GMT").hasValue());
+  EXPECT_FALSE(parseHTTPDateTime("Sun, 06 Nov 1994 24:49:37 GMT").hasValue());
+}
+
+TEST(HTTPTimeTests, FormatRoundTripTest) {
+  EXPECT_EQ("Thu, 01 Jan 1970 00:00:00 GMT", formatHTTPDateTime(0));
+  EXPECT_EQ("Wed, 31 Dec 1969 23:59:59 GMT", formatHTTPDateTime(-1));
+  EXPECT_EQ("Tue, 29 Feb 2000 12:00:00 GMT", formatHTTPDateTime(951825600));
+  for (time_t t = -5000000000; t < 5000000000; t += 86399 * 37) {
+    auto s = formatHTTPDateTime(t);
+    EXPECT_EQ(proxygen::kHTTPDateTimeLength, s.size());
+    auto parsed = parseHTTPDateTime(s);
+    ASSERT_TRUE(parsed.hasValue()) << s;
+    EXPECT_EQ(t, parsed.value()) << s;
+  }
+}
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/HeavyHitters.h>
+
+using namespace proxygen;
+
+TEST(HeavyHittersTest, FindsTheHeavyKeys) {
+  HeavyHitters hitters(1024, 4, 8);
+  // a long tail of keys seen once or twice, and 3 heavy ones in between
+  for (int i = 0; i < 10000; i++) {
+    hitters.add(folly::to<std::string>("/tail/", i % 5000));
+    if (i % 10 == 0) {
+      hitters.add("/a");
+    }
+    if (i % 20 == 0) {
+      hitters.add("/b", 2);
+    }
+    if (i % 50 == 0) {
+      hitters.add("/c");
+    }
+  }
+  EXPECT_EQ(10000 + 1000 + 1000 + 200, hitters.getTotal());
+  auto top = hitters.getTop();
+  ASSERT_GE(top.size(), 3);
+  EXPECT_LE(top.size(), 8);
+  EXPECT_EQ("/a", top[0].key);
+  EXPECT_EQ("/b", top[1].key);
+  EXPECT_EQ("/c", top[2].key);
+  // never below the true count
+  EXPECT_GE(top[0].count, 1000);
+  EXPECT_GE(top[2].count, 200);
+  EXPECT_LT(top[2].count, 300);
+  EXPECT_GE(hitters.estimate("/tail/7"), 2);
+  EXPECT_EQ(0, HeavyHitters(1024, 4, 8).estimate("/a"));
+}
+
+TEST(HeavyHittersTest, Merge) {
+  HeavyHitters first(256, 4, 4);
+  HeavyHitters second(256, 4, 4);
+  // each part has a local favourite, and "shared" is the top of the sum
+  for (int i = 0; i < 100; i++) {
+    first.add("first");
+    second.add("second");
+    first.add("shared");
+    second.add("shared");
+  }
+  first.merge(second);
+  EXPECT_EQ(400, first.getTotal());
+  auto top = first.getTop();
+  ASSERT_EQ(3, top.size());
+  EXPECT_EQ("shared", top[0].key);
+  EXPECT_EQ(200, top[0].count);
+  EXPECT_EQ(100, top[1].count);
+  EXPECT_EQ(100, top[2].count);
+}
+
+TEST(HeavyHittersTest, Evicts) {
+  HeavyHitters hitters(256, 4, 2);
+  hitters.add("old", 5);
+  hitters.add("older", 3);
+  hitters.add("new", 10);
+  auto top = hitters.getTop();
+  ASSERT_EQ(2, top.size());
+  EXPECT_EQ("new", top[0].key);
+  EXPECT_EQ("old", top[1].key);
+  // not enough to get in
+  hitters.add("tail", 1);
+  EXPECT_EQ("old", hitters.getTop()[1].key);
+}
+
+TEST(HeavyHittersTest, Decay) {
+  HeavyHitters hitters(256, 4, 4);
+  hitters.add("past", 100);
+  hitters.decay();
+  hitters.decay();
+  EXPECT_EQ(25, hitters.estimate("past"));
+  EXPECT_EQ(25, hitters.getTotal());
+  hitters.add("present", 30);
+  EXPECT_EQ("present", hitters.getTop()[0].key);
+  hitters.clear();
+  EXPECT_TRUE(hitters.getTop().empty());
+  EXPECT_EQ(0, hitters.estimate("present"));
+}
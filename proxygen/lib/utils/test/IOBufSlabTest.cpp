@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstddef>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/IOBufSlab.h>
+#include <thread>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+using proxygen::IOBufSlab;
+
+TEST(IOBufSlabTest, Reuse) {
+  IOBufSlab slab;
+  auto buf = slab.create(3000);
+  EXPECT_EQ(4096, buf->capacity());
+  EXPECT_EQ(IOBufSlab::kSlabSize, slab.getSlabBytes());
+  const uint8_t* data = buf->data();
+
+  // the rest of the slab serves the same size class
+  auto other = slab.create(4000);
+  EXPECT_EQ(data + 4096, other->data());
+  buf.reset();
+  buf = slab.create(2049);
+  EXPECT_EQ(data, buf->data());
+  EXPECT_EQ(0, buf->length());
+
+  // another class takes another slab
+  auto small = slab.create(300);
+  EXPECT_EQ(512, small->capacity());
+  EXPECT_EQ(2 * IOBufSlab::kSlabSize, slab.getSlabBytes());
+}
+
+TEST(IOBufSlabTest, OutsideTheClasses) {
+  IOBufSlab slab;
+  auto tiny = slab.create(10);
+  EXPECT_GE(tiny->tailroom(), 10);
+  auto large = slab.create(IOBufSlab::kMaxBlockSize + 1);
+  EXPECT_GE(large->tailroom(), IOBufSlab::kMaxBlockSize + 1);
+  EXPECT_EQ(0, slab.getSlabBytes());
+
+  EXPECT_EQ(nullptr, slab.maybeCopyBuffer(""));
+  auto copy = slab.maybeCopyBuffer(std::string(1000, 'x'));
+  EXPECT_EQ(1000, copy->length());
+  EXPECT_EQ(1024, copy->capacity());
+  EXPECT_EQ('x', copy->data()[999]);
+}
+
+TEST(IOBufSlabTest, RemoteFree) {
+  IOBufSlab slab;
+  auto buf = slab.create(1024);
+  const uint8_t* data = buf->data();
+  std::thread([&] { buf.reset(); }).join();
+  EXPECT_EQ(1, slab.getRemoteFrees());
+
+  // which the next miss takes back
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  bool found = false;
+  for (size_t i = 0; i < IOBufSlab::kSlabSize / 1024; i++) {
+    bufs.push_back(slab.create(1024));
+    found = found || bufs.back()->data() == data;
+  }
+  EXPECT_TRUE(found);
+  EXPECT_EQ(IOBufSlab::kSlabSize, slab.getSlabBytes());
+}
+
+TEST(IOBufSlabTest, OutlivesSlab) {
+  std::unique_ptr<IOBuf> local;
+  std::unique_ptr<IOBuf> remote;
+  {
+    IOBufSlab slab;
+    local = slab.create(256);
+    remote = slab.create(256);
+  }
+  memset(local->writableData(), 0, local->capacity());
+  local.reset();
+  std::thread([&] { remote.reset(); }).join();
+}
+
+TEST(IOBufSlabTest, ReserveTailroom) {
+  IOBufSlab slab;
+  IOBufQueue queue;
+  slab.reserveTailroom(queue, 100, 2048);
+  EXPECT_EQ(2048, queue.front()->tailroom());
+  queue.append("hello", 5);
+  EXPECT_EQ(1, queue.front()->countChainElements());
+
+  // enough left
+  slab.reserveTailroom(queue, 100, 2048);
+  EXPECT_EQ(1, queue.front()->countChainElements());
+  slab.reserveTailroom(queue, 4000, 2048);
+  EXPECT_EQ(2, queue.front()->countChainElements());
+  EXPECT_EQ(4096, queue.front()->prev()->tailroom());
+}
+
+TEST(IOBufSlabTest, Allocate) {
+  IOBufSlab slab;
+  void* obj = slab.allocate(1000);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(obj) % alignof(std::max_align_t));
+  memset(obj, 0, 1000);
+  EXPECT_EQ(1024, slab.getUsedBytes());
+  void* large = slab.allocate(IOBufSlab::kMaxBlockSize);
+  EXPECT_EQ(1024, slab.getUsedBytes());
+
+  std::thread([&] { IOBufSlab::deallocate(obj); }).join();
+  EXPECT_EQ(0, slab.getUsedBytes());
+  EXPECT_EQ(1, slab.getRemoteFrees());
+  IOBufSlab::deallocate(large);
+  IOBufSlab::deallocate(nullptr);
+}
+
+TEST(IOBufSlabTest, HugePages) {
+  IOBufSlab::setUseHugePages(true);
+  IOBufSlab slab;
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  // more than a region holds
+  for (size_t i = 0; i <= IOBufSlab::kRegionSize / IOBufSlab::kSlabSize;
+       i++) {
+    bufs.push_back(slab.create(IOBufSlab::kMaxBlockSize));
+    memset(bufs.back()->writableData(), 0, bufs.back()->capacity());
+  }
+  IOBufSlab::setUseHugePages(false);
+
+  EXPECT_EQ(bufs.size() * IOBufSlab::kSlabSize, slab.getSlabBytes());
+  EXPECT_EQ(bufs.size() * IOBufSlab::kMaxBlockSize, slab.getUsedBytes());
+  EXPECT_EQ(2 * IOBufSlab::kRegionSize, slab.getRegionBytes());
+  EXPECT_LE(slab.getNumHugetlbRegions(), 2);
+  // regions are aligned, for the huge pages
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(bufs.front()->data()) %
+            IOBufSlab::kRegionSize);
+}
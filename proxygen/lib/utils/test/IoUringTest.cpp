@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <memory>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/IoUring.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace proxygen;
+
+class IoUringTest : public testing::Test {
+ public:
+  void SetUp() override {
+    if (!IoUring::isSupported()) {
+      return;
+    }
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds_));
+    ring_.reset(new IoUring(8, 4, 4, 16));
+    slot_ = ring_->addFile(fds_[0]);
+    ASSERT_GE(slot_, 0);
+  }
+
+  void TearDown() override {
+    if (ring_) {
+      ring_.reset();
+      close(fds_[0]);
+      close(fds_[1]);
+    }
+  }
+
+  std::vector<IoUring::Completion> wait(size_t count) {
+    std::vector<IoUring::Completion> completions;
+    for (int i = 0; i < 1000 && completions.size() < count; i++) {
+      ring_->submit();
+      ring_->reap([&] (const IoUring::Completion& completion) {
+          completions.push_back(completion);
+        });
+      if (completions.size() < count) {
+        usleep(1000);
+      }
+    }
+    return completions;
+  }
+
+ protected:
+  int fds_[2];
+  std::unique_ptr<IoUring> ring_;
+  int slot_{-1};
+};
+
+TEST_F(IoUringTest, MultishotRecv) {
+  if (!ring_) {
+    return;
+  }
+  ring_->prepareRecvMultishot(slot_, 1);
+  EXPECT_EQ(1, ring_->getNumPrepared());
+  ring_->submit();
+  EXPECT_EQ(0, ring_->getNumPrepared());
+
+  std::string received;
+  for (int i = 0; i < 3; i++) {
+    // more than a buffer, so each write takes a couple of them
+    std::string data(20, 'a' + i);
+    ASSERT_EQ(data.size(), write(fds_[1], data.data(), data.size()));
+    while (received.size() < data.size() * (i + 1)) {
+      auto completions = wait(1);
+      ASSERT_FALSE(completions.empty());
+      for (auto& completion: completions) {
+        EXPECT_EQ(1, completion.userData);
+        ASSERT_GT(completion.result, 0);
+        EXPECT_TRUE(completion.hasMore());
+        ASSERT_TRUE(completion.hasBuffer());
+        uint16_t id = completion.getBufferId();
+        received.append((const char*)ring_->getBuffer(id), completion.result);
+        ring_->recycleBuffer(id);
+      }
+    }
+  }
+  EXPECT_EQ(std::string(20, 'a') + std::string(20, 'b') +
+            std::string(20, 'c'), received);
+
+  ring_->prepareCancel(1);
+  auto completions = wait(2);
+  ASSERT_EQ(2, completions.size());
+  for (auto& completion: completions) {
+    if (completion.userData == 1) {
+      EXPECT_EQ(-ECANCELED, completion.result);
+      EXPECT_FALSE(completion.hasMore());
+    } else {
+      EXPECT_EQ(0, completion.userData);
+      EXPECT_EQ(0, completion.result);
+    }
+  }
+}
+
+TEST_F(IoUringTest, Sendmsg) {
+  if (!ring_) {
+    return;
+  }
+  char first[] = "hello ";
+  char second[] = "world";
+  iovec iov[2];
+  iov[0].iov_base = first;
+  iov[0].iov_len = strlen(first);
+  iov[1].iov_base = second;
+  iov[1].iov_len = strlen(second);
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  ring_->prepareSendmsg(slot_, &msg, MSG_NOSIGNAL, 7);
+
+  auto completions = wait(1);
+  ASSERT_EQ(1, completions.size());
+  EXPECT_EQ(7, completions[0].userData);
+  EXPECT_EQ(11, completions[0].result);
+
+  char buf[16];
+  ASSERT_EQ(11, read(fds_[1], buf, sizeof(buf)));
+  EXPECT_EQ("hello world", std::string(buf, 11));
+}
+
+TEST_F(IoUringTest, FileTable) {
+  if (!ring_) {
+    return;
+  }
+  std::vector<int> slots;
+  int slot;
+  while ((slot = ring_->addFile(fds_[1])) >= 0) {
+    slots.push_back(slot);
+  }
+  // one slot was taken in SetUp()
+  EXPECT_EQ(3, slots.size());
+  ring_->removeFile(slots[0]);
+  EXPECT_EQ(slots[0], ring_->addFile(fds_[1]));
+}
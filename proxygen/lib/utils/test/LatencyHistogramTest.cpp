@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/LatencyHistogram.h>
+
+using namespace proxygen;
+
+TEST(LatencyHistogramTest, Buckets) {
+  for (uint64_t v = 0; v < 16; v++) {
+    EXPECT_EQ(v, LatencyHistogram::getBucket(v));
+  }
+  // every bucket starts where the previous one ends, and is at most 1/16th
+  // of its values wide
+  for (size_t b = 1; b < LatencyHistogram::kNumBuckets; b++) {
+    uint64_t min = LatencyHistogram::getBucketMin(b);
+    EXPECT_EQ(min, LatencyHistogram::getBucketMax(b - 1) + 1);
+    EXPECT_EQ(b, LatencyHistogram::getBucket(min));
+    uint64_t max = LatencyHistogram::getBucketMax(b);
+    EXPECT_EQ(b, LatencyHistogram::getBucket(max));
+    EXPECT_LE(max - min, min / 16);
+  }
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::getBucket(UINT64_MAX));
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.getPercentile(50));
+  for (uint64_t v = 1; v <= 1000; v++) {
+    histogram.addValue(v * 1000);
+  }
+  EXPECT_EQ(1000, histogram.getCount());
+  EXPECT_EQ(500500, histogram.getMean());
+  auto p50 = histogram.getPercentile(50);
+  EXPECT_GE(p50, 500000);
+  EXPECT_LE(p50, 500000 * 17 / 16);
+  auto p99 = histogram.getPercentile(99);
+  EXPECT_GE(p99, 990000);
+  EXPECT_LE(p99, 990000 * 17 / 16);
+  EXPECT_GE(histogram.getPercentile(100), 1000000);
+
+  LatencyHistogram other;
+  other.addValue(3);
+  other.merge(histogram);
+  EXPECT_EQ(1001, other.getCount());
+  EXPECT_EQ(3, other.getPercentile(0));
+}
+
+TEST(LatencyHistogramTest, CorrectedValues) {
+  LatencyHistogram histogram;
+  histogram.addCorrectedValue(5, 10);
+  histogram.addCorrectedValue(10, 0);
+  EXPECT_EQ(2, histogram.getCount());
+
+  // a 100 stall with requests meant for every 10 hid 9 more requests,
+  // waiting 90, 80... 10
+  histogram.addCorrectedValue(100, 10);
+  EXPECT_EQ(12, histogram.getCount());
+  EXPECT_EQ((5 + 10 + 100 + 450) / 12, histogram.getMean());
+  EXPECT_EQ(1, histogram.getBucketCount(LatencyHistogram::getBucket(90)));
+  EXPECT_EQ(2, histogram.getBucketCount(LatencyHistogram::getBucket(10)));
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/LoopClock.h>
+#include <proxygen/lib/utils/TscClock.h>
+#include <thread>
+
+using namespace folly;
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+TEST(LoopClockTest, CachedWithinIteration) {
+  EventBase eventBase;
+  LoopClock clock(&eventBase);
+  EXPECT_EQ(LoopClock::get(), &clock);
+  TimePoint first;
+  TimePoint second;
+  eventBase.runInLoop([&] {
+    first = getLoopTime();
+    std::this_thread::sleep_for(milliseconds(5));
+    second = getLoopTime();
+  });
+  eventBase.loop();
+  EXPECT_EQ(first, second);
+}
+
+TEST(LoopClockTest, RefreshedNextIteration) {
+  EventBase eventBase;
+  LoopClock clock(&eventBase);
+  TimePoint first;
+  TimePoint second;
+  eventBase.runInLoop([&] {
+    first = getLoopTime();
+    std::this_thread::sleep_for(milliseconds(5));
+    eventBase.runInLoop([&] {
+      second = getLoopTime();
+    });
+  });
+  eventBase.loop();
+  EXPECT_GE(second - first, milliseconds(5));
+}
+
+TEST(LoopClockTest, NoClock) {
+  EXPECT_EQ(LoopClock::get(), nullptr);
+  auto before = getCurrentTime();
+  auto now = getLoopTime();
+  EXPECT_GE(now, before);
+  EXPECT_LE(now, getCurrentTime());
+  {
+    EventBase eventBase;
+    LoopClock clock(&eventBase);
+  }
+  EXPECT_EQ(LoopClock::get(), nullptr);
+}
+
+TEST(TscClockTest, Monotonic) {
+  auto previous = TscClock::now();
+  for (int i = 0; i < 1000; ++i) {
+    auto now = TscClock::now();
+    EXPECT_GE(now, previous);
+    previous = now;
+  }
+}
+
+TEST(TscClockTest, CloseToSteadyClock) {
+  auto start = getPreciseTime();
+  auto steadyStart = getCurrentTime();
+  std::this_thread::sleep_for(milliseconds(50));
+  auto elapsed = millisecondsBetween(getPreciseTime(), start);
+  auto steadyElapsed = millisecondsBetween(getCurrentTime(), steadyStart);
+  EXPECT_NEAR(elapsed.count(), steadyElapsed.count(), 2);
+}
@@ -0,0 +1,31 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/LoopLagMonitor.h>
+
+using namespace proxygen;
+using std::chrono::milliseconds;
+
+TEST(LoopLagMonitorTest, FollowAndDecay) {
+  folly::EventBase evb;
+  LoopLagMonitor monitor(&evb);
+  TimePoint deadline = getCurrentTime();
+  monitor.onSample(deadline, deadline - milliseconds(5));
+  EXPECT_EQ(monitor.getLag(), milliseconds(0));
+  monitor.onSample(deadline, deadline + milliseconds(400));
+  EXPECT_EQ(monitor.getLag(), milliseconds(400));
+  monitor.onSample(deadline, deadline);
+  EXPECT_EQ(monitor.getLag(), milliseconds(300));
+  monitor.onSample(deadline, deadline + milliseconds(20));
+  EXPECT_EQ(monitor.getLag(), milliseconds(225));
+  monitor.stop();
+  EXPECT_EQ(monitor.getLag(), milliseconds(0));
+}
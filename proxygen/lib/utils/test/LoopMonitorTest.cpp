@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/LoopMonitor.h>
+
+using namespace proxygen;
+using std::chrono::microseconds;
+
+TEST(LoopMonitorTest, Samples) {
+  LoopMonitor monitor;
+  monitor.onSample(300, 700, 4);
+  monitor.onSample(100, 900, 10);
+  monitor.onSample(-5, 1000, 2);
+  auto snapshot = monitor.getSnapshot();
+  EXPECT_EQ(snapshot.iterations, 3);
+  EXPECT_EQ(snapshot.iterationTime.getCount(), 3);
+  EXPECT_EQ(LatencyHistogram::getBucket(
+              snapshot.busyTime.getPercentile(100)),
+            LatencyHistogram::getBucket(300));
+  EXPECT_EQ(snapshot.totalBusy, microseconds(400));
+  EXPECT_EQ(snapshot.totalIdle, microseconds(2600));
+  EXPECT_EQ(snapshot.getBusyPercent(), 13);
+  EXPECT_EQ(snapshot.queueDepth, 2);
+  EXPECT_EQ(snapshot.maxQueueDepth, 10);
+}
+
+TEST(LoopMonitorTest, SlowestCallback) {
+  LoopMonitor monitor;
+  EXPECT_EQ(monitor.getSnapshot().getBusyPercent(), 0);
+  monitor.onCallback("a", microseconds(50));
+  monitor.onCallback("b", microseconds(80));
+  monitor.onCallback("c", microseconds(60));
+  auto snapshot = monitor.getSnapshot();
+  EXPECT_EQ(snapshot.slowestCallback, microseconds(80));
+  EXPECT_EQ(snapshot.slowestSource, "b");
+}
+
+TEST(LoopMonitorTest, ScopeWithoutMonitor) {
+  // the thread has no started monitor, nothing to record to
+  LoopMonitor::CallbackScope scope("LoopMonitorTest");
+}
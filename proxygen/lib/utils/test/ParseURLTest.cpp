@@ -109,6 +109,7 @@ TEST(ParseURL, QueryIsURL) {
 TEST(ParseURL, InvalidURL) {
   testParseURL("http://tel:198433511/", "", "", "", 0, "", false);
   testParseURL("localhost:80/foo#bar?qqq", "", "", "", 0, "", false);
+  testParseURL("/foo#bar?qqq", "", "", "", 0, "", false);
   testParseURL("#?", "", "", "", 0, "", false);
   testParseURL("#?hello", "", "", "", 0, "", false);
   testParseURL("[::1/foo?bar", "", "", "", 0, "", false);
@@ -134,3 +135,34 @@ TEST(ParseURL, IsHostIPAddress) {
   testHostIsIpAddress("", false);
   testHostIsIpAddress("127.0.0.1:80/foo#bar?qqq", false);
 }
+
+TEST(ParseURL, OriginForm) {
+  ParseURL u("/f/o/o?bar=1#frag?x");
+  EXPECT_TRUE(u.valid());
+  EXPECT_EQ("/f/o/o", u.path());
+  EXPECT_EQ("bar=1", u.query());
+  EXPECT_EQ("frag?x", u.fragment());
+  EXPECT_FALSE(u.hasHost());
+
+  ParseURL v("/foo#frag");
+  EXPECT_TRUE(v.valid());
+  EXPECT_EQ("/foo", v.path());
+  EXPECT_EQ("", v.query());
+  EXPECT_EQ("frag", v.fragment());
+}
+
+TEST(ParseURL, ComponentsAreViews) {
+  string url("http://localhost:8080/foo?bar#qqq");
+  ParseURL u(url);
+
+  auto inUrl = [&] (folly::StringPiece piece) {
+    return piece.begin() >= url.data() &&
+      piece.end() <= url.data() + url.size();
+  };
+  EXPECT_EQ("localhost:8080", u.authority());
+  EXPECT_TRUE(inUrl(u.authority()));
+  EXPECT_TRUE(inUrl(u.host()));
+  EXPECT_TRUE(inUrl(u.path()));
+  EXPECT_TRUE(inUrl(u.query()));
+  EXPECT_TRUE(inUrl(u.fragment()));
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/ReadBufferPool.h>
+#include <proxygen/lib/utils/ReadSizeEstimator.h>
+
+using folly::IOBuf;
+using proxygen::ReadBufferPool;
+using proxygen::ReadSizeEstimator;
+
+TEST(ReadBufferPoolTest, Reuse) {
+  ReadBufferPool pool;
+  auto buf = pool.acquire(3000);
+  EXPECT_GE(buf->tailroom(), 3000);
+  EXPECT_EQ(1, pool.getMisses());
+  IOBuf* raw = buf.get();
+  buf->append(100);
+  pool.recycle(std::move(buf));
+  EXPECT_EQ(raw->capacity(), pool.getBytes());
+
+  // a smaller size doesn't get the larger buffer
+  auto small = pool.acquire(1000);
+  EXPECT_NE(raw, small.get());
+  EXPECT_EQ(2, pool.getMisses());
+
+  buf = pool.acquire(4000);
+  EXPECT_EQ(raw, buf.get());
+  EXPECT_EQ(0, buf->length());
+  EXPECT_EQ(1, pool.getHits());
+  EXPECT_EQ(0, pool.getBytes());
+
+  // sizes above the largest one get the largest one
+  auto large = pool.acquire(1000000);
+  EXPECT_GE(large->tailroom(), ReadBufferPool::kMaxBufferSize);
+}
+
+TEST(ReadBufferPoolTest, Recycle) {
+  ReadBufferPool pool;
+  auto chain = pool.acquire(2048);
+  chain->appendChain(pool.acquire(2048));
+  auto shared = pool.acquire(2048);
+  auto clone = shared->cloneOne();
+  chain->appendChain(std::move(shared));
+
+  // the buffer that is still referenced by clone is freed
+  pool.recycle(std::move(chain));
+  EXPECT_EQ(2 * clone->capacity(), pool.getBytes());
+
+  pool.setMaxBytes(clone->capacity());
+  EXPECT_EQ(clone->capacity(), pool.getBytes());
+  pool.recycle(pool.acquire(2048));
+  pool.recycle(pool.acquire(65536));
+  EXPECT_EQ(clone->capacity(), pool.getBytes());
+}
+
+TEST(ReadBufferPoolTest, Reserve) {
+  ReadBufferPool pool;
+  pool.reserve(4096, 3);
+  EXPECT_LE(3 * 4096, pool.getBytes());
+  size_t reserved = pool.getBytes();
+  pool.reserve(4096, 3);
+  EXPECT_EQ(reserved, pool.getBytes());
+
+  for (int i = 0; i < 3; i++) {
+    auto buf = pool.acquire(3000);
+    EXPECT_GE(buf->tailroom(), 4096);
+  }
+  EXPECT_EQ(3, pool.getHits());
+  EXPECT_EQ(0, pool.getMisses());
+  EXPECT_EQ(0, pool.getBytes());
+
+  // never more than the pool may keep
+  pool.setMaxBytes(0);
+  pool.reserve(2048, 10);
+  EXPECT_EQ(0, pool.getBytes());
+}
+
+TEST(ReadSizeEstimatorTest, GrowAndShrink) {
+  ReadSizeEstimator estimator(2048, 4096, 16384);
+  EXPECT_EQ(4096, estimator.getSize());
+
+  // full reads double the size, up to the max
+  estimator.onRead(4096);
+  EXPECT_EQ(8192, estimator.getSize());
+  estimator.onRead(8192);
+  estimator.onRead(16384);
+  EXPECT_EQ(16384, estimator.getSize());
+
+  // it takes a few small reads in a row to shrink
+  estimator.onRead(100);
+  estimator.onRead(100);
+  estimator.onRead(10000);
+  estimator.onRead(100);
+  estimator.onRead(100);
+  EXPECT_EQ(16384, estimator.getSize());
+  estimator.onRead(100);
+  EXPECT_EQ(8192, estimator.getSize());
+  for (int i = 0; i < 10; i++) {
+    estimator.onRead(100);
+  }
+  EXPECT_EQ(2048, estimator.getSize());
+}
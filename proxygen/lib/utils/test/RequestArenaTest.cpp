@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <deque>
+#include <gtest/gtest.h>
+#include <list>
+#include <proxygen/lib/utils/RequestArena.h>
+#include <string>
+
+using proxygen::RequestArena;
+
+TEST(RequestArenaTest, Inline) {
+  RequestArena arena;
+  char* first = static_cast<char*>(arena.allocate(10));
+  char* second = static_cast<char*>(arena.allocate(20));
+  EXPECT_EQ(first + 16, second);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(second) % 16);
+  EXPECT_EQ(0, arena.getBlockBytes());
+
+  // past the inline bytes
+  memset(arena.allocate(RequestArena::kInlineSize), 0,
+         RequestArena::kInlineSize);
+  EXPECT_EQ(RequestArena::kBlockSize, arena.getBlockBytes());
+
+  // a block of its own
+  memset(arena.allocate(2 * RequestArena::kBlockSize), 0,
+         2 * RequestArena::kBlockSize);
+  EXPECT_LT(3 * RequestArena::kBlockSize, arena.getBlockBytes());
+  void* next = arena.allocate(100);
+  memset(next, 0, 100);
+
+  arena.reset();
+  EXPECT_EQ(0, arena.getBlockBytes());
+  EXPECT_EQ(first, arena.allocate(10));
+}
+
+TEST(RequestArenaTest, Recycle) {
+  RequestArena arena;
+  void* ptr = arena.allocate(40);
+  arena.deallocate(ptr, 40);
+  // the same size class
+  EXPECT_EQ(ptr, arena.allocate(64));
+  void* other = arena.allocate(40);
+  EXPECT_NE(ptr, other);
+
+  // the large ones are only freed with the arena
+  void* large = arena.allocate(RequestArena::kMaxRecycledSize + 1);
+  arena.deallocate(large, RequestArena::kMaxRecycledSize + 1);
+  EXPECT_NE(large, arena.allocate(RequestArena::kMaxRecycledSize + 1));
+}
+
+TEST(RequestArenaTest, Containers) {
+  RequestArena arena;
+  std::list<int, RequestArena::Allocator<int>> list(
+    (RequestArena::Allocator<int>(&arena)));
+  // a queue that stays short doesn't grow the arena
+  for (int i = 0; i < 10000; i++) {
+    list.push_back(i);
+    list.pop_front();
+  }
+  EXPECT_EQ(0, arena.getBlockBytes());
+
+  std::deque<std::string, RequestArena::Allocator<std::string>> deque(
+    (RequestArena::Allocator<std::string>(&arena)));
+  for (int i = 0; i < 1000; i++) {
+    deque.emplace_back(100, 'x');
+  }
+  EXPECT_LT(0, arena.getBlockBytes());
+  size_t bytes = arena.getBlockBytes();
+  for (int i = 0; i < 100000; i++) {
+    deque.emplace_back(100, 'y');
+    deque.pop_front();
+  }
+  EXPECT_EQ(bytes, arena.getBlockBytes());
+  EXPECT_EQ('y', deque.front()[0]);
+}
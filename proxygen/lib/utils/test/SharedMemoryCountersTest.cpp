@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <atomic>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/SharedMemoryCounters.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace proxygen;
+
+namespace {
+
+std::string getSegmentName(const std::string& test) {
+  return "/proxygen_" + test + "_" + std::to_string(::getpid());
+}
+
+}
+
+TEST(SharedMemoryCountersTest, Publish) {
+  auto name = getSegmentName("publish");
+  SharedMemoryCounterWriter writer(name, 2);
+  SharedMemoryCounterReader reader(name);
+  std::map<std::string, int64_t> counters;
+  reader.read(counters);
+  EXPECT_TRUE(counters.empty());
+
+  EXPECT_EQ(0, writer.publish({{"http.requests", 10}, {"http.errors", -1}}));
+  auto seq = reader.read(counters);
+  EXPECT_EQ(2, counters.size());
+  EXPECT_EQ(10, counters["http.requests"]);
+  EXPECT_EQ(-1, counters["http.errors"]);
+  EXPECT_GT(reader.getPublishedMs(), 0);
+
+  // one past the capacity, and one name too long
+  std::string longName(SharedMemoryCounters::kNameSize, 'x');
+  EXPECT_EQ(2, writer.publish({{"a", 1}, {"b", 2}, {"c", 3}, {longName, 4}}));
+  EXPECT_NE(seq, reader.read(counters));
+  EXPECT_EQ(2, counters.size());
+  EXPECT_EQ(1, counters["a"]);
+  EXPECT_EQ(2, counters["b"]);
+}
+
+TEST(SharedMemoryCountersTest, NoSegment) {
+  EXPECT_THROW(SharedMemoryCounterReader(getSegmentName("none")),
+               std::system_error);
+}
+
+TEST(SharedMemoryCountersTest, ConsistentTables) {
+  auto name = getSegmentName("consistent");
+  SharedMemoryCounterWriter writer(name, 64);
+  std::atomic<bool> done{false};
+  // every table has all its counters equal
+  std::thread publisher([&] {
+      std::map<std::string, int64_t> counters;
+      for (int64_t i = 0; i < 20000; i++) {
+        for (int j = 0; j < 64; j++) {
+          counters["counter." + std::to_string(j)] = i;
+        }
+        writer.publish(counters);
+      }
+      done = true;
+    });
+  SharedMemoryCounterReader reader(name);
+  std::map<std::string, int64_t> counters;
+  uint64_t reads = 0;
+  while (!done) {
+    reader.read(counters);
+    if (counters.empty()) {
+      continue;
+    }
+    ASSERT_EQ(64, counters.size());
+    auto value = counters.begin()->second;
+    for (const auto& counter: counters) {
+      ASSERT_EQ(value, counter.second);
+    }
+    reads++;
+  }
+  publisher.join();
+  reader.read(counters);
+  EXPECT_EQ(19999, counters["counter.0"]);
+  EXPECT_GT(reads, 0);
+}
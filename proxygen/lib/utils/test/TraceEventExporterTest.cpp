@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <proxygen/lib/utils/TraceEventExporter.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace proxygen;
+
+namespace {
+
+std::string makeTempPath() {
+  char path[] = "/tmp/TraceEventExporterTestXXXXXX";
+  int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  close(fd);
+  return path;
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+T get(const char*& p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  p += sizeof(value);
+  return value;
+}
+
+}
+
+TEST(TraceEventExporterTest, Encode) {
+  TraceEvent event(TraceEventType::DnsResolution, 42);
+  event.start(getCurrentTime());
+  event.addMeta(TraceFieldType::HostName, "example.com");
+  event.addMeta(TraceFieldType::NumberAnswers, 3);
+  event.addMeta(TraceFieldType::Ipv6Succeeded, true);
+
+  std::string buf(TraceEventExporter::encodedSize(event), '\0');
+  EXPECT_EQ(buf.size(), TraceEventExporter::encode(event, &buf[0]));
+
+  const char* p = buf.data();
+  EXPECT_EQ(buf.size() - 4, get<uint32_t>(p));
+  EXPECT_EQ(static_cast<uint16_t>(TraceEventType::DnsResolution),
+            get<uint16_t>(p));
+  EXPECT_EQ(1, get<uint8_t>(p));
+  EXPECT_EQ(event.getID(), get<uint32_t>(p));
+  EXPECT_EQ(42, get<uint32_t>(p));
+  EXPECT_LT(0, get<int64_t>(p));
+  EXPECT_EQ(0, get<int64_t>(p));
+  EXPECT_EQ(3, get<uint16_t>(p));
+
+  EXPECT_EQ(static_cast<uint16_t>(TraceFieldType::HostName),
+            get<uint16_t>(p));
+  EXPECT_EQ(static_cast<uint8_t>(TraceMetaData::Kind::STRING),
+            get<uint8_t>(p));
+  ASSERT_EQ(11, get<uint32_t>(p));
+  EXPECT_EQ("example.com", std::string(p, 11));
+  p += 11;
+  EXPECT_EQ(static_cast<uint16_t>(TraceFieldType::NumberAnswers),
+            get<uint16_t>(p));
+  EXPECT_EQ(static_cast<uint8_t>(TraceMetaData::Kind::INT), get<uint8_t>(p));
+  EXPECT_EQ(3, get<int64_t>(p));
+  EXPECT_EQ(static_cast<uint16_t>(TraceFieldType::Ipv6Succeeded),
+            get<uint16_t>(p));
+  EXPECT_EQ(static_cast<uint8_t>(TraceMetaData::Kind::BOOL), get<uint8_t>(p));
+  EXPECT_EQ(1, get<uint8_t>(p));
+  EXPECT_EQ(buf.data() + buf.size(), p);
+}
+
+TEST(TraceEventExporterTest, SamplesAndWrites) {
+  auto path = makeTempPath();
+  size_t recordSize = 0;
+  {
+    TraceEventExporter exporter(path, 2);
+    for (int i = 0; i < 10; i++) {
+      TraceEvent event(TraceEventType::ReadSocket);
+      event.addMeta(TraceFieldType::ReadBytes, i);
+      recordSize = TraceEventExporter::encodedSize(event);
+      exporter.traceEventAvailable(event);
+    }
+    exporter.flush();
+    EXPECT_EQ(5, exporter.getExported());
+    EXPECT_EQ(5, exporter.getSampledOut());
+    EXPECT_EQ(0, exporter.getDropped());
+  }
+
+  auto contents = readFile(path);
+  ASSERT_EQ(5 * recordSize, contents.size());
+  // the kept events are the first, third, ...
+  for (int i = 0; i < 5; i++) {
+    int64_t readBytes;
+    memcpy(&readBytes, contents.data() + (i + 1) * recordSize - 8, 8);
+    EXPECT_EQ(i * 2, readBytes);
+  }
+  unlink(path.c_str());
+}
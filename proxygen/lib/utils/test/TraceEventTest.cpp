@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/TraceEvent.h>
+
+using namespace proxygen;
+
+TEST(TraceEventTest, TypedMeta) {
+  TraceEvent event(TraceEventType::RequestExchange);
+  EXPECT_TRUE(event.addMeta(TraceFieldType::ReqHeaderSize, 120));
+  EXPECT_TRUE(event.addMeta(TraceFieldType::IsSecure, true));
+  EXPECT_TRUE(event.addMeta(TraceFieldType::Uri, "/index.html"));
+  EXPECT_TRUE(event.addMeta(TraceFieldType::HostName,
+                            std::string("example.com")));
+  EXPECT_EQ(4, event.getMetaData().size());
+
+  int64_t size = 0;
+  EXPECT_TRUE(event.readIntMeta(TraceFieldType::ReqHeaderSize, size));
+  EXPECT_EQ(120, size);
+  bool secure = false;
+  EXPECT_TRUE(event.readBoolMeta(TraceFieldType::IsSecure, secure));
+  EXPECT_TRUE(secure);
+  std::string uri;
+  EXPECT_TRUE(event.readStrMeta(TraceFieldType::Uri, uri));
+  EXPECT_EQ("/index.html", uri);
+  // strings can be read from any kind
+  std::string sizeStr;
+  EXPECT_TRUE(event.readStrMeta(TraceFieldType::ReqHeaderSize, sizeStr));
+  EXPECT_EQ("120", sizeStr);
+
+  EXPECT_FALSE(event.readStrMeta(TraceFieldType::Port, uri));
+  EXPECT_FALSE(event.readIntMeta(TraceFieldType::Port, size));
+  EXPECT_EQ(120, size);
+}
+
+TEST(TraceEventTest, ReplaceMeta) {
+  TraceEvent event(TraceEventType::RequestExchange);
+  EXPECT_TRUE(event.addMeta(TraceFieldType::Uri, "/a/long/path"));
+  EXPECT_FALSE(event.addMeta(TraceFieldType::Uri, "/short"));
+  EXPECT_FALSE(event.addMeta(TraceFieldType::Uri, "/a/even/longer/path"));
+  std::string uri;
+  EXPECT_TRUE(event.readStrMeta(TraceFieldType::Uri, uri));
+  EXPECT_EQ("/a/even/longer/path", uri);
+
+  // a value may change kind
+  EXPECT_FALSE(event.addMeta(TraceFieldType::Uri, 7));
+  int value = 0;
+  EXPECT_TRUE(event.readIntMeta(TraceFieldType::Uri, value));
+  EXPECT_EQ(7, value);
+  EXPECT_EQ(1, event.getMetaData().size());
+
+  event.increaseIntMeta(TraceFieldType::NumRetries, 2);
+  event.increaseIntMeta(TraceFieldType::NumRetries, 3);
+  EXPECT_TRUE(event.readIntMeta(TraceFieldType::NumRetries, value));
+  EXPECT_EQ(5, value);
+}
+
+TEST(TraceEventTest, ManyFieldsAndCopies) {
+  TraceMetaData meta;
+  TimePoint now = getCurrentTime();
+  meta.set(TraceFieldType::RedirectTime, now);
+  for (size_t i = 0; i < kTraceFieldTypeCount; ++i) {
+    auto key = static_cast<TraceFieldType>(i);
+    if (key != TraceFieldType::RedirectTime) {
+      meta.set(key, folly::to<std::string>("value", i));
+    }
+  }
+  EXPECT_EQ(kTraceFieldTypeCount, meta.size());
+
+  TraceMetaData copy(meta);
+  meta.clear();
+  EXPECT_TRUE(meta.empty());
+  folly::StringPiece value;
+  EXPECT_TRUE(copy.getString(TraceFieldType::Port, value));
+  EXPECT_EQ(folly::to<std::string>(
+              "value", static_cast<size_t>(TraceFieldType::Port)), value);
+  TimePoint redirect;
+  EXPECT_TRUE(copy.getTime(TraceFieldType::RedirectTime, redirect));
+  EXPECT_EQ(now, redirect);
+  int64_t notAnInt = 0;
+  EXPECT_FALSE(copy.getInt(TraceFieldType::RedirectTime, notAnInt));
+}
+
+TEST(TraceEventTest, MapRoundTrip) {
+  TraceEvent::MetaDataMap map;
+  map[TraceFieldType::StatusCode] = 200;
+  map[TraceFieldType::Protocol] = "h2";
+  map[TraceFieldType::ServerQuality] = 0.5;
+  TraceEvent event(TraceEventType::RequestExchange);
+  event.setMetaData(std::move(map));
+
+  auto out = event.getMetaData().toMap();
+  ASSERT_EQ(3, out.size());
+  EXPECT_EQ(200, out[TraceFieldType::StatusCode].asInt());
+  EXPECT_EQ("h2", out[TraceFieldType::Protocol].asString());
+  EXPECT_DOUBLE_EQ(0.5, out[TraceFieldType::ServerQuality].asDouble());
+}
@@ -19,3 +19,13 @@ TEST(UtilTest, CaseInsensitiveEqual) {
   ASSERT_FALSE(caseInsensitiveEqual("fo", "FOO"));
   ASSERT_FALSE(caseInsensitiveEqual("FO", "FOO"));
 }
+
+TEST(UtilTest, CaseInsensitiveEqualLong) {
+  ASSERT_TRUE(caseInsensitiveEqual("X-Forwarded-Proto", "x-forwarded-PROTO"));
+  ASSERT_FALSE(caseInsensitiveEqual("X-Forwarded-Proto", "X-Forwarded-Protp"));
+  // only ASCII letters fold: '@' and '`', '[' and '{' differ by 0x20 too
+  ASSERT_FALSE(caseInsensitiveEqual("AAAAAAA@", "aaaaaaa`"));
+  ASSERT_FALSE(caseInsensitiveEqual("[[[[[[[[", "{{{{{{{{"));
+  ASSERT_FALSE(caseInsensitiveEqual("\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1",
+                                    "\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1"));
+}
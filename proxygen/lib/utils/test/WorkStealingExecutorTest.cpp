@@ -0,0 +1,47 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <atomic>
+#include <chrono>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/WorkStealingExecutor.h>
+#include <thread>
+#include <vector>
+
+using namespace proxygen;
+
+TEST(WorkStealingExecutorTest, IdleThreadsSteal) {
+  const int kTasks = 16;
+  folly::EventBase busy;
+  folly::EventBase idle;
+  WorkStealingExecutor executor({&busy, &idle});
+  EXPECT_EQ(2, executor.getNumThreads());
+
+  std::atomic<int> ran{0};
+  int done = 0;
+  for (int i = 0; i < kTasks; i++) {
+    executor.add(&busy, [&] () -> WorkStealingExecutor::Callback {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ran++;
+        return [&] {
+          // stolen or not, the callback comes back to the busy EventBase
+          EXPECT_TRUE(busy.isInEventBaseThread());
+          if (++done == kTasks) {
+            busy.terminateLoopSoon();
+          }
+        };
+      });
+  }
+  busy.loopForever();
+  EXPECT_EQ(kTasks, ran);
+  EXPECT_EQ(kTasks, done);
+  EXPECT_EQ(0, executor.getNumPending());
+  EXPECT_LT(0, executor.getNumStolen());
+}
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <proxygen/lib/utils/ZlibStreamCompressor.h>
+#include <string>
+#include <zlib.h>
+
+using folly::IOBuf;
+using namespace proxygen;
+
+namespace {
+
+std::string inflateAll(const IOBuf& compressed, int windowBits) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  EXPECT_EQ(Z_OK, inflateInit2(&stream, windowBits));
+  std::string data;
+  const IOBuf* buf = &compressed;
+  int r = Z_OK;
+  do {
+    stream.next_in = const_cast<uint8_t*>(buf->data());
+    stream.avail_in = buf->length();
+    while (stream.avail_in > 0 && r == Z_OK) {
+      char out[256];
+      stream.next_out = reinterpret_cast<uint8_t*>(out);
+      stream.avail_out = sizeof(out);
+      r = inflate(&stream, Z_NO_FLUSH);
+      data.append(out, sizeof(out) - stream.avail_out);
+    }
+    buf = buf->next();
+  } while (buf != &compressed);
+  EXPECT_EQ(Z_STREAM_END, r);
+  inflateEnd(&stream);
+  return data;
+}
+
+}
+
+TEST(ZlibStreamCompressorTest, Streams) {
+  std::string text;
+  for (int i = 0; i < 1000; i++) {
+    text += "all work and no play makes jack a dull boy ";
+  }
+  for (auto type: {ZlibStreamCompressor::Type::GZIP,
+                   ZlibStreamCompressor::Type::DEFLATE,
+                   ZlibStreamCompressor::Type::RAW}) {
+    ZlibStreamCompressor compressor(type, 6);
+    // a chain in, with a flush in the middle
+    auto in = IOBuf::copyBuffer(text.substr(0, 100));
+    in->prependChain(IOBuf::copyBuffer(text.substr(100, 20000)));
+    auto out = compressor.compress(in.get(), Z_SYNC_FLUSH);
+    ASSERT_TRUE(out);
+    EXPECT_LT(0, out->computeChainDataLength());
+    in = IOBuf::copyBuffer(text.substr(20100));
+    out->prependChain(compressor.compress(in.get(), Z_NO_FLUSH));
+    out->prependChain(compressor.compress(nullptr, Z_FINISH));
+    EXPECT_FALSE(compressor.hasError());
+    EXPECT_GT(text.size() / 10, out->computeChainDataLength());
+    int windowBits = 15;
+    if (type == ZlibStreamCompressor::Type::GZIP) {
+      windowBits = 31;
+    } else if (type == ZlibStreamCompressor::Type::RAW) {
+      windowBits = -15;
+    }
+    EXPECT_EQ(text, inflateAll(*out, windowBits));
+  }
+}
+
+TEST(ZlibStreamCompressorTest, Pool) {
+  auto compressor = ZlibStreamCompressor::acquire(
+    ZlibStreamCompressor::Type::GZIP, 1);
+  auto in = IOBuf::copyBuffer("abandoned half way");
+  compressor->compress(in.get(), Z_NO_FLUSH);
+  ZlibStreamCompressor* first = compressor.get();
+  ZlibStreamCompressor::release(std::move(compressor));
+
+  // the next stream of that type reuses it, from the start
+  EXPECT_NE(first, ZlibStreamCompressor::acquire(
+              ZlibStreamCompressor::Type::DEFLATE, 1).get());
+  compressor = ZlibStreamCompressor::acquire(
+    ZlibStreamCompressor::Type::GZIP, 9);
+  EXPECT_EQ(first, compressor.get());
+  in = IOBuf::copyBuffer("hello");
+  auto out = compressor->compress(in.get(), Z_FINISH);
+  EXPECT_EQ("hello", inflateAll(*out, 31));
+}